@@ -69,8 +69,14 @@ class named_pipe_t
     // Increases the pipe's internal buffer to the maximum size.
     bool maximize_buffer();
 
+    // Makes subsequent reads return immediately when no data is available.
+    // This is meant to be called after a blocking open_for_read(), so that
+    // EOF is not confused with a writer that has not yet connected.
+    bool set_nonblocking();
+
     // Returns < 0 on EOF or an error.
     // On success (or partial read) returns number of bytes read.
+    // After set_nonblocking(), returns 0 if no data is available.
     ssize_t read(void *buf OUT, size_t sz);
 
     // Returns < 0 on an error.
@@ -138,6 +138,15 @@ named_pipe_t::close()
     return true;
 }
 
+bool
+named_pipe_t::set_nonblocking()
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1)
+        return false;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
 bool
 named_pipe_t::maximize_buffer()
 {
@@ -177,10 +186,11 @@ named_pipe_t::read(void *buf OUT, size_t sz)
             continue;
         break;
     }
-    // XXX: if we add nonblocking support we'll need to distinguish 0 (EOF)
-    // from no data (-1 w/ EAGAIN).
+    // For nonblocking support we distinguish 0 (EOF) from no data (-1 w/ EAGAIN).
     // Seems cleanest for a portable interface to swap them: 0 means no data
     // but pipe is still there, negative means EOF or something is wrong.
+    if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
     if (res == 0)
         return -1;
     return res;
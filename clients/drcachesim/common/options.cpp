@@ -42,14 +42,113 @@ droption_t<std::string> op_ipc_name
  "application processes and the caching device simulator.  A unique name must be chosen "
  "for each instance of the simulator being run at any one time.");
 
+droption_t<bool> op_thread_pipes
+(DROPTION_SCOPE_ALL, "thread_pipes", false, "Use a separate pipe per thread",
+ "By default, all application threads send their online trace data over a single "
+ "named pipe, which serializes them and leaves the interleaving of their buffers to "
+ "the pipe's arbitration.  If this option is enabled, each thread instead writes to "
+ "its own named pipe, with no size limit on each write, and the simulator merges "
+ "the per-thread streams by the timestamps the tracer places at the start of "
+ "each buffer.  This option is ignored with -shm or -offline.");
+
+droption_t<bool> op_shm
+(DROPTION_SCOPE_ALL, "shm", false, "Use shared memory instead of a pipe",
+ "By default, online trace data is sent to the simulator over a named pipe, which "
+ "costs a system call and a kernel copy per buffer and limits each write to the "
+ "atomic pipe write size.  If this option is enabled, the tracer instead fills "
+ "buffers that live in a shared memory ring, and the simulator reads them in place.  "
+ "The ring must have more slots (see -shm_slots) than the application has "
+ "simultaneously live threads, as each thread holds one slot at all times.");
+
+droption_t<unsigned int> op_shm_slots
+(DROPTION_SCOPE_ALL, "shm_slots", 128, "Number of shared memory buffers",
+ "For -shm, specifies the number of trace buffers in the shared memory ring.  "
+ "Each slot is 256KB.  If every slot is in use, application "
+ "threads wait for the simulator to release one.");
+
+droption_t<bool> op_async_reader
+(DROPTION_SCOPE_FRONTEND, "async_reader", true, "Read the trace on a separate thread",
+ "By default, the simulator reads and decodes the trace on a separate thread, "
+ "which fills large batches of references while the simulator works on the "
+ "previous batch, so that simulation does not wait on a pipe or file while data "
+ "is available.  Disabling this option reads the trace on the simulator's own "
+ "thread.  The results are the same either way.");
+
+droption_t<bool> op_offline
+(DROPTION_SCOPE_ALL, "offline", false, "Store trace files for offline simulation",
+ "By default, traces are processed online, sent over a pipe to a simulator.  "
+ "If this option is enabled, trace data is instead written to files in -outdir, "
+ "one file per application thread, for later simulation via -infile.  "
+ "No simulation is performed while the application runs.");
+
+droption_t<std::string> op_outdir
+(DROPTION_SCOPE_ALL, "outdir", ".", "Target directory for offline trace files",
+ "For the offline analysis mode (when -offline is requested), specifies the path "
+ "to a directory where per-thread trace files will be written.");
+
+droption_t<bool> op_compress
+(DROPTION_SCOPE_ALL, "compress", false, "Compress trace files and pipe data",
+ "For the offline analysis mode (when -offline is requested), stores each trace "
+ "file as a sequence of independently compressed chunks plus a chunk index.  "
+ "Compressed files are typically several times smaller, and the simulator can "
+ "skip over whole chunks when -skip_refs is used.  The simulator detects the "
+ "format automatically.  For online simulation over the default shared pipe, "
+ "sends each atomic write as a compressed chunk, which reduces the bytes through "
+ "the pipe at some cost in tracer time.  This option is ignored with -shm or "
+ "-thread_pipes.");
+
+droption_t<unsigned int> op_num_writers
+(DROPTION_SCOPE_CLIENT, "num_writers", 0, "Threads that write out offline traces",
+ "For the offline analysis mode (when -offline is requested), specifies how many "
+ "background threads the tracer creates to compress (with -compress) and write "
+ "out each full trace buffer.  An application thread then only swaps in an empty "
+ "buffer, of a few it owns, and goes on, unless its writer has fallen behind and "
+ "none is left.  Each application thread is assigned one writer, which keeps its "
+ "file in order.  A value of 0 writes each buffer from the application thread "
+ "that filled it.  This option is ignored without -offline.");
+
+droption_t<std::string> op_infile
+(DROPTION_SCOPE_FRONTEND, "infile", "", "Offline trace file or directory for input",
+ "Directs the simulator to use a trace recorded via -offline rather than a live "
+ "application.  The value is either a single trace file or the -outdir directory "
+ "holding one trace file per thread.  No application is launched.");
+
 droption_t<unsigned int> op_num_cores
 (DROPTION_SCOPE_FRONTEND, "cores", 4, "Number of cores",
  "Specifies the number of cores to simulate.");
 
+droption_t<unsigned int> op_sched_quantum
+(DROPTION_SCOPE_FRONTEND, "sched_quantum", 0, "Scheduling quantum in memrefs",
+ "By default each thread stays on the core it was first assigned to.  A non-zero "
+ "value instead models an operating system scheduler: a thread holds its core for a "
+ "quantum of roughly this many of its own memrefs, after which a waiting thread may "
+ "take the core.  A thread that cannot resume on its previous core "
+ "migrates to a free one, or else preempts the core whose quantum ends soonest, so "
+ "with more threads than cores the caches see the effect of context switches.  "
+ "The number of context switches and migrations into each core is reported.");
+
+droption_t<bool> op_replay_cpus
+(DROPTION_SCOPE_FRONTEND, "replay_cpus", false, "Schedule threads by recorded cpus",
+ "Places each thread on the core given by the cpu it was recorded running on, "
+ "modulo the number of cores.  The tracer records the cpu at the start of each "
+ "buffer where the platform supports it; threads with no recorded cpu are "
+ "scheduled as though this option were not set.  Context switches and migrations "
+ "are reported as with -sched_quantum.");
+
+droption_t<bool> op_process_tags
+(DROPTION_SCOPE_FRONTEND, "process_tags", false, "Keep processes' addresses apart",
+ "Threads of all traced processes, including children that fork without exec, "
+ "share the simulated cores and caches.  By default the same virtual address in "
+ "two processes refers to the same data, as it does for shared code.  This option "
+ "tags each address with its process id instead, so that processes with private "
+ "data at the same addresses, such as the workers of a prefork server, do not "
+ "share cache lines.  It is not needed with -use_physical, whose addresses are "
+ "already distinct.  Only supported on 64-bit platforms.");
+
 droption_t<unsigned int> op_line_size
-(DROPTION_SCOPE_FRONTEND, "line_size", 64, "Cache line size",
+(DROPTION_SCOPE_ALL, "line_size", 64, "Cache line size",
  "Specifies the cache line size, which is assumed to be identical for L1 and L2 "
- "caches.");
+ "caches, and for the tracer's caches with -L0_filter.");
 
 droption_t<bytesize_t> op_L1I_size
 (DROPTION_SCOPE_FRONTEND, "L1I_size", 32*1024U, "Instruction cache total size",
@@ -75,6 +174,103 @@ droption_t<unsigned int> op_LL_assoc
 (DROPTION_SCOPE_FRONTEND, "LL_assoc", 16, "Last-level cache associativity",
  "Specifies the associativity of the unified last-level (L2) cache.");
 
+droption_t<unsigned int> op_L1I_latency
+(DROPTION_SCOPE_FRONTEND, "L1I_latency", 0, "Instruction cache latency",
+ "Specifies the number of cycles each access to an L1 instruction cache takes, for "
+ "the latency estimate (see -memory_latency).");
+
+droption_t<unsigned int> op_L1D_latency
+(DROPTION_SCOPE_FRONTEND, "L1D_latency", 0, "Data cache latency",
+ "Specifies the number of cycles each access to an L1 data cache takes, for the "
+ "latency estimate (see -memory_latency).");
+
+droption_t<unsigned int> op_LL_latency
+(DROPTION_SCOPE_FRONTEND, "LL_latency", 0, "Last-level cache latency",
+ "Specifies the number of cycles each access to the last-level cache takes, for the "
+ "latency estimate (see -memory_latency).");
+
+droption_t<unsigned int> op_memory_latency
+(DROPTION_SCOPE_FRONTEND, "memory_latency", 0, "Memory latency",
+ "Specifies the number of cycles a last-level cache miss takes to be served from "
+ "memory.  If this or any cache latency is non-zero, the cache simulator estimates "
+ "the cycles spent on memory accesses, the average memory access time, and the "
+ "cycles stalled beyond the first-level caches, overall and per core and thread.  "
+ "With -config_file, the latencies are set in the file instead.");
+
+droption_t<std::string> op_config_file
+(DROPTION_SCOPE_FRONTEND, "config_file", "", "Cache hierarchy configuration file",
+ "Applies to the cache simulator only.  By default, each core has a private L1 "
+ "instruction cache and L1 data cache, sized by the L1 options, under a single "
+ "last-level cache shared by all cores.  This option instead reads an arbitrary "
+ "hierarchy from the given file: the number of cores, each cache's size, "
+ "associativity, replacement policy, latency, and parent, and optionally the "
+ "latency of memory.  If latencies are given, an estimate of the cycles spent on "
+ "memory accesses is printed.  The file format is described in the documentation.  "
+ "The other cache options, including -cores, are ignored, except that "
+ "-replace_policy applies to caches that do not specify a policy.  This option "
+ "is not supported with -L0_filter or -parallel.");
+
+droption_t<std::string> op_config_files
+(DROPTION_SCOPE_FRONTEND, "config_files", "",
+ "Comma-separated cache hierarchy configuration files to simulate together",
+ "Applies to the cache simulator only.  Simulates each hierarchy listed, each in the "
+ "format of -config_file, on the same trace in a single run.  The trace is decoded "
+ "once and each hierarchy is simulated on its own thread, and the statistics of "
+ "each are printed in turn.  This option is not supported with -config_file, "
+ "-interval_refs, -L0_filter, or -parallel.");
+
+droption_t<bool> op_L0_filter
+(DROPTION_SCOPE_ALL, "L0_filter", false, "Filter out L0 cache hits while tracing",
+ "The tracer models a direct-mapped instruction cache and data cache for each "
+ "thread (see -L0I_size and -L0D_size) and only records the instruction fetches "
+ "and data loads and stores that miss in them, plus periodic counts of the hits.  "
+ "This greatly reduces the trace size.  The cache simulator then reports the L0 "
+ "caches' statistics as those of the L1 caches and simulates the rest of the "
+ "hierarchy from their misses; the -L1I_* and -L1D_* options are not used.  "
+ "The program counters of data references are not available in a filtered trace.  "
+ "A trace recorded with -offline -L0_filter must be simulated with -L0_filter.  "
+ "Only supported on x86 and only for the cache simulator.");
+
+droption_t<bytesize_t> op_L0I_size
+(DROPTION_SCOPE_CLIENT, "L0I_size", 32*1024U, "Tracer instruction cache size",
+ "For -L0_filter, specifies the total size of each thread's direct-mapped "
+ "instruction cache in the tracer.  It must be a power of 2 and a multiple of "
+ "-line_size.");
+
+droption_t<bytesize_t> op_L0D_size
+(DROPTION_SCOPE_CLIENT, "L0D_size", 32*1024U, "Tracer data cache size",
+ "For -L0_filter, specifies the total size of each thread's direct-mapped "
+ "data cache in the tracer.  It must be a power of 2 and a multiple of -line_size.");
+
+droption_t<bool> op_instr_only
+(DROPTION_SCOPE_CLIENT, "instr_only", false, "Trace only instruction fetches",
+ "The tracer records no data references, and records each execution of a basic "
+ "block as a single entry holding the block's start address, in place of an entry "
+ "per instruction.  The lengths of each block's instructions are listed once, when "
+ "the block is first instrumented, in a per-process file next to the trace (see "
+ "the module list), which the simulator reads back to recover every fetch.  This "
+ "is not supported with -data_only, -L0_filter, or -use_physical.");
+
+droption_t<bool> op_data_only
+(DROPTION_SCOPE_CLIENT, "data_only", false, "Trace only data references",
+ "The tracer records no instruction fetches.  Each instruction that references "
+ "memory is preceded by an entry holding its program counter, which the simulator "
+ "uses for the data references' program counters but does not simulate as a "
+ "fetch.  This is not supported with -instr_only or -L0_filter.");
+
+droption_t<bool> op_instr_blocks
+(DROPTION_SCOPE_CLIENT, "instr_blocks", false,
+ "Trace instruction fetches as blocks",
+ "The tracer records each execution of a basic block as a single entry holding "
+ "the block's start address, followed by the block's data references, in place "
+ "of an entry per instruction.  As with -instr_only, the block's instructions are "
+ "listed once in a per-process file next to the trace, here with the number of "
+ "data references of each, which the simulator reads back to recover every fetch "
+ "and the program counter of every data reference.  The result is the same trace "
+ "as without this option, for much less tracing bandwidth in code with few data "
+ "references.  This is only supported on x86, and not with -instr_only, "
+ "-data_only, -L0_filter, or -use_physical.");
+
 droption_t<bool> op_use_physical
 (DROPTION_SCOPE_CLIENT, "use_physical", false, "Use physical addresses if possible",
  "If available, the default virtual addresses will be translated to physical.  "
@@ -89,11 +285,93 @@ droption_t<unsigned int> op_virt2phys_freq
  "The units are the number of memory accesses per forced access.  A value of 0 "
  "uses the cached values for the entire application execution.");
 
+droption_t<bytesize_t> op_trace_after_instrs
+(DROPTION_SCOPE_CLIENT, "trace_after_instrs", 0,
+ "Do not start tracing until N instructions",
+ "If non-zero, the tracer only counts instructions, which is much cheaper than "
+ "tracing them, until this many have executed across all threads, and then "
+ "starts tracing.  Unlike -skip_refs, the skipped part of the execution never "
+ "reaches the simulator.");
+
+droption_t<bytesize_t> op_trace_for_instrs
+(DROPTION_SCOPE_CLIENT, "trace_for_instrs", 0,
+ "Stop tracing after N instructions",
+ "If non-zero, tracing stops once this many instructions have been traced across "
+ "all threads.  Combined with -retrace_every_instrs, this traces a sequence of "
+ "sampling windows.");
+
+droption_t<bytesize_t> op_retrace_every_instrs
+(DROPTION_SCOPE_CLIENT, "retrace_every_instrs", 0,
+ "Trace again after N untraced instructions",
+ "Requires -trace_for_instrs.  If non-zero, once a window of -trace_for_instrs "
+ "instructions has been traced the tracer only counts instructions until this "
+ "many more have executed, and then traces another window, repeatedly.  For "
+ "example, -trace_for_instrs 10M -retrace_every_instrs 990M traces about 1% of "
+ "the execution.  The windows follow one another in the trace without any "
+ "marker.  Changing between counting and tracing flushes the code cache, so "
+ "very short windows are costly.");
+
+droption_t<std::string> op_trace_function
+(DROPTION_SCOPE_CLIENT, "trace_function", "",
+ "Only trace within calls to these functions",
+ "A comma-separated list of function names.  If non-empty, the tracer starts "
+ "with tracing off, wraps the named functions in each module, found among its "
+ "exports or, failing that, its symbols, and traces all threads while any thread "
+ "is inside a call to one of them.  Code outside of these calls runs without "
+ "instrumentation, but each switch flushes the code cache, so functions that are "
+ "called often and return quickly are costly to trace this way.  Not supported "
+ "with -trace_after_instrs or -trace_for_instrs.");
+
+droption_t<bool> op_trace_on_demand
+(DROPTION_SCOPE_CLIENT, "trace_on_demand", false,
+ "Only trace when the application or a nudge asks to",
+ "Starts with tracing off.  Tracing is switched on and off by the application "
+ "with the DRMEMTRACE_START_TRACING() and DRMEMTRACE_STOP_TRACING() annotations "
+ "from drmemtrace_annotations.h, and by nudges: each nudge switches tracing on if "
+ "it is off and off if it is on.  As with -trace_function, each switch flushes "
+ "the code cache.  Not supported with -trace_after_instrs or -trace_for_instrs.");
+
+droption_t<bool> op_record_allocs
+(DROPTION_SCOPE_CLIENT, "record_allocs", false, "Record heap allocations and mappings",
+ "Wraps the allocation routines malloc, calloc, realloc, and free, the C++ operators "
+ "new and delete, and, on UNIX, mmap and munmap, and records each allocation the app "
+ "makes with its address range and the return address of its call, and each free, in "
+ "the trace, for -report_allocs.  Only the outermost of nested calls is recorded, so "
+ "an allocation made by a library routine such as strdup is attributed to the "
+ "routine.  Allocations are recorded outside of the tracing windows as well.  Not "
+ "supported with -use_physical.");
+
+droption_t<bool> op_record_syscalls
+(DROPTION_SCOPE_CLIENT, "record_syscalls", false, "Record system calls",
+ "Records an entry in the trace before each system call the app makes, and one after "
+ "it returns with the time it took, for -syscall_pollution and -context_switch_us.  "
+ "Syscalls are recorded outside of the tracing windows as well.");
+
 droption_t<std::string> op_replace_policy
 (DROPTION_SCOPE_FRONTEND, "replace_policy", REPLACE_POLICY_LRU,
  "Cache replacement policy", "Specifies the replacement policy for caches. "
  "Supported policies: LRU (Least Recently Used), LFU (Least Frequently Used), "
- "FIFO (First-In-First-Out).");
+ "FIFO (First-In-First-Out), PLRU (tree pseudo-LRU), SRRIP (Static Re-Reference "
+ "Interval Prediction), DRRIP (Dynamic RRIP, choosing between static and bimodal "
+ "insertion by set dueling).");
+
+droption_t<std::string> op_data_prefetcher
+(DROPTION_SCOPE_FRONTEND, "data_prefetcher", PREFETCH_POLICY_NONE,
+ "Hardware data prefetcher policy",
+ "Applies to the cache simulator only.  Attaches a model of a hardware prefetcher "
+ "to each L1 data cache.  Supported policies: none, nextline (on a miss, fetch the "
+ "following lines), stride (track the stride between each instruction's accesses "
+ "and fetch ahead once it repeats), stream (follow ascending or descending streams "
+ "of misses).  With -config_file, each cache's prefetcher is set in the file "
+ "instead.  For each cache with prefetched lines the number of prefetches issued, "
+ "the number of those whose line was used, how many of those were used soon "
+ "(late), and the number of misses on lines a prefetch evicted (polluting) are "
+ "printed.  Not supported with -L0_filter.");
+
+droption_t<unsigned int> op_prefetch_degree
+(DROPTION_SCOPE_FRONTEND, "prefetch_degree", 1, 1, 64, "Lines fetched per prefetch",
+ "Applies to the cache simulator only.  The number of lines a hardware prefetcher "
+ "fetches ahead each time it acts (see -data_prefetcher).");
 
 droption_t<bytesize_t> op_page_size
 (DROPTION_SCOPE_FRONTEND, "page_size", bytesize_t(4*1024), "Virtual/physical page size",
@@ -123,15 +401,283 @@ droption_t<unsigned int> op_TLB_L2_assoc
 (DROPTION_SCOPE_FRONTEND, "TLB_L2_assoc", 4, "L2 TLB associativity",
  "Specifies the associativity of each unified L2 TLB.");
 
+droption_t<std::string> op_page_size_file
+(DROPTION_SCOPE_FRONTEND, "page_size_file", "", "Address ranges held by larger pages",
+ "Applies to the TLB simulator only.  Names a file listing the address ranges "
+ "that are mapped by pages other than -page_size ones, such as transparent huge "
+ "pages or hugetlbfs pages, one \"start end size\" line per range: the start and "
+ "end addresses in hex and the page size in bytes, optionally with a K, M, or G "
+ "suffix.  Lines starting with '#' are ignored.  Each TLB entry then translates a "
+ "whole page of the size given for its address, and pages of all sizes share the "
+ "TLBs' entries unless -TLB_L1I_huge_entries or -TLB_L1D_huge_entries give the "
+ "first-level TLBs separate ones.  With -use_physical, the tracer writes such a "
+ "file for the large pages it finds (see the documentation).");
+
+droption_t<unsigned int> op_TLB_L1I_huge_entries
+(DROPTION_SCOPE_FRONTEND, "TLB_L1I_huge_entries", 0, "Instruction TLB large-page entries",
+ "Requires -page_size_file.  If non-zero, each L1 instruction TLB gets this many "
+ "entries, of associativity -TLB_huge_assoc, for pages larger than -page_size, "
+ "separate from its -TLB_L1I_entries ones.  If zero, all pages share those.");
+
+droption_t<unsigned int> op_TLB_L1D_huge_entries
+(DROPTION_SCOPE_FRONTEND, "TLB_L1D_huge_entries", 0, "Data TLB large-page entries",
+ "Requires -page_size_file.  If non-zero, each L1 data TLB gets this many "
+ "entries, of associativity -TLB_huge_assoc, for pages larger than -page_size, "
+ "separate from its -TLB_L1D_entries ones.  If zero, all pages share those.");
+
+droption_t<unsigned int> op_TLB_huge_assoc
+(DROPTION_SCOPE_FRONTEND, "TLB_huge_assoc", 4, "Large-page TLB associativity",
+ "Specifies the associativity of the entries given by -TLB_L1I_huge_entries and "
+ "-TLB_L1D_huge_entries.");
+
 droption_t<std::string> op_TLB_replace_policy
 (DROPTION_SCOPE_FRONTEND, "TLB_replace_policy", REPLACE_POLICY_LFU,
  "TLB replacement policy", "Specifies the replacement policy for TLBs. "
  "Supported policies: LFU (Least Frequently Used).");
 
+droption_t<unsigned int> op_TLB_walk_levels
+(DROPTION_SCOPE_FRONTEND, "TLB_walk_levels", 4, 0, 8, "Page table levels",
+ "Applies to the " CACHE_TLB " simulator only.  On each last-level TLB miss, one "
+ "page table entry per level is read through the core's L1 data cache.  Zero "
+ "disables page walk accesses.");
+
+droption_t<bool> op_physical_caches
+(DROPTION_SCOPE_FRONTEND, "physical_caches", false, "Physically index the caches",
+ "Applies to the " CACHE_TLB " simulator only.  Hands the caches simulated "
+ "physical addresses, giving each -page_size page of each process a frame in the "
+ "order they are first touched, instead of the traced addresses.");
+
 droption_t<std::string> op_simulator_type
 (DROPTION_SCOPE_FRONTEND, "simulator_type", CPU_CACHE,
  "Simulator type", "Specifies the type of the simulator. "
- "Supported types: "CPU_CACHE", "TLB".");
+ "Supported types: " CPU_CACHE ", " TLB ", " CACHE_TLB ", " STACK_DISTANCE ", "
+ REUSE_DISTANCE ", " ACCESS_PATTERN ", " FALSE_SHARING ", " BRANCH_PREDICTOR
+ ".  The " CACHE_TLB
+ " simulator runs the "
+ CPU_CACHE " and " TLB " simulations together on each reference, with the page "
+ "table walks of last-level TLB misses going through the caches (see "
+ "-TLB_walk_levels and -physical_caches).  The " STACK_DISTANCE " simulator "
+ "computes LRU miss rates "
+ "for every power-of-two cache size and associativity up to -sd_max_size and "
+ "-sd_max_assoc in a single pass, treating instruction and data accesses from all "
+ "threads as two separate streams.  The " REUSE_DISTANCE " simulator reports "
+ "histograms of data reuse distances in cache lines and in pages, along with "
+ "working set sizes over windows of -rd_window references.  The " ACCESS_PATTERN
+ " simulator classifies the data accesses of each load and store instruction as "
+ "constant stride, streaming, pointer-chasing, or irregular.  The " FALSE_SHARING
+ " simulator finds cache lines that several threads use at once without sharing "
+ "any bytes.  The " BRANCH_PREDICTOR " simulator infers branches from the "
+ "instruction fetches of each thread and reports their mispredictions.");
+
+droption_t<bytesize_t> op_sd_max_size
+(DROPTION_SCOPE_FRONTEND, "sd_max_size", 8*1024*1024,
+ "Largest cache size for stack distance analysis",
+ "Specifies the largest total cache size, which must be a power of 2, reported by "
+ "the " STACK_DISTANCE " simulator.  Memory use and run time grow with this size.");
+
+droption_t<unsigned int> op_sd_max_assoc
+(DROPTION_SCOPE_FRONTEND, "sd_max_assoc", 16,
+ "Largest associativity for stack distance analysis",
+ "Specifies the largest associativity, which must be a power of 2, reported by "
+ "the " STACK_DISTANCE " simulator.  Run time grows with this value.");
+
+droption_t<bytesize_t> op_rd_window
+(DROPTION_SCOPE_FRONTEND, "rd_window", 10*1000*1000,
+ "Working set window for reuse distance analysis",
+ "Specifies the number of memory references in each window for which the "
+ REUSE_DISTANCE " simulator reports the working set size: the number of "
+ "distinct cache lines and pages accessed.");
+
+droption_t<bool> op_rd_by_pc
+(DROPTION_SCOPE_FRONTEND, "rd_by_pc", false,
+ "Break down reuse distances by instruction",
+ "Requests that the " REUSE_DISTANCE " simulator also report, for the "
+ "instructions with the most data accesses, the number of accesses, cold "
+ "accesses, and the mean cache line reuse distance.");
+
+droption_t<unsigned int> op_rd_top_pcs
+(DROPTION_SCOPE_FRONTEND, "rd_top_pcs", 20,
+ "Number of instructions reported by -rd_by_pc",
+ "Specifies how many instructions to list with -rd_by_pc.");
+
+droption_t<unsigned int> op_ap_top_pcs
+(DROPTION_SCOPE_FRONTEND, "ap_top_pcs", 20,
+ "Number of instructions listed by the " ACCESS_PATTERN " simulator",
+ "Specifies how many instructions, those with the most data accesses, the "
+ ACCESS_PATTERN " simulator lists along with their pattern, accesses, bytes "
+ "touched in whole cache lines, stride, and prefetchability score.");
+
+droption_t<bytesize_t> op_fs_window
+(DROPTION_SCOPE_FRONTEND, "fs_window", 10000,
+ "Sharing window for false sharing analysis",
+ "Specifies the number of data references, from all threads, within which the "
+ FALSE_SHARING " simulator considers two threads' uses of a cache line to "
+ "conflict.  Larger windows find sharing that is further apart in time, which "
+ "hurts less as the line is less likely to still be in the other core's cache.");
+
+droption_t<unsigned int> op_fs_top_lines
+(DROPTION_SCOPE_FRONTEND, "fs_top_lines", 20,
+ "Number of lines listed by the " FALSE_SHARING " simulator",
+ "Specifies how many cache lines, those with the most falsely shared accesses, "
+ "the " FALSE_SHARING " simulator lists along with the instructions involved and, "
+ "for traces recorded with -record_allocs, the call site of their allocation.");
+
+droption_t<std::string> op_bp_predictor
+(DROPTION_SCOPE_FRONTEND, "bp_predictor", BP_PREDICTOR_GSHARE,
+ "Direction predictor for the " BRANCH_PREDICTOR " simulator",
+ "Specifies the model the " BRANCH_PREDICTOR " simulator uses to predict whether "
+ "conditional branches are taken: " BP_PREDICTOR_GSHARE ", a table of 2-bit "
+ "counters indexed by the pc and the global branch history, or " BP_PREDICTOR_TAGE
+ ", a bimodal table plus four tagged tables indexed by global histories of 5 to 130 "
+ "branches.");
+
+droption_t<unsigned int> op_bp_table_bits
+(DROPTION_SCOPE_FRONTEND, "bp_table_bits", 14,
+ "Log2 of the direction predictor table size",
+ "Specifies the base 2 logarithm of the number of counters in the " BP_PREDICTOR_GSHARE
+ " table, which is also its history length, or in the " BP_PREDICTOR_TAGE " bimodal "
+ "table, whose tagged tables each have a quarter as many entries.");
+
+droption_t<unsigned int> op_bp_btb_entries
+(DROPTION_SCOPE_FRONTEND, "bp_btb_entries", 4096,
+ "Number of branch target buffer entries",
+ "Specifies the number of entries, which must be a power of 2, in the direct-mapped "
+ "branch target buffer the " BRANCH_PREDICTOR " simulator uses to predict the "
+ "targets of taken branches other than returns.");
+
+droption_t<unsigned int> op_bp_ras_entries
+(DROPTION_SCOPE_FRONTEND, "bp_ras_entries", 16,
+ "Number of return address stack entries",
+ "Specifies the number of entries in the return address stack the "
+ BRANCH_PREDICTOR " simulator uses to predict the targets of returns.");
+
+droption_t<unsigned int> op_bp_top_pcs
+(DROPTION_SCOPE_FRONTEND, "bp_top_pcs", 20,
+ "Number of branches listed by the " BRANCH_PREDICTOR " simulator",
+ "Specifies how many branches, those with the most mispredictions, the "
+ BRANCH_PREDICTOR " simulator lists along with their kind, executions, times "
+ "taken, and mispredictions, described by module and symbol where possible.");
+
+droption_t<unsigned int> op_report_misses
+(DROPTION_SCOPE_FRONTEND, "report_misses", 0,
+ "Number of top missing instructions to report",
+ "Applies to the cache simulator only.  If non-zero, misses are counted per "
+ "instruction and the given number of instructions with the most misses are listed "
+ "for the L1 instruction caches, the L1 data caches, and the last-level cache.  "
+ "Each is described by module and offset and, where symbol information is "
+ "available, by function and source line.");
+
+droption_t<unsigned int> op_report_allocs
+(DROPTION_SCOPE_FRONTEND, "report_allocs", 0,
+ "Number of top missing allocation sites to report",
+ "Applies to the cache simulator only, for a trace recorded with -record_allocs.  "
+ "If non-zero, the simulator tracks the app's live allocations and counts the "
+ "misses of data references to each per call site of the allocation, and the given "
+ "number of sites with the most misses are listed for each cache, described like "
+ "the instructions of -report_misses.  References to memory allocated before the "
+ "trace starts, or within -skip_refs, are not attributed, nor are any with "
+ "-physical_caches.  Not supported with -parallel.");
+
+droption_t<unsigned int> op_report_sets
+(DROPTION_SCOPE_FRONTEND, "report_sets", 0,
+ "Number of top conflict sets and instructions to report",
+ "Applies to the cache simulator only.  If non-zero, each cache classifies its "
+ "misses as compulsory (the first access to a block), capacity (also a miss in a "
+ "fully-associative LRU cache of the same capacity), or conflict (the rest), and "
+ "counts accesses, misses, and conflict misses per set.  The classes are printed "
+ "with each cache's statistics, followed by how the misses spread over the sets, "
+ "the given number of sets with the most conflict misses, and the given number of "
+ "instructions with the most conflict misses, described like those of "
+ "-report_misses.  Tracking the fully-associative cache slows down the simulation.  "
+ "Not supported with -L0_filter.");
+
+droption_t<unsigned int> op_sample_sets
+(DROPTION_SCOPE_FRONTEND, "sample_sets", 0, "Simulate one in this many LL sets",
+ "Applies to the cache simulator only.  If greater than 1, each cache with no parent "
+ "simulates only about one in this many of its sets, chosen by a hash of the set "
+ "index, and drops the references to the rest as they arrive, which speeds up the "
+ "simulation of a large last-level cache.  That cache's printed counts are scaled "
+ "up to all of its sets, and its miss rate is followed by a 95% confidence "
+ "interval.  The counts of -interval_refs, -report_misses, and -report_allocs cover "
+ "the sampled sets only.  Not supported with -coherence, -report_sets, "
+ "-page_node_file, or latency estimates (see -memory_latency).");
+
+droption_t<std::string> op_syscall_pollution
+(DROPTION_SCOPE_FRONTEND, "syscall_pollution", "",
+ "Lines displaced per syscall: <sysnum>:<percent>,...",
+ "Applies to the cache and TLB simulators, for a trace recorded with "
+ "-record_syscalls.  A comma-separated list of <sysnum>:<percent> entries, with * "
+ "in place of the number for every syscall not listed.  At the return of each "
+ "syscall, the given percentage of the lines of the first-level caches and of the "
+ "TLBs of the core running the thread are invalidated, standing for what the "
+ "kernel's own code and data displaced.  The percentages are best calibrated "
+ "against hardware counters for the syscalls a workload makes most.  Not supported "
+ "with -parallel.");
+
+droption_t<unsigned int> op_context_switch_us
+(DROPTION_SCOPE_FRONTEND, "context_switch_us", 0,
+ "Syscall time taken as a context switch",
+ "Applies to the cache and TLB simulators, for a trace recorded with "
+ "-record_syscalls.  If non-zero, a syscall that took at least this many "
+ "microseconds is assumed to have blocked and let other threads run, and on its "
+ "return the first-level caches and the TLBs of the core running the thread are "
+ "flushed entirely.  The number of syscalls and of such blocking syscalls is "
+ "printed for each core.  Not supported with -parallel.");
+
+droption_t<bool> op_coherence
+(DROPTION_SCOPE_FRONTEND, "coherence", false, "Model cache coherence",
+ "Applies to the cache simulator only.  Models a MESI write-invalidate protocol "
+ "among the caches: a write to a line invalidates every copy outside the writing "
+ "core's own path to memory, including any copy in an instruction cache.  For each "
+ "cache, the number of lines invalidated, the number of misses on invalidated lines "
+ "(coherence misses), and how many of those touched none of the bytes written by the "
+ "invalidating write (likely false sharing) are printed.  With -report_misses, the "
+ "instructions with the most coherence misses are listed as well.  Not supported "
+ "with -L0_filter or -parallel.");
+
+droption_t<std::string> op_write_policy
+(DROPTION_SCOPE_FRONTEND, "write_policy", WRITE_POLICY_NONE,
+ "Cache write policy: none, write_back, write_through",
+ "Applies to the cache simulator only.  Unless \"none\", each cache tracks which "
+ "of its lines are dirty and how much data moves between it and the level beneath "
+ "it, or memory for a cache with no parent.  A \"write_back\" cache holds written "
+ "lines until they are evicted, while a \"write_through\" cache passes each write "
+ "on.  Each cache then also reports its writebacks of dirty lines and the bytes it "
+ "fetched and wrote, and with -interval_refs those bytes are added to each interval.  "
+ "A -config_file can set the policy of each cache, which also enables this.  Not "
+ "supported with -L0_filter or -parallel.");
+
+droption_t<std::string> op_write_miss
+(DROPTION_SCOPE_FRONTEND, "write_miss", WRITE_MISS_ALLOCATE,
+ "Cache write miss policy: allocate, no_allocate",
+ "Applies to the cache simulator with -write_policy only.  Whether a write that misses "
+ "a cache fetches the line into it (\"allocate\") or is passed on to the level "
+ "beneath without filling the line (\"no_allocate\").");
+
+droption_t<std::string> op_page_node_file
+(DROPTION_SCOPE_FRONTEND, "page_node_file", "", "NUMA nodes of physical pages",
+ "Applies to the cache simulator only, for a trace with -use_physical.  Names a "
+ "file listing the NUMA node holding each physical address range, one \"start end "
+ "node\" line per range: the start and end addresses in hex and the node number.  "
+ "Lines starting with '#' are ignored.  The tracer writes such a file with "
+ "-use_physical (see the documentation).  The cores are spread evenly over the "
+ "nodes, in order, and each miss in a cache with no parent is counted as local or "
+ "remote to its core's node.  The counts are printed overall and per core and "
+ "thread, and -remote_memory_latency is added to the latency estimate for each "
+ "remote access.  Not supported with -parallel.");
+
+droption_t<unsigned int> op_numa_nodes
+(DROPTION_SCOPE_FRONTEND, "numa_nodes", 0, "Number of NUMA nodes",
+ "Applies to the cache simulator with -page_node_file only.  The number of nodes "
+ "to spread the cores over.  If 0, one more than the highest node in the "
+ "-page_node_file is used.");
+
+droption_t<unsigned int> op_remote_memory_latency
+(DROPTION_SCOPE_FRONTEND, "remote_memory_latency", 0, "Remote memory latency",
+ "Applies to the cache simulator with -page_node_file only.  Specifies the number "
+ "of cycles added to -memory_latency when a miss is served from memory on another "
+ "NUMA node than the accessing core's.  With -config_file, it is set in the file "
+ "instead, as remote_memory_latency.");
 
 droption_t<unsigned int> op_verbose
 (DROPTION_SCOPE_ALL, "verbose", 0, 0, 64, "Verbosity level",
@@ -153,6 +699,24 @@ droption_t<std::string> op_tracer
 (DROPTION_SCOPE_FRONTEND, "tracer", "", "Path to the tracer",
  "The full path to the tracer library.");
 
+droption_t<int> op_attach
+(DROPTION_SCOPE_FRONTEND, "attach", 0, "Trace the running process with this pid",
+ "Instead of launching an application, attaches to the process with this pid, which "
+ "must be one that ptrace is allowed to attach to, and traces it from then on.  The "
+ "process keeps running once tracing is done.  Use -attach_for_ms or "
+ "-trace_for_instrs to trace a bounded part of its execution.  With -offline, the "
+ "front end returns once the window is over, while online simulation waits for the "
+ "process to exit.  The process remains under DynamoRIO after the window, though "
+ "with no tracing instrumentation, as DynamoRIO cannot yet detach on this platform.  "
+ "Only supported on Linux.");
+
+droption_t<unsigned int> op_attach_for_ms
+(DROPTION_SCOPE_FRONTEND, "attach_for_ms", 0, "Trace an attached process for N ms",
+ "If non-zero, an -attach process is traced for this many milliseconds, after which "
+ "tracing is switched off.  The window is controlled by nudges, as with "
+ "-trace_on_demand, so this is not supported with -trace_function or the "
+ "instruction count windows.");
+
 droption_t<std::string> op_tracer_ops
 (DROPTION_SCOPE_FRONTEND, "tracer_ops",
  DROPTION_FLAG_SWEEP | DROPTION_FLAG_ACCUMULATE | DROPTION_FLAG_INTERNAL,
@@ -178,3 +742,53 @@ droption_t<bytesize_t> op_sim_refs
  "Specifies the number of memory references simulated. "
  "The simulated references come after the skipped and warmup references, "
  "and the references following the simulated ones are dropped.");
+
+droption_t<bool> op_parallel
+(DROPTION_SCOPE_FRONTEND, "parallel", false, "Simulate each core on its own thread",
+ "Applies to the cache simulator only.  Each core's L1 caches are simulated on a "
+ "separate thread, with a further thread for the last-level cache.  References are "
+ "handed out in fixed-size epochs and each epoch's last-level traffic is replayed "
+ "in core order, so results are repeatable, but they can differ slightly from "
+ "the default serial simulation, where last-level accesses from different cores "
+ "are interleaved reference by reference.");
+
+droption_t<std::string> op_checkpoint_save
+(DROPTION_SCOPE_FRONTEND, "checkpoint_save", "", "File to save the warmed-up state to",
+ "Applies to the cache and TLB simulators, but not the " CACHE_TLB " simulator.  "
+ "After the -warmup_refs references, or at "
+ "the end of the run if -warmup_refs is 0, the contents of every cache or TLB (their "
+ "tags and replacement state, along with coherence and dirty state where modeled) "
+ "are written to this file.  A later run of the same configuration can start from "
+ "them with -checkpoint_load.  Combined with -skip_refs, this allows warming up "
+ "once and then simulating many windows of a trace, possibly in parallel.  The "
+ "thread-to-core schedule and the state of prefetchers are not saved.  Not "
+ "supported with -parallel or -config_files.");
+
+droption_t<std::string> op_checkpoint_load
+(DROPTION_SCOPE_FRONTEND, "checkpoint_load", "", "File to restore the warmed-up state from",
+ "Applies to the cache and TLB simulators.  Before simulating, the contents of every "
+ "cache or TLB are restored from this file, written by -checkpoint_save for the "
+ "same configuration, and -warmup_refs is ignored.  Not supported with -parallel or "
+ "-config_files.");
+
+droption_t<bytesize_t> op_interval_refs
+(DROPTION_SCOPE_FRONTEND, "interval_refs", 0, "Snapshot statistics every N references",
+ "Applies to the cache and TLB simulators.  If non-zero, every N simulated "
+ "references (warmup references are not counted) a row of comma-separated values "
+ "is written holding each cache's or TLB's hits and misses so far and those of "
+ "the interval just ended, so that changes in behavior over the run can be seen. "
+ "A final row covers any partial interval at the end.  The rows are written to "
+ "-interval_file, or to stderr if it is not set.  Not supported with -parallel.");
+
+droption_t<std::string> op_interval_file
+(DROPTION_SCOPE_FRONTEND, "interval_file", "", "File for -interval_refs rows",
+ "The file the -interval_refs rows are written to, rather than stderr.");
+
+droption_t<std::string> op_interval_bbv_file
+(DROPTION_SCOPE_FRONTEND, "interval_bbv_file", "", "File for per-interval BBVs",
+ "If set along with -interval_refs, a basic block vector for each interval is "
+ "written to this file in the format read by SimPoint, one line per interval, "
+ "counting the instructions executed in each basic block.  A basic block here "
+ "starts at any instruction that does not directly follow the previous "
+ "instruction of its thread.  SimPoint can then pick representative intervals, "
+ "which can be simulated on their own with -skip_refs, -warmup_refs and -sim_refs.");
@@ -39,14 +39,46 @@
 #define REPLACE_POLICY_LRU                      "LRU"
 #define REPLACE_POLICY_LFU                      "LFU"
 #define REPLACE_POLICY_FIFO                     "FIFO"
+#define REPLACE_POLICY_PLRU                     "PLRU"
+#define REPLACE_POLICY_SRRIP                    "SRRIP"
+#define REPLACE_POLICY_DRRIP                    "DRRIP"
+#define PREFETCH_POLICY_NONE                    "none"
+#define PREFETCH_POLICY_NEXTLINE                "nextline"
+#define PREFETCH_POLICY_STRIDE                  "stride"
+#define PREFETCH_POLICY_STREAM                  "stream"
+#define WRITE_POLICY_NONE                       "none"
+#define WRITE_POLICY_BACK                       "write_back"
+#define WRITE_POLICY_THROUGH                    "write_through"
+#define WRITE_MISS_ALLOCATE                     "allocate"
+#define WRITE_MISS_NO_ALLOCATE                  "no_allocate"
 #define CPU_CACHE                               "cache"
 #define TLB                                     "TLB"
+#define CACHE_TLB                               "cache_TLB"
+#define STACK_DISTANCE                          "stack_distance"
+#define REUSE_DISTANCE                          "reuse_distance"
+#define ACCESS_PATTERN                          "access_pattern"
+#define FALSE_SHARING                           "false_sharing"
+#define BRANCH_PREDICTOR                        "branch_predictor"
+#define BP_PREDICTOR_GSHARE                     "gshare"
+#define BP_PREDICTOR_TAGE                       "tage"
 
 #include <string>
 #include "droption.h"
 
 extern droption_t<std::string> op_ipc_name;
+extern droption_t<bool> op_thread_pipes;
+extern droption_t<bool> op_shm;
+extern droption_t<unsigned int> op_shm_slots;
+extern droption_t<bool> op_async_reader;
+extern droption_t<bool> op_offline;
+extern droption_t<std::string> op_outdir;
+extern droption_t<bool> op_compress;
+extern droption_t<unsigned int> op_num_writers;
+extern droption_t<std::string> op_infile;
 extern droption_t<unsigned int> op_num_cores;
+extern droption_t<unsigned int> op_sched_quantum;
+extern droption_t<bool> op_replay_cpus;
+extern droption_t<bool> op_process_tags;
 extern droption_t<unsigned int> op_line_size;
 extern droption_t<bytesize_t> op_L1I_size;
 extern droption_t<bytesize_t> op_L1D_size;
@@ -54,9 +86,30 @@ extern droption_t<unsigned int> op_L1I_assoc;
 extern droption_t<unsigned int> op_L1D_assoc;
 extern droption_t<bytesize_t> op_LL_size;
 extern droption_t<unsigned int> op_LL_assoc;
+extern droption_t<unsigned int> op_L1I_latency;
+extern droption_t<unsigned int> op_L1D_latency;
+extern droption_t<unsigned int> op_LL_latency;
+extern droption_t<unsigned int> op_memory_latency;
+extern droption_t<std::string> op_config_file;
+extern droption_t<std::string> op_config_files;
+extern droption_t<bool> op_L0_filter;
+extern droption_t<bytesize_t> op_L0I_size;
+extern droption_t<bytesize_t> op_L0D_size;
+extern droption_t<bool> op_instr_only;
+extern droption_t<bool> op_data_only;
+extern droption_t<bool> op_instr_blocks;
 extern droption_t<bool> op_use_physical;
 extern droption_t<unsigned int> op_virt2phys_freq;
+extern droption_t<bytesize_t> op_trace_after_instrs;
+extern droption_t<bytesize_t> op_trace_for_instrs;
+extern droption_t<bytesize_t> op_retrace_every_instrs;
+extern droption_t<std::string> op_trace_function;
+extern droption_t<bool> op_trace_on_demand;
+extern droption_t<bool> op_record_allocs;
+extern droption_t<bool> op_record_syscalls;
 extern droption_t<std::string> op_replace_policy;
+extern droption_t<std::string> op_data_prefetcher;
+extern droption_t<unsigned int> op_prefetch_degree;
 extern droption_t<bytesize_t> op_page_size;
 extern droption_t<unsigned int> op_TLB_L1I_entries;
 extern droption_t<unsigned int> op_TLB_L1D_entries;
@@ -64,16 +117,55 @@ extern droption_t<unsigned int> op_TLB_L1I_assoc;
 extern droption_t<unsigned int> op_TLB_L1D_assoc;
 extern droption_t<unsigned int> op_TLB_L2_entries;
 extern droption_t<unsigned int> op_TLB_L2_assoc;
+extern droption_t<std::string> op_page_size_file;
+extern droption_t<unsigned int> op_TLB_L1I_huge_entries;
+extern droption_t<unsigned int> op_TLB_L1D_huge_entries;
+extern droption_t<unsigned int> op_TLB_huge_assoc;
 extern droption_t<std::string> op_TLB_replace_policy;
+extern droption_t<unsigned int> op_TLB_walk_levels;
+extern droption_t<bool> op_physical_caches;
 extern droption_t<std::string> op_simulator_type;
+extern droption_t<bytesize_t> op_sd_max_size;
+extern droption_t<unsigned int> op_sd_max_assoc;
+extern droption_t<bytesize_t> op_rd_window;
+extern droption_t<bool> op_rd_by_pc;
+extern droption_t<unsigned int> op_rd_top_pcs;
+extern droption_t<unsigned int> op_ap_top_pcs;
+extern droption_t<bytesize_t> op_fs_window;
+extern droption_t<unsigned int> op_fs_top_lines;
+extern droption_t<std::string> op_bp_predictor;
+extern droption_t<unsigned int> op_bp_table_bits;
+extern droption_t<unsigned int> op_bp_btb_entries;
+extern droption_t<unsigned int> op_bp_ras_entries;
+extern droption_t<unsigned int> op_bp_top_pcs;
+extern droption_t<unsigned int> op_report_misses;
+extern droption_t<unsigned int> op_report_allocs;
+extern droption_t<unsigned int> op_report_sets;
+extern droption_t<unsigned int> op_sample_sets;
+extern droption_t<std::string> op_syscall_pollution;
+extern droption_t<unsigned int> op_context_switch_us;
+extern droption_t<bool> op_coherence;
+extern droption_t<std::string> op_write_policy;
+extern droption_t<std::string> op_write_miss;
+extern droption_t<std::string> op_page_node_file;
+extern droption_t<unsigned int> op_numa_nodes;
+extern droption_t<unsigned int> op_remote_memory_latency;
 extern droption_t<unsigned int> op_verbose;
 extern droption_t<std::string> op_dr_root;
 extern droption_t<bool> op_dr_debug;
 extern droption_t<std::string> op_dr_ops;
 extern droption_t<std::string> op_tracer;
+extern droption_t<int> op_attach;
+extern droption_t<unsigned int> op_attach_for_ms;
 extern droption_t<std::string> op_tracer_ops;
 extern droption_t<bytesize_t> op_skip_refs;
 extern droption_t<bytesize_t> op_warmup_refs;
 extern droption_t<bytesize_t> op_sim_refs;
+extern droption_t<bool> op_parallel;
+extern droption_t<std::string> op_checkpoint_save;
+extern droption_t<std::string> op_checkpoint_load;
+extern droption_t<bytesize_t> op_interval_refs;
+extern droption_t<std::string> op_interval_file;
+extern droption_t<std::string> op_interval_bbv_file;
 
 #endif /* _OPTIONS_H_ */
@@ -0,0 +1,125 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* shm_ring: a shared-memory transport for trace buffers, as an alternative
+ * to named_pipe_t that avoids a system call and a kernel copy per buffer.
+ */
+
+#ifndef _SHM_RING_H_
+#define _SHM_RING_H_ 1
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef OUT
+# define OUT // nothing
+#endif
+#ifndef IN
+# define IN // nothing
+#endif
+
+// The shared region holds a header and a fixed number of equal-sized slots,
+// each large enough for one full tracer buffer.  Slot indices circulate
+// between two lock-free queues in the header:
+// + A writer takes a slot from the free queue and uses it directly as its
+//   trace buffer.  When full, the writer publishes the slot on the ready queue
+//   and takes another free slot.
+// + The single reader takes slots from the ready queue in publication order,
+//   processes the entries in place, and returns each slot to the free queue.
+// Thus no trace data is copied.  None of the calls here block: the
+// caller decides how to wait when a queue is empty.
+//
+// Usage is as follows, mirroring named_pipe_t:
+// + The reader calls create() up front (and at the end destroy()).
+// + Each writer process maps the file at get_path() itself and passes the
+//   mapping to attach(), or calls open_for_write(); it calls close() when done.
+// The region is a file rather than a POSIX shm object so that the tracer,
+// which must use DR's file routines, can map it.
+
+#define SHM_RING_MAX_SLOTS 1024
+#define SHM_RING_MAX_WRITERS 64
+// This must be at least as large as the tracer's buffer plus its redzone.
+#define SHM_RING_SLOT_SIZE (256*1024)
+
+class shm_ring_t
+{
+ public:
+    shm_ring_t();
+    explicit shm_ring_t(const char *name);
+    ~shm_ring_t();
+    bool set_name(const char *name);
+
+    // Creates and maps a new region with num_slots slots.
+    bool create(unsigned int num_slots, size_t slot_size = SHM_RING_SLOT_SIZE);
+    bool destroy();
+
+    // Maps an existing region.  Fails if it does not exist or is not yet
+    // initialized, in which case the caller may retry.
+    bool open_for_write();
+    // Registers an existing mapping of the region made by the caller.
+    // Fails if the region is not yet initialized.
+    bool attach(void *base, size_t size);
+    bool close();
+
+    // Returns the path of the file backing the region.
+    const std::string & get_path() const;
+    // Returns the size of the region for create() with these parameters.
+    static size_t region_size(unsigned int num_slots, size_t slot_size);
+    size_t get_slot_size() const;
+
+    // Writer interface.  Returns NULL if no slot is free.
+    void *acquire_buffer();
+    void publish_buffer(void *buf IN, size_t used);
+    // Registers the calling process as a writer, so the reader can detect
+    // when all writers have gone away.  The pid is used to detect writers
+    // that died without calling close().  A child created by fork registers
+    // itself with its own pid.
+    bool add_writer(int pid);
+
+    // Reader interface.  Returns NULL if no slot is ready, in which case
+    // *eof is set if no writers remain.
+    void *acquire_ready(size_t *used OUT, bool *eof OUT);
+    void release_buffer(void *buf IN);
+
+ private:
+    bool any_live_writer();
+
+    std::string path;
+    struct shm_ring_header_t *header;
+    unsigned char *slots;
+    size_t map_size;
+    bool owns_mapping;
+    int writer_pid;
+};
+
+#endif /* _SHM_RING_H_ */
@@ -0,0 +1,370 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <string>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include "shm_ring.h"
+
+#define SHM_RING_MAGIC 0x474e4952 /* "RING" */
+#define SHM_RING_VERSION 1
+#define SHM_RING_PERMS 0666
+#define CACHE_LINE_SIZE 64
+#define PAGE_ALIGN(x) (((x) + 4095) & ~(size_t)4095)
+
+// A bounded multi-producer multi-consumer queue of slot indices in the style
+// of Dmitry Vyukov's: each cell's sequence number says whether it is ready to
+// be written or read for a given position.  The capacity is a power of two no
+// smaller than the number of slots, so it can never be full.
+struct shm_queue_t {
+    volatile uint32_t enqueue_pos;
+    char pad1[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    volatile uint32_t dequeue_pos;
+    char pad2[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    uint32_t mask;
+    struct {
+        volatile uint32_t seq;
+        uint32_t value;
+    } cells[SHM_RING_MAX_SLOTS];
+};
+
+struct shm_ring_header_t {
+    volatile uint32_t magic; // set last by the creator
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t slot_size;
+    uint64_t region_size;
+    volatile uint32_t ever_attached;
+    volatile int32_t writers[SHM_RING_MAX_WRITERS];
+    volatile uint32_t used[SHM_RING_MAX_SLOTS];
+    shm_queue_t free_queue;
+    shm_queue_t ready_queue;
+};
+
+static void
+queue_init(shm_queue_t *q, unsigned int num_slots)
+{
+    uint32_t capacity = 1;
+    while (capacity < num_slots)
+        capacity <<= 1;
+    q->mask = capacity - 1;
+    for (uint32_t i = 0; i < capacity; i++)
+        q->cells[i].seq = i;
+    q->enqueue_pos = 0;
+    q->dequeue_pos = 0;
+}
+
+static bool
+queue_push(shm_queue_t *q, uint32_t value)
+{
+    uint32_t pos = q->enqueue_pos;
+    while (true) {
+        uint32_t seq = q->cells[pos & q->mask].seq;
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap(&q->enqueue_pos, pos, pos + 1))
+                break;
+        } else if (diff < 0)
+            return false; // full, which should not happen
+        pos = q->enqueue_pos;
+    }
+    q->cells[pos & q->mask].value = value;
+    __sync_synchronize();
+    q->cells[pos & q->mask].seq = pos + 1;
+    return true;
+}
+
+static bool
+queue_pop(shm_queue_t *q, uint32_t *value OUT)
+{
+    uint32_t pos = q->dequeue_pos;
+    while (true) {
+        uint32_t seq = q->cells[pos & q->mask].seq;
+        int32_t diff = (int32_t)(seq - (pos + 1));
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap(&q->dequeue_pos, pos, pos + 1))
+                break;
+        } else if (diff < 0)
+            return false; // empty
+        pos = q->dequeue_pos;
+    }
+    __sync_synchronize();
+    *value = q->cells[pos & q->mask].value;
+    __sync_synchronize();
+    q->cells[pos & q->mask].seq = pos + q->mask + 1;
+    return true;
+}
+
+static const char *
+ring_dir()
+{
+    // Kept in sync with named_pipe_t's location.
+    return "/tmp";
+}
+
+shm_ring_t::shm_ring_t() :
+    header(NULL), slots(NULL), map_size(0), owns_mapping(false),
+    writer_pid(0)
+{
+    // empty
+}
+
+shm_ring_t::shm_ring_t(const char *name) :
+    header(NULL), slots(NULL), map_size(0), owns_mapping(false),
+    writer_pid(0)
+{
+    set_name(name); // guaranteed to succeed
+}
+
+shm_ring_t::~shm_ring_t()
+{
+    close();
+}
+
+bool
+shm_ring_t::set_name(const char *name)
+{
+    if (header == NULL) {
+        path = std::string(std::string(ring_dir()) + "/" + name + ".ring");
+        return true;
+    }
+    return false;
+}
+
+const std::string &
+shm_ring_t::get_path() const
+{
+    return path;
+}
+
+size_t
+shm_ring_t::region_size(unsigned int num_slots, size_t slot_size)
+{
+    return PAGE_ALIGN(sizeof(shm_ring_header_t)) + num_slots * PAGE_ALIGN(slot_size);
+}
+
+size_t
+shm_ring_t::get_slot_size() const
+{
+    return header == NULL ? 0 : header->slot_size;
+}
+
+bool
+shm_ring_t::create(unsigned int num_slots, size_t slot_size)
+{
+    if (header != NULL || num_slots == 0 || num_slots > SHM_RING_MAX_SLOTS)
+        return false;
+    slot_size = PAGE_ALIGN(slot_size);
+    size_t size = region_size(num_slots, slot_size);
+    // Remove any stale region from a prior run so writers cannot attach to it.
+    unlink(path.c_str());
+    umask(0);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, SHM_RING_PERMS);
+    if (fd < 0)
+        return false;
+    if (ftruncate(fd, size) != 0) {
+        ::close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    header = (shm_ring_header_t *)map;
+    map_size = size;
+    owns_mapping = true;
+    slots = (unsigned char *)map + PAGE_ALIGN(sizeof(shm_ring_header_t));
+    // The file is zero-filled, so we only need to set the non-zero fields.
+    header->version = SHM_RING_VERSION;
+    header->num_slots = num_slots;
+    header->slot_size = (uint32_t)slot_size;
+    header->region_size = size;
+    queue_init(&header->free_queue, num_slots);
+    queue_init(&header->ready_queue, num_slots);
+    for (uint32_t i = 0; i < num_slots; i++)
+        queue_push(&header->free_queue, i);
+    __sync_synchronize();
+    header->magic = SHM_RING_MAGIC;
+    return true;
+}
+
+bool
+shm_ring_t::destroy()
+{
+    close();
+    return (unlink(path.c_str()) == 0);
+}
+
+bool
+shm_ring_t::attach(void *base, size_t size)
+{
+    shm_ring_header_t *hdr = (shm_ring_header_t *)base;
+    if (header != NULL || size < sizeof(*hdr) || hdr->magic != SHM_RING_MAGIC ||
+        hdr->version != SHM_RING_VERSION || hdr->region_size != size)
+        return false;
+    __sync_synchronize();
+    header = hdr;
+    map_size = size;
+    slots = (unsigned char *)base + PAGE_ALIGN(sizeof(shm_ring_header_t));
+    return true;
+}
+
+bool
+shm_ring_t::open_for_write()
+{
+    int fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(shm_ring_header_t)) {
+        ::close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    if (!attach(map, st.st_size)) {
+        munmap(map, st.st_size);
+        return false;
+    }
+    owns_mapping = true;
+    return true;
+}
+
+bool
+shm_ring_t::close()
+{
+    if (header == NULL)
+        return true;
+    if (writer_pid != 0) {
+        for (int i = 0; i < SHM_RING_MAX_WRITERS; i++) {
+            if (__sync_bool_compare_and_swap(&header->writers[i], writer_pid, 0))
+                break;
+        }
+        writer_pid = 0;
+    }
+    if (owns_mapping)
+        munmap(header, map_size);
+    header = NULL;
+    slots = NULL;
+    owns_mapping = false;
+    return true;
+}
+
+bool
+shm_ring_t::add_writer(int pid)
+{
+    if (header == NULL || writer_pid == pid)
+        return false;
+    for (int i = 0; i < SHM_RING_MAX_WRITERS; i++) {
+        if (__sync_bool_compare_and_swap(&header->writers[i], 0, pid)) {
+            writer_pid = pid;
+            header->ever_attached = 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+shm_ring_t::any_live_writer()
+{
+    bool live = false;
+    for (int i = 0; i < SHM_RING_MAX_WRITERS; i++) {
+        int32_t pid = header->writers[i];
+        if (pid == 0)
+            continue;
+        if (kill(pid, 0) != 0 && errno == ESRCH) {
+            // The writer died without detaching.
+            __sync_bool_compare_and_swap(&header->writers[i], pid, 0);
+            continue;
+        }
+        live = true;
+    }
+    return live;
+}
+
+void *
+shm_ring_t::acquire_buffer()
+{
+    uint32_t idx;
+    if (header == NULL || !queue_pop(&header->free_queue, &idx))
+        return NULL;
+    return slots + (size_t)idx * header->slot_size;
+}
+
+void
+shm_ring_t::publish_buffer(void *buf IN, size_t used)
+{
+    uint32_t idx = (uint32_t)(((unsigned char *)buf - slots) / header->slot_size);
+    header->used[idx] = (uint32_t)used;
+    // queue_push has a barrier before it makes the slot visible.
+    queue_push(&header->ready_queue, idx);
+}
+
+void *
+shm_ring_t::acquire_ready(size_t *used OUT, bool *eof OUT)
+{
+    uint32_t idx;
+    *eof = false;
+    if (header == NULL) {
+        *eof = true;
+        return NULL;
+    }
+    if (!queue_pop(&header->ready_queue, &idx)) {
+        if (!header->ever_attached || any_live_writer())
+            return NULL;
+        // A writer publishes everything before it detaches, so one more look
+        // is enough to not miss its last buffers.
+        __sync_synchronize();
+        if (!queue_pop(&header->ready_queue, &idx)) {
+            *eof = true;
+            return NULL;
+        }
+    }
+    *used = header->used[idx];
+    return slots + (size_t)idx * header->slot_size;
+}
+
+void
+shm_ring_t::release_buffer(void *buf IN)
+{
+    uint32_t idx = (uint32_t)(((unsigned char *)buf - slots) / header->slot_size);
+    queue_push(&header->free_queue, idx);
+}
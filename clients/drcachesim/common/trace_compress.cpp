@@ -0,0 +1,344 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* trace_compress: see trace_compress.h for the format.
+ * This is shared between the tracer client and the simulator so we avoid
+ * the STL and any memory allocation.
+ */
+
+#include <string.h>
+#include "trace_compress.h"
+
+// Each entry is encoded as a tag byte holding the type and a size code, then
+// a varint size unless the size code covers it, and then an address field
+// whose form depends on the type.  The types from TAG_TYPE_ESCAPE on, which
+// are rare, put the escape in the tag and the rest of the type in a second
+// byte.  The worst case is a full 64-bit varint, which is 10 bytes, and the
+// size takes at most 3 bytes.
+#define MAX_ENCODED_ENTRY_SIZE (2 + 3 + 10)
+
+#define TAG_TYPE_BITS 5
+#define TAG_TYPE_MASK ((1 << TAG_TYPE_BITS) - 1)
+#define TAG_TYPE_ESCAPE TAG_TYPE_MASK
+// Every trace_type_t must fit in the tag and the escape byte:
+// TRACE_TYPE_SYSCALL_END is the last.
+typedef char tag_type_bits_check[(TRACE_TYPE_SYSCALL_END - TAG_TYPE_ESCAPE <= 0xff) ?
+                                 1 : -1];
+
+// The sizes that fit in the tag, by size code.  Code 0 means a varint follows.
+static const unsigned short tag_sizes[] = { 0, 1, 2, 3, 4, 5, 6, 8 };
+#define NUM_TAG_SIZES (sizeof(tag_sizes) / sizeof(tag_sizes[0]))
+
+typedef enum {
+    ADDR_RAW,    // varint of the value (thread and process ids)
+    ADDR_PC,     // zigzag delta from the expected next pc
+    ADDR_DATA,   // zigzag delta from the previous data address of its class
+    ADDR_BUNDLE, // size lengths, two 4-bit lengths per byte
+} addr_kind_t;
+
+// Reads and writes tend to walk different streams, so each is delta-encoded
+// against its own kind; prefetches and flushes share a third base.
+typedef enum {
+    DATA_READ,
+    DATA_WRITE,
+    DATA_OTHER,
+    NUM_DATA_CLASSES,
+} data_class_t;
+
+static inline data_class_t
+data_class(unsigned short type)
+{
+    if (type == TRACE_TYPE_READ)
+        return DATA_READ;
+    if (type == TRACE_TYPE_WRITE)
+        return DATA_WRITE;
+    return DATA_OTHER;
+}
+
+typedef struct {
+    addr_t next_pc;
+    addr_t prev_data[NUM_DATA_CLASSES];
+} delta_state_t;
+
+static inline void
+delta_state_init(delta_state_t *state)
+{
+    memset(state, 0, sizeof(*state));
+}
+
+static inline addr_kind_t
+addr_kind(unsigned short type)
+{
+    switch (type) {
+    case TRACE_TYPE_INSTR:
+    case TRACE_TYPE_INSTR_PC:
+    case TRACE_TYPE_INSTR_BLOCK:
+        return ADDR_PC;
+    case TRACE_TYPE_INSTR_BUNDLE:
+        return ADDR_BUNDLE;
+    case TRACE_TYPE_THREAD:
+    case TRACE_TYPE_THREAD_EXIT:
+    case TRACE_TYPE_PID:
+    case TRACE_TYPE_TIMESTAMP:
+    case TRACE_TYPE_L0I_HITS:
+    case TRACE_TYPE_L0D_HITS:
+    case TRACE_TYPE_CPU_ID:
+    case TRACE_TYPE_SYSCALL:
+    case TRACE_TYPE_SYSCALL_END:
+        return ADDR_RAW;
+    default:
+        // Memory references, prefetches, and flushes.
+        return ADDR_DATA;
+    }
+}
+
+static inline unsigned char *
+encode_varint(unsigned char *out, uint64_t val)
+{
+    while (val >= 0x80) {
+        *out++ = (unsigned char)(val | 0x80);
+        val >>= 7;
+    }
+    *out++ = (unsigned char)val;
+    return out;
+}
+
+static inline const unsigned char *
+decode_varint(const unsigned char *in, const unsigned char *end, uint64_t *val)
+{
+    uint64_t res = 0;
+    int shift = 0;
+    while (in < end && shift < 64) {
+        unsigned char byte = *in++;
+        res |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *val = res;
+            return in;
+        }
+        shift += 7;
+    }
+    return NULL;
+}
+
+// Deltas are computed in addr_t arithmetic and sign-extended so that
+// wraparound on 32-bit is handled correctly.
+static inline uint64_t
+zigzag_delta(addr_t val, addr_t base)
+{
+    int64_t delta = (int64_t)(intptr_t)(val - base);
+    return ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+}
+
+static inline addr_t
+unzigzag_delta(uint64_t val, addr_t base)
+{
+    int64_t delta = (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+    return base + (addr_t)delta;
+}
+
+uint64_t
+trace_entry_num_memrefs(const trace_entry_t *entry)
+{
+    // This must match how reader_t turns entries into memrefs.
+    switch (entry->type) {
+    case TRACE_TYPE_THREAD:
+    case TRACE_TYPE_PID:
+    case TRACE_TYPE_TIMESTAMP:
+    case TRACE_TYPE_INSTR_PC:
+        return 0;
+    case TRACE_TYPE_INSTR_BUNDLE:
+    case TRACE_TYPE_INSTR_BLOCK:
+        return entry->size;
+    case TRACE_TYPE_INSTR_FLUSH:
+    case TRACE_TYPE_DATA_FLUSH:
+        // A zero size means the size comes from the subsequent *_FLUSH_END.
+        return entry->size != 0 ? 1 : 0;
+    default:
+        return 1;
+    }
+}
+
+size_t
+trace_compress_bound(size_t num_entries)
+{
+    return sizeof(trace_chunk_header_t) + num_entries * MAX_ENCODED_ENTRY_SIZE;
+}
+
+static inline unsigned char *
+encode_entry(unsigned char *out, const trace_entry_t *entry, delta_state_t *state)
+{
+    unsigned char code;
+    for (code = 1; code < NUM_TAG_SIZES; code++) {
+        if (tag_sizes[code] == entry->size)
+            break;
+    }
+    if (code == NUM_TAG_SIZES)
+        code = 0;
+    if (entry->type >= TAG_TYPE_ESCAPE) {
+        *out++ = (unsigned char)(TAG_TYPE_ESCAPE | (code << TAG_TYPE_BITS));
+        *out++ = (unsigned char)(entry->type - TAG_TYPE_ESCAPE);
+    } else
+        *out++ = (unsigned char)(entry->type | (code << TAG_TYPE_BITS));
+    if (code == 0)
+        out = encode_varint(out, entry->size);
+    switch (addr_kind(entry->type)) {
+    case ADDR_PC:
+        out = encode_varint(out, zigzag_delta(entry->addr, state->next_pc));
+        state->next_pc = entry->addr + entry->size;
+        break;
+    case ADDR_BUNDLE:
+        // No supported ISA has instructions longer than 15 bytes.
+        for (int i = 0; i < entry->size && i < (int)sizeof(entry->length); i++) {
+            if (i % 2 == 0)
+                *out = entry->length[i] & 0xf;
+            else
+                *out++ |= (unsigned char)(entry->length[i] << 4);
+            state->next_pc += entry->length[i];
+        }
+        if (entry->size % 2 != 0)
+            out++;
+        break;
+    case ADDR_DATA: {
+        addr_t *prev_data = &state->prev_data[data_class(entry->type)];
+        out = encode_varint(out, zigzag_delta(entry->addr, *prev_data));
+        *prev_data = entry->addr;
+        break;
+    }
+    default:
+        out = encode_varint(out, (uint64_t)entry->addr);
+        break;
+    }
+    return out;
+}
+
+size_t
+trace_compress_chunk(const trace_entry_t *in, size_t num_entries, uint64_t pid,
+                     unsigned char *out)
+{
+    trace_chunk_header_t *header = (trace_chunk_header_t *)out;
+    unsigned char *payload = out + sizeof(*header);
+    unsigned char *cur = payload;
+    delta_state_t state;
+    delta_state_init(&state);
+    header->magic = TRACE_CHUNK_MAGIC;
+    header->num_entries = 0;
+    header->reserved = 0;
+    header->num_memrefs = 0;
+    for (size_t i = 0; i < num_entries; i++) {
+        cur = encode_entry(cur, &in[i], &state);
+        header->num_memrefs += trace_entry_num_memrefs(&in[i]);
+        header->num_entries++;
+        if (i == 0 && in[i].type == TRACE_TYPE_THREAD) {
+            // Make the chunk self-contained for random access.
+            trace_entry_t pid_entry;
+            pid_entry.type = TRACE_TYPE_PID;
+            pid_entry.size = sizeof(pid_entry.addr);
+            pid_entry.addr = (addr_t)pid;
+            cur = encode_entry(cur, &pid_entry, &state);
+            header->num_entries++;
+        }
+    }
+    header->encoded_size = (uint32_t)(cur - payload);
+    return cur - out;
+}
+
+bool
+trace_decompress_chunk(const trace_chunk_header_t *header, const unsigned char *payload,
+                       trace_entry_t *out)
+{
+    const unsigned char *cur = payload;
+    const unsigned char *end = payload + header->encoded_size;
+    delta_state_t state;
+    uint64_t val;
+    delta_state_init(&state);
+    if (header->magic != TRACE_CHUNK_MAGIC)
+        return false;
+    for (uint32_t i = 0; i < header->num_entries; i++) {
+        trace_entry_t *entry = &out[i];
+        if (cur >= end)
+            return false;
+        unsigned char code = *cur >> TAG_TYPE_BITS;
+        entry->type = *cur++ & TAG_TYPE_MASK;
+        if (entry->type == TAG_TYPE_ESCAPE) {
+            if (cur >= end)
+                return false;
+            entry->type = (unsigned short)(TAG_TYPE_ESCAPE + *cur++);
+        }
+        if (code == 0) {
+            cur = decode_varint(cur, end, &val);
+            if (cur == NULL)
+                return false;
+            entry->size = (unsigned short)val;
+        } else
+            entry->size = tag_sizes[code];
+        entry->addr = 0;
+        switch (addr_kind(entry->type)) {
+        case ADDR_PC:
+            cur = decode_varint(cur, end, &val);
+            if (cur == NULL)
+                return false;
+            entry->addr = unzigzag_delta(val, state.next_pc);
+            state.next_pc = entry->addr + entry->size;
+            break;
+        case ADDR_BUNDLE:
+            if (entry->size > sizeof(entry->length) ||
+                cur + (entry->size + 1) / 2 > end)
+                return false;
+            for (int j = 0; j < entry->size; j++) {
+                if (j % 2 == 0)
+                    entry->length[j] = *cur & 0xf;
+                else
+                    entry->length[j] = *cur++ >> 4;
+                state.next_pc += entry->length[j];
+            }
+            if (entry->size % 2 != 0)
+                cur++;
+            break;
+        case ADDR_DATA: {
+            addr_t *prev_data = &state.prev_data[data_class(entry->type)];
+            cur = decode_varint(cur, end, &val);
+            if (cur == NULL)
+                return false;
+            entry->addr = unzigzag_delta(val, *prev_data);
+            *prev_data = entry->addr;
+            break;
+        }
+        default:
+            cur = decode_varint(cur, end, &val);
+            if (cur == NULL)
+                return false;
+            entry->addr = (addr_t)val;
+            break;
+        }
+    }
+    return cur == end;
+}
@@ -0,0 +1,118 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* trace_compress: a chunked, compressed container for trace files and for the
+ * default shared pipe.
+ *
+ * The raw trace_entry_t records are 16 bytes on 64-bit, while most of their
+ * content is predictable: instruction fetches mostly fall through and data
+ * addresses are usually near the previous data address of the same type.  We
+ * store each chunk of entries with the type and a common size in one byte,
+ * addresses delta-encoded in variable-length integers, and instruction bundle
+ * lengths packed two to a byte.
+ *
+ * File layout:
+ *   trace_file_header_t
+ *   sequence of chunks, each a trace_chunk_header_t followed by its payload
+ *   optional chunk index: num_chunks trace_chunk_index_t, then trace_index_footer_t
+ *
+ * Each chunk is encoded independently and starts with a thread entry followed
+ * by a process entry, so a reader can decode any chunk on its own (e.g., in
+ * parallel) and can skip whole chunks using the memref counts in the index.
+ * If the index is missing, e.g., because the application was killed, the
+ * chunk headers can be walked instead.
+ *
+ * Over a pipe, each atomic write is a single chunk, with no file header or index.
+ */
+
+#ifndef _TRACE_COMPRESS_H_
+#define _TRACE_COMPRESS_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include "trace_entry.h"
+
+#define TRACE_FILE_MAGIC "DRMTCMP1"
+#define TRACE_INDEX_MAGIC "DRMTIDX1"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_FILE_VERSION 2
+#define TRACE_CHUNK_MAGIC 0x4b4e4843 /* "CHNK" */
+
+typedef struct _trace_file_header_t {
+    char magic[TRACE_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t reserved;
+} trace_file_header_t;
+
+typedef struct _trace_chunk_header_t {
+    uint32_t magic;
+    uint32_t encoded_size; // payload bytes following this header
+    uint32_t num_entries;  // trace_entry_t records encoded in the payload
+    uint32_t reserved;
+    uint64_t num_memrefs;  // memref_t records the reader will produce
+} trace_chunk_header_t;
+
+typedef struct _trace_chunk_index_t {
+    uint64_t offset; // file offset of the chunk header
+    uint64_t num_memrefs;
+} trace_chunk_index_t;
+
+typedef struct _trace_index_footer_t {
+    uint64_t index_offset;
+    uint64_t num_chunks;
+    char magic[TRACE_MAGIC_SIZE];
+} trace_index_footer_t;
+
+// Returns the number of memref_t records a reader produces for this entry.
+uint64_t
+trace_entry_num_memrefs(const trace_entry_t *entry);
+
+// Returns the maximum size of an encoded chunk of num_entries entries,
+// including its header.
+size_t
+trace_compress_bound(size_t num_entries);
+
+// Encodes the num_entries entries starting at "in" into "out", which must hold
+// at least trace_compress_bound(num_entries + 1) bytes, as a chunk header plus
+// payload.  If the first entry is a thread entry, a process entry for pid is
+// encoded right after it.  Returns the total number of bytes written.
+size_t
+trace_compress_chunk(const trace_entry_t *in, size_t num_entries, uint64_t pid,
+                     unsigned char *out);
+
+// Decodes a chunk payload into "out", which must hold header->num_entries entries.
+// Returns false if the payload is malformed.
+bool
+trace_decompress_chunk(const trace_chunk_header_t *header, const unsigned char *payload,
+                       trace_entry_t *out);
+
+#endif /* _TRACE_COMPRESS_H_ */
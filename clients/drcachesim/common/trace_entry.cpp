@@ -44,6 +44,7 @@ const char * const trace_type_names[] = {
     "prefetch_write",
     "prefetch_instr",
     "instr",
+    "instr_bundle",
     "instr_flush",
     "instr_flush_end",
     "data_flush",
@@ -51,4 +52,18 @@ const char * const trace_type_names[] = {
     "thread",
     "thread_exit",
     "pid",
+    "timestamp",
+    "l0i_hits",
+    "l0d_hits",
+    "cpu_id",
+    "instr_pc",
+    "instr_block",
+    "hardware_prefetch",
+    "writeback",
+    "alloc",
+    "alloc_site",
+    "alloc_end",
+    "free",
+    "syscall",
+    "syscall_end",
 };
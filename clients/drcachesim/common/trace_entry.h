@@ -33,8 +33,9 @@
 /* This is the binary data format for what we send through IPC between the
  * memory tracing clients running inside the application(s) and the simulator
  * process.
- * We aren't bothering to pack it as it won't be over the network or persisted.
- * It's already arranged to minimize padding.
+ * We don't pack it, to keep it cheap to produce and consume.  It's already
+ * arranged to minimize padding.  Where bytes matter, with -compress,
+ * trace_compress.h provides a variable-length encoding of these records.
  * We do save space using heterogenous data via the type field to send
  * thread id data only periodically rather than paying for the cost of a
  * thread id field in every entry.
@@ -105,6 +106,68 @@ typedef enum {
     // These entries indicate which process the current thread belongs to.
     // The process id is in the addr field.
     TRACE_TYPE_PID,
+
+    // These entries follow the thread entry at the start of each buffer and
+    // hold the time, in microseconds, at which the tracer began filling that
+    // buffer.  Readers merging several streams order buffers by this value.
+    // XXX: on 32-bit the value is truncated to the addr field's size.
+    TRACE_TYPE_TIMESTAMP,
+
+    // With -L0_filter, the tracer omits the instruction fetches and the data
+    // loads and stores that hit in its per-thread L0 caches.  These entries
+    // hold, in the addr field, how many of the current thread's instruction
+    // fetches or data references respectively were omitted since the previous
+    // entry of the same type.
+    TRACE_TYPE_L0I_HITS,
+    TRACE_TYPE_L0D_HITS,
+
+    // These entries follow the timestamp at the start of each buffer and hold,
+    // in the addr field, the id of the cpu the thread was running on when the
+    // tracer began filling that buffer, or -1 where that is not available.
+    TRACE_TYPE_CPU_ID,
+
+    // With -data_only, the tracer omits instruction fetches.  These entries
+    // instead precede the data references of each instr and hold its pc in the
+    // addr field and its length in the size field.  They are not fetches.
+    TRACE_TYPE_INSTR_PC,
+
+    // With -instr_only, the tracer records no data references and one of these
+    // entries per execution of a basic block, in place of that block's instr
+    // and instr bundle entries.  The addr field holds the block's start pc and
+    // the size field its number of instrs.  The lengths of the block's instrs
+    // are listed once, in the block file described below, and the reader
+    // expands each block entry into its instr fetches.
+    TRACE_TYPE_INSTR_BLOCK,
+
+    // A prefetch issued by a hardware prefetcher model in the cache simulator.
+    // It never appears in a trace.
+    TRACE_TYPE_HARDWARE_PREFETCH,
+
+    // A write of a dirty block, or of a write passed through, from a cache
+    // model in the cache simulator to its parent.  It never appears in a trace.
+    TRACE_TYPE_WRITEBACK,
+
+    // With -record_allocs, the tracer records each heap allocation and mapping
+    // the app makes as three entries: TRACE_TYPE_ALLOC with the start address,
+    // TRACE_TYPE_ALLOC_SITE with the return address of the allocating call, and
+    // TRACE_TYPE_ALLOC_END with the end address (exclusive), all in the addr
+    // field.  The reader passes on one TRACE_TYPE_ALLOC memref with the start
+    // in addr, the size in size, and the call site in pc.  A TRACE_TYPE_FREE
+    // entry, passed on as is, holds the start address of an allocation freed
+    // or of a range unmapped.  The size field of all of these is 0.
+    TRACE_TYPE_ALLOC,
+    TRACE_TYPE_ALLOC_SITE,
+    TRACE_TYPE_ALLOC_END,
+    TRACE_TYPE_FREE,
+
+    // With -record_syscalls, the tracer records each system call the app makes
+    // as a TRACE_TYPE_SYSCALL entry before it and a TRACE_TYPE_SYSCALL_END entry
+    // once it returns, both with the syscall number in the size field.  The
+    // addr field is 0 for the former and holds for the latter the time, in
+    // microseconds, the syscall took.  A syscall that does not return, such as
+    // exit, has no end entry.  The reader passes both on as is.
+    TRACE_TYPE_SYSCALL,
+    TRACE_TYPE_SYSCALL_END,
 } trace_type_t;
 
 extern const char * const trace_type_names[];
@@ -127,6 +190,40 @@ typedef struct _trace_entry_t {
     };
 } trace_entry_t;
 
+// In offline mode the tracer writes each thread's buffers, unmodified, to a
+// separate file.  A file is simply a sequence of trace_entry_t records
+// starting with the thread and process entries for that thread.
+#define OUTFILE_PREFIX "drmemtrace"
+#define OUTFILE_SUFFIX "trace"
+
+// With -thread_pipes, the tracer announces each thread with thread and
+// process entries on the main pipe and then sends that thread's buffers over
+// its own named pipe whose name is the -ipc_name value followed by this
+// suffix and the thread id.
+#define THREAD_PIPE_SUFFIX ".t"
+
+// The tracer lists each process's modules, one "start end path" line per
+// module, so that the simulator can symbolize instruction addresses.  In offline
+// mode the list is named OUTFILE_PREFIX.<pid>.MODULE_FILE_SUFFIX in -outdir.
+// Otherwise it is named after the named pipe: <pipe path>.<pid>.MODULE_FILE_SUFFIX.
+#define MODULE_FILE_SUFFIX "modules"
+
+// With -use_physical, the tracer also lists the large pages it translated,
+// one "start end size" line per page with physical addresses, in the format
+// read by the simulator's -page_size_file, named as above but with this suffix.
+#define PAGE_SIZE_FILE_SUFFIX "page_sizes"
+
+// With -use_physical on a NUMA system, the tracer also lists the NUMA node
+// holding each physical page it translated, as "start end node" lines with
+// physical addresses and adjacent pages on one node merged, in the format read
+// by the simulator's -page_node_file, named as above but with this suffix.
+#define PAGE_NODE_FILE_SUFFIX "page_nodes"
+
+// With -instr_only, the tracer lists each basic block it instruments, before
+// the block can run, as a "start count length,length,..." line with a hex start
+// pc and decimal instr lengths, named as above but with this suffix.
+#define BLOCK_FILE_SUFFIX "blocks"
+
 static inline bool
 type_is_prefetch(unsigned short type)
 {
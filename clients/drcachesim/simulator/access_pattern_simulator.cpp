@@ -0,0 +1,283 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <assert.h>
+#include <stdint.h> /* for supporting 64-bit integers*/
+#include "utils.h"
+#include "memref.h"
+#include "droption.h"
+#include "../common/options.h"
+#include "access_pattern_simulator.h"
+
+const char * const access_pattern_simulator_t::pattern_names[] = {
+    "constant stride",
+    "streaming",
+    "pointer-chasing",
+    "irregular",
+};
+
+// The shares of an instruction's accesses, after its first, that its pattern's
+// test must predict.  A streaming instruction may also be predicted by stride.
+#define STRIDE_THRESHOLD 0.75
+#define STREAM_THRESHOLD 0.75
+#define CHASE_THRESHOLD 0.5
+
+// We stop adding to an instruction's successor table once it is this large.
+#define MAX_SUCCESSORS (64*1024)
+
+bool
+access_pattern_simulator_t::init()
+{
+    if (!create_reader())
+        return false;
+
+    // We do not model cores.
+    num_cores = 1;
+    thread_counts = NULL;
+    thread_ever_counts = NULL;
+
+    line_bits = compute_log2((int)op_line_size.get_value());
+    if (line_bits == -1) {
+        ERROR("Usage error: the line size must be a power of 2.\n");
+        return false;
+    }
+    return true;
+}
+
+access_pattern_simulator_t::~access_pattern_simulator_t()
+{
+}
+
+void
+access_pattern_simulator_t::access(const memref_t &memref)
+{
+    pc_stats_t &stats = pc_stats[memref.pc];
+    addr_t final_addr = memref.addr + memref.size - 1/*avoid overflow*/;
+    stats.accesses++;
+    for (addr_t line = memref.addr >> line_bits; line <= final_addr >> line_bits;
+         line++)
+        stats.lines.insert(line);
+
+    if (stats.accesses > 1 && stats.last_tid == memref.tid) {
+        int_least64_t delta = (int_least64_t)(memref.addr - stats.last_addr);
+        int_least64_t line_size = (int_least64_t)1 << line_bits;
+        stats.deltas++;
+        if (stats.have_delta && delta == stats.last_delta)
+            stats.stride_hits++;
+        else if (delta >= -line_size && delta <= line_size)
+            stats.stream_hits++;
+        else {
+            std::map<addr_t, addr_t>::iterator it =
+                stats.successors.find(stats.last_addr);
+            if (it != stats.successors.end()) {
+                if (it->second == memref.addr)
+                    stats.chase_hits++;
+                else
+                    it->second = memref.addr;
+            } else if (stats.successors.size() < MAX_SUCCESSORS)
+                stats.successors[stats.last_addr] = memref.addr;
+        }
+        if (stats.stride_votes == 0) {
+            stats.stride = delta;
+            stats.stride_votes = 1;
+        } else if (delta == stats.stride)
+            stats.stride_votes++;
+        else
+            stats.stride_votes--;
+        stats.last_delta = delta;
+        stats.have_delta = true;
+    } else
+        stats.have_delta = false;
+    stats.last_tid = memref.tid;
+    stats.last_addr = memref.addr;
+}
+
+void
+access_pattern_simulator_t::reset()
+{
+    // We keep each instruction's previous access and successors, which are
+    // still valid.
+    for (std::map<addr_t, pc_stats_t>::iterator it = pc_stats.begin();
+         it != pc_stats.end(); ++it) {
+        pc_stats_t &stats = it->second;
+        stats.accesses = 0;
+        stats.lines.clear();
+        stats.deltas = 0;
+        stats.stride_hits = 0;
+        stats.stream_hits = 0;
+        stats.chase_hits = 0;
+        stats.stride_votes = 0;
+    }
+}
+
+access_pattern_simulator_t::pattern_t
+access_pattern_simulator_t::classify(const pc_stats_t &stats)
+{
+    if (stats.deltas == 0)
+        return PATTERN_IRREGULAR;
+    if (stats.stride_hits >= STRIDE_THRESHOLD * stats.deltas)
+        return PATTERN_STRIDE;
+    if (stats.stride_hits + stats.stream_hits >= STREAM_THRESHOLD * stats.deltas)
+        return PATTERN_STREAM;
+    if (stats.chase_hits >= CHASE_THRESHOLD * stats.deltas)
+        return PATTERN_POINTER_CHASE;
+    return PATTERN_IRREGULAR;
+}
+
+double
+access_pattern_simulator_t::score(const pc_stats_t &stats)
+{
+    if (stats.deltas == 0)
+        return 0.0;
+    return (double)(stats.stride_hits + stats.stream_hits + stats.chase_hits) /
+        stats.deltas;
+}
+
+bool
+access_pattern_simulator_t::run()
+{
+    if (!reader->init()) {
+        if (op_infile.get_value().empty())
+            ERROR("failed to read from pipe %s", op_ipc_name.get_value().c_str());
+        else
+            ERROR("failed to read from %s", op_infile.get_value().c_str());
+        return false;
+    }
+
+    uint64_t warmup_refs = op_warmup_refs.get_value();
+    uint64_t sim_refs = op_sim_refs.get_value();
+
+    reader->skip_memrefs(op_skip_refs.get_value());
+
+    for (; *reader != *reader_end; ++(*reader)) {
+        memref_t memref = **reader;
+
+        // the references after warmup and simulated ones are dropped
+        if (warmup_refs == 0 && sim_refs == 0)
+            continue;
+
+        if (memref.type == TRACE_TYPE_READ ||
+            memref.type == TRACE_TYPE_WRITE)
+            access(memref);
+        else if (memref.type == TRACE_TYPE_INSTR ||
+                 type_is_prefetch(memref.type) ||
+                 memref.type == TRACE_TYPE_INSTR_FLUSH ||
+                 memref.type == TRACE_TYPE_DATA_FLUSH ||
+                 memref.type == TRACE_TYPE_THREAD_EXIT ||
+                 memref.type == TRACE_TYPE_CPU_ID ||
+                 memref.type == TRACE_TYPE_ALLOC ||
+                 memref.type == TRACE_TYPE_FREE ||
+                 memref.type == TRACE_TYPE_SYSCALL ||
+                 memref.type == TRACE_TYPE_SYSCALL_END) {
+            // We only analyze data accesses.
+        } else {
+            ERROR("unhandled memref type");
+            return false;
+        }
+
+        if (op_verbose.get_value() >= 3) {
+            std::cerr << "::" << memref.pid << "." << memref.tid << ":: " <<
+                " @" << (void *)memref.pc <<
+                " " << trace_type_names[memref.type] << " " <<
+                (void *)memref.addr << " x" << memref.size << std::endl;
+        }
+
+        // process counters for warmup and simulated references
+        if (warmup_refs > 0) {
+            warmup_refs--;
+            if (warmup_refs == 0)
+                reset();
+        }
+        else
+            sim_refs--;
+    }
+    return true;
+}
+
+static bool
+pc_accesses_greater(const std::pair<addr_t, int_least64_t> &a,
+                    const std::pair<addr_t, int_least64_t> &b)
+{
+    return a.second > b.second;
+}
+
+bool
+access_pattern_simulator_t::print_stats()
+{
+    int_least64_t pcs_by_pattern[PATTERN_COUNT] = {0};
+    int_least64_t accesses_by_pattern[PATTERN_COUNT] = {0};
+    std::vector<std::pair<addr_t, int_least64_t> > pcs;
+    for (std::map<addr_t, pc_stats_t>::iterator it = pc_stats.begin();
+         it != pc_stats.end(); ++it) {
+        if (it->second.accesses == 0)
+            continue;
+        pattern_t pattern = classify(it->second);
+        pcs_by_pattern[pattern]++;
+        accesses_by_pattern[pattern] += it->second.accesses;
+        pcs.push_back(std::make_pair(it->first, it->second.accesses));
+    }
+    std::cerr << "Access patterns of data accesses by instruction, all threads:" <<
+        std::endl;
+    std::cerr << "  " << std::setw(18) << std::left << "Pattern" <<
+        std::setw(14) << std::right << "Instrs" << std::setw(16) << std::right <<
+        "Accesses" << std::endl;
+    for (int i = 0; i < PATTERN_COUNT; i++) {
+        std::cerr << "  " << std::setw(18) << std::left << pattern_names[i] <<
+            std::setw(14) << std::right << pcs_by_pattern[i] <<
+            std::setw(16) << std::right << accesses_by_pattern[i] << std::endl;
+    }
+    std::sort(pcs.begin(), pcs.end(), pc_accesses_greater);
+    std::cerr << "  Top " << op_ap_top_pcs.get_value() << " instructions by "
+        "accesses (pc, pattern, accesses, bytes touched, stride, prefetchable):" <<
+        std::endl;
+    for (size_t i = 0; i < pcs.size() && i < op_ap_top_pcs.get_value(); i++) {
+        const pc_stats_t &stats = pc_stats[pcs[i].first];
+        pattern_t pattern = classify(stats);
+        std::cerr << "    " << std::setw(18) << std::left << (void *)pcs[i].first <<
+            std::setw(18) << std::left << pattern_names[pattern] <<
+            std::setw(14) << std::right << stats.accesses <<
+            std::setw(14) << std::right << ((int_least64_t)stats.lines.size() <<
+                                            line_bits);
+        if (pattern == PATTERN_STRIDE)
+            std::cerr << std::setw(10) << std::right << stats.stride;
+        else
+            std::cerr << std::setw(10) << std::right << "-";
+        std::cerr << std::setw(9) << std::right << std::fixed <<
+            std::setprecision(1) << score(stats) * 100 << "%" << std::endl;
+    }
+    return true;
+}
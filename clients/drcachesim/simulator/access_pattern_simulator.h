@@ -0,0 +1,106 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* access_pattern_simulator: classifies the access pattern of each instruction.
+ */
+
+#ifndef _ACCESS_PATTERN_SIMULATOR_H_
+#define _ACCESS_PATTERN_SIMULATOR_H_ 1
+
+#include <map>
+#include <set>
+#include <string>
+#include "simulator.h"
+
+// Classifies the data accesses of each static load or store by how the
+// address of each access relates to that of the instruction's previous access
+// in the same thread:
+// - constant stride: the same distance as the time before;
+// - streaming: otherwise within a cache line of the previous address;
+// - pointer-chasing: otherwise the address that followed the previous address
+//   the last time that was accessed, as repeated traversals of a linked
+//   structure produce;
+// - irregular: none of these.
+// We have no data values, so the pointer-chasing test only finds traversals
+// that recur.  The share of accesses that any of the three predicts is the
+// instruction's prefetchability score.
+class access_pattern_simulator_t : public simulator_t
+{
+ public:
+    virtual bool init();
+    virtual ~access_pattern_simulator_t();
+    virtual bool run();
+    virtual bool print_stats();
+
+ protected:
+    enum pattern_t {
+        PATTERN_STRIDE,
+        PATTERN_STREAM,
+        PATTERN_POINTER_CHASE,
+        PATTERN_IRREGULAR,
+        PATTERN_COUNT,
+    };
+    static const char * const pattern_names[];
+
+    struct pc_stats_t {
+        pc_stats_t() : accesses(0), last_tid(0), last_addr(0), last_delta(0),
+                       have_delta(false), deltas(0), stride_hits(0), stream_hits(0),
+                       chase_hits(0), stride(0), stride_votes(0) {}
+        int_least64_t accesses;
+        // The cache lines touched, for the bytes touched.
+        std::set<addr_t> lines;
+        // The previous access, which we only compare to in the same thread.
+        memref_tid_t last_tid;
+        addr_t last_addr;
+        int_least64_t last_delta;
+        bool have_delta;
+        int_least64_t deltas;
+        int_least64_t stride_hits;
+        int_least64_t stream_hits;
+        int_least64_t chase_hits;
+        // The most common stride, found by majority vote.
+        int_least64_t stride;
+        int_least64_t stride_votes;
+        // For the pointer-chasing test: the address that followed each address.
+        std::map<addr_t, addr_t> successors;
+    };
+
+    void access(const memref_t &memref);
+    void reset();
+    pattern_t classify(const pc_stats_t &stats);
+    double score(const pc_stats_t &stats);
+
+    int line_bits;
+    std::map<addr_t, pc_stats_t> pc_stats;
+};
+
+#endif /* _ACCESS_PATTERN_SIMULATOR_H_ */
@@ -30,46 +30,37 @@
  * DAMAGE.
  */
 
-#include "cache_lru.h"
+#include "alloc_map.h"
 
-// For LRU implementation, we use the cache line counter to represent
-// how recently a cache line is accessed.
-// The count value 0 means the most recent access, and the cache line with the
-// highest counter value will be picked for replacement in replace_which_way.
+alloc_map_t::alloc_map_t()
+{
+    last.start = 0;
+    last.end = 0;
+    last.site = 0;
+}
 
 void
-cache_lru_t::access_update(int line_idx, int way)
+alloc_map_t::update(const memref_t &memref)
 {
-    int cnt = get_caching_device_block(line_idx, way).counter;
-    // Optimization: return early if it is a repeated access.
-    if (cnt == 0)
+    last.end = last.start;
+    if (memref.type == TRACE_TYPE_FREE) {
+        allocs.erase(memref.addr);
         return;
-    // We inc all the counters that are not larger than cnt for LRU.
-    for (int i = 0; i < associativity; ++i) {
-        if (i != way && get_caching_device_block(line_idx, i).counter <= cnt)
-            get_caching_device_block(line_idx, i).counter++;
     }
-    // Clear the counter for LRU.
-    get_caching_device_block(line_idx, way).counter = 0;
-}
-
-int
-cache_lru_t::replace_which_way(int line_idx)
-{
-    // We implement LRU by picking the slot with the largest counter value.
-    int max_counter = 0;
-    int max_way = 0;
-    for (int way = 0; way < associativity; ++way) {
-        if (get_caching_device_block(line_idx, way).tag == TAG_INVALID) {
-            max_way = way;
-            break;
-        }
-        if (get_caching_device_block(line_idx, way).counter > max_counter) {
-            max_counter = get_caching_device_block(line_idx, way).counter;
-            max_way = way;
-        }
+    if (memref.size == 0)
+        return;
+    // Any allocation we still have that overlaps the new one was freed in a
+    // way we did not see, e.g., by an unwrapped routine or an unmap of part
+    // of a mapping, so we drop it.
+    alloc_t alloc = {memref.addr, memref.addr + memref.size, memref.pc};
+    std::map<addr_t, alloc_t>::iterator it = allocs.lower_bound(alloc.start);
+    if (it != allocs.begin()) {
+        std::map<addr_t, alloc_t>::iterator prev = it;
+        --prev;
+        if (prev->second.end > alloc.start)
+            allocs.erase(prev);
     }
-    // Set to non-zero for later access_update optimization on repeated access
-    get_caching_device_block(line_idx, max_way).counter = 1;
-    return max_way;
+    while (it != allocs.end() && it->first < alloc.end)
+        allocs.erase(it++);
+    allocs.insert(std::make_pair(alloc.start, alloc));
 }
@@ -0,0 +1,81 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* alloc_map: the live allocations of a trace recorded with -record_allocs.
+ */
+
+#ifndef _ALLOC_MAP_H_
+#define _ALLOC_MAP_H_ 1
+
+#include <map>
+#include "memref.h"
+
+// Maps the address ranges of the app's live allocations to the call sites
+// that allocated them, for -report_allocs.
+class alloc_map_t
+{
+ public:
+    alloc_map_t();
+    // Handles a TRACE_TYPE_ALLOC or TRACE_TYPE_FREE memref.
+    void update(const memref_t &memref);
+    // Returns whether addr lies in a live allocation, and if so its call site.
+    bool find(addr_t addr, addr_t *site)
+    {
+        if (addr - last.start < last.end - last.start) {
+            *site = last.site;
+            return true;
+        }
+        std::map<addr_t, alloc_t>::const_iterator it = allocs.upper_bound(addr);
+        if (it == allocs.begin())
+            return false;
+        --it;
+        if (addr >= it->second.end)
+            return false;
+        last = it->second;
+        *site = last.site;
+        return true;
+    }
+
+ private:
+    struct alloc_t {
+        addr_t start;
+        addr_t end;
+        addr_t site;
+    };
+    // Keyed by start.
+    std::map<addr_t, alloc_t> allocs;
+    // Optimization: the allocation of the last lookup, which is empty if
+    // there is none or it may have been freed.
+    alloc_t last;
+};
+
+#endif /* _ALLOC_MAP_H_ */
@@ -0,0 +1,167 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memref.h"
+#include "async_reader.h"
+#include "utils.h"
+
+// The decode thread fills one batch while the simulator works on the other.
+#define ASYNC_BATCHES 2
+#define ASYNC_BATCH_REFS (64*1024)
+
+async_reader_t::async_reader_t(reader_t *source_) :
+    source(source_), started(false), stopping(false), free_batches(ASYNC_BATCHES),
+    full_batches(ASYNC_BATCHES), cur_batch(NULL), cur_idx(0)
+{
+    batches = new batch_t[ASYNC_BATCHES];
+    for (int i = 0; i < ASYNC_BATCHES; i++) {
+        batches[i].refs = new memref_t[ASYNC_BATCH_REFS];
+        batches[i].count = 0;
+        free_batches.push(&batches[i]);
+    }
+}
+
+async_reader_t::~async_reader_t()
+{
+    if (started && !at_eof) {
+        // Hand back our batch so the decode thread can see that we are done.
+        // It may first have to wait for its source, e.g., for a live
+        // application to close its pipe.
+        stopping = true;
+        free_batches.push(cur_batch);
+    }
+    if (started)
+        pthread_join(decode_thread, NULL);
+    for (int i = 0; i < ASYNC_BATCHES; i++)
+        delete [] batches[i].refs;
+    delete [] batches;
+    delete source;
+}
+
+bool
+async_reader_t::init()
+{
+    if (!source->init())
+        return false;
+    // The source is already positioned at its first memref.  We do not start
+    // decoding until it is requested, in case the caller wants to skip.
+    at_eof = !(*source != reader_t());
+    return true;
+}
+
+void *
+async_reader_t::decode_thread_main(void *arg)
+{
+    async_reader_t *reader = (async_reader_t *) arg;
+    while (true) {
+        batch_t *batch = reader->free_batches.pop();
+        if (reader->stopping)
+            break;
+        batch->count = reader->source->next_batch(batch->refs, ASYNC_BATCH_REFS);
+        reader->full_batches.push(batch);
+        if (batch->count == 0)
+            break;
+    }
+    return NULL;
+}
+
+void
+async_reader_t::start()
+{
+    started = true;
+    if (pthread_create(&decode_thread, NULL, decode_thread_main, this) != 0) {
+        ERROR("failed to create decode thread");
+        exit(1);
+    }
+    cur_batch = full_batches.pop();
+    cur_idx = 0;
+    at_eof = (cur_batch->count == 0);
+}
+
+void
+async_reader_t::next_buffer()
+{
+    free_batches.push(cur_batch);
+    cur_batch = full_batches.pop();
+    cur_idx = 0;
+    at_eof = (cur_batch->count == 0);
+}
+
+const memref_t&
+async_reader_t::operator*()
+{
+    if (!started)
+        start();
+    assert(!at_eof);
+    return cur_batch->refs[cur_idx];
+}
+
+reader_t&
+async_reader_t::operator++()
+{
+    if (!started)
+        start();
+    if (!at_eof && ++cur_idx == cur_batch->count)
+        next_buffer();
+    return *this;
+}
+
+uint64_t
+async_reader_t::skip_memrefs(uint64_t count)
+{
+    if (started)
+        return reader_t::skip_memrefs(count);
+    uint64_t skipped = source->skip_memrefs(count);
+    at_eof = !(*source != reader_t());
+    return skipped;
+}
+
+size_t
+async_reader_t::next_batch(memref_t *out, size_t max)
+{
+    size_t count = 0;
+    if (!started && !at_eof)
+        start();
+    while (count < max && !at_eof) {
+        size_t avail = cur_batch->count - cur_idx;
+        size_t take = (max - count < avail) ? max - count : avail;
+        memcpy(out + count, cur_batch->refs + cur_idx, take * sizeof(*out));
+        count += take;
+        cur_idx += take;
+        if (cur_idx == cur_batch->count)
+            next_buffer();
+    }
+    return count;
+}
@@ -0,0 +1,86 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* async_reader: wraps another reader and decodes its memrefs on a separate
+ * thread.
+ */
+
+#ifndef _ASYNC_READER_H_
+#define _ASYNC_READER_H_ 1
+
+#include <pthread.h>
+#include "memref.h"
+#include "reader.h"
+#include "sim_queue.h"
+
+// The wrapped reader is driven from a decode thread, which fills large
+// batches of memrefs while the simulator consumes the previous one.  Thus the
+// simulator only waits on I/O when it has caught up with the input.
+// XXX i#1703: this is UNIX-only, like the rest of the simulator's
+// parallel mode.
+class async_reader_t : public reader_t
+{
+ public:
+    // Takes ownership of "source", which must not be initialized yet.
+    explicit async_reader_t(reader_t *source);
+    virtual ~async_reader_t();
+    virtual bool init();
+    virtual const memref_t& operator*();
+    virtual reader_t& operator++();
+    // Until the first memref is requested this is passed on to the wrapped
+    // reader, so it may still seek.
+    virtual uint64_t skip_memrefs(uint64_t count);
+    virtual size_t next_batch(memref_t *out, size_t max);
+
+ private:
+    struct batch_t {
+        memref_t *refs;
+        size_t count; // 0 marks the end of the input
+    };
+    typedef sim_queue_t<batch_t *> batch_queue_t;
+
+    static void *decode_thread_main(void *arg);
+    void start();
+    void next_buffer();
+
+    reader_t *source;
+    bool started;
+    volatile bool stopping;
+    pthread_t decode_thread;
+    batch_t *batches;
+    batch_queue_t free_batches;
+    batch_queue_t full_batches;
+    batch_t *cur_batch;
+    size_t cur_idx;
+};
+
+#endif /* _ASYNC_READER_H_ */
@@ -0,0 +1,365 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* benchmark: measures how fast the cache and TLB simulators run.
+ *
+ * The trace, either synthetic or the first -bench_refs memrefs of an -infile
+ * trace, is loaded into memory up front and replayed through a
+ * memory_reader_t, so that only the simulation itself is timed.  Each
+ * configuration is a set of simulator options, separated by "--":
+ *
+ *   drcachesim_bench [common options] [-- config options [-- config options]...]
+ *
+ * The common options apply to every configuration.  Without any
+ * configurations a built-in set is run, covering associativity, replacement
+ * policy, core count and hierarchy depth.  Each configuration runs in its own
+ * child process, so that its options do not leak into the next one.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "droption.h"
+#include "../common/options.h"
+#include "cache_simulator.h"
+#include "tlb_simulator.h"
+#include "file_reader.h"
+#include "memory_reader.h"
+#include "utils.h"
+
+static droption_t<bytesize_t> op_bench_refs
+(DROPTION_SCOPE_FRONTEND, "bench_refs", bytesize_t(10*1000*1000),
+ "Number of memrefs to simulate",
+ "The number of memrefs in the synthetic trace, or the maximum number loaded "
+ "from -infile.");
+
+static droption_t<unsigned int> op_bench_threads
+(DROPTION_SCOPE_FRONTEND, "bench_threads", 4, "Threads in the synthetic trace",
+ "The number of threads in the synthetic trace, whose references are "
+ "interleaved a few hundred at a time.");
+
+static droption_t<bytesize_t> op_bench_footprint
+(DROPTION_SCOPE_FRONTEND, "bench_footprint", bytesize_t(16*1024*1024),
+ "Data footprint of the synthetic trace",
+ "The size of the data the synthetic trace accesses: half of its data "
+ "references stream through it and the others are random.");
+
+static droption_t<unsigned int> op_bench_repeat
+(DROPTION_SCOPE_FRONTEND, "bench_repeat", 3, "Times to run each configuration",
+ "Each configuration is run this many times, on a freshly created simulator, "
+ "and the fastest run is reported.");
+
+// A simulator that reads its memrefs from memory.
+template <typename sim_t>
+class bench_simulator_t : public sim_t
+{
+ public:
+    explicit bench_simulator_t(const std::vector<memref_t> *refs_) : refs(refs_) {}
+
+ protected:
+    virtual bool create_reader()
+    {
+        this->reader = new memory_reader_t(refs);
+        this->reader_end = new memory_reader_t();
+        return true;
+    }
+
+ private:
+    const std::vector<memref_t> *refs;
+};
+
+// The built-in configurations, each named by its options unless it has a name.
+struct bench_config_t {
+    const char *name;
+    const char *ops;
+};
+static const bench_config_t default_configs[] = {
+    { "(default)", "" },
+    { NULL, "-L1I_assoc 2 -L1D_assoc 2 -LL_assoc 4" },
+    { NULL, "-L1I_assoc 32 -L1D_assoc 32 -LL_assoc 64" },
+    { NULL, "-replace_policy " REPLACE_POLICY_LFU },
+    { NULL, "-replace_policy " REPLACE_POLICY_FIFO },
+    { NULL, "-replace_policy " REPLACE_POLICY_PLRU },
+    { NULL, "-replace_policy " REPLACE_POLICY_SRRIP },
+    { NULL, "-replace_policy " REPLACE_POLICY_DRRIP },
+    { NULL, "-cores 1" },
+    { NULL, "-cores 16" },
+    { "(3 levels, 4 cores)", "-config_file @THREE_LEVELS@" },
+    { NULL, "-simulator_type " TLB },
+    { NULL, "-simulator_type " TLB " -cores 16" },
+};
+
+// For the built-in configurations, private L1 and L2 caches under a shared L3.
+static const char *const three_levels =
+    "num_cores 4\n"
+    "line_size 64\n"
+    "L1I0 { type instruction core 0 size 32K assoc 8 parent L2_0 }\n"
+    "L1D0 { type data core 0 size 32K assoc 8 parent L2_0 }\n"
+    "L1I1 { type instruction core 1 size 32K assoc 8 parent L2_1 }\n"
+    "L1D1 { type data core 1 size 32K assoc 8 parent L2_1 }\n"
+    "L1I2 { type instruction core 2 size 32K assoc 8 parent L2_2 }\n"
+    "L1D2 { type data core 2 size 32K assoc 8 parent L2_2 }\n"
+    "L1I3 { type instruction core 3 size 32K assoc 8 parent L2_3 }\n"
+    "L1D3 { type data core 3 size 32K assoc 8 parent L2_3 }\n"
+    "L2_0 { size 256K assoc 8 parent L3 }\n"
+    "L2_1 { size 256K assoc 8 parent L3 }\n"
+    "L2_2 { size 256K assoc 8 parent L3 }\n"
+    "L2_3 { size 256K assoc 8 parent L3 }\n"
+    "L3 { size 8M assoc 16 }\n";
+
+// Each thread runs through its own code, with a data reference after every
+// other instruction, alternating between streaming through the footprint and
+// jumping around it at random.  The trace is the same on every run.
+static void
+generate_trace(std::vector<memref_t> &refs)
+{
+    uint64_t num_refs = op_bench_refs.get_value();
+    unsigned int num_threads = op_bench_threads.get_value();
+    if (num_threads == 0)
+        num_threads = 1;
+    addr_t footprint = (addr_t)op_bench_footprint.get_value();
+    if (footprint < 64)
+        footprint = 64;
+    static const addr_t CODE_SIZE = 64*1024;
+    static const int SWITCH_REFS = 256;
+    std::vector<addr_t> pcs(num_threads), streams(num_threads);
+    for (unsigned int t = 0; t < num_threads; t++) {
+        pcs[t] = 0;
+        streams[t] = (footprint / num_threads) * t;
+    }
+    uint64_t seed = 42;
+    memref_t memref;
+    memset(&memref, 0, sizeof(memref));
+    refs.reserve((size_t)num_refs + num_threads);
+    for (uint64_t i = 0; i < num_refs; i++) {
+        unsigned int t = (unsigned int)((i / SWITCH_REFS) % num_threads);
+        memref.pid = 1;
+        memref.tid = t + 1;
+        if (i % 3 != 2) {
+            memref.type = TRACE_TYPE_INSTR;
+            memref.addr = 0x400000 + t * CODE_SIZE + pcs[t];
+            memref.size = 4;
+            memref.pc = memref.addr;
+            pcs[t] = (pcs[t] + 4) % CODE_SIZE;
+        } else {
+            memref.type = (i % 5 == 0) ? TRACE_TYPE_WRITE : TRACE_TYPE_READ;
+            memref.size = 8;
+            if (i % 2 == 0) {
+                memref.addr = 0x10000000 + streams[t];
+                streams[t] = (streams[t] + 8) % footprint;
+            } else {
+                seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                memref.addr = 0x10000000 + ((addr_t)((seed >> 24) % footprint) & ~7);
+            }
+        }
+        refs.push_back(memref);
+    }
+    for (unsigned int t = 0; t < num_threads; t++) {
+        memref.type = TRACE_TYPE_THREAD_EXIT;
+        memref.tid = t + 1;
+        memref.addr = 0;
+        memref.size = 0;
+        memref.pc = 0;
+        refs.push_back(memref);
+    }
+}
+
+static bool
+load_trace(std::vector<memref_t> &refs)
+{
+    file_reader_t reader(op_infile.get_value().c_str());
+    file_reader_t reader_end;
+    if (!reader.init()) {
+        ERROR("failed to read from %s\n", op_infile.get_value().c_str());
+        return false;
+    }
+    uint64_t max = op_bench_refs.get_value();
+    for (; reader != reader_end && refs.size() < max; ++reader)
+        refs.push_back(*reader);
+    return true;
+}
+
+static double
+now_seconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.;
+}
+
+// Runs one configuration, whose options have been parsed: returns the time of
+// the fastest run, or a negative value on failure.
+static double
+run_config(const std::vector<memref_t> &refs)
+{
+    double best = -1;
+    for (unsigned int i = 0; i < op_bench_repeat.get_value() || best < 0; i++) {
+        simulator_t *simulator;
+        if (op_simulator_type.get_value() == CPU_CACHE)
+            simulator = new bench_simulator_t<cache_simulator_t>(&refs);
+        else if (op_simulator_type.get_value() == TLB)
+            simulator = new bench_simulator_t<tlb_simulator_t>(&refs);
+        else {
+            ERROR("Usage error: only the " CPU_CACHE " and " TLB " simulators "
+                  "can be benchmarked.\n");
+            return -1;
+        }
+        if (!simulator->init()) {
+            delete simulator;
+            return -1;
+        }
+        double start = now_seconds();
+        bool ok = simulator->run();
+        double secs = now_seconds() - start;
+        delete simulator;
+        if (!ok)
+            return -1;
+        if (best < 0 || secs < best)
+            best = secs;
+    }
+    return best;
+}
+
+static void
+report(const std::string &config, size_t num_refs, double secs)
+{
+    std::cout << std::setw(48) << std::left << config
+              << std::setw(12) << std::right << num_refs
+              << std::setw(10) << std::fixed << std::setprecision(3) << secs
+              << std::setw(14) << std::setprecision(0) << (num_refs / secs)
+              << std::endl;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    std::string parse_err;
+    int last_index;
+    if (!droption_parser_t::parse_argv(DROPTION_SCOPE_FRONTEND, argc, argv,
+                                       &parse_err, &last_index)) {
+        ERROR("Usage error: %s\nUsage:\n%s", parse_err.c_str(),
+              droption_parser_t::usage_short(DROPTION_SCOPE_FRONTEND).c_str());
+        return 1;
+    }
+
+    // Each configuration's arguments, with a dummy first one for parse_argv.
+    std::vector<std::vector<std::string> > configs;
+    std::vector<std::string> names;
+    for (int i = last_index; i < argc; ) {
+        std::vector<std::string> args(1, argv[0]);
+        std::string name;
+        for (; i < argc && strcmp(argv[i], "--") != 0; i++) {
+            args.push_back(argv[i]);
+            name += (name.empty() ? "" : " ") + std::string(argv[i]);
+        }
+        ++i; // Skip the "--".
+        configs.push_back(args);
+        names.push_back(name.empty() ? "(default)" : name);
+    }
+    char conf_path[] = "/tmp/drcachesim_bench.XXXXXX";
+    bool have_conf = false;
+    if (configs.empty()) {
+        int fd = mkstemp(conf_path);
+        if (fd == -1 || write(fd, three_levels, strlen(three_levels)) !=
+            (ssize_t)strlen(three_levels)) {
+            ERROR("failed to write a config file to %s\n", conf_path);
+            return 1;
+        }
+        close(fd);
+        have_conf = true;
+        for (size_t i = 0; i < BUFFER_SIZE_ELEMENTS(default_configs); i++) {
+            std::vector<std::string> args(1, argv[0]);
+            std::istringstream words(default_configs[i].ops);
+            std::string word;
+            while (words >> word)
+                args.push_back(word == "@THREE_LEVELS@" ? conf_path : word);
+            configs.push_back(args);
+            names.push_back(default_configs[i].name != NULL ? default_configs[i].name :
+                            default_configs[i].ops);
+        }
+    }
+
+    std::vector<memref_t> refs;
+    if (op_infile.get_value().empty())
+        generate_trace(refs);
+    else if (!load_trace(refs))
+        return 1;
+
+    std::cout << std::setw(48) << std::left << "Configuration"
+              << std::setw(12) << std::right << "Memrefs"
+              << std::setw(10) << "Seconds"
+              << std::setw(14) << "Memrefs/sec" << std::endl;
+    int res = 0;
+    for (size_t i = 0; i < configs.size(); i++) {
+        std::cout.flush();
+        pid_t child = fork();
+        if (child == -1) {
+            ERROR("failed to fork\n");
+            res = 1;
+            break;
+        }
+        if (child == 0) {
+            std::vector<const char *> args;
+            for (size_t j = 0; j < configs[i].size(); j++)
+                args.push_back(configs[i][j].c_str());
+            if (!droption_parser_t::parse_argv(DROPTION_SCOPE_FRONTEND,
+                                               (int)args.size(), &args[0],
+                                               &parse_err, NULL)) {
+                ERROR("Usage error: %s\n", parse_err.c_str());
+                exit(1);
+            }
+            double secs = run_config(refs);
+            if (secs < 0)
+                exit(1);
+            report(names[i], refs.size(), secs);
+            exit(0);
+        }
+        int status;
+        if (waitpid(child, &status, 0) != child || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+            ERROR("configuration \"%s\" failed\n", names[i].c_str());
+            res = 1;
+        }
+    }
+    if (have_conf)
+        unlink(conf_path);
+    return res;
+}
@@ -0,0 +1,590 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <assert.h>
+#include <stdint.h> /* for supporting 64-bit integers*/
+#include "utils.h"
+#include "memref.h"
+#include "droption.h"
+#include "../common/options.h"
+#include "symbolizer.h"
+#include "branch_predictor_simulator.h"
+
+const char * const branch_predictor_simulator_t::kind_names[] = {
+    "conditional",
+    "jump",
+    "indirect",
+    "call",
+    "return",
+};
+
+// The most outstanding calls we track per thread to recognize returns.
+#define MAX_CALL_DEPTH 1024
+
+typedef branch_predictor_simulator_t::direction_predictor_t direction_predictor_t;
+
+// A table of 2-bit counters indexed by the pc xor the global history of
+// branch outcomes.
+class gshare_predictor_t : public direction_predictor_t
+{
+ public:
+    explicit gshare_predictor_t(int bits) :
+        mask((1U << bits) - 1), history(0), counters(1U << bits, 1) {}
+    virtual bool predict(addr_t pc) {
+        return counters[index(pc)] >= 2;
+    }
+    virtual void update(addr_t pc, bool taken) {
+        unsigned char &counter = counters[index(pc)];
+        if (taken && counter < 3)
+            counter++;
+        else if (!taken && counter > 0)
+            counter--;
+        history = ((history << 1) | (taken ? 1 : 0)) & mask;
+    }
+
+ protected:
+    unsigned int index(addr_t pc) {
+        return ((unsigned int)pc ^ history) & mask;
+    }
+    unsigned int mask;
+    unsigned int history;
+    std::vector<unsigned char> counters;
+};
+
+// A small TAGE: a bimodal base table plus tagged tables indexed by the pc and
+// geometrically longer global histories.  The longest matching history
+// provides the prediction, and a misprediction allocates an entry with a
+// longer history.
+class tage_predictor_t : public direction_predictor_t
+{
+ public:
+    explicit tage_predictor_t(int bits) :
+        base_mask((1U << bits) - 1), base(1U << bits, 1), history(HISTORY_SIZE),
+        history_head(0), updates(0) {
+        int tagged_bits = bits > 4 ? bits - 2 : 2;
+        tagged_mask = (1U << tagged_bits) - 1;
+        for (int i = 0; i < NUM_TABLES; i++) {
+            tables[i].resize(1U << tagged_bits);
+            index_fold[i].init(history_lengths[i], tagged_bits);
+            tag_fold[0][i].init(history_lengths[i], TAG_BITS);
+            tag_fold[1][i].init(history_lengths[i], TAG_BITS - 1);
+        }
+    }
+    virtual bool predict(addr_t pc) {
+        provider = -1;
+        alt_provider = -1;
+        for (int i = 0; i < NUM_TABLES; i++) {
+            indices[i] = ((unsigned int)pc ^ ((unsigned int)pc >> (i + 2)) ^
+                          index_fold[i].comp) & tagged_mask;
+            tags[i] = (unsigned short)
+                (((unsigned int)pc ^ tag_fold[0][i].comp ^ (tag_fold[1][i].comp << 1)) &
+                 ((1U << TAG_BITS) - 1));
+        }
+        for (int i = NUM_TABLES - 1; i >= 0; i--) {
+            if (tables[i][indices[i]].tag == tags[i]) {
+                if (provider == -1)
+                    provider = i;
+                else {
+                    alt_provider = i;
+                    break;
+                }
+            }
+        }
+        alt_pred = alt_provider == -1 ? base[pc & base_mask] >= 2 :
+            tables[alt_provider][indices[alt_provider]].counter >= 0;
+        pred = provider == -1 ? alt_pred :
+            tables[provider][indices[provider]].counter >= 0;
+        return pred;
+    }
+    virtual void update(addr_t pc, bool taken) {
+        if (provider == -1) {
+            unsigned char &counter = base[pc & base_mask];
+            if (taken && counter < 3)
+                counter++;
+            else if (!taken && counter > 0)
+                counter--;
+        } else {
+            entry_t &entry = tables[provider][indices[provider]];
+            if (taken && entry.counter < 3)
+                entry.counter++;
+            else if (!taken && entry.counter > -4)
+                entry.counter--;
+            if (pred != alt_pred) {
+                if (pred == taken && entry.useful < 3)
+                    entry.useful++;
+                else if (pred != taken && entry.useful > 0)
+                    entry.useful--;
+            }
+        }
+        if (pred != taken && provider < NUM_TABLES - 1) {
+            // Allocate in the shortest longer history table with a free entry,
+            // or else age the entries we could have used.
+            bool allocated = false;
+            for (int i = provider + 1; i < NUM_TABLES; i++) {
+                entry_t &entry = tables[i][indices[i]];
+                if (entry.useful == 0) {
+                    entry.tag = tags[i];
+                    entry.counter = taken ? 0 : -1;
+                    allocated = true;
+                    break;
+                }
+            }
+            if (!allocated) {
+                for (int i = provider + 1; i < NUM_TABLES; i++) {
+                    entry_t &entry = tables[i][indices[i]];
+                    if (entry.useful > 0)
+                        entry.useful--;
+                }
+            }
+        }
+        // Periodically age all entries so stale ones can be replaced.
+        if (++updates % USEFUL_RESET_PERIOD == 0) {
+            for (int i = 0; i < NUM_TABLES; i++) {
+                for (size_t j = 0; j < tables[i].size(); j++)
+                    tables[i][j].useful >>= 1;
+            }
+        }
+        push_history(taken);
+    }
+
+ protected:
+    static const int NUM_TABLES = 4;
+    static const int TAG_BITS = 9;
+    static const int HISTORY_SIZE = 256;
+    static const uint64_t USEFUL_RESET_PERIOD = 256*1024;
+    static const int history_lengths[NUM_TABLES];
+
+    struct entry_t {
+        entry_t() : tag(0), counter(0), useful(0) {}
+        unsigned short tag;
+        signed char counter; // 3-bit signed: taken if >= 0
+        unsigned char useful;
+    };
+
+    // The last length bits of history folded into width bits, updated as each
+    // bit is pushed.
+    struct folded_history_t {
+        void init(int len, int width) {
+            comp = 0;
+            length = len;
+            comp_length = width;
+            outpoint = len % width;
+        }
+        void update(bool new_bit, bool old_bit) {
+            comp = (comp << 1) | (new_bit ? 1 : 0);
+            comp ^= (old_bit ? 1U : 0U) << outpoint;
+            comp ^= comp >> comp_length;
+            comp &= (1U << comp_length) - 1;
+        }
+        unsigned int comp;
+        int length;
+        int comp_length;
+        int outpoint;
+    };
+
+    void push_history(bool taken) {
+        history_head = (history_head + HISTORY_SIZE - 1) % HISTORY_SIZE;
+        history[history_head] = taken;
+        for (int i = 0; i < NUM_TABLES; i++) {
+            bool old_bit = history[(history_head + history_lengths[i]) % HISTORY_SIZE];
+            index_fold[i].update(taken, old_bit);
+            tag_fold[0][i].update(taken, old_bit);
+            tag_fold[1][i].update(taken, old_bit);
+        }
+    }
+
+    unsigned int base_mask;
+    std::vector<unsigned char> base;
+    unsigned int tagged_mask;
+    std::vector<entry_t> tables[NUM_TABLES];
+    // The most recent outcome is at history_head.
+    std::vector<bool> history;
+    int history_head;
+    folded_history_t index_fold[NUM_TABLES];
+    folded_history_t tag_fold[2][NUM_TABLES];
+    uint64_t updates;
+    // State from predict() for update().
+    unsigned int indices[NUM_TABLES];
+    unsigned short tags[NUM_TABLES];
+    int provider;
+    int alt_provider;
+    bool pred;
+    bool alt_pred;
+};
+
+const int tage_predictor_t::history_lengths[NUM_TABLES] = {5, 15, 44, 130};
+
+bool
+branch_predictor_simulator_t::init()
+{
+    if (!create_reader())
+        return false;
+
+    // We do not model cores: each thread has its own predictors.
+    num_cores = 1;
+    thread_counts = NULL;
+    thread_ever_counts = NULL;
+
+    if (op_bp_predictor.get_value() != BP_PREDICTOR_GSHARE &&
+        op_bp_predictor.get_value() != BP_PREDICTOR_TAGE) {
+        ERROR("Usage error: -bp_predictor must be " BP_PREDICTOR_GSHARE " or "
+              BP_PREDICTOR_TAGE ".\n");
+        return false;
+    }
+    if (op_bp_table_bits.get_value() < 4 || op_bp_table_bits.get_value() > 24) {
+        ERROR("Usage error: -bp_table_bits must be between 4 and 24.\n");
+        return false;
+    }
+    btb_entries = op_bp_btb_entries.get_value();
+    if (compute_log2((int)btb_entries) == -1) {
+        ERROR("Usage error: -bp_btb_entries must be a power of 2.\n");
+        return false;
+    }
+    if (op_bp_ras_entries.get_value() == 0) {
+        ERROR("Usage error: -bp_ras_entries must be at least 1.\n");
+        return false;
+    }
+    return true;
+}
+
+branch_predictor_simulator_t::~branch_predictor_simulator_t()
+{
+    for (std::map<memref_tid_t, thread_t>::iterator it = threads.begin();
+         it != threads.end(); ++it)
+        delete it->second.predictor;
+}
+
+branch_predictor_simulator_t::thread_t &
+branch_predictor_simulator_t::get_thread(const memref_t &memref)
+{
+    // A thread's predictors are freed at its exit, should its id be reused.
+    thread_t &thread = threads[memref.tid];
+    if (thread.predictor != NULL)
+        return thread;
+    thread.pid = memref.pid;
+    int bits = (int)op_bp_table_bits.get_value();
+    if (op_bp_predictor.get_value() == BP_PREDICTOR_TAGE)
+        thread.predictor = new tage_predictor_t(bits);
+    else
+        thread.predictor = new gshare_predictor_t(bits);
+    thread.btb.resize(btb_entries);
+    thread.ras.resize(op_bp_ras_entries.get_value());
+    thread.ras_top = 0;
+    thread.ras_count = 0;
+    return thread;
+}
+
+bool
+branch_predictor_simulator_t::predict_target(thread_t &thread, addr_t pc,
+                                             addr_t target)
+{
+    btb_entry_t &entry = thread.btb[pc & (btb_entries - 1)];
+    bool hit = entry.pc == pc && entry.target == target;
+    entry.pc = pc;
+    entry.target = target;
+    return hit;
+}
+
+void
+branch_predictor_simulator_t::branch(thread_t &thread, addr_t pc, addr_t fallthrough,
+                                     addr_t next_pc)
+{
+    bool taken = next_pc != fallthrough;
+    pc_key_t key(thread.pid, pc);
+    std::map<pc_key_t, pc_stats_t>::iterator it = pc_stats.find(key);
+    // A fall-through is only a branch not taken once we know there is a branch.
+    if (!taken && it == pc_stats.end())
+        return;
+    pc_stats_t &stats = (it == pc_stats.end()) ? pc_stats[key] : it->second;
+
+    bool is_call = taken && thread.last_wrote;
+    bool is_return = false;
+    if (taken && !is_call) {
+        std::vector<addr_t>::reverse_iterator ret =
+            std::find(thread.calls.rbegin(), thread.calls.rend(), next_pc);
+        if (ret != thread.calls.rend()) {
+            is_return = true;
+            thread.calls.erase((ret + 1).base(), thread.calls.end());
+        }
+    }
+
+    stats.executions++;
+    thread.stats.branches++;
+    if (taken) {
+        stats.taken++;
+        if (stats.executions == 1)
+            stats.target = next_pc;
+        else if (stats.target != next_pc)
+            stats.multiple_targets = true;
+    }
+
+    mispredict_t mispredict = MISPREDICT_COUNT;
+    size_t ras_size = thread.ras.size();
+    if (is_return) {
+        stats.is_return = true;
+        if (thread.ras_count == 0 || thread.ras[thread.ras_top] != next_pc)
+            mispredict = MISPREDICT_RETURN;
+        if (thread.ras_count > 0) {
+            thread.ras_top = (thread.ras_top + ras_size - 1) % ras_size;
+            thread.ras_count--;
+        }
+    } else if (is_call) {
+        stats.is_call = true;
+        if (thread.calls.size() == MAX_CALL_DEPTH)
+            thread.calls.erase(thread.calls.begin());
+        thread.calls.push_back(fallthrough);
+        // The oldest entry is overwritten once the stack is full.
+        thread.ras_top = (thread.ras_top + 1) % ras_size;
+        thread.ras[thread.ras_top] = fallthrough;
+        if (thread.ras_count < ras_size)
+            thread.ras_count++;
+        if (!predict_target(thread, pc, next_pc))
+            mispredict = MISPREDICT_TARGET;
+    } else {
+        bool predicted = thread.predictor->predict(pc);
+        thread.predictor->update(pc, taken);
+        if (predicted != taken)
+            mispredict = MISPREDICT_DIRECTION;
+        if (taken && !predict_target(thread, pc, next_pc) &&
+            mispredict == MISPREDICT_COUNT)
+            mispredict = MISPREDICT_TARGET;
+    }
+    if (mispredict != MISPREDICT_COUNT) {
+        stats.mispredicts++;
+        thread.stats.mispredicts[mispredict]++;
+    }
+}
+
+void
+branch_predictor_simulator_t::reset()
+{
+    // We keep the predictor state and what we learned about each branch.
+    for (std::map<memref_tid_t, thread_t>::iterator it = threads.begin();
+         it != threads.end(); ++it)
+        it->second.stats = thread_stats_t();
+    for (std::map<pc_key_t, pc_stats_t>::iterator it = pc_stats.begin();
+         it != pc_stats.end(); ++it) {
+        it->second.executions = 0;
+        it->second.taken = 0;
+        it->second.mispredicts = 0;
+    }
+}
+
+bool
+branch_predictor_simulator_t::run()
+{
+    if (!reader->init()) {
+        if (op_infile.get_value().empty())
+            ERROR("failed to read from pipe %s", op_ipc_name.get_value().c_str());
+        else
+            ERROR("failed to read from %s", op_infile.get_value().c_str());
+        return false;
+    }
+
+    uint64_t warmup_refs = op_warmup_refs.get_value();
+    uint64_t sim_refs = op_sim_refs.get_value();
+
+    reader->skip_memrefs(op_skip_refs.get_value());
+
+    for (; *reader != *reader_end; ++(*reader)) {
+        memref_t memref = **reader;
+
+        // the references after warmup and simulated ones are dropped
+        if (warmup_refs == 0 && sim_refs == 0)
+            continue;
+
+        if (memref.type == TRACE_TYPE_INSTR) {
+            thread_t &thread = get_thread(memref);
+            thread.stats.instrs++;
+            // A repeated fetch of the same instruction is a rep string loop.
+            if (thread.have_last && memref.addr != thread.last_pc) {
+                branch(thread, thread.last_pc, thread.last_pc + thread.last_size,
+                       memref.addr);
+            }
+            thread.last_pc = memref.addr;
+            thread.last_size = memref.size;
+            thread.have_last = true;
+            thread.last_wrote = false;
+        } else if (memref.type == TRACE_TYPE_WRITE) {
+            std::map<memref_tid_t, thread_t>::iterator it = threads.find(memref.tid);
+            if (it != threads.end())
+                it->second.last_wrote = true;
+        } else if (memref.type == TRACE_TYPE_THREAD_EXIT) {
+            // We keep the thread's stats but free its predictors.
+            std::map<memref_tid_t, thread_t>::iterator it = threads.find(memref.tid);
+            if (it != threads.end()) {
+                thread_t &thread = it->second;
+                delete thread.predictor;
+                thread.predictor = NULL;
+                std::vector<btb_entry_t>().swap(thread.btb);
+                std::vector<addr_t>().swap(thread.ras);
+                std::vector<addr_t>().swap(thread.calls);
+                thread.have_last = false;
+            }
+        } else if (memref.type == TRACE_TYPE_READ ||
+                   type_is_prefetch(memref.type) ||
+                   memref.type == TRACE_TYPE_INSTR_FLUSH ||
+                   memref.type == TRACE_TYPE_DATA_FLUSH ||
+                   memref.type == TRACE_TYPE_CPU_ID ||
+                   memref.type == TRACE_TYPE_ALLOC ||
+                   memref.type == TRACE_TYPE_FREE ||
+                   memref.type == TRACE_TYPE_SYSCALL ||
+                   memref.type == TRACE_TYPE_SYSCALL_END) {
+            // We only analyze instruction fetches and, to find calls, writes.
+        } else {
+            ERROR("unhandled memref type");
+            return false;
+        }
+
+        if (op_verbose.get_value() >= 3) {
+            std::cerr << "::" << memref.pid << "." << memref.tid << ":: " <<
+                " @" << (void *)memref.pc <<
+                " " << trace_type_names[memref.type] << " " <<
+                (void *)memref.addr << " x" << memref.size << std::endl;
+        }
+
+        // process counters for warmup and simulated references
+        if (warmup_refs > 0) {
+            warmup_refs--;
+            if (warmup_refs == 0)
+                reset();
+        }
+        else
+            sim_refs--;
+    }
+    return true;
+}
+
+branch_predictor_simulator_t::branch_kind_t
+branch_predictor_simulator_t::classify(const pc_stats_t &stats)
+{
+    if (stats.is_return)
+        return BRANCH_RETURN;
+    if (stats.is_call)
+        return BRANCH_CALL;
+    if (stats.taken < stats.executions)
+        return BRANCH_CONDITIONAL;
+    if (stats.multiple_targets)
+        return BRANCH_INDIRECT;
+    return BRANCH_JUMP;
+}
+
+void
+branch_predictor_simulator_t::print_thread_stats(const thread_stats_t &stats)
+{
+    int_least64_t total = 0;
+    for (int i = 0; i < MISPREDICT_COUNT; i++)
+        total += stats.mispredicts[i];
+    std::cerr << "    " << std::setw(26) << std::left << "Instructions:" <<
+        std::setw(14) << std::right << stats.instrs << std::endl;
+    std::cerr << "    " << std::setw(26) << std::left << "Branches:" <<
+        std::setw(14) << std::right << stats.branches << std::endl;
+    std::cerr << "    " << std::setw(26) << std::left << "Direction mispredicts:" <<
+        std::setw(14) << std::right << stats.mispredicts[MISPREDICT_DIRECTION] <<
+        std::endl;
+    std::cerr << "    " << std::setw(26) << std::left << "Target mispredicts:" <<
+        std::setw(14) << std::right << stats.mispredicts[MISPREDICT_TARGET] <<
+        std::endl;
+    std::cerr << "    " << std::setw(26) << std::left << "Return mispredicts:" <<
+        std::setw(14) << std::right << stats.mispredicts[MISPREDICT_RETURN] <<
+        std::endl;
+    std::cerr << "    " << std::setw(26) << std::left << "Mispredicts per 1K instrs:" <<
+        std::setw(14) << std::right << std::fixed << std::setprecision(2) <<
+        (stats.instrs == 0 ? 0.0 : 1000.0 * total / stats.instrs) << std::endl;
+}
+
+static bool
+pc_mispredicts_greater(const std::pair<std::pair<memref_pid_t, addr_t>,
+                                       int_least64_t> &a,
+                       const std::pair<std::pair<memref_pid_t, addr_t>,
+                                       int_least64_t> &b)
+{
+    return a.second > b.second;
+}
+
+bool
+branch_predictor_simulator_t::print_stats()
+{
+    std::cerr << "Branch prediction with a " <<
+        (op_bp_predictor.get_value() == BP_PREDICTOR_TAGE ? "TAGE" : "gshare") <<
+        " predictor of 2^" << op_bp_table_bits.get_value() << " entries, a " <<
+        btb_entries << "-entry BTB, and a " << op_bp_ras_entries.get_value() <<
+        "-entry RAS:" << std::endl;
+    thread_stats_t total;
+    for (std::map<memref_tid_t, thread_t>::iterator it = threads.begin();
+         it != threads.end(); ++it) {
+        const thread_stats_t &stats = it->second.stats;
+        std::cerr << "  Thread " << it->first << ":" << std::endl;
+        print_thread_stats(stats);
+        total.instrs += stats.instrs;
+        total.branches += stats.branches;
+        for (int i = 0; i < MISPREDICT_COUNT; i++)
+            total.mispredicts[i] += stats.mispredicts[i];
+    }
+    std::cerr << "  Total:" << std::endl;
+    print_thread_stats(total);
+
+    std::vector<std::pair<pc_key_t, int_least64_t> > sorted;
+    for (std::map<pc_key_t, pc_stats_t>::iterator it = pc_stats.begin();
+         it != pc_stats.end(); ++it) {
+        if (it->second.mispredicts > 0)
+            sorted.push_back(std::make_pair(it->first, it->second.mispredicts));
+    }
+    if (sorted.empty())
+        return true;
+    symbolizer_t symbolizer;
+    symbolizer.init();
+    std::sort(sorted.begin(), sorted.end(), pc_mispredicts_greater);
+    if (sorted.size() > op_bp_top_pcs.get_value())
+        sorted.resize(op_bp_top_pcs.get_value());
+    std::cerr << "  Top " << sorted.size() << " branches by mispredicts (pc, kind, "
+        "executions, taken, mispredicts, mispredict rate):" << std::endl;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        const pc_stats_t &stats = pc_stats[sorted[i].first];
+        std::cerr << "    " << std::setw(18) << std::left <<
+            (void *)sorted[i].first.second <<
+            std::setw(12) << std::left << kind_names[classify(stats)] <<
+            std::setw(14) << std::right << stats.executions <<
+            std::setw(14) << std::right << stats.taken <<
+            std::setw(14) << std::right << stats.mispredicts <<
+            std::setw(9) << std::right << std::fixed << std::setprecision(1) <<
+            100.0 * stats.mispredicts / stats.executions << "%  " <<
+            symbolizer.describe(sorted[i].first.first, sorted[i].first.second) <<
+            std::endl;
+    }
+    return true;
+}
@@ -0,0 +1,156 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* branch_predictor_simulator: simulates branch prediction on the instruction
+ * fetch stream.
+ */
+
+#ifndef _BRANCH_PREDICTOR_SIMULATOR_H_
+#define _BRANCH_PREDICTOR_SIMULATOR_H_ 1
+
+#include <map>
+#include <utility>
+#include <vector>
+#include "simulator.h"
+
+// The trace has no instruction encodings, so branches are found from the
+// fetch stream of each thread: an instruction followed by one other than the
+// next in memory took a branch, and a branch seen taken before that is
+// followed by the next instruction was not taken.  Calls are the branches
+// that store their return address and returns are the branches to the return
+// address of an outstanding call, so they are only recognized on x86 with
+// data references in the trace.
+//
+// Each thread has its own predictors: a direction predictor, either gshare or
+// a small TAGE, for the branches other than calls and returns, a
+// direct-mapped branch target buffer for the targets of all taken branches
+// other than returns, and a return address stack.
+class branch_predictor_simulator_t : public simulator_t
+{
+ public:
+    virtual bool init();
+    virtual ~branch_predictor_simulator_t();
+    virtual bool run();
+    virtual bool print_stats();
+
+    // Predicts whether conditional branches are taken.  update() is called
+    // after each predict() with the same pc.
+    class direction_predictor_t {
+     public:
+        virtual ~direction_predictor_t() {}
+        virtual bool predict(addr_t pc) = 0;
+        virtual void update(addr_t pc, bool taken) = 0;
+    };
+
+ protected:
+    enum branch_kind_t {
+        BRANCH_CONDITIONAL,
+        BRANCH_JUMP,
+        BRANCH_INDIRECT,
+        BRANCH_CALL,
+        BRANCH_RETURN,
+        BRANCH_KIND_COUNT,
+    };
+    static const char * const kind_names[];
+
+    enum mispredict_t {
+        MISPREDICT_DIRECTION,
+        MISPREDICT_TARGET,
+        MISPREDICT_RETURN,
+        MISPREDICT_COUNT,
+    };
+
+    struct btb_entry_t {
+        btb_entry_t() : pc(0), target(0) {}
+        addr_t pc;
+        addr_t target;
+    };
+
+    struct thread_stats_t {
+        thread_stats_t() : instrs(0), branches(0) {
+            for (int i = 0; i < MISPREDICT_COUNT; i++)
+                mispredicts[i] = 0;
+        }
+        int_least64_t instrs;
+        int_least64_t branches;
+        int_least64_t mispredicts[MISPREDICT_COUNT];
+    };
+
+    struct thread_t {
+        thread_t() : predictor(NULL), ras_top(0), ras_count(0), last_pc(0),
+                     last_size(0), have_last(false), last_wrote(false) {}
+        memref_pid_t pid;
+        direction_predictor_t *predictor;
+        std::vector<btb_entry_t> btb;
+        // A circular stack of return addresses.
+        std::vector<addr_t> ras;
+        size_t ras_top;
+        size_t ras_count;
+        // The return addresses of the outstanding calls, used to recognize
+        // returns.
+        std::vector<addr_t> calls;
+        // The last instruction fetched and whether it wrote memory.
+        addr_t last_pc;
+        size_t last_size;
+        bool have_last;
+        bool last_wrote;
+        thread_stats_t stats;
+    };
+
+    struct pc_stats_t {
+        pc_stats_t() : executions(0), taken(0), mispredicts(0), target(0),
+                       multiple_targets(false), is_call(false), is_return(false) {}
+        int_least64_t executions;
+        int_least64_t taken;
+        int_least64_t mispredicts;
+        // The first target seen.
+        addr_t target;
+        bool multiple_targets;
+        bool is_call;
+        bool is_return;
+    };
+
+    typedef std::pair<memref_pid_t, addr_t> pc_key_t;
+
+    thread_t &get_thread(const memref_t &memref);
+    void branch(thread_t &thread, addr_t pc, addr_t fallthrough, addr_t next_pc);
+    bool predict_target(thread_t &thread, addr_t pc, addr_t target);
+    branch_kind_t classify(const pc_stats_t &stats);
+    void reset();
+    void print_thread_stats(const thread_stats_t &stats);
+
+    std::map<memref_tid_t, thread_t> threads;
+    std::map<pc_key_t, pc_stats_t> pc_stats;
+    unsigned int btb_entries;
+};
+
+#endif /* _BRANCH_PREDICTOR_SIMULATOR_H_ */
@@ -45,19 +45,12 @@ cache_t::init(int associativity_, int line_size_, int total_size,
                                   parent_, stats_);
 }
 
-void
-cache_t::init_blocks()
-{
-    for (int i = 0; i < num_blocks; i++) {
-        blocks[i] = new cache_line_t;
-    }
-}
-
 void
 cache_t::request(const memref_t &memref_in)
 {
-    // FIXME i#1726: if the request is a data write, we should check the
-    // instr cache and invalidate the cache line there if necessary on x86.
+    // FIXME i#1726: unless coherence is enabled (see enable_coherence()), a
+    // data write does not invalidate the line in the instr cache as it would
+    // on x86.
     caching_device_t::request(memref_in);
 }
 
@@ -69,12 +62,13 @@ cache_t::flush(const memref_t &memref)
     last_tag = TAG_INVALID;
     for (; tag <= final_tag; ++tag) {
         int block_idx = compute_block_idx(tag);
-        for (int way = 0; way < associativity; ++way) {
-            if (get_caching_device_block(block_idx, way).tag == tag) {
-                get_caching_device_block(block_idx, way).tag = TAG_INVALID;
-                // Xref cache_block_t constructor about why we set counter to 0.
-                get_caching_device_block(block_idx, way).counter = 0;
-            }
+        int way = find_tag_way(&tags[block_idx], associativity, tag);
+        if (way < associativity) {
+            if (dirty != NULL)
+                write_back_victim(memref, block_idx, way);
+            get_tag(block_idx, way) = TAG_INVALID;
+            // Xref caching_device_block.h about why we set counter to 0.
+            get_counter(block_idx, way) = 0;
         }
     }
     // We flush parent's code cache here.
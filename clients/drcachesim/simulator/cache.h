@@ -37,9 +37,9 @@
 #define _CACHE_H_ 1
 
 #include "caching_device.h"
-#include "cache_line.h"
 #include "cache_stats.h"
 
+// A cache using LFU replacement.
 class cache_t : public caching_device_t
 {
  public:
@@ -49,8 +49,29 @@ class cache_t : public caching_device_t
                       caching_device_t *parent, caching_device_stats_t *stats);
     virtual void request(const memref_t &memref);
     virtual void flush(const memref_t &memref);
+};
+
+// A cache using the replacement policy policy_t (see lfu_policy_t).
+template <typename policy_t>
+class cache_policy_t : public cache_t
+{
+ public:
+    virtual bool init(int associativity, int line_size, int total_size,
+                      caching_device_t *parent, caching_device_stats_t *stats)
+    {
+        if (!cache_t::init(associativity, line_size, total_size, parent, stats))
+            return false;
+        init_policy(policy);
+        return true;
+    }
+    virtual void request(const memref_t &memref)
+    {
+        // FIXME i#1726: see cache_t::request().
+        request_with(policy, memref);
+    }
+
  protected:
-    virtual void init_blocks();
+    policy_t policy;
 };
 
 #endif /* _CACHE_H_ */
@@ -38,15 +38,42 @@
 
 #include "cache.h"
 
-class cache_fifo_t : public cache_t
+// For the FIFO/Round-Robin implementation, all the cache blocks in a set are organized
+// as a FIFO. The counters of a set of blocks simulate the replacement pointer.
+// The counter of the victim block is 1, and others are 0.
+// While replacing happens, the victim block will be replaced and its counter will
+// be cleared. The counter of the next block will be set to 1.
+struct fifo_policy_t
 {
- public:
-    virtual bool init(int associativity, int line_size, int total_size,
-                      caching_device_t *parent, caching_device_stats_t *stats);
+    static void init_set(int *counters, int associativity)
+    {
+        // Create a replacement pointer for the set, and
+        // initialize it to point to the first block.
+        counters[0] = 1;
+    }
+    static void access_update(int *counters, int associativity, int way)
+    {
+        // Since the FIFO replacement policy is independent of cache hit,
+        // we do not need to do anything here.
+    }
+    static int replace_which_way(const addr_t *tags, int *counters, int associativity)
+    {
+        // We replace the block whose counter is 1.
+        for (int i = 0; i < associativity; i++) {
+            if (counters[i] == 1) {
+                // clear the counter of the victim block
+                counters[i] = 0;
+                // set the next block as victim
+                counters[(i + 1) & (associativity - 1)] = 1;
+                return i;
+            }
+        }
+        return -1;
+    }
+};
 
- protected:
-    virtual void access_update(int line_idx, int way);
-    virtual int replace_which_way(int line_idx);
+class cache_fifo_t : public cache_policy_t<fifo_policy_t>
+{
 };
 
 #endif /* _CACHE_FIFO_H_ */
@@ -38,11 +38,50 @@
 
 #include "cache.h"
 
-class cache_lru_t : public cache_t
+// For LRU implementation, we use the cache line counter to represent
+// how recently a cache line is accessed.
+// The count value 0 means the most recent access, and the cache line with the
+// highest counter value will be picked for replacement in replace_which_way.
+struct lru_policy_t
+{
+    static void init_set(int *counters, int associativity) {}
+    static void access_update(int *counters, int associativity, int way)
+    {
+        int cnt = counters[way];
+        // Optimization: return early if it is a repeated access.
+        if (cnt == 0)
+            return;
+        // We inc all the counters that are not larger than cnt for LRU.
+        for (int i = 0; i < associativity; ++i) {
+            if (i != way && counters[i] <= cnt)
+                counters[i]++;
+        }
+        // Clear the counter for LRU.
+        counters[way] = 0;
+    }
+    static int replace_which_way(const addr_t *tags, int *counters, int associativity)
+    {
+        // We implement LRU by picking the slot with the largest counter value.
+        int max_counter = 0;
+        int max_way = 0;
+        for (int way = 0; way < associativity; ++way) {
+            if (tags[way] == TAG_INVALID) {
+                max_way = way;
+                break;
+            }
+            if (counters[way] > max_counter) {
+                max_counter = counters[way];
+                max_way = way;
+            }
+        }
+        // Set to non-zero for later access_update optimization on repeated access
+        counters[max_way] = 1;
+        return max_way;
+    }
+};
+
+class cache_lru_t : public cache_policy_t<lru_policy_t>
 {
- protected:
-    virtual void access_update(int line_idx, int way);
-    virtual int replace_which_way(int line_idx);
 };
 
 #endif /* _CACHE_LRU_H_ */
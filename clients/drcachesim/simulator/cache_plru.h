@@ -0,0 +1,81 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* cache_plru: represents a single hardware cache with tree pseudo-LRU algo.
+ */
+
+#ifndef _CACHE_PLRU_H_
+#define _CACHE_PLRU_H_ 1
+
+#include "cache.h"
+
+// For tree pseudo-LRU, a set's ways are the leaves of a binary tree whose
+// associativity - 1 inner nodes each hold one bit pointing to the half of
+// their subtree to replace from next.  An access points the bits on its way's
+// path away from it, and a replacement follows the bits down from the root,
+// so both take log2(associativity) steps.  The nodes are numbered as in a
+// heap, from 1 at the root, and their bits are packed into the set's counters,
+// 32 to a counter.
+struct plru_policy_t
+{
+    static void init_set(int *counters, int associativity) {}
+    static void access_update(int *counters, int associativity, int way)
+    {
+        unsigned int *bits = (unsigned int *)counters;
+        for (int node = associativity + way; node > 1; node >>= 1) {
+            int parent = node >> 1;
+            // Point to the sibling of the child we came from.
+            if ((node & 1) == 0)
+                bits[parent >> 5] |= 1U << (parent & 31);
+            else
+                bits[parent >> 5] &= ~(1U << (parent & 31));
+        }
+    }
+    static int replace_which_way(const addr_t *tags, int *counters, int associativity)
+    {
+        for (int way = 0; way < associativity; ++way) {
+            if (tags[way] == TAG_INVALID)
+                return way;
+        }
+        const unsigned int *bits = (const unsigned int *)counters;
+        int node = 1;
+        while (node < associativity)
+            node = 2 * node + ((bits[node >> 5] >> (node & 31)) & 1);
+        return node - associativity;
+    }
+};
+
+class cache_plru_t : public cache_policy_t<plru_policy_t>
+{
+};
+
+#endif /* _CACHE_PLRU_H_ */
@@ -30,22 +30,19 @@
  * DAMAGE.
  */
 
-/* tlb_entry: represents a TLB entry.
- */
-
-#ifndef _TLB_ENTRY_H_
-#define _TLB_ENTRY_H_ 1
-
-#include "caching_device_block.h"
+#include <assert.h>
+#include "cache_proxy.h"
 
-class tlb_entry_t : public caching_device_block_t
+void
+cache_proxy_t::request(const memref_t &memref)
 {
- public:
-    // process ID to differentiate virtual pages
-    // that have the same VPN but belong to different processes.
-    memref_pid_t pid;
+    assert(output != NULL);
+    output->push_back(memref);
+}
 
-    //XXX: support page privilege and MMU-related exceptions
-};
-
-#endif /* _TLB_ENTRY_H_ */
+void
+cache_proxy_t::flush(const memref_t &memref)
+{
+    assert(output != NULL);
+    output->push_back(memref);
+}
@@ -0,0 +1,60 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* cache_proxy: stands in for a shared parent cache so that a child cache
+ * can be simulated on a different thread from its parent.
+ */
+
+#ifndef _CACHE_PROXY_H_
+#define _CACHE_PROXY_H_ 1
+
+#include <vector>
+#include "cache.h"
+
+// Requests and flushes that the child cache passes up are recorded, in order,
+// for later replay on the real parent via cache_t::request() or
+// cache_t::flush() (distinguished by the memref type).  The child's
+// child_access() calls land in this proxy's own stats, which the caller
+// later folds into the parent's via merge_child_stats().
+class cache_proxy_t : public cache_t
+{
+ public:
+    cache_proxy_t() : output(NULL) {}
+    virtual void request(const memref_t &memref);
+    virtual void flush(const memref_t &memref);
+    void set_output(std::vector<memref_t> *output_) { output = output_; }
+
+ protected:
+    std::vector<memref_t> *output;
+};
+
+#endif /* _CACHE_PROXY_H_ */
@@ -0,0 +1,149 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* cache_rrip: represents a single hardware cache with SRRIP or DRRIP algo.
+ */
+
+#ifndef _CACHE_RRIP_H_
+#define _CACHE_RRIP_H_ 1
+
+#include "cache.h"
+
+// For re-reference interval prediction (Jaleel et al., ISCA 2010), each
+// block's counter holds its re-reference prediction value (RRPV): from 0,
+// expected to be reused soon, up to RRPV_MAX, not expected to be reused.  A
+// hit predicts a near reuse.  The victim is the first block at RRPV_MAX, with
+// every block aged until there is one.  Static RRIP inserts new blocks at
+// RRPV_MAX - 1, so that blocks that are never reused leave before those that
+// are, which resists scans.
+struct srrip_policy_t
+{
+    static const int RRPV_MAX = 3;
+
+    static void init_set(int *counters, int associativity)
+    {
+        for (int way = 0; way < associativity; ++way)
+            counters[way] = RRPV_MAX;
+    }
+    static void access_update(int *counters, int associativity, int way)
+    {
+        // replace_which_way() leaves a freshly inserted block's RRPV negated,
+        // so that we can tell the fill from a hit.
+        if (counters[way] < 0)
+            counters[way] = -counters[way] - 1;
+        else
+            counters[way] = 0;
+    }
+    int replace_which_way(const addr_t *tags, int *counters, int associativity)
+    {
+        int way = find_victim(tags, counters, associativity);
+        counters[way] = -RRPV_MAX;  // Inserts at RRPV_MAX - 1.
+        return way;
+    }
+
+ protected:
+    static int find_victim(const addr_t *tags, int *counters, int associativity)
+    {
+        for (int way = 0; way < associativity; ++way) {
+            if (tags[way] == TAG_INVALID)
+                return way;
+        }
+        while (true) {
+            for (int way = 0; way < associativity; ++way) {
+                if (counters[way] >= RRPV_MAX)
+                    return way;
+            }
+            for (int way = 0; way < associativity; ++way)
+                ++counters[way];
+        }
+    }
+};
+
+// Dynamic RRIP chooses between SRRIP insertion and bimodal insertion (BRRIP),
+// which inserts at RRPV_MAX but for one fill in BRRIP_EPSILON, and so resists
+// thrashing by working sets larger than the cache.  By set dueling, a few
+// leader sets always use one or the other, and their misses drive a saturating
+// selector that picks the insertion for all the other sets.
+struct drrip_policy_t : public srrip_policy_t
+{
+    drrip_policy_t() : sets(NULL), psel(PSEL_MAX / 2), brrip_fills(0) {}
+    void init_set(int *counters, int associativity)
+    {
+        // The sets are initialized in order, from the first.
+        if (sets == NULL)
+            sets = counters;
+        srrip_policy_t::init_set(counters, associativity);
+    }
+    int replace_which_way(const addr_t *tags, int *counters, int associativity)
+    {
+        int set = (int)(counters - sets) / associativity;
+        bool use_brrip;
+        if (set % LEADER_SPACING == 0) {
+            // An SRRIP leader: its misses favor BRRIP.
+            if (psel < PSEL_MAX)
+                ++psel;
+            use_brrip = false;
+        } else if (set % LEADER_SPACING == LEADER_SPACING / 2) {
+            // A BRRIP leader: its misses favor SRRIP.
+            if (psel > 0)
+                --psel;
+            use_brrip = true;
+        } else
+            use_brrip = psel > PSEL_MAX / 2;
+        int way = find_victim(tags, counters, associativity);
+        // We use a counter rather than randomness, for repeatable results.
+        if (use_brrip && ++brrip_fills % BRRIP_EPSILON != 0)
+            counters[way] = -RRPV_MAX - 1;  // Inserts at RRPV_MAX.
+        else
+            counters[way] = -RRPV_MAX;
+        return way;
+    }
+
+ private:
+    // One set in LEADER_SPACING leads for each insertion policy.
+    static const int LEADER_SPACING = 32;
+    static const int PSEL_MAX = 1023;
+    static const int BRRIP_EPSILON = 32;
+    const int *sets;
+    int psel;
+    unsigned int brrip_fills;
+};
+
+class cache_srrip_t : public cache_policy_t<srrip_policy_t>
+{
+};
+
+class cache_drrip_t : public cache_policy_t<drrip_policy_t>
+{
+};
+
+#endif /* _CACHE_RRIP_H_ */
@@ -30,155 +30,732 @@
  * DAMAGE.
  */
 
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <sstream>
 #include <string>
 #include <assert.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdint.h> /* for supporting 64-bit integers*/
 #include "utils.h"
 #include "memref.h"
-#include "ipc_reader.h"
 #include "cache_stats.h"
 #include "cache.h"
 #include "cache_lru.h"
 #include "cache_fifo.h"
+#include "cache_plru.h"
+#include "cache_rrip.h"
 #include "droption.h"
 #include "../common/options.h"
 #include "cache_simulator.h"
 
+cache_simulator_t::cache_simulator_t() :
+    config_file(op_config_file.get_value()), input_skipped(false), icaches(NULL),
+    dcaches(NULL), llcache(NULL), numa_map(NULL), alloc_map(NULL),
+    llc_proxies(NULL)
+{
+}
+
+cache_simulator_t::cache_simulator_t(const std::string &config_file_,
+                                     reader_t *reader_, reader_t *reader_end_) :
+    config_file(config_file_), input_skipped(true), icaches(NULL), dcaches(NULL),
+    llcache(NULL), numa_map(NULL), alloc_map(NULL),
+    llc_proxies(NULL)
+{
+    reader = reader_;
+    reader_end = reader_end_;
+}
+
 bool
 cache_simulator_t::init()
 {
-    // XXX: add a "required" flag to droption to avoid needing this here
-    if (op_ipc_name.get_value().empty()) {
-        ERROR("Usage error: ipc name is required\nUsage:\n%s",
-              droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
+    if (reader == NULL && !create_reader())
         return false;
-    }
-    ipc_iter = ipc_reader_t(op_ipc_name.get_value().c_str());
 
     // XXX i#1703: get defaults from hardware being run on.
 
-    num_cores = op_num_cores.get_value();
-
-    llcache = create_cache(op_replace_policy.get_value());
-    if (llcache == NULL)
+    if (op_L0_filter.get_value() && op_parallel.get_value()) {
+        ERROR("Usage error: -parallel is not supported with -L0_filter.\n");
         return false;
-
-    if (!llcache->init(op_LL_assoc.get_value(), op_line_size.get_value(),
-                       op_LL_size.get_value(), NULL, new cache_stats_t)) {
-        ERROR("Usage error: failed to initialize LL cache.  Ensure sizes and "
-              "associativity are powers of 2 "
-              "and that the total size is a multiple of the line size.\n");
+    }
+    if (op_L0_filter.get_value() &&
+        op_data_prefetcher.get_value() != PREFETCH_POLICY_NONE) {
+        ERROR("Usage error: -data_prefetcher is not supported with -L0_filter.\n");
+        return false;
+    }
+    if (op_coherence.get_value() &&
+        (op_L0_filter.get_value() || op_parallel.get_value())) {
+        ERROR("Usage error: -L0_filter and -parallel are not supported "
+              "with -coherence.\n");
+        return false;
+    }
+    if (op_write_policy.get_value() != WRITE_POLICY_NONE &&
+        op_write_policy.get_value() != WRITE_POLICY_BACK &&
+        op_write_policy.get_value() != WRITE_POLICY_THROUGH) {
+        ERROR("Usage error: unknown -write_policy %s.\n",
+              op_write_policy.get_value().c_str());
+        return false;
+    }
+    if (op_write_miss.get_value() != WRITE_MISS_ALLOCATE &&
+        op_write_miss.get_value() != WRITE_MISS_NO_ALLOCATE) {
+        ERROR("Usage error: unknown -write_miss %s.\n",
+              op_write_miss.get_value().c_str());
+        return false;
+    }
+    if (op_write_policy.get_value() != WRITE_POLICY_NONE &&
+        (op_L0_filter.get_value() || op_parallel.get_value())) {
+        ERROR("Usage error: -L0_filter and -parallel are not supported "
+              "with -write_policy.\n");
+        return false;
+    }
+    if (op_report_sets.get_value() > 0 && op_L0_filter.get_value()) {
+        // The L1 caches never see the accesses the tracer filtered out.
+        ERROR("Usage error: -L0_filter is not supported with -report_sets.\n");
+        return false;
+    }
+    if (op_sample_sets.get_value() > 1 &&
+        (op_coherence.get_value() || op_report_sets.get_value() > 0 ||
+         !op_page_node_file.get_value().empty())) {
+        ERROR("Usage error: -coherence, -report_sets, and -page_node_file are not "
+              "supported with -sample_sets.\n");
         return false;
     }
 
-    icaches = new cache_t* [num_cores];
-    dcaches = new cache_t* [num_cores];
-    for (int i = 0; i < num_cores; i++) {
-        icaches[i] = create_cache(op_replace_policy.get_value());
-        if (icaches[i] == NULL)
+    config.num_cores = op_num_cores.get_value();
+    config.line_size = op_line_size.get_value();
+    config.memory_latency = op_memory_latency.get_value();
+    config.remote_memory_latency = op_remote_memory_latency.get_value();
+    if (!config_file.empty()) {
+        if (op_L0_filter.get_value() || op_parallel.get_value()) {
+            ERROR("Usage error: -L0_filter and -parallel are not supported "
+                  "with -config_file.\n");
             return false;
-        dcaches[i] = create_cache(op_replace_policy.get_value());
-        if (dcaches[i] == NULL)
+        }
+        config_reader_t config_reader;
+        if (!config_reader.configure(config_file, config))
             return false;
+    } else {
+        // The default hierarchy: private L1 caches under a shared last-level cache.
+        cache_params_t llc;
+        llc.name = "LL";
+        llc.type = "unified";
+        llc.size = op_LL_size.get_value();
+        llc.assoc = op_LL_assoc.get_value();
+        llc.latency = op_LL_latency.get_value();
+        config.caches.push_back(llc);
+        for (unsigned int i = 0; i < config.num_cores; i++) {
+            cache_params_t l1;
+            l1.core = i;
+            l1.parent = llc.name;
+            l1.name = "L1I";
+            l1.type = "instruction";
+            l1.size = op_L1I_size.get_value();
+            l1.assoc = op_L1I_assoc.get_value();
+            l1.latency = op_L1I_latency.get_value();
+            config.caches.push_back(l1);
+            l1.name = "L1D";
+            l1.type = "data";
+            l1.size = op_L1D_size.get_value();
+            l1.assoc = op_L1D_assoc.get_value();
+            l1.latency = op_L1D_latency.get_value();
+            l1.prefetcher = op_data_prefetcher.get_value();
+            config.caches.push_back(l1);
+        }
+    }
+    num_cores = config.num_cores;
 
-        if (!icaches[i]->init(op_L1I_assoc.get_value(), op_line_size.get_value(),
-                              op_L1I_size.get_value(), llcache, new cache_stats_t) ||
-            !dcaches[i]->init(op_L1D_assoc.get_value(), op_line_size.get_value(),
-                              op_L1D_size.get_value(), llcache, new cache_stats_t)) {
-            ERROR("Usage error: failed to initialize L1 caches.  Ensure sizes and "
-                  "associativity are powers of 2 "
-                  "and that the total sizes are multiples of the line size.\n");
+    llc_proxies = NULL;
+    if (op_parallel.get_value()) {
+        // The proxies only record what the L1 caches send up: their own blocks
+        // are never used, so we give each a single line.
+        llc_proxies = new cache_proxy_t* [num_cores];
+        for (int i = 0; i < num_cores; i++) {
+            llc_proxies[i] = new cache_proxy_t;
+            if (!llc_proxies[i]->init(1, config.line_size, config.line_size, NULL,
+                                      new cache_stats_t)) {
+                ERROR("Usage error: failed to initialize LL cache proxy.\n");
+                return false;
+            }
+        }
+    }
+
+    if (!create_hierarchy())
+        return false;
+
+    if (!op_page_node_file.get_value().empty()) {
+        if (op_parallel.get_value()) {
+            ERROR("Usage error: -parallel is not supported with -page_node_file.\n");
+            return false;
+        }
+        numa_map = new numa_map_t;
+        if (!numa_map->init(op_page_node_file.get_value()))
+            return false;
+        // Cores are spread evenly over the nodes, in order.
+        int nodes = op_numa_nodes.get_value() > 0 ? (int)op_numa_nodes.get_value() :
+            numa_map->get_num_nodes();
+        if (nodes == 0)
+            nodes = 1;
+        for (int i = 0; i < num_cores; i++)
+            core_node.push_back(i * nodes / num_cores);
+        core_numa.resize(num_cores);
+        for (size_t i = 0; i < config.caches.size(); i++) {
+            if (config.caches[i].parent.empty()) {
+                all_caches[i]->set_numa(numa_map, &numa_counts,
+                                        config.remote_memory_latency);
+            }
+        }
+    }
+
+    if (op_report_allocs.get_value() > 0) {
+        if (op_parallel.get_value()) {
+            ERROR("Usage error: -parallel is not supported with -report_allocs.\n");
             return false;
         }
+        alloc_map = new alloc_map_t;
+        for (size_t i = 0; i < all_caches.size(); i++)
+            all_caches[i]->get_stats()->set_alloc_map(alloc_map);
+    }
+
+    if (op_interval_refs.get_value() > 0 && op_parallel.get_value()) {
+        ERROR("Usage error: -interval_refs is not supported with -parallel.\n");
+        return false;
+    }
+    if ((!op_checkpoint_save.get_value().empty() ||
+         !op_checkpoint_load.get_value().empty()) && op_parallel.get_value()) {
+        ERROR("Usage error: -checkpoint_save and -checkpoint_load are not supported "
+              "with -parallel.\n");
+        return false;
+    }
+    if ((!op_syscall_pollution.get_value().empty() ||
+         op_context_switch_us.get_value() > 0) && op_parallel.get_value()) {
+        ERROR("Usage error: -syscall_pollution and -context_switch_us are not "
+              "supported with -parallel.\n");
+        return false;
+    }
+    if (!init_kernel_model())
+        return false;
+    if (!create_intervals())
+        return false;
+    if (intervals != NULL) {
+        // The default hierarchy reuses its first-level cache names for every core.
+        for (size_t i = 0; i < config.caches.size(); i++) {
+            std::ostringstream name;
+            if (config.caches[i].core >= 0 && config_file.empty())
+                name << "core" << config.caches[i].core << "_";
+            name << config.caches[i].name;
+            intervals->add_device(name.str(), all_caches[i]->get_stats());
+        }
     }
 
     thread_counts = new unsigned int[num_cores];
     memset(thread_counts, 0, sizeof(thread_counts[0])*num_cores);
     thread_ever_counts = new unsigned int[num_cores];
     memset(thread_ever_counts, 0, sizeof(thread_ever_counts[0])*num_cores);
+    core_sched.resize(num_cores);
 
     return true;
 }
 
+bool
+cache_simulator_t::create_hierarchy()
+{
+    bool record_misses = op_report_misses.get_value() > 0;
+    std::map<std::string, cache_t *> by_name;
+    icaches = new cache_t* [num_cores];
+    dcaches = new cache_t* [num_cores];
+    llcache = NULL;
+    // We create every cache before initializing any, so that each can be
+    // given its parent regardless of their order in the config.
+    for (size_t i = 0; i < config.caches.size(); i++) {
+        const cache_params_t &params = config.caches[i];
+        cache_t *cache = create_cache(params.replace_policy.empty() ?
+                                      op_replace_policy.get_value() :
+                                      params.replace_policy);
+        if (cache == NULL)
+            return false;
+        all_caches.push_back(cache);
+        if (params.core < 0) {
+            by_name[params.name] = cache;
+            continue;
+        }
+        if (params.type != "data")
+            icaches[params.core] = cache;
+        if (params.type != "instruction")
+            dcaches[params.core] = cache;
+    }
+    if (config_file.empty())
+        llcache = by_name["LL"];
+    for (size_t i = 0; i < config.caches.size(); i++) {
+        const cache_params_t &params = config.caches[i];
+        caching_device_t *parent = NULL;
+        if (!params.parent.empty())
+            parent = by_name[params.parent];
+        if (llc_proxies != NULL && params.core >= 0)
+            parent = llc_proxies[params.core];
+        if (!all_caches[i]->init(params.assoc, config.line_size, (int)params.size,
+                                 parent, new cache_stats_t(record_misses))) {
+            ERROR("Usage error: failed to initialize %s cache.  Ensure sizes and "
+                  "associativity are powers of 2 "
+                  "and that the total size is a multiple of the line size.\n",
+                  params.name.c_str());
+            return false;
+        }
+        if (!params.prefetcher.empty() && params.prefetcher != PREFETCH_POLICY_NONE) {
+            prefetcher_t *prefetcher = create_prefetcher(params.prefetcher);
+            if (prefetcher == NULL)
+                return false;
+            all_caches[i]->set_prefetcher(prefetcher);
+        }
+    }
+    if (op_report_sets.get_value() > 0) {
+        for (size_t i = 0; i < all_caches.size(); i++)
+            all_caches[i]->enable_set_analysis();
+    }
+    if (op_sample_sets.get_value() > 1) {
+        if (have_latency()) {
+            ERROR("Usage error: latency estimates are not supported with "
+                  "-sample_sets.\n");
+            return false;
+        }
+        for (size_t i = 0; i < config.caches.size(); i++) {
+            if (config.caches[i].parent.empty() &&
+                !all_caches[i]->set_sampling((int)op_sample_sets.get_value())) {
+                ERROR("Usage error: -sample_sets leaves no set of the %s cache.\n",
+                      config.caches[i].name.c_str());
+                return false;
+            }
+        }
+    }
+    if (op_coherence.get_value()) {
+        std::vector<caching_device_t *> roots;
+        for (size_t i = 0; i < config.caches.size(); i++) {
+            if (config.caches[i].parent.empty())
+                roots.push_back(all_caches[i]);
+        }
+        for (size_t i = 0; i < all_caches.size(); i++)
+            all_caches[i]->enable_coherence(roots);
+    }
+    bool write_policy = op_write_policy.get_value() != WRITE_POLICY_NONE;
+    for (size_t i = 0; i < config.caches.size(); i++) {
+        if (!config.caches[i].write_policy.empty() ||
+            !config.caches[i].write_miss.empty())
+            write_policy = true;
+    }
+    if (write_policy) {
+        // A config file's policies apply even without -write_policy, with
+        // write-back as the default then.
+        std::string default_policy = op_write_policy.get_value();
+        if (default_policy == WRITE_POLICY_NONE)
+            default_policy = WRITE_POLICY_BACK;
+        for (size_t i = 0; i < config.caches.size(); i++) {
+            const cache_params_t &params = config.caches[i];
+            std::string policy = params.write_policy.empty() ?
+                default_policy : params.write_policy;
+            std::string miss = params.write_miss.empty() ?
+                op_write_miss.get_value() : params.write_miss;
+            all_caches[i]->set_write_policy(policy == WRITE_POLICY_BACK,
+                                            miss == WRITE_MISS_ALLOCATE);
+        }
+    }
+    // The per-core and per-thread breakdown needs each reference simulated in
+    // order, and all the way down, as -parallel and -L0_filter do not.
+    last_latency_thread = NULL;
+    if (have_latency() && !op_parallel.get_value() && !op_L0_filter.get_value()) {
+        core_latency.resize(num_cores);
+        for (size_t i = 0; i < config.caches.size(); i++) {
+            all_caches[i]->set_latency(config.caches[i].latency, config.memory_latency,
+                                       &latency_counts);
+        }
+    }
+    return true;
+}
+
 cache_simulator_t::~cache_simulator_t()
 {
-    delete llcache->get_stats();
-    for (int i = 0; i < num_cores; i++) {
-        delete icaches[i]->get_stats();
-        delete dcaches[i]->get_stats();
-        delete icaches[i];
-        delete dcaches[i];
+    for (size_t i = 0; i < all_caches.size(); i++) {
+        delete all_caches[i]->get_stats();
+        delete all_caches[i]->get_prefetcher();
+        delete all_caches[i];
     }
     delete [] icaches;
     delete [] dcaches;
+    if (llc_proxies != NULL) {
+        for (int i = 0; i < num_cores; i++) {
+            delete llc_proxies[i]->get_stats();
+            delete llc_proxies[i];
+        }
+        delete [] llc_proxies;
+    }
     delete [] thread_counts;
     delete [] thread_ever_counts;
+    delete numa_map;
+    delete alloc_map;
 }
 
 bool
 cache_simulator_t::run()
 {
-    if (!ipc_iter.init()) {
-        ERROR("failed to read from pipe %s", op_ipc_name.get_value().c_str());
+    if (!reader->init()) {
+        if (op_infile.get_value().empty())
+            ERROR("failed to read from pipe %s", op_ipc_name.get_value().c_str());
+        else
+            ERROR("failed to read from %s", op_infile.get_value().c_str());
         return false;
     }
     memref_tid_t last_thread = 0;
     int last_core = 0;
 
-    uint64_t skip_refs = op_skip_refs.get_value();
     uint64_t warmup_refs = op_warmup_refs.get_value();
     uint64_t sim_refs = op_sim_refs.get_value();
 
-    // XXX i#1703: add options to select either ipc_reader_t or
-    // a recorded trace file reader, and use a base class reader_t
-    // here.
-    for (; ipc_iter != ipc_end; ++ipc_iter) {
-        memref_t memref = *ipc_iter;
-        if (skip_refs > 0) {
-            skip_refs--;
-            continue;
+    // The reader can skip faster than we can by iterating, e.g., by
+    // seeking past whole chunks of a compressed trace file.
+    if (!input_skipped)
+        reader->skip_memrefs(op_skip_refs.get_value());
+
+    if (op_parallel.get_value())
+        return run_parallel();
+
+    if (!op_checkpoint_load.get_value().empty()) {
+        if (!load_checkpoint())
+            return false;
+        warmup_refs = 0;
+    }
+
+    memref_t batch[MEMREF_BATCH_SIZE];
+    size_t batch_size;
+    while ((batch_size = reader->next_batch(batch, MEMREF_BATCH_SIZE)) > 0) {
+        for (size_t idx = 0; idx < batch_size; ++idx) {
+            const memref_t &memref = batch[idx];
+
+            // the references after warmup and simulated ones are dropped
+            if (warmup_refs == 0 && sim_refs == 0)
+                continue;
+
+            // both warmup and simulated references are simulated
+
+            // By default we use a static scheduling of threads to cores;
+            // -sched_quantum and -replay_cpus move threads between cores,
+            // which they only do at a change of thread or a cpu id entry.
+            ++sched_time;
+            int core;
+            if (memref.tid == last_thread && memref.type != TRACE_TYPE_CPU_ID)
+                core = last_core;
+            else {
+                if (memref.type == TRACE_TYPE_CPU_ID)
+                    core = handle_cpu_id(memref.tid, memref.addr);
+                else
+                    core = core_for_thread(memref.tid);
+                last_thread = memref.tid;
+                last_core = core;
+                if (numa_map != NULL)
+                    numa_counts.node = core_node[core];
+            }
+
+            if (memref.type == TRACE_TYPE_THREAD_EXIT) {
+                handle_thread_exit(memref.tid);
+                last_thread = 0;
+            } else if (memref.type == TRACE_TYPE_CPU_ID) {
+                // Only used for scheduling, above.
+            } else if (memref.type == TRACE_TYPE_ALLOC ||
+                       memref.type == TRACE_TYPE_FREE) {
+                if (alloc_map != NULL)
+                    alloc_map->update(memref);
+            } else if (memref.type == TRACE_TYPE_SYSCALL) {
+                // Only the return is modeled, below.
+            } else if (memref.type == TRACE_TYPE_SYSCALL_END) {
+                if (kernel_model)
+                    pollute_core(core, kernel_pollution(core, memref), memref);
+            } else if (op_L0_filter.get_value()) {
+                if (!simulate_filtered(core, memref)) {
+                    ERROR("unhandled memref type");
+                    return false;
+                }
+            } else if (!simulate_l1(core, memref)) {
+                if (memref.type == TRACE_TYPE_L0I_HITS ||
+                    memref.type == TRACE_TYPE_L0D_HITS)
+                    ERROR("the trace was filtered: -L0_filter is required");
+                else
+                    ERROR("unhandled memref type");
+                return false;
+            }
+
+            if (!core_latency.empty())
+                account_latency(memref.tid, core);
+            if (numa_map != NULL)
+                account_numa(memref.tid, core);
+
+            if (op_verbose.get_value() >= 3) {
+                std::cerr << "::" << memref.pid << "." << memref.tid << ":: " <<
+                    " @" << (void *)memref.pc <<
+                    " " << trace_type_names[memref.type] << " " <<
+                    (void *)memref.addr << " x" << memref.size << std::endl;
+            }
+
+            // process counters for warmup and simulated references
+            if (warmup_refs > 0) { // warm caches up
+                warmup_refs--;
+                // reset cache stats when warming up is completed
+                if (warmup_refs == 0) {
+                    reset_stats();
+                    if (!op_checkpoint_save.get_value().empty() && !save_checkpoint())
+                        return false;
+                }
+            }
+            else {
+                sim_refs--;
+                if (intervals != NULL)
+                    intervals->record(memref);
+            }
         }
+    }
+    if (intervals != NULL)
+        intervals->finish();
+    if (op_warmup_refs.get_value() == 0 && !op_checkpoint_save.get_value().empty())
+        return save_checkpoint();
+    return true;
+}
+
+void
+cache_simulator_t::get_checkpoint_devices(std::vector<caching_device_t *> &devices)
+{
+    devices.insert(devices.end(), all_caches.begin(), all_caches.end());
+}
+
+bool
+cache_simulator_t::simulate_l1(int core, const memref_t &memref)
+{
+    if (memref.type == TRACE_TYPE_INSTR ||
+        memref.type == TRACE_TYPE_PREFETCH_INSTR)
+        icaches[core]->request(memref);
+    else if (memref.type == TRACE_TYPE_READ ||
+             memref.type == TRACE_TYPE_WRITE ||
+             // We may potentially handle prefetches differently.
+             // TRACE_TYPE_PREFETCH_INSTR is handled above.
+             type_is_prefetch(memref.type))
+        dcaches[core]->request(memref);
+    else if (memref.type == TRACE_TYPE_INSTR_FLUSH)
+        icaches[core]->flush(memref);
+    else if (memref.type == TRACE_TYPE_DATA_FLUSH)
+        dcaches[core]->flush(memref);
+    else
+        return false;
+    return true;
+}
+
+void
+cache_simulator_t::reset_stats()
+{
+    for (size_t i = 0; i < all_caches.size(); i++)
+        all_caches[i]->get_stats()->reset();
+    if (!core_latency.empty()) {
+        core_latency.assign(num_cores, latency_counts_t());
+        thread_latency.clear();
+        last_latency_thread = NULL;
+    }
+    if (numa_map != NULL) {
+        core_numa.assign(num_cores, numa_counts_t());
+        thread_numa.clear();
+    }
+}
+
+void
+cache_simulator_t::pollute_core(int core, int percent, const memref_t &memref)
+{
+    if (percent == 0)
+        return;
+    icaches[core]->pollute(percent, memref);
+    if (dcaches[core] != icaches[core])
+        dcaches[core]->pollute(percent, memref);
+}
 
-        // the references after warmup and simulated ones are dropped
+bool
+cache_simulator_t::simulate_filtered(int core, const memref_t &memref)
+{
+    if (memref.type == TRACE_TYPE_L0I_HITS) {
+        icaches[core]->get_stats()->add_filtered_hits(memref.addr);
+        llcache->get_stats()->add_filtered_child_hits(memref.addr);
+    } else if (memref.type == TRACE_TYPE_L0D_HITS) {
+        dcaches[core]->get_stats()->add_filtered_hits(memref.addr);
+        llcache->get_stats()->add_filtered_child_hits(memref.addr);
+    } else if (memref.type == TRACE_TYPE_INSTR ||
+               memref.type == TRACE_TYPE_PREFETCH_INSTR) {
+        icaches[core]->get_stats()->access(memref, false);
+        llcache->request(memref);
+    } else if (memref.type == TRACE_TYPE_READ ||
+               memref.type == TRACE_TYPE_WRITE ||
+               type_is_prefetch(memref.type)) {
+        // The tracer does not filter prefetches, so they count as misses.
+        dcaches[core]->get_stats()->access(memref, false);
+        llcache->request(memref);
+    } else if (memref.type == TRACE_TYPE_INSTR_FLUSH)
+        icaches[core]->flush(memref);
+    else if (memref.type == TRACE_TYPE_DATA_FLUSH)
+        dcaches[core]->flush(memref);
+    else
+        return false;
+    return true;
+}
+
+// The number of references the reader thread hands out before every core's
+// batch is sent on.  Each epoch's last-level traffic is replayed core by core,
+// which keeps the results independent of thread timing.
+#define PARALLEL_EPOCH_REFS (16*1024)
+// How many epochs a thread may run ahead of the next stage.
+#define PARALLEL_QUEUE_EPOCHS 4
+
+void
+cache_simulator_t::send_epoch(std::vector<sim_batch_t *> &batches, bool reset_stats,
+                              bool done)
+{
+    // Every core gets a batch each epoch, even if empty, so the last-level
+    // thread can take them in a fixed order.
+    for (int i = 0; i < num_cores; i++) {
+        batches[i]->reset_stats = reset_stats;
+        batches[i]->done = done;
+        l1_queues[i]->push(batches[i]);
+        batches[i] = done ? NULL : new sim_batch_t;
+    }
+}
+
+void *
+cache_simulator_t::l1_worker_main(void *arg)
+{
+    l1_worker_arg_t *worker = (l1_worker_arg_t *) arg;
+    cache_simulator_t *sim = worker->sim;
+    int core = worker->core;
+    bool done = false;
+    while (!done) {
+        sim_batch_t *in = sim->l1_queues[core]->pop();
+        sim_batch_t *out = new sim_batch_t;
+        out->reset_stats = in->reset_stats;
+        out->done = in->done;
+        done = in->done;
+        if (in->reset_stats) {
+            sim->icaches[core]->get_stats()->reset();
+            sim->dcaches[core]->get_stats()->reset();
+            sim->llc_proxies[core]->get_stats()->reset();
+        }
+        sim->llc_proxies[core]->set_output(&out->refs);
+        for (std::vector<memref_t>::iterator it = in->refs.begin();
+             it != in->refs.end(); ++it) {
+            if (!sim->simulate_l1(core, *it))
+                assert(false); // The reader thread filters out other types.
+        }
+        sim->llc_proxies[core]->set_output(NULL);
+        delete in;
+        sim->llc_queues[core]->push(out);
+    }
+    return NULL;
+}
+
+void *
+cache_simulator_t::llc_worker_main(void *arg)
+{
+    cache_simulator_t *sim = (cache_simulator_t *) arg;
+    bool done = false;
+    while (!done) {
+        for (int i = 0; i < sim->num_cores; i++) {
+            sim_batch_t *batch = sim->llc_queues[i]->pop();
+            // All cores' batches in an epoch carry the same flags.
+            if (i == 0 && batch->reset_stats)
+                sim->llcache->get_stats()->reset();
+            done = batch->done;
+            for (std::vector<memref_t>::iterator it = batch->refs.begin();
+                 it != batch->refs.end(); ++it) {
+                if (it->type == TRACE_TYPE_INSTR_FLUSH ||
+                    it->type == TRACE_TYPE_DATA_FLUSH)
+                    sim->llcache->flush(*it);
+                else
+                    sim->llcache->request(*it);
+            }
+            delete batch;
+        }
+    }
+    return NULL;
+}
+
+bool
+cache_simulator_t::run_parallel()
+{
+    bool res = true;
+    memref_tid_t last_thread = 0;
+    int last_core = 0;
+    uint64_t warmup_refs = op_warmup_refs.get_value();
+    uint64_t sim_refs = op_sim_refs.get_value();
+
+    l1_queues = new batch_queue_t* [num_cores];
+    llc_queues = new batch_queue_t* [num_cores];
+    for (int i = 0; i < num_cores; i++) {
+        l1_queues[i] = new batch_queue_t(PARALLEL_QUEUE_EPOCHS);
+        llc_queues[i] = new batch_queue_t(PARALLEL_QUEUE_EPOCHS);
+    }
+    l1_worker_arg_t *args = new l1_worker_arg_t[num_cores];
+    pthread_t *l1_threads = new pthread_t[num_cores];
+    pthread_t llc_thread;
+    for (int i = 0; i < num_cores; i++) {
+        args[i].sim = this;
+        args[i].core = i;
+        if (pthread_create(&l1_threads[i], NULL, l1_worker_main, &args[i]) != 0) {
+            // We can't return with other threads blocked on our queues.
+            ERROR("failed to create simulation thread");
+            exit(1);
+        }
+    }
+    if (pthread_create(&llc_thread, NULL, llc_worker_main, this) != 0) {
+        ERROR("failed to create simulation thread");
+        exit(1);
+    }
+
+    std::vector<sim_batch_t *> batches(num_cores);
+    for (int i = 0; i < num_cores; i++)
+        batches[i] = new sim_batch_t;
+    uint64_t epoch_refs = 0;
+    bool reset_stats = false;
+    for (; *reader != *reader_end; ++(*reader)) {
+        memref_t memref = **reader;
+
+        // Keep draining the reader so a live application isn't blocked.
         if (warmup_refs == 0 && sim_refs == 0)
             continue;
 
-        // both warmup and simulated references are simulated
-
-        // We use a static scheduling of threads to cores, as it is
-        // not practical to measure which core each thread actually
-        // ran on for each memref.
+        ++sched_time;
         int core;
-        if (memref.tid == last_thread)
+        if (memref.tid == last_thread && memref.type != TRACE_TYPE_CPU_ID)
             core = last_core;
         else {
-            core = core_for_thread(memref.tid);
+            if (memref.type == TRACE_TYPE_CPU_ID)
+                core = handle_cpu_id(memref.tid, memref.addr);
+            else
+                core = core_for_thread(memref.tid);
             last_thread = memref.tid;
             last_core = core;
         }
 
-        if (memref.type == TRACE_TYPE_INSTR ||
-            memref.type == TRACE_TYPE_PREFETCH_INSTR)
-            icaches[core]->request(memref);
-        else if (memref.type == TRACE_TYPE_READ ||
-                 memref.type == TRACE_TYPE_WRITE ||
-                 // We may potentially handle prefetches differently.
-                 // TRACE_TYPE_PREFETCH_INSTR is handled above.
-                 type_is_prefetch(memref.type))
-            dcaches[core]->request(memref);
-        else if (memref.type == TRACE_TYPE_INSTR_FLUSH)
-            icaches[core]->flush(memref);
-        else if (memref.type == TRACE_TYPE_DATA_FLUSH)
-            dcaches[core]->flush(memref);
-        else if (memref.type == TRACE_TYPE_THREAD_EXIT) {
+        if (memref.type == TRACE_TYPE_THREAD_EXIT) {
             handle_thread_exit(memref.tid);
             last_thread = 0;
+        } else if (memref.type == TRACE_TYPE_CPU_ID ||
+                   memref.type == TRACE_TYPE_ALLOC ||
+                   memref.type == TRACE_TYPE_FREE ||
+                   memref.type == TRACE_TYPE_SYSCALL ||
+                   memref.type == TRACE_TYPE_SYSCALL_END) {
+            // Cpu ids are only used for scheduling, above.
+        } else if (memref.type == TRACE_TYPE_INSTR ||
+                   memref.type == TRACE_TYPE_PREFETCH_INSTR ||
+                   memref.type == TRACE_TYPE_READ ||
+                   memref.type == TRACE_TYPE_WRITE ||
+                   type_is_prefetch(memref.type) ||
+                   memref.type == TRACE_TYPE_INSTR_FLUSH ||
+                   memref.type == TRACE_TYPE_DATA_FLUSH) {
+            batches[core]->refs.push_back(memref);
         } else {
             ERROR("unhandled memref type");
-            return false;
+            res = false;
+            break;
         }
 
         if (op_verbose.get_value() >= 3) {
@@ -188,23 +765,42 @@ cache_simulator_t::run()
                 (void *)memref.addr << " x" << memref.size << std::endl;
         }
 
-        // process counters for warmup and simulated references
-        if (warmup_refs > 0) { // warm caches up
+        ++epoch_refs;
+        if (warmup_refs > 0) {
             warmup_refs--;
-            // reset cache stats when warming up is completed
+            // End the epoch here so every cache resets at the same point.
             if (warmup_refs == 0) {
-                for (int i = 0; i < num_cores; i++) {
-                    icaches[i]->get_stats()->reset();
-                    dcaches[i]->get_stats()->reset();
-                }
-                llcache->get_stats()->reset();
+                send_epoch(batches, reset_stats, false);
+                reset_stats = true;
+                epoch_refs = 0;
+                continue;
             }
-        }
-        else {
+        } else
             sim_refs--;
+        if (epoch_refs == PARALLEL_EPOCH_REFS) {
+            send_epoch(batches, reset_stats, false);
+            reset_stats = false;
+            epoch_refs = 0;
         }
     }
-    return true;
+    send_epoch(batches, reset_stats, true);
+
+    for (int i = 0; i < num_cores; i++)
+        pthread_join(l1_threads[i], NULL);
+    pthread_join(llc_thread, NULL);
+
+    // The L1 caches reported their accesses to the proxies rather than to
+    // the last-level cache.
+    for (int i = 0; i < num_cores; i++) {
+        llcache->get_stats()->merge_child_stats(*llc_proxies[i]->get_stats());
+        delete l1_queues[i];
+        delete llc_queues[i];
+    }
+    delete [] l1_queues;
+    delete [] llc_queues;
+    delete [] l1_threads;
+    delete [] args;
+    return res;
 }
 
 bool
@@ -214,17 +810,423 @@ cache_simulator_t::print_stats()
         unsigned int threads = thread_ever_counts[i];
         std::cerr << "Core #" << i << " (" << threads << " thread(s))" << std::endl;
         if (threads > 0) {
-            std::cerr << "  L1I stats:" << std::endl;
-            icaches[i]->get_stats()->print_stats("    ");
-            std::cerr << "  L1D stats:" << std::endl;
-            dcaches[i]->get_stats()->print_stats("    ");
+            print_core_schedule(i, "  ");
+            for (size_t j = 0; j < config.caches.size(); j++) {
+                if (config.caches[j].core != i)
+                    continue;
+                std::cerr << "  " << config.caches[j].name << " stats:" << std::endl;
+                all_caches[j]->get_stats()->print_stats("    ");
+            }
+        }
+    }
+    // We list the first-level caches and then the shared caches level by
+    // level, counting up from the cores.
+    // We go by the config rather than the caches' parents, which for -parallel
+    // are proxies.
+    std::vector<size_t> order;
+    std::map<std::string, size_t> shared;
+    std::map<std::string, int> levels;
+    int max_level = 1;
+    for (size_t j = 0; j < config.caches.size(); j++) {
+        if (config.caches[j].core < 0)
+            shared[config.caches[j].name] = j;
+    }
+    for (size_t j = 0; j < config.caches.size(); j++) {
+        if (config.caches[j].core < 0)
+            continue;
+        order.push_back(j);
+        int level = 1;
+        for (std::string parent = config.caches[j].parent; !parent.empty();
+             parent = config.caches[shared[parent]].parent) {
+            ++level;
+            if (level > levels[parent])
+                levels[parent] = level;
+            if (level > max_level)
+                max_level = level;
+        }
+    }
+    for (int level = 2; level <= max_level; level++) {
+        for (size_t j = 0; j < config.caches.size(); j++) {
+            if (config.caches[j].core >= 0 || levels[config.caches[j].name] != level)
+                continue;
+            order.push_back(j);
+            std::cerr << config.caches[j].name << " stats:" << std::endl;
+            all_caches[j]->get_stats()->print_stats("    ");
+        }
+    }
+    if (all_caches[0]->get_stats()->tracks_bandwidth()) {
+        // The traffic of the caches that miss to memory.
+        int_least64_t fetched = 0, written = 0;
+        for (size_t j = 0; j < config.caches.size(); j++) {
+            if (!config.caches[j].parent.empty())
+                continue;
+            fetched += all_caches[j]->get_stats()->get_bytes_fetched();
+            written += all_caches[j]->get_stats()->get_bytes_written();
+        }
+        std::cerr << "Memory traffic:" << std::endl;
+        std::cerr << "    " << std::setw(18) << std::left << "Bytes read:" <<
+            std::setw(20) << std::right << fetched << std::endl;
+        std::cerr << "    " << std::setw(18) << std::left << "Bytes written:" <<
+            std::setw(20) << std::right << written << std::endl;
+    }
+    print_latency();
+    print_numa();
+    if (op_report_misses.get_value() > 0 || alloc_map != NULL ||
+        op_report_sets.get_value() > 0) {
+        symbolizer_t symbolizer;
+        symbolizer.init();
+        // Caches of the same name, e.g., each core's L1I in the default
+        // hierarchy, are reported together.
+        std::vector<std::string> names;
+        std::map<std::string, std::vector<cache_t *> > by_name;
+        for (size_t i = 0; i < order.size(); i++) {
+            const std::string &name = config.caches[order[i]].name;
+            std::vector<cache_t *> &caches = by_name[name];
+            if (caches.empty())
+                names.push_back(name);
+            caches.push_back(all_caches[order[i]]);
+        }
+        if (op_report_misses.get_value() > 0) {
+            for (size_t i = 0; i < names.size(); i++) {
+                print_top_misses(symbolizer, names[i], &by_name[names[i]][0],
+                                 (int)by_name[names[i]].size(), TOP_MISSES_BY_PC);
+            }
+        }
+        if (op_report_misses.get_value() > 0 && op_coherence.get_value()) {
+            for (size_t i = 0; i < names.size(); i++) {
+                print_top_misses(symbolizer, names[i], &by_name[names[i]][0],
+                                 (int)by_name[names[i]].size(),
+                                 TOP_COHERENCE_MISSES_BY_PC);
+            }
+        }
+        if (alloc_map != NULL) {
+            // Caches with none, such as instruction caches, are left out.
+            for (size_t i = 0; i < names.size(); i++) {
+                print_top_misses(symbolizer, names[i], &by_name[names[i]][0],
+                                 (int)by_name[names[i]].size(), TOP_MISSES_BY_SITE);
+            }
+        }
+        if (op_report_sets.get_value() > 0) {
+            for (size_t i = 0; i < names.size(); i++) {
+                print_top_sets(names[i], &by_name[names[i]][0],
+                               (int)by_name[names[i]].size());
+                print_top_misses(symbolizer, names[i], &by_name[names[i]][0],
+                                 (int)by_name[names[i]].size(),
+                                 TOP_CONFLICT_MISSES_BY_PC);
+            }
         }
     }
-    std::cerr << "LL stats:" << std::endl;
-    llcache->get_stats()->print_stats("    ");
     return true;
 }
 
+bool
+cache_simulator_t::have_latency()
+{
+    if (config.memory_latency > 0 ||
+        (numa_map != NULL && config.remote_memory_latency > 0))
+        return true;
+    for (size_t j = 0; j < config.caches.size(); j++) {
+        if (config.caches[j].latency > 0)
+            return true;
+    }
+    return false;
+}
+
+void
+cache_simulator_t::account_latency(memref_tid_t tid, int core)
+{
+    // Flushes and thread exits cost nothing.
+    if (latency_counts.accesses == 0 && latency_counts.cycles == 0)
+        return;
+    if (last_latency_thread == NULL || last_latency_tid != tid) {
+        std::map<memref_tid_t, thread_latency_t>::iterator it = thread_latency.find(tid);
+        if (it == thread_latency.end()) {
+            thread_latency_t entry;
+            entry.core = core;
+            it = thread_latency.insert(std::make_pair(tid, entry)).first;
+        }
+        last_latency_tid = tid;
+        last_latency_thread = &it->second;
+    }
+    latency_counts_t &by_core = core_latency[core];
+    latency_counts_t &by_thread = last_latency_thread->counts;
+    by_core.accesses += latency_counts.accesses;
+    by_core.cycles += latency_counts.cycles;
+    by_core.stall_cycles += latency_counts.stall_cycles;
+    by_thread.accesses += latency_counts.accesses;
+    by_thread.cycles += latency_counts.cycles;
+    by_thread.stall_cycles += latency_counts.stall_cycles;
+    latency_counts = latency_counts_t();
+}
+
+void
+cache_simulator_t::account_numa(memref_tid_t tid, int core)
+{
+    if (numa_counts.local == 0 && numa_counts.remote == 0 && numa_counts.unknown == 0)
+        return;
+    std::map<memref_tid_t, thread_numa_t>::iterator it = thread_numa.find(tid);
+    if (it == thread_numa.end()) {
+        thread_numa_t entry;
+        entry.core = core;
+        it = thread_numa.insert(std::make_pair(tid, entry)).first;
+    }
+    numa_counts_t &by_core = core_numa[core];
+    numa_counts_t &by_thread = it->second.counts;
+    by_core.local += numa_counts.local;
+    by_core.remote += numa_counts.remote;
+    by_core.unknown += numa_counts.unknown;
+    by_thread.local += numa_counts.local;
+    by_thread.remote += numa_counts.remote;
+    by_thread.unknown += numa_counts.unknown;
+    numa_counts.local = 0;
+    numa_counts.remote = 0;
+    numa_counts.unknown = 0;
+}
+
+static void
+print_numa_counts(std::string prefix, const numa_counts_t &counts)
+{
+    std::cerr << prefix << std::setw(18) << std::left << "Local accesses:" <<
+        std::setw(20) << std::right << counts.local << std::endl;
+    std::cerr << prefix << std::setw(18) << std::left << "Remote accesses:" <<
+        std::setw(20) << std::right << counts.remote << std::endl;
+    if (counts.unknown > 0) {
+        std::cerr << prefix << std::setw(18) << std::left << "Unknown node:" <<
+            std::setw(20) << std::right << counts.unknown << std::endl;
+    }
+    if (counts.local + counts.remote > 0) {
+        std::cerr << prefix << std::setw(18) << std::left << "Remote rate:" <<
+            std::setw(20) << std::fixed << std::setprecision(2) << std::right <<
+            ((float)counts.remote*100 / (counts.local + counts.remote)) << "%" <<
+            std::endl;
+    }
+}
+
+void
+cache_simulator_t::print_numa()
+{
+    if (numa_map == NULL)
+        return;
+    std::cerr << "NUMA memory accesses:" << std::endl;
+    numa_counts_t total;
+    for (int i = 0; i < (int)core_numa.size(); i++) {
+        total.local += core_numa[i].local;
+        total.remote += core_numa[i].remote;
+        total.unknown += core_numa[i].unknown;
+    }
+    print_numa_counts("    ", total);
+    for (int i = 0; i < (int)core_numa.size(); i++) {
+        std::cerr << "  Core #" << i << " (node " << core_node[i] << "):" << std::endl;
+        if (core_numa[i].local + core_numa[i].remote + core_numa[i].unknown == 0)
+            continue;
+        print_numa_counts("    ", core_numa[i]);
+        std::map<memref_tid_t, thread_numa_t>::iterator it;
+        for (it = thread_numa.begin(); it != thread_numa.end(); ++it) {
+            if (it->second.core != i)
+                continue;
+            // We avoid std::cerr's digit grouping for the thread id.
+            std::ostringstream tid;
+            tid << it->first;
+            std::cerr << "    Thread " << tid.str() << ":" << std::endl;
+            print_numa_counts("      ", it->second.counts);
+        }
+    }
+}
+
+static void
+print_latency_counts(std::string prefix, int_least64_t cycles, int_least64_t accesses,
+                     int_least64_t stall_cycles)
+{
+    std::cerr << prefix << std::setw(18) << std::left << "Cycles:" <<
+        std::setw(20) << std::right << cycles << std::endl;
+    if (accesses > 0) {
+        std::cerr << prefix << std::setw(18) << std::left << "Cycles/access:" <<
+            std::setw(20) << std::fixed << std::setprecision(2) << std::right <<
+            ((double)cycles/accesses) << std::endl;
+    }
+    std::cerr << prefix << std::setw(18) << std::left << "Stall cycles:" <<
+        std::setw(20) << std::right << stall_cycles << std::endl;
+}
+
+void
+cache_simulator_t::print_latency()
+{
+    if (!have_latency())
+        return;
+    // Every access to a cache, hit or miss, costs its latency, and a miss in a
+    // cache with no parent also costs the memory latency.  We count as stalls
+    // the cycles beyond the first-level caches.
+    int_least64_t cycles = 0;
+    int_least64_t accesses = 0;
+    int_least64_t stall_cycles = 0;
+    for (size_t j = 0; j < config.caches.size(); j++) {
+        caching_device_stats_t *stats = all_caches[j]->get_stats();
+        int_least64_t count = stats->get_hits() + stats->get_misses();
+        int_least64_t cost = count * config.caches[j].latency;
+        if (config.caches[j].parent.empty())
+            cost += stats->get_misses() * config.memory_latency;
+        cycles += cost;
+        if (config.caches[j].core >= 0) {
+            accesses += count;
+            stall_cycles += cost - count * config.caches[j].latency;
+        } else
+            stall_cycles += cost;
+    }
+    for (size_t i = 0; i < core_numa.size(); i++) {
+        cycles += core_numa[i].remote * config.remote_memory_latency;
+        stall_cycles += core_numa[i].remote * config.remote_memory_latency;
+    }
+    std::cerr << "Latency estimate:" << std::endl;
+    print_latency_counts("    ", cycles, accesses, stall_cycles);
+    for (int i = 0; i < (int)core_latency.size(); i++) {
+        if (core_latency[i].accesses == 0)
+            continue;
+        std::cerr << "  Core #" << i << ":" << std::endl;
+        print_latency_counts("    ", core_latency[i].cycles, core_latency[i].accesses,
+                             core_latency[i].stall_cycles);
+        std::map<memref_tid_t, thread_latency_t>::iterator it;
+        for (it = thread_latency.begin(); it != thread_latency.end(); ++it) {
+            if (it->second.core != i)
+                continue;
+            // We avoid std::cerr's digit grouping for the thread id.
+            std::ostringstream tid;
+            tid << it->first;
+            std::cerr << "    Thread " << tid.str() << ":" << std::endl;
+            print_latency_counts("      ", it->second.counts.cycles,
+                                 it->second.counts.accesses,
+                                 it->second.counts.stall_cycles);
+        }
+    }
+}
+
+static bool
+compare_pc_misses(const std::pair<addr_t, caching_device_stats_t::pc_misses_t> &a,
+                  const std::pair<addr_t, caching_device_stats_t::pc_misses_t> &b)
+{
+    if (a.second.count != b.second.count)
+        return a.second.count > b.second.count;
+    return a.first < b.first;
+}
+
+void
+cache_simulator_t::print_top_misses(symbolizer_t &symbolizer, std::string name,
+                                    cache_t **caches, int count, top_misses_t kind)
+{
+    // Sum the per-instruction or per-site misses over all cores.
+    std::map<addr_t, caching_device_stats_t::pc_misses_t> total;
+    for (int i = 0; i < count; i++) {
+        caching_device_stats_t *stats = caches[i]->get_stats();
+        const std::map<addr_t, caching_device_stats_t::pc_misses_t> *misses;
+        if (kind == TOP_MISSES_BY_SITE)
+            misses = &stats->get_site_misses();
+        else if (kind == TOP_COHERENCE_MISSES_BY_PC)
+            misses = &stats->get_pc_coherence_misses();
+        else if (kind == TOP_CONFLICT_MISSES_BY_PC)
+            misses = &stats->get_pc_conflict_misses();
+        else
+            misses = &stats->get_pc_misses();
+        std::map<addr_t, caching_device_stats_t::pc_misses_t>::const_iterator it;
+        for (it = misses->begin(); it != misses->end(); ++it) {
+            std::map<addr_t, caching_device_stats_t::pc_misses_t>::iterator entry =
+                total.find(it->first);
+            if (entry == total.end())
+                total.insert(*it);
+            else
+                entry->second.count += it->second.count;
+        }
+    }
+    std::vector<std::pair<addr_t, caching_device_stats_t::pc_misses_t> >
+        sorted(total.begin(), total.end());
+    std::sort(sorted.begin(), sorted.end(), compare_pc_misses);
+    unsigned int max = op_report_misses.get_value();
+    if (kind == TOP_MISSES_BY_SITE)
+        max = op_report_allocs.get_value();
+    else if (kind == TOP_CONFLICT_MISSES_BY_PC)
+        max = op_report_sets.get_value();
+    if (sorted.size() > max)
+        sorted.resize(max);
+    if (kind != TOP_MISSES_BY_PC && sorted.empty())
+        return;
+    std::cerr << "Top " << sorted.size() << " " << name
+              << (kind == TOP_COHERENCE_MISSES_BY_PC ? " coherence" : "")
+              << (kind == TOP_CONFLICT_MISSES_BY_PC ? " conflict" : "")
+              << (kind == TOP_MISSES_BY_SITE ? " missing allocation sites:" :
+                  " missing instructions:") << std::endl;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        // We avoid std::cerr's digit grouping for the address.
+        std::ostringstream pc;
+        pc << "0x" << std::hex << sorted[i].first;
+        std::cerr << "    " << std::setw(20) << std::right << sorted[i].second.count
+                  << "  " << pc.str() << "  "
+                  << symbolizer.describe(sorted[i].second.pid, sorted[i].first)
+                  << std::endl;
+    }
+}
+
+static bool
+compare_set_conflicts(const std::pair<int, caching_device_stats_t::set_counts_t> &a,
+                      const std::pair<int, caching_device_stats_t::set_counts_t> &b)
+{
+    if (a.second.conflict_misses != b.second.conflict_misses)
+        return a.second.conflict_misses > b.second.conflict_misses;
+    return a.first < b.first;
+}
+
+void
+cache_simulator_t::print_top_sets(std::string name, cache_t **caches, int count)
+{
+    // Caches of the same name share a geometry, so we sum each set over them.
+    std::vector<caching_device_stats_t::set_counts_t> total =
+        caches[0]->get_stats()->get_set_counts();
+    for (int i = 1; i < count; i++) {
+        const std::vector<caching_device_stats_t::set_counts_t> &counts =
+            caches[i]->get_stats()->get_set_counts();
+        for (size_t j = 0; j < total.size() && j < counts.size(); j++) {
+            total[j].accesses += counts[j].accesses;
+            total[j].misses += counts[j].misses;
+            total[j].conflict_misses += counts[j].conflict_misses;
+        }
+    }
+    // The spread of misses over the sets: evenly spread misses leave the
+    // busiest set near the average.
+    std::vector<std::pair<int, caching_device_stats_t::set_counts_t> > sorted;
+    int_least64_t misses = 0, max_misses = 0;
+    int sets_missing = 0;
+    for (size_t j = 0; j < total.size(); j++) {
+        misses += total[j].misses;
+        if (total[j].misses > max_misses)
+            max_misses = total[j].misses;
+        if (total[j].misses > 0)
+            ++sets_missing;
+        if (total[j].conflict_misses > 0)
+            sorted.push_back(std::make_pair((int)j, total[j]));
+    }
+    if (misses == 0)
+        return;
+    std::cerr << name << " misses per set:" << std::endl;
+    std::cerr << "    " << std::setw(18) << std::left << "Sets missing:" <<
+        std::setw(20) << std::right << sets_missing << " of " << total.size() <<
+        std::endl;
+    std::cerr << "    " << std::setw(18) << std::left << "Average:" <<
+        std::setw(20) << std::right << misses / (int_least64_t)total.size() << std::endl;
+    std::cerr << "    " << std::setw(18) << std::left << "Busiest set:" <<
+        std::setw(20) << std::right << max_misses << std::endl;
+    if (sorted.empty())
+        return;
+    std::sort(sorted.begin(), sorted.end(), compare_set_conflicts);
+    if (sorted.size() > op_report_sets.get_value())
+        sorted.resize(op_report_sets.get_value());
+    std::cerr << "Top " << sorted.size() << " " << name << " conflict sets:" << std::endl;
+    std::cerr << "    " << std::setw(20) << std::right << "conflict misses" <<
+        std::setw(20) << "misses" << std::setw(20) << "accesses" << "  set" << std::endl;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        std::cerr << "    " << std::setw(20) << std::right <<
+            sorted[i].second.conflict_misses << std::setw(20) <<
+            sorted[i].second.misses << std::setw(20) << sorted[i].second.accesses <<
+            "  " << sorted[i].first << std::endl;
+    }
+}
+
 cache_t*
 cache_simulator_t::create_cache(std::string policy)
 {
@@ -235,9 +1237,34 @@ cache_simulator_t::create_cache(std::string policy)
         return new cache_t;
     if (policy == REPLACE_POLICY_FIFO) // set to FIFO
         return new cache_fifo_t;
+    if (policy == REPLACE_POLICY_PLRU) // set to tree pseudo-LRU
+        return new cache_plru_t;
+    if (policy == REPLACE_POLICY_SRRIP) // set to SRRIP
+        return new cache_srrip_t;
+    if (policy == REPLACE_POLICY_DRRIP) // set to DRRIP
+        return new cache_drrip_t;
 
     // undefined replacement policy
     ERROR("Usage error: undefined replacement policy. "
-          "Please choose "REPLACE_POLICY_LRU" or "REPLACE_POLICY_LFU".\n");
+          "Please choose "REPLACE_POLICY_LRU", "REPLACE_POLICY_LFU", "
+          REPLACE_POLICY_FIFO", "REPLACE_POLICY_PLRU", "REPLACE_POLICY_SRRIP" or "
+          REPLACE_POLICY_DRRIP".\n");
+    return NULL;
+}
+
+prefetcher_t*
+cache_simulator_t::create_prefetcher(std::string policy)
+{
+    int degree = (int)op_prefetch_degree.get_value();
+    if (policy == PREFETCH_POLICY_NEXTLINE)
+        return new next_line_prefetcher_t(degree);
+    if (policy == PREFETCH_POLICY_STRIDE)
+        return new stride_prefetcher_t(degree);
+    if (policy == PREFETCH_POLICY_STREAM)
+        return new stream_prefetcher_t(degree);
+
+    ERROR("Usage error: undefined prefetcher policy. "
+          "Please choose " PREFETCH_POLICY_NONE ", " PREFETCH_POLICY_NEXTLINE ", "
+          PREFETCH_POLICY_STRIDE " or " PREFETCH_POLICY_STREAM ".\n");
     return NULL;
 }
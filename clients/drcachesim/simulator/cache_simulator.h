@@ -37,32 +37,166 @@
 #define _CACHE_SIMULATOR_H_ 1
 
 #include <map>
+#include <string>
+#include <vector>
 #include "simulator.h"
+#include "alloc_map.h"
 #include "cache_stats.h"
 #include "cache.h"
-#include "ipc_reader.h"
+#include "cache_proxy.h"
+#include "config_reader.h"
+#include "numa_map.h"
+#include "prefetcher.h"
+#include "sim_queue.h"
+#include "symbolizer.h"
 
 class cache_simulator_t : public simulator_t
 {
  public:
+    // Simulates the hierarchy of -config_file, or the default one, on the
+    // memrefs of the reader from -infile or -ipc_name.
+    cache_simulator_t();
+    // For multi_simulator_t: simulates the hierarchy in "config_file" on the
+    // memrefs of "reader", which is already past any -skip_refs.  Takes
+    // ownership of both readers.
+    cache_simulator_t(const std::string &config_file, reader_t *reader,
+                      reader_t *reader_end);
     virtual bool init();
     virtual ~cache_simulator_t();
     virtual bool run();
     virtual bool print_stats();
+    virtual void get_checkpoint_devices(std::vector<caching_device_t *> &devices);
 
  protected:
     // Create a cache_t object with a specific replacement policy.
     virtual cache_t *create_cache(std::string policy);
 
-    // Currently we only support a simple 2-level hierarchy.
-    // XXX i#1715: add support for arbitrary cache layouts.
+    // Create a hardware prefetcher of a specific policy, other than none.
+    virtual prefetcher_t *create_prefetcher(std::string policy);
+
+    // Creates and links up the caches listed in config.
+    bool create_hierarchy();
+
+    // Hands an instruction or data access or flush to the core's L1 caches.
+    // Returns false if the memref is not of a type the L1 caches handle.
+    virtual bool simulate_l1(int core, const memref_t &memref);
+    // For the kernel model: invalidates the given percentage of the lines of
+    // the core's first-level caches (see simulator_t::kernel_pollution()).
+    virtual void pollute_core(int core, int percent, const memref_t &memref);
+
+    // Clears the stats at the end of warmup.
+    virtual void reset_stats();
+
+    // For -L0_filter: the tracer's L0 caches stand in for the L1 caches, so
+    // we account the hit counts and misses it sends to the L1 stats and hand
+    // the misses to the last-level cache.
+    bool simulate_filtered(int core, const memref_t &memref);
+
+    // For -parallel: a group of references passed from the reader thread to
+    // a core's L1 thread, or from there to the last-level cache thread.
+    struct sim_batch_t {
+        sim_batch_t() : reset_stats(false), done(false) {}
+        // Stats are reset before handling refs, at the end of warmup.
+        bool reset_stats;
+        // The last batch the receiving thread will see.
+        bool done;
+        std::vector<memref_t> refs;
+    };
+    typedef sim_queue_t<sim_batch_t *> batch_queue_t;
+    struct l1_worker_arg_t {
+        cache_simulator_t *sim;
+        int core;
+    };
+    virtual bool run_parallel();
+    void send_epoch(std::vector<sim_batch_t *> &batches, bool reset_stats, bool done);
+    static void *l1_worker_main(void *arg);
+    static void *llc_worker_main(void *arg);
+
+    // For -report_misses: lists the instructions with the most misses, or with
+    // -coherence the most coherence misses, summed over the given caches.
+    // For -report_allocs: lists the allocation call sites with the most misses.
+    // For -report_sets: lists the instructions with the most conflict misses.
+    enum top_misses_t {
+        TOP_MISSES_BY_PC,
+        TOP_COHERENCE_MISSES_BY_PC,
+        TOP_MISSES_BY_SITE,
+        TOP_CONFLICT_MISSES_BY_PC,
+    };
+    void print_top_misses(symbolizer_t &symbolizer, std::string name,
+                          cache_t **caches, int count, top_misses_t kind);
+    // For -report_sets: prints how the misses of the given caches spread over
+    // their sets, and lists the sets with the most conflict misses.
+    void print_top_sets(std::string name, cache_t **caches, int count);
+
+    // Prints an estimate of the cycles spent on accesses, from the config's
+    // latencies, overall and, where known, per core and thread.
+    void print_latency();
+    bool have_latency();
+    // Adds the cost of the memref just simulated, gathered in latency_counts,
+    // to the totals of its thread and core.
+    void account_latency(memref_tid_t tid, int core);
+
+    // For -page_node_file: prints each core's node and the accesses to memory
+    // of each core and thread, by whether the memory was on the core's node.
+    void print_numa();
+    // Adds the memory accesses of the memref just simulated, gathered in
+    // numa_counts, to the totals of its thread and core.
+    void account_numa(memref_tid_t tid, int core);
+
+    // The hierarchy, from config_file or else the default of private L1
+    // caches and one shared last-level cache.
+    std::string config_file;
+    cache_config_t config;
+    // Whether our reader was handed to us already past -skip_refs.
+    bool input_skipped;
+    // Every cache, in the order of config.caches.
+    std::vector<cache_t *> all_caches;
 
     // Implement a set of ICaches and DCaches with pointer arrays.
     // This is useful for implementing polymorphism correctly.
+    // For a core with one unified cache, both point to it.
     cache_t **icaches;
     cache_t **dcaches;
 
+    // For the default hierarchy only: the shared last-level cache, which
+    // -L0_filter and -parallel rely on.
     cache_t *llcache;
+
+    // For the latency estimate's breakdown: every cache adds the cost of the
+    // current memref to latency_counts, which we then move to the totals of its
+    // core and thread.  core_latency is empty if there is no breakdown.
+    latency_counts_t latency_counts;
+    std::vector<latency_counts_t> core_latency;
+    struct thread_latency_t {
+        int core;
+        latency_counts_t counts;
+    };
+    std::map<memref_tid_t, thread_latency_t> thread_latency;
+    memref_tid_t last_latency_tid;
+    thread_latency_t *last_latency_thread;
+
+    // For -page_node_file, else NULL: the node holding each page.  The caches
+    // with no parent count their misses in numa_counts, compared to the node
+    // of the current core, which we then move to the totals of its core and
+    // thread.
+    numa_map_t *numa_map;
+    std::vector<int> core_node;
+    numa_counts_t numa_counts;
+    std::vector<numa_counts_t> core_numa;
+    struct thread_numa_t {
+        int core;
+        numa_counts_t counts;
+    };
+    std::map<memref_tid_t, thread_numa_t> thread_numa;
+
+    // For -report_allocs, else NULL: the live allocations, to which every
+    // cache attributes its misses.
+    alloc_map_t *alloc_map;
+
+    // For -parallel, each core's L1 caches use a proxy as their parent.
+    cache_proxy_t **llc_proxies;
+    batch_queue_t **l1_queues;
+    batch_queue_t **llc_queues;
 };
 
 #endif /* _CACHE_SIMULATOR_H_ */
@@ -34,8 +34,10 @@
 #include <iomanip>
 #include "cache_stats.h"
 
-cache_stats_t::cache_stats_t() :
-    num_flushes(0), num_prefetch_hits(0), num_prefetch_misses(0)
+cache_stats_t::cache_stats_t(bool record_pc_misses) :
+    caching_device_stats_t(record_pc_misses), num_flushes(0), num_prefetch_hits(0),
+    num_prefetch_misses(0), num_hw_prefetches(0), num_hw_prefetches_useful(0),
+    num_hw_prefetches_late(0), num_hw_prefetches_polluting(0)
 {
 }
 
@@ -43,7 +45,11 @@ void
 cache_stats_t::access(const memref_t &memref, bool hit)
 {
     // handle prefetching requests
-    if (type_is_prefetch(memref.type)) {
+    if (memref.type == TRACE_TYPE_HARDWARE_PREFETCH) {
+        // A hit is dropped.
+        if (!hit)
+            num_hw_prefetches++;
+    } else if (type_is_prefetch(memref.type)) {
         if (hit)
             num_prefetch_hits++;
         else
@@ -53,6 +59,27 @@ cache_stats_t::access(const memref_t &memref, bool hit)
     }
 }
 
+void
+cache_stats_t::coherence_miss(const memref_t &memref, bool false_sharing)
+{
+    if (!type_is_prefetch(memref.type) && memref.type != TRACE_TYPE_HARDWARE_PREFETCH)
+        caching_device_stats_t::coherence_miss(memref, false_sharing);
+}
+
+void
+cache_stats_t::prefetch_use(const memref_t &memref, bool late)
+{
+    num_hw_prefetches_useful++;
+    if (late)
+        num_hw_prefetches_late++;
+}
+
+void
+cache_stats_t::prefetch_pollution(const memref_t &memref)
+{
+    num_hw_prefetches_polluting++;
+}
+
 void
 cache_stats_t::flush(const memref_t &memref)
 {
@@ -69,9 +96,20 @@ cache_stats_t::print_counts(std::string prefix)
     }
     if (num_prefetch_hits + num_prefetch_misses != 0) {
         std::cerr << prefix << std::setw(18) << std::left << "Prefetch hits:" <<
-            std::setw(20) << std::right << num_prefetch_hits << std::endl;
+            std::setw(20) << std::right << scaled(num_prefetch_hits) << std::endl;
         std::cerr << prefix << std::setw(18) << std::left << "Prefetch misses:" <<
-            std::setw(20) << std::right << num_prefetch_misses << std::endl;
+            std::setw(20) << std::right << scaled(num_prefetch_misses) << std::endl;
+    }
+    if (num_hw_prefetches != 0) {
+        std::cerr << prefix << std::setw(18) << std::left << "HW pf issued:" <<
+            std::setw(20) << std::right << scaled(num_hw_prefetches) << std::endl;
+        std::cerr << prefix << std::setw(18) << std::left << "HW pf useful:" <<
+            std::setw(20) << std::right << scaled(num_hw_prefetches_useful) << std::endl;
+        std::cerr << prefix << std::setw(18) << std::left << "HW pf late:" <<
+            std::setw(20) << std::right << scaled(num_hw_prefetches_late) << std::endl;
+        std::cerr << prefix << std::setw(18) << std::left << "HW pf polluting:" <<
+            std::setw(20) << std::right <<
+                scaled(num_hw_prefetches_polluting) << std::endl;
     }
 }
 
@@ -82,4 +120,8 @@ cache_stats_t::reset()
     num_flushes = 0;
     num_prefetch_hits = 0;
     num_prefetch_misses = 0;
+    num_hw_prefetches = 0;
+    num_hw_prefetches_useful = 0;
+    num_hw_prefetches_late = 0;
+    num_hw_prefetches_polluting = 0;
 }
@@ -41,12 +41,18 @@
 class cache_stats_t : public caching_device_stats_t
 {
  public:
-    cache_stats_t();
+    explicit cache_stats_t(bool record_pc_misses = false);
 
     // In addition to caching_device_stats_t::access,
     // cache_stats_t::access processes prefetching requests.
     virtual void access(const memref_t &memref, bool hit);
 
+    // Like access(), this leaves prefetching requests out.
+    virtual void coherence_miss(const memref_t &memref, bool false_sharing);
+
+    virtual void prefetch_use(const memref_t &memref, bool late);
+    virtual void prefetch_pollution(const memref_t &memref);
+
     // process CPU cache flushes
     virtual void flush(const memref_t &memref);
 
@@ -63,6 +69,13 @@ class cache_stats_t : public caching_device_stats_t
     int_least64_t num_flushes;
     int_least64_t num_prefetch_hits;
     int_least64_t num_prefetch_misses;
+    // Hardware prefetches that missed and so brought in a block, how many of
+    // those blocks were used, how many of those uses came soon after the
+    // prefetch, and how many demand misses were on blocks a prefetch replaced.
+    int_least64_t num_hw_prefetches;
+    int_least64_t num_hw_prefetches_useful;
+    int_least64_t num_hw_prefetches_late;
+    int_least64_t num_hw_prefetches_polluting;
 };
 
 #endif /* _CACHE_STATS_H_ */
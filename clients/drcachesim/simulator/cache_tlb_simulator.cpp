@@ -0,0 +1,207 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <assert.h>
+#include "utils.h"
+#include "memref.h"
+#include "droption.h"
+#include "../common/options.h"
+#include "cache_tlb_simulator.h"
+
+cache_tlb_simulator_t::cache_tlb_simulator_t() :
+    page_bits(0), next_frame(0),
+    // Without -physical_caches, the page tables live in the upper half of the
+    // address space, out of the way of the traced (user-mode) addresses.
+    next_table_frame((addr_t)1 << (sizeof(addr_t) * 8 - 1)),
+    last_pid(0), last_page((addr_t)-1), last_frame(0)
+{
+}
+
+bool
+cache_tlb_simulator_t::init()
+{
+    if (op_parallel.get_value()) {
+        ERROR("Usage error: -parallel is not supported by the " CACHE_TLB
+              " simulator.\n");
+        return false;
+    }
+    if (!op_checkpoint_save.get_value().empty() ||
+        !op_checkpoint_load.get_value().empty()) {
+        // The checkpoint would also need the page frames handed out so far.
+        ERROR("Usage error: -checkpoint_save and -checkpoint_load are not supported by "
+              "the " CACHE_TLB " simulator.\n");
+        return false;
+    }
+    if (!cache_simulator_t::init())
+        return false;
+    if (!tlbs.create_tlbs(num_cores))
+        return false;
+    if (intervals != NULL)
+        tlbs.add_interval_devices(intervals, "TLB_");
+    page_bits = compute_log2((int)op_page_size.get_value());
+    walk_stats.resize(num_cores);
+    for (size_t i = 0; i < all_caches.size(); i++) {
+        if (all_caches[i]->get_parent() == NULL)
+            last_level_caches.push_back(all_caches[i]);
+    }
+    return true;
+}
+
+addr_t
+cache_tlb_simulator_t::frame_of(const page_key_t &key)
+{
+    std::map<page_key_t, addr_t>::iterator it = frames.find(key);
+    if (it != frames.end())
+        return it->second;
+    addr_t frame;
+    if (op_physical_caches.get_value() || (key.second & ((1 << LEVEL_BITS) - 1)) == 0)
+        frame = next_frame++ << page_bits;
+    else
+        frame = next_table_frame++ << page_bits;
+    frames.insert(std::make_pair(key, frame));
+    return frame;
+}
+
+addr_t
+cache_tlb_simulator_t::physical_addr(memref_pid_t pid, addr_t addr)
+{
+    addr_t page = addr >> page_bits;
+    if (pid != last_pid || page != last_page) {
+        last_frame = frame_of(page_key_t(pid, page << LEVEL_BITS));
+        last_pid = pid;
+        last_page = page;
+    }
+    return last_frame | (addr & (((addr_t)1 << page_bits) - 1));
+}
+
+void
+cache_tlb_simulator_t::walk_page_table(int core, const memref_t &memref)
+{
+    // Each level's table is a page of entries indexed by the next bits of
+    // the page number, the top level's by the highest.
+    const int entry_size = sizeof(addr_t);
+    const int index_bits = page_bits - compute_log2(entry_size);
+    int levels = (int)op_TLB_walk_levels.get_value();
+    addr_t page = memref.addr >> page_bits;
+    walk_stats_t &stats = walk_stats[core];
+    int_least64_t l1_misses = dcaches[core]->get_stats()->get_misses();
+    int_least64_t memory_accesses = 0;
+    for (size_t i = 0; i < last_level_caches.size(); i++)
+        memory_accesses -= last_level_caches[i]->get_stats()->get_misses();
+
+    memref_t pte = memref;
+    pte.type = TRACE_TYPE_READ;
+    pte.size = entry_size;
+    if (memref.type == TRACE_TYPE_INSTR)
+        pte.pc = memref.addr;
+    for (int level = 0; level < levels; level++) {
+        int shift = index_bits * (levels - 1 - level);
+        // Shifting by the width of page is undefined, and the top-level table
+        // index is zero by then anyway.
+        addr_t table = shift + index_bits >= (int)sizeof(addr_t) * 8 ? 0 :
+            page >> (shift + index_bits);
+        addr_t entry = shift >= (int)sizeof(addr_t) * 8 ? 0 :
+            (page >> shift) & (((addr_t)1 << index_bits) - 1);
+        pte.addr = frame_of(page_key_t(memref.pid, (table << LEVEL_BITS) | (level + 1))) +
+            entry * entry_size;
+        dcaches[core]->request(pte);
+    }
+
+    stats.walks++;
+    stats.accesses += levels;
+    stats.l1_misses += dcaches[core]->get_stats()->get_misses() - l1_misses;
+    for (size_t i = 0; i < last_level_caches.size(); i++)
+        memory_accesses += last_level_caches[i]->get_stats()->get_misses();
+    stats.memory_accesses += memory_accesses;
+}
+
+bool
+cache_tlb_simulator_t::simulate_l1(int core, const memref_t &memref)
+{
+    if (memref.type == TRACE_TYPE_INSTR ||
+        memref.type == TRACE_TYPE_READ ||
+        memref.type == TRACE_TYPE_WRITE) {
+        if (tlbs.translate(core, memref))
+            walk_page_table(core, memref);
+    } else if (!type_is_prefetch(memref.type) &&
+               memref.type != TRACE_TYPE_INSTR_FLUSH &&
+               memref.type != TRACE_TYPE_DATA_FLUSH)
+        return cache_simulator_t::simulate_l1(core, memref);
+    if (!op_physical_caches.get_value())
+        return cache_simulator_t::simulate_l1(core, memref);
+    // An access or flush that crosses a page boundary is kept on the first page.
+    memref_t physical = memref;
+    physical.addr = physical_addr(memref.pid, memref.addr);
+    return cache_simulator_t::simulate_l1(core, physical);
+}
+
+void
+cache_tlb_simulator_t::pollute_core(int core, int percent, const memref_t &memref)
+{
+    cache_simulator_t::pollute_core(core, percent, memref);
+    tlbs.pollute_core(core, percent, memref);
+}
+
+void
+cache_tlb_simulator_t::reset_stats()
+{
+    cache_simulator_t::reset_stats();
+    tlbs.reset_tlb_stats();
+    walk_stats.assign(num_cores, walk_stats_t());
+}
+
+bool
+cache_tlb_simulator_t::print_stats()
+{
+    if (!cache_simulator_t::print_stats())
+        return false;
+    for (int i = 0; i < num_cores; i++) {
+        if (thread_ever_counts[i] == 0)
+            continue;
+        std::cerr << "Core #" << i << " TLBs:" << std::endl;
+        tlbs.print_core_tlb_stats(i, "  ");
+        const walk_stats_t &stats = walk_stats[i];
+        std::cerr << "  Page walk stats:" << std::endl;
+        std::cerr << "    " << std::setw(18) << std::left << "Walks:" <<
+            std::setw(20) << std::right << stats.walks << std::endl;
+        std::cerr << "    " << std::setw(18) << std::left << "Entry reads:" <<
+            std::setw(20) << std::right << stats.accesses << std::endl;
+        std::cerr << "    " << std::setw(18) << std::left << "L1D misses:" <<
+            std::setw(20) << std::right << stats.l1_misses << std::endl;
+        std::cerr << "    " << std::setw(18) << std::left << "Memory accesses:" <<
+            std::setw(20) << std::right << stats.memory_accesses << std::endl;
+    }
+    return true;
+}
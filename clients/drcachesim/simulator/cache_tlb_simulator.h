@@ -0,0 +1,105 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* cache_tlb_simulator: simulates the caches and the TLBs together.
+ */
+
+#ifndef _CACHE_TLB_SIMULATOR_H_
+#define _CACHE_TLB_SIMULATOR_H_ 1
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "cache_simulator.h"
+#include "tlb_simulator.h"
+
+// Runs each instruction fetch and data access through the core's TLBs and
+// then its caches, in a single pass.  A last-level TLB miss reads one page
+// table entry per -TLB_walk_levels level through the core's L1 data cache,
+// so the walks compete with the application for cache space, and we count
+// the cache misses they cause.  With -physical_caches the caches see simulated
+// physical addresses, otherwise the traced ones.
+// The page tables are modeled with -page_size pages at every level even where
+// -page_size_file gives a larger page.
+class cache_tlb_simulator_t : public cache_simulator_t
+{
+ public:
+    cache_tlb_simulator_t();
+    virtual bool init();
+    virtual bool print_stats();
+
+ protected:
+    virtual bool simulate_l1(int core, const memref_t &memref);
+    virtual void pollute_core(int core, int percent, const memref_t &memref);
+    virtual void reset_stats();
+
+    // Identifies a page of a process: a data page by its page number and a
+    // page table by its index at its level, with the level in the low bits
+    // (zero for data pages).
+    typedef std::pair<memref_pid_t, addr_t> page_key_t;
+    static const int LEVEL_BITS = 4;
+
+    // Returns the address of the frame holding the page of key, handing out
+    // frames in first-touch order.
+    addr_t frame_of(const page_key_t &key);
+    addr_t physical_addr(memref_pid_t pid, addr_t addr);
+    // Reads the page table entries translating memref.addr.
+    void walk_page_table(int core, const memref_t &memref);
+
+    // Only the TLBs of tlbs are used: we run the trace ourselves.
+    tlb_simulator_t tlbs;
+
+    int page_bits;
+    std::map<page_key_t, addr_t> frames;
+    addr_t next_frame;
+    addr_t next_table_frame;
+    // A single-entry cache of the last data page translated.
+    memref_pid_t last_pid;
+    addr_t last_page;
+    addr_t last_frame;
+
+    struct walk_stats_t {
+        walk_stats_t() : walks(0), accesses(0), l1_misses(0), memory_accesses(0) {}
+        int_least64_t walks;
+        int_least64_t accesses;
+        // Page table entry reads that missed in the L1 data cache.
+        int_least64_t l1_misses;
+        // Page table entry reads that missed in every cache.
+        int_least64_t memory_accesses;
+    };
+    std::vector<walk_stats_t> walk_stats;
+    // The caches without parents, whose misses go to memory.
+    std::vector<cache_t *> last_level_caches;
+};
+
+#endif /* _CACHE_TLB_SIMULATOR_H_ */
@@ -35,17 +35,25 @@
 #include "caching_device_stats.h"
 #include "utils.h"
 #include <assert.h>
+#include <string.h>
 
-caching_device_t::caching_device_t()
+caching_device_t::caching_device_t() :
+    tags(NULL), counters(NULL), states(NULL), written(NULL), dirty(NULL),
+    write_back(false), write_allocate(false), prefetcher(NULL), prefetch_info(NULL),
+    num_requests(0), latency_counts(NULL), numa_map(NULL), numa_counts(NULL),
+    analyze_sets(false), sampled_sets(NULL), pollute_way(0), pollute_carry(0)
 {
-    blocks = 0;
 }
 
 caching_device_t::~caching_device_t()
 {
-    for (int i = 0; i < num_blocks; i++)
-        delete blocks[i];
-    delete [] blocks;
+    delete [] tags;
+    delete [] counters;
+    delete [] states;
+    delete [] written;
+    delete [] dirty;
+    delete [] prefetch_info;
+    delete [] sampled_sets;
 }
 
 bool
@@ -70,9 +78,16 @@ caching_device_t::init(int associativity_, int block_size_, int num_blocks_,
     if (assoc_bits == -1 || block_size_bits == -1 || !IS_POWER_OF_2(blocks_per_set))
         return false;
     parent = parent_;
+    if (parent != NULL)
+        parent->children.push_back(this);
     stats = stats_;
 
-    blocks = new caching_device_block_t* [num_blocks];
+    tags = new addr_t[num_blocks];
+    counters = new int[num_blocks];
+    for (int i = 0; i < num_blocks; i++) {
+        tags[i] = TAG_INVALID;
+        counters[i] = 0;
+    }
     init_blocks();
 
     last_tag = TAG_INVALID; // sentinel
@@ -82,99 +97,302 @@ caching_device_t::init(int associativity_, int block_size_, int num_blocks_,
 void
 caching_device_t::request(const memref_t &memref_in)
 {
-    // Unfortunately we need to make a copy for our loop so we can pass
-    // the right data struct to the parent and stats collectors.
-    memref_t memref;
-    // We support larger sizes to improve the IPC perf.
-    // This means that one memref could touch multiple blocks.
-    // We treat each block separately for statistics purposes.
-    addr_t final_addr = memref_in.addr + memref_in.size - 1/*avoid overflow*/;
-    addr_t final_tag = compute_tag(final_addr);
-    addr_t tag = compute_tag(memref_in.addr);
-
-    // Optimization: check last tag if single-block
-    if (tag == final_tag && tag == last_tag) {
-        // Make sure last_tag is properly in sync.
-        assert(tag != TAG_INVALID &&
-               tag == get_caching_device_block(last_block_idx, last_way).tag);
-        stats->access(memref_in, true/*hit*/);
-        if (parent != NULL)
-            parent->stats->child_access(memref_in, true);
-        access_update(last_block_idx, last_way);
-        return;
-    }
+    lfu_policy_t lfu;
+    request_with(lfu, memref_in);
+}
 
-    memref = memref_in;
-    for (; tag <= final_tag; ++tag) {
-        int way;
-        int block_idx = compute_block_idx(tag);
+void
+caching_device_t::enable_set_analysis()
+{
+    analyze_sets = true;
+    stats->enable_set_analysis(blocks_per_set, num_blocks);
+}
 
-        if (tag + 1 <= final_tag)
-            memref.size = ((tag + 1) << block_size_bits) - memref.addr;
+bool
+caching_device_t::set_sampling(int ratio)
+{
+    if (ratio < 1)
+        return false;
+    // A multiplicative hash spreads the sampled sets over the whole index
+    // range, rather than taking every ratio-th set, which strided accesses
+    // could hit or miss all together.
+    int num_sampled = 0;
+    sampled_sets = new unsigned char[blocks_per_set];
+    for (int i = 0; i < blocks_per_set; i++) {
+        sampled_sets[i] = ((((unsigned int)i * 2654435761U) >> 16) % ratio) == 0;
+        num_sampled += sampled_sets[i];
+    }
+    if (num_sampled == 0) {
+        delete [] sampled_sets;
+        sampled_sets = NULL;
+        return false;
+    }
+    stats->enable_sampling(blocks_per_set, num_sampled);
+    return true;
+}
 
-        for (way = 0; way < associativity; ++way) {
-            if (get_caching_device_block(block_idx, way).tag == tag) {
-                stats->access(memref, true/*hit*/);
-                if (parent != NULL)
-                    parent->stats->child_access(memref, true);
-                break;
+void
+caching_device_t::pollute(int percent, const memref_t &cause)
+{
+    // Which lines the outside code displaces depends on what it touches and on
+    // the replacement policy, neither of which we know, so we take the same
+    // number from each set, rotating through the ways from one call to the
+    // next.
+    for (int i = 0; i < blocks_per_set; i++) {
+        int block_idx = i << assoc_bits;
+        pollute_carry += percent * associativity;
+        for (int j = 0; pollute_carry >= 100 && j < associativity; j++) {
+            pollute_carry -= 100;
+            int way = (pollute_way + j) & (associativity - 1);
+            if (get_tag(block_idx, way) == TAG_INVALID)
+                continue;
+            if (dirty != NULL)
+                write_back_victim(cause, block_idx, way);
+            get_tag(block_idx, way) = TAG_INVALID;
+            // Xref caching_device_block.h about why we set counter to 0.
+            get_counter(block_idx, way) = 0;
+            if (states != NULL)
+                states[block_idx + way] = COHERENCE_INVALID;
+            if (prefetch_info != NULL) {
+                prefetch_info[block_idx + way].unused = false;
+                prefetch_info[block_idx + way].victim = TAG_INVALID;
             }
         }
+        // A set gives up at most all of its blocks.
+        if (pollute_carry >= 100)
+            pollute_carry %= 100;
+    }
+    pollute_way = (pollute_way + 1) & (associativity - 1);
+    last_tag = TAG_INVALID;
+}
 
-        if (way == associativity) {
-            stats->access(memref, false/*miss*/);
-            // If no parent we assume we get the data from main memory
-            if (parent != NULL) {
-                parent->stats->child_access(memref, false);
-                parent->request(memref);
-            }
+void
+caching_device_t::enable_coherence(const std::vector<caching_device_t *> &roots_)
+{
+    if (parent == NULL)
+        roots = roots_;
+    states = new unsigned char[num_blocks];
+    written = new written_range_t[num_blocks];
+    for (int i = 0; i < num_blocks; i++) {
+        states[i] = COHERENCE_INVALID;
+        written[i].offs = 0;
+        written[i].size = 0;
+    }
+}
 
-            // FIXME i#1726: coherence policy
+void
+caching_device_t::update_coherence(const memref_t &memref, int block_idx, int way,
+                                   bool hit)
+{
+    unsigned char &state = states[block_idx + way];
+    if (!children.empty()) {
+        // We only need to know that a block filled from below is valid again.
+        if (!hit)
+            state = COHERENCE_SHARED;
+        return;
+    }
+    // A newly filled or refilled block has no rights yet.
+    if (!hit)
+        state = COHERENCE_INVALID;
+    if (memref.type == TRACE_TYPE_WRITE) {
+        // Unless we already hold the only copy, the others must be invalidated.
+        if (state != COHERENCE_EXCLUSIVE && state != COHERENCE_MODIFIED)
+            snoop(memref, true/*write*/);
+        state = COHERENCE_MODIFIED;
+    } else if (!hit) {
+        state = snoop(memref, false/*read*/) ? COHERENCE_SHARED : COHERENCE_EXCLUSIVE;
+    }
+}
 
-            way = replace_which_way(block_idx);
-            get_caching_device_block(block_idx, way).tag = tag;
+bool
+caching_device_t::snoop(const memref_t &memref, bool write)
+{
+    bool shared = false;
+    caching_device_t *node = this;
+    for (; node->parent != NULL; node = node->parent) {
+        std::vector<caching_device_t *> &siblings = node->parent->children;
+        for (size_t i = 0; i < siblings.size(); i++) {
+            if (siblings[i] != node && siblings[i]->snoop_subtree(memref, write))
+                shared = true;
         }
+    }
+    for (size_t i = 0; i < node->roots.size(); i++) {
+        if (node->roots[i] != node && node->roots[i]->snoop_subtree(memref, write))
+            shared = true;
+    }
+    return shared;
+}
 
-        access_update(block_idx, way);
-
-        if (tag + 1 <= final_tag) {
-            addr_t next_addr = (tag + 1) << block_size_bits;
-            memref.addr = next_addr;
-            memref.size = final_addr - next_addr + 1/*undo the -1*/;
+bool
+caching_device_t::snoop_subtree(const memref_t &memref, bool write)
+{
+    bool held = false;
+    if (states != NULL) {
+        addr_t tag = compute_tag(memref.addr);
+        int block_idx = compute_block_idx(tag);
+        int way = find_tag_way(&tags[block_idx], associativity, tag);
+        if (way < associativity && states[block_idx + way] != COHERENCE_INVALID) {
+            held = true;
+            if (write) {
+                states[block_idx + way] = COHERENCE_INVALID;
+                written[block_idx + way].offs = (int)(memref.addr & (block_size - 1));
+                written[block_idx + way].size = (int)memref.size;
+                stats->invalidate(memref);
+                // The writer takes over any dirty data along with the block.
+                if (dirty != NULL)
+                    dirty[block_idx + way] = 0;
+                if (tag == last_tag)
+                    last_tag = TAG_INVALID;
+            } else
+                states[block_idx + way] = COHERENCE_SHARED;
         }
-        // Optimization: remember last tag
-        last_tag = tag;
-        last_way = way;
-        last_block_idx = block_idx;
     }
+    for (size_t i = 0; i < children.size(); i++) {
+        if (children[i]->snoop_subtree(memref, write))
+            held = true;
+    }
+    return held;
+}
+
+void
+caching_device_t::set_write_policy(bool write_back_, bool write_allocate_)
+{
+    write_back = write_back_;
+    write_allocate = write_allocate_;
+    dirty = new unsigned char[num_blocks];
+    for (int i = 0; i < num_blocks; i++)
+        dirty[i] = 0;
+    stats->enable_bandwidth();
+}
+
+void
+caching_device_t::write_to_parent(const memref_t &memref, bool evicting)
+{
+    stats->write((int)memref.size, evicting);
+    if (parent != NULL) {
+        memref_t write = memref;
+        write.type = TRACE_TYPE_WRITEBACK;
+        parent->request(write);
+    }
+}
+
+// The per-device header of a checkpoint, to catch a mismatched hierarchy.
+struct device_state_header_t {
+    int associativity;
+    int block_size;
+    int num_blocks;
+    bool coherence;
+    bool write_policy;
+};
+
+bool
+caching_device_t::save_state(std::ostream &out)
+{
+    device_state_header_t header;
+    memset(&header, 0, sizeof(header)); // No stray bytes in the file.
+    header.associativity = associativity;
+    header.block_size = block_size;
+    header.num_blocks = num_blocks;
+    header.coherence = states != NULL;
+    header.write_policy = dirty != NULL;
+    out.write((const char *)&header, sizeof(header));
+    out.write((const char *)tags, num_blocks * sizeof(tags[0]));
+    out.write((const char *)counters, num_blocks * sizeof(counters[0]));
+    if (states != NULL) {
+        out.write((const char *)states, num_blocks * sizeof(states[0]));
+        out.write((const char *)written, num_blocks * sizeof(written[0]));
+    }
+    if (dirty != NULL)
+        out.write((const char *)dirty, num_blocks * sizeof(dirty[0]));
+    return save_blocks(out) && out.good();
+}
+
+bool
+caching_device_t::restore_state(std::istream &in)
+{
+    device_state_header_t header;
+    if (!in.read((char *)&header, sizeof(header)) ||
+        header.associativity != associativity ||
+        header.block_size != block_size ||
+        header.num_blocks != num_blocks ||
+        header.coherence != (states != NULL) ||
+        header.write_policy != (dirty != NULL))
+        return false;
+    in.read((char *)tags, num_blocks * sizeof(tags[0]));
+    in.read((char *)counters, num_blocks * sizeof(counters[0]));
+    if (states != NULL) {
+        in.read((char *)states, num_blocks * sizeof(states[0]));
+        in.read((char *)written, num_blocks * sizeof(written[0]));
+    }
+    if (dirty != NULL)
+        in.read((char *)dirty, num_blocks * sizeof(dirty[0]));
+    // Prefetched blocks are tracked afresh.
+    delete [] prefetch_info;
+    prefetch_info = NULL;
+    num_requests = 0;
+    last_tag = TAG_INVALID;
+    return restore_blocks(in) && in.good();
 }
 
 void
-caching_device_t::access_update(int block_idx, int way)
+caching_device_t::set_latency(int latency_, int memory_latency,
+                              latency_counts_t *counts)
 {
-    // We just inc the counter for LFU.  We live with any blip on overflow.
-    get_caching_device_block(block_idx, way).counter++;
+    latency_counts = counts;
+    latency = latency_;
+    first_level = children.empty() ? 1 : 0;
+    stall_latency = first_level ? 0 : latency;
+    miss_latency = parent == NULL ? memory_latency : 0;
 }
 
-int
-caching_device_t::replace_which_way(int block_idx)
+void
+caching_device_t::set_numa(numa_map_t *map, numa_counts_t *counts, int remote_latency_)
 {
-    // The base caching device class only implements LFU.
-    // A subclass can override this and access_update() to implement
-    // some other scheme.
-    int min_counter;
-    int min_way = 0;
-    for (int way = 0; way < associativity; ++way) {
-        if (get_caching_device_block(block_idx, way).tag == TAG_INVALID) {
-            min_way = way;
-            break;
+    numa_map = map;
+    numa_counts = counts;
+    remote_latency = remote_latency_;
+}
+
+void
+caching_device_t::set_prefetcher(prefetcher_t *prefetcher_)
+{
+    prefetcher = prefetcher_;
+}
+
+bool
+caching_device_t::update_prefetch(const memref_t &memref, int block_idx, int way,
+                                  bool hit, addr_t victim)
+{
+    if (prefetch_info == NULL) {
+        prefetch_info = new prefetch_info_t[num_blocks];
+        for (int i = 0; i < num_blocks; i++) {
+            prefetch_info[i].unused = false;
+            prefetch_info[i].arrival = 0;
+            prefetch_info[i].victim = TAG_INVALID;
         }
-        if (way == 0 || get_caching_device_block(block_idx, way).counter < min_counter) {
-            min_counter = get_caching_device_block(block_idx, way).counter;
-            min_way = way;
+    }
+    num_requests++;
+    bool hw_prefetch = memref.type == TRACE_TYPE_HARDWARE_PREFETCH;
+    bool demand = !hw_prefetch && !type_is_prefetch(memref.type);
+    prefetch_info_t &info = prefetch_info[block_idx + way];
+    if (hit) {
+        if (!demand || !info.unused)
+            return false;
+        info.unused = false;
+        stats->prefetch_use(memref, num_requests - info.arrival <= PREFETCH_LATE_WINDOW);
+        return true;
+    }
+    if (demand) {
+        addr_t tag = compute_tag(memref.addr);
+        for (int i = 0; i < associativity; i++) {
+            if (prefetch_info[block_idx + i].victim == tag) {
+                prefetch_info[block_idx + i].victim = TAG_INVALID;
+                stats->prefetch_pollution(memref);
+            }
         }
     }
-    // Clear the counter for LFU.
-    get_caching_device_block(block_idx, min_way).counter = 0;
-    return min_way;
+    info.unused = hw_prefetch;
+    info.arrival = num_requests;
+    info.victim = hw_prefetch ? victim : TAG_INVALID;
+    return false;
 }
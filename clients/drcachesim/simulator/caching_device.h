@@ -36,18 +36,84 @@
 #ifndef _CACHING_DEVICE_H_
 #define _CACHING_DEVICE_H_ 1
 
+#include <assert.h>
+#include <stddef.h>
+#include <istream>
+#include <ostream>
+#include <vector>
 #include "caching_device_block.h"
 #include "caching_device_stats.h"
 #include "memref.h"
+#include "numa_map.h"
+#include "prefetcher.h"
+#include "tag_search.h"
 
 // Statistics collection is abstracted out into the caching_device_stats_t class.
 
-// Different replacement policies are expected to be implemented by
-// subclassing caching_device_t.
+// Different replacement policies are expected to be implemented as policy
+// classes passed to request_with(): see lfu_policy_t below for the interface.
+// Using a template parameter rather than virtual methods lets the compiler
+// inline the policy into the innermost simulation loop.
 
 // We assume we're only invoked from a single thread of control and do
 // not need to synchronize data access.
 
+// A replacement policy operates on one set at a time, given pointers to the
+// set's tags and counters (see caching_device_block.h).  Its methods are
+// called on an instance, so a policy may keep state beyond the counters, such
+// as the selector for set dueling in drrip_policy_t, in non-static members.
+// The base caching device class only implements LFU.
+struct lfu_policy_t
+{
+    static void init_set(int *counters, int associativity) {}
+    static void access_update(int *counters, int associativity, int way)
+    {
+        // We just inc the counter for LFU.  We live with any blip on overflow.
+        counters[way]++;
+    }
+    static int replace_which_way(const addr_t *tags, int *counters, int associativity)
+    {
+        int min_counter = 0;
+        int min_way = 0;
+        for (int way = 0; way < associativity; ++way) {
+            if (tags[way] == TAG_INVALID) {
+                min_way = way;
+                break;
+            }
+            if (way == 0 || counters[way] < min_counter) {
+                min_counter = counters[way];
+                min_way = way;
+            }
+        }
+        // Clear the counter for LFU.
+        counters[min_way] = 0;
+        return min_way;
+    }
+};
+
+// For latency estimates: the cost of a group of accesses, in the first-level
+// devices' accesses, the cycles they took, and the part of those cycles spent
+// beyond the first level (see caching_device_t::set_latency()).
+struct latency_counts_t
+{
+    latency_counts_t() : accesses(0), cycles(0), stall_cycles(0) {}
+    int_least64_t accesses;
+    int_least64_t cycles;
+    int_least64_t stall_cycles;
+};
+
+// For NUMA placement: the node of the core making the current access, and the
+// misses to memory on that node, on another node, or on a node not known
+// (see caching_device_t::set_numa()).
+struct numa_counts_t
+{
+    numa_counts_t() : node(0), local(0), remote(0), unknown(0) {}
+    int node;
+    int_least64_t local;
+    int_least64_t remote;
+    int_least64_t unknown;
+};
+
 class caching_device_t
 {
  public:
@@ -59,29 +125,224 @@ class caching_device_t
 
     caching_device_stats_t *get_stats() const { return stats; }
     caching_device_t *get_parent() const { return parent; }
+    int get_block_size() const { return block_size; }
+
+    // Attaches a hardware prefetcher, which this device does not take ownership
+    // of, to be trained on each demand access.  Must be called after init().
+    void set_prefetcher(prefetcher_t *prefetcher);
+    prefetcher_t *get_prefetcher() const { return prefetcher; }
+
+    // Has each demand access to this device add its latency to *counts, and
+    // each miss in a device with no parent the memory latency as well.  Must be
+    // called once the whole hierarchy is initialized.
+    void set_latency(int latency, int memory_latency, latency_counts_t *counts);
+
+    // For a device with no parent: has each miss look up the node holding its
+    // (physical) address in map and add to *counts, comparing it to
+    // counts->node.  A demand miss to another node also adds remote_latency to
+    // the counts given to set_latency(), if any.  Must be called after
+    // set_latency().
+    void set_numa(numa_map_t *map, numa_counts_t *counts, int remote_latency);
+
+    // Models write-invalidate (MESI) coherence among the devices of a
+    // hierarchy, whose roots (the devices with no parent) are given: a write to
+    // a block invalidates every copy outside the writer's own path to its root.
+    // Only the devices with no children take part in the protocol proper; above
+    // them we just track which blocks have been invalidated.  Must be called
+    // after init(), on every device of the hierarchy.
+    void enable_coherence(const std::vector<caching_device_t *> &roots);
+
+    // Tracks dirty blocks and the bytes moved between this device and its
+    // parent, or memory for a device with no parent (see
+    // caching_device_stats_t::fetch()).  A write-back device marks the blocks
+    // written and writes them to its parent only on eviction, while a
+    // write-through device passes each write on.  A device that does not
+    // allocate on a write miss passes the write on without filling the block.
+    // Writes reach the parent as TRACE_TYPE_WRITEBACK requests.  Must be called
+    // after init(), on every device of the hierarchy.
+    void set_write_policy(bool write_back, bool write_allocate);
+
+    // Has the stats classify each miss and count the accesses and misses of
+    // each set (see caching_device_stats_t::enable_set_analysis()).  Must be
+    // called after init().
+    void enable_set_analysis();
+
+    // Simulates only about one in every ratio sets, chosen by a hash of the
+    // set index, for a cheaper estimate of a large device's behavior: a request
+    // to any other set is dropped on arrival, reaching neither the stats nor the
+    // parent.  The stats scale their counts up to the whole device (see
+    // caching_device_stats_t::enable_sampling()).  Must be called after init(),
+    // before any request.  Returns false if no set would be simulated.
+    bool set_sampling(int ratio);
+
+    // Models the lines displaced by code run outside the trace, such as the
+    // kernel's on a system call: invalidates the given percentage of the
+    // blocks, spread evenly over the sets, writing back any that are dirty on
+    // behalf of cause.  The stats are not updated.
+    void pollute(int percent, const memref_t &cause);
+
+    // For checkpoints: writes the contents of this device, its blocks' tags and
+    // replacement counters along with any coherence and dirty state, to out.
+    // restore_state() reads them back into a device of the same geometry and
+    // configuration, returning false if the data does not match.  The stats are
+    // not part of the state, nor is the state of prefetchers or of a policy
+    // beyond its counters.
+    bool save_state(std::ostream &out);
+    bool restore_state(std::istream &in);
 
  protected:
-    virtual void access_update(int block_idx, int way);
-    virtual int replace_which_way(int block_idx);
+    template <typename policy_t> inline void request_with(policy_t &policy,
+                                                          const memref_t &memref);
+    template <typename policy_t> void init_policy(policy_t &policy);
+    // For a write policy: applies a write from a child, which unlike a demand
+    // write covers whole blocks and so needs no fill.
+    template <typename policy_t> void write_back_with(policy_t &policy,
+                                                      const memref_t &memref);
 
     inline addr_t compute_tag(addr_t addr) { return addr >> block_size_bits; }
     inline int compute_block_idx(addr_t tag) {
         return (tag & blocks_per_set_mask) << assoc_bits;
     }
-    inline caching_device_block_t& get_caching_device_block(int block_idx, int way) {
-        return *(blocks[block_idx + way]);
+    inline addr_t &get_tag(int block_idx, int way) {
+        return tags[block_idx + way];
+    }
+    inline int &get_counter(int block_idx, int way) {
+        return counters[block_idx + way];
+    }
+    // Subclasses that keep additional per-block state allocate it here,
+    // and add it to checkpoints here.
+    virtual void init_blocks() {}
+    virtual bool save_blocks(std::ostream &out) { return true; }
+    virtual bool restore_blocks(std::istream &in) { return true; }
+
+    // For coherence: the bytes of an invalidated block that the invalidating
+    // write touched, as an offset into the block and a size.
+    struct written_range_t {
+        int offs;
+        int size;
+    };
+    // For coherence: whether an access to an invalidated block touches any of
+    // the bytes whose write invalidated it.  If not, the miss is due to false
+    // sharing.
+    inline bool touches_written(int idx, const memref_t &memref) {
+        int offs = (int)(memref.addr & (block_size - 1));
+        return offs < written[idx].offs + written[idx].size &&
+            written[idx].offs < offs + (int)memref.size;
+    }
+    // For coherence: updates a block's state after an access, snooping the
+    // other devices if need be.
+    void update_coherence(const memref_t &memref, int block_idx, int way, bool hit);
+    // For coherence: applies an access to every device not on this one's path
+    // to its root.  A write invalidates their copies of the block, and a
+    // read demotes their copies to shared.  Returns whether any held a copy.
+    bool snoop(const memref_t &memref, bool write);
+    bool snoop_subtree(const memref_t &memref, bool write);
+
+    // For a write policy: writes to the parent, if any, the given bytes of a
+    // dirty block being evicted, or of a write being passed through.
+    void write_to_parent(const memref_t &memref, bool evicting);
+    // For a write policy: writes back the block in the given slot, which is
+    // about to be replaced or invalidated on behalf of the given access, if it
+    // is dirty.
+    inline void write_back_victim(const memref_t &cause, int block_idx, int way) {
+        addr_t victim = get_tag(block_idx, way);
+        if (dirty[block_idx + way] && victim != TAG_INVALID) {
+            memref_t memref = cause;
+            memref.addr = victim << block_size_bits;
+            memref.size = block_size;
+            write_to_parent(memref, true/*evicting*/);
+        }
+        dirty[block_idx + way] = 0;
+    }
+
+    inline void count_numa(const memref_t &memref) {
+        int node = numa_map->node_of(memref.addr);
+        if (node < 0)
+            numa_counts->unknown++;
+        else if (node == numa_counts->node)
+            numa_counts->local++;
+        else {
+            numa_counts->remote++;
+            if (latency_counts != NULL && memref.type != TRACE_TYPE_HARDWARE_PREFETCH &&
+                !type_is_prefetch(memref.type)) {
+                latency_counts->cycles += remote_latency;
+                latency_counts->stall_cycles += remote_latency;
+            }
+        }
     }
-    // a pure virtual function for subclasses to initialize their own block array
-    virtual void init_blocks() = 0;
+
+    inline void add_latency(const memref_t &memref, bool hit) {
+        if (latency_counts == NULL || memref.type == TRACE_TYPE_HARDWARE_PREFETCH ||
+            type_is_prefetch(memref.type))
+            return;
+        latency_counts->cycles += latency;
+        latency_counts->stall_cycles += stall_latency;
+        latency_counts->accesses += first_level;
+        if (!hit) {
+            latency_counts->cycles += miss_latency;
+            latency_counts->stall_cycles += miss_latency;
+        }
+    }
+
+    // A prefetched block first used within this many accesses of its arrival
+    // counts as late: the prefetch would likely still have been in flight.
+    static const int PREFETCH_LATE_WINDOW = 16;
+    // For a block brought in by a hardware prefetch: whether it is yet to be
+    // used, when it arrived, and the tag of the block it replaced.
+    struct prefetch_info_t {
+        bool unused;
+        int_least64_t arrival;
+        addr_t victim;
+    };
+    // Tracks prefetched blocks' use, and the demand misses on blocks they
+    // replaced, once this device has seen a hardware prefetch.  Returns whether
+    // the access was the first to a prefetched block.
+    bool update_prefetch(const memref_t &memref, int block_idx, int way, bool hit,
+                         addr_t victim);
 
     int associativity;
     int block_size;
     int num_blocks;
     caching_device_t *parent;
-    // This should be an array of caching_device_block_t pointers, otherwise
-    // an extended block class which has its own member variables cannot be indexed
-    // correctly by base class pointers.
-    caching_device_block_t **blocks;
+    std::vector<caching_device_t *> children;
+    // For coherence, in a device with no parent: every such device.
+    std::vector<caching_device_t *> roots;
+    // The block state is kept in parallel arrays indexed by
+    // compute_block_idx() + way, so that each set's tags are contiguous.
+    addr_t *tags;
+    int *counters;
+    // For coherence only, else NULL: each block's MESI state (see
+    // caching_device_block.h) and what invalidated it.
+    unsigned char *states;
+    written_range_t *written;
+    // For a write policy only, else NULL: whether each block is dirty.
+    unsigned char *dirty;
+    bool write_back;
+    bool write_allocate;
+    prefetcher_t *prefetcher;
+    // Allocated on the first hardware prefetch, else NULL.
+    prefetch_info_t *prefetch_info;
+    // The number of accesses since prefetch_info was allocated.
+    int_least64_t num_requests;
+    // For latency estimates, see set_latency(), else NULL.  For a first-level
+    // device, its latency is not a stall.
+    latency_counts_t *latency_counts;
+    int latency;
+    int stall_latency;
+    int miss_latency;
+    int first_level;
+    // For NUMA placement, see set_numa(), else NULL.
+    numa_map_t *numa_map;
+    numa_counts_t *numa_counts;
+    int remote_latency;
+    // For set analysis, see enable_set_analysis().
+    bool analyze_sets;
+    // For set sampling only, else NULL: whether each set is simulated.
+    unsigned char *sampled_sets;
+    // For pollute(): the way each set starts from next time, and the share of a
+    // block, in percent, carried over from the last set.
+    int pollute_way;
+    int pollute_carry;
     int blocks_per_set;
     // Optimization fields for fast bit operations
     int blocks_per_set_mask;
@@ -96,4 +357,213 @@ class caching_device_t
     int last_block_idx;
 };
 
+template <typename policy_t>
+void
+caching_device_t::init_policy(policy_t &policy)
+{
+    for (int i = 0; i < blocks_per_set; i++)
+        policy.init_set(&counters[i << assoc_bits], associativity);
+}
+
+template <typename policy_t>
+inline void
+caching_device_t::request_with(policy_t &policy, const memref_t &memref_in)
+{
+    // Unfortunately we need to make a copy for our loop so we can pass
+    // the right data struct to the parent and stats collectors.
+    memref_t memref;
+    // We support larger sizes to improve the IPC perf.
+    // This means that one memref could touch multiple blocks.
+    // We treat each block separately for statistics purposes.
+    addr_t final_addr = memref_in.addr + memref_in.size - 1/*avoid overflow*/;
+    addr_t final_tag = compute_tag(final_addr);
+    addr_t tag = compute_tag(memref_in.addr);
+
+    if (memref_in.type == TRACE_TYPE_WRITEBACK) {
+        write_back_with(policy, memref_in);
+        return;
+    }
+
+    // Optimization: check last tag if single-block.
+    // With coherence, a write must also already own the block, with a write
+    // policy a write must update it, and with prefetching every access is
+    // tracked.
+    if (tag == final_tag && tag == last_tag && prefetch_info == NULL &&
+        (memref_in.type != TRACE_TYPE_WRITE ||
+         ((states == NULL || states[last_block_idx + last_way] == COHERENCE_MODIFIED) &&
+          dirty == NULL))) {
+        // Make sure last_tag is properly in sync.
+        assert(tag != TAG_INVALID && tag == get_tag(last_block_idx, last_way));
+        stats->access(memref_in, true/*hit*/);
+        if (analyze_sets) {
+            stats->set_access(memref_in, tag, (int)(tag & blocks_per_set_mask),
+                              true, false);
+        }
+        // The last tag is always in a sampled set.
+        if (sampled_sets != NULL)
+            stats->sample_access((int)(tag & blocks_per_set_mask), true);
+        if (parent != NULL)
+            parent->stats->child_access(memref_in, true);
+        add_latency(memref_in, true);
+        policy.access_update(&counters[last_block_idx], associativity, last_way);
+        return;
+    }
+
+    memref = memref_in;
+    for (; tag <= final_tag; ++tag) {
+        int way;
+        int block_idx = compute_block_idx(tag);
+        addr_t victim = TAG_INVALID;
+
+        if (tag + 1 <= final_tag)
+            memref.size = ((tag + 1) << block_size_bits) - memref.addr;
+
+        if (sampled_sets != NULL && !sampled_sets[tag & blocks_per_set_mask]) {
+            // Left out of the sample: see set_sampling().
+            if (tag + 1 <= final_tag) {
+                addr_t next_addr = (tag + 1) << block_size_bits;
+                memref.addr = next_addr;
+                memref.size = final_addr - next_addr + 1/*undo the -1*/;
+            }
+            continue;
+        }
+        way = find_tag_way(&tags[block_idx], associativity, tag);
+        // An invalidated block keeps its tag: we refill it in place.
+        bool invalidated = way < associativity && states != NULL &&
+            states[block_idx + way] == COHERENCE_INVALID;
+        bool hit = way < associativity && !invalidated;
+        bool is_write = memref.type == TRACE_TYPE_WRITE;
+        add_latency(memref, hit);
+        if (analyze_sets) {
+            stats->set_access(memref, tag, (int)(tag & blocks_per_set_mask), hit,
+                              invalidated);
+        }
+        if (sampled_sets != NULL)
+            stats->sample_access((int)(tag & blocks_per_set_mask), hit);
+        if (hit) {
+            stats->access(memref, true/*hit*/);
+            if (parent != NULL)
+                parent->stats->child_access(memref, true);
+        } else if (dirty != NULL && is_write && !write_allocate && !invalidated) {
+            // The write goes around us, leaving our contents as they are.
+            stats->access(memref, false/*miss*/);
+            if (parent != NULL)
+                parent->stats->child_access(memref, false);
+            write_to_parent(memref, false/*passing through*/);
+            if (tag + 1 <= final_tag) {
+                addr_t next_addr = (tag + 1) << block_size_bits;
+                memref.addr = next_addr;
+                memref.size = final_addr - next_addr + 1/*undo the -1*/;
+            }
+            continue;
+        } else {
+            stats->access(memref, false/*miss*/);
+            if (invalidated) {
+                stats->coherence_miss(memref, !touches_written(block_idx + way,
+                                                               memref));
+            }
+            // If no parent we assume we get the data from main memory
+            if (parent != NULL) {
+                parent->stats->child_access(memref, false);
+                if (dirty != NULL && is_write) {
+                    // We fetch the block before writing into it.
+                    memref_t fill = memref;
+                    fill.type = TRACE_TYPE_READ;
+                    parent->request(fill);
+                } else
+                    parent->request(memref);
+            } else if (numa_counts != NULL)
+                count_numa(memref);
+            if (dirty != NULL)
+                stats->fetch(block_size);
+
+            if (!invalidated) {
+                way = policy.replace_which_way(&tags[block_idx], &counters[block_idx],
+                                               associativity);
+                victim = get_tag(block_idx, way);
+                if (dirty != NULL)
+                    write_back_victim(memref, block_idx, way);
+                get_tag(block_idx, way) = tag;
+            }
+        }
+
+        if (dirty != NULL && is_write) {
+            if (write_back)
+                dirty[block_idx + way] = 1;
+            else
+                write_to_parent(memref, false/*passing through*/);
+        }
+        policy.access_update(&counters[block_idx], associativity, way);
+        if (states != NULL)
+            update_coherence(memref, block_idx, way, hit);
+        bool first_use = false;
+        if (prefetch_info != NULL || memref.type == TRACE_TYPE_HARDWARE_PREFETCH)
+            first_use = update_prefetch(memref, block_idx, way, hit, victim);
+        if (prefetcher != NULL && memref.type != TRACE_TYPE_HARDWARE_PREFETCH &&
+            !type_is_prefetch(memref.type))
+            prefetcher->prefetch(this, memref, !hit || first_use);
+
+        if (tag + 1 <= final_tag) {
+            addr_t next_addr = (tag + 1) << block_size_bits;
+            memref.addr = next_addr;
+            memref.size = final_addr - next_addr + 1/*undo the -1*/;
+        }
+        // Optimization: remember last tag
+        last_tag = tag;
+        last_way = way;
+        last_block_idx = block_idx;
+    }
+}
+
+template <typename policy_t>
+void
+caching_device_t::write_back_with(policy_t &policy, const memref_t &memref_in)
+{
+    if (dirty == NULL)
+        return;
+    memref_t memref = memref_in;
+    addr_t final_addr = memref_in.addr + memref_in.size - 1/*avoid overflow*/;
+    addr_t final_tag = compute_tag(final_addr);
+    for (addr_t tag = compute_tag(memref_in.addr); tag <= final_tag; ++tag) {
+        int block_idx = compute_block_idx(tag);
+        if (tag + 1 <= final_tag)
+            memref.size = ((tag + 1) << block_size_bits) - memref.addr;
+        int way = find_tag_way(&tags[block_idx], associativity, tag);
+        bool hit = way < associativity &&
+            (states == NULL || states[block_idx + way] != COHERENCE_INVALID);
+        if (sampled_sets != NULL && !sampled_sets[tag & blocks_per_set_mask]) {
+            // Left out of the sample: see set_sampling().
+        } else if (!hit && !write_allocate) {
+            write_to_parent(memref, false/*passing through*/);
+        } else {
+            if (!hit) {
+                if (way == associativity) {
+                    way = policy.replace_which_way(&tags[block_idx],
+                                                   &counters[block_idx], associativity);
+                    write_back_victim(memref, block_idx, way);
+                    if (get_tag(block_idx, way) == last_tag)
+                        last_tag = TAG_INVALID;
+                    get_tag(block_idx, way) = tag;
+                    if (prefetch_info != NULL) {
+                        prefetch_info[block_idx + way].unused = false;
+                        prefetch_info[block_idx + way].victim = TAG_INVALID;
+                    }
+                }
+                if (states != NULL)
+                    states[block_idx + way] = COHERENCE_SHARED;
+                policy.access_update(&counters[block_idx], associativity, way);
+            }
+            if (write_back)
+                dirty[block_idx + way] = 1;
+            else
+                write_to_parent(memref, false/*passing through*/);
+        }
+        if (tag + 1 <= final_tag) {
+            addr_t next_addr = (tag + 1) << block_size_bits;
+            memref.addr = next_addr;
+            memref.size = final_addr - next_addr + 1/*undo the -1*/;
+        }
+    }
+}
+
 #endif /* _CACHING_DEVICE_H_ */
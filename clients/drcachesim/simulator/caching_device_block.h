@@ -30,7 +30,7 @@
  * DAMAGE.
  */
 
-/* caching_device_block: represents a unit block of a caching device.
+/* caching_device_block: the state of a unit block of a caching device.
  */
 
 #ifndef _CACHING_DEVICE_BLOCK_H_
@@ -45,21 +45,28 @@
 // block status.
 static const addr_t TAG_INVALID = (addr_t)-1; // block is invalid
 
-class caching_device_block_t
-{
- public:
-    // Initializing counter to 0 is just to be safe and to make it easier to write new
-    // replacement algorithms without errors (and we expect negligible perf cost), as
-    // we expect any use of counter to only occur *after* a valid tag is put in place,
-    // where for the current replacement code we also set the counter at that time.
-    caching_device_block_t() : tag(TAG_INVALID), counter(0) {}
-
-    addr_t tag;
-
-    // XXX: using int_least64_t here results in a ~4% slowdown for 32-bit apps.
-    // A 32-bit counter should be sufficient but we may want to revisit.
-    // We already have inttypes.h so we can reinstate int_least64_t easily.
-    int counter; // for use by replacement policies
+// With coherence enabled (see caching_device_t::enable_coherence()), each block
+// also has a MESI state.  A block invalidated by another device's write keeps its
+// tag, in the COHERENCE_INVALID state, so that the next access to it can be told
+// apart from an ordinary miss.
+enum {
+    COHERENCE_INVALID,
+    COHERENCE_SHARED,
+    COHERENCE_EXCLUSIVE,
+    COHERENCE_MODIFIED
 };
 
+// Each block has a tag and a counter for use by replacement policies.
+// Rather than one object per block, caching_device_t keeps each field in its
+// own array so that a set's tags are contiguous in memory.  A subclass with
+// extra per-block state adds further arrays of its own (see tlb_t).
+//
+// Initializing counters to 0 is just to be safe and to make it easier to write new
+// replacement algorithms without errors (and we expect negligible perf cost), as
+// we expect any use of a counter to only occur *after* a valid tag is put in place,
+// where for the current replacement code we also set the counter at that time.
+//
+// XXX: using int_least64_t for the counters results in a ~4% slowdown for 32-bit
+// apps.  A 32-bit counter should be sufficient but we may want to revisit.
+
 #endif /* _CACHING_DEVICE_BLOCK_H_ */
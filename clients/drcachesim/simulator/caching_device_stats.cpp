@@ -32,10 +32,18 @@
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <math.h>
 #include "caching_device_stats.h"
+#include "alloc_map.h"
 
-caching_device_stats_t::caching_device_stats_t() :
-    num_hits(0), num_misses(0), num_child_hits(0)
+caching_device_stats_t::caching_device_stats_t(bool record_pc_misses_) :
+    num_hits(0), num_misses(0), num_child_hits(0), num_invalidations(0),
+    num_coherence_misses(0), num_false_sharing_misses(0), num_writebacks(0),
+    bytes_fetched(0), bytes_written(0), track_bandwidth(false),
+    record_pc_misses(record_pc_misses_), allocs(NULL), num_compulsory_misses(0),
+    num_capacity_misses(0), num_conflict_misses(0), shadow_capacity(0), shadow_size(0),
+    num_sampled_sets(0), sample_scale(1.)
 {
 }
 
@@ -50,26 +58,174 @@ caching_device_stats_t::access(const memref_t &memref, bool hit)
     // We're only computing miss rate so we just inc counters here.
     if (hit)
         num_hits++;
-    else
+    else {
         num_misses++;
+        if (record_pc_misses)
+            record_pc_miss(pc_misses, memref);
+        addr_t site;
+        if (allocs != NULL && memref.type != TRACE_TYPE_INSTR &&
+            allocs->find(memref.addr, &site))
+            record_miss(site_misses, site, memref.pid);
+    }
 }
 
 void
-caching_device_stats_t::child_access(const memref_t &memref, bool hit)
+caching_device_stats_t::record_pc_miss(std::map<addr_t, pc_misses_t> &misses,
+                                       const memref_t &memref)
+{
+    addr_t pc = (memref.type == TRACE_TYPE_INSTR) ? memref.addr : memref.pc;
+    record_miss(misses, pc, memref.pid);
+}
+
+void
+caching_device_stats_t::record_miss(std::map<addr_t, pc_misses_t> &misses,
+                                    addr_t key, memref_pid_t pid)
+{
+    std::map<addr_t, pc_misses_t>::iterator it = misses.find(key);
+    if (it == misses.end()) {
+        pc_misses_t entry = {1, pid};
+        misses.insert(std::make_pair(key, entry));
+    } else
+        it->second.count++;
+}
+
+void
+caching_device_stats_t::enable_set_analysis(int num_sets, int num_blocks)
+{
+    set_counts_t zero = {0, 0, 0};
+    set_counts.assign(num_sets, zero);
+    shadow_capacity = num_blocks;
+}
+
+void
+caching_device_stats_t::enable_sampling(int num_sets, int num_sampled)
 {
+    set_counts_t zero = {0, 0, 0};
+    sample_counts.assign(num_sets, zero);
+    num_sampled_sets = num_sampled;
+    sample_scale = (double)num_sets / num_sampled;
+}
+
+void
+caching_device_stats_t::set_access(const memref_t &memref, addr_t tag, int set,
+                                   bool hit, bool invalidated)
+{
+    bool first = seen_blocks.insert(tag).second;
+    bool shadow_hit;
+    std::map<addr_t, std::list<addr_t>::iterator>::iterator it =
+        shadow_blocks.find(tag);
+    if (it != shadow_blocks.end()) {
+        shadow_hit = true;
+        shadow_lru.splice(shadow_lru.begin(), shadow_lru, it->second);
+    } else {
+        shadow_hit = false;
+        shadow_lru.push_front(tag);
+        shadow_blocks.insert(std::make_pair(tag, shadow_lru.begin()));
+        if (++shadow_size > shadow_capacity) {
+            shadow_blocks.erase(shadow_lru.back());
+            shadow_lru.pop_back();
+            --shadow_size;
+        }
+    }
+    // Prefetches only move blocks around.
+    if (type_is_prefetch(memref.type) ||
+        memref.type == TRACE_TYPE_HARDWARE_PREFETCH)
+        return;
+    set_counts_t &counts = set_counts[set];
+    counts.accesses++;
     if (hit)
+        return;
+    counts.misses++;
+    if (invalidated)
+        return;
+    if (first)
+        num_compulsory_misses++;
+    else if (!shadow_hit)
+        num_capacity_misses++;
+    else {
+        num_conflict_misses++;
+        counts.conflict_misses++;
+        record_pc_miss(pc_conflict_misses, memref);
+    }
+}
+
+void
+caching_device_stats_t::child_access(const memref_t &memref, bool hit)
+{
+    // A hardware prefetch that hits is dropped, so it is no child hit.
+    if (hit && memref.type != TRACE_TYPE_HARDWARE_PREFETCH)
         num_child_hits++;
     // else being computed in access()
 }
 
+void
+caching_device_stats_t::invalidate(const memref_t &write)
+{
+    num_invalidations++;
+}
+
+void
+caching_device_stats_t::coherence_miss(const memref_t &memref, bool false_sharing)
+{
+    num_coherence_misses++;
+    if (false_sharing)
+        num_false_sharing_misses++;
+    if (record_pc_misses)
+        record_pc_miss(pc_coherence_misses, memref);
+}
+
+void
+caching_device_stats_t::fetch(int bytes)
+{
+    bytes_fetched += bytes;
+}
+
+void
+caching_device_stats_t::write(int bytes, bool writeback)
+{
+    bytes_written += bytes;
+    if (writeback)
+        num_writebacks++;
+}
+
 void
 caching_device_stats_t::print_counts(std::string prefix)
 {
     std::cerr.imbue(std::locale("")); // Add commas, at least for my locale
+    if (samples_sets()) {
+        std::ostringstream sampled;
+        sampled << num_sampled_sets << " of " << sample_counts.size();
+        std::cerr << prefix << std::setw(18) << std::left << "Sampled sets:" <<
+            std::setw(20) << std::right << sampled.str() << std::endl;
+    }
     std::cerr << prefix << std::setw(18) << std::left << "Hits:" <<
-        std::setw(20) << std::right << num_hits << std::endl;
+        std::setw(20) << std::right << scaled(num_hits) << std::endl;
     std::cerr << prefix << std::setw(18) << std::left << "Misses:" <<
-        std::setw(20) << std::right << num_misses << std::endl;
+        std::setw(20) << std::right << scaled(num_misses) << std::endl;
+    if (num_invalidations + num_coherence_misses != 0) {
+        std::cerr << prefix << std::setw(18) << std::left << "Invalidations:" <<
+            std::setw(20) << std::right << num_invalidations << std::endl;
+        std::cerr << prefix << std::setw(18) << std::left << "Coherence misses:" <<
+            std::setw(20) << std::right << num_coherence_misses << std::endl;
+        std::cerr << prefix << std::setw(18) << std::left << "False sharing:" <<
+            std::setw(20) << std::right << num_false_sharing_misses << std::endl;
+    }
+    if (analyzes_sets()) {
+        std::cerr << prefix << std::setw(18) << std::left << "Compulsory misses:" <<
+            std::setw(20) << std::right << num_compulsory_misses << std::endl;
+        std::cerr << prefix << std::setw(18) << std::left << "Capacity misses:" <<
+            std::setw(20) << std::right << num_capacity_misses << std::endl;
+        std::cerr << prefix << std::setw(18) << std::left << "Conflict misses:" <<
+            std::setw(20) << std::right << num_conflict_misses << std::endl;
+    }
+    if (track_bandwidth) {
+        std::cerr << prefix << std::setw(18) << std::left << "Writebacks:" <<
+            std::setw(20) << std::right << scaled(num_writebacks) << std::endl;
+        std::cerr << prefix << std::setw(18) << std::left << "Bytes fetched:" <<
+            std::setw(20) << std::right << scaled(bytes_fetched) << std::endl;
+        std::cerr << prefix << std::setw(18) << std::left << "Bytes written:" <<
+            std::setw(20) << std::right << scaled(bytes_written) << std::endl;
+    }
 }
 
 void
@@ -82,9 +238,36 @@ caching_device_stats_t::print_rates(std::string prefix)
         std::cerr << prefix << std::setw(18) << std::left << miss_label <<
             std::setw(20) << std::fixed << std::setprecision(2) << std::right <<
             ((float)num_misses*100/(num_hits+num_misses)) << "%" << std::endl;
+        if (samples_sets() && num_sampled_sets > 1)
+            print_sample_interval(prefix);
     }
 }
 
+void
+caching_device_stats_t::print_sample_interval(std::string prefix)
+{
+    // The sampled sets are a cluster sample of the accesses, so we estimate the
+    // variance of the miss rate, a ratio estimator, from how far each set's
+    // misses are from what the overall rate predicts for its accesses.
+    double rate = (double)num_misses / (num_hits + num_misses);
+    double sum_sq = 0.;
+    for (size_t i = 0; i < sample_counts.size(); i++) {
+        double diff = sample_counts[i].misses - rate * sample_counts[i].accesses;
+        sum_sq += diff * diff;
+    }
+    double mean_accesses = (double)(num_hits + num_misses) / num_sampled_sets;
+    double fraction = 1. / sample_scale;
+    double error = 1.96 / mean_accesses *
+        sqrt((1. - fraction) * sum_sq / (num_sampled_sets - 1) / num_sampled_sets);
+    double low = rate - error < 0. ? 0. : rate - error;
+    double high = rate + error > 1. ? 1. : rate + error;
+    std::ostringstream interval;
+    interval << std::fixed << std::setprecision(2) << low*100 << "%-" <<
+        high*100 << "%";
+    std::cerr << prefix << std::setw(18) << std::left << "Miss rate 95% CI:" <<
+        std::setw(20) << std::right << interval.str() << std::endl;
+}
+
 void
 caching_device_stats_t::print_child_stats(std::string prefix)
 {
@@ -93,7 +276,8 @@ caching_device_stats_t::print_child_stats(std::string prefix)
             std::setw(20) << std::right << num_child_hits << std::endl;
         std::cerr << prefix << std::setw(18) << std::left << "Total miss rate:" <<
             std::setw(20) << std::fixed << std::setprecision(2) << std::right <<
-            ((float)num_misses*100/(num_hits+num_child_hits+num_misses)) << "%" <<
+            ((float)scaled(num_misses)*100/
+             (scaled(num_hits)+num_child_hits+scaled(num_misses))) << "%" <<
             std::endl;
     }
 }
@@ -106,10 +290,46 @@ caching_device_stats_t::print_stats(std::string prefix)
     print_child_stats(prefix);
 }
 
+void
+caching_device_stats_t::merge_child_stats(const caching_device_stats_t &other)
+{
+    num_child_hits += other.num_child_hits;
+}
+
+void
+caching_device_stats_t::add_filtered_hits(int_least64_t count)
+{
+    num_hits += count;
+}
+
+void
+caching_device_stats_t::add_filtered_child_hits(int_least64_t count)
+{
+    num_child_hits += count;
+}
+
 void
 caching_device_stats_t::reset()
 {
     num_hits = 0;
     num_misses = 0;
     num_child_hits = 0;
+    num_invalidations = 0;
+    num_coherence_misses = 0;
+    num_false_sharing_misses = 0;
+    num_writebacks = 0;
+    bytes_fetched = 0;
+    bytes_written = 0;
+    pc_misses.clear();
+    site_misses.clear();
+    pc_coherence_misses.clear();
+    // The blocks seen and the shadow cache's contents carry over, as the
+    // device's own contents do.
+    num_compulsory_misses = 0;
+    num_capacity_misses = 0;
+    num_conflict_misses = 0;
+    set_counts_t zero = {0, 0, 0};
+    set_counts.assign(set_counts.size(), zero);
+    pc_conflict_misses.clear();
+    sample_counts.assign(sample_counts.size(), zero);
 }
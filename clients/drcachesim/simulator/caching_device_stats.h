@@ -36,14 +36,22 @@
 #ifndef _CACHING_DEVICE_STATS_H_
 #define _CACHING_DEVICE_STATS_H_ 1
 
+#include <list>
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
 #include <inttypes.h>
 #include "memref.h"
 
+class alloc_map_t;
+
 class caching_device_stats_t
 {
  public:
-    caching_device_stats_t();
+    // If record_pc_misses is set, misses are also counted per instruction
+    // address (the pc of a data reference, the addr of an instruction fetch).
+    explicit caching_device_stats_t(bool record_pc_misses = false);
     virtual ~caching_device_stats_t();
 
     // Called on each access.
@@ -54,19 +62,150 @@ class caching_device_stats_t
     // Called on each access by a child caching device.
     virtual void child_access(const memref_t &memref, bool hit);
 
+    // With coherence enabled, called when another device's write invalidates
+    // one of our blocks.
+    virtual void invalidate(const memref_t &write);
+
+    // With coherence enabled, called in addition to access() on a miss to a
+    // block that another device's write invalidated.  false_sharing says whether
+    // the access touched none of the bytes that write did.
+    virtual void coherence_miss(const memref_t &memref, bool false_sharing);
+
+    // Called on the first demand access to a block that a hardware prefetch
+    // brought in, and on a demand miss to a block that such a prefetch
+    // replaced.  Only CPU caches (see cache_stats_t) keep these statistics.
+    virtual void prefetch_use(const memref_t &memref, bool late) {}
+    virtual void prefetch_pollution(const memref_t &memref) {}
+
+    // With a write policy (see caching_device_t::set_write_policy()), called
+    // for each block fetched from the parent, or from memory for a device
+    // with no parent, and for each write to it: of a dirty block evicted
+    // (a writeback) or of data passed through.
+    void enable_bandwidth() { track_bandwidth = true; }
+    virtual void fetch(int bytes);
+    virtual void write(int bytes, bool writeback);
+
     virtual void print_stats(std::string prefix);
 
     virtual void reset();
 
+    // Adds the child access counts gathered by another stats object, for when
+    // children were simulated against a stand-in for this device.
+    virtual void merge_child_stats(const caching_device_stats_t &other);
+
+    // Adds hits, or a child's hits, that were filtered out of the trace
+    // before reaching the simulator (see -L0_filter).
+    virtual void add_filtered_hits(int_least64_t count);
+    virtual void add_filtered_child_hits(int_least64_t count);
+
+    struct pc_misses_t {
+        int_least64_t count;
+        memref_pid_t pid; // The first process seen to miss at this pc.
+    };
+    const std::map<addr_t, pc_misses_t> &get_pc_misses() const
+        { return pc_misses; }
+    const std::map<addr_t, pc_misses_t> &get_pc_coherence_misses() const
+        { return pc_coherence_misses; }
+
+    // If an allocation map is set, misses of data references to live
+    // allocations are also counted per allocation call site.
+    void set_alloc_map(alloc_map_t *map) { allocs = map; }
+    const std::map<addr_t, pc_misses_t> &get_site_misses() const
+        { return site_misses; }
+
+    // Called, once enabled, on each access to a block after access(), with the
+    // block's tag and set.  Each demand miss is classified as compulsory (the
+    // first access to the block), capacity (a miss in a fully-associative LRU
+    // cache of the same num_blocks as well), or conflict (the rest).  Accesses,
+    // misses, and conflict misses are counted per set, and conflict misses
+    // also per instruction.  Misses to blocks coherence invalidated are not
+    // classified.
+    void enable_set_analysis(int num_sets, int num_blocks);
+    bool analyzes_sets() const { return !set_counts.empty(); }
+    virtual void set_access(const memref_t &memref, addr_t tag, int set, bool hit,
+                            bool invalidated);
+    struct set_counts_t {
+        int_least64_t accesses;
+        int_least64_t misses;
+        int_least64_t conflict_misses;
+    };
+    const std::vector<set_counts_t> &get_set_counts() const { return set_counts; }
+    const std::map<addr_t, pc_misses_t> &get_pc_conflict_misses() const
+        { return pc_conflict_misses; }
+
+    // For set sampling (see caching_device_t::set_sampling()): of the
+    // device's num_sets sets, num_sampled are simulated, each access to which
+    // is passed to sample_access() as well as access().  The counts printed are
+    // then scaled up to the whole device, and the miss rate comes with a 95%
+    // confidence interval from how the miss rates of the sampled sets vary.
+    // The counts returned by the accessors below and those of the per-pc and
+    // per-site reports are left unscaled.
+    void enable_sampling(int num_sets, int num_sampled);
+    bool samples_sets() const { return !sample_counts.empty(); }
+    void sample_access(int set, bool hit) {
+        sample_counts[set].accesses++;
+        if (!hit)
+            sample_counts[set].misses++;
+    }
+
+    int_least64_t get_hits() const { return num_hits; }
+    int_least64_t get_misses() const { return num_misses; }
+    bool tracks_bandwidth() const { return track_bandwidth; }
+    int_least64_t get_bytes_fetched() const { return bytes_fetched; }
+    int_least64_t get_bytes_written() const { return bytes_written; }
+
  protected:
     // print different groups of information, beneficial for code reuse
     virtual void print_counts(std::string prefix); // hit/miss numbers
     virtual void print_rates(std::string prefix); // hit/miss rates
     virtual void print_child_stats(std::string prefix); // child/total info
+    void print_sample_interval(std::string prefix); // for set sampling
+
+    void record_pc_miss(std::map<addr_t, pc_misses_t> &misses, const memref_t &memref);
+    void record_miss(std::map<addr_t, pc_misses_t> &misses, addr_t key,
+                     memref_pid_t pid);
+    // Scales a count for printing, for set sampling.
+    int_least64_t scaled(int_least64_t count) const {
+        if (sample_scale == 1.)
+            return count;
+        return (int_least64_t)(count * sample_scale + 0.5);
+    }
 
     int_least64_t num_hits;
     int_least64_t num_misses;
     int_least64_t num_child_hits;
+    int_least64_t num_invalidations;
+    int_least64_t num_coherence_misses;
+    int_least64_t num_false_sharing_misses;
+    int_least64_t num_writebacks;
+    int_least64_t bytes_fetched;
+    int_least64_t bytes_written;
+
+    bool track_bandwidth;
+    bool record_pc_misses;
+    std::map<addr_t, pc_misses_t> pc_misses;
+    std::map<addr_t, pc_misses_t> pc_coherence_misses;
+    alloc_map_t *allocs;
+    std::map<addr_t, pc_misses_t> site_misses;
+
+    // For set analysis: the blocks ever accessed, and the fully-associative
+    // cache, most recently used first, with each block's place in it.
+    int_least64_t num_compulsory_misses;
+    int_least64_t num_capacity_misses;
+    int_least64_t num_conflict_misses;
+    std::vector<set_counts_t> set_counts;
+    std::map<addr_t, pc_misses_t> pc_conflict_misses;
+    std::set<addr_t> seen_blocks;
+    std::list<addr_t> shadow_lru;
+    std::map<addr_t, std::list<addr_t>::iterator> shadow_blocks;
+    int shadow_capacity;
+    int shadow_size;
+
+    // For set sampling: the accesses and misses of each set (the conflict
+    // misses go unused), and the ratio of all sets to sampled ones.
+    std::vector<set_counts_t> sample_counts;
+    int num_sampled_sets;
+    double sample_scale;
 };
 
 #endif /* _CACHING_DEVICE_STATS_H_ */
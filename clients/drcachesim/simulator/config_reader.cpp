@@ -0,0 +1,341 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include "config_reader.h"
+#include "utils.h"
+#include "../common/options.h"
+
+config_reader_t::config_reader_t() : line(0)
+{
+}
+
+bool
+config_reader_t::next_token(std::string &token)
+{
+    while (true) {
+        size_t start = pending.find_first_not_of(" \t\r");
+        if (start != std::string::npos) {
+            size_t end = start + 1;
+            if (pending[start] != '{' && pending[start] != '}') {
+                end = pending.find_first_of(" \t\r{}", start);
+                if (end == std::string::npos)
+                    end = pending.size();
+            }
+            token = pending.substr(start, end - start);
+            pending.erase(0, end);
+            return true;
+        }
+        if (!std::getline(file, pending))
+            return false;
+        ++line;
+        size_t comment = pending.find("//");
+        if (comment != std::string::npos)
+            pending.erase(comment);
+    }
+}
+
+bool
+config_reader_t::read_value(const std::string &name, std::string &value)
+{
+    if (!next_token(value) || value == "{" || value == "}") {
+        ERROR("Usage error: %s line %d: missing value for %s\n", path.c_str(), line,
+              name.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool
+config_reader_t::read_uint(const std::string &name, uint64_t max, uint64_t &value)
+{
+    std::string token;
+    if (!read_value(name, token))
+        return false;
+    char *end;
+    value = strtoull(token.c_str(), &end, 10);
+    // We accept the same K, M, and G suffixes as size options on the command line.
+    uint64_t scale = 1;
+    switch (toupper(*end)) {
+    case 'K': scale = 1024; ++end; break;
+    case 'M': scale = 1024*1024; ++end; break;
+    case 'G': scale = 1024*1024*1024; ++end; break;
+    }
+    if (!isdigit(token[0]) || *end != '\0' || value > max / scale) {
+        ERROR("Usage error: %s line %d: invalid value %s for %s\n", path.c_str(), line,
+              token.c_str(), name.c_str());
+        return false;
+    }
+    value *= scale;
+    return true;
+}
+
+bool
+config_reader_t::read_cache(const std::string &name, cache_params_t &params)
+{
+    std::string token;
+    uint64_t value;
+    params.name = name;
+    params.line = line;
+    if (!next_token(token) || token != "{") {
+        ERROR("Usage error: %s line %d: expected { after %s\n", path.c_str(), line,
+              name.c_str());
+        return false;
+    }
+    while (true) {
+        if (!next_token(token)) {
+            ERROR("Usage error: %s: missing } for cache %s\n", path.c_str(),
+                  name.c_str());
+            return false;
+        }
+        if (token == "}")
+            return true;
+        if (token == "type") {
+            if (!read_value(token, params.type))
+                return false;
+            if (params.type != "instruction" && params.type != "data" &&
+                params.type != "unified") {
+                ERROR("Usage error: %s line %d: unknown cache type %s\n", path.c_str(),
+                      line, params.type.c_str());
+                return false;
+            }
+        } else if (token == "core") {
+            if (!read_uint(token, INT_MAX, value))
+                return false;
+            params.core = (int)value;
+        } else if (token == "size") {
+            if (!read_uint(token, INT_MAX, value))
+                return false;
+            params.size = value;
+        } else if (token == "assoc") {
+            if (!read_uint(token, INT_MAX, value))
+                return false;
+            params.assoc = (unsigned int)value;
+        } else if (token == "latency") {
+            if (!read_uint(token, UINT_MAX, value))
+                return false;
+            params.latency = (unsigned int)value;
+        } else if (token == "replace_policy") {
+            if (!read_value(token, params.replace_policy))
+                return false;
+            if (params.replace_policy != REPLACE_POLICY_LRU &&
+                params.replace_policy != REPLACE_POLICY_LFU &&
+                params.replace_policy != REPLACE_POLICY_FIFO &&
+                params.replace_policy != REPLACE_POLICY_PLRU &&
+                params.replace_policy != REPLACE_POLICY_SRRIP &&
+                params.replace_policy != REPLACE_POLICY_DRRIP) {
+                ERROR("Usage error: %s line %d: unknown replacement policy %s\n",
+                      path.c_str(), line, params.replace_policy.c_str());
+                return false;
+            }
+        } else if (token == "prefetcher") {
+            if (!read_value(token, params.prefetcher))
+                return false;
+            if (params.prefetcher != PREFETCH_POLICY_NONE &&
+                params.prefetcher != PREFETCH_POLICY_NEXTLINE &&
+                params.prefetcher != PREFETCH_POLICY_STRIDE &&
+                params.prefetcher != PREFETCH_POLICY_STREAM) {
+                ERROR("Usage error: %s line %d: unknown prefetcher %s\n",
+                      path.c_str(), line, params.prefetcher.c_str());
+                return false;
+            }
+        } else if (token == "write_policy") {
+            if (!read_value(token, params.write_policy))
+                return false;
+            if (params.write_policy != WRITE_POLICY_BACK &&
+                params.write_policy != WRITE_POLICY_THROUGH) {
+                ERROR("Usage error: %s line %d: unknown write policy %s\n",
+                      path.c_str(), line, params.write_policy.c_str());
+                return false;
+            }
+        } else if (token == "write_miss") {
+            if (!read_value(token, params.write_miss))
+                return false;
+            if (params.write_miss != WRITE_MISS_ALLOCATE &&
+                params.write_miss != WRITE_MISS_NO_ALLOCATE) {
+                ERROR("Usage error: %s line %d: unknown write miss policy %s\n",
+                      path.c_str(), line, params.write_miss.c_str());
+                return false;
+            }
+        } else if (token == "parent") {
+            if (!read_value(token, params.parent))
+                return false;
+        } else {
+            ERROR("Usage error: %s line %d: unknown cache parameter %s\n", path.c_str(),
+                  line, token.c_str());
+            return false;
+        }
+    }
+}
+
+bool
+config_reader_t::check_hierarchy(const cache_config_t &config)
+{
+    std::map<std::string, size_t> index;
+    std::vector<int> num_children(config.caches.size(), 0);
+    std::vector<int> icache_count(config.num_cores, 0);
+    std::vector<int> dcache_count(config.num_cores, 0);
+    for (size_t i = 0; i < config.caches.size(); i++) {
+        const cache_params_t &cache = config.caches[i];
+        if (!index.insert(std::make_pair(cache.name, i)).second) {
+            ERROR("Usage error: %s line %d: duplicate cache name %s\n", path.c_str(),
+                  cache.line, cache.name.c_str());
+            return false;
+        }
+        if (cache.size == 0) {
+            ERROR("Usage error: %s line %d: cache %s has no size\n", path.c_str(),
+                  cache.line, cache.name.c_str());
+            return false;
+        }
+        if (cache.core < 0) {
+            if (cache.type != "unified") {
+                ERROR("Usage error: %s line %d: cache %s has a type but no core\n",
+                      path.c_str(), cache.line, cache.name.c_str());
+                return false;
+            }
+            continue;
+        }
+        if (cache.core >= (int)config.num_cores) {
+            ERROR("Usage error: %s line %d: cache %s is on core %d of %u\n",
+                  path.c_str(), cache.line, cache.name.c_str(), cache.core,
+                  config.num_cores);
+            return false;
+        }
+        if (cache.type != "data")
+            icache_count[cache.core]++;
+        if (cache.type != "instruction")
+            dcache_count[cache.core]++;
+    }
+    for (size_t i = 0; i < config.caches.size(); i++) {
+        const cache_params_t &cache = config.caches[i];
+        if (cache.parent.empty())
+            continue;
+        std::map<std::string, size_t>::iterator parent = index.find(cache.parent);
+        if (parent == index.end()) {
+            ERROR("Usage error: %s line %d: unknown parent %s of cache %s\n",
+                  path.c_str(), cache.line, cache.parent.c_str(), cache.name.c_str());
+            return false;
+        }
+        if (config.caches[parent->second].core >= 0) {
+            ERROR("Usage error: %s line %d: cache %s of core %d cannot be a parent\n",
+                  path.c_str(), cache.line, cache.parent.c_str(),
+                  config.caches[parent->second].core);
+            return false;
+        }
+        num_children[parent->second]++;
+        // A chain longer than the number of caches must loop.
+        size_t depth = 0;
+        const cache_params_t *ancestor = &cache;
+        while (!ancestor->parent.empty()) {
+            ancestor = &config.caches[index[ancestor->parent]];
+            if (++depth > config.caches.size()) {
+                ERROR("Usage error: %s line %d: the parents of cache %s form a cycle\n",
+                      path.c_str(), cache.line, cache.name.c_str());
+                return false;
+            }
+        }
+    }
+    for (size_t i = 0; i < config.caches.size(); i++) {
+        const cache_params_t &cache = config.caches[i];
+        if (cache.core < 0 && num_children[i] == 0) {
+            ERROR("Usage error: %s line %d: cache %s has no core and no children\n",
+                  path.c_str(), cache.line, cache.name.c_str());
+            return false;
+        }
+    }
+    for (unsigned int core = 0; core < config.num_cores; core++) {
+        if (icache_count[core] != 1 || dcache_count[core] != 1) {
+            ERROR("Usage error: %s: core %u needs one instruction and one data "
+                  "cache, or one unified cache\n", path.c_str(), core);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+config_reader_t::configure(const std::string &path_, cache_config_t &config)
+{
+    path = path_;
+    file.open(path.c_str());
+    if (!file.good()) {
+        ERROR("Usage error: failed to open config file %s\n", path.c_str());
+        return false;
+    }
+    std::string token;
+    uint64_t value;
+    while (next_token(token)) {
+        if (token == "num_cores") {
+            if (!read_uint(token, INT_MAX, value))
+                return false;
+            if (value == 0) {
+                ERROR("Usage error: %s line %d: num_cores must be positive\n",
+                      path.c_str(), line);
+                return false;
+            }
+            config.num_cores = (unsigned int)value;
+        } else if (token == "line_size") {
+            if (!read_uint(token, INT_MAX, value))
+                return false;
+            config.line_size = (unsigned int)value;
+        } else if (token == "memory_latency") {
+            if (!read_uint(token, UINT_MAX, value))
+                return false;
+            config.memory_latency = (unsigned int)value;
+        } else if (token == "remote_memory_latency") {
+            if (!read_uint(token, UINT_MAX, value))
+                return false;
+            config.remote_memory_latency = (unsigned int)value;
+        } else if (token == "{" || token == "}") {
+            ERROR("Usage error: %s line %d: unexpected %s\n", path.c_str(), line,
+                  token.c_str());
+            return false;
+        } else {
+            cache_params_t params;
+            if (!read_cache(token, params))
+                return false;
+            if (params.type.empty())
+                params.type = "unified";
+            config.caches.push_back(params);
+        }
+    }
+    if (config.caches.empty()) {
+        ERROR("Usage error: %s: no caches specified\n", path.c_str());
+        return false;
+    }
+    return check_hierarchy(config);
+}
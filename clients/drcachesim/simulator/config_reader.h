@@ -0,0 +1,115 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* config_reader: parses a cache hierarchy description for cache_simulator_t.
+ */
+
+#ifndef _CONFIG_READER_H_
+#define _CONFIG_READER_H_ 1
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// The file is a sequence of whitespace-separated tokens, with "//" starting a
+// comment that runs to the end of the line.  Global settings are name-value
+// pairs and each cache is a name followed by its parameters in braces:
+//
+//   num_cores       2
+//   line_size       64
+//   memory_latency  200     // cycles for a miss in a cache with no parent
+//   remote_memory_latency 100 // extra cycles if on another node (NUMA)
+//   L1I_0 { type instruction core 0 size 32K assoc 8 latency 4 parent L2_0 }
+//   L1D_0 { type data core 0 size 32K assoc 8 latency 4 parent L2_0 }
+//   L2_0  { size 256K assoc 8 latency 12 parent L3 }
+//   ...
+//   L3    { size 8M assoc 16 replace_policy LRU latency 40 }
+//
+// A cache may also name a hardware prefetcher, e.g., "prefetcher stride", as
+// for -data_prefetcher, and a write policy, e.g., "write_policy write_through",
+// and write miss policy, e.g., "write_miss no_allocate", as for -write_policy
+// and -write_miss.
+//
+// A cache with a core is a first-level cache of that core, and every core needs
+// one for instructions and one for data, or one of type unified for both.  Any
+// other cache must be the parent of at least one cache.  Caches that share a
+// parent, e.g., the L2 caches of a cluster, share its contents.
+struct cache_params_t
+{
+    cache_params_t() :
+        core(-1), size(0), assoc(1), latency(0), line(0) {}
+    std::string name;
+    std::string type; // "instruction", "data", or "unified"
+    int core;         // For first-level caches; -1 otherwise.
+    uint64_t size;
+    unsigned int assoc;
+    std::string replace_policy;
+    std::string prefetcher; // Empty for none.
+    std::string write_policy; // Empty for the -write_policy default.
+    std::string write_miss; // Empty for the -write_miss default.
+    std::string parent; // Empty for a cache that misses to memory.
+    unsigned int latency;
+    int line; // For error reports.
+};
+
+struct cache_config_t
+{
+    unsigned int num_cores;
+    unsigned int line_size;
+    unsigned int memory_latency;
+    unsigned int remote_memory_latency;
+    std::vector<cache_params_t> caches;
+};
+
+class config_reader_t
+{
+ public:
+    config_reader_t();
+    // Reads the file at "path" into "config", whose prior field values are
+    // the defaults.  Prints an error and returns false if the file is invalid.
+    bool configure(const std::string &path, cache_config_t &config);
+
+ private:
+    bool next_token(std::string &token);
+    bool read_value(const std::string &name, std::string &value);
+    bool read_uint(const std::string &name, uint64_t max, uint64_t &value);
+    bool read_cache(const std::string &name, cache_params_t &params);
+    bool check_hierarchy(const cache_config_t &config);
+
+    std::string path;
+    std::ifstream file;
+    int line;
+    std::string pending; // The rest of the current line.
+};
+
+#endif /* _CONFIG_READER_H_ */
@@ -0,0 +1,308 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <assert.h>
+#include <stdint.h> /* for supporting 64-bit integers*/
+#include "utils.h"
+#include "memref.h"
+#include "droption.h"
+#include "../common/options.h"
+#include "symbolizer.h"
+#include "false_sharing_simulator.h"
+
+// The number of instructions listed for each line.
+#define TOP_PCS_PER_LINE 4
+
+bool
+false_sharing_simulator_t::init()
+{
+    if (!create_reader())
+        return false;
+
+    // We do not model cores.
+    num_cores = 1;
+    thread_counts = NULL;
+    thread_ever_counts = NULL;
+
+    line_bits = compute_log2((int)op_line_size.get_value());
+    if (line_bits == -1) {
+        ERROR("Usage error: the line size must be a power of 2.\n");
+        return false;
+    }
+    // We track up to 64 granules per line, in a uint64_t.
+    granule_bits = line_bits > 6 ? line_bits - 6 : 0;
+    time = 0;
+    return true;
+}
+
+false_sharing_simulator_t::~false_sharing_simulator_t()
+{
+}
+
+uint64_t
+false_sharing_simulator_t::mask_of(addr_t start, addr_t end)
+{
+    // The granules of the line offsets in [start, end].
+    int first = (int)(start >> granule_bits);
+    int count = (int)(end >> granule_bits) - first + 1;
+    if (count >= 64)
+        return ~(uint64_t)0;
+    return (((uint64_t)1 << count) - 1) << first;
+}
+
+void
+false_sharing_simulator_t::access(const memref_t &memref)
+{
+    bool is_write = memref.type == TRACE_TYPE_WRITE;
+    addr_t offset_mask = ((addr_t)1 << line_bits) - 1;
+    addr_t final_addr = memref.addr + memref.size - 1/*avoid overflow*/;
+    time++;
+    for (addr_t line_addr = memref.addr >> line_bits;
+         line_addr <= final_addr >> line_bits; line_addr++) {
+        line_t &line = lines[std::make_pair(memref.pid, line_addr)];
+        addr_t start = (line_addr == memref.addr >> line_bits) ?
+            (memref.addr & offset_mask) : 0;
+        addr_t end = (line_addr == final_addr >> line_bits) ?
+            (final_addr & offset_mask) : offset_mask;
+        uint64_t mask = mask_of(start, end);
+        bool false_sharing = false, true_sharing = false;
+        user_t *self = NULL;
+        for (size_t i = 0; i < line.users.size(); ) {
+            // Out of the window, a thread's use no longer conflicts.
+            if (time - line.users[i].last_time > op_fs_window.get_value()) {
+                line.users[i] = line.users.back();
+                line.users.pop_back();
+            } else
+                ++i;
+        }
+        for (size_t i = 0; i < line.users.size(); i++) {
+            user_t &user = line.users[i];
+            if (user.tid == memref.tid) {
+                self = &user;
+                continue;
+            }
+            uint64_t other = is_write ? (user.read_mask | user.write_mask) :
+                user.write_mask;
+            if (other != 0) {
+                if ((other & mask) != 0)
+                    true_sharing = true;
+                else {
+                    false_sharing = true;
+                    line.tids.insert(user.tid);
+                    line.pcs[user.last_pc]++;
+                }
+            }
+        }
+        if (true_sharing)
+            line.true_sharing++;
+        if (false_sharing) {
+            line.false_sharing++;
+            line.tids.insert(memref.tid);
+            line.pcs[memref.pc]++;
+            if (!line.have_site)
+                line.have_site = allocs.find(line_addr << line_bits, &line.site);
+        }
+        if (self == NULL) {
+            user_t user = {memref.tid, 0, 0, 0, 0};
+            line.users.push_back(user);
+            self = &line.users.back();
+        }
+        if (is_write)
+            self->write_mask |= mask;
+        else
+            self->read_mask |= mask;
+        self->last_time = time;
+        self->last_pc = memref.pc;
+    }
+}
+
+void
+false_sharing_simulator_t::reset()
+{
+    // We keep each line's recent users, which are still valid.
+    for (std::map<std::pair<memref_pid_t, addr_t>, line_t>::iterator it =
+             lines.begin(); it != lines.end(); ++it) {
+        line_t &line = it->second;
+        line.false_sharing = 0;
+        line.true_sharing = 0;
+        line.tids.clear();
+        line.pcs.clear();
+    }
+}
+
+bool
+false_sharing_simulator_t::run()
+{
+    if (!reader->init()) {
+        if (op_infile.get_value().empty())
+            ERROR("failed to read from pipe %s", op_ipc_name.get_value().c_str());
+        else
+            ERROR("failed to read from %s", op_infile.get_value().c_str());
+        return false;
+    }
+
+    uint64_t warmup_refs = op_warmup_refs.get_value();
+    uint64_t sim_refs = op_sim_refs.get_value();
+
+    reader->skip_memrefs(op_skip_refs.get_value());
+
+    for (; *reader != *reader_end; ++(*reader)) {
+        memref_t memref = **reader;
+
+        // Allocations are tracked even when references are dropped, as later
+        // references may lie in them.
+        if (memref.type == TRACE_TYPE_ALLOC ||
+            memref.type == TRACE_TYPE_FREE) {
+            allocs.update(memref);
+            continue;
+        }
+
+        // the references after warmup and simulated ones are dropped
+        if (warmup_refs == 0 && sim_refs == 0)
+            continue;
+
+        if (memref.type == TRACE_TYPE_READ ||
+            memref.type == TRACE_TYPE_WRITE)
+            access(memref);
+        else if (memref.type == TRACE_TYPE_INSTR ||
+                 type_is_prefetch(memref.type) ||
+                 memref.type == TRACE_TYPE_INSTR_FLUSH ||
+                 memref.type == TRACE_TYPE_DATA_FLUSH ||
+                 memref.type == TRACE_TYPE_THREAD_EXIT ||
+                 memref.type == TRACE_TYPE_CPU_ID ||
+                 memref.type == TRACE_TYPE_SYSCALL ||
+                 memref.type == TRACE_TYPE_SYSCALL_END) {
+            // We only analyze data accesses.
+        } else {
+            ERROR("unhandled memref type");
+            return false;
+        }
+
+        if (op_verbose.get_value() >= 3) {
+            std::cerr << "::" << memref.pid << "." << memref.tid << ":: " <<
+                " @" << (void *)memref.pc <<
+                " " << trace_type_names[memref.type] << " " <<
+                (void *)memref.addr << " x" << memref.size << std::endl;
+        }
+
+        // process counters for warmup and simulated references
+        if (warmup_refs > 0) {
+            warmup_refs--;
+            if (warmup_refs == 0)
+                reset();
+        }
+        else
+            sim_refs--;
+    }
+    return true;
+}
+
+typedef std::pair<std::pair<memref_pid_t, addr_t>, int_least64_t> line_count_t;
+
+static bool
+line_count_greater(const line_count_t &a, const line_count_t &b)
+{
+    return a.second > b.second;
+}
+
+static bool
+pc_count_greater(const std::pair<addr_t, int_least64_t> &a,
+                 const std::pair<addr_t, int_least64_t> &b)
+{
+    return a.second > b.second;
+}
+
+bool
+false_sharing_simulator_t::print_stats()
+{
+    int_least64_t shared_lines = 0, false_lines = 0;
+    int_least64_t false_sharing = 0, true_sharing = 0;
+    std::vector<line_count_t> sorted;
+    for (std::map<std::pair<memref_pid_t, addr_t>, line_t>::iterator it =
+             lines.begin(); it != lines.end(); ++it) {
+        const line_t &line = it->second;
+        if (line.false_sharing > 0 || line.true_sharing > 0)
+            shared_lines++;
+        if (line.false_sharing > 0) {
+            false_lines++;
+            sorted.push_back(std::make_pair(it->first, line.false_sharing));
+        }
+        false_sharing += line.false_sharing;
+        true_sharing += line.true_sharing;
+    }
+    std::cerr << "Cache line sharing within windows of " << op_fs_window.get_value()
+              << " data references, all threads:" << std::endl;
+    std::cerr << "  " << std::setw(26) << std::left << "Lines shared:" <<
+        std::setw(14) << std::right << shared_lines << std::endl;
+    std::cerr << "  " << std::setw(26) << std::left << "Lines falsely shared:" <<
+        std::setw(14) << std::right << false_lines << std::endl;
+    std::cerr << "  " << std::setw(26) << std::left << "True sharing accesses:" <<
+        std::setw(14) << std::right << true_sharing << std::endl;
+    std::cerr << "  " << std::setw(26) << std::left << "False sharing accesses:" <<
+        std::setw(14) << std::right << false_sharing << std::endl;
+    if (sorted.empty())
+        return true;
+
+    symbolizer_t symbolizer;
+    symbolizer.init();
+    std::sort(sorted.begin(), sorted.end(), line_count_greater);
+    if (sorted.size() > op_fs_top_lines.get_value())
+        sorted.resize(op_fs_top_lines.get_value());
+    std::cerr << "  Top " << sorted.size() << " lines by false sharing accesses "
+        "(line, false sharing, true sharing, threads):" << std::endl;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        memref_pid_t pid = sorted[i].first.first;
+        const line_t &line = lines[sorted[i].first];
+        std::cerr << "    " << std::setw(18) << std::left <<
+            (void *)(sorted[i].first.second << line_bits) <<
+            std::setw(14) << std::right << line.false_sharing <<
+            std::setw(14) << std::right << line.true_sharing <<
+            std::setw(10) << std::right << line.tids.size() << std::endl;
+        if (line.have_site) {
+            std::cerr << "      allocated at 0x" << std::hex << line.site << std::dec
+                      << "  " << symbolizer.describe(pid, line.site) << std::endl;
+        }
+        std::vector<std::pair<addr_t, int_least64_t> > pcs(line.pcs.begin(),
+                                                            line.pcs.end());
+        std::sort(pcs.begin(), pcs.end(), pc_count_greater);
+        for (size_t j = 0; j < pcs.size() && j < TOP_PCS_PER_LINE; j++) {
+            std::cerr << "      " << std::setw(14) << std::right << pcs[j].second
+                      << "  0x" << std::hex << pcs[j].first << std::dec << "  "
+                      << symbolizer.describe(pid, pcs[j].first) << std::endl;
+        }
+    }
+    return true;
+}
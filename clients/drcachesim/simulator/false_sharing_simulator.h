@@ -0,0 +1,99 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* false_sharing_simulator: finds cache lines that threads share without
+ * sharing data.
+ */
+
+#ifndef _FALSE_SHARING_SIMULATOR_H_
+#define _FALSE_SHARING_SIMULATOR_H_ 1
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+#include "simulator.h"
+#include "alloc_map.h"
+
+// Tracks, for each cache line, which bytes of it each thread read and wrote
+// within the last -fs_window data references.  An access conflicts with
+// another thread's recent use of the line when one of the two is a write: it
+// is true sharing if they touched a byte in common and false sharing
+// otherwise.  False sharing moves the line between cores just as true sharing
+// does, although no data passes between the threads, so the lines with the
+// most false sharing are laid out badly.  Bytes are tracked in up to 64
+// granules per line.
+class false_sharing_simulator_t : public simulator_t
+{
+ public:
+    virtual bool init();
+    virtual ~false_sharing_simulator_t();
+    virtual bool run();
+    virtual bool print_stats();
+
+ protected:
+    // A thread's recent use of a line.
+    struct user_t {
+        memref_tid_t tid;
+        uint64_t read_mask;
+        uint64_t write_mask;
+        // The reference count at the thread's last access to the line.
+        uint64_t last_time;
+        addr_t last_pc;
+    };
+
+    struct line_t {
+        line_t() : false_sharing(0), true_sharing(0), site(0), have_site(false) {}
+        std::vector<user_t> users;
+        int_least64_t false_sharing;
+        int_least64_t true_sharing;
+        // The threads and instructions involved in false sharing.
+        std::set<memref_tid_t> tids;
+        std::map<addr_t, int_least64_t> pcs;
+        // With -record_allocs, the call site of the line's allocation.
+        addr_t site;
+        bool have_site;
+    };
+
+    void access(const memref_t &memref);
+    uint64_t mask_of(addr_t start, addr_t end);
+    void reset();
+
+    int line_bits;
+    int granule_bits;
+    uint64_t time;
+    // Keyed by process and line address.
+    std::map<std::pair<memref_pid_t, addr_t>, line_t> lines;
+    alloc_map_t allocs;
+};
+
+#endif /* _FALSE_SHARING_SIMULATOR_H_ */
@@ -0,0 +1,100 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "memref.h"
+#include "fanout_reader.h"
+
+fanout_reader_t::fanout_reader_t(fanout_queue_t *queue_, fanout_queue_t *free_queue_) :
+    queue(queue_), free_queue(free_queue_), cur_batch(NULL), cur_idx(0)
+{
+}
+
+bool
+fanout_reader_t::init()
+{
+    cur_batch = queue->pop();
+    cur_idx = 0;
+    at_eof = (cur_batch->count == 0);
+    return true;
+}
+
+void
+fanout_reader_t::next_buffer()
+{
+    if (__sync_sub_and_fetch(&cur_batch->readers_left, 1) == 0)
+        free_queue->push(cur_batch);
+    cur_batch = queue->pop();
+    cur_idx = 0;
+    at_eof = (cur_batch->count == 0);
+}
+
+const memref_t&
+fanout_reader_t::operator*()
+{
+    assert(!at_eof);
+    return cur_batch->refs[cur_idx];
+}
+
+reader_t&
+fanout_reader_t::operator++()
+{
+    if (!at_eof && ++cur_idx == cur_batch->count)
+        next_buffer();
+    return *this;
+}
+
+size_t
+fanout_reader_t::next_batch(memref_t *out, size_t max)
+{
+    size_t count = 0;
+    while (count < max && !at_eof) {
+        size_t avail = cur_batch->count - cur_idx;
+        size_t take = (max - count < avail) ? max - count : avail;
+        memcpy(out + count, cur_batch->refs + cur_idx, take * sizeof(*out));
+        count += take;
+        cur_idx += take;
+        if (cur_idx == cur_batch->count)
+            next_buffer();
+    }
+    return count;
+}
+
+void
+fanout_reader_t::drain()
+{
+    if (cur_batch == NULL)
+        init();
+    while (!at_eof)
+        next_buffer();
+}
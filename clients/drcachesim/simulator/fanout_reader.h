@@ -0,0 +1,81 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* fanout_reader: presents memrefs decoded once and shared among several
+ * simulators.
+ */
+
+#ifndef _FANOUT_READER_H_
+#define _FANOUT_READER_H_ 1
+
+#include "memref.h"
+#include "reader.h"
+#include "sim_queue.h"
+
+// A batch of memrefs that every consumer reads but none modifies.
+struct fanout_batch_t {
+    memref_t *refs;
+    size_t count; // 0 marks the end of the input
+    // The consumers yet to finish with the batch.
+    volatile int readers_left;
+};
+typedef sim_queue_t<fanout_batch_t *> fanout_queue_t;
+
+// Presents the memrefs of the batches a producer pushes onto "queue".  The
+// same batches are pushed to every consumer's queue; the last consumer to
+// finish with one hands it back on "free_queue" for the producer to refill.
+// As for the other readers, the default constructor produces an EOF object.
+// XXX i#1703: this is UNIX-only, like the rest of the simulator's
+// parallel mode.
+class fanout_reader_t : public reader_t
+{
+ public:
+    fanout_reader_t() : queue(NULL), free_queue(NULL), cur_batch(NULL), cur_idx(0) {}
+    fanout_reader_t(fanout_queue_t *queue, fanout_queue_t *free_queue);
+    virtual bool init();
+    virtual const memref_t& operator*();
+    virtual reader_t& operator++();
+    virtual size_t next_batch(memref_t *out, size_t max);
+    // Releases the remaining batches unread, so a consumer that stops early
+    // does not hold up the producer.
+    void drain();
+
+ private:
+    void next_buffer();
+
+    fanout_queue_t *queue;
+    fanout_queue_t *free_queue;
+    fanout_batch_t *cur_batch;
+    size_t cur_idx;
+};
+
+#endif /* _FANOUT_READER_H_ */
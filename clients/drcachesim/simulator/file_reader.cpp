@@ -0,0 +1,348 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <assert.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <string.h>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "memref.h"
+#include "file_reader.h"
+#include "utils.h"
+
+// XXX i#1727: the directory walking here is UNIX-only.
+
+file_reader_t::file_reader_t() :
+    cur_input(0), live_inputs(0), delivered_from_cur(false)
+{
+    // Following typical stream iterator convention, the default constructor
+    // produces an EOF object.
+    at_eof = true;
+}
+
+file_reader_t::file_reader_t(const char *path) :
+    input_path(path), cur_input(0), live_inputs(0), delivered_from_cur(false)
+{
+    at_eof = true;
+}
+
+file_reader_t::~file_reader_t()
+{
+    for (std::vector<input_t>::iterator in = inputs.begin(); in != inputs.end(); ++in) {
+        delete in->file;
+        delete [] in->buf;
+    }
+}
+
+bool
+file_reader_t::open_file(const std::string &path)
+{
+    input_t in;
+    in.file = new std::ifstream(path.c_str(), std::ifstream::binary);
+    if (!*in.file) {
+        ERROR("Failed to open trace file %s\n", path.c_str());
+        delete in.file;
+        return false;
+    }
+    in.buf_size = BUF_SIZE;
+    in.buf = new trace_entry_t[in.buf_size];
+    in.cur_buf = in.buf;
+    in.end_buf = in.buf;
+    in.eof = false;
+    in.next_chunk = 0;
+    in.buffered_memrefs = 0;
+    trace_file_header_t header;
+    in.file->read((char *)&header, sizeof(header));
+    in.compressed = (in.file->gcount() == sizeof(header) &&
+                     memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic)) == 0);
+    if (in.compressed) {
+        if (header.version != TRACE_FILE_VERSION) {
+            ERROR("Unsupported trace file version %u in %s\n", header.version,
+                  path.c_str());
+        } else if (!read_index(in, path))
+            in.compressed = false;
+        if (!in.compressed) {
+            delete in.file;
+            delete [] in.buf;
+            return false;
+        }
+    } else {
+        in.file->clear();
+        in.file->seekg(0);
+    }
+    inputs.push_back(in);
+    ++live_inputs;
+    return true;
+}
+
+bool
+file_reader_t::read_index(input_t &in, const std::string &path)
+{
+    trace_index_footer_t footer;
+    in.file->seekg(0, std::ios::end);
+    uint64_t file_size = in.file->tellg();
+    if (file_size >= sizeof(trace_file_header_t) + sizeof(footer)) {
+        in.file->seekg(file_size - sizeof(footer));
+        in.file->read((char *)&footer, sizeof(footer));
+        if (*in.file &&
+            memcmp(footer.magic, TRACE_INDEX_MAGIC, sizeof(footer.magic)) == 0 &&
+            footer.index_offset + footer.num_chunks * sizeof(trace_chunk_index_t) +
+            sizeof(footer) == file_size) {
+            in.chunks.resize(footer.num_chunks);
+            in.file->seekg(footer.index_offset);
+            if (footer.num_chunks > 0) {
+                in.file->read((char *)&in.chunks[0],
+                              footer.num_chunks * sizeof(trace_chunk_index_t));
+            }
+            if (*in.file)
+                return true;
+            ERROR("Failed to read chunk index of %s\n", path.c_str());
+            return false;
+        }
+    }
+    // The index is missing, most likely because the application was killed
+    // before its threads exited.  We rebuild it from the chunk headers.
+    uint64_t offs = sizeof(trace_file_header_t);
+    in.chunks.clear();
+    while (offs + sizeof(trace_chunk_header_t) <= file_size) {
+        trace_chunk_header_t header;
+        in.file->clear();
+        in.file->seekg(offs);
+        in.file->read((char *)&header, sizeof(header));
+        if (!*in.file || header.magic != TRACE_CHUNK_MAGIC ||
+            offs + sizeof(header) + header.encoded_size > file_size)
+            break;
+        trace_chunk_index_t chunk = {offs, header.num_memrefs};
+        in.chunks.push_back(chunk);
+        offs += sizeof(header) + header.encoded_size;
+    }
+    in.file->clear();
+    return true;
+}
+
+bool
+file_reader_t::read_chunk(input_t &in)
+{
+    if (in.next_chunk >= in.chunks.size())
+        return false;
+    trace_chunk_header_t header;
+    in.file->seekg(in.chunks[in.next_chunk].offset);
+    in.file->read((char *)&header, sizeof(header));
+    if (!*in.file || header.magic != TRACE_CHUNK_MAGIC) {
+        ERROR("Corrupted chunk header in %s\n", input_path.c_str());
+        return false;
+    }
+    in.payload.resize(header.encoded_size);
+    if (header.encoded_size > 0)
+        in.file->read((char *)&in.payload[0], header.encoded_size);
+    if (!*in.file) {
+        ERROR("Truncated trace file %s\n", input_path.c_str());
+        return false;
+    }
+    if (header.num_entries > in.buf_size) {
+        delete [] in.buf;
+        in.buf_size = header.num_entries;
+        in.buf = new trace_entry_t[in.buf_size];
+    }
+    if (!trace_decompress_chunk(&header, in.payload.empty() ? NULL : &in.payload[0],
+                                in.buf)) {
+        ERROR("Corrupted chunk in %s\n", input_path.c_str());
+        return false;
+    }
+    in.cur_buf = in.buf;
+    in.end_buf = in.buf + header.num_entries;
+    in.buffered_memrefs = header.num_memrefs;
+    ++in.next_chunk;
+    return true;
+}
+
+void
+file_reader_t::close_input(input_t &in)
+{
+    in.file->close();
+    delete in.file;
+    in.file = NULL;
+    --live_inputs;
+}
+
+bool
+file_reader_t::init()
+{
+    struct stat st;
+    if (stat(input_path.c_str(), &st) != 0) {
+        ERROR("Failed to find trace input %s\n", input_path.c_str());
+        return false;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(input_path.c_str());
+        if (dir == NULL) {
+            ERROR("Failed to list directory %s\n", input_path.c_str());
+            return false;
+        }
+        std::vector<std::string> names;
+        struct dirent *ent;
+        std::string suffix = "." OUTFILE_SUFFIX;
+        while ((ent = readdir(dir)) != NULL) {
+            std::string name(ent->d_name);
+            if (name.size() > suffix.size() &&
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+                names.push_back(name);
+        }
+        closedir(dir);
+        // Sort for a deterministic interleaving across runs.
+        std::sort(names.begin(), names.end());
+        for (std::vector<std::string>::iterator name = names.begin();
+             name != names.end(); ++name) {
+            if (!open_file(input_path + "/" + *name))
+                return false;
+        }
+    } else if (!open_file(input_path))
+        return false;
+    if (inputs.empty()) {
+        ERROR("No trace files found in %s\n", input_path.c_str());
+        return false;
+    }
+    at_eof = false;
+    ++*this;
+    return true;
+}
+
+trace_entry_t *
+file_reader_t::peek_entry(input_t &in)
+{
+    if (in.cur_buf >= in.end_buf) {
+        if (in.eof)
+            return NULL;
+        if (in.compressed) {
+            // We loop to skip over chunks holding no entries.
+            do {
+                if (!read_chunk(in)) {
+                    in.eof = true;
+                    return NULL;
+                }
+            } while (in.cur_buf >= in.end_buf);
+            return in.cur_buf;
+        }
+        in.file->read((char *)in.buf, BUF_SIZE * sizeof(trace_entry_t));
+        std::streamsize sz = in.file->gcount();
+        if (sz % sizeof(trace_entry_t) != 0)
+            ERROR("Truncated trace file %s\n", input_path.c_str());
+        in.cur_buf = in.buf;
+        in.end_buf = in.buf + (sz / sizeof(trace_entry_t));
+        if (!*in.file)
+            in.eof = true;
+        if (in.cur_buf >= in.end_buf)
+            return NULL;
+    }
+    return in.cur_buf;
+}
+
+trace_entry_t *
+file_reader_t::read_next_entry()
+{
+    while (live_inputs > 0) {
+        input_t &in = inputs[cur_input];
+        trace_entry_t *entry = NULL;
+        if (in.file != NULL)
+            entry = peek_entry(in);
+        if (entry == NULL && in.file != NULL)
+            close_input(in);
+        // Each buffer written by the tracer starts with a thread entry, so that
+        // is where we switch to another thread's file.
+        if (entry == NULL ||
+            (entry->type == TRACE_TYPE_THREAD && delivered_from_cur && live_inputs > 1)) {
+            cur_input = (cur_input + 1) % inputs.size();
+            delivered_from_cur = false;
+            continue;
+        }
+        ++in.cur_buf;
+        delivered_from_cur = true;
+        return entry;
+    }
+    at_eof = true;
+    return NULL;
+}
+
+uint64_t
+file_reader_t::skip_memrefs(uint64_t count)
+{
+    uint64_t skipped = 0;
+    bool all_compressed = true;
+    for (std::vector<input_t>::iterator in = inputs.begin(); in != inputs.end(); ++in) {
+        if (!in->compressed)
+            all_compressed = false;
+    }
+    if (!all_compressed)
+        return reader_t::skip_memrefs(count);
+    // Step to the end of the current chunk the slow way.
+    while (skipped < count && !at_eof &&
+           (!at_entry_boundary() ||
+            inputs[cur_input].cur_buf < inputs[cur_input].end_buf)) {
+        ++*this;
+        if (!at_eof)
+            ++skipped;
+    }
+    // Now drop whole chunks, visiting the inputs in the same order that
+    // read_next_entry() would.  We stop before the chunk holding the target
+    // memref, which ++ must actually decode.
+    while (skipped < count && !at_eof && live_inputs > 0) {
+        input_t &in = inputs[cur_input];
+        bool have_buffered = (in.file != NULL && in.cur_buf < in.end_buf);
+        if (in.file != NULL && !have_buffered && in.next_chunk >= in.chunks.size())
+            close_input(in);
+        if (in.file == NULL || (delivered_from_cur && live_inputs > 1)) {
+            cur_input = (cur_input + 1) % inputs.size();
+            delivered_from_cur = false;
+            continue;
+        }
+        uint64_t chunk_memrefs = have_buffered ? in.buffered_memrefs :
+            in.chunks[in.next_chunk].num_memrefs;
+        if (chunk_memrefs >= count - skipped)
+            break;
+        if (have_buffered)
+            in.cur_buf = in.end_buf;
+        else
+            ++in.next_chunk;
+        skipped += chunk_memrefs;
+        delivered_from_cur = true;
+    }
+    while (skipped < count && !at_eof) {
+        ++*this;
+        if (!at_eof)
+            ++skipped;
+    }
+    return skipped;
+}
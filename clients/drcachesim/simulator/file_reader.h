@@ -0,0 +1,101 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* file_reader: reads trace files written by the tracer in offline mode
+ * and presents them via an interator interface to the cache simulator.
+ */
+
+#ifndef _FILE_READER_H_
+#define _FILE_READER_H_ 1
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "memref.h"
+#include "reader.h"
+#include "../common/trace_entry.h"
+#include "../common/trace_compress.h"
+
+// The input path can either name a single trace file or a directory
+// containing one trace file per application thread, as produced by the
+// tracer's -offline mode.  For a directory, the per-thread streams are
+// interleaved one buffer at a time, using the thread entry that starts each
+// buffer as the switch point.
+// Files written with -compress are detected automatically and decoded one
+// chunk at a time; their chunk index lets skip_memrefs() avoid decoding
+// chunks that are skipped entirely.
+class file_reader_t : public reader_t
+{
+ public:
+    file_reader_t();
+    explicit file_reader_t(const char *path);
+    virtual ~file_reader_t();
+    virtual bool init();
+    virtual uint64_t skip_memrefs(uint64_t count);
+
+ protected:
+    virtual trace_entry_t * read_next_entry();
+
+ private:
+    bool open_file(const std::string &path);
+
+    struct input_t {
+        std::ifstream *file;
+        trace_entry_t *buf;
+        size_t buf_size; // in entries
+        trace_entry_t *cur_buf;
+        trace_entry_t *end_buf;
+        bool eof;
+        // For compressed files:
+        bool compressed;
+        std::vector<trace_chunk_index_t> chunks;
+        size_t next_chunk;
+        uint64_t buffered_memrefs; // memrefs of the chunk held in buf
+        std::vector<unsigned char> payload;
+    };
+    // Returns the next unconsumed entry for "in", refilling its buffer if
+    // necessary, or NULL if the input is exhausted.
+    trace_entry_t *peek_entry(input_t &in);
+    bool read_index(input_t &in, const std::string &path);
+    bool read_chunk(input_t &in);
+    void close_input(input_t &in);
+
+    std::string input_path;
+    std::vector<input_t> inputs;
+    unsigned int cur_input;
+    unsigned int live_inputs;
+    bool delivered_from_cur;
+
+    static const int BUF_SIZE = 4*1024;
+};
+
+#endif /* _FILE_READER_H_ */
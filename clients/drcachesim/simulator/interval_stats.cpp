@@ -0,0 +1,143 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <iostream>
+#include "utils.h"
+#include "interval_stats.h"
+
+interval_stats_t::interval_stats_t(uint64_t interval_refs_) :
+    interval_refs(interval_refs_), interval_count(0), total_refs(0), intervals(0),
+    header_written(false), csv(&std::cerr), cur_block(0)
+{
+}
+
+bool
+interval_stats_t::init(const std::string &csv_path, const std::string &bbv_path)
+{
+    if (!csv_path.empty()) {
+        csv_file.open(csv_path.c_str());
+        if (!csv_file.is_open()) {
+            ERROR("Usage error: failed to open interval file %s\n", csv_path.c_str());
+            return false;
+        }
+        csv = &csv_file;
+    }
+    if (!bbv_path.empty()) {
+        bbv_file.open(bbv_path.c_str());
+        if (!bbv_file.is_open()) {
+            ERROR("Usage error: failed to open interval bbv file %s\n",
+                  bbv_path.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+interval_stats_t::add_device(const std::string &name,
+                             const caching_device_stats_t *stats)
+{
+    names.push_back(name);
+    devices.push_back(stats);
+    last_hits.push_back(0);
+    last_misses.push_back(0);
+    last_fetched.push_back(0);
+    last_written.push_back(0);
+}
+
+void
+interval_stats_t::record_instr(const memref_t &memref)
+{
+    std::map<memref_tid_t, addr_t>::iterator next =
+        next_pc.insert(std::make_pair(memref.tid, (addr_t)0)).first;
+    if (memref.pc != next->second || cur_block == 0) {
+        std::map<addr_t, unsigned int>::iterator id =
+            block_ids.insert(std::make_pair(memref.pc,
+                                            (unsigned int)block_ids.size() + 1)).first;
+        cur_block = id->second;
+    }
+    next->second = memref.pc + memref.size;
+    ++block_counts[cur_block];
+}
+
+void
+interval_stats_t::snapshot()
+{
+    if (!header_written) {
+        *csv << "interval,refs";
+        for (size_t i = 0; i < names.size(); i++) {
+            *csv << "," << names[i] << "_hits," << names[i] << "_misses," <<
+                names[i] << "_interval_hits," << names[i] << "_interval_misses";
+            if (devices[i]->tracks_bandwidth()) {
+                *csv << "," << names[i] << "_interval_bytes_fetched," << names[i] <<
+                    "_interval_bytes_written";
+            }
+        }
+        *csv << std::endl;
+        header_written = true;
+    }
+    total_refs += interval_count;
+    *csv << intervals << "," << total_refs;
+    for (size_t i = 0; i < devices.size(); i++) {
+        int_least64_t hits = devices[i]->get_hits();
+        int_least64_t misses = devices[i]->get_misses();
+        *csv << "," << hits << "," << misses << "," << hits - last_hits[i] << "," <<
+            misses - last_misses[i];
+        last_hits[i] = hits;
+        last_misses[i] = misses;
+        if (devices[i]->tracks_bandwidth()) {
+            int_least64_t fetched = devices[i]->get_bytes_fetched();
+            int_least64_t written = devices[i]->get_bytes_written();
+            *csv << "," << fetched - last_fetched[i] << "," << written - last_written[i];
+            last_fetched[i] = fetched;
+            last_written[i] = written;
+        }
+    }
+    *csv << std::endl;
+    if (bbv_file.is_open()) {
+        bbv_file << "T";
+        for (std::map<unsigned int, uint64_t>::iterator it = block_counts.begin();
+             it != block_counts.end(); ++it)
+            bbv_file << ":" << it->first << ":" << it->second << " ";
+        bbv_file << std::endl;
+        block_counts.clear();
+    }
+    ++intervals;
+    interval_count = 0;
+}
+
+void
+interval_stats_t::finish()
+{
+    if (interval_count > 0)
+        snapshot();
+}
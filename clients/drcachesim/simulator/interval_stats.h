@@ -0,0 +1,100 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* interval_stats: periodic snapshots of the simulated devices' counters.
+ */
+
+#ifndef _INTERVAL_STATS_H_
+#define _INTERVAL_STATS_H_ 1
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "caching_device_stats.h"
+#include "memref.h"
+
+// Every -interval_refs simulated references, writes one CSV row holding each
+// registered device's cumulative hits and misses along with those of the
+// interval just ended, followed for a device that tracks bandwidth (see
+// caching_device_stats_t::fetch()) by the bytes it fetched and wrote in the
+// interval.  Optionally also writes one basic block vector per
+// interval, in the format consumed by SimPoint, to find a program's phases.
+class interval_stats_t
+{
+ public:
+    explicit interval_stats_t(uint64_t interval_refs);
+    // An empty csv_path writes the rows to stderr; an empty bbv_path does not
+    // collect basic block vectors.
+    bool init(const std::string &csv_path, const std::string &bbv_path);
+    void add_device(const std::string &name, const caching_device_stats_t *stats);
+    // Called for each simulated (i.e., not warmup) memref, once it has been
+    // simulated.
+    void record(const memref_t &memref)
+    {
+        if (bbv_file.is_open() && memref.type == TRACE_TYPE_INSTR)
+            record_instr(memref);
+        if (++interval_count == interval_refs)
+            snapshot();
+    }
+    // Writes the final, partial interval, if any.
+    void finish();
+
+ private:
+    void record_instr(const memref_t &memref);
+    void snapshot();
+
+    uint64_t interval_refs;
+    uint64_t interval_count;
+    uint64_t total_refs;
+    uint64_t intervals;
+    bool header_written;
+
+    std::ofstream csv_file;
+    std::ostream *csv;
+    std::vector<std::string> names;
+    std::vector<const caching_device_stats_t *> devices;
+    std::vector<int_least64_t> last_hits;
+    std::vector<int_least64_t> last_misses;
+    std::vector<int_least64_t> last_fetched;
+    std::vector<int_least64_t> last_written;
+
+    // For the basic block vectors.  A block starts at any instruction that
+    // does not directly follow its thread's previous one.  Ids start at 1.
+    std::ofstream bbv_file;
+    std::map<addr_t, unsigned int> block_ids;
+    std::map<unsigned int, uint64_t> block_counts;
+    std::map<memref_tid_t, addr_t> next_pc;
+    unsigned int cur_block;
+};
+
+#endif /* _INTERVAL_STATS_H_ */
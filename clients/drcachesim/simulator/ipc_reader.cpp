@@ -31,26 +31,37 @@
  */
 
 #include <assert.h>
-#include <map>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sstream>
 #include "memref.h"
 #include "ipc_reader.h"
 #include "utils.h"
+#include "../common/trace_compress.h"
 
-#ifdef VERBOSE
-# include <iostream>
-#endif
+// For -thread_pipes: how many times we poll for an older buffer before we
+// deliver a newer one anyway.  Threads that are blocked in the application
+// may not produce their next buffer for a long time.
+#define MERGE_WAIT_POLLS 200
+#define MERGE_POLL_USEC 10
+#define CHANNEL_INIT_SIZE (256*1024)
 
-#define BOOLS_MATCH(b1, b2) (!!(b1) == !!(b2))
-
-ipc_reader_t::ipc_reader_t()
+ipc_reader_t::ipc_reader_t() :
+    thread_pipes(false), compressed(false), main_eof(false), cur_channel(-1),
+    announce_bytes(0), wire_start(0), wire_end(0)
 {
     // Following typical stream iterator convention, the default constructor
     // produces an EOF object.
     at_eof = true;
 }
 
-ipc_reader_t::ipc_reader_t(const char *ipc_name) :
-    pipe(ipc_name), cur_tid(0), cur_pid(0), cur_pc(0), bundle_idx(0)
+ipc_reader_t::ipc_reader_t(const char *ipc_name_, bool thread_pipes_,
+                           bool compressed_) :
+    pipe(ipc_name_), ipc_name(ipc_name_), thread_pipes(thread_pipes_),
+    compressed(compressed_ && !thread_pipes_), main_eof(false), cur_channel(-1),
+    announce_bytes(0), wire_start(0), wire_end(0)
 {
     at_eof = true;
 }
@@ -63,158 +74,267 @@ ipc_reader_t::init()
         !pipe.open_for_read())
         return false;
     pipe.maximize_buffer();
-    cur_buf = buf;
-    end_buf = buf;
+    // Once the first writer has connected, we poll the shared pipe for new
+    // threads in between reading from the per-thread pipes.
+    if (thread_pipes && !pipe.set_nonblocking())
+        return false;
     ++*this;
     return true;
 }
 
 ipc_reader_t::~ipc_reader_t()
 {
+    for (std::vector<channel_t>::iterator chan = channels.begin();
+         chan != channels.end(); ++chan) {
+        if (chan->pipe != NULL)
+            close_channel(*chan);
+    }
     pipe.close();
     pipe.destroy();
 }
 
-const memref_t&
-ipc_reader_t::operator*()
+trace_entry_t *
+ipc_reader_t::read_next_entry()
 {
-    return cur_ref;
+    if (thread_pipes)
+        return read_next_merged_entry();
+    if (compressed)
+        return read_next_chunk();
+    // The base class hands out the rest of buf before calling us again.
+    ssize_t sz = pipe.read(buf, sizeof(buf)); // blocking read
+    if (sz <= 0 || sz % sizeof(buf[0]) != 0) {
+        at_eof = true;
+        return NULL;
+    }
+    batch_cur = buf + 1;
+    batch_end = buf + (sz / sizeof(buf[0]));
+    return buf;
 }
 
-bool
-ipc_reader_t::operator==(const ipc_reader_t& rhs)
+trace_entry_t *
+ipc_reader_t::read_next_chunk()
 {
-    return BOOLS_MATCH(rhs.at_eof, at_eof);
+    // As in read_next_entry(), the base class hands out the rest of buf.
+    while (true) {
+        trace_chunk_header_t header;
+        size_t avail = wire_end - wire_start;
+        if (avail >= sizeof(header)) {
+            memcpy(&header, wire_buf + wire_start, sizeof(header));
+            if (header.magic != TRACE_CHUNK_MAGIC || header.num_entries > BUF_SIZE ||
+                sizeof(header) + header.encoded_size > sizeof(wire_buf)) {
+                ERROR("Invalid compressed trace data\n");
+                at_eof = true;
+                return NULL;
+            }
+            if (avail >= sizeof(header) + header.encoded_size) {
+                if (!trace_decompress_chunk(&header,
+                                            wire_buf + wire_start + sizeof(header),
+                                            buf)) {
+                    ERROR("Invalid compressed trace data\n");
+                    at_eof = true;
+                    return NULL;
+                }
+                wire_start += sizeof(header) + header.encoded_size;
+                if (header.num_entries == 0)
+                    continue;
+                batch_cur = buf + 1;
+                batch_end = buf + header.num_entries;
+                return buf;
+            }
+        }
+        // Keep the partial chunk and read more after it.
+        memmove(wire_buf, wire_buf + wire_start, avail);
+        wire_start = 0;
+        wire_end = avail;
+        ssize_t sz = pipe.read(wire_buf + wire_end, sizeof(wire_buf) - wire_end);
+        if (sz <= 0) {
+            at_eof = true;
+            return NULL;
+        }
+        wire_end += sz;
+    }
 }
 
 bool
-ipc_reader_t::operator!=(const ipc_reader_t& rhs)
+ipc_reader_t::open_channel(memref_tid_t tid)
+{
+    std::ostringstream name;
+    name << ipc_name << THREAD_PIPE_SUFFIX << tid;
+    channel_t chan;
+    chan.pipe = new named_pipe_t(name.str().c_str());
+    // The tracer created the pipe before announcing the thread.  This blocks
+    // until the thread opens its end, which it does right after announcing.
+    if (!chan.pipe->open_for_read()) {
+        ERROR("Failed to open pipe for thread %d\n", (int)tid);
+        delete chan.pipe;
+        return false;
+    }
+    chan.pipe->maximize_buffer();
+    chan.pipe->set_nonblocking();
+    chan.capacity = CHANNEL_INIT_SIZE;
+    chan.buf = (char *) malloc(chan.capacity);
+    // We start the channel with the announcement itself, so the reader
+    // learns the thread's process before any of its buffers.
+    memcpy(chan.buf, announce_buf, sizeof(announce_buf));
+    chan.start = 0;
+    chan.end = sizeof(announce_buf);
+    chan.scanned = 0;
+    chan.buffer_end = 0;
+    chan.eof = false;
+    chan.last_timestamp = 0;
+    chan.stalled = false;
+    channels.push_back(chan);
+    return true;
+}
+
+void
+ipc_reader_t::close_channel(channel_t &chan)
 {
-    return !BOOLS_MATCH(rhs.at_eof, at_eof);
+    chan.pipe->destroy();
+    delete chan.pipe;
+    chan.pipe = NULL;
+    free(chan.buf);
+    chan.buf = NULL;
 }
 
-reader_t
-ipc_reader_t::operator++(int)
+void
+ipc_reader_t::poll_new_threads()
 {
-    ipc_reader_t tmp = *this;
-    ++*this;
-    return tmp;
+    // Each thread announces itself with a thread entry and a process entry.
+    while (!main_eof) {
+        ssize_t sz = pipe.read((char *)announce_buf + announce_bytes,
+                               sizeof(announce_buf) - announce_bytes);
+        if (sz < 0) {
+            // All writer processes have closed the shared pipe.
+            main_eof = true;
+            break;
+        }
+        if (sz == 0)
+            break;
+        announce_bytes += sz;
+        if (announce_bytes < sizeof(announce_buf))
+            continue;
+        announce_bytes = 0;
+        if (announce_buf[0].type != TRACE_TYPE_THREAD ||
+            announce_buf[1].type != TRACE_TYPE_PID) {
+            ERROR("Invalid thread announcement\n");
+            continue;
+        }
+        open_channel((memref_tid_t)announce_buf[0].addr);
+    }
+}
+
+void
+ipc_reader_t::fill_channel(channel_t &chan)
+{
+    if (chan.eof)
+        return;
+    if (chan.start > 0 && chan.start == chan.end) {
+        chan.start = chan.end = chan.scanned = 0;
+    } else if (chan.end == chan.capacity) {
+        if (chan.start > 0) {
+            memmove(chan.buf, chan.buf + chan.start, chan.end - chan.start);
+            chan.end -= chan.start;
+            chan.scanned -= chan.start;
+            chan.start = 0;
+        } else {
+            // A single buffer is larger than we can hold.
+            chan.capacity *= 2;
+            chan.buf = (char *) realloc(chan.buf, chan.capacity);
+        }
+    }
+    ssize_t sz = chan.pipe->read(chan.buf + chan.end, chan.capacity - chan.end);
+    if (sz < 0)
+        chan.eof = true;
+    else
+        chan.end += sz;
 }
 
-reader_t&
-ipc_reader_t::operator++()
+bool
+ipc_reader_t::complete_buffer(channel_t &chan, uint64_t *timestamp OUT)
 {
-    // If we ever switch to separate IPC buffers per application thread,
-    // we'd do the merging and timestamp ordering here.
+    size_t avail = (chan.end - chan.start) / sizeof(trace_entry_t);
+    if (avail == 0)
+        return false;
+    trace_entry_t *entry = (trace_entry_t *)(chan.buf + chan.start);
+    // Look for the thread entry that starts the next buffer.
+    size_t i = (chan.scanned > chan.start) ?
+        (chan.scanned - chan.start) / sizeof(trace_entry_t) : 1;
+    for (; i < avail; i++) {
+        if (entry[i].type == TRACE_TYPE_THREAD)
+            break;
+    }
+    chan.scanned = chan.start + i * sizeof(trace_entry_t);
+    if (i == avail && !chan.eof)
+        return false;
+    chan.buffer_end = chan.scanned;
+    if (avail > 1 && entry[1].type == TRACE_TYPE_TIMESTAMP)
+        *timestamp = (uint64_t) entry[1].addr;
+    else
+        *timestamp = chan.last_timestamp;
+    return true;
+}
 
-    // We bail if we get a partial read, or EOF, or any error.
+trace_entry_t *
+ipc_reader_t::read_next_merged_entry()
+{
+    if (cur_channel >= 0) {
+        channel_t &chan = channels[cur_channel];
+        chan.start += sizeof(trace_entry_t);
+        if (chan.start < chan.buffer_end)
+            return (trace_entry_t *)(chan.buf + chan.start);
+        cur_channel = -1;
+    }
+    // We are at a buffer boundary: pick the oldest complete buffer, waiting
+    // a little for threads that might still produce an older one.
+    int polls = 0;
     while (true) {
-        if (bundle_idx == 0/*not in instr bundle*/) {
-            if (cur_buf >= end_buf) {
-                ssize_t sz = pipe.read(buf, sizeof(buf)); // blocking read
-                if (sz < 0 || sz % sizeof(*end_buf) != 0) {
-                    at_eof = true;
-                    break;
+        poll_new_threads();
+        int best = -1;
+        uint64_t best_timestamp = 0;
+        uint64_t pending_bound = ~(uint64_t)0;
+        bool any_open = false;
+        for (size_t i = 0; i < channels.size(); i++) {
+            channel_t &chan = channels[i];
+            if (chan.pipe == NULL)
+                continue;
+            fill_channel(chan);
+            uint64_t timestamp;
+            if (complete_buffer(chan, &timestamp)) {
+                chan.stalled = false;
+                if (best < 0 || timestamp < best_timestamp) {
+                    best = (int)i;
+                    best_timestamp = timestamp;
                 }
-                cur_buf = buf;
-                end_buf = buf + (sz / sizeof(*end_buf));
-            } else
-                cur_buf++;
+            } else if (chan.eof && chan.start == chan.end) {
+                close_channel(chan);
+                continue;
+            } else if (!chan.stalled && chan.last_timestamp < pending_bound)
+                pending_bound = chan.last_timestamp;
+            any_open = true;
         }
-        if (cur_buf < end_buf) {
-#ifdef VERBOSE
-            std::cerr << "RECV: " << cur_buf->type << " sz=" << cur_buf->size <<
-                " addr=" << (void *)cur_buf->addr << std::endl;
-#endif
-            bool have_memref = false;
-            switch (cur_buf->type) {
-            case TRACE_TYPE_READ:
-            case TRACE_TYPE_WRITE:
-            case TRACE_TYPE_PREFETCH:
-            case TRACE_TYPE_PREFETCHT0:
-            case TRACE_TYPE_PREFETCHT1:
-            case TRACE_TYPE_PREFETCHT2:
-            case TRACE_TYPE_PREFETCHNTA:
-            case TRACE_TYPE_PREFETCH_READ:
-            case TRACE_TYPE_PREFETCH_WRITE:
-            case TRACE_TYPE_PREFETCH_INSTR:
-                have_memref = true;
-                cur_ref.pid = cur_pid;
-                cur_ref.tid = cur_tid;
-                cur_ref.type = cur_buf->type;
-                cur_ref.size = cur_buf->size;
-                cur_ref.addr = cur_buf->addr;
-                // The trace stream always has the instr fetch first, which we
-                // use to obtain the PC for subsequent data references.
-                cur_ref.pc = cur_pc;
-                break;
-            case TRACE_TYPE_INSTR:
-                have_memref = true;
-                cur_ref.pid = cur_pid;
-                cur_ref.tid = cur_tid;
-                cur_ref.type = cur_buf->type;
-                cur_ref.size = cur_buf->size;
-                cur_pc = cur_buf->addr;
-                cur_ref.addr = cur_pc;
-                cur_ref.pc = cur_pc;
-                next_pc = cur_pc + cur_ref.size;
-                break;
-            case TRACE_TYPE_INSTR_BUNDLE:
-                have_memref = true;
-                // The trace stream always has the instr fetch first, which we
-                // use to compute the starting PC for the subsequent instructions.
-                cur_ref.size = cur_buf->length[bundle_idx++];
-                cur_pc = next_pc;
-                cur_ref.pc = cur_pc;
-                cur_ref.addr = cur_pc;
-                next_pc = cur_pc + cur_ref.size;
-                // cur_buf->size stores the number of instrs in this bundle
-                assert(cur_buf->size <= sizeof(cur_buf->length));
-                if (bundle_idx == cur_buf->size)
-                    bundle_idx = 0;
-                break;
-            case TRACE_TYPE_INSTR_FLUSH:
-            case TRACE_TYPE_DATA_FLUSH:
-                cur_ref.pid = cur_pid;
-                cur_ref.tid = cur_tid;
-                cur_ref.type = cur_buf->type;
-                cur_ref.size = cur_buf->size;
-                cur_ref.addr = cur_buf->addr;
-                if (cur_ref.size != 0)
-                    have_memref = true;
-                break;
-            case TRACE_TYPE_INSTR_FLUSH_END:
-            case TRACE_TYPE_DATA_FLUSH_END:
-                cur_ref.size = cur_buf->addr - cur_ref.addr;
-                have_memref = true;
-                break;
-            case TRACE_TYPE_THREAD:
-                cur_tid = (memref_tid_t) cur_buf->addr;
-                cur_pid = tid2pid[cur_tid];
-                break;
-            case TRACE_TYPE_THREAD_EXIT:
-                cur_tid = (memref_tid_t) cur_buf->addr;
-                cur_pid = tid2pid[cur_tid];
-                // We do pass this to the caller but only some fields are valid:
-                cur_ref.pid = cur_pid;
-                cur_ref.tid = cur_tid;
-                cur_ref.type = cur_buf->type;
-                have_memref = true;
-                break;
-            case TRACE_TYPE_PID:
-                // We do want to replace, in case of tid reuse.
-                tid2pid[cur_tid] = (memref_pid_t) cur_buf->addr;
-                break;
-            default:
-                ERROR("Unknown trace entry type %d\n", cur_buf->type);
-                assert(false);
-                at_eof = true; // bail
-                break;
+        if (best >= 0 && (best_timestamp <= pending_bound || polls >= MERGE_WAIT_POLLS)) {
+            if (polls >= MERGE_WAIT_POLLS) {
+                // Stop waiting for these until they produce data.
+                for (size_t i = 0; i < channels.size(); i++) {
+                    if (channels[i].pipe != NULL && (int)i != best &&
+                        channels[i].last_timestamp < best_timestamp)
+                        channels[i].stalled = true;
+                }
             }
-            if (have_memref)
-                break;
+            channel_t &chan = channels[best];
+            chan.last_timestamp = best_timestamp;
+            cur_channel = best;
+            return (trace_entry_t *)(chan.buf + chan.start);
         }
+        if (!any_open && main_eof) {
+            at_eof = true;
+            return NULL;
+        }
+        ++polls;
+        if (polls < MERGE_WAIT_POLLS)
+            sched_yield();
+        else
+            usleep(MERGE_POLL_USEC);
     }
-
-    return *this;
 }
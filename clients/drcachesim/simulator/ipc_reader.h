@@ -38,39 +38,73 @@
 #ifndef _IPC_READER_H_
 #define _IPC_READER_H_ 1
 
-#include <list>
 #include <string>
-#include <map>
+#include <vector>
 #include "memref.h"
 #include "reader.h"
 #include "../common/named_pipe.h"
 #include "../common/trace_entry.h"
 
+// By default all application threads share one pipe.  With thread_pipes,
+// the shared pipe only announces new threads, each thread sends its buffers
+// over its own pipe, and we merge the per-thread streams one buffer at a time
+// in timestamp order.
 class ipc_reader_t : public reader_t
 {
  public:
     ipc_reader_t();
-    explicit ipc_reader_t(const char *ipc_name);
+    // With "compressed", the shared pipe carries trace_compress.h chunks.
+    // It is ignored with thread_pipes.
+    ipc_reader_t(const char *ipc_name, bool thread_pipes = false,
+                 bool compressed = false);
     virtual ~ipc_reader_t();
-    bool init();
-    virtual const memref_t& operator*();
-    virtual bool operator==(const ipc_reader_t& rhs);
-    virtual bool operator!=(const ipc_reader_t& rhs);
-    virtual reader_t operator++(int);
-    virtual reader_t& operator++();
+    virtual bool init();
 
-    void stream_server();
+ protected:
+    virtual trace_entry_t * read_next_entry();
 
  private:
-    bool at_eof;
+    trace_entry_t * read_next_merged_entry();
+    trace_entry_t * read_next_chunk();
+    void poll_new_threads();
+    bool open_channel(memref_tid_t tid);
+
+    // A per-thread pipe with its own buffering.  Reads may end in the middle
+    // of an entry, so we track bytes.
+    struct channel_t {
+        named_pipe_t *pipe;
+        char *buf;
+        size_t capacity;
+        size_t start;      // offset of the next unconsumed byte
+        size_t end;        // offset past the last byte read
+        size_t scanned;    // how far we have looked for the next buffer's start
+        size_t buffer_end; // end of the buffer being delivered
+        bool eof;
+        // A buffer is never older than the timestamp of the last one we took
+        // from this thread, which bounds what a channel with no data yet
+        // could still deliver.
+        uint64_t last_timestamp;
+        // Set once we gave up waiting on this channel, until it has data again.
+        bool stalled;
+    };
+    // Reads whatever data is available without blocking.
+    void fill_channel(channel_t &chan);
+    // Returns whether the channel holds a complete buffer: one followed by the
+    // start of the next buffer or by EOF.  If so, returns its timestamp and
+    // sets chan.buffer_end.
+    bool complete_buffer(channel_t &chan, uint64_t *timestamp OUT);
+    void close_channel(channel_t &chan);
+
     named_pipe_t pipe;
-    memref_t cur_ref;
-    memref_tid_t cur_tid;
-    memref_pid_t cur_pid;
-    addr_t cur_pc;
-    addr_t next_pc;
-    int bundle_idx;
-    std::map<memref_tid_t, memref_pid_t> tid2pid;
+    std::string ipc_name;
+    bool thread_pipes;
+    bool compressed;
+    bool main_eof;
+    std::vector<channel_t> channels;
+    int cur_channel; // -1 when at a buffer boundary
+    // The shared pipe's stream, which may be read partway through an entry.
+    trace_entry_t announce_buf[2];
+    size_t announce_bytes;
 
     // For efficiency we want to read large chunks at a time.
     // The atomic write size for a pipe on Linux is 4096 bytes but
@@ -78,8 +112,13 @@ class ipc_reader_t : public reader_t
     // time.
     static const int BUF_SIZE = 16*1024;
     trace_entry_t buf[BUF_SIZE];
-    trace_entry_t *cur_buf;
-    trace_entry_t *end_buf;
+
+    // For compressed: the bytes read from the pipe, which need not end on a
+    // chunk boundary.  Each chunk is at most one atomic write.
+    static const int WIRE_BUF_SIZE = 64*1024;
+    unsigned char wire_buf[WIRE_BUF_SIZE];
+    size_t wire_start;
+    size_t wire_end;
 };
 
 #endif /* _IPC_READER_H_ */
@@ -44,10 +44,12 @@
 #else
 # include <sys/types.h>
 # include <sys/wait.h>
+# include <unistd.h>
 #endif
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include <iostream>
 #include "dr_api.h"
 #include "dr_inject.h"
@@ -56,7 +58,14 @@
 #include "droption.h"
 #include "../common/options.h"
 #include "cache_simulator.h"
+#include "multi_simulator.h"
 #include "tlb_simulator.h"
+#include "cache_tlb_simulator.h"
+#include "stack_distance_simulator.h"
+#include "reuse_distance_simulator.h"
+#include "access_pattern_simulator.h"
+#include "false_sharing_simulator.h"
+#include "branch_predictor_simulator.h"
 #include "utils.h"
 
 #define FATAL_ERROR(msg, ...) do { \
@@ -89,13 +98,42 @@ get_full_path(const char *app, char *buf, size_t buflen/*# elements*/)
         FATAL_ERROR("drfront_get_app_full_path failed on %s: %d\n", app, sc);
 }
 
+static bool
+register_application(void *inject_data, std::string tracer_ops)
+{
+    char *process;
+    process_id_t pid;
+
+    pid = dr_inject_get_process_id(inject_data);
+
+    process = dr_inject_get_image_name(inject_data);
+    NOTIFY(1, "INFO", "configuring %s pid=%d dr_ops=\"%s\"", process, pid,
+           op_dr_ops.get_value().c_str());
+    if (dr_register_process(process, pid,
+                            false/*local*/, op_dr_root.get_value().c_str(),
+                            DR_MODE_CODE_MANIPULATION,
+                            op_dr_debug.get_value(), DR_PLATFORM_DEFAULT,
+                            op_dr_ops.get_value().c_str()) != DR_SUCCESS) {
+        FATAL_ERROR("failed to register DynamoRIO configuration");
+        return false;
+    }
+    NOTIFY(1, "INFO", "configuring client \"%s\" ops=\"%s\"",
+           op_tracer.get_value().c_str(), tracer_ops.c_str());
+    if (dr_register_client(process, pid,
+                           false/*local*/, DR_PLATFORM_DEFAULT, CLIENT_ID,
+                           0, op_tracer.get_value().c_str(),
+                           tracer_ops.c_str()) != DR_SUCCESS) {
+        FATAL_ERROR("failed to register DynamoRIO client configuration");
+        return false;
+    }
+    return true;
+}
+
 static bool
 configure_application(char *app_name, char **app_argv,
                       std::string tracer_ops, void **inject_data)
 {
     int errcode;
-    char *process;
-    process_id_t pid;
 
 #ifdef UNIX
     errcode = dr_inject_prepare_to_exec(app_name, (const char **)app_argv, inject_data);
@@ -116,30 +154,92 @@ configure_application(char *app_name, char **app_argv,
         FATAL_ERROR("%s", msg.c_str());
         return false;
     }
+    return register_application(*inject_data, tracer_ops);
+}
 
-    pid = dr_inject_get_process_id(*inject_data);
+#ifdef LINUX
+// Injects into the running process pid and traces it for the -attach_for_ms
+// window, if any.  This is run in a child of the front end, as the tracer's
+// initialization in the target waits for the simulator to open the pipe.
+static void
+attach_to_process(process_id_t pid, std::string tracer_ops)
+{
+    void *inject_data;
+    int errcode = dr_inject_process_attach(pid, &inject_data);
+    if (errcode == WARN_IMAGE_MACHINE_TYPE_MISMATCH_EXE) {
+        FATAL_ERROR("process %d has bitwidth unsupported by this launcher", pid);
+        assert(false); // won't get here
+    } else if (errcode != 0) {
+        FATAL_ERROR("failed to attach to process %d: %s", pid, strerror(errcode));
+        assert(false); // won't get here
+    }
+    if (!register_application(inject_data, tracer_ops) ||
+        !dr_inject_process_inject(inject_data, false/*!force*/, NULL) ||
+        !dr_inject_process_run(inject_data)) {
+        FATAL_ERROR("unable to inject into process %d", pid);
+        assert(false); // won't get here
+    }
+    NOTIFY(1, "INFO", "attached to process %d", pid);
+    if (op_attach_for_ms.get_value() > 0) {
+        // Under -trace_on_demand each nudge switches tracing on or off.
+        if (dr_nudge_pid(pid, CLIENT_ID, 0, 0) != DR_SUCCESS)
+            FATAL_ERROR("failed to start tracing process %d", pid);
+        usleep(op_attach_for_ms.get_value() * 1000);
+        if (dr_nudge_pid(pid, CLIENT_ID, 0, 0) != DR_SUCCESS)
+            FATAL_ERROR("failed to stop tracing process %d", pid);
+        NOTIFY(1, "INFO", "stopped tracing process %d", pid);
+    }
+    dr_inject_process_exit(inject_data, false/*leave it running*/);
+}
+#endif
 
-    process = dr_inject_get_image_name(*inject_data);
-    NOTIFY(1, "INFO", "configuring %s pid=%d dr_ops=\"%s\"", process, pid,
-           op_dr_ops.get_value().c_str());
-    if (dr_register_process(process, pid,
-                            false/*local*/, op_dr_root.get_value().c_str(),
-                            DR_MODE_CODE_MANIPULATION,
-                            op_dr_debug.get_value(), DR_PLATFORM_DEFAULT,
-                            op_dr_ops.get_value().c_str()) != DR_SUCCESS) {
-        FATAL_ERROR("failed to register DynamoRIO configuration");
-        return false;
+static simulator_t *
+create_simulator()
+{
+    simulator_t *simulator;
+    if (op_L0_filter.get_value() && op_simulator_type.get_value() != CPU_CACHE) {
+        FATAL_ERROR("Usage error: -L0_filter is only supported by the " CPU_CACHE
+                    " simulator.");
+        return NULL;
     }
-    NOTIFY(1, "INFO", "configuring client \"%s\" ops=\"%s\"",
-           op_tracer.get_value().c_str(), tracer_ops.c_str());
-    if (dr_register_client(process, pid,
-                           false/*local*/, DR_PLATFORM_DEFAULT, CLIENT_ID,
-                           0, op_tracer.get_value().c_str(),
-                           tracer_ops.c_str()) != DR_SUCCESS) {
-        FATAL_ERROR("failed to register DynamoRIO client configuration");
-        return false;
+    if (!op_config_files.get_value().empty() &&
+        op_simulator_type.get_value() != CPU_CACHE) {
+        FATAL_ERROR("Usage error: -config_files is only supported by the " CPU_CACHE
+                    " simulator.");
+        return NULL;
     }
-    return true;
+    // declare the simulator based on its type
+    if (op_simulator_type.get_value() == CPU_CACHE &&
+        !op_config_files.get_value().empty())
+        simulator = new multi_simulator_t;
+    else if (op_simulator_type.get_value() == CPU_CACHE)
+        simulator = new cache_simulator_t;
+    else if (op_simulator_type.get_value() == TLB)
+        simulator = new tlb_simulator_t;
+    else if (op_simulator_type.get_value() == CACHE_TLB)
+        simulator = new cache_tlb_simulator_t;
+    else if (op_simulator_type.get_value() == STACK_DISTANCE)
+        simulator = new stack_distance_simulator_t;
+    else if (op_simulator_type.get_value() == REUSE_DISTANCE)
+        simulator = new reuse_distance_simulator_t;
+    else if (op_simulator_type.get_value() == ACCESS_PATTERN)
+        simulator = new access_pattern_simulator_t;
+    else if (op_simulator_type.get_value() == FALSE_SHARING)
+        simulator = new false_sharing_simulator_t;
+    else if (op_simulator_type.get_value() == BRANCH_PREDICTOR)
+        simulator = new branch_predictor_simulator_t;
+    else {
+        FATAL_ERROR("Usage error: unsupported simulator type. "
+                    "Please choose " CPU_CACHE ", " TLB ", " CACHE_TLB ", "
+                    STACK_DISTANCE ", " REUSE_DISTANCE ", " ACCESS_PATTERN ", "
+                    FALSE_SHARING ", or " BRANCH_PREDICTOR ".");
+        return NULL;
+    }
+    if (!simulator->init()) {
+        FATAL_ERROR("failed to initialize simulator");
+        assert(false); // won't get here
+    }
+    return simulator;
 }
 
 int
@@ -187,6 +287,71 @@ _tmain(int argc, const TCHAR *targv[])
         }
     }
 
+    if (!op_infile.get_value().empty()) {
+        // Offline simulation of a recorded trace: there is no application
+        // to launch.
+        simulator = create_simulator();
+        if (!simulator->run()) {
+            FATAL_ERROR("failed to run simulator");
+            assert(false); // won't get here
+        }
+        simulator->print_stats();
+        delete simulator;
+        sc = drfront_cleanup_args(argv, argc);
+        if (sc != DRFRONT_SUCCESS)
+            FATAL_ERROR("drfront_cleanup_args failed: %d\n", sc);
+        return 0;
+    }
+
+    if (op_attach.get_value() != 0) {
+#ifdef LINUX
+        // Trace a process that is already running: there is no application
+        // to launch, and it outlives us.
+        tracer_ops = op_tracer_ops.get_value();
+        if (op_attach_for_ms.get_value() > 0)
+            tracer_ops += " -trace_on_demand";
+        if (!file_is_readable(op_tracer.get_value().c_str())) {
+            FATAL_ERROR("tracer library %s is unreadable",
+                        op_tracer.get_value().c_str());
+            assert(false); // won't get here
+        }
+        if (!op_offline.get_value())
+            simulator = create_simulator();
+        pid_t attacher = fork();
+        if (attacher < 0) {
+            FATAL_ERROR("failed to fork");
+            assert(false); // won't get here
+        } else if (attacher == 0) {
+            attach_to_process(op_attach.get_value(), tracer_ops);
+            exit(0);
+        }
+        if (simulator != NULL) {
+            // The pipe stays open until the process exits.
+            if (!simulator->run()) {
+                FATAL_ERROR("failed to run simulator");
+                assert(false); // won't get here
+            }
+        }
+        waitpid(attacher, &errcode, 0);
+        if (errcode != 0)
+            FATAL_ERROR("failed to trace process %d", op_attach.get_value());
+        if (simulator != NULL) {
+            simulator->print_stats();
+            delete simulator;
+        } else {
+            NOTIFY(0, "INFO", "trace files for process %d are being written to %s",
+                   op_attach.get_value(), op_outdir.get_value().c_str());
+        }
+        sc = drfront_cleanup_args(argv, argc);
+        if (sc != DRFRONT_SUCCESS)
+            FATAL_ERROR("drfront_cleanup_args failed: %d\n", sc);
+        return 0;
+#else
+        FATAL_ERROR("Usage error: -attach is only supported on Linux");
+        assert(false); // won't get here
+#endif
+    }
+
     if (app_idx >= argc) {
         FATAL_ERROR("Usage error: no application specified\nUsage:\n%s",
                     droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
@@ -222,21 +387,10 @@ _tmain(int argc, const TCHAR *targv[])
         assert(false); // won't get here
     }
 
-    // declare the simulator based on its type
-    if (op_simulator_type.get_value() == CPU_CACHE)
-        simulator = new cache_simulator_t;
-    else if (op_simulator_type.get_value() == TLB)
-        simulator = new tlb_simulator_t;
-    else {
-        ERROR("Usage error: unsupported simulator type. "
-              "Please choose "CPU_CACHE" or "TLB".\n");
-        return false;
-    }
-
-    if (!simulator->init()) {
-        FATAL_ERROR("failed to initialize simulator");
-        assert(false); // won't get here
-    }
+    // In offline mode the tracer writes to files and we simply wait for
+    // the application to finish.
+    if (!op_offline.get_value())
+        simulator = create_simulator();
 
     tracer_ops = op_tracer_ops.get_value();
 
@@ -268,7 +422,7 @@ _tmain(int argc, const TCHAR *targv[])
     dr_inject_process_run(inject_data);
 #endif
 
-    if (!simulator->run()) {
+    if (simulator != NULL && !simulator->run()) {
         FATAL_ERROR("failed to run simulator");
         assert(false); // won't get here
     }
@@ -290,10 +444,14 @@ _tmain(int argc, const TCHAR *targv[])
     // XXX: we may want a prefix on our output
     std::cerr << "---- <application exited with code " << errcode <<
         "> ----" << std::endl;
-    simulator->print_stats();
-
-    // release simulator's space
-    delete simulator;
+    if (simulator != NULL) {
+        simulator->print_stats();
+        // release simulator's space
+        delete simulator;
+    } else {
+        NOTIFY(0, "INFO", "trace files written to %s",
+               op_outdir.get_value().c_str());
+    }
 
     sc = drfront_cleanup_args(argv, argc);
     if (sc != DRFRONT_SUCCESS)
@@ -0,0 +1,86 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <string.h>
+#include "memory_reader.h"
+
+bool
+memory_reader_t::init()
+{
+    pos = 0;
+    at_eof = (refs == NULL || refs->empty());
+    return true;
+}
+
+const memref_t&
+memory_reader_t::operator*()
+{
+    assert(!at_eof);
+    return (*refs)[pos];
+}
+
+reader_t&
+memory_reader_t::operator++()
+{
+    if (!at_eof && ++pos == refs->size())
+        at_eof = true;
+    return *this;
+}
+
+uint64_t
+memory_reader_t::skip_memrefs(uint64_t count)
+{
+    if (at_eof)
+        return 0;
+    uint64_t left = refs->size() - pos;
+    if (count >= left) {
+        count = left;
+        at_eof = true;
+    }
+    pos += (size_t)count;
+    return count;
+}
+
+size_t
+memory_reader_t::next_batch(memref_t *out, size_t max)
+{
+    if (at_eof)
+        return 0;
+    size_t count = refs->size() - pos;
+    if (count > max)
+        count = max;
+    memcpy(out, &(*refs)[pos], count * sizeof(*out));
+    pos += count;
+    if (pos == refs->size())
+        at_eof = true;
+    return count;
+}
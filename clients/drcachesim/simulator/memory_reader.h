@@ -0,0 +1,65 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* memory_reader: replays memrefs held in memory, for benchmarking the
+ * simulators without any i/o or trace decoding.
+ */
+
+#ifndef _MEMORY_READER_H_
+#define _MEMORY_READER_H_ 1
+
+#include <vector>
+#include "memref.h"
+#include "reader.h"
+
+// Presents the memrefs of a vector, which it does not own and which must
+// outlive it, in order.  As for the other readers, the default constructor
+// produces an EOF object.  init() restarts from the first memref, so a
+// reader can be replayed any number of times.
+class memory_reader_t : public reader_t
+{
+ public:
+    memory_reader_t() : refs(NULL), pos(0) {}
+    explicit memory_reader_t(const std::vector<memref_t> *refs_) :
+        refs(refs_), pos(0) {}
+    virtual bool init();
+    virtual const memref_t& operator*();
+    virtual reader_t& operator++();
+    virtual uint64_t skip_memrefs(uint64_t count);
+    virtual size_t next_batch(memref_t *out, size_t max);
+
+ private:
+    const std::vector<memref_t> *refs;
+    size_t pos;
+};
+
+#endif /* _MEMORY_READER_H_ */
@@ -54,7 +54,8 @@ typedef struct _memref_t {
     size_t size;
     addr_t addr;
 
-    // The pc field is only used for read, write, and prefetch entries.
+    // The pc field is only used for read, write, and prefetch entries, and
+    // holds the call site for TRACE_TYPE_ALLOC.
     // XXX: should we remove it from here and have the simulator compute it
     // from instr entries?  Though if the user turns off icache simulation
     // it may be better to keep it as a field here and have the reader
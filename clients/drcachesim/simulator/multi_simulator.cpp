@@ -0,0 +1,186 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <pthread.h>
+#include "utils.h"
+#include "droption.h"
+#include "../common/options.h"
+#include "multi_simulator.h"
+
+// Each simulator may lag the decoder by up to this many batches, beyond the
+// one it is reading.
+#define FANOUT_BATCHES 4
+#define FANOUT_BATCH_REFS (64*1024)
+
+bool
+multi_simulator_t::init()
+{
+    free_batches = NULL;
+    // We do not model cores: each configuration does so itself.
+    num_cores = 0;
+    thread_counts = NULL;
+    thread_ever_counts = NULL;
+
+    if (!op_config_file.get_value().empty()) {
+        ERROR("Usage error: -config_file and -config_files are exclusive.\n");
+        return false;
+    }
+    if (op_interval_refs.get_value() > 0) {
+        // The configurations would all write the same interval files.
+        ERROR("Usage error: -interval_refs is not supported with -config_files.\n");
+        return false;
+    }
+    if (!op_checkpoint_save.get_value().empty() ||
+        !op_checkpoint_load.get_value().empty()) {
+        // Likewise for the checkpoint file.
+        ERROR("Usage error: -checkpoint_save and -checkpoint_load are not supported "
+              "with -config_files.\n");
+        return false;
+    }
+    std::istringstream list(op_config_files.get_value());
+    std::string file;
+    while (std::getline(list, file, ',')) {
+        if (file.empty())
+            continue;
+        children.push_back(child_t());
+        children.back().config_file = file;
+    }
+    if (children.empty()) {
+        ERROR("Usage error: -config_files lists no files.\n");
+        return false;
+    }
+
+    if (!create_reader())
+        return false;
+
+    batches.resize(FANOUT_BATCHES + 1);
+    free_batches = new fanout_queue_t(batches.size());
+    for (size_t i = 0; i < batches.size(); i++) {
+        batches[i].refs = new memref_t[FANOUT_BATCH_REFS];
+        batches[i].count = 0;
+        batches[i].readers_left = 0;
+        free_batches->push(&batches[i]);
+    }
+    for (size_t i = 0; i < children.size(); i++) {
+        child_t &child = children[i];
+        child.queue = new fanout_queue_t(batches.size());
+        child.reader = new fanout_reader_t(child.queue, free_batches);
+        child.sim = new cache_simulator_t(child.config_file, child.reader,
+                                          new fanout_reader_t());
+        if (!child.sim->init())
+            return false;
+    }
+    return true;
+}
+
+multi_simulator_t::~multi_simulator_t()
+{
+    for (size_t i = 0; i < children.size(); i++) {
+        delete children[i].sim;
+        delete children[i].queue;
+    }
+    for (size_t i = 0; i < batches.size(); i++)
+        delete [] batches[i].refs;
+    delete free_batches;
+}
+
+void *
+multi_simulator_t::child_main(void *arg)
+{
+    child_t *child = (child_t *) arg;
+    child->ok = child->sim->run();
+    // Keep releasing batches so the decoder and the other simulators go on.
+    if (!child->ok)
+        child->reader->drain();
+    return NULL;
+}
+
+bool
+multi_simulator_t::run()
+{
+    if (!reader->init()) {
+        if (op_infile.get_value().empty())
+            ERROR("failed to read from pipe %s", op_ipc_name.get_value().c_str());
+        else
+            ERROR("failed to read from %s", op_infile.get_value().c_str());
+        return false;
+    }
+
+    // We skip once here so the simulators need not.
+    reader->skip_memrefs(op_skip_refs.get_value());
+
+    std::vector<pthread_t> threads(children.size());
+    for (size_t i = 0; i < children.size(); i++) {
+        if (pthread_create(&threads[i], NULL, child_main, &children[i]) != 0) {
+            // We can't return with other threads blocked on our queues.
+            ERROR("failed to create simulation thread");
+            exit(1);
+        }
+    }
+    // Every simulator applies -warmup_refs and -sim_refs itself, and we keep
+    // draining the reader so a live application isn't blocked, so we hand on
+    // the whole trace.
+    while (true) {
+        fanout_batch_t *batch = free_batches->pop();
+        batch->count = reader->next_batch(batch->refs, FANOUT_BATCH_REFS);
+        batch->readers_left = (int)children.size();
+        for (size_t i = 0; i < children.size(); i++)
+            children[i].queue->push(batch);
+        if (batch->count == 0)
+            break;
+    }
+
+    bool res = true;
+    for (size_t i = 0; i < children.size(); i++) {
+        pthread_join(threads[i], NULL);
+        if (!children[i].ok) {
+            ERROR("failed to simulate %s\n", children[i].config_file.c_str());
+            res = false;
+        }
+    }
+    return res;
+}
+
+bool
+multi_simulator_t::print_stats()
+{
+    for (size_t i = 0; i < children.size(); i++) {
+        std::cerr << "Configuration #" << i << ": " << children[i].config_file <<
+            std::endl;
+        if (!children[i].sim->print_stats())
+            return false;
+    }
+    return true;
+}
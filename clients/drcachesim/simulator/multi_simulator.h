@@ -0,0 +1,76 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* multi_simulator: simulates several cache hierarchies on one trace.
+ */
+
+#ifndef _MULTI_SIMULATOR_H_
+#define _MULTI_SIMULATOR_H_ 1
+
+#include <string>
+#include <vector>
+#include "simulator.h"
+#include "cache_simulator.h"
+#include "fanout_reader.h"
+
+// For -config_files: decodes the trace once and hands each batch of memrefs
+// to one cache_simulator_t per configuration, each on its own thread.  The
+// batches are shared read-only among the simulators, so comparing several
+// hierarchies takes one run of the application and one pass over the trace.
+// XXX i#1703: this is UNIX-only, like the rest of the simulator's
+// parallel mode.
+class multi_simulator_t : public simulator_t
+{
+ public:
+    virtual bool init();
+    virtual ~multi_simulator_t();
+    virtual bool run();
+    virtual bool print_stats();
+
+ protected:
+    struct child_t {
+        child_t() : sim(NULL), reader(NULL), queue(NULL), ok(false) {}
+        std::string config_file;
+        cache_simulator_t *sim;
+        // Owned by sim.
+        fanout_reader_t *reader;
+        fanout_queue_t *queue;
+        bool ok;
+    };
+    static void *child_main(void *arg);
+
+    std::vector<child_t> children;
+    std::vector<fanout_batch_t> batches;
+    fanout_queue_t *free_batches;
+};
+
+#endif /* _MULTI_SIMULATOR_H_ */
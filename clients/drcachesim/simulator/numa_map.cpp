@@ -0,0 +1,78 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <stdio.h>
+#include "utils.h"
+#include "numa_map.h"
+
+numa_map_t::numa_map_t() : num_nodes(0)
+{
+    last.start = 0;
+    last.end = 0;
+    last.node = -1;
+}
+
+bool
+numa_map_t::init(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == NULL) {
+        ERROR("Usage error: failed to open page node file %s\n", path.c_str());
+        return false;
+    }
+    char line[256];
+    int num = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f) != NULL) {
+        ++num;
+        unsigned long long start = 0, end = 0;
+        int node = -1;
+        int fields = sscanf(line, "%llx %llx %d", &start, &end, &node);
+        if (fields <= 0 || line[0] == '#')
+            continue;
+        if (fields < 3 || end <= start || node < 0) {
+            ERROR("Usage error: %s line %d: expected \"start end node\"\n",
+                  path.c_str(), num);
+            ok = false;
+            continue;
+        }
+        range_t range;
+        range.start = (addr_t)start;
+        range.end = (addr_t)end;
+        range.node = node;
+        ranges[range.start] = range;
+        if (node >= num_nodes)
+            num_nodes = node + 1;
+    }
+    fclose(f);
+    return ok;
+}
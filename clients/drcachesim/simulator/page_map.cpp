@@ -30,54 +30,56 @@
  * DAMAGE.
  */
 
-#include "cache_fifo.h"
+#include <ctype.h>
+#include <stdio.h>
+#include "utils.h"
+#include "page_map.h"
 
-// For the FIFO/Round-Robin implementation, all the cache blocks in a set are organized
-// as a FIFO. The counters of a set of blocks simulate the replacement pointer.
-// The counter of the victim block is 1, and others are 0.
-// While replacing happens, the victim block will be replaced and its counter will
-// be cleared. The counter of the next block will be set to 1.
+page_map_t::page_map_t(int default_bits_) : default_bits(default_bits_)
+{
+    last.start = 0;
+    last.end = 0;
+    last.bits = default_bits;
+}
 
 bool
-cache_fifo_t::init(int associativity_, int block_size_, int total_size,
-                   caching_device_t *parent_, caching_device_stats_t *stats_)
+page_map_t::init(const std::string &path)
 {
-    // Works in the same way as the base class,
-    // except that the counters are initialized in a different way.
-
-    bool ret_val = cache_t::init(associativity_, block_size_, total_size,
-                                 parent_, stats_);
-    if (ret_val == false)
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == NULL) {
+        ERROR("Usage error: failed to open page size file %s\n", path.c_str());
         return false;
-
-    // Create a replacement pointer for each set, and
-    // initialize it to point to the first block.
-    for (int i = 0; i < blocks_per_set; i++) {
-        get_caching_device_block(i << assoc_bits, 0).counter = 1;
     }
-    return true;
-}
-
-void
-cache_fifo_t::access_update(int block_idx, int way)
-{
-    // Since the FIFO replacement policy is independent of cache hit,
-    // we do not need to do anything here.
-    return;
-}
-
-int
-cache_fifo_t::replace_which_way(int block_idx)
-{
-    // We replace the block whose counter is 1.
-    for (int i = 0; i < associativity; i++) {
-        if (get_caching_device_block(block_idx, i).counter == 1) {
-            // clear the counter of the victim block
-            get_caching_device_block(block_idx, i).counter = 0;
-            // set the next block as victim
-            get_caching_device_block(block_idx, (i + 1) & (associativity - 1)).counter = 1;
-            return i;
+    char line[256];
+    int num = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f) != NULL) {
+        ++num;
+        unsigned long long start = 0, end = 0, size = 0;
+        char suffix[2] = "";
+        int fields = sscanf(line, "%llx %llx %llu%1s", &start, &end, &size, suffix);
+        if (fields <= 0 || line[0] == '#')
+            continue;
+        // We accept the same K, M, and G suffixes as size options.
+        switch (toupper(suffix[0])) {
+        case 'K': size *= 1024; break;
+        case 'M': size *= 1024*1024; break;
+        case 'G': size *= 1024*1024*1024; break;
+        case '\0': break;
+        default: size = 0;
         }
+        range_t range;
+        range.start = (addr_t)start;
+        range.end = (addr_t)end;
+        range.bits = size > (1ULL << 30) ? -1 : compute_log2((int)size);
+        if (fields < 3 || range.bits < 0 || end <= start ||
+            range.start % size != 0 || range.end % size != 0) {
+            ERROR("Usage error: %s line %d: expected page-aligned \"start end size\" "
+                  "with a power-of-2 size\n", path.c_str(), num);
+            ok = false;
+        } else if (range.bits != default_bits)
+            ranges[range.start] = range;
     }
-    return -1;
+    fclose(f);
+    return ok;
 }
@@ -0,0 +1,80 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* page_map: the size of the page holding each address.
+ */
+
+#ifndef _PAGE_MAP_H_
+#define _PAGE_MAP_H_ 1
+
+#include <map>
+#include <string>
+#include "memref.h"
+
+// Maps address ranges to the pages that hold them, for -page_size_file.
+// Addresses outside every range are in pages of the default size.
+class page_map_t
+{
+ public:
+    explicit page_map_t(int default_bits);
+    // Reads "start end size" lines, with end exclusive, from path.
+    bool init(const std::string &path);
+    int get_default_bits() const { return default_bits; }
+    // Returns log2 of the size of the page holding addr.
+    int page_bits(addr_t addr)
+    {
+        if (addr - last.start < last.end - last.start)
+            return last.bits;
+        std::map<addr_t, range_t>::const_iterator it = ranges.upper_bound(addr);
+        if (it == ranges.begin())
+            return default_bits;
+        --it;
+        if (addr >= it->second.end)
+            return default_bits;
+        last = it->second;
+        return last.bits;
+    }
+
+ private:
+    struct range_t {
+        addr_t start;
+        addr_t end;
+        int bits;
+    };
+    // Keyed by start.
+    std::map<addr_t, range_t> ranges;
+    int default_bits;
+    // Optimization: the range of the last lookup, which is empty at first.
+    range_t last;
+};
+
+#endif /* _PAGE_MAP_H_ */
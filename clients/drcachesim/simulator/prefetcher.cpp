@@ -0,0 +1,154 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "caching_device.h"
+#include "prefetcher.h"
+#include "../common/trace_entry.h"
+
+void
+prefetcher_t::issue(caching_device_t *cache, const memref_t &memref, addr_t addr)
+{
+    memref_t request = memref;
+    request.type = TRACE_TYPE_HARDWARE_PREFETCH;
+    request.addr = addr;
+    request.size = 1;
+    cache->request(request);
+}
+
+void
+next_line_prefetcher_t::prefetch(caching_device_t *cache, const memref_t &memref,
+                                 bool miss)
+{
+    if (!miss)
+        return;
+    addr_t block = memref.addr & ~((addr_t)cache->get_block_size() - 1);
+    for (int i = 1; i <= degree; i++)
+        issue(cache, memref, block + i * cache->get_block_size());
+}
+
+stride_prefetcher_t::stride_prefetcher_t(int degree) :
+    prefetcher_t(degree), table(TABLE_SIZE)
+{
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        table[i].pc = 0;
+        table[i].last_addr = 0;
+        table[i].stride = 0;
+        table[i].confidence = 0;
+    }
+}
+
+void
+stride_prefetcher_t::prefetch(caching_device_t *cache, const memref_t &memref,
+                              bool miss)
+{
+    // Instruction fetches have no separate pc to key on.
+    if (memref.type == TRACE_TYPE_INSTR)
+        return;
+    entry_t &entry = table[(memref.pc ^ (memref.pc >> 8)) & (TABLE_SIZE - 1)];
+    if (entry.pc != memref.pc) {
+        entry.pc = memref.pc;
+        entry.last_addr = memref.addr;
+        entry.stride = 0;
+        entry.confidence = 0;
+        return;
+    }
+    int_least64_t stride = (int_least64_t)(memref.addr - entry.last_addr);
+    entry.last_addr = memref.addr;
+    if (stride == 0)
+        return;
+    if (stride != entry.stride) {
+        entry.stride = stride;
+        entry.confidence = 0;
+        return;
+    }
+    if (entry.confidence < CONFIDENCE_THRESHOLD)
+        entry.confidence++;
+    if (entry.confidence < CONFIDENCE_THRESHOLD)
+        return;
+    // We only fetch strides that leave the block, as the block is already here.
+    int block_size = cache->get_block_size();
+    addr_t last_block = memref.addr & ~((addr_t)block_size - 1);
+    for (int i = 1; i <= degree; i++) {
+        addr_t addr = memref.addr + (addr_t)(stride * i);
+        addr_t block = addr & ~((addr_t)block_size - 1);
+        if (block != last_block)
+            issue(cache, memref, addr);
+        last_block = block;
+    }
+}
+
+stream_prefetcher_t::stream_prefetcher_t(int degree) :
+    prefetcher_t(degree), streams(MAX_STREAMS), num_misses(0)
+{
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        streams[i].last_block = 0;
+        streams[i].direction = 0;
+        streams[i].last_use = -1;
+    }
+}
+
+void
+stream_prefetcher_t::prefetch(caching_device_t *cache, const memref_t &memref,
+                              bool miss)
+{
+    if (!miss)
+        return;
+    num_misses++;
+    addr_t block = memref.addr / cache->get_block_size();
+    int lru = 0;
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        stream_t &stream = streams[i];
+        if (stream.last_use < streams[lru].last_use)
+            lru = i;
+        if (stream.last_use < 0)
+            continue;
+        int_least64_t distance = (int_least64_t)(block - stream.last_block);
+        if (distance == 0 || distance > WINDOW || distance < -WINDOW)
+            continue;
+        int direction = distance > 0 ? 1 : -1;
+        stream.last_block = block;
+        stream.last_use = num_misses;
+        if (stream.direction != direction) {
+            // A new stream, or one that turned around: wait for confirmation.
+            stream.direction = direction;
+            return;
+        }
+        for (int j = 1; j <= degree; j++) {
+            issue(cache, memref,
+                  (block + (addr_t)(direction * j)) * cache->get_block_size());
+        }
+        return;
+    }
+    streams[lru].last_block = block;
+    streams[lru].direction = 0;
+    streams[lru].last_use = num_misses;
+}
@@ -0,0 +1,123 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* prefetcher: models of hardware prefetchers attached to a caching device.
+ */
+
+#ifndef _PREFETCHER_H_
+#define _PREFETCHER_H_ 1
+
+#include <vector>
+#include "memref.h"
+
+class caching_device_t;
+
+// A prefetcher watches the demand accesses to the caching device it is attached
+// to (see caching_device_t::set_prefetcher()) and issues requests of type
+// TRACE_TYPE_HARDWARE_PREFETCH to that device for the blocks it predicts.
+class prefetcher_t
+{
+ public:
+    // The prefetcher fetches "degree" blocks ahead of each access it acts on.
+    explicit prefetcher_t(int degree) : degree(degree) {}
+    virtual ~prefetcher_t() {}
+
+    // Called after each demand access, separately for each block touched.
+    // The first access to a prefetched block counts as a miss, as it would
+    // have been one without the prefetcher, so that a prefetcher that acts on
+    // misses keeps up with the stream it started.
+    virtual void prefetch(caching_device_t *cache, const memref_t &memref,
+                          bool miss) = 0;
+
+ protected:
+    // Requests the block containing addr on behalf of memref.
+    void issue(caching_device_t *cache, const memref_t &memref, addr_t addr);
+
+    int degree;
+};
+
+// On each miss, fetches the next "degree" blocks.
+class next_line_prefetcher_t : public prefetcher_t
+{
+ public:
+    explicit next_line_prefetcher_t(int degree) : prefetcher_t(degree) {}
+    virtual void prefetch(caching_device_t *cache, const memref_t &memref,
+                          bool miss);
+};
+
+// Tracks the stride between successive data accesses by the same instruction,
+// in a table indexed by pc, and once a stride repeats fetches the blocks at the
+// next "degree" strides.
+class stride_prefetcher_t : public prefetcher_t
+{
+ public:
+    explicit stride_prefetcher_t(int degree);
+    virtual void prefetch(caching_device_t *cache, const memref_t &memref,
+                          bool miss);
+
+ protected:
+    static const int TABLE_SIZE = 256;
+    // A stride must be seen this many times in a row before we act on it.
+    static const int CONFIDENCE_THRESHOLD = 2;
+    struct entry_t {
+        addr_t pc;
+        addr_t last_addr;
+        int_least64_t stride;
+        int confidence;
+    };
+    std::vector<entry_t> table;
+};
+
+// Follows up to MAX_STREAMS streams of misses to ascending or descending
+// blocks.  A miss within WINDOW blocks of a stream's last one continues it,
+// once the direction is known, by fetching the next "degree" blocks in that
+// direction; any other miss replaces the least recently used stream.
+class stream_prefetcher_t : public prefetcher_t
+{
+ public:
+    explicit stream_prefetcher_t(int degree);
+    virtual void prefetch(caching_device_t *cache, const memref_t &memref,
+                          bool miss);
+
+ protected:
+    static const int MAX_STREAMS = 16;
+    static const int WINDOW = 16;
+    struct stream_t {
+        addr_t last_block;
+        int direction; // 1 or -1 once known, else 0.
+        int_least64_t last_use;
+    };
+    std::vector<stream_t> streams;
+    int_least64_t num_misses;
+};
+
+#endif /* _PREFETCHER_H_ */
@@ -0,0 +1,423 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <assert.h>
+#include <map>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "memref.h"
+#include "reader.h"
+#include "utils.h"
+
+#ifdef VERBOSE
+# include <iostream>
+#endif
+
+#define BOOLS_MATCH(b1, b2) (!!(b1) == !!(b2))
+
+reader_t::reader_t() :
+    batch_cur(NULL), batch_end(NULL), at_eof(true), cur_tid(0), cur_pid(0), cur_pc(0),
+    next_pc(0), input_entry(NULL), bundle_idx(0), process_tags(false),
+    remove_block_files(false), block(NULL), block_idx(0), block_refs_left(0)
+{
+    // Following typical stream iterator convention, the default constructor
+    // produces an EOF object.
+}
+
+reader_t::~reader_t()
+{
+    if (!remove_block_files)
+        return;
+    for (std::map<memref_pid_t, block_file_t>::iterator it = block_files.begin();
+         it != block_files.end(); ++it)
+        unlink(it->second.path.c_str());
+}
+
+const memref_t&
+reader_t::operator*()
+{
+    return cur_ref;
+}
+
+bool
+reader_t::operator==(const reader_t& rhs)
+{
+    return BOOLS_MATCH(rhs.at_eof, at_eof);
+}
+
+bool
+reader_t::operator!=(const reader_t& rhs)
+{
+    return !BOOLS_MATCH(rhs.at_eof, at_eof);
+}
+
+reader_t&
+reader_t::operator++()
+{
+    advance();
+    return *this;
+}
+
+void
+reader_t::advance()
+{
+    // We bail if we get a partial read, or EOF, or any error.
+    while (true) {
+        if (bundle_idx == 0/*not in instr bundle*/) {
+            if (block != NULL && block_refs_left == 0 &&
+                block_idx < block->lengths.size())
+                input_entry = &block_entry; // the block's next instr
+            else if (batch_cur < batch_end)
+                input_entry = batch_cur++;
+            else
+                input_entry = read_next_entry();
+        }
+        if (input_entry == NULL) {
+            at_eof = true;
+            break;
+        }
+#ifdef VERBOSE
+        std::cerr << "RECV: " << input_entry->type << " sz=" << input_entry->size <<
+            " addr=" << (void *)input_entry->addr << std::endl;
+#endif
+        bool have_memref = false;
+        switch (input_entry->type) {
+        case TRACE_TYPE_READ:
+        case TRACE_TYPE_WRITE:
+        case TRACE_TYPE_PREFETCH:
+        case TRACE_TYPE_PREFETCHT0:
+        case TRACE_TYPE_PREFETCHT1:
+        case TRACE_TYPE_PREFETCHT2:
+        case TRACE_TYPE_PREFETCHNTA:
+        case TRACE_TYPE_PREFETCH_READ:
+        case TRACE_TYPE_PREFETCH_WRITE:
+        case TRACE_TYPE_PREFETCH_INSTR:
+            have_memref = true;
+            cur_ref.pid = cur_pid;
+            cur_ref.tid = cur_tid;
+            cur_ref.type = input_entry->type;
+            cur_ref.size = input_entry->size;
+            cur_ref.addr = input_entry->addr;
+            // The trace stream always has the instr fetch first, which we
+            // use to obtain the PC for subsequent data references.
+            cur_ref.pc = cur_pc;
+            if (block != NULL)
+                block_ref_done();
+            break;
+        case TRACE_TYPE_INSTR:
+            have_memref = true;
+            cur_ref.pid = cur_pid;
+            cur_ref.tid = cur_tid;
+            cur_ref.type = input_entry->type;
+            cur_ref.size = input_entry->size;
+            cur_pc = input_entry->addr;
+            cur_ref.addr = cur_pc;
+            cur_ref.pc = cur_pc;
+            next_pc = cur_pc + cur_ref.size;
+            break;
+        case TRACE_TYPE_INSTR_BUNDLE:
+            have_memref = true;
+            // The trace stream always has the instr fetch first, which we
+            // use to compute the starting PC for the subsequent instructions.
+            cur_ref.size = input_entry->length[bundle_idx++];
+            cur_pc = next_pc;
+            cur_ref.pc = cur_pc;
+            cur_ref.addr = cur_pc;
+            next_pc = cur_pc + cur_ref.size;
+            // input_entry->size stores the number of instrs in this bundle
+            assert(input_entry->size <= sizeof(input_entry->length));
+            if (bundle_idx == input_entry->size)
+                bundle_idx = 0;
+            break;
+        case TRACE_TYPE_INSTR_PC:
+            // This is not a fetch: it only supplies the PC for the data
+            // references that follow.
+            cur_pc = input_entry->addr;
+            next_pc = cur_pc + input_entry->size;
+            break;
+        case TRACE_TYPE_INSTR_BLOCK:
+            if (input_entry != &block_entry) {
+                // A new block.  The rest of any block still in progress was
+                // cut short, by a fault or a signal, and is dropped.
+                block = find_block(cur_pid, input_entry->addr, input_entry->size);
+                if (block == NULL) {
+                    ERROR("Unknown block 0x%llx of process %lld: "
+                          "the block file is required\n",
+                          (unsigned long long)input_entry->addr, (long long)cur_pid);
+                    at_eof = true; // bail
+                    break;
+                }
+                block_entry = *input_entry;
+                block_idx = 0;
+                next_pc = block_entry.addr;
+            }
+            have_memref = true;
+            cur_ref.pid = cur_pid;
+            cur_ref.tid = cur_tid;
+            cur_ref.type = TRACE_TYPE_INSTR;
+            cur_ref.size = block->lengths[block_idx];
+            // With -instr_blocks, the instr's data entries come next.
+            block_refs_left = block->refs.empty() ? 0 : block->refs[block_idx];
+            block_idx++;
+            cur_pc = next_pc;
+            cur_ref.pc = cur_pc;
+            cur_ref.addr = cur_pc;
+            next_pc = cur_pc + cur_ref.size;
+            if (block_idx == block->lengths.size() && block_refs_left == 0)
+                block = NULL;
+            break;
+        case TRACE_TYPE_INSTR_FLUSH:
+        case TRACE_TYPE_DATA_FLUSH:
+            cur_ref.pid = cur_pid;
+            cur_ref.tid = cur_tid;
+            cur_ref.type = input_entry->type;
+            cur_ref.size = input_entry->size;
+            cur_ref.addr = input_entry->addr;
+            if (cur_ref.size != 0)
+                have_memref = true;
+            if (block != NULL)
+                block_ref_done();
+            break;
+        case TRACE_TYPE_INSTR_FLUSH_END:
+        case TRACE_TYPE_DATA_FLUSH_END:
+            cur_ref.size = input_entry->addr - cur_ref.addr;
+            have_memref = true;
+            break;
+        case TRACE_TYPE_ALLOC:
+            // The call site and end address follow.
+            cur_ref.pid = cur_pid;
+            cur_ref.tid = cur_tid;
+            cur_ref.type = input_entry->type;
+            cur_ref.size = 0;
+            cur_ref.addr = input_entry->addr;
+            break;
+        case TRACE_TYPE_ALLOC_SITE:
+            cur_ref.pc = input_entry->addr;
+            break;
+        case TRACE_TYPE_ALLOC_END:
+            cur_ref.size = input_entry->addr - cur_ref.addr;
+            have_memref = true;
+            break;
+        case TRACE_TYPE_FREE:
+            have_memref = true;
+            cur_ref.pid = cur_pid;
+            cur_ref.tid = cur_tid;
+            cur_ref.type = input_entry->type;
+            cur_ref.size = 0;
+            cur_ref.addr = input_entry->addr;
+            cur_ref.pc = 0;
+            break;
+        case TRACE_TYPE_THREAD:
+            switch_thread((memref_tid_t) input_entry->addr);
+            cur_pid = tid2pid[cur_tid];
+            break;
+        case TRACE_TYPE_THREAD_EXIT:
+            switch_thread((memref_tid_t) input_entry->addr);
+            block = NULL;
+            cur_pid = tid2pid[cur_tid];
+            // We do pass this to the caller but only some fields are valid:
+            cur_ref.pid = cur_pid;
+            cur_ref.tid = cur_tid;
+            cur_ref.type = input_entry->type;
+            have_memref = true;
+            break;
+        case TRACE_TYPE_PID:
+            // We do want to replace, in case of tid reuse.
+            tid2pid[cur_tid] = (memref_pid_t) input_entry->addr;
+            cur_pid = tid2pid[cur_tid];
+            break;
+        case TRACE_TYPE_TIMESTAMP:
+            // Only used by subclasses to order buffers.
+            break;
+        case TRACE_TYPE_L0I_HITS:
+        case TRACE_TYPE_L0D_HITS:
+            // We pass the hit count in addr.
+            have_memref = true;
+            cur_ref.pid = cur_pid;
+            cur_ref.tid = cur_tid;
+            cur_ref.type = input_entry->type;
+            cur_ref.size = 0;
+            cur_ref.addr = input_entry->addr;
+            cur_ref.pc = 0;
+            break;
+        case TRACE_TYPE_CPU_ID:
+            // We pass the cpu id in addr, for simulators modeling scheduling.
+            have_memref = true;
+            cur_ref.pid = cur_pid;
+            cur_ref.tid = cur_tid;
+            cur_ref.type = input_entry->type;
+            cur_ref.size = 0;
+            cur_ref.addr = input_entry->addr;
+            cur_ref.pc = 0;
+            break;
+        case TRACE_TYPE_SYSCALL:
+        case TRACE_TYPE_SYSCALL_END:
+            // We pass the syscall number in size and the duration in addr.
+            have_memref = true;
+            cur_ref.pid = cur_pid;
+            cur_ref.tid = cur_tid;
+            cur_ref.type = input_entry->type;
+            cur_ref.size = input_entry->size;
+            cur_ref.addr = input_entry->addr;
+            cur_ref.pc = 0;
+            break;
+        default:
+            ERROR("Unknown trace entry type %d\n", input_entry->type);
+            assert(false);
+            at_eof = true; // bail
+            break;
+        }
+        if (have_memref && process_tags &&
+            cur_ref.type != TRACE_TYPE_THREAD_EXIT &&
+            cur_ref.type != TRACE_TYPE_L0I_HITS &&
+            cur_ref.type != TRACE_TYPE_L0D_HITS &&
+            cur_ref.type != TRACE_TYPE_CPU_ID &&
+            cur_ref.type != TRACE_TYPE_SYSCALL &&
+            cur_ref.type != TRACE_TYPE_SYSCALL_END) {
+            // User-space addresses leave the top 16 bits free.
+            // XXX: processes whose ids match in the low 16 bits share a tag.
+            cur_ref.addr ^= (addr_t)(cur_ref.pid & 0xffff) << 48;
+        }
+        if (have_memref || at_eof)
+            break;
+    }
+}
+
+// Sets aside the block in progress of the current thread, if any, and resumes
+// that of tid.
+void
+reader_t::switch_thread(memref_tid_t tid)
+{
+    if (tid == cur_tid)
+        return;
+    if (block != NULL) {
+        block_state_t state = {block_entry, block, block_idx, block_refs_left,
+                               cur_pc, next_pc};
+        thread_blocks[cur_tid] = state;
+        block = NULL;
+    }
+    cur_tid = tid;
+    if (thread_blocks.empty())
+        return;
+    std::map<memref_tid_t, block_state_t>::iterator it = thread_blocks.find(tid);
+    if (it != thread_blocks.end()) {
+        block_entry = it->second.entry;
+        block = it->second.block;
+        block_idx = it->second.idx;
+        block_refs_left = it->second.refs_left;
+        cur_pc = it->second.pc;
+        next_pc = it->second.next_pc;
+        thread_blocks.erase(it);
+    }
+}
+
+// Returns the block of count instrs at start in process pid, or NULL if it is
+// not listed.
+const reader_t::block_t *
+reader_t::find_block(memref_pid_t pid, addr_t start, unsigned short count)
+{
+    block_file_t &file = block_files[pid];
+    std::pair<addr_t, unsigned short> key(start, count);
+    std::map<std::pair<addr_t, unsigned short>, block_t>::iterator it =
+        file.blocks.find(key);
+    if (it != file.blocks.end())
+        return &it->second;
+    if (file.path.empty()) {
+        std::ostringstream path;
+        path << block_prefix << "." << pid << "." BLOCK_FILE_SUFFIX;
+        file.path = path.str();
+    }
+    // The tracer lists a block before the block first runs, so a block we
+    // have not seen yet must be among the lines added since our last read.
+    FILE *f = fopen(file.path.c_str(), "r");
+    if (f == NULL)
+        return NULL;
+    if (fseek(f, file.offs, SEEK_SET) != 0) {
+        fclose(f);
+        return NULL;
+    }
+    char line[8192];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *pos = line;
+        size_t len = strlen(line);
+        // Leave a line still being written for next time.
+        if (len == 0 || line[len - 1] != '\n')
+            break;
+        file.offs += (long)len;
+        addr_t block_start = (addr_t)strtoull(pos, &pos, 16);
+        unsigned long block_count = strtoul(pos, &pos, 10);
+        // Each instr is listed as its length or, with -instr_blocks, as
+        // length:refs.
+        block_t block;
+        while (*pos == ' ' || *pos == ',') {
+            block.lengths.push_back((unsigned char)strtoul(pos + 1, &pos, 10));
+            if (*pos == ':')
+                block.refs.push_back((unsigned short)strtoul(pos + 1, &pos, 10));
+        }
+        if (block_count == 0 || block.lengths.size() != block_count ||
+            (!block.refs.empty() && block.refs.size() != block_count))
+            continue;
+        // A later listing, for code that changed, replaces an earlier one.
+        file.blocks[std::make_pair(block_start, (unsigned short)block_count)] = block;
+    }
+    fclose(f);
+    it = file.blocks.find(key);
+    if (it != file.blocks.end())
+        return &it->second;
+    return NULL;
+}
+
+uint64_t
+reader_t::skip_memrefs(uint64_t count)
+{
+    uint64_t skipped = 0;
+    while (skipped < count && !at_eof) {
+        ++*this;
+        if (!at_eof)
+            ++skipped;
+    }
+    return skipped;
+}
+
+size_t
+reader_t::next_batch(memref_t *out, size_t max)
+{
+    size_t count = 0;
+    while (count < max && !at_eof) {
+        out[count++] = cur_ref;
+        advance();
+    }
+    return count;
+}
@@ -38,26 +38,136 @@
 #define _READER_H_ 1
 
 #include <iterator>
+#include <map>
+#include <string>
+#include <vector>
 #include <assert.h>
 #include "memref.h"
+#include "../common/trace_entry.h"
 
+// The reader_t base class converts the raw trace_entry_t stream into memref_t
+// records.  Subclasses only need to supply the next trace_entry_t via
+// read_next_entry(), which lets the same decoding logic be shared between
+// reading from a live pipe and reading from a recorded trace file.
 class reader_t : public std::iterator<std::input_iterator_tag, memref_t>
 {
  public:
-    virtual ~reader_t() {}
+    reader_t();
+    virtual ~reader_t();
+    virtual bool init() { at_eof = false; ++*this; return true; }
+    virtual const memref_t& operator*();
+    virtual bool operator==(const reader_t& rhs);
+    virtual bool operator!=(const reader_t& rhs);
+    virtual reader_t& operator++();
     // XXX: we can't have any pure virtual functions here, as then the
     // postfix operator won't compile as it can't return an abstract type.
     // We could not support postfix at all.
     // Instead we have dummy implementations to make this a non-abstract
     // class and avoid the problem that way.
-    virtual const memref_t& operator*() { assert(false); return ignored_memref; }
-    virtual bool operator==(const reader_t& rhs) { return false; }
-    virtual bool operator!=(const reader_t& rhs) { return false; }
-    virtual reader_t& operator++() { assert(false); return *this; }
     virtual reader_t operator++(int) { assert(false); return *this; }
 
+    // Advances past the next "count" memrefs, as though ++ were applied "count"
+    // times.  Returns the number skipped, which is less than "count" only on EOF.
+    // Subclasses with random access to their input can override this to avoid
+    // decoding every skipped entry.
+    virtual uint64_t skip_memrefs(uint64_t count);
+
+    // Copies up to "max" memrefs into "out", starting with the current one,
+    // and advances past them, as though * and ++ were applied to each.
+    // Returns the number copied, which is 0 only on EOF.  This saves a pair
+    // of virtual calls per memref over iterating.
+    virtual size_t next_batch(memref_t *out, size_t max);
+
+    // Tags each memref's address with the id of its process, so that the
+    // same virtual address in different processes is kept apart.  The pc is
+    // left as is.
+    void set_process_tags(bool tag) { process_tags = tag; }
+
+    // For traces recorded with -instr_only or -instr_blocks: the blocks of
+    // process pid are listed in prefix.<pid>.BLOCK_FILE_SUFFIX, which we delete
+    // once we are done with it if "remove" is set.
+    void set_block_file_prefix(const std::string &prefix, bool remove)
+    {
+        block_prefix = prefix;
+        remove_block_files = remove;
+    }
+
+ protected:
+    // Returns a pointer to the next entry, or NULL on EOF or an error, in
+    // which case the subclass must set at_eof.
+    virtual trace_entry_t * read_next_entry() { assert(false); return NULL; }
+
+    // Returns whether every entry returned by read_next_entry() so far has
+    // been fully consumed, i.e., we are not partway through an instr bundle
+    // or block.
+    bool at_entry_boundary() const { return bundle_idx == 0 && block == NULL; }
+
+    // A subclass that holds further entries in memory after the one
+    // read_next_entry() returns can point these at them: we then consume
+    // them in order before calling read_next_entry() again.
+    trace_entry_t *batch_cur;
+    trace_entry_t *batch_end;
+
+    bool at_eof;
+
  private:
-    memref_t ignored_memref; // Purely for operator*
+    struct block_t {
+        std::vector<unsigned char> lengths;
+        // With -instr_blocks, the number of data entries each instr records.
+        std::vector<unsigned short> refs;
+    };
+
+    void advance();
+    const block_t *find_block(memref_pid_t pid, addr_t start, unsigned short count);
+    void switch_thread(memref_tid_t tid);
+    // Accounts for a data entry of the block in progress.
+    void block_ref_done()
+    {
+        if (block_refs_left > 0 && --block_refs_left == 0 &&
+            block_idx == block->lengths.size())
+            block = NULL;
+    }
+
+    memref_t cur_ref;
+    memref_tid_t cur_tid;
+    memref_pid_t cur_pid;
+    addr_t cur_pc;
+    addr_t next_pc;
+    trace_entry_t *input_entry;
+    int bundle_idx;
+    bool process_tags;
+    std::map<memref_tid_t, memref_pid_t> tid2pid;
+
+    struct block_file_t {
+        block_file_t() : offs(0) {}
+        std::string path;
+        // How far we have read: the tracer may still be appending.
+        long offs;
+        // The blocks, keyed by start pc and instr count.
+        std::map<std::pair<addr_t, unsigned short>, block_t> blocks;
+    };
+    std::string block_prefix;
+    bool remove_block_files;
+    std::map<memref_pid_t, block_file_t> block_files;
+
+    // The block we are expanding, if any: we produce the fetch of its instr
+    // block_idx next, once the block_refs_left data entries of the previous
+    // instr have gone by.
+    struct block_state_t {
+        trace_entry_t entry;
+        const block_t *block;
+        size_t idx;
+        int refs_left;
+        addr_t pc;
+        addr_t next_pc;
+    };
+    trace_entry_t block_entry;
+    const block_t *block;
+    size_t block_idx;
+    int block_refs_left;
+    // With -instr_blocks, the data entries of a block may be split across
+    // buffers, so we set aside the block of a thread we switch away from.
+    std::map<memref_tid_t, block_state_t> thread_blocks;
 };
 
 #endif /* _READER_H_ */
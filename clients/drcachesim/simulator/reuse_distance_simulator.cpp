@@ -0,0 +1,378 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <assert.h>
+#include <stdint.h> /* for supporting 64-bit integers*/
+#include "utils.h"
+#include "memref.h"
+#include "droption.h"
+#include "../common/options.h"
+#include "reuse_distance_simulator.h"
+
+const uint64_t reuse_profile_t::REUSE_DISTANCE_COLD;
+
+// The initial and minimum number of Fenwick tree slots.
+#define MIN_TREE_SLOTS 1024
+
+reuse_profile_t::reuse_profile_t() : block_size_bits(0), next_slot(0), cur_window(0)
+{
+    reset();
+}
+
+bool
+reuse_profile_t::init(int block_size)
+{
+    block_size_bits = compute_log2(block_size);
+    if (block_size_bits == -1)
+        return false;
+    tree.assign(MIN_TREE_SLOTS + 1, 0);
+    next_slot = 0;
+    return true;
+}
+
+void
+reuse_profile_t::tree_add(uint64_t slot, int delta)
+{
+    // The tree is 1-based.
+    for (uint64_t i = slot + 1; i < tree.size(); i += i & (~i + 1))
+        tree[i] += delta;
+}
+
+uint64_t
+reuse_profile_t::tree_prefix_sum(uint64_t slot)
+{
+    // Returns the number of marks in [0, slot].
+    uint64_t sum = 0;
+    for (uint64_t i = slot + 1; i > 0; i -= i & (~i + 1))
+        sum += tree[i];
+    return sum;
+}
+
+void
+reuse_profile_t::compact()
+{
+    // Renumber the live slots densely, preserving their order, and leave room
+    // for as many new accesses as there are live blocks.
+    std::vector<std::pair<uint64_t, addr_t> > live;
+    live.reserve(last_access.size());
+    for (std::map<addr_t, last_access_t>::iterator it = last_access.begin();
+         it != last_access.end(); ++it)
+        live.push_back(std::make_pair(it->second.slot, it->first));
+    std::sort(live.begin(), live.end());
+    uint64_t slots = 2 * live.size();
+    if (slots < MIN_TREE_SLOTS)
+        slots = MIN_TREE_SLOTS;
+    tree.assign(slots + 1, 0);
+    for (next_slot = 0; next_slot < live.size(); next_slot++) {
+        last_access[live[next_slot].second].slot = next_slot;
+        tree_add(next_slot, 1);
+    }
+}
+
+uint64_t
+reuse_profile_t::access(addr_t addr)
+{
+    addr_t tag = addr >> block_size_bits;
+    uint64_t distance;
+    if (next_slot + 1 >= tree.size())
+        compact();
+    std::map<addr_t, last_access_t>::iterator it = last_access.find(tag);
+    if (it == last_access.end()) {
+        distance = REUSE_DISTANCE_COLD;
+        num_cold++;
+        cur_window_blocks++;
+        it = last_access.insert(std::make_pair(tag, last_access_t())).first;
+    } else {
+        // Every other block has one mark, at its latest access, so the marks
+        // after ours count the distinct blocks accessed since.
+        distance = (last_access.size() - tree_prefix_sum(it->second.slot));
+        tree_add(it->second.slot, -1);
+        if (it->second.window != cur_window)
+            cur_window_blocks++;
+        int bucket = 0;
+        for (uint64_t dist = distance; dist > 0; dist >>= 1)
+            bucket++;
+        if (bucket >= (int)histogram.size())
+            histogram.resize(bucket + 1, 0);
+        histogram[bucket]++;
+    }
+    it->second.slot = next_slot;
+    it->second.window = cur_window;
+    tree_add(next_slot, 1);
+    next_slot++;
+    num_accesses++;
+    return distance;
+}
+
+void
+reuse_profile_t::end_window()
+{
+    window_blocks.push_back(cur_window_blocks);
+    cur_window++;
+    cur_window_blocks = 0;
+}
+
+void
+reuse_profile_t::reset()
+{
+    // We keep last_access, as the blocks are still warm.
+    histogram.clear();
+    window_blocks.clear();
+    // A new window number ensures blocks seen before the reset are counted
+    // again in the next window.
+    cur_window++;
+    cur_window_blocks = 0;
+    num_accesses = 0;
+    num_cold = 0;
+}
+
+void
+reuse_profile_t::print(std::string prefix, std::string units)
+{
+    std::cerr.imbue(std::locale("")); // Add commas, at least for my locale
+    std::cerr << prefix << std::setw(18) << std::left << "Accesses:" <<
+        std::setw(20) << std::right << num_accesses << std::endl;
+    std::cerr << prefix << std::setw(18) << std::left << "Cold accesses:" <<
+        std::setw(20) << std::right << num_cold << std::endl;
+    if (num_accesses == 0)
+        return;
+    std::cerr << prefix << "Reuse distance histogram (distinct " << units <<
+        "):" << std::endl;
+    for (size_t i = 0; i < histogram.size(); i++) {
+        if (histogram[i] == 0)
+            continue;
+        std::ostringstream label;
+        if (i <= 1)
+            label << i;
+        else
+            label << (1ULL << (i - 1)) << "-" << (1ULL << i) - 1;
+        std::cerr << prefix << "  " << std::setw(24) << std::left << label.str() <<
+            std::setw(14) << std::right << histogram[i] <<
+            std::setw(9) << std::fixed << std::setprecision(2) <<
+            ((float)histogram[i]*100/num_accesses) << "%" << std::endl;
+    }
+    std::cerr << prefix << "Working set size by window (" << units << ", bytes):" <<
+        std::endl;
+    for (size_t i = 0; i < window_blocks.size(); i++) {
+        std::ostringstream label;
+        label << "#" << i;
+        std::cerr << prefix << "  " << std::setw(8) << std::left << label.str() <<
+            std::setw(14) << std::right << window_blocks[i] <<
+            std::setw(16) << std::right << (window_blocks[i] << block_size_bits) <<
+            std::endl;
+    }
+}
+
+bool
+reuse_distance_simulator_t::init()
+{
+    if (!create_reader())
+        return false;
+
+    // We do not model cores.
+    num_cores = 1;
+    thread_counts = NULL;
+    thread_ever_counts = NULL;
+
+    if (!line_profile.init(op_line_size.get_value()) ||
+        !page_profile.init((int)op_page_size.get_value())) {
+        ERROR("Usage error: the line size and page size must be powers of 2.\n");
+        return false;
+    }
+    window_refs = op_rd_window.get_value();
+    refs_in_window = 0;
+    return true;
+}
+
+reuse_distance_simulator_t::~reuse_distance_simulator_t()
+{
+}
+
+void
+reuse_distance_simulator_t::access(const memref_t &memref)
+{
+    // Like the cache simulator, we split references touching several lines
+    // or pages and count each piece as an access.
+    addr_t final_addr = memref.addr + memref.size - 1/*avoid overflow*/;
+    addr_t line_size = op_line_size.get_value();
+    for (addr_t line = memref.addr & ~(line_size - 1); line <= final_addr;
+         line += line_size) {
+        uint64_t distance = line_profile.access(line);
+        if (op_rd_by_pc.get_value()) {
+            pc_stats_t &stats = pc_stats[memref.pc];
+            stats.accesses++;
+            if (distance == reuse_profile_t::REUSE_DISTANCE_COLD)
+                stats.cold++;
+            else
+                stats.total_distance += distance;
+        }
+        if (line + line_size < line)
+            break; // Overflow.
+    }
+    addr_t page_size = op_page_size.get_value();
+    for (addr_t page = memref.addr & ~(page_size - 1); page <= final_addr;
+         page += page_size) {
+        page_profile.access(page);
+        if (page + page_size < page)
+            break; // Overflow.
+    }
+}
+
+void
+reuse_distance_simulator_t::end_window()
+{
+    line_profile.end_window();
+    page_profile.end_window();
+    refs_in_window = 0;
+}
+
+void
+reuse_distance_simulator_t::reset()
+{
+    line_profile.reset();
+    page_profile.reset();
+    pc_stats.clear();
+    refs_in_window = 0;
+}
+
+bool
+reuse_distance_simulator_t::run()
+{
+    if (!reader->init()) {
+        if (op_infile.get_value().empty())
+            ERROR("failed to read from pipe %s", op_ipc_name.get_value().c_str());
+        else
+            ERROR("failed to read from %s", op_infile.get_value().c_str());
+        return false;
+    }
+
+    uint64_t warmup_refs = op_warmup_refs.get_value();
+    uint64_t sim_refs = op_sim_refs.get_value();
+
+    // The reader can skip faster than we can by iterating, e.g., by
+    // seeking past whole chunks of a compressed trace file.
+    reader->skip_memrefs(op_skip_refs.get_value());
+
+    for (; *reader != *reader_end; ++(*reader)) {
+        memref_t memref = **reader;
+
+        // the references after warmup and simulated ones are dropped
+        if (warmup_refs == 0 && sim_refs == 0)
+            continue;
+
+        if (memref.type == TRACE_TYPE_READ ||
+            memref.type == TRACE_TYPE_WRITE)
+            access(memref);
+        else if (memref.type == TRACE_TYPE_INSTR ||
+                 type_is_prefetch(memref.type) ||
+                 memref.type == TRACE_TYPE_INSTR_FLUSH ||
+                 memref.type == TRACE_TYPE_DATA_FLUSH ||
+                 memref.type == TRACE_TYPE_THREAD_EXIT ||
+                 memref.type == TRACE_TYPE_CPU_ID ||
+                 memref.type == TRACE_TYPE_ALLOC ||
+                 memref.type == TRACE_TYPE_FREE ||
+                 memref.type == TRACE_TYPE_SYSCALL ||
+                 memref.type == TRACE_TYPE_SYSCALL_END) {
+            // We only analyze data accesses.
+        } else {
+            ERROR("unhandled memref type");
+            return false;
+        }
+
+        if (op_verbose.get_value() >= 3) {
+            std::cerr << "::" << memref.pid << "." << memref.tid << ":: " <<
+                " @" << (void *)memref.pc <<
+                " " << trace_type_names[memref.type] << " " <<
+                (void *)memref.addr << " x" << memref.size << std::endl;
+        }
+
+        // process counters for warmup and simulated references
+        if (warmup_refs > 0) {
+            warmup_refs--;
+            if (warmup_refs == 0)
+                reset();
+        }
+        else {
+            sim_refs--;
+            if (++refs_in_window == window_refs)
+                end_window();
+        }
+    }
+    if (refs_in_window > 0)
+        end_window();
+    return true;
+}
+
+static bool
+pc_stats_greater(const std::pair<addr_t, int_least64_t> &a,
+                 const std::pair<addr_t, int_least64_t> &b)
+{
+    return a.second > b.second;
+}
+
+bool
+reuse_distance_simulator_t::print_stats()
+{
+    std::cerr << "Reuse distance profile of data accesses, all threads "
+        "(window " << window_refs << " references):" << std::endl;
+    std::cerr << "  Cache line (" << op_line_size.get_value() << " bytes) stats:" <<
+        std::endl;
+    line_profile.print("    ", "lines");
+    std::cerr << "  Page (" << op_page_size.get_value() << " bytes) stats:" <<
+        std::endl;
+    page_profile.print("    ", "pages");
+    if (op_rd_by_pc.get_value()) {
+        // Sort by access count.
+        std::vector<std::pair<addr_t, int_least64_t> > pcs;
+        for (std::map<addr_t, pc_stats_t>::iterator it = pc_stats.begin();
+             it != pc_stats.end(); ++it)
+            pcs.push_back(std::make_pair(it->first, it->second.accesses));
+        std::sort(pcs.begin(), pcs.end(), pc_stats_greater);
+        std::cerr << "  Top " << op_rd_top_pcs.get_value() << " instructions by line "
+            "accesses (pc, accesses, cold, mean distance):" << std::endl;
+        for (size_t i = 0; i < pcs.size() && i < op_rd_top_pcs.get_value(); i++) {
+            const pc_stats_t &stats = pc_stats[pcs[i].first];
+            int_least64_t reuses = stats.accesses - stats.cold;
+            std::cerr << "    " << std::setw(18) << std::left <<
+                (void *)pcs[i].first << std::setw(14) << std::right <<
+                stats.accesses << std::setw(14) << std::right << stats.cold <<
+                std::setw(14) << std::right << std::fixed << std::setprecision(1) <<
+                (reuses == 0 ? 0.0 : (double)stats.total_distance/reuses) << std::endl;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,115 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* reuse_distance_simulator: reports reuse distances and working set sizes.
+ */
+
+#ifndef _REUSE_DISTANCE_SIMULATOR_H_
+#define _REUSE_DISTANCE_SIMULATOR_H_ 1
+
+#include <map>
+#include <string>
+#include <vector>
+#include "simulator.h"
+
+// Computes the reuse distance of each access to a sequence of blocks: the
+// number of distinct other blocks accessed since the previous access to the
+// same block.  We mark each block's most recent access in a Fenwick tree
+// indexed by access time, so the distance is the number of marks after the
+// previous access.  Times are renumbered when the tree fills up.
+class reuse_profile_t
+{
+ public:
+    reuse_profile_t();
+    bool init(int block_size);
+    // Returns REUSE_DISTANCE_COLD for a block's first access.
+    uint64_t access(addr_t addr);
+    // Starts a new working set window.
+    void end_window();
+    void reset();
+    // Prints the distance histogram and working set sizes.
+    void print(std::string prefix, std::string units);
+
+    static const uint64_t REUSE_DISTANCE_COLD = (uint64_t)-1;
+
+ protected:
+    struct last_access_t {
+        uint64_t slot; // Index into the Fenwick tree.
+        uint64_t window; // The working set window of the access.
+    };
+    void tree_add(uint64_t slot, int delta);
+    uint64_t tree_prefix_sum(uint64_t slot);
+    void compact();
+
+    int block_size_bits;
+    std::map<addr_t, last_access_t> last_access;
+    std::vector<int> tree;
+    uint64_t next_slot;
+    uint64_t cur_window;
+    uint64_t cur_window_blocks;
+    std::vector<uint64_t> window_blocks;
+    // Bucket 0 holds distance 0 and bucket i holds [2^(i-1), 2^i).
+    std::vector<int_least64_t> histogram;
+    int_least64_t num_accesses;
+    int_least64_t num_cold;
+};
+
+class reuse_distance_simulator_t : public simulator_t
+{
+ public:
+    virtual bool init();
+    virtual ~reuse_distance_simulator_t();
+    virtual bool run();
+    virtual bool print_stats();
+
+ protected:
+    void access(const memref_t &memref);
+    void end_window();
+    void reset();
+
+    // All threads' data accesses, considered together.
+    reuse_profile_t line_profile;
+    reuse_profile_t page_profile;
+    uint64_t window_refs;
+    uint64_t refs_in_window;
+
+    // For -rd_by_pc: line reuse distances of each instruction's accesses.
+    struct pc_stats_t {
+        pc_stats_t() : accesses(0), cold(0), total_distance(0) {}
+        int_least64_t accesses;
+        int_least64_t cold;
+        uint64_t total_distance;
+    };
+    std::map<addr_t, pc_stats_t> pc_stats;
+};
+
+#endif /* _REUSE_DISTANCE_SIMULATOR_H_ */
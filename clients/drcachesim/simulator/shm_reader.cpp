@@ -0,0 +1,108 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <assert.h>
+#include <sched.h>
+#include <unistd.h>
+#include "memref.h"
+#include "shm_reader.h"
+#include "utils.h"
+
+// How many times we poll an empty ring before we start sleeping.
+#define SPIN_COUNT 1024
+#define SLEEP_USEC 100
+
+shm_reader_t::shm_reader_t() :
+    created(false), slot(NULL), cur_buf(NULL), end_buf(NULL)
+{
+    // Following typical stream iterator convention, the default constructor
+    // produces an EOF object.
+    at_eof = true;
+}
+
+shm_reader_t::shm_reader_t(const char *ipc_name, unsigned int num_slots) :
+    ring(ipc_name), slot(NULL), cur_buf(NULL), end_buf(NULL)
+{
+    at_eof = true;
+    created = ring.create(num_slots);
+}
+
+shm_reader_t::~shm_reader_t()
+{
+    if (created)
+        ring.destroy();
+}
+
+bool
+shm_reader_t::init()
+{
+    if (!created)
+        return false;
+    at_eof = false;
+    ++*this;
+    return true;
+}
+
+trace_entry_t *
+shm_reader_t::read_next_entry()
+{
+    if (cur_buf != NULL)
+        ++cur_buf;
+    while (cur_buf == NULL || cur_buf >= end_buf) {
+        if (slot != NULL) {
+            // We are done with every entry in it, including any bundle.
+            ring.release_buffer(slot);
+            slot = NULL;
+        }
+        size_t used;
+        bool eof;
+        int polls = 0;
+        while ((slot = (trace_entry_t *) ring.acquire_ready(&used, &eof)) == NULL) {
+            if (eof) {
+                at_eof = true;
+                return NULL;
+            }
+            if (++polls < SPIN_COUNT)
+                sched_yield();
+            else
+                usleep(SLEEP_USEC);
+        }
+        if (used % sizeof(trace_entry_t) != 0 || used > ring.get_slot_size()) {
+            ERROR("Invalid shared memory buffer size %zu\n", used);
+            at_eof = true;
+            return NULL;
+        }
+        cur_buf = slot;
+        end_buf = slot + (used / sizeof(trace_entry_t));
+    }
+    return cur_buf;
+}
@@ -0,0 +1,71 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* shm_reader: obtains memory streams from DR clients running in
+ * application processes via a shared-memory ring and presents them via
+ * an interator interface to the cache simulator.
+ */
+
+#ifndef _SHM_READER_H_
+#define _SHM_READER_H_ 1
+
+#include <string>
+#include "memref.h"
+#include "reader.h"
+#include "../common/shm_ring.h"
+#include "../common/trace_entry.h"
+
+// Unlike ipc_reader_t, entries are decoded directly out of the shared slots
+// the tracer filled, with no copy.
+class shm_reader_t : public reader_t
+{
+ public:
+    shm_reader_t();
+    // The ring is created here, before the application is launched, as
+    // writers attach to an existing ring rather than blocking on an open
+    // the way they do for a pipe.
+    shm_reader_t(const char *ipc_name, unsigned int num_slots);
+    virtual ~shm_reader_t();
+    virtual bool init();
+
+ protected:
+    virtual trace_entry_t * read_next_entry();
+
+ private:
+    shm_ring_t ring;
+    bool created;
+    trace_entry_t *slot;
+    trace_entry_t *cur_buf;
+    trace_entry_t *end_buf;
+};
+
+#endif /* _SHM_READER_H_ */
@@ -0,0 +1,92 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* sim_queue: a bounded blocking queue for handing work between simulator
+ * threads.
+ */
+
+#ifndef _SIM_QUEUE_H_
+#define _SIM_QUEUE_H_ 1
+
+#include <deque>
+#include <pthread.h>
+
+// XXX i#1703: this is UNIX-only, like the rest of the simulator's
+// parallel mode.
+template <typename T>
+class sim_queue_t
+{
+ public:
+    explicit sim_queue_t(size_t capacity_) : capacity(capacity_)
+    {
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&not_empty, NULL);
+        pthread_cond_init(&not_full, NULL);
+    }
+    ~sim_queue_t()
+    {
+        pthread_cond_destroy(&not_full);
+        pthread_cond_destroy(&not_empty);
+        pthread_mutex_destroy(&lock);
+    }
+    // Blocks while the queue is full.
+    void push(const T &item)
+    {
+        pthread_mutex_lock(&lock);
+        while (items.size() >= capacity)
+            pthread_cond_wait(&not_full, &lock);
+        items.push_back(item);
+        pthread_cond_signal(&not_empty);
+        pthread_mutex_unlock(&lock);
+    }
+    // Blocks while the queue is empty.
+    T pop()
+    {
+        pthread_mutex_lock(&lock);
+        while (items.empty())
+            pthread_cond_wait(&not_empty, &lock);
+        T item = items.front();
+        items.pop_front();
+        pthread_cond_signal(&not_full);
+        pthread_mutex_unlock(&lock);
+        return item;
+    }
+
+ private:
+    std::deque<T> items;
+    size_t capacity;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+#endif /* _SIM_QUEUE_H_ */
@@ -30,24 +30,149 @@
  * DAMAGE.
  */
 
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <iterator>
 #include <assert.h>
 #include <limits.h>
+#include <stdlib.h>
 #include "utils.h"
 #include "memref.h"
 #include "droption.h"
 #include "../common/options.h"
 #include "simulator.h"
+#include "ipc_reader.h"
+#include "shm_reader.h"
+#include "file_reader.h"
+#include "async_reader.h"
+#include "symbolizer.h"
 
-simulator_t::~simulator_t() {}
+simulator_t::~simulator_t()
+{
+    delete reader;
+    delete reader_end;
+    delete intervals;
+}
+
+bool
+simulator_t::create_reader()
+{
+    if (!op_infile.get_value().empty()) {
+        reader = new file_reader_t(op_infile.get_value().c_str());
+        reader_end = new file_reader_t();
+    }
+    // XXX: add a "required" flag to droption to avoid needing this here
+    else if (op_ipc_name.get_value().empty()) {
+        ERROR("Usage error: ipc name is required\nUsage:\n%s",
+              droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
+        return false;
+    }
+    else if (op_shm.get_value()) {
+        reader = new shm_reader_t(op_ipc_name.get_value().c_str(),
+                                  op_shm_slots.get_value());
+        reader_end = new shm_reader_t();
+    } else {
+        reader = new ipc_reader_t(op_ipc_name.get_value().c_str(),
+                                  op_thread_pipes.get_value(),
+                                  op_compress.get_value());
+        reader_end = new ipc_reader_t();
+    }
+    bool online;
+    std::string prefix = symbolizer_t::process_file_prefix(&online);
+    reader->set_block_file_prefix(prefix, online);
+    if (op_process_tags.get_value()) {
+#if defined(X86_64) || defined(ARM_64)
+        reader->set_process_tags(true);
+#else
+        ERROR("Usage error: -process_tags is only supported on 64-bit\n");
+        return false;
+#endif
+    }
+    // The end object is never advanced, so it needs no thread.
+    if (op_async_reader.get_value())
+        reader = new async_reader_t(reader);
+    return true;
+}
+
+bool
+simulator_t::create_intervals()
+{
+    if (op_interval_refs.get_value() == 0) {
+        if (!op_interval_file.get_value().empty() ||
+            !op_interval_bbv_file.get_value().empty()) {
+            ERROR("Usage error: -interval_file and -interval_bbv_file require "
+                  "-interval_refs\n");
+            return false;
+        }
+        return true;
+    }
+    intervals = new interval_stats_t(op_interval_refs.get_value());
+    return intervals->init(op_interval_file.get_value(),
+                           op_interval_bbv_file.get_value());
+}
+
+// A checkpoint is this header followed by the state of each device, as
+// written by caching_device_t::save_state().
+static const char CHECKPOINT_MAGIC[8] = {'D','R','C','K','P','T','0','1'};
+
+bool
+simulator_t::load_checkpoint()
+{
+    std::vector<caching_device_t *> devices;
+    get_checkpoint_devices(devices);
+    std::ifstream in(op_checkpoint_load.get_value().c_str(), std::ios::binary);
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    size_t count;
+    if (!in.read(magic, sizeof(magic)) ||
+        !std::equal(magic, magic + sizeof(magic), CHECKPOINT_MAGIC) ||
+        !in.read((char *)&count, sizeof(count)) || count != devices.size()) {
+        ERROR("Failed to load checkpoint %s: not a checkpoint of this hierarchy\n",
+              op_checkpoint_load.get_value().c_str());
+        return false;
+    }
+    for (size_t i = 0; i < devices.size(); i++) {
+        if (!devices[i]->restore_state(in)) {
+            ERROR("Failed to load checkpoint %s: device %d does not match\n",
+                  op_checkpoint_load.get_value().c_str(), (int)i);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+simulator_t::save_checkpoint()
+{
+    std::vector<caching_device_t *> devices;
+    get_checkpoint_devices(devices);
+    std::ofstream out(op_checkpoint_save.get_value().c_str(),
+                      std::ios::binary | std::ios::trunc);
+    size_t count = devices.size();
+    out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    out.write((const char *)&count, sizeof(count));
+    for (size_t i = 0; i < devices.size(); i++)
+        devices[i]->save_state(out);
+    out.close();
+    if (!out) {
+        ERROR("Failed to write checkpoint %s\n", op_checkpoint_save.get_value().c_str());
+        return false;
+    }
+    return true;
+}
 
 int
 simulator_t::core_for_thread(memref_tid_t tid)
 {
     std::map<memref_tid_t,int>::iterator exists = thread2core.find(tid);
-    if (exists != thread2core.end())
+    if (exists != thread2core.end() &&
+        (op_sched_quantum.get_value() == 0 || replayed_threads.count(tid) > 0)) {
+        run_on_core(tid, exists->second);
         return exists->second;
+    }
+    if (op_sched_quantum.get_value() > 0)
+        return schedule_thread(tid);
     // A new thread: we want to assign it to the least-loaded core,
     // measured just by the number of threads.
     // We assume the # of cores is small and that it's fastest to do a
@@ -65,12 +190,102 @@ simulator_t::core_for_thread(memref_tid_t tid)
         std::cerr << "new thread " << tid << " => core " << min_core <<
             " (count=" << thread_counts[min_core] << ")" << std::endl;
     }
-    ++thread_counts[min_core];
-    ++thread_ever_counts[min_core];
-    thread2core[tid] = min_core;
+    add_to_core(tid, min_core);
+    run_on_core(tid, min_core);
     return min_core;
 }
 
+int
+simulator_t::schedule_thread(memref_tid_t tid)
+{
+    std::map<memref_tid_t,int>::iterator exists = thread2core.find(tid);
+    int prev_core = (exists == thread2core.end()) ? -1 : exists->second;
+    if (prev_core >= 0 && core_sched[prev_core].running == tid)
+        return prev_core;
+    // The thread resumes on its previous core, whose caches may still be warm,
+    // if that core is idle or its quantum is used up.  Otherwise it takes an
+    // idle core, whose slice_end is 0, or else preempts the core whose quantum
+    // ends soonest.
+    int core = prev_core;
+    if (prev_core < 0 ||
+        (core_sched[prev_core].running != 0 &&
+         core_sched[prev_core].slice_end > sched_time)) {
+        core = (prev_core < 0) ? 0 : prev_core;
+        for (int i = 0; i < num_cores; i++) {
+            if (core_sched[i].slice_end < core_sched[core].slice_end)
+                core = i;
+        }
+    }
+    if (prev_core < 0) {
+        if (op_verbose.get_value() >= 1) {
+            std::cerr << "new thread " << tid << " => core " << core <<
+                " (count=" << thread_counts[core] << ")" << std::endl;
+        }
+        add_to_core(tid, core);
+    } else if (core != prev_core)
+        move_thread(tid, prev_core, core);
+    run_on_core(tid, core);
+    return core;
+}
+
+int
+simulator_t::handle_cpu_id(memref_tid_t tid, addr_t cpu)
+{
+    if (!op_replay_cpus.get_value() || cpu == (addr_t)-1)
+        return core_for_thread(tid);
+    int core = (int)(cpu % num_cores);
+    std::map<memref_tid_t,int>::iterator exists = thread2core.find(tid);
+    if (exists == thread2core.end()) {
+        if (op_verbose.get_value() >= 1) {
+            std::cerr << "new thread " << tid << " => core " << core <<
+                " (cpu=" << cpu << ")" << std::endl;
+        }
+        add_to_core(tid, core);
+    } else if (exists->second != core)
+        move_thread(tid, exists->second, core);
+    replayed_threads.insert(tid);
+    run_on_core(tid, core);
+    return core;
+}
+
+void
+simulator_t::move_thread(memref_tid_t tid, int from_core, int to_core)
+{
+    assert(thread_counts[from_core] > 0);
+    --thread_counts[from_core];
+    if (core_sched[from_core].running == tid) {
+        core_sched[from_core].running = 0;
+        core_sched[from_core].slice_end = 0;
+    }
+    if (op_verbose.get_value() >= 2) {
+        std::cerr << "thread " << tid << " migrated from core " << from_core <<
+            " to core " << to_core << std::endl;
+    }
+    add_to_core(tid, to_core);
+    ++core_sched[to_core].migrations;
+}
+
+void
+simulator_t::add_to_core(memref_tid_t tid, int core)
+{
+    ++thread_counts[core];
+    if (core_sched[core].threads_seen.insert(tid).second)
+        ++thread_ever_counts[core];
+    thread2core[tid] = core;
+}
+
+void
+simulator_t::run_on_core(memref_tid_t tid, int core)
+{
+    core_sched_t &sched = core_sched[core];
+    if (sched.running == tid)
+        return;
+    if (sched.running != 0)
+        ++sched.switches;
+    sched.running = tid;
+    sched.slice_end = sched_time + (uint64_t)op_sched_quantum.get_value() * num_cores;
+}
+
 void
 simulator_t::handle_thread_exit(memref_tid_t tid)
 {
@@ -82,5 +297,84 @@ simulator_t::handle_thread_exit(memref_tid_t tid)
         std::cerr << "thread " << tid << " exited from core " << exists->second <<
             " (count=" << thread_counts[exists->second] << ")" << std::endl;
     }
+    if (core_sched[exists->second].running == tid) {
+        core_sched[exists->second].running = 0;
+        core_sched[exists->second].slice_end = 0;
+    }
+    // A later thread reusing this id counts as a new thread.
+    for (int i = 0; i < num_cores; i++)
+        core_sched[i].threads_seen.erase(tid);
+    replayed_threads.erase(tid);
     thread2core.erase(tid);
 }
+
+void
+simulator_t::print_core_schedule(int core, const std::string &prefix)
+{
+    if (op_sched_quantum.get_value() > 0 || op_replay_cpus.get_value()) {
+        std::cerr << prefix << std::setw(18) << std::left << "Context switches:" <<
+            std::setw(20) << std::right << core_sched[core].switches << std::endl;
+        std::cerr << prefix << std::setw(18) << std::left << "Migrations in:" <<
+            std::setw(20) << std::right << core_sched[core].migrations << std::endl;
+    }
+    if (kernel_model) {
+        std::cerr << prefix << std::setw(18) << std::left << "Syscalls:" <<
+            std::setw(20) << std::right << core_sched[core].syscalls << std::endl;
+        if (op_context_switch_us.get_value() > 0) {
+            std::cerr << prefix << std::setw(18) << std::left << "Blocking syscalls:" <<
+                std::setw(20) << std::right << core_sched[core].blocking_syscalls <<
+                std::endl;
+        }
+    }
+}
+
+bool
+simulator_t::init_kernel_model()
+{
+    // The spec is a comma-separated list of <sysnum>:<percent>, with * for
+    // the syscalls not listed.
+    const std::string &spec = op_syscall_pollution.get_value();
+    std::string::size_type pos = 0;
+    while (pos < spec.size()) {
+        std::string::size_type end = spec.find(',', pos);
+        if (end == std::string::npos)
+            end = spec.size();
+        std::string item = spec.substr(pos, end - pos);
+        std::string::size_type colon = item.find(':');
+        char *num_end = NULL, *percent_end = NULL;
+        long num = 0, percent = -1;
+        if (colon != std::string::npos) {
+            num = strtol(item.c_str(), &num_end, 10);
+            percent = strtol(item.c_str() + colon + 1, &percent_end, 10);
+        }
+        if (colon == std::string::npos || colon == 0 || *percent_end != '\0' ||
+            percent < 0 || percent > 100 ||
+            (item.compare(0, colon, "*") != 0 &&
+             (num_end != item.c_str() + colon || num < 0))) {
+            ERROR("Usage error: invalid -syscall_pollution entry \"%s\".\n",
+                  item.c_str());
+            return false;
+        }
+        if (item.compare(0, colon, "*") == 0)
+            default_pollution = (int)percent;
+        else
+            syscall_pollution[(int)num] = (int)percent;
+        pos = end + 1;
+    }
+    kernel_model = !spec.empty() || op_context_switch_us.get_value() > 0;
+    return true;
+}
+
+int
+simulator_t::kernel_pollution(int core, const memref_t &memref)
+{
+    core_sched[core].syscalls++;
+    if (op_context_switch_us.get_value() > 0 &&
+        memref.addr >= op_context_switch_us.get_value()) {
+        // The thread most likely blocked, and other threads ran in its place.
+        core_sched[core].blocking_syscalls++;
+        return 100;
+    }
+    std::map<int, int>::const_iterator it = syscall_pollution.find((int)memref.size);
+    return it == syscall_pollution.end() ? default_pollution : it->second;
+}
@@ -37,32 +37,104 @@
 #define _SIMULATOR_H_ 1
 
 #include <map>
+#include <set>
+#include <string>
+#include <vector>
 #include "caching_device_stats.h"
 #include "caching_device.h"
-#include "ipc_reader.h"
+#include "interval_stats.h"
+#include "reader.h"
 
 class simulator_t
 {
  public:
-    simulator_t() {}
+    simulator_t() : num_cores(0), reader(NULL), reader_end(NULL), thread_counts(NULL),
+        thread_ever_counts(NULL), sched_time(0), intervals(NULL), kernel_model(false),
+        default_pollution(0) {}
     virtual bool init() = 0;
     virtual ~simulator_t() = 0;
     virtual bool run() = 0;
     virtual bool print_stats() = 0;
 
+    // For checkpoints: appends every device whose contents make up the
+    // simulated state, in a fixed order.  Simulators that do not model
+    // caching devices have none.
+    virtual void get_checkpoint_devices(std::vector<caching_device_t *> &devices) {}
+
  protected:
     virtual int core_for_thread(memref_tid_t tid);
     virtual void handle_thread_exit(memref_tid_t tid);
+    // Handles a TRACE_TYPE_CPU_ID entry, returning the thread's core.
+    virtual int handle_cpu_id(memref_tid_t tid, addr_t cpu);
+    // Prints a core's context switches and migrations if threads are
+    // scheduled dynamically, and its syscalls if the kernel is modeled.
+    void print_core_schedule(int core, const std::string &prefix);
+    // For -syscall_pollution and -context_switch_us, which model the kernel
+    // at the syscall entries of the trace: parses the former.
+    bool init_kernel_model();
+    // For a TRACE_TYPE_SYSCALL_END of a thread on core, returns the percentage
+    // of the lines of the core's private devices that the kernel displaced:
+    // all of them for a syscall that took long enough to have blocked.
+    int kernel_pollution(int core, const memref_t &memref);
+    // Creates either an ipc_reader_t or, if -infile is specified, a
+    // file_reader_t for offline simulation.
+    virtual bool create_reader();
+    // Creates intervals if -interval_refs is specified.  Subclasses then add
+    // their devices to it.
+    bool create_intervals();
+    // For -checkpoint_load, called once the devices exist: restores their
+    // contents and has run() skip warmup.  For -checkpoint_save, called at
+    // the end of warmup, or at the end of the run if there is none.
+    bool load_checkpoint();
+    bool save_checkpoint();
 
     int num_cores;
 
-    ipc_reader_t ipc_end;
-    ipc_reader_t ipc_iter;
+    reader_t *reader;
+    reader_t *reader_end;
+
+    // How many memrefs run() takes from the reader at a time.
+    static const size_t MEMREF_BATCH_SIZE = 256;
 
     // For thread mapping to cores:
     std::map<memref_tid_t, int> thread2core;
     unsigned int *thread_counts;
     unsigned int *thread_ever_counts;
+
+    // For -sched_quantum and -replay_cpus, which move threads between cores.
+    // Subclasses size core_sched to the number of cores and advance sched_time,
+    // the scheduler's clock, once per memref.
+    struct core_sched_t {
+        core_sched_t() : running(0), slice_end(0), switches(0), migrations(0),
+            syscalls(0), blocking_syscalls(0) {}
+        memref_tid_t running; // 0 if the core is idle
+        uint64_t slice_end;
+        int_least64_t switches;
+        int_least64_t migrations;
+        // For the kernel model.
+        int_least64_t syscalls;
+        int_least64_t blocking_syscalls;
+        std::set<memref_tid_t> threads_seen;
+    };
+    std::vector<core_sched_t> core_sched;
+    uint64_t sched_time;
+    // The threads placed by their recorded cpus rather than by the quantum.
+    std::set<memref_tid_t> replayed_threads;
+
+    // For -interval_refs.
+    interval_stats_t *intervals;
+
+    // For the kernel model: whether it is enabled, and the pollution of each
+    // syscall number and of the rest.
+    bool kernel_model;
+    std::map<int, int> syscall_pollution;
+    int default_pollution;
+
+ private:
+    int schedule_thread(memref_tid_t tid);
+    void move_thread(memref_tid_t tid, int from_core, int to_core);
+    void add_to_core(memref_tid_t tid, int core);
+    void run_on_core(memref_tid_t tid, int core);
 };
 
 #endif /* _SIMULATOR_H_ */
@@ -0,0 +1,317 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <assert.h>
+#include <string.h>
+#include <stdint.h> /* for supporting 64-bit integers*/
+#include "utils.h"
+#include "memref.h"
+#include "tag_search.h"
+#include "droption.h"
+#include "../common/options.h"
+#include "stack_distance_simulator.h"
+
+stack_profile_t::stack_profile_t() : levels(NULL), num_levels(0), num_accesses(0)
+{
+}
+
+stack_profile_t::~stack_profile_t()
+{
+    for (int i = 0; i < num_levels; i++) {
+        delete [] levels[i].stacks;
+        delete [] levels[i].distances;
+    }
+    delete [] levels;
+}
+
+bool
+stack_profile_t::init(int line_size_, int max_assoc_, uint64_t max_size)
+{
+    if (!IS_POWER_OF_2(line_size_) || !IS_POWER_OF_2(max_assoc_) ||
+        !IS_POWER_OF_2(max_size) || max_size < (uint64_t)line_size_ ||
+        // Assuming cache line size is at least 4 bytes, as caching_device_t does.
+        line_size_ < 4)
+        return false;
+    line_size = line_size_;
+    line_size_bits = compute_log2(line_size);
+    max_assoc = max_assoc_;
+    uint64_t max_lines = max_size / line_size;
+    for (num_levels = 0; (max_lines >> num_levels) > 0; num_levels++)
+        ; /* empty */
+    levels = new level_t[num_levels];
+    for (int i = 0; i < num_levels; i++) {
+        uint64_t sets = 1ULL << i;
+        // Configurations with this many sets and a larger associativity are
+        // larger than max_size.
+        levels[i].depth = (int)((max_lines >> i) < (uint64_t)max_assoc ?
+                                (max_lines >> i) : max_assoc);
+        size_t entries = (size_t)(sets * levels[i].depth);
+        levels[i].stacks = new addr_t[entries];
+        for (size_t j = 0; j < entries; j++)
+            levels[i].stacks[j] = TAG_INVALID;
+        levels[i].distances = new int_least64_t[levels[i].depth + 1];
+    }
+    reset();
+    return true;
+}
+
+void
+stack_profile_t::access_line(addr_t tag, bool count)
+{
+    for (int i = 0; i < num_levels; i++) {
+        level_t &level = levels[i];
+        addr_t *stack = &level.stacks[(tag & ((1ULL << i) - 1)) * level.depth];
+        int dist = find_tag_way(stack, level.depth, tag);
+        if (count)
+            level.distances[dist]++;
+        // Move the line to the top.  If it was not found, the bottom line drops
+        // out of the part of the stack that we track.
+        if (dist == level.depth)
+            dist--;
+        memmove(&stack[1], &stack[0], dist * sizeof(stack[0]));
+        stack[0] = tag;
+    }
+    if (count)
+        num_accesses++;
+}
+
+void
+stack_profile_t::flush_line(addr_t tag)
+{
+    // Removing a line from every stack invalidates it in every configuration
+    // at once, while the lines below it stay in the same caches.
+    for (int i = 0; i < num_levels; i++) {
+        level_t &level = levels[i];
+        addr_t *stack = &level.stacks[(tag & ((1ULL << i) - 1)) * level.depth];
+        int dist = find_tag_way(stack, level.depth, tag);
+        if (dist == level.depth)
+            continue;
+        memmove(&stack[dist], &stack[dist + 1],
+                (level.depth - dist - 1) * sizeof(stack[0]));
+        stack[level.depth - 1] = TAG_INVALID;
+    }
+}
+
+void
+stack_profile_t::access(addr_t addr, int size, bool count)
+{
+    addr_t tag = addr >> line_size_bits;
+    addr_t final_tag = (addr + size - 1/*avoid overflow*/) >> line_size_bits;
+    for (; tag <= final_tag; ++tag)
+        access_line(tag, count);
+}
+
+void
+stack_profile_t::flush(addr_t addr, int size)
+{
+    addr_t tag = addr >> line_size_bits;
+    addr_t final_tag = (addr + size - 1/*avoid overflow*/) >> line_size_bits;
+    for (; tag <= final_tag; ++tag)
+        flush_line(tag);
+}
+
+void
+stack_profile_t::reset()
+{
+    for (int i = 0; i < num_levels; i++) {
+        for (int j = 0; j <= levels[i].depth; j++)
+            levels[i].distances[j] = 0;
+    }
+    num_accesses = 0;
+}
+
+static std::string
+size_string(uint64_t size)
+{
+    std::ostringstream ss;
+    if (size >= 1024*1024 && size % (1024*1024) == 0)
+        ss << size / (1024*1024) << "M";
+    else if (size >= 1024 && size % 1024 == 0)
+        ss << size / 1024 << "K";
+    else
+        ss << size;
+    return ss.str();
+}
+
+void
+stack_profile_t::print(std::string prefix)
+{
+    std::cerr.imbue(std::locale("")); // Add commas, at least for my locale
+    std::cerr << prefix << std::setw(18) << std::left << "Accesses:" <<
+        std::setw(20) << std::right << num_accesses << std::endl;
+    if (num_accesses == 0)
+        return;
+    std::cerr << prefix << "Miss rates by total size (rows) and associativity:" <<
+        std::endl;
+    std::cerr << prefix << std::setw(10) << std::left << "Size";
+    for (int assoc = 1; assoc <= max_assoc; assoc *= 2) {
+        std::ostringstream label;
+        label << assoc << "-way";
+        std::cerr << std::setw(9) << std::right << label.str();
+    }
+    std::cerr << std::endl;
+    for (int lines_bits = 0; lines_bits < num_levels; lines_bits++) {
+        std::cerr << prefix << std::setw(10) << std::left <<
+            size_string((uint64_t)line_size << lines_bits);
+        for (int assoc = 1, assoc_bits = 0; assoc <= max_assoc;
+             assoc *= 2, assoc_bits++) {
+            if (assoc_bits > lines_bits) {
+                std::cerr << std::setw(9) << std::right << "-";
+                continue;
+            }
+            // This configuration has 1 << (lines_bits - assoc_bits) sets.
+            const level_t &level = levels[lines_bits - assoc_bits];
+            assert(assoc <= level.depth);
+            int_least64_t hits = 0;
+            for (int dist = 0; dist < assoc; dist++)
+                hits += level.distances[dist];
+            std::cerr << std::setw(8) << std::right << std::fixed <<
+                std::setprecision(2) <<
+                ((float)(num_accesses - hits)*100/num_accesses) << "%";
+        }
+        std::cerr << std::endl;
+    }
+}
+
+bool
+stack_distance_simulator_t::init()
+{
+    if (!create_reader())
+        return false;
+
+    // We do not model cores.
+    num_cores = 1;
+    thread_counts = NULL;
+    thread_ever_counts = NULL;
+
+    if (!iprofile.init(op_line_size.get_value(), op_sd_max_assoc.get_value(),
+                       op_sd_max_size.get_value()) ||
+        !dprofile.init(op_line_size.get_value(), op_sd_max_assoc.get_value(),
+                       op_sd_max_size.get_value())) {
+        ERROR("Usage error: failed to initialize stack distance profiles.  Ensure "
+              "the line size, maximum size, and maximum associativity are powers "
+              "of 2 and that the maximum size is at least the line size.\n");
+        return false;
+    }
+    return true;
+}
+
+stack_distance_simulator_t::~stack_distance_simulator_t()
+{
+}
+
+bool
+stack_distance_simulator_t::run()
+{
+    if (!reader->init()) {
+        if (op_infile.get_value().empty())
+            ERROR("failed to read from pipe %s", op_ipc_name.get_value().c_str());
+        else
+            ERROR("failed to read from %s", op_infile.get_value().c_str());
+        return false;
+    }
+
+    uint64_t warmup_refs = op_warmup_refs.get_value();
+    uint64_t sim_refs = op_sim_refs.get_value();
+
+    // The reader can skip faster than we can by iterating, e.g., by
+    // seeking past whole chunks of a compressed trace file.
+    reader->skip_memrefs(op_skip_refs.get_value());
+
+    for (; *reader != *reader_end; ++(*reader)) {
+        memref_t memref = **reader;
+
+        // the references after warmup and simulated ones are dropped
+        if (warmup_refs == 0 && sim_refs == 0)
+            continue;
+
+        if (memref.type == TRACE_TYPE_INSTR)
+            iprofile.access(memref.addr, memref.size, true);
+        else if (memref.type == TRACE_TYPE_PREFETCH_INSTR)
+            iprofile.access(memref.addr, memref.size, false);
+        else if (memref.type == TRACE_TYPE_READ ||
+                 memref.type == TRACE_TYPE_WRITE)
+            dprofile.access(memref.addr, memref.size, true);
+        else if (type_is_prefetch(memref.type)) {
+            // Like cache_stats_t, we keep prefetches out of the miss rates.
+            dprofile.access(memref.addr, memref.size, false);
+        } else if (memref.type == TRACE_TYPE_INSTR_FLUSH)
+            iprofile.flush(memref.addr, memref.size);
+        else if (memref.type == TRACE_TYPE_DATA_FLUSH)
+            dprofile.flush(memref.addr, memref.size);
+        else if (memref.type != TRACE_TYPE_THREAD_EXIT &&
+                 memref.type != TRACE_TYPE_CPU_ID &&
+                 memref.type != TRACE_TYPE_ALLOC &&
+                 memref.type != TRACE_TYPE_FREE &&
+                 memref.type != TRACE_TYPE_SYSCALL &&
+                 memref.type != TRACE_TYPE_SYSCALL_END) {
+            ERROR("unhandled memref type");
+            return false;
+        }
+
+        if (op_verbose.get_value() >= 3) {
+            std::cerr << "::" << memref.pid << "." << memref.tid << ":: " <<
+                " @" << (void *)memref.pc <<
+                " " << trace_type_names[memref.type] << " " <<
+                (void *)memref.addr << " x" << memref.size << std::endl;
+        }
+
+        // process counters for warmup and simulated references
+        if (warmup_refs > 0) {
+            warmup_refs--;
+            if (warmup_refs == 0) {
+                iprofile.reset();
+                dprofile.reset();
+            }
+        }
+        else {
+            sim_refs--;
+        }
+    }
+    return true;
+}
+
+bool
+stack_distance_simulator_t::print_stats()
+{
+    std::cerr << "LRU stack distance profile, all threads (line size " <<
+        op_line_size.get_value() << "):" << std::endl;
+    std::cerr << "  Instruction stats:" << std::endl;
+    iprofile.print("    ");
+    std::cerr << "  Data stats:" << std::endl;
+    dprofile.print("    ");
+    return true;
+}
@@ -0,0 +1,96 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* stack_distance_simulator: computes LRU miss rates for many cache
+ * configurations in a single pass over the trace.
+ */
+
+#ifndef _STACK_DISTANCE_SIMULATOR_H_
+#define _STACK_DISTANCE_SIMULATOR_H_ 1
+
+#include <string>
+#include "simulator.h"
+
+// Records the LRU stack distance of each access to one stream of cache lines,
+// separately for every power-of-two number of sets.  By the inclusion property
+// of LRU, an access hits in a cache with S sets and associativity A exactly
+// when its distance within its set's stack, for S sets, is less than A.
+class stack_profile_t
+{
+ public:
+    stack_profile_t();
+    ~stack_profile_t();
+    bool init(int line_size, int max_assoc, uint64_t max_size);
+    // A reference touching several lines counts as one access per line.
+    // Accesses with count=false update the stacks without being recorded.
+    void access(addr_t addr, int size, bool count);
+    void flush(addr_t addr, int size);
+    void reset();
+    void print(std::string prefix);
+
+ protected:
+    void access_line(addr_t tag, bool count);
+    void flush_line(addr_t tag);
+
+    // One level per number of sets, which is 1 << level.
+    struct level_t {
+        // The deepest distance that matters: beyond it, every configuration
+        // with this many sets misses.
+        int depth;
+        // The stacks of all sets, depth entries each, most recent first.
+        addr_t *stacks;
+        // The count of accesses at each distance, plus one for "beyond depth".
+        int_least64_t *distances;
+    };
+    level_t *levels;
+    int num_levels;
+    int line_size;
+    int line_size_bits;
+    int max_assoc;
+    int_least64_t num_accesses;
+};
+
+class stack_distance_simulator_t : public simulator_t
+{
+ public:
+    virtual bool init();
+    virtual ~stack_distance_simulator_t();
+    virtual bool run();
+    virtual bool print_stats();
+
+ protected:
+    // Like the L1 caches of the cache simulator, but shared by all threads.
+    stack_profile_t iprofile;
+    stack_profile_t dprofile;
+};
+
+#endif /* _STACK_DISTANCE_SIMULATOR_H_ */
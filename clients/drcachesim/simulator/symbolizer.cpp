@@ -0,0 +1,150 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <sstream>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dr_api.h"
+#include "drsyms.h"
+#include "droption.h"
+#include "../common/named_pipe.h"
+#include "../common/options.h"
+#include "../common/trace_entry.h"
+#include "symbolizer.h"
+
+symbolizer_t::symbolizer_t() : remove_files(false), drsyms_initialized(false)
+{
+}
+
+symbolizer_t::~symbolizer_t()
+{
+    if (drsyms_initialized)
+        drsym_exit();
+}
+
+std::string
+symbolizer_t::process_file_prefix(bool *online)
+{
+    *online = op_infile.get_value().empty();
+    if (!*online) {
+        std::string dir = op_infile.get_value();
+        struct stat st;
+        if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            size_t sep = dir.rfind('/');
+            dir = (sep == std::string::npos) ? "." : dir.substr(0, sep);
+        }
+        return dir + "/" + OUTFILE_PREFIX;
+    }
+    named_pipe_t pipe(op_ipc_name.get_value().c_str());
+    return pipe.get_pipe_path();
+}
+
+void
+symbolizer_t::init()
+{
+    prefix = process_file_prefix(&remove_files);
+    dr_standalone_init();
+    drsyms_initialized = (drsym_init(0) == DRSYM_SUCCESS);
+}
+
+const std::vector<symbolizer_t::module_t> &
+symbolizer_t::get_modules(memref_pid_t pid)
+{
+    std::map<memref_pid_t, std::vector<module_t> >::iterator it = modules.find(pid);
+    if (it != modules.end())
+        return it->second;
+    std::vector<module_t> &list = modules[pid];
+    std::ostringstream path;
+    path << prefix << "." << pid << "." MODULE_FILE_SUFFIX;
+    FILE *f = fopen(path.str().c_str(), "r");
+    if (f == NULL)
+        return list;
+    char line[4096];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long long start, end;
+        int len;
+        if (sscanf(line, "%llx %llx %n", &start, &end, &len) < 2)
+            continue;
+        module_t mod;
+        mod.start = (addr_t)start;
+        mod.end = (addr_t)end;
+        mod.path = std::string(line + len);
+        if (!mod.path.empty() && mod.path[mod.path.size() - 1] == '\n')
+            mod.path.erase(mod.path.size() - 1);
+        list.push_back(mod);
+    }
+    fclose(f);
+    if (remove_files)
+        unlink(path.str().c_str());
+    return list;
+}
+
+std::string
+symbolizer_t::describe(memref_pid_t pid, addr_t pc)
+{
+    std::ostringstream desc;
+    const std::vector<module_t> &list = get_modules(pid);
+    const module_t *mod = NULL;
+    // Later loads at the same address take precedence.
+    for (size_t i = list.size(); i > 0; i--) {
+        if (pc >= list[i - 1].start && pc < list[i - 1].end) {
+            mod = &list[i - 1];
+            break;
+        }
+    }
+    if (mod == NULL)
+        return "<unknown module>";
+    size_t modoffs = pc - mod->start;
+    std::string modname = mod->path.substr(mod->path.rfind('/') + 1);
+    desc << modname << "+0x" << std::hex << modoffs;
+    if (!drsyms_initialized)
+        return desc.str();
+    drsym_info_t info;
+    char name[256];
+    char file[MAXIMUM_PATH];
+    info.struct_size = sizeof(info);
+    info.name = name;
+    info.name_size = sizeof(name);
+    info.file = file;
+    info.file_size = sizeof(file);
+    drsym_error_t res = drsym_lookup_address(mod->path.c_str(), modoffs, &info,
+                                             DRSYM_DEMANGLE);
+    if (res == DRSYM_SUCCESS || res == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
+        desc << " " << name << "+0x" << (modoffs - info.start_offs);
+        if (res == DRSYM_SUCCESS)
+            desc << " " << file << ":" << std::dec << info.line;
+    }
+    return desc.str();
+}
@@ -0,0 +1,77 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* symbolizer: maps instruction addresses to modules, symbols, and lines.
+ */
+
+#ifndef _SYMBOLIZER_H_
+#define _SYMBOLIZER_H_ 1
+
+#include <map>
+#include <string>
+#include <vector>
+#include "memref.h"
+
+// Uses the module lists written by the tracer (see MODULE_FILE_SUFFIX) and
+// drsyms to describe instruction addresses.
+class symbolizer_t
+{
+ public:
+    symbolizer_t();
+    ~symbolizer_t();
+    // Locates the module lists for the current -infile or -ipc_name.
+    void init();
+    // Returns the module, symbol, and source line containing pc in process pid,
+    // as far as they are known.
+    std::string describe(memref_pid_t pid, addr_t pc);
+    // Returns the prefix of the per-process files the tracer writes next
+    // to the trace for the current -infile or -ipc_name, setting *online for
+    // -ipc_name.
+    static std::string process_file_prefix(bool *online);
+
+ protected:
+    struct module_t {
+        addr_t start;
+        addr_t end;
+        std::string path;
+    };
+    const std::vector<module_t> &get_modules(memref_pid_t pid);
+
+    // The module list of pid is named prefix.<pid>.MODULE_FILE_SUFFIX.
+    std::string prefix;
+    // Online, we remove the lists once we've read them.
+    bool remove_files;
+    bool drsyms_initialized;
+    std::map<memref_pid_t, std::vector<module_t> > modules;
+};
+
+#endif /* _SYMBOLIZER_H_ */
@@ -0,0 +1,116 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* tag_search: finds a tag within one set of a caching device.
+ */
+
+#ifndef _TAG_SEARCH_H_
+#define _TAG_SEARCH_H_ 1
+
+#include "caching_device_block.h"
+
+// We use whatever vector extensions the compiler targets: SSE2 is always
+// present on x86-64, while AVX2 requires building with e.g. -mavx2 or
+// -march=native.  Other targets use the scalar loop.
+#if defined(__AVX2__) || defined(__SSE2__)
+# include <immintrin.h>
+#elif defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
+
+// Returns the lowest way in [start_way, associativity) whose tag equals tag,
+// or associativity if there is none.  The set's tags must be contiguous.
+static inline int
+find_tag_way(const addr_t *tags, int associativity, addr_t tag, int start_way = 0)
+{
+    int way = start_way;
+    // The simulator does not include dr_api.h, so X64 is not defined here.
+#if defined(X86_64) || defined(ARM_64)
+# if defined(__AVX2__)
+    const __m256i needle = _mm256_set1_epi64x(tag);
+    for (; way + 4 <= associativity; way += 4) {
+        __m256i cmp = _mm256_cmpeq_epi64
+            (_mm256_loadu_si256((const __m256i *)&tags[way]), needle);
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(cmp));
+        if (mask != 0)
+            return way + __builtin_ctz(mask);
+    }
+# elif defined(__SSE2__)
+    // SSE2 has no 64-bit compare: a 64-bit lane matches if both of its
+    // 32-bit halves match.
+    const __m128i needle = _mm_set1_epi64x(tag);
+    for (; way + 2 <= associativity; way += 2) {
+        __m128i cmp = _mm_cmpeq_epi32
+            (_mm_loadu_si128((const __m128i *)&tags[way]), needle);
+        cmp = _mm_and_si128(cmp, _mm_shuffle_epi32(cmp, _MM_SHUFFLE(2, 3, 0, 1)));
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(cmp));
+        if (mask != 0)
+            return way + __builtin_ctz(mask);
+    }
+# elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint64x2_t needle = vdupq_n_u64(tag);
+    for (; way + 2 <= associativity; way += 2) {
+        uint64x2_t cmp = vceqq_u64(vld1q_u64((const uint64_t *)&tags[way]), needle);
+        if (vgetq_lane_u64(cmp, 0) != 0)
+            return way;
+        if (vgetq_lane_u64(cmp, 1) != 0)
+            return way + 1;
+    }
+# endif
+#else
+# if defined(__SSE2__)
+    const __m128i needle = _mm_set1_epi32(tag);
+    for (; way + 4 <= associativity; way += 4) {
+        __m128i cmp = _mm_cmpeq_epi32
+            (_mm_loadu_si128((const __m128i *)&tags[way]), needle);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(cmp));
+        if (mask != 0)
+            return way + __builtin_ctz(mask);
+    }
+# elif defined(__ARM_NEON)
+    const uint32x4_t needle = vdupq_n_u32(tag);
+    for (; way + 4 <= associativity; way += 4) {
+        uint32x4_t cmp = vceqq_u32(vld1q_u32((const uint32_t *)&tags[way]), needle);
+        uint32x2_t any = vorr_u32(vget_low_u32(cmp), vget_high_u32(cmp));
+        if (vget_lane_u32(vpmax_u32(any, any), 0) != 0)
+            break; // The scalar loop below finds which way.
+    }
+# endif
+#endif
+    for (; way < associativity; ++way) {
+        if (tags[way] == tag)
+            return way;
+    }
+    return associativity;
+}
+
+#endif /* _TAG_SEARCH_H_ */
@@ -34,12 +34,30 @@
 #include "utils.h"
 #include <assert.h>
 
+tlb_t::~tlb_t()
+{
+    delete [] pids;
+}
+
 void
 tlb_t::init_blocks()
 {
-    for (int i = 0; i < num_blocks; i++) {
-        blocks[i] = new tlb_entry_t;
-    }
+    pids = new memref_pid_t[num_blocks];
+    for (int i = 0; i < num_blocks; i++)
+        pids[i] = 0;
+}
+
+bool
+tlb_t::save_blocks(std::ostream &out)
+{
+    out.write((const char *)pids, num_blocks * sizeof(pids[0]));
+    return out.good();
+}
+
+bool
+tlb_t::restore_blocks(std::istream &in)
+{
+    return (bool)in.read((char *)pids, num_blocks * sizeof(pids[0]));
 }
 
 void
@@ -54,38 +72,43 @@ tlb_t::request(const memref_t &memref_in)
     // the right data struct to the parent and stats collectors.
     memref_t memref;
     // We support larger sizes to improve the IPC perf.
-    // This means that one memref could touch multiple blocks.
-    // We treat each block separately for statistics purposes.
+    // This means that one memref could touch multiple pages.
+    // We treat each page separately for statistics purposes.
     addr_t final_addr = memref_in.addr + memref_in.size - 1/*avoid overflow*/;
-    addr_t final_tag = compute_tag(final_addr);
-    addr_t tag = compute_tag(memref_in.addr);
+    int bits = page_bits(memref_in.addr);
+    addr_t tag = compute_page_tag(memref_in.addr, bits);
     memref_pid_t pid = memref_in.pid;
 
-    // Optimization: check last tag and pid if single-block
-    if (tag == final_tag && tag == last_tag && pid == last_pid) {
+    // Optimization: check last tag and pid if single-page
+    if ((final_addr >> bits) == (memref_in.addr >> bits) &&
+        tag == last_tag && pid == last_pid) {
         // Make sure last_tag and pid are properly in sync.
         assert(tag != TAG_INVALID &&
-               tag == get_caching_device_block(last_block_idx, last_way).tag &&
-               pid == ((tlb_entry_t &)get_caching_device_block(
-                       last_block_idx, last_way)).pid);
+               tag == get_tag(last_block_idx, last_way) &&
+               pid == get_pid(last_block_idx, last_way));
         stats->access(memref_in, true/*hit*/);
         if (parent != NULL)
             parent->get_stats()->child_access(memref_in, true);
-        access_update(last_block_idx, last_way);
+        lfu_policy_t::access_update(&counters[last_block_idx], associativity,
+                                    last_way);
         return;
     }
 
     memref = memref_in;
-    for (; tag <= final_tag; ++tag) {
+    while (true) {
         int way;
         int block_idx = compute_block_idx(tag);
+        addr_t page_last = memref.addr | (((addr_t)1 << bits) - 1);
+        bool more = page_last < final_addr;
 
-        if (tag + 1 <= final_tag)
-            memref.size = ((tag + 1) << block_size_bits) - memref.addr;
+        if (more)
+            memref.size = page_last + 1 - memref.addr;
 
-        for (way = 0; way < associativity; ++way) {
-            if (get_caching_device_block(block_idx, way).tag == tag &&
-                ((tlb_entry_t &)get_caching_device_block(block_idx, way)).pid == pid) {
+        // The same page may be present for several processes.
+        for (way = find_tag_way(&tags[block_idx], associativity, tag);
+             way < associativity;
+             way = find_tag_way(&tags[block_idx], associativity, tag, way + 1)) {
+            if (get_pid(block_idx, way) == pid) {
                 stats->access(memref, true/*hit*/);
                 if (parent != NULL)
                     parent->get_stats()->child_access(memref, true);
@@ -103,22 +126,26 @@ tlb_t::request(const memref_t &memref_in)
 
             // XXX: do we need to handle TLB coherency?
 
-            way = replace_which_way(block_idx);
-            get_caching_device_block(block_idx, way).tag = tag;
-            ((tlb_entry_t &)get_caching_device_block(block_idx, way)).pid = pid;
+            way = lfu_policy_t::replace_which_way(&tags[block_idx],
+                                                  &counters[block_idx],
+                                                  associativity);
+            get_tag(block_idx, way) = tag;
+            get_pid(block_idx, way) = pid;
         }
 
-        access_update(block_idx, way);
+        lfu_policy_t::access_update(&counters[block_idx], associativity, way);
 
-        if (tag + 1 <= final_tag) {
-            addr_t next_addr = (tag + 1) << block_size_bits;
-            memref.addr = next_addr;
-            memref.size = final_addr - next_addr + 1/*undo the -1*/;
-        }
         // Optimization: remember last tag and pid
         last_tag = tag;
         last_way = way;
         last_block_idx = block_idx;
         last_pid = pid;
+
+        if (!more)
+            break;
+        memref.addr = page_last + 1;
+        memref.size = final_addr - memref.addr + 1/*undo the -1*/;
+        bits = page_bits(memref.addr);
+        tag = compute_page_tag(memref.addr, bits);
     }
 }
@@ -37,18 +37,51 @@
 #define _TLB_H_ 1
 
 #include "caching_device.h"
-#include "tlb_entry.h"
+#include "page_map.h"
 #include "tlb_stats.h"
 
+// A TLB using LFU replacement.
 class tlb_t : public caching_device_t
 {
  public:
+    tlb_t() : pids(NULL), page_map(NULL) {}
+    virtual ~tlb_t();
     virtual void request(const memref_t &memref);
+    // By default every entry translates a page of the block size passed to
+    // init().  With a page map, each entry instead translates a page of the
+    // size the map gives for its address, and pages of all sizes share the
+    // entries.
+    void set_page_map(page_map_t *map) { page_map = map; }
  protected:
     virtual void init_blocks();
+    virtual bool save_blocks(std::ostream &out);
+    virtual bool restore_blocks(std::istream &in);
+
+    inline int page_bits(addr_t addr) {
+        return page_map == NULL ? block_size_bits : page_map->page_bits(addr);
+    }
+    inline addr_t compute_page_tag(addr_t addr, int bits) {
+        addr_t tag = addr >> bits;
+        // The tags of pages of other sizes hold the size in their top bits,
+        // which are otherwise zero, so they do not match.
+        if (bits != block_size_bits)
+            tag |= (addr_t)bits << (sizeof(addr_t) * 8 - 6);
+        return tag;
+    }
+
+    inline memref_pid_t &get_pid(int block_idx, int way) {
+        return pids[block_idx + way];
+    }
+
+    // The process ID of each entry, to differentiate virtual pages
+    // that have the same VPN but belong to different processes.
+    // XXX: support page privilege and MMU-related exceptions
+    memref_pid_t *pids;
 
     // Optimization: remember last pid in addition to last tag
     memref_pid_t last_pid;
+
+    page_map_t *page_map;
 };
 
 #endif /* _TLB_H_ */
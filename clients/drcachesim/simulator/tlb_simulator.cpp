@@ -32,13 +32,13 @@
 
 #include <iostream>
 #include <iterator>
+#include <sstream>
 #include <string>
 #include <assert.h>
 #include <limits.h>
 #include <stdint.h> /* for supporting 64-bit integers*/
 #include "utils.h"
 #include "memref.h"
-#include "ipc_reader.h"
 #include "tlb_stats.h"
 #include "tlb.h"
 #include "droption.h"
@@ -48,19 +48,51 @@
 bool
 tlb_simulator_t::init()
 {
-    // XXX: add a "required" flag to droption to avoid needing this here
-    if (op_ipc_name.get_value().empty()) {
-        ERROR("Usage error: ipc name is required\nUsage:\n%s",
-              droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
+    if (!create_reader())
         return false;
-    }
-    ipc_iter = ipc_reader_t(op_ipc_name.get_value().c_str());
 
-    num_cores = op_num_cores.get_value();
+    if (!create_tlbs(op_num_cores.get_value()))
+        return false;
+
+    thread_counts = new unsigned int[num_cores];
+    memset(thread_counts, 0, sizeof(thread_counts[0])*num_cores);
+    thread_ever_counts = new unsigned int[num_cores];
+    memset(thread_ever_counts, 0, sizeof(thread_ever_counts[0])*num_cores);
+    core_sched.resize(num_cores);
+
+    if (!create_intervals())
+        return false;
+    if (intervals != NULL)
+        add_interval_devices(intervals, "");
+    if (!init_kernel_model())
+        return false;
+
+    return true;
+}
+
+bool
+tlb_simulator_t::create_tlbs(int cores)
+{
+    num_cores = cores;
+
+    if (!op_page_size_file.get_value().empty()) {
+        page_map = new page_map_t(compute_log2((int)op_page_size.get_value()));
+        if (!page_map->init(op_page_size_file.get_value()))
+            return false;
+    } else if (op_TLB_L1I_huge_entries.get_value() > 0 ||
+               op_TLB_L1D_huge_entries.get_value() > 0) {
+        ERROR("Usage error: -TLB_L1I_huge_entries and -TLB_L1D_huge_entries "
+              "require -page_size_file.\n");
+        return false;
+    }
 
     itlbs = new tlb_t* [num_cores];
     dtlbs = new tlb_t* [num_cores];
     lltlbs = new tlb_t* [num_cores];
+    if (op_TLB_L1I_huge_entries.get_value() > 0)
+        ihtlbs = new tlb_t* [num_cores]();
+    if (op_TLB_L1D_huge_entries.get_value() > 0)
+        dhtlbs = new tlb_t* [num_cores]();
     for (int i = 0; i < num_cores; i++) {
         itlbs[i] = create_tlb(op_TLB_replace_policy.get_value());
         if (itlbs[i] == NULL)
@@ -82,16 +114,40 @@ tlb_simulator_t::init()
                   "page size and associativity are powers of 2.\n");
             return false;
         }
-    }
-
-    thread_counts = new unsigned int[num_cores];
-    memset(thread_counts, 0, sizeof(thread_counts[0])*num_cores);
-    thread_ever_counts = new unsigned int[num_cores];
-    memset(thread_ever_counts, 0, sizeof(thread_ever_counts[0])*num_cores);
+        itlbs[i]->set_page_map(page_map);
+        dtlbs[i]->set_page_map(page_map);
+        lltlbs[i]->set_page_map(page_map);
 
+        if (ihtlbs != NULL) {
+            ihtlbs[i] = create_huge_tlb(op_TLB_L1I_huge_entries.get_value(), lltlbs[i]);
+            if (ihtlbs[i] == NULL)
+                return false;
+        }
+        if (dhtlbs != NULL) {
+            dhtlbs[i] = create_huge_tlb(op_TLB_L1D_huge_entries.get_value(), lltlbs[i]);
+            if (dhtlbs[i] == NULL)
+                return false;
+        }
+    }
     return true;
 }
 
+void
+tlb_simulator_t::add_interval_devices(interval_stats_t *to, const std::string &prefix)
+{
+    for (int i = 0; i < num_cores; i++) {
+        std::ostringstream core;
+        core << prefix << "core" << i << "_";
+        to->add_device(core.str() + "L1I", itlbs[i]->get_stats());
+        if (ihtlbs != NULL)
+            to->add_device(core.str() + "L1I_huge", ihtlbs[i]->get_stats());
+        to->add_device(core.str() + "L1D", dtlbs[i]->get_stats());
+        if (dhtlbs != NULL)
+            to->add_device(core.str() + "L1D_huge", dhtlbs[i]->get_stats());
+        to->add_device(core.str() + "LL", lltlbs[i]->get_stats());
+    }
+}
+
 tlb_simulator_t::~tlb_simulator_t()
 {
     for (int i = 0; i < num_cores; i++) {
@@ -105,6 +161,19 @@ tlb_simulator_t::~tlb_simulator_t()
     delete [] itlbs;
     delete [] dtlbs;
     delete [] lltlbs;
+    for (int i = 0; i < num_cores; i++) {
+        if (ihtlbs != NULL && ihtlbs[i] != NULL) {
+            delete ihtlbs[i]->get_stats();
+            delete ihtlbs[i];
+        }
+        if (dhtlbs != NULL && dhtlbs[i] != NULL) {
+            delete dhtlbs[i]->get_stats();
+            delete dhtlbs[i];
+        }
+    }
+    delete [] ihtlbs;
+    delete [] dhtlbs;
+    delete page_map;
     delete [] thread_counts;
     delete [] thread_ever_counts;
 }
@@ -112,89 +181,128 @@ tlb_simulator_t::~tlb_simulator_t()
 bool
 tlb_simulator_t::run()
 {
-    if (!ipc_iter.init()) {
-        ERROR("failed to read from pipe %s", op_ipc_name.get_value().c_str());
+    if (!reader->init()) {
+        if (op_infile.get_value().empty())
+            ERROR("failed to read from pipe %s", op_ipc_name.get_value().c_str());
+        else
+            ERROR("failed to read from %s", op_infile.get_value().c_str());
         return false;
     }
     memref_tid_t last_thread = 0;
     int last_core = 0;
 
-    uint64_t skip_refs = op_skip_refs.get_value();
     uint64_t warmup_refs = op_warmup_refs.get_value();
     uint64_t sim_refs = op_sim_refs.get_value();
 
-    // XXX i#1703: add options to select either ipc_reader_t or
-    // a recorded trace file reader, and use a base class reader_t
-    // here.
-    for (; ipc_iter != ipc_end; ++ipc_iter) {
-        memref_t memref = *ipc_iter;
-        if (skip_refs > 0) {
-            skip_refs--;
-            continue;
-        }
+    // The reader can skip faster than we can by iterating, e.g., by
+    // seeking past whole chunks of a compressed trace file.
+    reader->skip_memrefs(op_skip_refs.get_value());
 
-        // the references after warmup and simulated ones are dropped
-        if (warmup_refs == 0 && sim_refs == 0)
-            continue;
-
-        // both warmup and simulated references are simulated
-
-        // We use a static scheduling of threads to cores, as it is
-        // not practical to measure which core each thread actually
-        // ran on for each memref.
-        int core;
-        if (memref.tid == last_thread)
-            core = last_core;
-        else {
-            core = core_for_thread(memref.tid);
-            last_thread = memref.tid;
-            last_core = core;
-        }
-
-        if (memref.type == TRACE_TYPE_INSTR)
-            itlbs[core]->request(memref);
-        else if (memref.type == TRACE_TYPE_READ ||
-                 memref.type == TRACE_TYPE_WRITE)
-            dtlbs[core]->request(memref);
-        else if (memref.type == TRACE_TYPE_THREAD_EXIT) {
-            handle_thread_exit(memref.tid);
-            last_thread = 0;
-        }
-        else if (type_is_prefetch(memref.type) ||
-                 memref.type == TRACE_TYPE_INSTR_FLUSH ||
-                 memref.type == TRACE_TYPE_DATA_FLUSH) {
-            // TLB simulator ignores prefetching and cache flushing
-        } else {
-            ERROR("unhandled memref type");
+    if (!op_checkpoint_load.get_value().empty()) {
+        if (!load_checkpoint())
             return false;
-        }
+        warmup_refs = 0;
+    }
 
-        if (op_verbose.get_value() >= 3) {
-            std::cerr << "::" << memref.pid << "." << memref.tid << ":: " <<
-                " @" << (void *)memref.pc <<
-                " " << trace_type_names[memref.type] << " " <<
-                (void *)memref.addr << " x" << memref.size << std::endl;
-        }
+    memref_t batch[MEMREF_BATCH_SIZE];
+    size_t batch_size;
+    while ((batch_size = reader->next_batch(batch, MEMREF_BATCH_SIZE)) > 0) {
+        for (size_t idx = 0; idx < batch_size; ++idx) {
+            const memref_t &memref = batch[idx];
+
+            // the references after warmup and simulated ones are dropped
+            if (warmup_refs == 0 && sim_refs == 0)
+                continue;
+
+            // both warmup and simulated references are simulated
+
+            // By default we use a static scheduling of threads to cores;
+            // -sched_quantum and -replay_cpus move threads between cores,
+            // which they only do at a change of thread or a cpu id entry.
+            ++sched_time;
+            int core;
+            if (memref.tid == last_thread && memref.type != TRACE_TYPE_CPU_ID)
+                core = last_core;
+            else {
+                if (memref.type == TRACE_TYPE_CPU_ID)
+                    core = handle_cpu_id(memref.tid, memref.addr);
+                else
+                    core = core_for_thread(memref.tid);
+                last_thread = memref.tid;
+                last_core = core;
+            }
+
+            if (memref.type == TRACE_TYPE_INSTR ||
+                memref.type == TRACE_TYPE_READ ||
+                memref.type == TRACE_TYPE_WRITE)
+                translate(core, memref);
+            else if (memref.type == TRACE_TYPE_THREAD_EXIT) {
+                handle_thread_exit(memref.tid);
+                last_thread = 0;
+            }
+            else if (memref.type == TRACE_TYPE_SYSCALL_END) {
+                if (kernel_model)
+                    pollute_core(core, kernel_pollution(core, memref), memref);
+            }
+            else if (type_is_prefetch(memref.type) ||
+                     memref.type == TRACE_TYPE_INSTR_FLUSH ||
+                     memref.type == TRACE_TYPE_DATA_FLUSH ||
+                     memref.type == TRACE_TYPE_CPU_ID ||
+                     memref.type == TRACE_TYPE_ALLOC ||
+                     memref.type == TRACE_TYPE_FREE ||
+                     memref.type == TRACE_TYPE_SYSCALL) {
+                // TLB simulator ignores prefetching, cache flushing, and
+                // allocations, and cpu ids are only used for scheduling, above.
+            } else {
+                ERROR("unhandled memref type");
+                return false;
+            }
 
-        // process counters for warmup and simulated references
-        if (warmup_refs > 0) { // warm tlbs up
-            warmup_refs--;
-            // reset tlb stats when warming up is completed
-            if (warmup_refs == 0) {
-                for (int i = 0; i < num_cores; i++) {
-                    itlbs[i]->get_stats()->reset();
-                    dtlbs[i]->get_stats()->reset();
-                    lltlbs[i]->get_stats()->reset();
+            if (op_verbose.get_value() >= 3) {
+                std::cerr << "::" << memref.pid << "." << memref.tid << ":: " <<
+                    " @" << (void *)memref.pc <<
+                    " " << trace_type_names[memref.type] << " " <<
+                    (void *)memref.addr << " x" << memref.size << std::endl;
+            }
+
+            // process counters for warmup and simulated references
+            if (warmup_refs > 0) { // warm tlbs up
+                warmup_refs--;
+                // reset tlb stats when warming up is completed
+                if (warmup_refs == 0) {
+                    reset_tlb_stats();
+                    if (!op_checkpoint_save.get_value().empty() && !save_checkpoint())
+                        return false;
                 }
             }
-        }
-        else {
-            sim_refs--;
+            else {
+                sim_refs--;
+                if (intervals != NULL)
+                    intervals->record(memref);
+            }
         }
     }
+    if (intervals != NULL)
+        intervals->finish();
+    if (op_warmup_refs.get_value() == 0 && !op_checkpoint_save.get_value().empty())
+        return save_checkpoint();
     return true;
 }
 
+void
+tlb_simulator_t::get_checkpoint_devices(std::vector<caching_device_t *> &devices)
+{
+    for (int i = 0; i < num_cores; i++) {
+        devices.push_back(itlbs[i]);
+        devices.push_back(dtlbs[i]);
+        devices.push_back(lltlbs[i]);
+        if (ihtlbs != NULL)
+            devices.push_back(ihtlbs[i]);
+        if (dhtlbs != NULL)
+            devices.push_back(dhtlbs[i]);
+    }
+}
+
 bool
 tlb_simulator_t::print_stats()
 {
@@ -202,17 +310,74 @@ tlb_simulator_t::print_stats()
         unsigned int threads = thread_ever_counts[i];
         std::cerr << "Core #" << i << " (" << threads << " thread(s))" << std::endl;
         if (threads > 0) {
-            std::cerr << "  L1I stats:" << std::endl;
-            itlbs[i]->get_stats()->print_stats("    ");
-            std::cerr << "  L1D stats:" << std::endl;
-            dtlbs[i]->get_stats()->print_stats("    ");
-            std::cerr << "  LL stats:" << std::endl;
-            lltlbs[i]->get_stats()->print_stats("    ");
+            print_core_schedule(i, "  ");
+            print_core_tlb_stats(i, "  ");
         }
     }
     return true;
 }
 
+bool
+tlb_simulator_t::translate(int core, const memref_t &memref)
+{
+    tlb_t *tlb;
+    if (memref.type == TRACE_TYPE_INSTR)
+        tlb = first_level_tlb(itlbs, ihtlbs, core, memref.addr);
+    else
+        tlb = first_level_tlb(dtlbs, dhtlbs, core, memref.addr);
+    int_least64_t ll_misses = lltlbs[core]->get_stats()->get_misses();
+    tlb->request(memref);
+    return lltlbs[core]->get_stats()->get_misses() != ll_misses;
+}
+
+void
+tlb_simulator_t::pollute_core(int core, int percent, const memref_t &memref)
+{
+    if (percent == 0)
+        return;
+    // All of a core's TLBs are private to it.
+    itlbs[core]->pollute(percent, memref);
+    dtlbs[core]->pollute(percent, memref);
+    lltlbs[core]->pollute(percent, memref);
+    if (ihtlbs != NULL)
+        ihtlbs[core]->pollute(percent, memref);
+    if (dhtlbs != NULL)
+        dhtlbs[core]->pollute(percent, memref);
+}
+
+void
+tlb_simulator_t::reset_tlb_stats()
+{
+    for (int i = 0; i < num_cores; i++) {
+        itlbs[i]->get_stats()->reset();
+        dtlbs[i]->get_stats()->reset();
+        lltlbs[i]->get_stats()->reset();
+        if (ihtlbs != NULL)
+            ihtlbs[i]->get_stats()->reset();
+        if (dhtlbs != NULL)
+            dhtlbs[i]->get_stats()->reset();
+    }
+}
+
+void
+tlb_simulator_t::print_core_tlb_stats(int core, const std::string &prefix)
+{
+    std::cerr << prefix << "L1I stats:" << std::endl;
+    itlbs[core]->get_stats()->print_stats(prefix + "  ");
+    if (ihtlbs != NULL) {
+        std::cerr << prefix << "L1I large-page stats:" << std::endl;
+        ihtlbs[core]->get_stats()->print_stats(prefix + "  ");
+    }
+    std::cerr << prefix << "L1D stats:" << std::endl;
+    dtlbs[core]->get_stats()->print_stats(prefix + "  ");
+    if (dhtlbs != NULL) {
+        std::cerr << prefix << "L1D large-page stats:" << std::endl;
+        dhtlbs[core]->get_stats()->print_stats(prefix + "  ");
+    }
+    std::cerr << prefix << "LL stats:" << std::endl;
+    lltlbs[core]->get_stats()->print_stats(prefix + "  ");
+}
+
 tlb_t*
 tlb_simulator_t::create_tlb(std::string policy)
 {
@@ -229,3 +394,22 @@ tlb_simulator_t::create_tlb(std::string policy)
           "Please choose "REPLACE_POLICY_LFU".\n");
     return NULL;
 }
+
+tlb_t*
+tlb_simulator_t::create_huge_tlb(unsigned int entries, tlb_t *parent)
+{
+    tlb_t *tlb = create_tlb(op_TLB_replace_policy.get_value());
+    if (tlb == NULL)
+        return NULL;
+    // The block size only sets the default page size: the page map gives each
+    // entry's actual size.
+    if (!tlb->init(op_TLB_huge_assoc.get_value(), op_page_size.get_value(), entries,
+                   parent, new tlb_stats_t)) {
+        ERROR("Usage error: failed to initialize large-page TLBs. Ensure entry "
+              "number and associativity are powers of 2.\n");
+        delete tlb;
+        return NULL;
+    }
+    tlb->set_page_map(page_map);
+    return tlb;
+}
@@ -38,27 +38,63 @@
 
 #include <map>
 #include "simulator.h"
+#include "page_map.h"
 #include "tlb_stats.h"
 #include "tlb.h"
-#include "ipc_reader.h"
 
 class tlb_simulator_t : public simulator_t
 {
  public:
+    tlb_simulator_t() : itlbs(NULL), dtlbs(NULL), lltlbs(NULL), ihtlbs(NULL),
+        dhtlbs(NULL), page_map(NULL) {}
     virtual bool init();
     virtual ~tlb_simulator_t();
     virtual bool run();
     virtual bool print_stats();
 
+    // For cache_tlb_simulator_t, which drives the TLBs of this object itself
+    // rather than calling init() and run().
+    // Creates the TLBs of "cores" cores.
+    bool create_tlbs(int cores);
+    // Looks up the translation of an instruction fetch or data access in the
+    // core's TLBs.  Returns whether it missed in the last-level TLB, which
+    // is when a page table walk is needed.
+    bool translate(int core, const memref_t &memref);
+    // For the kernel model: invalidates the given percentage of the entries of
+    // each of the core's TLBs (see simulator_t::kernel_pollution()).
+    void pollute_core(int core, int percent, const memref_t &memref);
+    void reset_tlb_stats();
+    void print_core_tlb_stats(int core, const std::string &prefix);
+    void add_interval_devices(interval_stats_t *to, const std::string &prefix);
+    virtual void get_checkpoint_devices(std::vector<caching_device_t *> &devices);
+
  protected:
     // Create a tlb_t object with a specific replacement policy.
     virtual tlb_t *create_tlb(std::string policy);
+    // Creates a first-level TLB for large pages, of -TLB_huge_assoc.
+    tlb_t *create_huge_tlb(unsigned int entries, tlb_t *parent);
+    // Returns the first-level TLB of core that translates addr: huge_tlbs[core]
+    // if there is one and addr is in a page larger than the default.
+    inline tlb_t *first_level_tlb(tlb_t **tlbs, tlb_t **huge_tlbs, int core,
+                                  addr_t addr)
+    {
+        if (huge_tlbs != NULL &&
+            page_map->page_bits(addr) > page_map->get_default_bits())
+            return huge_tlbs[core];
+        return tlbs[core];
+    }
 
     // Each CPU core contains a L1 ITLB, L1 DTLB and L2 TLB.
     // All of them are private to the core.
     tlb_t **itlbs;
     tlb_t **dtlbs;
     tlb_t **lltlbs;
+    // With -TLB_L1I_huge_entries and -TLB_L1D_huge_entries, each core's
+    // separate first-level TLBs for large pages, under its L2 TLB.
+    tlb_t **ihtlbs;
+    tlb_t **dhtlbs;
+    // For -page_size_file.
+    page_map_t *page_map;
 };
 
 #endif /* _TLB_SIMULATOR_H_ */
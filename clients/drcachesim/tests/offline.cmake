@@ -0,0 +1,75 @@
+# **********************************************************
+# Copyright (c) 2015 Google, Inc.    All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+#
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+# Invoked by the test suite for testing the offline trace mode
+
+# input:
+# * cmd = command to run the app under the tracer with -offline -outdir <dir>
+#     should have intra-arg space=@@ and inter-arg space=@ and ;=!
+# * cmp = file containing the expected simulator output
+# * postcmd = the simulator launcher, which is run on <dir> via -infile
+
+# Intra-arg space=@@ and inter-arg space=@.
+string(REGEX REPLACE "@@" " " cmd "${cmd}")
+string(REGEX REPLACE "@" ";" cmd "${cmd}")
+string(REGEX REPLACE "!" "\\;" cmd "${cmd}")
+
+if (NOT "${cmd}" MATCHES "-outdir;([^;]+)")
+  message(FATAL_ERROR "*** test cmd ${cmd} is missing -outdir ***\n")
+endif ()
+set(outdir "${CMAKE_MATCH_1}")
+file(REMOVE_RECURSE ${outdir})
+
+# run the app to produce the trace files
+execute_process(COMMAND ${cmd}
+  RESULT_VARIABLE cmd_result
+  ERROR_VARIABLE cmd_err
+  OUTPUT_VARIABLE cmd_out)
+if (cmd_result)
+  message(FATAL_ERROR "*** ${cmd} failed (${cmd_result}): ${cmd_err}***\n")
+endif (cmd_result)
+
+# now simulate the recorded trace
+execute_process(COMMAND ${postcmd} -infile ${outdir}
+  RESULT_VARIABLE cmd_result
+  ERROR_VARIABLE cmd_err
+  OUTPUT_VARIABLE cmd_out)
+if (cmd_result)
+  message(FATAL_ERROR "*** ${postcmd} failed (${cmd_result}): ${cmd_err} ${cmd_out}***\n")
+endif (cmd_result)
+
+file(READ ${cmp} expect)
+
+# cleanup
+file(REMOVE_RECURSE ${outdir})
+
+if (NOT "${cmd_err}" MATCHES "^${expect}$")
+  message(FATAL_ERROR "tool output ${cmd_err} failed to match expected ${expect}")
+endif ()
@@ -30,24 +30,8 @@
  * DAMAGE.
  */
 
-/* cache_line: represents a cache line.
- */
-
-#ifndef _CACHE_LINE_H_
-#define _CACHE_LINE_H_ 1
-
-#include "caching_device_block.h"
-
-class cache_line_t : public caching_device_block_t
-{
-
-    // Currently, "cache_line_t" is identical to caching_device_block_t; however,
-    // cache_line_t is probably to be extended to have distinct member variables
-    // and functions, e.g., coherency-related ones. Therefore, it is
-    // reasonable to keep two identical classes now rather than use one instead.
-
-    // FIXME i#1726: implement cache coherency protocols
+#include "drmemtrace_annotations.h"
 
-};
+DR_DEFINE_ANNOTATION(void, drmemtrace_start_tracing, (void), )
 
-#endif /* _CACHE_LINE_H_ */
+DR_DEFINE_ANNOTATION(void, drmemtrace_stop_tracing, (void), )
@@ -0,0 +1,65 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Annotations for applications traced with -trace_on_demand.  To switch
+ * tracing on and off around the code of interest, include this header, build
+ * drmemtrace_annotations.c into the application, and call:
+ *
+ *   DRMEMTRACE_START_TRACING();
+ *   ...
+ *   DRMEMTRACE_STOP_TRACING();
+ *
+ * Natively, and without -trace_on_demand, these do nothing.
+ */
+
+#ifndef _DRMEMTRACE_ANNOTATIONS_H_
+#define _DRMEMTRACE_ANNOTATIONS_H_ 1
+
+#include "dr_annotations_asm.h"
+
+#define DRMEMTRACE_START_TRACING() drmemtrace_start_tracing()
+
+#define DRMEMTRACE_STOP_TRACING() drmemtrace_stop_tracing()
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+DR_DECLARE_ANNOTATION(void, drmemtrace_start_tracing, (void));
+
+DR_DECLARE_ANNOTATION(void, drmemtrace_stop_tracing, (void));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DRMEMTRACE_ANNOTATIONS_H_ */
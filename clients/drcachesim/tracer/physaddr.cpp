@@ -37,6 +37,7 @@
 # include <unistd.h>
 # include <sys/stat.h>
 # include <fcntl.h>
+# include <sys/syscall.h>
 #endif
 #include "physaddr.h"
 #include "../common/options.h"
@@ -55,19 +56,35 @@
 # define PAGEMAP_VALID 0x8000000000000000
 # define PAGEMAP_SWAP  0x4000000000000000
 # define PAGEMAP_PFN   0x007fffffffffffff
-# define PAGE_BITS 12 // XXX i#1703: handle large pages
-# define PAGE_START(addr) ((addr) & (~((1 << PAGE_BITS)-1)))
-# define PAGE_OFFS(addr) ((addr) & ((1 << PAGE_BITS)-1))
+# define PAGE_BITS 12
+# define LARGE_PAGE_BITS 21
+# define HUGE_PAGE_BITS 30
+# define PAGE_START(addr, bits) ((addr) & ~(((addr_t)1 << (bits)) - 1))
+# define PAGE_OFFS(addr, bits) ((addr) & (((addr_t)1 << (bits)) - 1))
+// We read the pagemap entries of this many neighboring 4K pages at once, as
+// nearby pages tend to be touched soon after.
+# define PAGEMAP_BATCH 16
+// Page flags in /proc/kpageflags, which is indexed by pfn.
+# define KPF_HUGE 17
+# define KPF_THP  22
 static const addr_t PAGE_INVALID = (addr_t)-1;
+
+static inline bool
+pagemap_present(uint64_t entry)
+{
+    return TESTALL(PAGEMAP_VALID, entry) && !TESTANY(PAGEMAP_SWAP, entry);
+}
 #endif
 
 physaddr_t::physaddr_t()
 #ifdef LINUX
-    : last_vpage(PAGE_INVALID), last_ppage(PAGE_INVALID), fd(-1), count(0)
+    : fd(-1), flags_fd(-1), have_numa(true), count(0)
 #endif
 {
-    // Nothing else.
-    // No destructor needed either: ifstream closes when destroyed.
+#ifdef LINUX
+    flush();
+#endif
+    // No destructor needed: the files live as long as the process.
 }
 
 bool
@@ -81,6 +98,9 @@ physaddr_t::init()
     // get EINVAL on any non-8-aligned size, and ifstream at least likes to
     // read buffers of non-aligned sizes.
     fd = open(pagemap.c_str(), O_RDONLY);
+    // Reading the page flags needs the same privileges as reading pfns from
+    // pagemap, but we can do without them: we then only cache 4K pages.
+    flags_fd = open("/proc/kpageflags", O_RDONLY);
     // Accessing /proc/pid/pagemap requires privileges on some distributions,
     // such as Fedora with recent kernels.  We have no choice but to fail there.
     return (fd != -1);
@@ -95,53 +115,214 @@ addr_t
 physaddr_t::virtual2physical(addr_t virt)
 {
 #ifdef LINUX
-    addr_t vpage = PAGE_START(virt);
     bool use_cache = true;
     if (op_virt2phys_freq.get_value() > 0 && ++count >= op_virt2phys_freq.get_value()) {
         // Flush the cache and re-sync with the kernel
         use_cache = false;
-        last_vpage = PAGE_INVALID;
-        v2p.clear();
+        flush();
         count = 0;
     }
     if (use_cache) {
         // Use cached values on the assumption that the kernel hasn't re-mapped
         // this virtual page.
-        if (vpage == last_vpage)
-            return last_ppage + PAGE_OFFS(virt);
+        if (PAGE_START(virt, last.bits) == last.vpage)
+            return last.ppage + PAGE_OFFS(virt, last.bits);
         // XXX i#1703: add (debug-build-only) internal stats here and
         // on cache_t::request() fastpath.
-        std::map<addr_t,addr_t>::iterator exists = v2p.find(vpage);
-        if (exists != v2p.end()) {
-            last_vpage = vpage;
-            last_ppage = exists->second;
-            return last_ppage + PAGE_OFFS(virt);
-        }
+        if (lookup(virt, &last))
+            return last.ppage + PAGE_OFFS(virt, last.bits);
     }
     // Not cached, or forced to re-sync, so we have to read from the file.
     if (fd == -1)
         return 0;
-    // The pagemap file contains one 64-bit int per page, which we assume
-    // here is 4096 bytes.
-    // (XXX i#1703: handle large pages)
-    // Thus we want offset:
-    //   (addr / 4096 * 8) == ((addr >> 12) << 3) == addr >> 9
-    if (lseek64(fd, vpage >> 9, SEEK_SET) < 0)
+    addr_t vpage = PAGE_START(virt, PAGE_BITS);
+    addr_t batch_start = vpage & ~((addr_t)PAGEMAP_BATCH * (1 << PAGE_BITS) - 1);
+    uint64_t entries[PAGEMAP_BATCH];
+    if (!read_pagemap(batch_start, entries, PAGEMAP_BATCH))
         return 0;
-    unsigned long long entry;
-    if (read(fd, (char *)&entry, sizeof(entry)) != sizeof(entry))
+    uint64_t entry = entries[(vpage - batch_start) >> PAGE_BITS];
+    if (!pagemap_present(entry))
         return 0;
-    if (!TESTALL(PAGEMAP_VALID, entry) || TESTANY(PAGEMAP_SWAP, entry))
-        return 0;
-    last_ppage = (addr_t)((entry & PAGEMAP_PFN) << PAGE_BITS);
+    fill(batch_start, entries, PAGEMAP_BATCH);
+    if (have_numa)
+        record_nodes(batch_start, entries, PAGEMAP_BATCH);
+    uint64_t pfn = entry & PAGEMAP_PFN;
+    page_t page;
+    page.bits = large_page_bits(vpage, pfn);
+    page.vpage = PAGE_START(virt, page.bits);
+    page.ppage = (addr_t)(pfn << PAGE_BITS) - (vpage - page.vpage);
+    if (page.bits > PAGE_BITS) {
+        insert(page);
+        large_pages_seen[page.ppage] = page.bits;
+        // A large page is on one node, which the batch has told us.
+        std::map<addr_t,node_range_t>::iterator node =
+            page_nodes.find((addr_t)(pfn << PAGE_BITS));
+        if (node != page_nodes.end()) {
+            node_range_t range = node->second;
+            range.end = page.ppage + ((addr_t)1 << page.bits);
+            page_nodes[page.ppage] = range;
+        }
+    }
+    last = page;
     if (op_verbose.get_value() >= 2) {
         std::cerr << "virtual " << virt << " => physical " <<
-            (last_ppage + PAGE_OFFS(virt)) << std::endl;
+            (last.ppage + PAGE_OFFS(virt, last.bits)) << " (page size " <<
+            (1ULL << last.bits) << ")" << std::endl;
     }
-    v2p[vpage] = last_ppage;
-    last_vpage = vpage;
-    return last_ppage + PAGE_OFFS(virt);
+    return last.ppage + PAGE_OFFS(virt, last.bits);
 #else
     return 0;
 #endif
 }
+
+#ifdef LINUX
+bool
+physaddr_t::lookup(addr_t virt, page_t *page)
+{
+    addr_t vpage = PAGE_START(virt, PAGE_BITS);
+    page_t *entry = &small_pages[(vpage >> PAGE_BITS) % NUM_SMALL_PAGES];
+    if (entry->vpage == vpage) {
+        *page = *entry;
+        return true;
+    }
+    entry = &large_pages[(virt >> LARGE_PAGE_BITS) % NUM_LARGE_PAGES];
+    if (entry->vpage == PAGE_START(virt, LARGE_PAGE_BITS)) {
+        *page = *entry;
+        return true;
+    }
+    entry = &huge_pages[(virt >> HUGE_PAGE_BITS) % NUM_HUGE_PAGES];
+    if (entry->vpage == PAGE_START(virt, HUGE_PAGE_BITS)) {
+        *page = *entry;
+        return true;
+    }
+    std::map<addr_t,addr_t>::iterator exists = v2p.find(vpage);
+    if (exists == v2p.end())
+        return false;
+    page->vpage = vpage;
+    page->ppage = exists->second;
+    page->bits = PAGE_BITS;
+    insert(*page);
+    return true;
+}
+
+bool
+physaddr_t::read_pagemap(addr_t vpage, uint64_t *entries, size_t num)
+{
+    // The pagemap file contains one 64-bit entry per 4K page.
+    ssize_t size = (ssize_t)(num * sizeof(*entries));
+    return pread64(fd, (char *)entries, size,
+                   (off64_t)(vpage >> PAGE_BITS) * sizeof(*entries)) == size;
+}
+
+// Returns the size, in bits, of the page that holds vpage, which is mapped to
+// pfn.  The page flags only say whether a page is part of a large page, so we
+// look for the largest aligned and physically contiguous range around it.
+int
+physaddr_t::large_page_bits(addr_t vpage, uint64_t pfn)
+{
+    uint64_t flags;
+    if (flags_fd == -1 ||
+        pread64(flags_fd, (char *)&flags, sizeof(flags),
+                (off64_t)(pfn * sizeof(flags))) != sizeof(flags) ||
+        !TESTANY((1ULL << KPF_HUGE) | (1ULL << KPF_THP), flags))
+        return PAGE_BITS;
+    // Transparent huge pages are always 2M; hugetlbfs pages may be 1G.
+    static const int sizes[] = { HUGE_PAGE_BITS, LARGE_PAGE_BITS };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int bits = sizes[i];
+        if (bits == HUGE_PAGE_BITS && !TESTANY(1ULL << KPF_HUGE, flags))
+            continue;
+        uint64_t subpages = 1ULL << (bits - PAGE_BITS);
+        addr_t base = PAGE_START(vpage, bits);
+        uint64_t idx = (vpage - base) >> PAGE_BITS;
+        if (pfn < idx || (pfn - idx) % subpages != 0)
+            continue;
+        uint64_t first, end;
+        if (!read_pagemap(base, &first, 1) ||
+            !read_pagemap(base + (addr_t)((subpages - 1) << PAGE_BITS), &end, 1))
+            continue;
+        if (pagemap_present(first) && pagemap_present(end) &&
+            (first & PAGEMAP_PFN) == pfn - idx &&
+            (end & PAGEMAP_PFN) == pfn - idx + subpages - 1)
+            return bits;
+    }
+    return PAGE_BITS;
+}
+
+void
+physaddr_t::fill(addr_t vpage, const uint64_t *entries, size_t num)
+{
+    for (size_t i = 0; i < num; i++, vpage += (1 << PAGE_BITS)) {
+        if (!pagemap_present(entries[i]))
+            continue;
+        page_t page;
+        page.vpage = vpage;
+        page.ppage = (addr_t)((entries[i] & PAGEMAP_PFN) << PAGE_BITS);
+        page.bits = PAGE_BITS;
+        v2p[vpage] = page.ppage;
+        insert(page);
+    }
+}
+
+// Asks the kernel which node holds each present page of the batch at vpage.
+// Without NUMA support we get ENOSYS, and then stop asking.
+void
+physaddr_t::record_nodes(addr_t vpage, const uint64_t *entries, size_t num)
+{
+    void *pages[PAGEMAP_BATCH];
+    addr_t ppages[PAGEMAP_BATCH];
+    int status[PAGEMAP_BATCH];
+    size_t present = 0;
+    for (size_t i = 0; i < num && i < PAGEMAP_BATCH; i++) {
+        if (!pagemap_present(entries[i]))
+            continue;
+        pages[present] = (void *)(vpage + (i << PAGE_BITS));
+        ppages[present] = (addr_t)((entries[i] & PAGEMAP_PFN) << PAGE_BITS);
+        ++present;
+    }
+    if (present == 0)
+        return;
+    // With no target nodes, move_pages() just reports where each page is.
+    if (syscall(SYS_move_pages, 0/*this process*/, present, pages, NULL, status,
+                0) != 0) {
+        have_numa = false;
+        return;
+    }
+    for (size_t i = 0; i < present; i++) {
+        if (status[i] < 0)
+            continue;
+        node_range_t range;
+        range.end = ppages[i] + (1 << PAGE_BITS);
+        range.node = status[i];
+        page_nodes[ppages[i]] = range;
+    }
+}
+
+void
+physaddr_t::insert(const page_t &page)
+{
+    if (page.bits == HUGE_PAGE_BITS)
+        huge_pages[(page.vpage >> HUGE_PAGE_BITS) % NUM_HUGE_PAGES] = page;
+    else if (page.bits == LARGE_PAGE_BITS)
+        large_pages[(page.vpage >> LARGE_PAGE_BITS) % NUM_LARGE_PAGES] = page;
+    else
+        small_pages[(page.vpage >> PAGE_BITS) % NUM_SMALL_PAGES] = page;
+}
+
+void
+physaddr_t::flush()
+{
+    page_t invalid;
+    invalid.vpage = PAGE_INVALID;
+    invalid.ppage = PAGE_INVALID;
+    invalid.bits = PAGE_BITS;
+    last = invalid;
+    for (int i = 0; i < NUM_SMALL_PAGES; i++)
+        small_pages[i] = invalid;
+    for (int i = 0; i < NUM_LARGE_PAGES; i++)
+        large_pages[i] = invalid;
+    for (int i = 0; i < NUM_HUGE_PAGES; i++)
+        huge_pages[i] = invalid;
+    v2p.clear();
+}
+#endif
@@ -38,6 +38,7 @@
 
 #include <fstream>
 #include <map>
+#include <stdint.h>
 #include "../common/trace_entry.h"
 
 class physaddr_t
@@ -46,13 +47,52 @@ class physaddr_t
     physaddr_t();
     bool init();
     addr_t virtual2physical(addr_t virt);
+    // The large pages translated so far, from the physical address of each to
+    // log2 of its size.
+    const std::map<addr_t,int> &get_large_pages() const { return large_pages_seen; }
+    // The NUMA node of each page translated so far, from the physical address
+    // of each to its end and node.  Empty if the kernel does not support NUMA.
+    struct node_range_t {
+        addr_t end;
+        int node;
+    };
+    const std::map<addr_t,node_range_t> &get_page_nodes() const { return page_nodes; }
 
  private:
+    std::map<addr_t,int> large_pages_seen;
+    std::map<addr_t,node_range_t> page_nodes;
     // Assumed to be single-threaded
 #ifdef LINUX
-    addr_t last_vpage;
-    addr_t last_ppage;
+    // A translation of a page of 1 << bits bytes.
+    struct page_t {
+        addr_t vpage;
+        addr_t ppage;
+        int bits;
+    };
+    bool lookup(addr_t virt, page_t *page);
+    bool read_pagemap(addr_t vpage, uint64_t *entries, size_t count);
+    int large_page_bits(addr_t vpage, uint64_t pfn);
+    void fill(addr_t vpage, const uint64_t *entries, size_t count);
+    void record_nodes(addr_t vpage, const uint64_t *entries, size_t count);
+    void insert(const page_t &page);
+    void flush();
+
+    enum {
+        NUM_SMALL_PAGES = 4096,
+        NUM_LARGE_PAGES = 64,
+        NUM_HUGE_PAGES = 8,
+    };
+    page_t last;
+    // Direct-mapped caches of 4K, 2M, and 1G pages in front of v2p, which
+    // holds every 4K page we have read.
+    page_t small_pages[NUM_SMALL_PAGES];
+    page_t large_pages[NUM_LARGE_PAGES];
+    page_t huge_pages[NUM_HUGE_PAGES];
     int fd;
+    // /proc/kpageflags, to find large pages, or -1 if we can't read it.
+    int flags_fd;
+    // Whether move_pages() can tell us the nodes of our pages.
+    bool have_numa;
     std::map<addr_t,addr_t> v2p;
     unsigned int count;
 #endif
@@ -42,14 +42,24 @@
 #include <stddef.h> /* for offsetof */
 #include <string.h>
 #include <limits.h> /* for INT_MAX/INT_MIN */
+#include <set>
 #include <string>
+#include <vector>
 #include "dr_api.h"
+#ifdef LINUX
+# include <sched.h> /* for sched_getcpu */
+# include <signal.h> /* for SIGSEGV */
+#endif
 #include "drmgr.h"
 #include "drutil.h"
+#include "drwrap.h"
+#include "drsyms.h"
 #include "droption.h"
 #include "physaddr.h"
 #include "../common/trace_entry.h"
+#include "../common/trace_compress.h"
 #include "../common/named_pipe.h"
+#include "../common/shm_ring.h"
 #include "../common/options.h"
 
 #ifdef ARM
@@ -61,6 +71,7 @@
 #define BUFFER_SIZE_ELEMENTS(buf)   (BUFFER_SIZE_BYTES(buf) / sizeof((buf)[0]))
 #define BUFFER_LAST_ELEMENT(buf)    (buf)[BUFFER_SIZE_ELEMENTS(buf) - 1]
 #define NULL_TERMINATE_BUFFER(buf)  BUFFER_LAST_ELEMENT(buf) = 0
+#define IS_POWER_OF_2(x)            ((x) != 0 && ((x) & ((x) - 1)) == 0)
 
 #define NOTIFY(level, ...) do {            \
     if (op_verbose.get_value() >= (level)) \
@@ -76,33 +87,141 @@
 #define TRACE_BUF_SIZE (sizeof(trace_entry_t) * MAX_NUM_ENTRIES)
 /* The redzone is allocated right after the trace buffer.
  * We fill the redzone with sentinel value to detect when the redzone
- * is reached, i.e., when the trace buffer is full.
+ * is reached, i.e., when the trace buffer is full.  With fault_flush we
+ * instead make it inaccessible, and the store that reaches it faults.
  */
 #define REDZONE_SIZE (sizeof(trace_entry_t) * MAX_NUM_ENTRIES)
 #define MAX_BUF_SIZE (TRACE_BUF_SIZE + REDZONE_SIZE)
 
+/* For -num_writers: the spare buffers each thread owns, and the full buffers
+ * a writer thread's queue can hold.  A thread that runs out of either waits.
+ */
+#define WRITER_SPARE_BUFS 4
+#define WRITER_QUEUE_SIZE 64
+#define WRITER_IDLE_SLEEP_MS 1
+
+struct _writer_t;
+
 /* thread private buffer and counter */
 typedef struct {
     byte *seg_base;
     trace_entry_t *buf_base;
     uint64 num_refs;
+    /* When, and on which cpu, the buffer being filled was started, for its header */
+    uint64 buf_start_ts;
+    int buf_start_cpu;
+    /* For offline mode: this thread's trace file; for -thread_pipes, its pipe */
+    file_t file;
+    /* For -compress: the encoding buffer and the chunk index */
+    unsigned char *chunk_buf;
+    uint64 file_offs;
+    trace_chunk_index_t *chunk_index;
+    size_t chunk_index_count;
+    size_t chunk_index_capacity;
+    /* For -L0_filter: the tags of this thread's L0 caches */
+    addr_t *l0i_tags;
+    addr_t *l0d_tags;
+    /* For -record_allocs: how many allocation routine calls are in progress */
+    int alloc_depth;
+    /* For -record_syscalls: when the current syscall was entered */
+    uint64 syscall_start;
+    /* For -num_writers: this thread's writer, and the empty buffers it has
+     * handed back, which are guarded by the writer's lock
+     */
+    struct _writer_t *writer;
+    trace_entry_t *spare_bufs[WRITER_SPARE_BUFS];
+    int num_spare;
 } per_thread_t;
 
+/* For -num_writers: a full buffer for a writer thread to write out */
+typedef struct {
+    per_thread_t *data;
+    trace_entry_t *buf_base;
+    trace_entry_t *buf_end;
+} write_job_t;
+
+typedef struct _writer_t {
+    /* Guards the queue and the spare buffers of the threads we write for */
+    void *lock;
+    /* Held from taking a job until it is written, so a thread can wait for
+     * its buffer in progress.  DR also does not suspend us at exit holding it.
+     */
+    void *busy;
+    write_job_t queue[WRITER_QUEUE_SIZE];
+    uint head;
+    uint count;
+} writer_t;
+
+/* The encoding buffer must hold a full buffer including the redzone, plus the
+ * process entry added to each chunk.
+ */
+#define CHUNK_BUF_SIZE trace_compress_bound(MAX_BUF_SIZE / sizeof(trace_entry_t) + 1)
+#define CHUNK_INDEX_INIT_COUNT 64
+
 #define MAX_NUM_DELAY_INSTRS 32
 /* per bb user data during instrumentation */
 typedef struct {
+    /* The tracing window state when this bb was built */
+    bool tracing;
+    bool counting;
+    instr_t *first_app;
+    int num_app_instrs;
+    /* For -instr_only: the count of distinct app instrs in the bb */
+    int block_instrs;
     app_pc last_app_pc;
+    /* For -L0_filter: the L0 line of the previous app instr, and the
+     * fetches we know hit since the last count we inserted
+     */
+    addr_t last_l0i_tag;
+    int l0i_hits;
     instr_t *strex;
     int num_delay_instrs;
     instr_t *delay_instrs[MAX_NUM_DELAY_INSTRS];
 } user_data_t;
 
-/* we write to a single global pipe */
+/* we write to a single global pipe, unless in offline mode */
 static named_pipe_t ipc_pipe;
+/* or, for -shm, we fill buffers in a ring shared with the simulator */
+static shm_ring_t ipc_ring;
+static void *ring_map;
+static size_t ring_map_size;
+/* The simulator normally creates the ring before launching us */
+#define RING_ATTACH_TRIES 500
+#define RING_ATTACH_SLEEP_MS 10
+
+/* the list of modules, for symbolizing the simulator's results */
+static file_t module_file = INVALID_FILE;
+/* For -instr_only: the list of block lengths, and the lines written to it */
+static file_t block_file = INVALID_FILE;
+static std::set<std::string> blocks_listed;
 
 static client_id_t client_id;
 static void  *mutex;    /* for multithread support */
 static uint64 num_refs; /* keep a global memory reference count */
+/* Whether -compress applies to the shared pipe */
+static bool compress_pipe;
+/* For -num_writers with -offline: the writer threads, or NULL */
+static writer_t *writers;
+static uint num_writers;
+static volatile bool writers_exiting;
+/* Whether a full buffer is flushed on the fault its redzone raises rather than
+ * by a check at the end of each bb.  We use this on Linux, except with
+ * -L0_filter, whose flush appends entries in the redzone, and with -shm,
+ * whose buffers are the ring's slots.
+ */
+static bool fault_flush;
+
+/* For -trace_after_instrs, the tracing windows, and the regions of interest:
+ * whether we are tracing, and whether we count instrs to find the end of the
+ * current window.  A new bb takes these on, and we flush the code cache when
+ * they change.
+ */
+static volatile bool tracing_enabled = true;
+static volatile bool window_counting;
+/* Whether -trace_function or -trace_on_demand switches tracing on and off */
+static bool trace_regions;
+/* The instrs left in the current window, across all threads */
+static volatile ptr_int_t window_instrs_left;
 
 static dr_spill_slot_t slot_ptr = SPILL_SLOT_2; /* TLS slot for reg_ptr */
 static dr_spill_slot_t slot_tmp = SPILL_SLOT_3; /* TLS slot for reg_tmp/reg_addr */
@@ -114,15 +233,32 @@ static physaddr_t physaddr;
 /* Allocated TLS slot offsets */
 enum {
     MEMTRACE_TLS_OFFS_BUF_PTR,
+    /* For -L0_filter: the L0 tag arrays and hit counts */
+    MEMTRACE_TLS_OFFS_L0I_TAGS,
+    MEMTRACE_TLS_OFFS_L0D_TAGS,
+    MEMTRACE_TLS_OFFS_L0I_HITS,
+    MEMTRACE_TLS_OFFS_L0D_HITS,
     MEMTRACE_TLS_COUNT, /* total number of TLS slots allocated */
 };
 static reg_id_t tls_seg;
 static uint     tls_offs;
 static int      tls_idx;
-#define TLS_SLOT(tls_base, enum_val) (void **)((byte *)(tls_base)+tls_offs+(enum_val))
+#define TLS_OFFS(enum_val) (tls_offs + (enum_val)*sizeof(void *))
+#define TLS_SLOT(tls_base, enum_val) (void **)((byte *)(tls_base)+TLS_OFFS(enum_val))
 #define BUF_PTR(tls_base) *(trace_entry_t **)TLS_SLOT(tls_base, MEMTRACE_TLS_OFFS_BUF_PTR)
-/* We leave a slot at the start so we can easily insert a header entry */
-#define BUF_HDR_SLOTS 1
+#define L0_HITS(tls_base, enum_val) *(ptr_uint_t *)TLS_SLOT(tls_base, enum_val)
+
+/* For -L0_filter: each L0 cache is an array of tags, where a tag is an
+ * address shifted right by l0_line_bits.
+ */
+static uint l0_line_bits;
+static size_t l0i_lines;
+static size_t l0d_lines;
+#define L0_TAG_INVALID ((addr_t)-1)
+/* We leave slots at the start so we can easily insert the header entries:
+ * the thread entry, the timestamp entry, and the cpu id entry.
+ */
+#define BUF_HDR_SLOTS 3
 #define BUF_HDR_SLOTS_SIZE (BUF_HDR_SLOTS * sizeof(trace_entry_t))
 
 #define MINSERT instrlist_meta_preinsert
@@ -135,40 +271,369 @@ init_thread_entry(void *drcontext, trace_entry_t *entry)
     entry->addr = (addr_t) dr_get_thread_id(drcontext);
 }
 
+static inline void
+init_buffer_header(void *drcontext, per_thread_t *data, trace_entry_t *entry)
+{
+    init_thread_entry(drcontext, &entry[0]);
+    entry[1].type = TRACE_TYPE_TIMESTAMP;
+    entry[1].size = sizeof(addr_t);
+    entry[1].addr = (addr_t) data->buf_start_ts;
+    entry[2].type = TRACE_TYPE_CPU_ID;
+    entry[2].size = sizeof(addr_t);
+    entry[2].addr = (addr_t)(ptr_int_t) data->buf_start_cpu;
+}
+
+static inline void
+start_buffer_header(per_thread_t *data)
+{
+    data->buf_start_ts = dr_get_microseconds();
+#ifdef LINUX
+    /* This is a vdso call on most kernels, so it is cheap enough per buffer */
+    data->buf_start_cpu = sched_getcpu();
+#else
+    data->buf_start_cpu = -1;
+#endif
+}
+
+static inline void
+compressed_pipe_write(per_thread_t *data, trace_entry_t *start, trace_entry_t *end)
+{
+    /* A chunk is never much larger than its raw entries, so it is still atomic */
+    ssize_t size = (ssize_t)
+        trace_compress_chunk(start, end - start, dr_get_process_id(), data->chunk_buf);
+    DR_ASSERT(size <= ipc_pipe.get_atomic_write_size());
+    if (ipc_pipe.write((void *)data->chunk_buf, size) < size)
+        DR_ASSERT(false);
+}
+
 static inline byte *
-atomic_pipe_write(void *drcontext, byte *pipe_start, byte *pipe_end)
+atomic_pipe_write(void *drcontext, per_thread_t *data, byte *pipe_start, byte *pipe_end)
 {
     ssize_t towrite = pipe_end - pipe_start;
     DR_ASSERT(towrite <= ipc_pipe.get_atomic_write_size() &&
               towrite > (ssize_t)BUF_HDR_SLOTS_SIZE);
-    if (ipc_pipe.write((void *)pipe_start, towrite) < (ssize_t)towrite)
+    if (compress_pipe) {
+        compressed_pipe_write(data, (trace_entry_t *)pipe_start,
+                              (trace_entry_t *)pipe_end);
+    } else if (ipc_pipe.write((void *)pipe_start, towrite) < (ssize_t)towrite)
         DR_ASSERT(false);
-    // Re-emit thread entry header
+    // Re-emit the header entries
     DR_ASSERT(pipe_end - BUF_HDR_SLOTS_SIZE > pipe_start);
     pipe_start = pipe_end - BUF_HDR_SLOTS_SIZE;
-    init_thread_entry(drcontext, (trace_entry_t *)pipe_start);
+    init_buffer_header(drcontext, data, (trace_entry_t *)pipe_start);
     return pipe_start;
 }
 
+static inline void
+thread_file_write(per_thread_t *data, byte *start, byte *end)
+{
+    /* There is no atomicity concern with a per-thread file or pipe */
+    if (dr_write_file(data->file, start, end - start) < (ssize_t)(end - start))
+        DR_ASSERT(false);
+    data->file_offs += end - start;
+}
+
+/* This may run on a writer thread, so the index is in global memory */
+static void
+offline_chunk_write(per_thread_t *data, trace_entry_t *start, trace_entry_t *end)
+{
+    trace_chunk_index_t *entry;
+    size_t size = trace_compress_chunk(start, end - start, dr_get_process_id(),
+                                       data->chunk_buf);
+    if (data->chunk_index_count == data->chunk_index_capacity) {
+        size_t new_capacity = data->chunk_index_capacity * 2;
+        trace_chunk_index_t *new_index = (trace_chunk_index_t *)
+            dr_global_alloc(new_capacity * sizeof(*new_index));
+        memcpy(new_index, data->chunk_index,
+               data->chunk_index_count * sizeof(*new_index));
+        dr_global_free(data->chunk_index,
+                       data->chunk_index_capacity * sizeof(*new_index));
+        data->chunk_index = new_index;
+        data->chunk_index_capacity = new_capacity;
+    }
+    entry = &data->chunk_index[data->chunk_index_count++];
+    entry->offset = data->file_offs;
+    entry->num_memrefs = ((trace_chunk_header_t *)data->chunk_buf)->num_memrefs;
+    thread_file_write(data, data->chunk_buf, data->chunk_buf + size);
+}
+
+static void
+offline_index_write(per_thread_t *data)
+{
+    trace_index_footer_t footer;
+    footer.index_offset = data->file_offs;
+    footer.num_chunks = data->chunk_index_count;
+    memcpy(footer.magic, TRACE_INDEX_MAGIC, sizeof(footer.magic));
+    thread_file_write(data, (byte *)data->chunk_index,
+                       (byte *)(data->chunk_index + data->chunk_index_count));
+    thread_file_write(data, (byte *)&footer, (byte *)(&footer + 1));
+    dr_global_free(data->chunk_index,
+                   data->chunk_index_capacity * sizeof(*data->chunk_index));
+}
+
+static void
+offline_buffer_write(per_thread_t *data, trace_entry_t *start, trace_entry_t *end)
+{
+    if (op_compress.get_value())
+        offline_chunk_write(data, start, end);
+    else
+        thread_file_write(data, (byte *)start, (byte *)end);
+}
+
+/* Our instrumentation reads from buffer and skips the clean call if the
+ * content is 0, so we need set zero in the trace buffer and set non-zero
+ * in redzone.  With fault_flush nothing reads the buffer, and the
+ * instrumentation never writes past the start of the redzone.
+ */
+static void
+buffer_reset(trace_entry_t *buf_base, trace_entry_t *buf_ptr)
+{
+    byte *redzone;
+    if (fault_flush)
+        return;
+    memset(buf_base, 0, TRACE_BUF_SIZE);
+    redzone = (byte *)buf_base + TRACE_BUF_SIZE;
+    if ((byte *)buf_ptr > redzone) {
+        // Set sentinel (non-zero) value in redzone
+        memset(redzone, -1, (byte *)buf_ptr - redzone);
+    }
+}
+
+/* Clears a new trace buffer and sets up its redzone */
+static void
+buffer_init(trace_entry_t *buf_base)
+{
+    memset(buf_base, 0, TRACE_BUF_SIZE);
+    if (fault_flush) {
+        if (!dr_memory_protect((byte *)buf_base + TRACE_BUF_SIZE, REDZONE_SIZE,
+                               DR_MEMPROT_NONE))
+            DR_ASSERT(false);
+    } else {
+        /* set sentinel (non-zero) value in redzone */
+        memset((byte *)buf_base + TRACE_BUF_SIZE, -1, REDZONE_SIZE);
+    }
+}
+
+static trace_entry_t *
+buffer_create(void)
+{
+    trace_entry_t *buf_base = (trace_entry_t *)
+        dr_raw_mem_alloc(MAX_BUF_SIZE, DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+    DR_ASSERT(buf_base != NULL);
+    buffer_init(buf_base);
+    return buf_base;
+}
+
+/***************************************************************************
+ * -num_writers
+ */
+
+/* Writes out the oldest job in writer's queue, if any, and hands its buffer
+ * back to the thread that filled it.
+ */
+static bool
+writer_process_job(writer_t *writer)
+{
+    write_job_t job;
+    dr_mutex_lock(writer->busy);
+    dr_mutex_lock(writer->lock);
+    if (writer->count == 0) {
+        dr_mutex_unlock(writer->lock);
+        dr_mutex_unlock(writer->busy);
+        return false;
+    }
+    job = writer->queue[writer->head];
+    writer->head = (writer->head + 1) % WRITER_QUEUE_SIZE;
+    writer->count--;
+    dr_mutex_unlock(writer->lock);
+
+    offline_buffer_write(job.data, job.buf_base, job.buf_end);
+    buffer_reset(job.buf_base, job.buf_end);
+
+    dr_mutex_lock(writer->lock);
+    DR_ASSERT(job.data->num_spare < WRITER_SPARE_BUFS);
+    job.data->spare_bufs[job.data->num_spare++] = job.buf_base;
+    dr_mutex_unlock(writer->lock);
+    dr_mutex_unlock(writer->busy);
+    return true;
+}
+
+static void
+writer_thread(void *arg)
+{
+    writer_t *writer = (writer_t *) arg;
+    /* We only ever hold our own locks, and briefly at that */
+    dr_client_thread_set_suspendable(false);
+    while (!writers_exiting) {
+        if (!writer_process_job(writer))
+            dr_sleep(WRITER_IDLE_SLEEP_MS);
+    }
+}
+
+static void
+writers_start(void)
+{
+    uint i;
+    for (i = 0; i < num_writers; i++) {
+        writers[i].lock = dr_mutex_create();
+        writers[i].busy = dr_mutex_create();
+        writers[i].head = 0;
+        writers[i].count = 0;
+        if (!dr_create_client_thread(writer_thread, &writers[i]))
+            DR_ASSERT(false);
+    }
+}
+
+/* Queues the full buffer up to buf_ptr for this thread's writer and switches
+ * the thread to one of its spare buffers.
+ */
+static void
+writer_hand_off(per_thread_t *data, trace_entry_t *buf_ptr)
+{
+    writer_t *writer = data->writer;
+    write_job_t *job;
+    dr_mutex_lock(writer->lock);
+    while (data->num_spare == 0 || writer->count == WRITER_QUEUE_SIZE) {
+        /* The writer has fallen behind: wait for it to catch up */
+        dr_mutex_unlock(writer->lock);
+        dr_thread_yield();
+        dr_mutex_lock(writer->lock);
+    }
+    job = &writer->queue[(writer->head + writer->count) % WRITER_QUEUE_SIZE];
+    job->data = data;
+    job->buf_base = data->buf_base;
+    job->buf_end = buf_ptr;
+    writer->count++;
+    data->buf_base = data->spare_bufs[--data->num_spare];
+    dr_mutex_unlock(writer->lock);
+}
+
+/* Takes this thread's buffers back from its writer, writing out in order the
+ * ones it has yet to.  Only the thread itself, or the thread that runs its
+ * exit at process exit, calls this.
+ */
+static void
+writer_drain(per_thread_t *data)
+{
+    writer_t *writer = data->writer;
+    write_job_t ours[WRITER_SPARE_BUFS];
+    uint i, num_ours = 0, num_kept = 0;
+
+    dr_mutex_lock(writer->lock);
+    for (i = 0; i < writer->count; i++) {
+        write_job_t *job = &writer->queue[(writer->head + i) % WRITER_QUEUE_SIZE];
+        if (job->data == data) {
+            DR_ASSERT(num_ours < WRITER_SPARE_BUFS);
+            ours[num_ours++] = *job;
+        } else {
+            writer->queue[(writer->head + num_kept++) % WRITER_QUEUE_SIZE] = *job;
+        }
+    }
+    writer->count = num_kept;
+    dr_mutex_unlock(writer->lock);
+
+    /* Any buffer of ours the writer took earlier must go out first */
+    dr_mutex_lock(writer->busy);
+    dr_mutex_unlock(writer->busy);
+    for (i = 0; i < num_ours; i++) {
+        offline_buffer_write(data, ours[i].buf_base, ours[i].buf_end);
+        data->spare_bufs[data->num_spare++] = ours[i].buf_base;
+    }
+}
+
+static trace_entry_t *
+ring_acquire_buffer()
+{
+    void *buf;
+    /* All slots are taken: wait for the simulator to release one */
+    while ((buf = ipc_ring.acquire_buffer()) == NULL)
+        dr_thread_yield();
+    return (trace_entry_t *) buf;
+}
+
+static bool
+ring_attach()
+{
+    const char *path = ipc_ring.get_path().c_str();
+    for (int i = 0; i < RING_ATTACH_TRIES; i++) {
+        /* We need write access to map it shared and writable */
+        file_t f = dr_open_file(path, DR_FILE_READ | DR_FILE_WRITE_APPEND);
+        if (f != INVALID_FILE) {
+            uint64 size;
+            if (dr_file_size(f, &size) && size > 0) {
+                ring_map_size = (size_t) size;
+                ring_map = dr_map_file(f, &ring_map_size, 0, NULL,
+                                       DR_MEMPROT_READ | DR_MEMPROT_WRITE, 0);
+                if (ring_map != NULL) {
+                    if (ring_map_size >= size && ipc_ring.attach(ring_map, (size_t)size))
+                        ring_map_size = (size_t) size;
+                    else {
+                        dr_unmap_file(ring_map, ring_map_size);
+                        ring_map = NULL;
+                    }
+                }
+            }
+            dr_close_file(f);
+            if (ring_map != NULL)
+                return true;
+        }
+        dr_sleep(RING_ATTACH_SLEEP_MS);
+    }
+    return false;
+}
+
+/* For -L0_filter: adds entries for the hits counted by our instrumentation
+ * since the last buffer.  The redzone has room for them.
+ */
+static trace_entry_t *
+append_l0_hits(per_thread_t *data, trace_entry_t *buf_ptr)
+{
+    static const int slots[] = { MEMTRACE_TLS_OFFS_L0I_HITS, MEMTRACE_TLS_OFFS_L0D_HITS };
+    static const ushort types[] = { TRACE_TYPE_L0I_HITS, TRACE_TYPE_L0D_HITS };
+    for (int i = 0; i < 2; i++) {
+        ptr_uint_t hits = L0_HITS(data->seg_base, slots[i]);
+        if (hits == 0)
+            continue;
+        buf_ptr->type = types[i];
+        buf_ptr->size = 0;
+        buf_ptr->addr = (addr_t) hits;
+        ++buf_ptr;
+        L0_HITS(data->seg_base, slots[i]) = 0;
+    }
+    return buf_ptr;
+}
+
 static void
-memtrace(void *drcontext)
+memtrace(void *drcontext, bool exiting)
 {
     per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
     trace_entry_t *mem_ref, *buf_ptr;
-    byte *pipe_start, *pipe_end, *redzone;
+    byte *pipe_start, *pipe_end;
 
     buf_ptr = BUF_PTR(data->seg_base);
-    /* The initial slot is left empty for the thread entry, which we add here */
-    init_thread_entry(drcontext, data->buf_base);
+    if (op_L0_filter.get_value())
+        buf_ptr = append_l0_hits(data, buf_ptr);
+    /* The initial slots are left empty for the header, which we add here */
+    init_buffer_header(drcontext, data, data->buf_base);
     pipe_start = (byte *)data->buf_base;
     pipe_end = pipe_start;
 
-    for (mem_ref = data->buf_base + BUF_HDR_SLOTS; mem_ref < buf_ptr; mem_ref++) {
+    mem_ref = data->buf_base + BUF_HDR_SLOTS;
+    if (writers != NULL && !(have_phys && op_use_physical.get_value())) {
+        /* There is nothing to do per entry, so we only count them */
+        data->num_refs += buf_ptr - mem_ref;
+        mem_ref = buf_ptr;
+    }
+    for (; mem_ref < buf_ptr; mem_ref++) {
         data->num_refs++;
         if (have_phys && op_use_physical.get_value()) {
             if (mem_ref->type != TRACE_TYPE_THREAD &&
                 mem_ref->type != TRACE_TYPE_THREAD_EXIT &&
-                mem_ref->type != TRACE_TYPE_PID) {
+                mem_ref->type != TRACE_TYPE_PID &&
+                mem_ref->type != TRACE_TYPE_L0I_HITS &&
+                mem_ref->type != TRACE_TYPE_L0D_HITS &&
+                mem_ref->type != TRACE_TYPE_SYSCALL &&
+                mem_ref->type != TRACE_TYPE_SYSCALL_END) {
                 addr_t phys = physaddr.virtual2physical(mem_ref->addr);
                 DR_ASSERT(mem_ref->type != TRACE_TYPE_INSTR_BUNDLE);
                 if (phys != 0)
@@ -186,40 +651,137 @@ memtrace(void *drcontext)
         }
         // Split up the buffer into multiple writes to ensure atomic pipe writes.
         // We can only split before TRACE_TYPE_INSTR, assuming only a few data
-        // entries in between instr entries.
-        if (mem_ref->type == TRACE_TYPE_INSTR) {
+        // entries in between instr entries, or before the pc and block entries
+        // that replace it with -data_only and -instr_only, or before the
+        // allocation and syscall entries, which outside of a tracing window are
+        // all there is.  A filtered trace has no pc-providing instr entries to keep next
+        // to data entries, and may have long runs of data entries, so there we
+        // split anywhere.
+        if (!op_offline.get_value() && !op_shm.get_value() &&
+            !op_thread_pipes.get_value() &&
+            (mem_ref->type == TRACE_TYPE_INSTR ||
+             mem_ref->type == TRACE_TYPE_INSTR_PC ||
+             mem_ref->type == TRACE_TYPE_INSTR_BLOCK ||
+             mem_ref->type == TRACE_TYPE_ALLOC ||
+             mem_ref->type == TRACE_TYPE_FREE ||
+             mem_ref->type == TRACE_TYPE_SYSCALL ||
+             mem_ref->type == TRACE_TYPE_SYSCALL_END || op_L0_filter.get_value())) {
             if (((byte *)mem_ref - pipe_start) > ipc_pipe.get_atomic_write_size())
-                pipe_start = atomic_pipe_write(drcontext, pipe_start, pipe_end);
+                pipe_start = atomic_pipe_write(drcontext, data, pipe_start, pipe_end);
             // Advance pipe_end pointer
             pipe_end = (byte *)mem_ref;
         }
     }
-    // Write the rest to pipe
-    // The last few entries (e.g., instr + refs) may exceed the atomic write size,
-    // so we may need two writes.
-    if (((byte *)buf_ptr - pipe_start) > ipc_pipe.get_atomic_write_size())
-        pipe_start = atomic_pipe_write(drcontext, pipe_start, pipe_end);
-    if (((byte *)buf_ptr - pipe_start) > (ssize_t)BUF_HDR_SLOTS_SIZE)
-        atomic_pipe_write(drcontext, pipe_start, (byte *)buf_ptr);
-
-    // Our instrumentation reads from buffer and skips the clean call if the
-    // content is 0, so we need set zero in the trace buffer and set non-zero
-    // in redzone.
-    memset(data->buf_base, 0, TRACE_BUF_SIZE);
-    redzone = (byte *)data->buf_base + TRACE_BUF_SIZE;
-    if ((byte *)buf_ptr > redzone) {
-        // Set sentinel (non-zero) value in redzone
-        memset(redzone, -1, (byte *)buf_ptr - redzone);
+    if (op_offline.get_value()) {
+        bool have_entries =
+            ((byte *)buf_ptr - pipe_start) > (ssize_t)BUF_HDR_SLOTS_SIZE;
+        if (writers != NULL) {
+            if (have_entries && !exiting) {
+                // Leave the write, and clearing the buffer, to our writer.
+                writer_hand_off(data, buf_ptr);
+                start_buffer_header(data);
+                BUF_PTR(data->seg_base) = data->buf_base + BUF_HDR_SLOTS;
+                return;
+            }
+            // Our last buffer goes out after those the writer still has.
+            if (exiting)
+                writer_drain(data);
+        }
+        // Write the whole buffer to this thread's file at once.
+        if (have_entries)
+            offline_buffer_write(data, (trace_entry_t *)pipe_start, buf_ptr);
+    } else if (op_shm.get_value()) {
+        // Hand the buffer itself to the simulator.  We always do so on exit
+        // as this buffer is not ours to free.
+        if (((byte *)buf_ptr - pipe_start) > (ssize_t)BUF_HDR_SLOTS_SIZE || exiting) {
+            ipc_ring.publish_buffer(data->buf_base, (byte *)buf_ptr - pipe_start);
+            if (exiting)
+                return;
+            // A recycled slot has stale contents throughout.
+            data->buf_base = ring_acquire_buffer();
+            start_buffer_header(data);
+            memset(data->buf_base, 0, TRACE_BUF_SIZE);
+            memset((byte *)data->buf_base + TRACE_BUF_SIZE, -1, REDZONE_SIZE);
+            BUF_PTR(data->seg_base) = data->buf_base + BUF_HDR_SLOTS;
+            return;
+        }
+    } else if (op_thread_pipes.get_value()) {
+        // This thread is the only writer to its pipe.
+        if (((byte *)buf_ptr - pipe_start) > (ssize_t)BUF_HDR_SLOTS_SIZE)
+            thread_file_write(data, pipe_start, (byte *)buf_ptr);
+    } else {
+        // Write the rest to pipe
+        // The last few entries (e.g., instr + refs) may exceed the atomic write
+        // size, so we may need two writes.
+        if (((byte *)buf_ptr - pipe_start) > ipc_pipe.get_atomic_write_size())
+            pipe_start = atomic_pipe_write(drcontext, data, pipe_start, pipe_end);
+        if (((byte *)buf_ptr - pipe_start) > (ssize_t)BUF_HDR_SLOTS_SIZE)
+            atomic_pipe_write(drcontext, data, pipe_start, (byte *)buf_ptr);
     }
+    start_buffer_header(data);
+    buffer_reset(data->buf_base, buf_ptr);
     BUF_PTR(data->seg_base) = data->buf_base + BUF_HDR_SLOTS;
 }
 
+/* Returns where the client may write count entries, first flushing the buffer
+ * if they would reach the redzone.  Without fault_flush the entries could go
+ * in the redzone, but outside of a tracing window no instrumentation would
+ * notice the buffer filling up.
+ */
+static trace_entry_t *
+reserve_entries(void *drcontext, per_thread_t *data, int count)
+{
+    trace_entry_t *redzone = (trace_entry_t *)((byte *)data->buf_base + TRACE_BUF_SIZE);
+    if (BUF_PTR(data->seg_base) + count > redzone)
+        memtrace(drcontext, false);
+    return BUF_PTR(data->seg_base);
+}
+
+#ifdef LINUX
+/* The most entries the instrumentation of one app instr writes: it fills the
+ * buffer only at the end of an instr, so at most this many precede a fault.
+ */
+# define MAX_INSTR_ENTRIES (MAX_NUM_DELAY_INSTRS + 64)
+
+/* With fault_flush, a store of our instrumentation that reaches the redzone
+ * faults.  All entries before reg_ptr are complete, so we flush those, move
+ * the ones the faulting instr's instrumentation had written so far to the
+ * start of the new buffer, and re-execute the store with reg_ptr pointing
+ * there.
+ */
+static dr_signal_action_t
+event_signal(void *drcontext, dr_siginfo_t *info)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    reg_id_t reg_ptr = IF_X86_ELSE(DR_REG_XCX, DR_REG_R1);
+    byte *redzone = (byte *)data->buf_base + TRACE_BUF_SIZE;
+    trace_entry_t partial[MAX_INSTR_ENTRIES];
+    trace_entry_t *instr_start, *buf_ptr;
+    size_t partial_size;
+
+    if (info->sig != SIGSEGV || !info->raw_mcontext_valid ||
+        info->fault_fragment_info.cache_start_pc == NULL ||
+        info->access_address < redzone || info->access_address >= redzone + REDZONE_SIZE)
+        return DR_SIGNAL_DELIVER;
+    instr_start = (trace_entry_t *) reg_get_value(reg_ptr, info->raw_mcontext);
+    DR_ASSERT(instr_start == BUF_PTR(data->seg_base));
+    partial_size = redzone - (byte *)instr_start;
+    DR_ASSERT(partial_size <= sizeof(partial));
+    memcpy(partial, instr_start, partial_size);
+    memtrace(drcontext, false);
+    buf_ptr = BUF_PTR(data->seg_base);
+    memcpy(buf_ptr, partial, partial_size);
+    reg_set_value(reg_ptr, info->raw_mcontext, (reg_t) buf_ptr);
+    return DR_SIGNAL_SUPPRESS;
+}
+#endif
+
 /* clean_call sends the memory reference info to the simulator */
 static void
 clean_call(void)
 {
     void *drcontext = dr_get_current_drcontext();
-    memtrace(drcontext);
+    memtrace(drcontext, false);
 }
 
 static void
@@ -227,7 +789,7 @@ insert_load_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
                     reg_id_t reg_ptr)
 {
     dr_insert_read_raw_tls(drcontext, ilist, where, tls_seg,
-                           tls_offs + MEMTRACE_TLS_OFFS_BUF_PTR, reg_ptr);
+                           TLS_OFFS(MEMTRACE_TLS_OFFS_BUF_PTR), reg_ptr);
 }
 
 static void
@@ -241,7 +803,7 @@ insert_update_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
                              opnd_create_reg(reg_ptr),
                              OPND_CREATE_INT16(adjust)));
     dr_insert_write_raw_tls(drcontext, ilist, where, tls_seg,
-                            tls_offs + MEMTRACE_TLS_OFFS_BUF_PTR, reg_ptr);
+                            TLS_OFFS(MEMTRACE_TLS_OFFS_BUF_PTR), reg_ptr);
 #ifdef ARM // X86 does not support general predicated execution
     if (pred != DR_PRED_NONE) {
         instr_t *instr;
@@ -398,6 +960,7 @@ instrument_instr(void *drcontext, instrlist_t *ilist,
                  reg_id_t reg_ptr, reg_id_t reg_tmp, int adjust)
 {
     insert_save_type_and_size(drcontext, ilist, where, reg_ptr, reg_tmp,
+                              op_data_only.get_value() ? TRACE_TYPE_INSTR_PC :
                               TRACE_TYPE_INSTR,
                               (ushort)instr_length(drcontext, app), adjust);
     insert_save_pc(drcontext, ilist, where, reg_ptr, reg_tmp,
@@ -554,91 +1117,532 @@ instrument_clean_call(void *drcontext, instrlist_t *ilist, instr_t *where,
 #endif
 }
 
-/* For each memory reference app instr, we insert inline code to fill the buffer
- * with an instruction entry and memory reference entries.
+#ifdef X86
+/* For -L0_filter, we use two more scratch registers than the regular
+ * instrumentation: xax holds the aflags and xdx is a general scratch register.
  */
-static dr_emit_flags_t
-event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
-                      instr_t *instr, bool for_trace,
-                      bool translating, void *user_data)
+static dr_spill_slot_t slot_xax = SPILL_SLOT_4;
+static dr_spill_slot_t slot_xdx = SPILL_SLOT_5;
+
+static opnd_t
+opnd_create_tls_slot(int slot)
 {
-    reg_id_t reg_ptr = IF_X86_ELSE(DR_REG_XCX, DR_REG_R1);
-    reg_id_t reg_tmp = IF_X86_ELSE(DR_REG_XBX, DR_REG_R2);
-    int i, adjust = 0;
-    user_data_t *ud = (user_data_t *) user_data;
-    dr_pred_type_t pred;
+    return opnd_create_far_base_disp(tls_seg, DR_REG_NULL, DR_REG_NULL, 0,
+                                     TLS_OFFS(slot), OPSZ_PTR);
+}
 
-    if (!instr_is_app(instr) ||
-        /* Skip identical app pc, which happens with rep str expansion.
-         * XXX: the expansion means our instr fetch trace is not perfect,
-         * but we live with having the wrong instr length.
-         */
-        ud->last_app_pc == instr_get_app_pc(instr))
-        return DR_EMIT_DEFAULT;
+/* Inserts code to add count to the L0 hit count in TLS slot slot.
+ * The aflags must be saved.
+ */
+static void
+insert_add_l0_hits(void *drcontext, instrlist_t *ilist, instr_t *where,
+                   int slot, int count)
+{
+    MINSERT(ilist, where,
+            INSTR_CREATE_add(drcontext, opnd_create_tls_slot(slot),
+                             OPND_CREATE_INT32(count)));
+}
 
-    // FIXME i#1698: there are constraints for code between ldrex/strex pairs.
-    // However there is no way to completely avoid the instrumentation in between,
-    // so we reduce the instrumentation in between by moving strex instru
-    // from before the strex to after the strex.
-    if (ud->strex == NULL && instr_is_exclusive_store(instr)) {
-        opnd_t dst = instr_get_dst(instr, 0);
-        DR_ASSERT(opnd_is_base_disp(dst));
-        // Assuming there are no consecutive strex instructions, otherwise we
-        // will insert instrumentation code at the second strex instruction.
-        if (!instr_writes_to_reg(instr, opnd_get_base(dst),
-                                 DR_QUERY_INCLUDE_COND_DSTS)) {
-            ud->strex = instr;
-            ud->last_app_pc = instr_get_app_pc(instr);
-        }
-        return DR_EMIT_DEFAULT;
+/* Inserts code to look up app's fetch in the L0 instruction cache, adding an
+ * instr entry to the buffer on a miss and counting a hit otherwise.  Since
+ * the pc is known, so are the tag and the set.  We also add the hits we know
+ * of from the preceding instrs in this bb.
+ * XXX: we only look up the line holding an instr's first byte.
+ */
+static void
+instrument_filter_instr(void *drcontext, instrlist_t *ilist, instr_t *app,
+                        instr_t *where, bool lookup, user_data_t *ud)
+{
+    reg_id_t reg_ptr = DR_REG_XCX, reg_tag = DR_REG_XDX;
+    addr_t tag = (addr_t)instr_get_app_pc(app) >> l0_line_bits;
+    int disp = (int)((tag & (l0i_lines - 1)) * sizeof(addr_t));
+
+    dr_save_arith_flags_to_xax(drcontext, ilist, where);
+    if (ud->l0i_hits > 0) {
+        insert_add_l0_hits(drcontext, ilist, where, MEMTRACE_TLS_OFFS_L0I_HITS,
+                           ud->l0i_hits);
+        ud->l0i_hits = 0;
     }
-
-    // Optimization: delay the simple instr trace instrumentation if possible
-    if (!(instr_reads_memory(instr) ||instr_writes_memory(instr)) &&
-        // Avoid dropping trailing instrs
-        !drmgr_is_last_instr(drcontext, instr) &&
-        // The delay instr buffer is not full.
-        ud->num_delay_instrs < MAX_NUM_DELAY_INSTRS) {
-        ud->delay_instrs[ud->num_delay_instrs++] = instr;
-        return DR_EMIT_DEFAULT;
+    if (lookup) {
+        instr_t *hit = INSTR_CREATE_label(drcontext);
+        instr_t *done = INSTR_CREATE_label(drcontext);
+        instr_t *mov1, *mov2;
+        instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)tag,
+                                         opnd_create_reg(reg_tag),
+                                         ilist, where, &mov1, &mov2);
+        instr_set_meta(mov1);
+        if (mov2 != NULL)
+            instr_set_meta(mov2);
+        dr_insert_read_raw_tls(drcontext, ilist, where, tls_seg,
+                               TLS_OFFS(MEMTRACE_TLS_OFFS_L0I_TAGS), reg_ptr);
+        MINSERT(ilist, where,
+                INSTR_CREATE_cmp(drcontext, OPND_CREATE_MEMPTR(reg_ptr, disp),
+                                 opnd_create_reg(reg_tag)));
+        MINSERT(ilist, where, INSTR_CREATE_jcc(drcontext, OP_jz,
+                                               opnd_create_instr(hit)));
+        MINSERT(ilist, where,
+                XINST_CREATE_store(drcontext, OPND_CREATE_MEMPTR(reg_ptr, disp),
+                                   opnd_create_reg(reg_tag)));
+        insert_load_buf_ptr(drcontext, ilist, where, reg_ptr);
+        instrument_instr(drcontext, ilist, app, where, reg_ptr, reg_tag, 0);
+        insert_update_buf_ptr(drcontext, ilist, where, reg_ptr, DR_PRED_NONE,
+                              sizeof(trace_entry_t));
+        MINSERT(ilist, where, XINST_CREATE_jump(drcontext, opnd_create_instr(done)));
+        MINSERT(ilist, where, hit);
+        insert_add_l0_hits(drcontext, ilist, where, MEMTRACE_TLS_OFFS_L0I_HITS, 1);
+        MINSERT(ilist, where, done);
     }
+    dr_restore_arith_flags_from_xax(drcontext, ilist, where);
+}
 
-    pred = instr_get_predicate(instr);
-    /* opt: save/restore reg per instr instead of per entry */
-    /* We need two scratch registers */
-    dr_save_reg(drcontext, bb, instr, reg_ptr, slot_ptr);
-    dr_save_reg(drcontext, bb, instr, reg_tmp, slot_tmp);
-    /* load buf ptr into reg_ptr */
-    insert_load_buf_ptr(drcontext, bb, instr, reg_ptr);
+/* Inserts code to add an entry for the memory reference ref, but for loads
+ * and stores only if they miss in the L0 data cache, counting a hit otherwise.
+ * XXX: we only look up the line holding the first byte.
+ */
+static void
+instrument_filter_mem(void *drcontext, instrlist_t *ilist, instr_t *where,
+                      opnd_t ref, bool write)
+{
+    reg_id_t reg_ptr = DR_REG_XCX, reg_addr = DR_REG_XBX, reg_tag = DR_REG_XDX;
+    ushort type = write ? TRACE_TYPE_WRITE : TRACE_TYPE_READ;
+    ushort size = (ushort)drutil_opnd_mem_size_in_bytes(ref, where);
+    instr_t *hit = NULL, *done = NULL;
+    bool lookup = true;
+    bool ok;
 
-    if (ud->num_delay_instrs != 0) {
-        adjust = instrument_delay_instrs(drcontext, bb, ud, instr,
-                                         reg_ptr, reg_tmp, adjust);
+    if (instr_is_prefetch(where)) {
+        type = instr_to_prefetch_type(where);
+        size = 1;
+        lookup = false;
+    } else if (instr_is_flush(where)) {
+        type = TRACE_TYPE_DATA_FLUSH;
+        lookup = false;
     }
+    /* The address computation does not touch the aflags, which are not saved
+     * yet, so xax still holds the app value if ref needs it.
+     */
+    if (opnd_uses_reg(ref, reg_ptr))
+        dr_restore_reg(drcontext, ilist, where, reg_ptr, slot_ptr);
+    if (opnd_uses_reg(ref, reg_addr))
+        dr_restore_reg(drcontext, ilist, where, reg_addr, slot_tmp);
+    if (opnd_uses_reg(ref, DR_REG_XAX))
+        dr_restore_reg(drcontext, ilist, where, DR_REG_XAX, slot_xax);
+    if (opnd_uses_reg(ref, reg_tag))
+        dr_restore_reg(drcontext, ilist, where, reg_tag, slot_xdx);
+    ok = drutil_insert_get_mem_addr(drcontext, ilist, where, ref, reg_addr, reg_tag);
+    DR_ASSERT(ok);
 
-    if (ud->strex != NULL) {
-        DR_ASSERT(instr_is_exclusive_store(ud->strex));
-        adjust = instrument_instr(drcontext, bb, ud->strex, instr,
-                                  reg_ptr, reg_tmp, adjust);
-        adjust = instrument_mem(drcontext, bb, instr,
-                                instr_get_dst(ud->strex, 0),
-                                true, reg_ptr, reg_tmp,
-                                instr_get_predicate(ud->strex), adjust);
-        ud->strex = NULL;
+    dr_save_arith_flags_to_xax(drcontext, ilist, where);
+    if (lookup) {
+        hit = INSTR_CREATE_label(drcontext);
+        done = INSTR_CREATE_label(drcontext);
+        /* reg_tag = addr >> bits; reg_ptr = &tags[reg_tag & (lines - 1)] */
+        MINSERT(ilist, where,
+                XINST_CREATE_move(drcontext, opnd_create_reg(reg_tag),
+                                  opnd_create_reg(reg_addr)));
+        MINSERT(ilist, where,
+                INSTR_CREATE_shr(drcontext, opnd_create_reg(reg_tag),
+                                 OPND_CREATE_INT8(l0_line_bits)));
+        MINSERT(ilist, where,
+                XINST_CREATE_move(drcontext, opnd_create_reg(reg_ptr),
+                                  opnd_create_reg(reg_tag)));
+        MINSERT(ilist, where,
+                INSTR_CREATE_and(drcontext, opnd_create_reg(reg_ptr),
+                                 OPND_CREATE_INT32((int)(l0d_lines - 1))));
+        MINSERT(ilist, where,
+                INSTR_CREATE_shl(drcontext, opnd_create_reg(reg_ptr),
+                                 OPND_CREATE_INT8(IF_X64_ELSE(3, 2))));
+        MINSERT(ilist, where,
+                INSTR_CREATE_add(drcontext, opnd_create_reg(reg_ptr),
+                                 opnd_create_tls_slot(MEMTRACE_TLS_OFFS_L0D_TAGS)));
+        MINSERT(ilist, where,
+                INSTR_CREATE_cmp(drcontext, OPND_CREATE_MEMPTR(reg_ptr, 0),
+                                 opnd_create_reg(reg_tag)));
+        MINSERT(ilist, where, INSTR_CREATE_jcc(drcontext, OP_jz,
+                                               opnd_create_instr(hit)));
+        MINSERT(ilist, where,
+                XINST_CREATE_store(drcontext, OPND_CREATE_MEMPTR(reg_ptr, 0),
+                                   opnd_create_reg(reg_tag)));
+    }
+    insert_load_buf_ptr(drcontext, ilist, where, reg_ptr);
+    insert_save_type_and_size(drcontext, ilist, where, reg_ptr, reg_tag,
+                              type, size, 0);
+    MINSERT(ilist, where,
+            XINST_CREATE_store(drcontext,
+                               OPND_CREATE_MEMPTR(reg_ptr,
+                                                  offsetof(trace_entry_t, addr)),
+                               opnd_create_reg(reg_addr)));
+    insert_update_buf_ptr(drcontext, ilist, where, reg_ptr, DR_PRED_NONE,
+                          sizeof(trace_entry_t));
+    if (lookup) {
+        MINSERT(ilist, where, XINST_CREATE_jump(drcontext, opnd_create_instr(done)));
+        MINSERT(ilist, where, hit);
+        insert_add_l0_hits(drcontext, ilist, where, MEMTRACE_TLS_OFFS_L0D_HITS, 1);
+        MINSERT(ilist, where, done);
     }
+    dr_restore_arith_flags_from_xax(drcontext, ilist, where);
+}
 
-    /* Instruction entry for instr fetch trace.  This does double-duty by
-     * also providing the PC for subsequent data ref entries.
-     */
-    /* XXX i#1703: we may want to put the instr fetch under an option, in
-     * case the user only cares about data references.
-     * Note that in that case we may want to still provide the PC for
-     * memory references, and it may be better to add a PC field to
-     * trace_entry_t than require a separate instr entry for every memref
-     * instr (if average # of memrefs per instr is < 2, PC field is better).
-     */
-    adjust = instrument_instr(drcontext, bb, instr, instr, reg_ptr, reg_tmp, adjust);
-    ud->last_app_pc = instr_get_app_pc(instr);
+/* For -L0_filter, instead of recording every instr fetch and memory
+ * reference, we look each up in the thread's L0 caches and only record the
+ * misses.  An instr on the same line as the previous instr in the bb must hit,
+ * so we just count it.
+ * XXX i#1703: add ARM support.
+ */
+static dr_emit_flags_t
+instrument_filtered(void *drcontext, instrlist_t *bb, instr_t *instr,
+                    user_data_t *ud)
+{
+    reg_id_t reg_ptr = DR_REG_XCX, reg_tmp = DR_REG_XBX;
+    addr_t tag = (addr_t)instr_get_app_pc(instr) >> l0_line_bits;
+    bool lookup = (tag != ud->last_l0i_tag);
+    bool has_mem = instr_reads_memory(instr) || instr_writes_memory(instr);
+    bool is_last = drmgr_is_last_instr(drcontext, instr);
+    int i;
+
+    ud->last_app_pc = instr_get_app_pc(instr);
+    ud->last_l0i_tag = tag;
+    if (!lookup)
+        ud->l0i_hits++;
+    if (!lookup && !has_mem && !is_last)
+        return DR_EMIT_DEFAULT;
+
+    dr_save_reg(drcontext, bb, instr, reg_ptr, slot_ptr);
+    dr_save_reg(drcontext, bb, instr, reg_tmp, slot_tmp);
+    dr_save_reg(drcontext, bb, instr, DR_REG_XAX, slot_xax);
+    dr_save_reg(drcontext, bb, instr, DR_REG_XDX, slot_xdx);
+
+    instrument_filter_instr(drcontext, bb, instr, instr, lookup, ud);
+    if (has_mem) {
+        for (i = 0; i < instr_num_srcs(instr); i++) {
+            if (opnd_is_memory_reference(instr_get_src(instr, i))) {
+                instrument_filter_mem(drcontext, bb, instr, instr_get_src(instr, i),
+                                      false);
+            }
+        }
+        for (i = 0; i < instr_num_dsts(instr); i++) {
+            if (opnd_is_memory_reference(instr_get_dst(instr, i))) {
+                instrument_filter_mem(drcontext, bb, instr, instr_get_dst(instr, i),
+                                      true);
+            }
+        }
+    }
+
+    if (is_last) {
+        insert_load_buf_ptr(drcontext, bb, instr, reg_ptr);
+        instrument_clean_call(drcontext, bb, instr, reg_ptr, reg_tmp);
+    }
+
+    dr_restore_reg(drcontext, bb, instr, DR_REG_XDX, slot_xdx);
+    dr_restore_reg(drcontext, bb, instr, DR_REG_XAX, slot_xax);
+    dr_restore_reg(drcontext, bb, instr, reg_tmp, slot_tmp);
+    dr_restore_reg(drcontext, bb, instr, reg_ptr, slot_ptr);
+    return DR_EMIT_DEFAULT;
+}
+#endif
+
+/* Returns how many data entries event_app_instruction() records for instr */
+static int
+instr_num_mem_refs(instr_t *instr)
+{
+    int i, count = 0;
+    if (!instr_reads_memory(instr) && !instr_writes_memory(instr))
+        return 0;
+    for (i = 0; i < instr_num_srcs(instr); i++) {
+        if (opnd_is_memory_reference(instr_get_src(instr, i)))
+            count++;
+    }
+    for (i = 0; i < instr_num_dsts(instr); i++) {
+        if (opnd_is_memory_reference(instr_get_dst(instr, i)))
+            count++;
+    }
+    return count;
+}
+
+/* For -instr_only and -instr_blocks, we add a single block entry per bb
+ * execution, at the bb's first app instr, in place of its instr and instr
+ * bundle entries.  With -instr_blocks, each instr's data entries follow as
+ * usual but with no instr entry before them: the block file lists how many
+ * each instr has, for the reader to tell which instr they belong to.
+ */
+static dr_emit_flags_t
+instrument_block(void *drcontext, instrlist_t *bb, instr_t *instr, user_data_t *ud)
+{
+    reg_id_t reg_ptr = IF_X86_ELSE(DR_REG_XCX, DR_REG_R1);
+    reg_id_t reg_tmp = IF_X86_ELSE(DR_REG_XBX, DR_REG_R2);
+    trace_entry_t entry;
+    bool first = (instr == ud->first_app && ud->block_instrs > 0);
+    bool refs = op_instr_blocks.get_value() && instr_num_mem_refs(instr) > 0;
+    /* With -instr_only, a single entry per bb, we may as well check the buffer
+     * at the start.  Otherwise we check it at the end as usual.
+     */
+    bool check = !fault_flush &&
+        (op_instr_blocks.get_value() ? drmgr_is_last_instr(drcontext, instr) : first);
+    int i, adjust = 0;
+
+    ud->last_app_pc = instr_get_app_pc(instr);
+    if (!first && !refs && !check)
+        return DR_EMIT_DEFAULT;
+    dr_save_reg(drcontext, bb, instr, reg_ptr, slot_ptr);
+    dr_save_reg(drcontext, bb, instr, reg_tmp, slot_tmp);
+    insert_load_buf_ptr(drcontext, bb, instr, reg_ptr);
+    if (first) {
+        entry.type = TRACE_TYPE_INSTR_BLOCK;
+        entry.size = (ushort)ud->block_instrs;
+        entry.addr = (addr_t)instr_get_app_pc(instr);
+        adjust = instrument_trace_entry(drcontext, bb, entry, instr, reg_ptr, reg_tmp,
+                                        adjust);
+    }
+    if (refs) {
+        /* The same entries, in the same order, as event_app_instruction() */
+        for (i = 0; i < instr_num_srcs(instr); i++) {
+            if (opnd_is_memory_reference(instr_get_src(instr, i))) {
+                adjust = instrument_mem(drcontext, bb, instr, instr_get_src(instr, i),
+                                        false, reg_ptr, reg_tmp, DR_PRED_NONE, adjust);
+            }
+        }
+        for (i = 0; i < instr_num_dsts(instr); i++) {
+            if (opnd_is_memory_reference(instr_get_dst(instr, i))) {
+                adjust = instrument_mem(drcontext, bb, instr, instr_get_dst(instr, i),
+                                        true, reg_ptr, reg_tmp, DR_PRED_NONE, adjust);
+            }
+        }
+    }
+    insert_update_buf_ptr(drcontext, bb, instr, reg_ptr, DR_PRED_NONE, adjust);
+    if (check)
+        instrument_clean_call(drcontext, bb, instr, reg_ptr, reg_tmp);
+    dr_restore_reg(drcontext, bb, instr, reg_ptr, slot_ptr);
+    dr_restore_reg(drcontext, bb, instr, reg_tmp, slot_tmp);
+    return DR_EMIT_DEFAULT;
+}
+
+/* For -instr_only and -instr_blocks: lists the lengths of the app instrs of bb,
+ * and with -instr_blocks their numbers of data entries, in the block file,
+ * unless an identical block is listed already, and returns their count.  We
+ * skip identical app pcs as event_app_instruction() does.
+ */
+static int
+block_file_add(void *drcontext, instrlist_t *bb)
+{
+    char buf[64];
+    std::string lengths;
+    app_pc start = NULL, last_pc = NULL;
+    instr_t *instr;
+    int count = 0;
+
+    for (instr = instrlist_first_app(bb); instr != NULL;
+         instr = instr_get_next_app(instr)) {
+        app_pc pc = instr_get_app_pc(instr);
+        if (pc == last_pc)
+            continue;
+        if (count == 0)
+            start = pc;
+        last_pc = pc;
+        if (op_instr_blocks.get_value()) {
+            dr_snprintf(buf, BUFFER_SIZE_ELEMENTS(buf), count == 0 ? "%d:%d" : ",%d:%d",
+                        instr_length(drcontext, instr), instr_num_mem_refs(instr));
+        } else {
+            dr_snprintf(buf, BUFFER_SIZE_ELEMENTS(buf), count == 0 ? "%d" : ",%d",
+                        instr_length(drcontext, instr));
+        }
+        NULL_TERMINATE_BUFFER(buf);
+        lengths += buf;
+        count++;
+    }
+    if (count == 0)
+        return 0;
+    DR_ASSERT(count <= USHRT_MAX);
+    dr_snprintf(buf, BUFFER_SIZE_ELEMENTS(buf), PFX " %d ", start, count);
+    NULL_TERMINATE_BUFFER(buf);
+    std::string line = buf + lengths + "\n";
+    dr_mutex_lock(mutex);
+    /* A single write, so that a reader never sees part of a line */
+    if (blocks_listed.insert(line).second && block_file != INVALID_FILE)
+        dr_write_file(block_file, line.c_str(), line.size());
+    dr_mutex_unlock(mutex);
+    return count;
+}
+
+/* Called once the instrs of the current tracing window have run out */
+static void
+end_tracing_window(void)
+{
+    bool changed = false;
+    dr_mutex_lock(mutex);
+    /* Another thread may have got here first */
+    if (window_instrs_left <= 0) {
+        changed = true;
+        if (!tracing_enabled) {
+            tracing_enabled = true;
+            window_instrs_left = (ptr_int_t)op_trace_for_instrs.get_value();
+        } else {
+            tracing_enabled = false;
+            window_instrs_left = (ptr_int_t)op_retrace_every_instrs.get_value();
+        }
+        window_counting = (window_instrs_left > 0);
+        NOTIFY(1, "%s tracing\n", tracing_enabled ? "Starting" : "Stopping");
+    }
+    dr_mutex_unlock(mutex);
+    /* Code built from now on uses the new mode.  The flush must be done with
+     * no locks held.
+     */
+    if (changed && !dr_delay_flush_region(NULL, ~0UL, 0, NULL))
+        DR_ASSERT(false);
+}
+
+#ifndef X86
+static void
+count_instrs(int count)
+{
+    if (dr_atomic_add32_return_sum((volatile int *)&window_instrs_left, -count) <= 0)
+        end_tracing_window();
+}
+#endif
+
+/* Inserts code to deduct the count instrs of a bb from the current window,
+ * calling end_tracing_window() if that uses it up.
+ */
+static void
+insert_count_instrs(void *drcontext, instrlist_t *ilist, instr_t *where, int count)
+{
+#ifdef X86
+    reg_id_t reg_ptr = DR_REG_XCX;
+    instr_t *skip_call = INSTR_CREATE_label(drcontext);
+    instr_t *mov1, *mov2;
+    dr_save_reg(drcontext, ilist, where, reg_ptr, slot_ptr);
+    dr_save_reg(drcontext, ilist, where, DR_REG_XAX, slot_tmp);
+    dr_save_arith_flags_to_xax(drcontext, ilist, where);
+    instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)&window_instrs_left,
+                                     opnd_create_reg(reg_ptr), ilist, where,
+                                     &mov1, &mov2);
+    instr_set_meta(mov1);
+    if (mov2 != NULL)
+        instr_set_meta(mov2);
+    MINSERT(ilist, where,
+            LOCK(INSTR_CREATE_sub(drcontext, OPND_CREATE_MEMPTR(reg_ptr, 0),
+                                  OPND_CREATE_INT32(count))));
+    MINSERT(ilist, where, INSTR_CREATE_jcc(drcontext, OP_jnle,
+                                           opnd_create_instr(skip_call)));
+    dr_insert_clean_call(drcontext, ilist, where, (void *)end_tracing_window, false, 0);
+    MINSERT(ilist, where, skip_call);
+    dr_restore_arith_flags_from_xax(drcontext, ilist, where);
+    dr_restore_reg(drcontext, ilist, where, DR_REG_XAX, slot_tmp);
+    dr_restore_reg(drcontext, ilist, where, reg_ptr, slot_ptr);
+#else
+    /* XXX: inline this as on x86 */
+    dr_insert_clean_call(drcontext, ilist, where, (void *)count_instrs, false, 1,
+                         OPND_CREATE_INT32(count));
+#endif
+}
+
+/* For each memory reference app instr, we insert inline code to fill the buffer
+ * with an instruction entry and memory reference entries.
+ */
+static dr_emit_flags_t
+event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
+                      instr_t *instr, bool for_trace,
+                      bool translating, void *user_data)
+{
+    reg_id_t reg_ptr = IF_X86_ELSE(DR_REG_XCX, DR_REG_R1);
+    reg_id_t reg_tmp = IF_X86_ELSE(DR_REG_XBX, DR_REG_R2);
+    int i, adjust = 0;
+    user_data_t *ud = (user_data_t *) user_data;
+    dr_pred_type_t pred;
+
+    if (ud->counting && instr == ud->first_app)
+        insert_count_instrs(drcontext, bb, instr, ud->num_app_instrs);
+    if (!ud->tracing)
+        return DR_EMIT_DEFAULT;
+
+    if (!instr_is_app(instr) ||
+        /* Skip identical app pc, which happens with rep str expansion.
+         * XXX: the expansion means our instr fetch trace is not perfect,
+         * but we live with having the wrong instr length.
+         */
+        ud->last_app_pc == instr_get_app_pc(instr))
+        return DR_EMIT_DEFAULT;
+
+#ifdef X86
+    if (op_L0_filter.get_value())
+        return instrument_filtered(drcontext, bb, instr, ud);
+#endif
+    if (op_instr_only.get_value() || op_instr_blocks.get_value())
+        return instrument_block(drcontext, bb, instr, ud);
+
+    // FIXME i#1698: there are constraints for code between ldrex/strex pairs.
+    // However there is no way to completely avoid the instrumentation in between,
+    // so we reduce the instrumentation in between by moving strex instru
+    // from before the strex to after the strex.
+    if (ud->strex == NULL && instr_is_exclusive_store(instr)) {
+        opnd_t dst = instr_get_dst(instr, 0);
+        DR_ASSERT(opnd_is_base_disp(dst));
+        // Assuming there are no consecutive strex instructions, otherwise we
+        // will insert instrumentation code at the second strex instruction.
+        if (!instr_writes_to_reg(instr, opnd_get_base(dst),
+                                 DR_QUERY_INCLUDE_COND_DSTS)) {
+            ud->strex = instr;
+            ud->last_app_pc = instr_get_app_pc(instr);
+        }
+        return DR_EMIT_DEFAULT;
+    }
+
+    // With -data_only we skip instrs without memory references, other than
+    // the last, where we may need to check the buffer.
+    if (op_data_only.get_value() &&
+        !(instr_reads_memory(instr) || instr_writes_memory(instr)) &&
+        (fault_flush || !drmgr_is_last_instr(drcontext, instr)))
+        return DR_EMIT_DEFAULT;
+
+    // Optimization: delay the simple instr trace instrumentation if possible
+    if (!op_data_only.get_value() &&
+        !(instr_reads_memory(instr) ||instr_writes_memory(instr)) &&
+        // Avoid dropping trailing instrs
+        !drmgr_is_last_instr(drcontext, instr) &&
+        // The delay instr buffer is not full.
+        ud->num_delay_instrs < MAX_NUM_DELAY_INSTRS) {
+        ud->delay_instrs[ud->num_delay_instrs++] = instr;
+        return DR_EMIT_DEFAULT;
+    }
+
+    pred = instr_get_predicate(instr);
+    /* opt: save/restore reg per instr instead of per entry */
+    /* We need two scratch registers */
+    dr_save_reg(drcontext, bb, instr, reg_ptr, slot_ptr);
+    dr_save_reg(drcontext, bb, instr, reg_tmp, slot_tmp);
+    /* load buf ptr into reg_ptr */
+    insert_load_buf_ptr(drcontext, bb, instr, reg_ptr);
+
+    if (ud->num_delay_instrs != 0) {
+        adjust = instrument_delay_instrs(drcontext, bb, ud, instr,
+                                         reg_ptr, reg_tmp, adjust);
+    }
+
+    if (ud->strex != NULL) {
+        DR_ASSERT(instr_is_exclusive_store(ud->strex));
+        adjust = instrument_instr(drcontext, bb, ud->strex, instr,
+                                  reg_ptr, reg_tmp, adjust);
+        adjust = instrument_mem(drcontext, bb, instr,
+                                instr_get_dst(ud->strex, 0),
+                                true, reg_ptr, reg_tmp,
+                                instr_get_predicate(ud->strex), adjust);
+        ud->strex = NULL;
+    }
+
+    /* Instruction entry for instr fetch trace.  This does double-duty by
+     * also providing the PC for subsequent data ref entries.
+     */
+    /* With -data_only this is a pc entry instead, and only for memory
+     * reference instrs.
+     * XXX i#1703: it may be better to add a PC field to trace_entry_t than
+     * require a separate entry for every memref instr (if average # of
+     * memrefs per instr is < 2, PC field is better).
+     */
+    if (!op_data_only.get_value() ||
+        instr_reads_memory(instr) || instr_writes_memory(instr)) {
+        adjust = instrument_instr(drcontext, bb, instr, instr, reg_ptr, reg_tmp,
+                                  adjust);
+    }
+    ud->last_app_pc = instr_get_app_pc(instr);
 
     // FIXME i#1703: add OP_clflush handling for cache flush on X86
     if (instr_reads_memory(instr) || instr_writes_memory(instr)) {
@@ -676,7 +1680,7 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
      * We restore the registers after the clean call, which should be ok
      * assuming the clean call does not need the two register values.
      */
-    if (drmgr_is_last_instr(drcontext, instr))
+    if (drmgr_is_last_instr(drcontext, instr) && !fault_flush)
         instrument_clean_call(drcontext, bb, instr, reg_ptr, reg_tmp);
 
     /* restore scratch registers */
@@ -693,7 +1697,11 @@ event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
                  bool for_trace, bool translating, OUT void **user_data)
 {
     user_data_t *data = (user_data_t *) dr_thread_alloc(drcontext, sizeof(user_data_t));
+    data->tracing = tracing_enabled;
+    data->counting = window_counting;
     data->last_app_pc = NULL;
+    data->last_l0i_tag = L0_TAG_INVALID;
+    data->l0i_hits = 0;
     data->strex = NULL;
     data->num_delay_instrs = 0;
     *user_data = (void *)data;
@@ -701,6 +1709,10 @@ event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
         DR_ASSERT(false);
         /* in release build, carry on: we'll just miss per-iter refs */
     }
+    /* The mode may have changed by the time a bb is rebuilt for translation */
+    if (op_trace_after_instrs.get_value() > 0 || op_trace_for_instrs.get_value() > 0 ||
+        trace_regions)
+        return DR_EMIT_STORE_TRANSLATIONS;
     return DR_EMIT_DEFAULT;
 }
 
@@ -708,7 +1720,15 @@ static dr_emit_flags_t
 event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
                   bool for_trace, bool translating, void *user_data)
 {
-    /* do nothing */
+    user_data_t *ud = (user_data_t *) user_data;
+    instr_t *instr;
+    ud->first_app = instrlist_first_app(bb);
+    ud->num_app_instrs = 0;
+    for (instr = ud->first_app; instr != NULL; instr = instr_get_next_app(instr))
+        ud->num_app_instrs++;
+    ud->block_instrs = 0;
+    if ((op_instr_only.get_value() || op_instr_blocks.get_value()) && ud->tracing)
+        ud->block_instrs = block_file_add(drcontext, bb);
     return DR_EMIT_DEFAULT;
 }
 
@@ -733,7 +1753,7 @@ event_pre_syscall(void *drcontext, int sysnum)
         addr_t end   = (addr_t)dr_syscall_get_param(drcontext, 1);
         data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
         if (end > start) {
-            buf_ptr = BUF_PTR(data->seg_base);
+            buf_ptr = reserve_entries(drcontext, data, 2);
             buf_ptr->type = TRACE_TYPE_INSTR_FLUSH;
             buf_ptr->addr = start;
             buf_ptr->size = ((end - start) <= USHRT_MAX) ? (end - start) : 0;
@@ -748,10 +1768,36 @@ event_pre_syscall(void *drcontext, int sysnum)
         }
     }
 #endif
-    memtrace(drcontext);
+    if (op_record_syscalls.get_value()) {
+        per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+        trace_entry_t *buf_ptr = reserve_entries(drcontext, data, 1);
+        buf_ptr->type = TRACE_TYPE_SYSCALL;
+        buf_ptr->size = (unsigned short) sysnum;
+        buf_ptr->addr = 0;
+        BUF_PTR(data->seg_base) = ++buf_ptr;
+    }
+    memtrace(drcontext, false);
+    if (op_record_syscalls.get_value()) {
+        /* We start the clock after writing out the buffer, so as to time the
+         * syscall rather than the tracer.
+         */
+        per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+        data->syscall_start = dr_get_microseconds();
+    }
     return true;
 }
 
+static void
+event_post_syscall(void *drcontext, int sysnum)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    trace_entry_t *buf_ptr = reserve_entries(drcontext, data, 1);
+    buf_ptr->type = TRACE_TYPE_SYSCALL_END;
+    buf_ptr->size = (unsigned short) sysnum;
+    buf_ptr->addr = (addr_t) (dr_get_microseconds() - data->syscall_start);
+    BUF_PTR(data->seg_base) = ++buf_ptr;
+}
+
 static void
 event_thread_init(void *drcontext)
 {
@@ -765,23 +1811,113 @@ event_thread_init(void *drcontext)
      * slot and find where the pointer points to in the buffer.
      */
     data->seg_base = (byte *) dr_get_dr_segment_base(tls_seg);
-    data->buf_base = (trace_entry_t *)
-        dr_raw_mem_alloc(MAX_BUF_SIZE, DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
-    DR_ASSERT(data->seg_base != NULL && data->buf_base != NULL);
-    /* clear trace buffer */
-    memset(data->buf_base, 0, TRACE_BUF_SIZE);
-    /* set sentinel (non-zero) value in redzone */
-    memset((byte *)data->buf_base + TRACE_BUF_SIZE, -1, REDZONE_SIZE);
+    DR_ASSERT(data->seg_base != NULL);
+    if (op_shm.get_value()) {
+        data->buf_base = ring_acquire_buffer();
+        buffer_init(data->buf_base);
+    } else
+        data->buf_base = buffer_create();
+    data->writer = NULL;
+    data->num_spare = 0;
+    if (writers != NULL) {
+        /* Spread the threads over the writers by id */
+        data->writer = &writers[dr_get_thread_id(drcontext) % num_writers];
+        for (; data->num_spare < WRITER_SPARE_BUFS; data->num_spare++)
+            data->spare_bufs[data->num_spare] = buffer_create();
+    }
     /* put buf_base to TLS plus header slots as starting buf_ptr */
     BUF_PTR(data->seg_base) = data->buf_base + BUF_HDR_SLOTS;
+    start_buffer_header(data);
+    data->alloc_depth = 0;
+    data->syscall_start = 0;
 
     /* pass pid and tid to the simulator to register current thread */
     init_thread_entry(drcontext, &pid_info[0]);
     pid_info[1].type = TRACE_TYPE_PID;
     pid_info[1].size = sizeof(process_id_t);
     pid_info[1].addr = (addr_t) dr_get_process_id();
-    if (ipc_pipe.write((void *)pid_info, sizeof(pid_info)) < (ssize_t)sizeof(pid_info))
-        DR_ASSERT(false);
+    if (op_offline.get_value()) {
+        char path[MAXIMUM_PATH];
+        /* We include the pid to support multiple processes sharing an outdir */
+        dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s/%s.%d.%d.%s",
+                    op_outdir.get_value().c_str(), OUTFILE_PREFIX,
+                    dr_get_process_id(), dr_get_thread_id(drcontext), OUTFILE_SUFFIX);
+        NULL_TERMINATE_BUFFER(path);
+        data->file = dr_open_file(path, DR_FILE_WRITE_OVERWRITE | DR_FILE_ALLOW_LARGE);
+        if (data->file == INVALID_FILE) {
+            NOTIFY(0, "Failed to create trace file %s\n", path);
+            dr_abort();
+        }
+        data->file_offs = 0;
+        if (op_compress.get_value()) {
+            trace_file_header_t header;
+            memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic));
+            header.version = TRACE_FILE_VERSION;
+            header.reserved = 0;
+            thread_file_write(data, (byte *)&header, (byte *)(&header + 1));
+            data->chunk_buf = (unsigned char *)
+                dr_raw_mem_alloc(CHUNK_BUF_SIZE, DR_MEMPROT_READ | DR_MEMPROT_WRITE,
+                                 NULL);
+            DR_ASSERT(data->chunk_buf != NULL);
+            data->chunk_index_count = 0;
+            data->chunk_index_capacity = CHUNK_INDEX_INIT_COUNT;
+            data->chunk_index = (trace_chunk_index_t *)
+                dr_global_alloc(data->chunk_index_capacity * sizeof(*data->chunk_index));
+            /* Every chunk carries the process entry, so we only pass the thread */
+            offline_chunk_write(data, &pid_info[0], &pid_info[1]);
+        } else {
+            thread_file_write(data, (byte *)pid_info,
+                              (byte *)pid_info + sizeof(pid_info));
+        }
+    } else if (op_shm.get_value()) {
+        /* Publish these in a buffer of their own, before any trace data */
+        data->file = INVALID_FILE;
+        trace_entry_t *buf = ring_acquire_buffer();
+        memcpy(buf, pid_info, sizeof(pid_info));
+        ipc_ring.publish_buffer(buf, sizeof(pid_info));
+    } else {
+        data->file = INVALID_FILE;
+        if (compress_pipe) {
+            data->chunk_buf = (unsigned char *)
+                dr_raw_mem_alloc(CHUNK_BUF_SIZE, DR_MEMPROT_READ | DR_MEMPROT_WRITE,
+                                 NULL);
+            DR_ASSERT(data->chunk_buf != NULL);
+            /* Every chunk carries the process entry, so we only pass the thread */
+            compressed_pipe_write(data, &pid_info[0], &pid_info[1]);
+        } else if (ipc_pipe.write((void *)pid_info, sizeof(pid_info)) <
+                   (ssize_t)sizeof(pid_info))
+            DR_ASSERT(false);
+        if (op_thread_pipes.get_value()) {
+            /* The simulator opens our pipe once it sees the entries above on
+             * the main pipe, which unblocks our open.  We create the pipe first
+             * so it is there by then.
+             */
+            char name[MAXIMUM_PATH];
+            dr_snprintf(name, BUFFER_SIZE_ELEMENTS(name), "%s%s%d",
+                        op_ipc_name.get_value().c_str(), THREAD_PIPE_SUFFIX,
+                        dr_get_thread_id(drcontext));
+            NULL_TERMINATE_BUFFER(name);
+            named_pipe_t thread_pipe(name);
+            /* A stale pipe left by a prior thread with the same id is fine */
+            thread_pipe.create();
+            /* we want an isolated fd so we don't use open_for_write() */
+            data->file = dr_open_file(thread_pipe.get_pipe_path().c_str(),
+                                      DR_FILE_WRITE_ONLY);
+            DR_ASSERT(data->file != INVALID_FILE);
+        }
+    }
+    if (op_L0_filter.get_value()) {
+        data->l0i_tags = (addr_t *)
+            dr_thread_alloc(drcontext, l0i_lines * sizeof(addr_t));
+        data->l0d_tags = (addr_t *)
+            dr_thread_alloc(drcontext, l0d_lines * sizeof(addr_t));
+        memset(data->l0i_tags, -1, l0i_lines * sizeof(addr_t));
+        memset(data->l0d_tags, -1, l0d_lines * sizeof(addr_t));
+        *TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_L0I_TAGS) = data->l0i_tags;
+        *TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_L0D_TAGS) = data->l0d_tags;
+        L0_HITS(data->seg_base, MEMTRACE_TLS_OFFS_L0I_HITS) = 0;
+        L0_HITS(data->seg_base, MEMTRACE_TLS_OFFS_L0D_HITS) = 0;
+    }
     data->num_refs = 0;
 }
 
@@ -791,40 +1927,569 @@ event_thread_exit(void *drcontext)
     per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
 
     /* let the simulator know this thread has exited */
-    trace_entry_t *buf_ptr = BUF_PTR(data->seg_base);
+    trace_entry_t *buf_ptr = reserve_entries(drcontext, data, 1);
     buf_ptr->type = TRACE_TYPE_THREAD_EXIT;
     buf_ptr->size = sizeof(thread_id_t);
     buf_ptr->addr = (addr_t) dr_get_thread_id(drcontext);
     BUF_PTR(data->seg_base) = ++buf_ptr;
 
-    memtrace(drcontext);
+    memtrace(drcontext, true);
+
+    if (op_offline.get_value()) {
+        if (op_compress.get_value()) {
+            offline_index_write(data);
+            dr_raw_mem_free(data->chunk_buf, CHUNK_BUF_SIZE);
+        }
+        dr_close_file(data->file);
+    } else if (compress_pipe) {
+        dr_raw_mem_free(data->chunk_buf, CHUNK_BUF_SIZE);
+    } else if (data->file != INVALID_FILE) {
+        /* The simulator sees EOF on this thread's pipe */
+        dr_close_file(data->file);
+    }
 
     dr_mutex_lock(mutex);
     num_refs += data->num_refs;
     dr_mutex_unlock(mutex);
-    dr_raw_mem_free(data->buf_base, MAX_BUF_SIZE);
+    if (!op_shm.get_value())
+        dr_raw_mem_free(data->buf_base, MAX_BUF_SIZE);
+    /* memtrace() took back any buffers our writer had */
+    DR_ASSERT(data->writer == NULL || data->num_spare == WRITER_SPARE_BUFS);
+    while (data->num_spare > 0)
+        dr_raw_mem_free(data->spare_bufs[--data->num_spare], MAX_BUF_SIZE);
+    if (op_L0_filter.get_value()) {
+        dr_thread_free(drcontext, data->l0i_tags, l0i_lines * sizeof(addr_t));
+        dr_thread_free(drcontext, data->l0d_tags, l0d_lines * sizeof(addr_t));
+    }
+    dr_thread_free(drcontext, data, sizeof(per_thread_t));
+}
+
+/***************************************************************************
+ * -record_allocs
+ */
+
+enum {
+    ALLOC_MALLOC,  /* (size) */
+    ALLOC_CALLOC,  /* (count, size) */
+    ALLOC_REALLOC, /* (ptr, size) */
+    ALLOC_FREE,    /* (ptr) */
+    ALLOC_MMAP,    /* (addr, size, ...) */
+    ALLOC_MUNMAP,  /* (addr, size) */
+};
+
+static const struct {
+    const char *name;
+    int kind;
+} alloc_routines[] = {
+    { "malloc", ALLOC_MALLOC },
+    { "calloc", ALLOC_CALLOC },
+    { "realloc", ALLOC_REALLOC },
+    { "free", ALLOC_FREE },
+#ifdef UNIX
+    /* The C++ operators, by their Itanium C++ ABI names */
+    { IF_X64_ELSE("_Znwm", "_Znwj"), ALLOC_MALLOC },
+    { IF_X64_ELSE("_Znam", "_Znaj"), ALLOC_MALLOC },
+    { "_ZdlPv", ALLOC_FREE },
+    { "_ZdaPv", ALLOC_FREE },
+    { "mmap", ALLOC_MMAP },
+    { "munmap", ALLOC_MUNMAP },
+#endif
+};
+
+/* An outermost allocation routine call, from its pre to its post callback */
+typedef struct {
+    int kind;
+    app_pc site;
+    size_t size;
+    addr_t ptr; /* the block freed or resized, or the range unmapped */
+} alloc_call_t;
+
+static void
+record_alloc(void *drcontext, per_thread_t *data, addr_t start, size_t size,
+             app_pc site)
+{
+    trace_entry_t *buf_ptr = reserve_entries(drcontext, data, 3);
+    buf_ptr->type = TRACE_TYPE_ALLOC;
+    buf_ptr->size = 0;
+    buf_ptr->addr = start;
+    ++buf_ptr;
+    buf_ptr->type = TRACE_TYPE_ALLOC_SITE;
+    buf_ptr->size = 0;
+    buf_ptr->addr = (addr_t) site;
+    ++buf_ptr;
+    buf_ptr->type = TRACE_TYPE_ALLOC_END;
+    buf_ptr->size = 0;
+    buf_ptr->addr = start + size;
+    BUF_PTR(data->seg_base) = ++buf_ptr;
+}
+
+static void
+record_free(void *drcontext, per_thread_t *data, addr_t start)
+{
+    trace_entry_t *buf_ptr = reserve_entries(drcontext, data, 1);
+    buf_ptr->type = TRACE_TYPE_FREE;
+    buf_ptr->size = 0;
+    buf_ptr->addr = start;
+    BUF_PTR(data->seg_base) = ++buf_ptr;
+}
+
+static void
+alloc_pre(void *wrapcxt, OUT void **user_data)
+{
+    void *drcontext = drwrap_get_drcontext(wrapcxt);
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    int kind = (int)(ptr_int_t) *user_data;
+    alloc_call_t *call;
+    /* We only record the outermost call: an operator new calling malloc, or a
+     * malloc calling mmap, is one allocation by the app.
+     */
+    if (data->alloc_depth++ > 0) {
+        *user_data = NULL;
+        return;
+    }
+    call = (alloc_call_t *) dr_thread_alloc(drcontext, sizeof(*call));
+    call->kind = kind;
+    call->site = drwrap_get_retaddr(wrapcxt);
+    call->size = 0;
+    call->ptr = 0;
+    switch (kind) {
+    case ALLOC_MALLOC:
+        call->size = (size_t) drwrap_get_arg(wrapcxt, 0);
+        break;
+    case ALLOC_CALLOC:
+        call->size = (size_t) drwrap_get_arg(wrapcxt, 0) *
+            (size_t) drwrap_get_arg(wrapcxt, 1);
+        break;
+    case ALLOC_REALLOC:
+        call->ptr = (addr_t) drwrap_get_arg(wrapcxt, 0);
+        call->size = (size_t) drwrap_get_arg(wrapcxt, 1);
+        break;
+    case ALLOC_MMAP:
+        call->size = (size_t) drwrap_get_arg(wrapcxt, 1);
+        break;
+    default:
+        call->ptr = (addr_t) drwrap_get_arg(wrapcxt, 0);
+        break;
+    }
+    *user_data = call;
+}
+
+/* Also called, with a NULL wrapcxt, for a call unwound by longjmp or an
+ * exception, which recorded nothing.
+ */
+static void
+alloc_post(void *wrapcxt, void *user_data)
+{
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    alloc_call_t *call = (alloc_call_t *) user_data;
+    data->alloc_depth--;
+    if (call == NULL)
+        return;
+    if (wrapcxt != NULL) {
+        addr_t res = (addr_t) drwrap_get_retval(wrapcxt);
+        switch (call->kind) {
+        case ALLOC_FREE:
+            if (call->ptr != 0)
+                record_free(drcontext, data, call->ptr);
+            break;
+        case ALLOC_MUNMAP:
+            if (res == 0)
+                record_free(drcontext, data, call->ptr);
+            break;
+        case ALLOC_REALLOC:
+            /* A failed realloc leaves the block as it was. */
+            if (call->ptr != 0 && (res != 0 || call->size == 0))
+                record_free(drcontext, data, call->ptr);
+            if (res != 0 && call->size > 0)
+                record_alloc(drcontext, data, res, call->size, call->site);
+            break;
+        case ALLOC_MMAP:
+            if (res != (addr_t) -1/*MAP_FAILED*/ && call->size > 0)
+                record_alloc(drcontext, data, res, call->size, call->site);
+            break;
+        default:
+            if (res != 0 && call->size > 0)
+                record_alloc(drcontext, data, res, call->size, call->site);
+            break;
+        }
+    }
+    dr_thread_free(drcontext, call, sizeof(*call));
+}
+
+static void
+event_alloc_module_load(void *drcontext, const module_data_t *info, bool loaded)
+{
+    for (size_t i = 0; i < BUFFER_SIZE_ELEMENTS(alloc_routines); i++) {
+        app_pc func = (app_pc)
+            dr_get_proc_address(info->handle, alloc_routines[i].name);
+        if (func != NULL) {
+            drwrap_wrap_ex(func, alloc_pre, alloc_post,
+                           (void *)(ptr_int_t) alloc_routines[i].kind, 0);
+        }
+    }
+}
+
+/***************************************************************************
+ * Regions of interest: -trace_function and -trace_on_demand
+ */
+
+/* The calls to -trace_function functions in progress, across all threads */
+static int region_depth;
+static std::vector<std::string> region_functions;
+
+/* Switches tracing on or off, which ends any tracing window, and returns
+ * whether that changed the mode.  The caller must hold the mutex and, if the
+ * mode changed, flush the code cache once it no longer does.
+ */
+static bool
+switch_tracing(bool enable)
+{
+    if (tracing_enabled == enable && !window_counting)
+        return false;
+    tracing_enabled = enable;
+    window_counting = false;
+    NOTIFY(1, "%s tracing\n", tracing_enabled ? "Starting" : "Stopping");
+    return true;
+}
+
+static void
+flush_for_new_mode(void)
+{
+    if (!dr_delay_flush_region(NULL, ~0UL, 0, NULL))
+        DR_ASSERT(false);
+}
+
+static void
+region_pre(void *wrapcxt, OUT void **user_data)
+{
+    bool changed = false;
+    dr_mutex_lock(mutex);
+    if (region_depth++ == 0)
+        changed = switch_tracing(true);
+    dr_mutex_unlock(mutex);
+    if (changed)
+        flush_for_new_mode();
+}
+
+/* Also called, with a NULL wrapcxt, for a call unwound by longjmp or an
+ * exception.
+ */
+static void
+region_post(void *wrapcxt, void *user_data)
+{
+    bool changed = false;
+    dr_mutex_lock(mutex);
+    if (--region_depth == 0)
+        changed = switch_tracing(false);
+    dr_mutex_unlock(mutex);
+    if (changed)
+        flush_for_new_mode();
+}
+
+static void
+event_region_module_load(void *drcontext, const module_data_t *info, bool loaded)
+{
+    for (size_t i = 0; i < region_functions.size(); i++) {
+        app_pc func = (app_pc)
+            dr_get_proc_address(info->handle, region_functions[i].c_str());
+        size_t modoffs;
+        if (func == NULL && info->full_path != NULL &&
+            drsym_lookup_symbol(info->full_path, region_functions[i].c_str(),
+                                &modoffs, DRSYM_DEMANGLE) == DRSYM_SUCCESS)
+            func = info->start + modoffs;
+        if (func != NULL) {
+            NOTIFY(1, "Tracing within %s at " PFX "\n",
+                   region_functions[i].c_str(), func);
+            drwrap_wrap(func, region_pre, region_post);
+        }
+    }
+}
+
+static void
+set_tracing(bool enable)
+{
+    bool changed;
+    dr_mutex_lock(mutex);
+    changed = switch_tracing(enable);
+    dr_mutex_unlock(mutex);
+    if (changed)
+        flush_for_new_mode();
+}
+
+/* The DRMEMTRACE_START_TRACING() annotation */
+static void
+annotation_start_tracing(void)
+{
+    set_tracing(true);
+}
+
+/* The DRMEMTRACE_STOP_TRACING() annotation */
+static void
+annotation_stop_tracing(void)
+{
+    set_tracing(false);
+}
+
+static void
+event_nudge(void *drcontext, uint64 argument)
+{
+    set_tracing(!tracing_enabled);
+}
+
+static void
+event_module_load(void *drcontext, const module_data_t *info, bool loaded)
+{
+    const char *path = info->full_path;
+    if (path == NULL || path[0] == '\0')
+        path = dr_module_preferred_name(info);
+    if (path == NULL)
+        return;
+    dr_mutex_lock(mutex);
+    dr_fprintf(module_file, PFX " " PFX " %s\n", info->start, info->end, path);
+    dr_mutex_unlock(mutex);
+}
+
+/* Returns the path of this process's file with the given suffix: in -outdir
+ * for offline traces, and next to the named pipe otherwise.
+ */
+static void
+process_file_path(char *path, size_t size, const char *suffix)
+{
+    if (op_offline.get_value()) {
+        dr_snprintf(path, size, "%s/%s.%d.%s", op_outdir.get_value().c_str(),
+                    OUTFILE_PREFIX, dr_get_process_id(), suffix);
+    } else {
+        /* we only need the path, so this works with -shm too */
+        named_pipe_t pipe(op_ipc_name.get_value().c_str());
+        dr_snprintf(path, size, "%s.%d.%s", pipe.get_pipe_path().c_str(),
+                    dr_get_process_id(), suffix);
+    }
+    path[size - 1] = '\0';
+}
+
+static void
+module_file_open()
+{
+    char path[MAXIMUM_PATH];
+    process_file_path(path, BUFFER_SIZE_ELEMENTS(path), MODULE_FILE_SUFFIX);
+    module_file = dr_open_file(path, DR_FILE_WRITE_OVERWRITE);
+    if (module_file == INVALID_FILE)
+        NOTIFY(0, "Failed to create module list %s\n", path);
+}
+
+/* For -instr_only: also lists the blocks listed so far, for a forked child */
+static void
+block_file_open()
+{
+    char path[MAXIMUM_PATH];
+    process_file_path(path, BUFFER_SIZE_ELEMENTS(path), BLOCK_FILE_SUFFIX);
+    block_file = dr_open_file(path, DR_FILE_WRITE_OVERWRITE);
+    if (block_file == INVALID_FILE) {
+        NOTIFY(0, "Failed to create block list %s\n", path);
+        return;
+    }
+    for (std::set<std::string>::const_iterator it = blocks_listed.begin();
+         it != blocks_listed.end(); ++it)
+        dr_write_file(block_file, it->c_str(), it->size());
+}
+
+/* Lists the large pages physaddr found, for the simulator's -page_size_file. */
+static void
+page_size_file_write()
+{
+    char path[MAXIMUM_PATH];
+    process_file_path(path, BUFFER_SIZE_ELEMENTS(path), PAGE_SIZE_FILE_SUFFIX);
+    file_t file = dr_open_file(path, DR_FILE_WRITE_OVERWRITE);
+    if (file == INVALID_FILE) {
+        NOTIFY(0, "Failed to create page size list %s\n", path);
+        return;
+    }
+    const std::map<addr_t,int> &pages = physaddr.get_large_pages();
+    for (std::map<addr_t,int>::const_iterator it = pages.begin(); it != pages.end();
+         ++it) {
+        dr_fprintf(file, PFX " " PFX " %u\n", it->first,
+                   it->first + ((addr_t)1 << it->second), 1U << it->second);
+    }
+    dr_close_file(file);
+}
+
+/* Lists the NUMA node of each page physaddr translated, for the simulator's
+ * -page_node_file.  Physically adjacent pages on one node share a line.
+ */
+static void
+page_node_file_write()
+{
+    const std::map<addr_t,physaddr_t::node_range_t> &nodes = physaddr.get_page_nodes();
+    if (nodes.empty())
+        return;
+    char path[MAXIMUM_PATH];
+    process_file_path(path, BUFFER_SIZE_ELEMENTS(path), PAGE_NODE_FILE_SUFFIX);
+    file_t file = dr_open_file(path, DR_FILE_WRITE_OVERWRITE);
+    if (file == INVALID_FILE) {
+        NOTIFY(0, "Failed to create page node list %s\n", path);
+        return;
+    }
+    std::map<addr_t,physaddr_t::node_range_t>::const_iterator it = nodes.begin();
+    addr_t start = it->first;
+    physaddr_t::node_range_t range = it->second;
+    for (++it; it != nodes.end(); ++it) {
+        if (it->first == range.end && it->second.node == range.node) {
+            range.end = it->second.end;
+            continue;
+        }
+        dr_fprintf(file, PFX " " PFX " %d\n", start, range.end, range.node);
+        start = it->first;
+        range = it->second;
+    }
+    dr_fprintf(file, PFX " " PFX " %d\n", start, range.end, range.node);
+    dr_close_file(file);
+}
+
+#ifdef UNIX
+/* A child created by fork, rather than by exec, starts with a copy of the
+ * parent's state.  We trace its one thread as a new thread of a new process,
+ * leaving the entries the parent had yet to write out to the parent.
+ */
+static void
+event_fork_init(void *drcontext)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    dr_module_iterator_t *iter;
+
+    /* We only drop our copies of the parent's resources */
+    if (op_offline.get_value()) {
+        if (op_compress.get_value()) {
+            dr_global_free(data->chunk_index,
+                           data->chunk_index_capacity * sizeof(*data->chunk_index));
+            dr_raw_mem_free(data->chunk_buf, CHUNK_BUF_SIZE);
+        }
+        dr_close_file(data->file);
+    } else if (compress_pipe) {
+        dr_raw_mem_free(data->chunk_buf, CHUNK_BUF_SIZE);
+    } else if (data->file != INVALID_FILE)
+        dr_close_file(data->file);
+    if (op_shm.get_value()) {
+        /* The parent's slot is not ours to publish */
+        if (!ipc_ring.add_writer(dr_get_process_id()))
+            DR_ASSERT(false);
+    } else
+        dr_raw_mem_free(data->buf_base, MAX_BUF_SIZE);
+    if (writers != NULL) {
+        /* The parent's writers did not come along.  Their queues are the
+         * parent's to write, and their locks may have been held at the fork.
+         */
+        uint i;
+        for (i = 0; i < num_writers; i++) {
+            writer_t *writer = &writers[i];
+            uint j;
+            for (j = 0; j < writer->count; j++) {
+                write_job_t *job = &writer->queue[(writer->head + j) % WRITER_QUEUE_SIZE];
+                if (job->data == data)
+                    dr_raw_mem_free(job->buf_base, MAX_BUF_SIZE);
+            }
+        }
+        while (data->num_spare > 0)
+            dr_raw_mem_free(data->spare_bufs[--data->num_spare], MAX_BUF_SIZE);
+        writers_start();
+    }
+    if (op_L0_filter.get_value()) {
+        dr_thread_free(drcontext, data->l0i_tags, l0i_lines * sizeof(addr_t));
+        dr_thread_free(drcontext, data->l0d_tags, l0d_lines * sizeof(addr_t));
+    }
     dr_thread_free(drcontext, data, sizeof(per_thread_t));
+    num_refs = 0;
+
+    /* The child has its own module list, starting with the parent's modules */
+    if (module_file != INVALID_FILE) {
+        dr_close_file(module_file);
+        module_file_open();
+        if (module_file != INVALID_FILE) {
+            iter = dr_module_iterator_start();
+            while (dr_module_iterator_hasnext(iter)) {
+                module_data_t *info = dr_module_iterator_next(iter);
+                event_module_load(drcontext, info, true);
+                dr_free_module_data(info);
+            }
+            dr_module_iterator_stop(iter);
+        }
+    }
+    /* The child runs the blocks the parent built, so it lists them all */
+    if (block_file != INVALID_FILE) {
+        dr_close_file(block_file);
+        block_file_open();
+    }
+
+    event_thread_init(drcontext);
 }
+#endif
 
 static void
 event_exit(void)
 {
     dr_log(NULL, LOG_ALL, 1, "drcachesim num refs seen: "SZFMT"\n", num_refs);
     ipc_pipe.close();
+    if (module_file != INVALID_FILE)
+        dr_close_file(module_file);
+    if (block_file != INVALID_FILE)
+        dr_close_file(block_file);
+    if (have_phys && op_use_physical.get_value()) {
+        page_size_file_write();
+        page_node_file_write();
+    }
+    if (op_shm.get_value()) {
+        ipc_ring.close();
+        dr_unmap_file(ring_map, ring_map_size);
+    }
     if (!dr_raw_tls_cfree(tls_offs, MEMTRACE_TLS_COUNT))
         DR_ASSERT(false);
+    if (writers != NULL) {
+        /* Every thread took its buffers back on exit */
+        uint i;
+        writers_exiting = true;
+        for (i = 0; i < num_writers; i++) {
+            dr_mutex_destroy(writers[i].lock);
+            dr_mutex_destroy(writers[i].busy);
+        }
+        dr_global_free(writers, num_writers * sizeof(*writers));
+    }
+#ifdef UNIX
+    if (!dr_unregister_fork_init_event(event_fork_init))
+        DR_ASSERT(false);
+#endif
 
     if (!drmgr_unregister_tls_field(tls_idx) ||
         !drmgr_unregister_thread_init_event(event_thread_init) ||
         !drmgr_unregister_thread_exit_event(event_thread_exit) ||
         !drmgr_unregister_pre_syscall_event(event_pre_syscall) ||
+        (module_file != INVALID_FILE &&
+         !drmgr_unregister_module_load_event(event_module_load)) ||
+        (op_record_allocs.get_value() &&
+         !drmgr_unregister_module_load_event(event_alloc_module_load)) ||
+        (op_record_syscalls.get_value() &&
+         !drmgr_unregister_post_syscall_event(event_post_syscall)) ||
+        (!region_functions.empty() &&
+         !drmgr_unregister_module_load_event(event_region_module_load)) ||
         !drmgr_unregister_bb_instrumentation_ex_event(event_bb_app2app,
                                                       event_bb_analysis,
                                                       event_app_instruction,
                                                       event_bb_instru2instru))
         DR_ASSERT(false);
 
+    if (op_trace_on_demand.get_value()) {
+        dr_annotation_unregister_call("drmemtrace_start_tracing",
+                                      (void *)annotation_start_tracing);
+        dr_annotation_unregister_call("drmemtrace_stop_tracing",
+                                      (void *)annotation_stop_tracing);
+        if (!dr_unregister_nudge_event(event_nudge, client_id))
+            DR_ASSERT(false);
+    }
+
     dr_mutex_destroy(mutex);
+    if (!region_functions.empty() && drsym_exit() != DRSYM_SUCCESS)
+        DR_ASSERT(false);
+    if (op_record_allocs.get_value() || !region_functions.empty())
+        drwrap_exit();
     drutil_exit();
     drmgr_exit();
 }
@@ -848,19 +2513,141 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
         dr_abort();
     }
 
-    if (!ipc_pipe.set_name(op_ipc_name.get_value().c_str()))
-        DR_ASSERT(false);
-    /* we want an isolated fd so we don't use ipc_pipe.open_for_write() */
-    int fd = dr_open_file(ipc_pipe.get_pipe_path().c_str(), DR_FILE_WRITE_ONLY);
-    DR_ASSERT(fd != INVALID_FILE);
-    if (!ipc_pipe.set_fd(fd))
-        DR_ASSERT(false);
-    if (!ipc_pipe.maximize_buffer())
-        DR_ASSERT(false);
+    compress_pipe = op_compress.get_value() && !op_offline.get_value() &&
+        !op_shm.get_value() && !op_thread_pipes.get_value();
+
+    if (op_retrace_every_instrs.get_value() > 0 && op_trace_for_instrs.get_value() == 0) {
+        NOTIFY(0, "Usage error: -retrace_every_instrs requires -trace_for_instrs\n");
+        dr_abort();
+    }
+    if (IF_X64_ELSE(false, op_trace_after_instrs.get_value() > INT_MAX ||
+                    op_trace_for_instrs.get_value() > INT_MAX ||
+                    op_retrace_every_instrs.get_value() > INT_MAX)) {
+        NOTIFY(0, "Usage error: instruction counts are limited to %d\n", INT_MAX);
+        dr_abort();
+    }
+    if (!op_trace_function.get_value().empty()) {
+        std::string names = op_trace_function.get_value();
+        size_t start = 0;
+        while (start <= names.size()) {
+            size_t end = names.find(',', start);
+            if (end == std::string::npos)
+                end = names.size();
+            if (end > start)
+                region_functions.push_back(names.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+    trace_regions = !region_functions.empty() || op_trace_on_demand.get_value();
+    if (trace_regions && (op_trace_after_instrs.get_value() > 0 ||
+                          op_trace_for_instrs.get_value() > 0)) {
+        NOTIFY(0, "Usage error: -trace_function and -trace_on_demand are not "
+               "supported with -trace_after_instrs or -trace_for_instrs\n");
+        dr_abort();
+    }
+    if (trace_regions)
+        tracing_enabled = false;
+    else if (op_trace_after_instrs.get_value() > 0) {
+        tracing_enabled = false;
+        window_instrs_left = (ptr_int_t)op_trace_after_instrs.get_value();
+    } else
+        window_instrs_left = (ptr_int_t)op_trace_for_instrs.get_value();
+    window_counting = (window_instrs_left > 0);
+
+    if (op_instr_only.get_value() && op_data_only.get_value()) {
+        NOTIFY(0, "Usage error: -instr_only and -data_only are mutually exclusive\n");
+        dr_abort();
+    }
+    if ((op_instr_only.get_value() || op_data_only.get_value()) &&
+        op_L0_filter.get_value()) {
+        NOTIFY(0, "Usage error: -instr_only and -data_only are not supported "
+               "with -L0_filter\n");
+        dr_abort();
+    }
+    if (op_instr_only.get_value() && op_use_physical.get_value()) {
+        /* A block may cross a page boundary, as an instr bundle may */
+        NOTIFY(0, "Usage error: -instr_only is not supported with -use_physical\n");
+        dr_abort();
+    }
+    if (op_instr_blocks.get_value()) {
+#ifdef X86
+        if (op_instr_only.get_value() || op_data_only.get_value() ||
+            op_L0_filter.get_value() || op_use_physical.get_value()) {
+            NOTIFY(0, "Usage error: -instr_blocks is not supported with -instr_only, "
+                   "-data_only, -L0_filter, or -use_physical\n");
+            dr_abort();
+        }
+#else
+        /* A predicated instr may skip its data entries */
+        NOTIFY(0, "Usage error: -instr_blocks is not yet supported on this platform\n");
+        dr_abort();
+#endif
+    }
+    if (op_record_allocs.get_value() && op_use_physical.get_value()) {
+        /* An allocation is a virtual address range */
+        NOTIFY(0, "Usage error: -record_allocs is not supported with -use_physical\n");
+        dr_abort();
+    }
+
+    if (op_L0_filter.get_value()) {
+#ifdef X86
+        uint64 line_size = op_line_size.get_value();
+        uint64 l0i_size = op_L0I_size.get_value();
+        uint64 l0d_size = op_L0D_size.get_value();
+        if (!IS_POWER_OF_2(line_size) || !IS_POWER_OF_2(l0i_size) ||
+            !IS_POWER_OF_2(l0d_size) || l0i_size < line_size || l0d_size < line_size) {
+            NOTIFY(0, "Usage error: -L0I_size and -L0D_size must be powers of 2 "
+                   "and multiples of -line_size\n");
+            dr_abort();
+        }
+        for (l0_line_bits = 0; (1ULL << l0_line_bits) < line_size; l0_line_bits++)
+            ; /* nothing */
+        l0i_lines = (size_t)(l0i_size / line_size);
+        l0d_lines = (size_t)(l0d_size / line_size);
+#else
+        NOTIFY(0, "Usage error: -L0_filter is not yet supported on this platform\n");
+        dr_abort();
+#endif
+    }
+
+    if (op_offline.get_value()) {
+        if (!dr_directory_exists(op_outdir.get_value().c_str()) &&
+            !dr_create_dir(op_outdir.get_value().c_str())) {
+            NOTIFY(0, "Failed to create -outdir %s\n", op_outdir.get_value().c_str());
+            dr_abort();
+        }
+    } else if (op_shm.get_value()) {
+        if (!ipc_ring.set_name(op_ipc_name.get_value().c_str()))
+            DR_ASSERT(false);
+        if (!ring_attach()) {
+            NOTIFY(0, "Failed to attach to shared memory %s\n",
+                   ipc_ring.get_path().c_str());
+            dr_abort();
+        }
+        if (ipc_ring.get_slot_size() < MAX_BUF_SIZE ||
+            !ipc_ring.add_writer(dr_get_process_id()))
+            DR_ASSERT(false);
+    } else {
+        if (!ipc_pipe.set_name(op_ipc_name.get_value().c_str()))
+            DR_ASSERT(false);
+        /* we want an isolated fd so we don't use ipc_pipe.open_for_write() */
+        int fd = dr_open_file(ipc_pipe.get_pipe_path().c_str(), DR_FILE_WRITE_ONLY);
+        DR_ASSERT(fd != INVALID_FILE);
+        if (!ipc_pipe.set_fd(fd))
+            DR_ASSERT(false);
+        if (!ipc_pipe.maximize_buffer())
+            DR_ASSERT(false);
+    }
 
     if (!drmgr_init() || !drutil_init())
         DR_ASSERT(false);
 
+#ifdef LINUX
+    fault_flush = !op_L0_filter.get_value() && !op_shm.get_value();
+    if (fault_flush && !drmgr_register_signal_event(event_signal))
+        DR_ASSERT(false);
+#endif
+
     /* register events */
     dr_register_exit_event(event_exit);
     if (!drmgr_register_thread_init_event(event_thread_init) ||
@@ -876,6 +2663,41 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
     client_id = id;
     mutex = dr_mutex_create();
 
+    module_file_open();
+    if (module_file != INVALID_FILE &&
+        !drmgr_register_module_load_event(event_module_load))
+        DR_ASSERT(false);
+    if (op_instr_only.get_value() || op_instr_blocks.get_value())
+        block_file_open();
+    if (op_record_allocs.get_value() || !region_functions.empty()) {
+        if (!drwrap_init())
+            DR_ASSERT(false);
+    }
+    if (op_record_allocs.get_value() &&
+        !drmgr_register_module_load_event(event_alloc_module_load))
+        DR_ASSERT(false);
+    if (op_record_syscalls.get_value() &&
+        !drmgr_register_post_syscall_event(event_post_syscall))
+        DR_ASSERT(false);
+    if (!region_functions.empty()) {
+        if (drsym_init(0) != DRSYM_SUCCESS ||
+            !drmgr_register_module_load_event(event_region_module_load))
+            DR_ASSERT(false);
+    }
+    if (op_trace_on_demand.get_value()) {
+        if (!dr_annotation_register_call("drmemtrace_start_tracing",
+                                         (void *)annotation_start_tracing, false, 0,
+                                         DR_ANNOTATION_CALL_TYPE_FASTCALL) ||
+            !dr_annotation_register_call("drmemtrace_stop_tracing",
+                                         (void *)annotation_stop_tracing, false, 0,
+                                         DR_ANNOTATION_CALL_TYPE_FASTCALL))
+            DR_ASSERT(false);
+        dr_register_nudge_event(event_nudge, id);
+    }
+#ifdef UNIX
+    dr_register_fork_init_event(event_fork_init);
+#endif
+
     tls_idx = drmgr_register_tls_field();
     DR_ASSERT(tls_idx != -1);
     /* The TLS field provided by DR cannot be directly accessed from the code cache.
@@ -885,6 +2707,12 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
     if (!dr_raw_tls_calloc(&tls_seg, &tls_offs, MEMTRACE_TLS_COUNT, 0))
         DR_ASSERT(false);
 
+    if (op_offline.get_value() && op_num_writers.get_value() > 0) {
+        num_writers = op_num_writers.get_value();
+        writers = (writer_t *) dr_global_alloc(num_writers * sizeof(*writers));
+        writers_start();
+    }
+
     /* make it easy to tell, by looking at log file, which client executed */
     dr_log(NULL, LOG_ALL, 1, "drcachesim client initializing\n");
 
@@ -48,6 +48,28 @@
  *                    Uses nudge to notify a child process being terminated
  *                    by its parent, so that the exit event will be called.
  * -logdir <dir>      Sets log directory, which by default is ".".
+ * -hit_counts        Counts how many times each unique basic block executes,
+ *                    using inlined per-thread counters, and adds the counts
+ *                    to the log file.  Not supported with -thread_private.
+ * -dedup_bbs         Records each basic block only once per log, rather than
+ *                    every time it is built.
+ * -snapshot_ms <ms>  Every <ms> milliseconds, writes the basic blocks seen
+ *                    since the previous snapshot to a new snap.log file.
+ *                    Not supported with -thread_private.
+ * -max_hit_bbs <num> Sets the maximum number of unique basic blocks that
+ *                    -hit_counts can count, which by default is 65536.
+ * -bitmap_file <path> Maps the existing file <path>, e.g., a fuzzer's
+ *                    shared memory under /dev/shm, and increments an
+ *                    AFL-style byte counter in it, picked by hashing the
+ *                    block's module offset, every time a block executes.
+ *                    No log files are written.
+ * -bitmap_size <num> Sets the number of counters in -bitmap_file, which must
+ *                    be a power of 2 and by default is 65536.
+ * -persistent_func <name|0xoffs> Re-runs the main module function with the
+ *                    given export name or offset from its base, with its
+ *                    first arguments, when it returns.
+ * -persistent_iters <num> Sets how many times -persistent_func runs in total,
+ *                    which by default is 1000.
  *
  * The two options below can only be used when the client is compiled with
  * CBR_COVERAGE being defined.
@@ -63,6 +85,7 @@
 #include "dr_api.h"
 #include "drmgr.h"
 #include "drx.h"
+#include "drwrap.h"
 #include "drcov.h"
 #include "../common/modules.h"
 #include "../common/utils.h"
@@ -96,6 +119,14 @@ typedef struct _drcov_option_t {
     bool nudge_kills;
     char logdir[MAXIMUM_PATH];
     int native_until_thread;
+    bool dedup_bbs;
+    uint snapshot_ms;
+    bool hit_counts;
+    uint max_hit_bbs;
+    char bitmap_file[MAXIMUM_PATH];
+    uint bitmap_size;
+    char persistent_func[MAXIMUM_PATH];
+    uint persistent_iters;
 #ifdef CBR_COVERAGE
     bool check;
     bool summary;
@@ -108,6 +139,8 @@ static drcov_option_t options;
 
 typedef struct _per_thread_t {
     void *bb_table;
+    /* for -dedup_bbs: maps bb start pc to BB_SEEN_VALUE of its recorded entry */
+    hashtable_t *bb_seen;
     /* for quick per-thread query without lock */
     module_entry_t *cache[NUM_THREAD_MODULE_CACHE];
     file_t  log;
@@ -126,6 +159,35 @@ static int sysnum_execve = IF_X64_ELSE(59, 11);
 static volatile bool go_native;
 static int tls_idx = -1;
 
+/* For -hit_counts: each unique block gets a slot, i.e., an index into both
+ * hit_table and hit_counter, which is incremented inline.  hit_slots maps a
+ * block's start pc to its slot+1 and is protected by its own lock.
+ */
+#define HIT_SLOTS_HASH_BITS 12
+#define DEFAULT_MAX_HIT_BBS (64*1024)
+static hashtable_t hit_slots;
+static void *hit_table;
+static drx_sharded_counter_t *hit_counter;
+
+/* For -bitmap_file: the mapped counters, indexed by bitmap_index(). */
+#define DEFAULT_BITMAP_SIZE (64*1024)
+static byte *bitmap;
+static size_t bitmap_map_size;
+
+/* For -persistent_func: the state on the first entry to the function, which
+ * each later run starts from.  Only the thread that entered it first loops.
+ */
+#define DEFAULT_PERSISTENT_ITERS 1000
+#define PERSISTENT_STACK_SLOTS 8
+static app_pc persistent_pc;
+static void *persistent_lock;
+static thread_id_t persistent_owner;
+static bool persistent_active;
+static uint persistent_runs;
+static dr_mcontext_t persistent_mc;
+static reg_t persistent_stack[PERSISTENT_STACK_SLOTS];
+static size_t persistent_stack_size;
+
 static void
 event_exit(void);
 
@@ -158,7 +220,7 @@ log_file_create_helper(void *drcontext, const char *suffix)
 static void
 log_file_create(void *drcontext, per_thread_t *data)
 {
-    if (options.dump_text || options.dump_binary) {
+    if (options.bitmap_file[0] == '\0' && (options.dump_text || options.dump_binary)) {
         data->log = log_file_create_helper(drcontext, drcontext == NULL ?
                                            "proc.log" : "thd.log");
     } else {
@@ -393,13 +455,12 @@ bb_table_print(void *drcontext, per_thread_t *data)
 }
 
 static void
-bb_table_entry_add(void *drcontext, per_thread_t *data, app_pc start,
+bb_entry_fill(per_thread_t *data, bb_entry_t *bb_entry, app_pc start,
 #ifdef CBR_COVERAGE
-                   app_pc cbr_tgt, ushort num_instrs, bool trace,
+              app_pc cbr_tgt, ushort num_instrs, bool trace,
 #endif
-                   uint size)
+              uint size)
 {
-    bb_entry_t *bb_entry = drtable_alloc(data->bb_table, 1, NULL);
     module_entry_t **mod_entry_cache = data != NULL ? data->cache : NULL;
     module_entry_t *mod_entry = module_table_lookup(mod_entry_cache,
                                                     NUM_THREAD_MODULE_CACHE,
@@ -436,12 +497,72 @@ bb_table_entry_add(void *drcontext, per_thread_t *data, app_pc start,
 #endif
 }
 
+/* A rebuilt block is only a duplicate if it is from the same module entry and
+ * has the same size: a module reloaded at the same address gets a new module
+ * id unless it is the same module, and modified code may change the size.
+ */
+#define BB_SEEN_VALUE(bb_entry) \
+    ((void *)(((ptr_uint_t)(bb_entry)->mod_id << 16) | (bb_entry)->size))
+#define BB_SEEN_HASH_BITS 12
+
+/* Returns whether bb_entry is new to data's log and should be recorded */
+static bool
+bb_seen_add(per_thread_t *data, app_pc start, bb_entry_t *bb_entry)
+{
+    bool added = false;
+    hashtable_lock(data->bb_seen);
+    if (hashtable_lookup(data->bb_seen, start) != BB_SEEN_VALUE(bb_entry)) {
+        hashtable_add_replace(data->bb_seen, start, BB_SEEN_VALUE(bb_entry));
+        added = true;
+    }
+    hashtable_unlock(data->bb_seen);
+    return added;
+}
+
+static void
+bb_table_entry_add(void *drcontext, per_thread_t *data, app_pc start,
+#ifdef CBR_COVERAGE
+                   app_pc cbr_tgt, ushort num_instrs, bool trace,
+#endif
+                   uint size)
+{
+    bb_entry_t bb_entry;
+    bb_entry_fill(data, &bb_entry, start,
+#ifdef CBR_COVERAGE
+                  cbr_tgt, num_instrs, trace,
+#endif
+                  size);
+    if (data->bb_seen != NULL && !bb_seen_add(data, start, &bb_entry))
+        return;
+    if (options.snapshot_ms > 0) {
+        /* The snapshot thread reads the table without a lock and treats an
+         * entry as unwritten until its size is non-zero, so we store the size
+         * last through volatile accesses, which keeps the compiler from
+         * reordering the stores.
+         * XXX: this relies on x86's store ordering; ARM needs a barrier.
+         */
+        volatile bb_entry_t *new_entry = drtable_alloc(data->bb_table, 1, NULL);
+        new_entry->start = bb_entry.start;
+        new_entry->mod_id = bb_entry.mod_id;
+#ifdef CBR_COVERAGE
+        new_entry->cbr_tgt = bb_entry.cbr_tgt;
+        new_entry->trace = bb_entry.trace;
+        new_entry->num_instrs = bb_entry.num_instrs;
+#endif
+        new_entry->size = bb_entry.size;
+    } else
+        *(bb_entry_t *)drtable_alloc(data->bb_table, 1, NULL) = bb_entry;
+}
+
 #define INIT_BB_TABLE_ENTRIES 4096
 static void *
 bb_table_create(bool synch)
 {
-    return drtable_create(INIT_BB_TABLE_ENTRIES,
-                          sizeof(bb_entry_t), 0 /* flags */, synch, NULL);
+    /* A shared table is filled by all threads: reserve entries without
+     * serializing on the table lock.
+     */
+    return drtable_create(INIT_BB_TABLE_ENTRIES, sizeof(bb_entry_t),
+                          synch ? DRTABLE_ALLOC_CONCURRENT : 0, synch, NULL);
 }
 
 static void
@@ -450,6 +571,265 @@ bb_table_destroy(void *table, void *data)
     drtable_destroy(table, data);
 }
 
+/****************************************************************************
+ * Hit Count Functions
+ */
+
+static void
+hit_count_init(void)
+{
+    /* We hold the table lock across lookup and add ourselves. */
+    hashtable_init_ex(&hit_slots, HIT_SLOTS_HASH_BITS, HASH_INTPTR, false/*!strdup*/,
+                      false/*!synch*/, NULL, NULL, NULL);
+    /* Not compact: a slot's index must stay the same for its counter. */
+    hit_table = drtable_create(INIT_BB_TABLE_ENTRIES, sizeof(bb_count_entry_t),
+                               0, true/*synch*/, NULL);
+    hit_counter = drx_sharded_counter_create(options.max_hit_bbs);
+    ASSERT(hit_counter != NULL, "failed to create hit counters");
+}
+
+static void
+hit_count_exit(void)
+{
+    drx_sharded_counter_free(hit_counter);
+    drtable_destroy(hit_table, NULL);
+    hashtable_delete(&hit_slots);
+}
+
+/* Returns the counter slot for the block starting at start, assigning a new
+ * one on first sight, or -1 if we are out of slots.
+ */
+static int
+hit_count_get_slot(per_thread_t *data, app_pc start,
+#ifdef CBR_COVERAGE
+                   app_pc cbr_tgt, ushort num_instrs, bool trace,
+#endif
+                   uint size)
+{
+    static bool warned;
+    ptr_uint_t slot;
+    bb_count_entry_t *entry;
+    if (hit_counter == NULL)
+        return -1;
+    hashtable_lock(&hit_slots);
+    slot = (ptr_uint_t) hashtable_lookup(&hit_slots, start);
+    if (slot == 0 && drtable_num_entries(hit_table) < options.max_hit_bbs) {
+        entry = drtable_alloc(hit_table, 1, &slot);
+        bb_entry_fill(data, &entry->bb, start,
+#ifdef CBR_COVERAGE
+                      cbr_tgt, num_instrs, trace,
+#endif
+                      size);
+        entry->count = 0;
+        slot++;
+        hashtable_add(&hit_slots, start, (void *)slot);
+    } else if (slot == 0 && !warned) {
+        warned = true;
+        NOTIFY(0, "drcov: -max_hit_bbs %u reached: further bbs are not counted\n",
+               options.max_hit_bbs);
+    }
+    hashtable_unlock(&hit_slots);
+    return (int)slot - 1;
+}
+
+static bool
+hit_table_entry_sum(ptr_uint_t idx, void *entry, void *iter_data)
+{
+    ((bb_count_entry_t *)entry)->count = drx_sharded_counter_sum(hit_counter,
+                                                                 (uint)idx);
+    return true; /* continue iteration */
+}
+
+static bool
+hit_table_entry_print(ptr_uint_t idx, void *entry, void *iter_data)
+{
+    per_thread_t *data = iter_data;
+    bb_count_entry_t *count_entry = (bb_count_entry_t *)entry;
+    dr_fprintf(data->log, "module[%3u]: "PFX", %3u, "UINT64_FORMAT_STRING"\n",
+               count_entry->bb.mod_id, count_entry->bb.start, count_entry->bb.size,
+               count_entry->count);
+    return true; /* continue iteration */
+}
+
+static void
+hit_table_print(per_thread_t *data)
+{
+    if (data->log == INVALID_FILE)
+        return;
+    drtable_iterate(hit_table, NULL, hit_table_entry_sum);
+    dr_fprintf(data->log, "BB Counts: %u bbs\n", drtable_num_entries(hit_table));
+    if (options.dump_text) {
+        dr_fprintf(data->log, "module id, start, size, count:\n");
+        drtable_iterate(hit_table, data, hit_table_entry_print);
+    } else
+        drtable_dump_entries(hit_table, data->log);
+}
+
+/****************************************************************************
+ * Bitmap Functions
+ */
+
+static void
+bitmap_init(void)
+{
+    /* We need write access to map it shared and writable. */
+    file_t f = dr_open_file(options.bitmap_file, DR_FILE_READ | DR_FILE_WRITE_APPEND);
+    uint64 size;
+    USAGE_CHECK(f != INVALID_FILE, "cannot open -bitmap_file");
+    USAGE_CHECK(dr_file_size(f, &size) && size >= options.bitmap_size,
+                "-bitmap_file is smaller than -bitmap_size");
+    /* Reachable from the code cache, so the inlined update can use an
+     * absolute (on x64, rip-relative) address.
+     */
+    bitmap_map_size = options.bitmap_size;
+    bitmap = dr_map_file(f, &bitmap_map_size, 0, NULL,
+                         DR_MEMPROT_READ | DR_MEMPROT_WRITE, DR_MAP_CACHE_REACHABLE);
+    dr_close_file(f);
+    USAGE_CHECK(bitmap != NULL, "failed to map -bitmap_file");
+}
+
+static void
+bitmap_exit(void)
+{
+    dr_unmap_file(bitmap, bitmap_map_size);
+    bitmap = NULL;
+}
+
+/* Picks a block's counter from its module offset and module id, so the
+ * same block uses the same counter across runs despite address space
+ * randomization.
+ */
+static ptr_int_t
+bitmap_index(per_thread_t *data, app_pc start)
+{
+    bb_entry_t bb_entry;
+    uint hash;
+    bb_entry_fill(data, &bb_entry, start,
+#ifdef CBR_COVERAGE
+                  NULL, 0, false,
+#endif
+                  0);
+    hash = (bb_entry.start ^ ((uint)bb_entry.mod_id << 20)) * 2654435761U;
+    return (ptr_int_t)((hash ^ (hash >> 16)) & (options.bitmap_size - 1));
+}
+
+/* Increments the byte at counter, wrapping like AFL's map.  The sequence
+ * leaves the arithmetic flags alone, so they need not be saved.
+ */
+static void
+bitmap_insert_update(void *drcontext, instrlist_t *bb, instr_t *where,
+                     byte *counter)
+{
+#ifdef X86
+    dr_save_reg(drcontext, bb, where, DR_REG_XAX, SPILL_SLOT_1);
+    instrlist_meta_preinsert(bb, where, INSTR_CREATE_movzx
+                             (drcontext, opnd_create_reg(DR_REG_EAX),
+                              OPND_CREATE_ABSMEM(counter, OPSZ_1)));
+    instrlist_meta_preinsert(bb, where, INSTR_CREATE_lea
+                             (drcontext, opnd_create_reg(DR_REG_XAX),
+                              OPND_CREATE_MEM_lea(DR_REG_XAX, DR_REG_NULL, 0, 1)));
+    instrlist_meta_preinsert(bb, where, INSTR_CREATE_mov_st
+                             (drcontext, OPND_CREATE_ABSMEM(counter, OPSZ_1),
+                              opnd_create_reg(DR_REG_AL)));
+    dr_restore_reg(drcontext, bb, where, DR_REG_XAX, SPILL_SLOT_1);
+#elif defined(ARM)
+    dr_save_reg(drcontext, bb, where, DR_REG_R0, SPILL_SLOT_1);
+    dr_save_reg(drcontext, bb, where, DR_REG_R1, SPILL_SLOT_2);
+    instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)counter,
+                                     opnd_create_reg(DR_REG_R1), bb, where,
+                                     NULL, NULL);
+    instrlist_meta_preinsert(bb, where, XINST_CREATE_load_1byte
+                             (drcontext, opnd_create_reg(DR_REG_R0),
+                              OPND_CREATE_MEM8(DR_REG_R1, 0)));
+    /* Unlike adds, add does not write the flags. */
+    instrlist_meta_preinsert(bb, where, XINST_CREATE_add
+                             (drcontext, opnd_create_reg(DR_REG_R0),
+                              OPND_CREATE_INT(1)));
+    instrlist_meta_preinsert(bb, where, XINST_CREATE_store_1byte
+                             (drcontext, OPND_CREATE_MEM8(DR_REG_R1, 0),
+                              opnd_create_reg(DR_REG_R0)));
+    dr_restore_reg(drcontext, bb, where, DR_REG_R1, SPILL_SLOT_2);
+    dr_restore_reg(drcontext, bb, where, DR_REG_R0, SPILL_SLOT_1);
+#endif
+}
+
+/****************************************************************************
+ * Persistent Mode
+ */
+
+static void
+persistent_pre(void *wrapcxt, OUT void **user_data)
+{
+    thread_id_t tid = dr_get_thread_id(drwrap_get_drcontext(wrapcxt));
+    *user_data = NULL;
+    dr_mutex_lock(persistent_lock);
+    if (persistent_owner == 0) {
+        dr_mcontext_t *mc = drwrap_get_mcontext_ex(wrapcxt, DR_MC_ALL);
+        persistent_mc = *mc;
+        /* The return address and any stack arguments, which the function
+         * may overwrite.  A short read at the stack's end is fine.
+         */
+        dr_safe_read((void *)mc->xsp, sizeof(persistent_stack), persistent_stack,
+                     &persistent_stack_size);
+        persistent_owner = tid;
+    }
+    /* Only the outermost call of a recursive function loops. */
+    if (persistent_owner == tid && !persistent_active) {
+        persistent_active = true;
+        *user_data = (void *)persistent_pc;
+    }
+    dr_mutex_unlock(persistent_lock);
+}
+
+static void
+persistent_post(void *wrapcxt, void *user_data)
+{
+    dr_mcontext_t *mc;
+    if (user_data == NULL)
+        return;
+    persistent_active = false;
+    /* No looping once the function is unwound past, e.g., by longjmp. */
+    if (wrapcxt == NULL || ++persistent_runs >= options.persistent_iters)
+        return;
+    mc = drwrap_get_mcontext_ex(wrapcxt, DR_MC_ALL);
+    *mc = persistent_mc;
+    mc->pc = persistent_pc;
+    if (persistent_stack_size > 0) {
+        dr_safe_write((void *)mc->xsp, persistent_stack_size, persistent_stack,
+                      NULL);
+    }
+    if (drwrap_redirect_execution(wrapcxt) != DREXT_SUCCESS)
+        ASSERT(false, "failed to re-run -persistent_func");
+}
+
+static void
+persistent_init(void)
+{
+    module_data_t *exe = dr_get_main_module();
+    uint offs;
+    ASSERT(exe != NULL, "failed to find the main module");
+    if (strncmp(options.persistent_func, "0x", 2) == 0 &&
+        dr_sscanf(options.persistent_func + 2, "%x", &offs) == 1)
+        persistent_pc = exe->start + offs;
+    else {
+        persistent_pc = (app_pc)
+            dr_get_proc_address(exe->handle, options.persistent_func);
+    }
+    dr_free_module_data(exe);
+    USAGE_CHECK(persistent_pc != NULL, "-persistent_func not found in main module");
+    drwrap_init();
+    persistent_lock = dr_mutex_create();
+    if (!drwrap_wrap(persistent_pc, persistent_pre, persistent_post))
+        ASSERT(false, "failed to wrap -persistent_func");
+}
+
+static void
+persistent_exit(void)
+{
+    dr_mutex_destroy(persistent_lock);
+    drwrap_exit();
+}
+
 static void
 version_print(file_t log)
 {
@@ -468,11 +848,16 @@ version_print(file_t log)
 static void
 dump_drcov_data(void *drcontext, per_thread_t *data)
 {
+    /* The fuzzer reads the bitmap itself. */
+    if (bitmap != NULL)
+        return;
     if (options.dump_text || options.dump_binary) {
         version_print(data->log);
         module_table_print(module_table, data->log,
                            IF_CBR_COVERAGE_ELSE(true, false));
         bb_table_print(drcontext, data);
+        if (options.hit_counts)
+            hit_table_print(data);
     }
 # ifdef CBR_COVERAGE
     if (options.check)
@@ -480,6 +865,116 @@ dump_drcov_data(void *drcontext, per_thread_t *data)
 # endif
 }
 
+/****************************************************************************
+ * Snapshots
+ */
+
+/* For -snapshot_ms, a client thread periodically writes the part of the
+ * process-wide bb table that was added since its last snapshot to a new log
+ * file, so the coverage survives the process being killed.  Each snapshot
+ * file has the regular drcov format and drcov2lcov -dir merges them.
+ */
+#define SNAPSHOT_BUF_ENTRIES 128
+
+typedef struct _snapshot_iter_t {
+    per_thread_t data;  /* for bb_table_entry_print(): only log is set */
+    ptr_uint_t start;   /* first index not yet in a snapshot */
+    ptr_uint_t end;     /* index after the last entry in this snapshot */
+    uint count;
+    uint buf_used;
+    bb_entry_t buf[SNAPSHOT_BUF_ENTRIES];
+} snapshot_iter_t;
+
+static volatile bool snapshot_exiting;
+
+/* Finds the end of the run of written entries starting at iter->start.
+ * Table holes are never passed to us, but an entry reserved by another
+ * thread and not yet written ends the run: it goes in the next snapshot.
+ */
+static bool
+snapshot_entry_count(ptr_uint_t idx, void *entry, void *iter_data)
+{
+    snapshot_iter_t *iter = (snapshot_iter_t *)iter_data;
+    if (idx < iter->start)
+        return true; /* continue iteration */
+    if (((volatile bb_entry_t *)entry)->size == 0)
+        return false; /* stop iteration */
+    iter->end = idx + 1;
+    iter->count++;
+    return true; /* continue iteration */
+}
+
+static void
+snapshot_flush(snapshot_iter_t *iter)
+{
+    dr_write_file(iter->data.log, iter->buf, iter->buf_used * sizeof(bb_entry_t));
+    iter->buf_used = 0;
+}
+
+static bool
+snapshot_entry_write(ptr_uint_t idx, void *entry, void *iter_data)
+{
+    snapshot_iter_t *iter = (snapshot_iter_t *)iter_data;
+    if (idx < iter->start)
+        return true; /* continue iteration */
+    if (idx >= iter->end)
+        return false; /* stop iteration */
+    if (options.dump_text)
+        bb_table_entry_print(idx, entry, &iter->data);
+    else {
+        iter->buf[iter->buf_used++] = *(bb_entry_t *)entry;
+        if (iter->buf_used == SNAPSHOT_BUF_ENTRIES)
+            snapshot_flush(iter);
+    }
+    return true; /* continue iteration */
+}
+
+static void
+snapshot_take(snapshot_iter_t *iter)
+{
+    /* The table lock is held by the iteration, but concurrent allocation only
+     * takes it to add a chunk, so bb building is not blocked.
+     */
+    iter->count = 0;
+    iter->end = iter->start;
+    drtable_iterate(global_data->bb_table, iter, snapshot_entry_count);
+    if (iter->count == 0)
+        return;
+    iter->data.log = log_file_create_helper(NULL, "snap.log");
+    if (iter->data.log == INVALID_FILE)
+        return;
+    version_print(iter->data.log);
+    module_table_print(module_table, iter->data.log,
+                       IF_CBR_COVERAGE_ELSE(true, false));
+    dr_fprintf(iter->data.log, "BB Table: %u bbs\n", iter->count);
+    if (options.dump_text) {
+        dr_fprintf(iter->data.log, "module id, start, size");
+#ifdef CBR_COVERAGE
+        dr_fprintf(iter->data.log, ", cbr tgt, trace, #instr");
+#endif
+        dr_fprintf(iter->data.log, ":\n");
+    }
+    iter->buf_used = 0;
+    drtable_iterate(global_data->bb_table, iter, snapshot_entry_write);
+    if (iter->buf_used > 0)
+        snapshot_flush(iter);
+    dr_close_file(iter->data.log);
+    iter->start = iter->end;
+}
+
+static void
+snapshot_thread(void *arg)
+{
+    snapshot_iter_t iter;
+    memset(&iter, 0, sizeof(iter));
+    while (!snapshot_exiting) {
+        dr_sleep(options.snapshot_ms);
+        if (snapshot_exiting)
+            break;
+        snapshot_take(&iter);
+    }
+}
+
 /****************************************************************************
  * Thread/Global Data Creation/Destroy
  */
@@ -510,6 +1005,15 @@ thread_data_create(void *drcontext)
      * if so, no lock is required for bb_table operation.
      */
     data->bb_table = bb_table_create(drcontext == NULL ? true : false);
+    if (options.dedup_bbs) {
+        /* We hold the table lock across lookup and add ourselves. */
+        data->bb_seen = drcontext == NULL ?
+            dr_global_alloc(sizeof(*data->bb_seen)) :
+            dr_thread_alloc(drcontext, sizeof(*data->bb_seen));
+        hashtable_init_ex(data->bb_seen, BB_SEEN_HASH_BITS, HASH_INTPTR,
+                          false/*!strdup*/, false/*!synch*/, NULL, NULL, NULL);
+    } else
+        data->bb_seen = NULL;
     memset(data->cache, 0, sizeof(data->cache));
     log_file_create(drcontext, data);
     return data;
@@ -520,6 +1024,13 @@ thread_data_destroy(void *drcontext, per_thread_t *data)
 {
     /* destroy the bb table */
     bb_table_destroy(data->bb_table, data);
+    if (data->bb_seen != NULL) {
+        hashtable_delete(data->bb_seen);
+        if (drcontext == NULL)
+            dr_global_free(data->bb_seen, sizeof(*data->bb_seen));
+        else
+            dr_thread_free(drcontext, data->bb_seen, sizeof(*data->bb_seen));
+    }
     dr_close_file(data->log);
     /* free thread data */
     if (drcontext == NULL) {
@@ -625,7 +1136,8 @@ event_pre_syscall(void *drcontext, int sysnum)
 
 /* We collect the basic block information including offset from module base,
  * size, and num of instructions, and add it into a basic block table without
- * instrumentation.
+ * instrumentation.  For -hit_counts we also look up the block's counter slot
+ * and pass it to event_app_instruction in user_data.
  */
 static dr_emit_flags_t
 event_basic_block_analysis(void *drcontext, void *tag, instrlist_t *bb,
@@ -639,8 +1151,9 @@ event_basic_block_analysis(void *drcontext, void *tag, instrlist_t *bb,
     app_pc cbr_tgt = NULL;
 #endif
 
-    /* do nothing for translation */
-    if (translating)
+    *user_data = (void *)(ptr_int_t)-1;
+    /* do nothing for translation, other than reproducing the instrumentation */
+    if (translating && !options.hit_counts && bitmap == NULL)
         return DR_EMIT_DEFAULT;
 
     data = (per_thread_t *)drmgr_get_tls_field(drcontext, tls_idx);
@@ -666,7 +1179,8 @@ event_basic_block_analysis(void *drcontext, void *tag, instrlist_t *bb,
             cbr_tgt = opnd_get_pc(instr_get_target(instr));
 #endif
     }
-    /* We allow duplicated basic blocks for the following reasons:
+    /* Unless -dedup_bbs is set, we allow duplicated basic blocks for the
+     * following reasons:
      * 1. Avoids handling issues like code cache consistency, e.g.,
      *    module load/unload, self-modifying code, etc.
      * 2. Avoids the overhead on duplication check.
@@ -675,23 +1189,62 @@ event_basic_block_analysis(void *drcontext, void *tag, instrlist_t *bb,
      * 4. The duplication can be easily handled in a post-processing step,
      *    which is required anyway.
      */
-    bb_table_entry_add(drcontext, data, start_pc,
+    if (!translating && bitmap == NULL) {
+        bb_table_entry_add(drcontext, data, start_pc,
+#ifdef CBR_COVERAGE
+                           cbr_tgt, num_instrs, for_trace,
+#endif
+                           (uint)(end_pc - start_pc));
+    }
+    /* Unlike the BB Table, hit counts are kept per unique block. */
+    if (options.hit_counts) {
+        *user_data = (void *)(ptr_int_t)
+            hit_count_get_slot(data, start_pc,
 #ifdef CBR_COVERAGE
-                       cbr_tgt, num_instrs, for_trace,
+                               cbr_tgt, num_instrs, for_trace,
 #endif
-                       (uint)(end_pc - start_pc));
+                               (uint)(end_pc - start_pc));
+    }
+    if (bitmap != NULL)
+        *user_data = (void *)bitmap_index(data, start_pc);
 
+    if (translating)
+        return DR_EMIT_DEFAULT;
     if (go_native)
         return DR_EMIT_GO_NATIVE;
     else
         return DR_EMIT_DEFAULT;
 }
 
+static dr_emit_flags_t
+event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
+                      bool for_trace, bool translating, void *user_data)
+{
+    int slot = (int)(ptr_int_t)user_data;
+    if (slot < 0 || !drmgr_is_first_instr(drcontext, inst))
+        return DR_EMIT_DEFAULT;
+    if (bitmap != NULL)
+        bitmap_insert_update(drcontext, bb, inst, bitmap + slot);
+    else {
+        drx_insert_sharded_counter_update(drcontext, hit_counter, bb, inst,
+                                          SPILL_SLOT_1, SPILL_SLOT_2, slot, 1);
+    }
+    return DR_EMIT_DEFAULT;
+}
+
 static void
 event_module_unload(void *drcontext, const module_data_t *info)
 {
     /* we do not delete the module entry but clean the cache only. */
     module_table_unload(module_table, info);
+    /* A new module at the same address must get new hit count slots.  The
+     * old slots keep their counts for the unloaded module.
+     */
+    if (options.hit_counts) {
+        hashtable_lock(&hit_slots);
+        hashtable_remove_range(&hit_slots, info->start, info->end);
+        hashtable_unlock(&hit_slots);
+    }
 }
 
 static void
@@ -781,10 +1334,17 @@ event_fork(void *drcontext)
 static void
 event_exit(void)
 {
+    snapshot_exiting = true;
     if (!drcov_per_thread) {
         dump_drcov_data(NULL, global_data);
         global_data_destroy(global_data);
     }
+    if (options.hit_counts)
+        hit_count_exit();
+    if (persistent_pc != NULL)
+        persistent_exit();
+    if (bitmap != NULL)
+        bitmap_exit();
     /* destroy module table */
     module_table_destroy(module_table);
 
@@ -811,6 +1371,12 @@ event_init(void)
     /* create process data if whole process bb coverage. */
     if (!drcov_per_thread)
         global_data = global_data_create();
+    if (options.hit_counts)
+        hit_count_init();
+    if (options.bitmap_file[0] != '\0')
+        bitmap_init();
+    if (options.persistent_func[0] != '\0')
+        persistent_init();
 }
 
 static void
@@ -820,6 +1386,9 @@ options_init(client_id_t id, int argc, const char *argv[])
     const char *token;
     /* default values */
     options.nudge_kills = true;
+    options.max_hit_bbs = DEFAULT_MAX_HIT_BBS;
+    options.bitmap_size = DEFAULT_BITMAP_SIZE;
+    options.persistent_iters = DEFAULT_PERSISTENT_ITERS;
     dr_snprintf(options.logdir, BUFFER_SIZE_ELEMENTS(options.logdir), ".");
 
     for (i = 1/*skip client*/; i < argc; i++) {
@@ -847,6 +1416,55 @@ options_init(client_id_t id, int argc, const char *argv[])
                 USAGE_CHECK(false, "invalid -native_until_thread number");
             }
         }
+        else if (strcmp(token, "-dedup_bbs") == 0)
+            options.dedup_bbs = true;
+        else if (strcmp(token, "-snapshot_ms") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -snapshot_ms number");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &options.snapshot_ms) != 1 ||
+                options.snapshot_ms == 0) {
+                USAGE_CHECK(false, "invalid -snapshot_ms number");
+            }
+        }
+        else if (strcmp(token, "-hit_counts") == 0)
+            options.hit_counts = true;
+        else if (strcmp(token, "-max_hit_bbs") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -max_hit_bbs number");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &options.max_hit_bbs) != 1 ||
+                options.max_hit_bbs == 0) {
+                USAGE_CHECK(false, "invalid -max_hit_bbs number");
+            }
+        }
+        else if (strcmp(token, "-bitmap_file") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -bitmap_file path");
+            strncpy(options.bitmap_file, argv[++i],
+                    BUFFER_SIZE_ELEMENTS(options.bitmap_file));
+            NULL_TERMINATE_BUFFER(options.bitmap_file);
+        }
+        else if (strcmp(token, "-bitmap_size") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -bitmap_size number");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &options.bitmap_size) != 1 ||
+                options.bitmap_size == 0 ||
+                (options.bitmap_size & (options.bitmap_size - 1)) != 0) {
+                USAGE_CHECK(false, "invalid -bitmap_size number");
+            }
+        }
+        else if (strcmp(token, "-persistent_func") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -persistent_func name");
+            strncpy(options.persistent_func, argv[++i],
+                    BUFFER_SIZE_ELEMENTS(options.persistent_func));
+            NULL_TERMINATE_BUFFER(options.persistent_func);
+        }
+        else if (strcmp(token, "-persistent_iters") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -persistent_iters number");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &options.persistent_iters) != 1 ||
+                options.persistent_iters == 0) {
+                USAGE_CHECK(false, "invalid -persistent_iters number");
+            }
+        }
         else if (strcmp(token, "-verbose") == 0) {
             USAGE_CHECK((i + 1) < argc, "missing -verbose number");
             token = argv[++i];
@@ -868,6 +1486,16 @@ options_init(client_id_t id, int argc, const char *argv[])
             USAGE_CHECK(false, "invalid option");
         }
     }
+    /* Only the process-wide table is snapshotted. */
+    USAGE_CHECK(options.snapshot_ms == 0 || !drcov_per_thread,
+                "-snapshot_ms is not supported with -thread_private");
+    /* The counters are summed across all threads. */
+    USAGE_CHECK(!options.hit_counts || !drcov_per_thread,
+                "-hit_counts is not supported with -thread_private");
+    /* Both use the block's instrumentation slot, and there is no log. */
+    USAGE_CHECK(options.bitmap_file[0] == '\0' ||
+                (!options.hit_counts && options.snapshot_ms == 0),
+                "-bitmap_file is not supported with -hit_counts or -snapshot_ms");
     /* If both or neither specified, we honor the binary. */
     if ((options.dump_text && options.dump_binary) ||
         (!options.dump_text && !options.dump_binary)) {
@@ -887,7 +1515,6 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
     dr_register_exit_event(event_exit);
     drmgr_register_thread_init_event(event_thread_init);
     drmgr_register_thread_exit_event(event_thread_exit);
-    drmgr_register_bb_instrumentation_event(event_basic_block_analysis, NULL, NULL);
     drmgr_register_module_load_event(event_module_load);
     drmgr_register_module_unload_event(event_module_unload);
     dr_register_filter_syscall_event(event_filter_syscall);
@@ -904,9 +1531,18 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
     if (dr_using_all_private_caches())
         drcov_per_thread = true;
     options_init(id, argc, argv);
+    drmgr_register_bb_instrumentation_event(event_basic_block_analysis,
+                                            (options.hit_counts ||
+                                             options.bitmap_file[0] != '\0') ?
+                                            event_app_instruction : NULL, NULL);
 
     if (options.nudge_kills)
         drx_register_soft_kills(event_soft_kill);
 
     event_init();
+
+    if (options.snapshot_ms > 0 &&
+        !dr_create_client_thread(snapshot_thread, NULL)) {
+        ASSERT(false, "failed to create the snapshot thread");
+    }
 }
@@ -73,4 +73,13 @@ typedef struct _bb_entry_t {
 #endif
 } bb_entry_t;
 
+/* Data structure used in the optional "BB Counts" section of drcov.log,
+ * which follows the BB Table when drcov is run with -hit_counts.  There is
+ * one entry per unique block, unlike the BB Table.
+ */
+typedef struct _bb_count_entry_t {
+    bb_entry_t bb;
+    uint64     count;      /* number of times the bb was executed */
+} bb_count_entry_t;
+
 #endif /* _DRCOV_H_ */
@@ -46,6 +46,8 @@
 #include "hashtable.h"
 #include "dr_frontend.h"
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "../../common/utils.h"
 #undef ASSERT /* we're standalone, so no client assert */
@@ -58,6 +60,7 @@
 #ifdef UNIX
 # include <dirent.h> /* opendir, readdir */
 # include <unistd.h> /* getcwd */
+# include <pthread.h>
 #else
 # include <windows.h>
 # include <direct.h> /* _getcwd */
@@ -159,6 +162,16 @@ static droption_t<std::string> op_reduce_set
  "have the same code coverage as the full set.  The smaller set's file paths are "
  "written to the given output file path.");
 
+static droption_t<std::string> op_database
+(DROPTION_SCOPE_FRONTEND, "database", "", "Merge into a persistent coverage database",
+ "Keeps the merged coverage of all log files processed so far in the given file.  "
+ "If the file exists, its coverage is loaded first and the log files of this run are "
+ "merged into it.  The result is written back, and the lcov output covers the whole "
+ "database.  This lets a series of runs be processed incrementally, instead of "
+ "reprocessing every log file each time.  With -reduce_set, only the log files of "
+ "this run that add coverage beyond the database are listed.  The database should "
+ "be deleted when the modules are rebuilt.  Not supported with -test_pattern.");
+
 static droption_t<twostring_t> op_pathmap
 (DROPTION_SCOPE_FRONTEND, "pathmap", 0, twostring_t("",""), "Map library to local path",
  "Takes two values: the first specifies the library path to look for in each drcov "
@@ -171,6 +184,13 @@ static droption_t<bool> op_include_tool
  "coverage output.  Normally such execution is excluded and the output focuses on "
  "the application only.");
 
+static droption_t<unsigned int> op_jobs
+(DROPTION_SCOPE_FRONTEND, "jobs", 1, 1, 256, "Number of threads reading input files",
+ "Reads and merges up to this many log files in parallel, which speeds up "
+ "processing a large number of log files.  The output is the same as with one "
+ "thread.  Ignored on Windows and with -test_pattern or -reduce_set, whose "
+ "results depend on the order in which the log files are read.");
+
 static droption_t<bool> op_help
 (DROPTION_SCOPE_FRONTEND, "help", false, "Print this message",
  "Prints the usage message.");
@@ -193,9 +213,21 @@ static char input_dir_buf[MAXIMUM_PATH];
 static char input_list_buf[MAXIMUM_PATH];
 static char output_file_buf[MAXIMUM_PATH];
 static char set_file_buf[MAXIMUM_PATH];
+static char database_file_buf[MAXIMUM_PATH];
 
 static file_t set_log = INVALID_FILE;
 
+/* For -jobs: log files are queued while the inputs are enumerated and are
+ * then read by a pool of threads.
+ */
+static bool parallel_read;
+static std::vector<std::string> input_queue;
+#ifdef UNIX
+static pthread_mutex_t module_htable_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int next_input;
+static volatile int num_inputs_read;
+#endif
+
 /****************************************************************************
  * Utility Functions
  */
@@ -505,6 +537,14 @@ static uint num_module_htable_entries;
 #define BITMAP_INDEX(x)      ((x) / BITS_PER_BYTE)
 #define BITMAP_OFFSET(x)     ((x) % BITS_PER_BYTE)
 #define BITMAP_MASK(offs)    (1 << (offs))
+/* With -jobs, threads reading different log files merge into the same
+ * bitmaps, so partial bytes are or-ed in atomically.
+ */
+#ifdef UNIX
+# define BITMAP_OR(bm, idx, val) __sync_fetch_and_or(&(bm)[idx], (val))
+#else
+# define BITMAP_OR(bm, idx, val) ((bm)[idx] |= (val))
+#endif
 
 /* bitmap_set[start_offs][end_offs]: the value that all bits are set
  * from start_offs to end_offs in a byte.
@@ -581,14 +621,14 @@ bb_bitmap_add(module_table_t *table, bb_entry_t *entry)
     idx_end  = BITMAP_INDEX(addr_end);
     offs_end = (idx_end > idx) ? BITS_PER_BYTE-1 : BITMAP_OFFSET(addr_end);
     /* first byte in the bitmap */
-    bm[idx] |= bitmap_set[offs][offs_end];
+    BITMAP_OR(bm, idx, bitmap_set[offs][offs_end]);
     /* set all the middle byte */
     for (i = idx + 1; i < idx_end; i++)
         bm[i] = BB_TABLE_RANGE_SET;
     /* last byte in the bitmap */
     if (idx_end > idx) {
         offs_end = BITMAP_OFFSET(addr_end);
-        bm[idx_end] |= bitmap_set[0][offs_end];
+        BITMAP_OR(bm, idx_end, bitmap_set[0][offs_end]);
     }
     return true;
 }
@@ -745,6 +785,24 @@ module_is_from_tool(const char * path)
             strstr(path, DRCOV_LIB_NAME) != NULL);
 }
 
+static inline void
+module_htable_lock_acquire(void)
+{
+#ifdef UNIX
+    if (parallel_read)
+        pthread_mutex_lock(&module_htable_lock);
+#endif
+}
+
+static inline void
+module_htable_lock_release(void)
+{
+#ifdef UNIX
+    if (parallel_read)
+        pthread_mutex_unlock(&module_htable_lock);
+#endif
+}
+
 static char *
 read_module_list(char *buf, module_table_t ***tables, uint *num_mods)
 {
@@ -776,6 +834,7 @@ read_module_list(char *buf, module_table_t ***tables, uint *num_mods)
             ASSERT(false, "Failed to read module table");
         buf = move_to_next_line(buf);
         PRINT(5, "Module: %u, "PFX", %s\n", mod_id, (ptr_uint_t)mod_size, path);
+        module_htable_lock_acquire();
         mod_table = (module_table_t *) hashtable_lookup(&module_htable, path);
         if (mod_table == NULL) {
             modpath = path;
@@ -816,6 +875,7 @@ read_module_list(char *buf, module_table_t ***tables, uint *num_mods)
             if (!hashtable_add(&module_htable, (void *)modpath, mod_table))
                 ASSERT(false, "Failed to add new module");
         }
+        module_htable_lock_release();
         (*tables)[i] = mod_table;
     }
     return buf;
@@ -927,7 +987,7 @@ close_input_file(file_t f, char *map, size_t map_size)
 }
 
 static bool
-read_drcov_file(char *input)
+parse_drcov_file(const char *input)
 {
     file_t log;
     char  *map, *ptr;
@@ -969,6 +1029,58 @@ read_drcov_file(char *input)
     return true;
 }
 
+#ifdef UNIX
+static void *
+read_thread_main(void *arg)
+{
+    while (true) {
+        int i = __sync_fetch_and_add(&next_input, 1);
+        if (i >= (int)input_queue.size())
+            break;
+        if (parse_drcov_file(input_queue[i].c_str()))
+            __sync_fetch_and_add(&num_inputs_read, 1);
+    }
+    return NULL;
+}
+
+/* Reads the queued log files with -jobs threads.  Returns whether any of
+ * them was read successfully.
+ */
+static bool
+read_queued_files(void)
+{
+    std::vector<pthread_t> threads(op_jobs.get_value());
+    size_t i, num_threads = 0;
+    PRINT(2, "Reading %u log files with %u threads\n",
+          (uint)input_queue.size(), (uint)threads.size());
+    for (i = 0; i < threads.size() && i < input_queue.size(); i++) {
+        if (pthread_create(&threads[i], NULL, read_thread_main, NULL) != 0) {
+            WARN(1, "Failed to create reader thread\n");
+            break;
+        }
+        num_threads++;
+    }
+    /* We take part as well, which also covers thread creation failing */
+    read_thread_main(NULL);
+    for (i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    return num_inputs_read > 0;
+}
+#endif
+
+/* Reads the log file, or with -jobs queues it for read_queued_files(), in
+ * which case the return value only says that it was queued.
+ */
+static bool
+read_drcov_file(const char *input)
+{
+    if (parallel_read) {
+        input_queue.push_back(input);
+        return true;
+    }
+    return parse_drcov_file(input);
+}
+
 static inline bool
 is_drcov_log_file(const char *fname)
 {
@@ -1101,6 +1213,10 @@ read_drcov_input(void)
         res = read_drcov_list() && res;
     if (op_dir.specified())
         res = read_drcov_dir() && res;
+#ifdef UNIX
+    if (parallel_read)
+        res = read_queued_files() && res;
+#endif
     return res;
 }
 
@@ -1176,6 +1292,124 @@ enumerate_line_info(void)
     return true;
 }
 
+/****************************************************************************
+ * Coverage Database
+ */
+
+/* The -database file holds the merged per-module bitmaps:
+ *   DRCOV2LCOV DATABASE VERSION: <version>
+ *   Module Table: <count>
+ * followed by, for each module, a "<size>, <path>" line and then the
+ * module's bitmap of size/8 bytes.
+ */
+#define DATABASE_VERSION 1
+
+/* Returns the start of the line after ptr, or NULL if there is none before end.
+ * Unlike move_to_next_line(), does not skip binary data that follows.
+ */
+static char *
+database_next_line(char *ptr, char *end)
+{
+    char *nl = (char *) memchr(ptr, '\n', end - ptr);
+    return (nl == NULL ? NULL : nl + 1);
+}
+
+static bool
+read_database(void)
+{
+    file_t db;
+    char *map, *ptr, *end;
+    char path[MAXIMUM_PATH];
+    size_t map_size;
+    uint64 file_size, mod_size;
+    uint version, num_mods, i;
+    module_table_t *table;
+
+    if (!dr_file_exists(database_file_buf)) {
+        PRINT(2, "Creating new database %s\n", database_file_buf);
+        return true;
+    }
+    PRINT(2, "Reading database %s\n", database_file_buf);
+    db = open_input_file(database_file_buf, &map, &map_size, &file_size);
+    if (db == INVALID_FILE)
+        return false;
+    ptr = map;
+    end = map + file_size;
+    if (dr_sscanf(ptr, "DRCOV2LCOV DATABASE VERSION: %u\n", &version) != 1 ||
+        version != DATABASE_VERSION ||
+        (ptr = database_next_line(ptr, end)) == NULL ||
+        dr_sscanf(ptr, "Module Table: %u\n", &num_mods) != 1 ||
+        (ptr = database_next_line(ptr, end)) == NULL) {
+        WARN(1, "Invalid database header in %s\n", database_file_buf);
+        close_input_file(db, map, map_size);
+        return false;
+    }
+    for (i = 0; i < num_mods; i++) {
+        /* XXX: i#1143: we do not use dr_sscanf since it does not support %[] */
+        if (sscanf(ptr, "%"INT64_FORMAT"u, %[^\n\r]", &mod_size, path) != 2 ||
+            (ptr = database_next_line(ptr, end)) == NULL ||
+            mod_size >= UINT_MAX || !ALIGNED(mod_size, PAGE_SIZE) ||
+            mod_size/BITS_PER_BYTE > (uint64)(end - ptr) ||
+            hashtable_lookup(&module_htable, path) != NULL) {
+            WARN(1, "Corrupt module %u in database %s\n", i, database_file_buf);
+            close_input_file(db, map, map_size);
+            return false;
+        }
+        PRINT(4, "Database module: "PFX", %s\n", (ptr_uint_t)mod_size, path);
+        table = module_table_create(path, (size_t)mod_size);
+        memcpy(table->bb_table.bitmap, ptr, (size_t)mod_size/BITS_PER_BYTE);
+        ptr += mod_size/BITS_PER_BYTE;
+        num_module_htable_entries++;
+        if (!hashtable_add(&module_htable, (void *)path, table))
+            ASSERT(false, "Failed to add new module");
+    }
+    close_input_file(db, map, map_size);
+    return true;
+}
+
+static bool
+write_database(void)
+{
+    file_t db;
+    char tmp_path[MAXIMUM_PATH];
+    uint i, num_mods = 0;
+    hash_entry_t *e;
+
+    dr_snprintf(tmp_path, BUFFER_SIZE_ELEMENTS(tmp_path), "%s.tmp", database_file_buf);
+    NULL_TERMINATE_BUFFER(tmp_path);
+    PRINT(2, "Writing database %s\n", database_file_buf);
+    db = dr_open_file(tmp_path, DR_FILE_WRITE_OVERWRITE | DR_FILE_ALLOW_LARGE);
+    if (db == INVALID_FILE) {
+        WARN(1, "Failed to open database file %s\n", tmp_path);
+        return false;
+    }
+    for (i = 0; i < HASHTABLE_SIZE(module_htable.table_bits); i++) {
+        for (e = module_htable.table[i]; e != NULL; e = e->next) {
+            if (e->payload != MODULE_TABLE_IGNORE)
+                num_mods++;
+        }
+    }
+    dr_fprintf(db, "DRCOV2LCOV DATABASE VERSION: %u\n", DATABASE_VERSION);
+    dr_fprintf(db, "Module Table: %u\n", num_mods);
+    for (i = 0; i < HASHTABLE_SIZE(module_htable.table_bits); i++) {
+        for (e = module_htable.table[i]; e != NULL; e = e->next) {
+            module_table_t *table = (module_table_t *)e->payload;
+            if (table == MODULE_TABLE_IGNORE)
+                continue;
+            dr_fprintf(db, UINT64_FORMAT_STRING", %s\n", (uint64)table->size,
+                       (char *)e->key);
+            dr_write_file(db, table->bb_table.bitmap, table->size/BITS_PER_BYTE);
+        }
+    }
+    dr_close_file(db);
+    /* Only replace the old database once the new one is complete */
+    if (!dr_rename_file(tmp_path, database_file_buf, true/*replace*/)) {
+        WARN(1, "Failed to replace database file %s\n", database_file_buf);
+        return false;
+    }
+    return true;
+}
+
 /****************************************************************************
  * Output
  */
@@ -1337,6 +1571,31 @@ option_init(int argc, const char *argv[])
     NULL_TERMINATE_BUFFER(output_file_buf);
     PRINT(2, "Output file: %s\n", output_file_buf);
 
+    if (op_database.specified()) {
+        if (op_test_pattern.specified()) {
+            WARN(0, "-database is not supported with -test_pattern\n");
+            return false;
+        }
+        if (drfront_get_absolute_path(op_database.get_value().c_str(),
+                                      database_file_buf,
+                                      BUFFER_SIZE_ELEMENTS(database_file_buf)) !=
+            DRFRONT_SUCCESS) {
+            WARN(1, "Failed to get full path of database file\n");
+            return false;
+        }
+        NULL_TERMINATE_BUFFER(database_file_buf);
+        PRINT(2, "Database file: %s\n", database_file_buf);
+    }
+
+#ifdef UNIX
+    /* -test_pattern tracks the current test across the bbs of each file, and
+     * -reduce_set needs to know whether a file adds anything new, so both
+     * read the files in order.
+     */
+    parallel_read = (op_jobs.get_value() > 1 && !op_test_pattern.specified() &&
+                     !op_reduce_set.specified());
+#endif
+
     if (op_reduce_set.specified()) {
         if (drfront_get_absolute_path(op_reduce_set.get_value().c_str(),
                                       set_file_buf,
@@ -1380,12 +1639,28 @@ main(int argc, const char *argv[])
                       line_table_delete /* free */,
                       NULL /* hash */, NULL /* cmp */);
 
+    if (op_database.specified()) {
+        PRINT(1, "Reading database...\n");
+        if (!read_database()) {
+            ASSERT(false, "Failed to read database %s\n", database_file_buf);
+            return 1;
+        }
+    }
+
     PRINT(1, "Reading input files...\n");
     if (!read_drcov_input()) {
         ASSERT(false, "Failed to read input files\n");
         return 1;
     }
 
+    if (op_database.specified()) {
+        PRINT(1, "Writing database...\n");
+        if (!write_database()) {
+            ASSERT(false, "Failed to write database %s\n", database_file_buf);
+            return 1;
+        }
+    }
+
     PRINT(1, "Enumerating line info...\n");
     if (!enumerate_line_info()) {
         ASSERT(false, "Failed to enumerate line info\n");
@@ -47,6 +47,7 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <string.h>
 
 // XXX i#1732: make a msgbox on Windows (controlled by option for batch runs)
 #define NOTIFY(level, ...) do {            \
@@ -56,6 +57,18 @@
 
 static bool (*opcode_supported)(instr_t *);
 
+// The opcode_supported_* routines only look at the opcode, except that
+// opcodes widened in SSE2 also depend on whether there is an xmm operand.
+// We thus precompute a verdict per opcode for the selected model at init
+// time, and only call opcode_supported when the verdict depends on the
+// operands.
+enum {
+    VERDICT_SUPPORTED,
+    VERDICT_UNSUPPORTED,
+    VERDICT_CHECK_OPERANDS
+};
+static unsigned char verdicts[OP_LAST + 1];
+
 static std::vector<std::string> blacklist;
 
 /* DR deliberately does not bother to keep model-specific information in its
@@ -757,13 +770,46 @@ report_invalid_opcode(int opc, app_pc pc)
         dr_abort();
 }
 
+static void
+verdicts_init(void)
+{
+    // We build each opcode both without operands and with an xmm operand
+    // and compare the results.
+    for (int opc = OP_FIRST; opc <= OP_LAST; opc++) {
+        instr_t *plain = instr_build(GLOBAL_DCONTEXT, opc, 0, 0);
+        instr_t *xmm = instr_build(GLOBAL_DCONTEXT, opc, 0, 1);
+        instr_set_src(xmm, 0, opnd_create_reg(DR_REG_XMM0));
+        bool plain_ok = opcode_supported(plain);
+        bool xmm_ok = opcode_supported(xmm);
+        if (plain_ok != xmm_ok)
+            verdicts[opc] = VERDICT_CHECK_OPERANDS;
+        else
+            verdicts[opc] = plain_ok ? VERDICT_SUPPORTED : VERDICT_UNSUPPORTED;
+        instr_destroy(GLOBAL_DCONTEXT, plain);
+        instr_destroy(GLOBAL_DCONTEXT, xmm);
+    }
+}
+
+static inline bool
+instr_supported(instr_t *instr)
+{
+    int opc = instr_get_opcode(instr);
+    if (opc < OP_FIRST || opc > OP_LAST)
+        return opcode_supported(instr);
+    if (verdicts[opc] == VERDICT_CHECK_OPERANDS)
+        return opcode_supported(instr);
+    return verdicts[opc] == VERDICT_SUPPORTED;
+}
+
 static dr_emit_flags_t
 event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
                       instr_t *instr, bool for_trace,
                       bool translating, void *user_data)
 {
-    // We check meta instrs too
-    if (!opcode_supported(instr))
+    // We check meta instrs too.  Traces and re-translations are made of
+    // blocks we already checked when they were first built, so we skip them
+    // to avoid both the work and duplicate reports.
+    if (!for_trace && !translating && !instr_supported(instr))
         report_invalid_opcode(instr_get_opcode(instr), instr_get_app_pc(instr));
 #ifdef X86
     if (op_fool_cpuid.get_value() && instr_get_opcode(instr) == OP_cpuid) {
@@ -788,6 +834,79 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
     return DR_EMIT_DEFAULT;
 }
 
+#define SCAN_MAX_INSTR_LENGTH 17 // The x86 maximum, and more than ARM needs
+
+// Linearly decodes [start, end) looking for instructions that would need our
+// instrumentation.  Returns whether there were none.  Unless verbose, we stop
+// at the first one found.
+static bool
+scan_region(void *drcontext, const module_data_t *mod, byte *start, byte *end)
+{
+    bool clean = true;
+    byte copy[SCAN_MAX_INSTR_LENGTH];
+    instr_t instr;
+    instr_init(drcontext, &instr);
+    for (byte *pc = start; pc < end; ) {
+        byte *next_pc;
+        instr_reset(drcontext, &instr);
+        if (end - pc >= SCAN_MAX_INSTR_LENGTH)
+            next_pc = decode(drcontext, pc, &instr);
+        else {
+            // Do not read past the end of the region.
+            memset(copy, 0, sizeof(copy));
+            memcpy(copy, pc, end - pc);
+            next_pc = decode_from_copy(drcontext, copy, pc, &instr);
+            if (next_pc != NULL)
+                next_pc = pc + (next_pc - copy);
+        }
+        if (next_pc == NULL || next_pc > end) {
+            // Data or padding: resynchronize at the next byte.
+            pc++;
+            continue;
+        }
+        int opc = instr_get_opcode(&instr);
+        if (!instr_supported(&instr) ||
+            (op_fool_cpuid.get_value() && opc == OP_cpuid)) {
+            clean = false;
+            NOTIFY(1, "Scan of %s found \"%s\" @ +" PIFX "\n",
+                   dr_module_preferred_name(mod), decode_opcode_name(opc),
+                   pc - mod->start);
+            if (op_verbose.get_value() < 1)
+                break;
+        }
+        pc = next_pc;
+    }
+    instr_free(drcontext, &instr);
+    return clean;
+}
+
+// For -scan_modules: if nothing in the module's code needs us, we turn off
+// instrumentation for it.  This has to happen in the load event, so we cannot
+// push the scan to a separate thread.
+static void
+event_module_load(void *drcontext, const module_data_t *mod, bool loaded)
+{
+    bool clean = true;
+    byte *pc = mod->start;
+    while (pc < mod->end && (clean || op_verbose.get_value() >= 1)) {
+        byte *base;
+        size_t size;
+        uint prot;
+        if (!dr_query_memory(pc, &base, &size, &prot))
+            break;
+        byte *end = (base + size > mod->end) ? mod->end : base + size;
+        if ((prot & DR_MEMPROT_READ) != 0 && (prot & DR_MEMPROT_EXEC) != 0 &&
+            !scan_region(drcontext, mod, pc, end))
+            clean = false;
+        pc = end;
+    }
+    if (clean) {
+        NOTIFY(1, "Scan of %s found nothing: not instrumenting it\n",
+               dr_module_preferred_name(mod));
+        dr_module_set_should_instrument(mod->handle, false);
+    }
+}
+
 static void
 event_exit(void)
 {
@@ -883,6 +1002,8 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
     dr_abort();
 #endif
 
+    verdicts_init();
+
     if (!op_blacklist.get_value().empty()) {
         std::stringstream stream(op_blacklist.get_value());
         std::string entry;
@@ -897,4 +1018,7 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
     dr_register_exit_event(event_exit);
     if (!drmgr_register_bb_instrumentation_event(NULL, event_app_instruction, NULL))
         DR_ASSERT(false);
+    if (op_scan_modules.get_value() &&
+        !drmgr_register_module_load_event(event_module_load))
+        DR_ASSERT(false);
 }
@@ -132,6 +132,18 @@ droption_t<std::string> op_blacklist
  "The blacklist is a :-separated list of library names for which violations "
  "should not be reported.");
 
+droption_t<bool> op_scan_modules
+(DROPTION_SCOPE_CLIENT, "scan_modules", false, "Scan each module up front.",
+ "When this option is enabled, drcpusim decodes all of the executable code of each "
+ "module when it is loaded.  A module in which no instruction unsupported by the "
+ "CPU model is found (and, with -fool_cpuid, no CPUID instruction) is then not "
+ "instrumented at all, which removes nearly all of the overhead of running its code. "
+ "Modules in which something is found are checked as they execute, as usual, so "
+ "that only instructions that are actually executed are reported.  The scan is a "
+ "linear sweep, which can be confused by data embedded in code: while it normally "
+ "resynchronizes quickly, an unsupported instruction that it decodes incorrectly "
+ "will be missed.");
+
 droption_t<unsigned int> op_verbose
 (DROPTION_SCOPE_CLIENT, "verbose", 0, 0, 64, "Verbosity level",
  "Verbosity level for notifications.");
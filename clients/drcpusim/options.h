@@ -43,6 +43,7 @@ extern droption_t<bool> op_continue;
 extern droption_t<bool> op_fool_cpuid;
 extern droption_t<bool> op_allow_prefetchw;
 extern droption_t<std::string> op_blacklist;
+extern droption_t<bool> op_scan_modules;
 extern droption_t<unsigned int> op_verbose;
 
 #endif /* _OPTIONS_H_ */
@@ -0,0 +1,876 @@
+/* ***************************************************************************
+ * Copyright (c) 2016 Google, Inc.  All rights reserved.
+ * ***************************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Heap Profiling Tool: drheapprof
+ *
+ * Wraps the allocation routines exported by the application's libraries and
+ * aggregates the allocations by the call stack that made them: counts,
+ * bytes, lifetimes, and peak live bytes.  The call stacks are symbolized at
+ * exit.
+ *
+ * The runtime options for this client include:
+ *
+ * -logdir <dir>       Sets log directory, which by default is ".".
+ * -max_frames <N>     Sets the number of frames of each call stack, which by
+ *                     default is 8.
+ * -top <N>            Prints the N call stacks allocating the most bytes,
+ *                     which by default is 50.  0 prints them all.
+ * -verbose <N>        For debugging the tool itself.
+ */
+
+#include "dr_api.h"
+#include "drmgr.h"
+#include "drwrap.h"
+#include "drsyms.h"
+#include "drx.h"
+#include "hashtable.h"
+#include "drvector.h"
+#include "../common/utils.h"
+#include "../common/modules.h"
+#include <string.h>
+#ifdef WINDOWS
+# include <intrin.h>
+#endif
+
+static uint verbose;
+
+#define NOTIFY(level, fmt, ...) do {          \
+    if (verbose >= (level))                   \
+        dr_fprintf(STDERR, fmt, __VA_ARGS__); \
+} while (0)
+
+#define MAX_FRAMES_LIMIT 64
+
+typedef struct _drheapprof_options_t {
+    char logdir[MAXIMUM_PATH];
+    uint max_frames;
+    uint top;
+} drheapprof_options_t;
+
+static drheapprof_options_t options;
+
+/* The routines we wrap, which each kind of call is recorded as */
+typedef enum {
+    CALL_MALLOC,
+    CALL_CALLOC,
+    CALL_REALLOC,
+    CALL_FREE,
+#ifdef UNIX
+    CALL_MMAP,
+    CALL_MUNMAP,
+#endif
+    /* Marks a call made from inside another wrapped call, such as a malloc
+     * from operator new, which we skip so it is not counted twice.
+     */
+    CALL_NESTED,
+} call_kind_t;
+
+typedef struct _alloc_routine_t {
+    const char *name;
+    call_kind_t kind;
+} alloc_routine_t;
+
+static const alloc_routine_t alloc_routines[] = {
+    {"malloc", CALL_MALLOC},
+    {"calloc", CALL_CALLOC},
+    {"realloc", CALL_REALLOC},
+    {"free", CALL_FREE},
+#ifdef UNIX
+    /* operator new and delete, in their Itanium C++ ABI mangled names */
+    {IF_X64_ELSE("_Znwm", "_Znwj"), CALL_MALLOC},
+    {IF_X64_ELSE("_Znam", "_Znaj"), CALL_MALLOC},
+    {IF_X64_ELSE("_ZnwmRKSt9nothrow_t", "_ZnwjRKSt9nothrow_t"), CALL_MALLOC},
+    {IF_X64_ELSE("_ZnamRKSt9nothrow_t", "_ZnajRKSt9nothrow_t"), CALL_MALLOC},
+    {"_ZdlPv", CALL_FREE},
+    {"_ZdaPv", CALL_FREE},
+    {IF_X64_ELSE("_ZdlPvm", "_ZdlPvj"), CALL_FREE},
+    {IF_X64_ELSE("_ZdaPvm", "_ZdaPvj"), CALL_FREE},
+    {"_ZdlPvRKSt9nothrow_t", CALL_FREE},
+    {"_ZdaPvRKSt9nothrow_t", CALL_FREE},
+    {"mmap", CALL_MMAP},
+    {"munmap", CALL_MUNMAP},
+#endif
+};
+#define NUM_ALLOC_ROUTINES (sizeof(alloc_routines) / sizeof(alloc_routines[0]))
+
+/* An allocation site is a unique call stack.  Sites are shared by all
+ * threads and kept until exit.  Each thread counts its allocations and
+ * frees for a site in its own thread_site_t, merged into the site_t only
+ * at thread exit, so the counters need no locks; only the live bytes,
+ * which determine the peak, are shared and updated atomically.
+ */
+typedef struct _site_t {
+    uint hash;
+    uint num_frames;
+    app_pc frames[MAX_FRAMES_LIMIT]; /* only num_frames are allocated */
+} site_t;
+
+typedef struct _site_stats_t {
+    uint64 allocs;
+    uint64 alloc_bytes;
+    uint64 frees;
+    uint64 freed_bytes;
+    uint64 lifetimes; /* sum of the lifetimes of the freed allocations */
+} site_stats_t;
+
+typedef struct _site_info_t {
+    site_t *site;
+    site_stats_t stats; /* merged from exited threads */
+    volatile ptr_int_t live_bytes;
+    ptr_int_t peak_bytes;
+} site_info_t;
+
+#define SITE_SIZE(num_frames) \
+    (sizeof(site_t) - (MAX_FRAMES_LIMIT - (num_frames)) * sizeof(app_pc))
+
+/* sites_lock protects site_table and sites, which all threads add to the
+ * first time they see a call stack.
+ */
+#define SITE_TABLE_BITS 12
+static void *sites_lock;
+static hashtable_t site_table; /* maps site_t to site_info_t */
+static drvector_t sites;       /* all site_info_t, for the report */
+
+typedef struct _thread_site_t {
+    site_info_t *info;
+    site_stats_t stats;
+} thread_site_t;
+
+/* The live allocations, for finding the site and size of each free.  The
+ * table is split into shards by address, each with its own lock, so that
+ * threads rarely contend for it.
+ */
+#define LIVE_SHARD_BITS 6
+#define LIVE_SHARDS (1 << LIVE_SHARD_BITS)
+#define LIVE_TABLE_BITS 10
+/* Heap allocations are at least this aligned */
+#define ALLOC_ALIGN_BITS 3
+
+typedef struct _live_t {
+    site_info_t *info;
+    size_t size;
+    uint64 timestamp;
+} live_t;
+
+typedef struct _live_shard_t {
+    void *lock;
+    hashtable_t table; /* maps address to live_t */
+} live_shard_t;
+
+static live_shard_t live_shards[LIVE_SHARDS];
+
+typedef struct _per_thread_t {
+    /* this thread's thread_site_t of each site, by site_t for allocations
+     * and by site_info_t for frees
+     */
+    hashtable_t by_stack;
+    hashtable_t by_info;
+    /* the number of wrapped calls in progress, to skip nested ones */
+    uint depth;
+    /* the outermost call in progress */
+    site_info_t *pending_info;
+    size_t pending_size;
+    void *pending_ptr;
+    /* scratch space for building a call stack */
+    site_t *stack;
+} per_thread_t;
+
+static int tls_idx;
+
+static module_table_t *module_table;
+
+/* For converting timestamps to nanoseconds */
+static uint64 start_timestamp;
+static uint64 start_micros;
+
+/****************************************************************************
+ * Timing
+ */
+
+/* Returns the time stamp counter on x86, where it is cheap to read, and
+ * microseconds elsewhere.
+ */
+static inline uint64
+get_timestamp(void)
+{
+#ifdef X86
+# ifdef WINDOWS
+    return __rdtsc();
+# else
+    return __builtin_ia32_rdtsc();
+# endif
+#else
+    return dr_get_microseconds();
+#endif
+}
+
+/* Returns the number of timestamp units per microsecond measured since
+ * startup, or 0 if too little time has passed to tell.
+ */
+static uint64
+timestamps_per_micro(void)
+{
+#ifdef X86
+    uint64 micros = dr_get_microseconds() - start_micros;
+    if (micros == 0)
+        return 0;
+    return (get_timestamp() - start_timestamp) / micros;
+#else
+    return 1;
+#endif
+}
+
+static uint64
+timestamp_to_ns(uint64 value, uint64 per_micro)
+{
+    if (per_micro == 0)
+        return value;
+    return value * 1000 / per_micro;
+}
+
+/****************************************************************************
+ * Call stacks
+ */
+
+static inline ptr_int_t
+atomic_add_ptr(volatile ptr_int_t *x, ptr_int_t val)
+{
+#ifdef WINDOWS
+    return IF_X64_ELSE(_InterlockedExchangeAdd64((volatile __int64 *)x, val),
+                       _InterlockedExchangeAdd((volatile long *)x, val)) + val;
+#else
+    return __sync_add_and_fetch(x, val);
+#endif
+}
+
+static uint
+site_hash(void *key)
+{
+    site_t *site = (site_t *) key;
+    return site->hash;
+}
+
+static bool
+site_equal(void *key1, void *key2)
+{
+    site_t *site1 = (site_t *) key1;
+    site_t *site2 = (site_t *) key2;
+    return site1->hash == site2->hash && site1->num_frames == site2->num_frames &&
+        memcmp(site1->frames, site2->frames,
+               site1->num_frames * sizeof(site1->frames[0])) == 0;
+}
+
+/* Walks the frame pointer chain from a wrapped routine's entry into
+ * stack, starting with the routine's return address.  Frames whose code
+ * was built without frame pointers end the walk early, or are skipped.
+ */
+static void
+capture_stack(void *wrapcxt, site_t *stack)
+{
+    uint i, num = 0;
+    stack->frames[num++] = drwrap_get_retaddr(wrapcxt);
+#ifdef X86
+    if (options.max_frames > 1) {
+        /* At the routine's entry xbp still holds its caller's frame */
+        dr_mcontext_t *mc = drwrap_get_mcontext_ex(wrapcxt, DR_MC_INTEGER |
+                                                   DR_MC_CONTROL);
+        ptr_uint_t fp = mc->xbp, sp = mc->xsp;
+        while (num < options.max_frames) {
+            app_pc record[2]; /* the next frame pointer and return address */
+            /* A frame pointer must be in the stack above the last frame */
+            if (fp < sp || fp - sp > 1024 * 1024 || !ALIGNED(fp, sizeof(void *)))
+                break;
+            if (!dr_safe_read((void *)fp, sizeof(record), record, NULL) ||
+                record[1] == NULL)
+                break;
+            stack->frames[num++] = record[1];
+            sp = fp + sizeof(record);
+            fp = (ptr_uint_t)record[0];
+        }
+    }
+#endif
+    stack->num_frames = num;
+    stack->hash = num;
+    for (i = 0; i < num; i++) {
+        ptr_uint_t pc = (ptr_uint_t)stack->frames[i];
+        stack->hash = (stack->hash ^ (uint)pc IF_X64(^ (uint)(pc >> 32))) * 0x9e3779b1;
+    }
+    stack->hash ^= stack->hash >> 16;
+}
+
+static void
+site_info_free(void *p)
+{
+    site_info_t *info = (site_info_t *) p;
+    dr_global_free(info->site, SITE_SIZE(info->site->num_frames));
+    dr_global_free(info, sizeof(*info));
+}
+
+/* Returns the site of the call stack, adding it if it is new */
+static site_info_t *
+site_lookup_or_add(site_t *stack)
+{
+    site_info_t *info;
+    dr_mutex_lock(sites_lock);
+    info = (site_info_t *) hashtable_lookup(&site_table, stack);
+    if (info == NULL) {
+        info = dr_global_alloc(sizeof(*info));
+        memset(info, 0, sizeof(*info));
+        info->site = dr_global_alloc(SITE_SIZE(stack->num_frames));
+        memcpy(info->site, stack, SITE_SIZE(stack->num_frames));
+        hashtable_add(&site_table, info->site, info);
+        drvector_append(&sites, info);
+    }
+    dr_mutex_unlock(sites_lock);
+    return info;
+}
+
+static void
+thread_site_free(void *p)
+{
+    dr_global_free(p, sizeof(thread_site_t));
+}
+
+static thread_site_t *
+thread_site_for_stack(per_thread_t *data, site_t *stack)
+{
+    thread_site_t *ts = (thread_site_t *) hashtable_lookup(&data->by_stack, stack);
+    if (ts != NULL)
+        return ts;
+    ts = (thread_site_t *) dr_global_alloc(sizeof(*ts));
+    memset(ts, 0, sizeof(*ts));
+    ts->info = site_lookup_or_add(stack);
+    hashtable_add(&data->by_stack, ts->info->site, ts);
+    hashtable_add(&data->by_info, ts->info, ts);
+    return ts;
+}
+
+static thread_site_t *
+thread_site_for_info(per_thread_t *data, site_info_t *info)
+{
+    thread_site_t *ts = (thread_site_t *) hashtable_lookup(&data->by_info, info);
+    if (ts != NULL)
+        return ts;
+    /* A free in this thread of memory allocated in another */
+    ts = (thread_site_t *) dr_global_alloc(sizeof(*ts));
+    memset(ts, 0, sizeof(*ts));
+    ts->info = info;
+    hashtable_add(&data->by_stack, info->site, ts);
+    hashtable_add(&data->by_info, info, ts);
+    return ts;
+}
+
+/****************************************************************************
+ * Recording allocations
+ */
+
+static uint
+live_hash(void *key)
+{
+    return (uint)((ptr_uint_t)key >> (ALLOC_ALIGN_BITS + LIVE_SHARD_BITS));
+}
+
+static bool
+live_equal(void *key1, void *key2)
+{
+    return key1 == key2;
+}
+
+static void
+live_free(void *p)
+{
+    dr_global_free(p, sizeof(live_t));
+}
+
+static live_shard_t *
+live_shard(void *ptr)
+{
+    return &live_shards[((ptr_uint_t)ptr >> ALLOC_ALIGN_BITS) & (LIVE_SHARDS - 1)];
+}
+
+/* Counts the free of the allocation live, which the caller then frees */
+static void
+count_free(per_thread_t *data, live_t *live)
+{
+    thread_site_t *ts = thread_site_for_info(data, live->info);
+    ts->stats.frees++;
+    ts->stats.freed_bytes += live->size;
+    ts->stats.lifetimes += get_timestamp() - live->timestamp;
+    atomic_add_ptr(&live->info->live_bytes, -(ptr_int_t)live->size);
+}
+
+static void
+record_free(per_thread_t *data, void *ptr)
+{
+    live_shard_t *shard = live_shard(ptr);
+    live_t *live;
+    dr_mutex_lock(shard->lock);
+    live = (live_t *) hashtable_lookup(&shard->table, ptr);
+    if (live != NULL)
+        hashtable_remove(&shard->table, ptr);
+    dr_mutex_unlock(shard->lock);
+    if (live == NULL)
+        return; /* allocated before we attached, or by an unwrapped routine */
+    count_free(data, live);
+    live_free(live);
+}
+
+static void
+record_alloc(per_thread_t *data, void *ptr, site_info_t *info, size_t size)
+{
+    live_shard_t *shard = live_shard(ptr);
+    live_t *live, *old;
+    thread_site_t *ts;
+    ptr_int_t live_bytes;
+    live = (live_t *) dr_global_alloc(sizeof(*live));
+    live->info = info;
+    live->size = size;
+    live->timestamp = get_timestamp();
+    dr_mutex_lock(shard->lock);
+    old = (live_t *) hashtable_add_replace(&shard->table, ptr, live);
+    dr_mutex_unlock(shard->lock);
+    if (old != NULL) {
+        /* The address was freed without our seeing it */
+        count_free(data, old);
+        live_free(old);
+    }
+    ts = thread_site_for_stack(data, info->site);
+    ts->stats.allocs++;
+    ts->stats.alloc_bytes += size;
+    live_bytes = atomic_add_ptr(&info->live_bytes, (ptr_int_t)size);
+    /* Racing updates may miss a new peak by the size of one allocation */
+    if (live_bytes > info->peak_bytes)
+        info->peak_bytes = live_bytes;
+}
+
+static void
+alloc_pre(void *wrapcxt, INOUT void **user_data)
+{
+    void *drcontext = drwrap_get_drcontext(wrapcxt);
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    call_kind_t kind = (call_kind_t)(ptr_uint_t) *user_data;
+    if (data == NULL) {
+        *user_data = (void *) CALL_NESTED;
+        return;
+    }
+    /* alloc_post undoes this for every call, nested or not */
+    if (data->depth++ > 0) {
+        *user_data = (void *) CALL_NESTED;
+        return;
+    }
+    data->pending_info = NULL;
+    data->pending_ptr = NULL;
+    data->pending_size = 0;
+    switch (kind) {
+    case CALL_MALLOC:
+        data->pending_size = (size_t) drwrap_get_arg(wrapcxt, 0);
+        break;
+    case CALL_CALLOC:
+        data->pending_size = (size_t) drwrap_get_arg(wrapcxt, 0) *
+            (size_t) drwrap_get_arg(wrapcxt, 1);
+        break;
+    case CALL_REALLOC:
+        data->pending_ptr = drwrap_get_arg(wrapcxt, 0);
+        data->pending_size = (size_t) drwrap_get_arg(wrapcxt, 1);
+        break;
+#ifdef UNIX
+    case CALL_MMAP:
+        data->pending_size = (size_t) drwrap_get_arg(wrapcxt, 1);
+        break;
+    case CALL_MUNMAP:
+#endif
+    case CALL_FREE:
+        /* We record a free before the memory can be handed out again */
+        if (drwrap_get_arg(wrapcxt, 0) != NULL)
+            record_free(data, drwrap_get_arg(wrapcxt, 0));
+        return;
+    default:
+        ASSERT(false, "unknown allocation routine");
+        return;
+    }
+    capture_stack(wrapcxt, data->stack);
+    data->pending_info = thread_site_for_stack(data, data->stack)->info;
+}
+
+static void
+alloc_post(void *wrapcxt, void *user_data)
+{
+    call_kind_t kind = (call_kind_t)(ptr_uint_t) user_data;
+    void *drcontext = (wrapcxt == NULL) ? dr_get_current_drcontext() :
+        drwrap_get_drcontext(wrapcxt);
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    void *ptr;
+    if (data == NULL)
+        return;
+    if (data->depth > 0)
+        data->depth--;
+    if (kind == CALL_NESTED || wrapcxt == NULL)
+        return; /* wrapcxt is NULL on an abnormal exit such as a longjmp */
+    if (data->pending_info == NULL)
+        return;
+    ptr = drwrap_get_retval(wrapcxt);
+#ifdef UNIX
+    if (kind == CALL_MMAP && ptr == (void *)(ptr_int_t)-1 /* MAP_FAILED */)
+        return;
+#endif
+    if (kind == CALL_REALLOC && data->pending_ptr != NULL &&
+        (ptr != NULL || data->pending_size == 0))
+        record_free(data, data->pending_ptr);
+    if (ptr != NULL)
+        record_alloc(data, ptr, data->pending_info, data->pending_size);
+}
+
+static void
+event_module_load(void *drcontext, const module_data_t *info, bool loaded)
+{
+    uint i;
+    module_table_load(module_table, info);
+    for (i = 0; i < NUM_ALLOC_ROUTINES; i++) {
+        app_pc func = (app_pc) dr_get_proc_address(info->handle,
+                                                   alloc_routines[i].name);
+        if (func == NULL)
+            continue;
+        if (!drwrap_wrap_ex(func, alloc_pre, alloc_post,
+                            (void *)(ptr_uint_t) alloc_routines[i].kind, 0)) {
+            NOTIFY(0, "drheapprof: failed to wrap %s!%s\n",
+                   dr_module_preferred_name(info), alloc_routines[i].name);
+        } else {
+            NOTIFY(1, "wrapping %s!%s @"PFX"\n", dr_module_preferred_name(info),
+                   alloc_routines[i].name, func);
+        }
+    }
+}
+
+static void
+event_module_unload(void *drcontext, const module_data_t *info)
+{
+    uint i;
+    for (i = 0; i < NUM_ALLOC_ROUTINES; i++) {
+        app_pc func = (app_pc) dr_get_proc_address(info->handle,
+                                                   alloc_routines[i].name);
+        if (func != NULL)
+            drwrap_unwrap(func, alloc_pre, alloc_post);
+    }
+    module_table_unload(module_table, info);
+}
+
+/****************************************************************************
+ * Report
+ */
+
+static void
+print_frame(file_t f, uint index, app_pc pc)
+{
+    module_entry_t *entry = module_table_lookup(NULL, 0, module_table, pc);
+    drsym_info_t sym;
+    char name[MAXIMUM_PATH];
+    char file[MAXIMUM_PATH];
+    const char *modname;
+    size_t offs;
+    if (entry == NULL || entry->data == NULL) {
+        dr_fprintf(f, "    #%-2u "PFX" <unknown>\n", index, pc);
+        return;
+    }
+    modname = dr_module_preferred_name(entry->data);
+    if (modname == NULL)
+        modname = "<noname>";
+    offs = pc - entry->data->start;
+    sym.struct_size = sizeof(sym);
+    sym.name = name;
+    sym.name_size = BUFFER_SIZE_BYTES(name);
+    sym.file = file;
+    sym.file_size = BUFFER_SIZE_BYTES(file);
+    /* The return address may be the start of the next line, so we look up
+     * the call instead.
+     */
+    switch (drsym_lookup_address(entry->data->full_path, offs - 1, &sym,
+                                 DRSYM_DEMANGLE)) {
+    case DRSYM_SUCCESS:
+        dr_fprintf(f, "    #%-2u "PFX" %s!%s+"PIFX" (%s:"UINT64_FORMAT_STRING")\n",
+                   index, pc, modname, name, offs - sym.start_offs, file, sym.line);
+        break;
+    case DRSYM_ERROR_LINE_NOT_AVAILABLE:
+        dr_fprintf(f, "    #%-2u "PFX" %s!%s+"PIFX"\n",
+                   index, pc, modname, name, offs - sym.start_offs);
+        break;
+    default:
+        dr_fprintf(f, "    #%-2u "PFX" %s+"PIFX"\n", index, pc, modname, offs);
+        break;
+    }
+}
+
+static void
+site_print(file_t f, uint rank, site_info_t *info, uint64 per_micro)
+{
+    uint i;
+    dr_fprintf(f, "Site %u: "UINT64_FORMAT_STRING" allocs, "UINT64_FORMAT_STRING
+               " bytes, "UINT64_FORMAT_STRING" frees, "UINT64_FORMAT_STRING
+               " bytes freed, peak "SZFMT" bytes live, "SZFMT" bytes live at exit",
+               rank, info->stats.allocs, info->stats.alloc_bytes, info->stats.frees,
+               info->stats.freed_bytes, info->peak_bytes, info->live_bytes);
+    if (info->stats.frees > 0) {
+        dr_fprintf(f, ", mean lifetime "UINT64_FORMAT_STRING,
+                   timestamp_to_ns(info->stats.lifetimes / info->stats.frees,
+                                   per_micro));
+    }
+    dr_fprintf(f, "\n");
+    for (i = 0; i < info->site->num_frames; i++)
+        print_frame(f, i, info->site->frames[i]);
+}
+
+static bool
+site_ranks_before(site_info_t *info1, site_info_t *info2)
+{
+    return info1->stats.alloc_bytes > info2->stats.alloc_bytes ||
+        (info1->stats.alloc_bytes == info2->stats.alloc_bytes &&
+         info1->stats.allocs > info2->stats.allocs);
+}
+
+static void
+report(file_t f)
+{
+    uint64 per_micro = timestamps_per_micro();
+    site_stats_t total;
+    site_info_t **top;
+    uint num_top = 0, max_top, i, j;
+    memset(&total, 0, sizeof(total));
+    max_top = (options.top == 0 || options.top > sites.entries) ? sites.entries :
+        options.top;
+    top = dr_global_alloc((max_top + 1) * sizeof(*top));
+    /* We keep the top sites in order by insertion */
+    for (i = 0; i < sites.entries; i++) {
+        site_info_t *info = (site_info_t *) drvector_get_entry(&sites, i);
+        total.allocs += info->stats.allocs;
+        total.alloc_bytes += info->stats.alloc_bytes;
+        total.frees += info->stats.frees;
+        total.freed_bytes += info->stats.freed_bytes;
+        if (info->stats.allocs == 0)
+            continue;
+        for (j = num_top; j > 0 && site_ranks_before(info, top[j - 1]); j--)
+            top[j] = top[j - 1];
+        top[j] = info;
+        if (num_top < max_top)
+            num_top++;
+    }
+    dr_fprintf(f, "Heap profile: "UINT64_FORMAT_STRING" allocs, "UINT64_FORMAT_STRING
+               " bytes, "UINT64_FORMAT_STRING" frees, "UINT64_FORMAT_STRING
+               " bytes freed, from %u call stacks\n", total.allocs, total.alloc_bytes,
+               total.frees, total.freed_bytes, sites.entries);
+    dr_fprintf(f, "Lifetimes are in %s.  Top %u call stacks by bytes allocated:\n",
+               per_micro == 0 ? "timestamp units" : "nanoseconds", num_top);
+    for (i = 0; i < num_top; i++) {
+        dr_fprintf(f, "\n");
+        site_print(f, i + 1, top[i], per_micro);
+    }
+    dr_global_free(top, (max_top + 1) * sizeof(*top));
+}
+
+/****************************************************************************
+ * Init and exit
+ */
+
+static void
+event_thread_init(void *drcontext)
+{
+    per_thread_t *data = dr_thread_alloc(drcontext, sizeof(*data));
+    memset(data, 0, sizeof(*data));
+    /* The tables are only used by their own thread, so they need no lock */
+    hashtable_init_ex(&data->by_stack, 8, HASH_CUSTOM, false/*!strdup*/,
+                      false/*!synch*/, NULL, site_hash, site_equal);
+    hashtable_init_ex(&data->by_info, 8, HASH_INTPTR, false/*!strdup*/,
+                      false/*!synch*/, thread_site_free, NULL, NULL);
+    data->stack = dr_thread_alloc(drcontext, SITE_SIZE(MAX_FRAMES_LIMIT));
+    drmgr_set_tls_field(drcontext, tls_idx, data);
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    uint i;
+    dr_mutex_lock(sites_lock);
+    for (i = 0; i < HASHTABLE_SIZE(data->by_info.table_bits); i++) {
+        hash_entry_t *he;
+        for (he = data->by_info.table[i]; he != NULL; he = he->next) {
+            thread_site_t *ts = (thread_site_t *) he->payload;
+            ts->info->stats.allocs += ts->stats.allocs;
+            ts->info->stats.alloc_bytes += ts->stats.alloc_bytes;
+            ts->info->stats.frees += ts->stats.frees;
+            ts->info->stats.freed_bytes += ts->stats.freed_bytes;
+            ts->info->stats.lifetimes += ts->stats.lifetimes;
+        }
+    }
+    dr_mutex_unlock(sites_lock);
+    drmgr_set_tls_field(drcontext, tls_idx, NULL);
+    hashtable_delete(&data->by_stack);
+    hashtable_delete(&data->by_info);
+    dr_thread_free(drcontext, data->stack, SITE_SIZE(MAX_FRAMES_LIMIT));
+    dr_thread_free(drcontext, data, sizeof(*data));
+}
+
+static void
+event_exit(void)
+{
+    char buf[MAXIMUM_PATH];
+    file_t f;
+    uint i;
+
+    f = drx_open_unique_appid_file(options.logdir, dr_get_process_id(),
+                                   "drheapprof", "log", DR_FILE_ALLOW_LARGE,
+                                   buf, BUFFER_SIZE_ELEMENTS(buf));
+    ASSERT(f != INVALID_FILE, "failed to open log file");
+    if (f != INVALID_FILE) {
+        NOTIFY(1, "drheapprof: writing %s\n", buf);
+        report(f);
+        dr_close_file(f);
+    }
+
+    for (i = 0; i < LIVE_SHARDS; i++) {
+        /* The table does not own its payloads, so we free them here */
+        hashtable_t *table = &live_shards[i].table;
+        uint j;
+        for (j = 0; j < HASHTABLE_SIZE(table->table_bits); j++) {
+            hash_entry_t *he;
+            for (he = table->table[j]; he != NULL; he = he->next)
+                live_free(he->payload);
+        }
+        hashtable_delete(table);
+        dr_mutex_destroy(live_shards[i].lock);
+    }
+    hashtable_delete(&site_table);
+    drvector_delete(&sites);
+    dr_mutex_destroy(sites_lock);
+    module_table_destroy(module_table);
+    drmgr_unregister_tls_field(tls_idx);
+    drsym_exit();
+    drx_exit();
+    drwrap_exit();
+    drmgr_exit();
+}
+
+static void
+options_init(client_id_t id, int argc, const char *argv[])
+{
+    int i;
+    const char *token;
+    /* default values */
+    dr_snprintf(options.logdir, BUFFER_SIZE_ELEMENTS(options.logdir), ".");
+    options.max_frames = 8;
+    options.top = 50;
+
+    for (i = 1/*skip client*/; i < argc; i++) {
+        token = argv[i];
+        if (strcmp(token, "-logdir") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing logdir path");
+            strncpy(options.logdir, argv[++i], BUFFER_SIZE_ELEMENTS(options.logdir));
+            NULL_TERMINATE_BUFFER(options.logdir);
+        }
+        else if (strcmp(token, "-max_frames") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -max_frames number");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &options.max_frames) != 1 ||
+                options.max_frames == 0 || options.max_frames > MAX_FRAMES_LIMIT) {
+                USAGE_CHECK(false, "invalid -max_frames number: must be 1 to 64");
+            }
+        }
+        else if (strcmp(token, "-top") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -top number");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &options.top) != 1) {
+                USAGE_CHECK(false, "invalid -top number");
+            }
+        }
+        else if (strcmp(token, "-verbose") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -verbose number");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &verbose) != 1) {
+                USAGE_CHECK(false, "invalid -verbose number");
+            }
+        }
+        else {
+            NOTIFY(0, "UNRECOGNIZED OPTION: \"%s\"\n", token);
+            USAGE_CHECK(false, "invalid option");
+        }
+    }
+}
+
+DR_EXPORT void
+dr_client_main(client_id_t id, int argc, const char *argv[])
+{
+    uint i;
+    IF_DEBUG(bool ok;)
+
+    dr_set_client_name("DrHeapProf", "http://dynamorio.org/issues");
+
+    options_init(id, argc, argv);
+
+    IF_DEBUG(ok = )
+        drmgr_init();
+    ASSERT(ok, "drmgr failed to initialize");
+    IF_DEBUG(ok = )
+        drwrap_init();
+    ASSERT(ok, "drwrap failed to initialize");
+    IF_DEBUG(ok = )
+        drx_init();
+    ASSERT(ok, "drx failed to initialize");
+    if (drsym_init(0) != DRSYM_SUCCESS)
+        ASSERT(false, "drsyms failed to initialize");
+
+    /* No-frills is safe b/c we're the only module doing wrapping, and
+     * we're only wrapping at module load and unwrapping at unload.
+     * Fast cleancalls is safe b/c we only read the integer registers.
+     */
+    drwrap_set_global_flags(DRWRAP_NO_FRILLS | DRWRAP_FAST_CLEANCALLS);
+
+    sites_lock = dr_mutex_create();
+    hashtable_init_ex(&site_table, SITE_TABLE_BITS, HASH_CUSTOM, false/*!strdup*/,
+                      false/*!synch*/, NULL, site_hash, site_equal);
+    drvector_init(&sites, 1024, false/*!synch*/, site_info_free);
+    for (i = 0; i < LIVE_SHARDS; i++) {
+        live_shards[i].lock = dr_mutex_create();
+        hashtable_init_ex(&live_shards[i].table, LIVE_TABLE_BITS, HASH_CUSTOM,
+                          false/*!strdup*/, false/*!synch*/, NULL,
+                          live_hash, live_equal);
+    }
+    module_table = module_table_create();
+    tls_idx = drmgr_register_tls_field();
+    ASSERT(tls_idx > -1, "unable to reserve TLS slot");
+
+    start_timestamp = get_timestamp();
+    start_micros = dr_get_microseconds();
+
+    dr_register_exit_event(event_exit);
+    drmgr_register_thread_init_event(event_thread_init);
+    drmgr_register_thread_exit_event(event_thread_exit);
+    drmgr_register_module_load_event(event_module_load);
+    drmgr_register_module_unload_event(event_module_unload);
+}
@@ -0,0 +1,89 @@
+# **********************************************************
+# Copyright (c) 2016 Google, Inc.    All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+#
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+# Invoked by the test suite for testing this tool
+
+# input:
+# * cmd = command to run
+#     should have intra-arg space=@@ and inter-arg space=@ and ;=!
+# * cmp = file containing output to compare app output to, to ensure app ran correctly
+
+# Intra-arg space=@@ and inter-arg space=@.
+string(REGEX REPLACE "@@" " " cmd "${cmd}")
+string(REGEX REPLACE "@" ";" cmd "${cmd}")
+string(REGEX REPLACE "!" "\\\;" cmd "${cmd}")
+
+# Remove stale profiles so we find ours
+file(GLOB old_files "drheapprof.*.log")
+foreach (old ${old_files})
+  file(REMOVE ${old})
+endforeach ()
+
+# run the cmd
+execute_process(COMMAND ${cmd}
+  RESULT_VARIABLE cmd_result
+  ERROR_VARIABLE cmd_err
+  OUTPUT_VARIABLE cmd_out)
+if (cmd_result)
+  message(FATAL_ERROR "*** ${cmd} failed (${cmd_result}): ${cmd_err}***\n")
+endif (cmd_result)
+
+# DR's tests write to stderr so combine stdout and stderr.
+set(app_out "${cmd_out}${cmd_err}")
+
+# get expected app output
+# we assume it has already been processed w/ regex => literal, etc.
+file(READ "${cmp}" str)
+
+if (WIN32)
+  # our test prep turned \n into \r?\n so revert
+  string(REGEX REPLACE "\r\\?" "" str "${str}")
+endif (WIN32)
+
+if (NOT "${app_out}" STREQUAL "${str}")
+  message(FATAL_ERROR "app output ${app_out} failed to match expected ${str}")
+endif ()
+
+# Now check the profile against the app's two call sites.
+file(GLOB log_files "drheapprof.*.log")
+list(LENGTH log_files num_files)
+if (NOT num_files EQUAL 1)
+  message(FATAL_ERROR "expected one profile but found: ${log_files}")
+endif ()
+file(READ ${log_files} prof)
+file(REMOVE ${log_files})
+
+foreach (tomatch
+    "Site [0-9]+: 10 allocs, 10000 bytes, 0 frees, 0 bytes freed, peak 10000 bytes live, 10000 bytes live at exit\n    #0 +0x[0-9a-f]+ [^\n]*!make_kept\\+"
+    "Site [0-9]+: 100 allocs, 6400 bytes, 100 frees, 6400 bytes freed, peak 64 bytes live, 0 bytes live at exit, mean lifetime [0-9]+\n    #0 +0x[0-9a-f]+ [^\n]*!make_garbage\\+")
+  if (NOT "${prof}" MATCHES "${tomatch}")
+    message(FATAL_ERROR "profile ${prof} failed to match expected ${tomatch}")
+  endif ()
+endforeach ()
@@ -0,0 +1,72 @@
+/* **********************************************************
+ * Copyright (c) 2016 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Allocates from two call sites with known counts for the drheapprof test */
+
+#include "tools.h"
+#include <stdlib.h>
+
+#define NUM_GARBAGE 100
+#define GARBAGE_SIZE 64
+#define NUM_KEPT 10
+#define KEPT_SIZE 1000
+
+static char *kept[NUM_KEPT];
+
+NOINLINE char *
+make_garbage(void)
+{
+    char *p = (char *) malloc(GARBAGE_SIZE);
+    /* Touch it so the malloc is not a tail call */
+    p[0] = 1;
+    return p;
+}
+
+NOINLINE char *
+make_kept(void)
+{
+    char *p = (char *) malloc(KEPT_SIZE);
+    p[0] = 1;
+    return p;
+}
+
+int
+main(int argc, char **argv)
+{
+    int i;
+    for (i = 0; i < NUM_GARBAGE; i++)
+        free(make_garbage());
+    for (i = 0; i < NUM_KEPT; i++)
+        kept[i] = make_kept();
+    print("all done\n");
+    return 0;
+}
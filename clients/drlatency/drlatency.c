@@ -0,0 +1,726 @@
+/* ***************************************************************************
+ * Copyright (c) 2016 Google, Inc.  All rights reserved.
+ * ***************************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Function Latency Tool: drlatency
+ *
+ * Measures the time from entry to exit of selected functions and reports a
+ * histogram of the latencies of each.
+ *
+ * The runtime options for this client include:
+ *
+ * -funcs <pattern>    Measures the functions matching <pattern>, of the form
+ *                     [module!]function, where both parts may contain the
+ *                     wildcards * and ?.  The module defaults to *.  May be
+ *                     repeated.  At least one is required.
+ * -logdir <dir>       Sets log directory, which by default is "-".
+ *                     If set to "-", the tool prints to stderr.
+ * -verbose <N>        For debugging the tool itself.
+ *
+ * The histograms are also printed when the process is nudged.
+ */
+
+#include "dr_api.h"
+#include "drmgr.h"
+#include "drwrap.h"
+#include "drsyms.h"
+#include "drx.h"
+#include "hashtable.h"
+#include "drvector.h"
+#include "../common/utils.h"
+#include <string.h>
+#if defined(X86) && defined(WINDOWS)
+# include <intrin.h>
+#endif
+
+static uint verbose;
+
+#define NOTIFY(level, fmt, ...) do {          \
+    if (verbose >= (level))                   \
+        dr_fprintf(STDERR, fmt, __VA_ARGS__); \
+} while (0)
+
+#define OPTION_MAX_LENGTH MAXIMUM_PATH
+
+typedef struct _drlatency_options_t {
+    char logdir[MAXIMUM_PATH];
+    drvector_t patterns; /* of -funcs strings */
+} drlatency_options_t;
+
+static drlatency_options_t options;
+
+/* Where to write the histograms */
+static file_t outf;
+
+/* runtest.cmake assumes this is the prefix, so update both when changing it */
+#define STDERR_PREFIX "~~~~ "
+
+/* Latencies are kept in log-linear histograms: values below SUB_BUCKETS
+ * have a bucket each, and each higher power of two is split into
+ * SUB_BUCKETS buckets, so a bucket is within 1/SUB_BUCKETS of its values.
+ */
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define NUM_BUCKETS ((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+typedef struct _hist_t {
+    uint64 count;
+    uint64 sum;
+    uint64 max;
+    uint64 buckets[NUM_BUCKETS];
+} hist_t;
+
+/* Each measured function gets a func_info_t, built once at module load.
+ * func_infos are kept until exit, even after their module is unloaded, so
+ * their histograms can still be reported.
+ */
+typedef struct _func_info_t {
+    char *name;     /* "module!func" */
+    size_t name_size;
+    uint index;     /* into funcs, per_thread_t.hists, and totals */
+} func_info_t;
+
+/* funcs_lock protects updates to func_table, funcs, totals, and threads.
+ * func_table is also read without funcs_lock on each return, so it has its
+ * own reader-writer lock.
+ */
+#define FUNC_TABLE_BITS 8
+static void *funcs_lock;
+static hashtable_t func_table; /* maps function entry pc to its func_info_t */
+static drvector_t funcs;       /* all func_info_t, by index */
+static hist_t **totals;        /* histograms from exited threads, by index */
+static uint num_totals;
+static drvector_t threads;     /* per_thread_t of live threads, for nudges */
+
+typedef struct _per_thread_t {
+    /* this thread's histogram of each function, allocated on first call */
+    hist_t **hists;
+    uint num_hists;
+} per_thread_t;
+
+static int tls_idx;
+
+/* For converting timestamps to nanoseconds */
+static uint64 start_timestamp;
+static uint64 start_micros;
+
+/****************************************************************************
+ * Timing
+ */
+
+/* Returns the time stamp counter on x86, where it is cheap to read, and
+ * microseconds elsewhere.
+ */
+static inline uint64
+get_timestamp(void)
+{
+#ifdef X86
+# ifdef WINDOWS
+    return __rdtsc();
+# else
+    return __builtin_ia32_rdtsc();
+# endif
+#else
+    return dr_get_microseconds();
+#endif
+}
+
+/* Returns the number of timestamp units per microsecond measured since
+ * startup, or 0 if too little time has passed to tell.
+ */
+static uint64
+timestamps_per_micro(void)
+{
+#ifdef X86
+    uint64 micros = dr_get_microseconds() - start_micros;
+    if (micros == 0)
+        return 0;
+    return (get_timestamp() - start_timestamp) / micros;
+#else
+    return 1;
+#endif
+}
+
+static uint64
+timestamp_to_ns(uint64 value, uint64 per_micro)
+{
+    if (per_micro == 0)
+        return value;
+    return value * 1000 / per_micro;
+}
+
+/****************************************************************************
+ * Histograms
+ */
+
+static uint
+highest_bit(uint64 value)
+{
+    uint bit = 0;
+    if (value >> 32) { value >>= 32; bit += 32; }
+    if (value >> 16) { value >>= 16; bit += 16; }
+    if (value >> 8) { value >>= 8; bit += 8; }
+    if (value >> 4) { value >>= 4; bit += 4; }
+    if (value >> 2) { value >>= 2; bit += 2; }
+    if (value >> 1) { bit += 1; }
+    return bit;
+}
+
+static uint
+bucket_index(uint64 value)
+{
+    uint bit;
+    if (value < SUB_BUCKETS)
+        return (uint)value;
+    bit = highest_bit(value);
+    return ((bit - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) |
+        (uint)((value >> (bit - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/* Returns the smallest value in bucket index, for index up to NUM_BUCKETS-1 */
+static uint64
+bucket_start(uint index)
+{
+    uint bit;
+    if (index < SUB_BUCKETS)
+        return index;
+    bit = (index >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+    return ((uint64)(SUB_BUCKETS | (index & (SUB_BUCKETS - 1)))) <<
+        (bit - SUB_BUCKET_BITS);
+}
+
+static void
+hist_add(hist_t *dst, hist_t *src)
+{
+    uint i;
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->max > dst->max)
+        dst->max = src->max;
+    for (i = 0; i < NUM_BUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+}
+
+/* Returns the start of the bucket holding the given percentile */
+static uint64
+hist_percentile(hist_t *hist, uint percent)
+{
+    uint64 seen = 0, goal = (hist->count * percent + 99) / 100;
+    uint i;
+    for (i = 0; i < NUM_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= goal && seen > 0)
+            return bucket_start(i);
+    }
+    return hist->max;
+}
+
+static void
+hist_print(const char *name, hist_t *hist, uint64 per_micro)
+{
+    const char *prefix = (outf == STDERR ? STDERR_PREFIX : "");
+    uint i;
+    dr_fprintf(outf, "%s%s: "UINT64_FORMAT_STRING" calls, mean "UINT64_FORMAT_STRING
+               ", p50 "UINT64_FORMAT_STRING", p90 "UINT64_FORMAT_STRING
+               ", p99 "UINT64_FORMAT_STRING", max "UINT64_FORMAT_STRING"\n",
+               prefix, name, hist->count,
+               timestamp_to_ns(hist->sum / hist->count, per_micro),
+               timestamp_to_ns(hist_percentile(hist, 50), per_micro),
+               timestamp_to_ns(hist_percentile(hist, 90), per_micro),
+               timestamp_to_ns(hist_percentile(hist, 99), per_micro),
+               timestamp_to_ns(hist->max, per_micro));
+    for (i = 0; i < NUM_BUCKETS; i++) {
+        if (hist->buckets[i] == 0)
+            continue;
+        dr_fprintf(outf, "%s    "UINT64_FORMAT_STRING"..", prefix,
+                   timestamp_to_ns(bucket_start(i), per_micro));
+        if (i + 1 < NUM_BUCKETS) {
+            dr_fprintf(outf, UINT64_FORMAT_STRING,
+                       timestamp_to_ns(bucket_start(i + 1), per_micro));
+        }
+        dr_fprintf(outf, ": "UINT64_FORMAT_STRING"\n", hist->buckets[i]);
+    }
+}
+
+/* Resizes a histogram pointer array to hold index, doubling it to amortize
+ * the copies.
+ */
+static hist_t **
+hists_grow(void *drcontext, hist_t **hists, uint *num, uint index)
+{
+    uint new_num = (*num == 0 ? 16 : *num);
+    hist_t **new_hists;
+    while (new_num <= index)
+        new_num *= 2;
+    new_hists = drcontext == NULL ? dr_global_alloc(new_num * sizeof(hist_t *)) :
+        dr_thread_alloc(drcontext, new_num * sizeof(hist_t *));
+    memset(new_hists, 0, new_num * sizeof(hist_t *));
+    if (hists != NULL) {
+        memcpy(new_hists, hists, *num * sizeof(hist_t *));
+        if (drcontext == NULL)
+            dr_global_free(hists, *num * sizeof(hist_t *));
+        else
+            dr_thread_free(drcontext, hists, *num * sizeof(hist_t *));
+    }
+    *num = new_num;
+    return new_hists;
+}
+
+/* Prints the histogram of each function, summed over exited threads and,
+ * without synchronizing with them, live threads.
+ */
+static void
+hists_print(const char *title)
+{
+    uint64 per_micro = timestamps_per_micro();
+    hist_t *sum = dr_global_alloc(sizeof(*sum));
+    uint i, j;
+    dr_mutex_lock(funcs_lock);
+    dr_fprintf(outf, "%s%s: function latencies in %s\n",
+               (outf == STDERR ? STDERR_PREFIX : ""), title,
+               per_micro == 0 ? "timestamp units" : "nanoseconds");
+    for (i = 0; i < funcs.entries; i++) {
+        func_info_t *info = (func_info_t *) drvector_get_entry(&funcs, i);
+        memset(sum, 0, sizeof(*sum));
+        if (i < num_totals && totals[i] != NULL)
+            hist_add(sum, totals[i]);
+        for (j = 0; j < threads.entries; j++) {
+            per_thread_t *data = (per_thread_t *) drvector_get_entry(&threads, j);
+            if (i < data->num_hists && data->hists[i] != NULL)
+                hist_add(sum, data->hists[i]);
+        }
+        if (sum->count > 0)
+            hist_print(info->name, sum, per_micro);
+    }
+    dr_mutex_unlock(funcs_lock);
+    dr_global_free(sum, sizeof(*sum));
+}
+
+/****************************************************************************
+ * Function wrapping
+ */
+
+/* We pass the entry timestamp to func_post in user_data, which on 32-bit
+ * truncates it: the difference is still right for latencies below 2^32.
+ */
+static void
+func_pre(void *wrapcxt, INOUT void **user_data)
+{
+    *user_data = (void *)(ptr_uint_t) get_timestamp();
+}
+
+static void
+func_post(void *wrapcxt, void *user_data)
+{
+    uint64 latency = (ptr_uint_t)get_timestamp() - (ptr_uint_t)user_data;
+    void *drcontext;
+    per_thread_t *data;
+    func_info_t *info;
+    hist_t *hist;
+    if (wrapcxt == NULL)
+        return; /* abnormal exit such as a longjmp */
+    drcontext = drwrap_get_drcontext(wrapcxt);
+    data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    info = (func_info_t *) hashtable_lookup(&func_table, drwrap_get_func(wrapcxt));
+    if (info == NULL || data == NULL)
+        return;
+    if (info->index >= data->num_hists) {
+        data->hists = hists_grow(drcontext, data->hists, &data->num_hists,
+                                 info->index);
+    }
+    hist = data->hists[info->index];
+    if (hist == NULL) {
+        hist = dr_thread_alloc(drcontext, sizeof(*hist));
+        memset(hist, 0, sizeof(*hist));
+        data->hists[info->index] = hist;
+    }
+    hist->count++;
+    hist->sum += latency;
+    if (latency > hist->max)
+        hist->max = latency;
+    hist->buckets[bucket_index(latency)]++;
+}
+
+static void
+func_info_free(void *p)
+{
+    func_info_t *info = (func_info_t *) p;
+    dr_global_free(info->name, info->name_size);
+    dr_global_free(info, sizeof(*info));
+}
+
+/* Matches str against pattern with the wildcards * and ? */
+static bool
+wildcard_match(const char *pattern, const char *str, bool ignore_case)
+{
+    const char *star = NULL, *resume = NULL;
+    while (*str != '\0') {
+        char p = *pattern, s = *str;
+        if (ignore_case) {
+            if (p >= 'A' && p <= 'Z')
+                p += 'a' - 'A';
+            if (s >= 'A' && s <= 'Z')
+                s += 'a' - 'A';
+        }
+        if (p == '*') {
+            star = pattern++;
+            resume = str;
+        } else if (p == '?' || (p != '\0' && p == s)) {
+            pattern++;
+            str++;
+        } else if (star != NULL) {
+            pattern = star + 1;
+            str = ++resume;
+        } else
+            return false;
+    }
+    while (*pattern == '*')
+        pattern++;
+    return *pattern == '\0';
+}
+
+/* Wraps func unless it is already wrapped under an alias.  The caller must
+ * hold funcs_lock.
+ */
+static void
+func_wrap(app_pc func, const module_data_t *mod, const char *sym_name)
+{
+    const char *modname = dr_module_preferred_name(mod);
+    func_info_t *info;
+    if (hashtable_lookup(&func_table, (void *)func) != NULL)
+        return;
+    info = dr_global_alloc(sizeof(*info));
+    info->name_size = (modname == NULL ? 0 : strlen(modname) + 1) +
+        strlen(sym_name) + 1;
+    info->name = dr_global_alloc(info->name_size);
+    dr_snprintf(info->name, info->name_size, "%s%s%s",
+                modname == NULL ? "" : modname, modname == NULL ? "" : "!", sym_name);
+    info->name[info->name_size - 1] = '\0';
+    info->index = funcs.entries;
+    drvector_append(&funcs, info);
+    hashtable_add(&func_table, (void *)func, info);
+    if (!drwrap_wrap_ex(func, func_pre, func_post, NULL, 0))
+        NOTIFY(0, "drlatency: failed to wrap %s\n", info->name);
+    else
+        NOTIFY(1, "wrapping %s @"PFX"\n", info->name, func);
+}
+
+typedef struct _search_data_t {
+    const module_data_t *mod;
+    const char *func_pattern;
+} search_data_t;
+
+static bool
+search_symbols_cb(const char *name, size_t modoffs, void *data)
+{
+    search_data_t *search = (search_data_t *) data;
+    if (wildcard_match(search->func_pattern, name, false))
+        func_wrap(search->mod->start + modoffs, search->mod, name);
+    return true; /* keep iterating */
+}
+
+static void
+event_module_load(void *drcontext, const module_data_t *info, bool loaded)
+{
+    const char *modname = dr_module_preferred_name(info);
+    uint i;
+    if (info->full_path == NULL || info->full_path[0] == '\0')
+        return;
+    dr_mutex_lock(funcs_lock);
+    for (i = 0; i < options.patterns.entries; i++) {
+        const char *pattern = (const char *) drvector_get_entry(&options.patterns, i);
+        const char *bang = strchr(pattern, '!');
+        char mod_pattern[OPTION_MAX_LENGTH];
+        search_data_t search;
+        if (bang != NULL) {
+            size_t len = bang - pattern;
+            if (len >= BUFFER_SIZE_ELEMENTS(mod_pattern))
+                len = BUFFER_SIZE_ELEMENTS(mod_pattern) - 1;
+            memcpy(mod_pattern, pattern, len);
+            mod_pattern[len] = '\0';
+            if (modname == NULL ||
+                !wildcard_match(mod_pattern, modname, IF_WINDOWS_ELSE(true, false)))
+                continue;
+            pattern = bang + 1;
+        }
+        search.mod = info;
+        search.func_pattern = pattern;
+        if (strchr(pattern, '*') == NULL && strchr(pattern, '?') == NULL) {
+            /* A plain name is much cheaper to look up than to search for */
+            size_t modoffs;
+            if (drsym_lookup_symbol(info->full_path, pattern, &modoffs,
+                                    DRSYM_DEMANGLE) == DRSYM_SUCCESS && modoffs != 0)
+                func_wrap(info->start + modoffs, info, pattern);
+        } else {
+            drsym_enumerate_symbols(info->full_path, search_symbols_cb, &search,
+                                    DRSYM_DEMANGLE);
+        }
+    }
+    dr_mutex_unlock(funcs_lock);
+}
+
+static void
+event_module_unload(void *drcontext, const module_data_t *info)
+{
+    uint i;
+    dr_mutex_lock(funcs_lock);
+    /* The func_infos stay in funcs for reporting: we only unwrap */
+    hashtable_lock(&func_table);
+    for (i = 0; i < HASHTABLE_SIZE(func_table.table_bits); i++) {
+        hash_entry_t *he, *next;
+        for (he = func_table.table[i]; he != NULL; he = next) {
+            next = he->next;
+            if ((app_pc)he->key >= info->start && (app_pc)he->key < info->end) {
+                IF_DEBUG(bool ok =)
+                    drwrap_unwrap((app_pc)he->key, func_pre, func_post);
+                ASSERT(ok, "unwrap request failed");
+            }
+        }
+    }
+    hashtable_unlock(&func_table);
+    hashtable_remove_range(&func_table, info->start, info->end);
+    dr_mutex_unlock(funcs_lock);
+}
+
+/****************************************************************************
+ * Init and exit
+ */
+
+static void
+open_log_file(void)
+{
+    char buf[MAXIMUM_PATH];
+    if (strcmp(options.logdir, "-") == 0)
+        outf = STDERR;
+    else {
+        outf = drx_open_unique_appid_file(options.logdir, dr_get_process_id(),
+                                          "drlatency", "log",
+#ifndef WINDOWS
+                                          DR_FILE_CLOSE_ON_FORK |
+#endif
+                                          DR_FILE_ALLOW_LARGE,
+                                          buf, BUFFER_SIZE_ELEMENTS(buf));
+        ASSERT(outf != INVALID_FILE, "failed to open log file");
+        NOTIFY(1, "log file is %s\n", buf);
+    }
+}
+
+static void
+event_thread_init(void *drcontext)
+{
+    per_thread_t *data = dr_thread_alloc(drcontext, sizeof(*data));
+    data->hists = NULL;
+    data->num_hists = 0;
+    drmgr_set_tls_field(drcontext, tls_idx, data);
+    dr_mutex_lock(funcs_lock);
+    drvector_append(&threads, data);
+    dr_mutex_unlock(funcs_lock);
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    uint i;
+    dr_mutex_lock(funcs_lock);
+    for (i = 0; i < threads.entries; i++) {
+        if (drvector_get_entry(&threads, i) == data) {
+            /* Order does not matter: move the last one here */
+            drvector_set_entry(&threads, i,
+                               drvector_get_entry(&threads, threads.entries - 1));
+            threads.entries--;
+            break;
+        }
+    }
+    if (data->num_hists > num_totals)
+        totals = hists_grow(NULL, totals, &num_totals, data->num_hists - 1);
+    for (i = 0; i < data->num_hists; i++) {
+        if (data->hists[i] == NULL)
+            continue;
+        if (totals[i] == NULL) {
+            totals[i] = dr_global_alloc(sizeof(hist_t));
+            memset(totals[i], 0, sizeof(hist_t));
+        }
+        hist_add(totals[i], data->hists[i]);
+        dr_thread_free(drcontext, data->hists[i], sizeof(hist_t));
+    }
+    dr_mutex_unlock(funcs_lock);
+    if (data->hists != NULL)
+        dr_thread_free(drcontext, data->hists, data->num_hists * sizeof(hist_t *));
+    drmgr_set_tls_field(drcontext, tls_idx, NULL);
+    dr_thread_free(drcontext, data, sizeof(*data));
+}
+
+static void
+event_nudge(void *drcontext, uint64 argument)
+{
+    hists_print("Nudge");
+}
+
+#ifndef WINDOWS
+static void
+event_fork(void *drcontext)
+{
+    /* The old file was closed by DR b/c we passed DR_FILE_CLOSE_ON_FORK */
+    open_log_file();
+}
+#endif
+
+static void
+pattern_free(void *p)
+{
+    dr_global_free(p, strlen((char *)p) + 1);
+}
+
+static void
+event_exit(void)
+{
+    uint i;
+    hists_print("Exit");
+    if (outf != STDERR)
+        dr_close_file(outf);
+    hashtable_delete(&func_table);
+    drvector_delete(&funcs);
+    for (i = 0; i < num_totals; i++) {
+        if (totals[i] != NULL)
+            dr_global_free(totals[i], sizeof(hist_t));
+    }
+    if (totals != NULL)
+        dr_global_free(totals, num_totals * sizeof(hist_t *));
+    drvector_delete(&threads);
+    drvector_delete(&options.patterns);
+    dr_mutex_destroy(funcs_lock);
+    drmgr_unregister_tls_field(tls_idx);
+    drsym_exit();
+    drx_exit();
+    drwrap_exit();
+    drmgr_exit();
+}
+
+static void
+options_init(client_id_t id, int argc, const char *argv[])
+{
+    int i;
+    const char *token;
+    /* default values */
+    dr_snprintf(options.logdir, BUFFER_SIZE_ELEMENTS(options.logdir), "-");
+    drvector_init(&options.patterns, 8, false/*!synch*/, pattern_free);
+
+    for (i = 1/*skip client*/; i < argc; i++) {
+        token = argv[i];
+        if (strcmp(token, "-funcs") == 0) {
+            char *pattern;
+            USAGE_CHECK((i + 1) < argc, "missing -funcs pattern");
+            token = argv[++i];
+            pattern = dr_global_alloc(strlen(token) + 1);
+            strncpy(pattern, token, strlen(token) + 1);
+            drvector_append(&options.patterns, pattern);
+        }
+        else if (strcmp(token, "-logdir") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing logdir path");
+            strncpy(options.logdir, argv[++i], BUFFER_SIZE_ELEMENTS(options.logdir));
+            NULL_TERMINATE_BUFFER(options.logdir);
+        }
+        else if (strcmp(token, "-verbose") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -verbose number");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &verbose) != 1) {
+                USAGE_CHECK(false, "invalid -verbose number");
+            }
+        }
+        else {
+            NOTIFY(0, "UNRECOGNIZED OPTION: \"%s\"\n", token);
+            USAGE_CHECK(false, "invalid option");
+        }
+    }
+    USAGE_CHECK(options.patterns.entries > 0, "at least one -funcs is required");
+}
+
+DR_EXPORT void
+dr_client_main(client_id_t id, int argc, const char *argv[])
+{
+    hashtable_config_t config = {sizeof(config),};
+    IF_DEBUG(bool ok;)
+
+    dr_set_client_name("DrLatency", "http://dynamorio.org/issues");
+
+    options_init(id, argc, argv);
+
+    IF_DEBUG(ok = )
+        drmgr_init();
+    ASSERT(ok, "drmgr failed to initialize");
+    IF_DEBUG(ok = )
+        drwrap_init();
+    ASSERT(ok, "drwrap failed to initialize");
+    IF_DEBUG(ok = )
+        drx_init();
+    ASSERT(ok, "drx failed to initialize");
+    if (drsym_init(0) != DRSYM_SUCCESS)
+        ASSERT(false, "drsyms failed to initialize");
+
+    /* No-frills is safe b/c we're the only module doing wrapping, and
+     * we're only wrapping at module load and unwrapping at unload.
+     * Fast cleancalls is safe b/c we're only wrapping func entry and
+     * we don't care about the app context.
+     */
+    drwrap_set_global_flags(DRWRAP_NO_FRILLS | DRWRAP_FAST_CLEANCALLS);
+
+    funcs_lock = dr_mutex_create();
+    hashtable_init_ex(&func_table, FUNC_TABLE_BITS, HASH_INTPTR,
+                      false/*!strdup*/, true/*synch*/, NULL, NULL, NULL);
+    config.resizable = true;
+    config.resize_threshold = 75;
+    config.read_write_lock = true;
+    hashtable_configure(&func_table, &config);
+    drvector_init(&funcs, 64, false/*!synch*/, func_info_free);
+    drvector_init(&threads, 16, false/*!synch*/, NULL);
+    tls_idx = drmgr_register_tls_field();
+    ASSERT(tls_idx > -1, "unable to reserve TLS slot");
+
+    start_timestamp = get_timestamp();
+    start_micros = dr_get_microseconds();
+
+    dr_register_exit_event(event_exit);
+    drmgr_register_thread_init_event(event_thread_init);
+    drmgr_register_thread_exit_event(event_thread_exit);
+    dr_register_nudge_event(event_nudge, id);
+#ifdef UNIX
+    dr_register_fork_init_event(event_fork);
+#endif
+    drmgr_register_module_load_event(event_module_load);
+    drmgr_register_module_unload_event(event_module_unload);
+
+#ifdef WINDOWS
+    dr_enable_console_printing();
+#endif
+
+    open_log_file();
+}
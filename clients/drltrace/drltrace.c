@@ -43,6 +43,12 @@
  * -ignore_underscore  Ignores library routine names starting with "_".
  * -all_args <N>       Prints N arg values for every library call.
  *                     Set to 2 by default.
+ * -count_calls        Only counts the calls to each library routine and
+ *                     prints the totals at exit.
+ * -sample <N>         Only reports every Nth call to each library routine
+ *                     by each thread.
+ * -no_lazy_wrap       Wraps every export when its library is loaded, rather
+ *                     than when code at the export is first executed.
  * -verbose <N>        For debugging the tool itself.
  */
 
@@ -50,7 +56,10 @@
 #include "drmgr.h"
 #include "drwrap.h"
 #include "drx.h"
+#include "hashtable.h"
+#include "drvector.h"
 #include "../common/utils.h"
+#include <stdarg.h>
 #include <string.h>
 
 /* XXX i#1349: features to add:
@@ -87,6 +96,9 @@ typedef struct _drltrace_options_t {
     bool ignore_underscore;
     char only_to_lib[MAXIMUM_PATH];
     uint all_args;
+    bool count_calls;
+    uint sample;
+    bool lazy_wrap;
 } drltrace_options_t;
 
 static drltrace_options_t options;
@@ -100,6 +112,161 @@ static app_pc exe_start;
 /* runtest.cmake assumes this is the prefix, so update both when changing it */
 #define STDERR_PREFIX "~~~~ "
 
+/* Each traced function gets a func_info_t, built once at module load and passed
+ * to lib_entry() as its user_data.  func_infos are kept until exit, even after
+ * their module is unloaded, so their call counts can still be reported.
+ *
+ * With -lazy_wrap (the default), an export is only recorded in func_table at
+ * module load, and is wrapped when the first block containing its entry is
+ * built.  Libraries like libc have thousands of exports of which an app
+ * typically calls a few dozen, so this avoids most of the drwrap entries.
+ */
+typedef struct _func_info_t {
+    char *name;     /* "module!func" */
+    size_t name_size;
+    uint index;     /* into funcs, per_thread_t.counts, and totals */
+    bool wrapped;   /* written under funcs_lock */
+} func_info_t;
+
+/* funcs_lock protects updates to func_table, funcs, and totals.
+ * func_table is also read without funcs_lock during block building, so it
+ * has its own reader-writer lock.
+ */
+#define FUNC_TABLE_BITS 12
+static void *funcs_lock;
+static hashtable_t func_table; /* maps export entry pc to its func_info_t */
+static drvector_t funcs;       /* all func_info_t, by index */
+static uint64 *totals;         /* call counts from exited threads, by index */
+static uint num_totals;
+
+/* When writing to a file, each thread buffers its trace lines and writes them
+ * out in large chunks rather than issuing a write per library call.
+ */
+#define TRACE_LINE_MAX 1024
+#define TRACE_BUF_SIZE (64*1024)
+
+typedef struct _per_thread_t {
+    /* for -count_calls and -sample: this thread's calls to each function */
+    uint64 *counts;
+    uint num_counts;
+    size_t used;
+    char buf[TRACE_BUF_SIZE];
+} per_thread_t;
+
+static int tls_idx;
+
+/****************************************************************************
+ * Trace output
+ */
+
+static void
+trace_flush(per_thread_t *data)
+{
+    if (data->used > 0)
+        dr_write_file(outf, data->buf, data->used);
+    data->used = 0;
+}
+
+static void
+trace_write(void *drcontext, const char *line, size_t len)
+{
+    per_thread_t *data = NULL;
+    /* We do not delay stderr output, which the user is likely watching */
+    if (outf != STDERR)
+        data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    if (data == NULL) {
+        dr_write_file(outf, line, len);
+        return;
+    }
+    if (data->used + len > TRACE_BUF_SIZE)
+        trace_flush(data);
+    memcpy(data->buf + data->used, line, len);
+    data->used += len;
+}
+
+/* Appends to a trace line of TRACE_LINE_MAX chars, truncating if it is full */
+static void
+line_append(char *line, size_t *len, const char *fmt, ...)
+{
+    va_list ap;
+    int res;
+    va_start(ap, fmt);
+    res = dr_vsnprintf(line + *len, TRACE_LINE_MAX - *len, fmt, ap);
+    va_end(ap);
+    if (res < 0 || (size_t)res >= TRACE_LINE_MAX - *len)
+        *len = TRACE_LINE_MAX;
+    else
+        *len += res;
+}
+
+/****************************************************************************
+ * Call counts
+ */
+
+/* Resizes a count array to hold index, doubling it to amortize the copies */
+static uint64 *
+counts_grow(void *drcontext, uint64 *counts, uint *num, uint index)
+{
+    uint new_num = (*num == 0 ? 64 : *num);
+    uint64 *new_counts;
+    while (new_num <= index)
+        new_num *= 2;
+    new_counts = drcontext == NULL ? dr_global_alloc(new_num * sizeof(uint64)) :
+        dr_thread_alloc(drcontext, new_num * sizeof(uint64));
+    memset(new_counts, 0, new_num * sizeof(uint64));
+    if (counts != NULL) {
+        memcpy(new_counts, counts, *num * sizeof(uint64));
+        if (drcontext == NULL)
+            dr_global_free(counts, *num * sizeof(uint64));
+        else
+            dr_thread_free(drcontext, counts, *num * sizeof(uint64));
+    }
+    *num = new_num;
+    return new_counts;
+}
+
+/* Returns this thread's call count of func, including this call */
+static uint64
+count_call(void *drcontext, func_info_t *info)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    if (info->index >= data->num_counts) {
+        data->counts = counts_grow(drcontext, data->counts, &data->num_counts,
+                                   info->index);
+    }
+    return ++data->counts[info->index];
+}
+
+static void
+counts_thread_exit(void *drcontext, per_thread_t *data)
+{
+    uint i;
+    if (data->counts == NULL)
+        return;
+    dr_mutex_lock(funcs_lock);
+    if (data->num_counts > num_totals)
+        totals = counts_grow(NULL, totals, &num_totals, data->num_counts - 1);
+    for (i = 0; i < data->num_counts; i++)
+        totals[i] += data->counts[i];
+    dr_mutex_unlock(funcs_lock);
+    dr_thread_free(drcontext, data->counts, data->num_counts * sizeof(uint64));
+    data->counts = NULL;
+    data->num_counts = 0;
+}
+
+static void
+counts_print(void)
+{
+    uint i;
+    for (i = 0; i < num_totals && i < funcs.entries; i++) {
+        func_info_t *info = (func_info_t *) drvector_get_entry(&funcs, i);
+        if (totals[i] > 0) {
+            dr_fprintf(outf, "%s%s: "UINT64_FORMAT_STRING" calls\n",
+                       (outf == STDERR ? STDERR_PREFIX : ""), info->name, totals[i]);
+        }
+    }
+}
+
 /****************************************************************************
  * Library entry wrapping
  */
@@ -107,24 +274,25 @@ static app_pc exe_start;
 static void
 lib_entry(void *wrapcxt, INOUT void **user_data)
 {
-    const char *name = (const char *) *user_data;
-    const char *modname = NULL;
-    app_pc func = drwrap_get_func(wrapcxt);
-    module_data_t *mod;
+    func_info_t *info = (func_info_t *) *user_data;
+    void *drcontext = drwrap_get_drcontext(wrapcxt);
+    char line[TRACE_LINE_MAX];
+    size_t len = 0;
+    const module_data_t *mod;
     if (options.only_from_app) {
         /* For just this option, the modxfer approach might be better */
         app_pc retaddr =  NULL;
-        void *drcontext = drwrap_get_drcontext(wrapcxt);
         DR_TRY_EXCEPT(drcontext, {
             retaddr = drwrap_get_retaddr(wrapcxt);
         }, { /* EXCEPT */
             retaddr = NULL;
         });
         if (retaddr != NULL) {
-            mod = dr_lookup_module(retaddr);
+            /* This is on every call, so use the cached lookup */
+            mod = dr_lookup_module_ex(retaddr);
             if (mod != NULL) {
                 bool from_exe = (mod->start == exe_start);
-                dr_free_module_data(mod);
+                dr_release_module_data(mod);
                 if (!from_exe)
                     return;
             }
@@ -137,33 +305,75 @@ lib_entry(void *wrapcxt, INOUT void **user_data)
             return;
         }
     }
-    /* XXX: it may be better to heap-allocate the "module!func" string and
-     * pass in, to avoid this lookup.
-     */
-    mod = dr_lookup_module(func);
-    if (mod != NULL)
-        modname = dr_module_preferred_name(mod);
-    dr_fprintf(outf, "%s%s%s%s", (outf == STDERR ? STDERR_PREFIX : ""),
-               modname == NULL ? "" : modname,
-               modname == NULL ? "" : "!", name);
+    if (options.count_calls || options.sample > 1) {
+        uint64 count = count_call(drcontext, info);
+        if (options.count_calls || (count - 1) % options.sample != 0)
+            return;
+    }
+    line_append(line, &len, "%s%s", (outf == STDERR ? STDERR_PREFIX : ""),
+                info->name);
     if (options.all_args > 0) {
         uint i;
-        void *drcontext = drwrap_get_drcontext(wrapcxt);
-        dr_fprintf(outf, "(");
+        line_append(line, &len, "(");
         DR_TRY_EXCEPT(drcontext, {
             for (i = 0; i < options.all_args; i++) {
-                dr_fprintf(outf, "%s"PFX, (i != 0) ? ", " : "",
-                           drwrap_get_arg(wrapcxt, i));
+                line_append(line, &len, "%s"PFX, (i != 0) ? ", " : "",
+                            drwrap_get_arg(wrapcxt, i));
             }
         }, {
-            dr_fprintf(outf, "<invalid memory>");
+            line_append(line, &len, "<invalid memory>");
             /* Just keep going */
         });
-        dr_fprintf(outf, ")");
+        line_append(line, &len, ")");
     }
-    dr_fprintf(outf, "\n");
-    if (mod != NULL)
-        dr_free_module_data(mod);
+    /* Keep the newline even if the line was truncated */
+    if (len >= TRACE_LINE_MAX)
+        len = TRACE_LINE_MAX - 1;
+    line[len++] = '\n';
+    trace_write(drcontext, line, len);
+}
+
+static void
+func_info_free(void *p)
+{
+    func_info_t *info = (func_info_t *) p;
+    dr_global_free(info->name, info->name_size);
+    dr_global_free(info, sizeof(*info));
+}
+
+/* Returns a new func_info_t for func, or NULL if func already has one: i.e.,
+ * it was already seen under an alias.  The caller must hold funcs_lock.
+ */
+static func_info_t *
+func_info_create(app_pc func, const module_data_t *mod, const char *sym_name)
+{
+    const char *modname = dr_module_preferred_name(mod);
+    func_info_t *info;
+    if (hashtable_lookup(&func_table, (void *)func) != NULL)
+        return NULL;
+    info = dr_global_alloc(sizeof(*info));
+    info->name_size = (modname == NULL ? 0 : strlen(modname) + 1) +
+        strlen(sym_name) + 1;
+    info->name = dr_global_alloc(info->name_size);
+    dr_snprintf(info->name, info->name_size, "%s%s%s",
+                modname == NULL ? "" : modname, modname == NULL ? "" : "!", sym_name);
+    info->name[info->name_size - 1] = '\0';
+    info->index = funcs.entries;
+    info->wrapped = false;
+    drvector_append(&funcs, info);
+    hashtable_add(&func_table, (void *)func, info);
+    return info;
+}
+
+/* The caller must hold funcs_lock */
+static void
+func_wrap(app_pc func, func_info_t *info)
+{
+    IF_DEBUG(bool ok =)
+        drwrap_wrap_ex(func, lib_entry, NULL, (void *) info, 0);
+    ASSERT(ok, "wrap request failed");
+    info->wrapped = true;
+    NOTIFY(2, "wrapping export %s @"PFX"\n", info->name, func);
 }
 
 static void
@@ -171,6 +381,10 @@ iterate_exports(const module_data_t *info, bool add)
 {
     dr_symbol_export_iterator_t *exp_iter =
         dr_symbol_export_iterator_start(info->handle);
+    /* Flush any exports already in the cache once for the whole module */
+    if (add)
+        drwrap_begin_batch();
+    dr_mutex_lock(funcs_lock);
     while (dr_symbol_export_iterator_hasnext(exp_iter)) {
         dr_symbol_export_t *sym = dr_symbol_export_iterator_next(exp_iter);
         app_pc func = NULL;
@@ -194,21 +408,62 @@ iterate_exports(const module_data_t *info, bool add)
             func = NULL;
         if (func != NULL) {
             if (add) {
-                IF_DEBUG(bool ok =)
-                    drwrap_wrap_ex(func, lib_entry, NULL, (void *) sym->name, 0);
-                ASSERT(ok, "wrap request failed");
-                NOTIFY(2, "wrapping export %s!%s @"PFX"\n",
-                       dr_module_preferred_name(info), sym->name, func);
+                func_info_t *func_info = func_info_create(func, info, sym->name);
+                if (func_info != NULL && !options.lazy_wrap)
+                    func_wrap(func, func_info);
             } else {
-                IF_DEBUG(bool ok =)
-                    drwrap_unwrap(func, lib_entry, NULL);
-                ASSERT(ok, "unwrap request failed");
+                func_info_t *func_info = (func_info_t *)
+                    hashtable_lookup(&func_table, (void *)func);
+                if (func_info != NULL) {
+                    if (func_info->wrapped) {
+                        IF_DEBUG(bool ok =)
+                            drwrap_unwrap(func, lib_entry, NULL);
+                        ASSERT(ok, "unwrap request failed");
+                        func_info->wrapped = false;
+                    }
+                    hashtable_remove(&func_table, (void *)func);
+                }
             }
         }
     }
+    dr_mutex_unlock(funcs_lock);
+    if (add)
+        drwrap_end_batch();
     dr_symbol_export_iterator_stop(exp_iter);
 }
 
+/* For -lazy_wrap: wraps any not-yet-wrapped export whose entry is in this
+ * block.  We check every instruction rather than just the block start as
+ * DR may have elided a call into the middle of the block.  This runs
+ * before drwrap's own instrumentation, which thus sees the new wrap, and
+ * as this is the first build of this code no flush is needed.
+ */
+static dr_emit_flags_t
+event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
+                 bool for_trace, bool translating)
+{
+    instr_t *instr;
+    for (instr = instrlist_first_app(bb); instr != NULL;
+         instr = instr_get_next_app(instr)) {
+        app_pc pc = instr_get_app_pc(instr);
+        func_info_t *info;
+        if (pc == NULL)
+            continue;
+        info = (func_info_t *) hashtable_lookup(&func_table, (void *)pc);
+        if (info != NULL && !info->wrapped) {
+            dr_mutex_lock(funcs_lock);
+            /* Re-check as another thread may have raced us, or the module
+             * may have been unloaded.
+             */
+            info = (func_info_t *) hashtable_lookup(&func_table, (void *)pc);
+            if (info != NULL && !info->wrapped)
+                func_wrap(pc, info);
+            dr_mutex_unlock(funcs_lock);
+        }
+    }
+    return DR_EMIT_DEFAULT;
+}
+
 static bool
 library_matches_filter(const module_data_t *info)
 {
@@ -256,10 +511,39 @@ open_log_file(void)
     }
 }
 
+static void
+event_thread_init(void *drcontext)
+{
+    per_thread_t *data = dr_thread_alloc(drcontext, sizeof(*data));
+    data->counts = NULL;
+    data->num_counts = 0;
+    data->used = 0;
+    drmgr_set_tls_field(drcontext, tls_idx, data);
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    trace_flush(data);
+    counts_thread_exit(drcontext, data);
+    drmgr_set_tls_field(drcontext, tls_idx, NULL);
+    dr_thread_free(drcontext, data, sizeof(*data));
+}
+
 #ifndef WINDOWS
 static void
 event_fork(void *drcontext)
 {
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    /* The parent reports what was buffered or counted before the fork */
+    if (data != NULL) {
+        data->used = 0;
+        if (data->counts != NULL)
+            memset(data->counts, 0, data->num_counts * sizeof(uint64));
+    }
+    if (totals != NULL)
+        memset(totals, 0, num_totals * sizeof(uint64));
     /* The old file was closed by DR b/c we passed DR_FILE_CLOSE_ON_FORK */
     open_log_file();
 }
@@ -268,8 +552,16 @@ event_fork(void *drcontext)
 static void
 event_exit(void)
 {
+    if (options.count_calls)
+        counts_print();
     if (outf != STDERR)
         dr_close_file(outf);
+    hashtable_delete(&func_table);
+    drvector_delete(&funcs);
+    if (totals != NULL)
+        dr_global_free(totals, num_totals * sizeof(uint64));
+    dr_mutex_destroy(funcs_lock);
+    drmgr_unregister_tls_field(tls_idx);
     drx_exit();
     drwrap_exit();
     drmgr_exit();
@@ -285,6 +577,8 @@ options_init(client_id_t id)
     /* default values */
     dr_snprintf(options.logdir, BUFFER_SIZE_ELEMENTS(options.logdir), "-");
     options.all_args = 2;
+    options.sample = 1;
+    options.lazy_wrap = true;
 
     for (s = dr_get_token(opstr, token, BUFFER_SIZE_ELEMENTS(token));
          s != NULL;
@@ -308,6 +602,17 @@ options_init(client_id_t id)
                 int res = dr_sscanf(token, "%u", &options.all_args);
                 USAGE_CHECK(res == 1, "invalid -all_args number");
             }
+        } else if (strcmp(token, "-count_calls") == 0) {
+            options.count_calls = true;
+        } else if (strcmp(token, "-no_lazy_wrap") == 0) {
+            options.lazy_wrap = false;
+        } else if (strcmp(token, "-sample") == 0) {
+            s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token));
+            USAGE_CHECK(s != NULL, "missing -sample number");
+            if (s != NULL) {
+                int res = dr_sscanf(token, "%u", &options.sample);
+                USAGE_CHECK(res == 1 && options.sample > 0, "invalid -sample number");
+            }
         } else if (strcmp(token, "-verbose") == 0) {
             s = dr_get_token(s, token, BUFFER_SIZE_ELEMENTS(token));
             USAGE_CHECK(s != NULL, "missing -verbose number");
@@ -326,6 +631,7 @@ DR_EXPORT void
 dr_init(client_id_t id)
 {
     module_data_t *exe;
+    hashtable_config_t config = {sizeof(config),};
     IF_DEBUG(bool ok;)
 
     dr_set_client_name("DrLTrace", "http://dynamorio.org/issues");
@@ -348,18 +654,34 @@ dr_init(client_id_t id)
     dr_free_module_data(exe);
 
     /* No-frills is safe b/c we're the only module doing wrapping, and
-     * we're only wrapping at module load and unwrapping at unload.
+     * we're only wrapping at module load or first execution (each
+     * under funcs_lock) and unwrapping at unload.
      * Fast cleancalls is safe b/c we're only wrapping func entry and
      * we don't care about the app context.
      */
     drwrap_set_global_flags(DRWRAP_NO_FRILLS | DRWRAP_FAST_CLEANCALLS);
 
+    funcs_lock = dr_mutex_create();
+    hashtable_init_ex(&func_table, FUNC_TABLE_BITS, HASH_INTPTR,
+                      false/*!strdup*/, true/*synch*/, NULL, NULL, NULL);
+    config.resizable = true;
+    config.resize_threshold = 75;
+    config.read_write_lock = true;
+    hashtable_configure(&func_table, &config);
+    drvector_init(&funcs, 1024, false/*!synch*/, func_info_free);
+    tls_idx = drmgr_register_tls_field();
+    ASSERT(tls_idx > -1, "unable to reserve TLS slot");
+
     dr_register_exit_event(event_exit);
+    drmgr_register_thread_init_event(event_thread_init);
+    drmgr_register_thread_exit_event(event_thread_exit);
 #ifdef UNIX
     dr_register_fork_init_event(event_fork);
 #endif
     drmgr_register_module_load_event(event_module_load);
     drmgr_register_module_unload_event(event_module_unload);
+    if (options.lazy_wrap)
+        drmgr_register_bb_app2app_event(event_bb_app2app, NULL);
 
 #ifdef WINDOWS
     dr_enable_console_printing();
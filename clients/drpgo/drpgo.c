@@ -0,0 +1,1086 @@
+/* ***************************************************************************
+ * Copyright (c) 2016 Google, Inc.  All rights reserved.
+ * ***************************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Edge Profiling Tool: drpgo
+ *
+ * Counts the executions of every basic block and the taken executions of
+ * every conditional branch with inline counters, and records the targets of
+ * indirect calls.  At exit the counts are mapped to source lines with drsyms
+ * and written out as a text sample profile for the compiler's sample-based
+ * (AutoFDO) feedback-directed optimization, along with a list of the branch
+ * edges by module offset.
+ *
+ * The runtime options for this client include:
+ *
+ * -logdir <dir>        Sets the directory for the output files, which by
+ *                      default is the current directory.
+ * -module <name>       Profiles the library whose name contains <name>
+ *                      rather than the application executable.
+ * -max_counters <N>    Sets the number of counters, each block taking one
+ *                      plus one for a final conditional branch.  Blocks past
+ *                      the limit are not counted.  The default is 65536.
+ * -verbose <N>         For debugging the tool itself.
+ */
+
+#include "dr_api.h"
+#include "drmgr.h"
+#include "drx.h"
+#include "drsyms.h"
+#include "hashtable.h"
+#include "drvector.h"
+#include "../common/modules.h"
+#include "../common/utils.h"
+#include "limits.h"
+#include <string.h>
+
+static uint verbose;
+
+#define NOTIFY(level, fmt, ...) do {          \
+    if (verbose >= (level))                   \
+        dr_fprintf(STDERR, fmt, __VA_ARGS__); \
+} while (0)
+
+#define MINSERT instrlist_meta_preinsert
+
+#define DEFAULT_MAX_COUNTERS (64*1024)
+
+typedef struct _drpgo_options_t {
+    char logdir[MAXIMUM_PATH];
+    char module[MAXIMUM_PATH];
+    uint max_counters;
+} drpgo_options_t;
+
+static drpgo_options_t options;
+
+static app_pc exe_start;
+static module_table_t *module_table;
+
+/* The kind of a block's final instruction: beyond the block's own count we
+ * only profile conditional branches and calls, which always end a block as
+ * we do not support -opt_speed's elision.
+ */
+enum {
+    EXIT_OTHER,
+    EXIT_CBR,
+    EXIT_CALL,
+    EXIT_ICALL,
+};
+
+/* Each unique block, identified by its start pc, module entry and size, gets
+ * a block_t with inline counters for its executions and, if it ends in a
+ * conditional branch, for the branch's taken executions.  The counters are
+ * sharded per thread.  block_table maps a start pc to its chain of block_t,
+ * which is cut at module unload so that a new module at the same address
+ * gets new blocks; blocks holds them all until exit.
+ */
+typedef struct _block_t {
+    int mod_id;
+    uint start;             /* offset from the module base */
+    ushort size;
+    ushort num_instrs;
+    byte *lengths;          /* of each instruction */
+    int count_slot;         /* into counters, or -1 if they ran out */
+    int taken_slot;         /* for an EXIT_CBR counted inline, else -1 */
+    uint64 slow_taken;      /* for an EXIT_CBR counted in a clean call */
+    byte exit_kind;
+    int target_mod;         /* for EXIT_CBR and EXIT_CALL: -1 if unknown */
+    uint target;            /* offset from the target module's base */
+    struct _block_t *next;  /* with the same start pc */
+} block_t;
+
+#define BLOCK_TABLE_BITS 12
+static hashtable_t block_table;
+static drvector_t blocks;
+static drx_sharded_counter_t *counters;
+static uint num_slots;
+/* protects slow_taken */
+static void *slow_lock;
+
+/* Each indirect call instruction gets an icall_site_t recording the targets
+ * it reached, which are counted in a clean call under icall_lock.
+ * icall_table maps the instruction's pc to its site.
+ */
+typedef struct _call_target_t {
+    int mod_id;
+    uint offs;
+    uint64 count;
+} call_target_t;
+
+typedef struct _icall_site_t {
+    int mod_id;
+    uint offs;
+    call_target_t *targets;
+    uint num_targets;
+    uint capacity;
+} icall_site_t;
+
+#define ICALL_TABLE_BITS 8
+static void *icall_lock;
+static hashtable_t icall_table;
+static drvector_t icall_sites;
+
+/****************************************************************************
+ * Arrays
+ */
+
+/* Returns array, or a larger copy of it, with room for element num */
+static void *
+array_reserve(void *array, uint num, uint *capacity, size_t elem_size)
+{
+    void *bigger;
+    uint new_capacity;
+    if (num < *capacity)
+        return array;
+    new_capacity = (*capacity == 0 ? 16 : *capacity * 2);
+    bigger = dr_global_alloc(new_capacity * elem_size);
+    if (array != NULL) {
+        memcpy(bigger, array, num * elem_size);
+        dr_global_free(array, *capacity * elem_size);
+    }
+    *capacity = new_capacity;
+    return bigger;
+}
+
+static void
+array_free(void *array, uint capacity, size_t elem_size)
+{
+    if (array != NULL)
+        dr_global_free(array, capacity * elem_size);
+}
+
+static void
+elem_swap(byte *a, byte *b, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i++) {
+        byte tmp = a[i];
+        a[i] = b[i];
+        b[i] = tmp;
+    }
+}
+
+static void
+heap_sift_down(byte *base, uint root, uint num, size_t size,
+               int (*cmp)(const void *, const void *))
+{
+    while (2 * root + 1 < num) {
+        uint child = 2 * root + 1;
+        if (child + 1 < num && cmp(base + child * size, base + (child + 1) * size) < 0)
+            child++;
+        if (cmp(base + root * size, base + child * size) >= 0)
+            return;
+        elem_swap(base + root * size, base + child * size, size);
+        root = child;
+    }
+}
+
+/* A heapsort, as we do not link with libc for its qsort */
+static void
+array_sort(void *array, uint num, size_t size, int (*cmp)(const void *, const void *))
+{
+    byte *base = (byte *) array;
+    uint i;
+    if (num < 2)
+        return;
+    for (i = num / 2; i > 0; i--)
+        heap_sift_down(base, i - 1, num, size, cmp);
+    for (i = num - 1; i > 0; i--) {
+        elem_swap(base, base + i * size, size);
+        heap_sift_down(base, 0, i, size, cmp);
+    }
+}
+
+static char *
+string_dup(const char *str)
+{
+    size_t size = strlen(str) + 1;
+    char *dup = dr_global_alloc(size);
+    memcpy(dup, str, size);
+    return dup;
+}
+
+static void
+string_free(char *str)
+{
+    if (str != NULL)
+        dr_global_free(str, strlen(str) + 1);
+}
+
+/****************************************************************************
+ * Counting
+ */
+
+static bool
+module_is_profiled(const module_data_t *mod)
+{
+    if (options.module[0] != '\0') {
+        const char *name = dr_module_preferred_name(mod);
+        return (name != NULL && strstr(name, options.module) != NULL);
+    }
+    return mod->start == exe_start;
+}
+
+static int
+counter_slot_alloc(void)
+{
+    static bool warned;
+    if (num_slots < options.max_counters)
+        return (int)num_slots++;
+    if (!warned) {
+        warned = true;
+        NOTIFY(0, "drpgo: -max_counters %u reached: further blocks are not counted\n",
+               options.max_counters);
+    }
+    return -1;
+}
+
+static bool
+cbr_has_inline_count(instr_t *instr)
+{
+    int opcode = instr_get_opcode(instr);
+    /* jecxz and the loops have no setcc twin and are rare enough for a
+     * clean call.
+     */
+    return ((opcode >= OP_jo && opcode <= OP_jnle) ||
+            (opcode >= OP_jo_short && opcode <= OP_jnle_short));
+}
+
+static void
+block_free(void *p)
+{
+    block_t *block = (block_t *) p;
+    dr_global_free(block->lengths, block->num_instrs * sizeof(byte));
+    dr_global_free(block, sizeof(*block));
+}
+
+/* Returns the block_t for bb, creating it on first sight, or NULL if bb is
+ * not in a profiled module.
+ */
+static block_t *
+block_lookup_or_add(void *drcontext, void *tag, instrlist_t *bb, bool translating)
+{
+    app_pc start = dr_fragment_app_pc(tag);
+    app_pc end = start;
+    module_entry_t *mod_entry =
+        module_table_lookup(NULL, 0, module_table, start);
+    instr_t *instr, *last = NULL;
+    block_t *block;
+    uint num_instrs = 0, i;
+
+    if (mod_entry == NULL || mod_entry->data == NULL ||
+        !module_is_profiled(mod_entry->data))
+        return NULL;
+    for (instr = instrlist_first_app(bb); instr != NULL;
+         instr = instr_get_next_app(instr)) {
+        app_pc pc = instr_get_app_pc(instr);
+        /* -opt_speed (elision) is not supported */
+        ASSERT(pc == end, "-opt_speed is not supported");
+        end = pc + instr_length(drcontext, instr);
+        last = instr;
+        num_instrs++;
+    }
+    if (last == NULL || end - start >= USHRT_MAX || num_instrs >= USHRT_MAX)
+        return NULL;
+
+    hashtable_lock(&block_table);
+    for (block = (block_t *) hashtable_lookup(&block_table, start); block != NULL;
+         block = block->next) {
+        if (block->mod_id == mod_entry->id && block->size == (ushort)(end - start))
+            break;
+    }
+    if (block == NULL && !translating) {
+        block = dr_global_alloc(sizeof(*block));
+        block->mod_id = mod_entry->id;
+        block->start = (uint)(start - mod_entry->data->start);
+        block->size = (ushort)(end - start);
+        block->num_instrs = (ushort)num_instrs;
+        block->lengths = dr_global_alloc(num_instrs * sizeof(byte));
+        for (instr = instrlist_first_app(bb), i = 0; instr != NULL;
+             instr = instr_get_next_app(instr), i++)
+            block->lengths[i] = (byte)instr_length(drcontext, instr);
+        block->count_slot = counter_slot_alloc();
+        block->taken_slot = -1;
+        block->slow_taken = 0;
+        block->exit_kind = EXIT_OTHER;
+        block->target_mod = -1;
+        block->target = 0;
+        if (instr_is_cbr(last) || instr_is_call_direct(last)) {
+            app_pc target = opnd_get_pc(instr_get_target(last));
+            module_entry_t *target_entry =
+                module_table_lookup(NULL, 0, module_table, target);
+            if (target_entry != NULL && target_entry->data != NULL) {
+                block->target_mod = target_entry->id;
+                block->target = (uint)(target - target_entry->data->start);
+            }
+            block->exit_kind = instr_is_cbr(last) ? EXIT_CBR : EXIT_CALL;
+            if (block->exit_kind == EXIT_CBR && block->count_slot >= 0 &&
+                cbr_has_inline_count(last))
+                block->taken_slot = counter_slot_alloc();
+        } else if (instr_is_call_indirect(last))
+            block->exit_kind = EXIT_ICALL;
+        block->next = (block_t *) hashtable_lookup(&block_table, start);
+        hashtable_add_replace(&block_table, start, block);
+        drvector_append(&blocks, block);
+    }
+    hashtable_unlock(&block_table);
+
+    if (block != NULL && block->exit_kind == EXIT_ICALL && !translating) {
+        app_pc pc = instr_get_app_pc(last);
+        dr_mutex_lock(icall_lock);
+        if (hashtable_lookup(&icall_table, pc) == NULL) {
+            icall_site_t *site = dr_global_alloc(sizeof(*site));
+            site->mod_id = mod_entry->id;
+            site->offs = (uint)(pc - mod_entry->data->start);
+            site->targets = NULL;
+            site->num_targets = 0;
+            site->capacity = 0;
+            hashtable_add(&icall_table, pc, site);
+            drvector_append(&icall_sites, site);
+        }
+        dr_mutex_unlock(icall_lock);
+    }
+    return block;
+}
+
+static void
+icall_site_free(void *p)
+{
+    icall_site_t *site = (icall_site_t *) p;
+    array_free(site->targets, site->capacity, sizeof(call_target_t));
+    dr_global_free(site, sizeof(*site));
+}
+
+static void
+at_icall(app_pc instr_addr, app_pc target_addr)
+{
+    module_entry_t *target_entry =
+        module_table_lookup(NULL, 0, module_table, target_addr);
+    icall_site_t *site;
+    int mod_id = -1;
+    uint offs = 0, i;
+    if (target_entry != NULL && target_entry->data != NULL) {
+        mod_id = target_entry->id;
+        offs = (uint)(target_addr - target_entry->data->start);
+    }
+    dr_mutex_lock(icall_lock);
+    site = (icall_site_t *) hashtable_lookup(&icall_table, instr_addr);
+    if (site != NULL) {
+        for (i = 0; i < site->num_targets; i++) {
+            if (site->targets[i].mod_id == mod_id && site->targets[i].offs == offs)
+                break;
+        }
+        if (i == site->num_targets) {
+            site->targets = array_reserve(site->targets, i, &site->capacity,
+                                          sizeof(call_target_t));
+            site->targets[i].mod_id = mod_id;
+            site->targets[i].offs = offs;
+            site->targets[i].count = 0;
+            site->num_targets++;
+        }
+        site->targets[i].count++;
+    }
+    dr_mutex_unlock(icall_lock);
+}
+
+static void
+at_slow_cbr(app_pc inst_addr, app_pc targ_addr, app_pc fall_addr, int taken,
+            void *user_data)
+{
+    if (taken) {
+        dr_mutex_lock(slow_lock);
+        ((block_t *)user_data)->slow_taken++;
+        dr_mutex_unlock(slow_lock);
+    }
+}
+
+/* Counts the taken executions of the conditional branch inst by testing its
+ * condition again in a meta branch around the counter update, which saves
+ * the flags that inst still needs.
+ */
+static void
+insert_taken_count(void *drcontext, instrlist_t *bb, instr_t *inst, int slot)
+{
+    int opcode = instr_get_opcode(inst);
+    instr_t *taken = INSTR_CREATE_label(drcontext);
+    instr_t *done = INSTR_CREATE_label(drcontext);
+    if (opcode >= OP_jo_short && opcode <= OP_jnle_short)
+        opcode = opcode - OP_jo_short + OP_jo;
+    MINSERT(bb, inst, INSTR_CREATE_jcc(drcontext, opcode, opnd_create_instr(taken)));
+    MINSERT(bb, inst, INSTR_CREATE_jmp(drcontext, opnd_create_instr(done)));
+    MINSERT(bb, inst, taken);
+    MINSERT(bb, inst, done);
+    drx_insert_sharded_counter_update(drcontext, counters, bb, done,
+                                      SPILL_SLOT_1, SPILL_SLOT_2, slot, 1);
+}
+
+static dr_emit_flags_t
+event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
+                  bool for_trace, bool translating, OUT void **user_data)
+{
+    *user_data = block_lookup_or_add(drcontext, tag, bb, translating);
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
+                      bool for_trace, bool translating, void *user_data)
+{
+    block_t *block = (block_t *) user_data;
+    if (block == NULL || block->count_slot < 0)
+        return DR_EMIT_DEFAULT;
+    if (drmgr_is_first_instr(drcontext, inst)) {
+        drx_insert_sharded_counter_update(drcontext, counters, bb, inst,
+                                          SPILL_SLOT_1, SPILL_SLOT_2,
+                                          block->count_slot, 1);
+    }
+    if (drmgr_is_last_instr(drcontext, inst)) {
+        if (block->exit_kind == EXIT_CBR) {
+            if (block->taken_slot >= 0)
+                insert_taken_count(drcontext, bb, inst, block->taken_slot);
+            else {
+                dr_insert_cbr_instrumentation_ex(drcontext, bb, inst,
+                                                 (void *)at_slow_cbr,
+                                                 OPND_CREATE_INTPTR(block));
+            }
+        } else if (block->exit_kind == EXIT_ICALL) {
+            dr_insert_mbr_instrumentation(drcontext, bb, inst, (void *)at_icall,
+                                          SPILL_SLOT_1);
+        }
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+event_module_load(void *drcontext, const module_data_t *info, bool loaded)
+{
+    module_table_load(module_table, info);
+}
+
+static void
+event_module_unload(void *drcontext, const module_data_t *info)
+{
+    /* We keep the blocks and sites, which refer to the module entry, for
+     * the profile, but new code at these addresses must get new ones.
+     */
+    module_table_unload(module_table, info);
+    hashtable_lock(&block_table);
+    hashtable_remove_range(&block_table, info->start, info->end);
+    hashtable_unlock(&block_table);
+    dr_mutex_lock(icall_lock);
+    hashtable_remove_range(&icall_table, info->start, info->end);
+    dr_mutex_unlock(icall_lock);
+}
+
+/****************************************************************************
+ * Profile output
+ */
+
+/* The executions of one instruction, summed over the blocks holding it */
+typedef struct _instr_count_t {
+    uint offs;
+    uint64 count;
+} instr_count_t;
+
+/* A call made from one instruction to one named function */
+typedef struct _site_call_t {
+    uint offs;
+    char *callee;
+    uint64 count;
+} site_call_t;
+
+typedef struct _line_call_t {
+    const char *callee;
+    uint64 count;
+} line_call_t;
+
+typedef struct _line_t {
+    uint64 line;
+    uint64 count;
+    line_call_t *calls;
+    uint num_calls;
+    uint capacity;
+} line_t;
+
+typedef struct _func_t {
+    char *name;
+    char *file;
+    size_t start_offs;
+    uint64 start_line;  /* 0 if not yet known */
+    uint64 head;
+    line_t *lines;
+    uint num_lines;
+    uint capacity;
+} func_t;
+
+/* The state of profiling one module */
+typedef struct _profile_t {
+    module_entry_t *entry;
+    instr_count_t *instrs;
+    uint num_instrs;
+    uint instrs_capacity;
+    site_call_t *calls;
+    uint num_calls;
+    uint calls_capacity;
+    uint next_call;     /* cursor into calls while symbolizing instrs */
+    hashtable_t func_table; /* maps a function's start offset to its func_t */
+    drvector_t funcs;
+} profile_t;
+
+typedef struct _edge_t {
+    uint branch;
+    uint fall;
+    int target_mod;
+    uint target;
+    uint64 taken;
+    uint64 total;
+} edge_t;
+
+static int
+instr_count_cmp(const void *a, const void *b)
+{
+    uint x = ((const instr_count_t *)a)->offs, y = ((const instr_count_t *)b)->offs;
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static int
+site_call_cmp(const void *a, const void *b)
+{
+    const site_call_t *x = (const site_call_t *)a, *y = (const site_call_t *)b;
+    if (x->offs != y->offs)
+        return (x->offs < y->offs) ? -1 : 1;
+    return strcmp(x->callee, y->callee);
+}
+
+static int
+line_cmp(const void *a, const void *b)
+{
+    uint64 x = ((const line_t *)a)->line, y = ((const line_t *)b)->line;
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static int
+edge_cmp(const void *a, const void *b)
+{
+    uint x = ((const edge_t *)a)->branch, y = ((const edge_t *)b)->branch;
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static uint64
+block_count(block_t *block)
+{
+    return drx_sharded_counter_sum(counters, (uint)block->count_slot);
+}
+
+/* Returns the mangled name of the function starting at offs in the module
+ * with id mod_id, or NULL if offs is not the start of a known function.
+ */
+static char *
+function_name(int mod_id, uint offs)
+{
+    module_entry_t *entry;
+    drsym_info_t sym;
+    drsym_error_t res;
+    char name[MAXIMUM_PATH];
+    if (mod_id < 0)
+        return NULL;
+    entry = drvector_get_entry(&module_table->vector, mod_id);
+    if (entry == NULL || entry->data == NULL || entry->data->full_path == NULL)
+        return NULL;
+    sym.struct_size = sizeof(sym);
+    sym.name = name;
+    sym.name_size = BUFFER_SIZE_BYTES(name);
+    sym.file = NULL;
+    sym.file_size = 0;
+    res = drsym_lookup_address(entry->data->full_path, offs, &sym,
+                               DRSYM_LEAVE_MANGLED);
+    /* We only need the name, not the line */
+    if ((res != DRSYM_SUCCESS && res != DRSYM_ERROR_LINE_NOT_AVAILABLE) ||
+        sym.start_offs != offs)
+        return NULL;
+    return string_dup(name);
+}
+
+static void
+profile_add_call(profile_t *prof, uint offs, int mod_id, uint target, uint64 count)
+{
+    char *callee;
+    if (count == 0)
+        return;
+    callee = function_name(mod_id, target);
+    if (callee == NULL)
+        return;
+    prof->calls = array_reserve(prof->calls, prof->num_calls, &prof->calls_capacity,
+                                sizeof(site_call_t));
+    prof->calls[prof->num_calls].offs = offs;
+    prof->calls[prof->num_calls].callee = callee;
+    prof->calls[prof->num_calls].count = count;
+    prof->num_calls++;
+}
+
+/* Gathers the instruction counts and calls of prof->entry's module, sorted
+ * by offset and with duplicates merged.
+ */
+static void
+profile_collect(profile_t *prof)
+{
+    uint i, j, num;
+    for (i = 0; i < blocks.entries; i++) {
+        block_t *block = drvector_get_entry(&blocks, i);
+        uint offs = block->start;
+        uint64 count;
+        if (block->mod_id != prof->entry->id || block->count_slot < 0)
+            continue;
+        count = block_count(block);
+        if (count == 0)
+            continue;
+        for (j = 0; j < block->num_instrs; j++) {
+            prof->instrs = array_reserve(prof->instrs, prof->num_instrs,
+                                         &prof->instrs_capacity,
+                                         sizeof(instr_count_t));
+            prof->instrs[prof->num_instrs].offs = offs;
+            prof->instrs[prof->num_instrs].count = count;
+            prof->num_instrs++;
+            offs += block->lengths[j];
+        }
+        if (block->exit_kind == EXIT_CALL) {
+            profile_add_call(prof, offs - block->lengths[block->num_instrs - 1],
+                             block->target_mod, block->target, count);
+        }
+    }
+    for (i = 0; i < icall_sites.entries; i++) {
+        icall_site_t *site = drvector_get_entry(&icall_sites, i);
+        if (site->mod_id != prof->entry->id)
+            continue;
+        for (j = 0; j < site->num_targets; j++) {
+            profile_add_call(prof, site->offs, site->targets[j].mod_id,
+                             site->targets[j].offs, site->targets[j].count);
+        }
+    }
+
+    array_sort(prof->instrs, prof->num_instrs, sizeof(instr_count_t), instr_count_cmp);
+    for (i = 0, num = 0; i < prof->num_instrs; i++) {
+        if (num > 0 && prof->instrs[num - 1].offs == prof->instrs[i].offs)
+            prof->instrs[num - 1].count += prof->instrs[i].count;
+        else
+            prof->instrs[num++] = prof->instrs[i];
+    }
+    prof->num_instrs = num;
+
+    array_sort(prof->calls, prof->num_calls, sizeof(site_call_t), site_call_cmp);
+    for (i = 0, num = 0; i < prof->num_calls; i++) {
+        if (num > 0 && prof->calls[num - 1].offs == prof->calls[i].offs &&
+            strcmp(prof->calls[num - 1].callee, prof->calls[i].callee) == 0) {
+            prof->calls[num - 1].count += prof->calls[i].count;
+            string_free(prof->calls[i].callee);
+        } else
+            prof->calls[num++] = prof->calls[i];
+    }
+    prof->num_calls = num;
+}
+
+static line_t *
+func_get_line(func_t *func, uint64 line)
+{
+    uint i;
+    for (i = 0; i < func->num_lines; i++) {
+        if (func->lines[i].line == line)
+            return &func->lines[i];
+    }
+    func->lines = array_reserve(func->lines, func->num_lines, &func->capacity,
+                                sizeof(line_t));
+    func->lines[i].line = line;
+    func->lines[i].count = 0;
+    func->lines[i].calls = NULL;
+    func->lines[i].num_calls = 0;
+    func->lines[i].capacity = 0;
+    func->num_lines++;
+    return &func->lines[i];
+}
+
+static void
+line_add_call(line_t *line, const char *callee, uint64 count)
+{
+    uint i;
+    for (i = 0; i < line->num_calls; i++) {
+        if (strcmp(line->calls[i].callee, callee) == 0) {
+            line->calls[i].count += count;
+            return;
+        }
+    }
+    line->calls = array_reserve(line->calls, line->num_calls, &line->capacity,
+                                sizeof(line_call_t));
+    line->calls[i].callee = callee;
+    line->calls[i].count = count;
+    line->num_calls++;
+}
+
+static void
+func_free(void *p)
+{
+    func_t *func = (func_t *) p;
+    uint i;
+    for (i = 0; i < func->num_lines; i++)
+        array_free(func->lines[i].calls, func->lines[i].capacity, sizeof(line_call_t));
+    array_free(func->lines, func->capacity, sizeof(line_t));
+    string_free(func->name);
+    string_free(func->file);
+    dr_global_free(func, sizeof(*func));
+}
+
+/* Called by drsym_lookup_addresses() for each of prof->instrs in order.  An
+ * instruction's line gets the largest count of the line's instructions, as
+ * the compiler's profile loader expects, and the calls made from it.  Code
+ * inlined from another file is not attributed, as we cannot tell where it
+ * was inlined.
+ */
+static bool
+profile_add_instr(size_t index, drsym_error_t status, drsym_info_t *info, void *data)
+{
+    profile_t *prof = (profile_t *) data;
+    instr_count_t *instr = &prof->instrs[index];
+    func_t *func;
+    line_t *line;
+    if (status != DRSYM_SUCCESS || info->name == NULL || info->file == NULL)
+        return true;
+    func = (func_t *) hashtable_lookup(&prof->func_table, (void *)info->start_offs);
+    if (func == NULL) {
+        func = dr_global_alloc(sizeof(*func));
+        func->name = string_dup(info->name);
+        func->file = string_dup(info->file);
+        func->start_offs = info->start_offs;
+        func->start_line = 0;
+        func->head = 0;
+        func->lines = NULL;
+        func->num_lines = 0;
+        func->capacity = 0;
+        hashtable_add(&prof->func_table, (void *)info->start_offs, func);
+        drvector_append(&prof->funcs, func);
+    }
+    if (instr->offs == info->start_offs) {
+        func->head = instr->count;
+        func->start_line = info->line;
+    }
+    if (strcmp(info->file, func->file) != 0)
+        return true;
+    line = func_get_line(func, info->line);
+    if (instr->count > line->count)
+        line->count = instr->count;
+    while (prof->next_call < prof->num_calls &&
+           prof->calls[prof->next_call].offs < instr->offs)
+        prof->next_call++;
+    for (; prof->next_call < prof->num_calls &&
+             prof->calls[prof->next_call].offs == instr->offs; prof->next_call++) {
+        line_add_call(line, prof->calls[prof->next_call].callee,
+                      prof->calls[prof->next_call].count);
+    }
+    return true;
+}
+
+/* Writes func in the text sample profile format:
+ *   name:total:head
+ *    line_offset: count [callee:count ...]
+ * where lines are relative to the line of the function's first instruction.
+ */
+static void
+func_print(file_t f, func_t *func)
+{
+    uint64 total = 0;
+    uint i, j;
+    if (func->start_line == 0)
+        return;
+    array_sort(func->lines, func->num_lines, sizeof(line_t), line_cmp);
+    for (i = 0; i < func->num_lines; i++) {
+        if (func->lines[i].line >= func->start_line)
+            total += func->lines[i].count;
+    }
+    if (total == 0)
+        return;
+    dr_fprintf(f, "%s:"UINT64_FORMAT_STRING":"UINT64_FORMAT_STRING"\n",
+               func->name, total, func->head);
+    for (i = 0; i < func->num_lines; i++) {
+        line_t *line = &func->lines[i];
+        if (line->line < func->start_line)
+            continue;
+        dr_fprintf(f, " "UINT64_FORMAT_STRING": "UINT64_FORMAT_STRING,
+                   line->line - func->start_line, line->count);
+        for (j = 0; j < line->num_calls; j++) {
+            dr_fprintf(f, " %s:"UINT64_FORMAT_STRING,
+                       line->calls[j].callee, line->calls[j].count);
+        }
+        dr_fprintf(f, "\n");
+    }
+}
+
+static void
+profile_print(file_t f, profile_t *prof)
+{
+    const char *path = prof->entry->data->full_path;
+    size_t *offs;
+    drsym_info_t sym;
+    char name[MAXIMUM_PATH];
+    char file[MAXIMUM_PATH];
+    drsym_error_t res;
+    uint i;
+
+    if (prof->num_instrs == 0)
+        return;
+    offs = dr_global_alloc(prof->num_instrs * sizeof(*offs));
+    for (i = 0; i < prof->num_instrs; i++)
+        offs[i] = prof->instrs[i].offs;
+    sym.struct_size = sizeof(sym);
+    sym.name = name;
+    sym.name_size = BUFFER_SIZE_BYTES(name);
+    sym.file = file;
+    sym.file_size = BUFFER_SIZE_BYTES(file);
+    res = drsym_lookup_addresses(path, offs, prof->num_instrs, &sym,
+                                 profile_add_instr, prof, DRSYM_LEAVE_MANGLED);
+    dr_global_free(offs, prof->num_instrs * sizeof(*offs));
+    if (res != DRSYM_SUCCESS) {
+        NOTIFY(0, "drpgo: unable to look up symbols for %s\n", path);
+        return;
+    }
+
+    for (i = 0; i < prof->funcs.entries; i++) {
+        func_t *func = drvector_get_entry(&prof->funcs, i);
+        if (func->start_line == 0) {
+            /* The entry did not execute: we look up its line separately */
+            sym.name = NULL;
+            sym.name_size = 0;
+            sym.file = NULL;
+            sym.file_size = 0;
+            if (drsym_lookup_address(path, func->start_offs, &sym,
+                                     DRSYM_LEAVE_MANGLED) == DRSYM_SUCCESS)
+                func->start_line = sym.line;
+        }
+        func_print(f, func);
+    }
+}
+
+static void
+profile_module(file_t prof_file, file_t edge_file, module_entry_t *entry)
+{
+    profile_t prof;
+    edge_t *edges = NULL;
+    uint num_edges = 0, capacity = 0, i, num;
+
+    memset(&prof, 0, sizeof(prof));
+    prof.entry = entry;
+    hashtable_init(&prof.func_table, 8, HASH_INTPTR, false/*!strdup*/);
+    drvector_init(&prof.funcs, 64, false/*!synch*/, func_free);
+    profile_collect(&prof);
+    profile_print(prof_file, &prof);
+    hashtable_delete(&prof.func_table);
+    drvector_delete(&prof.funcs);
+    for (i = 0; i < prof.num_calls; i++)
+        string_free(prof.calls[i].callee);
+    array_free(prof.calls, prof.calls_capacity, sizeof(site_call_t));
+    array_free(prof.instrs, prof.instrs_capacity, sizeof(instr_count_t));
+
+    for (i = 0; i < blocks.entries; i++) {
+        block_t *block = drvector_get_entry(&blocks, i);
+        if (block->mod_id != entry->id || block->exit_kind != EXIT_CBR ||
+            block->count_slot < 0)
+            continue;
+        edges = array_reserve(edges, num_edges, &capacity, sizeof(edge_t));
+        edges[num_edges].fall = block->start + block->size;
+        edges[num_edges].branch = edges[num_edges].fall -
+            block->lengths[block->num_instrs - 1];
+        edges[num_edges].target_mod = block->target_mod;
+        edges[num_edges].target = block->target;
+        edges[num_edges].total = block_count(block);
+        edges[num_edges].taken = block->slow_taken + (block->taken_slot < 0 ? 0 :
+            drx_sharded_counter_sum(counters, (uint)block->taken_slot));
+        num_edges++;
+    }
+    array_sort(edges, num_edges, sizeof(edge_t), edge_cmp);
+    for (i = 0, num = 0; i < num_edges; i++) {
+        if (num > 0 && edges[num - 1].branch == edges[i].branch) {
+            edges[num - 1].taken += edges[i].taken;
+            edges[num - 1].total += edges[i].total;
+        } else
+            edges[num++] = edges[i];
+    }
+    dr_fprintf(edge_file, "Module %s: %u branches\n", entry->data->full_path, num);
+    dr_fprintf(edge_file, "branch, taken target, taken count, "
+               "fall-through target, fall-through count:\n");
+    for (i = 0; i < num; i++) {
+        dr_fprintf(edge_file, PIFX", ", (ptr_uint_t)edges[i].branch);
+        if (edges[i].target_mod == entry->id)
+            dr_fprintf(edge_file, PIFX", ", (ptr_uint_t)edges[i].target);
+        else
+            dr_fprintf(edge_file, "<external>, ");
+        dr_fprintf(edge_file, UINT64_FORMAT_STRING", "PIFX", "UINT64_FORMAT_STRING"\n",
+                   edges[i].taken, (ptr_uint_t)edges[i].fall,
+                   edges[i].total - edges[i].taken);
+    }
+    array_free(edges, capacity, sizeof(edge_t));
+}
+
+/****************************************************************************
+ * Init and exit
+ */
+
+static file_t
+open_output_file(const char *suffix)
+{
+    char buf[MAXIMUM_PATH];
+    file_t f = drx_open_unique_appid_file(options.logdir, dr_get_process_id(),
+                                          "drpgo", suffix,
+                                          DR_FILE_ALLOW_LARGE,
+                                          buf, BUFFER_SIZE_ELEMENTS(buf));
+    ASSERT(f != INVALID_FILE, "failed to open output file");
+    NOTIFY(1, "drpgo: writing %s\n", buf);
+    return f;
+}
+
+static void
+event_exit(void)
+{
+    file_t prof_file = open_output_file("prof");
+    file_t edge_file = open_output_file("edges");
+    uint i;
+
+    drvector_lock(&module_table->vector);
+    for (i = 0; i < module_table->vector.entries; i++) {
+        module_entry_t *entry = drvector_get_entry(&module_table->vector, i);
+        if (entry->data != NULL && module_is_profiled(entry->data))
+            profile_module(prof_file, edge_file, entry);
+    }
+    drvector_unlock(&module_table->vector);
+    if (prof_file != INVALID_FILE)
+        dr_close_file(prof_file);
+    if (edge_file != INVALID_FILE)
+        dr_close_file(edge_file);
+
+    hashtable_delete(&block_table);
+    drvector_delete(&blocks);
+    hashtable_delete(&icall_table);
+    drvector_delete(&icall_sites);
+    drx_sharded_counter_free(counters);
+    dr_mutex_destroy(slow_lock);
+    dr_mutex_destroy(icall_lock);
+    module_table_destroy(module_table);
+    drsym_exit();
+    drx_exit();
+    drmgr_exit();
+}
+
+static void
+options_init(client_id_t id, int argc, const char *argv[])
+{
+    int i;
+    const char *token;
+    /* default values */
+    dr_snprintf(options.logdir, BUFFER_SIZE_ELEMENTS(options.logdir), ".");
+    options.max_counters = DEFAULT_MAX_COUNTERS;
+
+    for (i = 1/*skip client*/; i < argc; i++) {
+        token = argv[i];
+        if (strcmp(token, "-logdir") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing logdir path");
+            strncpy(options.logdir, argv[++i], BUFFER_SIZE_ELEMENTS(options.logdir));
+            NULL_TERMINATE_BUFFER(options.logdir);
+        }
+        else if (strcmp(token, "-module") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing module name");
+            strncpy(options.module, argv[++i], BUFFER_SIZE_ELEMENTS(options.module));
+            NULL_TERMINATE_BUFFER(options.module);
+        }
+        else if (strcmp(token, "-max_counters") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -max_counters number");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &options.max_counters) != 1 ||
+                options.max_counters == 0) {
+                USAGE_CHECK(false, "invalid -max_counters number");
+            }
+        }
+        else if (strcmp(token, "-verbose") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -verbose number");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &verbose) != 1) {
+                USAGE_CHECK(false, "invalid -verbose number");
+            }
+        }
+        else {
+            NOTIFY(0, "UNRECOGNIZED OPTION: \"%s\"\n", token);
+            USAGE_CHECK(false, "invalid option");
+        }
+    }
+}
+
+DR_EXPORT void
+dr_client_main(client_id_t id, int argc, const char *argv[])
+{
+    module_data_t *exe;
+    IF_DEBUG(bool ok;)
+
+    dr_set_client_name("DrPGO", "http://dynamorio.org/issues");
+
+    options_init(id, argc, argv);
+
+    IF_DEBUG(ok = )
+        drmgr_init();
+    ASSERT(ok, "drmgr failed to initialize");
+    IF_DEBUG(ok = )
+        drx_init();
+    ASSERT(ok, "drx failed to initialize");
+    if (drsym_init(0) != DRSYM_SUCCESS)
+        ASSERT(false, "drsyms failed to initialize");
+
+    exe = dr_get_main_module();
+    if (exe != NULL)
+        exe_start = exe->start;
+    dr_free_module_data(exe);
+
+    module_table = module_table_create();
+    /* We hold the table lock across lookup and add ourselves. */
+    hashtable_init_ex(&block_table, BLOCK_TABLE_BITS, HASH_INTPTR, false/*!strdup*/,
+                      false/*!synch*/, NULL, NULL, NULL);
+    drvector_init(&blocks, 1024, false/*!synch*/, block_free);
+    counters = drx_sharded_counter_create(options.max_counters);
+    ASSERT(counters != NULL, "failed to create counters");
+    slow_lock = dr_mutex_create();
+    icall_lock = dr_mutex_create();
+    hashtable_init_ex(&icall_table, ICALL_TABLE_BITS, HASH_INTPTR, false/*!strdup*/,
+                      false/*!synch*/, NULL, NULL, NULL);
+    drvector_init(&icall_sites, 64, false/*!synch*/, icall_site_free);
+
+    dr_register_exit_event(event_exit);
+    drmgr_register_module_load_event(event_module_load);
+    drmgr_register_module_unload_event(event_module_unload);
+    drmgr_register_bb_instrumentation_event(event_bb_analysis,
+                                            event_app_instruction, NULL);
+
+#ifdef WINDOWS
+    dr_enable_console_printing();
+#endif
+}
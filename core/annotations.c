@@ -36,6 +36,7 @@
 #include "instr_create.h"
 #include "decode_fast.h"
 #include "utils.h"
+#include "fragment.h"
 #include "annotations.h"
 
 #ifdef ANNOTATIONS /* around whole file */
@@ -147,6 +148,15 @@
 
 #define DYNAMORIO_ANNOTATE_LOG_ARG_COUNT 20
 
+#define DYNAMORIO_ANNOTATE_MANAGE_CODE_AREA_NAME \
+    "dynamorio_annotate_manage_code_area"
+
+#define DYNAMORIO_ANNOTATE_UNMANAGE_CODE_AREA_NAME \
+    "dynamorio_annotate_unmanage_code_area"
+
+#define DYNAMORIO_ANNOTATE_FLUSH_FRAGMENTS_NAME \
+    "dynamorio_annotate_flush_fragments"
+
 /* Facilitates timestamp substitution in `dynamorio_annotate_log()`. */
 #define LOG_ANNOTATION_TIMESTAMP_TOKEN "${timestamp}"
 #define LOG_ANNOTATION_TIMESTAMP_TOKEN_LENGTH 12
@@ -251,6 +261,16 @@ static ssize_t
 annotation_printf(const char *format, ...);
 #endif
 
+/* Implement the JIT code area annotations */
+static void
+annotation_manage_code_area(app_pc start, size_t size);
+
+static void
+annotation_unmanage_code_area(app_pc start, size_t size);
+
+static void
+annotation_flush_fragments(app_pc start, size_t size);
+
 /* Invoked during hashtable entry removal */
 static void
 free_annotation_handler(void *p);
@@ -296,6 +316,16 @@ annotation_init()
                                 DR_ANNOTATION_CALL_TYPE_VARARG);
 #endif
 
+    dr_annotation_register_call(DYNAMORIO_ANNOTATE_MANAGE_CODE_AREA_NAME,
+                                (void *) annotation_manage_code_area, false, 2,
+                                DR_ANNOTATION_CALL_TYPE_FASTCALL);
+    dr_annotation_register_call(DYNAMORIO_ANNOTATE_UNMANAGE_CODE_AREA_NAME,
+                                (void *) annotation_unmanage_code_area, false, 2,
+                                DR_ANNOTATION_CALL_TYPE_FASTCALL);
+    dr_annotation_register_call(DYNAMORIO_ANNOTATE_FLUSH_FRAGMENTS_NAME,
+                                (void *) annotation_flush_fragments, false, 2,
+                                DR_ANNOTATION_CALL_TYPE_FASTCALL);
+
 #if !(defined(WINDOWS) && defined(X64))
     /* DR pretends to be Valgrind. */
     dr_annotation_register_valgrind(DR_VG_ID__RUNNING_ON_VALGRIND,
@@ -369,7 +399,9 @@ instrument_annotation(dcontext_t *dcontext, IN OUT app_pc *start_pc,
 
             TABLE_RWLOCK(handlers, write, lock);
             handler = strhash_hash_lookup(GLOBAL_DCONTEXT, handlers, layout.name);
-            if (handler != NULL && handler->type == DR_ANNOTATION_HANDLER_CALL) {
+            if (handler != NULL && (handler->type == DR_ANNOTATION_HANDLER_CALL ||
+                                    handler->type == DR_ANNOTATION_HANDLER_COUNTER ||
+                                    handler->type == DR_ANNOTATION_HANDLER_TLS_STORE)) {
                 /* Substitute the annotation with a label pointing to the handler. */
                 instr_t *call = INSTR_CREATE_label(dcontext);
                 dr_instr_label_data_t *label_data = instr_get_label_data_area(call);
@@ -608,6 +640,76 @@ dr_annotation_register_return(const char *annotation_name, void *return_value)
     return result;
 }
 
+/* Registers the single receiver of an inline handler type, which like a return value
+ * excludes all other registrations for the annotation.
+ */
+static bool
+register_inline_receiver(const char *annotation_name, dr_annotation_handler_type_t type,
+                         dr_annotation_receiver_t *proto)
+{
+    bool result = true;
+    dr_annotation_handler_t *handler;
+    dr_annotation_receiver_t *receiver;
+
+    TABLE_RWLOCK(handlers, write, lock);
+    handler = (dr_annotation_handler_t *) strhash_hash_lookup(GLOBAL_DCONTEXT, handlers,
+                                                              annotation_name);
+    if (handler == NULL) { /* make a new handler if never registered yet */
+        handler = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, dr_annotation_handler_t,
+                                  ACCT_OTHER, UNPROTECTED);
+        memset(handler, 0, sizeof(dr_annotation_handler_t));
+        handler->type = type;
+        handler->symbol_name = dr_strdup(annotation_name HEAPACCT(ACCT_OTHER));
+        strhash_hash_add(GLOBAL_DCONTEXT, handlers, handler->symbol_name, handler);
+    }
+    if (handler->receiver_list == NULL) {
+        /* Any previous registration of another type has been unregistered. The args
+         * of a clean call handler are left in place for a later re-registration.
+         */
+        handler->type = type;
+        receiver = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, dr_annotation_receiver_t,
+                                   ACCT_OTHER, UNPROTECTED);
+        *receiver = *proto;
+        receiver->save_fpstate = false;
+        receiver->next = NULL;
+        handler->receiver_list = receiver;
+    } else {
+        result = false; /* Existing handler prevents the new registration. */
+    }
+    TABLE_RWLOCK(handlers, write, unlock);
+    return result;
+}
+
+bool
+dr_annotation_register_counter(const char *annotation_name, ptr_uint_t *counter)
+{
+    dr_annotation_receiver_t proto;
+#ifdef X64
+    /* The increment addresses the counter directly, rip-relative. */
+    if (!rel32_reachable_from_vmcode((byte *) counter))
+        return false;
+#endif
+    proto.instrumentation.counter = counter;
+    return register_inline_receiver(annotation_name, DR_ANNOTATION_HANDLER_COUNTER,
+                                    &proto);
+}
+
+bool
+dr_annotation_register_tls_store(const char *annotation_name, reg_id_t tls_seg,
+                                 uint tls_offs,
+                                 dr_annotation_calling_convention_t call_type)
+{
+    dr_annotation_receiver_t proto;
+    dr_annotation_handler_t arg_layout;
+    /* Locate the first argument just as a clean call handler would. */
+    arg_layout.args = &proto.instrumentation.tls_store.arg;
+    create_arg_opnds(&arg_layout, 1, call_type);
+    proto.instrumentation.tls_store.segment = tls_seg;
+    proto.instrumentation.tls_store.offset = tls_offs;
+    return register_inline_receiver(annotation_name, DR_ANNOTATION_HANDLER_TLS_STORE,
+                                    &proto);
+}
+
 bool
 dr_annotation_unregister_call(const char *annotation_name, void *callee)
 {
@@ -662,6 +764,28 @@ dr_annotation_unregister_return(const char *annotation_name)
     return found;
 }
 
+bool
+dr_annotation_unregister_inline(const char *annotation_name)
+{
+    bool found = false;
+    dr_annotation_handler_t *handler;
+
+    TABLE_RWLOCK(handlers, write, lock);
+    handler = (dr_annotation_handler_t *) strhash_hash_lookup(GLOBAL_DCONTEXT, handlers,
+                                                              annotation_name);
+    if (handler != NULL && handler->receiver_list != NULL &&
+        (handler->type == DR_ANNOTATION_HANDLER_COUNTER ||
+         handler->type == DR_ANNOTATION_HANDLER_TLS_STORE)) {
+        ASSERT(handler->receiver_list->next == NULL);
+        HEAP_TYPE_FREE(GLOBAL_DCONTEXT, handler->receiver_list, dr_annotation_receiver_t,
+                       ACCT_OTHER, UNPROTECTED);
+        handler->receiver_list = NULL;
+        found = true;
+    } /* Leave the handler for the next registration (free it on exit) */
+    TABLE_RWLOCK(handlers, write, unlock);
+    return found;
+}
+
 #if !(defined(WINDOWS) && defined(X64))
 bool
 dr_annotation_unregister_valgrind(dr_valgrind_request_id_t request_id,
@@ -1147,6 +1271,46 @@ annotation_printf(const char *format, ...)
 }
 #endif
 
+static void
+annotation_manage_code_area(app_pc start, size_t size)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    LOG(THREAD, LOG_ANNOTATIONS, 2, "Managing code area "PFX"-"PFX"\n",
+        start, start + size);
+    if (size == 0 || is_couldbelinking(dcontext))
+        return;
+    set_region_jit_managed(dcontext, start, size);
+}
+
+static void
+annotation_unmanage_code_area(app_pc start, size_t size)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    LOG(THREAD, LOG_ANNOTATIONS, 2, "Unmanaging code area "PFX"-"PFX"\n",
+        start, start + size);
+    if (size == 0 || is_couldbelinking(dcontext))
+        return;
+    set_region_app_managed(dcontext, start, size);
+}
+
+/* The JIT is typically rewriting code that some thread, possibly this one, is
+ * still executing, so we use an unlink flush rather than a synchall flush:
+ * fragments already entered run to their exits.
+ */
+static void
+annotation_flush_fragments(app_pc start, size_t size)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    LOG(THREAD, LOG_ANNOTATIONS, 2, "Flushing fragments "PFX"-"PFX"\n",
+        start, start + size);
+    if (size == 0 || is_couldbelinking(dcontext))
+        return;
+    if (!executable_vm_area_executed_from(start, start + size))
+        return;
+    STATS_INC(num_jit_annotated_flushes);
+    flush_fragments_from_region(dcontext, start, size, false/*unlink*/);
+}
+
 static void
 free_annotation_handler(void *p)
 {
@@ -1162,8 +1326,7 @@ free_annotation_handler(void *p)
         HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, handler->args, opnd_t, handler->num_args,
                         ACCT_OTHER, UNPROTECTED);
     }
-    if ((handler->type == DR_ANNOTATION_HANDLER_CALL) ||
-        (handler->type == DR_ANNOTATION_HANDLER_RETURN_VALUE))
+    if (handler->symbol_name != NULL) /* NULL for Valgrind annotations */
         dr_strfree(handler->symbol_name HEAPACCT(ACCT_OTHER));
     HEAP_TYPE_FREE(GLOBAL_DCONTEXT, p, dr_annotation_handler_t, ACCT_OTHER, UNPROTECTED);
 }
@@ -197,6 +197,44 @@ DR_API
 bool
 dr_annotation_register_return(const char *annotation_name, void *return_value);
 
+DR_API
+/**
+ * Register a counter for a DR annotation. Each time the annotation is encountered, the
+ * counter is incremented by a single inline atomic instruction, with no clean call.
+ * This is intended for annotations that execute too frequently for a clean call to be
+ * affordable. Returns true on successful registration, or false if the annotation
+ * already has a handler or \p counter is not reachable from the code cache (on x64
+ * it should be a client global variable rather than heap memory).
+ *
+ * @param[in] annotation_name  The name of the annotation function as it appears in the
+ *                             target app's source code (unmangled).
+ * @param[in] counter          The counter to increment on every instance of the
+ *                             annotation.
+ */
+bool
+dr_annotation_register_counter(const char *annotation_name, ptr_uint_t *counter);
+
+DR_API
+/**
+ * Register a thread-local store for a DR annotation. Each time the annotation is
+ * encountered, its first argument is written to the raw TLS slot at \p tls_offs from
+ * segment \p tls_seg, as returned by dr_raw_tls_calloc(), using one or two inline
+ * instructions and no clean call. The client can then read the most recent value
+ * for the current thread with dr_insert_read_raw_tls() or from a clean call. Returns
+ * true on successful registration, or false if the annotation already has a handler.
+ *
+ * @param[in] annotation_name  The name of the annotation function as it appears in the
+ *                             target app's source code (unmangled).
+ * @param[in] tls_seg          The TLS segment returned by dr_raw_tls_calloc().
+ * @param[in] tls_offs         The offset of the slot within \p tls_seg.
+ * @param[in] call_type        The calling convention of the annotation function as
+ *                             compiled in the target app (x86 only).
+ */
+bool
+dr_annotation_register_tls_store(const char *annotation_name, reg_id_t tls_seg,
+                                 uint tls_offs,
+                                 dr_annotation_calling_convention_t call_type);
+
 DR_API
 /**
  * Unregister the specified handler from a DR annotation. Instances of the annotation that
@@ -227,6 +265,18 @@ DR_API
 bool
 dr_annotation_unregister_return(const char *annotation_name);
 
+DR_API
+/**
+ * Unregister the counter or thread-local store from a DR annotation. Instances of the
+ * annotation that have already been instrumented will remain in the code cache, but
+ * any newly encountered instances will no longer be instrumented. Returns true if a
+ * registration was found and successfully unregistered.
+ *
+ * @param[in] annotation_name  The annotation function for which to unregister.
+ */
+bool
+dr_annotation_unregister_inline(const char *annotation_name);
+
 DR_API
 /**
  * Unregister the specified callback from a Valgrind client request. The registered
@@ -303,6 +353,8 @@ typedef enum _dr_annotation_handler_type_t {
     DR_ANNOTATION_HANDLER_CALL,
     DR_ANNOTATION_HANDLER_RETURN_VALUE,
     DR_ANNOTATION_HANDLER_VALGRIND,
+    DR_ANNOTATION_HANDLER_COUNTER,   /* inline increment, no clean call */
+    DR_ANNOTATION_HANDLER_TLS_STORE, /* inline store of the first arg, no clean call */
     DR_ANNOTATION_HANDLER_LAST
 } dr_annotation_handler_type_t;
 
@@ -312,6 +364,12 @@ typedef struct _dr_annotation_receiver_t {
         void *callback;
         void *return_value;
         ptr_uint_t (*vg_callback)(dr_vg_client_request_t *request);
+        ptr_uint_t *counter;
+        struct {
+            opnd_t arg;
+            reg_id_t segment;
+            uint offset;
+        } tls_store;
     } instrumentation;
     bool save_fpstate;
     struct _dr_annotation_receiver_t *next;
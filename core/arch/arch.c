@@ -203,6 +203,10 @@ dump_emitted_routines(dcontext_t *dcontext, file_t file,
                 print_file(file, "clean_call_save:\n");
             else if (last_pc == code->clean_call_restore)
                 print_file(file, "clean_call_restore:\n");
+            else if (last_pc == code->clean_call_save_noxmm)
+                print_file(file, "clean_call_save_noxmm:\n");
+            else if (last_pc == code->clean_call_restore_noxmm)
+                print_file(file, "clean_call_restore_noxmm:\n");
             last_pc = disassemble_with_bytes(dcontext, last_pc, file);
         } while (last_pc < emitted_pc);
         print_file(file, "%s routines size: "SSZFMT" / "SSZFMT"\n\n",
@@ -453,10 +457,16 @@ shared_gencode_emit(generated_code_t *gencode _IF_X64(bool x86_mode))
     if (!client_clean_call_is_thread_private()) {
         pc = check_size_and_cache_line(isa_mode, gencode, pc);
         gencode->clean_call_save = pc;
-        pc = emit_clean_call_save(GLOBAL_DCONTEXT, pc, gencode);
+        pc = emit_clean_call_save(GLOBAL_DCONTEXT, pc, gencode, true/*save xmm*/);
         pc = check_size_and_cache_line(isa_mode, gencode, pc);
         gencode->clean_call_restore = pc;
-        pc = emit_clean_call_restore(GLOBAL_DCONTEXT, pc, gencode);
+        pc = emit_clean_call_restore(GLOBAL_DCONTEXT, pc, gencode, true/*save xmm*/);
+        pc = check_size_and_cache_line(isa_mode, gencode, pc);
+        gencode->clean_call_save_noxmm = pc;
+        pc = emit_clean_call_save(GLOBAL_DCONTEXT, pc, gencode, false/*no xmm*/);
+        pc = check_size_and_cache_line(isa_mode, gencode, pc);
+        gencode->clean_call_restore_noxmm = pc;
+        pc = emit_clean_call_restore(GLOBAL_DCONTEXT, pc, gencode, false/*no xmm*/);
     }
 
     ASSERT(pc < gencode->commit_end_pc);
@@ -1091,6 +1101,7 @@ arch_thread_init(dcontext_t *dcontext)
         selfmod_init = true;
         set_selfmod_sandbox_offsets(dcontext);
     }
+    encode_thread_init(dcontext);
 #endif
 
     ASSERT_CURIOSITY(proc_is_cache_aligned(get_local_state())
@@ -1276,10 +1287,16 @@ arch_thread_init(dcontext_t *dcontext)
     if (client_clean_call_is_thread_private()) {
         pc = check_size_and_cache_line(isa_mode, code, pc);
         code->clean_call_save = pc;
-        pc = emit_clean_call_save(dcontext, pc, code);
+        pc = emit_clean_call_save(dcontext, pc, code, true/*save xmm*/);
         pc = check_size_and_cache_line(isa_mode, code, pc);
         code->clean_call_restore = pc;
-        pc = emit_clean_call_restore(dcontext, pc, code);
+        pc = emit_clean_call_restore(dcontext, pc, code, true/*save xmm*/);
+        pc = check_size_and_cache_line(isa_mode, code, pc);
+        code->clean_call_save_noxmm = pc;
+        pc = emit_clean_call_save(dcontext, pc, code, false/*no xmm*/);
+        pc = check_size_and_cache_line(isa_mode, code, pc);
+        code->clean_call_restore_noxmm = pc;
+        pc = emit_clean_call_restore(dcontext, pc, code, false/*no xmm*/);
     }
 
     ASSERT(pc < code->commit_end_pc);
@@ -1326,6 +1343,9 @@ arch_thread_profile_exit(dcontext_t *dcontext)
 void
 arch_thread_exit(dcontext_t *dcontext _IF_WINDOWS(bool detach_stacked_callbacks))
 {
+#ifdef X86
+    encode_thread_exit(dcontext);
+#endif
 #if defined(X64) || defined(ARM)
     /* PR 244737: thread-private uses only shared gencode on x64 */
     ASSERT(dcontext->private_code == NULL);
@@ -1801,7 +1821,7 @@ trace_head_return_coarse_routine(IF_X64_ELSE(gencode_mode_t mode, void))
 }
 
 cache_pc
-get_clean_call_save(dcontext_t *dcontext _IF_X64(gencode_mode_t mode))
+get_clean_call_save(dcontext_t *dcontext, bool save_xmm _IF_X64(gencode_mode_t mode))
 {
     generated_code_t *code;
     if (client_clean_call_is_thread_private())
@@ -1811,11 +1831,12 @@ get_clean_call_save(dcontext_t *dcontext _IF_X64(gencode_mode_t mode))
     ASSERT(code != NULL);
     /* FIXME i#1551: NYI on ARM (we need emit_clean_call_save()) */
     IF_ARM(ASSERT_NOT_IMPLEMENTED(false));
-    return (cache_pc) code->clean_call_save;
+    return (cache_pc) (save_xmm ? code->clean_call_save :
+                       code->clean_call_save_noxmm);
 }
 
 cache_pc
-get_clean_call_restore(dcontext_t *dcontext _IF_X64(gencode_mode_t mode))
+get_clean_call_restore(dcontext_t *dcontext, bool save_xmm _IF_X64(gencode_mode_t mode))
 {
     generated_code_t *code;
     if (client_clean_call_is_thread_private())
@@ -1825,7 +1846,8 @@ get_clean_call_restore(dcontext_t *dcontext _IF_X64(gencode_mode_t mode))
     ASSERT(code != NULL);
     /* FIXME i#1551: NYI on ARM (we need emit_clean_call_restore()) */
     IF_ARM(ASSERT_NOT_IMPLEMENTED(false));
-    return (cache_pc) code->clean_call_restore;
+    return (cache_pc) (save_xmm ? code->clean_call_restore :
+                       code->clean_call_restore_noxmm);
 }
 
 static inline cache_pc
@@ -166,6 +166,12 @@ mixed_mode_enabled(void)
 #define DSTACK_OFFSET          ((PROT_OFFS)+offsetof(dcontext_t, dstack))
 #define THREAD_RECORD_OFFSET   ((PROT_OFFS)+offsetof(dcontext_t, thread_record))
 #define WHEREAMI_OFFSET        ((PROT_OFFS)+offsetof(dcontext_t, whereami))
+#define NATIVE_CALL_RETADDR_OFFSET \
+    ((PROT_OFFS)+offsetof(dcontext_t, native_call_retaddr))
+#define NATIVE_CALL_RETSTUB_OFFSET \
+    ((PROT_OFFS)+offsetof(dcontext_t, native_call_retstub))
+#define NATIVE_CALL_GENERATION_OFFSET \
+    ((PROT_OFFS)+offsetof(dcontext_t, native_call_generation))
 
 #define FRAGMENT_FIELD_OFFSET  ((PROT_OFFS)+offsetof(dcontext_t, fragment_field))
 #define PRIVATE_CODE_OFFSET    ((PROT_OFFS)+offsetof(dcontext_t, private_code))
@@ -339,6 +345,7 @@ typedef struct _clean_call_info_t {
     bool skip_clear_eflags;
     uint num_xmms_skip;
     bool xmm_skip[NUM_XMM_REGS];
+    bool skip_save_ymmh; /* save only the low 128 bits of the xmm regs saved */
     uint num_regs_skip;
     bool reg_skip[NUM_GP_REGS];
     bool preserve_mcontext; /* even if skip reg save, preserve mcontext shape */
@@ -494,6 +501,9 @@ void mangle_insert_clone_code(dcontext_t *dcontext, instrlist_t *ilist,
 /* the stack size of a full context switch for clean call */
 int
 get_clean_call_switch_stack_size(void);
+/* the stack size of a context switch that saves no xmm regs */
+int
+get_clean_call_noxmm_switch_stack_size(void);
 /* extra temporarily-used stack usage beyond
  * get_clean_call_switch_stack_size()
  */
@@ -534,8 +544,8 @@ int find_syscall_num(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr);
 
 /* in mangle.c  but not exported to non-arch files */
 int
-insert_out_of_line_context_switch(dcontext_t *dcontext, instrlist_t *ilist,
-                                  instr_t *instr, bool save);
+insert_out_of_line_context_switch(dcontext_t *dcontext, clean_call_info_t *cci,
+                                  instrlist_t *ilist, instr_t *instr, bool save);
 #ifdef X86
 /* mangle the instruction that reference memory via segment register */
 void
@@ -564,6 +574,14 @@ set_selfmod_sandbox_offsets(dcontext_t *dcontext);
 bool insert_selfmod_sandbox(dcontext_t *dcontext, instrlist_t *ilist, uint flags,
                             app_pc start_pc, app_pc end_pc, /* end is open */
                             bool record_translation, bool for_cache);
+void insert_fragment_exec_counter(dcontext_t *dcontext, instrlist_t *ilist, uint flags,
+                                  uint64 *counter, bool record_translation);
+
+/* in encode.c */
+void
+encode_thread_init(dcontext_t *dcontext);
+void
+encode_thread_exit(dcontext_t *dcontext);
 #endif /* X86 */
 
 #ifdef ARM
@@ -824,6 +842,9 @@ typedef struct _generated_code_t {
     /* i#171: out-of-line clean call context switch */
     byte *clean_call_save;
     byte *clean_call_restore;
+    /* variants for callees that touch no xmm regs */
+    byte *clean_call_save_noxmm;
+    byte *clean_call_restore_noxmm;
 
     bool thread_shared;
     bool writable;
@@ -865,8 +886,10 @@ cache_pc trace_head_return_coarse_routine(IF_X64(gencode_mode_t mode));
 
 /* shared clean call context switch */
 bool client_clean_call_is_thread_private();
-cache_pc get_clean_call_save(dcontext_t *dcontext _IF_X64(gencode_mode_t mode));
-cache_pc get_clean_call_restore(dcontext_t *dcontext _IF_X64(gencode_mode_t mode));
+cache_pc get_clean_call_save(dcontext_t *dcontext, bool save_xmm
+                             _IF_X64(gencode_mode_t mode));
+cache_pc get_clean_call_restore(dcontext_t *dcontext, bool save_xmm
+                                _IF_X64(gencode_mode_t mode));
 
 void protect_generated_code(generated_code_t *code, bool writable);
 
@@ -1075,10 +1098,12 @@ emit_native_ret_ibl_xfer(dcontext_t *dcontext, byte *pc, generated_code_t *code)
 
 /* clean calls are used by core DR: native_exec, so not in CLIENT_INTERFACE */
 byte *
-emit_clean_call_save(dcontext_t *dcontext, byte *pc, generated_code_t *code);
+emit_clean_call_save(dcontext_t *dcontext, byte *pc, generated_code_t *code,
+                     bool save_xmm);
 
 byte *
-emit_clean_call_restore(dcontext_t *dcontext, byte *pc, generated_code_t *code);
+emit_clean_call_restore(dcontext_t *dcontext, byte *pc, generated_code_t *code,
+                        bool save_xmm);
 
 void
 insert_save_eflags(dcontext_t *dcontext, instrlist_t *ilist, instr_t *where,
@@ -1215,6 +1240,7 @@ typedef struct _callee_info_t {
     app_pc fwd_tgt;           /* last forward branch target */
     int num_xmms_used;        /* number of xmms used by callee */
     bool xmm_used[NUM_XMM_REGS];  /* xmm/ymm registers usage */
+    bool ymmh_used;           /* if the function may write the top half of a ymm */
     bool reg_used[NUM_GP_REGS];   /* general purpose registers usage */
     int num_callee_save_regs; /* number of regs callee saved */
     bool callee_save_regs[NUM_GP_REGS]; /* callee-save registers */
@@ -85,6 +85,7 @@ typedef enum {
 } ibl_branch_type_t;
 
 #define IBL_HASH_FUNC_OFFSET_MAX IF_X64_ELSE(4,3)
+#define IBL_L1_BITS_MAX 16 /* for -ibl_l1_bits */
 
 struct _fragment_entry_t; /* in fragment.h */
 struct _ibl_table_t; /* in fragment.h */
@@ -117,6 +118,8 @@ typedef struct _table_stat_state_t {
      * used for BB2BB IBL.
      */
     lookup_table_access_t table[IBL_BRANCH_TYPE_END];
+    /* -ibl_l1_bits per-thread caches probed before each table */
+    struct _fragment_entry_t **l1_table[IBL_BRANCH_TYPE_END];
     /* FIXME: should allocate this separately so that release and
      * DEBUG builds have the same layout especially when backward
      * aligned entry */
@@ -146,6 +149,13 @@ typedef struct _spill_state_t {
 #endif
     /* FIXME: move this below the tables to fit more on cache line */
     dcontext_t *dcontext;
+#ifdef X86
+    /* -trace_ret_predict: the negated return address of the last call made
+     * from a trace, and the cache pc of the landing pad that exits to it.
+     */
+    reg_t ret_predict_negtag;
+    byte *ret_predict_pc;
+#endif
 #ifdef ARM
     /* We store addresses here so we can load pointer-sized addresses into
      * registers with a single instruction in our exit stubs and gencode.
@@ -198,6 +208,10 @@ typedef struct _local_state_extended_t {
 #define IBL_TARGET_REG           SCRATCH_REG2
 #define IBL_TARGET_SLOT          TLS_REG2_SLOT
 #define TLS_DCONTEXT_SLOT        ((ushort)offsetof(spill_state_t, dcontext))
+#ifdef X86
+# define TLS_RET_PREDICT_TAG_SLOT ((ushort)offsetof(spill_state_t, ret_predict_negtag))
+# define TLS_RET_PREDICT_PC_SLOT  ((ushort)offsetof(spill_state_t, ret_predict_pc))
+#endif
 #ifdef ARM
 # define TLS_FCACHE_RETURN_SLOT  ((ushort)offsetof(spill_state_t, fcache_return))
 #endif
@@ -209,6 +223,8 @@ typedef struct _local_state_extended_t {
 #define TLS_TABLE_SLOT(btype)    ((ushort)(TABLE_OFFSET                         \
                                   + offsetof(table_stat_state_t, table[btype])  \
                                   + offsetof(lookup_table_access_t, lookuptable)))
+#define TLS_L1_TABLE_SLOT(btype) ((ushort)(TABLE_OFFSET                         \
+                                  + offsetof(table_stat_state_t, l1_table[btype])))
 
 #ifdef HASHTABLE_STATISTICS
 # define TLS_HTABLE_STATS_SLOT   ((ushort)(offsetof(local_state_extended_t,     \
@@ -351,6 +367,8 @@ emit_detach_callback_final_jmp(dcontext_t *dcontext,
 #  define ATOMIC_COMPARE_EXCHANGE_PTR ATOMIC_COMPARE_EXCHANGE_int
 # endif
 # define SPINLOCK_PAUSE() _mm_pause() /* PAUSE = 0xf3 0x90 = repz nop */
+/* Keeps the compiler from moving memory accesses across this point */
+# define COMPILER_BARRIER() _ReadWriteBarrier()
 # define RDTSC_LL(var) (var = __rdtsc())
 # define SERIALIZE_INSTRUCTIONS() do { \
         int cpuid_res_local[4];        \
@@ -615,6 +633,8 @@ uint64 proc_get_timestamp(void);
 #  define SET_IF_NOT_LESS(flag) SET_FLAG(ge, flag)
 # endif /* X86/ARM */
 
+/* Keeps the compiler from moving memory accesses across this point */
+# define COMPILER_BARRIER() __asm__ __volatile__("" : : : "memory")
 # define ATOMIC_INC(type, var) ATOMIC_INC_##type(var)
 # define ATOMIC_DEC(type, var) ATOMIC_DEC_##type(var)
 # define ATOMIC_ADD(type, var, val) ATOMIC_ADD_##type(var, val)
@@ -1058,6 +1078,7 @@ void dr_fxrstor32(byte *buf_aligned);
 
 /* x86_code.c */
 void dynamo_start(priv_mcontext_t *mc);
+void dynamo_start_current_thread(priv_mcontext_t *mc);
 
 /* Gets the retstack index saved in x86.asm and restores the mcontext to the
  * original app state.
@@ -1637,8 +1658,13 @@ is_jmp_rel8(byte *code_buf, app_pc app_loc, app_pc *jmp_target /* OUT */);
  *
  *    (36-19)=17 vs (206-120)=86 => 69 bytes.  was 65 bytes prior to PR 209709!
  *    usually 3 bytes smaller since don't need to restore eflags.
+ *
+ * -trace_ret_predict adds at most one of its call-side (34 bytes plus a
+ * direct exit stub) or return-side (46 bytes) sequences on top.
  */
-#define TRACE_CTI_MANGLE_SIZE_UPPER_BOUND 72
+#define TRACE_RET_PREDICT_SIZE_UPPER_BOUND 56
+#define TRACE_CTI_MANGLE_SIZE_UPPER_BOUND \
+    (72 + (DYNAMO_OPTION(trace_ret_predict) ? TRACE_RET_PREDICT_SIZE_UPPER_BOUND : 0))
 
 fragment_t *
 build_basic_block_fragment(dcontext_t *dcontext, app_pc start_pc,
@@ -1646,10 +1672,15 @@ build_basic_block_fragment(dcontext_t *dcontext, app_pc start_pc,
                            _IF_CLIENT(bool for_trace)
                            _IF_CLIENT(instrlist_t **unmangled_ilist));
 
+void decode_cache_invalidate(app_pc start, app_pc end);
+
 void interp(dcontext_t *dcontext);
 uint extend_trace(dcontext_t *dcontext, fragment_t *f, linkstub_t *prev_l);
 int append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
-                                    app_pc speculate_next_tag, bool record_translation);
+                                    app_pc speculate_next_tag, app_pc speculate_alt_tag,
+                                    bool record_translation);
+int append_trace_ret_predict(dcontext_t *dcontext, instrlist_t *trace,
+                             uint trace_flags, bool record_translation);
 
 uint
 forward_eflags_analysis(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr);
@@ -174,6 +174,15 @@ GLOBAL_LABEL(dr_app_start:)
         bl       GLOBAL_REF(unexpected_return)
         END_FUNC(dr_app_start)
 
+/*
+ * dr_app_start_thread - Causes only the current thread to run under Dynamo control
+ */
+        DECLARE_EXPORTED_FUNC(dr_app_start_thread)
+GLOBAL_LABEL(dr_app_start_thread:)
+        /* FIXME i#1551: NYI on ARM */
+        bl       GLOBAL_REF(unexpected_return)
+        END_FUNC(dr_app_start_thread)
+
 /*
  * dr_app_take_over - For the client interface, we'll export 'dr_app_take_over'
  * for consistency with the dr_ naming convention of all exported functions.
@@ -395,8 +395,8 @@ insert_reachable_cti(dcontext_t *dcontext, instrlist_t *ilist, instr_t *where,
 }
 
 int
-insert_out_of_line_context_switch(dcontext_t *dcontext, instrlist_t *ilist,
-                                  instr_t *instr, bool save)
+insert_out_of_line_context_switch(dcontext_t *dcontext, clean_call_info_t *cci,
+                                  instrlist_t *ilist, instr_t *instr, bool save)
 {
     /* FIXME i#1551: NYI on ARM */
     ASSERT_NOT_IMPLEMENTED(false);
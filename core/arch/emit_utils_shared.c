@@ -64,6 +64,7 @@
 #endif
 #include <limits.h> /* for UCHAR_MAX */
 #include "../perscache.h"
+#include "../native_exec.h" /* for call_to_native() */
 
 #ifdef VMX86_SERVER
 # include "vmkuw.h"
@@ -5520,15 +5521,34 @@ client_clean_call_is_thread_private(void)
 #endif
 }
 
+/* Sets up cci to describe the context saved by the out-of-line clean call
+ * routines: everything, or everything but the xmm regs.  Returns the size
+ * of the saved context.
+ */
+static int
+clean_call_out_of_line_info(clean_call_info_t *cci, bool save_xmm)
+{
+    *cci = default_clean_call_info;
+    if (save_xmm)
+        return get_clean_call_switch_stack_size();
+    memset(cci->xmm_skip, 1, sizeof(cci->xmm_skip));
+    cci->num_xmms_skip = NUM_XMM_REGS;
+    return get_clean_call_noxmm_switch_stack_size();
+}
+
 byte *
-emit_clean_call_save(dcontext_t *dcontext, byte *pc, generated_code_t *code)
+emit_clean_call_save(dcontext_t *dcontext, byte *pc, generated_code_t *code,
+                     bool save_xmm)
 {
     instrlist_t ilist;
+    clean_call_info_t cci;
+    int switch_size;
 #ifdef ARM
     /* FIXME i#1551: NYI on ARM (no assert here, it's in get_clean_call_save()) */
     return pc;
 #endif
 
+    switch_size = clean_call_out_of_line_info(&cci, save_xmm);
     instrlist_init(&ilist);
     /* xref insert_out_of_line_context_switch @ x86/mangle.c,
      * stack was adjusted beyond what we place there to get retaddr
@@ -5542,13 +5562,13 @@ emit_clean_call_save(dcontext_t *dcontext, byte *pc, generated_code_t *code)
         (dcontext,
          opnd_create_reg(DR_REG_XSP),
          opnd_create_base_disp(DR_REG_XSP, DR_REG_NULL, 0,
-                               (int)(get_clean_call_switch_stack_size() +
+                               (int)(switch_size +
                                      get_clean_call_temp_stack_size() +
                                      XSP_SZ /* return addr */),
                                OPSZ_lea)));
 
     /* save all registers */
-    insert_push_all_registers(dcontext, NULL, &ilist, NULL, PAGE_SIZE,
+    insert_push_all_registers(dcontext, &cci, &ilist, NULL, PAGE_SIZE,
                               OPND_CREATE_INT32(0), REG_NULL);
 #elif defined(ARM)
     /* FIXME i#1551: NYI on ARM */
@@ -5601,14 +5621,18 @@ emit_clean_call_save(dcontext_t *dcontext, byte *pc, generated_code_t *code)
 }
 
 byte *
-emit_clean_call_restore(dcontext_t *dcontext, byte *pc, generated_code_t *code)
+emit_clean_call_restore(dcontext_t *dcontext, byte *pc, generated_code_t *code,
+                        bool save_xmm)
 {
     instrlist_t ilist;
+    clean_call_info_t cci;
+    int switch_size;
 #ifdef ARM
     /* FIXME i#1551: NYI on ARM (no assert here, it's in get_clean_call_restore()) */
     return pc;
 #endif
 
+    switch_size = clean_call_out_of_line_info(&cci, save_xmm);
     instrlist_init(&ilist);
 
 #ifdef WINDOWS
@@ -5632,19 +5656,18 @@ emit_clean_call_restore(dcontext_t *dcontext, byte *pc, generated_code_t *code)
          opnd_create_base_disp(DR_REG_XSP, DR_REG_NULL, 0,
                                (int)XSP_SZ, OPSZ_lea)));
     /* restore all registers */
-    insert_pop_all_registers(dcontext, NULL, &ilist, NULL, PAGE_SIZE);
+    insert_pop_all_registers(dcontext, &cci, &ilist, NULL, PAGE_SIZE);
     /* return back */
     /* we adjust lea + ret_imm instead of ind jmp to take advantage of RSB */
     APP(&ilist, INSTR_CREATE_lea
         (dcontext,
          opnd_create_reg(DR_REG_XSP),
          opnd_create_base_disp(DR_REG_XSP, DR_REG_NULL, 0,
-                               -(get_clean_call_switch_stack_size() +
+                               -(switch_size +
                                  (int)XSP_SZ /* return address */),
                                OPSZ_lea)));
     APP(&ilist, INSTR_CREATE_ret_imm
-        (dcontext,
-         OPND_CREATE_INT16(get_clean_call_switch_stack_size())));
+        (dcontext, OPND_CREATE_INT16(switch_size)));
 #elif defined(ARM)
     /* FIXMED i#1551: NYI on ARM */
     ASSERT_NOT_IMPLEMENTED(false);
@@ -5767,6 +5790,97 @@ insert_return_to_native(dcontext_t *dcontext, instrlist_t *ilist, instr_t *where
      */
 }
 
+#if defined(UNIX) && defined(X86)
+/* Emits reg_cmp = reg_cmp - dcontext field at offs followed by a jecxz to tgt,
+ * without touching the arithmetic flags.  Clobbers reg_scratch.
+ */
+static void
+insert_jecxz_if_dc_field_equal(dcontext_t *dcontext, instrlist_t *ilist,
+                               instr_t *where, reg_id_t reg_dc, reg_id_t reg_scratch,
+                               uint offs, instr_t *tgt)
+{
+    PRE(ilist, where,
+        instr_create_restore_from_dc_via_reg(dcontext, reg_dc, reg_scratch, offs));
+    PRE(ilist, where, INSTR_CREATE_not(dcontext, opnd_create_reg(reg_scratch)));
+    PRE(ilist, where,
+        INSTR_CREATE_lea(dcontext, opnd_create_reg(SCRATCH_REG2),
+                         opnd_create_base_disp(SCRATCH_REG2, reg_scratch, 1, 1,
+                                               OPSZ_lea)));
+    PRE(ilist, where, INSTR_CREATE_jecxz(dcontext, opnd_create_instr(tgt)));
+}
+
+/* Partially inlined call_to_native(): if the return address on top of the app
+ * stack matches this thread's cached dcontext->native_call_retaddr, and no
+ * non-native module has been unloaded since (which frees ret stubs), the
+ * return address is replaced with the cached ret stub and we go native without
+ * a context switch.  Otherwise we fall back to a clean call to
+ * call_to_native(), which refills the cache.  Does not touch eflags.
+ * Two registers are needed:
+ * - reg_dc holds the dcontext
+ * - reg_scratch is the scratch register and must already be saved.
+ * SCRATCH_REG2 (xcx) is saved and restored here for the jecxz.
+ */
+void
+insert_call_to_native(dcontext_t *dcontext, instrlist_t *ilist, instr_t *where,
+                      reg_id_t reg_dc, reg_id_t reg_scratch)
+{
+    instr_t *check_gen = INSTR_CREATE_label(dcontext);
+    instr_t *hit = INSTR_CREATE_label(dcontext);
+    instr_t *miss = INSTR_CREATE_label(dcontext);
+    instr_t *slow = INSTR_CREATE_label(dcontext);
+    instr_t *done = INSTR_CREATE_label(dcontext);
+    ASSERT(DYNAMO_OPTION(native_exec_opt) && DYNAMO_OPTION(native_exec_retakeover));
+    ASSERT(reg_scratch != SCRATCH_REG2 && reg_dc != SCRATCH_REG2);
+
+    PRE(ilist, where, instr_create_save_to_dc_via_reg(dcontext, reg_dc, SCRATCH_REG2,
+                                                      SCRATCH_REG2_OFFS));
+    /* [xsp] == dcontext->native_call_retaddr? */
+    PRE(ilist, where, XINST_CREATE_load(dcontext, opnd_create_reg(SCRATCH_REG2),
+                                        OPND_CREATE_MEMPTR(REG_XSP, 0)));
+    insert_jecxz_if_dc_field_equal(dcontext, ilist, where, reg_dc, reg_scratch,
+                                   NATIVE_CALL_RETADDR_OFFSET, check_gen);
+    PRE(ilist, where, XINST_CREATE_jump(dcontext, opnd_create_instr(miss)));
+    /* native_call_cache_generation == dcontext->native_call_generation? */
+    PRE(ilist, where, check_gen);
+    PRE(ilist, where, INSTR_CREATE_mov_imm
+        (dcontext, opnd_create_reg(SCRATCH_REG2),
+         OPND_CREATE_INTPTR((ptr_int_t)&native_call_cache_generation)));
+    PRE(ilist, where, XINST_CREATE_load(dcontext, opnd_create_reg(SCRATCH_REG2),
+                                        OPND_CREATE_MEMPTR(SCRATCH_REG2, 0)));
+    insert_jecxz_if_dc_field_equal(dcontext, ilist, where, reg_dc, reg_scratch,
+                                   NATIVE_CALL_GENERATION_OFFSET, hit);
+    PRE(ilist, where, miss);
+    PRE(ilist, where, instr_create_restore_from_dc_via_reg(dcontext, reg_dc,
+                                                           SCRATCH_REG2,
+                                                           SCRATCH_REG2_OFFS));
+    PRE(ilist, where, XINST_CREATE_jump(dcontext, opnd_create_instr(slow)));
+
+    /* C equivalent:
+     *   prepare_return_from_native_via_stub(dcontext, app_sp)
+     * with the ret stub lookup served from the cache.
+     */
+    PRE(ilist, where, hit);
+    PRE(ilist, where, instr_create_restore_from_dc_via_reg(dcontext, reg_dc,
+                                                           SCRATCH_REG2,
+                                                           SCRATCH_REG2_OFFS));
+    PRE(ilist, where,
+        instr_create_restore_from_dc_via_reg(dcontext, reg_dc, reg_scratch,
+                                             NATIVE_CALL_RETSTUB_OFFSET));
+    PRE(ilist, where, XINST_CREATE_store(dcontext, OPND_CREATE_MEMPTR(REG_XSP, 0),
+                                         opnd_create_reg(reg_scratch)));
+    /* C equivalent:
+     *   entering_native(dcontext)
+     */
+    insert_entering_native(dcontext, ilist, where, reg_dc, reg_scratch);
+    PRE(ilist, where, XINST_CREATE_jump(dcontext, opnd_create_instr(done)));
+
+    PRE(ilist, where, slow);
+    dr_insert_clean_call(dcontext, ilist, where, (void *)call_to_native, false/*!fp*/,
+                         1, opnd_create_reg(REG_XSP));
+    PRE(ilist, where, done);
+}
+#endif
+
 #if defined(UNIX)
 static void
 insert_entering_non_native(dcontext_t *dcontext, instrlist_t *ilist, instr_t *where,
@@ -338,6 +338,17 @@ typedef enum _dr_opnd_query_flags_t {
  */
 /* DR_API EXPORT BEGIN */
 
+/**
+ * The number of source operands beyond the first that an instr_t holds
+ * without a separate allocation.
+ */
+#define INSTR_INLINE_SRCS 2
+/**
+ * The number of destination operands that an instr_t holds without a
+ * separate allocation.
+ */
+#define INSTR_INLINE_DSTS 2
+
 /**
  * instr_t type exposed for optional "fast IR" access.  Note that DynamoRIO
  * reserves the right to change this structure across releases and does
@@ -364,9 +375,10 @@ struct _instr_t {
     byte    rip_rel_pos;
 #endif
 
-    /* we dynamically allocate dst and src arrays b/c x86 instrs can have
-     * up to 8 of each of them, but most have <=2 dsts and <=3 srcs, and we
-     * use this struct for un-decoded instrs too
+    /* x86 instrs can have up to 8 dsts and 8 srcs, but most have <=2 dsts
+     * and <=3 srcs, so srcs and dsts point at the inline_ arrays below when
+     * the operands fit there and we only allocate the arrays for the rest.
+     * srcs is NULL with at most one src, and dsts is NULL with no dsts.
      */
     byte    num_dsts;
     byte    num_srcs;
@@ -375,7 +387,6 @@ struct _instr_t {
         struct {
             /* for efficiency everyone has a 1st src opnd, since we often just
              * decode jumps, which all have a single source (==target)
-             * yes this is an extra 10 bytes, but the whole struct is still < 64 bytes!
              */
             opnd_t    src0;
             opnd_t    *srcs; /* this array has 2nd src and beyond */
@@ -383,6 +394,8 @@ struct _instr_t {
         };
         dr_instr_label_data_t label_data;
     };
+    opnd_t    inline_srcs[INSTR_INLINE_SRCS];
+    opnd_t    inline_dsts[INSTR_INLINE_DSTS];
 
     uint    prefixes; /* data size, addr size, or lock prefix info */
     uint    eflags;   /* contains EFLAGS_ bits, but amount of info varies
@@ -780,6 +793,12 @@ DR_API
 instr_t *
 instr_clone(dcontext_t *dcontext, instr_t *orig);
 
+/* Re-points srcs and dsts at instr's own inline operands after another instr_t
+ * was copied into instr by value.
+ */
+void
+instr_reattach_inline_opnds(instr_t *instr);
+
 DR_API
 /**
  * Convenience routine: calls
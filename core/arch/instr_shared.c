@@ -87,7 +87,7 @@
 instr_t*
 instr_create(dcontext_t *dcontext)
 {
-    instr_t *instr = (instr_t*) heap_alloc(dcontext, sizeof(instr_t) HEAPACCT(ACCT_IR));
+    instr_t *instr = (instr_t*) heap_arena_alloc(dcontext, sizeof(instr_t) HEAPACCT(ACCT_IR));
     /* everything initializes to 0, even flags, to indicate
      * an uninitialized instruction */
     memset((void *)instr, 0, sizeof(instr_t));
@@ -106,14 +106,65 @@ instr_destroy(dcontext_t *dcontext, instr_t *instr)
     instr_free(dcontext, instr);
 
     /* CAUTION: assumes that instr is not part of any instrlist */
-    heap_free(dcontext, instr, sizeof(instr_t) HEAPACCT(ACCT_IR));
+    heap_arena_free(dcontext, instr, sizeof(instr_t) HEAPACCT(ACCT_IR));
+}
+
+/* Returns storage for num_dsts dst operands: instr's inline array if they fit,
+ * else a new array.
+ */
+static inline opnd_t *
+instr_alloc_dsts(dcontext_t *dcontext, instr_t *instr, uint num_dsts)
+{
+    if (num_dsts == 0)
+        return NULL;
+    if (num_dsts <= INSTR_INLINE_DSTS)
+        return instr->inline_dsts;
+    return (opnd_t *) heap_arena_alloc(dcontext, num_dsts*sizeof(opnd_t)
+                                       HEAPACCT(ACCT_IR));
+}
+
+/* Returns storage for the operands beyond src0 of num_srcs src operands. */
+static inline opnd_t *
+instr_alloc_srcs(dcontext_t *dcontext, instr_t *instr, uint num_srcs)
+{
+    if (num_srcs <= 1)
+        return NULL;
+    if (num_srcs - 1 <= INSTR_INLINE_SRCS)
+        return instr->inline_srcs;
+    return (opnd_t *) heap_arena_alloc(dcontext, (num_srcs-1)*sizeof(opnd_t)
+                                       HEAPACCT(ACCT_IR));
+}
+
+static inline void
+instr_free_dsts(dcontext_t *dcontext, opnd_t *dsts, uint num_dsts)
+{
+    if (num_dsts > INSTR_INLINE_DSTS)
+        heap_arena_free(dcontext, dsts, num_dsts*sizeof(opnd_t) HEAPACCT(ACCT_IR));
+}
+
+static inline void
+instr_free_srcs(dcontext_t *dcontext, opnd_t *srcs, uint num_srcs)
+{
+    if (num_srcs > 1 && num_srcs - 1 > INSTR_INLINE_SRCS)
+        heap_arena_free(dcontext, srcs, (num_srcs-1)*sizeof(opnd_t) HEAPACCT(ACCT_IR));
+}
+
+void
+instr_reattach_inline_opnds(instr_t *instr)
+{
+    if (instr_is_label(instr))
+        return;
+    if (instr->num_dsts > 0 && instr->num_dsts <= INSTR_INLINE_DSTS)
+        instr->dsts = instr->inline_dsts;
+    if (instr->num_srcs > 1 && instr->num_srcs - 1 <= INSTR_INLINE_SRCS)
+        instr->srcs = instr->inline_srcs;
 }
 
 /* returns a clone of orig, but with next and prev fields set to NULL */
 instr_t *
 instr_clone(dcontext_t *dcontext, instr_t *orig)
 {
-    instr_t *instr = (instr_t*) heap_alloc(dcontext, sizeof(instr_t) HEAPACCT(ACCT_IR));
+    instr_t *instr = (instr_t*) heap_arena_alloc(dcontext, sizeof(instr_t) HEAPACCT(ACCT_IR));
     memcpy((void *)instr, (void *)orig, sizeof(instr_t));
     instr->next = NULL;
     instr->prev = NULL;
@@ -126,7 +177,7 @@ instr_clone(dcontext_t *dcontext, instr_t *orig)
 
     if ((orig->flags & INSTR_RAW_BITS_ALLOCATED) != 0) {
         /* instr length already set from memcpy */
-        instr->bytes = (byte *) heap_alloc(dcontext, instr->length
+        instr->bytes = (byte *) heap_arena_alloc(dcontext, instr->length
                                            HEAPACCT(ACCT_IR));
         memcpy((void *)instr->bytes, (void *)orig->bytes, instr->length);
     }
@@ -140,15 +191,13 @@ instr_clone(dcontext_t *dcontext, instr_t *orig)
     else /* disable normal dst cloning */
 #endif
     if (orig->num_dsts > 0) { /* checking num_dsts, not dsts, b/c of label data */
-        instr->dsts = (opnd_t *) heap_alloc(dcontext, instr->num_dsts*sizeof(opnd_t)
-                                          HEAPACCT(ACCT_IR));
+        instr->dsts = instr_alloc_dsts(dcontext, instr, instr->num_dsts);
+        /* orig's operands need not be inline even if they fit (decode cache) */
         memcpy((void *)instr->dsts, (void *)orig->dsts,
                instr->num_dsts*sizeof(opnd_t));
     }
     if (orig->num_srcs > 1) { /* checking num_src, not srcs, b/c of label data */
-        instr->srcs = (opnd_t *) heap_alloc(dcontext,
-                                          (instr->num_srcs-1)*sizeof(opnd_t)
-                                          HEAPACCT(ACCT_IR));
+        instr->srcs = instr_alloc_srcs(dcontext, instr, instr->num_srcs);
         memcpy((void *)instr->srcs, (void *)orig->srcs,
                (instr->num_srcs-1)*sizeof(opnd_t));
     }
@@ -174,7 +223,7 @@ void
 instr_free(dcontext_t *dcontext, instr_t *instr)
 {
     if ((instr->flags & INSTR_RAW_BITS_ALLOCATED) != 0) {
-        heap_free(dcontext, instr->bytes, instr->length HEAPACCT(ACCT_IR));
+        heap_arena_free(dcontext, instr->bytes, instr->length HEAPACCT(ACCT_IR));
         instr->bytes = NULL;
         instr->flags &= ~INSTR_RAW_BITS_ALLOCATED;
     }
@@ -188,15 +237,13 @@ instr_free(dcontext_t *dcontext, instr_t *instr)
     }
 #endif
     if (instr->num_dsts > 0) { /* checking num_dsts, not dsts, b/c of label data */
-        heap_free(dcontext, instr->dsts, instr->num_dsts*sizeof(opnd_t)
-                  HEAPACCT(ACCT_IR));
+        instr_free_dsts(dcontext, instr->dsts, instr->num_dsts);
         instr->dsts = NULL;
         instr->num_dsts = 0;
     }
     if (instr->num_srcs > 1) { /* checking num_src, not src, b/c of label data */
-        /* remember one src is static, rest are dynamic */
-        heap_free(dcontext, instr->srcs, (instr->num_srcs-1)*sizeof(opnd_t)
-                  HEAPACCT(ACCT_IR));
+        /* remember one src is static, rest are inline or dynamic */
+        instr_free_srcs(dcontext, instr->srcs, instr->num_srcs);
         instr->srcs = NULL;
         instr->num_srcs = 0;
     }
@@ -220,11 +267,11 @@ instr_mem_usage(instr_t *instr)
             usage += instr_mem_usage(in);
     }
 #endif
-    if (instr->dsts != NULL) {
+    if (instr->num_dsts > INSTR_INLINE_DSTS) {
         usage += instr->num_dsts*sizeof(opnd_t);
     }
-    if (instr->srcs != NULL) {
-        /* remember one src is static, rest are dynamic */
+    if (instr->num_srcs > 1 && instr->num_srcs - 1 > INSTR_INLINE_SRCS) {
+        /* remember one src is static, rest are inline or dynamic */
         usage += (instr->num_srcs-1)*sizeof(opnd_t);
     }
     usage += sizeof(instr_t);
@@ -327,7 +374,7 @@ private_instr_encode(dcontext_t *dcontext, instr_t *instr, bool always_cache)
     /* we cannot use a stack buffer for encoding since our stack on x64 linux
      * can be too far to reach from our heap
      */
-    byte *buf = heap_alloc(dcontext, 32 /* max instr length is 17 bytes */
+    byte *buf = heap_arena_alloc(dcontext, 32 /* max instr length is 17 bytes */
                            HEAPACCT(ACCT_IR));
     uint len;
     /* Do not cache instr opnds as they are pc-relative to final encoding location.
@@ -344,7 +391,7 @@ private_instr_encode(dcontext_t *dcontext, instr_t *instr, bool always_cache)
             SYSLOG_INTERNAL_WARNING("cannot encode %s", opcode_to_encoding_info
                                     (instr->opcode, instr_get_isa_mode(instr)
                                      _IF_ARM(false))->name);
-            heap_free(dcontext, buf, 32 HEAPACCT(ACCT_IR));
+            heap_arena_free(dcontext, buf, 32 HEAPACCT(ACCT_IR));
             return 0;
         }
         /* if unreachable, we can't cache, since re-relativization won't work */
@@ -392,7 +439,7 @@ private_instr_encode(dcontext_t *dcontext, instr_t *instr, bool always_cache)
         instr->bytes = tmp;
         instr_set_operands_valid(instr, valid);
     }
-    heap_free(dcontext, buf, 32 HEAPACCT(ACCT_IR));
+    heap_arena_free(dcontext, buf, 32 HEAPACCT(ACCT_IR));
     return len;
 }
 
@@ -533,16 +580,14 @@ instr_set_num_opnds(dcontext_t *dcontext,
         CLIENT_ASSERT_TRUNCATE(instr->num_dsts, byte, instr_num_dsts,
                                "instr_set_num_opnds: too many dsts");
         instr->num_dsts = (byte) instr_num_dsts;
-        instr->dsts = (opnd_t *) heap_alloc(dcontext, instr_num_dsts*sizeof(opnd_t)
-                                          HEAPACCT(ACCT_IR));
+        instr->dsts = instr_alloc_dsts(dcontext, instr, instr_num_dsts);
     }
     if (instr_num_srcs > 0) {
-        /* remember that src0 is static, rest are dynamic */
+        /* remember that src0 is static, rest are inline or dynamic */
         if (instr_num_srcs > 1) {
             CLIENT_ASSERT(instr->num_srcs <= 1 && instr->srcs == NULL,
                           "instr_set_num_opnds: srcs are already set");
-            instr->srcs = (opnd_t *) heap_alloc(dcontext, (instr_num_srcs-1)*sizeof(opnd_t)
-                                              HEAPACCT(ACCT_IR));
+            instr->srcs = instr_alloc_srcs(dcontext, instr, instr_num_srcs);
         }
         CLIENT_ASSERT_TRUNCATE(instr->num_srcs, byte, instr_num_srcs,
                                "instr_set_num_opnds: too many srcs");
@@ -586,25 +631,32 @@ void
 instr_remove_srcs(dcontext_t *dcontext, instr_t *instr, uint start, uint end)
 {
     opnd_t *new_srcs;
+    uint new_num;
     CLIENT_ASSERT(start >= 0 && end <= instr->num_srcs && start < end,
                   "instr_remove_srcs: ordinals invalid");
-    if (instr->num_srcs - 1 > (byte)(end - start)) {
-        new_srcs = (opnd_t *) heap_alloc
-            (dcontext, (instr->num_srcs - 1 - (end-start))*sizeof(opnd_t)
-             HEAPACCT(ACCT_IR));
-        if (start > 1)
+    new_num = instr->num_srcs - (end - start);
+    if (start == 0) {
+        if (end < instr->num_srcs)
+            instr->src0 = instr->srcs[end - 1];
+        /* now treat it as removing [1, end] from the srcs array, which starts
+         * at src 1
+         */
+        start = 1;
+        end++;
+    }
+    new_srcs = instr_alloc_srcs(dcontext, instr, new_num);
+    if (new_srcs != NULL) {
+        /* the inline array may be both the old and the new one */
+        if (new_srcs != instr->srcs && start > 1)
             memcpy(new_srcs, instr->srcs, (start-1)*sizeof(opnd_t));
-        if ((byte)end < instr->num_srcs - 1) {
-            memcpy(new_srcs + (start == 0 ? 0 : (start-1)), instr->srcs + end,
-                   (instr->num_srcs - 1 - end)*sizeof(opnd_t));
+        if (end < instr->num_srcs) {
+            memmove(new_srcs + (start-1), instr->srcs + (end-1),
+                    (instr->num_srcs - end)*sizeof(opnd_t));
         }
-    } else
-        new_srcs = NULL;
-    if (start == 0 && end < instr->num_srcs)
-        instr->src0 = instr->srcs[end - 1];
-    heap_free(dcontext, instr->srcs, (instr->num_srcs-1)*sizeof(opnd_t)
-              HEAPACCT(ACCT_IR));
-    instr->num_srcs -= (byte)(end - start);
+    }
+    if (new_srcs != instr->srcs)
+        instr_free_srcs(dcontext, instr->srcs, instr->num_srcs);
+    instr->num_srcs = (byte) new_num;
     instr->srcs = new_srcs;
     instr_being_modified(instr, false/*raw bits invalid*/);
     instr_set_operands_valid(instr, true);
@@ -615,21 +667,23 @@ void
 instr_remove_dsts(dcontext_t *dcontext, instr_t *instr, uint start, uint end)
 {
     opnd_t *new_dsts;
+    uint new_num;
     CLIENT_ASSERT(start >= 0 && end <= instr->num_dsts && start < end,
                   "instr_remove_dsts: ordinals invalid");
-    if (instr->num_dsts > (byte)(end - start)) {
-        new_dsts = (opnd_t *) heap_alloc
-            (dcontext, (instr->num_dsts - (end-start))*sizeof(opnd_t) HEAPACCT(ACCT_IR));
-        if (start > 0)
+    new_num = instr->num_dsts - (end - start);
+    new_dsts = instr_alloc_dsts(dcontext, instr, new_num);
+    if (new_dsts != NULL) {
+        /* the inline array may be both the old and the new one */
+        if (new_dsts != instr->dsts && start > 0)
             memcpy(new_dsts, instr->dsts, start*sizeof(opnd_t));
         if (end < instr->num_dsts) {
-            memcpy(new_dsts + start, instr->dsts + end,
-                   (instr->num_dsts - end)*sizeof(opnd_t));
+            memmove(new_dsts + start, instr->dsts + end,
+                    (instr->num_dsts - end)*sizeof(opnd_t));
         }
-    } else
-        new_dsts = NULL;
-    heap_free(dcontext, instr->dsts, instr->num_dsts*sizeof(opnd_t) HEAPACCT(ACCT_IR));
-    instr->num_dsts -= (byte)(end - start);
+    }
+    if (new_dsts != instr->dsts)
+        instr_free_dsts(dcontext, instr->dsts, instr->num_dsts);
+    instr->num_dsts = (byte) new_num;
     instr->dsts = new_dsts;
     instr_being_modified(instr, false/*raw bits invalid*/);
     instr_set_operands_valid(instr, true);
@@ -1076,7 +1130,7 @@ instr_free_raw_bits(dcontext_t *dcontext, instr_t *instr)
 {
     if ((instr->flags & INSTR_RAW_BITS_ALLOCATED) == 0)
         return;
-    heap_free(dcontext, instr->bytes, instr->length HEAPACCT(ACCT_IR));
+    heap_arena_free(dcontext, instr->bytes, instr->length HEAPACCT(ACCT_IR));
     instr->flags &= ~INSTR_RAW_BITS_VALID;
     instr->flags &= ~INSTR_RAW_BITS_ALLOCATED;
 }
@@ -1093,7 +1147,7 @@ instr_allocate_raw_bits(dcontext_t *dcontext, instr_t *instr, uint num_bytes)
         original_bits = instr->bytes;
     if ((instr->flags & INSTR_RAW_BITS_ALLOCATED) == 0 ||
         instr->length != num_bytes) {
-        byte * new_bits = (byte *) heap_alloc(dcontext, num_bytes HEAPACCT(ACCT_IR));
+        byte * new_bits = (byte *) heap_arena_alloc(dcontext, num_bytes HEAPACCT(ACCT_IR));
         if (original_bits != NULL) {
             /* copy original bits into modified bits so can just modify
              * a few and still have all info in one place
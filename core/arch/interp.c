@@ -119,6 +119,134 @@ volatile bool bb_lock_start;
 file_t bbdump_file = INVALID_FILE;
 #endif
 
+/* -decode_cache: full decodes of application instrs keyed by app pc, so that
+ * rebuilding a bb after a flush, a reset, or for a trace does not decode the
+ * same code again.  Entries are dropped by decode_cache_invalidate() whenever
+ * a region is flushed or starts being tracked as executable, which together
+ * cover every way its code can change while an entry exists.
+ */
+typedef struct _decode_cache_entry_t {
+    /* Template: raw bits point at the app pc, and the operands beyond src0
+     * live right after this struct.
+     */
+    instr_t instr;
+    size_t size; /* of the whole allocation */
+} decode_cache_entry_t;
+
+/* keeps the cache's memory bounded: we clear it all when full */
+#define DECODE_CACHE_MAX_ENTRIES (64*1024)
+#define INIT_HTABLE_SIZE_DECODE_CACHE 12
+
+static generic_table_t *decode_cache;
+/* Bumped on every invalidation, under the table's write lock, so a decode
+ * that raced with one is not added.
+ */
+static uint decode_cache_flushtime;
+/* bounds of the cached pcs, to skip invalidating unrelated regions */
+static app_pc decode_cache_min_pc;
+static app_pc decode_cache_max_pc;
+
+static void
+decode_cache_entry_free(void *p)
+{
+    decode_cache_entry_t *e = (decode_cache_entry_t *) p;
+    global_heap_free(e, e->size HEAPACCT(ACCT_IR));
+}
+
+/* Drops cached decodes of any instr starting in [start, end). */
+void
+decode_cache_invalidate(app_pc start, app_pc end)
+{
+    uint removed;
+    if (decode_cache == NULL)
+        return;
+    TABLE_RWLOCK(decode_cache, write, lock);
+    decode_cache_flushtime++;
+    if (start < decode_cache_max_pc + MAX_INSTR_LENGTH && end > decode_cache_min_pc) {
+        /* start at the max instr length back so we cover instrs spanning start */
+        app_pc from = (start > (app_pc) MAX_INSTR_LENGTH) ?
+            start - MAX_INSTR_LENGTH : NULL;
+        removed = generic_hash_range_remove(GLOBAL_DCONTEXT, decode_cache,
+                                            (ptr_uint_t) from, (ptr_uint_t) end);
+        STATS_ADD(num_decode_cache_invalidations, removed);
+    }
+    TABLE_RWLOCK(decode_cache, write, unlock);
+}
+
+/* Decodes the instr at pc like decode(), replaying a cached decode if there is
+ * one.  Since that produces a fresh instr, *instr may be replaced.
+ */
+static app_pc
+decode_cache_decode(dcontext_t *dcontext, app_pc pc, instr_t **instr)
+{
+    decode_cache_entry_t *e;
+    app_pc next_pc;
+    uint flushtime;
+    size_t size;
+    uint num_opnds;
+
+    TABLE_RWLOCK(decode_cache, read, lock);
+    e = (decode_cache_entry_t *)
+        generic_hash_lookup(GLOBAL_DCONTEXT, decode_cache, (ptr_uint_t) pc);
+    if (e != NULL && instr_get_isa_mode(&e->instr) == dr_get_isa_mode(dcontext)) {
+        instr_destroy(dcontext, *instr);
+        *instr = instr_clone(dcontext, &e->instr);
+        next_pc = pc + e->instr.length;
+        TABLE_RWLOCK(decode_cache, read, unlock);
+        STATS_INC(num_decode_cache_hits);
+        return next_pc;
+    }
+    flushtime = decode_cache_flushtime;
+    TABLE_RWLOCK(decode_cache, read, unlock);
+
+    next_pc = decode(dcontext, pc, *instr);
+    if (next_pc == NULL || !instr_valid(*instr) || !instr_raw_bits_valid(*instr) ||
+        TEST(INSTR_RAW_BITS_ALLOCATED, (*instr)->flags))
+        return next_pc;
+
+    num_opnds = (*instr)->num_dsts +
+        ((*instr)->num_srcs > 1 ? (*instr)->num_srcs - 1 : 0);
+    size = sizeof(*e) + num_opnds * sizeof(opnd_t);
+    e = (decode_cache_entry_t *) global_heap_alloc(size HEAPACCT(ACCT_IR));
+    memcpy(&e->instr, *instr, sizeof(e->instr));
+    e->instr.next = NULL;
+    e->instr.prev = NULL;
+    e->instr.note = NULL;
+    e->instr.translation = NULL;
+    e->instr.dsts = (opnd_t *) (e + 1);
+    if ((*instr)->num_dsts > 0) {
+        memcpy(e->instr.dsts, (*instr)->dsts, (*instr)->num_dsts * sizeof(opnd_t));
+    }
+    e->instr.srcs = e->instr.dsts + (*instr)->num_dsts;
+    if ((*instr)->num_srcs > 1) {
+        memcpy(e->instr.srcs, (*instr)->srcs,
+               ((*instr)->num_srcs - 1) * sizeof(opnd_t));
+    }
+    e->size = size;
+
+    TABLE_RWLOCK(decode_cache, write, lock);
+    if (flushtime != decode_cache_flushtime ||
+        generic_hash_lookup(GLOBAL_DCONTEXT, decode_cache, (ptr_uint_t) pc) != NULL) {
+        /* the code may have changed since we read it, or another thread won */
+        TABLE_RWLOCK(decode_cache, write, unlock);
+        decode_cache_entry_free(e);
+        return next_pc;
+    }
+    if (decode_cache->entries >= DECODE_CACHE_MAX_ENTRIES) {
+        generic_hash_clear(GLOBAL_DCONTEXT, decode_cache);
+        decode_cache_min_pc = NULL;
+        decode_cache_max_pc = NULL;
+    }
+    generic_hash_add(GLOBAL_DCONTEXT, decode_cache, (ptr_uint_t) pc, e);
+    if (decode_cache_min_pc == NULL || pc < decode_cache_min_pc)
+        decode_cache_min_pc = pc;
+    if (pc > decode_cache_max_pc)
+        decode_cache_max_pc = pc;
+    TABLE_RWLOCK(decode_cache, write, unlock);
+    STATS_INC(num_decode_cache_adds);
+    return next_pc;
+}
+
 /* initialization */
 void
 interp_init()
@@ -129,6 +257,14 @@ interp_init()
         ASSERT(bbdump_file != INVALID_FILE);
     }
 #endif
+    if (DYNAMO_OPTION(decode_cache)) {
+        decode_cache = generic_hash_create(GLOBAL_DCONTEXT,
+                                           INIT_HTABLE_SIZE_DECODE_CACHE,
+                                           80 /* load factor */,
+                                           HASHTABLE_SHARED | HASHTABLE_PERSISTENT,
+                                           decode_cache_entry_free
+                                           _IF_DEBUG("decode cache"));
+    }
 }
 
 #ifdef CUSTOM_TRACES_RET_REMOVAL
@@ -148,6 +284,10 @@ interp_exit()
     }
 #endif
     DELETE_LOCK(bb_building_lock);
+    if (decode_cache != NULL) {
+        generic_hash_destroy(GLOBAL_DCONTEXT, decode_cache);
+        decode_cache = NULL;
+    }
 
     LOG(GLOBAL, LOG_INTERP|LOG_STATS, 1, "Total application code seen: %d KB\n",
         GLOBAL_STAT(app_code_seen)/1024);
@@ -230,6 +370,7 @@ typedef struct {
 #ifdef ARM
     dr_pred_type_t svc_pred;    /* predicate for conditional svc */
 #endif
+    bool use_arena;             /* IR comes from the thread's arena */
     DEBUG_DECLARE(bool initialized;)
 } build_bb_t;
 
@@ -458,6 +599,7 @@ must_escape_from(app_pc pc)
         || (automatic_startup &&
             (pc == (app_pc)dynamorio_app_init ||
              pc == (app_pc)dr_app_start ||
+             pc == (app_pc)dr_app_start_thread ||
              pc == (app_pc)dynamo_thread_init ||
              pc == (app_pc)dynamorio_app_exit ||
              /* dr_app_stop is a nop already */
@@ -472,6 +614,8 @@ must_escape_from(app_pc pc)
             LOG(THREAD_GET, LOG_INTERP, 3, "dynamorio_app_init\n");
         else if (pc == (app_pc)dr_app_start)
             LOG(THREAD_GET, LOG_INTERP, 3, "dr_app_start\n");
+        else if (pc == (app_pc)dr_app_start_thread)
+            LOG(THREAD_GET, LOG_INTERP, 3, "dr_app_start_thread\n");
         /* FIXME: are dynamo_thread_* still needed hered? */
         else if (pc == (app_pc)dynamo_thread_init)
             LOG(THREAD_GET, LOG_INTERP, 3, "dynamo_thread_init\n");
@@ -2749,13 +2893,19 @@ client_process_bb(dcontext_t *dcontext, build_bb_t *bb)
         return true;
     }
 
-    /* Call the bb creation callback(s) */
+    /* Call the bb creation callback(s).  Clients may hold on to instrs or
+     * lists they create past this block, so they get regular heap memory.
+     */
+    if (bb->use_arena)
+        heap_arena_suspend(dcontext);
     if (!instrument_basic_block(dcontext,
                                 /* DrMem#1735: pass app pc, not selfmod copy pc */
                                 (bb->pretend_pc == NULL ? bb->start_pc : bb->pretend_pc),
                                 bb->ilist, bb->for_trace, !bb->app_interp, &emitflags)) {
         /* although no callback was called we must process syscalls/ints (PR 307284) */
     }
+    if (bb->use_arena)
+        heap_arena_resume(dcontext);
     if (bb->for_cache && TEST(DR_EMIT_GO_NATIVE, emitflags)) {
         LOG(THREAD, LOG_INTERP, 2, "client requested that we go native\n");
         SYSLOG_INTERNAL_INFO("thread "TIDFMT" is going native at client request",
@@ -3205,6 +3355,8 @@ build_bb_ilist(dcontext_t *dcontext, build_bb_t *bb)
     bool hotp_should_inject = false, hotp_injected = false;
 #endif
     app_pc page_start_pc = (app_pc) NULL;
+    /* lines already recorded for -selfmod_line_shadow */
+    app_pc code_lines_start = NULL, code_lines_end = NULL;
     bool bb_build_nested = false;
     /* Caller will free objects allocated here so we must use the passed-in
      * dcontext for allocation; we need separate var for non-global dcontext.
@@ -3351,11 +3503,27 @@ build_bb_ilist(dcontext_t *dcontext, build_bb_t *bb)
                 set_thread_decode_page_start(my_dcontext == NULL ?
                                              dcontext : my_dcontext, page_start_pc);
             }
+            /* Record the lines we're about to decode before we read them: a
+             * racing write then either sees the mark and flushes, or is
+             * emulated before we decode.
+             */
+            if (bb->for_cache && DYNAMO_OPTION(selfmod_line_shadow) &&
+                (bb->cur_pc < code_lines_start ||
+                 bb->cur_pc + MAX_INSTR_LENGTH > code_lines_end)) {
+                vm_area_mark_code_lines(bb->cur_pc, bb->cur_pc + MAX_INSTR_LENGTH);
+                code_lines_start = (app_pc) ALIGN_BACKWARD(bb->cur_pc, CODE_LINE_SIZE);
+                code_lines_end = (app_pc)
+                    ALIGN_FORWARD(bb->cur_pc + MAX_INSTR_LENGTH, CODE_LINE_SIZE);
+            }
 
             bb->instr_start = bb->cur_pc;
             if (bb->full_decode) {
                 /* only going through this do loop once! */
-                bb->cur_pc = decode(dcontext, bb->cur_pc, bb->instr);
+                if (decode_cache != NULL && bb->pretend_pc == NULL &&
+                    !TEST(FRAG_SELFMOD_SANDBOXED, bb->flags))
+                    bb->cur_pc = decode_cache_decode(dcontext, bb->cur_pc, &bb->instr);
+                else
+                    bb->cur_pc = decode(dcontext, bb->cur_pc, bb->instr);
                 if (bb->record_translation)
                     instr_set_translation(bb->instr, bb->instr_start);
             } else {
@@ -4328,6 +4496,18 @@ build_bb_ilist(dcontext_t *dcontext, build_bb_t *bb)
     }
 }
 
+/* Releases the IR arena scope opened by init_interp_build_bb(), once
+ * nothing built in it is live any longer.
+ */
+static inline void
+exit_bb_ir_arena(dcontext_t *dcontext, build_bb_t *bb)
+{
+    if (bb->use_arena) {
+        bb->use_arena = false;
+        heap_arena_end(dcontext);
+    }
+}
+
 /* Call when about to throw exception or other drastic action in the
  * middle of bb building, in order to free resources
  */
@@ -4346,6 +4526,7 @@ bb_build_abort(dcontext_t *dcontext, bool clean_vmarea, bool unlock)
             instrlist_clear_and_destroy(dcontext, bb->ilist);
             DODEBUG({ bb->ilist = NULL; });
         }
+        exit_bb_ir_arena(dcontext, bb);
         if (clean_vmarea) {
             /* Free the vmlist and any locks held (we could have been in
              * the middle of check_thread_vm_area and had a decode fault
@@ -4435,6 +4616,15 @@ mangle_bb_ilist(dcontext_t *dcontext, build_bb_t *bb)
         }
         STATS_INC(num_sandboxed_fragments);
     }
+# ifdef CLIENT_INTERFACE
+    if (DYNAMO_OPTION(fragment_counts)) {
+        uint64 *counter = instrument_fragment_exec_counter(bb->start_pc, true/*create*/);
+        if (counter != NULL) {
+            insert_fragment_exec_counter(dcontext, bb->ilist, bb->flags, counter,
+                                         bb->record_translation);
+        }
+    }
+# endif
 #endif /* X86 */
 
     DOLOG(4, LOG_INTERP, {
@@ -4655,9 +4845,15 @@ build_native_exec_bb(dcontext_t *dcontext, build_bb_t *bb)
      * code.
      */
     if (bb->native_call) {
-        dr_insert_clean_call(dcontext, bb->ilist, NULL,
-                             (void *)call_to_native, false/*!fp*/, 1,
-                             opnd_create_reg(REG_XSP));
+#if defined(UNIX) && defined(X86)
+        if (DYNAMO_OPTION(native_exec_opt) && DYNAMO_OPTION(native_exec_retakeover)) {
+            insert_call_to_native(dcontext, bb->ilist, NULL,
+                                  REG_NULL /* default */, SCRATCH_REG0);
+        } else
+#endif
+            dr_insert_clean_call(dcontext, bb->ilist, NULL,
+                                 (void *)call_to_native, false/*!fp*/, 1,
+                                 opnd_create_reg(REG_XSP));
     } else {
         if (DYNAMO_OPTION(native_exec_opt)) {
             insert_return_to_native(dcontext, bb->ilist, NULL,
@@ -4999,6 +5195,11 @@ init_interp_build_bb(dcontext_t *dcontext, build_bb_t *bb, app_pc start,
     /* we need to clone the ilist pre-mangling */
     bb->unmangled_ilist = unmangled_ilist;
 #endif
+    /* The pre-mangling clone outlives the build, so it can't use the arena. */
+    if (DYNAMO_OPTION(bb_ir_arena) IF_CLIENT_INTERFACE(&& unmangled_ilist == NULL)) {
+        heap_arena_begin(dcontext);
+        bb->use_arena = true;
+    }
 }
 
 static inline void
@@ -5061,6 +5262,7 @@ build_basic_block_fragment(dcontext_t *dcontext, app_pc start, uint initial_flag
             instrlist_clear_and_destroy(dcontext, bb.ilist);
             vm_area_destroy_list(dcontext, bb.vmlist);
             dcontext->bb_build_info = NULL;
+            exit_bb_ir_arena(dcontext, &bb);
             init_interp_build_bb(dcontext, &bb, start, initial_flags
                                  _IF_CLIENT(for_trace) _IF_CLIENT(unmangled_ilist));
 #ifdef CLIENT_INTERFACE
@@ -5122,7 +5324,9 @@ build_basic_block_fragment(dcontext_t *dcontext, app_pc start, uint initial_flag
 #endif
 
     exit_interp_build_bb(dcontext, &bb);
+    startup_profile_block_built();
  build_basic_block_fragment_done:
+    exit_bb_ir_arena(dcontext, &bb);
     dcontext->whereami = wherewasi;
     KSTOP(bb_building);
     return f;
@@ -5751,6 +5955,171 @@ insert_transparent_comparison(dcontext_t *dcontext, instrlist_t *trace,
     return added_size;
 }
 
+#ifdef X86
+/* -trace_ret_predict is a depth-one return address prediction for traces.  A
+ * direct call in a trace records the negated return address and the cache pc
+ * of a landing pad exiting to it in TLS, and a return in a trace whose target
+ * matches jumps straight to that pad instead of going through the IBL.  The
+ * prediction is reset on every cache entry (see dispatch_enter_fcache()), so
+ * it never outlives the fragment holding the pad.  As with
+ * insert_transparent_comparison() this is 32-bit only.
+ */
+# define TRACE_RET_PREDICT(dc) \
+    (DYNAMO_OPTION(trace_ret_predict) && !X64_CACHE_MODE_DC(dc) && \
+     !INTERNAL_OPTION(unsafe_ignore_eflags_trace))
+
+/* Returns the return address pushed right before the direct call exit
+ * targeter, or NULL if targeter is not one.  A wrong answer is harmless: the
+ * landing pad exits to the very tag that matched.
+ */
+static app_pc
+ret_predict_call_retaddr(instr_t *targeter)
+{
+    instr_t *push = instr_get_prev(targeter);
+    if (!EXIT_IS_CALL(instr_exit_branch_type(targeter)) ||
+        !opnd_is_pc(instr_get_target(targeter)) || push == NULL)
+        return NULL;
+    if (instr_opcode_valid(push)) {
+        if (instr_get_opcode(push) == OP_push_imm &&
+            opnd_is_immed_int(instr_get_src(push, 0)))
+            return (app_pc) opnd_get_immed_int(instr_get_src(push, 0));
+    } else if (instr_raw_bits_valid(push) && push->length >= PUSH_IMM32_LENGTH) {
+        /* bundle from decode_fragment(): look for a trailing push imm32 */
+        byte *b = push->bytes + push->length - PUSH_IMM32_LENGTH;
+        if (*b == 0x68 /* push imm32 */)
+            return (app_pc)(ptr_uint_t) *(uint *)(b + 1);
+    }
+    return NULL;
+}
+
+/* Inserts the call side of -trace_ret_predict before targeter, a direct call
+ * exit:
+ *     mov $-retaddr -> ret-predict-tag-slot
+ *     mov $landing -> ret-predict-pc-slot
+ *     jmp over
+ *   landing:
+ *     restore ecx
+ *     jmp retaddr    # direct exit
+ *   over:
+ * Returns size to be added to trace.
+ */
+static int
+insert_ret_predict_call(dcontext_t *dcontext, instrlist_t *trace, instr_t *targeter,
+                        uint trace_flags)
+{
+    int added_size = 0;
+    app_pc retaddr = ret_predict_call_retaddr(targeter);
+    instr_t *landing, *over, *jmp;
+    if (retaddr == NULL)
+        return 0;
+    landing = INSTR_CREATE_label(dcontext);
+    over = INSTR_CREATE_label(dcontext);
+    added_size += tracelist_add
+        (dcontext, trace, targeter,
+         INSTR_CREATE_mov_st(dcontext,
+                             opnd_create_tls_slot(os_tls_offset
+                                                  (TLS_RET_PREDICT_TAG_SLOT)),
+                             OPND_CREATE_INT32(-(int)(ptr_int_t)retaddr)));
+    added_size += tracelist_add
+        (dcontext, trace, targeter,
+         INSTR_CREATE_mov_st(dcontext,
+                             opnd_create_tls_slot(os_tls_offset
+                                                  (TLS_RET_PREDICT_PC_SLOT)),
+                             opnd_create_instr(landing)));
+    jmp = INSTR_CREATE_jmp_short(dcontext, opnd_create_instr(over));
+    /* not an exit cti */
+    instr_set_meta(jmp);
+    added_size += tracelist_add(dcontext, trace, targeter, jmp);
+    added_size += tracelist_add(dcontext, trace, targeter, landing);
+    added_size += insert_restore_spilled_xcx(dcontext, trace, targeter);
+    added_size += tracelist_add(dcontext, trace, targeter,
+                                XINST_CREATE_jump(dcontext, opnd_create_pc(retaddr)));
+    added_size += local_exit_stub_size(dcontext, retaddr, trace_flags);
+    added_size += tracelist_add(dcontext, trace, targeter, over);
+    STATS_INC(trace_ret_predict_calls);
+    LOG(THREAD, LOG_MONITOR, 3,
+        "ret predict: recording return address "PFX" at call\n", retaddr);
+    return added_size;
+}
+
+/* Inserts the return side of -trace_ret_predict around targeter, a return
+ * exit with the target in ecx, using a flags-free compare like
+ * insert_transparent_comparison():
+ *     mov edx -> edx-tls-spill-slot
+ *     mov ret-predict-tag-slot -> edx
+ *     lea (ecx,edx) -> ecx
+ *     jecxz hit
+ *     not edx
+ *     lea 1(ecx,edx) -> ecx
+ *     mov edx-tls-spill-slot -> edx
+ *     jmp exit   # targeter
+ *   hit:
+ *     mov edx-tls-spill-slot -> edx
+ *     jmp *ret-predict-pc-slot
+ * Returns size to be added to trace.
+ */
+static int
+insert_ret_predict_check(dcontext_t *dcontext, instrlist_t *trace, instr_t *targeter)
+{
+    int added_size = 0;
+    instr_t *hit = INSTR_CREATE_label(dcontext);
+    instr_t *jecxz, *jmp;
+    added_size += tracelist_add
+        (dcontext, trace, targeter,
+         INSTR_CREATE_mov_st(dcontext,
+                             opnd_create_tls_slot(os_tls_offset(TLS_XDX_SLOT)),
+                             opnd_create_reg(REG_EDX)));
+    added_size += tracelist_add
+        (dcontext, trace, targeter,
+         INSTR_CREATE_mov_ld(dcontext, opnd_create_reg(REG_EDX),
+                             opnd_create_tls_slot(os_tls_offset
+                                                  (TLS_RET_PREDICT_TAG_SLOT))));
+    added_size += tracelist_add
+        (dcontext, trace, targeter,
+         INSTR_CREATE_lea(dcontext, opnd_create_reg(REG_ECX),
+                          opnd_create_base_disp(REG_ECX, REG_EDX, 1, 0, OPSZ_lea)));
+    jecxz = INSTR_CREATE_jecxz(dcontext, opnd_create_instr(hit));
+    /* do not treat jecxz as exit cti! */
+    instr_set_meta(jecxz);
+    added_size += tracelist_add(dcontext, trace, targeter, jecxz);
+    /* ecx - negtag + ~negtag + 1 == ecx */
+    added_size += tracelist_add
+        (dcontext, trace, targeter,
+         INSTR_CREATE_not(dcontext, opnd_create_reg(REG_EDX)));
+    added_size += tracelist_add
+        (dcontext, trace, targeter,
+         INSTR_CREATE_lea(dcontext, opnd_create_reg(REG_ECX),
+                          opnd_create_base_disp(REG_ECX, REG_EDX, 1, 1, OPSZ_lea)));
+    added_size += tracelist_add
+        (dcontext, trace, targeter,
+         INSTR_CREATE_mov_ld(dcontext, opnd_create_reg(REG_EDX),
+                             opnd_create_tls_slot(os_tls_offset(TLS_XDX_SLOT))));
+    /* the hit path goes right after targeter, ahead of any continue label */
+    jmp = INSTR_CREATE_jmp_ind(dcontext,
+                               opnd_create_tls_slot(os_tls_offset
+                                                    (TLS_RET_PREDICT_PC_SLOT)));
+    instr_set_meta(jmp);
+    added_size += tracelist_add_after(dcontext, trace, targeter, jmp);
+    added_size += tracelist_add
+        (dcontext, trace, jmp,
+         INSTR_CREATE_mov_ld(dcontext, opnd_create_reg(REG_EDX),
+                             opnd_create_tls_slot(os_tls_offset(TLS_XDX_SLOT))));
+    added_size += tracelist_add_after(dcontext, trace, targeter, hit);
+    STATS_INC(trace_ret_predict_checks);
+    return added_size;
+}
+
+/* Returns whether targeter, an indirect exit, is a return. */
+static bool
+ret_predict_is_return(dcontext_t *dcontext, instr_t *targeter)
+{
+    ibl_type_t ibl_type;
+    return (get_ibl_routine_type(dcontext, opnd_get_pc(instr_get_target(targeter)),
+                                 &ibl_type) &&
+            ibl_type.branch_type == IBL_RETURN);
+}
+#endif /* X86 */
+
 #ifdef X64
 static int
 mangle_x64_ib_in_trace(dcontext_t *dcontext, instrlist_t *trace,
@@ -5957,6 +6326,9 @@ mangle_indirect_branch_in_trace(dcontext_t *dcontext, instrlist_t *trace,
             added_size +=
                 insert_transparent_comparison(dcontext, trace, targeter,
                                               next_tag);
+            /* on a miss, try the predicted return target before the IBL */
+            if (TRACE_RET_PREDICT(dcontext) && ret_predict_is_return(dcontext, targeter))
+                added_size += insert_ret_predict_check(dcontext, trace, targeter);
             /* leave jmp as it is, a jmp to exit stub (thence to ind br
              * lookup) */
         }
@@ -6078,7 +6450,7 @@ fixup_last_cti(dcontext_t *dcontext, instrlist_t *trace,
      * Use tracelist_add to automate adding inserted instr sizes.
      */
     int added_size = 0;
-    uint exits_deleted = 0;
+    uint exits_deleted = 0, exits_added = 0;
 
     /* count exit stubs to get the ordinal of the exit that targeted us
      * start at prev_l, and count up extraneous exits and blks until end
@@ -6200,6 +6572,16 @@ fixup_last_cti(dcontext_t *dcontext, instrlist_t *trace,
         } else if (instr_is_ubr(targeter)) {
 #ifndef CUSTOM_TRACES
             ASSERT(targeter == end_instr);
+#endif
+#ifdef X86
+            /* must come first, as it stays above the ubr we delete below */
+            if (TRACE_RET_PREDICT(dcontext)) {
+                int size = insert_ret_predict_call(dcontext, trace, targeter,
+                                                   trace_flags);
+                if (size > 0)
+                    exits_added++;
+                added_size += size;
+            }
 #endif
             /* remove unnecessary ubr at end of block */
             delete_after = instr_get_prev(targeter);
@@ -6249,8 +6631,10 @@ fixup_last_cti(dcontext_t *dcontext, instrlist_t *trace,
         }
     }
 
+    /* the call's deleted ubr is among exits_deleted */
+    ASSERT(exits_deleted >= exits_added);
     if (num_exits_deleted != NULL)
-        *num_exits_deleted = exits_deleted;
+        *num_exits_deleted = exits_deleted - exits_added;
 
     if (record_translation)
         instrlist_set_translation_target(trace, NULL);
@@ -6274,11 +6658,13 @@ fixup_last_cti(dcontext_t *dcontext, instrlist_t *trace,
 }
 
 /* Add a speculative counter on last IBL exit
+ * If speculate_alt_tag is not NULL it is compared against as well, after
+ * speculate_next_tag, with its own direct exit.
  * Returns additional size to add to trace estimate.
  */
 int
 append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
-                                app_pc speculate_next_tag,
+                                app_pc speculate_next_tag, app_pc speculate_alt_tag,
                                 bool record_translation)
 {
     /* unlike fixup_last_cti() here we are about to go directly to the IBL routine */
@@ -6419,6 +6805,25 @@ append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
         "append_trace_speculate_last_ibl: added cmp vs. "PFX" for ind br\n",
         speculate_next_tag);
 
+    if (speculate_alt_tag != NULL && speculate_alt_tag != speculate_next_tag) {
+        instr_t *alt_continue, *alt_jmp;
+        /* The comparison goes after the first one, and its continue label
+         * lands right after the exit CTI, ahead of the first target's path,
+         * so we hang the second target's path off that label.
+         */
+        added_size +=
+            insert_transparent_comparison(dcontext, trace, where, speculate_alt_tag);
+        alt_continue = instr_get_next(where);
+        ASSERT(alt_continue != NULL && instr_is_label(alt_continue));
+        alt_jmp = XINST_CREATE_jump(dcontext, opnd_create_pc(speculate_alt_tag));
+        added_size += tracelist_add_after(dcontext, trace, alt_continue, alt_jmp);
+        added_size += insert_restore_spilled_xcx(dcontext, trace, alt_jmp);
+        STATS_INC(num_traces_end_at_ibl_speculative_alt);
+        LOG(THREAD, LOG_INTERP, 3,
+            "append_trace_speculate_last_ibl: added cmp vs. "PFX" for ind br\n",
+            speculate_alt_tag);
+    }
+
     if (record_translation)
         instrlist_set_translation_target(trace, NULL);
     instrlist_set_our_mangling(trace, false); /* PR 267260 */
@@ -6426,6 +6831,45 @@ append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
     return added_size;
 }
 
+/* Adds -trace_ret_predict code for the last exit of the trace, which fixup_last_cti()
+ * never sees: a direct call records a prediction and a return checks it.
+ * Must be called after append_trace_speculate_last_ibl() so any speculation
+ * is tried first.
+ * Returns additional size to add to trace estimate.
+ */
+int
+append_trace_ret_predict(dcontext_t *dcontext, instrlist_t *trace,
+                         uint trace_flags, bool record_translation)
+{
+    int added_size = 0;
+#ifdef X86
+    instr_t *inst = instrlist_last(trace);
+    ASSERT(inst != NULL && instr_is_exit_cti(inst));
+    if (!TRACE_RET_PREDICT(dcontext) || !instr_is_ubr(inst))
+        return 0;
+    if (record_translation)
+        instrlist_set_translation_target(trace, instr_get_translation(inst));
+    instrlist_set_our_mangling(trace, true); /* PR 267260 */
+    if (is_indirect_branch_lookup_routine(dcontext, opnd_get_pc(instr_get_target(inst)))) {
+        if (ret_predict_is_return(dcontext, inst))
+            added_size += insert_ret_predict_check(dcontext, trace, inst);
+    } else {
+        int size = insert_ret_predict_call(dcontext, trace, inst, trace_flags);
+#if defined(RETURN_AFTER_CALL) || defined(RCT_IND_BRANCH)
+        monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
+        /* the landing pad's exit belongs to the last block */
+        if (size > 0)
+            md->blk_info[md->num_blks - 1].info.num_exits++;
+#endif
+        added_size += size;
+    }
+    if (record_translation)
+        instrlist_set_translation_target(trace, NULL);
+    instrlist_set_our_mangling(trace, false); /* PR 267260 */
+#endif
+    return added_size;
+}
+
 #ifdef HASHTABLE_STATISTICS
 /* Add a counter on last IBL exit
  * if speculate_next_tag is not NULL then check case 4817's possible success
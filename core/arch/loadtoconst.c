@@ -1878,6 +1878,7 @@ instr_replace_inplace(dcontext_t *dcontext, instr_t *in, instr_t *replacee)
 
     instr_reset(dcontext,in);
     memcpy(in,replacee,sizeof(instr_t));
+    instr_reattach_inline_opnds(in);
 
     instr_set_next(in,next);
     instr_set_prev(in,prev);
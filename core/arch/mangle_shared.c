@@ -57,6 +57,9 @@
 clean_call_info_t default_clean_call_info;
 callee_info_t default_callee_info;
 
+/* number of extra slots in addition to register slots. */
+#define NUM_EXTRA_SLOTS 2 /* pc, aflags */
+
 /* the stack size of a full context switch for clean call */
 int
 get_clean_call_switch_stack_size(void)
@@ -64,6 +67,15 @@ get_clean_call_switch_stack_size(void)
     return sizeof(priv_mcontext_t);
 }
 
+/* the stack size of a context switch that saves no xmm regs:
+ * see insert_push_all_registers()
+ */
+int
+get_clean_call_noxmm_switch_stack_size(void)
+{
+    return (NUM_GP_REGS + NUM_EXTRA_SLOTS) * XSP_SZ;
+}
+
 /* extra temporarily-used stack usage beyond
  * get_clean_call_switch_stack_size()
  */
@@ -147,8 +159,6 @@ insert_get_mcontext_base(dcontext_t *dcontext, instrlist_t *ilist,
  * dr_prepare_for_call) assumes that this routine only modifies xsp
  * and xax and no other registers.
  */
-/* number of extra slots in addition to register slots. */
-#define NUM_EXTRA_SLOTS 2 /* pc, aflags */
 uint
 prepare_for_clean_call(dcontext_t *dcontext, clean_call_info_t *cci,
                        instrlist_t *ilist, instr_t *instr)
@@ -220,7 +230,7 @@ prepare_for_clean_call(dcontext_t *dcontext, clean_call_info_t *cci,
      */
     if (cci->out_of_line_swap) {
         dstack_offs +=
-            insert_out_of_line_context_switch(dcontext, ilist, instr, true);
+            insert_out_of_line_context_switch(dcontext, cci, ilist, instr, true);
     } else {
         dstack_offs +=
             insert_push_all_registers(dcontext, cci, ilist, instr, PAGE_SIZE,
@@ -288,7 +298,7 @@ cleanup_after_clean_call(dcontext_t *dcontext, clean_call_info_t *cci,
 
     /* now restore everything */
     if (cci->out_of_line_swap) {
-        insert_out_of_line_context_switch(dcontext, ilist, instr, false);
+        insert_out_of_line_context_switch(dcontext, cci, ilist, instr, false);
     } else {
         /* XXX: add a cci field for optimizing this away if callee makes no calls */
         insert_pop_all_registers(dcontext, cci, ilist, instr,
@@ -973,6 +983,9 @@ find_syscall_num(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr)
     instr_t *prev = instr_get_prev(instr);
     /* Allow either eax or rax for x86_64 */
     reg_id_t sysreg = reg_to_pointer_sized(DR_REG_SYSNUM);
+#ifdef X86
+    bool followed_copy = false;
+#endif
     if (prev != NULL) {
         prev = instr_get_prev_expanded(dcontext, ilist, instr);
         /* walk backwards looking for "mov imm->xax"
@@ -980,8 +993,31 @@ find_syscall_num(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr)
          * for the syscall in between
          */
         while (prev != NULL &&
-               !instr_is_syscall(prev) && !instr_is_interrupt(prev) &&
-               !instr_writes_to_reg(prev, sysreg, DR_QUERY_INCLUDE_ALL)) {
+               !instr_is_syscall(prev) && !instr_is_interrupt(prev)) {
+            if (instr_writes_to_reg(prev, sysreg, DR_QUERY_INCLUDE_ALL)) {
+#ifdef X86
+                /* Follow one whole-register copy into xax, as compilers
+                 * sometimes materialize the number in another register first:
+                 *   mov $0xca -> %edx; ...; mov %edx -> %eax
+                 */
+                if (!followed_copy &&
+                    (instr_get_opcode(prev) == OP_mov_ld ||
+                     instr_get_opcode(prev) == OP_mov_st) &&
+                    opnd_is_reg(instr_get_src(prev, 0)) &&
+                    opnd_is_reg(instr_get_dst(prev, 0))) {
+                    reg_id_t src = opnd_get_reg(instr_get_src(prev, 0));
+                    reg_id_t dst = opnd_get_reg(instr_get_dst(prev, 0));
+                    if ((reg_is_32bit(dst) || reg_is_pointer_sized(dst)) &&
+                        reg_is_gpr(src) && reg_get_size(src) == reg_get_size(dst)) {
+                        followed_copy = true;
+                        sysreg = reg_to_pointer_sized(src);
+                        prev = instr_get_prev_expanded(dcontext, ilist, prev);
+                        continue;
+                    }
+                }
+#endif
+                break;
+            }
 #ifdef CLIENT_INTERFACE
             /* if client added cti in between, bail and assume non-ignorable */
             if (instr_is_cti(prev) &&
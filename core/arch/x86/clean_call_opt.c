@@ -83,6 +83,7 @@ callee_info_init(callee_info_t *ci)
     ci->num_xmms_used = NUM_XMM_REGS;
     for (i = 0; i < NUM_XMM_REGS; i++)
         ci->xmm_used[i] = true;
+    ci->ymmh_used = true;
     for (i = 0; i < NUM_GP_REGS; i++)
         ci->reg_used[i] = true;
     ci->spill_reg = DR_REG_INVALID;
@@ -446,6 +447,23 @@ decode_callee_ilist(dcontext_t *dcontext, callee_info_t *ci)
     check_callee_ilist(dcontext, ci);
 }
 
+/* Legacy SSE instructions leave the top half of a ymm register alone, so
+ * only vex-encoded instructions and explicit ymm operands can change it.
+ */
+static bool
+instr_may_write_ymmh(instr_t *instr)
+{
+    int i;
+    if (instr_zeroes_ymmh(instr))
+        return true;
+    for (i = 0; i < instr_num_dsts(instr); i++) {
+        opnd_t opnd = instr_get_dst(instr, i);
+        if (opnd_is_reg(opnd) && reg_is_ymm(opnd_get_reg(opnd)))
+            return true;
+    }
+    return false;
+}
+
 static void
 analyze_callee_regs_usage(dcontext_t *dcontext, callee_info_t *ci)
 {
@@ -456,6 +474,7 @@ analyze_callee_regs_usage(dcontext_t *dcontext, callee_info_t *ci)
     ci->num_xmms_used = 0;
     memset(ci->xmm_used, 0, sizeof(bool) * NUM_XMM_REGS);
     memset(ci->reg_used, 0, sizeof(bool) * NUM_GP_REGS);
+    ci->ymmh_used = false;
     ci->write_aflags = false;
     for (instr  = instrlist_first(ilist);
          instr != NULL;
@@ -477,6 +496,12 @@ analyze_callee_regs_usage(dcontext_t *dcontext, callee_info_t *ci)
                 ci->num_xmms_used++;
             }
         }
+        if (!ci->ymmh_used && instr_may_write_ymmh(instr)) {
+            LOG(THREAD, LOG_CLEANCALL, 2,
+                "CLEANCALL: callee "PFX" may write ymm at "PFX"\n",
+                ci->start, instr_get_app_pc(instr));
+            ci->ymmh_used = true;
+        }
         /* General purpose registers */
         for (i = 0; i < NUM_GP_REGS; i++) {
             reg_id_t reg = DR_REG_XAX + (reg_id_t)i;
@@ -768,6 +793,52 @@ analyze_callee_pick_spill_reg(dcontext_t *dcontext, callee_info_t *ci)
     ci->spill_reg = DR_REG_INVALID;
 }
 
+/* Internal forward branches still target the callee's app pcs: point them at
+ * the instrs they target so the inlined copy stays within itself.  A target
+ * past the last remaining instr was part of the epilogue we removed (the
+ * return, callee-saved register pops, or frame teardown), which our inlined
+ * register restore replaces, so it goes to a label at the end.
+ * Returns false if some target is neither.
+ */
+static bool
+analyze_callee_branch_targets(dcontext_t *dcontext, callee_info_t *ci)
+{
+    instr_t *cti, *tgt, *last, *end_label = NULL;
+    app_pc tgt_pc;
+
+    if (ci->fwd_tgt == NULL)
+        return true;
+    last = instrlist_last(ci->ilist);
+    for (cti  = instrlist_first(ci->ilist);
+         cti != NULL && cti != end_label;
+         cti  = instr_get_next(cti)) {
+        if (!instr_is_cti(cti))
+            continue;
+        ASSERT(instr_is_ubr(cti) || instr_is_cbr(cti));
+        tgt_pc = opnd_get_pc(instr_get_target(cti));
+        for (tgt  = instrlist_first(ci->ilist);
+             tgt != NULL;
+             tgt  = instr_get_next(tgt)) {
+            if (instr_get_app_pc(tgt) == tgt_pc)
+                break;
+        }
+        if (tgt == NULL) {
+            if (tgt_pc <= instr_get_app_pc(last))
+                return false;
+            if (end_label == NULL) {
+                end_label = INSTR_CREATE_label(GLOBAL_DCONTEXT);
+                instrlist_append(ci->ilist, end_label);
+            }
+            tgt = end_label;
+        }
+        LOG(THREAD, LOG_CLEANCALL, 3,
+            "CLEANCALL: internal branch at "PFX" to "PFX" kept in inlined code.\n",
+            instr_get_app_pc(cti), tgt_pc);
+        instr_set_target(cti, opnd_create_instr(tgt));
+    }
+    return true;
+}
+
 static void
 analyze_callee_inline(dcontext_t *dcontext, callee_info_t *ci)
 {
@@ -790,9 +861,9 @@ analyze_callee_inline(dcontext_t *dcontext, callee_info_t *ci)
             ci->start, ci->num_instrs);
         opt_inline = false;
     }
-    if (ci->bwd_tgt != NULL || ci->fwd_tgt != NULL) {
+    if (ci->bwd_tgt != NULL) {
         LOG(THREAD, LOG_CLEANCALL, 1,
-            "CLEANCALL: callee "PFX" cannot be inlined: has control flow.\n",
+            "CLEANCALL: callee "PFX" cannot be inlined: has a loop.\n",
             ci->start);
         opt_inline = false;
     }
@@ -988,6 +1059,12 @@ analyze_callee_inline(dcontext_t *dcontext, callee_info_t *ci)
             }
         }
     }
+    if (instr == NULL && opt_inline && !analyze_callee_branch_targets(dcontext, ci)) {
+        LOG(THREAD, LOG_CLEANCALL, 1,
+            "CLEANCALL: callee "PFX" cannot be inlined: "
+            "branch into removed code.\n", ci->start);
+        opt_inline = false;
+    }
     if (instr == NULL && opt_inline) {
         ci->opt_inline = true;
         LOG(THREAD, LOG_CLEANCALL, 1,
@@ -1074,6 +1151,15 @@ analyze_clean_call_regs(dcontext_t *dcontext, clean_call_info_t *cci)
     }
     if (INTERNAL_OPTION(opt_cleancall) > 2 && cci->num_xmms_skip != NUM_XMM_REGS)
         cci->should_align = false;
+    /* A callee using only legacy SSE needs just the low 128 bits of what it
+     * touches saved, rather than the full ymm.
+     */
+    if (YMM_ENABLED() && !info->ymmh_used && cci->num_xmms_skip != NUM_XMM_REGS) {
+        LOG(THREAD, LOG_CLEANCALL, 3,
+            "CLEANCALL: if inserting clean call "PFX
+            ", skip saving the top half of the ymm registers.\n", info->start);
+        cci->skip_save_ymmh = true;
+    }
     /* 2. general purpose registers */
     /* set regs not to be saved for clean call */
     for (i = 0; i < NUM_GP_REGS; i++) {
@@ -1204,6 +1290,7 @@ analyze_clean_call_inline(dcontext_t *dcontext, clean_call_info_t *cci)
                 info->start);
             cci->num_regs_skip = 0;
             memset(cci->reg_skip, 0, sizeof(bool) * NUM_GP_REGS);
+            cci->skip_save_ymmh = false;
             cci->should_align = true;
         } else {
             uint i;
@@ -1216,6 +1303,8 @@ analyze_clean_call_inline(dcontext_t *dcontext, clean_call_info_t *cci)
         }
         if (cci->num_xmms_skip == NUM_XMM_REGS) {
             STATS_INC(cleancall_xmm_skipped);
+        } else if (cci->skip_save_ymmh) {
+            STATS_INC(cleancall_ymmh_skipped);
         }
         if (cci->skip_save_aflags) {
             STATS_INC(cleancall_aflags_save_skipped);
@@ -1275,7 +1364,8 @@ analyze_clean_call(dcontext_t *dcontext, clean_call_info_t *cci, instr_t *where,
         }
     }
     /* 9. derived fields */
-    if (cci->num_xmms_skip == 0 /* save all xmms */ &&
+    if ((cci->num_xmms_skip == 0 /* save all xmms */ ||
+         cci->num_xmms_skip == NUM_XMM_REGS /* save no xmms */) &&
         cci->num_regs_skip == 0 /* save all regs */ &&
         !cci->skip_save_aflags)
         cci->out_of_line_swap = true;
@@ -447,6 +447,30 @@ static const byte xop_a_extra[256] = {
     0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0   /* F */
 };
 
+/* Bytes that may start a prefix: legacy prefixes, rex (only a prefix in
+ * 64-bit mode), and the vex (c4,c5) and xop (8f) escapes.  Most instructions
+ * have no prefix at all, so decode_sizeof() consults this up front and skips
+ * its prefix loop entirely when the first byte cannot be one.
+ */
+static const byte prefix_byte[256] = {
+    0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0,  /* 0 */
+    0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0,  /* 1 */
+    0,0,0,0, 0,0,1,0, 0,0,0,0, 0,0,1,0,  /* 2 */
+    0,0,0,0, 0,0,1,0, 0,0,0,0, 0,0,1,0,  /* 3 */
+    1,1,1,1, 1,1,1,1, 1,1,1,1, 1,1,1,1,  /* 4 */
+    0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0,  /* 5 */
+    0,0,0,0, 1,1,1,1, 0,0,0,0, 0,0,0,0,  /* 6 */
+    0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0,  /* 7 */
+    0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,1,  /* 8 */
+    0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0,  /* 9 */
+    0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0,  /* A */
+    0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0,  /* B */
+    0,0,0,0, 1,1,0,0, 0,0,0,0, 0,0,0,0,  /* C */
+    0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0,  /* D */
+    0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0,  /* E */
+    1,0,1,1, 0,0,0,0, 0,0,0,0, 0,0,0,0   /* F */
+};
+
 /* Returns the length of the instruction at pc.
  * If num_prefixes is non-NULL, returns the number of prefix bytes.
  * If rip_rel_pos is non-NULL, returns the offset into the instruction
@@ -465,7 +489,7 @@ decode_sizeof(dcontext_t *dcontext, byte *start_pc, int *num_prefixes
     bool word_operands = false; /* data16 */
     bool qword_operands = false; /* rex.w */
     bool addr16 = false; /* really "addr32" for x64 mode */
-    bool found_prefix = true;
+    bool found_prefix = (prefix_byte[opc] != 0);
     bool rep_prefix = false;
     byte reg_opcode;    /* reg_opcode field of modrm byte */
 #ifdef X64
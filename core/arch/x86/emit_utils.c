@@ -1842,6 +1842,17 @@ insert_restore_eflags(dcontext_t *dcontext, instrlist_t *ilist, instr_t *where,
 #define HASHLOOKUP_TAG_OFFS       (offsetof(fragment_entry_t, tag_fragment))
 #define HASHLOOKUP_START_PC_OFFS       (offsetof(fragment_entry_t, start_pc_fragment))
 
+/* Whether the ibl head probes the -ibl_l1_bits cache.  We only do it for
+ * shared routines that find their table in TLS, and not for inlined heads.
+ */
+static bool
+ibl_use_l1_cache(ibl_code_t *ibl_code, bool target_trace_table, bool inline_ibl_head)
+{
+    return IBL_L1_ENABLED() && !inline_ibl_head && ibl_code->thread_shared_routine &&
+        (target_trace_table || SHARED_BB_ONLY_IB_TARGETS())
+        IF_X64(&& !ibl_code->x86_mode && !ibl_code->x86_to_x64_mode);
+}
+
 /* When inline_ibl_head, this emits the inlined lookup for the exit stub.
  *   Only assumption is that xcx = effective address of indirect branch
  * Else, this emits the top of the shared lookup routine, which assumes:
@@ -1862,11 +1873,13 @@ append_ibl_head(dcontext_t *dcontext, instrlist_t *ilist,
                 bool inline_ibl_head)
 {
     instr_t *mask, *table = NULL, *compare_tag = NULL, *after_linkcount;
+    instr_t *l1_hit = NULL;
     opnd_t mask_opnd;
     bool absolute = !ibl_code->thread_shared_routine;
     bool table_in_tls = SHARED_IB_TARGETS() &&
         (target_trace_table || SHARED_BB_ONLY_IB_TARGETS()) &&
         DYNAMO_OPTION(ibl_table_in_tls);
+    bool l1_cache = ibl_use_l1_cache(ibl_code, target_trace_table, inline_ibl_head);
     uint hash_to_address_factor;
     /* Use TLS only for spilling app state -- registers & flags */
     bool only_spill_state_in_tls = !absolute && !table_in_tls;
@@ -1959,6 +1972,36 @@ append_ibl_head(dcontext_t *dcontext, instrlist_t *ilist,
     APP(ilist, XINST_CREATE_load(dcontext, opnd_create_reg(SCRATCH_REG1),
                                  opnd_create_reg(SCRATCH_REG2)));
 
+    if (l1_cache) {
+        /* Probe the -ibl_l1_bits cache, whose slots point at table entries.
+         * The entry is validated just like a table entry, and a hit shares
+         * the found path below, as does target_delete_entry if the entry is
+         * being deleted.
+         *>>>    and     $IBL_L1_INDEX_MASK,%xcx
+         *>>>    add     fs:l1_table,%xcx
+         *>>>    mov     (%xcx),%xcx
+         *>>>    cmp     HASHLOOKUP_TAG_OFFS(%xcx),%xbx
+         *>>>    je      l1_hit
+         *>>>    mov     %xbx,%xcx
+         */
+        ASSERT(table_in_tls);
+        l1_hit = INSTR_CREATE_label(dcontext);
+        APP(ilist, INSTR_CREATE_and(dcontext, opnd_create_reg(SCRATCH_REG2),
+                                    OPND_CREATE_INT32((int)IBL_L1_INDEX_MASK())));
+        APP(ilist, INSTR_CREATE_add(dcontext, opnd_create_reg(SCRATCH_REG2),
+                                    OPND_TLS_FIELD(TLS_L1_TABLE_SLOT
+                                                   (ibl_code->branch_type))));
+        APP(ilist, XINST_CREATE_load(dcontext, opnd_create_reg(SCRATCH_REG2),
+                                     OPND_CREATE_MEMPTR(SCRATCH_REG2, 0)));
+        APP(ilist, INSTR_CREATE_cmp(dcontext,
+                                    OPND_CREATE_MEMPTR(SCRATCH_REG2,
+                                                       HASHLOOKUP_TAG_OFFS),
+                                    opnd_create_reg(SCRATCH_REG1)));
+        APP(ilist, INSTR_CREATE_jcc(dcontext, OP_je, opnd_create_instr(l1_hit)));
+        APP(ilist, XINST_CREATE_load(dcontext, opnd_create_reg(SCRATCH_REG2),
+                                     opnd_create_reg(SCRATCH_REG1)));
+    }
+
     if (only_spill_state_in_tls) {
         /* grab the per_thread_t into XDI - can't use SAVE_TO_DC after this */
         /* >>> mov  %xdi, fragment_field(%xdi) */
@@ -2104,7 +2147,8 @@ append_ibl_head(dcontext_t *dcontext, instrlist_t *ilist,
     APP(ilist, compare_tag);
 
     /*>>>    jne     next_fragment                                   */
-    if (miss_8bit)
+    /* The l1 fill below can push the miss target out of 8-bit range. */
+    if (miss_8bit && !l1_cache)
         APP(ilist, INSTR_CREATE_jcc(dcontext, OP_jne_short, miss_tgt));
     else
         APP(ilist, INSTR_CREATE_jcc(dcontext, OP_jne, miss_tgt));
@@ -2125,6 +2169,28 @@ append_ibl_head(dcontext_t *dcontext, instrlist_t *ilist,
     }
 #endif
 
+    if (l1_cache) {
+        /* Fill the l1 slot for this tag with the entry we found.  The found
+         * path still wants the tag in xbx, which we reload from the entry.
+         *>>>    and     $IBL_L1_INDEX_MASK,%xbx
+         *>>>    add     fs:l1_table,%xbx
+         *>>>    mov     %xcx,(%xbx)
+         *>>>    mov     HASHLOOKUP_TAG_OFFS(%xcx),%xbx
+         *>>>  l1_hit:
+         */
+        APP(ilist, INSTR_CREATE_and(dcontext, opnd_create_reg(SCRATCH_REG1),
+                                    OPND_CREATE_INT32((int)IBL_L1_INDEX_MASK())));
+        APP(ilist, INSTR_CREATE_add(dcontext, opnd_create_reg(SCRATCH_REG1),
+                                    OPND_TLS_FIELD(TLS_L1_TABLE_SLOT
+                                                   (ibl_code->branch_type))));
+        APP(ilist, XINST_CREATE_store(dcontext, OPND_CREATE_MEMPTR(SCRATCH_REG1, 0),
+                                      opnd_create_reg(SCRATCH_REG2)));
+        APP(ilist, XINST_CREATE_load(dcontext, opnd_create_reg(SCRATCH_REG1),
+                                     OPND_CREATE_MEMPTR(SCRATCH_REG2,
+                                                        HASHLOOKUP_TAG_OFFS)));
+        APP(ilist, l1_hit);
+    }
+
 #define HEAD_START_PC_OFFS HASHLOOKUP_START_PC_OFFS
     append_ibl_found(dcontext, ilist, ibl_code, patch, HEAD_START_PC_OFFS,
                      false, only_spill_state_in_tls,
@@ -2400,6 +2466,12 @@ emit_indirect_branch_lookup(dcontext_t *dcontext, generated_code_t *code, byte *
     const linkstub_t *linkstub = NULL;
     IF_X64(bool x86_to_x64_ibl_opt = ibl_code->x86_to_x64_mode &&
         DYNAMO_OPTION(x86_to_x64_ibl_opt);)
+    /* Each probe bumps the collision counter, so we keep the loop for stats. */
+    bool unroll_probes = DYNAMO_OPTION(ibl_unroll_probes)
+#ifdef HASHTABLE_STATISTICS
+        && !INTERNAL_OPTION(hashtable_ibl_stats)
+#endif
+        ;
 
     instr_t *next_fragment_nochasing =
         INSTR_CREATE_cmp(dcontext,
@@ -2518,7 +2590,8 @@ emit_indirect_branch_lookup(dcontext_t *dcontext, generated_code_t *code, byte *
     /*>>>    je      sentinel_check                                  */
     /* FIXME: je_short ends up not reaching target for shared inline! */
     APP(&ilist,
-        INSTR_CREATE_jcc(dcontext, OP_je_short, opnd_create_instr(sentinel_check)));
+        INSTR_CREATE_jcc(dcontext, unroll_probes ? OP_je : OP_je_short,
+                         opnd_create_instr(sentinel_check)));
 
     /* For open address hashing xcx = &lookuptable[h]; to get &lt[h+1] just add 8x16
      *   add xcx, 8x16  # no wrap around check, instead rely on a nulltag sentinel entry
@@ -2548,6 +2621,42 @@ emit_indirect_branch_lookup(dcontext_t *dcontext, generated_code_t *code, byte *
                                        OPND_CREATE_MEMPTR(SCRATCH_REG2,
                                                           HASHLOOKUP_TAG_OFFS),
                                        opnd_create_reg(SCRATCH_REG1));
+    }
+    if (unroll_probes) {
+        /* The table is cache-line aligned (HASHTABLE_ALIGN_TABLE), so the next
+         * few entries are usually in the line we just loaded.  We probe them
+         * here rather than taking a branch back to compare_tag for each one.
+         * A match goes to compare_tag, which repeats the compare (and for
+         * x86_mode the top-bits check) so the hit path is shared.
+         *>>>    cmp     HASHLOOKUP_TAG_OFFS(%xcx),%xbx
+         *>>>    je      compare_tag
+         *>>>    cmp     $0, HASHLOOKUP_TAG_OFFS(%xcx)
+         *>>>    je      sentinel_check
+         *>>>    lea     sizeof(fragment_entry_t)(%xcx),%xcx
+         */
+        uint i;
+        for (i = 1; i < proc_get_cache_line_size() / sizeof(fragment_entry_t); i++) {
+            APP(&ilist,
+                INSTR_CREATE_cmp(dcontext,
+                                 OPND_CREATE_MEMPTR(SCRATCH_REG2, HASHLOOKUP_TAG_OFFS),
+                                 opnd_create_reg(SCRATCH_REG1)));
+            APP(&ilist,
+                INSTR_CREATE_jcc(dcontext, OP_je, opnd_create_instr(compare_tag)));
+            APP(&ilist,
+                INSTR_CREATE_cmp(dcontext,
+                                 OPND_CREATE_MEMPTR(SCRATCH_REG2, HASHLOOKUP_TAG_OFFS),
+                                 OPND_CREATE_INT8(0)));
+            APP(&ilist,
+                INSTR_CREATE_jcc(dcontext, OP_je, opnd_create_instr(sentinel_check)));
+            APP(&ilist,
+                INSTR_CREATE_lea(dcontext, opnd_create_reg(SCRATCH_REG2),
+                                 opnd_create_base_disp(SCRATCH_REG2, REG_NULL, 0,
+                                                       sizeof(fragment_entry_t),
+                                                       OPSZ_lea)));
+        }
+    }
+
+    if (inline_ibl_head) {
         APP(&ilist, compare_tag);
 
         /*  TODO: check whether the static predictor can help here */
@@ -2564,6 +2673,9 @@ emit_indirect_branch_lookup(dcontext_t *dcontext, generated_code_t *code, byte *
                          DYNAMO_OPTION(trace_single_restore_prefix) :
                          DYNAMO_OPTION(bb_single_restore_prefix),
                          NULL);
+    } else if (ibl_use_l1_cache(ibl_code, target_trace_table, inline_ibl_head)) {
+        /* The l1 fill in the head can put compare_tag out of 8-bit range. */
+        APP(&ilist, INSTR_CREATE_jmp(dcontext, opnd_create_instr(compare_tag)));
     } else {
         /* case 5232: use INSTR_CREATE_jmp_smart,
          * since release builds can use a short jump
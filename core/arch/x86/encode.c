@@ -2310,6 +2310,162 @@ copy_and_re_relativize_raw_instr(dcontext_t *dcontext, instr_t *instr,
     return orig_dst_pc + instr->length;
 }
 
+/* -encode_cache: a small per-thread direct-mapped cache of the bytes produced
+ * for instrs whose encoding cannot depend on where they are emitted.  Mangling
+ * and stub emission produce the same spills, flag saves, and TLS accesses over
+ * and over, and a hit copies the bytes rather than walking the decode_table
+ * templates for the opcode again.  Entries match only on an exact opcode,
+ * prefix, mode, and operand (including size) match, so the encoding chosen is
+ * always the one the template walk would pick.
+ */
+#define ENCODE_CACHE_BITS 7
+#define ENCODE_CACHE_SIZE (1 << ENCODE_CACHE_BITS)
+#define ENCODE_CACHE_MAX_DSTS 2
+#define ENCODE_CACHE_MAX_SRCS 3
+
+typedef struct _encode_cache_entry_t {
+    int opcode; /* OP_INVALID for an unused entry */
+    uint prefixes;
+#ifdef X64
+    bool x86_mode;
+#endif
+    byte num_dsts;
+    byte num_srcs;
+    byte length;
+    opnd_t dsts[ENCODE_CACHE_MAX_DSTS];
+    opnd_t srcs[ENCODE_CACHE_MAX_SRCS];
+    byte bytes[MAX_INSTR_LENGTH];
+} encode_cache_entry_t;
+
+typedef struct _encode_cache_t {
+    encode_cache_entry_t entry[ENCODE_CACHE_SIZE];
+} encode_cache_t;
+
+void
+encode_thread_init(dcontext_t *dcontext)
+{
+    encode_cache_t *cache = NULL;
+    if (DYNAMO_OPTION(encode_cache)) {
+        cache = (encode_cache_t *)
+            heap_alloc(dcontext, sizeof(*cache) HEAPACCT(ACCT_OTHER));
+        memset(cache, 0, sizeof(*cache));
+    }
+    dcontext->encode_field = (void *) cache;
+}
+
+void
+encode_thread_exit(dcontext_t *dcontext)
+{
+    if (dcontext->encode_field != NULL) {
+        heap_free(dcontext, dcontext->encode_field, sizeof(encode_cache_t)
+                  HEAPACCT(ACCT_OTHER));
+        dcontext->encode_field = NULL;
+    }
+}
+
+/* Only operands whose encoding is independent of the pc qualify: no pc or
+ * instr_t targets and no addresses that might be made rip-relative.
+ */
+static inline bool
+encode_cache_opnd_ok(opnd_t opnd)
+{
+    return (opnd_is_null(opnd) || opnd_is_reg(opnd) || opnd_is_immed_int(opnd) ||
+            opnd_is_base_disp(opnd));
+}
+
+static inline uint
+encode_cache_opnd_hash(opnd_t opnd)
+{
+    if (opnd_is_reg(opnd))
+        return opnd_get_reg(opnd);
+    else if (opnd_is_immed_int(opnd))
+        return (uint) opnd_get_immed_int(opnd);
+    else if (opnd_is_base_disp(opnd)) {
+        return (opnd_get_base(opnd) ^ (opnd_get_index(opnd) << 8) ^
+                (uint) opnd_get_disp(opnd));
+    }
+    return 0;
+}
+
+static inline bool
+encode_cache_opnd_same(opnd_t op1, opnd_t op2)
+{
+    return (opnd_get_size(op1) == opnd_get_size(op2) && opnd_same(op1, op2));
+}
+
+/* Returns the cache slot for instr, or NULL if instr cannot be cached. */
+static encode_cache_entry_t *
+encode_cache_slot(dcontext_t *dcontext, instr_t *instr)
+{
+    encode_cache_t *cache;
+    uint hash;
+    int i;
+    /* Only the owning thread touches its cache, which also rules out
+     * GLOBAL_DCONTEXT encodings during init.
+     */
+    if (dcontext == GLOBAL_DCONTEXT || dcontext->encode_field == NULL ||
+        dcontext != get_thread_private_dcontext())
+        return NULL;
+    if (instr_num_dsts(instr) > ENCODE_CACHE_MAX_DSTS ||
+        instr_num_srcs(instr) > ENCODE_CACHE_MAX_SRCS)
+        return NULL;
+    cache = (encode_cache_t *) dcontext->encode_field;
+    hash = (uint) instr_get_opcode(instr) ^ (instr->prefixes << 5);
+    for (i = 0; i < instr_num_dsts(instr); i++) {
+        opnd_t opnd = instr_get_dst(instr, i);
+        if (!encode_cache_opnd_ok(opnd))
+            return NULL;
+        hash = hash * 31 + encode_cache_opnd_hash(opnd);
+    }
+    for (i = 0; i < instr_num_srcs(instr); i++) {
+        opnd_t opnd = instr_get_src(instr, i);
+        if (!encode_cache_opnd_ok(opnd))
+            return NULL;
+        hash = hash * 31 + encode_cache_opnd_hash(opnd);
+    }
+    hash ^= hash >> ENCODE_CACHE_BITS;
+    hash ^= hash >> (2 * ENCODE_CACHE_BITS);
+    return &cache->entry[hash & (ENCODE_CACHE_SIZE - 1)];
+}
+
+static bool
+encode_cache_matches(encode_cache_entry_t *e, instr_t *instr)
+{
+    int i;
+    if (e->opcode != instr_get_opcode(instr) || e->prefixes != instr->prefixes ||
+        IF_X64(e->x86_mode != instr_get_x86_mode(instr) ||)
+        e->num_dsts != instr_num_dsts(instr) || e->num_srcs != instr_num_srcs(instr))
+        return false;
+    for (i = 0; i < e->num_dsts; i++) {
+        if (!encode_cache_opnd_same(e->dsts[i], instr_get_dst(instr, i)))
+            return false;
+    }
+    for (i = 0; i < e->num_srcs; i++) {
+        if (!encode_cache_opnd_same(e->srcs[i], instr_get_src(instr, i)))
+            return false;
+    }
+    return true;
+}
+
+static void
+encode_cache_fill(encode_cache_entry_t *e, instr_t *instr, byte *start, byte *end)
+{
+    int i;
+    ASSERT(end - start <= MAX_INSTR_LENGTH);
+    e->opcode = instr_get_opcode(instr);
+    e->prefixes = instr->prefixes;
+    IF_X64(e->x86_mode = instr_get_x86_mode(instr));
+    e->num_dsts = (byte) instr_num_dsts(instr);
+    e->num_srcs = (byte) instr_num_srcs(instr);
+    for (i = 0; i < e->num_dsts; i++)
+        e->dsts[i] = instr_get_dst(instr, i);
+    for (i = 0; i < e->num_srcs; i++)
+        e->srcs[i] = instr_get_src(instr, i);
+    e->length = (byte) (end - start);
+    memcpy(e->bytes, start, e->length);
+    STATS_INC(num_encode_cache_adds);
+}
+
 /* Encodes instruction instr.  The parameter copy_pc points
  * to the address of this instruction in the fragment cache.
  * Checks for and fixes pc-relative instructions.
@@ -2337,6 +2493,7 @@ instr_encode_arch(dcontext_t *dcontext, instr_t *instr, byte *copy_pc, byte *fin
     byte *disp_relativize_at = NULL;
     uint opc;
     bool output_initial_opcode = false;
+    encode_cache_entry_t *cache_slot = NULL;
     if (has_instr_opnds != NULL)
         *has_instr_opnds = false;
 
@@ -2362,6 +2519,15 @@ instr_encode_arch(dcontext_t *dcontext, instr_t *instr, byte *copy_pc, byte *fin
         }
     }
 
+    if (DYNAMO_OPTION(encode_cache)) {
+        cache_slot = encode_cache_slot(dcontext, instr);
+        if (cache_slot != NULL && encode_cache_matches(cache_slot, instr)) {
+            memcpy(copy_pc, cache_slot->bytes, cache_slot->length);
+            STATS_INC(num_encode_cache_hits);
+            return copy_pc + cache_slot->length;
+        }
+    }
+
     /* else really encode */
     info = instr_get_instr_info(instr);
     if (info == NULL) {
@@ -2728,6 +2894,9 @@ instr_encode_arch(dcontext_t *dcontext, instr_t *instr, byte *copy_pc, byte *fin
     }
 #endif
 
+    if (cache_slot != NULL && !di.has_instr_opnds && disp_relativize_at == NULL)
+        encode_cache_fill(cache_slot, instr, cache_pc, field_ptr);
+
     if (has_instr_opnds != NULL)
         *has_instr_opnds = di.has_instr_opnds;
     return field_ptr;
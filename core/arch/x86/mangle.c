@@ -270,9 +270,15 @@ remangle_short_rewrite(dcontext_t *dcontext,
 #if !defined(STANDALONE_DECODER)
 
 int
-insert_out_of_line_context_switch(dcontext_t *dcontext, instrlist_t *ilist,
-                                  instr_t *instr, bool save)
+insert_out_of_line_context_switch(dcontext_t *dcontext, clean_call_info_t *cci,
+                                  instrlist_t *ilist, instr_t *instr, bool save)
 {
+    /* Callees that touch no xmm regs get the smaller shared routines, unless
+     * the caller wants the full mcontext shape on the stack.
+     */
+    bool save_xmm = (cci->num_xmms_skip != NUM_XMM_REGS || cci->preserve_mcontext);
+    int switch_size = save_xmm ? get_clean_call_switch_stack_size() :
+        get_clean_call_noxmm_switch_stack_size();
     if (save) {
         /* We adjust the stack so the return address will not be clobbered,
          * so we can have call/return pair to take advantage of hardware
@@ -284,16 +290,18 @@ insert_out_of_line_context_switch(dcontext_t *dcontext, instrlist_t *ilist,
             (dcontext,
              opnd_create_reg(DR_REG_XSP),
              opnd_create_base_disp(DR_REG_XSP, DR_REG_NULL, 0,
-                                   -(int)(get_clean_call_switch_stack_size() +
+                                   -(int)(switch_size +
                                           get_clean_call_temp_stack_size()),
                                    OPSZ_lea)));
     }
     PRE(ilist, instr,
         INSTR_CREATE_call
         (dcontext, save ?
-         opnd_create_pc(get_clean_call_save(dcontext _IF_X64(GENCODE_X64))) :
-         opnd_create_pc(get_clean_call_restore(dcontext _IF_X64(GENCODE_X64)))));
-    return get_clean_call_switch_stack_size();
+         opnd_create_pc(get_clean_call_save(dcontext, save_xmm
+                                            _IF_X64(GENCODE_X64))) :
+         opnd_create_pc(get_clean_call_restore(dcontext, save_xmm
+                                               _IF_X64(GENCODE_X64)))));
+    return switch_size;
 }
 
 void
@@ -360,7 +368,16 @@ insert_push_all_registers(dcontext_t *dcontext, clean_call_info_t *cci,
          * currently have 32-byte alignment for clean calls.
          */
         uint opcode = move_mm_reg_opcode(ALIGNED(alignment, 16), ALIGNED(alignment, 32));
+        reg_id_t reg_base = REG_SAVED_XMM0;
+        opnd_size_t reg_size = OPSZ_SAVED_XMM;
         ASSERT(proc_has_feature(FEATURE_SSE));
+        if (cci->skip_save_ymmh) {
+            /* The callee leaves the top halves alone (only legacy SSE) */
+            ASSERT(YMM_ENABLED());
+            opcode = ALIGNED(alignment, 16) ? OP_movdqa : OP_movdqu;
+            reg_base = REG_XMM0;
+            reg_size = OPSZ_16;
+        }
         for (i=0; i<NUM_XMM_SAVED; i++) {
             if (!cci->xmm_skip[i]) {
                 PRE(ilist, instr, instr_create_1dst_1src
@@ -368,8 +385,8 @@ insert_push_all_registers(dcontext_t *dcontext, clean_call_info_t *cci,
                      opnd_create_base_disp(REG_XSP, REG_NULL, 0,
                                            PRE_XMM_PADDING + i*XMM_SAVED_REG_SIZE +
                                            offs_beyond_xmm,
-                                           OPSZ_SAVED_XMM),
-                     opnd_create_reg(REG_SAVED_XMM0 + (reg_id_t)i)));
+                                           reg_size),
+                     opnd_create_reg(reg_base + (reg_id_t)i)));
             }
         }
         ASSERT(i*XMM_SAVED_REG_SIZE == XMM_SAVED_SIZE);
@@ -503,15 +520,24 @@ insert_pop_all_registers(dcontext_t *dcontext, clean_call_info_t *cci,
         /* See discussion in emit_fcache_enter_shared on which opcode
          * is better. */
         uint opcode = move_mm_reg_opcode(ALIGNED(alignment, 32), ALIGNED(alignment, 16));
+        reg_id_t reg_base = REG_SAVED_XMM0;
+        opnd_size_t reg_size = OPSZ_SAVED_XMM;
         ASSERT(proc_has_feature(FEATURE_SSE));
+        if (cci->skip_save_ymmh) {
+            /* Must match insert_push_all_registers() */
+            ASSERT(YMM_ENABLED());
+            opcode = ALIGNED(alignment, 16) ? OP_movdqa : OP_movdqu;
+            reg_base = REG_XMM0;
+            reg_size = OPSZ_16;
+        }
         for (i=0; i<NUM_XMM_SAVED; i++) {
             if (!cci->xmm_skip[i]) {
                 PRE(ilist, instr, instr_create_1dst_1src
-                    (dcontext, opcode, opnd_create_reg(REG_SAVED_XMM0 + (reg_id_t)i),
+                    (dcontext, opcode, opnd_create_reg(reg_base + (reg_id_t)i),
                      opnd_create_base_disp(REG_XSP, REG_NULL, 0,
                                            PRE_XMM_PADDING + i*XMM_SAVED_REG_SIZE +
                                            offs_beyond_xmm,
-                                           OPSZ_SAVED_XMM)));
+                                           reg_size)));
             }
         }
         ASSERT(i*XMM_SAVED_REG_SIZE == XMM_SAVED_SIZE);
@@ -3173,10 +3199,54 @@ mangle_annotation_helper(dcontext_t *dcontext, instr_t *label, instrlist_t *ilis
     dr_annotation_handler_t *handler = GET_ANNOTATION_HANDLER(label_data);
     dr_annotation_receiver_t *receiver = handler->receiver_list;
     opnd_t *args = NULL;
+    dr_cleancall_save_t save_flags;
 
+    if (handler->type == DR_ANNOTATION_HANDLER_COUNTER) {
+        /* DR annotations are at the entry of the annotation function, where the
+         * arithmetic flags are dead, so a bare increment suffices.
+         */
+        if (receiver != NULL) {
+            instr_t *inc = INSTR_CREATE_inc
+                (dcontext, OPND_CREATE_ABSMEM(receiver->instrumentation.counter,
+                                              OPSZ_PTR));
+            PRE(ilist, label, LOCK(inc));
+        }
+        return;
+    }
+    if (handler->type == DR_ANNOTATION_HANDLER_TLS_STORE) {
+        if (receiver != NULL) {
+            opnd_t arg = receiver->instrumentation.tls_store.arg;
+            opnd_t slot = opnd_create_far_base_disp
+                (receiver->instrumentation.tls_store.segment, REG_NULL, REG_NULL, 0,
+                 receiver->instrumentation.tls_store.offset, OPSZ_PTR);
+            if (!opnd_is_reg(arg)) {
+                /* A stack arg needs a register: %xax is caller-saved and is never
+                 * an argument register, so it is dead at function entry.
+                 */
+                PRE(ilist, label, INSTR_CREATE_mov_ld(dcontext,
+                                                      opnd_create_reg(REG_XAX), arg));
+                arg = opnd_create_reg(REG_XAX);
+            }
+            PRE(ilist, label, INSTR_CREATE_mov_st(dcontext, slot, arg));
+        }
+        return;
+    }
     ASSERT(handler->type == DR_ANNOTATION_HANDLER_CALL);
 
+    /* For DR annotations (but not Valgrind annotations, which have no symbol and are
+     * inline in the app code) the clean call is at the entry of the annotation
+     * function. The calling convention leaves the arithmetic flags and the
+     * caller-saved xmm registers dead there, so the call need not preserve them.
+     */
     while (receiver != NULL) {
+        if (receiver->save_fpstate)
+            save_flags = DR_CLEANCALL_SAVE_FLOAT;
+        else if (handler->symbol_name != NULL)
+            save_flags = DR_CLEANCALL_NOSAVE_XMM;
+        else
+            save_flags = 0;
+        if (handler->symbol_name != NULL)
+            save_flags |= DR_CLEANCALL_NOSAVE_FLAGS;
         if (handler->num_args != 0) {
             args = HEAP_ARRAY_ALLOC(dcontext, opnd_t, handler->num_args,
                                     ACCT_CLEANCALL, UNPROTECTED);
@@ -3184,7 +3254,7 @@ mangle_annotation_helper(dcontext_t *dcontext, instr_t *label, instrlist_t *ilis
         }
         dr_insert_clean_call_ex_varg(dcontext, ilist, label,
                                      receiver->instrumentation.callback,
-                                     receiver->save_fpstate ? DR_CLEANCALL_SAVE_FLOAT : 0,
+                                     save_flags,
                                      handler->num_args, args);
         if (handler->num_args != 0) {
             HEAP_ARRAY_FREE(dcontext, args, opnd_t, handler->num_args,
@@ -4009,6 +4079,56 @@ insert_selfmod_sandbox(dcontext_t *dcontext, instrlist_t *ilist, uint flags,
     return true;
 }
 
+/* For -fragment_counts: increments the 64-bit execution counter at counter
+ * ahead of the first app instr of the block.  We go after any selfmod
+ * top-of-bb check, whose patch offsets are relative to the block entry, and
+ * after any client instrumentation at the top.  The increment is not atomic.
+ */
+void
+insert_fragment_exec_counter(dcontext_t *dcontext, instrlist_t *ilist, uint flags,
+                             uint64 *counter, bool record_translation)
+{
+    instr_t *where;
+    for (where = instrlist_first_expanded(dcontext, ilist);
+         where != NULL && instr_is_meta(where);
+         where = instr_get_next_expanded(dcontext, ilist, where))
+        ; /* nothing */
+    if (where == NULL)
+        return;
+    /* Client code ahead of us might have left its own value in the flags. */
+    if (where != instrlist_first(ilist))
+        flags &= ~(FRAG_WRITES_EFLAGS_6 | FRAG_WRITES_EFLAGS_OF);
+
+    instrlist_set_our_mangling(ilist, true); /* PR 267260 */
+    if (record_translation)
+        instrlist_set_translation_target(ilist, instr_get_translation(where));
+    insert_save_eflags(dcontext, ilist, where, flags, true/*tls*/, false/*!absolute*/
+                       _IF_X64(false));
+#ifdef X64
+    PRE(ilist, where,
+        SAVE_TO_TLS(dcontext, REG_XCX, MANGLE_XCX_SPILL_SLOT));
+    PRE(ilist, where,
+        INSTR_CREATE_mov_imm(dcontext, opnd_create_reg(REG_XCX),
+                             OPND_CREATE_INTPTR(counter)));
+    PRE(ilist, where,
+        INSTR_CREATE_inc(dcontext, OPND_CREATE_MEM64(REG_XCX, 0)));
+    PRE(ilist, where,
+        RESTORE_FROM_TLS(dcontext, REG_XCX, MANGLE_XCX_SPILL_SLOT));
+#else
+    PRE(ilist, where,
+        INSTR_CREATE_add(dcontext, OPND_CREATE_ABSMEM(counter, OPSZ_4),
+                         OPND_CREATE_INT8(1)));
+    PRE(ilist, where,
+        INSTR_CREATE_adc(dcontext, OPND_CREATE_ABSMEM((byte *)counter + 4, OPSZ_4),
+                         OPND_CREATE_INT8(0)));
+#endif
+    insert_restore_eflags(dcontext, ilist, where, flags, true/*tls*/, false/*!absolute*/
+                          _IF_X64(false));
+    if (record_translation)
+        instrlist_set_translation_target(ilist, NULL);
+    instrlist_set_our_mangling(ilist, false); /* PR 267260 */
+}
+
 /* Offsets within selfmod sandbox top-of-bb code that we patch once
  * the code is emitted, as the values depend on the emitted address.
  * These vary by whether sandbox_top_of_bb_check_s2ro() and whether
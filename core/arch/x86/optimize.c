@@ -134,8 +134,14 @@ void
 optimize_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
 {
     /* we have un-truncation-check 32-bit casts for opnd_get_immed_int(), for
-     * one thing, here and in loadtoconst.c */
-    IF_X64(ASSERT_NOT_IMPLEMENTED(false));
+     * one thing, here and in loadtoconst.c, so on x64 options.c only lets
+     * through the passes that have been made 64-bit-safe.
+     */
+    IF_X64(ASSERT_NOT_IMPLEMENTED(!dynamo_options.unroll_loops &&
+                                  dynamo_options.constant_prop == 0 &&
+                                  dynamo_options.remove_dead_code == 0 &&
+                                  !dynamo_options.rlr &&
+                                  !dynamo_options.stack_adjust));
 
     /* FIXME: this routine is of course not in its final form
      * we are still playing with different optimizations
@@ -3882,13 +3888,19 @@ peephole_optimize(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
              * this makes a difference on microbenchmarks, doesn't
              * seem to show up on spec though
              */
-            instrlist_preinsert(trace, inst,
-                                INSTR_CREATE_mov_ld(dcontext,
-                                                    opnd_create_reg(REG_ESP),
-                                                    opnd_create_reg(REG_EBP)));
-            instrlist_preinsert(trace, inst,
-                                INSTR_CREATE_pop(dcontext,
-                                                 opnd_create_reg(REG_EBP)));
+            /* Both replacements translate back to the leave: if the pop
+             * faults, re-executing the leave is safe since the mov is
+             * idempotent.
+             */
+            app_pc xl8 = instr_get_translation(inst);
+            instr_t *in;
+            in = INSTR_CREATE_mov_ld(dcontext, opnd_create_reg(REG_XSP),
+                                     opnd_create_reg(REG_XBP));
+            instr_set_translation(in, xl8);
+            instrlist_preinsert(trace, inst, in);
+            in = INSTR_CREATE_pop(dcontext, opnd_create_reg(REG_XBP));
+            instr_set_translation(in, xl8);
+            instrlist_preinsert(trace, inst, in);
             instrlist_remove(trace, inst);
             instr_destroy(dcontext, inst);
         }
@@ -3981,6 +3993,7 @@ replace_inc_with_add(dcontext_t *dcontext, instr_t *inst, instrlist_t *trace)
         in = INSTR_CREATE_sub(dcontext, instr_get_dst(inst, 0), OPND_CREATE_INT8(1));
     }
     instr_set_prefixes(in, instr_get_prefixes(inst));
+    instr_set_translation(in, instr_get_translation(inst));
     replace_inst(dcontext, trace, inst, in);
     return true;
 }
@@ -157,6 +157,7 @@ DECL_EXTERN(native_module_callout)
 DECL_EXTERN(dispatch)
 #ifdef DR_APP_EXPORTS
 DECL_EXTERN(dr_app_start_helper)
+DECL_EXTERN(dr_app_start_thread_helper)
 #endif
 DECL_EXTERN(dynamo_process_exit)
 DECL_EXTERN(dynamo_thread_exit)
@@ -486,6 +487,27 @@ GLOBAL_LABEL(dr_app_start:)
         ret
         END_FUNC(dr_app_start)
 
+/*
+ * dr_app_start_thread - Causes only the current thread to run under Dynamo control
+ */
+        DECLARE_EXPORTED_FUNC(dr_app_start_thread)
+GLOBAL_LABEL(dr_app_start_thread:)
+        sub     REG_XSP, FRAME_ALIGNMENT - ARG_SZ  /* Maintain alignment. */
+
+        /* grab exec state and pass as param in a priv_mcontext_t struct */
+        PUSH_PRIV_MCXT(PTRSZ [FRAME_ALIGNMENT - ARG_SZ + REG_XSP -\
+                       PUSH_PRIV_MCXT_PRE_PC_SHIFT]) /* return address as pc */
+
+        /* do the rest in C */
+        lea     REG_XAX, [REG_XSP] /* stack grew down, so priv_mcontext_t at tos */
+        CALLC1(GLOBAL_REF(dr_app_start_thread_helper), REG_XAX)
+
+        /* if we come back, then DR is not taking control so
+         * clean up stack and return */
+        add      REG_XSP, PRIV_MCXT_SIZE + FRAME_ALIGNMENT - ARG_SZ
+        ret
+        END_FUNC(dr_app_start_thread)
+
 /*
  * dr_app_take_over - For the client interface, we'll export 'dr_app_take_over'
  * for consistency with the dr_ naming convention of all exported functions.
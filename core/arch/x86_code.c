@@ -80,8 +80,8 @@ thread_starting(dcontext_t *dcontext)
 }
 
 /* Initializes a dcontext with the supplied state and calls dispatch */
-void
-dynamo_start(priv_mcontext_t *mc)
+static void
+dynamo_start_common(priv_mcontext_t *mc, bool take_over_threads)
 {
     priv_mcontext_t *mcontext;
     dcontext_t *dcontext = get_thread_private_dcontext();
@@ -89,7 +89,8 @@ dynamo_start(priv_mcontext_t *mc)
     thread_starting(dcontext);
 
     /* Signal other threads for take over. */
-    dynamorio_take_over_threads(dcontext);
+    if (take_over_threads)
+        dynamorio_take_over_threads(dcontext);
 
     /* Set return address */
     mc->pc = canonicalize_pc_target(dcontext, mc->pc);
@@ -120,6 +121,19 @@ dynamo_start(priv_mcontext_t *mc)
     ASSERT_NOT_REACHED();
 }
 
+void
+dynamo_start(priv_mcontext_t *mc)
+{
+    dynamo_start_common(mc, true/*take over other threads*/);
+}
+
+/* Used by dr_app_start_thread(): the other threads are left alone */
+void
+dynamo_start_current_thread(priv_mcontext_t *mc)
+{
+    dynamo_start_common(mc, false/*current thread only*/);
+}
+
 /* auto_setup: called by dynamo_auto_start for non-early follow children.
  * This routine itself would be dynamo_auto_start except that we want
  * our own go-native path separate from load_dynamo (we could still have
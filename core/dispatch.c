@@ -91,6 +91,12 @@ dispatch_exit_fcache(dcontext_t *dcontext);
 static void
 dispatch_exit_fcache_stats(dcontext_t *dcontext);
 
+static void
+exit_profile_start(dcontext_t *dcontext);
+
+static void
+exit_profile_end(dcontext_t *dcontext);
+
 static void
 handle_post_system_call(dcontext_t *dcontext);
 
@@ -365,7 +371,8 @@ dispatch_enter_fcache(dcontext_t *dcontext, fragment_t *targetf)
         (LINKSTUB_DIRECT(dcontext->last_exit->flags) &&
          TEST(FRAG_COARSE_GRAIN, targetf->flags))) {
         coarse_lazy_link(dcontext, targetf);
-    }
+    } else if (DYNAMO_OPTION(lazy_link) && LINKSTUB_DIRECT(dcontext->last_exit->flags))
+        lazy_link_exit(dcontext, targetf);
 
     if (!enter_nolinking(dcontext, targetf, true)) {
         /* not actually entering cache, so back to couldbelinking */
@@ -383,6 +390,18 @@ dispatch_enter_fcache(dcontext_t *dcontext, fragment_t *targetf)
     }
 
     dispatch_enter_fcache_stats(dcontext, targetf);
+    exit_profile_end(dcontext);
+
+#ifdef X86
+    if (DYNAMO_OPTION(trace_ret_predict) && dcontext->local_state != NULL) {
+        /* A prediction must not outlive the trace holding its landing pad,
+         * which can only be deleted while we are out of the cache.  No
+         * return goes to 1, so this never matches.
+         */
+        dcontext->local_state->spill_space.ret_predict_negtag = (reg_t) -1;
+        dcontext->local_state->spill_space.ret_predict_pc = NULL;
+    }
+#endif
 
     /* FIXME: for now we do this before the synch point to avoid complexity of
      * missing a KSTART(fcache_* for cases like NtSetContextThread where a thread
@@ -599,6 +618,7 @@ dispatch_enter_native(dcontext_t *dcontext)
      * entering native execution as well as the fcache.
      */
     fcache_enter_func_t go_native = get_fcache_enter_private_routine(dcontext);
+    exit_profile_end(dcontext);
     set_last_exit(dcontext, (linkstub_t *) get_native_exec_linkstub());
     ASSERT_OWN_NO_LOCKS();
     if (dcontext->next_tag == BACK_TO_NATIVE_AFTER_SYSCALL) {
@@ -780,6 +800,7 @@ dispatch_enter_dynamorio(dcontext_t *dcontext)
         }
 
         dispatch_exit_fcache_stats(dcontext);
+        exit_profile_start(dcontext);
         /* Maybe-permanent native transitions (dr_app_stop()) have to pop kstack,
          * and thus so do temporary native_exec transitions.  Thus, for neither
          * is there anything to pop here.
@@ -992,6 +1013,18 @@ dispatch_exit_fcache(dcontext_t *dcontext)
         }
 #endif /* RCT_IND_BRANCH */
 
+#ifdef CLIENT_INTERFACE
+        if (DYNAMO_OPTION(ibl_profile) && !LINKSTUB_FAKE(dcontext->last_exit)) {
+            app_pc site = dcontext->last_fragment->tag;
+            if (TEST(FRAG_IS_TRACE, dcontext->last_fragment->flags)) {
+                site = get_trace_exit_component_tag
+                    (dcontext, dcontext->last_fragment, dcontext->last_exit);
+            }
+            instrument_ibl_profile_record(dcontext, site, dcontext->next_tag,
+                                          extract_branchtype(dcontext->last_exit->flags));
+        }
+#endif
+
         /* update IBL target tables for any indirect branch exit */
         SELF_PROTECT_LOCAL(dcontext, WRITABLE);
         /* update IBL target table if target is a valid IBT */
@@ -1638,6 +1671,107 @@ dispatch_exit_fcache_stats(dcontext_t *dcontext)
 #endif /* defined(DEBUG) || defined(KSTATS) */
 }
 
+/* -exit_profile: a release-build histogram of cache exits by reason, with the
+ * rdtsc time from each exit until we next leave DR.  Cycles are accumulated
+ * per thread and folded into the shared stats in whole Kcycles.
+ */
+static exit_profile_reason_t
+exit_profile_reason(dcontext_t *dcontext)
+{
+    const linkstub_t *l = dcontext->last_exit;
+    if (l == get_syscall_linkstub() || IS_SHARED_SYSCALLS_LINKSTUB(l))
+        return EXIT_PROFILE_SYSCALL;
+    if (l == get_selfmod_linkstub())
+        return EXIT_PROFILE_SELFMOD;
+    if (l == IF_UNIX_ELSE(get_sigreturn_linkstub(), get_asynch_linkstub()))
+        return EXIT_PROFILE_ASYNCH;
+    if (l == get_native_exec_linkstub() || l == get_native_exec_syscall_linkstub())
+        return EXIT_PROFILE_NATIVE_EXEC;
+#ifdef CLIENT_INTERFACE
+    if (l == get_client_linkstub())
+        return EXIT_PROFILE_CLIENT;
+#endif
+    if (l == get_reset_linkstub() || l == get_ibl_deleted_linkstub()
+        IF_HOTP(|| l == get_hot_patch_linkstub()))
+        return EXIT_PROFILE_OTHER;
+    if (LINKSTUB_INDIRECT(l->flags))
+        return EXIT_PROFILE_INDIRECT;
+    if (exited_due_to_ni_syscall(dcontext))
+        return EXIT_PROFILE_SYSCALL;
+#ifdef WINDOWS
+    if (TEST(LINK_CALLBACK_RETURN, l->flags))
+        return EXIT_PROFILE_ASYNCH;
+#endif
+    if (LINKSTUB_DIRECT(l->flags))
+        return EXIT_PROFILE_DIRECT;
+    return EXIT_PROFILE_OTHER;
+}
+
+static void
+exit_profile_stats_add(exit_profile_reason_t reason, uint count, uint64 kcycles)
+{
+#define EXIT_PROFILE_CASE(reason, stat)                                 \
+    case EXIT_PROFILE_##reason:                                         \
+        if (count > 0)                                                  \
+            RSTATS_ADD(exit_profile_##stat, count);                     \
+        if (kcycles > 0)                                                \
+            RSTATS_ADD(exit_profile_kcycles_##stat, kcycles);           \
+        break
+    switch (reason) {
+    EXIT_PROFILE_CASE(DIRECT, direct);
+    EXIT_PROFILE_CASE(INDIRECT, indirect);
+    EXIT_PROFILE_CASE(SYSCALL, syscall);
+    EXIT_PROFILE_CASE(SELFMOD, selfmod);
+    EXIT_PROFILE_CASE(ASYNCH, asynch);
+    EXIT_PROFILE_CASE(NATIVE_EXEC, native_exec);
+    EXIT_PROFILE_CASE(CLIENT, client);
+    EXIT_PROFILE_CASE(OTHER, other);
+    default: ASSERT_NOT_REACHED();
+    }
+#undef EXIT_PROFILE_CASE
+}
+
+/* Called on every exit from the cache, once last_exit and next_tag are final */
+static void
+exit_profile_start(dcontext_t *dcontext)
+{
+    exit_profile_t *ep = &dcontext->exit_profile;
+    if (!DYNAMO_OPTION(exit_profile))
+        return;
+    /* We can come back out without passing through one of our cache entry
+     * points (e.g., a callback return): charge that time to the prior exit.
+     */
+    exit_profile_end(dcontext);
+    ep->reason = exit_profile_reason(dcontext);
+    /* Exits not from a real fragment are attributed to where we resume */
+    ep->tag = dcontext->last_fragment->tag;
+    if (ep->tag == NULL)
+        ep->tag = dcontext->next_tag;
+    exit_profile_stats_add(ep->reason, 1, 0);
+    RDTSC_LL(ep->start);
+}
+
+/* Called whenever we leave DR for the cache, a system call or native code */
+static void
+exit_profile_end(dcontext_t *dcontext)
+{
+    exit_profile_t *ep = &dcontext->exit_profile;
+    uint64 now, cycles;
+    if (ep->start == 0)
+        return;
+    RDTSC_LL(now);
+    cycles = now - ep->start;
+    ep->start = 0;
+    ep->pending[ep->reason] += cycles;
+    if (ep->pending[ep->reason] >= 1024) {
+        exit_profile_stats_add(ep->reason, 0, ep->pending[ep->reason] >> 10);
+        ep->pending[ep->reason] &= 1023;
+    }
+#ifdef CLIENT_INTERFACE
+    instrument_exit_profile_record(dcontext, ep->tag, ep->reason, cycles);
+#endif
+}
+
 
 /***************************************************************************
  * SYSTEM CALLS
@@ -1932,6 +2066,7 @@ handle_system_call(dcontext_t *dcontext)
         SELF_PROTECT_LOCAL(dcontext, READONLY);
 
         set_at_syscall(dcontext, true);
+        exit_profile_end(dcontext);
         KSTART_DC(dcontext, syscall_fcache); /* stopped in dispatch_exit_fcache_stats */
         enter_fcache(dcontext, (fcache_enter_func_t)
                      /* DEFAULT_ISA_MODE as we want the ISA mode of our gencode */
@@ -2112,6 +2247,7 @@ issue_last_system_call_from_app(dcontext_t *dcontext)
 
     if (is_couldbelinking(dcontext))
         enter_nolinking(dcontext, NULL, true);
+    exit_profile_end(dcontext);
     KSTART(syscall_fcache); /* stopped in dispatch_exit_fcache_stats */
     enter_fcache(dcontext, (fcache_enter_func_t)
                  /* DEFAULT_ISA_MODE as we want the ISA mode of our gencode */
@@ -53,6 +53,31 @@ issue_last_system_call_from_app(dcontext_t *dcontext);
 void
 transfer_to_dispatch(dcontext_t *dcontext, priv_mcontext_t *mc, bool full_DR_state);
 
+/* Why a thread left the code cache, as classified for -exit_profile.
+ * Must be kept in synch with dr_exit_reason_t.
+ */
+typedef enum {
+    EXIT_PROFILE_DIRECT,       /* direct branch not (yet) linked */
+    EXIT_PROFILE_INDIRECT,     /* indirect branch lookup miss */
+    EXIT_PROFILE_SYSCALL,      /* system call handled by DR, pre or post */
+    EXIT_PROFILE_SELFMOD,      /* fragment flushed itself for code modification */
+    EXIT_PROFILE_ASYNCH,       /* signal, sigreturn, callback or exception */
+    EXIT_PROFILE_NATIVE_EXEC,  /* transition to or from native_exec */
+    EXIT_PROFILE_CLIENT,       /* client redirection */
+    EXIT_PROFILE_OTHER,        /* reset, hot patch, deleted fragment, etc. */
+    EXIT_PROFILE_NUM_REASONS
+} exit_profile_reason_t;
+
+/* Per-thread -exit_profile state, embedded in the dcontext */
+typedef struct _exit_profile_t {
+    /* timestamp of the exit we have not yet re-entered the cache from, or 0 */
+    uint64 start;
+    exit_profile_reason_t reason;
+    app_pc tag;
+    /* cycles not yet folded into the Kcycle release stats */
+    uint64 pending[EXIT_PROFILE_NUM_REASONS];
+} exit_profile_t;
+
 /* hooks on entry/exit to/from DR */
 #define NO_HOOK ((void (*)(void)) NULL)
 
@@ -349,12 +349,220 @@ statistics_exit(void)
     stats = NULL;
 }
 
+#ifdef LINUX
+/* With -stats_shmem, the global stats live in a file under /dev/shm so that
+ * an external viewer (tools/drstatsunix.c) can map it read-only and sample
+ * the values while we run.  The stats are updated in place with the same
+ * atomic adds as always, so readers need no lock.
+ */
+static dr_statistics_t *stats_shmem;
+static char stats_shmem_name[MAXIMUM_PATH];
+
+/* Creates a fresh segment holding the current stats and maps it at addr
+ * (or anywhere if addr is NULL).  Returns NULL on failure.
+ */
+static byte *
+statistics_shmem_create(dr_statistics_t *cur, app_pc addr)
+{
+    file_t f;
+    size_t size = sizeof(dr_statistics_t);
+    byte *map;
+    snprintf(stats_shmem_name, BUFFER_SIZE_ELEMENTS(stats_shmem_name),
+             "%s/%s%d", STATS_SHMEM_DIR, STATS_SHMEM_PREFIX, get_process_id());
+    NULL_TERMINATE_BUFFER(stats_shmem_name);
+    /* a stale segment from a previous process with our pid may be present */
+    os_delete_file(stats_shmem_name);
+    f = os_open(stats_shmem_name, OS_OPEN_WRITE | OS_OPEN_REQUIRE_NEW);
+    if (f == INVALID_FILE)
+        return NULL;
+    if (os_write(f, cur, size) != (ssize_t) size) {
+        os_close(f);
+        os_delete_file(stats_shmem_name);
+        return NULL;
+    }
+    if (addr == NULL)
+        map = map_file(f, &size, 0, NULL, MEMPROT_READ|MEMPROT_WRITE, 0);
+    else {
+        /* already accounted for as DR memory */
+        map = os_map_file(f, &size, 0, addr, MEMPROT_READ|MEMPROT_WRITE,
+                          MAP_FILE_FIXED);
+    }
+    os_close(f);
+    if (map == NULL)
+        os_delete_file(stats_shmem_name);
+    return map;
+}
+
+static void
+statistics_shmem_init(void)
+{
+    if (!DYNAMO_OPTION(stats_shmem))
+        return;
+# ifndef DEBUG
+    if (!DYNAMO_OPTION(global_rstats))
+        return;
+# endif
+    ASSERT(stats == &nonshared_stats);
+    /* the magic string is deliberately truncated to fit */
+    memcpy(stats->magicstring, DYNAMORIO_MAGIC_STRING,
+           BUFFER_SIZE_ELEMENTS(stats->magicstring) - 1);
+    NULL_TERMINATE_BUFFER(stats->magicstring);
+    stats_shmem = (dr_statistics_t *) statistics_shmem_create(stats, NULL);
+    if (stats_shmem == NULL) {
+        SYSLOG_INTERNAL_WARNING("unable to create shared stats segment %s",
+                                stats_shmem_name);
+        return;
+    }
+    stats = stats_shmem;
+    LOG(GLOBAL, LOG_TOP|LOG_STATS, 1, "stats exported in %s\n", stats_shmem_name);
+}
+
+/* The child of a fork must not keep updating its parent's segment.  We can't
+ * just switch the stats pointer, as generated code may have the address of a
+ * stat baked in, so we replace the mapping in place.
+ */
+static void
+statistics_shmem_fork_init(void)
+{
+    if (stats_shmem == NULL)
+        return;
+    memcpy(&nonshared_stats, stats_shmem, sizeof(nonshared_stats));
+    nonshared_stats.process_id = get_process_id();
+    if (statistics_shmem_create(&nonshared_stats, (app_pc) stats_shmem) == NULL) {
+        /* Keep the parent's segment rather than leave a hole in DR memory. */
+        SYSLOG_INTERNAL_WARNING("unable to re-create shared stats segment %s",
+                                stats_shmem_name);
+    }
+}
+
+static void
+statistics_shmem_exit(void)
+{
+    if (stats_shmem == NULL)
+        return;
+    /* the code cache is gone, so nothing else refers to the segment */
+    memcpy(&nonshared_stats, stats_shmem, sizeof(nonshared_stats));
+    stats = &nonshared_stats;
+    unmap_file((byte *) stats_shmem, sizeof(dr_statistics_t));
+    os_delete_file(stats_shmem_name);
+    stats_shmem = NULL;
+}
+#endif
+
 dr_statistics_t *
 get_dr_stats(void)
 {
     return stats;
 }
 
+/* -startup_profile: wall-clock time of each phase of dynamorio_app_init() and
+ * of building the first -startup_profile_blocks blocks.  Phases are recorded
+ * before .data is protected; the block count is the only later write.
+ */
+typedef enum {
+    STARTUP_OPTIONS,
+    STARTUP_CLIENT_LOAD,
+    STARTUP_HEAP,
+    STARTUP_OS,
+    STARTUP_LOADER,
+    STARTUP_COMPONENTS,
+    STARTUP_THREAD_INIT,
+    STARTUP_MODULE_SCAN,
+    STARTUP_CLIENT_INIT,
+    STARTUP_OTHER,
+    STARTUP_FIRST_BLOCKS,
+    STARTUP_NUM_PHASES
+} startup_phase_t;
+
+static const char * const startup_phase_names[STARTUP_NUM_PHASES] = {
+    "options",
+    "client lib load",
+    "heap",
+    "os and vm areas",
+    "private loader",
+    "components",
+    "initial thread",
+    "module scan",
+    "client init",
+    "other",
+    "first blocks",
+};
+
+static uint64 startup_phase_us[STARTUP_NUM_PHASES];
+static uint64 startup_last_mark;
+DECLARE_NEVERPROT_VAR(static volatile int startup_blocks_built, 0);
+
+/* Charges the time since the previous mark to phase.  The starting mark is
+ * taken before options are read, so it is unconditional.
+ */
+static void
+startup_profile_mark(startup_phase_t phase)
+{
+    uint64 now;
+    if (!DYNAMO_OPTION(startup_profile))
+        return;
+    now = query_time_micros();
+    startup_phase_us[phase] += now - startup_last_mark;
+    startup_last_mark = now;
+}
+
+static void
+startup_profile_report(uint64 first_blocks_us, int num_blocks)
+{
+    uint64 total = 0;
+    int i;
+    startup_phase_us[STARTUP_FIRST_BLOCKS] = first_blocks_us;
+    RSTATS_ADD(startup_us_options, startup_phase_us[STARTUP_OPTIONS]);
+    RSTATS_ADD(startup_us_client_load, startup_phase_us[STARTUP_CLIENT_LOAD]);
+    RSTATS_ADD(startup_us_heap, startup_phase_us[STARTUP_HEAP]);
+    RSTATS_ADD(startup_us_os, startup_phase_us[STARTUP_OS]);
+    RSTATS_ADD(startup_us_loader, startup_phase_us[STARTUP_LOADER]);
+    RSTATS_ADD(startup_us_components, startup_phase_us[STARTUP_COMPONENTS]);
+    RSTATS_ADD(startup_us_thread_init, startup_phase_us[STARTUP_THREAD_INIT]);
+    RSTATS_ADD(startup_us_module_scan, startup_phase_us[STARTUP_MODULE_SCAN]);
+    RSTATS_ADD(startup_us_client_init, startup_phase_us[STARTUP_CLIENT_INIT]);
+    RSTATS_ADD(startup_us_other, startup_phase_us[STARTUP_OTHER]);
+    RSTATS_ADD(startup_us_first_blocks, first_blocks_us);
+    RSTATS_ADD(startup_blocks_timed, num_blocks);
+    print_file(STDERR, "<startup profile for %s (%d), in microseconds:>\n",
+               get_application_name(), get_application_pid());
+    for (i = 0; i < STARTUP_NUM_PHASES; i++) {
+        print_file(STDERR, "  %-16s %12"UINT64_FORMAT_CODE"\n",
+                   startup_phase_names[i], startup_phase_us[i]);
+        total += startup_phase_us[i];
+    }
+    print_file(STDERR, "  %-16s %12"UINT64_FORMAT_CODE" (%d blocks)\n",
+               "total", total, num_blocks);
+}
+
+/* Called for each new basic block; the thread that builds the last block of
+ * interest reports.
+ */
+void
+startup_profile_block_built(void)
+{
+    int count;
+    if (!DYNAMO_OPTION(startup_profile) ||
+        startup_blocks_built >= (int) DYNAMO_OPTION(startup_profile_blocks))
+        return;
+    count = atomic_add_exchange_int(&startup_blocks_built, 1);
+    if (count == (int) DYNAMO_OPTION(startup_profile_blocks))
+        startup_profile_report(query_time_micros() - startup_last_mark, count);
+}
+
+/* Reports at exit if the app built fewer blocks than requested */
+static void
+startup_profile_exit(void)
+{
+    int count = startup_blocks_built;
+    if (!DYNAMO_OPTION(startup_profile) ||
+        count >= (int) DYNAMO_OPTION(startup_profile_blocks))
+        return;
+    /* Keep a racing block build from reporting too */
+    if (atomic_compare_exchange_int(&startup_blocks_built, count, INT_MAX))
+        startup_profile_report(query_time_micros() - startup_last_mark, count);
+}
+
 /* initialize per-process dynamo state; this must be called before any
  * threads are created and before any other API calls are made;
  * returns zero on success, non-zero on failure
@@ -372,6 +580,7 @@ dynamorio_app_init(void)
 #endif
         /* avoid time() for libc independence */
         DODEBUG(starttime = query_time_seconds(););
+        startup_last_mark = query_time_micros();
 
 #ifdef UNIX
         if (getenv(DYNAMORIO_VAR_EXECVE) != NULL) {
@@ -409,6 +618,7 @@ dynamorio_app_init(void)
 
         config_init();
         options_init();
+        startup_profile_mark(STARTUP_OPTIONS);
 #ifdef WINDOWS
         syscalls_init_options_read(); /* must be called after options_init
                                        * but before init_syscall_trampolines */
@@ -459,6 +669,7 @@ dynamorio_app_init(void)
         statistics_pre_init();
 #endif
         statistics_init();
+        startup_profile_mark(STARTUP_OTHER);
 
 #ifdef VMX86_SERVER
         /* Must be before {vmm_,}heap_init() */
@@ -473,11 +684,13 @@ dynamorio_app_init(void)
          * reachable from the dr heap. Xref PR 215395. */
         instrument_load_client_libs();
 #endif
+        startup_profile_mark(STARTUP_CLIENT_LOAD);
 
         /* initialize components (CAUTION: order is important here) */
         vmm_heap_init(); /* must be called even if not using vmm heap */
         heap_init();
         dynamo_heap_initialized = true;
+        startup_profile_mark(STARTUP_HEAP);
 
         /* The process start event should be done after os_init() but before
          * process_control_int() because the former initializes event logging
@@ -502,12 +715,17 @@ dynamorio_app_init(void)
             earliest_inject_cleanup(dr_earliest_inject_args);
 #endif
 
+        startup_profile_mark(STARTUP_OTHER);
         dynamo_vm_areas_init();
         decode_init();
         proc_init();
         modules_init(); /* before vm_areas_init() */
         os_init();
         config_heap_init(); /* after heap_init */
+#ifdef LINUX
+        statistics_shmem_init(); /* after heap_init and os_init */
+#endif
+        startup_profile_mark(STARTUP_OS);
 
         /* Setup for handling faults in loader_init() */
         /* initial stack so we don't have to use app's
@@ -537,7 +755,9 @@ dynamorio_app_init(void)
          * FIXME i#338: this must be before arch_init() for Windows, but Linux
          * wants it later.
          */
+        startup_profile_mark(STARTUP_OTHER);
         loader_init();
+        startup_profile_mark(STARTUP_LOADER);
         arch_init();
         synch_init();
 
@@ -559,6 +779,7 @@ dynamorio_app_init(void)
                 hotp_init();
 #endif
         }
+        startup_profile_mark(STARTUP_COMPONENTS);
 
 #ifdef INTERNAL
         {
@@ -604,11 +825,13 @@ dynamorio_app_init(void)
         /* i#117/PR 395156: it'd be nice to have mc here but would
          * require changing start/stop API
          */
+        startup_profile_mark(STARTUP_OTHER);
         dynamo_thread_init(NULL, NULL _IF_CLIENT_INTERFACE(false));
 #ifdef UNIX
         /* i#27: we need to special-case the 1st thread */
         signal_thread_inherit(get_thread_private_dcontext(), NULL);
 #endif
+        startup_profile_mark(STARTUP_THREAD_INIT);
 
         /* We move vm_areas_init() below dynamo_thread_init() so we can have
          * two things: 1) a dcontext and 2) a SIGSEGV handler, for TRY/EXCEPT
@@ -628,6 +851,7 @@ dynamorio_app_init(void)
             find_dynamo_library_vm_areas();
             dynamo_vm_areas_unlock();
         }
+        startup_profile_mark(STARTUP_MODULE_SCAN);
 
 #ifdef ANNOTATIONS
         annotation_init();
@@ -642,7 +866,9 @@ dynamorio_app_init(void)
          *       report; better document that client libraries shouldn't have
          *       DllMain.
          */
+        startup_profile_mark(STARTUP_OTHER);
         instrument_init();
+        startup_profile_mark(STARTUP_CLIENT_INIT);
         /* To give clients a chance to process pcaches as we load them, we
          * delay the loading until we've initialized the clients.
          */
@@ -687,6 +913,8 @@ dynamorio_app_init(void)
             early_inject_init();
         }
 #endif
+        /* the first blocks are timed from here */
+        startup_profile_mark(STARTUP_OTHER);
     }
 
     dynamo_initialized = true;
@@ -748,6 +976,10 @@ dynamorio_fork_init(dcontext_t *dcontext)
         create_log_dir(PROCESS_DIR);
     }
 
+# ifdef LINUX
+    statistics_shmem_fork_init();
+# endif
+
 # ifdef DEBUG
     /* just like dynamorio_app_init, create main_logfile before stats */
     if (stats->loglevel > 0) {
@@ -806,6 +1038,13 @@ dynamorio_fork_init(dcontext_t *dcontext)
     /* FIXME: maybe should have a callback list for who wants to be notified
      * on a fork -- probably everyone who makes a log file on init.
      */
+    /* We deliberately do not reset any code cache state here: the shared caches
+     * and their tables, vmareas, and this thread's private fragments and trace
+     * head counters are all inherited copy-on-write from the parent, so a child
+     * of a warmed-up parent starts out with a warm cache.  Only the parent's
+     * other threads, which do not exist in the child, are torn down above.
+     * Anything added here that flushes or re-creates fragments defeats that.
+     */
     fragment_fork_init(dcontext);
     /* this must be called after dynamo_other_thread_exit() above */
     signal_fork_init(dcontext);
@@ -1046,6 +1285,9 @@ dynamo_shared_exit(IF_WINDOWS_(thread_record_t *toexit)
     /* Free exception stack before calling heap_exit */
     stack_free(exception_stack, EXCEPTION_STACK_SIZE);
     exception_stack = NULL;
+#endif
+#ifdef LINUX
+    statistics_shmem_exit(); /* before heap_exit */
 #endif
     config_heap_exit();
     heap_exit();
@@ -1275,6 +1517,8 @@ dynamo_process_exit(void)
     synchronize_dynamic_options();
     SYSLOG(SYSLOG_INFORMATION, INFO_PROCESS_STOP,
            2, get_application_name(), get_application_pid());
+    if (!dynamo_exited)
+        startup_profile_exit();
 #ifdef DEBUG
     if (!dynamo_exited) {
         if (INTERNAL_OPTION(nullcalls)) {
@@ -1686,6 +1930,8 @@ create_callback_dcontext(dcontext_t *old_dcontext)
     new_dcontext->vm_areas_field = old_dcontext->vm_areas_field;
     new_dcontext->os_field = old_dcontext->os_field;
     new_dcontext->synch_field = old_dcontext->synch_field;
+    new_dcontext->encode_field = old_dcontext->encode_field;
+    new_dcontext->rstats_field = old_dcontext->rstats_field;
     /* case 8958: copy win32_start_addr in case we produce a forensics file
      * from within a callback.
      */
@@ -2173,6 +2419,7 @@ dynamo_thread_init(byte *dstack_in, priv_mcontext_t *mc
 #endif
     heap_thread_init(dcontext);
     DOSTATS({ stats_thread_init(dcontext); });
+    rstats_thread_init(dcontext);
 #ifdef KSTATS
     kstat_thread_init(dcontext);
 #endif
@@ -2424,6 +2671,7 @@ dynamo_thread_exit_common(dcontext_t *dcontext, thread_id_t id,
 #ifdef KSTATS
     kstat_thread_exit(dcontext);
 #endif
+    rstats_thread_exit(dcontext);
     DOSTATS({ stats_thread_exit(dcontext); });
     heap_thread_exit(dcontext);
 #ifdef DEADLOCK_AVOIDANCE
@@ -2589,6 +2837,30 @@ dr_app_start_helper(priv_mcontext_t *mc)
     }
 }
 
+/* Called by dr_app_start_thread in arch-specific assembly file */
+void
+dr_app_start_thread_helper(priv_mcontext_t *mc)
+{
+    apicheck(dynamo_initialized, PRODUCT_NAME" not initialized");
+    /* We only re-enter a thread we already know about: one that ran under us
+     * before and then called dr_app_stop().  Setting up a new thread is what
+     * the takeover in dr_app_start() is for.
+     */
+    apicheck(get_thread_private_dcontext() != NULL,
+             "dr_app_start_thread() called on a thread unknown to "PRODUCT_NAME);
+    LOG(GLOBAL, LOG_TOP, 1, "dr_app_start_thread in thread "TIDFMT"\n",
+        get_thread_id());
+
+    if (!INTERNAL_OPTION(nullcalls)) {
+        /* Adjust the app stack to account for the return address + alignment.
+         * See dr_app_start_thread in x86.asm.
+         */
+        mc->xsp += DYNAMO_START_XSP_ADJUST;
+        dynamo_start_current_thread(mc);
+        /* the interpreter takes over from here */
+    }
+}
+
 /* dummy routine that returns control to the app if it is currently
  * under dynamo control
  */
@@ -483,6 +483,8 @@ typedef struct _fcache {
     bool finite_cache;
     uint regen_param;
     uint replace_param;
+    /* the configured regen_param, which -cache_autotune moves regen_param around */
+    uint regen_param_base;
 
     /* for adaptive working set: */
     uint      num_regenerated;
@@ -495,6 +497,10 @@ typedef struct _fcache {
      * recording num_regenerated and num_replaced
      */
     bool     record_wset;
+    /* whether the last resize check made us replace rather than grow;
+     * read racily by -adaptive_trace_threshold
+     */
+    bool     under_pressure;
 
     free_list_header_t *free_list[FREE_LIST_SIZES_NUM];
 #ifdef DEBUG
@@ -663,6 +669,9 @@ add_to_free_list(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
 static void
 fcache_free_unit(dcontext_t *dcontext, fcache_unit_t *unit, bool dealloc_or_reuse);
 
+static fcache_unit_t *
+fcache_create_unit(dcontext_t *dcontext, fcache_t *cache, cache_pc pc, size_t size);
+
 #define CHECK_PARAMS(who, name, ret) do {                           \
     /* make it easier to set max */                                 \
     if (FCACHE_OPTION(cache_##who##_max) > 0 &&                     \
@@ -777,6 +786,18 @@ fcache_check_option_compatibility()
                                  FCACHE_OPTION(cache_shared_trace_unit_max),
                                  "cache_shared_trace_unit_init should equal cache_shared_trace_unit_max")
             || ret;
+        /* The hot region is grown in place by committing more of it, and only
+         * once it is full do we move on to regular units.
+         */
+        if (DYNAMO_OPTION(cache_shared_trace_hot_region) > 0 &&
+            DYNAMO_OPTION(cache_shared_trace_hot_region) <
+            DYNAMO_OPTION(cache_shared_trace_unit_max)) {
+            USAGE_ERROR("-cache_shared_trace_hot_region must be >= "
+                        "-cache_shared_trace_unit_max");
+            dynamo_options.cache_shared_trace_hot_region =
+                DYNAMO_OPTION(cache_shared_trace_unit_max);
+            ret = true;
+        }
     }
     if (INTERNAL_OPTION(pad_jmps_shift_bb) &&
         DYNAMO_OPTION(cache_bb_align) < START_PC_ALIGNMENT) {
@@ -824,9 +845,26 @@ fcache_reset_init(void)
             shared_cache_bb->init_unit_size/1024);
     }
     if (DYNAMO_OPTION(shared_traces)) {
+        /* With a hot region, traces fill one large reservation that is
+         * committed on demand, rather than being spread over units interleaved
+         * with the bb cache's, for better i-cache and iTLB locality.
+         */
+        bool hot_region = DYNAMO_OPTION(cache_shared_trace_hot_region) > 0;
         shared_cache_trace = fcache_cache_init(GLOBAL_DCONTEXT,
-                                               FRAG_SHARED|FRAG_IS_TRACE, true);
+                                               FRAG_SHARED|FRAG_IS_TRACE, !hot_region);
         ASSERT(shared_cache_trace != NULL);
+        if (hot_region) {
+            PROTECT_CACHE(shared_cache_trace, lock);
+            shared_cache_trace->units =
+                fcache_create_unit(GLOBAL_DCONTEXT, shared_cache_trace, NULL,
+                                   ALIGN_FORWARD(DYNAMO_OPTION
+                                                 (cache_shared_trace_hot_region),
+                                                 PAGE_SIZE));
+            PROTECT_CACHE(shared_cache_trace, unlock);
+            LOG(GLOBAL, LOG_CACHE, 1, "Shared trace hot region is %d KB @"PFX"\n",
+                UNIT_RESERVED_SIZE(shared_cache_trace->units)/1024,
+                shared_cache_trace->units->start_pc);
+        }
         LOG(GLOBAL, LOG_CACHE, 1, "Initial shared trace cache is %d KB\n",
             shared_cache_trace->init_unit_size/1024);
     }
@@ -1342,6 +1380,11 @@ fcache_create_unit(dcontext_t *dcontext, fcache_t *cache, cache_pc pc, size_t si
     }
 
     cache->size += u->size;
+#ifdef LINUX
+    if (DYNAMO_OPTION(numa_local_private) && !cache->is_shared &&
+        os_heap_bind_local_node(u->start_pc, u->reserved_end_pc - u->start_pc))
+        STATS_INC(numa_local_units);
+#endif
 
     u->cur_pc = u->start_pc;
     u->full = false;
@@ -1443,6 +1486,17 @@ fcache_free_unit(dcontext_t *dcontext, fcache_unit_t *unit, bool dealloc_or_reus
         allunits->num_dead++;
         RSTATS_ADD_PEAK(fcache_num_free, 1);
         STATS_ADD(fcache_free_capacity, unit->size);
+#ifdef LINUX
+        if (DYNAMO_OPTION(free_unit_trim_threshold) > 0) {
+            /* see the matching policy in heap_free_unit() */
+            size_t dead_committed = 0;
+            for (u = allunits->dead; u != NULL; u = u->next_global)
+                dead_committed += u->size;
+            if (dead_committed > DYNAMO_OPTION(free_unit_trim_threshold) &&
+                os_heap_discard_pages(unit->start_pc, unit->size))
+                STATS_ADD(fcache_trimmed_bytes, unit->size);
+        }
+#endif
 #ifdef WINDOWS_PC_SAMPLE
         if (unit->profile)
             fcache_unit_profile_stop(unit);
@@ -1478,6 +1532,7 @@ fcache_free_unit(dcontext_t *dcontext, fcache_unit_t *unit, bool dealloc_or_reus
         FCACHE_GUARDED(FCACHE_OPTION(cache_##which##_unit_init));       \
     cache->finite_cache = dynamo_options.finite_##which##_cache;        \
     cache->regen_param = dynamo_options.cache_##which##_regen;          \
+    cache->regen_param_base = cache->regen_param;                       \
     cache->replace_param = dynamo_options.cache_##which##_replace;      \
 } while (0);
 
@@ -1532,6 +1587,7 @@ fcache_cache_init(dcontext_t *dcontext, uint flags, bool initial_unit)
     cache->num_replaced = 0;
     cache->wset_check = 0;
     cache->record_wset = false;
+    cache->under_pressure = false;
     if (cache->is_shared) { /* else won't use free list */
         memset(cache->free_list, 0, sizeof(cache->free_list));
         DODEBUG({
@@ -2326,6 +2382,41 @@ fifo_prepend_empty(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
     DOLOG(6, LOG_CACHE, { print_fifo(dcontext, cache); });
 }
 
+/* Under -cache_autotune, closes out a replacement window that fell short of
+ * the regen threshold and adjusts the threshold for the next window: a near
+ * miss means the working set is likely just over the cache size, so we grow
+ * sooner, while very few regenerations mean the current size is plenty, so we
+ * require more evidence before growing again.  regen_param is kept within
+ * [base/4, MIN(base*2, replace)].
+ */
+static void
+fcache_autotune_regen(dcontext_t *dcontext, fcache_t *cache)
+{
+    uint step = MAX(cache->regen_param / 4, 1);
+    ASSERT(cache->replace_param > 0 && cache->regen_param > 0);
+    if (cache->num_replaced < cache->replace_param ||
+        cache->num_regenerated >= cache->regen_param)
+        return;
+    if (cache->num_regenerated >= cache->regen_param / 2) {
+        uint min_regen = MAX(cache->regen_param_base / 4, 1);
+        if (cache->regen_param > min_regen) {
+            cache->regen_param = MAX(cache->regen_param - step, min_regen);
+            STATS_INC(fcache_autotune_eager);
+        }
+    } else if (cache->num_regenerated < cache->regen_param / 8) {
+        uint max_regen = MIN(cache->regen_param_base * 2, cache->replace_param);
+        if (cache->regen_param < max_regen) {
+            cache->regen_param = MIN(cache->regen_param + step, max_regen);
+            STATS_INC(fcache_autotune_lazy);
+        }
+    }
+    LOG(THREAD, LOG_CACHE, 2,
+        "%s unit autotune: %d regenerated / %d replaced => regen param %d\n",
+        cache->name, cache->num_regenerated, cache->num_replaced, cache->regen_param);
+    cache->num_replaced -= cache->replace_param;
+    cache->num_regenerated = 0;
+}
+
 /* returns whether the cache should be allowed to grow */
 static bool
 check_regen_replace_ratio(dcontext_t *dcontext, fcache_t *cache, uint add_size)
@@ -2333,6 +2424,7 @@ check_regen_replace_ratio(dcontext_t *dcontext, fcache_t *cache, uint add_size)
     if (cache->max_size != 0 && cache->size + add_size > cache->max_size) {
         /* if at max size, avoid regen/replace checks */
         LOG(THREAD, LOG_CACHE, 4, "at max size 0x%x\n", cache->max_size);
+        cache->under_pressure = true;
         return false;
     } else if (!cache->finite_cache || cache->replace_param == 0) {
         /* always upgrade -- adaptive working set is disabled */
@@ -2367,6 +2459,7 @@ check_regen_replace_ratio(dcontext_t *dcontext, fcache_t *cache, uint add_size)
             }
         }
         LOG(THREAD, LOG_CACHE, 3, "Free upgrade, no resize check\n");
+        cache->under_pressure = false;
         return true;
     } else {
         if (USE_FIFO_FOR_CACHE(cache)) {
@@ -2386,6 +2479,8 @@ check_regen_replace_ratio(dcontext_t *dcontext, fcache_t *cache, uint add_size)
                 return true;
             }
         }
+        if (DYNAMO_OPTION(cache_autotune))
+            fcache_autotune_regen(dcontext, cache);
         /* FIXME: for shared w/ replace==100 perhaps remove this if */
         if (cache->num_replaced >= cache->replace_param &&
             cache->num_regenerated >= cache->regen_param) {
@@ -2407,10 +2502,12 @@ check_regen_replace_ratio(dcontext_t *dcontext, fcache_t *cache, uint add_size)
                 LOG(THREAD, LOG_CACHE, 1,
                     "%s unit reached ratio with %d regenerated / %d replaced\n",
                     cache->name, cache->num_regenerated, cache->num_replaced);
+                cache->under_pressure = false;
                 return true;
             }
         }
         LOG(THREAD, LOG_CACHE, 4, "No resize allowed yet\n");
+        cache->under_pressure = true;
         return false;
     }
     return true;
@@ -3578,6 +3675,17 @@ get_cache_for_new_fragment(dcontext_t *dcontext, fragment_t *f)
     return NULL;
 }
 
+/* Returns whether the trace cache used by dcontext is replacing fragments
+ * rather than growing.  No lock is held, so this is only a hint.
+ */
+bool
+fcache_trace_cache_under_pressure(dcontext_t *dcontext)
+{
+    fcache_thread_units_t *tu = (fcache_thread_units_t *) dcontext->fcache_field;
+    fcache_t *cache = DYNAMO_OPTION(shared_traces) ? shared_cache_trace : tu->trace;
+    return cache != NULL && cache->under_pressure;
+}
+
 void
 fcache_add_fragment(dcontext_t *dcontext, fragment_t *f)
 {
@@ -118,12 +118,22 @@ static per_thread_t *shared_pt;
 #define USE_SHARED_PT() (SHARED_IBT_TABLES_ENABLED() || \
     (TRACEDUMP_ENABLED() && DYNAMO_OPTION(shared_traces)))
 
+/* Shared bb and trace tables looked up without the read lock */
+#define SHARED_TABLE_LOCKFREE_READS() \
+    (DYNAMO_OPTION(shared_table_lockfree_reads) && SHARED_FRAGMENTS_ENABLED())
+
+#define USE_DEAD_TABLES() (SHARED_IBT_TABLES_ENABLED() || \
+    SHARED_TABLE_LOCKFREE_READS())
+
 /* We keep track of "old" IBT target tables in a linked list and
- * deallocate them in fragment_exit(). */
+ * deallocate them in fragment_exit().  Old shared bb and trace tables
+ * with lock-free readers go here too, tagged by lacking
+ * FRAG_TABLE_IBL_TARGETED, and are only freed at reset or exit.
+ */
 /* FIXME Deallocate tables more aggressively using a distributed, refcounting
  * algo as is used for shared deletion. */
 typedef struct _dead_fragment_table_t {
-    fragment_entry_t *table_unaligned;
+    void *table_unaligned; /* fragment_entry_t* or fragment_t** */
     uint table_flags;
     uint capacity;
     uint ref_count;
@@ -162,6 +172,12 @@ DECLARE_CXTSWPROT_VAR(mutex_t shared_cache_flush_lock,
  */
 DECLARE_FREQPROT_VAR(uint flushtime_global, 0);
 
+/* For -coarse_freeze_every_nth_fragment: coarse fragments built since the last
+ * periodic persist, and whether one is due at the next nolinking point.
+ */
+DECLARE_NEVERPROT_VAR(static int coarse_fragments_since_freeze, 0);
+DECLARE_NEVERPROT_VAR(static bool coarse_freeze_pending, false);
+
 #ifdef CLIENT_INTERFACE
 DECLARE_CXTSWPROT_VAR(mutex_t client_flush_request_lock,
                       INIT_LOCK_FREE(client_flush_request_lock));
@@ -194,6 +210,11 @@ static const fragment_t null_fragment = { NULL_TAG, 0, 0, 0, 0,
 static const fragment_t sentinel_fragment = { NULL_TAG, 0, 0, 0, 0,
                                             HASHLOOKUP_SENTINEL_START_PC, };
 
+/* What empty -ibl_l1_bits slots point at: like null_fragment, an app target
+ * of 0 "hits" here and goes to an ibl miss.
+ */
+const fragment_entry_t ibl_l1_empty_entry = { NULL_TAG, HASHLOOKUP_NULL_START_PC };
+
 /* Shared fragment IBTs: We need to preserve the open addressing traversal
  * in the hashtable while marking a table entry as unlinked.
  * A null_fragment won't work since it terminates the traversal,
@@ -539,6 +560,23 @@ check_stay_on_trace_stats_overflow(dcontext_t *dcontext, ibl_branch_type_t branc
 }
 #endif /* HASHTABLE_STATISTICS */
 
+/* Empties dcontext's -ibl_l1_bits cache for branch_type and points TLS at it.
+ * The cache slots point into the table that TLS pointed at when they were
+ * filled, so this must be called whenever that table may be freed.
+ */
+static void
+ibl_l1_reset(dcontext_t *dcontext, ibl_branch_type_t branch_type)
+{
+    per_thread_t *pt = (per_thread_t *) dcontext->fragment_field;
+    local_state_extended_t *state =
+        (local_state_extended_t *) dcontext->local_state;
+    uint i;
+    ASSERT(IBL_L1_ENABLED() && pt->ibl_l1[branch_type] != NULL);
+    for (i = 0; i < IBL_L1_ENTRIES(); i++)
+        pt->ibl_l1[branch_type][i] = (fragment_entry_t *) &ibl_l1_empty_entry;
+    state->table_space.l1_table[branch_type] = pt->ibl_l1[branch_type];
+}
+
 /* init/update the tls slots storing this table's mask and lookup base
  * N.B.: for thread-shared the caller must call for each thread
  */
@@ -570,6 +608,8 @@ update_lookuptable_tls(dcontext_t *dcontext, ibl_table_t *table)
         table->table;
     state->table_space.table[table->branch_type].hash_mask =
         table->hash_mask;
+    if (IBL_L1_ENABLED())
+        ibl_l1_reset(dcontext, table->branch_type);
 }
 
 #ifdef DEBUG
@@ -674,13 +714,29 @@ hashtable_ibl_free_entry(dcontext_t *dcontext, ibl_table_t *table,
 #include "hashtablex.h"
 /* all defines are undef-ed at end of hashtablex.h */
 
+/* forward decl */
+static inline void
+add_to_dead_table_list(void *old_table_unaligned, uint old_capacity,
+                       uint old_ref_count, uint old_table_flags);
+
 static void
 hashtable_fragment_resized_custom(dcontext_t *dcontext, fragment_table_t *table,
                                   uint old_capacity, fragment_t **old_table,
                                   fragment_t **old_table_unaligned,
                                   uint old_ref_count, uint old_table_flags)
 {
-    /* nothing */
+    /* check_size left the old table alone for any lock-free readers still
+     * probing it
+     */
+    if (TEST(HASHTABLE_LOCKFREE_READS, table->table_flags)) {
+        ASSERT_TABLE_SYNCHRONIZED(table, WRITE);
+        LOG(GLOBAL, LOG_FRAGMENT, 2,
+            "%s: old table "PFX" capacity %d kept for lock-free readers\n",
+            table->name, old_table_unaligned, old_capacity);
+        add_to_dead_table_list(old_table_unaligned, old_capacity, old_ref_count,
+                               old_table_flags);
+        STATS_INC(num_dead_shared_fragment_tables);
+    }
 }
 
 static void
@@ -930,23 +986,22 @@ safely_nullify_tables(dcontext_t *dcontext, ibl_table_t *new_table,
     STATS_INC(num_shared_ibt_table_flushes);
 }
 
-/* Add an item to the dead tables list */
+/* Add an item to the dead tables list.
+ * The caller must hold the write lock of the table the item came from so
+ * that ref_count is copied accurately.
+ */
 static inline void
-add_to_dead_table_list(dcontext_t *alloc_dc, ibl_table_t *ftable,
-                       uint old_capacity,
-                       fragment_entry_t *old_table_unaligned, uint old_ref_count,
-                       uint old_table_flags)
+add_to_dead_table_list(void *old_table_unaligned, uint old_capacity,
+                       uint old_ref_count, uint old_table_flags)
 {
     dead_fragment_table_t *item =(dead_fragment_table_t*)
         heap_alloc(GLOBAL_DCONTEXT, sizeof(dead_fragment_table_t)
                    HEAPACCT(ACCT_IBLTABLE));
 
     LOG(GLOBAL, LOG_FRAGMENT, 2,
-        "add_to_dead_table_list %s "PFX" capacity %d\n",
-        ftable->name, old_table_unaligned, old_capacity);
-    ASSERT(old_ref_count >= 1); /* someone other the caller must be holding a reference */
-    /* write lock must be held so that ref_count is copied accurately */
-    ASSERT_TABLE_SYNCHRONIZED(ftable, WRITE);
+        "add_to_dead_table_list "PFX" capacity %d flags 0x%x\n",
+        old_table_unaligned, old_capacity, old_table_flags);
+    ASSERT(USE_DEAD_TABLES());
     item->capacity = old_capacity;
     item->table_unaligned = old_table_unaligned;
     item->table_flags = old_table_flags;
@@ -984,7 +1039,6 @@ hashtable_ibl_resized_custom(dcontext_t *dcontext, ibl_table_t *table,
                              fragment_entry_t *old_table_unaligned,
                              uint old_ref_count, uint old_table_flags)
 {
-    dcontext_t *alloc_dc = FRAGMENT_TABLE_ALLOC_DC(dcontext, table->table_flags);
     per_thread_t *pt = GET_PT(dcontext);
     bool shared_ibt_table =
         TESTALL(FRAG_TABLE_TARGET_SHARED | FRAG_TABLE_SHARED, table->table_flags);
@@ -1038,8 +1092,12 @@ hashtable_ibl_resized_custom(dcontext_t *dcontext, ibl_table_t *table,
              * management.
              */
             safely_nullify_tables(dcontext, table, old_table, old_capacity);
-            add_to_dead_table_list(alloc_dc, table, old_capacity,
-                                   old_table_unaligned,
+            LOG(GLOBAL, LOG_FRAGMENT, 2, "%s: retiring old table "PFX"\n",
+                table->name, old_table_unaligned);
+            /* someone other than us must be holding a reference */
+            ASSERT(old_ref_count >= 1);
+            ASSERT_TABLE_SYNCHRONIZED(table, WRITE);
+            add_to_dead_table_list(old_table_unaligned, old_capacity,
                                    old_ref_count, table->table_flags);
         }
         /* Update the resizing thread's private ptr. */
@@ -1122,6 +1180,7 @@ hashtable_fragment_reset(dcontext_t *dcontext, fragment_table_t *table)
     /* case 7691: we now use separate ibl table types */
     ASSERT(!TEST(FRAG_TABLE_INCLUSIVE_HIERARCHY, table->table_flags));
     LOG(THREAD, LOG_FRAGMENT, 2, "hashtable_fragment_reset\n");
+    hashtable_fragment_migrate(dcontext, table, UINT_MAX);
     DOLOG(1, LOG_FRAGMENT|LOG_STATS, {
         hashtable_fragment_load_statistics(dcontext, table);
     });
@@ -1305,7 +1364,11 @@ fragment_reset_init(void)
                                     INTERNAL_OPTION(shared_bb_load),
                                     (hash_function_t)INTERNAL_OPTION(alt_hash_func),
                                     0 /* hash_mask_offset */,
-                                    FRAG_TABLE_SHARED | FRAG_TABLE_TARGET_SHARED
+                                    FRAG_TABLE_SHARED | FRAG_TABLE_TARGET_SHARED |
+                                    (SHARED_TABLE_LOCKFREE_READS() ?
+                                     HASHTABLE_LOCKFREE_READS : 0) |
+                                    (DYNAMO_OPTION(shared_table_resize_step) > 0 ?
+                                     HASHTABLE_INCREMENTAL_RESIZE : 0)
                                     _IF_DEBUG("shared_bb"));
         }
         if (DYNAMO_OPTION(shared_traces)) {
@@ -1314,7 +1377,11 @@ fragment_reset_init(void)
                                     INTERNAL_OPTION(shared_trace_load),
                                     (hash_function_t)INTERNAL_OPTION(alt_hash_func),
                                     0 /* hash_mask_offset */,
-                                    FRAG_TABLE_SHARED | FRAG_TABLE_TARGET_SHARED
+                                    FRAG_TABLE_SHARED | FRAG_TABLE_TARGET_SHARED |
+                                    (SHARED_TABLE_LOCKFREE_READS() ?
+                                     HASHTABLE_LOCKFREE_READS : 0) |
+                                    (DYNAMO_OPTION(shared_table_resize_step) > 0 ?
+                                     HASHTABLE_INCREMENTAL_RESIZE : 0)
                                     _IF_DEBUG("shared_trace"));
         }
         /* init routine will work for future_fragment_t* same as for fragment_t* */
@@ -1432,7 +1499,7 @@ fragment_init()
     if (USE_SHARED_PT())
         shared_pt = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, per_thread_t, ACCT_OTHER, PROTECTED);
 
-    if (SHARED_IBT_TABLES_ENABLED()) {
+    if (USE_DEAD_TABLES()) {
         dead_lists =
             HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT,  dead_table_lists_t, ACCT_OTHER, PROTECTED);
         memset(dead_lists, 0, sizeof(*dead_lists));
@@ -1464,12 +1531,7 @@ fragment_reset_free(void)
      * not looking at freed entries
      */
     if (SHARED_IBT_TABLES_ENABLED()) {
-
         ibl_branch_type_t branch_type;
-        dead_fragment_table_t *current, *next;
-        DEBUG_DECLARE(int table_count = 0;)
-        DEBUG_DECLARE(stats_int_t dead_tables = GLOBAL_STAT(num_dead_shared_ibt_tables);)
-
         for (branch_type = IBL_BRANCH_TYPE_START;
              branch_type < IBL_BRANCH_TYPE_END; branch_type++) {
             if (DYNAMO_OPTION(shared_trace_ibt_tables)) {
@@ -1489,6 +1551,12 @@ fragment_reset_free(void)
                                      &shared_pt->bb_ibt[branch_type]);
             }
         }
+    }
+
+    if (USE_DEAD_TABLES()) {
+        dead_fragment_table_t *current, *next;
+        DEBUG_DECLARE(int table_count = 0;)
+        DEBUG_DECLARE(stats_int_t dead_tables = GLOBAL_STAT(num_dead_shared_ibt_tables);)
 
         /* Delete dead tables. */
         /* grab lock for consistency, although we expect a single thread */
@@ -1500,8 +1568,13 @@ fragment_reset_free(void)
             LOG(GLOBAL, LOG_FRAGMENT, 2,
                 "fragment_reset_free: dead table "PFX" cap %d, freeing\n",
                 current->table_unaligned, current->capacity);
-            hashtable_ibl_free_table(GLOBAL_DCONTEXT, current->table_unaligned,
-                                     current->table_flags, current->capacity);
+            if (TEST(FRAG_TABLE_IBL_TARGETED, current->table_flags)) {
+                hashtable_ibl_free_table(GLOBAL_DCONTEXT, current->table_unaligned,
+                                         current->table_flags, current->capacity);
+            } else {
+                hashtable_fragment_free_table(GLOBAL_DCONTEXT, current->table_unaligned,
+                                              current->table_flags, current->capacity);
+            }
             heap_free(GLOBAL_DCONTEXT, current, sizeof(dead_fragment_table_t)
                       HEAPACCT(ACCT_IBLTABLE));
             STATS_DEC(num_dead_shared_ibt_tables);
@@ -1593,17 +1666,21 @@ fragment_exit()
         /* write out all traces prior to deleting any, so links print nicely */
         uint i;
         fragment_t *f;
+        fragment_table_t *table;
         /* change_linking_lock is required for output_trace(), though there
          * won't be any races at this point of exiting.
          */
         acquire_recursive_lock(&change_linking_lock);
         TABLE_RWLOCK(shared_trace, read, lock);
-        for (i = 0; i < shared_trace->capacity; i++) {
-            f = shared_trace->table[i];
-            if (!REAL_FRAGMENT(f))
-                continue;
-            if (SHOULD_OUTPUT_FRAGMENT(f->flags))
-                output_trace(GLOBAL_DCONTEXT, shared_pt, f, -1);
+        /* including any old table of an unfinished incremental resize */
+        for (table = shared_trace; table != NULL; table = table->resize_old) {
+            for (i = 0; i < table->capacity; i++) {
+                f = table->table[i];
+                if (!REAL_FRAGMENT(f))
+                    continue;
+                if (SHOULD_OUTPUT_FRAGMENT(f->flags))
+                    output_trace(GLOBAL_DCONTEXT, shared_pt, f, -1);
+            }
         }
         TABLE_RWLOCK(shared_trace, read, unlock);
         release_recursive_lock(&change_linking_lock);
@@ -1682,7 +1759,7 @@ fragment_exit()
         shared_future = NULL;
     }
 
-    if (SHARED_IBT_TABLES_ENABLED()) {
+    if (USE_DEAD_TABLES()) {
         HEAP_TYPE_FREE(GLOBAL_DCONTEXT, dead_lists, dead_table_lists_t,
                        ACCT_OTHER, PROTECTED);
         dead_lists = NULL;
@@ -1696,7 +1773,7 @@ fragment_exit()
     } else
         ASSERT(shared_pt == NULL);
 
-    if (SHARED_IBT_TABLES_ENABLED())
+    if (USE_DEAD_TABLES())
         DELETE_LOCK(dead_tables_lock);
 #ifdef SHARING_STUDY
     if (INTERNAL_OPTION(fragment_sharing_study)) {
@@ -1852,6 +1929,16 @@ fragment_thread_reset_init(dcontext_t *dcontext)
      */
     pt->flushtime_last_update = (dynamo_resetting) ? 0 : flushtime_global;
 
+    if (IBL_L1_ENABLED()) {
+        for (branch_type = IBL_BRANCH_TYPE_START;
+             branch_type < IBL_BRANCH_TYPE_END; branch_type++) {
+            pt->ibl_l1[branch_type] =
+                HEAP_ARRAY_ALLOC(dcontext, fragment_entry_t *, IBL_L1_ENTRIES(),
+                                 ACCT_IBLTABLE, UNPROTECTED);
+            ibl_l1_reset(dcontext, branch_type);
+        }
+    }
+
     /* set initial hashtable sizes */
     hashtable_fragment_init(dcontext, &pt->bb, INIT_HTABLE_SIZE_BB,
                             INTERNAL_OPTION(private_bb_load),
@@ -2052,6 +2139,7 @@ fragment_thread_init(dcontext_t *dcontext)
     pt->finished_all_unlink = create_event();
     pt->soon_to_be_linking = false;
     pt->at_syscall_at_flush = false;
+    pt->flush_released = false;
 
 #ifdef PROFILE_LINKCOUNT
     pt->tracedump_num_below_threshold = 0;
@@ -2171,6 +2259,14 @@ fragment_thread_reset_free(dcontext_t *dcontext)
         hashtable_fragment_free(dcontext, &pt->trace);
     hashtable_fragment_free(dcontext, &pt->bb);
     hashtable_fragment_free(dcontext, &pt->future);
+    if (IBL_L1_ENABLED()) {
+        for (branch_type = IBL_BRANCH_TYPE_START;
+             branch_type < IBL_BRANCH_TYPE_END; branch_type++) {
+            HEAP_ARRAY_FREE(dcontext, pt->ibl_l1[branch_type], fragment_entry_t *,
+                            IBL_L1_ENTRIES(), ACCT_IBLTABLE, UNPROTECTED);
+            pt->ibl_l1[branch_type] = NULL;
+        }
+    }
 
     SELF_PROTECT_CACHE(dcontext, NULL, READONLY);
 
@@ -2398,7 +2494,7 @@ fragment_create(dcontext_t *dcontext, app_pc tag, int body_size,
     DOSTATS({ f->id = (int) next_id; });
     DO_GLOBAL_STATS({
         if (!TEST(FRAG_IS_TRACE, f->flags)) {
-            RSTATS_INC(num_bbs);
+            RSTATS_INC_THREAD(num_bbs);
             IF_X64(if (FRAG_IS_32(f->flags)) STATS_INC(num_32bit_bbs);)
         }
     });
@@ -2450,6 +2546,18 @@ fragment_create(dcontext_t *dcontext, app_pc tag, int body_size,
      */
     fcache_add_fragment(dcontext, f);
 
+    if (TEST(FRAG_COARSE_GRAIN, flags) &&
+        DYNAMO_OPTION(coarse_freeze_every_nth_fragment) > 0 &&
+        atomic_add_exchange_int(&coarse_fragments_since_freeze, 1) ==
+        (int) DYNAMO_OPTION(coarse_freeze_every_nth_fragment)) {
+        /* Persist incrementally rather than only at exit or unload so that
+         * other processes using -use_persisted pick up new code sooner.
+         * We can't freeze here while holding bb building locks.
+         */
+        coarse_fragments_since_freeze = 0;
+        coarse_freeze_pending = true;
+    }
+
     /* after fcache_add_fragment so we can call get_fragment_coarse_info */
     DOSTATS({
         if (TEST(FRAG_SHARED, flags)) {
@@ -2745,9 +2853,14 @@ fragment_lookup_type(dcontext_t *dcontext, app_pc tag, uint lookup_flags)
             /* MUST look at shared trace table before shared bb table,
              * since a shared trace can shadow a shared trace head
              */
-            read_lock(&shared_trace->rwlock);
-            f = hashtable_fragment_lookup(dcontext, (ptr_uint_t)tag, shared_trace);
-            read_unlock(&shared_trace->rwlock);
+            if (TEST(HASHTABLE_LOCKFREE_READS, shared_trace->table_flags)) {
+                f = hashtable_fragment_lookup_lockfree(dcontext, (ptr_uint_t)tag,
+                                                       shared_trace);
+            } else {
+                read_lock(&shared_trace->rwlock);
+                f = hashtable_fragment_lookup(dcontext, (ptr_uint_t)tag, shared_trace);
+                read_unlock(&shared_trace->rwlock);
+            }
             if (f->tag != NULL) {
                 ASSERT(f->tag == tag);
                 ASSERT(!TESTANY(FRAG_FAKE|FRAG_COARSE_GRAIN, f->flags));
@@ -2759,9 +2872,14 @@ fragment_lookup_type(dcontext_t *dcontext, app_pc tag, uint lookup_flags)
             /* MUST look at private trace table before shared bb table,
              * since a private trace can shadow a shared trace head
              */
-            read_lock(&shared_bb->rwlock);
-            f = hashtable_fragment_lookup(dcontext, (ptr_uint_t)tag, shared_bb);
-            read_unlock(&shared_bb->rwlock);
+            if (TEST(HASHTABLE_LOCKFREE_READS, shared_bb->table_flags)) {
+                f = hashtable_fragment_lookup_lockfree(dcontext, (ptr_uint_t)tag,
+                                                       shared_bb);
+            } else {
+                read_lock(&shared_bb->rwlock);
+                f = hashtable_fragment_lookup(dcontext, (ptr_uint_t)tag, shared_bb);
+                read_unlock(&shared_bb->rwlock);
+            }
             if (f->tag != NULL) {
                 ASSERT(f->tag == tag);
                 ASSERT(!TESTANY(FRAG_FAKE|FRAG_COARSE_GRAIN, f->flags));
@@ -2835,6 +2953,8 @@ hashtable_pclookup(dcontext_t *dcontext, fragment_table_t *table, cache_pc pc)
             return f;
         }
     }
+    if (table->resize_old != NULL)
+        return hashtable_pclookup(dcontext, table->resize_old, pc);
     return NULL;
 }
 
@@ -5769,6 +5889,16 @@ enter_nolinking(dcontext_t *dcontext, fragment_t *was_I_flushed, bool cache_tran
         mutex_unlock(&reset_pending_lock);
     }
 
+    if (coarse_freeze_pending) {
+        /* Racy test-and-clear: at worst we persist twice. */
+        coarse_freeze_pending = false;
+        STATS_INC(coarse_freezes_periodic);
+        /* Persisting leaves the in-memory units in place, so nothing was
+         * flushed.
+         */
+        coarse_units_freeze_all(false/*!in place*/);
+    }
+
     /* FIXME: perf opt: make global flag can check w/ making a call,
      * or at least inline the call
      */
@@ -5963,6 +6093,15 @@ increment_global_flushtime()
  * until all threads are out of the shared cache.
  */
 
+/* -thread_scoped_flush only applies when every fragment is thread-private: a
+ * thread with no fragments in the region then has nothing the flush needs
+ * from it, so rather than stopping it at its next cache exit for the whole
+ * flush we let it run, holding it back only if it tries to build from the
+ * region before the flush is over.
+ */
+#define THREAD_SCOPED_FLUSH() \
+    (DYNAMO_OPTION(thread_scoped_flush) && !SHARED_FRAGMENTS_ENABLED())
+
 /* Variables shared between the 3 flush stage routines
  * flush_fragments_synch_unlink_priv(),
  * flush_fragments_unlink_shared(), and flush_fragments_end_synch.
@@ -5975,11 +6114,133 @@ DECLARE_NEVERPROT_VAR(static int flush_num_threads, 0);
 DECLARE_NEVERPROT_VAR(static int pending_delete_threads, 0);
 DECLARE_NEVERPROT_VAR(static int shared_flushed, 0);
 DECLARE_NEVERPROT_VAR(static bool flush_synchall, false);
+/* The region of a -thread_scoped_flush in progress, consulted by threads that
+ * the flush let go (see wait_for_scoped_flush()).
+ */
+DECLARE_NEVERPROT_VAR(static app_pc volatile flush_scoped_start, NULL);
+DECLARE_NEVERPROT_VAR(static app_pc volatile flush_scoped_end, NULL);
+/* The regions of a flush_fragments_from_regions() in progress, which each stage
+ * processes in place of its [base, base+size) region.
+ */
+DECLARE_NEVERPROT_VAR(static vm_area_vector_t *flush_regions, NULL);
 #ifdef DEBUG
 DECLARE_NEVERPROT_VAR(static int num_flushed, 0);
 DECLARE_NEVERPROT_VAR(static int flush_last_stage, 0);
 #endif
 
+/* Whether the flush in progress covers any region (rather than a list of
+ * fragments, or nothing but the synch).
+ */
+#define FLUSH_HAS_REGION(size) ((size) > 0 || flush_regions != NULL)
+
+/* Iterates over the regions of the flush in progress: those of flush_regions
+ * if set, else the single region [base, base+size).
+ */
+typedef struct _flush_region_iter_t {
+    vmvector_iterator_t vmvi;
+    app_pc base;
+    size_t size;
+    bool done;
+} flush_region_iter_t;
+
+static void
+flush_region_iter_start(flush_region_iter_t *iter, app_pc base, size_t size)
+{
+    iter->base = base;
+    iter->size = size;
+    iter->done = false;
+    if (flush_regions != NULL)
+        vmvector_iterator_start(flush_regions, &iter->vmvi);
+}
+
+static bool
+flush_region_iter_next(flush_region_iter_t *iter, app_pc *start, app_pc *end)
+{
+    if (flush_regions != NULL) {
+        if (!vmvector_iterator_hasnext(&iter->vmvi))
+            return false;
+        vmvector_iterator_next(&iter->vmvi, start, end);
+        return true;
+    }
+    if (iter->done)
+        return false;
+    iter->done = true;
+    *start = iter->base;
+    *end = iter->base + iter->size;
+    return true;
+}
+
+static void
+flush_region_iter_stop(flush_region_iter_t *iter)
+{
+    if (flush_regions != NULL)
+        vmvector_iterator_stop(&iter->vmvi);
+}
+
+/* Returns whether any region of the flush in progress overlaps the vm areas
+ * of tgt_dcontext, or, if vmlist is non-NULL, the trace vm list vmlist.
+ */
+static bool
+flush_regions_overlap(dcontext_t *tgt_dcontext, void *vmlist, app_pc base, size_t size)
+{
+    flush_region_iter_t iter;
+    app_pc start, end;
+    bool overlap = false;
+    if (!FLUSH_HAS_REGION(size))
+        return false;
+    flush_region_iter_start(&iter, base, size);
+    while (!overlap && flush_region_iter_next(&iter, &start, &end)) {
+        if (vmlist != NULL)
+            overlap = vm_list_overlaps(tgt_dcontext, vmlist, start, end);
+        else
+            overlap = thread_vm_area_overlap(tgt_dcontext, start, end);
+    }
+    flush_region_iter_stop(&iter);
+    return overlap;
+}
+
+/* Unlinks the fragments of dcontext in each region of the flush in progress.
+ * Returns the number of fragments unlinked.
+ */
+static int
+flush_regions_unlink_fragments(dcontext_t *dcontext, app_pc base, size_t size,
+                               int ref_count _IF_DGCDIAG(app_pc written_pc))
+{
+    flush_region_iter_t iter;
+    app_pc start, end;
+    int unlinked = 0;
+    flush_region_iter_start(&iter, base, size);
+    while (flush_region_iter_next(&iter, &start, &end)) {
+        unlinked += vm_area_unlink_fragments(dcontext, start, end, ref_count
+                                             _IF_DGCDIAG(written_pc));
+    }
+    flush_region_iter_stop(&iter);
+    return unlinked;
+}
+
+/* For -thread_scoped_flush: a thread that a flush let go must not build from
+ * the region being flushed until that flush is complete.  Called before
+ * examining [start, end) for a new basic block.
+ */
+void
+wait_for_scoped_flush(dcontext_t *dcontext, app_pc start, app_pc end)
+{
+    per_thread_t *pt = (per_thread_t *) dcontext->fragment_field;
+    if (pt == NULL || !pt->flush_released)
+        return;
+    if (start < flush_scoped_end && end > flush_scoped_start) {
+        LOG(THREAD, LOG_FRAGMENT, 2,
+            "waiting for thread-scoped flush of "PFX"-"PFX"\n",
+            flush_scoped_start, flush_scoped_end);
+        STATS_INC(num_scoped_flush_waits);
+        /* the flusher clears our flag once the region's fragments and
+         * executable area have been dealt with
+         */
+        while (pt->flush_released)
+            os_thread_yield();
+    }
+}
+
 static void
 flush_fragments_free_futures(app_pc base, size_t size)
 {
@@ -6008,15 +6269,40 @@ flush_fragments_free_futures(app_pc base, size_t size)
     } /* else we leak them */
 }
 
+/* We rely on coarse fragments not touching more than one vmarea region
+ * for our ibl invalidation.  It's
+ * ok to invalidate more than we need to so we don't care if there are
+ * multiple coarse units within this range.  We just need the exec areas
+ * bounds that overlap the flush region.
+ */
+static void
+flush_region_exec_bounds(app_pc start, app_pc end, app_pc *exec_start, app_pc *exec_end)
+{
+    if (!executable_area_overlap_bounds(start, end, exec_start, exec_end,
+                                        0, true/*doesn't matter w/ 0*/)) {
+        /* caller checks for overlap but lock let go so can get here; go ahead
+         * and do synch per flushing contract.
+         */
+        *exec_start = start;
+        *exec_end = end;
+    }
+    LOG(GLOBAL, LOG_FRAGMENT, 2,
+        "flush_fragments_synchall_start: from "PFX"-"PFX" => coarse "PFX"-"PFX"\n",
+        start, end, *exec_start, *exec_end);
+}
+
 /* This routine begins a flush that requires full thread synch: currently,
- * it is used for flushing coarse-grain units and for dr_flush_region()
+ * it is used for flushing coarse-grain units and for dr_flush_region().
+ * If regions is non-NULL its regions are flushed in place of [base, base+size).
  */
 static void
 flush_fragments_synchall_start(dcontext_t *ignored, app_pc base, size_t size,
-                               bool exec_invalid)
+                               vm_area_vector_t *regions, bool exec_invalid)
 {
     dcontext_t *my_dcontext = get_thread_private_dcontext();
     app_pc exec_start = NULL, exec_end = NULL;
+    flush_region_iter_t iter;
+    app_pc start, end;
     bool all_synched = true;
     int i;
     const thread_synch_state_t desired_state =
@@ -6052,28 +6338,12 @@ flush_fragments_synchall_start(dcontext_t *ignored, app_pc base, size_t size,
     ASSERT(allsynch_flusher == NULL);
     allsynch_flusher = my_dcontext;
     flush_synchall = true;
+    flush_regions = regions;
     ASSERT(flush_last_stage == 0);
     DODEBUG({ flush_last_stage = 1; });
 
     LOG(GLOBAL, LOG_FRAGMENT, 2,
         "flush_fragments_synchall_start: walking the threads\n");
-    /* We rely on coarse fragments not touching more than one vmarea region
-     * for our ibl invalidation.  It's
-     * ok to invalidate more than we need to so we don't care if there are
-     * multiple coarse units within this range.  We just need the exec areas
-     * bounds that overlap the flush region.
-     */
-    if (!executable_area_overlap_bounds(base, base+size, &exec_start, &exec_end,
-                                        0, true/*doesn't matter w/ 0*/)) {
-        /* caller checks for overlap but lock let go so can get here; go ahead
-         * and do synch per flushing contract.
-         */
-        exec_start = base;
-        exec_end = base+size;
-    }
-    LOG(GLOBAL, LOG_FRAGMENT, 2,
-        "flush_fragments_synchall_start: from "PFX"-"PFX" => coarse "PFX"-"PFX"\n",
-        base, base+size, exec_start, exec_end);
 
     /* FIXME: share some of this code that I duplicated from reset */
     for (i = 0; i < flush_num_threads; i++) {
@@ -6142,32 +6412,42 @@ flush_fragments_synchall_start(dcontext_t *ignored, app_pc base, size_t size,
              * also, but fine fragments are not constrained and could be missed using
              * only a tag-based range remove.
              */
-            DEBUG_DECLARE(removed =)
-                fragment_remove_all_ibl_in_region(dcontext, exec_start, exec_end);
-            LOG(THREAD, LOG_FRAGMENT, 2,
-                "\tremoved %d ibl entries in "PFX"-"PFX"\n",
-                removed, exec_start, exec_end);
-            /* Free any fine private fragments in the region */
-            vm_area_allsynch_flush_fragments(dcontext, dcontext, base, base+size,
-                                             exec_invalid, all_synched/*ignored*/);
-            if (!SHARED_IBT_TABLES_ENABLED() && SHARED_FRAGMENTS_ENABLED()) {
-                /* Remove shared fine fragments from private ibl tables */
-                vm_area_allsynch_flush_fragments(dcontext, GLOBAL_DCONTEXT,
-                                                 base, base+size,
+            flush_region_iter_start(&iter, base, size);
+            while (flush_region_iter_next(&iter, &start, &end)) {
+                flush_region_exec_bounds(start, end, &exec_start, &exec_end);
+                DEBUG_DECLARE(removed =)
+                    fragment_remove_all_ibl_in_region(dcontext, exec_start, exec_end);
+                LOG(THREAD, LOG_FRAGMENT, 2,
+                    "\tremoved %d ibl entries in "PFX"-"PFX"\n",
+                    removed, exec_start, exec_end);
+                /* Free any fine private fragments in the region */
+                vm_area_allsynch_flush_fragments(dcontext, dcontext, start, end,
                                                  exec_invalid, all_synched/*ignored*/);
+                if (!SHARED_IBT_TABLES_ENABLED() && SHARED_FRAGMENTS_ENABLED()) {
+                    /* Remove shared fine fragments from private ibl tables */
+                    vm_area_allsynch_flush_fragments(dcontext, GLOBAL_DCONTEXT,
+                                                     start, end, exec_invalid,
+                                                     all_synched/*ignored*/);
+                }
             }
+            flush_region_iter_stop(&iter);
         }
     }
-    /* Removed shared coarse fragments from ibl tables, before freeing any */
-    if (SHARED_IBT_TABLES_ENABLED() && SHARED_FRAGMENTS_ENABLED())
-        fragment_remove_all_ibl_in_region(GLOBAL_DCONTEXT, exec_start, exec_end);
-    /* Free coarse units and shared fine fragments, as well as removing shared fine
-     * entries in any shared ibl tables
-     */
-    if (SHARED_FRAGMENTS_ENABLED()) {
-        vm_area_allsynch_flush_fragments(GLOBAL_DCONTEXT, GLOBAL_DCONTEXT,
-                                         base, base+size, exec_invalid, all_synched);
+    flush_region_iter_start(&iter, base, size);
+    while (flush_region_iter_next(&iter, &start, &end)) {
+        flush_region_exec_bounds(start, end, &exec_start, &exec_end);
+        /* Removed shared coarse fragments from ibl tables, before freeing any */
+        if (SHARED_IBT_TABLES_ENABLED() && SHARED_FRAGMENTS_ENABLED())
+            fragment_remove_all_ibl_in_region(GLOBAL_DCONTEXT, exec_start, exec_end);
+        /* Free coarse units and shared fine fragments, as well as removing shared
+         * fine entries in any shared ibl tables
+         */
+        if (SHARED_FRAGMENTS_ENABLED()) {
+            vm_area_allsynch_flush_fragments(GLOBAL_DCONTEXT, GLOBAL_DCONTEXT,
+                                             start, end, exec_invalid, all_synched);
+        }
     }
+    flush_region_iter_stop(&iter);
 }
 
 static void
@@ -6184,6 +6464,7 @@ flush_fragments_synchall_end(dcontext_t *ignored)
     flush_threads = NULL;
     ASSERT(flusher == NULL);
     flush_synchall = false;
+    flush_regions = NULL;
     ASSERT(dynamo_all_threads_synched);
     ASSERT(allsynch_flusher == my_dcontext);
     allsynch_flusher = NULL;
@@ -6207,14 +6488,16 @@ flush_fragments_synchall_end(dcontext_t *ignored)
  * performed and false is returned.  The caller must acquire the executable
  * areas lock and re-check the overlap if exec area manipulation is to be
  * performed.  Returns true otherwise.
+ *
+ * If regions is non-NULL, its regions are unlinked in place of [base,
+ * base+size), which should then be empty, and no overlap check is done.
  */
-bool
-flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size,
-                                  /* WARNING: case 8572: the caller owning this lock
-                                   * is incompatible w/ suspend-the-world flushing!
-                                   */
-                                  bool own_initexit_lock, bool exec_invalid,
-                                  bool force_synchall _IF_DGCDIAG(app_pc written_pc))
+static bool
+flush_fragments_synch_unlink_priv_common(dcontext_t *dcontext, app_pc base,
+                                         size_t size, vm_area_vector_t *regions,
+                                         bool own_initexit_lock, bool exec_invalid,
+                                         bool force_synchall
+                                         _IF_DGCDIAG(app_pc written_pc))
 {
     dcontext_t *tgt_dcontext;
     per_thread_t *tgt_pt;
@@ -6278,7 +6561,7 @@ flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size
          */
         ASSERT(!own_initexit_lock);
         /* The synchall will flush fine as well as coarse so we'll be done */
-        flush_fragments_synchall_start(dcontext, base, size, exec_invalid);
+        flush_fragments_synchall_start(dcontext, base, size, regions, exec_invalid);
         return true;
     }
 
@@ -6296,6 +6579,7 @@ flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size
         mutex_lock(&thread_initexit_lock);
     ASSERT_OWN_MUTEX(true, &thread_initexit_lock);
     flusher = dcontext;
+    flush_regions = regions;
     get_list_of_threads(&flush_threads, &flush_num_threads);
 
     ASSERT(flush_last_stage == 0);
@@ -6333,6 +6617,22 @@ flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size
     if (!special_ibl_xfer_is_thread_private())
         unlink_special_ibl_xfer(GLOBAL_DCONTEXT);
 
+    if (THREAD_SCOPED_FLUSH() && FLUSH_HAS_REGION(size)) {
+        /* For multiple regions we hold back building from anywhere in between */
+        flush_region_iter_t iter;
+        app_pc start, end, scoped_start = NULL, scoped_end = NULL;
+        flush_region_iter_start(&iter, base, size);
+        while (flush_region_iter_next(&iter, &start, &end)) {
+            if (scoped_start == NULL || start < scoped_start)
+                scoped_start = start;
+            if (end > scoped_end)
+                scoped_end = end;
+        }
+        flush_region_iter_stop(&iter);
+        flush_scoped_start = scoped_start;
+        flush_scoped_end = scoped_end;
+    }
+
     for (i=0; i<flush_num_threads; i++) {
         tgt_dcontext = flush_threads[i]->dcontext;
         tgt_pt = (per_thread_t *) tgt_dcontext->fragment_field;
@@ -6386,11 +6686,11 @@ flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size
         /* if a trace-in-progress crosses this region, must squash the trace
          * (all traces are essentially frozen now since threads stop in dispatch)
          */
-        if (size > 0 /* else, no region to cross */ &&
+        if (FLUSH_HAS_REGION(size) /* else, no region to cross */ &&
             is_building_trace(tgt_dcontext)) {
             void *trace_vmlist = cur_trace_vmlist(tgt_dcontext);
             if (trace_vmlist != NULL &&
-                vm_list_overlaps(tgt_dcontext, trace_vmlist, base, base+size)) {
+                flush_regions_overlap(tgt_dcontext, trace_vmlist, base, size)) {
                 LOG(THREAD, LOG_FRAGMENT, 2,
                     "\tsquashing trace of thread "TIDFMT"\n", tgt_dcontext->owning_thread);
                 trace_abort(tgt_dcontext);
@@ -6445,7 +6745,7 @@ flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size
         }
 
         /* don't need to go any further if thread has no frags in region */
-        if (size == 0 || !thread_vm_area_overlap(tgt_dcontext, base, base+size)) {
+        if (!flush_regions_overlap(tgt_dcontext, NULL, base, size)) {
             LOG(THREAD, LOG_FRAGMENT, 2,
                 "\tthread "TIDFMT" has no fragments in region to flush\n",
                 tgt_dcontext->owning_thread);
@@ -6478,6 +6778,15 @@ flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size
                 } else
                     link_special_ibl_xfer(dcontext);
             }
+            if (FLUSH_HAS_REGION(size) && THREAD_SCOPED_FLUSH() &&
+                tgt_dcontext != dcontext &&
+                !tgt_pt->could_be_linking) {
+                LOG(THREAD, LOG_FRAGMENT, 2,
+                    "\tletting thread "TIDFMT" run during the flush\n",
+                    tgt_dcontext->owning_thread);
+                tgt_pt->flush_released = true;
+                STATS_INC(num_scoped_flush_released);
+            }
             goto next_thread;
         }
 
@@ -6491,14 +6800,14 @@ flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size
             }
         });
 
-        if (size > 0) {
+        if (FLUSH_HAS_REGION(size)) {
             /* unlink all frags in overlapping regions, and mark regions for deletion */
             tgt_pt->flush_queue_nonempty = true;
 #ifdef DEBUG
             num_flushed +=
 #endif
-                vm_area_unlink_fragments(tgt_dcontext, base, base + size, 0
-                                         _IF_DGCDIAG(written_pc));
+                flush_regions_unlink_fragments(tgt_dcontext, base, size, 0
+                                               _IF_DGCDIAG(written_pc));
         }
 
     next_thread:
@@ -6515,7 +6824,8 @@ flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size
          * synch to stop threads at cache exit, since we need them all
          * out of DR for duration of shared flush.
          */
-        if (tgt_dcontext != dcontext && !tgt_pt->could_be_linking)
+        if (tgt_dcontext != dcontext && !tgt_pt->could_be_linking &&
+            !tgt_pt->flush_released)
             tgt_pt->wait_for_unlink = true; /* stop at cache exit */
         mutex_unlock(&tgt_pt->linking_lock);
     }
@@ -6523,6 +6833,20 @@ flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size
     return true;
 }
 
+bool
+flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size,
+                                  /* WARNING: case 8572: the caller owning this lock
+                                   * is incompatible w/ suspend-the-world flushing!
+                                   */
+                                  bool own_initexit_lock, bool exec_invalid,
+                                  bool force_synchall _IF_DGCDIAG(app_pc written_pc))
+{
+    return flush_fragments_synch_unlink_priv_common(dcontext, base, size, NULL,
+                                                    own_initexit_lock, exec_invalid,
+                                                    force_synchall
+                                                    _IF_DGCDIAG(written_pc));
+}
+
 /* This routine continues a flush of one of two groups of fragments:
  * 1) if list!=NULL, the list of shared fragments beginning at list and
  *    chained by next_vmarea (we assume that private fragments are
@@ -6601,8 +6925,9 @@ flush_fragments_unlink_shared(dcontext_t *dcontext, app_pc base, size_t size,
          */
         if (list == NULL) {
             shared_flushed =
-                vm_area_unlink_fragments(GLOBAL_DCONTEXT, base, base + size,
-                                         pending_delete_threads _IF_DGCDIAG(written_pc));
+                flush_regions_unlink_fragments(GLOBAL_DCONTEXT, base, size,
+                                               pending_delete_threads
+                                               _IF_DGCDIAG(written_pc));
         } else {
             shared_flushed = unlink_fragments_for_deletion(GLOBAL_DCONTEXT, list,
                                                            pending_delete_threads);
@@ -6754,7 +7079,12 @@ flush_fragments_end_synch(dcontext_t *dcontext, bool keep_initexit_lock)
             tgt_pt->at_syscall_at_flush = false;
         }
 
-        if (tgt_dcontext != dcontext) {
+        if (tgt_pt->flush_released) {
+            /* never stopped, so nothing to wake up: it may well be
+             * could_be_linking by now, but not waiting on us
+             */
+            tgt_pt->flush_released = false;
+        } else if (tgt_dcontext != dcontext) {
             if (tgt_pt->could_be_linking) {
                 signal_event(tgt_pt->finished_with_unlink);
             } else {
@@ -6772,6 +7102,10 @@ flush_fragments_end_synch(dcontext_t *dcontext, bool keep_initexit_lock)
         mutex_unlock(&tgt_pt->linking_lock);
     }
 
+    flush_scoped_start = NULL;
+    flush_scoped_end = NULL;
+    flush_regions = NULL;
+
     /* thread init/exit can proceed now */
     flusher = NULL;
     global_heap_free(flush_threads, flush_num_threads*sizeof(thread_record_t*)
@@ -6809,6 +7143,7 @@ flush_fragments_in_region_start(dcontext_t *dcontext, app_pc base, size_t size,
                                 _IF_DGCDIAG(app_pc written_pc))
 {
     KSTART(flush_region);
+    decode_cache_invalidate(base, base + size);
     while (true) {
         if (flush_fragments_synch_unlink_priv(dcontext, base, size, own_initexit_lock,
                                               exec_invalid, force_synchall
@@ -6891,6 +7226,56 @@ flush_fragments_from_region(dcontext_t *dcontext, app_pc base, size_t size,
     flush_fragments_in_region_finish(dcontext, false);
 }
 
+/* Flushes fragments from each region in the vector regions without any changes
+ * to the exec list, synchronizing with the other threads once for all of them
+ * rather than once per region.  regions must be private to the caller.  Does
+ * not free futures and caller can't be holding the initexit lock.
+ */
+void
+flush_fragments_from_regions(dcontext_t *dcontext, vm_area_vector_t *regions,
+                             bool force_synchall)
+{
+    vmvector_iterator_t vmvi;
+    app_pc start, end;
+    bool executed = false;
+    ASSERT_DO_NOT_OWN_MUTEX(true, &thread_initexit_lock);
+    ASSERT(regions != NULL && !TEST(VECTOR_SHARED, regions->flags));
+
+    vmvector_iterator_start(regions, &vmvi);
+    while (vmvector_iterator_hasnext(&vmvi)) {
+        vmvector_iterator_next(&vmvi, &start, &end);
+        if (executable_vm_area_executed_from(start, end)) {
+            executed = true;
+            /* as in flush_fragments_synch_unlink_priv(), coarse units need a synchall */
+            if (executable_vm_area_coarse_overlap(start, end))
+                force_synchall = true;
+        }
+    }
+    vmvector_iterator_stop(&vmvi);
+    if (!executed)
+        return;
+
+    KSTART(flush_region);
+    vmvector_iterator_start(regions, &vmvi);
+    while (vmvector_iterator_hasnext(&vmvi)) {
+        vmvector_iterator_next(&vmvi, &start, &end);
+        decode_cache_invalidate(start, end);
+    }
+    vmvector_iterator_stop(&vmvi);
+    /* With an empty region stage 1 always synchs, and each stage then works
+     * on the regions.
+     */
+    flush_fragments_synch_unlink_priv_common(dcontext, EMPTY_REGION_BASE,
+                                             EMPTY_REGION_SIZE, regions,
+                                             false/*don't own initexit*/,
+                                             false/*exec valid*/, force_synchall
+                                             _IF_DGCDIAG(NULL));
+    flush_fragments_unlink_shared(dcontext, EMPTY_REGION_BASE, EMPTY_REGION_SIZE,
+                                  NULL _IF_DGCDIAG(NULL));
+    executable_areas_lock();
+    flush_fragments_in_region_finish(dcontext, false);
+}
+
 /* Invalidate all fragments in all caches.  Currently executed
  * fragments may be alive until they reach an exit.
  *
@@ -406,6 +406,22 @@ typedef struct _fragment_entry_t {
 
 #define HASHLOOKUP_SENTINEL_START_PC ((cache_pc)PTR_UINT_1)
 
+/* -ibl_l1_bits: a small direct-mapped per-thread cache, one per branch type,
+ * that the IBL routines probe before the ibl table in TLS.  Each slot points
+ * at the table entry last hit by a tag mapping to that slot, indexed by the
+ * tag bits just above the pointer size, so a hit is validated against and then
+ * handled exactly like a table hit.  Slots that point nowhere else point at
+ * ibl_l1_empty_entry.  The pointed-at tables stay allocated until this thread
+ * updates its table pointers, at which point we reset the slots.
+ */
+#define IBL_L1_ENABLED() \
+    (IF_X86_ELSE(DYNAMO_OPTION(ibl_l1_bits) > 0, false) && \
+     DYNAMO_OPTION(ibl_table_in_tls) && SHARED_IB_TARGETS())
+#define IBL_L1_ENTRIES() (1U << DYNAMO_OPTION(ibl_l1_bits))
+#define IBL_L1_INDEX_MASK() ((IBL_L1_ENTRIES() - 1) * sizeof(fragment_entry_t *))
+
+extern const fragment_entry_t ibl_l1_empty_entry;
+
 /* Flags stored in {fragment,ibl}_table_t->flags bitfield
  */
 /* Indicates that fragment entries are shared between multiple tables in an
@@ -523,6 +539,12 @@ typedef struct _per_thread_t {
      * not used while not flushing.
      */
     bool           at_syscall_at_flush;
+    /* for -thread_scoped_flush: set while a flush that found none of this
+     * thread's fragments in its region lets this thread keep running
+     */
+    bool           flush_released;
+    /* -ibl_l1_bits caches, pointed at from TLS */
+    fragment_entry_t **ibl_l1[IBL_BRANCH_TYPE_END];
 
 #ifdef PROFILE_LINKCOUNT
     uint tracedump_num_below_threshold;
@@ -1002,6 +1024,9 @@ enter_couldbelinking(dcontext_t *dcontext, fragment_t *watch, bool temporary);
 void
 enter_threadexit(dcontext_t *dcontext);
 
+void
+wait_for_scoped_flush(dcontext_t *dcontext, app_pc start, app_pc end);
+
 uint
 get_flushtime_last_update(dcontext_t *dcontext);
 
@@ -1086,6 +1111,13 @@ void
 flush_fragments_from_region(dcontext_t *dcontext, app_pc base, size_t size,
                             bool force_synchall);
 
+/* Like flush_fragments_from_region() for each region in the private vector
+ * regions, synchronizing only once.
+ */
+void
+flush_fragments_from_regions(dcontext_t *dcontext, vm_area_vector_t *regions,
+                             bool force_synchall);
+
 void
 flush_fragments_custom_list(dcontext_t *dcontext, fragment_t *list,
                             bool own_initexit_lock, bool exec_invalid);
@@ -382,6 +382,9 @@ typedef struct _client_flush_req_t {
      (dcontext)->client_data != NULL && \
      (dcontext)->client_data->is_client_thread)
 
+/* Number of module segments each thread caches for dr_lookup_module_ex() */
+# define MODULE_VIEW_CACHE_SIZE 4
+
 /* Client interface-specific data for dcontexts */
 typedef struct _client_data_t {
     /* field for use by user via exported API */
@@ -432,6 +435,21 @@ typedef struct _client_data_t {
     bool           mcontext_in_dcontext;
     bool           suspended;
     priv_mcontext_t *cur_mc;
+    /* -ibl_profile table of (site, target) pairs, allocated on first use */
+    struct _dr_ibl_profile_entry_t *ibl_profile;
+    /* -exit_profile table of (tag, reason) pairs, allocated on first use */
+    struct _dr_exit_profile_entry_t *exit_profile;
+    /* dr_lookup_module_ex() cache of recently used module segments.  Each
+     * entry holds a reference on its view.  The cache is only valid while
+     * module_cache_generation matches module_list_generation.
+     */
+    struct {
+        app_pc start;
+        app_pc end;
+        struct _module_view_t *view;
+    } module_cache[MODULE_VIEW_CACHE_SIZE];
+    int module_cache_generation;
+    uint module_cache_next;
 } client_data_t;
 #else
 # define IS_CLIENT_THREAD(dcontext) false
@@ -569,6 +587,7 @@ void dynamorio_fork_init(dcontext_t *dcontext);
 #endif
 void dynamorio_take_over_threads(dcontext_t *dcontext);
 dr_statistics_t * get_dr_stats(void);
+void startup_profile_block_built(void);
 
 /* functions needed by detach */
 int dynamo_shared_exit(IF_WINDOWS_(thread_record_t *toexit)
@@ -850,6 +869,8 @@ struct _dcontext_t {
     void *         vm_areas_field;
     void *         os_field;
     void *         synch_field;
+    void *         encode_field;
+    void *         rstats_field;
 #ifdef UNIX
     void *         signal_field;
     void *         pcprofile_field;
@@ -893,6 +914,14 @@ struct _dcontext_t {
      */
     retaddr_and_retloc_t native_retstack[MAX_NATIVE_RETSTACK];
     uint native_retstack_cur;
+    /* One-entry cache of the last return address that call_to_native() replaced
+     * with a ret stub, consulted by the code from insert_call_to_native().
+     * Only valid while native_call_generation matches
+     * native_call_cache_generation.
+     */
+    app_pc native_call_retaddr;
+    app_pc native_call_retstub;
+    ptr_uint_t native_call_generation;
 
 #ifdef PROGRAM_SHEPHERDING
     bool           alloc_no_reserve; /* to implement executable_if_alloc policy */
@@ -935,6 +964,8 @@ struct _dcontext_t {
     uint64         cache_count[10];  /* top ten cache_frag_counts */
 #endif
 
+    exit_profile_t exit_profile;   /* -exit_profile state */
+
 #ifdef CLIENT_INTERFACE
     /* client interface-specific data */
     client_data_t *client_data;
@@ -189,6 +189,13 @@ generic_hash_remove(dcontext_t *dcontext, generic_table_t *htable, ptr_uint_t ke
     return false;
 }
 
+uint
+generic_hash_range_remove(dcontext_t *dcontext, generic_table_t *htable,
+                          ptr_uint_t start, ptr_uint_t end)
+{
+    return hashtable_generic_range_remove(dcontext, htable, start, end, NULL);
+}
+
 /* pass 0 to start.  returns -1 when there are no more entries. */
 int
 generic_hash_iterate_next(dcontext_t *dcontext, generic_table_t *htable, int iter,
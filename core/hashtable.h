@@ -70,6 +70,16 @@
 #define HASHTABLE_READ_ONLY             0x00000040
 /* Align the main table to the cache line */
 #define HASHTABLE_ALIGN_TABLE           0x00000080
+/* Lookups may use the lookup_lockfree routine instead of the read lock.
+ * Writers then bump write_seq and never free a table in use (see
+ * hashtablex.h), and the resized_custom routine must keep the old table
+ * alive.
+ */
+#define HASHTABLE_LOCKFREE_READS        0x00000100
+/* Resize by moving entries over a few at a time on later adds, rather than
+ * all at once (see hashtablex.h).  Not for tables read by the ibl routines.
+ */
+#define HASHTABLE_INCREMENTAL_RESIZE    0x00000200
 
 /* Specific tables can add their own flags starting with this value
  * FIXME: any better way? how know when hit limit with <<?
@@ -95,7 +105,23 @@
 
 #define TABLE_RWLOCK(ptable,rw,lock) do {   \
     if (TABLE_NEEDS_LOCK(ptable))           \
-        rw##_##lock(&(ptable)->rwlock);     \
+        TABLE_##rw##_##lock(ptable);        \
+} while (0)
+
+#define TABLE_read_lock(ptable)   read_lock(&(ptable)->rwlock)
+#define TABLE_read_unlock(ptable) read_unlock(&(ptable)->rwlock)
+/* write_seq is odd exactly while a writer holds the lock */
+#define TABLE_write_lock(ptable) do {           \
+    write_lock(&(ptable)->rwlock);              \
+    TABLE_BUMP_WRITE_SEQ(ptable);               \
+} while (0)
+#define TABLE_write_unlock(ptable) do {         \
+    TABLE_BUMP_WRITE_SEQ(ptable);               \
+    write_unlock(&(ptable)->rwlock);            \
+} while (0)
+#define TABLE_BUMP_WRITE_SEQ(ptable) do {                           \
+    if (TEST(HASHTABLE_LOCKFREE_READS, (ptable)->table_flags))      \
+        ATOMIC_INC(int, (ptable)->write_seq);                       \
 } while (0)
 
 #define TABLE_MEMOP(table_flags, op) \
@@ -221,6 +247,11 @@ generic_hash_add(dcontext_t *dcontext, generic_table_t *htable, ptr_uint_t key,
 bool
 generic_hash_remove(dcontext_t *dcontext, generic_table_t *htable, ptr_uint_t key);
 
+/* removes all entries with keys in [start, end), returning how many */
+uint
+generic_hash_range_remove(dcontext_t *dcontext, generic_table_t *htable,
+                          ptr_uint_t start, ptr_uint_t end);
+
 /* pass 0 to start.  returns -1 when there are no more entries. */
 int
 generic_hash_iterate_next(dcontext_t *dcontext, generic_table_t *htable, int iter,
@@ -221,7 +221,16 @@ typedef struct HTNAME(_,NAME_KEY,_table_t) {
 #endif /* HASHTABLE_STATISTICS */
     uint table_flags; /* the HASHTABLE_* values are used here */
     read_write_lock_t rwlock;       /* shared tables should use a read/write lock */
+    /* odd while a writer holds rwlock; only maintained for
+     * HASHTABLE_LOCKFREE_READS tables
+     */
+    volatile uint write_seq;
     ENTRY_TYPE *table_unaligned;  /* real alloc for table if HASHTABLE_ALIGN_TABLE */
+    /* HASHTABLE_INCREMENTAL_RESIZE: the table we are still moving entries out
+     * of, and how far down it we have gotten, or NULL
+     */
+    struct HTNAME(_,NAME_KEY,_table_t) *resize_old;
+    uint resize_next;
 #ifdef HASHTABLE_USE_LOOKUPTABLE
     byte *lookup_table_unaligned; /* real allocation unit for lookuptable */
 #endif
@@ -262,6 +271,17 @@ static uint
 HTNAME(hashtable_,NAME_KEY,_unlinked_remove)(dcontext_t *dcontext,
                                              HTNAME(,NAME_KEY,_table_t) *table);
 
+static void
+HTNAME(hashtable_,NAME_KEY,_resize_incremental)(dcontext_t *dcontext,
+                                                HTNAME(,NAME_KEY,_table_t) *table,
+                                                uint old_hash_bits,
+                                                uint add_now, uint add_later);
+
+static void
+HTNAME(hashtable_,NAME_KEY,_migrate)(dcontext_t *dcontext,
+                                     HTNAME(,NAME_KEY,_table_t) *table,
+                                     uint max_buckets);
+
 static void
 HTNAME(hashtable_,NAME_KEY,_groom_table)(dcontext_t *dcontext,
                                          HTNAME(,NAME_KEY,_table_t) *table);
@@ -554,6 +574,9 @@ HTNAME(hashtable_,NAME_KEY,_init)(dcontext_t *dcontext,
                                                load_factor_percent, func,
                                                hash_offset _IFLOOKUP(use_lookup));
     ASSIGN_INIT_READWRITE_LOCK_FREE(table->rwlock, HTLOCK_RANK);
+    table->write_seq = 0;
+    table->resize_old = NULL;
+    table->resize_next = 0;
 #ifdef HASHTABLE_STATISTICS
     INIT_HASHTABLE_STATS(table->drlookup_stats);
 #endif
@@ -620,6 +643,17 @@ HTNAME(hashtable_,NAME_KEY,_free)(dcontext_t *dcontext,
 # endif
 #endif /* HASHTABLE_STATISTICS */
 
+    if (table->resize_old != NULL) {
+        /* only empty slots and moved-out entries are left to care about */
+        HTNAME(hashtable_,NAME_KEY,_free_table)
+            (dcontext, table->resize_old->table_unaligned
+             _IFLOOKUP(table->resize_old->lookup_table_unaligned),
+             table->table_flags, table->resize_old->capacity);
+        TABLE_MEMOP(table->table_flags, free)
+            (dcontext, table->resize_old, sizeof(*table->resize_old)
+             HEAPACCT(HASHTABLE_WHICH_HEAP(table->table_flags)));
+        table->resize_old = NULL;
+    }
     HTNAME(hashtable_,NAME_KEY,_free_table)(dcontext, table->table_unaligned
                                             _IFLOOKUP(table->lookup_table_unaligned),
                                             table->table_flags, table->capacity);
@@ -762,6 +796,9 @@ HTNAME(hashtable_,NAME_KEY,_lookup)(dcontext_t *dcontext, ptr_uint_t tag,
             HTNAME(hashtable_,NAME_KEY,_check_consistency)(dcontext,htable,hindex);
         });
     }
+    /* not moved over yet? */
+    if (htable->resize_old != NULL)
+        return HTNAME(hashtable_,NAME_KEY,_lookup)(dcontext, tag, htable->resize_old);
     HTABLE_STAT_INC(htable,miss);
     return e;
 }
@@ -778,6 +815,73 @@ HTNAME(hashtable_,NAME_KEY,_rlookup)(dcontext_t *dcontext, ptr_uint_t tag,
     return e;
 }
 
+#ifndef HASHTABLE_USE_LOOKUPTABLE
+/* Lookup for HASHTABLE_LOCKFREE_READS tables that takes no lock and never
+ * writes to shared memory.  We snapshot the table between two reads of
+ * write_seq, which is odd while a writer holds the lock, and probe it
+ * without a lock.  If write_seq has moved by the end of the probe a writer
+ * raced with us and we try again, falling back to the read lock after a few
+ * tries so a stream of writers cannot starve us.  A snapshot can be stale
+ * but never freed, as replaced tables are kept alive by resized_custom, and
+ * the entries themselves are freed only via the usual flush synch.
+ * Relies on loads not being reordered with other loads, as on x86.
+ */
+static inline ENTRY_TYPE
+HTNAME(hashtable_,NAME_KEY,_lookup_lockfree)(dcontext_t *dcontext, ptr_uint_t tag,
+                                             HTNAME(,NAME_KEY,_table_t) *htable)
+{
+    /* just the fields HASH_FUNC and HASH_INDEX_WRAPAROUND look at */
+    struct {
+        ptr_uint_t hash_mask;
+        uint hash_bits;
+        hash_function_t hash_func;
+        uint hash_mask_offset;
+    } snap, *psnap = &snap;
+    uint tries;
+    ASSERT(TEST(HASHTABLE_LOCKFREE_READS, htable->table_flags));
+    for (tries = 0; tries < 4; tries++) {
+        uint seq = htable->write_seq;
+        ENTRY_TYPE *table;
+        uint capacity, hindex, probes;
+        ENTRY_TYPE e;
+        if (TEST(1, seq)) {
+            SPINLOCK_PAUSE();
+            continue;
+        }
+        COMPILER_BARRIER();
+        table = htable->table;
+        capacity = htable->capacity;
+        snap.hash_mask = htable->hash_mask;
+        snap.hash_bits = htable->hash_bits;
+        snap.hash_func = htable->hash_func;
+        snap.hash_mask_offset = htable->hash_mask_offset;
+        COMPILER_BARRIER();
+        if (htable->write_seq != seq)
+            continue;
+        hindex = HASH_FUNC(tag, psnap);
+        e = table[hindex];
+        /* bounded, since a racing writer can hand us a probe sequence
+         * with no empty slot
+         */
+        for (probes = 0; !ENTRY_IS_EMPTY(e) && probes < capacity; probes++) {
+            if (TAGS_ARE_EQUAL(htable, ENTRY_TAG(e), tag))
+                break;
+            hindex = HASH_INDEX_WRAPAROUND(hindex + 1, psnap);
+            e = table[hindex];
+        }
+        COMPILER_BARRIER();
+        if (htable->write_seq != seq)
+            continue;
+        /* not possible without a writer, which we would have seen */
+        ASSERT(probes < capacity);
+        /* no HTABLE_STAT_INC: that would write to the shared table */
+        return e;
+    }
+    STATS_INC(htable_lockfree_lookup_fallbacks);
+    return HTNAME(hashtable_,NAME_KEY,_rlookup)(dcontext, tag, htable);
+}
+#endif
+
 /* add f to a fragment table
  * returns whether resized the table or not
  * N.B.: this routine will recursively call itself via check_table_size if the
@@ -807,6 +911,10 @@ HTNAME(hashtable_,NAME_KEY,_add)(dcontext_t *dcontext, ENTRY_TYPE e,
      * call, like hindex, as it will change if resized.
      */
     resized = !HTNAME(hashtable_,NAME_KEY,_check_size)(dcontext, table, 1, 0);
+    if (table->resize_old != NULL) {
+        HTNAME(hashtable_,NAME_KEY,_migrate)(dcontext, table,
+                                             DYNAMO_OPTION(shared_table_resize_step));
+    }
 
     hindex = HASH_FUNC(ENTRY_TAG(e), table);
     /* find an empty null slot */
@@ -1009,10 +1117,21 @@ HTNAME(hashtable_,NAME_KEY,_check_size)(dcontext_t *dcontext,
      * followed up by a full removal of the unlinked entries.
      */
     entries = lockless ? table->entries + table->unlinked_entries : table->entries;
+    if (table->resize_old != NULL) {
+        /* all of these will end up in the new table */
+        entries += table->resize_old->entries;
+        if (entries > table->resize_threshold) {
+            /* too slow to move: finish the last resize before starting another */
+            STATS_INC(num_incremental_htable_resizes_forced);
+            HTNAME(hashtable_,NAME_KEY,_migrate)(dcontext, table, UINT_MAX);
+            ASSERT(table->resize_old == NULL && table->entries == entries);
+        }
+    }
     if (entries > table->resize_threshold) {
         ENTRY_TYPE *old_table = table->table;
         ENTRY_TYPE *old_table_unaligned = table->table_unaligned;
         uint old_capacity = table->capacity;
+        uint old_hash_bits = table->hash_bits;
 #ifdef HASHTABLE_USE_LOOKUPTABLE
         AUX_ENTRY_TYPE *old_lookuptable_to_nullify = table->lookuptable;
         byte *old_lookup_table_unaligned = table->lookup_table_unaligned;
@@ -1071,6 +1190,14 @@ HTNAME(hashtable_,NAME_KEY,_check_size)(dcontext_t *dcontext,
             ASSERT(table->hash_bits > old_bits);
         }
 
+        if (TEST(HASHTABLE_INCREMENTAL_RESIZE, table->table_flags)) {
+            ASSERT(!lockless);
+            HTNAME(hashtable_,NAME_KEY,_resize_incremental)(dcontext, table,
+                                                            old_hash_bits,
+                                                            add_now, add_later);
+            return false; /* == resized the table */
+        }
+
         HTNAME(hashtable_,NAME_KEY,_resize)(alloc_dc, table);
         /* will be incremented by rehashing below -- in fact, by
          * recursive calls to this routine from
@@ -1168,7 +1295,10 @@ HTNAME(hashtable_,NAME_KEY,_check_size)(dcontext_t *dcontext,
          * they are accessed while in-cache, unlike other shared tables
          * such as the shared BB or shared trace table.
          */
-        if (!shared_lockless) {
+        /* Lock-free readers may still be probing the old table:
+         * resized_custom must defer freeing it.
+         */
+        if (!shared_lockless && !TEST(HASHTABLE_LOCKFREE_READS, table->table_flags)) {
             HTNAME(hashtable_,NAME_KEY,_free_table)
                 (alloc_dc, old_table_unaligned _IFLOOKUP(old_lookup_table_unaligned),
                  table->table_flags, old_capacity);
@@ -1398,6 +1528,8 @@ HTNAME(hashtable_,NAME_KEY,_remove)(ENTRY_TYPE fr, HTNAME(,NAME_KEY,_table_t) *h
         HTNAME(hashtable_,NAME_KEY,_remove_helper)(htable, hindex, pg);
         return true;
     }
+    if (htable->resize_old != NULL)
+        return HTNAME(hashtable_,NAME_KEY,_remove)(fr, htable->resize_old);
     return false;
 }
 
@@ -1435,10 +1567,109 @@ HTNAME(hashtable_,NAME_KEY,_replace)
 #endif
         return true;
     }
-
+    if (htable->resize_old != NULL) {
+        return HTNAME(hashtable_,NAME_KEY,_replace)(old_e, new_e,
+                                                    htable->resize_old);
+    }
     return false;
 }
 
+/* Starts a resize of a HASHTABLE_INCREMENTAL_RESIZE table, once check_size
+ * has picked the new hash_bits.  Rather than rehashing every entry while
+ * holding the write lock, which stalls every thread that wants the table,
+ * we keep the old table on the side and move a few of its buckets over on
+ * each add (see _migrate).  Lookups, removals and replacements consult the
+ * old table too until it is empty.
+ * The old table is only reachable through table, so it needs no lock of
+ * its own.
+ */
+static void
+HTNAME(hashtable_,NAME_KEY,_resize_incremental)(dcontext_t *dcontext,
+                                                HTNAME(,NAME_KEY,_table_t) *table,
+                                                uint old_hash_bits,
+                                                uint add_now, uint add_later)
+{
+    dcontext_t *alloc_dc = FRAGMENT_TABLE_ALLOC_DC(dcontext, table->table_flags);
+    HTNAME(,NAME_KEY,_table_t) *old;
+    ASSERT(table->resize_old == NULL);
+    /* the ibl routines and lock-free readers only ever look at one table */
+    ASSERT(!TESTANY(HASHTABLE_LOCKLESS_ACCESS | HASHTABLE_LOCKFREE_READS,
+                    table->table_flags));
+    old = (HTNAME(,NAME_KEY,_table_t) *) TABLE_MEMOP(table->table_flags, alloc)
+        (alloc_dc, sizeof(*old) HEAPACCT(HASHTABLE_WHICH_HEAP(table->table_flags)));
+    /* the copy's rwlock is never used */
+    *old = *table;
+    old->hash_bits = old_hash_bits;
+    old->table_flags &= ~HASHTABLE_INCREMENTAL_RESIZE;
+    old->entries -= add_now + add_later;
+    DODEBUG({ old->is_local = true; });
+
+    HTNAME(hashtable_,NAME_KEY,_resize)(alloc_dc, table);
+    table->entries = add_now; /* add_later will be added by later calls */
+    table->resize_old = old;
+    table->resize_next = old->capacity - 1 - 1 /* sentinel */;
+    STATS_INC(num_incremental_htable_resizes);
+    LOG(THREAD, LOG_HTABLE, 2,
+        "%s hashtable resize from capacity %d to %d started, %d entries to move\n",
+        table->name, old->capacity, table->capacity, old->entries);
+}
+
+/* Moves entries from the old table of an incremental resize into table,
+ * looking at no more than max_buckets old buckets, and frees the old table
+ * once it is empty.  Caller must hold the write lock.
+ */
+static void
+HTNAME(hashtable_,NAME_KEY,_migrate)(dcontext_t *dcontext,
+                                     HTNAME(,NAME_KEY,_table_t) *table,
+                                     uint max_buckets)
+{
+    HTNAME(,NAME_KEY,_table_t) *old = table->resize_old;
+    dcontext_t *alloc_dc;
+    if (old == NULL)
+        return;
+    /* Same reverse walk as range_remove: removing never moves an unvisited
+     * entry above the cursor unless it pulls a chain across the wraparound,
+     * in which case we start over at the top.  Removals from the old table by
+     * others can do the same, so we also start over if we reach the bottom
+     * with entries left.
+     */
+    for (; max_buckets > 0 && old->entries > 0; max_buckets--) {
+        ENTRY_TYPE e = old->table[table->resize_next];
+        if (!ENTRY_IS_EMPTY(e)) {
+            uint hindex;
+            if (HTNAME(hashtable_,NAME_KEY,_remove_helper)
+                (old, table->resize_next, &old->table[table->resize_next]))
+                table->resize_next = old->capacity - 1 - 1 /* sentinel */;
+            /* no need for _add's checks: check_size made room for these */
+            hindex = HASH_FUNC(ENTRY_TAG(e), table);
+            while (!ENTRY_IS_EMPTY(table->table[hindex]))
+                hindex = HASH_INDEX_WRAPAROUND(hindex + 1, table);
+            table->table[hindex] = e;
+            table->entries++;
+            if (ENTRY_IS_INVALID(e))
+                table->unlinked_entries++;
+        } else if (table->resize_next == 0)
+            table->resize_next = old->capacity - 1 - 1 /* sentinel */;
+        else
+            table->resize_next--;
+    }
+    if (old->entries > 0)
+        return;
+    LOG(THREAD, LOG_HTABLE, 2, "%s hashtable resize to capacity %d finished\n",
+        table->name, table->capacity);
+    alloc_dc = FRAGMENT_TABLE_ALLOC_DC(dcontext, table->table_flags);
+    table->resize_old = NULL;
+    HTNAME(hashtable_,NAME_KEY,_resized_custom)
+        (dcontext, table, old->capacity, old->table, old->table_unaligned
+         _IFLOOKUP(old->lookuptable) _IFLOOKUP(old->lookup_table_unaligned),
+         old->ref_count, table->table_flags);
+    HTNAME(hashtable_,NAME_KEY,_free_table)
+        (alloc_dc, old->table_unaligned _IFLOOKUP(old->lookup_table_unaligned),
+         table->table_flags, old->capacity);
+    TABLE_MEMOP(table->table_flags, free)
+        (alloc_dc, old, sizeof(*old) HEAPACCT(HASHTABLE_WHICH_HEAP(table->table_flags)));
+}
+
 /* removes all entries and resets the table but keeps the same capacity */
 /* not static b/c not used by all tables */
 void
@@ -1452,6 +1683,7 @@ HTNAME(hashtable_,NAME_KEY,_clear)(dcontext_t *dcontext,
     if (TEST(HASHTABLE_READ_ONLY, table->table_flags))
         return;
     LOG(THREAD, LOG_HTABLE, 2, "hashtable_"KEY_STRING"_clear\n");
+    HTNAME(hashtable_,NAME_KEY,_migrate)(dcontext, table, UINT_MAX);
     DOLOG(2, LOG_HTABLE|LOG_STATS, {
         HTNAME(hashtable_,NAME_KEY,_load_statistics)(dcontext, table);
     });
@@ -1505,6 +1737,7 @@ HTNAME(hashtable_,NAME_KEY,_range_remove)(dcontext_t *dcontext,
     if (TEST(HASHTABLE_READ_ONLY, table->table_flags))
         return 0;
     LOG(THREAD, LOG_HTABLE, 2, "hashtable_"KEY_STRING"_range_remove\n");
+    HTNAME(hashtable_,NAME_KEY,_migrate)(dcontext, table, UINT_MAX);
     DOLOG(2, LOG_HTABLE|LOG_STATS, {
         HTNAME(hashtable_,NAME_KEY,_load_statistics)(dcontext, table);
     });
@@ -2231,6 +2464,8 @@ HTNAME(hashtable_,NAME_KEY,_resurrect)(dcontext_t *dcontext, byte *mapped_table
     htable->table = (ENTRY_TYPE *) (mapped_table + sizeof(*htable));
     htable->table_unaligned = NULL;
     ASSIGN_INIT_READWRITE_LOCK_FREE(htable->rwlock, HTLOCK_RANK);
+    htable->write_seq = 0;
+    htable->resize_old = NULL;
     DODEBUG({
         htable->name = table_name;
     });
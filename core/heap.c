@@ -107,27 +107,46 @@ static const uint BLOCK_SIZES[] = {
     /* we have a lot of size 16 requests for IR but they are transient */
     24, /* fcache empties and vm_area_t are now 20, vm area extras still 24 */
     ALIGN_FORWARD(sizeof(fragment_t) + sizeof(indirect_linkstub_t), HEAP_ALIGNMENT), /* 40 dbg / 36 rel */
-#if defined(X64) || defined(PROFILE_LINKCOUNT) || defined(CUSTOM_EXIT_STUBS)
-    sizeof(instr_t), /* 64 (104 x64) */
+#ifdef CLIENT_INTERFACE
+    /* CLIENT_INTERFACE rules out cbr_fallthrough_linkstub_t (see
+     * use_cbr_fallthrough_short()), so instead of a direct+cbr bucket we size
+     * for bbs with one direct exit (or one direct and one indirect), which
+     * carry a post_linkstub_t.
+     */
+# if defined(X64) || defined(PROFILE_LINKCOUNT) || defined(CUSTOM_EXIT_STUBS)
+    ALIGN_FORWARD(sizeof(fragment_t) + sizeof(direct_linkstub_t) +
+                  sizeof(post_linkstub_t), HEAP_ALIGNMENT), /* 104 dbg / 96 rel x64 */
+# else
+    ALIGN_FORWARD(sizeof(fragment_t) + sizeof(direct_linkstub_t) +
+                  sizeof(post_linkstub_t), HEAP_ALIGNMENT), /* 56 dbg / 52 rel */
+# endif
+#elif defined(X64) || defined(PROFILE_LINKCOUNT) || defined(CUSTOM_EXIT_STUBS)
     sizeof(fragment_t) + sizeof(direct_linkstub_t)
         + sizeof(cbr_fallthrough_linkstub_t), /* 68 dbg / 64 rel, 112 x64 */
     /* all other bb/trace buckets are 8 larger but in same order */
 #else
     sizeof(fragment_t) + sizeof(direct_linkstub_t)
         + sizeof(cbr_fallthrough_linkstub_t), /* 60 dbg / 56 rel */
-    sizeof(instr_t), /* 64 */
 #endif
     /* we keep this bucket even though only 10% or so of normal bbs
      * hit this.
-     * FIXME: release == instr_t here so a small waste when walking buckets
      */
     ALIGN_FORWARD(sizeof(fragment_t) + 2*sizeof(direct_linkstub_t),
                   HEAP_ALIGNMENT), /* 68 dbg / 64 rel (128 x64) */
     ALIGN_FORWARD(sizeof(trace_t) + 2*sizeof(direct_linkstub_t) + sizeof(uint),
                   HEAP_ALIGNMENT), /* 80 dbg / 76 rel (148 x64 => 152) */
+    /* instr_t carries its common operands inline, which puts it among the
+     * trace buckets
+     */
+#ifdef X64
+    sizeof(instr_t), /* 168 x64 */
+#endif
     /* FIXME: measure whether should put in indirect mixes as well */
     ALIGN_FORWARD(sizeof(trace_t) + 3*sizeof(direct_linkstub_t) + sizeof(uint),
                   HEAP_ALIGNMENT), /* 96 dbg / 92 rel (180 x64 => 184) */
+#ifndef X64
+    sizeof(instr_t), /* 112 */
+#endif
     ALIGN_FORWARD(sizeof(trace_t) + 5*sizeof(direct_linkstub_t) + sizeof(uint),
                   HEAP_ALIGNMENT), /* 128 dbg / 124 rel (244 x64 => 248) */
     256,
@@ -264,9 +283,47 @@ typedef struct _thread_units_t {
 } thread_units_t;
 
 /* per-thread structure: */
+/* A chunk of a thread's arena (see heap_arena_alloc()) */
+typedef struct _arena_chunk_t {
+    struct _arena_chunk_t *next;
+    heap_pc end;
+} arena_chunk_t;
+
+/* Large enough for the IR of a typical bb.  Bigger bbs chain more chunks. */
+#define ARENA_CHUNK_SIZE (16*1024)
+#define ARENA_CHUNK_START(c) ((heap_pc)(c) + ALIGN_FORWARD(sizeof(arena_chunk_t), \
+                                                           HEAP_ALIGNMENT))
+/* anything bigger goes to the regular heap */
+#define ARENA_MAX_ALLOC (ARENA_CHUNK_SIZE / 4)
+
+typedef struct _heap_arena_t {
+    arena_chunk_t *chunks; /* the current chunk is first */
+    heap_pc cur;
+    uint depth;     /* nesting of heap_arena_begin() */
+    uint suspended; /* nesting of heap_arena_suspend() */
+} heap_arena_t;
+
+/* Under -global_heap_magazines each thread caches freed global heap blocks
+ * of each fixed-size bucket, linked through their first word as on the free
+ * lists.  Frees from any thread go to the freeing thread's magazine with no
+ * lock; a full magazine hands MAGAZINE_BATCH blocks back to the global free
+ * list, and an empty one refills from it, in one lock acquisition each.
+ */
+typedef struct _heap_magazine_t {
+    heap_pc blocks;
+    uint count;
+} heap_magazine_t;
+
+#define MAGAZINE_BATCH 32
+#define MAGAZINE_MAX (2*MAGAZINE_BATCH)
+
 typedef struct _thread_heap_t {
     thread_units_t *local_heap;
     thread_units_t *nonpersistent_heap;
+    heap_arena_t arena;
+    heap_magazine_t magazines[BLOCK_TYPES-1];
+    /* guards the magazines against a signal handler's global alloc */
+    volatile bool magazines_busy;
 } thread_heap_t;
 
 /* global, unique thread-shared structure:
@@ -419,6 +476,12 @@ typedef byte *vm_addr_t;
 static byte *heap_allowable_region_start = (byte *)PTR_UINT_0;
 static byte *heap_allowable_region_end = (byte *)POINTER_MAX;
 
+/* The closed interval that must be reachable from the DR heap.  Initialized so
+ * it will be overridden on the first request.
+ */
+static byte *must_reach_region_start = (byte *)POINTER_MAX;
+static byte *must_reach_region_end = (byte *)PTR_UINT_0;
+
 /* used only to protect read/write access to the must_reach_* static variables in
  * request_region_be_heap_reachable() */
 DECLARE_CXTSWPROT_VAR(static mutex_t request_region_be_heap_reachable_lock,
@@ -435,11 +498,6 @@ DECLARE_CXTSWPROT_VAR(static mutex_t request_region_be_heap_reachable_lock,
 void
 request_region_be_heap_reachable(byte *start, size_t size)
 {
-    /* initialize so will be overridden on first call; protected by the
-     * request_region_be_heap_reachable_lock */
-    static byte *must_reach_region_start = (byte *)POINTER_MAX;
-    static byte *must_reach_region_end = (byte *)PTR_UINT_0;  /* closed */
-
     LOG(GLOBAL, LOG_HEAP, 2,
         "Adding must-be-reachable-from-heap region "PFX"-"PFX"\n"
         "Existing must-be-reachable region "PFX"-"PFX"\n"
@@ -505,6 +563,23 @@ request_region_be_heap_reachable(byte *start, size_t size)
     }
 }
 
+/* Returns whether [start, start+size) could be added to the must-reach region
+ * while still leaving room on one side for a vm reservation of vm_size.  Only
+ * meant for the up-front requests, before any other thread exists.
+ */
+static bool
+heap_reachable_region_would_fit(byte *start, size_t size)
+{
+    byte *reach_start = MIN(must_reach_region_start, start);
+    byte *reach_end = MAX(must_reach_region_end, start + size - 1);
+    byte *allow_start = REACHABLE_32BIT_START(reach_start, reach_end);
+    byte *allow_end = REACHABLE_32BIT_END(reach_start, reach_end);
+    if (allow_start > reach_start || reach_end > allow_end)
+        return false;
+    return (size_t)(reach_start - allow_start) >= DYNAMO_OPTION(vm_size) ||
+        (size_t)(allow_end - reach_end) >= DYNAMO_OPTION(vm_size);
+}
+
 void
 vmcode_get_reachable_region(byte **region_start OUT, byte **region_end OUT)
 {
@@ -529,6 +604,7 @@ static bool common_heap_free(thread_units_t *tu, void *p, size_t size
 static void release_real_memory(void *p, size_t size, bool remove_vm);
 static void release_guarded_real_memory(vm_addr_t p, size_t size, bool remove_vm,
                                         bool guarded);
+static void stack_cache_exit(void);
 
 typedef enum {
     /* I - Init, Interop - first allocation failed
@@ -716,13 +792,24 @@ vmm_heap_initialize_unusable(vm_heap_t *vmh)
     vmh->num_free_blocks = vmh->num_blocks = 0;
 }
 
+#ifdef LINUX
+/* For -vm_huge_pages: the size of a transparent huge page */
+# define VMM_HUGE_PAGE_SIZE (2*1024*1024)
+#endif
+
 static
 void
 vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
 {
     ptr_uint_t preferred;
     heap_error_code_t error_code;
+    size_t align = VMM_BLOCK_SIZE;
     ASSIGN_INIT_LOCK_FREE(vmh->lock, vmh_lock);
+#ifdef LINUX
+    /* The kernel only uses a huge page for a huge-page-aligned range */
+    if (DYNAMO_OPTION(vm_huge_pages))
+        align = VMM_HUGE_PAGE_SIZE;
+#endif
 
     size = ALIGN_FORWARD(size, VMM_BLOCK_SIZE);
     ASSERT(size <= MAX_VMM_HEAP_UNIT_SIZE);
@@ -743,7 +830,7 @@ vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
     preferred = (DYNAMO_OPTION(vm_base)
                  + get_random_offset(DYNAMO_OPTION(vm_max_offset)/VMM_BLOCK_SIZE)
                  *VMM_BLOCK_SIZE);
-    preferred = ALIGN_FORWARD(preferred, VMM_BLOCK_SIZE);
+    preferred = ALIGN_FORWARD(preferred, align);
     /* overflow check: w/ vm_base shouldn't happen so debug-only check */
     ASSERT(!POINTER_OVERFLOW_ON_ADD(preferred, size));
 
@@ -768,19 +855,19 @@ vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
          * syslog or assert here
          */
         /* need extra size to ensure alignment */
-        vmh->alloc_size = size + VMM_BLOCK_SIZE;
+        vmh->alloc_size = size + align;
 #ifdef X64
         /* PR 215395, make sure allocation satisfies heap reachability contraints */
         vmh->alloc_start = os_heap_reserve_in_region
             ((void *)ALIGN_FORWARD(heap_allowable_region_start, PAGE_SIZE),
              (void *)ALIGN_BACKWARD(heap_allowable_region_end, PAGE_SIZE),
-             size + VMM_BLOCK_SIZE, &error_code,
+             size + align, &error_code,
              true/*+x*/);
 #else
         vmh->alloc_start = (heap_pc)
-            os_heap_reserve(NULL, size + VMM_BLOCK_SIZE, &error_code, true/*+x*/);
+            os_heap_reserve(NULL, size + align, &error_code, true/*+x*/);
 #endif
-        vmh->start_addr = (heap_pc) ALIGN_FORWARD(vmh->alloc_start, VMM_BLOCK_SIZE);
+        vmh->start_addr = (heap_pc) ALIGN_FORWARD(vmh->alloc_start, align);
         LOG(GLOBAL, LOG_HEAP, 1, "vmm_heap_unit_init unable to allocate at preferred="
             PFX" letting OS place sz=%dM addr="PFX" \n",
             preferred, size/(1024*1024), vmh->start_addr);
@@ -815,6 +902,11 @@ vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
         ASSERT_NOT_REACHED();
     }
     vmh->end_addr = vmh->start_addr + size;
+#ifdef LINUX
+    if (DYNAMO_OPTION(vm_huge_pages) &&
+        !os_heap_advise_huge_pages(vmh->start_addr, size))
+        SYSLOG_INTERNAL_WARNING_ONCE("transparent huge pages are unavailable");
+#endif
     ASSERT_TRUNCATE(vmh->num_blocks, uint, size / VMM_BLOCK_SIZE);
     vmh->num_blocks = (uint) (size / VMM_BLOCK_SIZE);
     vmh->num_free_blocks = vmh->num_blocks;
@@ -962,7 +1054,7 @@ rel32_reachable_from_vmcode(byte *tgt)
  * the request.
  */
 static vm_addr_t
-vmm_heap_reserve_blocks(vm_heap_t *vmh, size_t size_in)
+vmm_heap_reserve_blocks(vm_heap_t *vmh, size_t size_in, bool from_top)
 {
     vm_addr_t p;
     uint request;
@@ -982,7 +1074,11 @@ vmm_heap_reserve_blocks(vm_heap_t *vmh, size_t size_in)
         mutex_unlock(&vmh->lock);
         return NULL;
     }
-    first_block = bitmap_allocate_blocks(vmh->blocks, vmh->num_blocks, request);
+    if (from_top)
+        first_block = bitmap_allocate_blocks_from_top(vmh->blocks, vmh->num_blocks,
+                                                      request);
+    else
+        first_block = bitmap_allocate_blocks(vmh->blocks, vmh->num_blocks, request);
     if (first_block != BITMAP_NOT_FOUND) {
         vmh->num_free_blocks -= request;
     }
@@ -1120,7 +1216,13 @@ vmm_heap_reserve(size_t size, heap_error_code_t *error_code, bool executable)
             }
         }
 
-        p = vmm_heap_reserve_blocks(&heapmgt->vmheap, size);
+        /* With -vm_huge_pages, executable memory grows down from the top of the
+         * region, which keeps the code cache and gencode together on as few
+         * huge pages as we can, apart from the heap growing up from the bottom.
+         */
+        p = vmm_heap_reserve_blocks(&heapmgt->vmheap, size,
+                                    executable &&
+                                    IF_LINUX_ELSE(DYNAMO_OPTION(vm_huge_pages), false));
         LOG(GLOBAL, LOG_HEAP, 2, "vmm_heap_reserve: size=%d p="PFX"\n",
             size, p);
 
@@ -1326,6 +1428,45 @@ vmm_heap_alloc(size_t size, uint prot, heap_error_code_t *error_code)
     return p;
 }
 
+#if defined(X64) && defined(UNIX)
+/* Adds each -vm_reach_modules library, in order, if the vm reservation still
+ * fits within reach of it and of everything requested before it.
+ */
+static void
+request_modules_be_heap_reachable(void)
+{
+    char name[MAXIMUM_PATH];
+    const char *prev, *next;
+    bool done = false;
+    string_option_read_lock();
+    prev = DYNAMO_OPTION(vm_reach_modules);
+    do {
+        app_pc start, end;
+        next = strchr(prev, ';');
+        if (next == NULL) {
+            next = prev + strlen(prev);
+            done = true;
+        }
+        strncpy(name, prev, MIN(BUFFER_SIZE_ELEMENTS(name) - 1, next - prev));
+        name[MIN(BUFFER_SIZE_ELEMENTS(name) - 1, next - prev)] = '\0';
+        prev = next + 1;
+        if (name[0] == '\0')
+            continue;
+        if (!os_get_image_bounds(name, &start, &end)) {
+            LOG(GLOBAL, LOG_HEAP, 1, "-vm_reach_modules: %s is not loaded\n", name);
+        } else if (!heap_reachable_region_would_fit(start, end - start)) {
+            /* a later, smaller library may still fit */
+            SYSLOG_INTERNAL_WARNING("-vm_reach_modules: %s is out of reach", name);
+        } else {
+            LOG(GLOBAL, LOG_HEAP, 1, "-vm_reach_modules: %s at "PFX"-"PFX"\n",
+                name, start, end);
+            request_region_be_heap_reachable(start, end - start);
+        }
+    } while (!done);
+    string_option_read_unlock();
+}
+#endif
+
 /* set reachability constraints before loading any client libs */
 void
 vmm_heap_init_constraints()
@@ -1345,7 +1486,21 @@ vmm_heap_init_constraints()
          * has less of an impact on its heap.
          */
         app_pc base = get_application_base();
-        request_region_be_heap_reachable(base, get_application_end() - base);
+# ifdef UNIX
+        /* get_application_end() only covers the first segment, which for a
+         * large executable leaves much of its text and data out of reach.
+         */
+        app_pc end;
+        if (os_get_image_bounds(NULL, &base, &end) &&
+            heap_reachable_region_would_fit(base, end - base))
+            request_region_be_heap_reachable(base, end - base);
+        else
+# endif
+            request_region_be_heap_reachable(base, get_application_end() - base);
+# ifdef UNIX
+        if (!IS_STRING_OPTION_EMPTY(vm_reach_modules))
+            request_modules_be_heap_reachable();
+# endif
     } else {
         /* It seems silly to let the 1st client lib set the region, so we give
          * -vm_base priority.
@@ -1608,6 +1763,7 @@ heap_exit()
     heap_management_t *temp;
 
     heap_exiting = true;
+    stack_cache_exit();
     /* FIXME: we shouldn't need either lock if executed last */
     dynamo_vm_areas_lock();
     acquire_recursive_lock(&heap_unit_lock);
@@ -2369,6 +2525,68 @@ heap_munmap(void *p, size_t size)
 # define STACK_GUARD_PAGES 1
 #endif
 
+/* Freed dstacks kept for reuse with -stack_cache, so a new thread can skip
+ * the reservation and guard page setup of a fresh stack.  Only stacks of
+ * DYNAMORIO_STACK_SIZE are cached.  Entries are the stack bases (not TOS).
+ */
+#define MAX_STACK_CACHE 64
+DECLARE_CXTSWPROT_VAR(static mutex_t stack_cache_lock,
+                      INIT_LOCK_FREE(stack_cache_lock));
+DECLARE_NEVERPROT_VAR(static byte *stack_cache[MAX_STACK_CACHE], {0});
+DECLARE_NEVERPROT_VAR(static uint stack_cache_count, 0);
+
+/* Returns a cached stack base at or above min_addr, or NULL */
+static byte *
+stack_cache_remove(byte *min_addr)
+{
+    byte *p = NULL;
+    uint i;
+    if (DYNAMO_OPTION(stack_cache) == 0 || stack_cache_count == 0)
+        return NULL;
+    mutex_lock(&stack_cache_lock);
+    for (i = stack_cache_count; i > 0; i--) {
+        if (stack_cache[i-1] >= min_addr) {
+            p = stack_cache[i-1];
+            stack_cache[i-1] = stack_cache[--stack_cache_count];
+            break;
+        }
+    }
+    mutex_unlock(&stack_cache_lock);
+    return p;
+}
+
+/* Returns whether p was added to the cache */
+static bool
+stack_cache_add(byte *p)
+{
+    bool added = false;
+    if (DYNAMO_OPTION(stack_cache) == 0 || dynamo_exited)
+        return false;
+    mutex_lock(&stack_cache_lock);
+    if (stack_cache_count < MIN(DYNAMO_OPTION(stack_cache), MAX_STACK_CACHE)) {
+        stack_cache[stack_cache_count++] = p;
+        added = true;
+    }
+    mutex_unlock(&stack_cache_lock);
+    return added;
+}
+
+static void
+stack_cache_exit(void)
+{
+    /* no other threads remain, so no lock needed */
+    while (stack_cache_count > 0) {
+        release_guarded_real_memory((vm_addr_t)stack_cache[--stack_cache_count],
+                                    DYNAMORIO_STACK_SIZE,
+                                    true/*update DR areas immediately*/, true);
+        DOSTATS({
+            if (!dynamo_exited_log_and_stats)
+                STATS_SUB(stack_capacity, DYNAMORIO_STACK_SIZE);
+        });
+    }
+    DELETE_LOCK(stack_cache_lock);
+}
+
 /* use stack_alloc to build a stack -- it returns TOS
  * For STACK_GUARD_PAGE, it also marks the bottom STACK_GUARD_PAGES==1
  * to detect overflows when used.
@@ -2378,6 +2596,22 @@ stack_alloc(size_t size, byte *min_addr)
 {
     void *p;
 
+    if (size == DYNAMORIO_STACK_SIZE) {
+        p = stack_cache_remove(min_addr);
+        if (p != NULL) {
+#ifdef DEBUG_MEMORY
+# ifdef STACK_GUARD_PAGE
+            /* leave the guard page alone */
+            memset((byte *)p + STACK_GUARD_PAGES * PAGE_SIZE, HEAP_ALLOCATED_BYTE,
+                   size - STACK_GUARD_PAGES * PAGE_SIZE);
+# else
+            memset(p, HEAP_ALLOCATED_BYTE, size);
+# endif
+#endif
+            return (void *) ((ptr_uint_t)p + size);
+        }
+    }
+
     /* we reserve and commit at once for now
      * FIXME case 2330: commit-on-demand could allow larger max sizes w/o
      * hurting us in the common case
@@ -2417,6 +2651,8 @@ stack_free(void *p, size_t size)
     if (size == 0)
         size = DYNAMORIO_STACK_SIZE;
     p = (void *) ((vm_addr_t)p - size);
+    if (size == DYNAMORIO_STACK_SIZE && stack_cache_add((byte *)p))
+        return;
     release_guarded_real_memory((vm_addr_t)p, size, true/*update DR areas immediately*/,
                                 true);
     DOSTATS({
@@ -2672,11 +2908,136 @@ common_global_heap_free(thread_units_t *tu, void *p, size_t size HEAPACCT(which_
     ASSERT(ok);
 }
 
+/* Debug builds keep per-block accounting, stats, and fill checks that all
+ * need global_alloc_lock, so they always take the locked path.
+ */
+#if defined(DEBUG) || defined(HEAP_ACCOUNTING)
+# define GLOBAL_HEAP_MAGAZINES() false
+#else
+# define GLOBAL_HEAP_MAGAZINES() DYNAMO_OPTION(global_heap_magazines)
+#endif
+
+/* Returns the fixed-size bucket for size, or BLOCK_TYPES-1 if it's variable. */
+static inline uint
+heap_fixed_bucket(size_t size)
+{
+    size_t aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);
+    uint bucket = 0;
+    while (aligned_size > BLOCK_SIZES[bucket])
+        bucket++;
+    return bucket;
+}
+
+/* Returns the calling thread's heap with its magazines claimed, or NULL if
+ * they're off, not set up yet, or already in use lower on the stack.
+ */
+static thread_heap_t *
+magazines_acquire(void)
+{
+    dcontext_t *dcontext;
+    thread_heap_t *th;
+    if (!GLOBAL_HEAP_MAGAZINES())
+        return NULL;
+    dcontext = get_thread_private_dcontext();
+    if (dcontext == NULL || dcontext == GLOBAL_DCONTEXT)
+        return NULL;
+    th = (thread_heap_t *) dcontext->heap_field;
+    if (th == NULL || th->magazines_busy)
+        return NULL;
+    th->magazines_busy = true;
+    return th;
+}
+
+static inline void
+magazines_release(thread_heap_t *th)
+{
+    ASSERT(th->magazines_busy);
+    th->magazines_busy = false;
+}
+
+/* Moves the first num blocks of mag onto the global free list. */
+static void
+magazine_return(heap_magazine_t *mag, uint bucket, uint num)
+{
+    thread_units_t *tu = &heapmgt->global_units;
+    heap_pc head = mag->blocks, last = head;
+    uint i;
+    ASSERT(num > 0 && num <= mag->count);
+    for (i = 1; i < num; i++)
+        last = *((heap_pc *)last);
+    mag->blocks = *((heap_pc *)last);
+    mag->count -= num;
+    acquire_recursive_lock(&global_alloc_lock);
+    *((heap_pc *)last) = tu->free_list[bucket];
+    tu->free_list[bucket] = head;
+    release_recursive_lock(&global_alloc_lock);
+}
+
+/* Moves up to MAGAZINE_BATCH blocks from the global free list into mag. */
+static void
+magazine_refill(heap_magazine_t *mag, uint bucket)
+{
+    thread_units_t *tu = &heapmgt->global_units;
+    heap_pc head, last = NULL, p;
+    uint num = 0;
+    acquire_recursive_lock(&global_alloc_lock);
+    head = tu->free_list[bucket];
+    for (p = head; p != NULL && num < MAGAZINE_BATCH; p = *((heap_pc *)p)) {
+        last = p;
+        num++;
+    }
+    if (num > 0) {
+        tu->free_list[bucket] = p;
+        *((heap_pc *)last) = mag->blocks;
+        mag->blocks = head;
+        mag->count += num;
+    }
+    release_recursive_lock(&global_alloc_lock);
+}
+
+static void *
+magazine_alloc(thread_heap_t *th, uint bucket)
+{
+    heap_magazine_t *mag = &th->magazines[bucket];
+    heap_pc p;
+    if (mag->count == 0) {
+        magazine_refill(mag, bucket);
+        /* nothing free: carve a new block the usual way */
+        if (mag->count == 0)
+            return NULL;
+    }
+    p = mag->blocks;
+    mag->blocks = *((heap_pc *)p);
+    mag->count--;
+    return (void *) p;
+}
+
+static void
+magazine_free(thread_heap_t *th, uint bucket, void *p)
+{
+    heap_magazine_t *mag = &th->magazines[bucket];
+    *((heap_pc *)p) = mag->blocks;
+    mag->blocks = (heap_pc) p;
+    mag->count++;
+    if (mag->count >= MAGAZINE_MAX)
+        magazine_return(mag, bucket, MAGAZINE_BATCH);
+}
+
 /* these functions use the global heap instead of a thread's heap: */
 void *
 global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
 {
-    void *p = common_global_heap_alloc(&heapmgt->global_units, size HEAPACCT(which));
+    void *p = NULL;
+    uint bucket = heap_fixed_bucket(size);
+    if (bucket < BLOCK_TYPES-1 && size > 0) {
+        thread_heap_t *th = magazines_acquire();
+        if (th != NULL) {
+            p = magazine_alloc(th, bucket);
+            magazines_release(th);
+        }
+    }
+    if (p == NULL)
+        p = common_global_heap_alloc(&heapmgt->global_units, size HEAPACCT(which));
     ASSERT(p != NULL);
     LOG(GLOBAL, LOG_HEAP, 6, "\nglobal alloc: "PFX" (%d bytes)\n", p, size);
     return p;
@@ -2685,7 +3046,13 @@ global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
 void
 global_heap_free(void *p, size_t size HEAPACCT(which_heap_t which))
 {
-    common_global_heap_free(&heapmgt->global_units, p, size HEAPACCT(which));
+    uint bucket = heap_fixed_bucket(size);
+    thread_heap_t *th;
+    if (bucket < BLOCK_TYPES-1 && p != NULL && (th = magazines_acquire()) != NULL) {
+        magazine_free(th, bucket, p);
+        magazines_release(th);
+    } else
+        common_global_heap_free(&heapmgt->global_units, p, size HEAPACCT(which));
     LOG(GLOBAL, LOG_HEAP, 6, "\nglobal free: "PFX" (%d bytes)\n", p, size);
 }
 
@@ -2775,6 +3142,12 @@ heap_create_unit(thread_units_t *tu, size_t size, bool must_be_new)
         STATS_ADD_PEAK(heap_reserved_only, (u->reserved_end_pc - u->end_pc));
     }
     RSTATS_ADD_PEAK(heap_num_live, 1);
+#ifdef LINUX
+    /* Units come off a process-wide dead list, so bind on every hand-out */
+    if (DYNAMO_OPTION(numa_local_private) && tu->dcontext != GLOBAL_DCONTEXT &&
+        os_heap_bind_local_node(u, UNIT_RESERVED_SIZE(u)))
+        STATS_INC(numa_local_units);
+#endif
 
     u->cur_pc = u->start_pc;
     u->next_local = NULL;
@@ -2883,6 +3256,24 @@ heap_free_unit(heap_unit_t *unit, dcontext_t *dcontext)
             prev_u->next_global = unit;
         }
         heapmgt->heap.num_dead++;
+#ifdef LINUX
+        if (DYNAMO_OPTION(free_unit_trim_threshold) > 0) {
+            /* Past the watermark we keep the reservation and commit but give the
+             * pages back; reuse simply faults them in again.  This must be done
+             * under the lock, as once released the unit can be handed out.
+             */
+            size_t dead_committed = 0;
+            for (u = heapmgt->heap.dead; u != NULL; u = u->next_global)
+                dead_committed += UNIT_COMMIT_SIZE(u);
+            if (dead_committed > DYNAMO_OPTION(free_unit_trim_threshold)) {
+                /* the unit header lives at the top of the unit so we keep that page */
+                byte *trim_start = (byte *) ALIGN_FORWARD(unit->start_pc, PAGE_SIZE);
+                if (trim_start < unit->end_pc &&
+                    os_heap_discard_pages(trim_start, unit->end_pc - trim_start))
+                    STATS_ADD(heap_trimmed_bytes, unit->end_pc - trim_start);
+            }
+        }
+#endif
         release_recursive_lock(&heap_unit_lock);
         RSTATS_ADD_PEAK(heap_num_free, 1);
     } else {
@@ -3143,9 +3534,13 @@ heap_thread_init(dcontext_t *dcontext)
 {
     thread_heap_t *th = (thread_heap_t *)
         global_heap_alloc(sizeof(thread_heap_t) HEAPACCT(ACCT_MEM_MGT));
+    /* the magazines must be empty before global_heap_alloc() can find th */
+    memset(th->magazines, 0, sizeof(th->magazines));
+    th->magazines_busy = false;
     dcontext->heap_field = (void *) th;
     th->local_heap = (thread_units_t *) global_heap_alloc(sizeof(thread_units_t)
                                                        HEAPACCT(ACCT_MEM_MGT));
+    memset(&th->arena, 0, sizeof(th->arena));
     threadunits_init(dcontext, th->local_heap, HEAP_UNIT_MIN_SIZE);
     if (DYNAMO_OPTION(enable_reset)) {
         th->nonpersistent_heap = (thread_units_t *)
@@ -3174,6 +3569,23 @@ void
 heap_thread_exit(dcontext_t *dcontext)
 {
     thread_heap_t *th = (thread_heap_t *) dcontext->heap_field;
+    arena_chunk_t *chunk, *next_chunk;
+    uint bucket;
+    /* Hand the cached blocks back; from here on global frees take the locked
+     * path.
+     */
+    th->magazines_busy = true;
+    for (bucket = 0; bucket < BLOCK_TYPES-1; bucket++) {
+        if (th->magazines[bucket].count > 0) {
+            magazine_return(&th->magazines[bucket], bucket,
+                            th->magazines[bucket].count);
+        }
+    }
+    /* the arena's chunks come from local_heap */
+    for (chunk = th->arena.chunks; chunk != NULL; chunk = next_chunk) {
+        next_chunk = chunk->next;
+        heap_free(dcontext, chunk, ARENA_CHUNK_SIZE HEAPACCT(ACCT_IR));
+    }
     threadunits_exit(th->local_heap, dcontext);
     heap_thread_reset_free(dcontext);
     global_heap_free(th->local_heap, sizeof(thread_units_t) HEAPACCT(ACCT_MEM_MGT));
@@ -3182,6 +3594,7 @@ heap_thread_exit(dcontext_t *dcontext)
         global_heap_free(th->nonpersistent_heap, sizeof(thread_units_t)
                          HEAPACCT(ACCT_MEM_MGT));
     }
+    dcontext->heap_field = NULL;
     global_heap_free(th, sizeof(thread_heap_t) HEAPACCT(ACCT_MEM_MGT));
 }
 
@@ -3757,6 +4170,102 @@ heap_free(dcontext_t *dcontext, void *p, size_t size HEAPACCT(which_heap_t which
     ASSERT(ok);
 }
 
+void
+heap_arena_begin(dcontext_t *dcontext)
+{
+    heap_arena_t *arena = &((thread_heap_t *) dcontext->heap_field)->arena;
+    ASSERT(dcontext != GLOBAL_DCONTEXT);
+    arena->depth++;
+}
+
+void
+heap_arena_end(dcontext_t *dcontext)
+{
+    heap_arena_t *arena = &((thread_heap_t *) dcontext->heap_field)->arena;
+    arena_chunk_t *chunk, *next_chunk;
+    ASSERT(dcontext != GLOBAL_DCONTEXT);
+    ASSERT(arena->depth > 0);
+    arena->depth--;
+    if (arena->depth > 0 || arena->chunks == NULL)
+        return;
+    /* Release everything, keeping one chunk for the next scope */
+    for (chunk = arena->chunks->next; chunk != NULL; chunk = next_chunk) {
+        next_chunk = chunk->next;
+        heap_free(dcontext, chunk, ARENA_CHUNK_SIZE HEAPACCT(ACCT_IR));
+    }
+    chunk = arena->chunks;
+    chunk->next = NULL;
+    DOCHECK(CHKLVL_MEMFILL, {
+        memset(ARENA_CHUNK_START(chunk), HEAP_UNALLOCATED_BYTE,
+               arena->cur - ARENA_CHUNK_START(chunk));
+    });
+    arena->cur = ARENA_CHUNK_START(chunk);
+}
+
+void
+heap_arena_suspend(dcontext_t *dcontext)
+{
+    ((thread_heap_t *) dcontext->heap_field)->arena.suspended++;
+}
+
+void
+heap_arena_resume(dcontext_t *dcontext)
+{
+    heap_arena_t *arena = &((thread_heap_t *) dcontext->heap_field)->arena;
+    ASSERT(arena->suspended > 0);
+    arena->suspended--;
+}
+
+static bool
+heap_arena_contains(heap_arena_t *arena, heap_pc p)
+{
+    arena_chunk_t *chunk;
+    for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+        if (p >= ARENA_CHUNK_START(chunk) && p < chunk->end)
+            return true;
+    }
+    return false;
+}
+
+void *
+heap_arena_alloc(dcontext_t *dcontext, size_t size HEAPACCT(which_heap_t which))
+{
+    heap_arena_t *arena;
+    size_t aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);
+    heap_pc p;
+    if (dcontext == GLOBAL_DCONTEXT)
+        return global_heap_alloc(size HEAPACCT(which));
+    arena = &((thread_heap_t *) dcontext->heap_field)->arena;
+    if (arena->depth == 0 || arena->suspended > 0 || aligned_size > ARENA_MAX_ALLOC)
+        return heap_alloc(dcontext, size HEAPACCT(which));
+    if (arena->chunks == NULL || arena->cur + aligned_size > arena->chunks->end) {
+        arena_chunk_t *chunk = (arena_chunk_t *)
+            heap_alloc(dcontext, ARENA_CHUNK_SIZE HEAPACCT(ACCT_IR));
+        chunk->end = (heap_pc)chunk + ARENA_CHUNK_SIZE;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->cur = ARENA_CHUNK_START(chunk);
+        STATS_INC(heap_arena_chunks);
+    }
+    p = arena->cur;
+    arena->cur += aligned_size;
+    return (void *) p;
+}
+
+void
+heap_arena_free(dcontext_t *dcontext, void *p, size_t size HEAPACCT(which_heap_t which))
+{
+    if (dcontext != GLOBAL_DCONTEXT) {
+        heap_arena_t *arena = &((thread_heap_t *) dcontext->heap_field)->arena;
+        if (heap_arena_contains(arena, (heap_pc) p)) {
+            /* released all at once by heap_arena_end() */
+            ASSERT(arena->depth > 0);
+            return;
+        }
+    }
+    heap_free(dcontext, p, size HEAPACCT(which));
+}
+
 bool local_heap_protected(dcontext_t *dcontext)
 {
     thread_heap_t *th = (thread_heap_t *) dcontext->heap_field;
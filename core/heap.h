@@ -192,6 +192,22 @@ bool is_stack_overflow(dcontext_t *dcontext, byte *sp);
 void *heap_alloc(dcontext_t *dcontext, size_t size HEAPACCT(which_heap_t which));
 void heap_free(dcontext_t *dcontext, void *p, size_t size HEAPACCT(which_heap_t which));
 
+/* Thread-local arena for short-lived allocations, used for the IR of a bb
+ * being built under -bb_ir_arena.  Between heap_arena_begin() and the
+ * matching heap_arena_end() heap_arena_alloc() carves from the arena and
+ * heap_arena_free() of arena memory does nothing; the outermost
+ * heap_arena_end() releases it all at once.  Outside a scope, or while
+ * suspended, these behave like heap_alloc() and heap_free(), which they also
+ * fall back to for memory not from the arena.
+ */
+void heap_arena_begin(dcontext_t *dcontext);
+void heap_arena_end(dcontext_t *dcontext);
+void heap_arena_suspend(dcontext_t *dcontext);
+void heap_arena_resume(dcontext_t *dcontext);
+void *heap_arena_alloc(dcontext_t *dcontext, size_t size HEAPACCT(which_heap_t which));
+void heap_arena_free(dcontext_t *dcontext, void *p, size_t size
+                     HEAPACCT(which_heap_t which));
+
 #ifdef HEAP_ACCOUNTING
 void print_heap_statistics(void);
 #endif
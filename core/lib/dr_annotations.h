@@ -34,6 +34,7 @@
 #define _DYNAMORIO_ANNOTATIONS_H_ 1
 
 #include "dr_annotations_asm.h"
+#include <stddef.h>
 
 /* To simplify project configuration, this pragma excludes the file from GCC warnings. */
 #ifdef __GNUC__
@@ -46,6 +47,19 @@
 #define DYNAMORIO_ANNOTATE_LOG(format, ...) \
     DR_ANNOTATION(dynamorio_annotate_log, format, ##__VA_ARGS__)
 
+/* For JIT compilers: DR leaves code in a managed area writable and does not
+ * watch it for modification, so the JIT must announce every change to code
+ * that may have executed with DYNAMORIO_ANNOTATE_FLUSH_FRAGMENTS().
+ */
+#define DYNAMORIO_ANNOTATE_MANAGE_CODE_AREA(start, size) \
+    DR_ANNOTATION(dynamorio_annotate_manage_code_area, start, size)
+
+#define DYNAMORIO_ANNOTATE_UNMANAGE_CODE_AREA(start, size) \
+    DR_ANNOTATION(dynamorio_annotate_unmanage_code_area, start, size)
+
+#define DYNAMORIO_ANNOTATE_FLUSH_FRAGMENTS(start, size) \
+    DR_ANNOTATION(dynamorio_annotate_flush_fragments, start, size)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -54,6 +68,15 @@ DR_DECLARE_ANNOTATION(char, dynamorio_annotate_running_on_dynamorio, (void));
 
 DR_DECLARE_ANNOTATION(unsigned int, dynamorio_annotate_log, (const char *format, ...));
 
+DR_DECLARE_ANNOTATION(void, dynamorio_annotate_manage_code_area,
+                      (void *start, size_t size));
+
+DR_DECLARE_ANNOTATION(void, dynamorio_annotate_unmanage_code_area,
+                      (void *start, size_t size));
+
+DR_DECLARE_ANNOTATION(void, dynamorio_annotate_flush_fragments,
+                      (void *start, size_t size));
+
 #ifdef __cplusplus
 }
 #endif
@@ -83,6 +83,21 @@ DR_APP_API int dr_app_cleanup(void);
  */
 DR_APP_API void dr_app_start(void);
 
+/**
+ * Causes only the application's current thread to run under DR control upon
+ * return from this call.  Unlike dr_app_start(), no attempt is made to take
+ * over other threads, making this cheap enough to bracket individual requests
+ * or other short regions of interest.  The code cache and all of DR's tables
+ * persist across dr_app_stop() and this call, so code that ran under DR
+ * before is not rebuilt.
+ *
+ * The current thread must already be known to DR: i.e., it must have run
+ * under DR's control before (typically through dr_app_start()) and since
+ * returned to native execution via dr_app_stop().  Use dr_app_start() for a
+ * thread that DR has not yet seen.
+ */
+DR_APP_API void dr_app_start_thread(void);
+
 /**
  * Causes the application's current thread to run directly on the machine upon
  * return from this call; no effect if application is not currently running
@@ -140,6 +140,36 @@ int
 dr_inject_prepare_to_exec(const char *app_name, const char **app_cmdline,
                           void **data);
 
+DR_EXPORT
+/**
+ * Prepares to inject into the already running process \p pid, which need not
+ * be a child of the caller.  Injection uses ptrace as with
+ * dr_inject_prepare_to_ptrace(), so the same restrictions on which processes
+ * can be ptraced apply.  The process must be configured under \p pid (see
+ * dr_register_process()) before dr_inject_process_inject() is called, and
+ * resumes under DynamoRIO once dr_inject_process_run() is called.
+ * dr_inject_wait_for_child() polls for such a process to exit, as it cannot
+ * wait on it, and cannot obtain its exit code.
+ *
+ * A thread interrupted in a system call by the attach re-issues the system
+ * call under DynamoRIO.
+ *
+ * \note Only available on Linux.
+ *
+ * \warning ptrace injection is still experimental and subject to change.
+ *
+ * \param[in]   pid            The process to inject into.
+ *
+ * \param[out]  data           An opaque pointer that should be passed to
+ *                             subsequent dr_inject_* routines to refer to
+ *                             this process.
+ * \return  Returns 0 on success, after which the caller must call
+ *          dr_inject_process_exit() when finished.  On failure, returns a
+ *          system error code.
+ */
+int
+dr_inject_process_attach(process_id_t pid, void **data);
+
 DR_EXPORT
 /**
  * Use the ptrace system call to inject into the targetted process.  Must be
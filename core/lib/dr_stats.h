@@ -47,6 +47,11 @@
 #elif defined(UNIX)
 # define DYNAMORIO_MAGIC_STRING "DYNAMORIO_MAGIC_STRING"
 # define DYNAMORIO_MAGIC_STRING_LEN 16 /*include trailing \0*/
+  /* With -stats_shmem, dr_statistics_t is exported in this file, which
+   * external viewers can map read-only.
+   */
+# define STATS_SHMEM_DIR "/dev/shm"
+# define STATS_SHMEM_PREFIX "DynamoRIO-stats."
 #endif
 
 #define STAT_NAME_MAX_LEN 50
@@ -262,6 +262,30 @@ typedef struct _client_lib_t {
  * readers of the client_libs array (event handlers, etc.) use synch
  */
 static client_lib_t client_libs[MAX_CLIENT_LIBS] = {{0,}};
+
+/* Size of each thread's -ibl_profile table and how far we probe before dropping */
+#define IBL_PROFILE_TABLE_BITS 10
+#define IBL_PROFILE_TABLE_SIZE (1U << IBL_PROFILE_TABLE_BITS)
+#define IBL_PROFILE_MAX_PROBE 8
+/* Likewise for each thread's -exit_profile table */
+#define EXIT_PROFILE_TABLE_BITS 9
+#define EXIT_PROFILE_TABLE_SIZE (1U << EXIT_PROFILE_TABLE_BITS)
+#define EXIT_PROFILE_MAX_PROBE 8
+
+/* -fragment_counts: 64-bit execution counters keyed by tag.  The code cache
+ * embeds each counter's address, so counters are carved out of chunks that
+ * never move and are only freed at exit.  Counters outlive the fragments for
+ * their tag.  The chunk list is protected by the table's write lock.
+ */
+#define FRAGMENT_COUNTS_TABLE_BITS 10
+#define FRAGMENT_COUNTS_CHUNK_SIZE 4096
+typedef struct _fragment_counts_chunk_t {
+    struct _fragment_counts_chunk_t *next;
+    uint used;
+    uint64 counts[FRAGMENT_COUNTS_CHUNK_SIZE];
+} fragment_counts_chunk_t;
+static generic_table_t *fragment_counts;
+static fragment_counts_chunk_t *fragment_counts_chunks;
 static size_t num_client_libs = 0;
 
 static void *persist_user_data[MAX_CLIENT_LIBS];
@@ -279,6 +303,8 @@ static ssize_t dr_write_to_console_varg(bool to_stdout, const char *fmt, ...);
 
 bool client_requested_exit;
 
+static void module_view_cache_flush(dcontext_t *dcontext);
+
 #ifdef WINDOWS
 /* used for nudge support */
 static bool block_client_nudge_threads = false;
@@ -296,6 +322,22 @@ DECLARE_CXTSWPROT_VAR(static mutex_t client_thread_count_lock,
 
 static vm_area_vector_t *client_aux_libs;
 
+/* Client files opened with DR_FILE_BUFFERED.  There are rarely more than a
+ * handful, so a list suffices.  A single buffer per file, rather than one per
+ * thread, keeps the file's contents in the order the writes were made.
+ */
+#define CLIENT_FILE_BUF_SIZE (16*1024)
+typedef struct _client_file_buf_t {
+    file_t f;
+    char *buf;
+    size_t len;
+    struct _client_file_buf_t *next;
+} client_file_buf_t;
+static client_file_buf_t *client_file_bufs;
+/* protects client_file_bufs and the buffers themselves */
+DECLARE_CXTSWPROT_VAR(static mutex_t client_file_buf_lock,
+                      INIT_LOCK_FREE(client_file_buf_lock));
+
 #ifdef WINDOWS
 DECLARE_CXTSWPROT_VAR(static mutex_t client_aux_lib64_lock,
                       INIT_LOCK_FREE(client_aux_lib64_lock));
@@ -618,6 +660,13 @@ instrument_init(void)
 
     init_client_aux_libs();
 
+    if (DYNAMO_OPTION(fragment_counts)) {
+        fragment_counts =
+            generic_hash_create(GLOBAL_DCONTEXT, FRAGMENT_COUNTS_TABLE_BITS,
+                                80 /* load factor */, HASHTABLE_SHARED,
+                                NULL _IF_DEBUG("fragment exec counts"));
+    }
+
     if (num_client_libs > 0) {
         /* We no longer distinguish in-DR vs in-client crashes, as many crashes in
          * the DR lib are really client bugs.
@@ -779,6 +828,30 @@ instrument_exit(void)
     free_all_callback_lists();
 #endif
 
+    /* Write out files the client did not close */
+    instrument_flush_buffered_files(false/*!crashing*/);
+#ifdef DEBUG
+    while (client_file_bufs != NULL) {
+        client_file_buf_t *fb = client_file_bufs;
+        client_file_bufs = fb->next;
+        HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, fb->buf, char, CLIENT_FILE_BUF_SIZE,
+                        ACCT_CLIENT, UNPROTECTED);
+        HEAP_TYPE_FREE(GLOBAL_DCONTEXT, fb, client_file_buf_t, ACCT_CLIENT, UNPROTECTED);
+    }
+#endif
+    DELETE_LOCK(client_file_buf_lock);
+
+    if (fragment_counts != NULL) {
+        generic_hash_destroy(GLOBAL_DCONTEXT, fragment_counts);
+        fragment_counts = NULL;
+        while (fragment_counts_chunks != NULL) {
+            fragment_counts_chunk_t *chunk = fragment_counts_chunks;
+            fragment_counts_chunks = chunk->next;
+            HEAP_TYPE_FREE(GLOBAL_DCONTEXT, chunk, fragment_counts_chunk_t,
+                           ACCT_CLIENT, UNPROTECTED);
+        }
+    }
+
     vmvector_delete_vector(GLOBAL_DCONTEXT, client_aux_libs);
     client_aux_libs = NULL;
 #ifdef WINDOWS
@@ -1283,6 +1356,12 @@ instrument_thread_init(dcontext_t *dcontext, bool client_thread, bool valid_mc)
 void
 instrument_fork_init(dcontext_t *dcontext)
 {
+    client_file_buf_t *fb;
+    /* The parent still holds the same unwritten data and will write it */
+    mutex_lock(&client_file_buf_lock);
+    for (fb = client_file_bufs; fb != NULL; fb = fb->next)
+        fb->len = 0;
+    mutex_unlock(&client_file_buf_lock);
     call_all(fork_init_callbacks, int (*)(void *), (void *)dcontext);
 }
 #endif
@@ -1325,6 +1404,9 @@ instrument_thread_exit(dcontext_t *dcontext)
     client_flush_req_t *flush;
 #endif
 
+    /* The cached views are shared, so release them even in release build */
+    module_view_cache_flush(dcontext);
+
 #ifdef DEBUG
     /* PR 470957: avoid racy crashes by not freeing in release build */
 
@@ -1351,6 +1433,17 @@ instrument_thread_exit(dcontext_t *dcontext)
         flush = next_flush;
     }
 
+    if (dcontext->client_data->ibl_profile != NULL) {
+        HEAP_ARRAY_FREE(dcontext, dcontext->client_data->ibl_profile,
+                        dr_ibl_profile_entry_t, IBL_PROFILE_TABLE_SIZE,
+                        ACCT_CLIENT, UNPROTECTED);
+    }
+    if (dcontext->client_data->exit_profile != NULL) {
+        HEAP_ARRAY_FREE(dcontext, dcontext->client_data->exit_profile,
+                        dr_exit_profile_entry_t, EXIT_PROFILE_TABLE_SIZE,
+                        ACCT_CLIENT, UNPROTECTED);
+    }
+
     HEAP_TYPE_FREE(dcontext, dcontext->client_data, client_data_t,
                    ACCT_OTHER, UNPROTECTED);
     dcontext->client_data = NULL; /* for mutex_wait_contended_lock() */
@@ -1358,6 +1451,108 @@ instrument_thread_exit(dcontext_t *dcontext)
 #endif /* DEBUG */
 }
 
+/* -ibl_profile: a per-thread open-addressed table of (site, target) pairs
+ * filled in from dispatch when an indirect branch misses the inlined lookup.
+ */
+void
+instrument_ibl_profile_record(dcontext_t *dcontext, app_pc site, app_pc target,
+                              ibl_branch_type_t branch_type)
+{
+    dr_ibl_profile_entry_t *table = dcontext->client_data->ibl_profile;
+    uint idx, probe;
+    if (table == NULL) {
+        table = HEAP_ARRAY_ALLOC(dcontext, dr_ibl_profile_entry_t,
+                                 IBL_PROFILE_TABLE_SIZE, ACCT_CLIENT, UNPROTECTED);
+        memset(table, 0, IBL_PROFILE_TABLE_SIZE * sizeof(*table));
+        dcontext->client_data->ibl_profile = table;
+    }
+    idx = ((uint)(ptr_uint_t)site ^ ((uint)(ptr_uint_t)target >> 2)) * 0x9e3779b1U;
+    idx >>= (32 - IBL_PROFILE_TABLE_BITS);
+    for (probe = 0; probe < IBL_PROFILE_MAX_PROBE; probe++) {
+        dr_ibl_profile_entry_t *e = &table[(idx + probe) & (IBL_PROFILE_TABLE_SIZE - 1)];
+        if (e->count == 0) {
+            e->site = site;
+            e->target = target;
+            e->type = (dr_ibl_branch_type_t) branch_type;
+        } else if (e->site != site || e->target != target)
+            continue;
+        if (e->count < UINT_MAX)
+            e->count++;
+        return;
+    }
+    STATS_INC(ibl_profile_dropped);
+}
+
+/* Returns the -fragment_counts counter for tag, creating it if create is true.
+ * Returns NULL if there is none.
+ */
+uint64 *
+instrument_fragment_exec_counter(app_pc tag, bool create)
+{
+    uint64 *counter;
+    if (fragment_counts == NULL)
+        return NULL;
+    TABLE_RWLOCK(fragment_counts, read, lock);
+    counter = (uint64 *)
+        generic_hash_lookup(GLOBAL_DCONTEXT, fragment_counts, (ptr_uint_t)tag);
+    TABLE_RWLOCK(fragment_counts, read, unlock);
+    if (counter != NULL || !create)
+        return counter;
+    TABLE_RWLOCK(fragment_counts, write, lock);
+    /* Another thread may have raced us here */
+    counter = (uint64 *)
+        generic_hash_lookup(GLOBAL_DCONTEXT, fragment_counts, (ptr_uint_t)tag);
+    if (counter == NULL) {
+        fragment_counts_chunk_t *chunk = fragment_counts_chunks;
+        if (chunk == NULL || chunk->used == FRAGMENT_COUNTS_CHUNK_SIZE) {
+            chunk = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, fragment_counts_chunk_t,
+                                    ACCT_CLIENT, UNPROTECTED);
+            chunk->used = 0;
+            chunk->next = fragment_counts_chunks;
+            fragment_counts_chunks = chunk;
+        }
+        counter = &chunk->counts[chunk->used++];
+        *counter = 0;
+        generic_hash_add(GLOBAL_DCONTEXT, fragment_counts, (ptr_uint_t)tag, counter);
+    }
+    TABLE_RWLOCK(fragment_counts, write, unlock);
+    return counter;
+}
+
+/* -exit_profile: a per-thread open-addressed table of (source tag, exit reason)
+ * pairs with the count and the cycles spent in DR after each, filled in from
+ * dispatch when we go back to the cache.
+ */
+void
+instrument_exit_profile_record(dcontext_t *dcontext, app_pc tag,
+                               exit_profile_reason_t reason, uint64 cycles)
+{
+    dr_exit_profile_entry_t *table = dcontext->client_data->exit_profile;
+    uint idx, probe;
+    if (table == NULL) {
+        table = HEAP_ARRAY_ALLOC(dcontext, dr_exit_profile_entry_t,
+                                 EXIT_PROFILE_TABLE_SIZE, ACCT_CLIENT, UNPROTECTED);
+        memset(table, 0, EXIT_PROFILE_TABLE_SIZE * sizeof(*table));
+        dcontext->client_data->exit_profile = table;
+    }
+    idx = ((uint)(ptr_uint_t)tag + (uint)reason) * 0x9e3779b1U;
+    idx >>= (32 - EXIT_PROFILE_TABLE_BITS);
+    for (probe = 0; probe < EXIT_PROFILE_MAX_PROBE; probe++) {
+        dr_exit_profile_entry_t *e =
+            &table[(idx + probe) & (EXIT_PROFILE_TABLE_SIZE - 1)];
+        if (e->count == 0) {
+            e->tag = tag;
+            e->reason = (dr_exit_reason_t) reason;
+        } else if (e->tag != tag || e->reason != (dr_exit_reason_t) reason)
+            continue;
+        if (e->count < UINT_MAX)
+            e->count++;
+        e->cycles += cycles;
+        return;
+    }
+    STATS_INC(exit_profile_dropped);
+}
+
 bool
 dr_bb_hook_exists(void)
 {
@@ -1845,6 +2040,18 @@ dr_copy_module_data(const module_data_t *data)
                                              );
 }
 
+static void
+module_data_free_fields(module_data_t *data)
+{
+#ifdef UNIX
+    HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, data->segments, module_segment_data_t,
+                    data->num_segments, ACCT_VMAREAS, PROTECTED);
+#endif
+    if (data->full_path != NULL)
+        dr_strfree(data->full_path HEAPACCT(ACCT_CLIENT));
+    free_module_names(&data->names HEAPACCT(ACCT_CLIENT));
+}
+
 DR_API
 /* Used to free a module_data_t created by dr_copy_module_data() */
 void
@@ -1861,17 +2068,139 @@ dr_free_module_data(module_data_t *data)
         return;
     }
 
-#ifdef UNIX
-    HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, data->segments, module_segment_data_t,
-                    data->num_segments, ACCT_VMAREAS, PROTECTED);
-#endif
-    if (data->full_path != NULL)
-        dr_strfree(data->full_path HEAPACCT(ACCT_CLIENT));
-    free_module_names(&data->names HEAPACCT(ACCT_CLIENT));
-
+    module_data_free_fields(data);
     HEAP_TYPE_FREE(GLOBAL_DCONTEXT, data, module_data_t, ACCT_CLIENT, UNPROTECTED);
 }
 
+/* A read-only module_data_t shared between the module_area_t and any number
+ * of dr_lookup_module_ex() callers and per-thread caches, each of which holds
+ * a reference.  The module's own reference is dropped when it is unloaded.
+ */
+typedef struct _module_view_t {
+    module_data_t data; /* must be first */
+    volatile int refcount;
+} module_view_t;
+
+static module_view_t *
+module_view_create(const module_area_t *area)
+{
+    module_data_t *copy = copy_module_area_to_module_data(area);
+    module_view_t *view;
+    if (copy == NULL)
+        return NULL;
+    view = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, module_view_t, ACCT_CLIENT, UNPROTECTED);
+    view->data = *copy;
+    view->refcount = 1;
+    /* The fields now belong to the view */
+    HEAP_TYPE_FREE(GLOBAL_DCONTEXT, copy, module_data_t, ACCT_CLIENT, UNPROTECTED);
+    return view;
+}
+
+static void
+module_view_release(module_view_t *view)
+{
+    if (atomic_add_exchange_int(&view->refcount, -1) == 0) {
+        module_data_free_fields(&view->data);
+        HEAP_TYPE_FREE(GLOBAL_DCONTEXT, view, module_view_t, ACCT_CLIENT, UNPROTECTED);
+    }
+}
+
+/* Called with the module list write lock held as area is removed */
+void
+instrument_module_area_delete(module_area_t *area)
+{
+    if (area->client_view != NULL) {
+        module_view_release(area->client_view);
+        area->client_view = NULL;
+    }
+}
+
+static void
+module_view_cache_flush(dcontext_t *dcontext)
+{
+    client_data_t *cd = dcontext->client_data;
+    uint i;
+    for (i = 0; i < MODULE_VIEW_CACHE_SIZE; i++) {
+        if (cd->module_cache[i].view != NULL) {
+            module_view_release(cd->module_cache[i].view);
+            cd->module_cache[i].view = NULL;
+        }
+        cd->module_cache[i].start = NULL;
+        cd->module_cache[i].end = NULL;
+    }
+}
+
+DR_API
+const module_data_t *
+dr_lookup_module_ex(byte *pc)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    client_data_t *cd;
+    module_area_t *area;
+    module_view_t *view = NULL;
+    app_pc seg_start, seg_end;
+    uint i, slot;
+    CLIENT_ASSERT(dcontext != NULL, "dr_lookup_module_ex: requires a DR thread");
+    if (dcontext == NULL)
+        return NULL;
+    cd = dcontext->client_data;
+    /* Any load or unload may have changed which module a cached range maps to */
+    if (cd->module_cache_generation != module_list_generation) {
+        module_view_cache_flush(dcontext);
+        cd->module_cache_generation = module_list_generation;
+    }
+    for (i = 0; i < MODULE_VIEW_CACHE_SIZE; i++) {
+        if (pc >= cd->module_cache[i].start && pc < cd->module_cache[i].end) {
+            view = cd->module_cache[i].view;
+            ATOMIC_INC(int, view->refcount);
+            return &view->data;
+        }
+    }
+
+    os_get_module_info_lock();
+    area = module_pc_lookup_segment(pc, &seg_start, &seg_end);
+    if (area != NULL) {
+        view = area->client_view;
+        if (view == NULL) {
+            module_view_t *created = module_view_create(area);
+            /* Other threads may be racing us under the read lock */
+            if (created != NULL &&
+                !atomic_compare_exchange_ptr((ptr_uint_t *)&area->client_view,
+                                             (ptr_uint_t)NULL, (ptr_uint_t)created))
+                module_view_release(created);
+            view = area->client_view;
+        }
+    }
+    if (view != NULL) {
+        /* One reference for the caller and one for the cache slot */
+        ATOMIC_ADD(int, view->refcount, 2);
+        /* Re-read the generation under the lock so that the new entry is not
+         * cached against a list that has already moved on.
+         */
+        if (cd->module_cache_generation == module_list_generation) {
+            slot = cd->module_cache_next;
+            cd->module_cache_next = (slot + 1) % MODULE_VIEW_CACHE_SIZE;
+            if (cd->module_cache[slot].view != NULL)
+                module_view_release(cd->module_cache[slot].view);
+            cd->module_cache[slot].start = seg_start;
+            cd->module_cache[slot].end = seg_end;
+            cd->module_cache[slot].view = view;
+        } else
+            module_view_release(view);
+    }
+    os_get_module_info_unlock();
+    return (view == NULL) ? NULL : &view->data;
+}
+
+DR_API
+void
+dr_release_module_data(const module_data_t *data)
+{
+    if (data == NULL)
+        return;
+    module_view_release((module_view_t *)data);
+}
+
 DR_API
 bool
 dr_module_contains_addr(const module_data_t *data, app_pc addr)
@@ -2646,6 +2975,42 @@ dr_get_milliseconds(void)
     return query_time_millis();
 }
 
+DR_API
+uint64
+dr_get_microseconds(void)
+{
+    return query_time_micros();
+}
+
+DR_API
+bool
+dr_perf_counter_request(dr_perf_counter_t counter)
+{
+#ifdef LINUX
+    return os_perf_counter_request((uint)counter);
+#else
+    return false;
+#endif
+}
+
+DR_API
+bool
+dr_perf_counter_read(void *drcontext, dr_perf_counter_t counter, OUT uint64 *value)
+{
+#ifdef LINUX
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    CLIENT_ASSERT(drcontext != NULL, "dr_perf_counter_read: drcontext cannot be NULL");
+    CLIENT_ASSERT(drcontext != GLOBAL_DCONTEXT,
+                  "dr_perf_counter_read: drcontext is invalid");
+    CLIENT_ASSERT(dcontext == get_thread_private_dcontext(),
+                  "dr_perf_counter_read: drcontext must be the current thread's");
+    CLIENT_ASSERT(value != NULL, "dr_perf_counter_read: value cannot be NULL");
+    return os_perf_counter_read(dcontext, (uint)counter, value);
+#else
+    return false;
+#endif
+}
+
 DR_API
 uint
 dr_get_random_value(uint max)
@@ -3878,6 +4243,103 @@ dr_file_exists(const char *fname)
     return os_file_exists(fname, false);
 }
 
+/* Caller must hold client_file_buf_lock */
+static client_file_buf_t *
+client_file_buf_lookup(file_t f)
+{
+    client_file_buf_t *fb;
+    ASSERT_OWN_MUTEX(true, &client_file_buf_lock);
+    for (fb = client_file_bufs; fb != NULL; fb = fb->next) {
+        if (fb->f == f)
+            return fb;
+    }
+    return NULL;
+}
+
+/* Caller must hold client_file_buf_lock.  Returns false on a write error. */
+static bool
+client_file_buf_flush(client_file_buf_t *fb)
+{
+    size_t done = 0;
+    ASSERT_OWN_MUTEX(true, &client_file_buf_lock);
+    while (done < fb->len) {
+        ssize_t res = os_write(fb->f, fb->buf + done, fb->len - done);
+        if (res <= 0)
+            break;
+        done += res;
+    }
+    if (done < fb->len) {
+        /* keep what did not make it for the next attempt */
+        memmove(fb->buf, fb->buf + done, fb->len - done);
+        fb->len -= done;
+        return false;
+    }
+    fb->len = 0;
+    return true;
+}
+
+static bool
+client_file_is_buffered(file_t f)
+{
+    bool res;
+    if (client_file_bufs == NULL)
+        return false;
+    mutex_lock(&client_file_buf_lock);
+    res = (client_file_buf_lookup(f) != NULL);
+    mutex_unlock(&client_file_buf_lock);
+    return res;
+}
+
+/* Writes to f's buffer if f is buffered, and returns false if it is not */
+static bool
+client_file_buf_write(file_t f, const void *buf, size_t count, ssize_t *written OUT)
+{
+    client_file_buf_t *fb;
+    if (client_file_bufs == NULL)
+        return false;
+    mutex_lock(&client_file_buf_lock);
+    fb = client_file_buf_lookup(f);
+    if (fb == NULL) {
+        mutex_unlock(&client_file_buf_lock);
+        return false;
+    }
+    if (fb->len + count > CLIENT_FILE_BUF_SIZE) {
+        if (!client_file_buf_flush(fb)) {
+            *written = -1;
+            mutex_unlock(&client_file_buf_lock);
+            return true;
+        }
+    }
+    if (count > CLIENT_FILE_BUF_SIZE)
+        *written = os_write(f, buf, count);
+    else {
+        memcpy(fb->buf + fb->len, buf, count);
+        fb->len += count;
+        *written = count;
+    }
+    mutex_unlock(&client_file_buf_lock);
+    return true;
+}
+
+/* Writes out the buffers of all DR_FILE_BUFFERED files.  If crashing, gives up
+ * rather than wait for the lock, which the crashing thread may hold.
+ */
+void
+instrument_flush_buffered_files(bool crashing)
+{
+    client_file_buf_t *fb;
+    if (client_file_bufs == NULL)
+        return;
+    if (crashing) {
+        if (!mutex_trylock(&client_file_buf_lock))
+            return;
+    } else
+        mutex_lock(&client_file_buf_lock);
+    for (fb = client_file_bufs; fb != NULL; fb = fb->next)
+        client_file_buf_flush(fb);
+    mutex_unlock(&client_file_buf_lock);
+}
+
 DR_API
 /* Opens a file in the mode specified by mode_flags.
  * Returns INVALID_FILE if unsuccessful
@@ -3885,6 +4347,7 @@ DR_API
 file_t
 dr_open_file(const char *fname, uint mode_flags)
 {
+    file_t f;
     uint flags = 0;
 
     if (TEST(DR_FILE_WRITE_REQUIRE_NEW, mode_flags)) {
@@ -3913,7 +4376,24 @@ dr_open_file(const char *fname, uint mode_flags)
         flags |= OS_OPEN_CLOSE_ON_FORK;
 
     /* all client-opened files are protected */
-    return os_open_protected(fname, flags);
+    f = os_open_protected(fname, flags);
+
+    if (f != INVALID_FILE && TEST(DR_FILE_BUFFERED, mode_flags)) {
+        client_file_buf_t *fb;
+        CLIENT_ASSERT(TESTANY(OS_OPEN_WRITE|OS_OPEN_WRITE_ONLY, flags),
+                      "dr_open_file: DR_FILE_BUFFERED requires a write mode");
+        fb = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, client_file_buf_t, ACCT_CLIENT,
+                             UNPROTECTED);
+        fb->f = f;
+        fb->buf = HEAP_ARRAY_ALLOC(GLOBAL_DCONTEXT, char, CLIENT_FILE_BUF_SIZE,
+                                   ACCT_CLIENT, UNPROTECTED);
+        fb->len = 0;
+        mutex_lock(&client_file_buf_lock);
+        fb->next = client_file_bufs;
+        client_file_bufs = fb;
+        mutex_unlock(&client_file_buf_lock);
+    }
+    return f;
 }
 
 DR_API
@@ -3922,6 +4402,25 @@ DR_API
 void
 dr_close_file(file_t f)
 {
+    if (client_file_bufs != NULL) {
+        client_file_buf_t *fb, *prev = NULL;
+        mutex_lock(&client_file_buf_lock);
+        for (fb = client_file_bufs; fb != NULL; prev = fb, fb = fb->next) {
+            if (fb->f == f) {
+                client_file_buf_flush(fb);
+                if (prev == NULL)
+                    client_file_bufs = fb->next;
+                else
+                    prev->next = fb->next;
+                HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, fb->buf, char, CLIENT_FILE_BUF_SIZE,
+                                ACCT_CLIENT, UNPROTECTED);
+                HEAP_TYPE_FREE(GLOBAL_DCONTEXT, fb, client_file_buf_t, ACCT_CLIENT,
+                               UNPROTECTED);
+                break;
+            }
+        }
+        mutex_unlock(&client_file_buf_lock);
+    }
     /* all client-opened files are protected */
     os_close_protected(f);
 }
@@ -3951,6 +4450,14 @@ DR_API
 void
 dr_flush_file(file_t f)
 {
+    if (client_file_bufs != NULL) {
+        client_file_buf_t *fb;
+        mutex_lock(&client_file_buf_lock);
+        fb = client_file_buf_lookup(f);
+        if (fb != NULL)
+            client_file_buf_flush(fb);
+        mutex_unlock(&client_file_buf_lock);
+    }
     os_flush(f);
 }
 
@@ -3961,6 +4468,9 @@ DR_API
 ssize_t
 dr_write_file(file_t f, const void *buf, size_t count)
 {
+    ssize_t written;
+    if (client_file_buf_write(f, buf, count, &written))
+        return written;
 #ifdef WINDOWS
     if ((f == STDOUT || f == STDERR) && print_to_console)
         return dr_write_to_console_varg(f == STDOUT, "%.*s", count, buf);
@@ -3976,6 +4486,8 @@ DR_API
 ssize_t
 dr_read_file(file_t f, void *buf, size_t count)
 {
+    if (client_file_is_buffered(f))
+        dr_flush_file(f);
     return os_read(f, buf, count);
 }
 
@@ -3987,6 +4499,8 @@ dr_file_seek(file_t f, int64 offset, int origin)
 {
     CLIENT_ASSERT(origin == DR_SEEK_SET || origin == DR_SEEK_CUR || origin == DR_SEEK_END,
                   "dr_file_seek: invalid origin value");
+    if (client_file_is_buffered(f))
+        dr_flush_file(f);
     return os_seek(f, offset, origin);
 }
 
@@ -3995,6 +4509,8 @@ DR_API
 int64
 dr_file_tell(file_t f)
 {
+    if (client_file_is_buffered(f))
+        dr_flush_file(f);
     return os_tell(f);
 }
 
@@ -4346,6 +4862,15 @@ dr_fprintf(file_t f, const char *fmt, ...)
             written = -1;
     } else
 #endif
+    if (client_file_is_buffered(f)) {
+        char msg[MAX_LOG_LENGTH];
+        int len = our_vsnprintf(msg, BUFFER_SIZE_ELEMENTS(msg), fmt, ap);
+        NULL_TERMINATE_BUFFER(msg);
+        if (len < 0 || len >= BUFFER_SIZE_ELEMENTS(msg))
+            len = (int) strlen(msg);
+        if (!client_file_buf_write(f, msg, len, &written))
+            written = os_write(f, msg, len);
+    } else
         written = do_file_write(f, fmt, ap);
     va_end(ap);
     return written;
@@ -5920,7 +6445,9 @@ dr_insert_cbr_instrumentation_help(void *drcontext, instrlist_t *ilist, instr_t
         } else {
             /* call to clean call context save */
             ASSERT(opnd_get_pc(instr_get_target(app_flags_ok)) ==
-                   get_clean_call_save(dcontext _IF_X64(GENCODE_X64)));
+                   get_clean_call_save(dcontext, true _IF_X64(GENCODE_X64)) ||
+                   opnd_get_pc(instr_get_target(app_flags_ok)) ==
+                   get_clean_call_save(dcontext, false _IF_X64(GENCODE_X64)));
             out_of_line_switch = true;
         }
         ASSERT(app_flags_ok != NULL);
@@ -6599,6 +7126,77 @@ dr_unlink_flush_region(app_pc start, size_t size)
     return true;
 }
 
+/* Shared by dr_flush_regions() and dr_unlink_flush_regions() */
+static bool
+flush_regions_common(const dr_flush_region_t *regions, uint num_regions,
+                     bool force_synchall)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    vm_area_vector_t toflush;
+    uint i;
+    CLIENT_ASSERT(!standalone_library, "API not supported in standalone mode");
+    ASSERT(dcontext != NULL);
+
+    /* Same requirements as dr_flush_region() and dr_unlink_flush_region() */
+    CLIENT_ASSERT(!is_couldbelinking(dcontext), "dr_flush_regions: called from an event "
+                  "callback that doesn't support calling this routine; see header file "
+                  "for restrictions.");
+    CLIENT_ASSERT(OWN_NO_LOCKS(dcontext), "dr_flush_regions: caller owns a client "
+                  "lock or was called from an event callback that doesn't support "
+                  "calling this routine; see header file for restrictions.");
+    CLIENT_ASSERT(regions != NULL || num_regions == 0,
+                  "dr_flush_regions: regions cannot be NULL");
+
+    /* release build check of requirements, as many as possible at least */
+    if (is_couldbelinking(dcontext) || (regions == NULL && num_regions > 0))
+        return false;
+    for (i = 0; i < num_regions; i++) {
+        CLIENT_ASSERT(regions[i].size != 0,
+                      "dr_flush_regions: 0 is invalid size for flush");
+        if (regions[i].size == 0)
+            return false;
+    }
+
+    /* A private vector sorts the regions and merges those that overlap or touch.
+     * It needs no lock.
+     */
+    vmvector_init_vector(&toflush, 0);
+    for (i = 0; i < num_regions; i++) {
+        LOG(THREAD, LOG_FRAGMENT, 2, "%s: "PFX"-"PFX"\n", __FUNCTION__,
+            regions[i].start, regions[i].start + regions[i].size);
+        vmvector_add(&toflush, regions[i].start, regions[i].start + regions[i].size,
+                     NULL);
+    }
+    flush_fragments_from_regions(dcontext, &toflush, force_synchall);
+    vmvector_reset_vector(GLOBAL_DCONTEXT, &toflush);
+    return true;
+}
+
+DR_API
+/* Flush all fragments that contain code from any of the regions, with a single
+ * synchall flush.  Same requirements as dr_flush_region().
+ */
+bool
+dr_flush_regions(const dr_flush_region_t *regions, uint num_regions)
+{
+    return flush_regions_common(regions, num_regions, true/*force synchall*/);
+}
+
+DR_API
+/* Flush all fragments that contain code from any of the regions, with a single
+ * unlink flush.  Same requirements as dr_unlink_flush_region().
+ */
+bool
+dr_unlink_flush_regions(const dr_flush_region_t *regions, uint num_regions)
+{
+    /* This routine won't work with coarse_units */
+    CLIENT_ASSERT(!DYNAMO_OPTION(coarse_units),
+                  /* as of now, coarse_units are always disabled with -thread_private. */
+                  "dr_unlink_flush_regions is not supported with -opt_memory unless "
+                  "-thread_private or -enable_full_api is also specified");
+    return flush_regions_common(regions, num_regions, false/*don't force synchall*/);
+}
+
 DR_API
 /* Flush all fragments that contain code from the region [start, start+size) at the next
  * convenient time.  Unlike dr_flush_region() this routine has no restrictions on lock
@@ -6710,6 +7308,141 @@ dr_fragment_size(void *drcontext, void *tag)
     return size;
 }
 
+DR_API
+uint64
+dr_fragment_exec_count(void *drcontext, void *tag)
+{
+    uint64 *counter;
+    CLIENT_ASSERT(drcontext != NULL, "dr_fragment_exec_count: drcontext cannot be NULL");
+    counter = instrument_fragment_exec_counter((app_pc)tag, false/*!create*/);
+    return counter == NULL ? 0 : *counter;
+}
+
+DR_API
+bool
+dr_fragment_exec_count_iterate(bool (*iter_cb)(app_pc tag, uint64 count,
+                                               void *user_data),
+                               void *user_data)
+{
+    ptr_uint_t key, *tags;
+    void *payload;
+    uint64 **counters;
+    uint i, num = 0, max;
+    int iter = 0;
+    CLIENT_ASSERT(iter_cb != NULL,
+                  "dr_fragment_exec_count_iterate: iter_cb cannot be NULL");
+    if (fragment_counts == NULL)
+        return false;
+    /* We snapshot the (tag, counter) pairs so that iter_cb runs with no lock held
+     * and can itself query counts or trigger new blocks.  The counters never move,
+     * so the counts read below are current.
+     */
+    TABLE_RWLOCK(fragment_counts, read, lock);
+    max = fragment_counts->entries;
+    if (max == 0) {
+        TABLE_RWLOCK(fragment_counts, read, unlock);
+        return true;
+    }
+    tags = HEAP_ARRAY_ALLOC(GLOBAL_DCONTEXT, ptr_uint_t, max, ACCT_CLIENT, UNPROTECTED);
+    counters = HEAP_ARRAY_ALLOC(GLOBAL_DCONTEXT, uint64 *, max, ACCT_CLIENT,
+                                UNPROTECTED);
+    while (num < max &&
+           (iter = generic_hash_iterate_next(GLOBAL_DCONTEXT, fragment_counts, iter,
+                                             &key, &payload)) >= 0) {
+        tags[num] = key;
+        counters[num] = (uint64 *) payload;
+        num++;
+    }
+    TABLE_RWLOCK(fragment_counts, read, unlock);
+    for (i = 0; i < num; i++) {
+        if (!(*iter_cb)((app_pc)tags[i], *counters[i], user_data))
+            break;
+    }
+    HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, tags, ptr_uint_t, max, ACCT_CLIENT, UNPROTECTED);
+    HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, counters, uint64 *, max, ACCT_CLIENT, UNPROTECTED);
+    return true;
+}
+
+DR_API
+bool
+dr_ibl_profile_iterate(void *drcontext,
+                       bool (*iter_cb)(dr_ibl_profile_entry_t *entry, void *user_data),
+                       void *user_data)
+{
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    dr_ibl_profile_entry_t *table;
+    uint i;
+    CLIENT_ASSERT(drcontext != NULL && drcontext != GLOBAL_DCONTEXT,
+                  "dr_ibl_profile_iterate: drcontext is invalid");
+    CLIENT_ASSERT(iter_cb != NULL, "dr_ibl_profile_iterate: iter_cb cannot be NULL");
+    if (!DYNAMO_OPTION(ibl_profile))
+        return false;
+    table = dcontext->client_data->ibl_profile;
+    if (table == NULL)
+        return true;
+    for (i = 0; i < IBL_PROFILE_TABLE_SIZE; i++) {
+        if (table[i].count > 0 && !(*iter_cb)(&table[i], user_data))
+            break;
+    }
+    return true;
+}
+
+DR_API
+bool
+dr_ibl_profile_reset(void *drcontext)
+{
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    CLIENT_ASSERT(drcontext != NULL && drcontext != GLOBAL_DCONTEXT,
+                  "dr_ibl_profile_reset: drcontext is invalid");
+    if (!DYNAMO_OPTION(ibl_profile))
+        return false;
+    if (dcontext->client_data->ibl_profile != NULL) {
+        memset(dcontext->client_data->ibl_profile, 0,
+               IBL_PROFILE_TABLE_SIZE * sizeof(dr_ibl_profile_entry_t));
+    }
+    return true;
+}
+
+DR_API
+bool
+dr_exit_profile_iterate(void *drcontext,
+                        bool (*iter_cb)(dr_exit_profile_entry_t *entry, void *user_data),
+                        void *user_data)
+{
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    dr_exit_profile_entry_t *table;
+    uint i;
+    CLIENT_ASSERT(drcontext != NULL && drcontext != GLOBAL_DCONTEXT,
+                  "dr_exit_profile_iterate: drcontext is invalid");
+    CLIENT_ASSERT(iter_cb != NULL, "dr_exit_profile_iterate: iter_cb cannot be NULL");
+    if (!DYNAMO_OPTION(exit_profile))
+        return false;
+    table = dcontext->client_data->exit_profile;
+    if (table == NULL)
+        return true;
+    for (i = 0; i < EXIT_PROFILE_TABLE_SIZE; i++) {
+        if (table[i].count > 0 && !(*iter_cb)(&table[i], user_data))
+            break;
+    }
+    return true;
+}
+
+DR_API
+bool
+dr_exit_profile_reset(void *drcontext)
+{
+    dcontext_t *dcontext = (dcontext_t *) drcontext;
+    CLIENT_ASSERT(drcontext != NULL && drcontext != GLOBAL_DCONTEXT,
+                  "dr_exit_profile_reset: drcontext is invalid");
+    if (!DYNAMO_OPTION(exit_profile))
+        return false;
+    if (dcontext->client_data->exit_profile != NULL) {
+        memset(dcontext->client_data->exit_profile, 0,
+               EXIT_PROFILE_TABLE_SIZE * sizeof(dr_exit_profile_entry_t));
+    }
+    return true;
+}
+
 DR_API
 /* Retrieves the application PC of a fragment */
 app_pc
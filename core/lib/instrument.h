@@ -1498,6 +1498,7 @@ dr_is_nudge_thread(void *drcontext);
 void instrument_load_client_libs(void);
 void instrument_init(void);
 void instrument_exit(void);
+void instrument_flush_buffered_files(bool crashing);
 bool is_in_client_lib(app_pc addr);
 bool get_client_bounds(client_id_t client_id,
                        app_pc *start/*OUT*/, app_pc *end/*OUT*/);
@@ -1507,6 +1508,11 @@ void instrument_client_thread_init(dcontext_t *dcontext, bool client_thread);
 void instrument_thread_init(dcontext_t *dcontext, bool client_thread, bool valid_mc);
 void instrument_thread_exit_event(dcontext_t *dcontext);
 void instrument_thread_exit(dcontext_t *dcontext);
+void instrument_ibl_profile_record(dcontext_t *dcontext, app_pc site, app_pc target,
+                                   ibl_branch_type_t branch_type);
+uint64 *instrument_fragment_exec_counter(app_pc tag, bool create);
+void instrument_exit_profile_record(dcontext_t *dcontext, app_pc tag,
+                                    exit_profile_reason_t reason, uint64 cycles);
 #ifdef UNIX
 void instrument_fork_init(dcontext_t *dcontext);
 #endif
@@ -1524,6 +1530,7 @@ bool instrument_restore_state(dcontext_t *dcontext, bool restore_memory,
                               dr_restore_state_info_t *info);
 
 module_data_t * copy_module_area_to_module_data(const module_area_t *area);
+void instrument_module_area_delete(module_area_t *area);
 void instrument_module_load_trigger(app_pc pc);
 void instrument_module_load(module_data_t *data, bool previously_loaded);
 void instrument_module_unload(module_data_t *data);
@@ -1878,6 +1885,58 @@ DR_API
 uint64
 dr_get_milliseconds(void);
 
+DR_API
+/**
+ * Returns the number of microseconds since Jan 1, 1601 (this is
+ * the current UTC time).
+ *
+ * \note This is the Windows standard.  UNIX time functions typically
+ * count from the Epoch (Jan 1, 1970).  The Epoch is 11644473600*1000*1000
+ * microseconds after Jan 1, 1601.
+ */
+uint64
+dr_get_microseconds(void);
+
+/* DR_API EXPORT BEGIN */
+/** Hardware performance counters for dr_perf_counter_request(). */
+typedef enum {
+    DR_PERF_COUNTER_CYCLES,        /**< CPU cycles. */
+    DR_PERF_COUNTER_INSTRUCTIONS,  /**< Retired instructions. */
+    DR_PERF_COUNTER_CACHE_MISSES,  /**< Last-level cache misses. */
+    DR_PERF_COUNTER_BRANCH_MISSES, /**< Mispredicted branches. */
+} dr_perf_counter_t;
+/* DR_API EXPORT END */
+
+DR_API
+/**
+ * Requests that the hardware performance counter \p counter be opened for
+ * every thread, counting user-mode events for that thread alone.  It is
+ * opened for the calling thread right away, for new threads when they are
+ * initialized, and for any other existing thread on its first
+ * dr_perf_counter_read().  Generally this would be called during client
+ * initialization.  Returns false if the counter could not be opened for the
+ * calling thread, for example because the kernel's perf_event_paranoid
+ * setting forbids it or the processor has no such counter.
+ *
+ * \note Currently only supported on Linux, where it uses perf_event_open.
+ */
+bool
+dr_perf_counter_request(dr_perf_counter_t counter);
+
+DR_API
+/**
+ * Reads the current value of the requested performance counter \p counter
+ * for the current thread, which \p drcontext must belong to.  Only
+ * differences between values are meaningful.  On x86, when the kernel
+ * permits it, this is a few loads and an rdpmc instruction with no system
+ * call, making it cheap enough to call from a clean call.
+ * Returns false if \p counter was not requested or could not be opened.
+ *
+ * \note Currently only supported on Linux.
+ */
+bool
+dr_perf_counter_read(void *drcontext, dr_perf_counter_t counter, OUT uint64 *value);
+
 DR_API
 /**
  * Returns a pseudo-random number in the range [0..max).
@@ -2878,6 +2937,27 @@ DR_API
 module_data_t *
 dr_lookup_module(byte *pc);
 
+DR_API
+/**
+ * Looks up the module containing \p pc, like dr_lookup_module(), but rather
+ * than a private copy returns a shared read-only view of the module's data,
+ * which must not be modified.  Each thread caches the few module segments it
+ * most recently looked up, so that a repeated lookup takes no lock and
+ * allocates no memory.  This makes it suitable for hot paths such as clean
+ * calls.  Returns NULL if \p pc is outside all known modules.
+ *
+ * \note The returned view remains valid, even if the module is unloaded, until
+ * it is released with dr_release_module_data().  It must not be passed to
+ * dr_free_module_data().
+ */
+const module_data_t *
+dr_lookup_module_ex(byte *pc);
+
+DR_API
+/** Releases a view returned by dr_lookup_module_ex(). */
+void
+dr_release_module_data(const module_data_t *data);
+
 DR_API
 /**
  * Looks up the module with name \p name ignoring case.  If an exact name match is found
@@ -3622,6 +3702,15 @@ dr_file_exists(const char *fname);
  * DR_FILE_WRITE_OVERWRITE.
  */
 #define DR_FILE_WRITE_ONLY        0x40
+/**
+ * Buffer writes made with dr_write_file() and dr_fprintf() inside DR, writing
+ * them to the file only when the buffer fills, on dr_flush_file() and
+ * dr_close_file(), at process exit, and on a crash.  Requires a write mode.
+ * Reading, seeking, or querying the position of the file first writes out the
+ * buffer.  Writes made to the file through other means, such as a handle from
+ * dr_dup_file_handle(), are not ordered with the buffered ones.
+ */
+#define DR_FILE_BUFFERED          0x80
 /* DR_API EXPORT END */
 
 DR_API
@@ -3682,7 +3771,10 @@ bool
 dr_delete_file(const char *filename);
 
 DR_API
-/** Flushes any buffers for file \p f. */
+/**
+ * Flushes any buffers for file \p f, including DR's own buffer for a file
+ * opened with #DR_FILE_BUFFERED.
+ */
 void
 dr_flush_file(file_t f);
 
@@ -5762,6 +5854,41 @@ DR_API
 bool
 dr_unlink_flush_region(app_pc start, size_t size);
 
+/* DR_API EXPORT BEGIN */
+/** A region of code to flush, for dr_flush_regions() and dr_unlink_flush_regions(). */
+typedef struct _dr_flush_region_t {
+    app_pc start; /**< The start of the region. */
+    size_t size;  /**< The size of the region, which cannot be 0. */
+} dr_flush_region_t;
+/* DR_API EXPORT END */
+
+DR_API
+/**
+ * Flush all fragments containing any code from any of the \p num_regions
+ * regions in \p regions, with the same guarantees and restrictions as
+ * dr_flush_region().  All of the regions are flushed under a single
+ * synchronization with the other threads, which is much cheaper than a
+ * separate dr_flush_region() per region when flushing many scattered
+ * regions.  Overlapping and adjacent regions are merged.  Returns true if
+ * successful.
+ */
+bool
+dr_flush_regions(const dr_flush_region_t *regions, uint num_regions);
+
+DR_API
+/**
+ * Flush all fragments containing any code from any of the \p num_regions
+ * regions in \p regions, with the same guarantees and restrictions as
+ * dr_unlink_flush_region().  All of the regions are unlinked in a single
+ * pass over the threads rather than one pass per region.  Overlapping and
+ * adjacent regions are merged.  Returns true if successful.
+ *
+ * \note This routine is only available with either the -thread_private
+ * or -enable_full_api options.  It is not available when -opt_memory is specified.
+ */
+bool
+dr_unlink_flush_regions(const dr_flush_region_t *regions, uint num_regions);
+
 /* FIXME - can we better bound when the flush will happen?  Maybe unlink shared syscalls
  * or similar or check the queue in more locations?  Should always hit the flush before
  * executing new code in the cache, and I think we'll always hit it before a nudge is
@@ -5815,6 +5942,161 @@ DR_API
 app_pc
 dr_fragment_app_pc(void *tag);
 
+DR_API
+/**
+ * Returns the number of times the block with tag \p tag has been entered
+ * so far, summed over every fragment that has held that tag: the count is
+ * kept when a fragment is flushed, replaced, or made into a trace.  An
+ * execution of a trace counts once for each block it passes through.
+ * Returns 0 for a tag that has never been built or if the -fragment_counts
+ * runtime option is not enabled.
+ *
+ * With -fragment_counts, DR increments a per-tag counter inline at the top
+ * of each block, after any client instrumentation there.  The increment is
+ * not atomic, so blocks executed concurrently by several threads may lose
+ * a few counts.  The option is only supported on x86 and not with
+ * -coarse_units.
+ */
+uint64
+dr_fragment_exec_count(void *drcontext, void *tag);
+
+DR_API
+/**
+ * Calls \p iter_cb once for each tag with an execution counter, passing the
+ * count as described in dr_fragment_exec_count().  Iteration stops early
+ * if \p iter_cb returns false.  Tags built while iterating may or may not
+ * be visited.  Returns false if the -fragment_counts runtime option is not
+ * enabled.  May be called from any thread and from the process exit event.
+ */
+bool
+dr_fragment_exec_count_iterate(bool (*iter_cb)(app_pc tag, uint64 count,
+                                               void *user_data),
+                               void *user_data);
+
+/* DR_API EXPORT BEGIN */
+/**
+ * Indirect branch kinds reported by dr_ibl_profile_iterate().
+ */
+typedef enum {
+    DR_IBL_BRANCH_RETURN, /**< A return instruction. */
+    DR_IBL_BRANCH_CALL,   /**< An indirect call instruction. */
+    DR_IBL_BRANCH_JUMP,   /**< An indirect jump instruction. */
+} dr_ibl_branch_type_t;
+
+/**
+ * One (site, target) pair recorded by the -ibl_profile option.
+ * Passed to the callback of dr_ibl_profile_iterate().
+ */
+typedef struct _dr_ibl_profile_entry_t {
+    /**
+     * The tag of the basic block ending in the indirect branch.  For an
+     * exit from a trace this is the tag of the constituent block.
+     */
+    app_pc site;
+    app_pc target;               /**< The application target of the branch. */
+    uint count;                  /**< The number of times the pair was recorded. */
+    dr_ibl_branch_type_t type;   /**< The kind of indirect branch. */
+} dr_ibl_profile_entry_t;
+/* DR_API EXPORT END */
+
+DR_API
+/**
+ * Iterates over the indirect branch profile that DR gathered for the thread
+ * \p drcontext, calling \p iter_cb once per recorded (site, target) pair.
+ * Iteration stops early if \p iter_cb returns false.
+ *
+ * The profile is only gathered when the -ibl_profile runtime option is
+ * enabled; otherwise this routine returns false.  DR records a pair each
+ * time an indirect branch transfer is resolved outside of the code cache's
+ * inlined lookup: the first time each target is reached from a thread and
+ * each time the target is not (yet) eligible for the lookup tables.  This
+ * identifies hot targets at each site without any per-execution cost, but
+ * the counts are not execution counts.  Clients needing exact frequencies
+ * should use dr_insert_mbr_instrumentation().  Each thread's table holds a
+ * bounded number of pairs; further pairs are dropped.
+ *
+ * \note Must be called either by the thread owning \p drcontext or from
+ * that thread's exit event.
+ */
+bool
+dr_ibl_profile_iterate(void *drcontext,
+                       bool (*iter_cb)(dr_ibl_profile_entry_t *entry, void *user_data),
+                       void *user_data);
+
+DR_API
+/**
+ * Discards all pairs recorded so far in the indirect branch profile of the
+ * thread \p drcontext.  Returns false if the -ibl_profile runtime option is
+ * not enabled.  The same restriction as for dr_ibl_profile_iterate() applies.
+ */
+bool
+dr_ibl_profile_reset(void *drcontext);
+
+/* DR_API EXPORT BEGIN */
+/**
+ * Reasons for leaving the code cache reported by dr_exit_profile_iterate().
+ */
+typedef enum {
+    DR_EXIT_DIRECT,      /**< A direct branch whose target was not linked. */
+    DR_EXIT_INDIRECT,    /**< An indirect branch that missed the inlined lookup. */
+    DR_EXIT_SYSCALL,     /**< A system call, either before or after it executed. */
+    DR_EXIT_SELFMOD,     /**< A fragment flushed itself due to code modification. */
+    DR_EXIT_ASYNCH,      /**< A signal, sigreturn, callback, or exception. */
+    DR_EXIT_NATIVE_EXEC, /**< A transition to or from native execution. */
+    DR_EXIT_CLIENT,      /**< A client redirection such as dr_redirect_execution(). */
+    DR_EXIT_OTHER,       /**< Any other reason, such as a cache reset. */
+} dr_exit_reason_t;
+
+/**
+ * One (tag, reason) pair recorded by the -exit_profile option.
+ * Passed to the callback of dr_exit_profile_iterate().
+ */
+typedef struct _dr_exit_profile_entry_t {
+    /**
+     * The tag of the fragment the thread exited from.  For exits that do
+     * not come from a fragment, such as those after a system call, this is
+     * instead the application address at which execution resumed.
+     */
+    app_pc tag;
+    dr_exit_reason_t reason;     /**< Why the thread left the code cache. */
+    uint count;                  /**< The number of such exits. */
+    /**
+     * The time stamp counter cycles spent in DR, summed over these exits, from
+     * each exit until the thread next left DR.
+     */
+    uint64 cycles;
+} dr_exit_profile_entry_t;
+/* DR_API EXPORT END */
+
+DR_API
+/**
+ * Iterates over the code cache exit profile that DR gathered for the thread
+ * \p drcontext, calling \p iter_cb once per recorded (tag, reason) pair.
+ * Iteration stops early if \p iter_cb returns false.  A client can map each
+ * tag to its module with dr_lookup_module() to find the top offenders.
+ *
+ * The profile is only gathered when the -exit_profile runtime option is
+ * enabled; otherwise this routine returns false.  Process-wide totals per
+ * reason are also kept in the release-build statistics.  Each thread's table
+ * holds a bounded number of pairs; further pairs are dropped.
+ *
+ * \note Must be called either by the thread owning \p drcontext or from
+ * that thread's exit event.
+ */
+bool
+dr_exit_profile_iterate(void *drcontext,
+                        bool (*iter_cb)(dr_exit_profile_entry_t *entry, void *user_data),
+                        void *user_data);
+
+DR_API
+/**
+ * Discards all pairs recorded so far in the code cache exit profile of the
+ * thread \p drcontext.  Returns false if the -exit_profile runtime option is
+ * not enabled.  The same restriction as for dr_exit_profile_iterate() applies.
+ */
+bool
+dr_exit_profile_reset(void *drcontext);
+
 DR_API
 /**
  * Given an application PC, returns a PC that contains the application code
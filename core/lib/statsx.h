@@ -97,6 +97,7 @@
     RSTATS_DEF("Total signals delivered", num_signals)
     RSTATS_DEF("Signals dropped", num_signals_dropped)
     RSTATS_DEF("Signals in coarse units delayed", num_signals_coarse_delayed)
+    STATS_DEF("Signals delivered directly to handler fragment", num_signals_fast_delivered)
 #endif
     STATS_DEF("Exceptions in decoding app memory", num_exceptions_decode)
     RSTATS_DEF("System calls, pre", pre_syscall)
@@ -230,7 +231,12 @@
     STATS_DEF("Blocks ended early due to sandboxing limitations", num_bb_end_early)
     STATS_DEF("Self-writes detected by sandboxing", num_self_writes)
     STATS_DEF("Self-writes overruled by flushes", num_self_writes_after_flushes)
+    STATS_DEF("Code regions left writable as JIT-managed", num_jit_managed_code_regions)
+    STATS_DEF("Flushes announced by JIT annotations", num_jit_annotated_flushes)
     STATS_DEF("Write faults on read-only code regions", num_write_faults)
+    STATS_DEF("Write faults emulated, missed code lines", num_data_line_writes)
+    STATS_DEF("Write faults flushed, hit code lines", num_code_line_writes)
+    STATS_DEF("Write faults flushed, emulation limit", num_data_line_write_limit)
     STATS_DEF("Write fault races", num_write_fault_races)
     STATS_DEF("Write fault races, one selfmod", num_write_fault_races_selfmod)
     STATS_DEF("Flushes racy, no exec removal since selfmod", flush_selfmod_race_no_remove)
@@ -254,6 +260,8 @@
     STATS_DEF("Peak fcache units on to-free list", peak_cache_units_tofree)
     STATS_DEF("Fcache units flushed for wset", cache_units_wset_flushed)
     STATS_DEF("Fcache units allowed w/o a flush for wset", cache_units_wset_allowed)
+    STATS_DEF("Fcache regen thresholds lowered by autotune", fcache_autotune_eager)
+    STATS_DEF("Fcache regen thresholds raised by autotune", fcache_autotune_lazy)
     STATS_DEF("Fcache units flushed w/ no live fragments", cache_units_flushed_nolive)
     STATS_DEF("Flushes of vmvector areas", num_flush_vmvector)
     STATS_DEF("Shared deletion regions unlinked", num_shared_flush_regions)
@@ -280,6 +288,8 @@
     STATS_DEF("Flush queue marked nonempty: relink special ibl xfer",
               num_flushq_relink_special_ibl_xfer)
     STATS_DEF("Flush queue marked nonempty, yet empty", num_flushq_actually_empty)
+    STATS_DEF("Threads let go by thread-scoped flushes", num_scoped_flush_released)
+    STATS_DEF("Bb builds that waited for a thread-scoped flush", num_scoped_flush_waits)
     STATS_DEF("Fragments added to lazy deletion list", num_lazy_deletion_appends)
     STATS_DEF("Fragments freed from lazy deletion list at exit",
               num_lazy_deletion_frees_atexit)
@@ -287,6 +297,7 @@
     STATS_DEF("Lazy list instances moved to pending list", num_lazy_del_to_pending)
     STATS_DEF("Lazy list fragments moved to pending list", num_lazy_del_frags_to_pending)
     STATS_DEF("Translation info computed", translations_computed)
+    STATS_DEF("Translation info bytes saved by encoding", translation_info_bytes_saved)
     STATS_DEF("Fragments with translation info stored", num_fragment_translation_stored)
     STATS_DEF("Resets of entire fcache, proactively", fcache_reset_proactively)
     STATS_DEF("Resets due to too many pending deletions", fcache_reset_pending_del)
@@ -387,6 +398,11 @@
     STATS_DEF("Fragments generated, bb and trace", num_fragments)
     RSTATS_DEF("Basic block fragments generated", num_bbs)
     RSTATS_DEF("Trace fragments generated", num_traces)
+    STATS_DEF("Decode cache hits", num_decode_cache_hits)
+    STATS_DEF("Decode cache entries added", num_decode_cache_adds)
+    STATS_DEF("Decode cache invalidations", num_decode_cache_invalidations)
+    STATS_DEF("Encode cache hits", num_encode_cache_hits)
+    STATS_DEF("Encode cache entries added", num_encode_cache_adds)
 #ifdef X64
     STATS_DEF("32-bit basic block fragments generated", num_32bit_bbs)
     STATS_DEF("32-bit trace fragments generated", num_32bit_traces)
@@ -411,6 +427,18 @@
     STATS_DEF("Shared trace links shifted back to trace head", links_shared_trace_to_head)
     STATS_DEF("Shadowed trace head deleted", shadowed_trace_head_deleted)
     STATS_DEF("Trace head counters reset on trace deletion", th_counter_reset)
+    STATS_DEF("Trace head counters primed at reset", th_counter_warmed)
+    STATS_DEF("Trace head counter lookups hitting recent slot", th_counter_recent_hit)
+    STATS_DEF("Trace heads read from persisted profiles", trace_profile_heads_loaded)
+    STATS_DEF("Trace heads written to persisted profiles", trace_profile_heads_saved)
+    STATS_DEF("Trace heads marked from persisted profiles", trace_profile_heads_marked)
+    STATS_DEF("Trace head thresholds raised on trace abort", th_threshold_raised_abort)
+    STATS_DEF("Trace head thresholds lowered on trace exit", th_threshold_lowered_exit)
+    STATS_DEF("Trace head thresholds raised for trace cache pressure",
+              th_threshold_raised_pressure)
+    STATS_DEF("Trace paths queued for the helper thread", num_trace_paths_queued)
+    STATS_DEF("Trace paths dropped: queue full", num_trace_paths_dropped)
+    STATS_DEF("Trace paths not built: head or path changed", num_trace_paths_stale)
     STATS_DEF("Trace heads re-marked", trace_head_remark)
     STATS_DEF("Future fragments generated", num_future_fragments)
     STATS_DEF("Shared fragments generated", num_shared_fragments)
@@ -509,6 +537,12 @@
               num_dead_shared_ibt_tables_freed_at_exit)
     STATS_DEF("Shared IBT tables freed: immediately",
               num_shared_ibt_tables_freed_immediately)
+    STATS_DEF("Dead shared BB/trace tables", num_dead_shared_fragment_tables)
+    STATS_DEF("Lock-free shared table lookups falling back to lock",
+              htable_lockfree_lookup_fallbacks)
+    STATS_DEF("Incremental table resizes", num_incremental_htable_resizes)
+    STATS_DEF("Incremental table resizes finished early",
+              num_incremental_htable_resizes_forced)
     STATS_DEF("Pvt ptrs to shared tables updated at-sys walks",
               num_shared_tables_updated_atsyscall)
     STATS_DEF("IBT unlinked entries NOT moved on resize",
@@ -533,6 +567,8 @@
               num_ibt_exit_src_trace_shared_syscall)
     STATS_DEF("Extra IBT exits due to -no_link_ibl", num_ibt_exit_nolink)
     STATS_DEF("Extra IBT exits due to unknown reasons", num_ibt_exit_unknown)
+    STATS_DEF("IBL profile pairs dropped for a full table", ibl_profile_dropped)
+    STATS_DEF("Exit profile pairs dropped for a full table", exit_profile_dropped)
     STATS_DEF("Fragments regenerated, in-cache replacement", num_fragments_regenerated)
     STATS_DEF("Fragments regenerated or duplicated", num_fragments_deja_vu)
     STATS_DEF("Trace fragments extended", num_traces_extended)
@@ -592,11 +628,13 @@
     STATS_DEF("Lazy links from coarse-grain", lazy_links_from_coarse)
     STATS_DEF("Lazy links from persisted units", lazy_links_from_persisted)
     STATS_DEF("Lazy links from fine-grain", lazy_links_from_fine)
+    STATS_DEF("Lazy links on first exit (-lazy_link)", lazy_links_on_exit)
     STATS_DEF("Lazy links that failed to link", lazy_links_failed)
     STATS_DEF("Coarse-grain direct re-links", coarse_relinks)
     STATS_DEF("Coarse-grain trace head path-dependent", coarse_th_path_dependent)
     STATS_DEF("Coarse-grain trace heads from fine", coarse_th_from_fine)
     STATS_DEF("Coarse grain freezes", coarse_freezes)
+    STATS_DEF("Coarse grain periodic persists", coarse_freezes_periodic)
     STATS_DEF("Coarse grain freezes aborted", coarse_freeze_abort)
     STATS_DEF("Coarse grain at-unload not persist: synch fail",
               persist_unload_suspend_failure)
@@ -685,6 +723,36 @@
 
     STATS_DEF("Entrance hooks to DR", num_entering_DR)
     STATS_DEF("Exit hooks from DR", num_exiting_DR)
+    /* -exit_profile */
+    RSTATS_DEF("Exit profile exits, direct branch", exit_profile_direct)
+    RSTATS_DEF("Exit profile exits, indirect branch", exit_profile_indirect)
+    RSTATS_DEF("Exit profile exits, system call", exit_profile_syscall)
+    RSTATS_DEF("Exit profile exits, code modification", exit_profile_selfmod)
+    RSTATS_DEF("Exit profile exits, asynch event", exit_profile_asynch)
+    RSTATS_DEF("Exit profile exits, native_exec", exit_profile_native_exec)
+    RSTATS_DEF("Exit profile exits, client redirection", exit_profile_client)
+    RSTATS_DEF("Exit profile exits, other", exit_profile_other)
+    RSTATS_DEF("Exit profile Kcycles in DR, direct branch", exit_profile_kcycles_direct)
+    RSTATS_DEF("Exit profile Kcycles in DR, indirect branch", exit_profile_kcycles_indirect)
+    RSTATS_DEF("Exit profile Kcycles in DR, system call", exit_profile_kcycles_syscall)
+    RSTATS_DEF("Exit profile Kcycles in DR, code modification", exit_profile_kcycles_selfmod)
+    RSTATS_DEF("Exit profile Kcycles in DR, asynch event", exit_profile_kcycles_asynch)
+    RSTATS_DEF("Exit profile Kcycles in DR, native_exec", exit_profile_kcycles_native_exec)
+    RSTATS_DEF("Exit profile Kcycles in DR, client redirection", exit_profile_kcycles_client)
+    RSTATS_DEF("Exit profile Kcycles in DR, other", exit_profile_kcycles_other)
+    /* -startup_profile */
+    RSTATS_DEF("Startup usecs, options", startup_us_options)
+    RSTATS_DEF("Startup usecs, client lib load", startup_us_client_load)
+    RSTATS_DEF("Startup usecs, heap", startup_us_heap)
+    RSTATS_DEF("Startup usecs, os and vm areas", startup_us_os)
+    RSTATS_DEF("Startup usecs, private loader", startup_us_loader)
+    RSTATS_DEF("Startup usecs, components", startup_us_components)
+    RSTATS_DEF("Startup usecs, initial thread", startup_us_thread_init)
+    RSTATS_DEF("Startup usecs, module scan", startup_us_module_scan)
+    RSTATS_DEF("Startup usecs, client init", startup_us_client_init)
+    RSTATS_DEF("Startup usecs, other", startup_us_other)
+    RSTATS_DEF("Startup usecs, first blocks", startup_us_first_blocks)
+    RSTATS_DEF("Startup blocks timed", startup_blocks_timed)
     STATS_DEF("Fcache exits, total", num_exits)
     STATS_DEF("Fcache exits, coarse-grain fragments", num_exits_coarse)
     STATS_DEF("Fcache exits, coarse-grain targeting trace head", num_exits_coarse_trace_head)
@@ -767,6 +835,7 @@
 
     STATS_DEF("Fragments with OF restore prefix", num_oflag_prefix_restore)
     STATS_DEF("Fcache free capacity (bytes)", fcache_free_capacity)
+    STATS_DEF("Fcache free capacity returned to the OS (bytes)", fcache_trimmed_bytes)
 
     STATS_DEF("Fcache trace capacity (bytes)", fcache_trace_capacity)
     STATS_DEF("Fcache trace peak capacity (bytes)", fcache_trace_capacity_peak)
@@ -893,8 +962,10 @@
 
     RSTATS_DEF("Heap units on live list", heap_num_live)
     RSTATS_DEF("Peak heap units on live list", peak_heap_num_live)
+    STATS_DEF("Heap and fcache units placed on the local NUMA node", numa_local_units)
     RSTATS_DEF("Heap units on free list", heap_num_free)
     RSTATS_DEF("Peak heap units on free list", peak_heap_num_free)
+    STATS_DEF("Heap free unit memory returned to the OS (bytes)", heap_trimmed_bytes)
     STATS_DEF("Heap headers (bytes)", heap_headers)
     STATS_DEF("Heap align space (bytes)", heap_align)
     STATS_DEF("Peak heap align space (bytes)", peak_heap_align)
@@ -902,6 +973,7 @@
     STATS_DEF("Peak heap bucket pad space (bytes)", peak_heap_bucket_pad)
     STATS_DEF("Heap allocs in buckets", heap_allocs_buckets)
     STATS_DEF("Heap allocs variable-sized", heap_allocs_variable)
+    STATS_DEF("Heap arena chunks allocated", heap_arena_chunks)
     STATS_DEF("Total reserved memory", reserved_memory_capacity)
     STATS_DEF("Peak total reserved memory", peak_reserved_memory_capacity)
     STATS_DEF("Guard pages, reserved virtual pages", guard_pages)
@@ -1127,6 +1199,10 @@
     STATS_DEF("Trace fragment ending with an IBL, syscall", num_traces_end_at_ibl_syscall)
     STATS_DEF("Trace fragment ending at MUST_END_TRACE", num_traces_at_must_end_trace)
     STATS_DEF("Trace fragment ending with an IBL, speculative", num_traces_end_at_ibl_speculative_link)
+    STATS_DEF("Trace fragment ending with an IBL, speculative on trace head too",
+              num_traces_end_at_ibl_speculative_alt)
+    STATS_DEF("Trace calls recording a return prediction", trace_ret_predict_calls)
+    STATS_DEF("Trace returns checking the return prediction", trace_ret_predict_checks)
     STATS_DEF("Yields in intercept_apc wait dynamo_initialized", apc_yields_while_initializing)
     STATS_DEF("IBL Tables groomed", num_ibt_groomed)
     STATS_DEF("IBL Tables reached maximum capacity", num_ibt_max_capacity)
@@ -1199,6 +1275,7 @@
     STATS_DEF("Clean Call inserted", cleancall_inserted)
     STATS_DEF("Clean Call inlined", cleancall_inlined)
     STATS_DEF("Clean Call xmm skipped", cleancall_xmm_skipped)
+    STATS_DEF("Clean Call ymm top half skipped", cleancall_ymmh_skipped)
     STATS_DEF("Clean Call aflags save skipped", cleancall_aflags_save_skipped)
     STATS_DEF("Clean Call aflags clear skipped", cleancall_aflags_clear_skipped)
     /* i#107 handle application using same segment register */
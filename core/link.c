@@ -1335,6 +1335,26 @@ incoming_link_exists(dcontext_t *dcontext, fragment_t *f, linkstub_t *l,
     return incoming_find_link(dcontext, f, l, targetf) != NULL;
 }
 
+/* With -lazy_link, shared bbs do not link or register their direct exits when
+ * built: lazy_link_exit() does both when an exit is first taken.  A linked exit
+ * is always registered in its target's incoming list, but an unlinked exit may
+ * not be in any list, not even a future's.
+ */
+#define LAZY_LINK_FRAGMENT(f)                                                \
+    (DYNAMO_OPTION(lazy_link) && TEST(FRAG_SHARED, (f)->flags) &&            \
+     !TESTANY(FRAG_IS_TRACE | FRAG_COARSE_GRAIN | FRAG_FAKE, (f)->flags))
+
+/* Returns true if f's exit l was never registered with targetf (which may be
+ * NULL if there is no fragment or future for the target tag).
+ */
+static bool
+lazy_link_unregistered(dcontext_t *dcontext, fragment_t *f, linkstub_t *l,
+                       fragment_t *targetf)
+{
+    return LAZY_LINK_FRAGMENT(f) &&
+        (targetf == NULL || !incoming_link_exists(dcontext, f, l, targetf));
+}
+
 /* Removes the link from l to targetf from the incoming table
  * N.B.: may end up deleting targetf!
  * If l is a fake linkstub_t, then f must be coarse-grain, and this
@@ -1695,6 +1715,8 @@ incoming_remove_fragment(dcontext_t *dcontext, fragment_t *f)
                     }
                 }
             }
+            if (lazy_link_unregistered(dcontext, f, l, targetf))
+                continue;
             LOG(THREAD, LOG_LINKS, 4,
                 "    removed F%d("PFX")."PFX" -> ("PFX") from incoming list\n",
                 f->id, f->tag, EXIT_CTI_PC(f, l), target_tag);
@@ -1839,7 +1861,12 @@ link_fragment_outgoing(dcontext_t *dcontext, fragment_t *f, bool new_fragment)
                 g = f;
             else /* primarily interested in fragment of same sharing */
                 g = fragment_link_lookup_same_sharing(dcontext, target_tag, l, f->flags);
-            if (g != NULL) {
+            if (LAZY_LINK_FRAGMENT(f) &&
+                (new_fragment || lazy_link_unregistered(dcontext, f, l, g))) {
+                /* Left for lazy_link_exit(); re-link only exits it registered */
+                LOG(THREAD, LOG_LINKS, 4, "    lazy: not linking F%d("PFX")."PFX"\n",
+                    f->id, f->tag, EXIT_CTI_PC(f, l));
+            } else if (g != NULL) {
                 if (is_linkable(dcontext, f, l, g,
                                 NEED_SHARED_LOCK(f->flags) ||
                                 (new_fragment && SHARED_FRAGMENTS_ENABLED()),
@@ -2122,7 +2149,7 @@ shift_links_to_new_fragment(dcontext_t *dcontext,
                             fragment_lookup_future(dcontext, target_tag);
                     }
                 }
-                ASSERT(targetf != NULL);
+                ASSERT(targetf != NULL || LAZY_LINK_FRAGMENT(old_f));
                 /* if targetf == old_f, must remove self-link, b/c it won't be
                  * redirected below as it won't appear on incoming list (new
                  * self-link will).
@@ -2135,6 +2162,8 @@ shift_links_to_new_fragment(dcontext_t *dcontext,
                     DEBUG_DECLARE(keep =) unlink_branch(dcontext, old_f, l);
                     ASSERT(keep);
                 }
+                if (lazy_link_unregistered(dcontext, old_f, l, targetf))
+                    continue;
                 LOG(THREAD, LOG_LINKS, 4,
                     "    removed F%d("PFX")."PFX" -> ("PFX") from incoming lists\n",
                     old_f->id, old_f->tag, EXIT_CTI_PC(old_f, l), target_tag);
@@ -3465,10 +3494,17 @@ coarse_lazy_link(dcontext_t *dcontext, fragment_t *targetf)
                 IF_WINDOWS(ASSERT_NOT_REACHED());
                 goto lazy_link_done;
             }
-            /* May already be linked (we may have just built its target)
+            /* May already be linked (we may have just built its target).
              * Case 8825: we must hold the change_linking_lock when we check.
-             * Cheaper to just grab lock than to test first, unless high contention.
+             * During a startup burst the lock is highly contended and most
+             * stubs are already linked by another thread, so first test
+             * without the lock: a stale "linked" answer only defers the link
+             * to the next exit through this stub.
              */
+            if (entrance_stub_linked(stub, info)) {
+                DODEBUG({ already_linked = true; });
+                goto lazy_link_done;
+            }
             acquire_recursive_lock(&change_linking_lock);
             if (!entrance_stub_linked(stub, info) &&
                 (!coarse_is_trace_head(stub) || DYNAMO_OPTION(disable_traces))) {
@@ -3533,12 +3569,16 @@ coarse_lazy_link(dcontext_t *dcontext, fragment_t *targetf)
                     "lazy linking F%d("PFX") -> F%d("PFX")."PFX"\n",
                     f->id, f->tag, targetf->id, targetf->tag, FCACHE_ENTRY_PC(targetf));
                 link_branch(dcontext, f, l, targetf, HOT_PATCHABLE);
-                add_incoming(dcontext, f, l, targetf, true);
+                /* -lazy_link exits may already be registered but unlinked */
+                if (!LAZY_LINK_FRAGMENT(f) ||
+                    !incoming_link_exists(dcontext, f, l, targetf))
+                    add_incoming(dcontext, f, l, targetf, true);
                 STATS_INC(lazy_links_from_fine);
                 DODEBUG({ linked = true; });
             } else {
                 DOCHECK(CHKLVL_DEFAULT+1, { /* PR 307698: perf hit */
                     ASSERT(incoming_link_exists(dcontext, f, l, targetf) ||
+                           LAZY_LINK_FRAGMENT(f) ||
                            /* case 8786: another thread could have built a
                             * shared trace to replace this coarse fragment and
                             * already shifted incoming links to the new trace */
@@ -3567,6 +3607,42 @@ coarse_lazy_link(dcontext_t *dcontext, fragment_t *targetf)
     });
 }
 
+/* -lazy_link: links the direct exit just taken from a shared bb to the fine-grained
+ * targetf, registering it in targetf's incoming list if not already there.  We wait
+ * until here, as for coarse_lazy_link(), so we can link to newly built fragments.
+ */
+void
+lazy_link_exit(dcontext_t *dcontext, fragment_t *targetf)
+{
+    linkstub_t *l = dcontext->last_exit;
+    fragment_t *f = dcontext->last_fragment;
+    ASSERT(DYNAMO_OPTION(lazy_link));
+    ASSERT(LINKSTUB_DIRECT(l->flags));
+    /* Rule out fake exits and syscall-skip and other cases where we did not
+     * arrive at the exit's target.  The unlocked LINK_LINKED test avoids the
+     * lock for exits already linked by another thread.
+     */
+    if (LINKSTUB_FAKE(l) || !LAZY_LINK_FRAGMENT(f) || TEST(LINK_LINKED, l->flags) ||
+        TEST(FRAG_COARSE_GRAIN, targetf->flags) ||
+        dcontext->next_tag != EXIT_TARGET_TAG(dcontext, f, l))
+        return;
+    acquire_recursive_lock(&change_linking_lock);
+    if (!TEST(LINK_LINKED, l->flags) /* case 8825: test w/ lock! */ &&
+        is_linkable(dcontext, f, l, targetf, true/*have change_linking_lock*/,
+                    true/*mark new trace heads*/)) {
+        LOG(THREAD, LOG_LINKS, 4,
+            "lazy linking on exit F%d("PFX")."PFX" -> F%d("PFX")\n",
+            f->id, f->tag, EXIT_CTI_PC(f, l), targetf->id, targetf->tag);
+        SELF_PROTECT_CACHE(dcontext, f, WRITABLE);
+        link_branch(dcontext, f, l, targetf, HOT_PATCHABLE);
+        SELF_PROTECT_CACHE(dcontext, NULL, READONLY);
+        if (!incoming_link_exists(dcontext, f, l, targetf))
+            add_incoming(dcontext, f, l, targetf, true);
+        STATS_INC(lazy_links_on_exit);
+    }
+    release_recursive_lock(&change_linking_lock);
+}
+
 /* Passing in stub_pc's info avoids a vmvector lookup */
 cache_pc
 fcache_return_coarse_prefix(cache_pc stub_pc, coarse_info_t *info /*OPTIONAL*/)
@@ -429,6 +429,9 @@ coarse_stub_lookup_by_target(dcontext_t *dcontext, coarse_info_t *info,
 void
 coarse_lazy_link(dcontext_t *dcontext, fragment_t *targetf);
 
+void
+lazy_link_exit(dcontext_t *dcontext, fragment_t *targetf);
+
 cache_pc
 fcache_return_coarse_prefix(cache_pc stub_pc, coarse_info_t *info /*OPTIONAL*/);
 
@@ -34,6 +34,7 @@
 #include "globals.h"
 #include "instrument.h"
 #include "native_exec.h"
+#include "perscache.h"
 #include <string.h> /* for memset */
 #ifdef WINDOWS
 # include "ntdll.h" /* for protect_virtual_memory */
@@ -48,6 +49,9 @@
  */
 vm_area_vector_t *loaded_module_areas;
 
+/* Written under the module_data_lock write lock but read without it */
+DECLARE_NEVERPROT_VAR(volatile int module_list_generation, 0);
+
 /* To avoid breaking further the abstraction of vm_area_vector_t's
  * currently grabbing a separate lock.  In addition to protecting each
  * entry's data, this lock also makes atomic a lookup & remove or a
@@ -134,6 +138,9 @@ module_area_create(app_pc base, size_t view_size, bool at_map, const char *filep
 static void
 module_area_delete(module_area_t *ma)
 {
+#ifdef CLIENT_INTERFACE
+    instrument_module_area_delete(ma);
+#endif
     os_module_area_reset(ma HEAPACCT(ACCT_VMAREAS));
     free_module_names(&ma->names HEAPACCT(ACCT_VMAREAS));
     HEAP_TYPE_FREE(GLOBAL_DCONTEXT, ma, module_area_t, ACCT_VMAREAS, PROTECTED);
@@ -274,6 +281,7 @@ module_list_add(app_pc base, size_t view_size, bool at_map, const char *filepath
          */
 
         native_exec_module_load(ma, at_map);
+        module_list_generation++;
     } else {
         /* already added! */
         /* only possible for manual NtMapViewOfSection, loader
@@ -282,6 +290,9 @@ module_list_add(app_pc base, size_t view_size, bool at_map, const char *filepath
         /* do nothing */
     }
     os_get_module_info_write_unlock();
+    /* reads files, and needs the module info lock */
+    if (DYNAMO_OPTION(persist_trace_heads))
+        trace_profile_module_load(base);
 }
 
 void
@@ -299,6 +310,9 @@ module_list_remove(app_pc base, size_t view_size)
      * application race (note we pre-process unmap)
      */
     ASSERT(loaded_module_areas != NULL);
+    /* while we can still name the module's profile file */
+    if (DYNAMO_OPTION(persist_trace_heads))
+        trace_profile_module_unload(base);
     os_get_module_info_write_lock();
     ASSERT(vmvector_overlap(loaded_module_areas, base, base+view_size));
     ma = (module_area_t*)vmvector_lookup(loaded_module_areas, base);
@@ -331,6 +345,7 @@ module_list_remove(app_pc base, size_t view_size)
 
     native_exec_module_unload(ma);
 
+    module_list_generation++;
     /* defensively checking */
     if (ma != NULL) {
         /* os_module_area_reset() calls module_list_remove_mapping() to
@@ -418,6 +433,17 @@ module_pc_lookup(byte *pc)
     return (module_area_t *)vmvector_lookup(loaded_module_areas, pc);
 }
 
+module_area_t *
+module_pc_lookup_segment(byte *pc, app_pc *seg_start OUT, app_pc *seg_end OUT)
+{
+    module_area_t *ma = NULL;
+    ASSERT(loaded_module_areas != NULL);
+    ASSERT(os_get_module_info_locked());
+    if (!vmvector_lookup_data(loaded_module_areas, pc, seg_start, seg_end, (void **)&ma))
+        return NULL;
+    return ma;
+}
+
 /* Returns true if the region overlaps any module areas. */
 bool
 module_overlaps(byte *pc, size_t len)
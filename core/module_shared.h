@@ -173,6 +173,11 @@ typedef struct _module_area_t {
     char *full_path;
 
     os_module_data_t os_data; /* os specific data for this module */
+
+#ifdef CLIENT_INTERFACE
+    /* Shared copy for dr_lookup_module_ex(), created on first use */
+    struct _module_view_t * volatile client_view;
+#endif
 } module_area_t;
 
 /* Flags used in module_area_t.flags */
@@ -234,11 +239,22 @@ bool os_module_get_flag(app_pc module_base, uint flag);
 
 /**************** module_area accessor routines (os shared) *****************/
 
+/* Incremented on every module load and unload, so that caches of lookups
+ * can be validated without taking the module lock.
+ */
+extern volatile int module_list_generation;
+
 /* no lock required by caller */
 bool pc_is_in_module(byte *pc);
 
 module_area_t * module_pc_lookup(byte *pc);
 
+/* Like module_pc_lookup(), but also returns the bounds of the module segment
+ * containing pc.
+ */
+module_area_t * module_pc_lookup_segment(byte *pc, app_pc *seg_start OUT,
+                                         app_pc *seg_end OUT);
+
 bool module_overlaps(byte *pc, size_t len);
 
 /* Unlike os_get_module_info(), sets *name to NULL if return value is false */
@@ -287,6 +303,10 @@ void free_module_names(module_names_t *mod_names HEAPACCT(which_heap_t which));
 /* returns true if the module is marked as having text relocations */
 bool module_has_text_relocs(app_pc base, bool at_map);
 #endif
+#ifdef LINUX
+/* returns true if the module containing pc has a GNU build id note */
+bool module_has_build_id(app_pc pc);
+#endif
 
 void
 module_copy_os_data(os_module_data_t *dst, os_module_data_t *src);
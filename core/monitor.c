@@ -45,7 +45,7 @@
 #include "emit.h"
 #include "fcache.h"
 #include "monitor.h"
-#ifdef CUSTOM_TRACES
+#if defined(CUSTOM_TRACES) || defined(TRACE_BUILD_HELPER)
 #  include "instrument.h"
 #endif
 #include <string.h> /* for memset */
@@ -83,6 +83,8 @@ extern bool mangle_trace(dcontext_t *dcontext, instrlist_t *ilist, monitor_data_
 
 #define INIT_COUNTER_TABLE_SIZE 9
 #define COUNTER_TABLE_LOAD 75
+#define TH_RECENT_INDEX(tag) \
+        ((((ptr_uint_t)(tag)) ^ (((ptr_uint_t)(tag)) >> 6)) & (TH_RECENT_SLOTS - 1))
 /* counters must be in unprotected memory
  * we don't support local unprotected so we use global
  */
@@ -98,13 +100,56 @@ extern bool mangle_trace(dcontext_t *dcontext, instrlist_t *ilist, monitor_data_
 
 static void reset_trace_state(dcontext_t *dcontext, bool grab_link_lock);
 
+#ifdef TRACE_BUILD_HELPER
+/* Under -trace_build_helper an app thread that finds a hot shared trace head
+ * only records the path of the trace: the blocks it executes and the exit
+ * taken out of each.  It skips decoding and mangling the blocks and emitting
+ * the trace, and instead queues the path for a helper thread, which replays it
+ * through the regular trace building code in its own dcontext and emits the
+ * trace.  A path holds only tags and exit indices, so one queued across a
+ * flush is simply rebuilt from the code present when the helper gets to it,
+ * and while the helper builds it is a trace in progress like any other that
+ * the flusher can see and abort.
+ */
+enum {
+    TRACE_PATH_MAX_BBS = 64,
+    TRACE_PATH_QUEUE_SIZE = 16,
+};
+
+typedef struct _trace_path_t {
+    uint num_blks;
+    app_pc tag[TRACE_PATH_MAX_BBS];
+    /* index of the exit of the previous block taken to reach each block */
+    int exit[TRACE_PATH_MAX_BBS];
+    /* the block executed after the trace, or NULL if the last block ended it */
+    app_pc next_tag;
+    int next_exit;
+} trace_path_t;
+
+typedef struct _trace_path_queue_t {
+    trace_path_t path[TRACE_PATH_QUEUE_SIZE];
+    uint head;
+    uint count;
+    bool helper_started;
+    bool helper_failed;
+    event_t ready;
+} trace_path_queue_t;
+
+static trace_path_queue_t *trace_paths;
+DECLARE_CXTSWPROT_VAR(static mutex_t trace_path_lock, INIT_LOCK_FREE(trace_path_lock));
+
+static void trace_helper_thread(void *arg);
+static void internal_restore_last(dcontext_t *dcontext);
+#endif
+
 /* synchronization of shared traces */
 DECLARE_CXTSWPROT_VAR(mutex_t trace_building_lock, INIT_LOCK_FREE(trace_building_lock));
 
 /* For clearing counters on trace deletion we follow a lazy strategy
- * using a sentinel value to determine whether we've built a trace or not
+ * using a sentinel value to determine whether we've built a trace or not.
+ * Thresholds are capped at USHRT_MAX so this is above any of them.
  */
-#define TH_COUNTER_CREATED_TRACE_VALUE() (INTERNAL_OPTION(trace_threshold) + 1U)
+#define TH_COUNTER_CREATED_TRACE_VALUE() (USHRT_MAX + 1U)
 
 static void
 delete_private_copy(dcontext_t *dcontext)
@@ -304,6 +349,15 @@ monitor_init()
      * this does not include exit stubs
      */
     ASSERT(MAX_TRACE_BUFFER_SIZE <= MAX_FRAGMENT_SIZE);
+#ifdef TRACE_BUILD_HELPER
+    if (DYNAMO_OPTION(trace_build_helper)) {
+        /* the helper thread itself is created on the first queued path */
+        trace_paths = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, trace_path_queue_t,
+                                      ACCT_TRACE, UNPROTECTED);
+        memset(trace_paths, 0, sizeof(*trace_paths));
+        trace_paths->ready = create_event();
+    }
+#endif
 }
 
 /* re-initializes non-persistent memory */
@@ -312,11 +366,39 @@ monitor_thread_reset_init(dcontext_t *dcontext)
 {
 }
 
+/* Under -reset_warm_traces, primes the persistent counters of trace heads whose
+ * traces are being thrown out by a reset so that each trace is rebuilt on the
+ * head's next execution, rather than having to re-earn the full threshold.
+ * Traces are our hot set: this shortens the post-reset warmup without keeping
+ * any code across the reset.
+ */
+static void
+thcounter_warm_for_reset(dcontext_t *dcontext)
+{
+    monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
+    trace_head_counter_t *e;
+    uint i;
+    ASSERT(dynamo_resetting);
+    if (RUNNING_WITHOUT_CODE_CACHE())
+        return;
+    for (i = 0; i < md->thead_table.capacity; i++) {
+        for (e = md->thead_table.counter_table[i]; e != NULL; e = e->next) {
+            if (e->counter == TH_COUNTER_CREATED_TRACE_VALUE()) {
+                ASSERT(e->threshold > 0);
+                e->counter = e->threshold - 1;
+                STATS_INC(th_counter_warmed);
+            }
+        }
+    }
+}
+
 /* frees all non-persistent memory */
 void
 monitor_thread_reset_free(dcontext_t *dcontext)
 {
     trace_abort_and_delete(dcontext);
+    if (DYNAMO_OPTION(reset_warm_traces))
+        thcounter_warm_for_reset(dcontext);
 }
 
 void
@@ -336,6 +418,16 @@ monitor_exit()
     LOG(GLOBAL, LOG_MONITOR|LOG_STATS, 1,
         "Trace fragments generated: %d\n", GLOBAL_STAT(num_traces));
     DELETE_LOCK(trace_building_lock);
+#ifdef TRACE_BUILD_HELPER
+    if (trace_paths != NULL) {
+        /* all threads, including the helper, have been synched with by now */
+        destroy_event(trace_paths->ready);
+        HEAP_TYPE_FREE(GLOBAL_DCONTEXT, trace_paths, trace_path_queue_t,
+                       ACCT_TRACE, UNPROTECTED);
+        trace_paths = NULL;
+    }
+    DELETE_LOCK(trace_path_lock);
+#endif
 }
 
 void
@@ -375,6 +467,11 @@ monitor_thread_init(dcontext_t *dcontext)
                       HEAPACCT(ACCT_THCOUNTER));
     memset(md->thead_table.counter_table, 0, md->thead_table.capacity*
            sizeof(trace_head_counter_t*));
+    /* written on every trace head visit, so it must be unprotected like the counters */
+    md->thead_table.recent = (trace_head_counter_t **)
+        COUNTER_ALLOC(dcontext, TH_RECENT_SLOTS*sizeof(trace_head_counter_t*)
+                      HEAPACCT(ACCT_THCOUNTER));
+    memset(md->thead_table.recent, 0, TH_RECENT_SLOTS*sizeof(trace_head_counter_t*));
 }
 
 /* atexit cleanup */
@@ -416,20 +513,34 @@ monitor_thread_exit(dcontext_t *dcontext)
         COUNTER_FREE(dcontext, md->thead_table.counter_table,
                      md->thead_table.capacity*sizeof(trace_head_counter_t*)
                      HEAPACCT(ACCT_THCOUNTER));
+        COUNTER_FREE(dcontext, md->thead_table.recent,
+                     TH_RECENT_SLOTS*sizeof(trace_head_counter_t*)
+                     HEAPACCT(ACCT_THCOUNTER));
     }
     heap_free(dcontext, md, sizeof(monitor_data_t) HEAPACCT(ACCT_TRACE));
 #endif
 }
 
+/* Every visit to a trace head comes through here, so a hot head's counter
+ * is kept in a direct-mapped slot to avoid walking its hash chain.
+ */
 static trace_head_counter_t *
 thcounter_lookup(dcontext_t *dcontext, app_pc tag)
 {
     monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
     trace_head_counter_t *e;
-    uint hindex = HASH_FUNC((ptr_uint_t)tag, &md->thead_table);
+    trace_head_counter_t **slot = &md->thead_table.recent[TH_RECENT_INDEX(tag)];
+    uint hindex;
+    if (*slot != NULL && (*slot)->tag == tag) {
+        STATS_INC(th_counter_recent_hit);
+        return *slot;
+    }
+    hindex = HASH_FUNC((ptr_uint_t)tag, &md->thead_table);
     for (e = md->thead_table.counter_table[hindex]; e; e = e->next) {
-        if (e->tag == tag)
+        if (e->tag == tag) {
+            *slot = e;
             return e;
+        }
     }
     return NULL;
 }
@@ -447,12 +558,32 @@ thcounter_add(dcontext_t *dcontext, app_pc tag)
         COUNTER_ALLOC(dcontext, sizeof(trace_head_counter_t) HEAPACCT(ACCT_THCOUNTER));
     e->tag = tag;
     e->counter = 0;
+    e->threshold = INTERNAL_OPTION(trace_threshold);
+    /* build a trace on the next visit to a head that was hot in a previous run */
+    if (DYNAMO_OPTION(persist_trace_heads) && trace_profile_is_head(tag))
+        e->counter = e->threshold - 1;
     hindex = HASH_FUNC((ptr_uint_t)e->tag, &md->thead_table);
     e->next = md->thead_table.counter_table[hindex];
     md->thead_table.counter_table[hindex] = e;
+    md->thead_table.recent[TH_RECENT_INDEX(tag)] = e;
     return e;
 }
 
+/* Returns the counter value at which to build a trace from ctr's head.
+ * Under -adaptive_trace_threshold this is doubled while the trace cache is
+ * replacing traces rather than growing, to build fewer of them.
+ */
+static uint
+thcounter_threshold(dcontext_t *dcontext, trace_head_counter_t *ctr)
+{
+    uint threshold = ctr->threshold;
+    if (DYNAMO_OPTION(adaptive_trace_threshold) &&
+        fcache_trace_cache_under_pressure(dcontext)) {
+        threshold = MIN(threshold * 2, DYNAMO_OPTION(trace_threshold_max));
+    }
+    return threshold;
+}
+
 #if 0 /* not used */
 /* delete the trace head entry corresponding to tag if it exists */
 static void
@@ -467,6 +598,8 @@ thcounter_remove(dcontext_t *dcontext, app_pc tag)
                 prev_e->next = e->next;
             else
                 md->thead_table.counter_table[hindex] = e->next;
+            if (md->thead_table.recent[TH_RECENT_INDEX(tag)] == e)
+                md->thead_table.recent[TH_RECENT_INDEX(tag)] = NULL;
             COUNTER_FREE(dcontext, e, sizeof(trace_head_counter_t) HEAPACCT(ACCT_THCOUNTER));
             break;
         }
@@ -493,6 +626,8 @@ thcounter_range_remove(dcontext_t *dcontext, app_pc start, app_pc end)
                     prev_e->next = next_e;
                 else
                     md->thead_table.counter_table[i] = next_e;
+                if (md->thead_table.recent[TH_RECENT_INDEX(e->tag)] == e)
+                    md->thead_table.recent[TH_RECENT_INDEX(e->tag)] = NULL;
                 COUNTER_FREE(dcontext, e, sizeof(trace_head_counter_t)
                              HEAPACCT(ACCT_THCOUNTER));
             } else
@@ -598,6 +733,9 @@ reset_trace_state(dcontext_t *dcontext, bool grab_link_lock)
     md->trace_tag = NULL;  /* indicate return to search mode */
     md->trace_flags = 0;
     md->emitted_size = 0;
+#ifdef TRACE_BUILD_HELPER
+    md->record_path = false;
+#endif
     /* flags may not match, e.g., if frag was marked as trace head */
     ASSERT(md->last_fragment == NULL ||
            (md->last_fragment_flags & (FRAG_CANNOT_DELETE|FRAG_LINKED_OUTGOING)) ==
@@ -1245,6 +1383,113 @@ trace_flags_from_trace_head_flags(uint head_flags)
     return trace_flags;
 }
 
+#ifdef TRACE_BUILD_HELPER
+/* Called when starting a trace, once md->trace_flags and md->pass_to_client
+ * are set: whether to record the trace's path for the helper thread.
+ */
+static bool
+should_record_trace_path(dcontext_t *dcontext)
+{
+    monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
+    return (DYNAMO_OPTION(trace_build_helper) && !trace_paths->helper_failed &&
+            TEST(FRAG_SHARED, md->trace_flags) &&
+            /* clients see the whole trace ilist, so we keep building it */
+            IF_CLIENT_INTERFACE(!md->pass_to_client &&)
+            /* the helper thread itself builds its traces */
+            !IS_CLIENT_THREAD(dcontext));
+}
+
+/* Returns the index of exit l among the exits of its fragment, or -1 if l
+ * is not a real exit.
+ */
+static int
+trace_path_exit_index(dcontext_t *dcontext, linkstub_t *l)
+{
+    fragment_t *f;
+    linkstub_t *e;
+    int i = 0;
+    if (l == NULL || LINKSTUB_FAKE(l))
+        return -1;
+    f = linkstub_fragment(dcontext, l);
+    for (e = FRAGMENT_EXIT_STUBS(f); e != NULL; e = LINKSTUB_NEXT_EXIT(e), i++) {
+        if (e == l)
+            return i;
+    }
+    return -1;
+}
+
+/* The -trace_build_helper counterpart of end_and_emit_trace(): queues the
+ * recorded path for the helper thread and returns this thread to search mode.
+ */
+static fragment_t *
+end_and_queue_trace_path(dcontext_t *dcontext, fragment_t *cur_f)
+{
+    monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
+    app_pc cur_f_tag = cur_f->tag;
+    trace_path_t *path;
+    bool queued = false, start_helper = false;
+    uint i;
+
+    ASSERT(md->num_blks > 0 && md->num_blks <= TRACE_PATH_MAX_BBS);
+    mutex_lock(&trace_path_lock);
+    if (trace_paths->count < TRACE_PATH_QUEUE_SIZE) {
+        path = &trace_paths->path[(trace_paths->head + trace_paths->count) %
+                                  TRACE_PATH_QUEUE_SIZE];
+        path->num_blks = md->num_blks;
+        for (i = 0; i < md->num_blks; i++) {
+            path->tag[i] = md->blk_info[i].info.tag;
+            path->exit[i] = md->blk_info[i].path_exit;
+        }
+        /* A FRAG_MUST_END_TRACE block ends the trace after being added to it */
+        if (TEST(FRAG_MUST_END_TRACE, cur_f->flags) &&
+            cur_f_tag == md->blk_info[md->num_blks - 1].info.tag)
+            path->next_tag = NULL;
+        else
+            path->next_tag = cur_f_tag;
+        path->next_exit = trace_path_exit_index(dcontext, dcontext->last_exit);
+        trace_paths->count++;
+        queued = true;
+        if (!trace_paths->helper_started) {
+            trace_paths->helper_started = true;
+            start_helper = true;
+        }
+    }
+    mutex_unlock(&trace_path_lock);
+    if (queued) {
+        STATS_INC(num_trace_paths_queued);
+        LOG(THREAD, LOG_MONITOR, 2, "Queued path of trace "PFX" (%d blocks)\n",
+            md->trace_tag, md->num_blks);
+        if (start_helper && !dr_create_client_thread(trace_helper_thread, NULL)) {
+            SYSLOG_INTERNAL_WARNING("unable to create trace building helper thread");
+            trace_paths->helper_failed = true;
+        }
+        signal_event(trace_paths->ready);
+    } else {
+        /* the head's counter is reset on its next visit and it will get hot
+         * again, so we simply try later
+         */
+        STATS_INC(num_trace_paths_dropped);
+    }
+
+    /* Tear down as end_and_emit_trace() does, minus the emit */
+    if (md->last_copy != NULL) {
+        if (cur_f == md->last_copy)
+            cur_f = NULL;
+        delete_private_copy(dcontext);
+    }
+    if (md->last_fragment != NULL)
+        internal_restore_last(dcontext);
+    if (md->trace_vmlist != NULL) {
+        vm_area_destroy_list(dcontext, md->trace_vmlist);
+        md->trace_vmlist = NULL;
+    }
+    reset_trace_state(dcontext, true /* might need change_linking_lock */);
+    if (cur_f == NULL)
+        cur_f = fragment_lookup(dcontext, cur_f_tag);
+    return cur_f;
+}
+#endif
+
 /* Be careful with the case where the current fragment f to be executed
  * has the same tag as the one we're emitting as a trace.
  */
@@ -1269,6 +1514,11 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
      * to a trace b/c traces have prefixes that basic blocks don't!
      */
 
+#ifdef TRACE_BUILD_HELPER
+    if (md->record_path)
+        return end_and_queue_trace_path(dcontext, cur_f);
+#endif
+
     DOSTATS({
         /* static count last_exit statistics case 4817 */
         if (LINKSTUB_INDIRECT(dcontext->last_exit->flags)) {
@@ -1361,9 +1611,16 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
                      * all IBLs that never hit by comparing to a 0xbad tag */
                     speculate_next_tag = 0xbad;
 #endif
+                    /* A trace that ends in a loop through an indirect
+                     * branch often returns to its own head, so we can
+                     * speculate on that as a second target.
+                     */
                     md->emitted_size +=
                         append_trace_speculate_last_ibl(dcontext, trace,
                                                         speculate_next_tag,
+                                                        DYNAMO_OPTION
+                                                        (speculate_last_exit_head) ?
+                                                        tag : NULL,
                                                         false);
                 } else {
 #ifdef HASHTABLE_STATISTICS
@@ -1381,6 +1638,11 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
         }
     }
 
+    if (DYNAMO_OPTION(trace_ret_predict)) {
+        md->emitted_size +=
+            append_trace_ret_predict(dcontext, trace, md->trace_flags, false);
+    }
+
     DOLOG(2, LOG_MONITOR, {
         uint i;
         LOG(THREAD, LOG_MONITOR, 2, "Ending and emitting hot trace (tag "PFX")\n", tag);
@@ -1600,7 +1862,7 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
     if (TEST(FRAG_SHARED, md->trace_flags))
         mutex_unlock(&trace_building_lock);
 
-    RSTATS_INC(num_traces);
+    RSTATS_INC_THREAD(num_traces);
     DOSTATS({ IF_X64(if (FRAG_IS_32(trace_f->flags)) STATS_INC(num_32bit_traces);) });
     STATS_ADD(num_bbs_in_all_traces, md->num_blks);
     STATS_TRACK_MAX(max_bbs_in_a_trace, md->num_blks);
@@ -1757,8 +2019,16 @@ internal_extend_trace(dcontext_t *dcontext, fragment_t *f, linkstub_t *prev_l,
 
     md->trace_flags |= trace_flags_from_component_flags(f->flags);
 
-    /* call routine in interp.c */
-    md->emitted_size += extend_trace(dcontext, f, prev_l);
+#ifdef TRACE_BUILD_HELPER
+    if (md->record_path) {
+        /* the helper thread will decode and mangle f */
+        md->blk_info[md->num_blks].info.tag = f->tag;
+        md->blk_info[md->num_blks].path_exit = trace_path_exit_index(dcontext, prev_l);
+        md->num_blks++;
+    } else
+#endif
+        /* call routine in interp.c */
+        md->emitted_size += extend_trace(dcontext, f, prev_l);
 
     LOG(THREAD, LOG_MONITOR, 3, "extending added %d to size of trace => %d total\n",
         md->emitted_size - pre_emitted_size, md->emitted_size);
@@ -1978,6 +2248,7 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
     dr_custom_trace_action_t client = CUSTOM_TRACE_DR_DECIDES;
 #endif
     trace_head_counter_t *ctr;
+    uint threshold;
     uint add_size = 0, prev_mangle_size = 0; /* NOTE these aren't set if end_trace */
 
     if (DYNAMO_OPTION(disable_traces) || f == NULL) {
@@ -2155,6 +2426,10 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
             end_trace = true;
             STATS_INC(num_max_trace_bbs_enforced);
         }
+#ifdef TRACE_BUILD_HELPER
+        if (md->record_path && md->num_blks >= TRACE_PATH_MAX_BBS)
+            end_trace = true;
+#endif
         end_trace = (end_trace ||
                      /* mangling may never use trace buffer memory but just in case */
                      !make_room_in_trace_buffer(dcontext, add_size + prev_mangle_size, f));
@@ -2235,6 +2510,22 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
              */
             SELF_PROTECT_CACHE(dcontext, NULL, READONLY);
         }
+        else if (DYNAMO_OPTION(persist_trace_heads) &&
+                 !TESTANY(FRAG_CANNOT_BE_TRACE|FRAG_COARSE_GRAIN, f->flags) &&
+                 trace_profile_is_head(f->tag)) {
+            /* A hot head in a previous run: no need to wait for a backward branch */
+            bool need_lock = NEED_SHARED_LOCK(f->flags);
+            if (need_lock)
+                acquire_recursive_lock(&change_linking_lock);
+            if (!TEST(FRAG_IS_TRACE_HEAD, f->flags)) {
+                mark_trace_head(dcontext, f, NULL, NULL);
+                STATS_INC(trace_profile_heads_marked);
+            }
+            if (need_lock)
+                release_recursive_lock(&change_linking_lock);
+            SELF_PROTECT_CACHE(dcontext, NULL, READONLY);
+            trace_head = true;
+        }
         else {
             /* whether direct or fake, not marking a trace head */
             trace_head = false;
@@ -2266,9 +2557,26 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
         STATS_INC(th_counter_reset);
     }
 
+    if (DYNAMO_OPTION(adaptive_trace_threshold) &&
+        TEST(FRAG_IS_TRACE, dcontext->last_fragment->flags) &&
+        !LINKSTUB_FAKE(dcontext->last_exit) &&
+        ctr->threshold > DYNAMO_OPTION(trace_threshold_min)) {
+        /* A side exit of a trace, itself hot, is likely to be hot too */
+        ctr->threshold = MAX(ctr->threshold - MAX(ctr->threshold / 8, 1),
+                             DYNAMO_OPTION(trace_threshold_min));
+        STATS_INC(th_threshold_lowered_exit);
+        LOG(THREAD, LOG_MONITOR, 3, "trace head "PFX" threshold lowered to %d\n",
+            f->tag, ctr->threshold);
+    }
+    threshold = thcounter_threshold(dcontext, ctr);
+
     ctr->counter++;
+    DOSTATS({
+        if (ctr->counter == ctr->threshold && threshold > ctr->threshold)
+            STATS_INC(th_threshold_raised_pressure);
+    });
     /* Should never be > here (assert is down below) but we check just in case */
-    if (ctr->counter >= INTERNAL_OPTION(trace_threshold)) {
+    if (ctr->counter >= threshold) {
         /* if cannot delete fragment, do not start trace -- wait until
          * can delete it (w/ exceptions, deletion status changes). */
         if (!TEST(FRAG_CANNOT_DELETE, f->flags)) {
@@ -2297,13 +2605,12 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
             }
         }
         if (!start_trace) {
-            /* Back up the counter by one. This ensures that the
-             * counter will be == trace_threshold if this thread is later
+            /* Back up the counter to just below the threshold. This ensures
+             * that the counter will reach the threshold if this thread is later
              * able to start building a trace w/this tag and ensures
-             * that our one-up sentinel works for lazy clearing.
+             * that our sentinel works for lazy clearing.
              */
-            ctr->counter--;
-            ASSERT(ctr->counter < INTERNAL_OPTION(trace_threshold));
+            ctr->counter = threshold - 1;
         }
     }
 
@@ -2342,8 +2649,10 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
     if (start_trace) {
         KSTART(trace_building);
         /* ensure our sentinel counter value for counter clearing will work */
-        ASSERT(ctr->counter == INTERNAL_OPTION(trace_threshold));
+        ASSERT(ctr->counter >= threshold);
         ctr->counter = TH_COUNTER_CREATED_TRACE_VALUE();
+        if (DYNAMO_OPTION(persist_trace_heads))
+            trace_profile_record_head(f->tag);
         /* Found a hot trace head.  Switch this thread into trace
            selection mode, and initialize the instrlist_t for the new
            trace fragment with this block fragment.  Leave the
@@ -2365,6 +2674,9 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
 #ifdef PROFILE_RDTSC
         if (dynamo_options.profile_times)
             md->emitted_size += profile_call_size();
+#endif
+#ifdef TRACE_BUILD_HELPER
+        md->record_path = should_record_trace_path(dcontext);
 #endif
         LOG(THREAD, LOG_MONITOR, 2,
             "Found hot trace head F%d (tag "PFX")\n", f->id, f->tag);
@@ -2478,6 +2790,18 @@ trace_abort(dcontext_t *dcontext)
         vm_area_destroy_list(dcontext, md->trace_vmlist);
         md->trace_vmlist = NULL;
     }
+    if (DYNAMO_OPTION(adaptive_trace_threshold) && md->trace_tag != NULL) {
+        /* Make a head whose traces keep aborting wait longer before the next
+         * attempt.
+         */
+        trace_head_counter_t *ctr = thcounter_lookup(dcontext, md->trace_tag);
+        if (ctr != NULL && ctr->threshold < DYNAMO_OPTION(trace_threshold_max)) {
+            ctr->threshold = MIN(ctr->threshold * 2, DYNAMO_OPTION(trace_threshold_max));
+            STATS_INC(th_threshold_raised_abort);
+            LOG(THREAD, LOG_MONITOR, 3, "trace head "PFX" threshold raised to %d\n",
+                md->trace_tag, ctr->threshold);
+        }
+    }
     STATS_INC(num_aborted_traces);
     STATS_ADD(num_bbs_in_all_aborted_traces, md->num_blks);
     reset_trace_state(dcontext, true /* might need change_linking_lock */);
@@ -2486,6 +2810,116 @@ trace_abort(dcontext_t *dcontext)
         enter_nolinking(dcontext, NULL, false/*not a cache transition*/);
 }
 
+#ifdef TRACE_BUILD_HELPER
+/* Returns f's exit at index, or NULL if f has no such exit */
+static linkstub_t *
+trace_path_exit_linkstub(fragment_t *f, int index)
+{
+    linkstub_t *l;
+    int i = 0;
+    if (index < 0 || TEST(FRAG_COARSE_GRAIN, f->flags))
+        return NULL;
+    for (l = FRAGMENT_EXIT_STUBS(f); l != NULL; l = LINKSTUB_NEXT_EXIT(l), i++) {
+        if (i == index)
+            return l;
+    }
+    return NULL;
+}
+
+static bool
+trace_helper_take_path(trace_path_t *path)
+{
+    bool found = false;
+    mutex_lock(&trace_path_lock);
+    if (trace_paths->count > 0) {
+        *path = trace_paths->path[trace_paths->head];
+        trace_paths->head = (trace_paths->head + 1) % TRACE_PATH_QUEUE_SIZE;
+        trace_paths->count--;
+        found = true;
+    }
+    mutex_unlock(&trace_path_lock);
+    return found;
+}
+
+/* Builds the trace along path on the helper thread.  We act as dispatch
+ * would had this thread executed the path, taking each recorded exit out of
+ * the private copy of each block, so that monitor_cache_enter() builds and
+ * emits the trace with all of its usual checks.  If the blocks no longer
+ * match the path we give up on it.
+ */
+static void
+build_trace_from_path(dcontext_t *dcontext, trace_path_t *path)
+{
+    monitor_data_t *md = (monitor_data_t *) dcontext->monitor_field;
+    where_am_i_t whereami = dcontext->whereami;
+    trace_head_counter_t *ctr;
+    fragment_t *f, *next;
+    linkstub_t *l;
+    app_pc tag;
+    uint i;
+
+    ASSERT(path->num_blks > 0);
+    enter_couldbelinking(dcontext, NULL, false/*not a cache transition*/);
+    dcontext->whereami = WHERE_DISPATCH;
+    set_last_exit(dcontext, (linkstub_t *) get_starting_linkstub());
+    dcontext->next_tag = path->tag[0];
+    f = fragment_lookup_shared_bb(dcontext, path->tag[0]);
+    if (f == NULL || !TEST(FRAG_IS_TRACE_HEAD, f->flags)) {
+        STATS_INC(num_trace_paths_stale);
+    } else {
+        /* make this visit to the head the one that starts the trace */
+        ctr = thcounter_add(dcontext, f->tag);
+        ctr->counter = thcounter_threshold(dcontext, ctr) - 1;
+        f = monitor_cache_enter(dcontext, f);
+        for (i = 1; i <= path->num_blks && md->trace_tag != NULL; i++) {
+            ASSERT(f != NULL);
+            tag = (i < path->num_blks) ? path->tag[i] : path->next_tag;
+            l = trace_path_exit_linkstub(f, (i < path->num_blks) ? path->exit[i] :
+                                         path->next_exit);
+            if (tag == NULL || l == NULL)
+                break;
+            set_last_exit(dcontext, l);
+            monitor_cache_exit(dcontext);
+            dcontext->next_tag = tag;
+            next = fragment_lookup(dcontext, tag);
+            if (next == NULL) {
+                /* dispatch would build the block: we end the trace before it */
+                SELF_PROTECT_LOCAL(dcontext, WRITABLE);
+                f = end_and_emit_trace(dcontext, f);
+                SELF_PROTECT_LOCAL(dcontext, READONLY);
+                break;
+            }
+            f = monitor_cache_enter(dcontext, next);
+        }
+        if (md->trace_tag != NULL) {
+            /* the path no longer ends where it did for the app thread */
+            trace_abort(dcontext);
+            STATS_INC(num_trace_paths_stale);
+        }
+    }
+    /* we were never in the cache, so leave no exit behind */
+    set_last_exit(dcontext, (linkstub_t *) get_starting_linkstub());
+    dcontext->whereami = whereami;
+    enter_nolinking(dcontext, NULL, false/*not a cache transition*/);
+}
+
+static void
+trace_helper_thread(void *arg)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    trace_path_t path;
+    LOG(THREAD, LOG_MONITOR, 1, "Trace building helper thread started\n");
+    while (true) {
+        /* as in dr_sleep(), we may be synched with while we wait */
+        dcontext->client_data->client_thread_safe_for_synch = true;
+        wait_for_event(trace_paths->ready);
+        dcontext->client_data->client_thread_safe_for_synch = false;
+        while (trace_helper_take_path(&path))
+            build_trace_from_path(dcontext, &path);
+    }
+}
+#endif /* TRACE_BUILD_HELPER */
+
 #if defined(RETURN_AFTER_CALL) || defined(RCT_IND_BRANCH)
 /* PR 204770: use trace component bb tag for RCT source address */
 app_pc
@@ -117,14 +117,27 @@ mangle_trace_at_end(void);
 typedef struct _trace_head_counter_t {
     app_pc tag;
     uint   counter;
+    /* the value of counter at which a trace is built, which
+     * -adaptive_trace_threshold varies per head
+     */
+    uint   threshold;
     /* FIXME: use open-address to save memory, and share code
      * w/ fragment.c?
      */
     struct _trace_head_counter_t *next;
 } trace_head_counter_t;
 
+/* Number of slots in the direct-mapped cache of recently used counters
+ * that is consulted before walking a counter_table chain.  Must be a power of 2.
+ */
+#define TH_RECENT_SLOTS 64
+
 typedef struct _trace_head_table_t {
     trace_head_counter_t **counter_table;
+    /* TH_RECENT_SLOTS entries indexed by tag, each NULL or a counter also
+     * present in counter_table
+     */
+    trace_head_counter_t **recent;
     uint  hash_bits;
     ptr_uint_t  hash_mask;
     uint  hash_mask_offset;
@@ -135,6 +148,11 @@ typedef struct _trace_head_table_t {
     uint  resize_threshold;    /*  = capacity * load_factor */
 } trace_head_table_t;
 
+/* -trace_build_helper hands traces to a DR-created client thread */
+#if defined(CLIENT_SIDELINE) && defined(LINUX)
+# define TRACE_BUILD_HELPER
+#endif
+
 typedef struct _trace_bb_build_t {
     trace_bb_info_t info;
     /* PR 299808: we need to check bb bounds at emit time.  Also used
@@ -147,6 +165,12 @@ typedef struct _trace_bb_build_t {
      * that need to be mangled.
      */
     bool final_cti;
+#ifdef TRACE_BUILD_HELPER
+    /* when only recording a path: the index of the exit of the previous block
+     * that led to this one, or -1
+     */
+    int path_exit;
+#endif
 } trace_bb_build_t;
 
 typedef struct _monitor_data_t {
@@ -189,6 +213,13 @@ typedef struct _monitor_data_t {
      */
     uint           final_exit_flags;
 
+#ifdef TRACE_BUILD_HELPER
+    /* -trace_build_helper: we only record the blocks of this trace, for the
+     * helper thread to build it
+     */
+    bool           record_path;
+#endif
+
 #ifdef CUSTOM_TRACES
     fragment_t     wrapper; /* for creating new shadowed trace heads */
 #endif
@@ -55,6 +55,9 @@
  */
 vm_area_vector_t *native_exec_areas;
 
+/* Starts at 1 so a zeroed dcontext never matches. */
+DECLARE_NEVERPROT_VAR(ptr_uint_t native_call_cache_generation, 1);
+
 static const app_pc retstub_start = (app_pc) back_from_native_retstubs;
 #ifdef DEBUG
 static const app_pc retstub_end = (app_pc) back_from_native_retstubs_end;
@@ -181,8 +184,13 @@ native_exec_module_unload(module_area_t *ma)
         if (is_native)
             native_module_unhook(ma);
 #ifdef UNIX
-        else
+        else {
+            /* The module's ret stubs are about to be freed: drop all threads'
+             * cached stubs.  Writers are serialized by the module list lock.
+             */
+            native_call_cache_generation++;
             native_module_nonnative_mod_unload(ma);
+        }
 #endif
     }
 }
@@ -241,6 +249,10 @@ prepare_return_from_native_via_stub(dcontext_t *dcontext, app_pc *app_sp)
     stub_pc = native_module_get_ret_stub(dcontext, *app_sp);
     if (stub_pc == NULL)
         return false;
+    /* Cache for the inlined lookup in insert_call_to_native(). */
+    dcontext->native_call_retaddr = *app_sp;
+    dcontext->native_call_retstub = stub_pc;
+    dcontext->native_call_generation = native_call_cache_generation;
     *app_sp = stub_pc;
     return true;
 #endif
@@ -40,6 +40,11 @@
 
 extern vm_area_vector_t *native_exec_areas;
 
+/* Bumped whenever ret stubs may have been freed, invalidating every thread's
+ * dcontext->native_call_retaddr cache.
+ */
+extern ptr_uint_t native_call_cache_generation;
+
 void
 native_exec_module_load(module_area_t *ma, bool at_map);
 void
@@ -66,6 +71,13 @@ void
 insert_return_to_native(dcontext_t *dcontext, instrlist_t *ilist, instr_t *where,
                         reg_id_t reg_dc, reg_id_t reg_scratch);
 
+#if defined(UNIX) && defined(X86)
+/* Insert partially inlined call_to_native code */
+void
+insert_call_to_native(dcontext_t *dcontext, instrlist_t *ilist, instr_t *where,
+                      reg_id_t reg_dc, reg_id_t reg_scratch);
+#endif
+
 /* Gets called on every cross-module call out of a native module. */
 void
 native_module_callout(priv_mcontext_t *mc, app_pc target);
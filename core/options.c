@@ -838,6 +838,65 @@ check_option_compatibility_helper(int recurse_count)
         SET_DEFAULT_VALUE(trace_counter_on_delete);
         changed_options = true;
     }
+    if (DYNAMO_OPTION(adaptive_trace_threshold) &&
+        (DYNAMO_OPTION(trace_threshold_min) == 0 ||
+         DYNAMO_OPTION(trace_threshold_min) > INTERNAL_OPTION(trace_threshold) ||
+         DYNAMO_OPTION(trace_threshold_max) < INTERNAL_OPTION(trace_threshold) ||
+         DYNAMO_OPTION(trace_threshold_max) > USHRT_MAX)) {
+        USAGE_ERROR("-trace_threshold_min and -trace_threshold_max must bracket "
+                    "-trace_threshold and be in [1, USHRT_MAX], disabling "
+                    "-adaptive_trace_threshold");
+        dynamo_options.adaptive_trace_threshold = false;
+        changed_options = true;
+    }
+    if (DYNAMO_OPTION(trace_build_helper) &&
+        (!DYNAMO_OPTION(shared_traces) || !DYNAMO_OPTION(shared_bbs))) {
+        USAGE_ERROR("-trace_build_helper requires -shared_traces and -shared_bbs");
+        dynamo_options.trace_build_helper = false;
+        changed_options = true;
+    }
+#if !defined(CLIENT_SIDELINE) || !defined(LINUX)
+    if (DYNAMO_OPTION(trace_build_helper)) {
+        USAGE_ERROR("-trace_build_helper is only supported on Linux");
+        dynamo_options.trace_build_helper = false;
+        changed_options = true;
+    }
+#endif
+    if (DYNAMO_OPTION(decode_cache) && !INTERNAL_OPTION(hw_cache_consistency)) {
+        /* without write notifications we can't tell when a cached decode is stale */
+        USAGE_ERROR("-decode_cache requires -hw_cache_consistency");
+        dynamo_options.decode_cache = false;
+        changed_options = true;
+    }
+    if (DYNAMO_OPTION(shared_table_lockfree_reads) &&
+        DYNAMO_OPTION(shared_table_resize_step) > 0) {
+        USAGE_ERROR("-shared_table_lockfree_reads does not support "
+                    "-shared_table_resize_step, disabling the latter");
+        dynamo_options.shared_table_resize_step = 0;
+        changed_options = true;
+    }
+#ifndef X86
+    if (DYNAMO_OPTION(shared_table_lockfree_reads)) {
+        USAGE_ERROR("-shared_table_lockfree_reads is only supported on x86");
+        dynamo_options.shared_table_lockfree_reads = false;
+        changed_options = true;
+    }
+#endif
+#ifdef CLIENT_INTERFACE
+# ifndef X86
+    if (DYNAMO_OPTION(fragment_counts)) {
+        USAGE_ERROR("-fragment_counts is only supported on x86");
+        dynamo_options.fragment_counts = false;
+        changed_options = true;
+    }
+# endif
+    if (DYNAMO_OPTION(fragment_counts) && DYNAMO_OPTION(coarse_units)) {
+        /* Persisted code cannot embed our absolute counter addresses. */
+        USAGE_ERROR("-fragment_counts not compatible with -coarse_units, disabling");
+        dynamo_options.fragment_counts = false;
+        changed_options = true;
+    }
+#endif
     if (INTERNAL_OPTION(alt_hash_func) >= HASH_FUNCTION_ENUM_MAX) {
         USAGE_ERROR("Invalid selection (%d) for shared cache hash func, must be < %d",
                     INTERNAL_OPTION(alt_hash_func),
@@ -938,6 +997,14 @@ check_option_compatibility_helper(int recurse_count)
         dynamo_options.protect_mask &= ~SELFPROT_DCONTEXT;
         changed_options = true;
     }
+    if (DYNAMO_OPTION(global_heap_magazines) &&
+        TEST(SELFPROT_GLOBAL, dynamo_options.protect_mask)) {
+        /* magazines write to global blocks outside of global_alloc_lock */
+        USAGE_ERROR("-global_heap_magazines is incompatible with protecting the "
+                    "global heap");
+        dynamo_options.global_heap_magazines = false;
+        changed_options = true;
+    }
 #ifdef TRACE_HEAD_CACHE_INCR
     if (TESTANY(SELFPROT_LOCAL|SELFPROT_GLOBAL, dynamo_options.protect_mask)) {
         USAGE_ERROR("Cannot protect heap in a TRACE_HEAD_CACHE_INCR build");
@@ -1493,6 +1560,12 @@ check_option_compatibility_helper(int recurse_count)
     }
 #endif
 
+    if (DYNAMO_OPTION(ibl_l1_bits) > IBL_L1_BITS_MAX) {
+        USAGE_ERROR("-ibl_l1_bits can be at most %d", IBL_L1_BITS_MAX);
+        dynamo_options.ibl_l1_bits = IBL_L1_BITS_MAX;
+        changed_options = true;
+    }
+
     if (DYNAMO_OPTION(ibl_hash_func_offset) > IBL_HASH_FUNC_OFFSET_MAX) {
         USAGE_ERROR("-ibl_hash_func_offset currently can only be 0, 1, 2, or 3"
                     IF_X64(" or 4"));
@@ -1926,6 +1999,32 @@ check_option_compatibility_helper(int recurse_count)
         }
     }
 
+#if defined(EXPOSE_INTERNAL_OPTIONS) && defined(X64) && defined(X86)
+    /* Most of the trace optimizations in optimize.c assume a 32-bit register
+     * model and 32-bit immediates.  Only the peephole pass has been made
+     * x64-safe so far.
+     */
+    if (dynamo_options.prefetch || dynamo_options.rlr || dynamo_options.vectorize ||
+        dynamo_options.unroll_loops || dynamo_options.stack_adjust ||
+        dynamo_options.remove_dead_code > 0 || dynamo_options.constant_prop > 0 ||
+        dynamo_options.call_return_matching ||
+        dynamo_options.remove_unnecessary_zeroing) {
+        USAGE_ERROR("only -peephole and -instr_counts trace optimizations are "
+                    "supported on x64: disabling the rest");
+        dynamo_options.prefetch = false;
+        dynamo_options.rlr = false;
+        dynamo_options.vectorize = false;
+        dynamo_options.unroll_loops = false;
+        dynamo_options.stack_adjust = false;
+        dynamo_options.remove_dead_code = 0;
+        dynamo_options.constant_prop = 0;
+        dynamo_options.call_return_matching = false;
+        dynamo_options.remove_unnecessary_zeroing = false;
+        dynamo_options.optimize = dynamo_options.peephole || dynamo_options.instr_counts;
+        changed_options = true;
+    }
+#endif
+
 #ifdef X64
     if (DYNAMO_OPTION(x86_to_x64)) {
         /* i#1494: to avoid decode_fragment messing up the 32-bit/64-bit mode,
@@ -226,6 +226,8 @@
 
     PC_OPTION_INTERNAL(bool, nolink, "disable linking")
     PC_OPTION_DEFAULT_INTERNAL(bool, link_ibl, true, "link indirect branches")
+    OPTION(bool, lazy_link,
+           "link shared bb exits when first taken rather than when the bb is built")
     OPTION_INTERNAL(bool, tracedump_binary, "binary dump of traces (after optimization)")
     OPTION_INTERNAL(bool, tracedump_text, "text dump of traces (after optimization)")
     OPTION_INTERNAL(bool, tracedump_origins, "write out original instructions for each trace")
@@ -249,6 +251,10 @@
     OPTION_INTERNAL(bool, bbdump_tags, "dump tags, sizes, and sharedness of all bbs")
     OPTION_INTERNAL(bool, gendump, "dump generated code")
     OPTION_DEFAULT(bool, global_rstats, true, "enable global release-build statistics")
+#ifdef LINUX
+    OPTION_DEFAULT(bool, stats_shmem, false,
+                   "export global statistics in a shared memory file for live viewing")
+#endif
 
     /* this takes precedence over the DYNAMORIO_VAR_LOGDIR config var */
     OPTION_DEFAULT(pathstring_t, logdir, EMPTY_STRING,
@@ -315,12 +321,37 @@
 
 #if defined(UNIX)
     OPTION_NAME_INTERNAL(bool, profile_pcs, "prof_pcs", "pc-sampling profiling")
+    OPTION_DEFAULT_INTERNAL(uint, prof_pcs_interval, 10,
+        "pc-sampling interval in milliseconds, requires -prof_pcs")
 #else
 # ifdef WINDOWS_PC_SAMPLE
      OPTION_NAME(bool, profile_pcs, "prof_pcs", "pc-sampling profiling")
 # endif
 #endif
 
+#ifdef CLIENT_INTERFACE
+    /* Cheap per-site indirect branch target counts for dr_ibl_profile_iterate(),
+     * gathered in dispatch rather than in the inlined lookup routines.
+     */
+    OPTION_DEFAULT(bool, ibl_profile, false,
+                   "record indirect branch (site, target) pairs for clients")
+    /* Per-tag execution counters for dr_fragment_exec_count(), incremented
+     * inline at the top of each block and kept across fragment replacement.
+     */
+    OPTION_DEFAULT(bool, fragment_counts, false,
+                   "count block executions inline for dr_fragment_exec_count()")
+#endif
+
+    /* Release-build histogram of why and for how long we leave the code cache */
+    OPTION_DEFAULT(bool, exit_profile, false,
+                   "count code cache exits and time spent in DR by exit reason")
+
+    /* Release-build timing of each startup phase, printed to stderr */
+    OPTION_DEFAULT(bool, startup_profile, false,
+                   "time each phase of initialization and the first blocks built")
+    OPTION_DEFAULT(uint, startup_profile_blocks, 100,
+                   "number of initial blocks timed by -startup_profile")
+
 #ifdef EXPOSE_INTERNAL_OPTIONS
 # ifdef PROFILE_RDTSC
     OPTION_NAME_INTERNAL(bool, profile_times, "prof_times", "profiling via measuring time"))
@@ -684,6 +715,9 @@
 
     /* PR 304708: we intercept all signals for a better client interface */
     OPTION_DEFAULT(bool, intercept_all_signals, true, "intercept all signals")
+    OPTION_DEFAULT(bool, signal_fast_delivery, false,
+                   "deliver signals raised in the code cache straight to an "
+                   "existing fragment for the handler rather than via dispatch")
 
     /* i#853: Use our all_memory_areas address space cache when possible.  This
      * avoids expensive reads of /proc/pid/maps, but if the cache becomes stale,
@@ -792,6 +826,14 @@
      }, "enable trace creation", STATIC, OP_PCACHE_GLOBAL)
     OPTION_DEFAULT_INTERNAL(uint, trace_counter_on_delete, 0U,
         "trace head counter will be reset to this value upon trace deletion")
+    OPTION_DEFAULT(bool, adaptive_trace_threshold, false,
+        "vary the trace threshold per trace head based on trace aborts, trace exits, and trace cache pressure")
+    OPTION_DEFAULT(uint, trace_threshold_min, 8U,
+        "lowest per-head threshold for -adaptive_trace_threshold")
+    OPTION_DEFAULT(uint, trace_threshold_max, 1000U,
+        "highest per-head threshold for -adaptive_trace_threshold")
+    OPTION_DEFAULT(bool, trace_build_helper, false,
+        "record the paths of new shared traces and build them on a helper thread")
 
     OPTION_DEFAULT(uint, max_elide_jmp,  16,
         "maximum direct jumps to elide in a basic block")
@@ -806,6 +848,20 @@
         "maximum write instrs per selfmod fragment")
     OPTION_DEFAULT(uint, max_bb_instrs, 1024,
         "maximum instrs per basic block")
+    OPTION_DEFAULT(bool, bb_ir_arena, false,
+        "allocate the IR of a basic block being built from a per-thread arena")
+    OPTION_DEFAULT(bool, decode_cache, false,
+        "reuse full decodes of application code when rebuilding basic blocks")
+    OPTION_DEFAULT(bool, thread_scoped_flush, false,
+        "with only thread-private fragments, let threads with nothing in a flushed "
+        "region keep running during the flush")
+    OPTION_DEFAULT(bool, encode_cache, false,
+        "reuse the encodings of repeated position-independent instrs such as spills")
+    OPTION_DEFAULT(uint, stack_cache, 0,
+        "number of freed DR stacks (up to 64) to keep for reuse by new threads")
+    OPTION_DEFAULT(bool, thread_rstats, false,
+        "batch hot-path release stats in per-thread counters before adding them "
+        "to the shared global stats")
     PC_OPTION_DEFAULT(bool, process_SEH_push,
         IF_RETURN_AFTER_CALL_ELSE(true, false),
         "break bb's at an SEH push so we can see the frame pushed on in "
@@ -951,6 +1007,12 @@
     OPTION_DEFAULT(bool, ref_count_shared_ibt_tables, true,
         "use ref-counting to free thread-shared IBT tables prior to process exit")
 
+    /* Relies on x86 not reordering loads with other loads */
+    OPTION_DEFAULT(bool, shared_table_lockfree_reads, false,
+        "look up thread-shared BBs and traces without the table read lock, keeping resized-away tables until reset")
+    OPTION_DEFAULT(uint, shared_table_resize_step, 0,
+        "resize the thread-shared BB and trace tables incrementally, moving this many old buckets per add (0 = all at once)")
+
     /* PR 361894: if no TLS available, we fall back to thread-private */
     OPTION_DEFAULT(bool, ibl_table_in_tls, IF_HAVE_TLS_ELSE(true, false),
         "use TLS to hold IBL table addresses & masks")
@@ -1012,6 +1074,11 @@
                    "share ibl routine for traces")
     OPTION_DEFAULT(bool, speculate_last_exit, false,
         "enable speculative linking of trace last IB exit")
+    OPTION_DEFAULT(bool, speculate_last_exit_head, false,
+        "with -speculate_last_exit, also speculate that the trace's last IB exit returns to the trace head")
+    /* Only implemented for 32-bit code. */
+    OPTION_DEFAULT(bool, trace_ret_predict, false,
+        "predict that a return in a trace goes to the return address of the last call made from a trace")
 
     OPTION_DEFAULT(uint, max_trace_bbs, 128, "maximum number of basic blocks in a trace")
 
@@ -1156,6 +1223,11 @@
      */
     OPTION_DEFAULT_INTERNAL(uint_size, max_heap_unit_size, 256*1024, "maximum heap unit size")
     OPTION_DEFAULT(uint_size, heap_commit_increment, 4*1024, "heap commit increment")
+    /* Debug builds account for and check every global block under the lock,
+     * so this is ignored there.
+     */
+    OPTION_DEFAULT(bool, global_heap_magazines, false,
+                   "cache freed global heap blocks in per-thread magazines")
     OPTION_DEFAULT(uint, cache_commit_increment, 4*1024, "cache commit increment")
 
     /* cache capacity control
@@ -1232,6 +1304,11 @@
     OPTION_DEFAULT(uint_size, cache_shared_trace_unit_quadruple, (64*1024), /* FIXME: should be 32*1024 */
         "shared trace cache units are grown by 4X until this size, in KB or MB")
         /* default size is in Kilobytes, Examples: 4, 4k, 4m, or 0 for unlimited */
+    OPTION_DEFAULT(uint_size, cache_shared_trace_hot_region, 0,
+        "reserve one contiguous region of this size, in KB or MB, for the first shared "
+        "trace cache unit so that hot traces are laid out together, apart from basic "
+        "blocks; 0 to disable")
+        /* default size is in Kilobytes, Examples: 4, 4k, 4m, or 0 for unlimited */
 
     OPTION(uint_size, cache_coarse_bb_max, "max size of coarse bb cache, in KB or MB")
             /* override the default coarse bb fragment cache size */
@@ -1298,6 +1375,8 @@
         /* doesn't mean much for shared sizing, so default 100 makes
          * regen param a percentage */
         "#regen per #replaced ratio for sizing shared coarse cache")
+    OPTION_DEFAULT(bool, cache_autotune, false,
+        "adjust each cache's regen threshold based on recent replacement windows")
 
     OPTION_DEFAULT(uint, cache_trace_align, 8, "alignment of trace cache slots")
     OPTION_DEFAULT(uint, cache_bb_align, 4, "alignment of bb cache slots")
@@ -1307,6 +1386,11 @@
         "#write faults in a region before switching to sandboxing, 0 to disable")
     OPTION_DEFAULT(uint, sandbox2ro_threshold, 20,
         "#executions in a sandboxed region before switching to page prot, 0 to disable")
+    OPTION_DEFAULT(bool, selfmod_line_shadow, false,
+        "track which sub-page lines of read-only code pages code was built from, "
+        "and emulate writes that miss them instead of flushing (Linux x86 only)")
+    OPTION_DEFAULT(uint, selfmod_line_emulate_max, 100,
+        "#emulated writes to a page before letting one through to a flush")
 
     OPTION_COMMAND(bool, sandbox_writable, false, "sandbox_writable", {
         if (options->sandbox_writable) {
@@ -1385,6 +1469,8 @@
         "reset all caches every nth bb cache unit that is created/reused")
     OPTION(uint, reset_every_nth_trace_unit,
         "reset all caches every nth trace cache unit that is created/reused")
+    OPTION_DEFAULT(bool, reset_warm_traces, false,
+        "on a reset, rebuild each discarded trace on its head's next execution")
 
     /* virtual memory management */
     /* See case 1990 for examples where we have to fight for virtual address space with the app */
@@ -1417,6 +1503,25 @@
                    "requested size, try smaller sizes instead of dying")
     OPTION_DEFAULT(bool, vm_base_near_app, true,
                    "allocate vm region near the app")
+#if defined(X64) && defined(UNIX)
+    OPTION_DEFAULT(liststring_t, vm_reach_modules, EMPTY_STRING,
+                   "with -vm_base_near_app, ;-separated libraries, hottest first, to "
+                   "also keep within 32-bit reach of the vm region where they fit, "
+                   "so that fewer of their rip-relative references need mangling")
+#endif
+#ifdef LINUX
+    OPTION_DEFAULT(bool, vm_huge_pages, false,
+                   "align the vm region to huge pages and back it with transparent huge "
+                   "pages, and carve executable units such as the code cache's from its "
+                   "top so that code shares as few pages as possible")
+    OPTION_DEFAULT(bool, numa_local_private, false,
+                   "prefer the NUMA node of the creating thread's cpu for the pages of "
+                   "thread-private heap and code cache units")
+    OPTION_DEFAULT(uint_size, free_unit_trim_threshold, 0,
+                   "once the heap or code cache free list holds more than this many "
+                   "committed bytes, hand the pages of further freed units back to the "
+                   "kernel (0 disables)")
+#endif
 #ifdef X64
     /* We prefer low addresses in general, and only need this option if it's
      * an absolute requirement (XXX i#829: it is required for mixed-mode).
@@ -2034,6 +2139,9 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
                            "freeze coarse units at process exit")
     DYNAMIC_OPTION_DEFAULT(bool, coarse_freeze_at_unload, false,
                            "freeze coarse units at module unload or other flush")
+    DYNAMIC_OPTION_DEFAULT(uint, coarse_freeze_every_nth_fragment, 0,
+                           "persist coarse units every time this many new coarse "
+                           "fragments have been built (0 disables)")
     /* Remember that this is a threshold on per-module per-run new generated code.
      * Though bb building time would recommend a fragment count threshold, for
      * sharing benefits we care about code size.
@@ -2150,6 +2258,11 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
 #ifdef UNIX
     OPTION_DEFAULT(bool, persist_trust_textrel, true,
         "if textrel flag is not set, assume module has no text relocs")
+#endif
+#ifdef LINUX
+    OPTION_DEFAULT(bool, persist_trust_build_id, true,
+        "if a module has a GNU build id, validate a persisted cache against the id "
+        "and the module's header checksum instead of against the module's md5")
 #endif
     /* the DYNAMORIO_VAR_PERSCACHE_ROOT config var takes precedence over this */
     OPTION_DEFAULT(pathstring_t, persist_dir, EMPTY_STRING,
@@ -2157,6 +2270,9 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
     /* the DYNAMORIO_VAR_PERSCACHE_SHARED config var takes precedence over this */
     OPTION_DEFAULT(pathstring_t, persist_shared_dir, EMPTY_STRING,
         "base shared directory for persistent caches")
+    OPTION_DEFAULT(bool, persist_trace_heads, false,
+        "save the heads of hot traces per module in the persistent cache directory, "
+        "and mark them as trace heads with primed counters in later runs")
     /* convenience option */
     OPTION_COMMAND(bool, persist, false, "persist", {
         if (options->persist) {
@@ -2713,6 +2829,13 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
     OPTION_DEFAULT_INTERNAL(bool, ibl_sentinel_check, true, /* case 2174: FIXME: remove when working fine */
         "check for sentinel overwraps in IBL routine instead of exit")
 
+    OPTION_DEFAULT(bool, ibl_unroll_probes, false,
+        "on an IBL collision, probe the rest of the table's cache line inline before looping back")
+
+    /* Only implemented for x86 and x64, and needs -ibl_table_in_tls. */
+    OPTION_DEFAULT(uint, ibl_l1_bits, 0,
+        "log2 of the entries in a per-thread first-level IBL target cache probed before each IBL table (0 disables)")
+
     OPTION_DEFAULT(bool, ibl_addr_prefix, false, /* case 5231: FIXME: remove when working fine */
         "uses shorter but slower encode with addr16 prefix in IBL routine and elsewhere")
 
@@ -129,6 +129,17 @@ void os_heap_decommit(void *p, size_t size, heap_error_code_t *error_code);
 /* frees size bytes starting at address p (note - on windows the entire allocation
  * containing p is freed and size is ignored) */
 void os_heap_free(void *p, size_t size, heap_error_code_t *error_code);
+#ifdef LINUX
+/* asks for reserved memory to be backed by transparent huge pages as it is
+ * committed; returns false if the kernel does not support them */
+bool os_heap_advise_huge_pages(void *p, size_t size);
+/* asks for the pages of [p, p+size) to be placed on the NUMA node of the
+ * calling thread's current cpu; returns false if the kernel refuses */
+bool os_heap_bind_local_node(void *p, size_t size);
+/* drops the physical pages backing [p, p+size) while keeping the range
+ * committed: it reads back as zero and is repopulated on the next touch */
+bool os_heap_discard_pages(void *p, size_t size);
+#endif
 
 /* prognosticate whether systemwide memory pressure based on
  * last_error_code and systemwide omens
@@ -928,11 +939,9 @@ query_time_seconds(void);
 uint64
 query_time_millis(void);
 
-#ifdef UNIX
 /* microseconds since 1601 */
 uint64
 query_time_micros();
-#endif
 
 /* gives a good but not necessarily crypto-strength random seed */
 uint
@@ -385,9 +385,19 @@ coarse_unit_reset_free(dcontext_t *dcontext, coarse_info_t *info,
  */
 static file_t perscache_user_directory = INVALID_FILE;
 
+/* -persist_trace_heads table: keys are tags; payloads are the base of the
+ * tag's module
+ */
+static generic_table_t *trace_profile;
+
+static void trace_profile_init(void);
+static void trace_profile_exit(void);
+
 void
 perscache_init(void)
 {
+    if (DYNAMO_OPTION(persist_trace_heads))
+        trace_profile_init();
     if (DYNAMO_OPTION(use_persisted) &&
         DYNAMO_OPTION(persist_per_user) &&
         DYNAMO_OPTION(validate_owner_dir)) {
@@ -440,6 +450,8 @@ perscache_fast_exit(void)
     if (DYNAMO_OPTION(coarse_freeze_at_exit)) {
         coarse_units_freeze_all(false/*!in place*/);
     }
+    if (trace_profile != NULL)
+        trace_profile_exit();
 
     if (perscache_user_directory != INVALID_FILE) {
         ASSERT_CURIOSITY(DYNAMO_OPTION(validate_owner_dir));
@@ -2283,7 +2295,7 @@ persist_get_relevant_options(dcontext_t *dcontext, char *option_buf,
 static bool
 get_persist_filename(char *filename /*OUT*/, uint filename_max /* max #chars */,
                      app_pc modbase, bool write, persisted_module_info_t *modinfo,
-                     const char *option_string)
+                     const char *option_string, const char *suffix)
 {
     uint checksum, timestamp;
     size_t size, code_size;
@@ -2387,7 +2399,7 @@ get_persist_filename(char *filename /*OUT*/, uint filename_max /* max #chars */,
      * ranges per file.
      */
     snprintf(filename, filename_max, "%s%c%s%s-0x%08x.%s", dir, DIRSEP, name,
-             IF_DEBUG_ELSE("-dbg", ""), hash, PERSCACHE_FILE_SUFFIX);
+             IF_DEBUG_ELSE("-dbg", ""), hash, suffix);
     filename[filename_max-1] = '\0';
     os_get_module_info_unlock();
     if (modinfo != NULL) {
@@ -2476,23 +2488,24 @@ persist_calculate_module_digest(module_digest_t *digest, app_pc modbase, size_t
     }
 }
 
-/* Compares all but the module base */
+/* Compares all but the module base, and the module md5 as selected by validation */
 static bool
-persist_modinfo_cmp(persisted_module_info_t *mi1, persisted_module_info_t *mi2)
+persist_modinfo_cmp(persisted_module_info_t *mi1, persisted_module_info_t *mi2,
+                    uint validation)
 {
     bool match = true;
     /* We'd like to know if we have an md5 mismatch */
     ASSERT_CURIOSITY(module_digests_equal(&mi1->module_md5, &mi2->module_md5,
                                           TEST(PERSCACHE_MODULE_MD5_SHORT,
-                                               DYNAMO_OPTION(persist_load_validation)),
+                                               validation),
                                           TEST(PERSCACHE_MODULE_MD5_COMPLETE,
-                                               DYNAMO_OPTION(persist_load_validation)))
+                                               validation))
                      /* relocs => md5 diffs, until we handle relocs wrt md5 */
                      IF_WINDOWS(|| mi1->base != mi2->base)
                      || check_filter("win32.partial_map.exe",
                                      get_short_name(get_application_name())));
     if (TESTALL(PERSCACHE_MODULE_MD5_SHORT|PERSCACHE_MODULE_MD5_COMPLETE,
-                DYNAMO_OPTION(persist_load_validation))) {
+                validation)) {
         return (memcmp(&mi1->checksum, &mi2->checksum,
                        sizeof(*mi1)-offsetof(persisted_module_info_t, checksum)) == 0);
     }
@@ -2501,9 +2514,9 @@ persist_modinfo_cmp(persisted_module_info_t *mi1, persisted_module_info_t *mi2)
                              offsetof(persisted_module_info_t, checksum)) == 0);
     match = match && module_digests_equal(&mi1->module_md5, &mi2->module_md5,
                                           TEST(PERSCACHE_MODULE_MD5_SHORT,
-                                               DYNAMO_OPTION(persist_load_validation)),
+                                               validation),
                                           TEST(PERSCACHE_MODULE_MD5_COMPLETE,
-                                               DYNAMO_OPTION(persist_load_validation)));
+                                               validation));
     return match;
 }
 
@@ -3318,7 +3331,8 @@ coarse_unit_persist(dcontext_t *dcontext, coarse_info_t *info)
     /* get_persist_filename() fills in pers.modinfo */
     memset(&pers, 0, sizeof(pers));
     if (!get_persist_filename(filename, BUFFER_SIZE_ELEMENTS(filename), modbase,
-                              true/*write*/, &pers.modinfo, option_string)) {
+                              true/*write*/, &pers.modinfo, option_string,
+                              PERSCACHE_FILE_SUFFIX)) {
         LOG(THREAD, LOG_CACHE, 1, "  error calculating filename (or excluded)\n");
         STATS_INC(coarse_units_persist_error);
         goto coarse_unit_persist_exit;
@@ -3746,7 +3760,8 @@ persist_get_name_and_open(dcontext_t *dcontext, app_pc modbase,
                                                       option_buf_sz, *option_level);
         memset(modinfo, 0, sizeof(*modinfo));
         if (!get_persist_filename(filename, filename_sz, modbase,
-                                  false/*read*/, modinfo, *option_string)) {
+                                  false/*read*/, modinfo, *option_string,
+                                  PERSCACHE_FILE_SUFFIX)) {
             LOG(THREAD, LOG_CACHE, 1,
                 "  error computing name/excluded for "PFX"-"PFX"\n", start, end);
             STATS_INC(perscache_load_noname);
@@ -3815,6 +3830,7 @@ coarse_unit_load(dcontext_t *dcontext, app_pc start, app_pc end,
     size_t stubs_and_prefixes_len;
     byte *pc, *rx_pc, *rwx_pc;
     persisted_module_info_t modinfo;
+    uint validation;
     app_pc modbase = get_module_base(start);
     bool success = false;
     DEBUG_DECLARE(bool ok;)
@@ -3961,13 +3977,20 @@ coarse_unit_load(dcontext_t *dcontext, app_pc start, app_pc end,
     }
 
     /* Consistency with original module */
+    validation = DYNAMO_OPTION(persist_load_validation);
+#ifdef LINUX
+    /* The build id and the header checksum, which get_persist_filename() put
+     * in modinfo, already identify the module, so we skip walking its pages.
+     */
+    if (DYNAMO_OPTION(persist_trust_build_id) && module_has_build_id(modbase))
+        validation &= ~(PERSCACHE_MODULE_MD5_SHORT|PERSCACHE_MODULE_MD5_COMPLETE);
+#endif
     persist_calculate_module_digest(&modinfo.module_md5, modbase,
                                     (size_t) modinfo.image_size,
                                     modbase + pers->start_offs,
-                                    modbase + pers->end_offs,
-                                    DYNAMO_OPTION(persist_load_validation));
+                                    modbase + pers->end_offs, validation);
     /* Compare the module digest and module fields (except base) all at once */
-    if (!persist_modinfo_cmp(&modinfo, &pers->modinfo)) {
+    if (!persist_modinfo_cmp(&modinfo, &pers->modinfo, validation)) {
         LOG(THREAD, LOG_CACHE, 1, "  module info mismatch\n");
         DOLOG(1, LOG_CACHE, {
             LOG(THREAD, LOG_CACHE, 1, "modinfo stored in file: ");
@@ -4415,3 +4438,205 @@ mark_module_exempted(app_pc pc)
     }
 }
 
+
+/***************************************************************************
+ * TRACE HEAD PROFILES
+ */
+
+/* Under -persist_trace_heads we remember the tags of trace heads that got hot
+ * enough to build a trace, keyed by the module they are in.  When a module is
+ * unloaded, or at exit, its heads are written as module offsets to a file
+ * named like its persisted cache, so a different build of the module does not
+ * pick them up.  When the module is next loaded we read them back, and
+ * monitor.c marks those blocks as trace heads as soon as they are executed and
+ * starts their counters at the threshold.
+ */
+
+#define TRACE_PROFILE_FILE_SUFFIX "dth"
+#define TRACE_PROFILE_MAX_HEADS 4096
+#define INIT_HTABLE_SIZE_TRACE_PROFILE 9
+
+enum {
+    TRACE_PROFILE_MAGIC = 0x48545244, /* DRTH */
+    TRACE_PROFILE_VERSION = 1,
+};
+
+typedef struct _trace_profile_header_t {
+    uint magic;
+    uint version;
+    /* the module's size, as a sanity check on the offsets */
+    uint64 image_size;
+    uint num_heads;
+    /* followed by num_heads uint offsets from the module base */
+} trace_profile_header_t;
+
+static void
+trace_profile_init(void)
+{
+    trace_profile = generic_hash_create(GLOBAL_DCONTEXT, INIT_HTABLE_SIZE_TRACE_PROFILE,
+                                        80 /* load factor */, HASHTABLE_SHARED,
+                                        NULL _IF_DEBUG("trace head profile"));
+}
+
+/* Removes modbase's heads from the table and writes them to modbase's profile */
+static void
+trace_profile_save(app_pc modbase)
+{
+    char filename[MAXIMUM_PATH];
+    trace_profile_header_t hdr;
+    persisted_module_info_t modinfo;
+    uint *offs;
+    uint max, num = 0;
+    ptr_uint_t key;
+    void *payload;
+    int iter = 0;
+    file_t fd;
+
+    TABLE_RWLOCK(trace_profile, write, lock);
+    max = MIN(trace_profile->entries, TRACE_PROFILE_MAX_HEADS);
+    if (max == 0) {
+        TABLE_RWLOCK(trace_profile, write, unlock);
+        return;
+    }
+    offs = HEAP_ARRAY_ALLOC(GLOBAL_DCONTEXT, uint, max, ACCT_OTHER, PROTECTED);
+    while ((iter = generic_hash_iterate_next(GLOBAL_DCONTEXT, trace_profile, iter,
+                                             &key, &payload)) >= 0) {
+        if ((app_pc)payload != modbase)
+            continue;
+        if (num < max) {
+            IF_X64(ASSERT(CHECK_TRUNCATE_TYPE_uint(key - (ptr_uint_t)modbase)));
+            offs[num++] = (uint)(key - (ptr_uint_t)modbase);
+        }
+        iter = generic_hash_iterate_remove(GLOBAL_DCONTEXT, trace_profile, iter, key);
+    }
+    TABLE_RWLOCK(trace_profile, write, unlock);
+
+    if (num > 0 &&
+        get_persist_filename(filename, BUFFER_SIZE_ELEMENTS(filename), modbase,
+                             true/*write*/, &modinfo, NULL,
+                             TRACE_PROFILE_FILE_SUFFIX)) {
+        fd = os_open(filename, OS_OPEN_WRITE | OS_OPEN_FORCE_OWNER);
+        if (fd != INVALID_FILE) {
+            hdr.magic = TRACE_PROFILE_MAGIC;
+            hdr.version = TRACE_PROFILE_VERSION;
+            hdr.image_size = modinfo.image_size;
+            hdr.num_heads = num;
+            if (os_write(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) ||
+                os_write(fd, offs, num*sizeof(uint)) != (ssize_t)(num*sizeof(uint))) {
+                LOG(GLOBAL, LOG_CACHE, 1, "  unable to write %s\n", filename);
+                os_close(fd);
+                os_delete_file(filename);
+            } else {
+                LOG(GLOBAL, LOG_CACHE, 1, "  wrote %d trace heads to %s\n",
+                    num, filename);
+                STATS_ADD(trace_profile_heads_saved, num);
+                os_close(fd);
+            }
+        } else
+            LOG(GLOBAL, LOG_CACHE, 1, "  unable to open %s\n", filename);
+    }
+    HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, offs, uint, max, ACCT_OTHER, PROTECTED);
+}
+
+static void
+trace_profile_exit(void)
+{
+    ptr_uint_t key;
+    void *payload;
+    /* Each save removes one module's heads */
+    while (generic_hash_iterate_next(GLOBAL_DCONTEXT, trace_profile, 0,
+                                     &key, &payload) >= 0)
+        trace_profile_save((app_pc)payload);
+    generic_hash_destroy(GLOBAL_DCONTEXT, trace_profile);
+    trace_profile = NULL;
+}
+
+void
+trace_profile_module_load(app_pc base)
+{
+    char filename[MAXIMUM_PATH];
+    trace_profile_header_t hdr;
+    persisted_module_info_t modinfo;
+    uint *offs = NULL;
+    uint64 file_size;
+    uint i;
+    file_t fd;
+
+    if (trace_profile == NULL)
+        return;
+    if (!get_persist_filename(filename, BUFFER_SIZE_ELEMENTS(filename), base,
+                              false/*read*/, &modinfo, NULL,
+                              TRACE_PROFILE_FILE_SUFFIX))
+        return;
+    fd = os_open(filename, OS_OPEN_READ);
+    if (fd == INVALID_FILE)
+        return;
+    if (!os_get_file_size_by_handle(fd, &file_size) ||
+        file_size < sizeof(hdr) ||
+        os_read(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) ||
+        hdr.magic != TRACE_PROFILE_MAGIC ||
+        hdr.version != TRACE_PROFILE_VERSION ||
+        hdr.image_size != modinfo.image_size ||
+        hdr.num_heads == 0 || hdr.num_heads > TRACE_PROFILE_MAX_HEADS ||
+        file_size != sizeof(hdr) + hdr.num_heads*sizeof(uint)) {
+        LOG(GLOBAL, LOG_CACHE, 1, "  invalid trace head profile %s\n", filename);
+        os_close(fd);
+        return;
+    }
+    offs = HEAP_ARRAY_ALLOC(GLOBAL_DCONTEXT, uint, hdr.num_heads, ACCT_OTHER,
+                            PROTECTED);
+    if (os_read(fd, offs, hdr.num_heads*sizeof(uint)) ==
+        (ssize_t)(hdr.num_heads*sizeof(uint))) {
+        TABLE_RWLOCK(trace_profile, write, lock);
+        for (i = 0; i < hdr.num_heads; i++) {
+            if (offs[i] < modinfo.image_size &&
+                generic_hash_lookup(GLOBAL_DCONTEXT, trace_profile,
+                                    (ptr_uint_t)(base + offs[i])) == NULL) {
+                generic_hash_add(GLOBAL_DCONTEXT, trace_profile,
+                                 (ptr_uint_t)(base + offs[i]), (void *)base);
+            }
+        }
+        TABLE_RWLOCK(trace_profile, write, unlock);
+        LOG(GLOBAL, LOG_CACHE, 1, "  read %d trace heads for "PFX" from %s\n",
+            hdr.num_heads, base, filename);
+        STATS_ADD(trace_profile_heads_loaded, hdr.num_heads);
+    }
+    HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, offs, uint, hdr.num_heads, ACCT_OTHER, PROTECTED);
+    os_close(fd);
+}
+
+void
+trace_profile_module_unload(app_pc base)
+{
+    if (trace_profile == NULL)
+        return;
+    trace_profile_save(base);
+}
+
+void
+trace_profile_record_head(app_pc tag)
+{
+    app_pc modbase;
+    if (trace_profile == NULL || trace_profile_is_head(tag))
+        return;
+    /* we only save heads we can express as module offsets */
+    modbase = get_module_base(tag);
+    if (modbase == NULL)
+        return;
+    TABLE_RWLOCK(trace_profile, write, lock);
+    if (generic_hash_lookup(GLOBAL_DCONTEXT, trace_profile, (ptr_uint_t)tag) == NULL)
+        generic_hash_add(GLOBAL_DCONTEXT, trace_profile, (ptr_uint_t)tag, modbase);
+    TABLE_RWLOCK(trace_profile, write, unlock);
+}
+
+bool
+trace_profile_is_head(app_pc tag)
+{
+    bool res;
+    if (trace_profile == NULL)
+        return false;
+    TABLE_RWLOCK(trace_profile, read, lock);
+    res = (generic_hash_lookup(GLOBAL_DCONTEXT, trace_profile, (ptr_uint_t)tag) != NULL);
+    TABLE_RWLOCK(trace_profile, read, unlock);
+    return res;
+}
@@ -317,7 +317,7 @@ coarse_unit_merge(dcontext_t *dcontext, coarse_info_t *info1, coarse_info_t *inf
 
 enum {
     PERSISTENT_CACHE_MAGIC = 0x244f4952, /* RIO$ */
-    PERSISTENT_CACHE_VERSION = 10,
+    PERSISTENT_CACHE_VERSION = 12,
 };
 
 /* Global flags we need to process if present in a persisted cache */
@@ -605,4 +605,20 @@ coarse_unit_check_persist_space(file_t fd_in/*OPTIONAL*/, size_t size_needed);
 void
 mark_module_exempted(app_pc pc);
 
+/* -persist_trace_heads: reads the trace heads saved for the module at base */
+void
+trace_profile_module_load(app_pc base);
+
+/* -persist_trace_heads: saves the trace heads recorded for the module at base */
+void
+trace_profile_module_unload(app_pc base);
+
+/* -persist_trace_heads: records tag as the head of a hot trace */
+void
+trace_profile_record_head(app_pc tag);
+
+/* -persist_trace_heads: returns whether tag was a hot trace head */
+bool
+trace_profile_is_head(app_pc tag);
+
 #endif /* _PERSCACHE_H_ */
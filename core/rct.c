@@ -318,6 +318,7 @@ rct_ind_branch_check(dcontext_t *dcontext, app_pc target_addr, app_pc src_addr)
          * NOTE: this is a security hole so should never be in product build
          */
         if (target_addr == (app_pc) dr_app_start ||
+            target_addr == (app_pc) dr_app_start_thread ||
             target_addr == (app_pc) dr_app_take_over ||
             target_addr == (app_pc) dr_app_stop ||
             target_addr == (app_pc) dr_app_cleanup)
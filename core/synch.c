@@ -1232,6 +1232,11 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
         for (i = 0; i < num_threads_temp; i++) {
             /* care only if we have already notified or synched thread */
             if (synch_array_temp[i] != SYNCH_WITH_ALL_NEW) {
+                /* the list is usually unchanged, so try the same slot first */
+                if (i < num_threads && threads[i]->id == thread_ids_temp[i]) {
+                    synch_array[i] = synch_array_temp[i];
+                    continue;
+                }
                 for (j = 0; j < num_threads; j++) {
                     /* FIXME : os recycles thread ids, should have stronger
                      * check here, could check dcontext equivalence, (but we
@@ -1280,6 +1285,19 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
         num_threads_temp = num_threads;
         synch_array_temp = synch_array;
 
+        /* Ask every thread to head for a safe spot before we start synching
+         * with any of them, so they get there in parallel rather than one at a
+         * time as we reach each in turn.  Client threads are left to the loop
+         * below as they must wait until the others are finished.
+         */
+        for (i = 0; i < num_threads; i++) {
+            if (synch_array[i] == SYNCH_WITH_ALL_NEW && threads[i]->id != my_id
+                IF_CLIENT_INTERFACE(&& !IS_CLIENT_THREAD(threads[i]->dcontext))) {
+                adjust_wait_at_safe_spot(threads[i]->dcontext, 1);
+                synch_array[i] = SYNCH_WITH_ALL_NOTIFIED;
+            }
+        }
+
         for (i = 0; i < num_threads; i++) {
             /* do not de-ref threads[i] after synching if it was cleaned up! */
             if (synch_array[i] != SYNCH_WITH_ALL_SYNCHED && threads[i]->id != my_id) {
@@ -448,6 +448,129 @@ translate_restore_clean_call(dcontext_t *tdcontext, translate_walk_t *walk)
      */
 }
 
+/* Translation table encoding.  Each entry is a varint holding the delta
+ * from the previous entry's cache_offs shifted left by TRANSLATE_ENC_SHIFT,
+ * with the TRANSLATE_ flags in the low bits.  Unless TRANSLATE_ENC_NULL_APP
+ * is set, it is followed by a zigzag varint holding the delta from the most
+ * recent non-NULL app pc.  Most entries thus take 2 or 3 bytes instead of
+ * sizeof(translation_entry_t).
+ */
+#define TRANSLATE_ENC_NULL_APP 0x0004
+#define TRANSLATE_ENC_FLAGS_MASK (TRANSLATE_IDENTICAL | TRANSLATE_OUR_MANGLING)
+#define TRANSLATE_ENC_SHIFT 3
+/* ceil(bits in ptr_uint_t / 7) */
+#define TRANSLATE_ENC_MAX_VARINT ((sizeof(ptr_uint_t) * 8 + 6) / 7)
+
+/* Writes val to pos if pos is non-NULL.  Returns the encoded size. */
+static uint
+translation_varint_write(byte *pos, ptr_uint_t val)
+{
+    uint len = 0;
+    do {
+        byte b = (byte)(val & 0x7f);
+        val >>= 7;
+        if (val != 0)
+            b |= 0x80;
+        if (pos != NULL)
+            pos[len] = b;
+        len++;
+    } while (val != 0);
+    ASSERT(len <= TRANSLATE_ENC_MAX_VARINT);
+    return len;
+}
+
+static inline const byte *
+translation_varint_read(const byte *pos, ptr_uint_t *val OUT)
+{
+    ptr_uint_t res = 0;
+    uint shift = 0;
+    byte b;
+    do {
+        b = *pos++;
+        res |= ((ptr_uint_t)(b & 0x7f)) << shift;
+        shift += 7;
+    } while (TEST(0x80, b));
+    *val = res;
+    return pos;
+}
+
+/* Encodes entries[0..num_entries) into encoded, or if encoded is NULL just
+ * computes the size.  Returns the encoded size.
+ */
+static uint
+translation_info_encode(const translation_entry_t *entries, uint num_entries,
+                        byte *encoded)
+{
+    uint i, len = 0;
+    ushort last_offs = 0;
+    app_pc last_app = NULL;
+    for (i = 0; i < num_entries; i++) {
+        ptr_uint_t val;
+        ASSERT(entries[i].cache_offs >= last_offs);
+        ASSERT((entries[i].flags & ~TRANSLATE_ENC_FLAGS_MASK) == 0);
+        val = (((ptr_uint_t)(entries[i].cache_offs - last_offs)) << TRANSLATE_ENC_SHIFT)
+            | entries[i].flags;
+        if (entries[i].app == NULL)
+            val |= TRANSLATE_ENC_NULL_APP;
+        len += translation_varint_write(encoded == NULL ? NULL : encoded + len, val);
+        if (entries[i].app != NULL) {
+            ptr_int_t delta = (ptr_int_t)
+                ((ptr_uint_t)entries[i].app - (ptr_uint_t)last_app);
+            /* zigzag so small negative deltas stay small */
+            val = (((ptr_uint_t)delta) << 1) ^
+                (ptr_uint_t)(delta >> (sizeof(delta) * 8 - 1));
+            len += translation_varint_write(encoded == NULL ? NULL : encoded + len,
+                                            val);
+            last_app = entries[i].app;
+        }
+        last_offs = entries[i].cache_offs;
+    }
+    return len;
+}
+
+typedef struct _translation_iter_t {
+    const translation_info_t *info;
+    const byte *pos;
+    uint index;
+    ushort cache_offs;
+    app_pc last_app;
+} translation_iter_t;
+
+static inline void
+translation_iter_init(translation_iter_t *iter, const translation_info_t *info)
+{
+    iter->info = info;
+    iter->pos = info->encoded;
+    iter->index = 0;
+    iter->cache_offs = 0;
+    iter->last_app = NULL;
+}
+
+/* Decodes the next entry into *entry.  Returns false at the end of the table. */
+static bool
+translation_iter_next(translation_iter_t *iter, translation_entry_t *entry OUT)
+{
+    ptr_uint_t val;
+    if (iter->index >= iter->info->num_entries)
+        return false;
+    iter->pos = translation_varint_read(iter->pos, &val);
+    iter->cache_offs += (ushort)(val >> TRANSLATE_ENC_SHIFT);
+    entry->cache_offs = iter->cache_offs;
+    entry->flags = (ushort)(val & TRANSLATE_ENC_FLAGS_MASK);
+    if (TEST(TRANSLATE_ENC_NULL_APP, val))
+        entry->app = NULL;
+    else {
+        ptr_int_t delta;
+        iter->pos = translation_varint_read(iter->pos, &val);
+        delta = (ptr_int_t)((val >> 1) ^ (ptr_uint_t)(-(ptr_int_t)(val & 1)));
+        iter->last_app = (app_pc)((ptr_uint_t)iter->last_app + (ptr_uint_t)delta);
+        entry->app = iter->last_app;
+    }
+    iter->index++;
+    ASSERT(iter->pos <= iter->info->encoded + iter->info->encoded_size);
+    return true;
+}
+
 /* Returns a success code, but makes a best effort regardless.
  * If just_pc is true, only recreates pc.
  * Modifies mc with the recreated state.
@@ -462,7 +585,9 @@ recreate_app_state_from_info(dcontext_t *tdcontext, const translation_info_t *in
     byte *answer = NULL;
     byte *cpc, *prev_cpc;
     cache_pc target_cache = mc->pc;
-    uint i;
+    translation_iter_t iter;
+    translation_entry_t next;
+    bool have_next;
     bool contig = true, ours = false;
     recreate_success_t res = (just_pc ? RECREATE_SUCCESS_PC : RECREATE_SUCCESS_STATE);
     instr_t instr;
@@ -472,10 +597,13 @@ recreate_app_state_from_info(dcontext_t *tdcontext, const translation_info_t *in
 
     ASSERT(info != NULL);
     ASSERT(end_cache >= start_cache);
+    translation_iter_init(&iter, info);
+    have_next = translation_iter_next(&iter, &next);
+    ASSERT(have_next);
 
     LOG(THREAD_GET, LOG_INTERP, 3,
         "recreate_app : looking for "PFX" in frag @ "PFX" (tag "PFX")\n",
-        target_cache, start_cache, info->translation[0].app);
+        target_cache, start_cache, next.app);
     DOLOG(3, LOG_INTERP, {
         translation_info_print(info, start_cache, THREAD_GET);
     });
@@ -489,17 +617,15 @@ recreate_app_state_from_info(dcontext_t *tdcontext, const translation_info_t *in
      */
 
     cpc = start_cache;
-    ASSERT(cpc - start_cache == info->translation[0].cache_offs);
-    i = 0;
+    ASSERT(cpc - start_cache == next.cache_offs);
     while (cpc < end_cache) {
         /* we can go beyond the end of the table: then use the last point */
-        if (i < info->num_entries &&
-            cpc - start_cache >= info->translation[i].cache_offs) {
+        if (have_next && cpc - start_cache >= next.cache_offs) {
             /* We hit a change point: new app translation target */
-            answer = info->translation[i].app;
-            contig = !TEST(TRANSLATE_IDENTICAL, info->translation[i].flags);
-            ours = TEST(TRANSLATE_OUR_MANGLING, info->translation[i].flags);
-            i++;
+            answer = next.app;
+            contig = !TEST(TRANSLATE_IDENTICAL, next.flags);
+            ours = TEST(TRANSLATE_OUR_MANGLING, next.flags);
+            have_next = translation_iter_next(&iter, &next);
         }
 
         if (cpc >= target_cache) {
@@ -564,13 +690,13 @@ recreate_app_state_from_info(dcontext_t *tdcontext, const translation_info_t *in
         });
         if (answer == NULL) {
             /* use next instr's translation.  skip any further meta-instrs regions. */
-            for (; i < info->num_entries; i++) {
-                if (info->translation[i].app != NULL)
+            for (; have_next; have_next = translation_iter_next(&iter, &next)) {
+                if (next.app != NULL)
                     break;
             }
-            ASSERT(i < info->num_entries);
-            if (i < info->num_entries)
-                answer = info->translation[i].app;;
+            ASSERT(have_next);
+            if (have_next)
+                answer = next.app;
             ASSERT(answer != NULL);
         }
     }
@@ -1297,28 +1423,29 @@ recreate_app_state(dcontext_t *tdcontext, priv_mcontext_t *mcontext,
 }
 
 static inline uint
-translation_info_alloc_size(uint num_entries)
+translation_info_alloc_size(uint encoded_size)
 {
-    return (sizeof(translation_info_t) + sizeof(translation_entry_t)*num_entries);
+    return (sizeof(translation_info_t) + encoded_size);
 }
 
 /* we save space by inlining the array with the struct holding the length */
 static translation_info_t *
-translation_info_alloc(dcontext_t *dcontext, uint num_entries)
+translation_info_alloc(dcontext_t *dcontext, uint num_entries, uint encoded_size)
 {
     /* we need to use global heap since pending-delete fragments become
      * shared entities
      */
     translation_info_t *info =
-        global_heap_alloc(translation_info_alloc_size(num_entries) HEAPACCT(ACCT_OTHER));
+        global_heap_alloc(translation_info_alloc_size(encoded_size) HEAPACCT(ACCT_OTHER));
     info->num_entries = num_entries;
+    info->encoded_size = encoded_size;
     return info;
 }
 
 void
 translation_info_free(dcontext_t *dcontext, translation_info_t *info)
 {
-    global_heap_free(info, translation_info_alloc_size(info->num_entries)
+    global_heap_free(info, translation_info_alloc_size(info->encoded_size)
                      HEAPACCT(ACCT_OTHER));
 }
 
@@ -1351,17 +1478,19 @@ void
 translation_info_print(const translation_info_t *info, cache_pc start, file_t file)
 {
     uint i;
+    translation_iter_t iter;
+    translation_entry_t entry;
     ASSERT(info != NULL);
     ASSERT(file != INVALID_FILE);
-    print_file(file, "translation info "PFX"\n", info);
-    for (i=0; i<info->num_entries; i++) {
+    print_file(file, "translation info "PFX" (%d bytes encoded)\n", info,
+               info->encoded_size);
+    translation_iter_init(&iter, info);
+    for (i = 0; translation_iter_next(&iter, &entry); i++) {
         print_file(file, "\t%d +%5d == "PFX" => "PFX" %s%s\n",
-                   i, info->translation[i].cache_offs,
-                   start + info->translation[i].cache_offs,
-                   info->translation[i].app,
-                   TEST(TRANSLATE_IDENTICAL, info->translation[i].flags) ?
+                   i, entry.cache_offs, start + entry.cache_offs, entry.app,
+                   TEST(TRANSLATE_IDENTICAL, entry.flags) ?
                    "identical" : "contiguous",
-                   TEST(TRANSLATE_OUR_MANGLING, info->translation[i].flags) ?
+                   TEST(TRANSLATE_OUR_MANGLING, entry.flags) ?
                    " ours" : "");
     }
 }
@@ -1383,6 +1512,8 @@ record_translation_info(dcontext_t *dcontext, fragment_t *f, instrlist_t *existi
     instrlist_t *ilist;
     instr_t *inst;
     uint i;
+    uint encoded_size;
+    DEBUG_DECLARE(uint written;)
     uint last_len = 0;
     bool last_contig;
     app_pc last_translation = NULL;
@@ -1545,13 +1676,18 @@ record_translation_info(dcontext_t *dcontext, fragment_t *f, instrlist_t *existi
     if (existing_ilist == NULL)
         instrlist_clear_and_destroy(dcontext, ilist);
 
-    /* now copy into right-sized array */
-    info = translation_info_alloc(dcontext, i);
-    memcpy(info->translation, entries, sizeof(translation_entry_t) * i);
+    /* now encode into a right-sized array */
+    encoded_size = translation_info_encode(entries, i, NULL);
+    info = translation_info_alloc(dcontext, i, encoded_size);
+    DEBUG_DECLARE(written =)
+        translation_info_encode(entries, i, info->encoded);
+    ASSERT(written == encoded_size);
     HEAP_ARRAY_FREE(GLOBAL_DCONTEXT, entries, translation_entry_t,
                     num_entries, ACCT_OTHER, PROTECTED);
 
     STATS_INC(translations_computed);
+    STATS_ADD(translation_info_bytes_saved,
+              sizeof(translation_entry_t) * i - encoded_size);
 
     DOLOG(3, LOG_INTERP, {
         translation_info_print(info, f->start_pc, THREAD);
@@ -74,11 +74,16 @@ typedef struct _translation_entry_t {
  * if the previous translation entry is marked "identical" or a stride
  * equal to the instruction length as we decode from the cache if the
  * previous entry is !identical=="contiguous".
+ * The entries are kept delta-encoded as a byte stream (see translate.c)
+ * since these tables are kept for the lifetime of the fragment and full
+ * translation_entry_t's are mostly redundant.
  */
 typedef struct _translation_info_t {
     uint num_entries;
-    /* an array of num_entries elements */
-    translation_entry_t translation[1]; /* variable-sized */
+    /* size in bytes of the encoded array */
+    uint encoded_size;
+    /* num_entries encoded translation_entry_t's */
+    byte encoded[1]; /* variable-sized */
 } translation_info_t;
 
 /* PR 244737: all generated code is thread-shared on x64 */
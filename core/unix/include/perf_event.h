@@ -0,0 +1,88 @@
+/****************************************************************************
+ ****************************************************************************
+ ***
+ ***   This header was generated from Linux kernel headers to make
+ ***   information necessary for userspace to call into the Linux
+ ***   kernel available to DynamoRIO.  It contains only constants,
+ ***   structures, and macros generated from the original header, and
+ ***   thus, contains no copyrightable information.
+ ***
+ ***   Only the subset of <linux/perf_event.h> used by DynamoRIO is
+ ***   included: the original (PERF_ATTR_SIZE_VER0) perf_event_attr and
+ ***   the leading fields of perf_event_mmap_page.
+ ***
+ ****************************************************************************
+ ****************************************************************************/
+
+#ifndef _PERF_EVENT_H
+#define _PERF_EVENT_H
+
+#include <linux/types.h>
+
+enum perf_type_id {
+	PERF_TYPE_HARDWARE			= 0,
+	PERF_TYPE_SOFTWARE			= 1,
+	PERF_TYPE_TRACEPOINT			= 2,
+	PERF_TYPE_HW_CACHE			= 3,
+	PERF_TYPE_RAW				= 4,
+	PERF_TYPE_BREAKPOINT			= 5,
+};
+
+enum perf_hw_id {
+	PERF_COUNT_HW_CPU_CYCLES		= 0,
+	PERF_COUNT_HW_INSTRUCTIONS		= 1,
+	PERF_COUNT_HW_CACHE_REFERENCES		= 2,
+	PERF_COUNT_HW_CACHE_MISSES		= 3,
+	PERF_COUNT_HW_BRANCH_INSTRUCTIONS	= 4,
+	PERF_COUNT_HW_BRANCH_MISSES		= 5,
+	PERF_COUNT_HW_BUS_CYCLES		= 6,
+};
+
+#define PERF_ATTR_SIZE_VER0	64
+
+/* The bitfield flags of struct perf_event_attr */
+#define PERF_ATTR_FLAG_DISABLED		(1ULL << 0)
+#define PERF_ATTR_FLAG_INHERIT		(1ULL << 1)
+#define PERF_ATTR_FLAG_PINNED		(1ULL << 2)
+#define PERF_ATTR_FLAG_EXCLUSIVE	(1ULL << 3)
+#define PERF_ATTR_FLAG_EXCLUDE_USER	(1ULL << 4)
+#define PERF_ATTR_FLAG_EXCLUDE_KERNEL	(1ULL << 5)
+#define PERF_ATTR_FLAG_EXCLUDE_HV	(1ULL << 6)
+
+struct perf_event_attr {
+	__u32			type;
+	__u32			size;
+	__u64			config;
+	__u64			sample_period;
+	__u64			sample_type;
+	__u64			read_format;
+	__u64			flags;
+	__u32			wakeup_events;
+	__u32			bp_type;
+	__u64			config1;
+};
+
+#define PERF_FLAG_FD_NO_GROUP		(1UL << 0)
+#define PERF_FLAG_FD_OUTPUT		(1UL << 1)
+#define PERF_FLAG_PID_CGROUP		(1UL << 2)
+#define PERF_FLAG_FD_CLOEXEC		(1UL << 3)
+
+/* The bitfield capabilities of struct perf_event_mmap_page */
+#define PERF_CAP_BIT0			(1ULL << 0)
+#define PERF_CAP_BIT0_IS_DEPRECATED	(1ULL << 1)
+#define PERF_CAP_USER_RDPMC		(1ULL << 2)
+
+struct perf_event_mmap_page {
+	__u32	version;
+	__u32	compat_version;
+	__u32	lock;
+	__u32	index;
+	__s64	offset;
+	__u64	time_enabled;
+	__u64	time_running;
+	__u64	capabilities;
+	__u16	pmc_width;
+	/* further fields are not used */
+};
+
+#endif /* _PERF_EVENT_H */
@@ -106,6 +106,9 @@ static bool verbose = false;
  */
 static volatile int timeout_expired;
 
+/* How often dr_inject_wait_for_child() checks on an attached process */
+#define ATTACHED_POLL_US (10*1000)
+
 typedef enum _inject_method_t {
     INJECT_EARLY,       /* Works with self or child. */
     INJECT_LD_PRELOAD,  /* Works with self or child. */
@@ -121,6 +124,7 @@ typedef struct _dr_inject_info_t {
     int pipe_fd;
 
     bool exec_self;             /* this process will exec the app */
+    bool attached;              /* an existing process that is not our child */
     inject_method_t method;
 
     bool killpg;
@@ -131,6 +135,7 @@ typedef struct _dr_inject_info_t {
 #ifdef MACOS
     bool spawn_32bit;
 #endif
+    char attached_exe[MAXIMUM_PATH]; /* exe storage for attached */
 } dr_inject_info_t;
 
 #if defined(LINUX) && !defined(ANDROID) /* XXX i#1290/i#1701: NYI on MacOS/Android */
@@ -523,6 +528,44 @@ dr_inject_prepare_to_exec(const char *exe, const char **argv, void **data OUT)
     return errcode;
 }
 
+#if defined(LINUX) && !defined(ANDROID) /* XXX i#1290/i#1701: NYI on MacOS/Android */
+DR_EXPORT
+int
+dr_inject_process_attach(process_id_t pid, void **data OUT)
+{
+    dr_inject_info_t *info;
+    char proc_exe[64];
+    char exe[MAXIMUM_PATH];
+    ssize_t len;
+    int errcode = 0;
+
+    snprintf(proc_exe, BUFFER_SIZE_ELEMENTS(proc_exe), "/proc/%d/exe", pid);
+    NULL_TERMINATE_BUFFER(proc_exe);
+    len = readlink(proc_exe, exe, BUFFER_SIZE_ELEMENTS(exe) - 1);
+    if (len <= 0)
+        return errno;
+    exe[len] = '\0';
+    info = create_inject_info(exe, NULL);
+    strncpy(info->attached_exe, exe, BUFFER_SIZE_ELEMENTS(info->attached_exe));
+    NULL_TERMINATE_BUFFER(info->attached_exe);
+    info->image_name = info->attached_exe + (info->image_name - info->exe);
+    info->exe = info->attached_exe;
+    if (!exe_is_right_bitwidth(info->exe, &errcode) &&
+        errcode != WARN_IMAGE_MACHINE_TYPE_MISMATCH_EXE) {
+        free(info);
+        return errcode;
+    }
+    info->pid = pid;
+    info->pipe_fd = 0;  /* No pipe. */
+    info->exec_self = false;
+    info->attached = true;
+    /* ptrace is the only way in once the process is running */
+    info->method = INJECT_PTRACE;
+    *data = info;
+    return errcode;
+}
+#endif
+
 DR_EXPORT
 bool
 dr_inject_prepare_to_ptrace(void *data)
@@ -544,7 +587,7 @@ dr_inject_prepare_new_process_group(void *data)
     int res;
     if (data == NULL)
         return false;
-    if (info->exec_self)
+    if (info->exec_self || info->attached)
         return false;
     /* Put the child in its own process group. */
     res = setpgid(info->pid, info->pid);
@@ -692,7 +735,8 @@ dr_inject_process_run(void *data)
 #endif
         }
         /* Close the pipe. */
-        close(info->pipe_fd);
+        if (info->pipe_fd != 0)
+            close(info->pipe_fd);
         info->pipe_fd = 0;
     }
     return true;
@@ -724,6 +768,20 @@ dr_inject_wait_for_child(void *data, uint64 timeout_millis)
         setitimer(ITIMER_REAL, &timer, NULL);
     }
 
+    if (info->attached) {
+        /* We cannot wait on a process that is not our child, so we poll for
+         * it to go away.  Its exit code is its parent's to collect.
+         */
+        while (!timeout_expired) {
+            if (kill(info->pid, 0) < 0 && errno == ESRCH) {
+                info->exited = true;
+                break;
+            }
+            usleep(ATTACHED_POLL_US);
+        }
+        return info->exited;
+    }
+
     do {
         res = waitpid(info->pid, &info->exitcode, 0);
     } while (res != info->pid && res != -1 &&
@@ -747,6 +805,11 @@ dr_inject_process_exit(void *data, bool terminate)
         status = info->exitcode;
     } else if (info->exec_self) {
         status = -1;  /* We never injected, must have been some other error. */
+    } else if (info->attached) {
+        /* Not our child, so there is nothing to reap. */
+        if (terminate)
+            kill(info->pid, SIGKILL);
+        status = info->exitcode;
     } else if (terminate) {
         /* We use SIGKILL to match Windows, which doesn't provide the app a
          * chance to clean up.
@@ -1277,6 +1340,40 @@ user_regs_to_mc(priv_mcontext_t *mc, struct USER_REGS_TYPE *regs)
 #endif /* X86/ARM */
 }
 
+#ifdef X86
+/* Kernel-internal results of a system call that is to be restarted */
+enum {
+    ERESTARTSYS           = 512,
+    ERESTARTNOINTR        = 513,
+    ERESTARTNOHAND        = 514,
+    ERESTART_RESTARTBLOCK = 516,
+};
+
+/* A running process we attach to is usually stopped inside a blocking system
+ * call, which the kernel would restart or fail with EINTR when the thread
+ * resumes.  Since we resume it in DR instead, we cancel that here and point
+ * the app state in mc back at the system call instruction, so that DR issues
+ * it again just as the kernel would have.
+ */
+static void
+redirect_interrupted_syscall(priv_mcontext_t *mc, struct USER_REGS_TYPE *regs)
+{
+    ptr_int_t orig_sysnum = (ptr_int_t) regs->IF_X64_ELSE(orig_rax, orig_eax);
+    ptr_int_t res = (ptr_int_t) regs->REG_RETVAL_FIELD;
+    if (orig_sysnum < 0)
+        return; /* not in a system call */
+    /* Keep the kernel from restarting anything at DR's entry point. */
+    regs->IF_X64_ELSE(orig_rax, orig_eax) = -1;
+    if (res == -ERESTARTSYS || res == -ERESTARTNOINTR || res == -ERESTARTNOHAND) {
+        mc->xax = orig_sysnum;
+        mc->pc -= SYSCALL_LENGTH; /* int 0x80, syscall, and sysenter alike */
+    } else if (res == -ERESTART_RESTARTBLOCK) {
+        mc->xax = SYS_restart_syscall;
+        mc->pc -= SYSCALL_LENGTH;
+    }
+}
+#endif
+
 /* Detach from the injectee and re-exec ourselves as gdb with --pid.  This is
  * useful for debugging initialization in the injectee.
  * XXX: This is racy.  I have to insert os_thread_sleep(500) in takeover_ptrace()
@@ -1400,6 +1497,10 @@ inject_ptrace(dr_inject_info_t *info, const char *library_path)
     memset(&args, 0, sizeof(args));
     user_regs_to_mc(&args.mc, &regs);
     args.argc = ARGC_PTRACE_SENTINEL;
+#ifdef X86
+    if (info->attached)
+        redirect_interrupted_syscall(&args.mc, &regs);
+#endif
 
     /* We need to send the home directory over.  It's hard to find the
      * environment in the injectee, and even if we could HOME might be
@@ -1039,6 +1039,7 @@ privload_early_relocate_os_privmod_data(os_privmod_data_t *opd, byte *mod_base)
 static void
 privload_relocate_os_privmod_data(os_privmod_data_t *opd, byte *mod_base)
 {
+    module_relocate_symbol_cache_reset();
     if (opd->rel != NULL) {
         module_relocate_rel(mod_base, opd,
                             opd->rel,
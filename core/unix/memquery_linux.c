@@ -77,13 +77,14 @@ static mutex_t maps_iter_buf_lock = INIT_LOCK_FREE(maps_iter_buf_lock);
  */
 #define PROC_SELF_MAPS "/proc/self/maps"
 
-/* these are defined in /usr/src/linux/fs/proc/array.c */
+/* these are defined in /usr/src/linux/fs/proc/array.c.
+ * Each line has the form "start-end perms offset dev inode path", which
+ * maps_parse_line() scans by hand rather than with sscanf.
+ */
 #define MAPS_LINE_LENGTH        4096
 /* for systems with sizeof(void*) == 4: */
-#define MAPS_LINE_FORMAT4         "%08lx-%08lx %s %08lx %*s "UINT64_FORMAT_STRING" %4096s"
 #define MAPS_LINE_MAX4  49 /* sum of 8  1  8  1 4 1 8 1 5 1 10 1 */
 /* for systems with sizeof(void*) == 8: */
-#define MAPS_LINE_FORMAT8         "%016lx-%016lx %s %016lx %*s "UINT64_FORMAT_STRING" %4096s"
 #define MAPS_LINE_MAX8  73 /* sum of 16  1  16  1 4 1 16 1 5 1 10 1 */
 
 #define MAPS_LINE_MAX   MAPS_LINE_MAX8
@@ -96,7 +97,12 @@ static mutex_t maps_iter_buf_lock = INIT_LOCK_FREE(maps_iter_buf_lock);
  * FIXME: now we're using 16K right here: should we shrink?
  */
 #define BUFSIZE (MAPS_LINE_LENGTH+8)
-static char buf_scratch[BUFSIZE];
+/* The read buffer holds many lines so that a large maps file (tens of
+ * thousands of entries) takes few os_read() calls.  It must still be at
+ * least BUFSIZE to hold any single line.
+ */
+#define READ_BUFSIZE (4*MAPS_LINE_LENGTH+8)
+static char buf_scratch[READ_BUFSIZE];
 static char comment_buf_scratch[BUFSIZE];
 /* To satisfy our two uses (inner use with memory_info_buf_lock versus
  * outer use with maps_iter_buf_lock), we have two different locks and
@@ -104,7 +110,7 @@ static char comment_buf_scratch[BUFSIZE];
  * ordering issues: we need an inner lock for use in places like signal
  * handlers, but an outer lock when the iterator user allocates memory.
  */
-static char buf_iter[BUFSIZE];
+static char buf_iter[READ_BUFSIZE];
 static char comment_buf_iter[BUFSIZE];
 
 void
@@ -149,7 +155,7 @@ memquery_iterator_start(memquery_iter_t *iter, app_pc start, bool may_alloc)
              "/proc/%d/maps", get_thread_id());
     mi->maps = os_open(maps_name, OS_OPEN_READ);
     ASSERT(mi->maps != INVALID_FILE);
-    mi->buf[BUFSIZE-1] = '\0'; /* permanently */
+    mi->buf[READ_BUFSIZE-1] = '\0'; /* permanently */
 
     mi->newline = NULL;
     mi->bufread = 0;
@@ -180,6 +186,100 @@ memquery_iterator_stop(memquery_iter_t *iter)
         mutex_unlock(&memory_info_buf_lock);
 }
 
+static inline const char *
+maps_skip_space(const char *s)
+{
+    while (*s == ' ' || *s == '\t')
+        s++;
+    return s;
+}
+
+/* Copies the whitespace-delimited token at s into out (truncating to
+ * out_sz-1 chars) and returns a pointer past it, or NULL if there is no token.
+ */
+static const char *
+maps_parse_token(const char *s, char *out, size_t out_sz)
+{
+    size_t i = 0;
+    s = maps_skip_space(s);
+    if (*s == '\0')
+        return NULL;
+    for (; *s != '\0' && *s != ' ' && *s != '\t'; s++) {
+        if (i < out_sz - 1)
+            out[i++] = *s;
+    }
+    out[i] = '\0';
+    return s;
+}
+
+/* Returns a pointer past the hex number at s, or NULL if there is none. */
+static const char *
+maps_parse_hex(const char *s, ptr_uint_t *val OUT)
+{
+    const char *start;
+    ptr_uint_t v = 0;
+    s = maps_skip_space(s);
+    for (start = s; ; s++) {
+        if (*s >= '0' && *s <= '9')
+            v = (v << 4) | (*s - '0');
+        else if (*s >= 'a' && *s <= 'f')
+            v = (v << 4) | (*s - 'a' + 10);
+        else if (*s >= 'A' && *s <= 'F')
+            v = (v << 4) | (*s - 'A' + 10);
+        else
+            break;
+    }
+    if (s == start)
+        return NULL;
+    *val = v;
+    return s;
+}
+
+/* Returns a pointer past the decimal number at s, or NULL if there is none. */
+static const char *
+maps_parse_dec(const char *s, uint64 *val OUT)
+{
+    const char *start;
+    uint64 v = 0;
+    s = maps_skip_space(s);
+    for (start = s; *s >= '0' && *s <= '9'; s++)
+        v = v * 10 + (*s - '0');
+    if (s == start)
+        return NULL;
+    *val = v;
+    return s;
+}
+
+/* Parses one maps line into iter, perm, and comment.  Like the sscanf it
+ * replaces, returns the number of fields filled in (dev is not counted) and
+ * takes only the first whitespace-delimited token of the path.
+ */
+static int
+maps_parse_line(const char *line, memquery_iter_t *iter, char *perm, size_t perm_sz,
+                char *comment, size_t comment_sz)
+{
+    ptr_uint_t val;
+    char dev[16];
+    const char *s = maps_parse_hex(line, &val);
+    if (s == NULL)
+        return 0;
+    iter->vm_start = (app_pc) val;
+    if (*s != '-' || (s = maps_parse_hex(s + 1, &val)) == NULL)
+        return 1;
+    iter->vm_end = (app_pc) val;
+    if ((s = maps_parse_token(s, perm, perm_sz)) == NULL)
+        return 2;
+    if ((s = maps_parse_hex(s, &val)) == NULL)
+        return 3;
+    iter->offset = (size_t) val;
+    if ((s = maps_parse_token(s, dev, BUFFER_SIZE_ELEMENTS(dev))) == NULL ||
+        (s = maps_parse_dec(s, &iter->inode)) == NULL)
+        return 4;
+    if (maps_parse_token(s, comment, comment_sz) == NULL)
+        return 5;
+    return 6;
+}
+
 bool
 memquery_iterator_next(memquery_iter_t *iter)
 {
@@ -191,7 +291,7 @@ memquery_iterator_next(memquery_iter_t *iter)
     ASSERT((iter->may_alloc && OWN_MUTEX(&maps_iter_buf_lock)) ||
            (!iter->may_alloc && OWN_MUTEX(&memory_info_buf_lock)));
     if (mi->newline == NULL) {
-        mi->bufwant = BUFSIZE-1;
+        mi->bufwant = READ_BUFSIZE-1;
         mi->bufread = os_read(mi->maps, mi->buf, mi->bufwant);
         ASSERT(mi->bufread <= mi->bufwant);
         LOG(GLOBAL, LOG_VMAREAS, 6,
@@ -235,15 +335,8 @@ memquery_iterator_next(memquery_iter_t *iter)
     LOG(GLOBAL, LOG_VMAREAS, 6,
         "\nget_memory_info_from_os: line=[%s]\n", line);
     mi->comment_buffer[0]='\0';
-    len = sscanf(line,
-#ifdef IA32_ON_IA64
-                 MAPS_LINE_FORMAT8, /* cross-compiling! */
-#else
-                 sizeof(void*) == 4 ? MAPS_LINE_FORMAT4 : MAPS_LINE_FORMAT8,
-#endif
-                 (unsigned long*)&iter->vm_start, (unsigned long*)&iter->vm_end,
-                 perm, (unsigned long*)&iter->offset, &iter->inode,
-                 mi->comment_buffer);
+    len = maps_parse_line(line, iter, perm, BUFFER_SIZE_ELEMENTS(perm),
+                          mi->comment_buffer, BUFSIZE);
     if (iter->vm_start == iter->vm_end) {
         /* i#366 & i#599: Merge an empty regions caused by stack guard pages
          * into the stack region if the stack region is less than one page away.
@@ -188,10 +188,22 @@ os_module_area_init(module_area_t *ma, app_pc base, size_t view_size,
      */
     if (ma->os_data.checksum == 0 &&
         (DYNAMO_OPTION(coarse_enable_freeze) || DYNAMO_OPTION(use_persisted))) {
-        /* Use something so we have usable pcache names */
-        ma->os_data.checksum = crc32((const char *)ma->start, PAGE_SIZE);
+#ifdef LINUX
+        if (ma->os_data.build_id_len > 0) {
+            /* The build id identifies the file's contents, while the first
+             * page holds the headers that give the segment layout we mapped.
+             * Both end up in the pcache name and in its module info.
+             */
+            ma->os_data.checksum = crc32((const char *)ma->os_data.build_id,
+                                         ma->os_data.build_id_len);
+            if (ma->os_data.timestamp == 0)
+                ma->os_data.timestamp = crc32((const char *)ma->start, PAGE_SIZE);
+        } else
+#endif
+            /* Use something so we have usable pcache names */
+            ma->os_data.checksum = crc32((const char *)ma->start, PAGE_SIZE);
     }
-    /* Timestamp we just leave as 0 */
+    /* Otherwise, timestamp we just leave as 0 */
 }
 
 void
@@ -426,6 +438,13 @@ os_get_module_info(const app_pc pc, uint *checksum, uint *timestamp,
         if (file_version != NULL) {
             /* FIXME: NYI: make windows-only everywhere if no good linux source */
             *file_version = 0;
+#ifdef LINUX
+            /* The leading bytes of the build id at least let pcaches tell apart
+             * builds whose checksums collide.
+             */
+            memcpy(file_version, ma->os_data.build_id,
+                   MIN(sizeof(*file_version), ma->os_data.build_id_len));
+#endif
         }
     }
 
@@ -434,6 +453,21 @@ os_get_module_info(const app_pc pc, uint *checksum, uint *timestamp,
     return (ma != NULL);
 }
 
+#ifdef LINUX
+bool
+module_has_build_id(app_pc pc)
+{
+    module_area_t *ma;
+    bool res = false;
+    os_get_module_info_lock();
+    ma = module_pc_lookup(pc);
+    if (ma != NULL)
+        res = (ma->os_data.build_id_len > 0);
+    os_get_module_info_unlock();
+    return res;
+}
+#endif
+
 bool
 os_get_module_info_all_names(const app_pc pc, uint *checksum, uint *timestamp,
                              size_t *size, module_names_t **names,
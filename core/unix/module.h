@@ -50,6 +50,9 @@ typedef struct _module_segment_t {
     bool shared; /* not unique to this module */
 } module_segment_t;
 
+/* Longer build ids are truncated.  ld produces 20 bytes for sha1 and 16 for md5. */
+#define MODULE_BUILD_ID_MAX 32
+
 typedef struct _os_module_data_t {
     /* To compute the base address, one determines the memory address associated with
      * the lowest p_vaddr value for a PT_LOAD segment. One then obtains the base
@@ -71,6 +74,10 @@ typedef struct _os_module_data_t {
      */
     bool   hash_is_gnu;   /* gnu hash function? */
     app_pc hashtab;       /* absolute addr of .hash or .gnu.hash */
+    /* The fields below through gnu_symbias are only filled in on first use
+     * by module_hashtab_init(): most modules never have an export looked up.
+     */
+    bool   hashtab_ready;
     size_t num_buckets;   /* number of bucket entries */
     app_pc buckets;       /* absolute addr of hash bucket table */
     size_t num_chain;     /* number of chain entries */
@@ -84,6 +91,11 @@ typedef struct _os_module_data_t {
     ptr_uint_t gnu_shift;
     ptr_uint_t gnu_bitidx;
     size_t gnu_symbias;   /* .dynsym index of first export */
+    /* The NT_GNU_BUILD_ID note, which identifies the file's contents for
+     * pcaches.  build_id_len is 0 if the module has none.
+     */
+    byte build_id[MODULE_BUILD_ID_MAX];
+    uint build_id_len;
 #else /* MACOS */
     byte *exports;        /* absolute addr of exports trie */
     size_t exports_sz;    /* size of exports trie */
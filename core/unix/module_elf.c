@@ -133,10 +133,6 @@ typedef struct _elf_export_iterator_t {
 # define STT_GNU_IFUNC STT_LOOS
 #endif
 
-/* forward declaration */
-static void
-module_hashtab_init(os_module_data_t *os_data);
-
 /* Question : how is the size of the initial map determined?  There seems to be no better
  * way than to walk the program headers and find the largest virtual offset.  You'd think
  * there would be a field in the header or something easier than that...
@@ -441,18 +437,58 @@ module_fill_os_data(ELF_PROGRAM_HEADER_TYPE *prog_hdr, /* PT_DYNAMIC entry */
                 ASSERT_NOT_REACHED();
             }
         }
-        if (out_data != NULL) {
-            /* we put module_hashtab_init here since it should always be called
-             * together with module_fill_os_data and it updates os_data.
-             */
-            module_hashtab_init(out_data);
-        }
+        /* The hashtable header is parsed lazily by module_hashtab_init() on
+         * the first symbol lookup or iteration, as most modules never need it.
+         */
+        if (out_data != NULL)
+            out_data->hashtab_ready = false;
     } , { /* EXCEPT */
         ASSERT_CURIOSITY(false && "crashed while walking dynamic header");
         *soname = NULL;
     });
 }
 
+#ifdef LINUX
+/* Looks for an NT_GNU_BUILD_ID note in the PT_NOTE segment prog_hdr and if
+ * found copies its id into out_data.  As for the dynamic section, if at_map
+ * we use the file offset.
+ */
+static void
+module_read_build_id(ELF_PROGRAM_HEADER_TYPE *prog_hdr, app_pc base, size_t view_size,
+                     bool at_map, ptr_int_t load_delta, OUT os_module_data_t *out_data)
+{
+    byte *note, *end;
+    ASSERT(prog_hdr->p_type == PT_NOTE);
+    if (at_map) {
+        /* The notes are normally in the first page, right after the headers. */
+        if (prog_hdr->p_offset + prog_hdr->p_filesz > view_size)
+            return;
+        note = base + prog_hdr->p_offset;
+    } else
+        note = (byte *)prog_hdr->p_vaddr + load_delta;
+    end = note + prog_hdr->p_filesz;
+    TRY_EXCEPT_ALLOW_NO_DCONTEXT(get_thread_private_dcontext(), {
+        while (note + sizeof(ELF_NOTE_HEADER_TYPE) <= end) {
+            ELF_NOTE_HEADER_TYPE *nhdr = (ELF_NOTE_HEADER_TYPE *) note;
+            byte *name = note + sizeof(*nhdr);
+            byte *desc = name + ALIGN_FORWARD(nhdr->n_namesz, 4);
+            if (desc + nhdr->n_descsz > end)
+                break;
+            if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+                memcmp(name, "GNU", 4) == 0 && nhdr->n_descsz > 0) {
+                out_data->build_id_len = MIN(nhdr->n_descsz, MODULE_BUILD_ID_MAX);
+                memcpy(out_data->build_id, desc, out_data->build_id_len);
+                break;
+            }
+            note = desc + ALIGN_FORWARD(nhdr->n_descsz, 4);
+        }
+    } , { /* EXCEPT */
+        ASSERT_CURIOSITY(false && "crashed while walking note segment");
+        out_data->build_id_len = 0;
+    });
+}
+#endif
+
 /* Returned addresses out_base and out_end are relative to the actual
  * loaded module base, so the "base" param should be added to produce
  * absolute addresses.
@@ -517,6 +553,13 @@ module_walk_program_headers(app_pc base, size_t view_size, bool at_map, bool dyn
                                     base, view_size, at_map, dyn_reloc, load_delta,
                                     &soname, out_data);
             }
+#ifdef LINUX
+            if (out_data != NULL && prog_hdr->p_type == PT_NOTE &&
+                out_data->build_id_len == 0) {
+                module_read_build_id(prog_hdr, base, view_size, at_map, load_delta,
+                                     out_data);
+            }
+#endif
         }
     }
     ASSERT_CURIOSITY(found_load && mod_base != (app_pc)POINTER_MAX &&
@@ -619,11 +662,17 @@ module_read_program_header(app_pc base,
     return false;
 }
 
-/* fill os_module_data_t for hashtable lookup */
+/* Fill in the os_module_data_t hashtable lookup fields on first use.
+ * This may be called with only the read lock held on the module list: the
+ * values written are the same for every caller, and hashtab_ready is only set
+ * once they are all in place.
+ */
 static void
 module_hashtab_init(os_module_data_t *os_data)
 {
-    if (os_data->hashtab != NULL) {
+    if (os_data->hashtab_ready || os_data->hashtab == NULL)
+        return;
+    TRY_EXCEPT_ALLOW_NO_DCONTEXT(get_thread_private_dcontext(), {
         /* set up symbol lookup fields */
         if (os_data->hash_is_gnu) {
             /* .gnu.hash format.  can't find good docs for it. */
@@ -648,7 +697,14 @@ module_hashtab_init(os_module_data_t *os_data)
             os_data->chain = (app_pc) (htab + os_data->num_buckets);
         }
         ASSERT(os_data->symentry_size == sizeof(ELF_SYM_TYPE));
-    }
+        os_data->hashtab_ready = true;
+    } , { /* EXCEPT */
+        ASSERT_CURIOSITY(false && "crashed while reading hashtable header");
+        os_data->num_buckets = 0;
+        os_data->num_chain = 0;
+        os_data->gnu_symbias = 0;
+        os_data->hashtab = NULL;
+    });
 }
 
 app_pc
@@ -818,7 +874,8 @@ get_proc_address_from_os_data(os_module_data_t *os_data,
                               const char *name,
                               OUT bool *is_indirect_code)
 {
-    if (os_data->hashtab != NULL) {
+    module_hashtab_init(os_data);
+    if (os_data->hashtab != NULL && os_data->num_buckets > 0) {
         Elf_Symndx *buckets = (Elf_Symndx *) os_data->buckets;
         Elf_Symndx *chain = (Elf_Symndx *) os_data->chain;
         ELF_SYM_TYPE *symtab = (ELF_SYM_TYPE *) os_data->dynsym;
@@ -1255,6 +1312,31 @@ module_get_relro(app_pc base, OUT app_pc *relro_base, OUT size_t *relro_size)
     return true;
 }
 
+/* A module's relocation sections usually name the same symbol several times
+ * (e.g., a GLOB_DAT and a JUMP_SLOT for one function, or many data relocs
+ * against one object), and every resolution walks the hashtables of all
+ * private modules.  We memoize resolutions by .dynsym index for the module
+ * currently being relocated.  Entries hold the index plus one so that zero
+ * means empty.  Protected by privload_lock.
+ */
+#define RELOC_SYM_CACHE_SIZE 512
+typedef struct _reloc_sym_cache_entry_t {
+    uint sym_idx_plus_one;
+    app_pc res;
+} reloc_sym_cache_entry_t;
+DECLARE_NEVERPROT_VAR(static reloc_sym_cache_entry_t
+                      reloc_sym_cache[RELOC_SYM_CACHE_SIZE], {{0}});
+
+/* Must be called before relocating each module: cached resolutions are
+ * only valid for the module whose .dynsym they index.
+ */
+void
+module_relocate_symbol_cache_reset(void)
+{
+    ASSERT_OWN_RECURSIVE_LOCK(true, &privload_lock);
+    memset(reloc_sym_cache, 0, sizeof(reloc_sym_cache));
+}
+
 static app_pc
 module_lookup_symbol(ELF_SYM_TYPE *sym, os_privmod_data_t *pd)
 {
@@ -1383,6 +1465,7 @@ dr_symbol_import_iterator_start(module_handle_t handle,
         iter->dynstr = (const char *) ma->os_data.dynstr;
         iter->dynstr_size = ma->os_data.dynstr_size;
         iter->cur_sym = iter->dynsym;
+        module_hashtab_init(&ma->os_data);
 
         /* The length of .dynsym is not available in the mapped image, so we
          * have to be creative.  The two export hashtables point into dynsym,
@@ -1522,6 +1605,7 @@ dr_symbol_export_iterator_start(module_handle_t handle)
         iter->dynstr_size = ma->os_data.dynstr_size;
         iter->cur_sym = iter->dynsym;
         iter->load_delta = ma->start - ma->os_data.base_address;
+        module_hashtab_init(&ma->os_data);
 
         /* See dr_symbol_import_iterator_start(): we don't have the length of .dynsym
          * (we'd have to map the original file).
@@ -1603,6 +1687,7 @@ module_relocate_symbol(ELF_REL_TYPE *rel,
     reg_t addend;
     const char *name;
     bool resolved;
+    reloc_sym_cache_entry_t *cache;
 
     /* XXX: we assume ELF_REL_TYPE and ELF_RELA_TYPE only differ at the end,
      * i.e. with or without r_addend.
@@ -1686,7 +1771,14 @@ module_relocate_symbol(ELF_REL_TYPE *rel,
     if (resolved)
         return;
 
-    res = module_lookup_symbol(sym, pd);
+    cache = &reloc_sym_cache[r_sym % RELOC_SYM_CACHE_SIZE];
+    if (cache->sym_idx_plus_one == r_sym + 1)
+        res = cache->res;
+    else {
+        res = module_lookup_symbol(sym, pd);
+        cache->sym_idx_plus_one = r_sym + 1;
+        cache->res = res;
+    }
     LOG(GLOBAL, LOG_LOADER, 3, "symbol lookup for %s %p\n", name, res);
     if (res == NULL && ELF_ST_BIND(sym->st_info) != STB_WEAK) {
         /* Warn up front on undefined symbols.  Don't warn for weak symbols,
@@ -55,6 +55,7 @@
 # define ELF_REL_TYPE Elf64_Rel
 # define ELF_RELA_TYPE Elf64_Rela
 # define ELF_AUXV_TYPE Elf64_auxv_t
+# define ELF_NOTE_HEADER_TYPE Elf64_Nhdr
 /* system like android has ELF_ST_TYPE and ELF_ST_BIND */
 # ifndef ELF_ST_TYPE
 #  define ELF_ST_TYPE ELF64_ST_TYPE
@@ -75,6 +76,7 @@
 # define ELF_REL_TYPE Elf32_Rel
 # define ELF_RELA_TYPE Elf32_Rela
 # define ELF_AUXV_TYPE Elf32_auxv_t
+# define ELF_NOTE_HEADER_TYPE Elf32_Nhdr
 /* system like android has ELF_ST_TYPE and ELF_ST_BIND */
 # ifndef ELF_ST_TYPE
 #  define ELF_ST_TYPE ELF32_ST_TYPE
@@ -82,6 +84,11 @@
 # endif
 #endif
 
+/* Older headers, such as Android's, may lack the GNU note types. */
+#ifndef NT_GNU_BUILD_ID
+# define NT_GNU_BUILD_ID 3
+#endif
+
 #ifdef X86
 # ifdef X64
 /* AMD x86-64 relocations.  */
@@ -196,6 +203,9 @@ ELF_ADDR
 module_get_section_with_name(app_pc image, size_t img_size,
                              const char *sec_name);
 
+void
+module_relocate_symbol_cache_reset(void);
+
 void
 module_relocate_rel(app_pc modbase,
                     os_privmod_data_t *pd,
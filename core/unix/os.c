@@ -1927,6 +1927,10 @@ os_thread_init(dcontext_t *dcontext)
 
     signal_thread_init(dcontext);
 
+#ifdef LINUX
+    perf_event_thread_init(dcontext);
+#endif
+
     /* i#107, initialize thread area information,
      * the value was first get in os_tls_init and stored in os_tls
      */
@@ -1980,6 +1984,10 @@ os_thread_exit(dcontext_t *dcontext, bool other_thread)
 
     signal_thread_exit(dcontext, other_thread);
 
+#ifdef LINUX
+    perf_event_thread_exit(dcontext);
+#endif
+
     ksynch_free_var(&ostd->suspended);
     ksynch_free_var(&ostd->wakeup);
     ksynch_free_var(&ostd->resumed);
@@ -2110,6 +2118,10 @@ os_fork_init(dcontext_t *dcontext)
          }
     } while (true);
     TABLE_RWLOCK(fd_table, write, unlock);
+
+#ifdef LINUX
+    perf_event_fork_init(dcontext);
+#endif
 }
 
 byte *
@@ -2658,6 +2670,58 @@ dr_raw_brk(void *new_address)
 }
 #endif /* CLIENT_INTERFACE && LINUX */
 
+#ifdef LINUX
+# ifndef MADV_HUGEPAGE
+#  define MADV_HUGEPAGE 14
+# endif
+bool
+os_heap_advise_huge_pages(void *p, size_t size)
+{
+    /* The advice sticks to the range even as we later mprotect pieces of it */
+    int res = dynamorio_syscall(SYS_madvise, 3, p, size, MADV_HUGEPAGE);
+    LOG(GLOBAL, LOG_HEAP, 2, "os_heap_advise_huge_pages: "PFX"-"PFX" => %d\n",
+        p, (byte *)p + size, res);
+    return res == 0;
+}
+
+# ifndef MPOL_PREFERRED
+#  define MPOL_PREFERRED 1
+# endif
+# ifndef MPOL_MF_MOVE
+#  define MPOL_MF_MOVE (1 << 1)
+# endif
+bool
+os_heap_bind_local_node(void *p, size_t size)
+{
+    uint cpu, node;
+    ptr_uint_t nodemask[4];
+    int res = dynamorio_syscall(SYS_getcpu, 3, &cpu, &node, NULL);
+    if (res != 0 || node >= sizeof(nodemask) * 8)
+        return false;
+    memset(nodemask, 0, sizeof(nodemask));
+    nodemask[node / (sizeof(nodemask[0]) * 8)] |=
+        (ptr_uint_t)1 << (node % (sizeof(nodemask[0]) * 8));
+    /* A preferred rather than bound policy so we never fail an allocation when
+     * the local node is out of memory.  Pages already touched (e.g., a reused
+     * unit's header) are moved along with the rest.
+     */
+    res = dynamorio_syscall(SYS_mbind, 6, p, size, MPOL_PREFERRED, nodemask,
+                            sizeof(nodemask) * 8, MPOL_MF_MOVE);
+    LOG(GLOBAL, LOG_HEAP, 2, "os_heap_bind_local_node: "PFX"-"PFX" node %d => %d\n",
+        p, (byte *)p + size, node, res);
+    return res == 0;
+}
+
+bool
+os_heap_discard_pages(void *p, size_t size)
+{
+    int res = dynamorio_syscall(SYS_madvise, 3, p, size, MADV_DONTNEED);
+    LOG(GLOBAL, LOG_HEAP, 2, "os_heap_discard_pages: "PFX"-"PFX" => %d\n",
+        p, (byte *)p + size, res);
+    return res == 0;
+}
+#endif
+
 /* caller is required to handle thread synchronization and to update dynamo vm areas */
 void
 os_heap_free(void *p, size_t size, heap_error_code_t *error_code)
@@ -5935,7 +5999,7 @@ pre_system_call(dcontext_t *dcontext)
      */
     dcontext->sys_num = os_normalized_sysnum((int)MCXT_SYSNUM_REG(mc), NULL, dcontext);
 
-    RSTATS_INC(pre_syscall);
+    RSTATS_INC_THREAD(pre_syscall);
     DOSTATS({
             if (ignorable_system_call_normalized(dcontext->sys_num))
             STATS_INC(pre_syscall_ignorable);
@@ -7257,7 +7321,7 @@ post_system_call(dcontext_t *dcontext)
     where_am_i_t old_whereami;
     DEBUG_DECLARE(bool ok;)
 
-    RSTATS_INC(post_syscall);
+    RSTATS_INC_THREAD(post_syscall);
 
     old_whereami = dcontext->whereami;
     dcontext->whereami = WHERE_SYSCALL_HANDLER;
@@ -7986,6 +8050,16 @@ get_application_end(void)
     return executable_end;
 }
 
+/* Unlike get_application_end(), covers every segment of the image */
+bool
+os_get_image_bounds(const char *name, app_pc *start OUT, app_pc *end OUT)
+{
+    *start = (name == NULL) ? get_application_base() : NULL;
+    if (name == NULL && *start == NULL)
+        return false;
+    return memquery_library_bounds(name, start, end, NULL, 0) > 0;
+}
+
 app_pc
 get_image_entry()
 {
@@ -8778,6 +8852,39 @@ typedef struct _takeover_record_t {
 static takeover_record_t *thread_takeover_records;
 static uint num_thread_takeover_records;
 
+/* Sorts records by tid so each taken-over thread can find its own record with
+ * a binary search rather than a linear scan, which would make a takeover of n
+ * threads quadratic.  /proc/self/task lists tids in near-ascending order, so
+ * an insertion sort is close to linear here.
+ */
+static void
+takeover_records_sort(takeover_record_t *records, uint num)
+{
+    uint i, j;
+    for (i = 1; i < num; i++) {
+        takeover_record_t tmp = records[i];
+        for (j = i; j > 0 && records[j-1].tid > tmp.tid; j--)
+            records[j] = records[j-1];
+        records[j] = tmp;
+    }
+}
+
+static takeover_record_t *
+takeover_records_lookup(thread_id_t tid)
+{
+    uint lo = 0, hi = num_thread_takeover_records;
+    while (lo < hi) {
+        uint mid = lo + (hi - lo) / 2;
+        if (thread_takeover_records[mid].tid == tid)
+            return &thread_takeover_records[mid];
+        if (thread_takeover_records[mid].tid < tid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
 /* This is the dcontext of the thread that initiated the takeover.  We read the
  * owning_thread and signal_field threads from it in the signaled threads to
  * set up siginfo sharing.
@@ -8902,6 +9009,7 @@ os_take_over_all_unknown_threads(dcontext_t *dcontext)
             records[i].tid = tids[i];
             records[i].event = create_event();
         }
+        takeover_records_sort(records, threads_to_signal);
 
         /* Publish the records and the initial take over dcontext. */
         thread_takeover_records = records;
@@ -8950,10 +9058,10 @@ void
 os_thread_take_over(priv_mcontext_t *mc)
 {
     int r;
-    uint i;
     thread_id_t mytid;
     dcontext_t *dcontext;
     priv_mcontext_t *dc_mc;
+    takeover_record_t *record;
     event_t event = NULL;
 
     LOG(GLOBAL, LOG_THREADS, 1,
@@ -8977,12 +9085,9 @@ os_thread_take_over(priv_mcontext_t *mc)
     /* Wake up the thread that initiated the take over. */
     mytid = get_thread_id();
     ASSERT(thread_takeover_records != NULL);
-    for (i = 0; i < num_thread_takeover_records; i++) {
-        if (thread_takeover_records[i].tid == mytid) {
-            event = thread_takeover_records[i].event;
-            break;
-        }
-    }
+    record = takeover_records_lookup(mytid);
+    if (record != NULL)
+        event = record->event;
     ASSERT_MESSAGE(CHKLVL_ASSERTS, "mytid not present in takeover records!",
                    event != NULL);
     signal_event(event);
@@ -129,11 +129,23 @@ void *get_tls(ushort tls_offs);
 void set_tls(ushort tls_offs, void *value);
 byte *os_get_dr_tls_base(dcontext_t *dcontext);
 
+#ifdef LINUX
+/* in perf_event_linux.c */
+/* The number of counters in dr_perf_counter_t */
+# define PERF_EVENT_NUM_COUNTERS 4
+bool os_perf_counter_request(uint counter);
+bool os_perf_counter_read(dcontext_t *dcontext, uint counter, uint64 *value OUT);
+#endif
+
 /* in os.c */
 void os_file_init(void);
 void os_fork_init(dcontext_t *dcontext);
 void os_thread_stack_store(dcontext_t *dcontext);
 app_pc get_dynamorio_dll_end(void);
+/* Full bounds, including .bss, of the loaded library whose path contains name,
+ * or of the executable if name is NULL.
+ */
+bool os_get_image_bounds(const char *name, app_pc *start OUT, app_pc *end OUT);
 thread_id_t get_tls_thread_id(void);
 thread_id_t get_sys_thread_id(void);
 bool is_thread_terminated(dcontext_t *dcontext);
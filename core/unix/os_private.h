@@ -163,6 +163,10 @@ typedef struct _os_thread_data_t {
 #ifdef X86
     void *app_thread_areas; /* data structure for app's thread area info */
 #endif
+
+#ifdef LINUX
+    void *perf_events; /* perf_event_thread_t, allocated on demand */
+#endif
 } os_thread_data_t;
 
 enum { ARGC_PTRACE_SENTINEL = -1 };
@@ -209,6 +213,13 @@ fd_table_add(file_t fd, uint flags);
 
 uint permstr_to_memprot(const char * const perm);
 
+#ifdef LINUX
+/* in perf_event_linux.c */
+void perf_event_thread_init(dcontext_t *dcontext);
+void perf_event_thread_exit(dcontext_t *dcontext);
+void perf_event_fork_init(dcontext_t *dcontext);
+#endif
+
 /* in signal.c */
 struct _kernel_sigaction_t;
 typedef struct _kernel_sigaction_t kernel_sigaction_t;
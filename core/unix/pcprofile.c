@@ -43,6 +43,7 @@
 #include "../utils.h"
 #include "../fragment.h"
 #include "../fcache.h"
+#include "../module_shared.h"
 #include <string.h> /* for memset */
 #ifdef CLIENT_INTERFACE
 # include "instrument.h"
@@ -96,7 +97,8 @@ typedef struct _thread_pc_info_t {
     int where[WHERE_LAST];
 } thread_pc_info_t;
 
-#define ALARM_FREQUENCY 10 /* milliseconds */
+/* sampling interval in milliseconds */
+#define ALARM_FREQUENCY INTERNAL_OPTION(prof_pcs_interval)
 
 /* forward declarations for static functions */
 static pc_profile_entry_t *pcprofile_add_entry(thread_pc_info_t *info, void *pc, int whereami);
@@ -387,6 +389,18 @@ pcprofile_destroy_entry(thread_pc_info_t *info, void *pc)
 }
 #endif
 
+/* Appends the module containing app pc and the offset into it, so that
+ * samples can be attributed without a separate map of the address space.
+ */
+static void
+pcprofile_print_module(thread_pc_info_t *info, app_pc pc)
+{
+    char name[MAXIMUM_PATH];
+    app_pc base = get_module_base(pc);
+    if (base != NULL && os_get_module_name_buf(pc, name, BUFFER_SIZE_ELEMENTS(name)) > 0)
+        print_file(info->file, "\tin module %s+"PIFX"\n", name, (ptr_uint_t)(pc - base));
+}
+
 /* reset profile structures */
 static void
 pcprofile_reset(thread_pc_info_t *info)
@@ -509,6 +523,10 @@ pcprofile_results(thread_pc_info_t *info)
                         "pc="PFX"\t#=%d\tin %s @"PFX" w/ offs "PFX"\n",
                         e->pc, e->counter, type, e->tag, e->offset);
 #endif
+                /* tags of fragments we build are app pcs, but client-created
+                 * ones may not be: only print if there is a module there
+                 */
+                pcprofile_print_module(info, e->tag);
 #if USE_SYMTAB
                 /* FIXME: this only works for fragments whose tags are app pc's! */
                 if (valid_symtab) {
@@ -526,6 +544,7 @@ pcprofile_results(thread_pc_info_t *info)
 #else
                     print_file(info->file, "pc="PFX"\t#=%d\tin the app\n",
                                e->pc, e->counter);
+                    pcprofile_print_module(info, e->pc);
 #endif
 #if USE_SYMTAB
                 }
@@ -0,0 +1,245 @@
+/* *******************************************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * *******************************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * perf_event_linux.c - per-thread hardware performance counters via
+ * perf_event_open.
+ *
+ * Counters are requested process-wide and then opened for each thread in
+ * os_thread_init(), or on the first read in threads that predate the
+ * request.  Each counter's perf_event_mmap_page is mapped so that on x86 a
+ * read is just rdpmc plus the kernel-maintained offset, with no syscall,
+ * whenever the kernel allows user-mode rdpmc and the counter is live on the
+ * PMU.  Otherwise we fall back to read().
+ */
+
+#include "../globals.h"
+#include "os_private.h"
+#include "include/syscall.h"
+#include "include/perf_event.h"
+
+/* Indexed by counter, in the same order as dr_perf_counter_t */
+static const uint64 perf_event_config[PERF_EVENT_NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+/* Bitmask of requested counters.  Bits are only ever added. */
+static volatile int perf_event_requested;
+
+typedef struct _perf_event_thread_t {
+    file_t fd[PERF_EVENT_NUM_COUNTERS];
+    struct perf_event_mmap_page *page[PERF_EVENT_NUM_COUNTERS];
+} perf_event_thread_t;
+
+#ifdef X86
+static inline uint64
+perf_event_rdpmc(uint idx)
+{
+    uint low, high;
+    __asm__ __volatile__("rdpmc" : "=a"(low), "=d"(high) : "c"(idx));
+    return ((uint64)high << 32) | low;
+}
+#endif
+
+static bool
+perf_event_open_counter(dcontext_t *dcontext, perf_event_thread_t *pt, uint counter)
+{
+    struct perf_event_attr attr;
+    file_t fd, dup;
+    size_t size = PAGE_SIZE;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = PERF_ATTR_SIZE_VER0;
+    attr.config = perf_event_config[counter];
+    /* Counting kernel cycles requires a lower perf_event_paranoid setting,
+     * and we are only interested in the user-mode cost anyway.
+     */
+    attr.flags = PERF_ATTR_FLAG_EXCLUDE_KERNEL | PERF_ATTR_FLAG_EXCLUDE_HV;
+    /* We are always called on the thread to be counted */
+    fd = (file_t) dynamorio_syscall(SYS_perf_event_open, 5, &attr,
+                                    0/*calling thread*/, -1/*any cpu*/,
+                                    -1/*no group*/, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0) {
+        LOG(THREAD, LOG_THREADS, 1, "perf_event_open for counter %d failed: %d\n",
+            counter, fd);
+        return false;
+    }
+    /* Keep it out of the app's way, like our other persistent files */
+    dup = fd_priv_dup(fd);
+    if (dup >= 0) {
+        os_close(fd);
+        fd = dup;
+        fd_mark_close_on_exec(fd);
+    }
+    fd_table_add(fd, 0);
+    pt->fd[counter] = fd;
+    /* The mapping is only an optimization: without it we use read(). */
+    pt->page[counter] = (struct perf_event_mmap_page *)
+        map_file(fd, &size, 0, NULL, MEMPROT_READ, 0);
+    LOG(THREAD, LOG_THREADS, 1, "perf counter %d: fd %d, page "PFX"\n",
+        counter, fd, pt->page[counter]);
+    return true;
+}
+
+static void
+perf_event_close_counter(perf_event_thread_t *pt, uint counter)
+{
+    if (pt->page[counter] != NULL) {
+        unmap_file((byte *)pt->page[counter], PAGE_SIZE);
+        pt->page[counter] = NULL;
+    }
+    if (pt->fd[counter] != INVALID_FILE) {
+        os_close_protected(pt->fd[counter]);
+        pt->fd[counter] = INVALID_FILE;
+    }
+}
+
+static perf_event_thread_t *
+perf_event_thread_data(dcontext_t *dcontext)
+{
+    os_thread_data_t *ostd = (os_thread_data_t *) dcontext->os_field;
+    if (ostd->perf_events == NULL) {
+        perf_event_thread_t *pt = (perf_event_thread_t *)
+            heap_alloc(dcontext, sizeof(*pt) HEAPACCT(ACCT_OTHER));
+        uint i;
+        for (i = 0; i < PERF_EVENT_NUM_COUNTERS; i++) {
+            pt->fd[i] = INVALID_FILE;
+            pt->page[i] = NULL;
+        }
+        ostd->perf_events = pt;
+    }
+    return (perf_event_thread_t *) ostd->perf_events;
+}
+
+void
+perf_event_thread_init(dcontext_t *dcontext)
+{
+    perf_event_thread_t *pt;
+    uint i;
+    if (perf_event_requested == 0)
+        return;
+    pt = perf_event_thread_data(dcontext);
+    for (i = 0; i < PERF_EVENT_NUM_COUNTERS; i++) {
+        if (TEST(1 << i, perf_event_requested))
+            perf_event_open_counter(dcontext, pt, i);
+    }
+}
+
+void
+perf_event_thread_exit(dcontext_t *dcontext)
+{
+    os_thread_data_t *ostd = (os_thread_data_t *) dcontext->os_field;
+    perf_event_thread_t *pt = (perf_event_thread_t *) ostd->perf_events;
+    uint i;
+    if (pt == NULL)
+        return;
+    for (i = 0; i < PERF_EVENT_NUM_COUNTERS; i++)
+        perf_event_close_counter(pt, i);
+    heap_free(dcontext, pt, sizeof(*pt) HEAPACCT(ACCT_OTHER));
+    ostd->perf_events = NULL;
+}
+
+/* The child's copies of the parent's counters count the parent's thread */
+void
+perf_event_fork_init(dcontext_t *dcontext)
+{
+    perf_event_thread_exit(dcontext);
+    perf_event_thread_init(dcontext);
+}
+
+bool
+os_perf_counter_request(uint counter)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    int old;
+    if (counter >= PERF_EVENT_NUM_COUNTERS)
+        return false;
+    do {
+        old = perf_event_requested;
+    } while (!atomic_compare_exchange_int(&perf_event_requested, old,
+                                          old | (1 << counter)));
+    /* Open it now for the requesting thread, which typically is the initial
+     * thread and thus was initialized before any request could be made.
+     */
+    if (dcontext != NULL) {
+        perf_event_thread_t *pt = perf_event_thread_data(dcontext);
+        if (pt->fd[counter] == INVALID_FILE)
+            return perf_event_open_counter(dcontext, pt, counter);
+    }
+    return true;
+}
+
+bool
+os_perf_counter_read(dcontext_t *dcontext, uint counter, uint64 *value OUT)
+{
+    perf_event_thread_t *pt;
+    if (counter >= PERF_EVENT_NUM_COUNTERS || !TEST(1 << counter, perf_event_requested))
+        return false;
+    pt = perf_event_thread_data(dcontext);
+    if (pt->fd[counter] == INVALID_FILE &&
+        !perf_event_open_counter(dcontext, pt, counter))
+        return false;
+#ifdef X86
+    if (pt->page[counter] != NULL) {
+        volatile struct perf_event_mmap_page *page = pt->page[counter];
+        uint seq;
+        int64 count;
+        bool live;
+        /* The kernel updates the page under a sequence lock.  Older kernels
+         * used a different capabilities layout, which bit 1 distinguishes.
+         */
+        do {
+            uint idx;
+            seq = page->lock;
+            COMPILER_BARRIER();
+            idx = page->index;
+            count = page->offset;
+            live = (idx != 0 &&
+                    TESTALL(PERF_CAP_USER_RDPMC | PERF_CAP_BIT0_IS_DEPRECATED,
+                            page->capabilities));
+            if (live) {
+                uint shift = 64 - page->pmc_width;
+                count += (int64)(perf_event_rdpmc(idx - 1) << shift) >> shift;
+            }
+            COMPILER_BARRIER();
+        } while (page->lock != seq);
+        if (live) {
+            *value = (uint64) count;
+            return true;
+        }
+    }
+#endif
+    return os_read(pt->fd[counter], value, sizeof(*value)) == sizeof(*value);
+}
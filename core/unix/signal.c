@@ -2753,6 +2753,34 @@ transfer_from_sig_handler_to_fcache_return(dcontext_t *dcontext, sigcontext_t *s
     });
 }
 
+#ifdef X86
+/* -signal_fast_delivery: rather than going back through fcache_return and
+ * dispatch, point our sigreturn context straight at the handler's fragment
+ * if one already exists.  This is equivalent to an indirect branch lookup
+ * hit: the kernel restores the app registers (with the handler arguments in
+ * place) and the thread is still in the cache as far as the rest of DR is
+ * concerned.  Trace heads are excluded as they need dispatch to count their
+ * executions.  Returns false if the caller should go through fcache_return.
+ */
+static bool
+transfer_from_sig_handler_to_fragment(dcontext_t *dcontext, sigcontext_t *sc,
+                                      app_pc next_pc)
+{
+    fragment_t *f;
+    if (!DYNAMO_OPTION(signal_fast_delivery))
+        return false;
+    f = fragment_lookup(dcontext, next_pc);
+    if (f == NULL || TEST(FRAG_IS_TRACE_HEAD, f->flags) ||
+        FRAG_ISA_MODE(f->flags) != dr_get_isa_mode(dcontext))
+        return false;
+    sc->SC_XIP = (ptr_uint_t) FCACHE_ENTRY_PC(f);
+    STATS_INC(num_signals_fast_delivered);
+    LOG(THREAD, LOG_ASYNCH, 2,
+        "	resuming directly in F%d("PFX") @"PFX"\n", f->id, next_pc, sc->SC_XIP);
+    return true;
+}
+#endif
+
 #ifdef CLIENT_INTERFACE
 static dr_signal_action_t
 send_signal_to_client(dcontext_t *dcontext, int sig, sigframe_rt_t *frame,
@@ -3129,6 +3157,15 @@ adjust_syscall_for_restart(dcontext_t *dcontext, thread_sig_info_t *info, int si
          * heavyweight, so we do our own decode loop.
          * We assume we'll find a mov-imm b/c otherwise we wouldn't have inlined this.
          */
+#ifdef X86
+        /* find_syscall_num() also follows one register copy into xax, so we
+         * track the last constant moved into each GPR.
+         */
+        int gpr_imm[DR_NUM_GPR_REGS];
+        int i;
+        for (i = 0; i < DR_NUM_GPR_REGS; i++)
+            gpr_imm[i] = -1;
+#endif
         LOG(THREAD, LOG_ASYNCH, 3, "%s: decoding to find syscall #\n", __FUNCTION__);
         instr_init(dcontext, &instr);
         pc = FCACHE_ENTRY_PC(f);
@@ -3145,6 +3182,28 @@ adjust_syscall_for_restart(dcontext_t *dcontext, thread_sig_info_t *info, int si
                 sysnum = (int) opnd_get_immed_int(instr_get_src(&instr, 0));
                 /* don't break: find last one before syscall */
             }
+#ifdef X86
+            else if (instr_valid(&instr) && instr_num_dsts(&instr) > 0 &&
+                     opnd_is_reg(instr_get_dst(&instr, 0)) &&
+                     reg_is_gpr(opnd_get_reg(instr_get_dst(&instr, 0)))) {
+                reg_id_t dst =
+                    reg_to_pointer_sized(opnd_get_reg(instr_get_dst(&instr, 0)));
+                ptr_int_t val;
+                if (instr_get_opcode(&instr) == OP_mov_imm &&
+                    instr_is_mov_constant(&instr, &val))
+                    gpr_imm[dst - DR_REG_START_GPR] = (int) val;
+                else if ((instr_get_opcode(&instr) == OP_mov_ld ||
+                          instr_get_opcode(&instr) == OP_mov_st) &&
+                         opnd_is_reg(instr_get_src(&instr, 0)) &&
+                         reg_is_gpr(opnd_get_reg(instr_get_src(&instr, 0))) &&
+                         dst == reg_to_pointer_sized(DR_REG_SYSNUM)) {
+                    reg_id_t src =
+                        reg_to_pointer_sized(opnd_get_reg(instr_get_src(&instr, 0)));
+                    if (gpr_imm[src - DR_REG_START_GPR] != -1)
+                        sysnum = gpr_imm[src - DR_REG_START_GPR];
+                }
+            }
+#endif
         } while (pc != NULL && instr_valid(&instr) && !instr_is_syscall(&instr) &&
                  pc < FCACHE_ENTRY_PC(f) + f->size);
         instr_free(dcontext, &instr);
@@ -3777,6 +3836,63 @@ compute_memory_target(dcontext_t *dcontext, cache_pc instr_cache_pc,
     return target;
 }
 
+#ifdef X86
+/* For -selfmod_line_shadow: if a simple store to a page we made read-only
+ * misses every line we have built code from, perform it here and skip past it
+ * in the cache, leaving the page read-only and its fragments in place.
+ * Returns false if the caller should flush as usual.
+ */
+static bool
+emulate_write_to_data_line(dcontext_t *dcontext, cache_pc instr_cache_pc,
+                           sigcontext_t *sc, byte *target)
+{
+    sig_full_cxt_t sc_full = {sc, NULL};
+    priv_mcontext_t mc;
+    instr_t instr;
+    app_pc page = (app_pc) PAGE_START(target);
+    app_pc next_pc = NULL;
+    uint size = 0;
+    bool simple;
+    sigcontext_to_mcontext(&mc, &sc_full);
+    instr_init(dcontext, &instr);
+    decode(dcontext, instr_cache_pc, &instr);
+    simple = instr_valid(&instr) && instr_get_opcode(&instr) == OP_store;
+    if (simple) {
+        opnd_t dst = instr_get_dst(&instr, 0);
+        size = opnd_size_in_bytes(opnd_get_size(dst));
+        simple = (size == 4 IF_X64(|| size == 8)) &&
+            opnd_get_segment(dst) == REG_NULL &&
+            opnd_compute_address_priv(dst, &mc) == target;
+    }
+    instr_free(dcontext, &instr);
+    /* Persisted code is validated against the whole page, so it has to go
+     * through the flush.  We check outside the shadow lock, which ranks
+     * below executable_areas.
+     */
+    if (!simple || executable_vm_area_persisted_overlap(page, page + PAGE_SIZE))
+        return false;
+    /* FIXME: like the Windows MOD_CODE_EMULATE_WRITE path there is a window
+     * where other threads can write to the page while we have it writable;
+     * holding the shadow lock at least keeps them from building code from it.
+     */
+    vm_area_code_lines_lock();
+    if (vm_area_write_misses_code_lines(target, target + size) &&
+        make_writable(page, PAGE_SIZE)) {
+        next_pc = emulate(dcontext, instr_cache_pc, &mc);
+        make_unwritable(page, PAGE_SIZE);
+    }
+    vm_area_code_lines_unlock();
+    if (next_pc == NULL)
+        return false;
+    LOG(THREAD, LOG_ASYNCH, 2, "emulated write to data line "PFX" at cache pc "PFX"\n",
+        target, instr_cache_pc);
+    STATS_INC(num_data_line_writes);
+    STATS_INC(num_emulated_writes);
+    sc->SC_XIP = (ptr_uint_t) next_pc;
+    return true;
+}
+#endif
+
 /* If native_state is true, assumes the fault is not in the cache and thus
  * does not need translation but rather should always be re-executed.
  */
@@ -3802,6 +3918,11 @@ check_for_modified_code(dcontext_t *dcontext, cache_pc instr_cache_pc,
         fragment_t *f = NULL;
         fragment_t wrapper;
         ASSERT((cache_pc)sc->SC_XIP == instr_cache_pc);
+#ifdef X86
+        if (!native_state && DYNAMO_OPTION(selfmod_line_shadow) &&
+            emulate_write_to_data_line(dcontext, instr_cache_pc, sc, target))
+            return true;
+#endif
         if (!native_state) {
             /* For safe recreation we need to either be couldbelinking or hold
              * the initexit lock (to keep someone from flushing current
@@ -4376,7 +4497,7 @@ execute_handler_from_cache(dcontext_t *dcontext, int sig, sigframe_rt_t *our_fra
 #endif
 
     LOG(THREAD, LOG_ASYNCH, 2, "execute_handler_from_cache for signal %d\n", sig);
-    RSTATS_INC(num_signals);
+    RSTATS_INC_THREAD(num_signals);
 
     /* now that we know it's not a client-involved fault, dump as app fault */
     report_app_problem(dcontext, APPFAULT_FAULT, (byte *)sc->SC_XIP, (byte *)sc->SC_FP,
@@ -4439,12 +4560,18 @@ execute_handler_from_cache(dcontext_t *dcontext, int sig, sigframe_rt_t *our_fra
      * translated context to the app stack) to point to fcache_return!
      * Then we'll go back through kernel, appear in fcache_return,
      * and go through dispatch & interp, without messing up DR stack.
+     * With -signal_fast_delivery we instead go straight to the handler's
+     * fragment if it has already been built.
      */
-    transfer_from_sig_handler_to_fcache_return
-        (dcontext, sc,
-         /* Make sure handler is next thing we execute */
-         (app_pc) SIGACT_PRIMARY_HANDLER(info->app_sigaction[sig]),
-         (linkstub_t *) get_sigreturn_linkstub());
+#ifdef X86
+    if (!transfer_from_sig_handler_to_fragment
+        (dcontext, sc, (app_pc) SIGACT_PRIMARY_HANDLER(info->app_sigaction[sig])))
+#endif
+        transfer_from_sig_handler_to_fcache_return
+            (dcontext, sc,
+             /* Make sure handler is next thing we execute */
+             (app_pc) SIGACT_PRIMARY_HANDLER(info->app_sigaction[sig]),
+             (linkstub_t *) get_sigreturn_linkstub());
 
     if ((info->app_sigaction[sig]->flags & SA_ONESHOT) != 0) {
         /* clear handler now -- can't delete memory since sigreturn,
@@ -4484,7 +4611,7 @@ execute_handler_from_dispatch(dcontext_t *dcontext, int sig)
 #endif
 
     LOG(THREAD, LOG_ASYNCH, 2, "execute_handler_from_dispatch for signal %d\n", sig);
-    RSTATS_INC(num_signals);
+    RSTATS_INC_THREAD(num_signals);
 
     /* modify the rtframe before copying to stack so we can pass final
      * version to client, and propagate its mods
@@ -71,6 +71,9 @@
 # include "fcache.h"
 # include "synch.h" /* all_threads_synch_lock */
 #endif
+#ifdef CLIENT_INTERFACE
+# include "instrument.h" /* instrument_flush_buffered_files */
+#endif
 
 #include <stdarg.h> /* for varargs */
 
@@ -1595,6 +1598,28 @@ bitmap_allocate_blocks(bitmap_t b, uint bitmap_size, uint request_blocks)
     return res;
 }
 
+/* Like bitmap_allocate_blocks() but takes the highest run of free blocks, so that
+ * allocations made this way are packed together at the top.
+ */
+uint
+bitmap_allocate_blocks_from_top(bitmap_t b, uint bitmap_size, uint request_blocks)
+{
+    uint i, run = 0;
+    for (i = bitmap_size; i > 0; i--) {
+        if (!bitmap_test(b, i - 1)) {
+            run = 0;
+            continue;
+        }
+        if (++run == request_blocks) {
+            uint res = i - 1;
+            for (i = 0; i < request_blocks; i++)
+                bitmap_clear(b, res + i);
+            return res;
+        }
+    }
+    return BITMAP_NOT_FOUND;
+}
+
 void
 bitmap_free_blocks(bitmap_t b, uint bitmap_size, uint first_block, uint num_free)
 {
@@ -2314,6 +2339,10 @@ report_dynamorio_problem(dcontext_t *dcontext, uint dumpcore_flag,
     mutex_unlock(&report_buf_lock);
 
     if (dumpcore_flag != DUMPCORE_CURIOSITY) {
+#ifdef CLIENT_INTERFACE
+        /* keep what the client logged up to the crash */
+        instrument_flush_buffered_files(true/*crashing*/);
+#endif
         /* print out stats, can't be done inside the report_buf_lock
          * because of non-trivial lock rank order violation on the
          * snapshot_lock */
@@ -2967,6 +2996,38 @@ get_short_name(const char *exename)
     return exe;
 }
 
+/* Per-thread batching of hot release stats (-thread_rstats) */
+void
+rstats_thread_init(dcontext_t *dcontext)
+{
+    if (!DYNAMO_OPTION(thread_rstats))
+        return;                 /* dcontext->rstats_field stays NULL */
+    dcontext->rstats_field =
+        HEAP_TYPE_ALLOC(dcontext, thread_rstats_t, ACCT_STATS, UNPROTECTED);
+    memset(dcontext->rstats_field, 0, sizeof(thread_rstats_t));
+}
+
+/* May be called by another thread on dcontext's behalf */
+void
+rstats_thread_exit(dcontext_t *dcontext)
+{
+    thread_rstats_t *trs = (thread_rstats_t *) dcontext->rstats_field;
+    if (trs == NULL)
+        return;
+    /* stop batching before we fold in what's left */
+    dcontext->rstats_field = NULL;
+    if (GLOBAL_STATS_ON()) {
+#define THREAD_RSTAT_DEF(stat)                                              \
+        if (trs->pending[THREAD_RSTAT_##stat] != 0) {                       \
+            XSTATS_ATOMIC_ADD(GLOBAL_STAT(stat),                            \
+                              trs->pending[THREAD_RSTAT_##stat]);           \
+        }
+        THREAD_RSTATS_DEFINITIONS()
+#undef THREAD_RSTAT_DEF
+    }
+    HEAP_TYPE_FREE(dcontext, trs, thread_rstats_t, ACCT_STATS, UNPROTECTED);
+}
+
 /****************************************************************************/
 
 #ifdef DEBUG
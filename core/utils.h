@@ -460,6 +460,7 @@ enum {
     LOCK_RANK(patch_proof_areas), /* < dynamo_areas < global_alloc_lock */
     LOCK_RANK(emulate_write_areas), /* < dynamo_areas < global_alloc_lock */
     LOCK_RANK(IAT_areas), /* < dynamo_areas < global_alloc_lock */
+    LOCK_RANK(jit_managed_areas), /* < dynamo_areas < global_alloc_lock */
 #ifdef CLIENT_INTERFACE
     /* PR 198871: this same label is used for all client locks */
     LOCK_RANK(dr_client_mutex), /* > module_data_lock */
@@ -467,6 +468,7 @@ enum {
     LOCK_RANK(client_flush_request_lock), /* > dr_client_mutex */
     LOCK_RANK(callback_registration_lock), /* > dr_client_mutex */
     LOCK_RANK(client_tls_lock), /* > dr_client_mutex */
+    LOCK_RANK(client_file_buf_lock), /* > dr_client_mutex */
 #endif
     LOCK_RANK(intercept_hook_lock), /* < table_rwlock */
     LOCK_RANK(privload_lock), /* < modlist_areas, < table_rwlock */
@@ -495,6 +497,7 @@ enum {
 #ifdef CALL_PROFILE
     LOCK_RANK(profile_callers_lock), /* < global_alloc_lock */
 #endif
+    LOCK_RANK(trace_path_lock),
     LOCK_RANK(coarse_stub_areas), /* < global_alloc_lock */
     LOCK_RANK(moduledb_lock), /* < global heap allocation */
     LOCK_RANK(pcache_dir_check_lock),
@@ -541,6 +544,7 @@ enum {
                           * need to be even lower: as it is, only used for set */
 #endif
     LOCK_RANK(reset_pending_lock), /* > heap_unit_lock */
+    LOCK_RANK(stack_cache_lock), /* > heap_unit_lock, vmh_lock */
 
     LOCK_RANK(initstack_mutex),  /* FIXME: NOT TESTED */
 
@@ -1095,6 +1099,7 @@ bitmap_clear(bitmap_t b, uint i)
 /* bitmap_size is number of bits in the bitmap_t */
 void bitmap_initialize_free(bitmap_t b, uint bitmap_size);
 uint bitmap_allocate_blocks(bitmap_t b, uint bitmap_size, uint request_blocks);
+uint bitmap_allocate_blocks_from_top(bitmap_t b, uint bitmap_size, uint request_blocks);
 void bitmap_free_blocks(bitmap_t b, uint bitmap_size, uint first_block, uint num_free);
 
 #ifdef DEBUG
@@ -1590,6 +1595,50 @@ enum {LONGJMP_EXCEPTION = 1};
         XSTATS_WITH_DC(stats_reset__dcontext,                            \
                       XSTATS_RESET_DC(stats_reset__dcontext, stat))
 
+/* Release stats bumped on hot paths, whose increments can be batched in a
+ * per-thread block with -thread_rstats to avoid an atomic add on a shared
+ * cache line each time.  Each thread adds its batch to the global stat every
+ * THREAD_RSTATS_BATCH increments and adds the remainder at thread exit, so a
+ * global value lags by less than that much per live thread.
+ */
+#define THREAD_RSTATS_DEFINITIONS() \
+    THREAD_RSTAT_DEF(pre_syscall)   \
+    THREAD_RSTAT_DEF(post_syscall)  \
+    THREAD_RSTAT_DEF(num_bbs)       \
+    THREAD_RSTAT_DEF(num_traces)    \
+    THREAD_RSTAT_DEF(num_signals)
+
+enum {
+#define THREAD_RSTAT_DEF(stat) THREAD_RSTAT_##stat,
+    THREAD_RSTATS_DEFINITIONS()
+#undef THREAD_RSTAT_DEF
+    THREAD_RSTAT_NUM
+};
+
+#define THREAD_RSTATS_BATCH 256
+
+typedef struct _thread_rstats_t {
+    stats_int_t pending[THREAD_RSTAT_NUM];
+} thread_rstats_t;
+
+#define RSTATS_INC_THREAD(stat) do {                                          \
+        dcontext_t *rstats_inc__dc = NULL;                                    \
+        if (DYNAMO_OPTION(thread_rstats))                                     \
+            rstats_inc__dc = get_thread_private_dcontext();                   \
+        if (rstats_inc__dc != NULL && rstats_inc__dc->rstats_field != NULL) { \
+            stats_int_t *rstats_inc__val = &((thread_rstats_t *)              \
+                rstats_inc__dc->rstats_field)->pending[THREAD_RSTAT_##stat];  \
+            DO_THREAD_STATS(rstats_inc__dc,                                   \
+                            THREAD_STAT(rstats_inc__dc, stat) += 1);          \
+            if (++(*rstats_inc__val) == THREAD_RSTATS_BATCH) {                \
+                DO_GLOBAL_STATS(XSTATS_ATOMIC_ADD(GLOBAL_STAT(stat),          \
+                                                  THREAD_RSTATS_BATCH));      \
+                *rstats_inc__val = 0;                                         \
+            }                                                                 \
+        } else                                                                \
+            RSTATS_INC(stat);                                                 \
+    } while (0)
+
 /* common to both release and debug build */
 #define RSTATS_INC XSTATS_INC
 #define RSTATS_DEC XSTATS_DEC
@@ -1999,6 +2048,10 @@ notify(syslog_event_type_t priority, bool internal, bool synch,
  * needed by print_symbolic_address() */
 #define MAXIMUM_SYMBOL_LENGTH 80
 
+/* batched per-thread release stats: present in release builds too */
+void rstats_thread_init(dcontext_t *dcontext);
+void rstats_thread_exit(dcontext_t *dcontext);
+
 #ifdef DEBUG
 # define PRINT_TIMESTAMP_MAX_LENGTH 32
 
@@ -284,6 +284,11 @@ vm_area_vector_t *patch_proof_areas;
  */
 vm_area_vector_t *emulate_write_areas;
 
+/* Regions whose code changes are announced by the app via the JIT code area
+ * annotations, rather than detected through page protection or sandboxing.
+ */
+static vm_area_vector_t *jit_managed_areas;
+
 /* used for DYNAMO_OPTION(IAT_convert)
  * IAT or GOT areas of all mapped DLLs - note the exact regions are added here.
  * While the IATs for modules in native_exec_areas are not added here -
@@ -298,6 +303,22 @@ static vm_area_vector_t *written_areas;
 
 static void free_written_area(void *data);
 
+/* For -selfmod_line_shadow: maps a page start to which of its lines we may
+ * have built code from (bit i covers the i-th CODE_LINE_SIZE bytes).  Bits are
+ * only cleared when the memory is freed, so they conservatively cover every
+ * fragment ever built from the page.
+ */
+#define CODE_LINE_BIT(pc) \
+    (1ULL << (((ptr_uint_t)(pc) & (PAGE_SIZE - 1)) / CODE_LINE_SIZE))
+#define INIT_HTABLE_SIZE_CODE_LINES 9 /* bits */
+typedef struct _code_lines_t {
+    uint64 lines;
+    uint emulated_writes; /* since the page was last flushed for a write */
+} code_lines_t;
+static generic_table_t *code_line_shadow;
+
+static void free_code_lines(void *data);
+
 #ifdef PROGRAM_SHEPHERDING
 /* for executable_if_flush and executable_if_alloc, we need a future list, so their regions
  * are considered executable until de-allocated -- even if written to!
@@ -840,8 +861,11 @@ vm_area_vector_check_size(vm_area_vector_t *v)
                                                   HEAPACCT(ACCT_VMAREAS));
         }
         else {
-            /* FIXME: case 4471 we should be doubling size here */
-            int new_size = (INTERNAL_OPTION(vmarea_increment_size) + v->length);
+            /* case 4471: grow geometrically so that building up a vector of
+             * many thousands of areas does not realloc per increment
+             */
+            int new_size = v->length +
+                MAX(INTERNAL_OPTION(vmarea_increment_size), v->length);
             STATS_INC(num_vmareas_resized);
             v->buf = global_heap_realloc(v->buf, v->size, new_size,
                                          sizeof(struct vm_area_t)
@@ -878,6 +902,41 @@ vm_area_merge_fraglists(vm_area_t *dst, vm_area_t *src)
     }
 }
 
+/* Returns the index of the first area in v that ends at or after addr, i.e.,
+ * the first that can overlap or be adjacent to a region starting at addr, or
+ * v->length if there is none.  Lets add, remove, and flush skip the areas
+ * below addr in O(log n).
+ * Assumes caller holds v->lock, if necessary.
+ */
+static int
+vm_area_first_reaching(vm_area_vector_t *v, app_pc addr)
+{
+    int min = 0;
+    int max = v->length;
+    ASSERT_VMAREA_VECTOR_PROTECTED(v, READWRITE);
+    while (min < max) {
+        int i = (min + max) / 2;
+        if (v->buf[i].end < addr)
+            min = i + 1;
+        else
+            max = i;
+    }
+    return min;
+}
+
+/* Returns one past the index of the last area in v at or after index first
+ * that starts before end.
+ * Assumes caller holds v->lock, if necessary.
+ */
+static int
+vm_area_last_reaching(vm_area_vector_t *v, int first, app_pc end)
+{
+    int i;
+    for (i = first; i < v->length && v->buf[i].start < end; i++)
+        ; /* nothing */
+    return i;
+}
+
 /* Assumes caller holds v->lock, if necessary.
  * Does not return the area added since it may be merged or split depending
  * on existing areas->
@@ -903,7 +962,7 @@ static void
 add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end,
             uint vm_flags, uint frag_flags, void *data _IF_DEBUG(const char *comment))
 {
-    int i, j, diff;
+    int i, diff;
     /* if we have overlap, we extend an existing area -- else we add a new area */
     int overlap_start = -1, overlap_end = -1;
     DEBUG_DECLARE(uint flagignore;)
@@ -916,8 +975,10 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end,
         (v == executable_areas ? " executable_areas" :
          (v == IF_LINUX_ELSE(all_memory_areas, NULL) ? " all_memory_areas" :
           (v == dynamo_areas ? " dynamo_areas" : ""))), start, end, comment);
-    /* N.B.: new area could span multiple existing areas! */
-    for (i = 0; i < v->length; i++) {
+    /* N.B.: new area could span multiple existing areas!
+     * None that end before start can overlap or be adjacent, so skip them.
+     */
+    for (i = vm_area_first_reaching(v, start); i < v->length; i++) {
         /* look for overlap, or adjacency of same type (including all flags, and never
          * merge adjacent if keeping write counts)
          */
@@ -1144,8 +1205,7 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end,
         LOG(GLOBAL, LOG_VMAREAS, 3, "=> adding "PFX"-"PFX"\n", start, end);
         vm_area_vector_check_size(v);
         /* shift subsequent entries */
-        for (j = v->length; j > i; j--)
-            v->buf[j] = v->buf[j-1];
+        memmove(&v->buf[i+1], &v->buf[i], (v->length - i) * sizeof(vm_area_t));
         v->buf[i] = new_area;
         /* assumption: no overlaps between areas in list! */
 #ifdef DEBUG
@@ -1225,8 +1285,8 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end,
                 vm_area_merge_fraglists(&v->buf[overlap_start], &v->buf[i]);
         }
         diff = overlap_end - (overlap_start+1);
-        for (i = overlap_start+1; i < v->length-diff; i++)
-            v->buf[i] = v->buf[i+diff];
+        memmove(&v->buf[overlap_start+1], &v->buf[overlap_end],
+                (v->length - overlap_end) * sizeof(vm_area_t));
         v->length -= diff;
         i = overlap_start; /* for return value */
         if (TEST(VECTOR_FRAGMENT_LIST, v->flags) && v->buf[i].custom.frags != NULL) {
@@ -1303,7 +1363,7 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
     ASSERT_VMAREA_VECTOR_PROTECTED(v, WRITE);
     LOG(GLOBAL, LOG_VMAREAS, 4, "in remove_vm_area "PFX" "PFX"\n", start, end);
     /* N.B.: removed area could span multiple areas! */
-    for (i = 0; i < v->length; i++) {
+    for (i = vm_area_first_reaching(v, start); i < v->length; i++) {
         /* look for overlap */
         if (start < v->buf[i].end && end > v->buf[i].start) {
             if (overlap_start == -1)
@@ -1420,8 +1480,8 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
             ASSERT(!TEST(VECTOR_FRAGMENT_LIST, v->flags) || v->buf[i].custom.frags == NULL);
         }
         diff = overlap_end - overlap_start;
-        for (i = overlap_start; i < v->length-diff; i++)
-            v->buf[i] = v->buf[i+diff];
+        memmove(&v->buf[overlap_start], &v->buf[overlap_end],
+                (v->length - overlap_end) * sizeof(vm_area_t));
 #ifdef DEBUG
         memset(v->buf + v->length - diff, 0, diff * sizeof(vm_area_t));
 #endif
@@ -1582,12 +1642,22 @@ vm_areas_init()
                           patch_proof_areas);
     VMVECTOR_ALLOC_VECTOR(emulate_write_areas, GLOBAL_DCONTEXT, VECTOR_SHARED,
                           emulate_write_areas);
+    VMVECTOR_ALLOC_VECTOR(jit_managed_areas, GLOBAL_DCONTEXT, VECTOR_SHARED,
+                          jit_managed_areas);
     VMVECTOR_ALLOC_VECTOR(IAT_areas, GLOBAL_DCONTEXT, VECTOR_SHARED,
                           IAT_areas);
     VMVECTOR_ALLOC_VECTOR(written_areas, GLOBAL_DCONTEXT,
                           VECTOR_SHARED | VECTOR_NEVER_MERGE,
                           written_areas);
     vmvector_set_callbacks(written_areas, free_written_area, NULL, NULL, NULL);
+    if (DYNAMO_OPTION(selfmod_line_shadow)) {
+        code_line_shadow = generic_hash_create(GLOBAL_DCONTEXT,
+                                               INIT_HTABLE_SIZE_CODE_LINES,
+                                               80 /* load factor */,
+                                               HASHTABLE_SHARED | HASHTABLE_PERSISTENT,
+                                               free_code_lines
+                                               _IF_DEBUG("code line shadow"));
+    }
 #ifdef PROGRAM_SHEPHERDING
     VMVECTOR_ALLOC_VECTOR(futureexec_areas, GLOBAL_DCONTEXT, VECTOR_SHARED,
                           futureexec_areas);
@@ -1698,6 +1768,7 @@ vm_areas_exit()
         ASSERT(pretend_writable_areas == NULL);
         ASSERT(patch_proof_areas == NULL);
         ASSERT(emulate_write_areas == NULL);
+        ASSERT(jit_managed_areas == NULL);
         ASSERT(written_areas == NULL);
 #ifdef PROGRAM_SHEPHERDING
         ASSERT(futureexec_areas == NULL);
@@ -1757,9 +1828,15 @@ vm_areas_exit()
     patch_proof_areas = NULL;
     vmvector_delete_vector(GLOBAL_DCONTEXT, emulate_write_areas);
     emulate_write_areas = NULL;
+    vmvector_delete_vector(GLOBAL_DCONTEXT, jit_managed_areas);
+    jit_managed_areas = NULL;
 
     vmvector_delete_vector(GLOBAL_DCONTEXT, written_areas);
     written_areas = NULL;
+    if (code_line_shadow != NULL) {
+        generic_hash_destroy(GLOBAL_DCONTEXT, code_line_shadow);
+        code_line_shadow = NULL;
+    }
 
 #ifdef PROGRAM_SHEPHERDING
     DOLOG(1, LOG_VMAREAS, {
@@ -2247,6 +2324,13 @@ free_written_area(void *data)
                    ro_vs_sandbox_data_t, ACCT_VMAREAS, UNPROTECTED);
 }
 
+static void
+free_code_lines(void *data)
+{
+    HEAP_TYPE_FREE(GLOBAL_DCONTEXT, (code_lines_t *) data, code_lines_t,
+                   ACCT_VMAREAS, UNPROTECTED);
+}
+
 /* Functions as a lookup routine if an entry is already present.
  * Returns true if an entry was already present, false if not, in which
  * case an entry containing tag with suggested bounds of [start, end)
@@ -2509,6 +2593,8 @@ add_executable_vm_area_helper(app_pc start, app_pc end, uint vm_flags, uint frag
 {
     ASSERT_OWN_WRITE_LOCK(true, &executable_areas->lock);
 
+    /* The code may have changed while we weren't watching for writes. */
+    decode_cache_invalidate(start, end);
     add_vm_area(executable_areas, start, end,
                 vm_flags, frag_flags, NULL _IF_DEBUG(comment));
 
@@ -3727,6 +3813,50 @@ pretend_writable_vm_area_overlap(app_pc start, app_pc end)
     return overlap;
 }
 
+/* returns true if all of [start, end) lies in a single JIT-managed area */
+static bool
+is_jit_managed_area(app_pc start, app_pc end)
+{
+    app_pc area_end;
+    if (vmvector_empty(jit_managed_areas))
+        return false;
+    return vmvector_lookup_data(jit_managed_areas, start, NULL, &area_end, NULL) &&
+        end <= area_end;
+}
+
+/* Implements the dynamorio_annotate_manage_code_area annotation.  Code in the
+ * region is no longer kept read-only or sandboxed; the app is responsible for
+ * announcing changes via dynamorio_annotate_flush_fragments.
+ */
+void
+set_region_jit_managed(dcontext_t *dcontext, app_pc start, size_t size)
+{
+    LOG(GLOBAL, LOG_VMAREAS, 1, "JIT-managed code area "PFX"-"PFX"\n",
+        start, start + size);
+    vmvector_add(jit_managed_areas, start, start + size, NULL);
+    /* Anything already built from the region was built under the old policy:
+     * drop it and restore writability so the region is re-added as managed.
+     */
+    flush_fragments_and_remove_region(dcontext, start, size,
+                                      false/*don't own initexit_lock*/,
+                                      false/*keep futures*/);
+}
+
+/* Implements the dynamorio_annotate_unmanage_code_area annotation */
+void
+set_region_app_managed(dcontext_t *dcontext, app_pc start, size_t size)
+{
+    if (!vmvector_overlap(jit_managed_areas, start, start + size))
+        return;
+    LOG(GLOBAL, LOG_VMAREAS, 1, "no longer JIT-managed: "PFX"-"PFX"\n",
+        start, start + size);
+    vmvector_remove(jit_managed_areas, start, start + size);
+    /* re-added with the regular consistency policy on its next execution */
+    flush_fragments_and_remove_region(dcontext, start, size,
+                                      false/*don't own initexit_lock*/,
+                                      false/*keep futures*/);
+}
+
 #ifdef DEBUG
 /* returns comment for addr, if there is one, else NULL
  */
@@ -6116,6 +6246,9 @@ app_memory_deallocation(dcontext_t *dcontext, app_pc base, size_t size,
                         bool own_initexit_lock, bool image)
 {
     ASSERT(!dynamo_vm_area_overlap(base, base + size));
+    if (!vmvector_empty(jit_managed_areas) &&
+        vmvector_overlap(jit_managed_areas, base, base + size))
+        vmvector_remove(jit_managed_areas, base, base + size);
     /* we check for overlap regardless of memory protections, to allow flexible
      * policies that are independent of rwx bits -- if any overlap we remove,
      * no shortcuts
@@ -6124,6 +6257,13 @@ app_memory_deallocation(dcontext_t *dcontext, app_pc base, size_t size,
         /* ok for overlap to have changed in between, flush checks again */
         flush_fragments_and_remove_region(dcontext, base, size, own_initexit_lock,
                                           true/*free futures*/);
+        if (code_line_shadow != NULL) {
+            TABLE_RWLOCK(code_line_shadow, write, lock);
+            generic_hash_range_remove(GLOBAL_DCONTEXT, code_line_shadow,
+                                      (ptr_uint_t) PAGE_START(base),
+                                      (ptr_uint_t) base + size);
+            TABLE_RWLOCK(code_line_shadow, write, unlock);
+        }
 
 #ifdef RETURN_AFTER_CALL
         if (DYNAMO_OPTION(ret_after_call) && !image
@@ -6515,6 +6655,15 @@ app_memory_protection_change(dcontext_t *dcontext, app_pc base, size_t size,
     }
 #endif
 
+    /* A JIT toggling its code between writable and executable announces the
+     * actual changes, so there is nothing to flush here.
+     */
+    if (is_jit_managed_area(base, base + size)) {
+        LOG(THREAD, LOG_SYSCALLS|LOG_VMAREAS, 2,
+            "protection change in JIT-managed area "PFX"-"PFX"\n", base, base+size);
+        return DO_APP_MEM_PROT_CHANGE; /* let syscall go through */
+    }
+
 #ifndef PROGRAM_SHEPHERDING
     if (!INTERNAL_OPTION(hw_cache_consistency))
         return DO_APP_MEM_PROT_CHANGE; /* let syscall go through */
@@ -7250,6 +7399,10 @@ check_thread_vm_area(dcontext_t *dcontext, app_pc pc, app_pc tag, void **vmlist,
 
     ASSERT(flags != NULL);
 
+    /* a -thread_scoped_flush may have let us run while it flushes this code */
+    if (vmlist != NULL)
+        wait_for_scoped_flush(dcontext, pc, pc + 1);
+
     /* don't know yet whether this bb will be shared, but a good chance,
      * so we guess shared and will rectify later.
      * later, to add to local instead, we call again, and to tell the difference
@@ -7909,7 +8062,15 @@ check_thread_vm_area(dcontext_t *dcontext, app_pc pc, app_pc tag, void **vmlist,
                  * with only the valid subpage on the origins list.  We don't mark
                  * pieces of a large region, for simplicity.
                  */
-                if (is_executable_area_on_all_selfmod_pages(base_pc, base_pc+size)) {
+                if (is_jit_managed_area(base_pc, base_pc+size)) {
+                    /* the JIT announces its changes: no protection needed */
+                    LOG(GLOBAL, LOG_VMAREAS, 2,
+                        "\tNew executable region "PFX"-"PFX" is writable, but "
+                        "JIT-managed, so leaving as writable\n", base_pc, base_pc+size);
+                    STATS_INC(num_jit_managed_code_regions);
+                }
+                else if (is_executable_area_on_all_selfmod_pages(base_pc,
+                                                                  base_pc+size)) {
                     frag_flags |= SANDBOX_FLAG();
                 }
                 /* case 8308: We've added options to force certain regions to
@@ -7932,7 +8093,8 @@ check_thread_vm_area(dcontext_t *dcontext, app_pc pc, app_pc tag, void **vmlist,
                     LOG(GLOBAL, LOG_VMAREAS, 2,
                         "\tNew executable region "PFX"-"PFX" is writable, but selfmod, "
                         "so leaving as writable\n", base_pc, base_pc+size);
-                } else if (INTERNAL_OPTION(hw_cache_consistency)) {
+                } else if (INTERNAL_OPTION(hw_cache_consistency) &&
+                           !is_jit_managed_area(base_pc, base_pc+size)) {
                     /* Make entire region read-only
                      * If that's too big, i.e., it contains some data, the
                      * region size will be corrected when we get a write
@@ -9176,7 +9338,7 @@ vm_area_unlink_fragments(dcontext_t *dcontext, app_pc start, app_pc end,
     LOG_DECLARE(file_t thread_log = get_thread_private_logfile();)
     thread_data_t *data = GET_DATA(dcontext, 0);
     fragment_t *entry, *next;
-    int num = 0, i;
+    int num = 0, i, first;
     if (data == shared_data) {
         /* we also need to add to the deletion list */
         mutex_lock(&shared_delete_lock);
@@ -9203,10 +9365,11 @@ vm_area_unlink_fragments(dcontext_t *dcontext, app_pc start, app_pc end,
     LOG(thread_log, LOG_FRAGMENT|LOG_VMAREAS, 2,
         "vm_area_unlink_fragments "PFX".."PFX"\n", start, end);
 
-    /* walk backwards to avoid O(n^2)
-     * FIXME case 9819: could use executable_area_overlap_bounds() to avoid linear walk
+    /* walk backwards to avoid O(n^2), over only the areas that can overlap
+     * (case 9819)
      */
-    for (i = data->areas.length - 1; i >= 0; i--) {
+    first = vm_area_first_reaching(&data->areas, start);
+    for (i = vm_area_last_reaching(&data->areas, first, end) - 1; i >= first; i--) {
         /* look for overlap */
         if (start < data->areas.buf[i].end && end > data->areas.buf[i].start) {
             LOG(thread_log, LOG_FRAGMENT|LOG_VMAREAS, 2,
@@ -9797,7 +9960,7 @@ vm_area_allsynch_flush_fragments(dcontext_t *dcontext, dcontext_t *del_dcontext,
     thread_data_t *data = GET_DATA(del_dcontext, 0);
     vm_area_vector_t *v = &data->areas;
     fragment_t *entry, *next;
-    int i;
+    int i, first;
     bool remove_shared_vm_area = true;
     DEBUG_DECLARE(int num_fine = 0;)
     DEBUG_DECLARE(int num_coarse = 0;)
@@ -9884,10 +10047,11 @@ vm_area_allsynch_flush_fragments(dcontext_t *dcontext, dcontext_t *del_dcontext,
     }
 
     SHARED_VECTOR_RWLOCK(v, write, lock);
-    /* walk backwards to avoid O(n^2)
-     * FIXME case 9819: could use executable_area_overlap_bounds() to avoid linear walk
+    /* walk backwards to avoid O(n^2), over only the areas that can overlap
+     * (case 9819)
      */
-    for (i = v->length - 1; i >= 0; i--) {
+    first = vm_area_first_reaching(v, start);
+    for (i = vm_area_last_reaching(v, first, end) - 1; i >= first; i--) {
         if (start < v->buf[i].end && end > v->buf[i].start) {
             if (v->buf[i].start < start ||
                 v->buf[i].end > end) {
@@ -10272,6 +10436,104 @@ thread_vm_area_overlap(dcontext_t *dcontext, app_pc start, app_pc end)
     return res;
 }
 
+/* Bits of the page at pg covered by [start, end) */
+static uint64
+code_lines_on_page(app_pc pg, app_pc start, app_pc end)
+{
+    uint64 bits = 0;
+    app_pc line = (app_pc) ALIGN_BACKWARD(MAX(start, pg), CODE_LINE_SIZE);
+    for (; line < end && line < pg + PAGE_SIZE; line += CODE_LINE_SIZE)
+        bits |= CODE_LINE_BIT(line);
+    return bits;
+}
+
+void
+vm_area_mark_code_lines(app_pc start, app_pc end)
+{
+    app_pc pg;
+    ASSERT(code_line_shadow != NULL);
+    for (pg = (app_pc) PAGE_START(start); pg < end; pg += PAGE_SIZE) {
+        uint64 bits = code_lines_on_page(pg, start, end);
+        code_lines_t *cl;
+        TABLE_RWLOCK(code_line_shadow, read, lock);
+        cl = (code_lines_t *)
+            generic_hash_lookup(GLOBAL_DCONTEXT, code_line_shadow, (ptr_uint_t) pg);
+        if (cl != NULL && TESTALL(bits, cl->lines)) {
+            TABLE_RWLOCK(code_line_shadow, read, unlock);
+            continue;
+        }
+        TABLE_RWLOCK(code_line_shadow, read, unlock);
+        TABLE_RWLOCK(code_line_shadow, write, lock);
+        cl = (code_lines_t *)
+            generic_hash_lookup(GLOBAL_DCONTEXT, code_line_shadow, (ptr_uint_t) pg);
+        if (cl == NULL) {
+            cl = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, code_lines_t, ACCT_VMAREAS,
+                                 UNPROTECTED);
+            cl->lines = 0;
+            cl->emulated_writes = 0;
+            generic_hash_add(GLOBAL_DCONTEXT, code_line_shadow, (ptr_uint_t) pg, cl);
+        }
+        cl->lines |= bits;
+        TABLE_RWLOCK(code_line_shadow, write, unlock);
+    }
+}
+
+/* Held across the check and the emulated write so that no bb can start
+ * decoding a line in between.
+ */
+void
+vm_area_code_lines_lock(void)
+{
+    TABLE_RWLOCK(code_line_shadow, write, lock);
+}
+
+void
+vm_area_code_lines_unlock(void)
+{
+    TABLE_RWLOCK(code_line_shadow, write, unlock);
+}
+
+/* Once a page has taken -selfmod_line_emulate_max emulated writes we let one
+ * fault through to the regular flush, which makes the page writable until
+ * code runs from it again; repeated flushes then switch the page to
+ * sandboxing via -ro2sandbox_threshold.  This bounds the cost of a page that
+ * is written far more often than its code runs.
+ */
+bool
+vm_area_write_misses_code_lines(app_pc start, app_pc end)
+{
+    app_pc pg = (app_pc) PAGE_START(start);
+    code_lines_t *cl;
+    ASSERT(code_line_shadow != NULL);
+    ASSERT_TABLE_SYNCHRONIZED(code_line_shadow, WRITE);
+    if (pg != (app_pc) PAGE_START(end - 1))
+        return false;
+    cl = (code_lines_t *)
+        generic_hash_lookup(GLOBAL_DCONTEXT, code_line_shadow, (ptr_uint_t) pg);
+    if (cl == NULL) {
+        /* no code from this page, but it is on a region we made read-only */
+        cl = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, code_lines_t, ACCT_VMAREAS, UNPROTECTED);
+        cl->lines = 0;
+        cl->emulated_writes = 0;
+        generic_hash_add(GLOBAL_DCONTEXT, code_line_shadow, (ptr_uint_t) pg, cl);
+    }
+    if (TESTANY(code_lines_on_page(pg, start, end), cl->lines)) {
+        STATS_INC(num_code_line_writes);
+        cl->emulated_writes = 0;
+        return false;
+    }
+    if (cl->emulated_writes >= DYNAMO_OPTION(selfmod_line_emulate_max)) {
+        LOG(GLOBAL, LOG_VMAREAS, 2,
+            "page "PFX" hit %d emulated writes: flushing instead\n",
+            pg, cl->emulated_writes);
+        STATS_INC(num_data_line_write_limit);
+        cl->emulated_writes = 0;
+        return false;
+    }
+    cl->emulated_writes++;
+    return true;
+}
+
 /* Returns NULL if should re-execute the faulting write
  * Else returns the target pc for a new basic block -- caller should
  * return to dispatch rather than the code cache
@@ -428,6 +428,12 @@ is_dynamo_address(app_pc addr);
 bool
 is_pretend_writable_address(app_pc addr);
 
+void
+set_region_jit_managed(dcontext_t *dcontext, app_pc start, size_t size);
+
+void
+set_region_app_managed(dcontext_t *dcontext, app_pc start, size_t size);
+
 #ifdef DEBUG
 /* returns comment for addr, if there is one, else NULL
  */
@@ -749,6 +755,26 @@ app_pc
 handle_modified_code(dcontext_t *dcontext, cache_pc instr_cache_pc,
                      app_pc instr_app_pc, app_pc target, fragment_t *f);
 
+/* Granularity of -selfmod_line_shadow: one bit per line in a 64-bit page mask */
+#define CODE_LINE_SIZE (PAGE_SIZE / 64)
+
+/* Records that code may be built from [start, end), for -selfmod_line_shadow */
+void
+vm_area_mark_code_lines(app_pc start, app_pc end);
+
+/* Returns true if a faulting write to [start, end) touches no line that code
+ * was built from and should be emulated rather than flushing the page.
+ * Caller must hold the lock from vm_area_code_lines_lock().
+ */
+bool
+vm_area_write_misses_code_lines(app_pc start, app_pc end);
+
+void
+vm_area_code_lines_lock(void);
+
+void
+vm_area_code_lines_unlock(void);
+
 /* Returns the counter a selfmod fragment should execute for -sandbox2ro_threshold */
 uint *
 get_selfmod_exec_counter(app_pc tag);
@@ -3287,6 +3287,13 @@ query_time_millis()
     return ((uint64)time100ns / TIMER_UNITS_PER_MILLISECOND);
 }
 
+uint64
+query_time_micros()
+{
+    LONGLONG time100ns = query_time_100ns();
+    return ((uint64)time100ns / TIMER_UNITS_PER_MICROSECOND);
+}
+
 uint
 query_time_seconds()
 {
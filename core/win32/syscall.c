@@ -2540,7 +2540,7 @@ pre_system_call(dcontext_t *dcontext)
     DODEBUG(dcontext->expect_last_syscall_to_fail = false;);
 
     KSTART(pre_syscall);
-    RSTATS_INC(pre_syscall);
+    RSTATS_INC_THREAD(pre_syscall);
     DOSTATS({
             if (ignorable_system_call(sysnum, NULL, dcontext))
             STATS_INC(pre_syscall_ignorable);
@@ -4119,7 +4119,7 @@ void post_system_call(dcontext_t *dcontext)
 
     /* stats lock grabbing ok here, any synch with suspended threads taken
      * care of already */
-    RSTATS_INC(post_syscall);
+    RSTATS_INC_THREAD(post_syscall);
     DOSTATS({
         if (ignorable_system_call(sysnum, NULL, dcontext))
             STATS_INC(post_syscall_ignorable);
@@ -0,0 +1,410 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of VMware, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* DRContainers benchmarking standalone app. */
+
+/* This is a standalone app for benchmarking the hashtable, drvector, and
+ * drtable containers.  For each table size we time inserts, lookups (hits in
+ * a scattered order and misses), and removals, and for each thread count we
+ * time concurrent lookups on a shared synchronized container.  Hashtables are
+ * measured in their default chained form, open-addressed, and with a
+ * reader-writer lock.  Each result is printed as one line:
+ *   bench,<name>,<operations>,<ns per operation>,<operations per second>
+ * where the name encodes the container, the operation, the size ("s") and,
+ * for concurrent runs, the thread count ("t").  Threads are UNIX-only.
+ *
+ * Usage: drcontainers_bench [-sizes <N,...>] [-threads <N,...>] [-scale <N>]
+ *                           [ht|ht_oa|ht_rw|vec|table ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dr_api.h"
+#include "hashtable.h"
+#include "drvector.h"
+#include "drtable.h"
+#include "../ext_utils.h"
+
+#ifdef UNIX
+# include <pthread.h>
+#endif
+
+#define MAX_PARAMS 16
+/* Each measurement performs at least this many operations, times -scale. */
+#define MIN_OPS 1000000
+/* A prime stride visits every index of a power-of-ten or power-of-two size
+ * once, in an order that defeats the hardware prefetcher.
+ */
+#define STRIDE 7919
+
+static uint sizes[MAX_PARAMS] = { 1024, 65536, 1048576 };
+static uint num_sizes = 3;
+static uint threads[MAX_PARAMS] = { 1, 2, 4, 8 };
+static uint num_threads = 4;
+static uint scale = 1;
+static void * volatile sink;
+
+static int
+usage(const char *msg)
+{
+    if (msg != NULL && msg[0] != '\0')
+        dr_fprintf(STDERR, "%s\n", msg);
+    dr_fprintf(STDERR, "usage: drcontainers_bench [-sizes <N,...>] [-threads <N,...>] "
+               "[-scale <N>] [ht|ht_oa|ht_rw|vec|table ...]\n");
+    return 1;
+}
+
+static bool
+parse_list(const char *arg, uint *list, uint *num)
+{
+    char *end;
+    *num = 0;
+    while (*num < MAX_PARAMS) {
+        uint val = (uint)strtoul(arg, &end, 0);
+        if (end == arg || val == 0)
+            return false;
+        list[(*num)++] = val;
+        if (*end == '\0')
+            return true;
+        if (*end != ',')
+            return false;
+        arg = end + 1;
+    }
+    return false;
+}
+
+static void
+report(const char *op, uint size, uint nthreads, uint64 count, uint64 start_us)
+{
+    uint64 time = dr_get_microseconds() - start_us;
+    char name[64];
+    if (nthreads > 0)
+        dr_snprintf(name, BUFFER_SIZE_ELEMENTS(name), "%s.s%u.t%u", op, size, nthreads);
+    else
+        dr_snprintf(name, BUFFER_SIZE_ELEMENTS(name), "%s.s%u", op, size);
+    NULL_TERMINATE_BUFFER(name);
+    if (time == 0)
+        time = 1;
+    dr_printf("bench,%s,"UINT64_FORMAT_STRING",%u.%03u,"UINT64_FORMAT_STRING"\n",
+              name, count, (uint)(time * 1000 / count),
+              (uint)((time * 1000000 / count) % 1000), count * 1000000 / time);
+}
+
+static uint64
+num_ops(uint size)
+{
+    return (uint64)(size > MIN_OPS ? size : MIN_OPS) * scale;
+}
+
+/* Keys are never 0, which hashtable_add() rejects for HASH_INTPTR. */
+static void *
+key_for(uint64 i, uint size)
+{
+    return (void *)(ptr_uint_t)(((i * STRIDE) % size + 1) * 8);
+}
+
+/***************************************************************************
+ * Concurrent reads
+ */
+
+typedef struct _reader_t {
+    void (*func)(void *container, uint size, uint64 ops);
+    void *container;
+    uint size;
+    uint64 ops;
+} reader_t;
+
+static volatile bool readers_go;
+
+#ifdef UNIX
+static void *
+reader_thread(void *arg)
+{
+    reader_t *reader = (reader_t *) arg;
+    while (!readers_go)
+        ; /* spin so that all readers start together */
+    reader->func(reader->container, reader->size, reader->ops);
+    return NULL;
+}
+#endif
+
+/* Splits the operations for size across nthreads calls to func, run in
+ * parallel, and reports their combined throughput.
+ */
+static void
+run_readers(const char *op, void (*func)(void *, uint, uint64), void *container,
+            uint size, uint nthreads)
+{
+    uint64 ops = num_ops(size) / nthreads, start;
+    reader_t reader = { func, container, size, ops };
+#ifdef UNIX
+    pthread_t thread[MAX_PARAMS * 8];
+    uint i;
+    if (nthreads > BUFFER_SIZE_ELEMENTS(thread))
+        nthreads = BUFFER_SIZE_ELEMENTS(thread);
+    readers_go = false;
+    for (i = 0; i < nthreads; i++)
+        pthread_create(&thread[i], NULL, reader_thread, &reader);
+    start = dr_get_microseconds();
+    readers_go = true;
+    for (i = 0; i < nthreads; i++)
+        pthread_join(thread[i], NULL);
+#else
+    if (nthreads > 1)
+        return;
+    start = dr_get_microseconds();
+    func(container, size, ops);
+#endif
+    report(op, size, nthreads, ops * nthreads, start);
+}
+
+/***************************************************************************
+ * hashtable
+ */
+
+static void
+hashtable_lookups(void *container, uint size, uint64 ops)
+{
+    hashtable_t *table = (hashtable_t *) container;
+    uint64 i;
+    for (i = 0; i < ops; i++)
+        sink = hashtable_lookup(table, key_for(i, size));
+}
+
+static void
+bench_hashtable(const char *name, bool open_address, bool read_write_lock)
+{
+    hashtable_config_t config = { sizeof(config), true, 75, };
+    char op[32];
+    uint s, t;
+    config.open_address = open_address;
+    config.read_write_lock = read_write_lock;
+    for (s = 0; s < num_sizes; s++) {
+        hashtable_t table;
+        uint size = sizes[s];
+        uint64 i, ops, start;
+        /* Start small so that inserts include the cost of resizing. */
+        hashtable_init_ex(&table, 8, HASH_INTPTR, false, true/*synch*/, NULL,
+                          NULL, NULL);
+        hashtable_configure(&table, &config);
+
+        start = dr_get_microseconds();
+        for (i = 0; i < size; i++)
+            hashtable_add(&table, key_for(i, size), (void *)(ptr_uint_t)(i + 1));
+        dr_snprintf(op, BUFFER_SIZE_ELEMENTS(op), "%s.add", name);
+        NULL_TERMINATE_BUFFER(op);
+        report(op, size, 0, size, start);
+
+        ops = num_ops(size);
+        start = dr_get_microseconds();
+        hashtable_lookups(&table, size, ops);
+        dr_snprintf(op, BUFFER_SIZE_ELEMENTS(op), "%s.lookup", name);
+        NULL_TERMINATE_BUFFER(op);
+        report(op, size, 0, ops, start);
+
+        start = dr_get_microseconds();
+        for (i = 0; i < ops; i++) {
+            /* Odd keys are never added. */
+            sink = hashtable_lookup(&table, (void *)((ptr_uint_t)key_for(i, size) + 1));
+        }
+        dr_snprintf(op, BUFFER_SIZE_ELEMENTS(op), "%s.miss", name);
+        NULL_TERMINATE_BUFFER(op);
+        report(op, size, 0, ops, start);
+
+        dr_snprintf(op, BUFFER_SIZE_ELEMENTS(op), "%s.lookup", name);
+        NULL_TERMINATE_BUFFER(op);
+        for (t = 0; t < num_threads; t++)
+            run_readers(op, hashtable_lookups, &table, size, threads[t]);
+
+        start = dr_get_microseconds();
+        for (i = 0; i < size; i++)
+            hashtable_remove(&table, key_for(i, size));
+        dr_snprintf(op, BUFFER_SIZE_ELEMENTS(op), "%s.remove", name);
+        NULL_TERMINATE_BUFFER(op);
+        report(op, size, 0, size, start);
+
+        hashtable_delete(&table);
+    }
+}
+
+/***************************************************************************
+ * drvector
+ */
+
+static void
+drvector_gets(void *container, uint size, uint64 ops)
+{
+    drvector_t *vec = (drvector_t *) container;
+    uint64 i;
+    for (i = 0; i < ops; i++)
+        sink = drvector_get_entry(vec, (uint)((i * STRIDE) % size));
+}
+
+static void
+bench_drvector(void)
+{
+    uint s, t;
+    for (s = 0; s < num_sizes; s++) {
+        drvector_t vec;
+        uint size = sizes[s];
+        uint64 i, ops = num_ops(size), start;
+        /* Start small so that appends include the cost of growing. */
+        drvector_init(&vec, 16, true/*synch*/, NULL);
+
+        start = dr_get_microseconds();
+        for (i = 0; i < size; i++)
+            drvector_append(&vec, (void *)(ptr_uint_t)(i + 1));
+        report("vec.append", size, 0, size, start);
+
+        start = dr_get_microseconds();
+        drvector_gets(&vec, size, ops);
+        report("vec.get", size, 0, ops, start);
+
+        start = dr_get_microseconds();
+        for (i = 0; i < ops; i++)
+            drvector_set_entry(&vec, (uint)((i * STRIDE) % size), (void *)(ptr_uint_t)i);
+        report("vec.set", size, 0, ops, start);
+
+        for (t = 0; t < num_threads; t++)
+            run_readers("vec.get", drvector_gets, &vec, size, threads[t]);
+
+        drvector_delete(&vec);
+    }
+}
+
+/***************************************************************************
+ * drtable
+ */
+
+#define TABLE_ENTRY_SIZE 16
+
+static void
+drtable_gets(void *container, uint size, uint64 ops)
+{
+    uint64 i;
+    for (i = 0; i < ops; i++)
+        sink = drtable_get_entry(container, (ptr_uint_t)((i * STRIDE) % size));
+}
+
+static bool
+drtable_iter_cb(ptr_uint_t idx, void *entry, void *iter_data)
+{
+    (*(uint64 *)iter_data)++;
+    return true;
+}
+
+static void
+bench_drtable(void)
+{
+    uint s, t;
+    for (s = 0; s < num_sizes; s++) {
+        uint size = sizes[s];
+        uint64 i, ops = num_ops(size), start, visited = 0;
+        void *tab = drtable_create(16, TABLE_ENTRY_SIZE, 0, true/*synch*/, NULL);
+        void **entries = (void **) malloc(size * sizeof(*entries));
+
+        start = dr_get_microseconds();
+        for (i = 0; i < size; i++)
+            entries[i] = drtable_alloc(tab, 1, NULL);
+        report("table.alloc", size, 0, size, start);
+
+        start = dr_get_microseconds();
+        drtable_gets(tab, size, ops);
+        report("table.get", size, 0, ops, start);
+
+        start = dr_get_microseconds();
+        for (i = 0; i < ops; i++)
+            sink = (void *) drtable_get_index(tab, entries[(i * STRIDE) % size]);
+        report("table.index", size, 0, ops, start);
+
+        start = dr_get_microseconds();
+        for (i = 0; i < ops; i += size)
+            drtable_iterate(tab, &visited, drtable_iter_cb);
+        report("table.iterate", size, 0, visited, start);
+
+        for (t = 0; t < num_threads; t++)
+            run_readers("table.get", drtable_gets, tab, size, threads[t]);
+
+        free(entries);
+        drtable_destroy(tab, NULL);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int i, first;
+
+    dr_standalone_init();
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-sizes") == 0 && i + 1 < argc) {
+            if (!parse_list(argv[++i], sizes, &num_sizes))
+                return usage("-sizes must be a list of positive numbers.");
+        } else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            if (!parse_list(argv[++i], threads, &num_threads))
+                return usage("-threads must be a list of positive numbers.");
+        } else if (strcmp(argv[i], "-scale") == 0 && i + 1 < argc) {
+            scale = (uint)atoi(argv[++i]);
+            if (scale == 0)
+                return usage("-scale must be positive.");
+        } else
+            return usage("Unknown option.");
+    }
+    first = i;
+
+    if (first == argc) {
+        bench_hashtable("ht", false, false);
+        bench_hashtable("ht_oa", true, false);
+        bench_hashtable("ht_rw", false, true);
+        bench_drvector();
+        bench_drtable();
+    }
+    for (i = first; i < argc; i++) {
+        if (strcmp(argv[i], "ht") == 0)
+            bench_hashtable("ht", false, false);
+        else if (strcmp(argv[i], "ht_oa") == 0)
+            bench_hashtable("ht_oa", true, false);
+        else if (strcmp(argv[i], "ht_rw") == 0)
+            bench_hashtable("ht_rw", false, true);
+        else if (strcmp(argv[i], "vec") == 0)
+            bench_drvector();
+        else if (strcmp(argv[i], "table") == 0)
+            bench_drtable();
+        else
+            return usage("Unknown benchmark.");
+    }
+
+    return 0;
+}
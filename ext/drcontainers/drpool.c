@@ -0,0 +1,352 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Containers DynamoRIO Extension: DrPool and DrArena */
+
+#include "dr_api.h"
+#include "containers_private.h"
+#include "drpool.h"
+
+#define DRPOOL_MAGIC  0x4c4f5044  /* "DPOL" */
+#define DRARENA_MAGIC 0x4e524144  /* "DARN" */
+
+#define DEFAULT_SLAB_SIZE  (16*PAGE_SIZE)
+#define DEFAULT_BLOCK_SIZE (16*PAGE_SIZE)
+
+/* Objects and allocations are aligned to the pointer size. */
+#define OBJ_ALIGN sizeof(void *)
+
+/* Header at the start of each slab or arena block.  Its size keeps the
+ * memory that follows it aligned to OBJ_ALIGN.
+ */
+typedef struct _block_t {
+    struct _block_t *next;
+    size_t size;
+} block_t;
+
+static void *
+block_alloc(void *drcontext, size_t size)
+{
+    block_t *block;
+    if (drcontext != NULL)
+        block = (block_t *) dr_thread_alloc(drcontext, size);
+    else
+        block = (block_t *) dr_global_alloc(size);
+    if (block == NULL)
+        return NULL;
+    block->next = NULL;
+    block->size = size;
+    return block;
+}
+
+static void
+block_free(void *drcontext, block_t *block)
+{
+    if (drcontext != NULL)
+        dr_thread_free(drcontext, block, block->size);
+    else
+        dr_global_free(block, block->size);
+}
+
+static bool
+stats_fill(drpool_stats_t *stats, size_t reserved, size_t in_use, size_t live)
+{
+    if (stats == NULL || stats->size != sizeof(*stats))
+        return false;
+    stats->bytes_reserved = reserved;
+    stats->bytes_in_use = in_use;
+    stats->num_live = live;
+    return true;
+}
+
+/***************************************************************************
+ * DRPOOL
+ */
+
+/* A freed object holds the freelist link in its first word. */
+typedef struct _free_obj_t {
+    struct _free_obj_t *next;
+} free_obj_t;
+
+typedef struct _drpool_t {
+    uint   magic;
+    bool   synch;
+    void  *lock;
+    void  *drcontext;   /* NULL for a global pool */
+    size_t obj_size;    /* rounded up to OBJ_ALIGN */
+    size_t slab_size;
+    block_t *slabs;     /* all slabs, most recent first */
+    byte  *cur;         /* next never-used object in the newest slab */
+    byte  *end;         /* end of the newest slab */
+    free_obj_t *freelist;
+    size_t bytes_reserved;
+    size_t num_live;
+} drpool_t;
+
+void *
+drpool_create(void *drcontext, size_t obj_size, size_t slab_size, bool synch)
+{
+    drpool_t *pool;
+    DR_ASSERT(obj_size > 0);
+    DR_ASSERT(drcontext == NULL || !synch);
+    pool = dr_global_alloc(sizeof(*pool));
+    pool->magic = DRPOOL_MAGIC;
+    pool->synch = synch;
+    pool->lock = synch ? dr_mutex_create() : NULL;
+    pool->drcontext = drcontext;
+    pool->obj_size = ALIGN_FORWARD(MAX(obj_size, sizeof(free_obj_t)), OBJ_ALIGN);
+    if (slab_size == 0)
+        slab_size = DEFAULT_SLAB_SIZE;
+    /* hold at least a few objects per slab */
+    pool->slab_size = MAX(slab_size, sizeof(block_t) + 4 * pool->obj_size);
+    pool->slabs = NULL;
+    pool->cur = NULL;
+    pool->end = NULL;
+    pool->freelist = NULL;
+    pool->bytes_reserved = 0;
+    pool->num_live = 0;
+    return pool;
+}
+
+void *
+drpool_alloc(void *p)
+{
+    drpool_t *pool = (drpool_t *) p;
+    void *obj;
+    DR_ASSERT(pool != NULL && pool->magic == DRPOOL_MAGIC);
+    if (pool->synch)
+        dr_mutex_lock(pool->lock);
+    if (pool->freelist != NULL) {
+        obj = pool->freelist;
+        pool->freelist = pool->freelist->next;
+    } else {
+        if (pool->cur == NULL || pool->cur + pool->obj_size > pool->end) {
+            block_t *slab = block_alloc(pool->drcontext, pool->slab_size);
+            if (slab == NULL) {
+                if (pool->synch)
+                    dr_mutex_unlock(pool->lock);
+                return NULL;
+            }
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            pool->cur = (byte *)(slab + 1);
+            pool->end = (byte *)slab + slab->size;
+            pool->bytes_reserved += slab->size;
+        }
+        obj = pool->cur;
+        pool->cur += pool->obj_size;
+    }
+    pool->num_live++;
+    if (pool->synch)
+        dr_mutex_unlock(pool->lock);
+    return obj;
+}
+
+void
+drpool_free(void *p, void *obj)
+{
+    drpool_t *pool = (drpool_t *) p;
+    free_obj_t *entry = (free_obj_t *) obj;
+    DR_ASSERT(pool != NULL && pool->magic == DRPOOL_MAGIC);
+    if (obj == NULL)
+        return;
+    if (pool->synch)
+        dr_mutex_lock(pool->lock);
+    DR_ASSERT(pool->num_live > 0);
+    entry->next = pool->freelist;
+    pool->freelist = entry;
+    pool->num_live--;
+    if (pool->synch)
+        dr_mutex_unlock(pool->lock);
+}
+
+void
+drpool_destroy(void *p)
+{
+    drpool_t *pool = (drpool_t *) p;
+    block_t *slab, *next;
+    DR_ASSERT(pool != NULL && pool->magic == DRPOOL_MAGIC);
+    for (slab = pool->slabs; slab != NULL; slab = next) {
+        next = slab->next;
+        block_free(pool->drcontext, slab);
+    }
+    if (pool->synch)
+        dr_mutex_destroy(pool->lock);
+    pool->magic = 0;
+    dr_global_free(pool, sizeof(*pool));
+}
+
+bool
+drpool_get_stats(void *p, drpool_stats_t *stats)
+{
+    drpool_t *pool = (drpool_t *) p;
+    bool res;
+    DR_ASSERT(pool != NULL && pool->magic == DRPOOL_MAGIC);
+    if (pool->synch)
+        dr_mutex_lock(pool->lock);
+    res = stats_fill(stats, pool->bytes_reserved,
+                     pool->num_live * pool->obj_size, pool->num_live);
+    if (pool->synch)
+        dr_mutex_unlock(pool->lock);
+    return res;
+}
+
+/***************************************************************************
+ * DRARENA
+ */
+
+typedef struct _drarena_t {
+    uint   magic;
+    void  *drcontext;   /* NULL for a global arena */
+    size_t block_size;
+    /* The block being bumped is first and the arena's first block, which
+     * reset keeps, is last.  Oversized blocks are linked in after the
+     * first so bumping continues in the current block.
+     */
+    block_t *blocks;
+    byte  *cur;
+    byte  *end;
+    size_t bytes_reserved;
+    size_t bytes_in_use;
+    size_t num_live;
+} drarena_t;
+
+void *
+drarena_create(void *drcontext, size_t block_size)
+{
+    drarena_t *arena = dr_global_alloc(sizeof(*arena));
+    arena->magic = DRARENA_MAGIC;
+    arena->drcontext = drcontext;
+    if (block_size == 0)
+        block_size = DEFAULT_BLOCK_SIZE;
+    arena->block_size = MAX(block_size, 2 * sizeof(block_t));
+    arena->blocks = NULL;
+    arena->cur = NULL;
+    arena->end = NULL;
+    arena->bytes_reserved = 0;
+    arena->bytes_in_use = 0;
+    arena->num_live = 0;
+    return arena;
+}
+
+void *
+drarena_alloc(void *a, size_t size)
+{
+    drarena_t *arena = (drarena_t *) a;
+    void *res;
+    DR_ASSERT(arena != NULL && arena->magic == DRARENA_MAGIC);
+    size = ALIGN_FORWARD(MAX(size, 1), OBJ_ALIGN);
+    if (sizeof(block_t) + size > arena->block_size) {
+        block_t *block = block_alloc(arena->drcontext, sizeof(block_t) + size);
+        if (block == NULL)
+            return NULL;
+        if (arena->blocks == NULL) {
+            /* Keep the first block a regular one so reset can reuse it. */
+            arena->blocks = block;
+        } else {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        }
+        arena->bytes_reserved += block->size;
+        res = block + 1;
+    } else {
+        if (arena->cur == NULL || arena->cur + size > arena->end) {
+            block_t *block = block_alloc(arena->drcontext, arena->block_size);
+            if (block == NULL)
+                return NULL;
+            block->next = arena->blocks;
+            arena->blocks = block;
+            arena->cur = (byte *)(block + 1);
+            arena->end = (byte *)block + block->size;
+            arena->bytes_reserved += block->size;
+        }
+        res = arena->cur;
+        arena->cur += size;
+    }
+    arena->bytes_in_use += size;
+    arena->num_live++;
+    return res;
+}
+
+void
+drarena_reset(void *a)
+{
+    drarena_t *arena = (drarena_t *) a;
+    block_t *block, *next;
+    DR_ASSERT(arena != NULL && arena->magic == DRARENA_MAGIC);
+    for (block = arena->blocks; block != NULL && block->next != NULL; block = next) {
+        next = block->next;
+        arena->bytes_reserved -= block->size;
+        block_free(arena->drcontext, block);
+    }
+    arena->blocks = block;
+    if (block != NULL && block->size != arena->block_size) {
+        /* an oversized block is not worth keeping */
+        arena->bytes_reserved -= block->size;
+        block_free(arena->drcontext, block);
+        arena->blocks = NULL;
+        block = NULL;
+    }
+    if (block != NULL) {
+        arena->cur = (byte *)(block + 1);
+        arena->end = (byte *)block + block->size;
+    } else {
+        arena->cur = NULL;
+        arena->end = NULL;
+    }
+    arena->bytes_in_use = 0;
+    arena->num_live = 0;
+}
+
+void
+drarena_destroy(void *a)
+{
+    drarena_t *arena = (drarena_t *) a;
+    block_t *block, *next;
+    DR_ASSERT(arena != NULL && arena->magic == DRARENA_MAGIC);
+    for (block = arena->blocks; block != NULL; block = next) {
+        next = block->next;
+        block_free(arena->drcontext, block);
+    }
+    arena->magic = 0;
+    dr_global_free(arena, sizeof(*arena));
+}
+
+bool
+drarena_get_stats(void *a, drpool_stats_t *stats)
+{
+    drarena_t *arena = (drarena_t *) a;
+    DR_ASSERT(arena != NULL && arena->magic == DRARENA_MAGIC);
+    return stats_fill(stats, arena->bytes_reserved, arena->bytes_in_use,
+                      arena->num_live);
+}
@@ -0,0 +1,156 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Containers DynamoRIO Extension: DrPool and DrArena */
+
+#ifndef _DRPOOL_H_
+#define _DRPOOL_H_ 1
+
+/**
+ * @file drpool.h
+ * @brief Header for DynamoRIO DrPool and DrArena Extension
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************
+ * DRPOOL
+ */
+
+/**
+ * \addtogroup drcontainers Container Data Structures
+ */
+/*@{*/ /* begin doxygen group */
+
+/**
+ * Statistics for a pool or arena, filled in by drpool_get_stats() and
+ * drarena_get_stats().  All memory is obtained from DR's heap, so these
+ * bytes are also included in DR's own heap accounting.
+ */
+typedef struct _drpool_stats_t {
+    /** For compatibility. Set to sizeof(drpool_stats_t). */
+    size_t size;
+    /** Bytes obtained from DR's heap in slabs or blocks. */
+    size_t bytes_reserved;
+    /** Bytes handed out to and not yet returned by the caller. */
+    size_t bytes_in_use;
+    /** Number of objects or allocations currently live. */
+    size_t num_live;
+} drpool_stats_t;
+
+/**
+ * Creates a pool of fixed-size objects of \p obj_size bytes.  Objects are
+ * carved out of slabs of \p slab_size bytes (0 selects a default) with no
+ * per-object header, and freed objects are kept on a freelist for reuse.
+ * Slabs are only returned to DR by drpool_destroy().
+ * @param[in]  drcontext  If non-NULL, slabs come from dr_thread_alloc() and
+ *   the pool may only be used by that thread; else from dr_global_alloc().
+ * @param[in]  obj_size   The size of each object.
+ * @param[in]  slab_size  The size of each slab, or 0 for the default.
+ * @param[in]  synch      Whether to synchronize each operation.  Must be false
+ *   for a thread-private pool.
+ */
+void *
+drpool_create(void *drcontext, size_t obj_size, size_t slab_size, bool synch);
+
+/**
+ * Returns an uninitialized object from the pool, or NULL on failure.
+ */
+void *
+drpool_alloc(void *pool);
+
+/**
+ * Returns \p obj, which must have come from drpool_alloc() on the same pool,
+ * to the pool's freelist.
+ */
+void
+drpool_free(void *pool, void *obj);
+
+/**
+ * Destroys the pool and frees all of its slabs, including any objects
+ * that are still live.
+ */
+void
+drpool_destroy(void *pool);
+
+/** Fills in \p stats, whose \p size field must be set by the caller. */
+bool
+drpool_get_stats(void *pool, drpool_stats_t *stats);
+
+/***************************************************************************
+ * DRARENA
+ */
+
+/**
+ * Creates a bump allocator that carves variable-size allocations out of
+ * blocks of \p block_size bytes (0 selects a default).  Individual
+ * allocations are not freed; drarena_reset() releases them all at once.
+ * Arenas are not synchronized.
+ * @param[in]  drcontext  If non-NULL, blocks come from dr_thread_alloc() and
+ *   the arena may only be used by that thread; else from dr_global_alloc().
+ * @param[in]  block_size The size of each block, or 0 for the default.
+ */
+void *
+drarena_create(void *drcontext, size_t block_size);
+
+/**
+ * Returns \p size bytes aligned to the pointer size, or NULL on failure.
+ * Requests larger than the arena's block size get a block of their own.
+ */
+void *
+drarena_alloc(void *arena, size_t size);
+
+/**
+ * Releases every allocation made from the arena.  The first block is kept
+ * for reuse and the rest are returned to DR.
+ */
+void
+drarena_reset(void *arena);
+
+/** Destroys the arena and frees all of its blocks. */
+void
+drarena_destroy(void *arena);
+
+/** Fills in \p stats, whose \p size field must be set by the caller. */
+bool
+drarena_get_stats(void *arena, drpool_stats_t *stats);
+
+/*@}*/ /* end doxygen group */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DRPOOL_H_ */
@@ -37,6 +37,7 @@
 #include "drtable.h"
 #include "drvector.h"
 #include <string.h>
+#include <limits.h> /* INT_MAX */
 
 #define DRTABLE_MAGIC 0x42545244  /* "DRTB" */
 #define MAX_ENTRY_SIZE  PAGE_SIZE
@@ -74,8 +75,25 @@ struct _drtable_chunk_t {
     size_t     size;      /* the chunk size in bytes */
     byte      *base;      /* chunk base */
     byte      *cur_ptr;   /* start address of unallocated entries */
+    /* For DRTABLE_ALLOC_CONCURRENT, entries and cur_ptr are unused: entries
+     * are handed out by atomically incrementing reserved, which may run
+     * past capacity when racing threads find the chunk full.  hole is the
+     * start of a tail left unused by an allocation that straddled the end.
+     */
+    volatile int reserved;
+    ptr_uint_t hole;
 };
 
+static inline ptr_uint_t
+drtable_chunk_entries(drtable_chunk_t *chunk)
+{
+    if (TEST(DRTABLE_ALLOC_CONCURRENT, chunk->table->flags)) {
+        ptr_uint_t reserved = (ptr_uint_t)chunk->reserved;
+        return (reserved < chunk->hole ? reserved : chunk->hole);
+    }
+    return chunk->entries;
+}
+
 static bool
 drtable_free_callback(ptr_uint_t id, void *entry, void *table)
 {
@@ -92,11 +110,12 @@ drtable_chunk_iterate(drtable_chunk_t *chunk,
     ptr_uint_t i;
     byte *entry = chunk->base;
     drtable_t *table = chunk->table;
+    ptr_uint_t entries = drtable_chunk_entries(chunk);
     if (iter_func == NULL) {
         table->stop_iter = true;
         return;
     }
-    for (i = 0; i < chunk->entries; i++) {
+    for (i = 0; i < entries; i++) {
         if (!iter_func(i + chunk->index, entry, iter_data)) {
             table->stop_iter = true;
             break;
@@ -141,6 +160,10 @@ drtable_chunk_create(drtable_t *table, ptr_uint_t num_entries)
     chunk->cur_ptr = chunk->base;
     table->size = table->size + chunk->size;
     chunk->capacity = (uint)(chunk->size / table->entry_size);
+    /* leave room for reserved to overshoot capacity */
+    DR_ASSERT(chunk->capacity < INT_MAX / 2);
+    chunk->reserved = 0;
+    chunk->hole = chunk->capacity;
     table->capacity += chunk->capacity;
     drvector_append(&table->vec, chunk);
     return chunk;
@@ -169,6 +192,7 @@ drtable_create(ptr_uint_t capacity, size_t entry_size, uint flags, bool synch,
     size_t size;
 
     DR_ASSERT(entry_size > 0 && entry_size < MAX_ENTRY_SIZE);
+    DR_ASSERT(!TEST(DRTABLE_ALLOC_CONCURRENT, flags) || synch);
 
     table = dr_global_alloc(sizeof(*table));
     table->magic = DRTABLE_MAGIC;
@@ -206,6 +230,36 @@ drtable_destroy(void *tab, void *user_data)
     dr_global_free(table, sizeof(*table));
 }
 
+/* Lock-free allocation for DRTABLE_ALLOC_CONCURRENT: the lock is only
+ * taken to add a new chunk once the last one is full.
+ */
+static void *
+drtable_alloc_concurrent(drtable_t *table, ptr_uint_t num_entries,
+                         ptr_uint_t *idx_ptr)
+{
+    drtable_chunk_t *chunk = table->last_chunk;
+    ptr_uint_t start, end;
+    while (true) {
+        end = (ptr_uint_t)
+            dr_atomic_add32_return_sum(&chunk->reserved, (int)num_entries);
+        start = end - num_entries;
+        if (end <= chunk->capacity) {
+            if (idx_ptr != NULL)
+                *idx_ptr = chunk->index + start;
+            return chunk->base + start * table->entry_size;
+        }
+        /* Only one allocation can straddle the end of the chunk. */
+        if (start < chunk->capacity)
+            chunk->hole = start;
+        drtable_lock(table);
+        /* Another thread may have added a chunk already. */
+        if (table->last_chunk == chunk)
+            table->last_chunk = drtable_chunk_create(table, num_entries);
+        chunk = table->last_chunk;
+        drtable_unlock(table);
+    }
+}
+
 void *
 drtable_alloc(void *tab, ptr_uint_t num_entries, ptr_uint_t *idx_ptr)
 {
@@ -215,6 +269,8 @@ drtable_alloc(void *tab, ptr_uint_t num_entries, ptr_uint_t *idx_ptr)
     int i;
 
     DR_ASSERT(table != NULL && table->magic == DRTABLE_MAGIC);
+    if (TEST(DRTABLE_ALLOC_CONCURRENT, table->flags))
+        return drtable_alloc_concurrent(table, num_entries, idx_ptr);
     if (table->synch)
         drtable_lock(table);
     /* 1. find a chunk for holding entries */
@@ -307,7 +363,8 @@ drtable_chunk_lookup_index(drtable_t *table, ptr_uint_t index)
         return NULL;
     chunk = table->last_chunk;
     /* we have a racy here, the entries might be updated by others */
-    if (index >= chunk->index && index < chunk->index + chunk->entries)
+    if (index >= chunk->index &&
+        index < chunk->index + drtable_chunk_entries(chunk))
         return chunk;
     if (table->synch)
         drtable_lock(table);
@@ -323,20 +380,30 @@ drtable_chunk_lookup_index(drtable_t *table, ptr_uint_t index)
     return chunk;
 }
 
+static byte *
+drtable_chunk_end(drtable_chunk_t *chunk)
+{
+    if (TEST(DRTABLE_ALLOC_CONCURRENT, chunk->table->flags)) {
+        return chunk->base +
+            drtable_chunk_entries(chunk) * chunk->table->entry_size;
+    }
+    return chunk->cur_ptr;
+}
+
 static drtable_chunk_t *
 drtable_chunk_lookup_entry(drtable_t *table, byte *entry)
 {
     uint i;
     drtable_chunk_t *chunk = table->last_chunk;
     /* we have a racy here, the cur_ptr might be updated by others */
-    if (entry >= chunk->base && entry < chunk->cur_ptr)
+    if (entry >= chunk->base && entry < drtable_chunk_end(chunk))
         return chunk;
     if (table->synch)
         drtable_lock(table);
     for (i = table->vec.entries; i > 0; i--) {
         chunk = drvector_get_entry(&table->vec, i-1);
         DR_ASSERT(chunk != NULL);
-        if (entry >= chunk->base && entry < chunk->cur_ptr)
+        if (entry >= chunk->base && entry < drtable_chunk_end(chunk))
             break;
         chunk = NULL;
     }
@@ -376,6 +443,17 @@ drtable_num_entries(void *tab)
 {
     drtable_t *table = (drtable_t *)tab;
     DR_ASSERT(table != NULL && table->magic == DRTABLE_MAGIC);
+    if (TEST(DRTABLE_ALLOC_CONCURRENT, table->flags)) {
+        /* entries is not maintained by the lock-free path */
+        ptr_uint_t entries = 0;
+        uint i;
+        drtable_lock(table);
+        for (i = 0; i < table->vec.entries; i++) {
+            entries += drtable_chunk_entries(drvector_get_entry(&table->vec, i));
+        }
+        drtable_unlock(table);
+        return entries;
+    }
     return table->entries;
 }
 
@@ -395,12 +473,14 @@ drtable_dump_entries(void *tab, file_t log)
     entries = 0;
     for (i = 0; i < table->vec.entries; i++) {
         chunk = drvector_get_entry(&table->vec, i);
-        entries += chunk->entries;
+        ptr_uint_t chunk_entries = drtable_chunk_entries(chunk);
+        entries += chunk_entries;
         size = dr_write_file(log, chunk->base,
-                             table->entry_size * chunk->entries);
-        DR_ASSERT((size_t)size == table->entry_size * chunk->entries);
+                             table->entry_size * chunk_entries);
+        DR_ASSERT((size_t)size == table->entry_size * chunk_entries);
     }
-    DR_ASSERT(entries == (uint64)table->entries);
+    DR_ASSERT(TEST(DRTABLE_ALLOC_CONCURRENT, table->flags) ||
+              entries == (uint64)table->entries);
     if (table->synch)
         drtable_unlock(table);
     return entries;
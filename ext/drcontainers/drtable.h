@@ -69,6 +69,16 @@ typedef enum {
      * indics in a random order.
      */
     DRTABLE_ALLOC_COMPACT = 0x4,
+    /**
+     * Reserves entries with an atomic increment instead of acquiring the
+     * table lock, so that concurrent drtable_alloc() calls only serialize
+     * when a new chunk must be added.  Entry addresses remain stable.
+     * Requires a \p synch table, and #DRTABLE_ALLOC_COMPACT is ignored.
+     * If a multi-entry allocation races with the table running out of
+     * room, the tail of the old chunk is left unused and the indices in
+     * it are skipped.
+     */
+    DRTABLE_ALLOC_CONCURRENT = 0x8,
 } drtable_flags_t;
 
 /** Invalid index of drtable */
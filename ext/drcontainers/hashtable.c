@@ -153,7 +153,7 @@ hash_free(void *ptr, size_t size)
 #define HASH_FUNC(val, mask) ((val) & (mask))
 
 static uint
-hash_key(hashtable_t *table, void *key)
+hash_key_raw(hashtable_t *table, void *key)
 {
     uint hash = 0;
     if (table->hash_key_func != NULL) {
@@ -179,7 +179,13 @@ hash_key(hashtable_t *table, void *key)
                "hashtable.c hash_key internal error: invalid hash type");
         hash = (uint)(ptr_uint_t) key;
     }
-    return HASH_FUNC_BITS(hash, table->table_bits);
+    return hash;
+}
+
+static uint
+hash_key(hashtable_t *table, void *key)
+{
+    return HASH_FUNC_BITS(hash_key_raw(table, key), table->table_bits);
 }
 
 static bool
@@ -199,6 +205,257 @@ keys_equal(hashtable_t *table, void *key1, void *key2)
     }
 }
 
+/***************************************************************************
+ * OPEN ADDRESSING
+ *
+ * With config.open_address, table->table points at a single allocation holding
+ * a control byte per slot followed by the slots themselves.  A control byte is
+ * OA_EMPTY, OA_DELETED, or the low 7 bits of a full slot's key hash.  We probe
+ * OA_GROUP slots at a time: the control bytes for a group are loaded into one
+ * word and compared against the tag in parallel (SWAR), so that keys are only
+ * compared for slots whose tag matches.  The first OA_GROUP-1 control bytes
+ * are mirrored past the end so that a group starting near the end can be
+ * loaded without wrapping.
+ */
+
+#define OA_EMPTY   ((byte)0x80)
+#define OA_DELETED ((byte)0xfe)
+#define OA_GROUP   8
+#define OA_MIN_BITS 3 /* capacity must be at least OA_GROUP */
+#define OA_LSB     0x0101010101010101ULL
+#define OA_MSB     0x8080808080808080ULL
+
+typedef struct _oa_slot_t {
+    void *key;
+    void *payload;
+} oa_slot_t;
+
+#define OA_CAPACITY(table) HASHTABLE_SIZE((table)->table_bits)
+#define OA_CTRL(table) ((byte *)(table)->table)
+#define OA_SLOTS(table) \
+    ((oa_slot_t *)(OA_CTRL(table) + \
+                   ALIGN_FORWARD(OA_CAPACITY(table) + OA_GROUP - 1, sizeof(void *))))
+
+static size_t
+oa_alloc_size(uint num_bits)
+{
+    return ALIGN_FORWARD(HASHTABLE_SIZE(num_bits) + OA_GROUP - 1, sizeof(void *)) +
+        HASHTABLE_SIZE(num_bits) * sizeof(oa_slot_t);
+}
+
+static void
+oa_alloc(hashtable_t *table, uint num_bits)
+{
+    if (num_bits < OA_MIN_BITS)
+        num_bits = OA_MIN_BITS;
+    table->table_bits = num_bits;
+    table->table = (hash_entry_t **) hash_alloc(oa_alloc_size(num_bits));
+    memset(OA_CTRL(table), OA_EMPTY, OA_CAPACITY(table) + OA_GROUP - 1);
+    table->deleted = 0;
+}
+
+/* Mixes the hash so that both the slot index (low bits) and the tag (top bits)
+ * are well distributed even for aligned pointer keys.
+ */
+static uint
+oa_hash(hashtable_t *table, void *key)
+{
+    uint h = hash_key_raw(table, key);
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+#define OA_TAG(hash) ((byte)((hash) >> 25))
+
+static void
+oa_set_ctrl(hashtable_t *table, uint idx, byte val)
+{
+    OA_CTRL(table)[idx] = val;
+    if (idx < OA_GROUP - 1)
+        OA_CTRL(table)[OA_CAPACITY(table) + idx] = val;
+}
+
+static uint64
+oa_load_group(hashtable_t *table, uint pos)
+{
+    uint64 group;
+    memcpy(&group, OA_CTRL(table) + pos, sizeof(group));
+    return group;
+}
+
+/* Returns a mask with the top bit set in each byte of group equal to tag.
+ * May report false positives after a true match, which callers filter
+ * by comparing keys.
+ */
+static uint64
+oa_match_tag(uint64 group, byte tag)
+{
+    uint64 x = group ^ (OA_LSB * tag);
+    return (x - OA_LSB) & ~x & OA_MSB;
+}
+
+static uint64
+oa_match_empty(uint64 group)
+{
+    /* Only OA_EMPTY has the top bit set and bit 1 clear. */
+    return group & ~(group << 6) & OA_MSB;
+}
+
+/* Returns whether key is present, and its slot index in *idx if so. */
+static bool
+oa_find(hashtable_t *table, void *key, uint *idx OUT)
+{
+    uint mask = OA_CAPACITY(table) - 1;
+    uint hash = oa_hash(table, key);
+    uint pos = hash & mask, probed;
+    byte tag = OA_TAG(hash);
+    for (probed = 0; probed <= mask; probed += OA_GROUP) {
+        uint64 group = oa_load_group(table, pos);
+        uint64 match = oa_match_tag(group, tag);
+        uint i;
+        for (i = 0; match != 0; i++, match >>= 8) {
+            if ((match & 0x80) != 0) {
+                uint slot = (pos + i) & mask;
+                if (keys_equal(table, OA_SLOTS(table)[slot].key, key)) {
+                    *idx = slot;
+                    return true;
+                }
+            }
+        }
+        if (oa_match_empty(group) != 0)
+            return false;
+        pos = (pos + OA_GROUP) & mask;
+    }
+    return false;
+}
+
+/* Caller must have checked that key is absent and that there is room. */
+static void
+oa_insert(hashtable_t *table, void *key, void *payload)
+{
+    uint mask = OA_CAPACITY(table) - 1;
+    uint hash = oa_hash(table, key);
+    uint pos = hash & mask;
+    while (OA_CTRL(table)[pos] != OA_EMPTY && OA_CTRL(table)[pos] != OA_DELETED)
+        pos = (pos + 1) & mask;
+    if (OA_CTRL(table)[pos] == OA_DELETED)
+        table->deleted--;
+    oa_set_ctrl(table, pos, OA_TAG(hash));
+    OA_SLOTS(table)[pos].key = key;
+    OA_SLOTS(table)[pos].payload = payload;
+    table->entries++;
+}
+
+static void
+oa_remove_slot(hashtable_t *table, uint idx)
+{
+    oa_slot_t *slot = &OA_SLOTS(table)[idx];
+    if (table->str_dup)
+        hash_free(slot->key, strlen((const char *)slot->key) + 1);
+    if (table->free_payload_func != NULL)
+        (table->free_payload_func)(slot->payload);
+    oa_set_ctrl(table, idx, OA_DELETED);
+    table->deleted++;
+    table->entries--;
+}
+
+static bool
+oa_slot_full(hashtable_t *table, uint idx)
+{
+    return (OA_CTRL(table)[idx] & 0x80) == 0;
+}
+
+/* Makes room for one more entry.  Tombstones count against the load factor;
+ * if they make up most of it we rehash at the same size to purge them.
+ * caller must hold lock.
+ */
+static void
+oa_check_for_resize(hashtable_t *table)
+{
+    size_t capacity = OA_CAPACITY(table);
+    size_t threshold = table->config.resizable ? table->config.resize_threshold : 87;
+    if (threshold > 87)
+        threshold = 87;
+    if ((table->entries + table->deleted + 1) * 100 > threshold * capacity) {
+        byte *old_ctrl = OA_CTRL(table);
+        oa_slot_t *old_slots = OA_SLOTS(table);
+        uint old_bits = table->table_bits, i;
+        uint new_bits = old_bits;
+        if ((table->entries + 1) * 100 * 2 > threshold * capacity)
+            new_bits++;
+        oa_alloc(table, new_bits);
+        table->entries = 0;
+        for (i = 0; i < HASHTABLE_SIZE(old_bits); i++) {
+            if ((old_ctrl[i] & 0x80) == 0)
+                oa_insert(table, old_slots[i].key, old_slots[i].payload);
+        }
+        hash_free(old_ctrl, oa_alloc_size(old_bits));
+    }
+}
+
+static void
+oa_clear(hashtable_t *table)
+{
+    uint i;
+    for (i = 0; i < OA_CAPACITY(table); i++) {
+        if (oa_slot_full(table, i))
+            oa_remove_slot(table, i);
+    }
+    memset(OA_CTRL(table), OA_EMPTY, OA_CAPACITY(table) + OA_GROUP - 1);
+    table->deleted = 0;
+}
+
+/* Iterates over all entries of either table layout.  For open addressing
+ * the returned entry is a copy held in the iterator, with a NULL next.
+ */
+typedef struct _entry_iter_t {
+    uint bucket;
+    hash_entry_t *cur;
+    hash_entry_t tmp;
+} entry_iter_t;
+
+static hash_entry_t *
+entry_iter_next(hashtable_t *table, entry_iter_t *it)
+{
+    if (table->config.open_address) {
+        for (; it->bucket < OA_CAPACITY(table); it->bucket++) {
+            if (oa_slot_full(table, it->bucket)) {
+                it->tmp.key = OA_SLOTS(table)[it->bucket].key;
+                it->tmp.payload = OA_SLOTS(table)[it->bucket].payload;
+                it->tmp.next = NULL;
+                it->bucket++;
+                return &it->tmp;
+            }
+        }
+        return NULL;
+    }
+    if (it->cur != NULL)
+        it->cur = it->cur->next;
+    while (it->cur == NULL && it->bucket < HASHTABLE_SIZE(table->table_bits))
+        it->cur = table->table[it->bucket++];
+    return it->cur;
+}
+
+static char *
+dup_key(hashtable_t *table, void *key)
+{
+    if (table->str_dup) {
+        const char *s = (const char *) key;
+        char *dup = hash_alloc(strlen(s)+1);
+        strncpy(dup, s, strlen(s)+1);
+        return dup;
+    }
+    return (char *) key;
+}
+
+/***************************************************************************
+ * INTERFACE
+ */
+
 void
 hashtable_init_ex(hashtable_t *table, uint num_bits, hash_type_t hashtype, bool str_dup,
                   bool synch, void (*free_payload_func)(void*),
@@ -225,6 +482,9 @@ hashtable_init_ex(hashtable_t *table, uint num_bits, hash_type_t hashtype, bool
     table->config.size = sizeof(table->config);
     table->config.resizable = true;
     table->config.resize_threshold = 75;
+    table->config.open_address = false;
+    table->config.read_write_lock = false;
+    table->deleted = 0;
 }
 
 void
@@ -242,26 +502,83 @@ hashtable_configure(hashtable_t *table, hashtable_config_t *config)
         table->config.resizable = config->resizable;
     if (config->size > offsetof(hashtable_config_t, resize_threshold))
         table->config.resize_threshold = config->resize_threshold;
+    if (config->size > offsetof(hashtable_config_t, read_write_lock) &&
+        config->read_write_lock != table->config.read_write_lock) {
+        if (table->config.read_write_lock) {
+            dr_rwlock_destroy(table->lock);
+            table->lock = dr_mutex_create();
+        } else {
+            dr_mutex_destroy(table->lock);
+            table->lock = dr_rwlock_create();
+        }
+        table->config.read_write_lock = config->read_write_lock;
+    }
+    if (config->size > offsetof(hashtable_config_t, open_address) &&
+        config->open_address != table->config.open_address) {
+        ASSERT(table->entries == 0, "cannot change layout of non-empty table");
+        if (table->entries == 0) {
+            if (table->config.open_address) {
+                hash_free(table->table, oa_alloc_size(table->table_bits));
+                table->table = (hash_entry_t **)
+                    hash_alloc((size_t)HASHTABLE_SIZE(table->table_bits) *
+                               sizeof(hash_entry_t*));
+                memset(table->table, 0, (size_t)HASHTABLE_SIZE(table->table_bits) *
+                       sizeof(hash_entry_t*));
+            } else {
+                hash_free(table->table, (size_t)HASHTABLE_SIZE(table->table_bits) *
+                          sizeof(hash_entry_t*));
+                oa_alloc(table, table->table_bits);
+            }
+            table->config.open_address = config->open_address;
+        }
+    }
 }
 
 void
 hashtable_lock(hashtable_t *table)
 {
-    dr_mutex_lock(table->lock);
+    if (table->config.read_write_lock)
+        dr_rwlock_write_lock(table->lock);
+    else
+        dr_mutex_lock(table->lock);
 }
 
 void
 hashtable_unlock(hashtable_t *table)
 {
-    dr_mutex_unlock(table->lock);
+    if (table->config.read_write_lock)
+        dr_rwlock_write_unlock(table->lock);
+    else
+        dr_mutex_unlock(table->lock);
 }
 
 bool
 hashtable_lock_self_owns(hashtable_t *table)
 {
+    if (table->config.read_write_lock)
+        return dr_rwlock_self_owns_write_lock(table->lock);
     return dr_mutex_self_owns(table->lock);
 }
 
+/* Lookups only need shared access.  With a plain mutex this is just the lock. */
+static void
+table_read_lock(hashtable_t *table)
+{
+    if (table->config.read_write_lock)
+        dr_rwlock_read_lock(table->lock);
+    else
+        dr_mutex_lock(table->lock);
+}
+
+static void
+table_read_unlock(hashtable_t *table)
+{
+    if (table->config.read_write_lock)
+        dr_rwlock_read_unlock(table->lock);
+    else
+        dr_mutex_unlock(table->lock);
+}
+
 /* Lookup an entry by key and return a pointer to the corresponding entry
  * Returns NULL if no such entry exists */
 void *
@@ -269,9 +586,20 @@ hashtable_lookup(hashtable_t *table, void *key)
 {
     void *res = NULL;
     hash_entry_t *e;
-    uint hindex = hash_key(table, key);
+    uint hindex;
+    if (table->config.open_address) {
+        uint idx;
+        if (table->synch)
+            table_read_lock(table);
+        if (oa_find(table, key, &idx))
+            res = OA_SLOTS(table)[idx].payload;
+        if (table->synch)
+            table_read_unlock(table);
+        return res;
+    }
+    hindex = hash_key(table, key);
     if (table->synch)
-        dr_mutex_lock(table->lock);
+        table_read_lock(table);
     for (e = table->table[hindex]; e != NULL; e = e->next) {
         if (keys_equal(table, e->key, key)) {
             res = e->payload;
@@ -279,7 +607,7 @@ hashtable_lookup(hashtable_t *table, void *key)
         }
     }
     if (table->synch)
-        dr_mutex_unlock(table->lock);
+        table_read_unlock(table);
     return res;
 }
 
@@ -321,34 +649,44 @@ hashtable_check_for_resize(hashtable_t *table)
 bool
 hashtable_add(hashtable_t *table, void *key, void *payload)
 {
-    uint hindex = hash_key(table, key);
+    uint hindex;
     hash_entry_t *e;
     /* if payload is null can't tell from lookup miss */
     ASSERT(payload != NULL, "hashtable_add internal error");
+    if (table->config.open_address) {
+        uint idx;
+        bool res = false;
+        if (table->synch)
+            hashtable_lock(table);
+        if (!oa_find(table, key, &idx)) {
+            oa_check_for_resize(table);
+            oa_insert(table, dup_key(table, key), payload);
+            res = true;
+        }
+        if (table->synch)
+            hashtable_unlock(table);
+        return res;
+    }
+    hindex = hash_key(table, key);
     if (table->synch)
-        dr_mutex_lock(table->lock);
+        hashtable_lock(table);
     for (e = table->table[hindex]; e != NULL; e = e->next) {
         if (keys_equal(table, e->key, key)) {
             /* we have a use where payload != existing entry so we don't assert on that */
             if (table->synch)
-                dr_mutex_unlock(table->lock);
+                hashtable_unlock(table);
             return false;
         }
     }
     e = (hash_entry_t *) hash_alloc(sizeof(*e));
-    if (table->str_dup) {
-        const char *s = (const char *) key;
-        e->key = hash_alloc(strlen(s)+1);
-        strncpy((char *)e->key, s, strlen(s)+1);
-    } else
-        e->key = key;
+    e->key = dup_key(table, key);
     e->payload = payload;
     e->next = table->table[hindex];
     table->table[hindex] = e;
     table->entries++;
     hashtable_check_for_resize(table);
     if (table->synch)
-        dr_mutex_unlock(table->lock);
+        hashtable_unlock(table);
     return true;
 }
 
@@ -356,20 +694,32 @@ void *
 hashtable_add_replace(hashtable_t *table, void *key, void *payload)
 {
     void *old_payload = NULL;
-    uint hindex = hash_key(table, key);
+    uint hindex;
     hash_entry_t *e, *new_e, *prev_e;
     /* if payload is null can't tell from lookup miss */
     ASSERT(payload != NULL, "hashtable_add_replace internal error");
+    if (table->config.open_address) {
+        uint idx;
+        if (table->synch)
+            hashtable_lock(table);
+        if (oa_find(table, key, &idx)) {
+            /* The existing (equal) key is kept.  Up to caller to free payload. */
+            old_payload = OA_SLOTS(table)[idx].payload;
+            OA_SLOTS(table)[idx].payload = payload;
+        } else {
+            oa_check_for_resize(table);
+            oa_insert(table, dup_key(table, key), payload);
+        }
+        if (table->synch)
+            hashtable_unlock(table);
+        return old_payload;
+    }
+    hindex = hash_key(table, key);
     new_e = (hash_entry_t *) hash_alloc(sizeof(*new_e));
-    if (table->str_dup) {
-        const char *s = (const char *) key;
-        new_e->key = hash_alloc(strlen(s)+1);
-        strncpy((char *)new_e->key, s, strlen(s)+1);
-    } else
-        new_e->key = key;
+    new_e->key = dup_key(table, key);
     new_e->payload = payload;
     if (table->synch)
-        dr_mutex_lock(table->lock);
+        hashtable_lock(table);
     for (e = table->table[hindex], prev_e = NULL; e != NULL; prev_e = e, e = e->next) {
         if (keys_equal(table, e->key, key)) {
             if (prev_e == NULL)
@@ -392,7 +742,7 @@ hashtable_add_replace(hashtable_t *table, void *key, void *payload)
         hashtable_check_for_resize(table);
     }
     if (table->synch)
-        dr_mutex_unlock(table->lock);
+        hashtable_unlock(table);
     return old_payload;
 }
 
@@ -401,9 +751,22 @@ hashtable_remove(hashtable_t *table, void *key)
 {
     bool res = false;
     hash_entry_t *e, *prev_e;
-    uint hindex = hash_key(table, key);
+    uint hindex;
+    if (table->config.open_address) {
+        uint idx;
+        if (table->synch)
+            hashtable_lock(table);
+        if (oa_find(table, key, &idx)) {
+            oa_remove_slot(table, idx);
+            res = true;
+        }
+        if (table->synch)
+            hashtable_unlock(table);
+        return res;
+    }
+    hindex = hash_key(table, key);
     if (table->synch)
-        dr_mutex_lock(table->lock);
+        hashtable_lock(table);
     for (e = table->table[hindex], prev_e = NULL; e != NULL; prev_e = e, e = e->next) {
         if (keys_equal(table, e->key, key)) {
             if (prev_e == NULL)
@@ -421,7 +784,7 @@ hashtable_remove(hashtable_t *table, void *key)
         }
     }
     if (table->synch)
-        dr_mutex_unlock(table->lock);
+        hashtable_unlock(table);
     return res;
 }
 
@@ -433,6 +796,18 @@ hashtable_remove_range(hashtable_t *table, void *start, void *end)
     hash_entry_t *e, *prev_e, *next_e;
     if (table->synch)
         hashtable_lock(table);
+    if (table->config.open_address) {
+        for (i = 0; i < OA_CAPACITY(table); i++) {
+            if (oa_slot_full(table, i) && OA_SLOTS(table)[i].key >= start &&
+                OA_SLOTS(table)[i].key < end) {
+                oa_remove_slot(table, i);
+                res = true;
+            }
+        }
+        if (table->synch)
+            hashtable_unlock(table);
+        return res;
+    }
     for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
         for (e = table->table[i], prev_e = NULL; e != NULL; e = next_e) {
             next_e = e->next;
@@ -461,6 +836,10 @@ static void
 hashtable_clear_internal(hashtable_t *table)
 {
     uint i;
+    if (table->config.open_address) {
+        oa_clear(table);
+        return;
+    }
     for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
         hash_entry_t *e = table->table[i];
         while (e != NULL) {
@@ -481,25 +860,32 @@ void
 hashtable_clear(hashtable_t *table)
 {
     if (table->synch)
-        dr_mutex_lock(table->lock);
+        hashtable_lock(table);
     hashtable_clear_internal(table);
     if (table->synch)
-        dr_mutex_unlock(table->lock);
+        hashtable_unlock(table);
 }
 
 void
 hashtable_delete(hashtable_t *table)
 {
     if (table->synch)
-        dr_mutex_lock(table->lock);
+        hashtable_lock(table);
     hashtable_clear_internal(table);
-    hash_free(table->table, (size_t)HASHTABLE_SIZE(table->table_bits) *
-              sizeof(hash_entry_t*));
+    if (table->config.open_address)
+        hash_free(table->table, oa_alloc_size(table->table_bits));
+    else {
+        hash_free(table->table, (size_t)HASHTABLE_SIZE(table->table_bits) *
+                  sizeof(hash_entry_t*));
+    }
     table->table = NULL;
     table->entries = 0;
     if (table->synch)
-        dr_mutex_unlock(table->lock);
-    dr_mutex_destroy(table->lock);
+        hashtable_unlock(table);
+    if (table->config.read_write_lock)
+        dr_rwlock_destroy(table->lock);
+    else
+        dr_mutex_destroy(table->lock);
 }
 
 /***************************************************************************
@@ -548,23 +934,22 @@ hashtable_persist_size(void *drcontext, hashtable_t *table, size_t entry_size,
     if (table->hashtype == HASH_INTPTR &&
         TESTANY(DR_HASHPERS_ONLY_IN_RANGE | DR_HASHPERS_ONLY_PERSISTED, flags)) {
         /* synch is already provided */
-        uint i;
         ptr_uint_t start = 0;
         size_t size = 0;
         if (perscxt != NULL) {
             start = (ptr_uint_t) dr_persist_start(perscxt);
             size = dr_persist_size(perscxt);
         }
+        entry_iter_t it;
+        hash_entry_t *he;
         count = 0;
-        for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
-            hash_entry_t *he;
-            for (he = table->table[i]; he != NULL; he = he->next) {
-                if ((!TEST(DR_HASHPERS_ONLY_IN_RANGE, flags) ||
-                     key_in_range(table, he, start, size)) &&
-                    (!TEST(DR_HASHPERS_ONLY_PERSISTED, flags) ||
-                     dr_fragment_persistable(drcontext, perscxt, he->key)))
-                    count++;
-            }
+        memset(&it, 0, sizeof(it));
+        while ((he = entry_iter_next(table, &it)) != NULL) {
+            if ((!TEST(DR_HASHPERS_ONLY_IN_RANGE, flags) ||
+                 key_in_range(table, he, start, size)) &&
+                (!TEST(DR_HASHPERS_ONLY_PERSISTED, flags) ||
+                 dr_fragment_persistable(drcontext, perscxt, he->key)))
+                count++;
         }
     } else
         count = table->entries;
@@ -583,7 +968,8 @@ bool
 hashtable_persist(void *drcontext, hashtable_t *table, size_t entry_size,
                   file_t fd, void *perscxt, hasthable_persist_flags_t flags)
 {
-    uint i;
+    entry_iter_t it;
+    hash_entry_t *he;
     ptr_uint_t start = 0;
     size_t size = 0;
     IF_DEBUG(uint count_check = 0;)
@@ -600,24 +986,22 @@ hashtable_persist(void *drcontext, hashtable_t *table, size_t entry_size,
             return false;
     }
     /* synch is already provided */
-    for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
-        hash_entry_t *he;
-        for (he = table->table[i]; he != NULL; he = he->next) {
-            if ((!TEST(DR_HASHPERS_ONLY_IN_RANGE, flags) ||
-                 key_in_range(table, he, start, size)) &&
-                (!TEST(DR_HASHPERS_ONLY_PERSISTED, flags) ||
-                 dr_fragment_persistable(drcontext, perscxt, he->key))) {
-                IF_DEBUG(count_check++;)
-                if (!hash_write_file(fd, &he->key, sizeof(he->key)))
+    memset(&it, 0, sizeof(it));
+    while ((he = entry_iter_next(table, &it)) != NULL) {
+        if ((!TEST(DR_HASHPERS_ONLY_IN_RANGE, flags) ||
+             key_in_range(table, he, start, size)) &&
+            (!TEST(DR_HASHPERS_ONLY_PERSISTED, flags) ||
+             dr_fragment_persistable(drcontext, perscxt, he->key))) {
+            IF_DEBUG(count_check++;)
+            if (!hash_write_file(fd, &he->key, sizeof(he->key)))
+                return false;
+            if (TEST(DR_HASHPERS_PAYLOAD_IS_POINTER, flags)) {
+                if (!hash_write_file(fd, he->payload, entry_size))
+                    return false;
+            } else {
+                ASSERT(entry_size <= sizeof(void*), "inlined data too large");
+                if (!hash_write_file(fd, &he->payload, entry_size))
                     return false;
-                if (TEST(DR_HASHPERS_PAYLOAD_IS_POINTER, flags)) {
-                    if (!hash_write_file(fd, he->payload, entry_size))
-                        return false;
-                } else {
-                    ASSERT(entry_size <= sizeof(void*), "inlined data too large");
-                    if (!hash_write_file(fd, &he->payload, entry_size))
-                        return false;
-                }
             }
         }
     }
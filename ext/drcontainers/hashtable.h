@@ -80,6 +80,24 @@ typedef struct _hashtable_config_t {
     size_t size; /**< The size of the hashtable_config_t struct used */
     bool resizable; /**< Whether the table should be resized */
     uint resize_threshold; /**< Resize the table at this % full */
+    /**
+     * Whether to store entries inline in an open-addressed array, probed
+     * eight slots at a time using per-slot hash tags, instead of in
+     * separately allocated chained entries.  This avoids a heap allocation
+     * per entry and a pointer chase per probe, which benefits lookup-heavy
+     * tables.  It can only be changed while the table is empty.  Such a
+     * table always grows once it is 7/8 full, regardless of \p resizable,
+     * and its \p table field must not be walked directly.
+     */
+    bool open_address;
+    /**
+     * Whether the table's lock is a reader-writer lock, so that concurrent
+     * hashtable_lookup() calls on a synchronized table proceed in parallel
+     * while updates are exclusive.  Suited to read-mostly shared tables.
+     * hashtable_lock() acquires it for writing.  It can only be changed
+     * while the lock is not held.
+     */
+    bool read_write_lock;
 } hashtable_config_t;
 
 typedef struct _hashtable_t {
@@ -95,6 +113,7 @@ typedef struct _hashtable_t {
     uint entries;
     hashtable_config_t config;
     uint persist_count;
+    uint deleted; /* tombstones, for config.open_address */
 } hashtable_t;
 
 /* should move back to utils.c once have iterator and alloc_exit
@@ -0,0 +1,163 @@
+/* ***************************************************************************
+ * Copyright (c) 2016 Google, Inc.  All rights reserved.
+ * ***************************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* drgui_perf_tool.cpp
+ *
+ * Provides the performance dashboard tool: the plugin factory and its
+ * options page.
+ */
+
+#ifdef __CLASS__
+#  undef __CLASS__
+#endif
+#define __CLASS__ "drgui_perf_tool_t::"
+
+#include <QFormLayout>
+#include <QSpinBox>
+#include <QSettings>
+#include <QDebug>
+
+#include "drgui_perf_tool.h"
+#include "drgui_perf_view.h"
+
+/* Public
+ * Constructor
+ */
+drgui_perf_options_page_t::drgui_perf_options_page_t(void)
+{
+    QFormLayout *layout = new QFormLayout(this);
+    refresh_ms_spin_box = new QSpinBox(this);
+    refresh_ms_spin_box->setRange(100, 60 * 1000);
+    refresh_ms_spin_box->setSingleStep(100);
+    refresh_ms_spin_box->setSuffix(tr(" ms"));
+    layout->addRow(tr("Refresh interval:"), refresh_ms_spin_box);
+    history_spin_box = new QSpinBox(this);
+    history_spin_box->setRange(10, 100 * 1000);
+    layout->addRow(tr("Samples plotted:"), history_spin_box);
+    setLayout(layout);
+    read_settings();
+}
+
+/* Public
+ * Returns the names of the tools this page configures
+ */
+QStringList
+drgui_perf_options_page_t::tool_names(void) const
+{
+    return QStringList() << "Performance Dashboard";
+}
+
+/* Public
+ * Saves the settings; open dashboards pick them up when next attached
+ */
+void
+drgui_perf_options_page_t::write_settings(void)
+{
+    QSettings settings("DynamoRIO", "DrGUI");
+    settings.beginGroup(DRGUI_PERF_SETTINGS_GROUP);
+    settings.setValue("Refresh_ms", refresh_ms_spin_box->value());
+    settings.setValue("History", history_spin_box->value());
+    settings.endGroup();
+}
+
+/* Public
+ * Loads the settings into the page
+ */
+void
+drgui_perf_options_page_t::read_settings(void)
+{
+    QSettings settings("DynamoRIO", "DrGUI");
+    settings.beginGroup(DRGUI_PERF_SETTINGS_GROUP);
+    refresh_ms_spin_box->setValue(settings.value("Refresh_ms",
+                                                 DRGUI_PERF_DEFAULT_REFRESH_MS).toInt());
+    history_spin_box->setValue(settings.value("History",
+                                              DRGUI_PERF_DEFAULT_HISTORY).toInt());
+    settings.endGroup();
+}
+
+/* Public
+ * Constructor
+ */
+drgui_perf_tool_t::drgui_perf_tool_t(void)
+    : options_page(NULL)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+}
+
+/* Public
+ * Destructor
+ */
+drgui_perf_tool_t::~drgui_perf_tool_t(void)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+}
+
+/* Public
+ * Returns the names of the provided tools
+ */
+QStringList
+drgui_perf_tool_t::tool_names(void) const
+{
+    return QStringList() << "Performance Dashboard";
+}
+
+/* Public
+ * Returns a new dashboard.  The arguments may include -pid <pid> and
+ * -interval_file <path> to attach right away.
+ */
+QWidget *
+drgui_perf_tool_t::create_instance(const QStringList &args)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    return new drgui_perf_view_t(args);
+}
+
+/* Public
+ * Returns the options page, which the preferences dialog owns
+ */
+drgui_options_interface_t *
+drgui_perf_tool_t::create_options_page(void)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    options_page = new drgui_perf_options_page_t;
+    return options_page;
+}
+
+/* Public
+ * The dashboard has no source files to open
+ */
+void
+drgui_perf_tool_t::open_file(const QString &path, int line_num)
+{
+    Q_UNUSED(path);
+    Q_UNUSED(line_num);
+}
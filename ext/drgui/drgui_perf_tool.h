@@ -0,0 +1,89 @@
+/* ***************************************************************************
+ * Copyright (c) 2016 Google, Inc.  All rights reserved.
+ * ***************************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* drgui_perf_tool.h
+ *
+ * Provides the performance dashboard tool: the plugin factory and its
+ * options page.
+ */
+
+#ifndef DRGUI_PERF_TOOL_H
+#define DRGUI_PERF_TOOL_H
+
+#include "drgui_tool_interface.h"
+#include "drgui_options_interface.h"
+
+class QSpinBox;
+
+class drgui_perf_options_page_t : public drgui_options_interface_t
+{
+    Q_OBJECT
+    Q_INTERFACES(drgui_options_interface_t)
+
+public:
+    drgui_perf_options_page_t(void);
+
+    QStringList tool_names(void) const;
+
+    void write_settings(void);
+
+    void read_settings(void);
+
+private:
+    QSpinBox *refresh_ms_spin_box;
+    QSpinBox *history_spin_box;
+};
+
+class drgui_perf_tool_t : public drgui_tool_interface_t
+{
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID DrGUI_ToolInterface_iid)
+    Q_INTERFACES(drgui_tool_interface_t)
+
+public:
+    drgui_perf_tool_t(void);
+
+    ~drgui_perf_tool_t(void);
+
+    QStringList tool_names(void) const;
+
+    QWidget *create_instance(const QStringList &args = QStringList());
+
+    drgui_options_interface_t *create_options_page(void);
+
+    void open_file(const QString &path, int line_num);
+
+private:
+    drgui_perf_options_page_t *options_page;
+};
+
+#endif
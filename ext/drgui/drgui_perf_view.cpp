@@ -0,0 +1,569 @@
+/* ***************************************************************************
+ * Copyright (c) 2016 Google, Inc.  All rights reserved.
+ * ***************************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* drgui_perf_view.cpp
+ *
+ * Plots the live overhead of a process running under DR: its global
+ * statistics exported with -stats_shmem and the per-level miss rates that
+ * drcachesim writes with -interval_file.
+ */
+
+#ifdef __CLASS__
+#  undef __CLASS__
+#endif
+#define __CLASS__ "drgui_perf_view_t::"
+
+#include <QGridLayout>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QLineEdit>
+#include <QLabel>
+#include <QPushButton>
+#include <QTimer>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QSettings>
+#include <QDateTime>
+#include <QDebug>
+
+#include <stddef.h>
+#include <string.h>
+
+#include "configure.h"
+#include "globals_shared.h"
+#include "dr_stats.h"
+
+#include "drgui_perf_view.h"
+
+/* The code cache capacity stats are only kept in debug builds.  Release
+ * builds only count cache units, which we plot instead.
+ */
+static const char * const cache_capacity_stats[][2] = {
+    {"Fcache bb capacity (bytes)", "private bbs"},
+    {"Fcache trace capacity (bytes)", "private traces"},
+    {"Fcache shared bb capacity (bytes)", "shared bbs"},
+    {"Fcache shared trace capacity (bytes)", "shared traces"},
+};
+#define CACHE_UNITS_STAT "Fcache units on live list"
+
+/* IBL misses exit the cache.  The -exit_profile count is available in
+ * release builds; the debug-only stats split it by where the target is.
+ */
+static const char * const ibl_miss_stats[][2] = {
+    {"Exit profile exits, indirect branch", "misses"},
+    {"Fcache exits, ind target not in cache", "target not built"},
+    {"Fcache exits, ind target in cache but not table", "target not in table"},
+};
+
+/* Exits by reason, from -exit_profile, or else from the debug-only stats */
+#define EXIT_PROFILE_PREFIX "Exit profile exits, "
+static const char * const debug_exit_stats[][2] = {
+    {"Fcache exits, total indirect branches", "indirect branch"},
+    {"Fcache exits, system call executions", "system call"},
+    {"Fcache exits, flushed due to code mod", "code modification"},
+    {"Fcache exits, asynch", "asynch event"},
+    {"Fcache exits, native_exec executions", "native_exec"},
+    {"Fcache exits, client redirecting", "client redirection"},
+};
+
+#define ARRAY_ENTRIES(array) (sizeof(array) / sizeof((array)[0]))
+
+/* Public
+ * Constructor
+ */
+drgui_perf_plot_t::drgui_perf_plot_t(const QString &title_, const QString &unit_,
+                                     QWidget *parent)
+    : QWidget(parent), title(title_), unit(unit_),
+      history(DRGUI_PERF_DEFAULT_HISTORY)
+{
+    setMinimumSize(300, 200);
+}
+
+/* Public
+ * Appends a sample to the series called name, creating the series on its
+ * first sample
+ */
+void
+drgui_perf_plot_t::add_sample(const QString &name, double value)
+{
+    int i;
+    for (i = 0; i < series.count(); i++) {
+        if (series[i].name == name)
+            break;
+    }
+    if (i == series.count()) {
+        series_t new_series;
+        new_series.name = name;
+        series.append(new_series);
+    }
+    series[i].values.append(value);
+    if (series[i].values.count() > history)
+        series[i].values.remove(0, series[i].values.count() - history);
+    update();
+}
+
+/* Public
+ * Sets how many of the most recent samples are kept and shown
+ */
+void
+drgui_perf_plot_t::set_history(int samples)
+{
+    history = samples < 2 ? 2 : samples;
+    for (int i = 0; i < series.count(); i++) {
+        if (series[i].values.count() > history)
+            series[i].values.remove(0, series[i].values.count() - history);
+    }
+    update();
+}
+
+/* Public
+ * Removes all series
+ */
+void
+drgui_perf_plot_t::clear(void)
+{
+    series.clear();
+    update();
+}
+
+/* Protected
+ * Draws the series right-aligned, so the newest samples of all series line
+ * up, with the y axis scaled to the largest value shown
+ */
+void
+drgui_perf_plot_t::paintEvent(QPaintEvent *event)
+{
+    static const Qt::GlobalColor colors[] = {
+        Qt::blue, Qt::red, Qt::darkGreen, Qt::magenta,
+        Qt::darkCyan, Qt::darkYellow, Qt::darkBlue, Qt::darkRed,
+    };
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::white);
+    QFontMetrics metrics = painter.fontMetrics();
+    int line_height = metrics.height();
+
+    double max_value = 0;
+    for (int i = 0; i < series.count(); i++) {
+        foreach (double value, series[i].values) {
+            if (value > max_value)
+                max_value = value;
+        }
+    }
+    if (max_value <= 0)
+        max_value = 1;
+    QString max_label = QString::number(max_value, 'g', 4);
+
+    /* Title above, legend below, y labels to the left */
+    painter.setPen(Qt::black);
+    painter.drawText(QRect(0, 0, width(), line_height), Qt::AlignCenter,
+                     unit.isEmpty() ? title : QString("%1 (%2)").arg(title).arg(unit));
+    QRect area(metrics.width(max_label) + 8, line_height + 4, 0, 0);
+    area.setRight(width() - 8);
+    area.setBottom(height() - 2 * line_height - 8);
+    if (area.width() < 2 || area.height() < 2)
+        return;
+    painter.drawRect(area);
+    painter.drawText(QRect(0, area.top() - line_height / 2, area.left() - 4,
+                           line_height), Qt::AlignRight | Qt::AlignVCenter,
+                     max_label);
+    painter.drawText(QRect(0, area.bottom() - line_height / 2, area.left() - 4,
+                           line_height), Qt::AlignRight | Qt::AlignVCenter, "0");
+
+    double x_step = (double) area.width() / (history - 1);
+    int legend_x = area.left();
+    int legend_y = area.bottom() + line_height / 2 + 4;
+    for (int i = 0; i < series.count(); i++) {
+        const QVector<double> &values = series[i].values;
+        QColor color(colors[i % ARRAY_ENTRIES(colors)]);
+        QPolygonF line;
+        for (int j = 0; j < values.count(); j++) {
+            line << QPointF(area.right() - (values.count() - 1 - j) * x_step,
+                            area.bottom() - values[j] / max_value * area.height());
+        }
+        painter.setPen(QPen(color, 2));
+        painter.drawPolyline(line);
+        painter.fillRect(legend_x, legend_y + line_height / 4, line_height / 2,
+                         line_height / 2, color);
+        painter.setPen(Qt::black);
+        painter.drawText(legend_x + line_height, legend_y + metrics.ascent(),
+                         series[i].name);
+        legend_x += line_height * 2 + metrics.width(series[i].name);
+    }
+}
+
+/* Public
+ * Constructor.  The arguments may include -pid <pid> and
+ * -interval_file <path> to attach right away.
+ */
+drgui_perf_view_t::drgui_perf_view_t(const QStringList &args, QWidget *parent)
+    : QWidget(parent), stats_map(NULL), last_msecs(0)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    QVBoxLayout *main_layout = new QVBoxLayout(this);
+
+    QHBoxLayout *source_layout = new QHBoxLayout;
+    pid_line_edit = new QLineEdit(this);
+    pid_line_edit->setPlaceholderText(tr("process id (-stats_shmem)"));
+    interval_file_line_edit = new QLineEdit(this);
+    interval_file_line_edit->setPlaceholderText(tr("drcachesim -interval_file"));
+    QPushButton *attach_button = new QPushButton(tr("Attach"), this);
+    connect(attach_button, SIGNAL(clicked()), this, SLOT(attach()));
+    source_layout->addWidget(new QLabel(tr("Process:"), this));
+    source_layout->addWidget(pid_line_edit);
+    source_layout->addWidget(new QLabel(tr("Interval file:"), this));
+    source_layout->addWidget(interval_file_line_edit, 1);
+    source_layout->addWidget(attach_button);
+    main_layout->addLayout(source_layout);
+
+    status_label = new QLabel(this);
+    main_layout->addWidget(status_label);
+
+    QGridLayout *plot_layout = new QGridLayout;
+    cache_plot = new drgui_perf_plot_t(tr("Code cache size"), tr("KB"), this);
+    ibl_plot = new drgui_perf_plot_t(tr("IBL misses"), tr("per second"), this);
+    exits_plot = new drgui_perf_plot_t(tr("Code cache exits by reason"),
+                                       tr("per second"), this);
+    miss_plot = new drgui_perf_plot_t(tr("Miss rate per interval"), tr("%"), this);
+    plot_layout->addWidget(cache_plot, 0, 0);
+    plot_layout->addWidget(ibl_plot, 0, 1);
+    plot_layout->addWidget(exits_plot, 1, 0);
+    plot_layout->addWidget(miss_plot, 1, 1);
+    main_layout->addLayout(plot_layout, 1);
+    setLayout(main_layout);
+
+    timer = new QTimer(this);
+    connect(timer, SIGNAL(timeout()), this, SLOT(refresh()));
+
+    for (int i = 0; i + 1 < args.count(); i++) {
+        if (args[i] == "-pid")
+            pid_line_edit->setText(args[++i]);
+        else if (args[i] == "-interval_file")
+            interval_file_line_edit->setText(args[++i]);
+    }
+    if (!pid_line_edit->text().isEmpty() ||
+        !interval_file_line_edit->text().isEmpty())
+        attach();
+}
+
+/* Public
+ * Destructor
+ */
+drgui_perf_view_t::~drgui_perf_view_t(void)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    timer->stop();
+    unmap_stats();
+}
+
+/* Private
+ * Applies the options page settings
+ */
+void
+drgui_perf_view_t::read_settings(void)
+{
+    QSettings settings("DynamoRIO", "DrGUI");
+    settings.beginGroup(DRGUI_PERF_SETTINGS_GROUP);
+    int history = settings.value("History", DRGUI_PERF_DEFAULT_HISTORY).toInt();
+    timer->setInterval(settings.value("Refresh_ms",
+                                      DRGUI_PERF_DEFAULT_REFRESH_MS).toInt());
+    settings.endGroup();
+    cache_plot->set_history(history);
+    ibl_plot->set_history(history);
+    exits_plot->set_history(history);
+    miss_plot->set_history(history);
+}
+
+/* Private Slot
+ * Starts plotting the sources in the line edits from scratch
+ */
+void
+drgui_perf_view_t::attach(void)
+{
+    qDebug().nospace() << "INFO: Entering " << __CLASS__ << __FUNCTION__;
+    QStringList status;
+    QString error;
+    timer->stop();
+    unmap_stats();
+    interval_file.close();
+    cache_plot->clear();
+    ibl_plot->clear();
+    exits_plot->clear();
+    miss_plot->clear();
+    read_settings();
+
+    if (!pid_line_edit->text().isEmpty()) {
+        if (map_stats(&error))
+            status << tr("Attached to process %1").arg(pid_line_edit->text());
+        else
+            status << error;
+    }
+    if (!interval_file_line_edit->text().isEmpty()) {
+        if (open_intervals(&error))
+            status << tr("Reading %1").arg(interval_file_line_edit->text());
+        else
+            status << error;
+    }
+    status_label->setText(status.join("; "));
+    if (stats_map != NULL || interval_file.isOpen()) {
+        last_msecs = 0;
+        refresh();
+        timer->start();
+    }
+}
+
+/* Private Slot
+ * Takes a sample of every source
+ */
+void
+drgui_perf_view_t::refresh(void)
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (stats_map != NULL) {
+        /* The target removes its segment when it exits */
+        if (!QFile::exists(stats_file.fileName())) {
+            status_label->setText(tr("Process %1 has exited")
+                                  .arg(pid_line_edit->text()));
+            unmap_stats();
+        } else
+            sample_stats(last_msecs == 0 ? 0 : (now - last_msecs) / 1000.0);
+    }
+    last_msecs = now;
+    if (interval_file.isOpen())
+        sample_intervals();
+    if (stats_map == NULL && !interval_file.isOpen())
+        timer->stop();
+}
+
+/* Private
+ * Maps the -stats_shmem segment of the process in the pid line edit
+ */
+bool
+drgui_perf_view_t::map_stats(QString *error)
+{
+#ifdef UNIX
+    const dr_statistics_t *drstats;
+    qint64 size;
+    bool ok;
+    uint pid = pid_line_edit->text().toUInt(&ok);
+    if (!ok) {
+        *error = tr("Invalid process id %1").arg(pid_line_edit->text());
+        return false;
+    }
+    stats_file.setFileName(QString("%1/%2%3").arg(STATS_SHMEM_DIR)
+                           .arg(STATS_SHMEM_PREFIX).arg(pid));
+    if (!stats_file.open(QIODevice::ReadOnly)) {
+        *error = tr("Cannot open %1: is the process running with -stats_shmem?")
+            .arg(stats_file.fileName());
+        return false;
+    }
+    size = stats_file.size();
+    if (size >= (qint64) sizeof(dr_statistics_t))
+        stats_map = stats_file.map(0, size);
+    if (stats_map == NULL) {
+        *error = tr("%1 is not a statistics segment").arg(stats_file.fileName());
+        stats_file.close();
+        return false;
+    }
+    /* The segment holds num_stats entries past the fixed-size header */
+    drstats = (const dr_statistics_t *) stats_map;
+    if (strncmp(drstats->magicstring, DYNAMORIO_MAGIC_STRING,
+                DYNAMORIO_MAGIC_STRING_LEN - 1) != 0 ||
+        offsetof(dr_statistics_t, stats) + drstats->num_stats * sizeof(single_stat_t) >
+        (size_t) size) {
+        *error = tr("%1 does not match this version").arg(stats_file.fileName());
+        unmap_stats();
+        return false;
+    }
+    for (uint i = 0; i < drstats->num_stats; i++) {
+        const char *name = drstats->stats[i].name;
+        stat_index.insert(QString::fromLatin1(name, qstrnlen(name, STAT_NAME_MAX_LEN)),
+                          (int) i);
+    }
+    return true;
+#else
+    *error = tr("Statistics export (-stats_shmem) is only supported on Linux");
+    return false;
+#endif
+}
+
+/* Private
+ * Releases the -stats_shmem segment
+ */
+void
+drgui_perf_view_t::unmap_stats(void)
+{
+    if (stats_map != NULL)
+        stats_file.unmap((uchar *) stats_map);
+    stats_map = NULL;
+    stats_file.close();
+    stat_index.clear();
+    last_values.clear();
+}
+
+/* Private
+ * Returns the current value of the stat called name.  The process keeps
+ * updating it, so every read goes to the mapping.
+ */
+qint64
+drgui_perf_view_t::stat_value(const QString &name, bool *found) const
+{
+    QMap<QString, int>::const_iterator it = stat_index.find(name);
+    *found = (it != stat_index.end());
+    if (!*found)
+        return 0;
+    const dr_statistics_t *drstats = (const dr_statistics_t *) stats_map;
+    return (qint64) *(volatile const stats_int_t *) &drstats->stats[it.value()].value;
+}
+
+/* Private
+ * Plots the per-second rate of a counting stat over the last secs seconds
+ */
+void
+drgui_perf_view_t::plot_rate(drgui_perf_plot_t *plot, const QString &stat,
+                             const QString &label, double secs)
+{
+    bool found;
+    qint64 value = stat_value(stat, &found);
+    if (!found)
+        return;
+    if (secs > 0 && last_values.contains(stat))
+        plot->add_sample(label, (value - last_values.value(stat)) / secs);
+    last_values.insert(stat, value);
+}
+
+/* Private
+ * Takes a sample of the stats.  The first sample has no previous one, so
+ * secs is 0 and no rates are plotted.
+ */
+void
+drgui_perf_view_t::sample_stats(double secs)
+{
+    bool found, any_capacity = false;
+    for (size_t i = 0; i < ARRAY_ENTRIES(cache_capacity_stats); i++) {
+        qint64 value = stat_value(cache_capacity_stats[i][0], &found);
+        if (found) {
+            cache_plot->add_sample(cache_capacity_stats[i][1], value / 1024.0);
+            any_capacity = true;
+        }
+    }
+    if (!any_capacity) {
+        qint64 units = stat_value(CACHE_UNITS_STAT, &found);
+        if (found)
+            cache_plot->add_sample(tr("live units (count)"), (double) units);
+    }
+
+    for (size_t i = 0; i < ARRAY_ENTRIES(ibl_miss_stats); i++)
+        plot_rate(ibl_plot, ibl_miss_stats[i][0], ibl_miss_stats[i][1], secs);
+
+    bool any_profile = false;
+    for (QMap<QString, int>::const_iterator it = stat_index.begin();
+         it != stat_index.end(); ++it) {
+        if (it.key().startsWith(EXIT_PROFILE_PREFIX)) {
+            plot_rate(exits_plot, it.key(),
+                      it.key().mid(strlen(EXIT_PROFILE_PREFIX)), secs);
+            any_profile = true;
+        }
+    }
+    if (!any_profile) {
+        for (size_t i = 0; i < ARRAY_ENTRIES(debug_exit_stats); i++)
+            plot_rate(exits_plot, debug_exit_stats[i][0], debug_exit_stats[i][1], secs);
+    }
+}
+
+/* Private
+ * Opens the drcachesim interval file in the interval file line edit
+ */
+bool
+drgui_perf_view_t::open_intervals(QString *error)
+{
+    interval_file.setFileName(interval_file_line_edit->text());
+    /* Unbuffered, so each read picks up what was appended since the last */
+    if (!interval_file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        *error = tr("Cannot open %1").arg(interval_file.fileName());
+        return false;
+    }
+    interval_partial.clear();
+    interval_levels.clear();
+    hits_columns.clear();
+    misses_columns.clear();
+    return true;
+}
+
+/* Private
+ * Plots the miss rate of each cache for every interval row appended to the
+ * file since the last sample.  Rows are cumulative and per-interval hits and
+ * misses for each cache, named in the header row.
+ */
+void
+drgui_perf_view_t::sample_intervals(void)
+{
+    /* A new simulation rewrote the file */
+    if (interval_file.size() < interval_file.pos()) {
+        interval_file.seek(0);
+        interval_partial.clear();
+        miss_plot->clear();
+    }
+    interval_partial += interval_file.readAll();
+    int newline;
+    while ((newline = interval_partial.indexOf('\n')) >= 0) {
+        QString line = QString::fromLatin1(interval_partial.left(newline)).trimmed();
+        interval_partial.remove(0, newline + 1);
+        QStringList fields = line.split(',');
+        if (fields.value(0) == "interval") {
+            interval_levels.clear();
+            hits_columns.clear();
+            misses_columns.clear();
+            for (int i = 0; i < fields.count(); i++) {
+                if (!fields[i].endsWith("_interval_hits"))
+                    continue;
+                QString level = fields[i].left(fields[i].length() -
+                                               strlen("_interval_hits"));
+                int misses = fields.indexOf(level + "_interval_misses");
+                if (misses < 0)
+                    continue;
+                interval_levels << level;
+                hits_columns << i;
+                misses_columns << misses;
+            }
+            continue;
+        }
+        for (int i = 0; i < interval_levels.count(); i++) {
+            double hits = fields.value(hits_columns[i]).toDouble();
+            double misses = fields.value(misses_columns[i]).toDouble();
+            if (hits + misses > 0) {
+                miss_plot->add_sample(interval_levels[i],
+                                      100.0 * misses / (hits + misses));
+            }
+        }
+    }
+}
@@ -0,0 +1,147 @@
+/* ***************************************************************************
+ * Copyright (c) 2016 Google, Inc.  All rights reserved.
+ * ***************************************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* drgui_perf_view.h
+ *
+ * Plots the live overhead of a process running under DR: its global
+ * statistics exported with -stats_shmem and the per-level miss rates that
+ * drcachesim writes with -interval_file.
+ */
+
+#ifndef DRGUI_PERF_VIEW_H
+#define DRGUI_PERF_VIEW_H
+
+#include <QWidget>
+#include <QFile>
+#include <QList>
+#include <QMap>
+#include <QVector>
+#include <QStringList>
+
+class QLineEdit;
+class QLabel;
+class QTimer;
+class QPaintEvent;
+
+/* The settings shared by the view and its options page */
+#define DRGUI_PERF_SETTINGS_GROUP "Performance_dashboard"
+#define DRGUI_PERF_DEFAULT_REFRESH_MS 1000
+#define DRGUI_PERF_DEFAULT_HISTORY 300
+
+/* A strip chart of the most recent samples of several series */
+class drgui_perf_plot_t : public QWidget
+{
+    Q_OBJECT
+
+public:
+    drgui_perf_plot_t(const QString &title_, const QString &unit_,
+                      QWidget *parent = 0);
+
+    void add_sample(const QString &name, double value);
+
+    void set_history(int samples);
+
+    void clear(void);
+
+protected:
+    void paintEvent(QPaintEvent *event);
+
+private:
+    struct series_t {
+        QString name;
+        QVector<double> values;
+    };
+
+    QString title;
+    QString unit;
+    int history;
+    QList<series_t> series;
+};
+
+class drgui_perf_view_t : public QWidget
+{
+    Q_OBJECT
+
+public:
+    drgui_perf_view_t(const QStringList &args, QWidget *parent = 0);
+
+    ~drgui_perf_view_t(void);
+
+private slots:
+    void attach(void);
+
+    void refresh(void);
+
+private:
+    void read_settings(void);
+
+    bool map_stats(QString *error);
+
+    void unmap_stats(void);
+
+    qint64 stat_value(const QString &name, bool *found) const;
+
+    void sample_stats(double secs);
+
+    void plot_rate(drgui_perf_plot_t *plot, const QString &stat,
+                   const QString &label, double secs);
+
+    bool open_intervals(QString *error);
+
+    void sample_intervals(void);
+
+    /* GUI */
+    QLineEdit *pid_line_edit;
+    QLineEdit *interval_file_line_edit;
+    QLabel *status_label;
+    drgui_perf_plot_t *cache_plot;
+    drgui_perf_plot_t *ibl_plot;
+    drgui_perf_plot_t *exits_plot;
+    drgui_perf_plot_t *miss_plot;
+    QTimer *timer;
+
+    /* The -stats_shmem segment, whose stat names never change */
+    QFile stats_file;
+    const uchar *stats_map;
+    QMap<QString, int> stat_index;
+    QMap<QString, qint64> last_values;
+    qint64 last_msecs;
+
+    /* The drcachesim -interval_file, read as it grows */
+    QFile interval_file;
+    QByteArray interval_partial;
+    QStringList interval_levels;
+    QList<int> hits_columns;
+    QList<int> misses_columns;
+};
+
+#endif
@@ -107,8 +107,17 @@ typedef struct _cb_entry_t {
         } pair_ex;
         drmgr_ilist_ex_cb_t instru2instru_ex_cb;
     } cb;
+    const drmgr_bb_filter_t *filter; /* owned by the client */
 } cb_entry_t;
 
+/* A flattened insertion callback with its user_data, built once per bb so
+ * the per-instr walk only has to make the calls.
+ */
+typedef struct _insert_cb_t {
+    drmgr_insertion_cb_t cb;
+    void *user_data;
+} insert_cb_t;
+
 /* generic event list entry */
 typedef struct _generic_event_entry_t {
     priority_event_entry_t pri;
@@ -177,6 +186,13 @@ static cb_list_t cblist_instru2instru;
 static uint pair_count;
 static uint quartet_count;
 
+/* Count of callbacks with a drmgr_bb_filter_t, protected by bb_cb_lock */
+static uint filter_count;
+
+/* Whether drmgr_priority_t supplied by the caller includes the filter field */
+#define PRIORITY_HAS_FILTER(pri) \
+    ((pri)->struct_size >= offsetof(drmgr_priority_t, filter) + sizeof((pri)->filter))
+
 /* Priority used for non-_ex events */
 static const drmgr_priority_t default_priority = {
     sizeof(default_priority), "__DEFAULT__", NULL, NULL, 0
@@ -220,6 +236,31 @@ static void *tls_lock;
 
 static void *note_lock;
 
+/* Persisted read-only records.  We expect only a handful of components
+ * per process to persist data, so we use a fixed array like the tls slots.
+ */
+#define MAX_NUM_PERSIST 16
+
+typedef struct _persist_entry_t {
+    bool valid;
+    const char *name; /* owned by the client */
+    size_t (*size_cb)(void *, void *, void **);
+    bool (*persist_cb)(void *, void *, file_t, void *);
+    bool (*resurrect_cb)(void *, void *, byte *, size_t);
+    /* Filled in by the size event and consumed by the persist event.  DR
+     * calls the two as an atomic sequence, so a record unregistered in
+     * between is still written out to match the size we returned.
+     */
+    bool pending;
+    size_t pending_size;
+    void *pending_user_data;
+} persist_entry_t;
+
+/* Protected by persist_lock. */
+static persist_entry_t persist_entries[MAX_NUM_PERSIST];
+static void *persist_lock;
+static bool registered_persist; /* for lazy registration */
+
 /* Thread event cbs and rwlock */
 static cb_list_t cb_list_thread_init;
 static cb_list_t cb_list_thread_exit;
@@ -321,6 +362,16 @@ our_thread_init_event(void *drcontext);
 static void
 our_thread_exit_event(void *drcontext);
 
+static size_t
+drmgr_persist_ro_size(void *drcontext, void *perscxt, size_t file_offs,
+                      void **user_data OUT);
+
+static bool
+drmgr_persist_ro(void *drcontext, void *perscxt, file_t fd, void *user_data);
+
+static bool
+drmgr_resurrect_ro(void *drcontext, void *perscxt, byte **map INOUT);
+
 /***************************************************************************
  * INIT
  */
@@ -337,6 +388,7 @@ drmgr_init(void)
         return true;
 
     note_lock = dr_mutex_create();
+    persist_lock = dr_mutex_create();
 
     bb_cb_lock = dr_rwlock_create();
     thread_event_lock = dr_rwlock_create();
@@ -411,6 +463,11 @@ drmgr_exit(void)
         dr_unregister_bb_event(drmgr_bb_event);
     if (registered_fault)
         dr_unregister_restore_state_ex_event(drmgr_restore_state_event);
+    if (registered_persist) {
+        dr_unregister_persist_ro(drmgr_persist_ro_size, drmgr_persist_ro,
+                                 drmgr_resurrect_ro);
+        registered_persist = false;
+    }
 #ifdef WINDOWS
     drmgr_cls_exit();
 #endif
@@ -431,6 +488,7 @@ drmgr_exit(void)
     dr_rwlock_destroy(thread_event_lock);
     dr_rwlock_destroy(bb_cb_lock);
 
+    dr_mutex_destroy(persist_lock);
     dr_mutex_destroy(note_lock);
 }
 
@@ -566,6 +624,91 @@ drmgr_fix_app_ctis(void *drcontext, instrlist_t *bb)
     }
 }
 
+/***************************************************************************
+ * BB FILTERS
+ */
+
+static bool
+module_name_equal(const char *name1, const char *name2)
+{
+#ifdef WINDOWS
+    /* Module names are case-insensitive on Windows */
+    for (; *name1 != '\0' && *name2 != '\0'; name1++, name2++) {
+        char c1 = (*name1 >= 'A' && *name1 <= 'Z') ? *name1 - 'A' + 'a' : *name1;
+        char c2 = (*name2 >= 'A' && *name2 <= 'Z') ? *name2 - 'A' + 'a' : *name2;
+        if (c1 != c2)
+            return false;
+    }
+    return *name1 == *name2;
+#else
+    return strcmp(name1, name2) == 0;
+#endif
+}
+
+static bool
+module_name_in_list(const char *name, const char **list)
+{
+    for (; *list != NULL; list++) {
+        if (module_name_equal(name, *list))
+            return true;
+    }
+    return false;
+}
+
+/* Returns whether filter passes blocks from the module named modname, which
+ * is NULL for code outside of any module.
+ */
+static bool
+bb_filter_passes_module(const drmgr_bb_filter_t *filter, const char *modname)
+{
+    if (filter->include_modules != NULL &&
+        (modname == NULL || !module_name_in_list(modname, filter->include_modules)))
+        return false;
+    if (filter->exclude_modules != NULL && modname != NULL &&
+        module_name_in_list(modname, filter->exclude_modules))
+        return false;
+    return true;
+}
+
+static bool
+bb_filter_passes(void *drcontext, const drmgr_bb_filter_t *filter,
+                 const char *modname)
+{
+    if (filter == NULL)
+        return true;
+    if (!bb_filter_passes_module(filter, modname))
+        return false;
+    return filter->thread_filter == NULL || (*filter->thread_filter)(drcontext);
+}
+
+/* Returns whether every bb callback has a filter that excludes the module
+ * named modname and allows drmgr to skip the module's code altogether.
+ */
+static bool
+bb_filters_skip_module(const char *modname)
+{
+    cb_list_t *lists[] = { &cblist_app2app, &cblist_instrumentation,
+                           &cblist_instru2instru };
+    bool skip;
+    uint i, j;
+    if (modname == NULL)
+        return false;
+    dr_rwlock_read_lock(bb_cb_lock);
+    skip = (bb_event_count > 0 && filter_count == bb_event_count);
+    for (i = 0; skip && i < BUFFER_SIZE_ELEMENTS(lists); i++) {
+        for (j = 0; skip && j < lists[i]->num; j++) {
+            cb_entry_t *e = &lists[i]->cbs.bb[j];
+            if (!e->pri.valid)
+                continue;
+            if (e->filter == NULL || !e->filter->skip_modules ||
+                bb_filter_passes_module(e->filter, modname))
+                skip = false;
+        }
+    }
+    dr_rwlock_read_unlock(bb_cb_lock);
+    return skip;
+}
+
 static dr_emit_flags_t
 drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
                bool for_trace, bool translating)
@@ -582,6 +725,12 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
     cb_list_t iter_app2app;
     cb_list_t iter_insert;
     cb_list_t iter_instru;
+    insert_cb_t local_fused[EVENTS_STACK_SZ];
+    insert_cb_t *fused = local_fused;
+    uint fused_num = 0;
+    bool any_filter;
+    const module_data_t *mod = NULL;
+    const char *modname = NULL;
     per_thread_t *pt = (per_thread_t *) drmgr_get_tls_field(drcontext, our_tls_idx);
 
     dr_rwlock_read_lock(bb_cb_lock);
@@ -595,8 +744,16 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
                         (byte *)local_insert, BUFFER_SIZE_ELEMENTS(local_insert));
     cblist_create_local(drcontext, &cblist_instru2instru, &iter_instru,
                         (byte *)local_instru, BUFFER_SIZE_ELEMENTS(local_instru));
+    any_filter = (filter_count > 0);
     dr_rwlock_read_unlock(bb_cb_lock);
 
+    /* The filters only need the module name, which we look up once */
+    if (any_filter) {
+        mod = dr_lookup_module_ex(dr_fragment_app_pc(tag));
+        if (mod != NULL)
+            modname = dr_module_preferred_name(mod);
+    }
+
     /* We need per-thread user_data */
     if (pair_count > 0)
         pair_data = (void **) dr_thread_alloc(drcontext, sizeof(void*)*pair_count);
@@ -612,6 +769,11 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
         e = &iter_app2app.cbs.bb[i];
         if (!e->pri.valid)
             continue;
+        if (!bb_filter_passes(drcontext, e->filter, modname)) {
+            if (e->has_quartet)
+                quartet_data[quartet_idx++] = NULL;
+            continue;
+        }
         if (e->has_quartet) {
             res |= (*e->cb.app2app_ex_cb)
                 (drcontext, tag, bb, for_trace, translating, &quartet_data[quartet_idx]);
@@ -620,15 +782,33 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
             res |= (*e->cb.xform_cb)(drcontext, tag, bb, for_trace, translating);
     }
 
-    /* Pass 2: analysis */
+    /* Pass 2: analysis.
+     * We also gather the insertion callbacks, in priority order and with their
+     * user_data, into a flat array so that pass 3 invokes all of them in a
+     * single list walk without re-examining each entry per instr.
+     */
     pt->cur_phase = DRMGR_PHASE_ANALYSIS;
+    if (iter_insert.num > BUFFER_SIZE_ELEMENTS(local_fused)) {
+        fused = (insert_cb_t *)
+            dr_thread_alloc(drcontext, sizeof(*fused)*iter_insert.num);
+    }
     for (quartet_idx = 0, pair_idx = 0, i = 0; i < iter_insert.num; i++) {
         e = &iter_insert.cbs.bb[i];
         if (!e->pri.valid)
             continue;
+        if (!bb_filter_passes(drcontext, e->filter, modname)) {
+            if (e->has_quartet)
+                quartet_idx++;
+            else
+                pair_data[pair_idx++] = NULL;
+            continue;
+        }
         if (e->has_quartet) {
             res |= (*e->cb.pair_ex.analysis_ex_cb)
                 (drcontext, tag, bb, for_trace, translating, quartet_data[quartet_idx]);
+            fused[fused_num].cb = e->cb.pair_ex.insertion_ex_cb;
+            fused[fused_num].user_data = quartet_data[quartet_idx];
+            fused_num++;
             quartet_idx++;
         } else {
             if (e->cb.pair.analysis_cb == NULL) {
@@ -637,34 +817,26 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
                 res |= (*e->cb.pair.analysis_cb)
                     (drcontext, tag, bb, for_trace, translating, &pair_data[pair_idx]);
             }
+            if (e->cb.pair.insertion_cb != NULL) {
+                fused[fused_num].cb = e->cb.pair.insertion_cb;
+                fused[fused_num].user_data = pair_data[pair_idx];
+                fused_num++;
+            }
             pair_idx++;
         }
         /* XXX: add checks that cb followed the rules */
     }
 
-    /* Pass 3: instru, per instr */
+    /* Pass 3: instru, per instr.  Skipped entirely if nobody registered. */
     pt->cur_phase = DRMGR_PHASE_INSERTION;
     pt->first_app = instrlist_first(bb);
     pt->last_app = instrlist_last(bb);
-    for (inst = instrlist_first(bb); inst != NULL; inst = next_inst) {
+    for (inst = (fused_num == 0 ? NULL : instrlist_first(bb)); inst != NULL;
+         inst = next_inst) {
         next_inst = instr_get_next(inst);
-        for (quartet_idx = 0, pair_idx = 0, i = 0; i < iter_insert.num; i++) {
-            e = &iter_insert.cbs.bb[i];
-            if (!e->pri.valid)
-                continue;
-            if (e->has_quartet) {
-                res |= (*e->cb.pair_ex.insertion_ex_cb)
-                    (drcontext, tag, bb, inst, for_trace, translating,
-                     quartet_data[quartet_idx]);
-                quartet_idx++;
-            } else {
-                if (e->cb.pair.insertion_cb != NULL) {
-                    res |= (*e->cb.pair.insertion_cb)
-                        (drcontext, tag, bb, inst, for_trace, translating,
-                         pair_data[pair_idx]);
-                }
-                pair_idx++;
-            }
+        for (i = 0; i < fused_num; i++) {
+            res |= (*fused[i].cb)(drcontext, tag, bb, inst, for_trace, translating,
+                                  fused[i].user_data);
             /* XXX: add checks that cb followed the rules */
         }
         /* XXX i#1723: in f28be26, we added auto-predication of instrumentation
@@ -680,6 +852,11 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
         e = &iter_instru.cbs.bb[i];
         if (!e->pri.valid)
             continue;
+        if (!bb_filter_passes(drcontext, e->filter, modname)) {
+            if (e->has_quartet)
+                quartet_idx++;
+            continue;
+        }
         if (e->has_quartet) {
             res |= (*e->cb.instru2instru_ex_cb)
                 (drcontext, tag, bb, for_trace, translating, quartet_data[quartet_idx]);
@@ -706,10 +883,14 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
 
     pt->cur_phase = DRMGR_PHASE_NONE;
 
+    if (mod != NULL)
+        dr_release_module_data(mod);
     if (pair_count > 0)
         dr_thread_free(drcontext, pair_data, sizeof(void*)*pair_count);
     if (quartet_count > 0)
         dr_thread_free(drcontext, quartet_data, sizeof(void*)*quartet_count);
+    if (fused != local_fused)
+        dr_thread_free(drcontext, fused, sizeof(*fused)*iter_insert.num);
 
     cblist_delete_local(drcontext, &iter_app2app, BUFFER_SIZE_ELEMENTS(local_app2app));
     cblist_delete_local(drcontext, &iter_insert, BUFFER_SIZE_ELEMENTS(local_insert));
@@ -737,7 +918,7 @@ priority_event_add(cb_list_t *list,
         return -1; /* must have a name */
 
     /* if we add fields in the future this is where we decide which to use */
-    if (new_pri->struct_size < sizeof(drmgr_priority_t))
+    if (new_pri->struct_size < offsetof(drmgr_priority_t, filter))
         return -1; /* incorrect struct */
 
     /* check for duplicate names.
@@ -829,6 +1010,7 @@ drmgr_bb_cb_add(cb_list_t *list,
 {
     int idx;
     bool res = false;
+    const drmgr_bb_filter_t *filter = NULL;
     ASSERT(list != NULL, "invalid internal params");
     ASSERT(((xform_func != NULL && analysis_func == NULL && insertion_func == NULL &&
              app2app_ex_func == NULL && analysis_ex_func == NULL &&
@@ -847,10 +1029,18 @@ drmgr_bb_cb_add(cb_list_t *list,
              instru2instru_ex_func != NULL)),
            "invalid internal params");
 
+    if (priority != NULL && PRIORITY_HAS_FILTER(priority))
+        filter = priority->filter;
+    if (filter != NULL && filter->struct_size < sizeof(*filter))
+        return false; /* incorrect struct */
+
     dr_rwlock_write_lock(bb_cb_lock);
     idx = priority_event_add(list, priority);
     if (idx >= 0) {
         cb_entry_t *new_e = &list->cbs.bb[idx];
+        new_e->filter = filter;
+        if (filter != NULL)
+            filter_count++;
         if (app2app_ex_func != NULL) {
             new_e->has_quartet = true;
             new_e->cb.app2app_ex_cb = app2app_ex_func;
@@ -979,6 +1169,8 @@ drmgr_bb_cb_remove(cb_list_t *list,
                 quartet_count--;
             else if (xform_func == NULL)
                 pair_count--;
+            if (e->filter != NULL)
+                filter_count--;
             bb_event_count--;
             if (bb_event_count == 0)
                 dr_unregister_bb_event(drmgr_bb_event);
@@ -1389,6 +1581,8 @@ drmgr_modload_event(void *drcontext, const module_data_t *info,
     generic_event_entry_t local[EVENTS_STACK_SZ];
     cb_list_t iter;
     uint i;
+    if (bb_filters_skip_module(dr_module_preferred_name(info)))
+        dr_module_set_should_instrument(info->handle, false);
     dr_rwlock_read_lock(modload_event_lock);
     cblist_create_local(drcontext, &cblist_modload, &iter, (byte *)local,
                         BUFFER_SIZE_ELEMENTS(local));
@@ -2268,3 +2462,206 @@ drmgr_reserve_note_range(size_t size)
     dr_mutex_unlock(note_lock);
     return res;
 }
+
+/***************************************************************************
+ * PERSISTENCE
+ */
+
+/* Our persisted data is a header followed by one record per component.
+ * Each record is a persist_record_t, the NUL-terminated name, and the data,
+ * with the name and the data each padded to pointer alignment.  Padding is
+ * computed relative to the file offset, which DR maps at page alignment.
+ */
+#define PERSIST_MAGIC 0x5250444d /* "MDPR" */
+#define PERSIST_ALIGNMENT sizeof(void *)
+#define PERSIST_ALIGN(x) \
+    (((x) + PERSIST_ALIGNMENT - 1) & ~((ptr_uint_t)PERSIST_ALIGNMENT - 1))
+
+typedef struct _persist_header_t {
+    uint magic;
+    uint num_records;
+} persist_header_t;
+
+typedef struct _persist_record_t {
+    size_t name_size; /* includes the NUL */
+    size_t data_size;
+} persist_record_t;
+
+/* Padding needed to align the header, computed at size time. */
+static size_t persist_prepad;
+
+static bool
+persist_write_pad(file_t fd, size_t size)
+{
+    static const byte zeroes[PERSIST_ALIGNMENT];
+    ASSERT(size < PERSIST_ALIGNMENT, "pad too large");
+    return size == 0 || dr_write_file(fd, zeroes, size) == (ssize_t)size;
+}
+
+static bool
+persist_write_padded(file_t fd, const void *buf, size_t size)
+{
+    if (dr_write_file(fd, buf, size) != (ssize_t)size)
+        return false;
+    return persist_write_pad(fd, PERSIST_ALIGN(size) - size);
+}
+
+static size_t
+drmgr_persist_ro_size(void *drcontext, void *perscxt, size_t file_offs,
+                      void **user_data OUT)
+{
+    size_t sz, i;
+    dr_mutex_lock(persist_lock);
+    persist_prepad = PERSIST_ALIGN(file_offs) - file_offs;
+    sz = persist_prepad + PERSIST_ALIGN(sizeof(persist_header_t));
+    for (i = 0; i < MAX_NUM_PERSIST; i++) {
+        persist_entry_t *e = &persist_entries[i];
+        e->pending = e->valid;
+        if (!e->valid)
+            continue;
+        e->pending_user_data = NULL;
+        e->pending_size = (*e->size_cb)(drcontext, perscxt, &e->pending_user_data);
+        sz += sizeof(persist_record_t) + PERSIST_ALIGN(strlen(e->name) + 1) +
+            PERSIST_ALIGN(e->pending_size);
+    }
+    dr_mutex_unlock(persist_lock);
+    return sz;
+}
+
+static bool
+drmgr_persist_ro(void *drcontext, void *perscxt, file_t fd, void *user_data)
+{
+    persist_header_t header = {PERSIST_MAGIC, 0};
+    bool res = true;
+    size_t i;
+    dr_mutex_lock(persist_lock);
+    for (i = 0; i < MAX_NUM_PERSIST; i++) {
+        if (persist_entries[i].pending)
+            header.num_records++;
+    }
+    res = persist_write_pad(fd, persist_prepad) &&
+        persist_write_padded(fd, &header, sizeof(header));
+    for (i = 0; i < MAX_NUM_PERSIST && res; i++) {
+        persist_entry_t *e = &persist_entries[i];
+        persist_record_t record;
+        int64 start;
+        if (!e->pending)
+            continue;
+        e->pending = false;
+        record.name_size = strlen(e->name) + 1;
+        record.data_size = e->pending_size;
+        if (dr_write_file(fd, &record, sizeof(record)) != (ssize_t)sizeof(record) ||
+            !persist_write_padded(fd, e->name, record.name_size)) {
+            res = false;
+            break;
+        }
+        start = dr_file_tell(fd);
+        /* A size mismatch would corrupt every record after this one. */
+        if (!(*e->persist_cb)(drcontext, perscxt, fd, e->pending_user_data) ||
+            dr_file_tell(fd) - start != (int64)record.data_size ||
+            !persist_write_pad(fd, PERSIST_ALIGN(record.data_size) -
+                               record.data_size))
+            res = false;
+    }
+    for (i = 0; i < MAX_NUM_PERSIST; i++)
+        persist_entries[i].pending = false;
+    dr_mutex_unlock(persist_lock);
+    return res;
+}
+
+static bool
+drmgr_resurrect_ro(void *drcontext, void *perscxt, byte **map INOUT)
+{
+    byte *pc = (byte *) PERSIST_ALIGN((ptr_uint_t)*map);
+    persist_header_t *header = (persist_header_t *) pc;
+    bool res = true;
+    uint i;
+    size_t j;
+    if (header->magic != PERSIST_MAGIC)
+        return false;
+    pc += PERSIST_ALIGN(sizeof(*header));
+    dr_mutex_lock(persist_lock);
+    for (i = 0; i < header->num_records && res; i++) {
+        persist_record_t *record = (persist_record_t *) pc;
+        const char *name = (const char *) (pc + sizeof(*record));
+        byte *data = (byte *)name + PERSIST_ALIGN(record->name_size);
+        pc = data + PERSIST_ALIGN(record->data_size);
+        /* Records nobody has registered for are skipped. */
+        for (j = 0; j < MAX_NUM_PERSIST; j++) {
+            persist_entry_t *e = &persist_entries[j];
+            if (e->valid && strcmp(e->name, name) == 0) {
+                res = (*e->resurrect_cb)(drcontext, perscxt, data, record->data_size);
+                break;
+            }
+        }
+    }
+    dr_mutex_unlock(persist_lock);
+    *map = pc;
+    return res;
+}
+
+DR_EXPORT
+bool
+drmgr_register_persist_ro(const char *name,
+                          size_t (*func_size)(void *drcontext, void *perscxt,
+                                              void **user_data OUT),
+                          bool (*func_persist)(void *drcontext, void *perscxt,
+                                               file_t fd, void *user_data),
+                          bool (*func_resurrect)(void *drcontext, void *perscxt,
+                                                 byte *data, size_t size))
+{
+    persist_entry_t *free_slot = NULL;
+    bool res = true;
+    size_t i;
+    if (name == NULL || func_size == NULL || func_persist == NULL ||
+        func_resurrect == NULL)
+        return false;
+    dr_mutex_lock(persist_lock);
+    for (i = 0; i < MAX_NUM_PERSIST; i++) {
+        persist_entry_t *e = &persist_entries[i];
+        if (e->valid && strcmp(e->name, name) == 0) {
+            res = false;
+            break;
+        }
+        /* A pending slot is still owned by an in-progress persist. */
+        if (!e->valid && !e->pending && free_slot == NULL)
+            free_slot = e;
+    }
+    if (res && free_slot == NULL)
+        res = false;
+    if (res && !registered_persist) {
+        res = dr_register_persist_ro(drmgr_persist_ro_size, drmgr_persist_ro,
+                                     drmgr_resurrect_ro);
+        registered_persist = res;
+    }
+    if (res) {
+        free_slot->name = name;
+        free_slot->size_cb = func_size;
+        free_slot->persist_cb = func_persist;
+        free_slot->resurrect_cb = func_resurrect;
+        free_slot->valid = true;
+    }
+    dr_mutex_unlock(persist_lock);
+    return res;
+}
+
+DR_EXPORT
+bool
+drmgr_unregister_persist_ro(const char *name)
+{
+    bool res = false;
+    size_t i;
+    if (name == NULL)
+        return false;
+    dr_mutex_lock(persist_lock);
+    for (i = 0; i < MAX_NUM_PERSIST; i++) {
+        persist_entry_t *e = &persist_entries[i];
+        if (e->valid && strcmp(e->name, name) == 0) {
+            e->valid = false;
+            res = true;
+            break;
+        }
+    }
+    dr_mutex_unlock(persist_lock);
+    return res;
+}
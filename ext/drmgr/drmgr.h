@@ -152,6 +152,53 @@ typedef dr_emit_flags_t (*drmgr_insertion_cb_t)
     (void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
      bool for_trace, bool translating, void *user_data);
 
+/**
+ * Restricts the blocks whose building invokes a bb callback, specified
+ * through drmgr_priority_t.filter when the callback is registered.  A
+ * callback that is filtered out of a block is not called for it at all,
+ * which saves the time of deciding inside the callback for tools that only
+ * care about a few modules or threads.  Each callback of a quartet
+ * registered with drmgr_register_bb_instrumentation_ex_event() is filtered
+ * the same way, and the \p user_data they share is NULL for filtered-out
+ * blocks.
+ */
+typedef struct _drmgr_bb_filter_t {
+    /** The size of the drmgr_bb_filter_t struct */
+    size_t struct_size;
+    /**
+     * A NULL-terminated array of the names of the modules, as returned by
+     * dr_module_preferred_name(), whose blocks should be passed to the
+     * callback.  If NULL, blocks from every module and from code outside
+     * of any module are passed.  Module names are compared
+     * case-insensitively on Windows.
+     */
+    const char **include_modules;
+    /**
+     * A NULL-terminated array of the names of modules whose blocks should
+     * not be passed to the callback, applied after \p include_modules.
+     * This field is optional and can be NULL.
+     */
+    const char **exclude_modules;
+    /**
+     * Called while building each block in a module that passes the module
+     * sets, to decide whether to pass the block to the callback.  This field
+     * is optional and can be NULL.  Unless DynamoRIO's -thread_private
+     * option is set, blocks are shared by all threads, so the decision is
+     * made by whichever thread first executes a block.
+     */
+    bool (*thread_filter)(void *drcontext);
+    /**
+     * If true, and the filters of every registered bb callback exclude a
+     * module by name when it is loaded, drmgr calls
+     * dr_module_set_should_instrument() to keep all of its code from
+     * reaching the basic block event.  This saves building instrumented
+     * blocks but, as explained there, must not be used if any component
+     * registers a basic block event directly with DynamoRIO.  Callbacks
+     * registered after a module is loaded do not see its code.
+     */
+    bool skip_modules;
+} drmgr_bb_filter_t;
+
 /** Specifies the ordering of callbacks for \p drmgr's events */
 typedef struct _drmgr_priority_t {
     /** The size of the drmgr_priority_t struct */
@@ -180,6 +227,13 @@ typedef struct _drmgr_priority_t {
      * the requesting callback.  Numeric ties are invoked in unspecified order.
      */
     int priority;
+    /**
+     * For the bb events only, restricts which blocks the callback being
+     * registered is called for.  This field is optional and can be NULL.
+     * The filter and its strings must remain valid until the callback is
+     * unregistered.  It is ignored for other events.
+     */
+    const drmgr_bb_filter_t *filter;
 } drmgr_priority_t;
 
 /** Labels the current bb building phase */
@@ -737,6 +791,54 @@ DR_EXPORT
 ptr_uint_t
 drmgr_reserve_note_range(size_t size);
 
+/***************************************************************************
+ * PERSISTENCE
+ */
+
+DR_EXPORT
+/**
+ * Registers a named record of read-only data to be stored in each
+ * persisted code cache and handed back when that cache is loaded in a
+ * later run.  This is a multiplexing layer on top of
+ * dr_register_persist_ro() that lets multiple components each persist
+ * their own per-module metadata (e.g., via hashtable_persist())
+ * without depending on the registration order of the others.
+ *
+ * Each record is stored under \p name, which must remain valid until
+ * the record is unregistered.  At persist time drmgr calls \p func_size
+ * to obtain the number of bytes the record needs; any value stored in
+ * \p user_data is passed to \p func_persist, which must write exactly
+ * that many bytes to \p fd.  When a persisted cache is loaded,
+ * \p func_resurrect is called with a pointer to the record's data and
+ * its size.  Records in the file with no registered name are skipped,
+ * and a registered name with no record in the file is simply not
+ * called, letting the component recompute its data.  If \p
+ * func_resurrect returns false the persisted cache is not used.
+ * Record data is pointer-aligned.
+ *
+ * As with dr_register_persist_ro(), \p perscxt can be passed to
+ * dr_persist_start() and related routines.
+ * \return false if \p name is already registered or on other failure.
+ */
+bool
+drmgr_register_persist_ro(const char *name,
+                          size_t (*func_size)(void *drcontext, void *perscxt,
+                                              void **user_data OUT),
+                          bool (*func_persist)(void *drcontext, void *perscxt,
+                                               file_t fd, void *user_data),
+                          bool (*func_resurrect)(void *drcontext, void *perscxt,
+                                                 byte *data, size_t size));
+
+DR_EXPORT
+/**
+ * Unregisters the persisted record \p name previously registered with
+ * drmgr_register_persist_ro().
+ * \return true if unregistration is successful and false if it is not
+ * (e.g., \p name was not registered).
+ */
+bool
+drmgr_unregister_persist_ro(const char *name);
+
 /***************************************************************************
  * UTILITIES
  */
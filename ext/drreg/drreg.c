@@ -43,9 +43,11 @@
 #include "dr_api.h"
 #include "drmgr.h"
 #include "drvector.h"
+#include "hashtable.h"
 #include "drreg.h"
 #include <string.h>
 #include <limits.h>
+#include <stddef.h> /* offsetof */
 
 #ifdef DEBUG
 # define ASSERT(x, msg) DR_ASSERT_MSG(x, msg)
@@ -66,7 +68,9 @@
 
 #define AFLAGS_SLOT 0 /* always */
 
-/* We support using GPR registers only: [DR_REG_START_GPR..DR_REG_STOP_GPR] */
+/* We support GPR registers [DR_REG_START_GPR..DR_REG_STOP_GPR] and, on x86,
+ * the low 128 bits of the SIMD registers.
+ */
 
 #define REG_DEAD ((void*)(ptr_uint_t)0)
 #define REG_LIVE ((void*)(ptr_uint_t)1)
@@ -100,6 +104,17 @@ typedef struct _reg_info_t {
 
 #define GPR_IDX(reg) ((reg) - DR_REG_START_GPR)
 
+#ifdef X86
+# define NUM_SIMD_REGS IF_X64_ELSE(16, 8)
+# define SIMD_IDX(reg) \
+    (reg_is_ymm(reg) ? (reg) - DR_REG_START_YMM : (reg) - DR_REG_START_XMM)
+/* We only preserve the xmm portion of each register */
+# define SIMD_SLOT_SIZE 16
+# define MAX_SIMD_SPILLS 16
+/* The number of pointer-sized raw TLS slots holding the SIMD slots */
+# define SIMD_TLS_SLOTS() (ops.num_simd_spill_slots * SIMD_SLOT_SIZE / sizeof(reg_t))
+#endif
+
 typedef struct _per_thread_t {
     instr_t *cur_instr;
     int live_idx;
@@ -108,6 +123,11 @@ typedef struct _per_thread_t {
     uint app_uses_min, app_uses_max;
     reg_id_t slot_use[MAX_SPILLS]; /* holds the reg_id_t of which reg is inside */
     int pending_unreserved; /* count of to-be-lazily-restored unreserved regs */
+#ifdef X86
+    reg_info_t simd[NUM_SIMD_REGS];
+    reg_id_t simd_slot_use[MAX_SIMD_SPILLS];
+    int simd_pending_unreserved;
+#endif
     /* We store the linear address of our TLS for access from another thread: */
     byte *tls_seg_base;
 } per_thread_t;
@@ -117,11 +137,32 @@ static drreg_options_t ops;
 static int tls_idx = -1;
 static uint tls_slot_offs;
 static reg_id_t tls_seg;
+#ifdef X86
+/* The SIMD slots are stored directly in raw TLS, SIMD_SLOT_SIZE bytes each */
+static uint tls_simd_offs;
+#endif
+
+/* Liveness at the entry of each block, keyed by tag, so that a predecessor can
+ * treat registers that are dead at its exits as dead rather than live.
+ * Entries are removed when the fragment for the tag is deleted.
+ * Bit GPR_IDX(reg) of live_regs is set when reg is live.
+ */
+typedef struct _live_summary_t {
+    uint live_regs;
+    uint live_aflags;
+} live_summary_t;
+
+#define SUMMARY_TABLE_HASH_BITS 12
+static hashtable_t summary_table;
 
 #ifdef DEBUG
 static uint stats_max_slot;
 #endif
 
+static drreg_status_t
+drreg_restore_aflags(void *drcontext, per_thread_t *pt, instrlist_t *ilist,
+                     instr_t *where);
+
 /***************************************************************************
  * SPILLING AND RESTORING
  */
@@ -193,6 +234,54 @@ get_spilled_value(void *drcontext, uint slot)
     }
 }
 
+#ifdef X86
+static uint
+find_free_simd_slot(per_thread_t *pt)
+{
+    uint i;
+    for (i = 0; i < ops.num_simd_spill_slots; i++) {
+        if (pt->simd_slot_use[i] == DR_REG_NULL)
+            return i;
+    }
+    return MAX_SIMD_SPILLS;
+}
+
+static opnd_t
+simd_slot_opnd(uint slot)
+{
+    return opnd_create_far_base_disp(tls_seg, DR_REG_NULL, DR_REG_NULL, 0,
+                                     tls_simd_offs + slot*SIMD_SLOT_SIZE, OPSZ_16);
+}
+
+/* Up to caller to update pt->simd other than .ever_spilled.
+ * This routine updates pt->simd_slot_use.
+ * We use a legacy SSE store so the upper ymm bits are left untouched.
+ */
+static void
+spill_simd_reg(void *drcontext, per_thread_t *pt, reg_id_t reg, uint slot,
+               instrlist_t *ilist, instr_t *where)
+{
+    ASSERT(pt->simd_slot_use[slot] == DR_REG_NULL ||
+           pt->simd_slot_use[slot] == reg, "internal tracking error");
+    pt->simd_slot_use[slot] = reg;
+    pt->simd[SIMD_IDX(reg)].ever_spilled = true;
+    PRE(ilist, where, INSTR_CREATE_movdqu(drcontext, simd_slot_opnd(slot),
+                                          opnd_create_reg(reg)));
+}
+
+/* Up to caller to update pt->simd.  Updates pt->simd_slot_use if release==true. */
+static void
+restore_simd_reg(void *drcontext, per_thread_t *pt, reg_id_t reg, uint slot,
+                 instrlist_t *ilist, instr_t *where, bool release)
+{
+    ASSERT(pt->simd_slot_use[slot] == reg, "internal tracking error");
+    if (release)
+        pt->simd_slot_use[slot] = DR_REG_NULL;
+    PRE(ilist, where, INSTR_CREATE_movdqu(drcontext, opnd_create_reg(reg),
+                                          simd_slot_opnd(slot)));
+}
+#endif
+
 DR_EXPORT
 drreg_status_t
 drreg_max_slots_used(OUT uint *max)
@@ -228,7 +317,138 @@ count_app_uses(per_thread_t *pt, opnd_t opnd)
             if (opnd_is_memory_reference(opnd))
                 pt->reg[GPR_IDX(reg)].app_uses++;
         }
+#ifdef X86
+        else if (reg_is_xmm(reg) && SIMD_IDX(reg) < NUM_SIMD_REGS)
+            pt->simd[SIMD_IDX(reg)].app_uses++;
+#endif
+    }
+}
+
+#ifdef X86
+/* These read and write every SIMD register without listing them as operands */
+static bool
+instr_accesses_all_simd(instr_t *inst)
+{
+    switch (instr_get_opcode(inst)) {
+    case OP_fxsave32: case OP_fxrstor32: case OP_fxsave64: case OP_fxrstor64:
+    case OP_xsave32: case OP_xrstor32: case OP_xsaveopt32:
+    case OP_xsave64: case OP_xrstor64: case OP_xsaveopt64:
+    case OP_vzeroupper: case OP_vzeroall:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Returns whether inst overwrites all of the xmm portion of reg without reading
+ * it.  Most SSE instructions merge into their destination, so we only list
+ * the common full-width moves plus VEX forms, which zero the rest of the reg.
+ */
+static bool
+instr_kills_simd_reg(instr_t *inst, reg_id_t reg)
+{
+    if (!instr_writes_to_exact_reg(inst, reg, DR_QUERY_DEFAULT) &&
+        !instr_writes_to_exact_reg(inst, DR_REG_START_YMM + SIMD_IDX(reg),
+                                   DR_QUERY_DEFAULT))
+        return false;
+    if (instr_zeroes_ymmh(inst))
+        return true;
+    switch (instr_get_opcode(inst)) {
+    case OP_movdqa: case OP_movdqu: case OP_movaps: case OP_movups:
+    case OP_movapd: case OP_movupd: case OP_movd: case OP_movq:
+        return true;
+    default:
+        return false;
+    }
+}
+#endif
+
+static void
+summary_free(void *p)
+{
+    dr_global_free(p, sizeof(live_summary_t));
+}
+
+static bool
+summary_lookup(app_pc tag, OUT live_summary_t *summary)
+{
+    live_summary_t *entry;
+    if (tag == NULL)
+        return false;
+    hashtable_lock(&summary_table);
+    entry = (live_summary_t *) hashtable_lookup(&summary_table, (void *)tag);
+    if (entry != NULL)
+        *summary = *entry;
+    hashtable_unlock(&summary_table);
+    return entry != NULL;
+}
+
+static void
+summary_record(app_pc tag, live_summary_t *summary)
+{
+    live_summary_t *entry;
+    hashtable_lock(&summary_table);
+    entry = (live_summary_t *) hashtable_lookup(&summary_table, (void *)tag);
+    if (entry == NULL) {
+        entry = (live_summary_t *) dr_global_alloc(sizeof(*entry));
+        hashtable_add(&summary_table, (void *)tag, entry);
+    }
+    *entry = *summary;
+    hashtable_unlock(&summary_table);
+}
+
+static void
+drreg_event_fragment_deleted(void *drcontext, void *tag)
+{
+    hashtable_lock(&summary_table);
+    hashtable_remove(&summary_table, tag);
+    hashtable_unlock(&summary_table);
+}
+
+/* Computes the liveness just after inst where it leaves the block, or falls
+ * through to a later instr in the same list for a conditional branch, using the
+ * recorded summaries of the successor tags.  Returns false if any successor is
+ * unknown, in which case everything must be assumed live.
+ */
+static bool
+exit_liveness(void *drcontext, per_thread_t *pt, instr_t *inst, uint index, bool xfer,
+              OUT live_summary_t *exit_live)
+{
+    live_summary_t target;
+    app_pc fall_pc = NULL;
+    reg_id_t reg;
+    if (ops.conservative || !instr_is_app(inst))
+        return false;
+    if (xfer) {
+        if (!instr_is_ubr(inst) && !instr_is_cbr(inst) && !instr_is_call_direct(inst))
+            return false;
+        if (!opnd_is_pc(instr_get_target(inst)) ||
+            !summary_lookup(opnd_get_pc(instr_get_target(inst)), exit_live))
+            return false;
+        if (!instr_is_cbr(inst))
+            return true;
+    } else {
+        ASSERT(index == 0, "only the last instr can fall through");
+        exit_live->live_regs = 0;
+        exit_live->live_aflags = 0;
+    }
+    if (index > 0) {
+        /* The fall-through is the next instr in this list. */
+        for (reg = DR_REG_START_GPR; reg <= DR_REG_STOP_GPR; reg++) {
+            if (drvector_get_entry(&pt->reg[GPR_IDX(reg)].live, index-1) == REG_LIVE)
+                exit_live->live_regs |= 1 << GPR_IDX(reg);
+        }
+        exit_live->live_aflags |= (uint)(ptr_uint_t)
+            drvector_get_entry(&pt->aflags.live, index-1);
+        return true;
     }
+    if (instr_get_app_pc(inst) != NULL)
+        fall_pc = decode_next_pc(drcontext, instr_get_app_pc(inst));
+    if (!summary_lookup(fall_pc, &target))
+        return false;
+    exit_live->live_regs |= target.live_regs;
+    exit_live->live_aflags |= target.live_aflags;
+    return true;
 }
 
 /* This even has to go last, to handle labels inserted by other components:
@@ -245,9 +465,15 @@ drreg_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
     ptr_uint_t aflags_new, aflags_cur = 0;
     uint index = 0;
     reg_id_t reg;
+    live_summary_t exit_live, entry_live;
+    bool used_summary = false;
 
     for (reg = DR_REG_START_GPR; reg <= DR_REG_STOP_GPR; reg++)
         pt->reg[GPR_IDX(reg)].app_uses = 0;
+#ifdef X86
+    for (reg = DR_REG_START_XMM; reg < DR_REG_START_XMM + NUM_SIMD_REGS; reg++)
+        pt->simd[SIMD_IDX(reg)].app_uses = 0;
+#endif
 
     /* Reverse scan is more efficient.  This means our indices are also reversed. */
     for (inst = instrlist_last(bb); inst != NULL; inst = instr_get_prev(inst)) {
@@ -257,11 +483,17 @@ drreg_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
 
         bool xfer = (instr_is_cti(inst) || instr_is_interrupt(inst) ||
                      instr_is_syscall(inst));
+        /* Liveness beyond the block's exits comes from the successors' summaries */
+        bool exit_known = ((xfer || index == 0) &&
+                           exit_liveness(drcontext, pt, inst, index, xfer, &exit_live));
+        if (exit_known)
+            used_summary = true;
 
         /* GPR liveness */
         for (reg = DR_REG_START_GPR; reg <= DR_REG_STOP_GPR; reg++) {
             void *value = REG_LIVE;
-            if (xfer || instr_reads_from_reg(inst, reg, DR_QUERY_INCLUDE_COND_SRCS))
+            if ((xfer && !exit_known) ||
+                instr_reads_from_reg(inst, reg, DR_QUERY_INCLUDE_COND_SRCS))
                 value = REG_LIVE;
             /* make sure we don't consider writes to sub-regs */
             else if (instr_writes_to_exact_reg(inst, reg, DR_QUERY_INCLUDE_COND_SRCS)
@@ -269,18 +501,22 @@ drreg_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
                      IF_X86_X64(|| instr_writes_to_exact_reg(inst, reg_64_to_32(reg),
                                                              DR_QUERY_INCLUDE_COND_SRCS)))
                 value = REG_DEAD;
-            else if (index > 0)
+            else if (exit_known) {
+                value = TEST(1 << GPR_IDX(reg), exit_live.live_regs) ? REG_LIVE : REG_DEAD;
+            } else if (index > 0)
                 value = drvector_get_entry(&pt->reg[GPR_IDX(reg)].live, index-1);
             drvector_set_entry(&pt->reg[GPR_IDX(reg)].live, index, value);
         }
 
         /* aflags liveness */
         aflags_new = instr_get_arith_flags(inst, DR_QUERY_INCLUDE_COND_SRCS);
-        if (xfer)
+        if (xfer && !exit_known)
             aflags_cur = EFLAGS_READ_ARITH; /* assume flags are read before written */
         else {
             uint aflags_read, aflags_w2r;
-            if (index == 0)
+            if (exit_known)
+                aflags_cur = exit_live.live_aflags;
+            else if (index == 0)
                 aflags_cur = EFLAGS_READ_ARITH; /* assume flags are read before written */
             else {
                 aflags_cur = (uint)(ptr_uint_t)
@@ -295,6 +531,24 @@ drreg_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
         }
         drvector_set_entry(&pt->aflags.live, index, (void *)(ptr_uint_t)aflags_cur);
 
+#ifdef X86
+        /* SIMD liveness: we have no summaries for these so exits are all live */
+        if (ops.num_simd_spill_slots > 0) {
+            for (reg = DR_REG_START_XMM; reg < DR_REG_START_XMM + NUM_SIMD_REGS;
+                 reg++) {
+                void *value = REG_LIVE;
+                if (xfer || instr_accesses_all_simd(inst) ||
+                    instr_reads_from_reg(inst, reg, DR_QUERY_INCLUDE_COND_SRCS))
+                    value = REG_LIVE;
+                else if (instr_kills_simd_reg(inst, reg))
+                    value = REG_DEAD;
+                else if (index > 0)
+                    value = drvector_get_entry(&pt->simd[SIMD_IDX(reg)].live, index-1);
+                drvector_set_entry(&pt->simd[SIMD_IDX(reg)].live, index, value);
+            }
+        }
+#endif
+
         if (instr_is_app(inst)) {
             int i;
             for (i = 0; i < instr_num_dsts(inst); i++)
@@ -308,6 +562,21 @@ drreg_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
 
     pt->live_idx = index;
 
+    /* Publish our entry liveness for our predecessors.  A re-creation for
+     * translation must not change the table, as that would not match what the
+     * original build saw.
+     */
+    if (!ops.conservative && !translating && index > 0) {
+        entry_live.live_regs = 0;
+        for (reg = DR_REG_START_GPR; reg <= DR_REG_STOP_GPR; reg++) {
+            if (drvector_get_entry(&pt->reg[GPR_IDX(reg)].live, index-1) == REG_LIVE)
+                entry_live.live_regs |= 1 << GPR_IDX(reg);
+        }
+        entry_live.live_aflags = (uint)(ptr_uint_t)
+            drvector_get_entry(&pt->aflags.live, index-1);
+        summary_record((app_pc)tag, &entry_live);
+    }
+
     pt->app_uses_min = UINT_MAX;
     pt->app_uses_max = 0;
     for (reg = DR_REG_START_GPR; reg <= DR_REG_STOP_GPR; reg++) {
@@ -317,7 +586,10 @@ drreg_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
             pt->app_uses_min = pt->reg[GPR_IDX(reg)].app_uses;
     }
 
-    return DR_EMIT_DEFAULT;
+    /* The summaries can change before a later re-creation of this block, so
+     * we cannot rely on reproducing the same instrumentation for translation.
+     */
+    return used_summary ? DR_EMIT_STORE_TRANSLATIONS : DR_EMIT_DEFAULT;
 }
 
 static dr_emit_flags_t
@@ -338,18 +610,82 @@ drreg_event_bb_insert_late(void *drcontext, void *tag, instrlist_t *bb, instr_t
     reg_id_t reg;
     instr_t *next = instr_get_next(inst);
     bool restored_for_read[DR_NUM_GPR_REGS];
+    /* Lazily-restored state must be made native before any exit */
+    bool leaving = (drmgr_is_last_instr(drcontext, inst) || instr_is_cti(inst) ||
+                    instr_is_syscall(inst) || instr_is_interrupt(inst));
 
     /* For unreserved regs still spilled, we lazily do the restore here.  We also
      * update reserved regs wrt app uses.
      */
 
-    /* XXX i#511: we should also lazily restore aflags instead of on each unreserve. */
+#ifdef X86
+    /* SIMD registers are handled just like the GPRs below, except that we never
+     * choose one the app uses in this block for a reservation, so only the
+     * block's exits and instrs accessing every SIMD register matter for a
+     * reserved one.
+     */
+    for (reg = DR_REG_START_XMM; reg < DR_REG_START_XMM + NUM_SIMD_REGS; reg++) {
+        reg_info_t *info = &pt->simd[SIMD_IDX(reg)];
+        bool writes = (instr_accesses_all_simd(inst) ||
+                       instr_writes_to_reg(inst, reg, DR_QUERY_INCLUDE_ALL));
+        bool accessed = (writes ||
+                         instr_reads_from_reg(inst, reg, DR_QUERY_INCLUDE_ALL));
+        if (info->native || !(leaving || accessed))
+            continue;
+        if (!info->in_use) {
+            if (info->ever_spilled) {
+                LOG(drcontext, LOG_ALL, 3, "%s @"PFX": lazily restoring %s\n",
+                    __FUNCTION__, instr_get_app_pc(inst), get_register_name(reg));
+                restore_simd_reg(drcontext, pt, reg, info->slot, bb, inst, true);
+            } else
+                pt->simd_slot_use[info->slot] = DR_REG_NULL;
+            info->native = true;
+            ASSERT(pt->simd_pending_unreserved > 0, "should not go negative");
+            pt->simd_pending_unreserved--;
+        } else if (!drmgr_is_last_instr(drcontext, inst)) {
+            /* Same approach as for GPRs: move the tool value to a temp slot
+             * around the app instr.
+             */
+            uint tmp_slot = find_free_simd_slot(pt);
+            if (tmp_slot == MAX_SIMD_SPILLS) {
+                ASSERT(false, "NYI"); /* XXX: need better way to fail */
+                continue;
+            }
+            spill_simd_reg(drcontext, pt, reg, tmp_slot, bb, inst);
+            if (info->ever_spilled)
+                restore_simd_reg(drcontext, pt, reg, info->slot, bb, inst, false);
+            if (writes &&
+                (ops.conservative || pt->live_idx == 0 ||
+                 drvector_get_entry(&info->live, pt->live_idx-1) == REG_LIVE))
+                spill_simd_reg(drcontext, pt, reg, info->slot, bb, next);
+            restore_simd_reg(drcontext, pt, reg, tmp_slot, bb, next, true);
+        }
+    }
+#endif
+
+    /* Unreserved aflags are restored before the app touches them or leaves the
+     * block.  We do this before the GPRs as the restore may need a scratch reg.
+     */
+    if (!pt->aflags.native && !pt->aflags.in_use &&
+        (leaving ||
+         TESTANY(EFLAGS_READ_ARITH|EFLAGS_WRITE_ARITH,
+                 instr_get_arith_flags(inst, DR_QUERY_INCLUDE_ALL)))) {
+        LOG(drcontext, LOG_ALL, 3, "%s @"PFX": lazily restoring aflags\n",
+            __FUNCTION__, instr_get_app_pc(inst));
+        if (drreg_restore_aflags(drcontext, pt, bb, inst) != DRREG_SUCCESS)
+            ASSERT(false, "failed to restore aflags"); /* XXX: need better way to fail */
+    }
 
     /* Before each app read, or at end of bb, restore spilled registers to app values: */
     for (reg = DR_REG_START_GPR; reg <= DR_REG_STOP_GPR; reg++) {
         restored_for_read[GPR_IDX(reg)] = false;
         if (!pt->reg[GPR_IDX(reg)].native) {
-            if (drmgr_is_last_instr(drcontext, inst) ||
+            if (leaving ||
+                /* An unreserved reg is restored before any app write, too, as
+                 * its stale app value would otherwise be restored later.
+                 */
+                (!pt->reg[GPR_IDX(reg)].in_use &&
+                 instr_writes_to_reg(inst, reg, DR_QUERY_INCLUDE_ALL)) ||
                 instr_reads_from_reg(inst, reg, DR_QUERY_INCLUDE_ALL) ||
                 /* Treat a partial write as a read, to restore rest of reg */
                 (instr_writes_to_reg(inst, reg, DR_QUERY_INCLUDE_ALL) &&
@@ -598,6 +934,101 @@ drreg_unreserve_register(void *drcontext, instrlist_t *ilist, instr_t *where,
     return DRREG_SUCCESS;
 }
 
+/***************************************************************************
+ * SIMD REGISTERS
+ */
+
+DR_EXPORT
+drreg_status_t
+drreg_reserve_simd_register(void *drcontext, instrlist_t *ilist, instr_t *where,
+                            drvector_t *reg_allowed, OUT reg_id_t *reg_out)
+{
+#ifdef X86
+    per_thread_t *pt = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    uint slot = MAX_SIMD_SPILLS;
+    reg_id_t reg, best_reg = DR_REG_NULL;
+    reg_info_t *info;
+    ASSERT(drmgr_current_bb_phase(drcontext) == DRMGR_PHASE_INSERTION,
+           "must be called from drmgr insertion phase");
+    if (reg_out == NULL)
+        return DRREG_ERROR_INVALID_PARAMETER;
+    if (ops.num_simd_spill_slots == 0)
+        return DRREG_ERROR_OUT_OF_SLOTS;
+
+    /* We pick from the highest-numbered registers, which compilers use least.
+     * Registers the app uses in this block are excluded so that a reservation
+     * never has to be shuffled around an app access.
+     */
+    for (reg = DR_REG_START_XMM + NUM_SIMD_REGS - 1; reg >= DR_REG_START_XMM; reg--) {
+        uint idx = SIMD_IDX(reg);
+        if (pt->simd[idx].in_use || pt->simd[idx].app_uses > 0)
+            continue;
+        if (reg_allowed != NULL && drvector_get_entry(reg_allowed, idx) == NULL)
+            continue;
+        if (!pt->simd[idx].native) {
+            /* Previously unreserved but not yet lazily restored */
+            best_reg = reg;
+            break;
+        }
+        if (best_reg == DR_REG_NULL ||
+            drvector_get_entry(&pt->simd[idx].live, pt->live_idx) == REG_DEAD)
+            best_reg = reg;
+    }
+    if (best_reg == DR_REG_NULL)
+        return DRREG_ERROR_REG_CONFLICT;
+    reg = best_reg;
+    info = &pt->simd[SIMD_IDX(reg)];
+
+    if (!info->native) {
+        LOG(drcontext, LOG_ALL, 3, "%s @"PFX": using un-restored %s\n",
+            __FUNCTION__, instr_get_app_pc(where), get_register_name(reg));
+        pt->simd_pending_unreserved--;
+    } else {
+        slot = find_free_simd_slot(pt);
+        if (slot == MAX_SIMD_SPILLS)
+            return DRREG_ERROR_OUT_OF_SLOTS;
+        /* Even if dead now, we need to own a slot in case reserved past dead point */
+        if (ops.conservative ||
+            drvector_get_entry(&info->live, pt->live_idx) == REG_LIVE) {
+            LOG(drcontext, LOG_ALL, 3, "%s @"PFX": spilling %s\n",
+                __FUNCTION__, instr_get_app_pc(where), get_register_name(reg));
+            spill_simd_reg(drcontext, pt, reg, slot, ilist, where);
+        } else {
+            pt->simd_slot_use[slot] = reg;
+            info->ever_spilled = false;
+        }
+        info->slot = slot;
+        info->native = false;
+        info->xchg = DR_REG_NULL;
+    }
+    info->in_use = true;
+    *reg_out = reg;
+    return DRREG_SUCCESS;
+#else
+    /* XXX i#511: NYI for ARM */
+    return DRREG_ERROR_FEATURE_NOT_AVAILABLE;
+#endif
+}
+
+DR_EXPORT
+drreg_status_t
+drreg_unreserve_simd_register(void *drcontext, instrlist_t *ilist, instr_t *where,
+                              reg_id_t reg)
+{
+#ifdef X86
+    per_thread_t *pt = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    if (!reg_is_xmm(reg) || SIMD_IDX(reg) >= NUM_SIMD_REGS ||
+        !pt->simd[SIMD_IDX(reg)].in_use)
+        return DRREG_ERROR_INVALID_PARAMETER;
+    /* We lazily restore in drreg_event_bb_insert_late() */
+    pt->simd[SIMD_IDX(reg)].in_use = false;
+    pt->simd_pending_unreserved++;
+    return DRREG_SUCCESS;
+#else
+    return DRREG_ERROR_FEATURE_NOT_AVAILABLE;
+#endif
+}
+
 /***************************************************************************
  * ARITHMETIC FLAGS
  */
@@ -619,6 +1050,13 @@ drreg_reserve_aflags(void *drcontext, instrlist_t *ilist, instr_t *where)
     /* Just like scratch regs, flags are exclusively owned */
     if (pt->aflags.in_use)
         return DRREG_ERROR_IN_USE;
+    if (!pt->aflags.native) {
+        /* Unreserved but not yet lazily restored: the app value is still saved */
+        LOG(drcontext, LOG_ALL, 3, "%s @"PFX": using un-restored aflags\n",
+            __FUNCTION__, instr_get_app_pc(where));
+        pt->aflags.in_use = true;
+        return DRREG_SUCCESS;
+    }
     if (!TESTANY(EFLAGS_READ_ARITH, aflags)) {
         pt->aflags.in_use = true;
         pt->aflags.native = true;
@@ -670,39 +1108,34 @@ drreg_reserve_aflags(void *drcontext, instrlist_t *ilist, instr_t *where)
     return DRREG_SUCCESS;
 }
 
-DR_EXPORT
-drreg_status_t
-drreg_unreserve_aflags(void *drcontext, instrlist_t *ilist, instr_t *where)
+/* Restores the app's aflags from AFLAGS_SLOT if they are live at where.  Called
+ * lazily from drreg_event_bb_insert_late() once the aflags are unreserved.
+ */
+static drreg_status_t
+drreg_restore_aflags(void *drcontext, per_thread_t *pt, instrlist_t *ilist,
+                     instr_t *where)
 {
-    /* XXX i#1551:: restore lazily: wait in case someone else wants a local scratch.
-     * wait for next app instr or even until next app read/write (in
-     * drreg_event_bb_insert_late()).
-     */
-    per_thread_t *pt = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
     uint aflags = (uint)(ptr_uint_t) drvector_get_entry(&pt->aflags.live, pt->live_idx);
 #ifdef X86
-    uint temp_slot = find_free_slot(pt);
+    uint temp_slot;
+    bool preserve_xax;
 #elif defined(ARM)
     drreg_status_t res = DRREG_SUCCESS;
     reg_id_t scratch;
 #endif
-    ASSERT(drmgr_current_bb_phase(drcontext) == DRMGR_PHASE_INSERTION,
-           "must be called from drmgr insertion phase");
-    pt->aflags.in_use = false;
+    ASSERT(!pt->aflags.in_use && !pt->aflags.native, "aflags not pending restore");
+    pt->aflags.native = true;
     if (!TESTANY(EFLAGS_READ_ARITH, aflags))
         return DRREG_SUCCESS;
 #ifdef X86
-    if (pt->reg[DR_REG_XAX-DR_REG_START_GPR].in_use) {
-        /* XXX i#511: pick an unreserved reg, spill it, and put xax there
-         * temporarily.
-         */
-        return DRREG_ERROR_REG_CONFLICT;
-    }
+    temp_slot = find_free_slot(pt);
     if (temp_slot == MAX_SPILLS)
         return DRREG_ERROR_OUT_OF_SLOTS;
-    if (ops.conservative ||
-        drvector_get_entry(&pt->reg[DR_REG_XAX-DR_REG_START_GPR].live, pt->live_idx) ==
-        REG_LIVE)
+    /* xax may hold a tool value or a not-yet-restored scratch value here */
+    preserve_xax = (ops.conservative || !pt->reg[DR_REG_XAX-DR_REG_START_GPR].native ||
+                    drvector_get_entry(&pt->reg[DR_REG_XAX-DR_REG_START_GPR].live,
+                                       pt->live_idx) == REG_LIVE);
+    if (preserve_xax)
         spill_reg(drcontext, pt, DR_REG_XAX, temp_slot, ilist, where);
     restore_reg(drcontext, pt, DR_REG_XAX, AFLAGS_SLOT, ilist, where, true);
     if (TEST(EFLAGS_READ_OF, aflags)) {
@@ -710,9 +1143,7 @@ drreg_unreserve_aflags(void *drcontext, instrlist_t *ilist, instr_t *where)
             (drcontext, opnd_create_reg(DR_REG_AL), OPND_CREATE_INT8(0x7f)));
     }
     PRE(ilist, where, INSTR_CREATE_sahf(drcontext));
-    if (ops.conservative ||
-        drvector_get_entry(&pt->reg[DR_REG_XAX-DR_REG_START_GPR].live, pt->live_idx) ==
-        REG_LIVE)
+    if (preserve_xax)
         restore_reg(drcontext, pt, DR_REG_XAX, temp_slot, ilist, where, true);
 #elif defined(ARM)
     res = drreg_reserve_register(drcontext, ilist, where, NULL, &scratch);
@@ -727,6 +1158,23 @@ drreg_unreserve_aflags(void *drcontext, instrlist_t *ilist, instr_t *where)
     return DRREG_SUCCESS;
 }
 
+DR_EXPORT
+drreg_status_t
+drreg_unreserve_aflags(void *drcontext, instrlist_t *ilist, instr_t *where)
+{
+    per_thread_t *pt = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    ASSERT(drmgr_current_bb_phase(drcontext) == DRMGR_PHASE_INSERTION,
+           "must be called from drmgr insertion phase");
+    if (!pt->aflags.in_use)
+        return DRREG_ERROR_INVALID_PARAMETER;
+    /* We lazily restore in drreg_event_bb_insert_late(), once the app reads or
+     * writes the flags or leaves the block, so that a subsequent reservation
+     * can reuse the saved value without another save.
+     */
+    pt->aflags.in_use = false;
+    return DRREG_SUCCESS;
+}
+
 DR_EXPORT
 drreg_status_t
 drreg_aflags_liveness(void *drcontext, OUT uint *value)
@@ -758,6 +1206,38 @@ drreg_are_aflags_dead(void *drcontext, instr_t *inst, bool *dead)
  * RESTORE STATE
  */
 
+#ifdef X86
+/* Recognizes our SIMD spills and restores, which are the only accesses to our
+ * raw TLS SIMD slots.  Returns the offset into the SIMD slots in \p offs.
+ */
+static bool
+find_simd_spill_or_restore(instr_t *inst, OUT bool *spill, OUT reg_id_t *reg,
+                           OUT uint *offs)
+{
+    opnd_t mem, other;
+    if (ops.num_simd_spill_slots == 0 || instr_get_opcode(inst) != OP_movdqu)
+        return false;
+    mem = instr_get_dst(inst, 0);
+    other = instr_get_src(inst, 0);
+    *spill = opnd_is_far_base_disp(mem);
+    if (!*spill) {
+        mem = instr_get_src(inst, 0);
+        other = instr_get_dst(inst, 0);
+    }
+    if (!opnd_is_far_base_disp(mem) || opnd_get_segment(mem) != tls_seg ||
+        opnd_get_base(mem) != DR_REG_NULL || opnd_get_index(mem) != DR_REG_NULL ||
+        !opnd_is_reg(other) || !reg_is_xmm(opnd_get_reg(other)))
+        return false;
+    if ((uint)opnd_get_disp(mem) < tls_simd_offs ||
+        (uint)opnd_get_disp(mem) >= tls_simd_offs +
+        ops.num_simd_spill_slots*SIMD_SLOT_SIZE)
+        return false;
+    *reg = opnd_get_reg(other);
+    *offs = opnd_get_disp(mem) - tls_simd_offs;
+    return true;
+}
+#endif
+
 static bool
 drreg_event_restore_state(void *drcontext, bool restore_memory,
                           dr_restore_state_info_t *info)
@@ -771,6 +1251,9 @@ drreg_event_restore_state(void *drcontext, bool restore_memory,
      * a spill of an already-spilled reg to a different slot.
      */
     uint spilled_to[DR_NUM_GPR_REGS];
+#ifdef X86
+    uint simd_spilled_to[NUM_SIMD_REGS];
+#endif
     reg_id_t reg;
     instr_t inst;
     byte *prev_pc, *pc = info->fragment_info.cache_start_pc;
@@ -780,6 +1263,10 @@ drreg_event_restore_state(void *drcontext, bool restore_memory,
         return true; /* fault not in cache */
     for (reg = DR_REG_START_GPR; reg <= DR_REG_STOP_GPR; reg++)
         spilled_to[GPR_IDX(reg)] = MAX_SPILLS;
+#ifdef X86
+    for (reg = DR_REG_START_XMM; reg < DR_REG_START_XMM + NUM_SIMD_REGS; reg++)
+        simd_spilled_to[SIMD_IDX(reg)] = MAX_SIMD_SPILLS;
+#endif
     LOG(drcontext, LOG_ALL, 3, "%s: processing fault @"PFX": decoding from "PFX"\n",
         __FUNCTION__, info->raw_mcontext->pc, pc);
     instr_init(drcontext, &inst);
@@ -788,6 +1275,22 @@ drreg_event_restore_state(void *drcontext, bool restore_memory,
         prev_pc = pc;
         pc = decode(drcontext, pc, &inst);
 
+#ifdef X86
+        if (find_simd_spill_or_restore(&inst, &spill, &reg, &offs)) {
+            uint slot = offs / SIMD_SLOT_SIZE;
+            LOG(drcontext, LOG_ALL, 3, "%s @"PFX" found %s to %s => simd slot %d\n",
+                __FUNCTION__, prev_pc, spill ? "spill" : "restore",
+                get_register_name(reg), slot);
+            /* Same tool-value heuristics as for GPRs below */
+            if (spill) {
+                if (simd_spilled_to[SIMD_IDX(reg)] == MAX_SIMD_SPILLS ||
+                    simd_spilled_to[SIMD_IDX(reg)] == slot)
+                    simd_spilled_to[SIMD_IDX(reg)] = slot;
+            } else if (simd_spilled_to[SIMD_IDX(reg)] == slot)
+                simd_spilled_to[SIMD_IDX(reg)] = MAX_SIMD_SPILLS;
+            continue;
+        }
+#endif
         /* XXX i#511: if we add xchg to our arsenal we'll have to detect it here */
         if (instr_is_reg_spill_or_restore(drcontext, &inst, &tls, &spill, &reg, &offs)) {
             uint slot;
@@ -843,6 +1346,19 @@ drreg_event_restore_state(void *drcontext, bool restore_memory,
             reg_set_value(reg, info->mcontext, val);
         }
     }
+#ifdef X86
+    for (reg = DR_REG_START_XMM; reg < DR_REG_START_XMM + NUM_SIMD_REGS; reg++) {
+        uint slot = simd_spilled_to[SIMD_IDX(reg)];
+        if (slot < MAX_SIMD_SPILLS && TEST(DR_MC_MULTIMEDIA, info->mcontext->flags)) {
+            per_thread_t *pt = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+            LOG(drcontext, LOG_ALL, 3, "%s: restoring %s from simd slot %d\n",
+                __FUNCTION__, get_register_name(reg), slot);
+            memcpy(&info->mcontext->ymm[SIMD_IDX(reg)],
+                   pt->tls_seg_base + tls_simd_offs + slot*SIMD_SLOT_SIZE,
+                   SIMD_SLOT_SIZE);
+        }
+    }
+#endif
 
     return true;
 }
@@ -867,6 +1383,13 @@ drreg_thread_init(void *drcontext)
         pt->reg[GPR_IDX(reg)].native = true;
     }
     drvector_init(&pt->aflags.live, 20, false/*!synch*/, NULL);
+    pt->aflags.native = true;
+#ifdef X86
+    for (reg = DR_REG_START_XMM; reg < DR_REG_START_XMM + NUM_SIMD_REGS; reg++) {
+        drvector_init(&pt->simd[SIMD_IDX(reg)].live, 20, false/*!synch*/, NULL);
+        pt->simd[SIMD_IDX(reg)].native = true;
+    }
+#endif
     pt->tls_seg_base = dr_get_dr_segment_base(tls_seg);
 }
 
@@ -879,6 +1402,10 @@ drreg_thread_exit(void *drcontext)
         drvector_delete(&pt->reg[GPR_IDX(reg)].live);
     }
     drvector_delete(&pt->aflags.live);
+#ifdef X86
+    for (reg = DR_REG_START_XMM; reg < DR_REG_START_XMM + NUM_SIMD_REGS; reg++)
+        drvector_delete(&pt->simd[SIMD_IDX(reg)].live);
+#endif
     dr_thread_free(drcontext, pt, sizeof(*pt));
 }
 
@@ -910,9 +1437,19 @@ drreg_init(drreg_options_t *ops_in)
     if (count > 1)
         return DRREG_SUCCESS;
 
-    if (ops_in->struct_size < sizeof(ops))
+    /* Older clients do not have the SIMD fields */
+    if (ops_in->struct_size < offsetof(drreg_options_t, num_simd_spill_slots))
         return DRREG_ERROR_INVALID_PARAMETER;
-    ops = *ops_in;
+    memset(&ops, 0, sizeof(ops));
+    memcpy(&ops, ops_in, ops_in->struct_size < sizeof(ops) ?
+           ops_in->struct_size : sizeof(ops));
+#ifdef X86
+    if (ops.num_simd_spill_slots > MAX_SIMD_SPILLS)
+        return DRREG_ERROR_INVALID_PARAMETER;
+#else
+    /* XXX i#511: SIMD reservations are NYI for ARM */
+    ops.num_simd_spill_slots = 0;
+#endif
 
     drmgr_init();
 
@@ -933,6 +1470,19 @@ drreg_init(drreg_options_t *ops_in)
 
     if (!dr_raw_tls_calloc(&tls_seg, &tls_slot_offs, ops.num_spill_slots, 0))
         return DRREG_ERROR;
+#ifdef X86
+    if (ops.num_simd_spill_slots > 0) {
+        reg_id_t simd_seg;
+        if (!dr_raw_tls_calloc(&simd_seg, &tls_simd_offs, SIMD_TLS_SLOTS(), 0))
+            return DRREG_ERROR_OUT_OF_SLOTS;
+        ASSERT(simd_seg == tls_seg, "raw TLS segment mismatch");
+    }
+#endif
+
+    hashtable_init_ex(&summary_table, SUMMARY_TABLE_HASH_BITS, HASH_INTPTR,
+                      false/*!str_dup*/, false/*!synch: we lock explicitly*/,
+                      summary_free, NULL, NULL);
+    dr_register_delete_event(drreg_event_fragment_deleted);
 
     return DRREG_SUCCESS;
 }
@@ -955,10 +1505,19 @@ drreg_exit(void)
         !drmgr_unregister_restore_state_ex_event(drreg_event_restore_state))
         return DRREG_ERROR;
 
+    if (!dr_unregister_delete_event(drreg_event_fragment_deleted))
+        return DRREG_ERROR;
+    hashtable_delete(&summary_table);
+
     drmgr_exit();
 
     if (!dr_raw_tls_cfree(tls_slot_offs, ops.num_spill_slots))
         return DRREG_ERROR;
+#ifdef X86
+    if (ops.num_simd_spill_slots > 0 &&
+        !dr_raw_tls_cfree(tls_simd_offs, SIMD_TLS_SLOTS()))
+        return DRREG_ERROR;
+#endif
 
     return DRREG_SUCCESS;
 }
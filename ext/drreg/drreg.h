@@ -129,9 +129,23 @@ typedef struct _drreg_options_t {
      * By default, drreg assumes that the application will not rely
      * on the particular value of a dead register when a fault happens.
      * This allows drreg to reduce overhead.  This flag can be set to
-     * request that drreg not make this assumption.
+     * request that drreg not make this assumption.  It also disables the
+     * use of liveness information from successor blocks, which otherwise
+     * lets drreg treat registers that are dead at a block's exits as dead
+     * rather than assuming they are live.
      */
     bool conservative;
+    /**
+     * The number of SIMD spill slots to use for
+     * drreg_reserve_simd_register().  Each slot holds the low 128 bits
+     * of one register and occupies 16 bytes of raw TLS requested from DR
+     * via dr_raw_tls_calloc(), so this should be kept small.  As with
+     * \p num_spill_slots, an additional slot is needed for each SIMD
+     * register reserved across an application instruction that leaves
+     * the block.  At most 16 slots are supported.  SIMD reservations are
+     * currently only supported on x86.
+     */
+    uint num_simd_spill_slots;
 } drreg_options_t;
 
 DR_EXPORT
@@ -191,8 +205,10 @@ drreg_reserve_aflags(void *drcontext, instrlist_t *ilist, instr_t *where);
 DR_EXPORT
 /**
  * Must be called during drmgr's insertion phase.  Terminates
- * exclusive use of the arithmetic flags register.  Restores the
- * application value at \p where in \p ilist, if necessary.
+ * exclusive use of the arithmetic flags register.  The application
+ * value is restored lazily, if necessary, once the application reads or
+ * writes the flags or the block ends, so that a subsequent reservation
+ * can reuse the saved value.
  *
  * @return whether successful or an error code on failure.
  */
@@ -261,8 +277,10 @@ drreg_get_app_value(void *drcontext, instrlist_t *ilist, instr_t *where,
 DR_EXPORT
 /**
  * Must be called during drmgr's insertion phase.  Terminates
- * exclusive use of the register \p reg.  Restores the application
- * value at \p where in \p ilist, if necessary.
+ * exclusive use of the register \p reg.  The application value is
+ * restored lazily, if necessary, once the application reads or writes
+ * \p reg or the block ends, so that a subsequent reservation can reuse
+ * the register without another spill.
  *
  * @return whether successful or an error code on failure.
  */
@@ -273,6 +291,50 @@ drreg_unreserve_register(void *drcontext, instrlist_t *ilist, instr_t *where,
 
 /*@}*/ /* end doxygen group */
 
+/***************************************************************************
+ * SIMD REGISTERS
+ */
+
+DR_EXPORT
+/**
+ * Must be called during drmgr's insertion phase.  Requests exclusive
+ * use of an application SIMD register, spilling the low 128 bits of the
+ * application value at \p where in \p ilist if necessary.  The xmm
+ * register chosen is returned in \p reg.  If \p reg_allowed is
+ * non-NULL, only registers from the specified set will be considered,
+ * where \p reg_allowed must be a vector with one entry for each xmm
+ * register starting at DR_REG_XMM0, with a NULL entry indicating not
+ * allowed and any non-NULL entry indicating allowed.
+ *
+ * drreg computes the liveness of each SIMD register and does not spill
+ * one that is dead.  A register that the application uses in the
+ * current block is never chosen.  Only the xmm portion is preserved,
+ * so instrumentation must use legacy SSE encodings on the register, as
+ * VEX encodings would zero the upper portion of the application's ymm
+ * value.
+ *
+ * Requires drreg_options_t.num_simd_spill_slots to be non-zero.
+ * Currently only supported on x86.
+ *
+ * @return whether successful or an error code on failure.
+ */
+drreg_status_t
+drreg_reserve_simd_register(void *drcontext, instrlist_t *ilist, instr_t *where,
+                            drvector_t *reg_allowed, OUT reg_id_t *reg);
+
+DR_EXPORT
+/**
+ * Must be called during drmgr's insertion phase.  Terminates exclusive
+ * use of the SIMD register \p reg.  As for general-purpose registers,
+ * the application value is restored lazily, so that a subsequent
+ * reservation can reuse the register without another spill.
+ *
+ * @return whether successful or an error code on failure.
+ */
+drreg_status_t
+drreg_unreserve_simd_register(void *drcontext, instrlist_t *ilist, instr_t *where,
+                              reg_id_t reg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -240,6 +240,41 @@ drsym_error_t
 drsym_lookup_address(const char *modpath, size_t modoffs, drsym_info_t *info /*INOUT*/,
                      uint flags);
 
+/**
+ * Type for drsym_lookup_addresses callback function.
+ * Returns whether to continue with the remaining addresses.
+ *
+ * @param[in]  index   The index into the \p modoffs array being reported.
+ * @param[in]  status  The result drsym_lookup_address() would have returned.
+ * @param[in]  info    Information about the symbol at the address.
+ * @param[in]  data    User parameter passed to drsym_lookup_addresses().
+ */
+typedef bool (*drsym_lookup_addresses_cb)(size_t index, drsym_error_t status,
+                                          drsym_info_t *info, void *data);
+
+DR_EXPORT
+/**
+ * Looks up a batch of module offsets, equivalent to calling
+ * drsym_lookup_address() on each of them but loading the module and
+ * acquiring internal locks only once.  Results are reported through
+ * \p callback, reusing \p info (and its name and file buffers) for each
+ * address.  Passing the offsets in increasing order is much faster for
+ * large batches, as line information is cached one compilation unit at
+ * a time.
+ *
+ * @param[in] modpath   The full path to the module to be queried.
+ * @param[in] modoffs   Array of offsets from the base of the module.
+ * @param[in] count     The number of entries in \p modoffs.
+ * @param[in,out] info  Filled in for each address before calling \p callback.
+ * @param[in] callback  Function to call for each address.
+ * @param[in] data      User parameter passed to callback.
+ * @param[in] flags     Options as for drsym_lookup_address().
+ */
+drsym_error_t
+drsym_lookup_addresses(const char *modpath, const size_t *modoffs, size_t count,
+                       drsym_info_t *info /*INOUT*/, drsym_lookup_addresses_cb callback,
+                       void *data, uint flags);
+
 enum {
     DRSYM_TYPE_OTHER,  /**< Unknown type, cannot downcast. */
     DRSYM_TYPE_INT,    /**< Integer, cast to drsym_int_type_t. */
@@ -548,6 +583,50 @@ size_t
 drsym_demangle_symbol(char *dst, size_t dst_sz, const char *mangled,
                       uint flags);
 
+/**
+ * Type for drsym_demangle_symbols callback function.
+ * Returns whether to continue with the remaining names.
+ *
+ * @param[in]  index      The index into the \p mangled array being reported.
+ * @param[in]  name       The demangled name, or the mangled name as passed in if
+ *                        it could not be demangled.  Only valid during the call.
+ * @param[in]  demangled  Whether \p name was successfully demangled.
+ * @param[in]  data       User parameter passed to drsym_demangle_symbols().
+ */
+typedef bool (*drsym_demangle_symbols_cb)(size_t index, const char *name,
+                                          bool demangled, void *data);
+
+DR_EXPORT
+/**
+ * Demangles a batch of symbols, equivalent to calling drsym_demangle_symbol()
+ * on each of them with a large enough buffer.  Each distinct name is only
+ * demangled once.  Results are reported through \p callback in index order
+ * from the calling thread.
+ *
+ * If \p num_threads is larger than 1, the names are demangled by that many
+ * threads in parallel.  This is only supported in a standalone application
+ * (see dr_standalone_init()) that links with the system threads library on
+ * Linux and Mac, and must not be requested from a client.  Otherwise the
+ * names are demangled on the calling thread.
+ *
+ * Symbol lookups and enumerations already cache the demangled names of each
+ * module's symbols, and save them in the cache directory set by
+ * drsym_set_cache_dir() on Linux and Mac, so this routine is only needed for
+ * names obtained by other means.
+ *
+ * @param[in] mangled      Array of mangled C++ symbols.  NULL entries are
+ *                         reported with a NULL name.
+ * @param[in] count        The number of entries in \p mangled.
+ * @param[in] callback     Function to call for each name.
+ * @param[in] data         User parameter passed to callback.
+ * @param[in] num_threads  The number of threads to demangle with.
+ * @param[in] flags        Options as for drsym_demangle_symbol().
+ */
+drsym_error_t
+drsym_demangle_symbols(const char **mangled, size_t count,
+                       drsym_demangle_symbols_cb callback, void *data,
+                       uint num_threads, uint flags);
+
 DR_EXPORT
 /**
  * Outputs the kind of debug information available for the module \p modpath in
@@ -728,6 +807,20 @@ DR_EXPORT
 drsym_error_t
 drsym_enumerate_lines(const char *modpath, drsym_enumerate_lines_cb callback, void *data);
 
+DR_EXPORT
+/**
+ * Sets a directory in which drsyms persists the per-module indices it builds
+ * to answer drsym_lookup_symbol() queries, so that later processes can map
+ * them instead of walking and demangling the symbol table again.  Cache files
+ * are named by the module's build-id (or its .gnu_debuglink CRC) and modules
+ * with neither are not cached.  Pass NULL to disable caching, which is the
+ * default.  Only supported for ELF modules.
+ *
+ * @param[in] dir   An existing directory writable by the current process, or NULL.
+ */
+drsym_error_t
+drsym_set_cache_dir(const char *dir);
+
 
 /*@}*/ /* end doxygen group */
 
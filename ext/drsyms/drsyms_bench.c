@@ -32,8 +32,11 @@
 
 /* DRSyms benchmarking standalone app. */
 
-/* This is a standalone app for benchmarking drsyms.  Currently we just time
- * symbol enumeration of an arbitrary object file.
+/* This is a standalone app for benchmarking drsyms.  For each module in the
+ * corpus given on the command line we time module load, symbol enumeration,
+ * name lookup, address lookup (in random order and as a sorted batch), line
+ * enumeration, and demangling, reporting per-operation latency, throughput,
+ * and the process's peak memory footprint.
  */
 
 #include <stdio.h>
@@ -43,7 +46,24 @@
 #include "dr_api.h"
 #include "drsyms.h"
 
-static char sym_buf[4096];
+#ifdef UNIX
+# include <sys/resource.h> /* getrusage */
+#endif
+
+#define DEFAULT_SAMPLES 10000
+#define NAME_BUF_SIZE 4096
+
+static char sym_buf[NAME_BUF_SIZE];
+static uint demangle_threads = 1;
+
+/* A sample of the module's symbols, gathered during enumeration */
+typedef struct _sample_t {
+    char **names;
+    size_t *offs;
+    uint count;
+    uint max;
+    uint64 seen; /* total symbols enumerated */
+} sample_t;
 
 static int
 usage(const char *msg)
@@ -58,56 +78,238 @@ usage(const char *msg)
     if (msg != NULL && msg[0] != '\0') {
         dr_fprintf(STDERR, "%s\n", msg);
     }
-    dr_fprintf(STDERR, "usage: bench <modpath>\n");
+    dr_fprintf(STDERR, "usage: bench [-samples <N>] [-cache_dir <dir>] [-threads <N>] "
+               "<modpath>+\n");
     return 1;
 }
 
-/* The work done in this callback is minimal.  Right now it prints out a
- * sampling of mangled, demangled, and fully demangled names.
+/* Peak resident set size in KB, or 0 if unknown. */
+static uint64
+peak_memory_kb(void)
+{
+#ifdef UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+# ifdef MACOS
+    return usage.ru_maxrss / 1024; /* bytes */
+# else
+    return usage.ru_maxrss; /* KB */
+# endif
+#else
+    return 0;
+#endif
+}
+
+static void
+report(const char *op, uint64 count, uint64 start_us, uint64 end_us)
+{
+    uint64 time = end_us - start_us;
+    dr_printf("  %-24s %10"UINT64_FORMAT_CODE" ops %8"UINT64_FORMAT_CODE".%03d ms",
+              op, count, time / 1000, (int)(time % 1000));
+    if (count > 0 && time > 0) {
+        dr_printf(" %8"UINT64_FORMAT_CODE".%03d us/op %10"UINT64_FORMAT_CODE" ops/s",
+                  time / count, (int)((time * 1000 / count) % 1000),
+                  count * 1000000 / time);
+    }
+    dr_printf("  peak %"UINT64_FORMAT_CODE" KB\n", peak_memory_kb());
+}
+
+/* Keeps every Nth symbol until the sample is full, so we get a spread
+ * across the whole table without knowing its size in advance.
  */
 static bool
-sym_callback(const char *name, size_t modoffs, void *data)
+sample_callback(const char *name, size_t modoffs, void *data)
 {
-    uint64 *count = (uint64*)data;
-    *count += 1;
-    if (*count % 50000 == 0) {
-        dr_printf("{\"%s\",\n", name);
-        memset(sym_buf, 0, sizeof(sym_buf));
-        if (drsym_demangle_symbol(sym_buf, sizeof(sym_buf), name,
-                                  DRSYM_DEMANGLE_FULL) != 0) {
-            dr_printf(" \"%s\",\n", sym_buf);
-        }
-        memset(sym_buf, 0, sizeof(sym_buf));
-        if (drsym_demangle_symbol(sym_buf, sizeof(sym_buf), name,
-                                  DRSYM_DEMANGLE) != 0) {
-            dr_printf(" \"%s\"},\n", sym_buf);
-        }
+    sample_t *sample = (sample_t *)data;
+    sample->seen++;
+    if (sample->count < sample->max && modoffs != 0 && name[0] != '\0') {
+        size_t len = strlen(name) + 1;
+        sample->names[sample->count] = (char *)malloc(len);
+        memcpy(sample->names[sample->count], name, len);
+        sample->offs[sample->count] = modoffs;
+        sample->count++;
     }
     return true;
 }
 
+static bool
+count_callback(const char *name, size_t modoffs, void *data)
+{
+    *(uint64 *)data += 1;
+    return true;
+}
+
+static bool
+line_callback(drsym_line_info_t *info, void *data)
+{
+    *(uint64 *)data += 1;
+    return true;
+}
+
+static bool
+batch_callback(size_t index, drsym_error_t status, drsym_info_t *info, void *data)
+{
+    if (status == DRSYM_SUCCESS || status == DRSYM_ERROR_LINE_NOT_AVAILABLE)
+        *(uint64 *)data += 1;
+    return true;
+}
+
+static bool
+demangle_callback(size_t index, const char *name, bool demangled, void *data)
+{
+    if (demangled)
+        *(uint64 *)data += 1;
+    return true;
+}
+
+static int
+compare_offs(const void *a_in, const void *b_in)
+{
+    size_t a = *(const size_t *)a_in, b = *(const size_t *)b_in;
+    return (a < b) ? -1 : (a > b ? 1 : 0);
+}
+
 static void
-enumerate_with_flags(const char *modpath, drsym_flags_t flags)
+init_info(drsym_info_t *info, char *name, size_t name_sz, char *file, size_t file_sz)
 {
-    uint64 start, end, time;
-    uint64 sym_count = 0;
+    memset(info, 0, sizeof(*info));
+    info->struct_size = sizeof(*info);
+    info->name = name;
+    info->name_size = name_sz;
+    info->file = file;
+    info->file_size = file_sz;
+}
 
-    dr_printf("Beginning symbol enumeration\n");
-    /* Should use clock_gettime with CLOCK_MONOTONIC instead. */
-    start = dr_get_milliseconds();
-    drsym_enumerate_symbols(modpath, sym_callback, &sym_count, flags);
-    end = dr_get_milliseconds();
-    dr_printf("Finished symbol enumeration.\n");
+static void
+bench_module(const char *modpath, uint max_samples)
+{
+    static char file_buf[MAXIMUM_PATH];
+    uint64 start, end, count;
+    drsym_debug_kind_t kind;
+    drsym_info_t info;
+    sample_t sample;
+    size_t *offs;
+    uint i;
 
-    time = end - start;
+    dr_printf("%s\n", modpath);
+    memset(&sample, 0, sizeof(sample));
+    sample.max = max_samples;
+    sample.names = (char **)calloc(max_samples, sizeof(*sample.names));
+    sample.offs = (size_t *)calloc(max_samples, sizeof(*sample.offs));
+    offs = (size_t *)calloc(max_samples, sizeof(*offs));
 
-    dr_printf("Took %d.%03d seconds.\n", (int)(time / 1000), (int)(time % 1000));
+    /* Module load, measured cold and again after freeing our copy (which
+     * will hit the OS page cache and any persistent drsyms cache).
+     */
+    for (i = 0; i < 2; i++) {
+        drsym_free_resources(modpath);
+        start = dr_get_microseconds();
+        drsym_get_module_debug_kind(modpath, &kind);
+        end = dr_get_microseconds();
+        report(i == 0 ? "load (cold)" : "load (warm)", 1, start, end);
+    }
+
+    /* The first enumeration populates dbghelp's symbol cache.  We mostly care
+     * about how long the second enumeration takes.  We gather our sample of
+     * mangled names from the first.
+     */
+    start = dr_get_microseconds();
+    drsym_enumerate_symbols(modpath, sample_callback, &sample, DRSYM_LEAVE_MANGLED);
+    end = dr_get_microseconds();
+    report("enumerate (mangled)", sample.seen, start, end);
+    count = 0;
+    start = dr_get_microseconds();
+    drsym_enumerate_symbols(modpath, count_callback, &count, DRSYM_DEFAULT_FLAGS);
+    end = dr_get_microseconds();
+    report("enumerate (demangled)", count, start, end);
+    /* Now the demangled names come from the per-module cache. */
+    count = 0;
+    start = dr_get_microseconds();
+    drsym_enumerate_symbols(modpath, count_callback, &count, DRSYM_DEFAULT_FLAGS);
+    end = dr_get_microseconds();
+    report("enumerate (demangled, cached)", count, start, end);
+    if (sample.count == 0) {
+        dr_printf("  no symbols found\n");
+        goto done;
+    }
+
+    count = 0;
+    start = dr_get_microseconds();
+    for (i = 0; i < sample.count; i++) {
+        if (drsym_demangle_symbol(sym_buf, sizeof(sym_buf), sample.names[i],
+                                  DRSYM_DEMANGLE_FULL) != 0)
+            count++;
+    }
+    end = dr_get_microseconds();
+    report("demangle (full)", sample.count, start, end);
+
+    count = 0;
+    start = dr_get_microseconds();
+    drsym_demangle_symbols((const char **)sample.names, sample.count, demangle_callback,
+                           &count, demangle_threads, DRSYM_DEMANGLE_FULL);
+    end = dr_get_microseconds();
+    report("demangle (full, batch)", sample.count, start, end);
+
+    /* The first name lookup with a set of flags builds the name index. */
+    count = 0;
+    start = dr_get_microseconds();
+    for (i = 0; i < sample.count; i++) {
+        size_t modoffs;
+        if (drsym_lookup_symbol(modpath, sample.names[i], &modoffs,
+                                DRSYM_LEAVE_MANGLED) == DRSYM_SUCCESS)
+            count++;
+    }
+    end = dr_get_microseconds();
+    report("lookup name", sample.count, start, end);
+    if (count != sample.count)
+        dr_printf("  %d of %d names not found\n", sample.count - (uint)count, sample.count);
+
+    /* Random-order address lookups */
+    memcpy(offs, sample.offs, sample.count * sizeof(*offs));
+    for (i = sample.count - 1; i > 0; i--) {
+        uint j = dr_get_random_value(i + 1);
+        size_t tmp = offs[i];
+        offs[i] = offs[j];
+        offs[j] = tmp;
+    }
+    init_info(&info, sym_buf, sizeof(sym_buf), file_buf, sizeof(file_buf));
+    start = dr_get_microseconds();
+    for (i = 0; i < sample.count; i++)
+        drsym_lookup_address(modpath, offs[i], &info, DRSYM_DEFAULT_FLAGS);
+    end = dr_get_microseconds();
+    report("lookup address (random)", sample.count, start, end);
+
+    /* Sorted batch address lookups */
+    qsort(offs, sample.count, sizeof(*offs), compare_offs);
+    count = 0;
+    start = dr_get_microseconds();
+    drsym_lookup_addresses(modpath, offs, sample.count, &info, batch_callback, &count,
+                           DRSYM_DEFAULT_FLAGS);
+    end = dr_get_microseconds();
+    report("lookup address (sorted)", sample.count, start, end);
+
+    count = 0;
+    start = dr_get_microseconds();
+    drsym_enumerate_lines(modpath, line_callback, &count);
+    end = dr_get_microseconds();
+    report("enumerate lines", count, start, end);
+
+ done:
+    for (i = 0; i < sample.count; i++)
+        free(sample.names[i]);
+    free(sample.names);
+    free(sample.offs);
+    free(offs);
+    drsym_free_resources(modpath);
 }
 
 int
 main(int argc, char **argv)
 {
     const char *modpath;
+    uint max_samples = DEFAULT_SAMPLES;
+    int i;
 #ifdef WINDOWS
     char full_path[2048];
 #endif
@@ -115,26 +317,40 @@ main(int argc, char **argv)
     dr_standalone_init();
     drsym_init(0);
 
-    if (argc != 2) {
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-samples") == 0 && i + 1 < argc) {
+            max_samples = (uint)atoi(argv[++i]);
+            if (max_samples == 0)
+                return usage("-samples must be positive.");
+        } else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            demangle_threads = (uint)atoi(argv[++i]);
+            if (demangle_threads == 0)
+                return usage("-threads must be positive.");
+        } else if (strcmp(argv[i], "-cache_dir") == 0 && i + 1 < argc) {
+            if (drsym_set_cache_dir(argv[++i]) != DRSYM_SUCCESS)
+                return usage("Invalid cache directory.");
+        } else
+            return usage("Unknown option.");
+    }
+    if (i >= argc) {
         return usage(NULL);
     }
-    modpath = argv[1];
+
+    for (; i < argc; i++) {
+        modpath = argv[i];
 #ifdef WINDOWS
-    /* Work around i#289. */
-    if (GetFullPathName(modpath, sizeof(full_path), full_path, NULL) == 0) {
-        return usage("GetFullPathName failed.\n");
-    }
-    modpath = full_path;
+        /* Work around i#289. */
+        if (GetFullPathName(modpath, sizeof(full_path), full_path, NULL) == 0) {
+            return usage("GetFullPathName failed.\n");
+        }
+        modpath = full_path;
 #endif
-    if (!dr_file_exists(modpath)) {
-        return usage("Path does not exist.");
+        if (!dr_file_exists(modpath)) {
+            return usage("Path does not exist.");
+        }
+        bench_module(modpath, max_samples);
     }
 
-    /* The first enumeration populates dbghelp's symbol cache.  We mostly care
-     * about how long the second enumeration takes.
-     */
-    enumerate_with_flags(modpath, DRSYM_DEFAULT_FLAGS);
-    enumerate_with_flags(modpath, DRSYM_DEFAULT_FLAGS);
-
     drsym_exit();
+    return 0;
 }
@@ -53,13 +53,26 @@ static bool verbose = false;
     } \
 } while (0)
 
+/* Line tables are parsed lazily, one CU at a time, and we keep the most
+ * recently used few so that queries alternating between a handful of CUs
+ * (e.g., a hot loop calling into a library) don't reparse on every switch.
+ */
+#define LINES_CACHE_SIZE 8
+
+typedef struct _cu_lines_t {
+    Dwarf_Off cu_offs; /* DIE offset of the CU */
+    Dwarf_Line *lines; /* NULL if this entry is unused */
+    Dwarf_Signed num_lines;
+    /* Sorted addresses of lines[], so searches don't call into libdwarf */
+    Dwarf_Addr *line_addrs;
+    uint last_use;
+} cu_lines_t;
+
 typedef struct _dwarf_module_t {
     byte *load_base;
     Dwarf_Debug dbg;
-    /* we cache the last CU we looked up */
-    Dwarf_Die lines_cu;
-    Dwarf_Line *lines;
-    Dwarf_Signed num_lines;
+    cu_lines_t lines_cache[LINES_CACHE_SIZE];
+    uint lines_clock;
     /* Amount to adjust all offsets for __PAGEZERO + PIE (i#1365) */
     ssize_t offs_adjust;
 } dwarf_module_t;
@@ -244,47 +257,84 @@ drsym_dwarf_search_addr2line(void *mod_in, Dwarf_Addr pc, drsym_info_t *sym_info
     return success;
 }
 
-static Dwarf_Signed
-get_lines_from_cu(dwarf_module_t *mod, Dwarf_Die cu_die,
-                  Dwarf_Line **lines_out OUT)
+static void
+free_cached_lines(dwarf_module_t *mod, cu_lines_t *entry)
+{
+    if (entry->lines != NULL)
+        dwarf_srclines_dealloc(mod->dbg, entry->lines, entry->num_lines);
+    if (entry->line_addrs != NULL) {
+        dr_global_free(entry->line_addrs,
+                       (size_t)entry->num_lines * sizeof(*entry->line_addrs));
+    }
+    memset(entry, 0, sizeof(*entry));
+}
+
+static cu_lines_t *
+get_lines_from_cu(dwarf_module_t *mod, Dwarf_Die cu_die)
 {
-    if (mod->lines_cu != cu_die) {
-        Dwarf_Line *lines;
-        Dwarf_Signed num_lines;
-        Dwarf_Error de; /* expensive to init (DrM#1770) */
-        if (dwarf_srclines(cu_die, &lines, &num_lines, &de) != DW_DLV_OK) {
+    Dwarf_Line *lines;
+    Dwarf_Signed num_lines, i;
+    Dwarf_Error de; /* expensive to init (DrM#1770) */
+    Dwarf_Off cu_offs;
+    cu_lines_t *entry, *victim = NULL;
+
+    if (dwarf_dieoffset(cu_die, &cu_offs, &de) != DW_DLV_OK) {
+        NOTIFY_DWARF(de);
+        return NULL;
+    }
+    mod->lines_clock++;
+    for (entry = mod->lines_cache; entry < mod->lines_cache + LINES_CACHE_SIZE;
+         entry++) {
+        if (entry->lines != NULL && entry->cu_offs == cu_offs) {
+            entry->last_use = mod->lines_clock;
+            return entry;
+        }
+        if (victim == NULL || entry->lines == NULL ||
+            (victim->lines != NULL && entry->last_use < victim->last_use))
+            victim = entry;
+    }
+
+    if (dwarf_srclines(cu_die, &lines, &num_lines, &de) != DW_DLV_OK) {
+        NOTIFY_DWARF(de);
+        return NULL;
+    }
+    /* XXX: we should fix libelftc to sort as it builds the table but for now
+     * it's easier to sort and store here
+     */
+    qsort(lines, (size_t)num_lines, sizeof(*lines), compare_lines);
+    /* Save for next query */
+    free_cached_lines(mod, victim);
+    victim->line_addrs = dr_global_alloc((size_t)num_lines * sizeof(*victim->line_addrs));
+    for (i = 0; i < num_lines; i++) {
+        if (dwarf_lineaddr(lines[i], &victim->line_addrs[i], &de) != DW_DLV_OK) {
             NOTIFY_DWARF(de);
-            return -1;
+            victim->line_addrs[i] = 0;
         }
-        /* XXX: we should fix libelftc to sort as it builds the table but for now
-         * it's easier to sort and store here
-         */
-        qsort(lines, (size_t)num_lines, sizeof(*lines), compare_lines);
-        /* Save for next query */
-        dwarf_srclines_dealloc(mod->dbg, mod->lines, mod->num_lines);
-        mod->lines_cu = cu_die;
-        mod->lines = lines;
-        mod->num_lines = num_lines;
     }
-    *lines_out = mod->lines;
-    return mod->num_lines;
+    victim->cu_offs = cu_offs;
+    victim->lines = lines;
+    victim->num_lines = num_lines;
+    victim->last_use = mod->lines_clock;
+    return victim;
 }
 
 static search_result_t
 search_addr2line_in_cu(dwarf_module_t *mod, Dwarf_Addr pc, Dwarf_Die cu_die,
                        drsym_info_t *sym_info INOUT)
 {
+    cu_lines_t *cu_lines;
     Dwarf_Line *lines;
-    Dwarf_Signed num_lines;
-    int i;
-    Dwarf_Addr lineaddr, next_lineaddr = 0;
+    Dwarf_Signed num_lines, lo, hi;
+    Dwarf_Addr lineaddr;
     Dwarf_Line dw_line;
     Dwarf_Error de; /* expensive to init (DrM#1770) */
     search_result_t res = SEARCH_NOT_FOUND;
 
-    num_lines = get_lines_from_cu(mod, cu_die, &lines);
-    if (num_lines < 0)
+    cu_lines = get_lines_from_cu(mod, cu_die);
+    if (cu_lines == NULL)
         return SEARCH_NOT_FOUND;
+    lines = cu_lines->lines;
+    num_lines = cu_lines->num_lines;
 
     if (verbose) {
         char *name;
@@ -294,30 +344,31 @@ search_addr2line_in_cu(dwarf_module_t *mod, Dwarf_Addr pc, Dwarf_Die cu_die,
         }
     }
 
-    /* We could binary search this, but we assume dwarf_srclines is the
-     * bottleneck.
+    /* Binary search for the number of lines starting at or below pc.  The
+     * containing line is the last of those, unless pc is past the start of
+     * the final line of the CU, in which case we can't tell where it ends.
      */
     dw_line = NULL;
-    for (i = 0; i < num_lines - 1; i++) {
-        if (dwarf_lineaddr(lines[i], &lineaddr, &de) != DW_DLV_OK ||
-            dwarf_lineaddr(lines[i + 1], &next_lineaddr, &de) != DW_DLV_OK) {
-            NOTIFY_DWARF(de);
-            break;
-        }
-        NOTIFY("%s: pc "PFX" vs line "PFX"-"PFX"\n", __FUNCTION__, (ptr_uint_t)pc,
-               (ptr_uint_t)lineaddr, (ptr_uint_t)next_lineaddr);
-        if (lineaddr <= pc && pc < next_lineaddr) {
-            dw_line = lines[i];
-            res = SEARCH_FOUND;
-            break;
-        }
+    lo = 0;
+    hi = num_lines;
+    while (lo < hi) {
+        Dwarf_Signed mid = lo + (hi - lo) / 2;
+        if (cu_lines->line_addrs[mid] <= pc)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    /* Handle the case when the PC is from the last line of the CU. */
-    if (i == num_lines - 1 && dw_line == NULL && next_lineaddr <= pc) {
-        NOTIFY("%s: pc "PFX" vs last line "PFX"\n",
-               __FUNCTION__, (ptr_uint_t)pc, (ptr_uint_t)next_lineaddr);
+    if (num_lines == 1 || (lo == num_lines && num_lines > 0)) {
+        /* Handle the case when the PC is from the last line of the CU. */
+        NOTIFY("%s: pc "PFX" vs last line "PFX"\n", __FUNCTION__, (ptr_uint_t)pc,
+               (ptr_uint_t)cu_lines->line_addrs[num_lines - 1]);
         dw_line = lines[num_lines - 1];
         res = SEARCH_MAYBE;
+    } else if (lo > 0) {
+        NOTIFY("%s: pc "PFX" vs line "PFX"-"PFX"\n", __FUNCTION__, (ptr_uint_t)pc,
+               (ptr_uint_t)cu_lines->line_addrs[lo - 1], (ptr_uint_t)cu_lines->line_addrs[lo]);
+        dw_line = lines[lo - 1];
+        res = SEARCH_FOUND;
     }
 
     /* If we found dw_line, use it to fill out sym_info. */
@@ -354,6 +405,7 @@ static int
 enumerate_lines_in_cu(dwarf_module_t *mod, Dwarf_Die cu_die,
                       drsym_enumerate_lines_cb callback, void *data)
 {
+    cu_lines_t *cu_lines;
     Dwarf_Line *lines;
     Dwarf_Signed num_lines;
     int i;
@@ -366,8 +418,8 @@ enumerate_lines_in_cu(dwarf_module_t *mod, Dwarf_Die cu_die,
         NOTIFY_DWARF(de);
     }
 
-    num_lines = get_lines_from_cu(mod, cu_die, &lines);
-    if (num_lines < 0) {
+    cu_lines = get_lines_from_cu(mod, cu_die);
+    if (cu_lines == NULL) {
         /* This cu has no line info.  Don't bail: keep going. */
         info.file = NULL;
         info.line = 0;
@@ -376,6 +428,8 @@ enumerate_lines_in_cu(dwarf_module_t *mod, Dwarf_Die cu_die,
             return 0;
         return 1;
     }
+    lines = cu_lines->lines;
+    num_lines = cu_lines->num_lines;
 
     for (i = 0; i < num_lines; i++) {
         Dwarf_Unsigned lineno;
@@ -453,8 +507,9 @@ void
 drsym_dwarf_exit(void *mod_in)
 {
     dwarf_module_t *mod = (dwarf_module_t *) mod_in;
-    if (mod->lines != NULL)
-        dwarf_srclines_dealloc(mod->dbg, mod->lines, mod->num_lines);
+    int i;
+    for (i = 0; i < LINES_CACHE_SIZE; i++)
+        free_cached_lines(mod, &mod->lines_cache[i]);
     dwarf_finish(mod->dbg, NULL);
     dr_global_free(mod, sizeof(*mod));
 }
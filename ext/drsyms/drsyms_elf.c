@@ -43,6 +43,7 @@
 #include "dwarf.h"
 #include "libdwarf.h"
 
+#include <stdlib.h> /* qsort */
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -101,6 +102,17 @@ static bool verbose;
 # define Elf_Sym  Elf32_Sym
 #endif
 
+/* Entry in the address-sorted view of the symbol table */
+typedef struct _sorted_sym_t {
+    size_t lo_offs;
+    size_t hi_offs;
+    /* The largest hi_offs of this and all prior entries, so that a search for
+     * ranges containing an address can stop scanning backward early.
+     */
+    size_t max_hi_offs;
+    uint idx;
+} sorted_sym_t;
+
 typedef struct _elf_info_t {
     Elf *elf;
     Elf_Sym *syms;
@@ -109,6 +121,8 @@ typedef struct _elf_info_t {
     byte *map_base;
     ptr_uint_t load_base;
     drsym_debug_kind_t debug_kind;
+    /* Built on the first address lookup; NULL until then. */
+    sorted_sym_t *sorted_syms;
 } elf_info_t;
 
 /* Looks for a section with real data, not just a section with a header */
@@ -277,6 +291,8 @@ drsym_obj_mod_exit(void *mod_in)
         return;
     if (mod->elf != NULL)
         elf_end(mod->elf);
+    if (mod->sorted_syms != NULL)
+        dr_global_free(mod->sorted_syms, mod->num_syms * sizeof(*mod->sorted_syms));
     dr_global_free(mod, sizeof(*mod));
 }
 
@@ -313,6 +329,36 @@ drsym_obj_debuglink_section(void *mod_in, const char *modpath)
     return ((char*) mod->map_base) + section_header->sh_offset;
 }
 
+/* Returns the descriptor of the .note.gnu.build-id note.  If there is none,
+ * falls back to the CRC of the .gnu_debuglink file, which also changes
+ * whenever the debug info does.
+ */
+const byte *
+drsym_obj_build_id(void *mod_in, size_t *len OUT)
+{
+    elf_info_t *mod = (elf_info_t *) mod_in;
+    Elf_Shdr *section_header =
+        elf_getshdr(find_elf_section_by_name(mod->elf, ".note.gnu.build-id"));
+    if (section_header != NULL && section_header->sh_size > sizeof(Elf_Note)) {
+        Elf_Note *note = (Elf_Note *)(mod->map_base + section_header->sh_offset);
+        size_t desc_offs = sizeof(*note) + ALIGN_FORWARD(note->n_namesz, 4);
+        if (note->n_descsz > 0 && desc_offs + note->n_descsz <= section_header->sh_size) {
+            *len = note->n_descsz;
+            return ((byte *)note) + desc_offs;
+        }
+    }
+    section_header = elf_getshdr(find_elf_section_by_name(mod->elf, ".gnu_debuglink"));
+    if (section_header != NULL) {
+        const char *name = (const char *)(mod->map_base + section_header->sh_offset);
+        size_t crc_offs = ALIGN_FORWARD(strnlen(name, section_header->sh_size) + 1, 4);
+        if (crc_offs + sizeof(uint) <= section_header->sh_size) {
+            *len = sizeof(uint);
+            return (const byte *)name + crc_offs;
+        }
+    }
+    return NULL;
+}
+
 uint
 drsym_obj_num_symbols(void *mod_in)
 {
@@ -357,41 +403,91 @@ drsym_obj_symbol_offs(void *mod_in, uint idx, size_t *offs_start OUT,
     return DRSYM_SUCCESS;
 }
 
+static int
+compare_sorted_syms(const void *a_in, const void *b_in)
+{
+    const sorted_sym_t *a = (const sorted_sym_t *) a_in;
+    const sorted_sym_t *b = (const sorted_sym_t *) b_in;
+    if (a->lo_offs != b->lo_offs)
+        return (a->lo_offs < b->lo_offs) ? -1 : 1;
+    /* Keep table order among equal starts to match a linear search. */
+    return (a->idx < b->idx) ? -1 : (a->idx > b->idx ? 1 : 0);
+}
+
+static void
+build_sorted_syms(elf_info_t *mod)
+{
+    int i;
+    size_t max_hi = 0;
+    mod->sorted_syms = dr_global_alloc(mod->num_syms * sizeof(*mod->sorted_syms));
+    for (i = 0; i < mod->num_syms; i++) {
+        sorted_sym_t *ss = &mod->sorted_syms[i];
+        ss->lo_offs = mod->syms[i].st_value - mod->load_base;
+        ss->hi_offs = ss->lo_offs + mod->syms[i].st_size;
+        ss->idx = i;
+    }
+    qsort(mod->sorted_syms, mod->num_syms, sizeof(*mod->sorted_syms),
+          compare_sorted_syms);
+    for (i = 0; i < mod->num_syms; i++) {
+        if (mod->sorted_syms[i].hi_offs > max_hi)
+            max_hi = mod->sorted_syms[i].hi_offs;
+        mod->sorted_syms[i].max_hi_offs = max_hi;
+    }
+}
+
+/* Returns the lowest-indexed symbol whose range contains modoffs or, failing
+ * that, the closest preceding zero-sized named symbol (i#1337: asm routines).
+ * This matches a linear walk of the table but uses a sorted view of it.
+ */
 drsym_error_t
 drsym_obj_addrsearch_symtab(void *mod_in, size_t modoffs, uint *idx OUT)
 {
     elf_info_t *mod = (elf_info_t *) mod_in;
-    int i;
-    int closest_idx = -1;
-    size_t closest_diff = SIZE_T_MAX;
+    int lo, hi, i;
+    uint best_idx = UINT_MAX;
 
     if (mod == NULL || mod->syms == NULL || idx == NULL)
         return DRSYM_ERROR;
+    if (mod->num_syms == 0)
+        return DRSYM_ERROR_SYMBOL_NOT_FOUND;
+    if (mod->sorted_syms == NULL)
+        build_sorted_syms(mod);
+
+    /* Find the number of entries starting at or below modoffs. */
+    lo = 0;
+    hi = mod->num_syms;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (mod->sorted_syms[mid].lo_offs <= modoffs)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        return DRSYM_ERROR_SYMBOL_NOT_FOUND;
 
     /* XXX: if a function is split into non-contiguous pieces, will it
      * have multiple entries?
      */
-    for (i = 0; i < mod->num_syms; i++) {
-        size_t lo_offs = mod->syms[i].st_value - mod->load_base;
-        size_t hi_offs = lo_offs + mod->syms[i].st_size;
-        if (lo_offs <= modoffs && modoffs < hi_offs) {
-            *idx = i;
-            return DRSYM_SUCCESS;
-        }
-        /* i#1337: handle st_size==0 asm routines */
-        if (modoffs >= lo_offs) {
-            if (modoffs - lo_offs < closest_diff) {
-                closest_idx = i;
-                closest_diff = modoffs - lo_offs;
-            }
-        }
+    for (i = lo - 1; i >= 0 && mod->sorted_syms[i].max_hi_offs > modoffs; i--) {
+        if (modoffs < mod->sorted_syms[i].hi_offs && mod->sorted_syms[i].idx < best_idx)
+            best_idx = mod->sorted_syms[i].idx;
+    }
+    if (best_idx != UINT_MAX) {
+        *idx = best_idx;
+        return DRSYM_SUCCESS;
     }
 
-    if (closest_idx >= 0 && mod->syms[closest_idx].st_size == 0) {
+    /* The closest start is the first entry sharing the last start <= modoffs. */
+    for (i = lo - 1;
+         i > 0 && mod->sorted_syms[i - 1].lo_offs == mod->sorted_syms[lo - 1].lo_offs;
+         i--)
+        ; /* nothing */
+    if (mod->syms[mod->sorted_syms[i].idx].st_size == 0) {
         /* i#1337: rule out anything without a name */
-        const char *name = drsym_obj_symbol_name(mod_in, closest_idx);
+        const char *name = drsym_obj_symbol_name(mod_in, mod->sorted_syms[i].idx);
         if (name != NULL && name[0] != '\0') {
-            *idx = closest_idx;
+            *idx = mod->sorted_syms[i].idx;
             return DRSYM_SUCCESS;
         }
     }
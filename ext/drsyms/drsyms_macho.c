@@ -494,6 +494,15 @@ drsym_obj_debuglink_section(void *mod_in, const char *modpath)
     return NULL;
 }
 
+/* XXX: LC_UUID is the Mach-O equivalent of the ELF build-id and should
+ * be used here to enable persistent caching.
+ */
+const byte *
+drsym_obj_build_id(void *mod_in, size_t *len OUT)
+{
+    return NULL;
+}
+
 uint
 drsym_obj_num_symbols(void *mod_in)
 {
@@ -78,6 +78,12 @@ drsym_obj_load_base(void *mod_in);
 const char *
 drsym_obj_debuglink_section(void *mod_in, const char *modpath);
 
+/* Returns bytes identifying the contents of the file (such as an ELF build-id)
+ * for use as a persistent cache key, or NULL if there is no such identifier.
+ */
+const byte *
+drsym_obj_build_id(void *mod_in, size_t *len OUT);
+
 uint
 drsym_obj_num_symbols(void *mod_in);
 
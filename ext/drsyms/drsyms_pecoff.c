@@ -423,6 +423,15 @@ drsym_pecoff_sort_symbols(pecoff_data_t *mod)
     }
 }
 
+/* XXX: the CodeView debug directory entry's GUID and age could be used
+ * here to enable persistent caching.
+ */
+const byte *
+drsym_obj_build_id(void *mod_in, size_t *len OUT)
+{
+    return NULL;
+}
+
 uint
 drsym_obj_num_symbols(void *mod_in)
 {
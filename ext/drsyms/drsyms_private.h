@@ -123,6 +123,11 @@ size_t
 drsym_unix_demangle_symbol(char *dst OUT, size_t dst_sz, const char *mangled,
                            uint flags);
 
+drsym_error_t
+drsym_unix_demangle_symbols(const char **mangled, size_t count,
+                            drsym_demangle_symbols_cb callback, void *data,
+                            uint num_threads, uint flags);
+
 drsym_error_t
 drsym_unix_get_type(void *mod_in, size_t modoffs, uint levels_to_expand,
                     char *buf, size_t buf_sz, drsym_type_t **type OUT);
@@ -142,4 +147,7 @@ drsym_unix_get_module_debug_kind(void *moddata, drsym_debug_kind_t *kind OUT);
 drsym_error_t
 drsym_unix_enumerate_lines(void *mod_in, drsym_enumerate_lines_cb callback, void *data);
 
+drsym_error_t
+drsym_unix_set_cache_dir(const char *dir);
+
 #endif /* DRSYMS_PRIVATE_H */
@@ -45,19 +45,100 @@
 #include <string.h> /* strlen */
 #include <errno.h>
 #include <stddef.h> /* offsetof */
+#include <limits.h> /* UINT_MAX */
 
 #include "demangle.h"
 #include "libelftc.h"
+#include "hashtable.h"
 
 #ifdef WINDOWS
 # define IF_WINDOWS(x) x
 #else
 # define IF_WINDOWS(x)
+# include <pthread.h>
+/* Weak so that drsym_demangle_symbols() only uses threads when the standalone
+ * application links with them, and so that we add no library dependence.
+ */
+# pragma weak pthread_create
+# pragma weak pthread_join
 #endif
 
 /* For debugging */
 static bool verbose = false;
 
+/* Name lookups are served from a per-module index built on first use, one
+ * per demangling mode as the names differ.
+ */
+enum {
+    NAME_INDEX_MANGLED,
+    NAME_INDEX_DEMANGLED,
+    NAME_INDEX_DEMANGLED_FULL,
+    NAME_INDEX_COUNT,
+};
+
+#define NAME_INDEX_HASH_BITS 12
+
+/* If a cache directory is set, each name index is also written there as an
+ * open-addressed table that later processes map and probe in place, keyed by
+ * the module's build-id.  Layout: header, buckets, then a string pool whose
+ * offset 0 holds an empty string so that a name_offs of 0 marks a free bucket.
+ */
+#define NAME_CACHE_MAGIC 0x58444953 /* "SIDX" */
+#define NAME_CACHE_VERSION 1
+#define NAME_CACHE_MAX_ID_LEN 64
+
+typedef struct _name_cache_header_t {
+    uint magic;
+    uint version;
+    uint num_buckets; /* power of 2 */
+    uint num_entries;
+    uint strings_size;
+    uint reserved;
+} name_cache_header_t;
+
+typedef struct _name_cache_bucket_t {
+    uint64 modoffs;
+    uint name_offs;
+    uint reserved;
+} name_cache_bucket_t;
+
+typedef struct _name_cache_t {
+    file_t fd;
+    void *map_base; /* NULL if not mapped */
+    size_t map_size;
+} name_cache_t;
+
+/* Demangled names are cached per symbol index, one cache per demangling mode
+ * (the NAME_INDEX_MANGLED slot is unused).  offs[i] is 0 if symbol i has not
+ * been demangled yet, DEMANGLE_CACHE_FAILED if it is not a mangled name, and
+ * otherwise the offset of its demangled name in strings, whose offset 0 is
+ * unused.  If a cache directory is set the cache is saved there at module
+ * unload as the header, offs, and strings, and read back on first use.
+ */
+#define DEMANGLE_CACHE_MAGIC 0x4c474d44 /* "DMGL" */
+#define DEMANGLE_CACHE_VERSION 1
+#define DEMANGLE_CACHE_FAILED UINT_MAX
+#define DEMANGLE_CACHE_INIT_STRINGS (16*1024)
+
+typedef struct _demangle_cache_header_t {
+    uint magic;
+    uint version;
+    uint num_syms;
+    uint strings_size;
+} demangle_cache_header_t;
+
+typedef struct _demangle_cache_t {
+    uint *offs; /* NULL until first use */
+    uint num_syms;
+    char *strings;
+    size_t strings_alloc;
+    size_t strings_size;
+    bool dirty; /* Whether we have entries missing from the on-disk copy. */
+} demangle_cache_t;
+
+/* Protected by symbol_lock, like all our other state. */
+static char cache_dir[MAXIMUM_PATH];
+
 typedef struct _dbg_module_t {
     file_t fd;
     size_t file_size;
@@ -71,6 +152,11 @@ typedef struct _dbg_module_t {
      * while the primary mod has symtab+strtab.
      */
     struct _dbg_module_t *mod_with_dwarf;
+    /* Maps each name to the offset of its first symbol.  NULL until built. */
+    hashtable_t *name_index[NAME_INDEX_COUNT];
+    /* Mapped on-disk copies of name_index, used instead when present. */
+    name_cache_t name_cache[NAME_INDEX_COUNT];
+    demangle_cache_t demangle_cache[NAME_INDEX_COUNT];
 } dbg_module_t;
 
 /******************************************************************************
@@ -78,6 +164,9 @@ typedef struct _dbg_module_t {
  */
 
 static void unload_module(dbg_module_t *mod);
+static void demangle_cache_free(dbg_module_t *mod, int mode);
+static const char *demangle_cached(dbg_module_t *mod, uint idx, const char *mangled,
+                                   uint flags);
 static bool follow_debuglink(const char * modpath, dbg_module_t *mod,
                              const char *debuglink, char debug_modpath[MAXIMUM_PATH]);
 
@@ -288,6 +377,19 @@ follow_debuglink(const char *modpath, dbg_module_t *mod, const char *debuglink,
 static void
 unload_module(dbg_module_t *mod)
 {
+    int i;
+    for (i = 0; i < NAME_INDEX_COUNT; i++) {
+        if (mod->name_index[i] != NULL) {
+            hashtable_delete(mod->name_index[i]);
+            dr_global_free(mod->name_index[i], sizeof(*mod->name_index[i]));
+        }
+        if (mod->name_cache[i].map_base != NULL) {
+            dr_unmap_file(mod->name_cache[i].map_base, mod->name_cache[i].map_size);
+            dr_close_file(mod->name_cache[i].fd);
+        }
+        if (mod->demangle_cache[i].offs != NULL)
+            demangle_cache_free(mod, i);
+    }
     if (mod->dwarf_info != NULL)
         drsym_dwarf_exit(mod->dwarf_info);
     if (mod->obj_info != NULL)
@@ -358,22 +460,20 @@ symsearch_symtab(dbg_module_t *mod, drsym_enumerate_cb callback,
             break;
 
         if (TEST(DRSYM_DEMANGLE, flags)) {
-            size_t len;
-            /* Resize until it's big enough. */
-            while ((len = drsym_demangle_symbol(out->name, name_buf_size,
-                                                mangled, flags))
-                   > name_buf_size) {
+            const char *demangled = demangle_cached(mod, i, mangled, flags);
+            if (demangled != NULL)
+                unmangled = demangled;
+        }
+        /* The cached name can move if the callback makes a nested query. */
+        if (unmangled != mangled || callback_ex != NULL) {
+            size_t len = strlen(unmangled) + 1;
+            if (len > name_buf_size) {
                 dr_global_free(out->name, name_buf_size);
                 name_buf_size = len;
                 out->name = (char *) dr_global_alloc(name_buf_size);
             }
-            if (len != 0) {
-                /* Success. */
-                unmangled = out->name;
-            }
-        } else if (callback_ex != NULL) {
-            strncpy(out->name, unmangled, name_buf_size);
-            out->name[name_buf_size - 1] = '\0';
+            memcpy(out->name, unmangled, len);
+            unmangled = out->name;
         }
 
         if (callback_ex != NULL) {
@@ -410,7 +510,12 @@ addrsearch_symtab(dbg_module_t *mod, size_t modoffs, drsym_info_t *info INOUT,
         return DRSYM_ERROR;
 
     if (TEST(DRSYM_DEMANGLE, flags) && info->name != NULL) {
-        name_len = drsym_demangle_symbol(info->name, info->name_size, symbol, flags);
+        const char *demangled = demangle_cached(mod, idx, symbol, flags);
+        if (demangled != NULL) {
+            name_len = strlen(demangled) + 1;
+            strncpy(info->name, demangled, info->name_size);
+            info->name[info->name_size - 1] = '\0';
+        }
     }
     if (name_len == 0) {
         /* Demangling either failed or was not requested. */
@@ -426,6 +531,507 @@ addrsearch_symtab(dbg_module_t *mod, size_t modoffs, drsym_info_t *info INOUT,
     return drsym_obj_symbol_offs(mod->obj_info, idx, &info->start_offs, &info->end_offs);
 }
 
+/******************************************************************************
+ * Name index
+ */
+
+static int
+name_index_mode(uint flags)
+{
+    if (TEST(DRSYM_DEMANGLE_FULL, flags))
+        return NAME_INDEX_DEMANGLED_FULL;
+    if (TEST(DRSYM_DEMANGLE, flags))
+        return NAME_INDEX_DEMANGLED;
+    return NAME_INDEX_MANGLED;
+}
+
+/* Symbol enumeration callback for building a name index.  A lookup matches
+ * a symbol whose name is either equal to the search string or continues
+ * with a left paren (the start of the parameter list: we assume the user
+ * doesn't care about possible overloads), so we add the full name plus
+ * every prefix ending at a left paren.  Only the first symbol for a given
+ * key is kept, matching the order of a linear search.
+ */
+static bool
+name_index_add_cb(const char *sym, size_t modoffs, void *data INOUT)
+{
+    hashtable_t *index = (hashtable_t *) data;
+    const char *paren;
+    if (modoffs == 0)
+        return true;
+    hashtable_add(index, (void *)sym, (void *)modoffs);
+    for (paren = strchr(sym, '('); paren != NULL; paren = strchr(paren + 1, '(')) {
+        char prefix[256];
+        size_t len = paren - sym;
+        char *key = prefix;
+        if (len + 1 > sizeof(prefix))
+            key = dr_global_alloc(len + 1);
+        memcpy(key, sym, len);
+        key[len] = '\0';
+        hashtable_add(index, (void *)key, (void *)modoffs);
+        if (key != prefix)
+            dr_global_free(key, len + 1);
+    }
+    return true;
+}
+
+static drsym_error_t
+build_name_index(dbg_module_t *mod, uint flags)
+{
+    drsym_error_t r;
+    hashtable_t *table = dr_global_alloc(sizeof(*table));
+    hashtable_init_ex(table, NAME_INDEX_HASH_BITS, HASH_STRING,
+                      true/*strdup*/, false/*!synch: using symbol_lock*/,
+                      NULL, NULL, NULL);
+    r = symsearch_symtab(mod, name_index_add_cb, NULL, sizeof(drsym_info_t),
+                         table, flags);
+    if (r != DRSYM_SUCCESS) {
+        hashtable_delete(table);
+        dr_global_free(table, sizeof(*table));
+        return r;
+    }
+    NOTIFY("built name index with %u entries\n", table->entries);
+    mod->name_index[name_index_mode(flags)] = table;
+    return DRSYM_SUCCESS;
+}
+
+/******************************************************************************
+ * Persistent name index cache
+ */
+
+/* FNV-1a: the hash is part of the file format so we can't use hashtable's. */
+static uint
+name_cache_hash(const char *name)
+{
+    uint hash = 2166136261U;
+    for (; *name != '\0'; name++) {
+        hash ^= (byte) *name;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static bool
+name_cache_path(dbg_module_t *mod, int mode, const char *ext, char path[MAXIMUM_PATH])
+{
+    char id_hex[NAME_CACHE_MAX_ID_LEN * 2 + 1];
+    const byte *id;
+    size_t id_len, i;
+    if (cache_dir[0] == '\0')
+        return false;
+    id = drsym_obj_build_id(mod->obj_info, &id_len);
+    if (id == NULL || id_len == 0)
+        return false;
+    if (id_len > NAME_CACHE_MAX_ID_LEN)
+        id_len = NAME_CACHE_MAX_ID_LEN;
+    for (i = 0; i < id_len; i++)
+        dr_snprintf(id_hex + 2 * i, 3, "%02x", id[i]);
+    id_hex[2 * id_len] = '\0';
+    if (dr_snprintf(path, MAXIMUM_PATH, "%s/%s.%d.%s", cache_dir, id_hex,
+                    mode, ext) < 0)
+        return false;
+    path[MAXIMUM_PATH - 1] = '\0';
+    return true;
+}
+
+static bool
+name_cache_load(dbg_module_t *mod, int mode)
+{
+    name_cache_t *cache = &mod->name_cache[mode];
+    char path[MAXIMUM_PATH];
+    name_cache_header_t *hdr;
+    uint64 file_size;
+    if (!name_cache_path(mod, mode, "symidx", path) || !dr_file_exists(path))
+        return false;
+    cache->fd = dr_open_file(path, DR_FILE_READ);
+    if (cache->fd == INVALID_FILE)
+        return false;
+    if (!dr_file_size(cache->fd, &file_size) || file_size < sizeof(*hdr))
+        goto error;
+    cache->map_size = (size_t) file_size;
+    cache->map_base = dr_map_file(cache->fd, &cache->map_size, 0, NULL,
+                                  DR_MEMPROT_READ, DR_MAP_PRIVATE);
+    if (cache->map_base == NULL || cache->map_size < file_size)
+        goto error;
+    hdr = (name_cache_header_t *) cache->map_base;
+    if (hdr->magic != NAME_CACHE_MAGIC || hdr->version != NAME_CACHE_VERSION ||
+        hdr->num_buckets == 0 || (hdr->num_buckets & (hdr->num_buckets - 1)) != 0 ||
+        hdr->strings_size == 0 ||
+        sizeof(*hdr) + (uint64)hdr->num_buckets * sizeof(name_cache_bucket_t) +
+        hdr->strings_size > file_size)
+        goto error;
+    NOTIFY("%s: using %s\n", __FUNCTION__, path);
+    return true;
+
+ error:
+    NOTIFY("%s: ignoring invalid cache file %s\n", __FUNCTION__, path);
+    if (cache->map_base != NULL)
+        dr_unmap_file(cache->map_base, cache->map_size);
+    cache->map_base = NULL;
+    dr_close_file(cache->fd);
+    return false;
+}
+
+static size_t
+name_cache_lookup(name_cache_t *cache, const char *name)
+{
+    name_cache_header_t *hdr = (name_cache_header_t *) cache->map_base;
+    name_cache_bucket_t *buckets = (name_cache_bucket_t *)(hdr + 1);
+    const char *strings = (const char *)(buckets + hdr->num_buckets);
+    uint mask = hdr->num_buckets - 1;
+    uint idx, probes;
+    for (idx = name_cache_hash(name) & mask, probes = 0;
+         probes < hdr->num_buckets;
+         idx = (idx + 1) & mask, probes++) {
+        name_cache_bucket_t *b = &buckets[idx];
+        if (b->name_offs == 0 || b->name_offs >= hdr->strings_size)
+            break;
+        if (strncmp(strings + b->name_offs, name,
+                    hdr->strings_size - b->name_offs) == 0)
+            return (size_t) b->modoffs;
+    }
+    return 0;
+}
+
+/* Failure to write the cache is not an error: we just keep the in-memory index. */
+static void
+name_cache_write(dbg_module_t *mod, int mode, hashtable_t *index)
+{
+    char path[MAXIMUM_PATH], tmp_path[MAXIMUM_PATH];
+    name_cache_header_t hdr;
+    name_cache_bucket_t *buckets;
+    char *strings;
+    size_t buckets_size, strings_size = 1;
+    uint num_buckets = 16, i;
+    file_t f;
+    bool ok;
+
+    if (!name_cache_path(mod, mode, "symidx", path))
+        return;
+    for (i = 0; i < HASHTABLE_SIZE(index->table_bits); i++) {
+        hash_entry_t *e;
+        for (e = index->table[i]; e != NULL; e = e->next)
+            strings_size += strlen((const char *)e->key) + 1;
+    }
+    if (strings_size > UINT_MAX)
+        return;
+    while (num_buckets < 2 * index->entries)
+        num_buckets *= 2;
+    buckets_size = num_buckets * sizeof(*buckets);
+    buckets = dr_global_alloc(buckets_size);
+    memset(buckets, 0, buckets_size);
+    strings = dr_global_alloc(strings_size);
+    strings[0] = '\0';
+    strings_size = 1;
+    for (i = 0; i < HASHTABLE_SIZE(index->table_bits); i++) {
+        hash_entry_t *e;
+        for (e = index->table[i]; e != NULL; e = e->next) {
+            const char *name = (const char *) e->key;
+            size_t len = strlen(name) + 1;
+            uint idx = name_cache_hash(name) & (num_buckets - 1);
+            while (buckets[idx].name_offs != 0)
+                idx = (idx + 1) & (num_buckets - 1);
+            buckets[idx].name_offs = (uint) strings_size;
+            buckets[idx].modoffs = (uint64)(ptr_uint_t) e->payload;
+            memcpy(strings + strings_size, name, len);
+            strings_size += len;
+        }
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = NAME_CACHE_MAGIC;
+    hdr.version = NAME_CACHE_VERSION;
+    hdr.num_buckets = num_buckets;
+    hdr.num_entries = index->entries;
+    hdr.strings_size = (uint) strings_size;
+
+    /* Write to a private file and rename so readers never see a partial file. */
+    dr_snprintf(tmp_path, BUFFER_SIZE_ELEMENTS(tmp_path), "%s.%d.tmp", path,
+                dr_get_process_id());
+    NULL_TERMINATE_BUFFER(tmp_path);
+    f = dr_open_file(tmp_path, DR_FILE_WRITE_OVERWRITE);
+    if (f != INVALID_FILE) {
+        ok = (dr_write_file(f, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+              dr_write_file(f, buckets, buckets_size) == buckets_size &&
+              dr_write_file(f, strings, strings_size) == strings_size);
+        dr_close_file(f);
+        if (ok && dr_rename_file(tmp_path, path, true/*replace*/))
+            NOTIFY("%s: wrote %s\n", __FUNCTION__, path);
+        else
+            dr_delete_file(tmp_path);
+    }
+    dr_global_free(strings, hdr.strings_size);
+    dr_global_free(buckets, buckets_size);
+}
+
+static drsym_error_t
+lookup_name(dbg_module_t *mod, uint flags, const char *name, size_t *modoffs OUT)
+{
+    int mode = name_index_mode(flags);
+    if (mod->name_cache[mode].map_base == NULL && mod->name_index[mode] == NULL &&
+        !name_cache_load(mod, mode)) {
+        drsym_error_t r = build_name_index(mod, flags);
+        if (r != DRSYM_SUCCESS)
+            return r;
+        name_cache_write(mod, mode, mod->name_index[mode]);
+    }
+    if (mod->name_cache[mode].map_base != NULL)
+        *modoffs = name_cache_lookup(&mod->name_cache[mode], name);
+    else
+        *modoffs = (size_t) hashtable_lookup(mod->name_index[mode], (void *)name);
+    return DRSYM_SUCCESS;
+}
+
+/******************************************************************************
+ * Demangled name cache
+ */
+
+static void
+demangle_cache_load(dbg_module_t *mod, int mode)
+{
+    demangle_cache_t *cache = &mod->demangle_cache[mode];
+    char path[MAXIMUM_PATH];
+    demangle_cache_header_t hdr;
+    size_t offs_size = cache->num_syms * sizeof(*cache->offs);
+    uint64 file_size;
+    file_t f;
+    bool ok = false;
+    if (!name_cache_path(mod, mode, "dmgl", path) || !dr_file_exists(path))
+        return;
+    f = dr_open_file(path, DR_FILE_READ);
+    if (f == INVALID_FILE)
+        return;
+    if (dr_file_size(f, &file_size) &&
+        dr_read_file(f, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+        hdr.magic == DEMANGLE_CACHE_MAGIC && hdr.version == DEMANGLE_CACHE_VERSION &&
+        hdr.num_syms == cache->num_syms && hdr.strings_size > 0 &&
+        sizeof(hdr) + offs_size + hdr.strings_size == file_size) {
+        char *strings = dr_global_alloc(hdr.strings_size);
+        if (dr_read_file(f, cache->offs, offs_size) == offs_size &&
+            dr_read_file(f, strings, hdr.strings_size) == hdr.strings_size &&
+            strings[hdr.strings_size - 1] == '\0') {
+            dr_global_free(cache->strings, cache->strings_alloc);
+            cache->strings = strings;
+            cache->strings_alloc = hdr.strings_size;
+            cache->strings_size = hdr.strings_size;
+            ok = true;
+        } else {
+            dr_global_free(strings, hdr.strings_size);
+            memset(cache->offs, 0, offs_size);
+        }
+    }
+    if (ok)
+        NOTIFY("%s: using %s\n", __FUNCTION__, path);
+    else
+        NOTIFY("%s: ignoring invalid cache file %s\n", __FUNCTION__, path);
+    dr_close_file(f);
+}
+
+static void
+demangle_cache_init(dbg_module_t *mod, int mode)
+{
+    demangle_cache_t *cache = &mod->demangle_cache[mode];
+    cache->num_syms = (uint) drsym_obj_num_symbols(mod->obj_info);
+    cache->offs = dr_global_alloc(cache->num_syms * sizeof(*cache->offs));
+    memset(cache->offs, 0, cache->num_syms * sizeof(*cache->offs));
+    cache->strings_alloc = DEMANGLE_CACHE_INIT_STRINGS;
+    cache->strings = dr_global_alloc(cache->strings_alloc);
+    cache->strings[0] = '\0';
+    cache->strings_size = 1;
+    cache->dirty = false;
+    demangle_cache_load(mod, mode);
+}
+
+/* Failure to write the cache is not an error: it will just be rebuilt. */
+static void
+demangle_cache_write(dbg_module_t *mod, int mode)
+{
+    demangle_cache_t *cache = &mod->demangle_cache[mode];
+    char path[MAXIMUM_PATH], tmp_path[MAXIMUM_PATH];
+    size_t offs_size = cache->num_syms * sizeof(*cache->offs);
+    demangle_cache_header_t hdr;
+    file_t f;
+    bool ok;
+    if (!name_cache_path(mod, mode, "dmgl", path))
+        return;
+    hdr.magic = DEMANGLE_CACHE_MAGIC;
+    hdr.version = DEMANGLE_CACHE_VERSION;
+    hdr.num_syms = cache->num_syms;
+    hdr.strings_size = (uint) cache->strings_size;
+    dr_snprintf(tmp_path, BUFFER_SIZE_ELEMENTS(tmp_path), "%s.%d.tmp", path,
+                dr_get_process_id());
+    NULL_TERMINATE_BUFFER(tmp_path);
+    f = dr_open_file(tmp_path, DR_FILE_WRITE_OVERWRITE);
+    if (f == INVALID_FILE)
+        return;
+    ok = (dr_write_file(f, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+          dr_write_file(f, cache->offs, offs_size) == offs_size &&
+          dr_write_file(f, cache->strings, cache->strings_size) == cache->strings_size);
+    dr_close_file(f);
+    if (ok && dr_rename_file(tmp_path, path, true/*replace*/))
+        NOTIFY("%s: wrote %s\n", __FUNCTION__, path);
+    else
+        dr_delete_file(tmp_path);
+}
+
+static void
+demangle_cache_free(dbg_module_t *mod, int mode)
+{
+    demangle_cache_t *cache = &mod->demangle_cache[mode];
+    if (cache->dirty)
+        demangle_cache_write(mod, mode);
+    dr_global_free(cache->offs, cache->num_syms * sizeof(*cache->offs));
+    dr_global_free(cache->strings, cache->strings_alloc);
+    cache->offs = NULL;
+}
+
+/* Returns a pointer to the cached demangled form of symbol idx, or NULL if
+ * mangled is not a mangled name.  The pointer is only valid until the next
+ * call, as the string pool may move.
+ */
+static const char *
+demangle_cached(dbg_module_t *mod, uint idx, const char *mangled, uint flags)
+{
+    int mode = name_index_mode(flags);
+    demangle_cache_t *cache = &mod->demangle_cache[mode];
+    char buf[1024];
+    char *name = buf;
+    size_t name_sz = sizeof(buf), len;
+    uint offs;
+
+    if (cache->offs == NULL)
+        demangle_cache_init(mod, mode);
+    if (idx >= cache->num_syms)
+        return NULL;
+    offs = cache->offs[idx];
+    if (offs == DEMANGLE_CACHE_FAILED)
+        return NULL;
+    if (offs != 0 && offs < cache->strings_size)
+        return cache->strings + offs;
+
+    /* Resize until it's big enough. */
+    while ((len = drsym_demangle_symbol(name, name_sz, mangled, flags)) > name_sz) {
+        if (name != buf)
+            dr_global_free(name, name_sz);
+        name_sz = len;
+        name = (char *) dr_global_alloc(name_sz);
+    }
+    cache->dirty = true;
+    if (len == 0 || cache->strings_size + len > DEMANGLE_CACHE_FAILED) {
+        cache->offs[idx] = DEMANGLE_CACHE_FAILED;
+        if (name != buf)
+            dr_global_free(name, name_sz);
+        return NULL;
+    }
+    len = strlen(name) + 1;
+    if (cache->strings_size + len > cache->strings_alloc) {
+        size_t new_alloc = cache->strings_alloc * 2;
+        char *strings;
+        while (cache->strings_size + len > new_alloc)
+            new_alloc *= 2;
+        strings = dr_global_alloc(new_alloc);
+        memcpy(strings, cache->strings, cache->strings_size);
+        dr_global_free(cache->strings, cache->strings_alloc);
+        cache->strings = strings;
+        cache->strings_alloc = new_alloc;
+    }
+    offs = (uint) cache->strings_size;
+    memcpy(cache->strings + offs, name, len);
+    cache->strings_size += len;
+    cache->offs[idx] = offs;
+    if (name != buf)
+        dr_global_free(name, name_sz);
+    return cache->strings + offs;
+}
+
+/******************************************************************************
+ * Batch demangling
+ */
+
+typedef struct _demangle_batch_t {
+    const char **mangled;
+    uint flags;
+    /* Indices of the first occurrence of each distinct name. */
+    size_t *todo;
+    size_t num_todo;
+    /* Demangled names indexed like mangled, NULL on failure or for duplicates. */
+    char **out;
+    size_t *out_sz;
+    uint num_threads;
+} demangle_batch_t;
+
+typedef struct _demangle_worker_t {
+    demangle_batch_t *batch;
+    uint start;
+} demangle_worker_t;
+
+static void *
+demangle_batch_worker(void *arg)
+{
+    demangle_worker_t *worker = (demangle_worker_t *) arg;
+    demangle_batch_t *batch = worker->batch;
+    size_t j;
+    for (j = worker->start; j < batch->num_todo; j += batch->num_threads) {
+        size_t i = batch->todo[j];
+        size_t sz = 256, len;
+        char *name = (char *) dr_global_alloc(sz);
+        while ((len = drsym_unix_demangle_symbol(name, sz, batch->mangled[i],
+                                                 batch->flags)) > sz) {
+            dr_global_free(name, sz);
+            sz = len;
+            name = (char *) dr_global_alloc(sz);
+        }
+        if (len == 0) {
+            dr_global_free(name, sz);
+            name = NULL;
+        }
+        batch->out[i] = name;
+        batch->out_sz[i] = sz;
+    }
+    return NULL;
+}
+
+static void
+demangle_batch_run(demangle_batch_t *batch)
+{
+    uint num_threads = batch->num_threads, t;
+    demangle_worker_t *workers;
+#ifndef WINDOWS
+    pthread_t *threads = NULL;
+    uint started = 1;
+#endif
+    if (num_threads == 0 || num_threads > batch->num_todo)
+        num_threads = batch->num_todo == 0 ? 1 : (uint) batch->num_todo;
+    batch->num_threads = num_threads;
+    workers = dr_global_alloc(num_threads * sizeof(*workers));
+    for (t = 0; t < num_threads; t++) {
+        workers[t].batch = batch;
+        workers[t].start = t;
+    }
+#ifndef WINDOWS
+    if (num_threads > 1 && pthread_create != NULL && pthread_join != NULL) {
+        threads = dr_global_alloc(num_threads * sizeof(*threads));
+        for (; started < num_threads; started++) {
+            if (pthread_create(&threads[started], NULL, demangle_batch_worker,
+                               &workers[started]) != 0)
+                break;
+        }
+    }
+    /* We take the share of any thread we failed to create. */
+    demangle_batch_worker(&workers[0]);
+    for (t = started; t < num_threads; t++)
+        demangle_batch_worker(&workers[t]);
+    for (t = 1; t < started; t++)
+        pthread_join(threads[t], NULL);
+    if (threads != NULL)
+        dr_global_free(threads, num_threads * sizeof(*threads));
+#else
+    for (t = 0; t < num_threads; t++)
+        demangle_batch_worker(&workers[t]);
+#endif
+    dr_global_free(workers, num_threads * sizeof(*workers));
+}
+
 /******************************************************************************
  * Exports
  */
@@ -466,34 +1072,18 @@ drsym_unix_enumerate_symbols(void *mod_in, drsym_enumerate_cb callback,
     return symsearch_symtab(mod, callback, callback_ex, info_size, data, flags);
 }
 
-/* Params to sym_lookup_cb passed through data. */
-typedef struct _sym_lookup_params_t {
-    const char *search_sym;
-    size_t search_sym_len;
-    size_t *modoffs;
-} sym_lookup_params_t;
-
-/* Symbol enumeration callback for doing a single lookup.
- */
-static bool
-sym_lookup_cb(const char *sym, size_t modoffs, void *data INOUT)
-{
-    sym_lookup_params_t *p = (sym_lookup_params_t*)data;
-
-    if (strncmp(sym, p->search_sym, p->search_sym_len) == 0 &&
-        strlen(sym) >= p->search_sym_len &&
-        (sym[p->search_sym_len] == '\0' ||
-         /* Left paren means the beginning of the parameter list.  Since the
-          * parameter list starts where our search string ends, we assume the
-          * user doesn't care about possible overloads.
-          */
-         sym[p->search_sym_len] == '(')) {
-        NOTIFY("Looked up symbol: %s %s\n", p->search_sym, sym);
-        *p->modoffs = modoffs;
-        /* Stop after the first match. */
-        return false;
+drsym_error_t
+drsym_unix_set_cache_dir(const char *dir)
+{
+    if (dir == NULL) {
+        cache_dir[0] = '\0';
+        return DRSYM_SUCCESS;
     }
-    return true;
+    if (!dr_directory_exists(dir) || strlen(dir) >= BUFFER_SIZE_ELEMENTS(cache_dir))
+        return DRSYM_ERROR_INVALID_PARAMETER;
+    strncpy(cache_dir, dir, BUFFER_SIZE_ELEMENTS(cache_dir));
+    NULL_TERMINATE_BUFFER(cache_dir);
+    return DRSYM_SUCCESS;
 }
 
 drsym_error_t
@@ -503,7 +1093,6 @@ drsym_unix_lookup_symbol(void *mod_in, const char *symbol, size_t *modoffs OUT,
     dbg_module_t *mod = (dbg_module_t *) mod_in;
     drsym_error_t r;
     const char *sym_no_mod;
-    sym_lookup_params_t params;
 
     if (symbol == NULL) {
         sym_no_mod = NULL;
@@ -534,13 +1123,10 @@ drsym_unix_lookup_symbol(void *mod_in, const char *symbol, size_t *modoffs OUT,
     }
 
     if (*modoffs == 0) {
-        params.search_sym = sym_no_mod;
-        params.search_sym_len = strlen(sym_no_mod);
-        params.modoffs = modoffs;
-        r = drsym_unix_enumerate_symbols(mod, sym_lookup_cb, NULL, sizeof(drsym_info_t),
-                                         &params, flags);
+        r = lookup_name(mod, flags, sym_no_mod, modoffs);
         if (r != DRSYM_SUCCESS)
             return r;
+        NOTIFY("Looked up symbol: %s => "PIFX"\n", sym_no_mod, *modoffs);
     }
     if (*modoffs == 0)
         return DRSYM_ERROR_SYMBOL_NOT_FOUND;
@@ -678,6 +1264,62 @@ drsym_unix_demangle_symbol(char *dst OUT, size_t dst_sz, const char *mangled,
     return 0;
 }
 
+drsym_error_t
+drsym_unix_demangle_symbols(const char **mangled, size_t count,
+                            drsym_demangle_symbols_cb callback, void *data,
+                            uint num_threads, uint flags)
+{
+    demangle_batch_t batch;
+    hashtable_t seen;
+    size_t i;
+
+    if ((mangled == NULL && count > 0) || callback == NULL)
+        return DRSYM_ERROR_INVALID_PARAMETER;
+    if (count == 0)
+        return DRSYM_SUCCESS;
+    memset(&batch, 0, sizeof(batch));
+    batch.mangled = mangled;
+    batch.flags = flags;
+    batch.num_threads = num_threads;
+    batch.todo = dr_global_alloc(count * sizeof(*batch.todo));
+    batch.out = dr_global_alloc(count * sizeof(*batch.out));
+    memset(batch.out, 0, count * sizeof(*batch.out));
+    batch.out_sz = dr_global_alloc(count * sizeof(*batch.out_sz));
+
+    /* Reports tend to repeat the same names so we only demangle each once.
+     * The payload is the first index plus one as NULL means not found.
+     */
+    hashtable_init_ex(&seen, NAME_INDEX_HASH_BITS, HASH_STRING,
+                      false/*!strdup*/, false/*!synch*/, NULL, NULL, NULL);
+    for (i = 0; i < count; i++) {
+        if (mangled[i] == NULL)
+            continue;
+        if (hashtable_add(&seen, (void *)mangled[i], (void *)(i + 1)))
+            batch.todo[batch.num_todo++] = i;
+    }
+    demangle_batch_run(&batch);
+
+    for (i = 0; i < count; i++) {
+        size_t first = i;
+        const char *name;
+        if (mangled[i] != NULL)
+            first = (size_t) hashtable_lookup(&seen, (void *)mangled[i]) - 1;
+        name = batch.out[first] != NULL ? batch.out[first] : mangled[i];
+        if (!callback(i, name, batch.out[first] != NULL, data))
+            break;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (batch.out[i] != NULL)
+            dr_global_free(batch.out[i], batch.out_sz[i]);
+    }
+    hashtable_delete(&seen);
+    dr_global_free(batch.out_sz, count * sizeof(*batch.out_sz));
+    dr_global_free(batch.out, count * sizeof(*batch.out));
+    dr_global_free(batch.todo, count * sizeof(*batch.todo));
+    return DRSYM_SUCCESS;
+}
+
 drsym_error_t
 drsym_unix_get_module_debug_kind(void *mod_in, drsym_debug_kind_t *kind OUT)
 {
@@ -156,6 +156,39 @@ drsym_lookup_address_local(const char *modpath, size_t modoffs,
     return r;
 }
 
+static drsym_error_t
+drsym_lookup_addresses_local(const char *modpath, const size_t *modoffs, size_t count,
+                             drsym_info_t *info INOUT,
+                             drsym_lookup_addresses_cb callback, void *data, uint flags)
+{
+    void *mod;
+    size_t i;
+
+    if (modpath == NULL || (modoffs == NULL && count > 0) || info == NULL ||
+        callback == NULL)
+        return DRSYM_ERROR_INVALID_PARAMETER;
+    if (info->struct_size != sizeof(*info))
+        return DRSYM_ERROR_INVALID_SIZE;
+
+    dr_recurlock_lock(symbol_lock);
+    mod = lookup_or_load(modpath);
+    if (mod == NULL) {
+        dr_recurlock_unlock(symbol_lock);
+        return DRSYM_ERROR_LOAD_FAILED;
+    }
+
+    recursive_context = true;
+    for (i = 0; i < count; i++) {
+        drsym_error_t r = drsym_unix_lookup_address(mod, modoffs[i], info, flags);
+        if (!callback(i, r, info, data))
+            break;
+    }
+    recursive_context = false;
+
+    dr_recurlock_unlock(symbol_lock);
+    return DRSYM_SUCCESS;
+}
+
 static drsym_error_t
 drsym_enumerate_lines_local(const char *modpath, drsym_enumerate_lines_cb callback,
                             void *data)
@@ -246,6 +279,20 @@ drsym_lookup_address(const char *modpath, size_t modoffs, drsym_info_t *out INOU
     }
 }
 
+DR_EXPORT
+drsym_error_t
+drsym_lookup_addresses(const char *modpath, const size_t *modoffs, size_t count,
+                       drsym_info_t *info INOUT, drsym_lookup_addresses_cb callback,
+                       void *data, uint flags)
+{
+    if (IS_SIDELINE) {
+        return DRSYM_ERROR_NOT_IMPLEMENTED;
+    } else {
+        return drsym_lookup_addresses_local(modpath, modoffs, count, info, callback,
+                                            data, flags);
+    }
+}
+
 DR_EXPORT
 drsym_error_t
 drsym_lookup_symbol(const char *modpath, const char *symbol, size_t *modoffs OUT,
@@ -318,6 +365,17 @@ drsym_demangle_symbol(char *dst OUT, size_t dst_sz, const char *mangled,
     return drsym_unix_demangle_symbol(dst, dst_sz, mangled, flags);
 }
 
+DR_EXPORT
+drsym_error_t
+drsym_demangle_symbols(const char **mangled, size_t count,
+                       drsym_demangle_symbols_cb callback, void *data,
+                       uint num_threads, uint flags)
+{
+    /* No module state is involved so we don't need symbol_lock. */
+    return drsym_unix_demangle_symbols(mangled, count, callback, data, num_threads,
+                                       flags);
+}
+
 DR_EXPORT
 drsym_error_t
 drsym_get_module_debug_kind(const char *modpath, drsym_debug_kind_t *kind OUT)
@@ -384,3 +442,16 @@ drsym_enumerate_lines(const char *modpath, drsym_enumerate_lines_cb callback, vo
         return drsym_enumerate_lines_local(modpath, callback, data);
     }
 }
+
+DR_EXPORT
+drsym_error_t
+drsym_set_cache_dir(const char *dir)
+{
+    drsym_error_t res;
+    if (IS_SIDELINE)
+        return DRSYM_ERROR_NOT_IMPLEMENTED;
+    dr_recurlock_lock(symbol_lock);
+    res = drsym_unix_set_cache_dir(dir);
+    dr_recurlock_unlock(symbol_lock);
+    return res;
+}
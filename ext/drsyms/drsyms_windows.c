@@ -1494,6 +1494,33 @@ drsym_lookup_address(const char *modpath, size_t modoffs, drsym_info_t *out INOU
     }
 }
 
+DR_EXPORT
+drsym_error_t
+drsym_lookup_addresses(const char *modpath, const size_t *modoffs, size_t count,
+                       drsym_info_t *info INOUT, drsym_lookup_addresses_cb callback,
+                       void *data, uint flags)
+{
+    size_t i;
+    if (IS_SIDELINE)
+        return DRSYM_ERROR_NOT_IMPLEMENTED;
+    if (modpath == NULL || (modoffs == NULL && count > 0) || info == NULL ||
+        callback == NULL)
+        return DRSYM_ERROR_INVALID_PARAMETER;
+    /* Hold the lock across the batch so we only pay for it once. */
+    dr_recurlock_lock(symbol_lock);
+    for (i = 0; i < count; i++) {
+        drsym_error_t r = drsym_lookup_address_local(modpath, modoffs[i], info, flags);
+        if (r == DRSYM_ERROR_INVALID_SIZE || r == DRSYM_ERROR_LOAD_FAILED) {
+            dr_recurlock_unlock(symbol_lock);
+            return r;
+        }
+        if (!callback(i, r, info, data))
+            break;
+    }
+    dr_recurlock_unlock(symbol_lock);
+    return DRSYM_SUCCESS;
+}
+
 DR_EXPORT
 drsym_error_t
 drsym_lookup_symbol(const char *modpath, const char *symbol, size_t *modoffs OUT,
@@ -1586,6 +1613,36 @@ drsym_demangle_symbol(char *dst OUT, size_t dst_sz, const char *mangled,
     return r;
 }
 
+DR_EXPORT
+drsym_error_t
+drsym_demangle_symbols(const char **mangled, size_t count,
+                       drsym_demangle_symbols_cb callback, void *data,
+                       uint num_threads, uint flags)
+{
+    /* dbghelp is single-threaded so we ignore num_threads. */
+    size_t i, buf_sz = 1024, len;
+    char *buf;
+    if ((mangled == NULL && count > 0) || callback == NULL)
+        return DRSYM_ERROR_INVALID_PARAMETER;
+    buf = dr_global_alloc(buf_sz);
+    for (i = 0; i < count; i++) {
+        if (mangled[i] == NULL) {
+            if (!callback(i, NULL, false, data))
+                break;
+            continue;
+        }
+        while ((len = drsym_demangle_symbol(buf, buf_sz, mangled[i], flags)) > buf_sz) {
+            dr_global_free(buf, buf_sz);
+            buf_sz = len;
+            buf = dr_global_alloc(buf_sz);
+        }
+        if (!callback(i, len == 0 ? mangled[i] : buf, len != 0, data))
+            break;
+    }
+    dr_global_free(buf, buf_sz);
+    return DRSYM_SUCCESS;
+}
+
 /* The routine returns type info in drsym_type_t structure by type_id and
  * expands subtypes. The caller can pass 0 in levels_to_expand arg to avoid
  * subtypes expanding. The caller should lock symbol_lock before call this routine.
@@ -1915,3 +1972,16 @@ drsym_enumerate_lines(const char *modpath, drsym_enumerate_lines_cb callback, vo
         return drsym_enumerate_lines_local(modpath, callback, data);
     }
 }
+
+DR_EXPORT
+drsym_error_t
+drsym_set_cache_dir(const char *dir)
+{
+    drsym_error_t res;
+    if (IS_SIDELINE)
+        return DRSYM_ERROR_NOT_IMPLEMENTED;
+    dr_recurlock_lock(symbol_lock);
+    res = drsym_unix_set_cache_dir(dir);
+    dr_recurlock_unlock(symbol_lock);
+    return res;
+}
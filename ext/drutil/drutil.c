@@ -25,6 +25,8 @@
 
 #include "dr_api.h"
 #include "drmgr.h"
+#include "drutil.h"
+#include <string.h>
 
 /* currently using asserts on internal logic sanity checks (never on
  * input from user)
@@ -64,6 +66,28 @@
 
 static int drutil_init_count;
 
+#ifdef X86_64
+/* Raw TLS slots holding the state an expanded gather spills (see
+ * drutil_expand_gather()).  GATHER_SLOT_LIVE holds the gather's app pc
+ * while the spilled values are live so the restore event can find them.
+ */
+enum {
+    GATHER_SLOT_LIVE,
+    GATHER_SLOT_XAX,
+    GATHER_SLOT_XCX,
+    GATHER_SLOT_FLAGS,
+    GATHER_SLOT_YMM, /* a whole ymm register: 32 bytes */
+    GATHER_SLOT_COUNT = GATHER_SLOT_YMM + 32 / sizeof(void *),
+};
+static reg_id_t gather_tls_seg;
+static uint gather_tls_offs;
+static bool gather_tls_ok;
+
+static bool
+drutil_event_restore_state(void *drcontext, bool restore_memory,
+                           dr_restore_state_info_t *info);
+#endif
+
 DR_EXPORT
 bool
 drutil_init(void)
@@ -73,7 +97,15 @@ drutil_init(void)
     if (count > 1)
         return true;
 
-    /* nothing yet: but putting in API up front in case need later */
+#ifdef X86_64
+    if (!drmgr_init())
+        return false;
+    /* Without the slots drutil_expand_gather() leaves gathers alone. */
+    gather_tls_ok = dr_raw_tls_calloc(&gather_tls_seg, &gather_tls_offs,
+                                      GATHER_SLOT_COUNT, 0);
+    if (gather_tls_ok)
+        drmgr_register_restore_state_ex_event(drutil_event_restore_state);
+#endif
 
     return true;
 }
@@ -87,7 +119,14 @@ drutil_exit(void)
     if (count != 0)
         return;
 
-    /* nothing yet: but putting in API up front in case need later */
+#ifdef X86_64
+    if (gather_tls_ok) {
+        drmgr_unregister_restore_state_ex_event(drutil_event_restore_state);
+        dr_raw_tls_cfree(gather_tls_offs, GATHER_SLOT_COUNT);
+        gather_tls_ok = false;
+    }
+    drmgr_exit();
+#endif
 }
 
 /***************************************************************************
@@ -363,6 +402,119 @@ drutil_insert_get_mem_addr_arm(void *drcontext, instrlist_t *bb, instr_t *where,
 }
 #endif /* X86/ARM */
 
+/* Splits memref into the displacement and a key holding everything else,
+ * returning whether its address can be derived from another with the
+ * same key by adding the difference in displacements.
+ */
+static bool
+mem_addr_split(opnd_t memref, opnd_t *key OUT, int *disp OUT)
+{
+    if (!opnd_is_base_disp(memref))
+        return false;
+#ifdef X86
+    /* xlat is computed via xax and is not worth the trouble */
+    if (opnd_get_index(memref) == DR_REG_AL)
+        return false;
+#elif defined(ARM)
+    /* the negated flag covers the index too, and pc and the stolen register
+     * take special handling
+     */
+    if (opnd_get_index(memref) != DR_REG_NULL ||
+        opnd_get_base(memref) == DR_REG_PC ||
+        opnd_get_base(memref) == dr_get_stolen_reg())
+        return false;
+#endif
+    *disp = opnd_get_disp(memref);
+    if (TEST(DR_OPND_NEGATED, opnd_get_flags(memref)))
+        *disp = -*disp;
+    *key = memref;
+    opnd_set_size(key, OPSZ_lea);
+    opnd_set_disp_ex(key, 0, false, false, false);
+    return true;
+}
+
+/* Returns whether nothing from cache->where up to where can have changed
+ * the registers that the cached address depends on.
+ */
+static bool
+mem_addr_cache_valid(drutil_mem_addr_cache_t *cache, instr_t *where, reg_id_t dst)
+{
+    instr_t *inst;
+    int i;
+    if (cache->where == NULL || cache->dst != dst)
+        return false;
+    for (inst = cache->where; inst != where; inst = instr_get_next(inst)) {
+        if (inst == NULL)
+            return false;
+        if (instr_writes_to_reg(inst, dst, DR_QUERY_INCLUDE_ALL))
+            return false;
+        for (i = 0; i < opnd_num_regs_used(cache->key); i++) {
+            if (instr_writes_to_reg(inst, opnd_get_reg_used(cache->key, i),
+                                    DR_QUERY_INCLUDE_ALL))
+                return false;
+        }
+#ifdef X86
+        if (opnd_is_far_base_disp(cache->key) &&
+            instr_writes_to_reg(inst, opnd_get_segment(cache->key),
+                                DR_QUERY_INCLUDE_ALL))
+            return false;
+#endif
+    }
+    return true;
+}
+
+DR_EXPORT
+void
+drutil_mem_addr_cache_reset(drutil_mem_addr_cache_t *cache)
+{
+    cache->where = NULL;
+    cache->key = opnd_create_null();
+    cache->disp = 0;
+    cache->dst = DR_REG_NULL;
+}
+
+DR_EXPORT
+bool
+drutil_insert_get_mem_addr_cached(void *drcontext, instrlist_t *bb, instr_t *where,
+                                  opnd_t memref, reg_id_t dst, reg_id_t scratch,
+                                  drutil_mem_addr_cache_t *cache)
+{
+    opnd_t key;
+    int disp;
+    bool cacheable = mem_addr_split(memref, &key, &disp) &&
+        /* computing the address must not clobber a register it depends on */
+        !opnd_uses_reg(memref, dst);
+    if (cacheable && mem_addr_cache_valid(cache, where, dst) &&
+        opnd_same(key, cache->key)) {
+        int delta = disp - cache->disp;
+        instr_t *add = NULL;
+        if (delta != 0) {
+            add = XINST_CREATE_add(drcontext, opnd_create_reg(dst),
+                                   OPND_CREATE_INT32(delta));
+        }
+        if (add == NULL || instr_is_encoding_possible(add)) {
+            if (add != NULL)
+                PRE(bb, where, add);
+            cache->where = where;
+            cache->disp = disp;
+            return true;
+        }
+        instr_destroy(drcontext, add);
+    }
+    if (!drutil_insert_get_mem_addr(drcontext, bb, where, memref, dst, scratch)) {
+        drutil_mem_addr_cache_reset(cache);
+        return false;
+    }
+    if (cacheable) {
+        cache->where = where;
+        cache->key = key;
+        cache->disp = disp;
+        cache->dst = dst;
+    } else
+        drutil_mem_addr_cache_reset(cache);
+    return true;
+}
+
 DR_EXPORT
 uint
 drutil_opnd_mem_size_in_bytes(opnd_t memref, instr_t *inst)
@@ -581,3 +733,346 @@ drutil_expand_rep_string(void *drcontext, instrlist_t *bb)
 {
     return drutil_expand_rep_string_ex(drcontext, bb, NULL, NULL);
 }
+
+/***************************************************************************
+ * GATHER EXPANSION
+ */
+
+#ifdef X86_64
+/* The flags saved by lahf into ah, and the one saved by seto into al */
+# define LAHF_FLAGS_MASK 0xd5
+# define EFLAGS_OF_BIT   0x800
+
+typedef struct _gather_info_t {
+    reg_id_t dst;    /* xmm or ymm, as used by the gather */
+    reg_id_t index;
+    reg_id_t mask;
+    opnd_size_t index_size;
+    opnd_size_t elem_size;
+    uint num_elems;
+    /* A ymm register not used by the gather, spilled while we use its low half
+     * to reach the upper lanes.  DR_REG_NULL if the gather has no upper lanes.
+     */
+    reg_id_t scratch;
+} gather_info_t;
+
+static reg_id_t
+reg_as_xmm(reg_id_t reg)
+{
+    return reg_is_ymm(reg) ? reg - DR_REG_START_YMM + DR_REG_START_XMM : reg;
+}
+
+static reg_id_t
+reg_as_ymm(reg_id_t reg)
+{
+    return reg_is_ymm(reg) ? reg : reg - DR_REG_START_XMM + DR_REG_START_YMM;
+}
+
+static opnd_t
+gather_slot(uint slot, opnd_size_t size)
+{
+    return opnd_create_far_base_disp(gather_tls_seg, DR_REG_NULL, DR_REG_NULL, 0,
+                                     gather_tls_offs + slot * sizeof(void *), size);
+}
+
+static bool
+gather_get_info(instr_t *instr, gather_info_t *info)
+{
+    opnd_t memop;
+    reg_id_t reg;
+    switch (instr_get_opcode(instr)) {
+    case OP_vpgatherdd:
+    case OP_vgatherdps:
+        info->index_size = OPSZ_4;
+        info->elem_size = OPSZ_4;
+        break;
+    case OP_vpgatherdq:
+    case OP_vgatherdpd:
+        info->index_size = OPSZ_4;
+        info->elem_size = OPSZ_8;
+        break;
+    case OP_vpgatherqd:
+    case OP_vgatherqps:
+        info->index_size = OPSZ_8;
+        info->elem_size = OPSZ_4;
+        break;
+    case OP_vpgatherqq:
+    case OP_vgatherqpd:
+        info->index_size = OPSZ_8;
+        info->elem_size = OPSZ_8;
+        break;
+    default:
+        return false;
+    }
+    /* As in DR's VSIB handling: the VSIB memop is the 1st source and the mask
+     * register is the 2nd source.
+     */
+    memop = instr_get_src(instr, 0);
+    if (!opnd_is_base_disp(memop))
+        return false;
+    info->dst = opnd_get_reg(instr_get_dst(instr, 0));
+    info->index = opnd_get_index(memop);
+    info->mask = opnd_get_reg(instr_get_src(instr, 1));
+    /* DR's IR uses ymm for all three registers of a 256-bit gather even
+     * when only an xmm is accessed.
+     */
+    if (info->index_size == OPSZ_8 && info->elem_size == OPSZ_4) {
+        /* the hardware only writes an xmm dst and mask, zeroing the rest */
+        info->dst = reg_as_xmm(info->dst);
+        info->mask = reg_as_xmm(info->mask);
+    }
+    if (info->index_size == OPSZ_4 && info->elem_size == OPSZ_4)
+        info->num_elems = reg_is_ymm(info->index) ? 8 : 4;
+    else
+        info->num_elems = reg_is_ymm(info->index) ? 4 : 2;
+    info->scratch = DR_REG_NULL;
+    if (reg_is_ymm(info->dst) || reg_is_ymm(info->index)) {
+        for (reg = DR_REG_START_YMM; reg <= DR_REG_STOP_YMM; reg++) {
+            if (reg != reg_as_ymm(info->dst) && reg != reg_as_ymm(info->index) &&
+                reg != reg_as_ymm(info->mask)) {
+                info->scratch = reg;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+/* Inserts the low elem_size bytes of gpr as element elem of vreg, leaving
+ * the rest of vreg alone (beyond the zeroing of the upper ymm half that an
+ * xmm-sized gather performs anyway).
+ */
+static void
+gather_insert_elem(void *drcontext, instrlist_t *bb, instr_t *where,
+                   gather_info_t *info, reg_id_t vreg, uint elem, reg_id_t gpr)
+{
+    uint per_lane = 16 / opnd_size_in_bytes(info->elem_size);
+    uint lane = elem / per_lane;
+    opnd_t pos = OPND_CREATE_INT8(elem % per_lane);
+    opnd_t src = opnd_create_reg(reg_resize_to_opsz(gpr, info->elem_size));
+    if (!reg_is_ymm(vreg)) {
+        PRE(bb, where, INSTR_CREATE_vpinsrd(drcontext, opnd_create_reg(vreg),
+                                            opnd_create_reg(vreg), src, pos));
+    } else {
+        opnd_t xmm = opnd_create_reg(reg_as_xmm(info->scratch));
+        if (lane == 0) {
+            PRE(bb, where, INSTR_CREATE_vpinsrd(drcontext, xmm,
+                                                opnd_create_reg(reg_as_xmm(vreg)),
+                                                src, pos));
+        } else {
+            PRE(bb, where, INSTR_CREATE_vextracti128(drcontext, xmm,
+                                                     opnd_create_reg(vreg),
+                                                     OPND_CREATE_INT8(1)));
+            PRE(bb, where, INSTR_CREATE_vpinsrd(drcontext, xmm, xmm, src, pos));
+        }
+        /* DR's IR for vinserti128 names the source by its ymm register */
+        PRE(bb, where, INSTR_CREATE_vinserti128(drcontext, opnd_create_reg(vreg),
+                                                opnd_create_reg(vreg),
+                                                opnd_create_reg(info->scratch),
+                                                OPND_CREATE_INT8(lane)));
+    }
+}
+
+/* Replaces the gather instr with a sequence of its own:
+ *
+ *    spill xax, xcx, and the flags to TLS; store the gather's pc to the live slot
+ *    spill the scratch ymm to TLS, if needed
+ *    vmovmskp[sd] mask -> ecx
+ *  for each element i:
+ *    test ecx, 1<<i; jz skip_i
+ *    extract index element i -> xax (sign-extending a dword)
+ *    mov [base + xax*scale + disp] -> xax   (the only app instrs)
+ *    insert xax into dst element i
+ *    insert 0 into mask element i
+ *  skip_i:
+ *  zero the mask, and the upper part of an xmm-sized dst
+ *  restore the scratch ymm; clear the live slot; restore the flags, xcx, xax
+ *
+ * Clearing each mask element as it completes mirrors the hardware, so if
+ * an element load faults the gather can be restarted from the saved state
+ * once drutil_event_restore_state() has put back the spilled registers.
+ */
+static bool
+gather_expand(void *drcontext, instrlist_t *bb, instr_t *inst)
+{
+    gather_info_t info;
+    app_pc xl8 = instr_get_app_pc(inst);
+    opnd_t memop = instr_get_src(inst, 0);
+    reg_id_t base = opnd_get_base(memop);
+    instr_t *first, *second;
+    uint i;
+    if (!gather_get_info(inst, &info))
+        return false;
+    /* we need xax and xcx as scratch */
+    if (base == DR_REG_XAX || base == DR_REG_XCX)
+        return false;
+
+    PRE(bb, inst, INSTR_CREATE_mov_st(drcontext, gather_slot(GATHER_SLOT_XAX, OPSZ_8),
+                                      opnd_create_reg(DR_REG_XAX)));
+    PRE(bb, inst, INSTR_CREATE_mov_st(drcontext, gather_slot(GATHER_SLOT_XCX, OPSZ_8),
+                                      opnd_create_reg(DR_REG_XCX)));
+    PRE(bb, inst, INSTR_CREATE_lahf(drcontext));
+    PRE(bb, inst, INSTR_CREATE_setcc(drcontext, OP_seto, opnd_create_reg(DR_REG_AL)));
+    PRE(bb, inst, INSTR_CREATE_mov_st(drcontext,
+                                      gather_slot(GATHER_SLOT_FLAGS, OPSZ_8),
+                                      opnd_create_reg(DR_REG_XAX)));
+    instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)xl8,
+                                     opnd_create_reg(DR_REG_XAX), bb, inst,
+                                     &first, &second);
+    instr_set_meta(first);
+    if (second != NULL)
+        instr_set_meta(second);
+    PRE(bb, inst, INSTR_CREATE_mov_st(drcontext, gather_slot(GATHER_SLOT_LIVE, OPSZ_8),
+                                      opnd_create_reg(DR_REG_XAX)));
+    if (info.scratch != DR_REG_NULL) {
+        PRE(bb, inst, INSTR_CREATE_vmovdqu(drcontext,
+                                           gather_slot(GATHER_SLOT_YMM, OPSZ_32),
+                                           opnd_create_reg(info.scratch)));
+    }
+    if (info.elem_size == OPSZ_4) {
+        PRE(bb, inst, INSTR_CREATE_vmovmskps(drcontext, opnd_create_reg(DR_REG_XCX),
+                                             opnd_create_reg(info.mask)));
+    } else {
+        PRE(bb, inst, INSTR_CREATE_vmovmskpd(drcontext, opnd_create_reg(DR_REG_XCX),
+                                             opnd_create_reg(info.mask)));
+    }
+
+    for (i = 0; i < info.num_elems; i++) {
+        instr_t *skip = INSTR_CREATE_label(drcontext);
+        uint per_lane = 16 / opnd_size_in_bytes(info.index_size);
+        opnd_t index = opnd_create_reg(reg_as_xmm(info.index));
+        opnd_t elem;
+        PRE(bb, inst, INSTR_CREATE_test(drcontext, opnd_create_reg(DR_REG_ECX),
+                                        OPND_CREATE_INT32(1 << i)));
+        PRE(bb, inst, INSTR_CREATE_jcc(drcontext, OP_jz, opnd_create_instr(skip)));
+        if (i >= per_lane) {
+            index = opnd_create_reg(reg_as_xmm(info.scratch));
+            PRE(bb, inst, INSTR_CREATE_vextracti128(drcontext, index,
+                                                    opnd_create_reg(info.index),
+                                                    OPND_CREATE_INT8(1)));
+        }
+        if (info.index_size == OPSZ_4) {
+            PRE(bb, inst, INSTR_CREATE_vpextrd(drcontext, opnd_create_reg(DR_REG_EAX),
+                                               index, OPND_CREATE_INT8(i % per_lane)));
+            PRE(bb, inst, INSTR_CREATE_movsxd(drcontext, opnd_create_reg(DR_REG_XAX),
+                                              opnd_create_reg(DR_REG_EAX)));
+        } else {
+            PRE(bb, inst, INSTR_CREATE_vpextrd(drcontext, opnd_create_reg(DR_REG_XAX),
+                                               index, OPND_CREATE_INT8(i % per_lane)));
+        }
+        elem = opnd_create_far_base_disp(opnd_get_segment(memop), base, DR_REG_XAX,
+                                         opnd_get_scale(memop), opnd_get_disp(memop),
+                                         info.elem_size);
+        PREXL8(bb, inst, INSTR_XL8(INSTR_CREATE_mov_ld
+                                   (drcontext, opnd_create_reg
+                                    (reg_resize_to_opsz(DR_REG_XAX, info.elem_size)),
+                                    elem), xl8));
+        gather_insert_elem(drcontext, bb, inst, &info, info.dst, i, DR_REG_XAX);
+        PRE(bb, inst, INSTR_CREATE_mov_imm(drcontext, opnd_create_reg(DR_REG_EAX),
+                                           OPND_CREATE_INT32(0)));
+        gather_insert_elem(drcontext, bb, inst, &info, info.mask, i, DR_REG_XAX);
+        PRE(bb, inst, skip);
+    }
+
+    PRE(bb, inst, INSTR_CREATE_vpxor(drcontext, opnd_create_reg(info.mask),
+                                     opnd_create_reg(info.mask),
+                                     opnd_create_reg(info.mask)));
+    if (!reg_is_ymm(info.dst)) {
+        /* a VEX.128 move zeroes the upper ymm half even if no element was
+         * loaded, and a 2-element qd gather also zeroes dst bits 127:64
+         */
+        if (info.index_size == OPSZ_8 && info.elem_size == OPSZ_4 &&
+            info.num_elems == 2) {
+            PRE(bb, inst, INSTR_CREATE_vmovq(drcontext, opnd_create_reg(info.dst),
+                                             opnd_create_reg(info.dst)));
+        } else {
+            PRE(bb, inst, INSTR_CREATE_vmovdqa(drcontext, opnd_create_reg(info.dst),
+                                               opnd_create_reg(info.dst)));
+        }
+    }
+    if (info.scratch != DR_REG_NULL) {
+        PRE(bb, inst, INSTR_CREATE_vmovdqu(drcontext, opnd_create_reg(info.scratch),
+                                           gather_slot(GATHER_SLOT_YMM, OPSZ_32)));
+    }
+    PRE(bb, inst, INSTR_CREATE_mov_st(drcontext, gather_slot(GATHER_SLOT_LIVE, OPSZ_8),
+                                      OPND_CREATE_INT32(0)));
+    PRE(bb, inst, INSTR_CREATE_mov_ld(drcontext, opnd_create_reg(DR_REG_XAX),
+                                      gather_slot(GATHER_SLOT_FLAGS, OPSZ_8)));
+    PRE(bb, inst, INSTR_CREATE_add(drcontext, opnd_create_reg(DR_REG_AL),
+                                   OPND_CREATE_INT8(0x7f)));
+    PRE(bb, inst, INSTR_CREATE_sahf(drcontext));
+    PRE(bb, inst, INSTR_CREATE_mov_ld(drcontext, opnd_create_reg(DR_REG_XCX),
+                                      gather_slot(GATHER_SLOT_XCX, OPSZ_8)));
+    PRE(bb, inst, INSTR_CREATE_mov_ld(drcontext, opnd_create_reg(DR_REG_XAX),
+                                      gather_slot(GATHER_SLOT_XAX, OPSZ_8)));
+
+    instrlist_remove(bb, inst);
+    instr_destroy(drcontext, inst);
+    return true;
+}
+
+/* Puts back the registers spilled by an expanded gather whose element load
+ * faulted, so the translated state is the one at the start of the gather.
+ * XXX: we read the TLS of the current thread, which is not the target
+ * thread when another thread is being relocated (e.g., by dr_suspend_all_
+ * other_threads()).
+ */
+static bool
+drutil_event_restore_state(void *drcontext, bool restore_memory,
+                           dr_restore_state_info_t *info)
+{
+    ptr_uint_t *slots = (ptr_uint_t *)
+        ((byte *)dr_get_dr_segment_base(gather_tls_seg) + gather_tls_offs);
+    dr_mcontext_t *mc = info->mcontext;
+    gather_info_t ginfo;
+    instr_t instr;
+    if (slots[GATHER_SLOT_LIVE] == 0 || slots[GATHER_SLOT_LIVE] != (ptr_uint_t)mc->pc)
+        return true;
+    instr_init(drcontext, &instr);
+    if (decode(drcontext, mc->pc, &instr) != NULL && gather_get_info(&instr, &ginfo)) {
+        ptr_uint_t flags = slots[GATHER_SLOT_FLAGS];
+        mc->xax = slots[GATHER_SLOT_XAX];
+        mc->xcx = slots[GATHER_SLOT_XCX];
+        mc->xflags = (mc->xflags & ~(LAHF_FLAGS_MASK | EFLAGS_OF_BIT)) |
+            ((flags >> 8) & LAHF_FLAGS_MASK) | ((flags & 0xff) != 0 ? EFLAGS_OF_BIT : 0);
+        if (ginfo.scratch != DR_REG_NULL && TEST(DR_MC_MULTIMEDIA, mc->flags)) {
+            memcpy(&mc->ymm[ginfo.scratch - DR_REG_START_YMM],
+                   &slots[GATHER_SLOT_YMM], sizeof(dr_ymm_t));
+        }
+        /* execution resumes at the start of the gather */
+        if (restore_memory)
+            slots[GATHER_SLOT_LIVE] = 0;
+    }
+    instr_free(drcontext, &instr);
+    return true;
+}
+#endif /* X86_64 */
+
+DR_EXPORT
+bool
+drutil_expand_gather(void *drcontext, instrlist_t *bb, bool *expanded OUT)
+{
+#ifdef X86_64
+    instr_t *inst, *next_inst;
+#endif
+
+    if (drmgr_current_bb_phase(drcontext) != DRMGR_PHASE_APP2APP) {
+        USAGE_ERROR("drutil_expand_gather must be called from "
+                    "drmgr's app2app phase");
+        return false;
+    }
+    if (expanded != NULL)
+        *expanded = false;
+
+#ifdef X86_64
+    if (!gather_tls_ok)
+        return true;
+    for (inst = instrlist_first(bb); inst != NULL; inst = next_inst) {
+        next_inst = instr_get_next(inst);
+        if (instr_is_app(inst) && gather_expand(drcontext, bb, inst) &&
+            expanded != NULL)
+            *expanded = true;
+    }
+#endif
+    return true;
+}
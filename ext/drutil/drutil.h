@@ -91,6 +91,55 @@ bool
 drutil_insert_get_mem_addr(void *drcontext, instrlist_t *bb, instr_t *where,
                            opnd_t memref, reg_id_t dst, reg_id_t scratch);
 
+/**
+ * Records the last address computed by drutil_insert_get_mem_addr_cached()
+ * so that later memory references in the same block with the same base,
+ * index, scale, and segment can reuse it.
+ */
+typedef struct _drutil_mem_addr_cache_t {
+    /** The instruction before which the cached address was computed. */
+    instr_t *where;
+    /** The memory reference whose address is cached, with a zero displacement. */
+    opnd_t key;
+    /** The displacement included in the cached address. */
+    int disp;
+    /** The register holding the cached address. */
+    reg_id_t dst;
+} drutil_mem_addr_cache_t;
+
+DR_EXPORT
+/**
+ * Empties \p cache.  Must be called before the first use of \p cache
+ * in each basic block.
+ */
+void
+drutil_mem_addr_cache_reset(drutil_mem_addr_cache_t *cache);
+
+DR_EXPORT
+/**
+ * Identical to drutil_insert_get_mem_addr() except that, when \p dst
+ * already holds the address of an earlier memory reference that differs
+ * from \p memref only in its displacement, a single add of the
+ * displacement difference is inserted instead of the full computation.
+ * This is intended for tracing every memory reference in a block, e.g.,
+ * into a drx_buf buffer, where the same base register is used with many
+ * displacements.
+ *
+ * Reuse only happens if no instruction from the one passed as \p where to
+ * the previous call up to this \p where writes \p dst or any register used
+ * by \p memref, which this routine checks by walking \p bb.  Thus
+ * \p dst must be a register that the caller keeps reserved for this
+ * purpose, and any restore or other write of \p dst must already be in
+ * \p bb when this routine is called.  \p cache must be passed to
+ * drutil_mem_addr_cache_reset() at the start of each block.
+ *
+ * \return whether successful.
+ */
+bool
+drutil_insert_get_mem_addr_cached(void *drcontext, instrlist_t *bb, instr_t *where,
+                                  opnd_t memref, reg_id_t dst, reg_id_t scratch,
+                                  drutil_mem_addr_cache_t *cache);
+
 DR_EXPORT
 /**
  * Returns the size of the memory reference \p memref in bytes.
@@ -153,6 +202,41 @@ bool
 drutil_expand_rep_string_ex(void *drcontext, instrlist_t *bb, OUT bool *expanded,
                             OUT instr_t **stringop);
 
+DR_EXPORT
+/**
+ * Expands each AVX2 gather instruction (vpgatherdd, vgatherdps, and the
+ * other vpgather and vgather variants) in \p bb into a sequence of scalar
+ * loads, one per element, guarded by that element's mask bit.  The
+ * sequence has the same effect as the gather.  It fills in the destination
+ * element by element and clears the mask as elements complete, just like
+ * the hardware.  Because the scalar loads are regular application
+ * instructions with plain base-plus-index memory operands, per-operand
+ * instrumentation such as drutil_insert_get_mem_addr() covers each element
+ * that the gather accesses.  Each load's translation is the gather's
+ * address.
+ *
+ * The sequence uses xax, xcx, the arithmetic flags, and, for 256-bit
+ * gathers, a ymm register not used by the gather.  It spills them to
+ * thread-local storage that drutil_init() reserves.  If an element load
+ * faults, the spilled values are put back in the translated machine state.
+ * Gathers whose base register is xax or xcx are left alone, as are all
+ * gathers on 32-bit or ARM.  AVX-512 scatters and masked moves are not
+ * handled.
+ *
+ * The client must use the \p drmgr Extension and call this function from
+ * the application-to-application ("app2app") stage (see
+ * drmgr_register_bb_app2app_event()).  The transformation is
+ * deterministic, so the caller can return DR_EMIT_DEFAULT from its event.
+ *
+ * @param[in]  drcontext   The opaque context
+ * @param[in]  bb          Instruction list passed to the app2app event
+ * @param[out] expanded    Whether any expansion occurred
+ *
+ * \return whether successful.
+ */
+bool
+drutil_expand_gather(void *drcontext, instrlist_t *bb, OUT bool *expanded);
+
 
 /*@}*/ /* end doxygen group */
 
@@ -28,7 +28,9 @@
 #include "drwrap.h"
 #include "drmgr.h"
 #include "hashtable.h"
+#include "drpool.h"
 #include "drvector.h"
+#include "../ext_utils.h"
 #include <string.h>
 #include <stddef.h> /* offsetof */
 #include <limits.h> /* USHRT_MAX */
@@ -107,6 +109,47 @@ byte *
 get_cur_xsp(void);
 #endif
 
+/***************************************************************************
+ * LOCK-FREE PRESENCE FILTERS
+ */
+
+/* Block building looks up every app pc in our tables, and nearly all of those
+ * lookups miss.  Each table has a bitmap filter that is read without a lock:
+ * a clear bit means the pc is definitely absent.  Bits are only set, under a
+ * lock and before the entry is added, so a racy read at worst sees a
+ * miss that is ordered before a concurrent add.  Removals leave their bits set,
+ * so stale bits just fall back to the locked lookup.  The LSB is ignored so
+ * that i#1689's decorated and normalized pcs share a bit.
+ */
+#define PC_FILTER_BITS 14
+#define PC_FILTER_WORDS ((1 << PC_FILTER_BITS) / 32)
+
+typedef struct _pc_filter_t {
+    volatile uint bits[PC_FILTER_WORDS];
+} pc_filter_t;
+
+static inline uint
+pc_filter_index(app_pc pc)
+{
+    ptr_uint_t val = ((ptr_uint_t)pc) >> 1;
+    return (uint)((val ^ (val >> PC_FILTER_BITS)) & ((1 << PC_FILTER_BITS) - 1));
+}
+
+/* caller must hold the lock that serializes additions to the filter's table */
+static inline void
+pc_filter_add(pc_filter_t *filter, app_pc pc)
+{
+    uint idx = pc_filter_index(pc);
+    filter->bits[idx / 32] |= (1U << (idx % 32));
+}
+
+static inline bool
+pc_filter_maybe_contains(pc_filter_t *filter, app_pc pc)
+{
+    uint idx = pc_filter_index(pc);
+    return TEST(1U << (idx % 32), filter->bits[idx / 32]);
+}
+
 /***************************************************************************
  * REQUEST TRACKING
  */
@@ -115,6 +158,7 @@ get_cur_xsp(void);
 #define REPLACE_TABLE_HASH_BITS 6
 /* i#1689: we store the decorated (LSB=1) pc (passed from client) in the table */
 static hashtable_t replace_table;
+static pc_filter_t replace_filter;
 
 /* Native replacements need to store the stack adjust and user data */
 typedef struct _replace_native_t {
@@ -127,6 +171,7 @@ typedef struct _replace_native_t {
 #define REPLACE_NATIVE_TABLE_HASH_BITS 6
 /* i#1689: we store the decorated (LSB=1) pc (passed from client) in the table */
 static hashtable_t replace_native_table;
+static pc_filter_t replace_native_filter;
 
 static void
 replace_native_free(void *v)
@@ -151,12 +196,18 @@ typedef struct _wrap_entry_t {
      */
     drwrap_callconv_t callconv;
     void *user_data;
+    /* For drwrap_wrap_fast(): pre_cb and post_cb are NULL and instead fast_cb
+     * is called directly from the code cache with fast_num_args args.
+     */
+    void *fast_cb;
+    uint fast_num_args;
     struct _wrap_entry_t *next;
 } wrap_entry_t;
 
 #define WRAP_TABLE_HASH_BITS 6
 /* i#1689: we store the decorated (LSB=1) pc (passed from client) in the table */
 static hashtable_t wrap_table;
+static pc_filter_t wrap_filter;
 /* We need recursive locking on the table to support drwrap_unwrap
  * being called from a post event so we use this lock instead of
  * hashtable_lock(&wrap_table)
@@ -190,6 +241,24 @@ static int tls_idx;
 /* Lazy removal and flushing.  Protected by wrap_lock. */
 static uint disabled_count;
 
+/* Flushes of wrap targets are coalesced into a few regions: flushing some
+ * extra fragments costs far less than the thread synchronization of each
+ * separate flush.
+ */
+#define FLUSH_MAX_RANGES 64
+/* Targets closer than this to an existing region are merged into it. */
+#define FLUSH_MERGE_GAP (64 * 1024)
+
+typedef struct _flush_range_t {
+    app_pc start;
+    app_pc end;
+} flush_range_t;
+
+/* Flushes deferred by drwrap_begin_batch().  Protected by wrap_lock. */
+static uint batch_depth;
+static flush_range_t batch_ranges[FLUSH_MAX_RANGES];
+static uint batch_num_ranges;
+
 /* i#1713: per-thread state, similar to where_am_i_t */
 typedef enum _drwrap_where_t {
     DRWRAP_WHERE_OUTSIDE_CALLBACK,
@@ -267,6 +336,7 @@ static hashtable_t call_site_table;
 /* i#1689: we store the aligned (LSB=0) pc here */
 static hashtable_t post_call_table;
 static void *post_call_rwlock;
+static pc_filter_t post_call_filter;
 
 typedef struct _post_call_entry_t {
     /* PR 454616: we need two flags in the post_call_table: one that
@@ -287,6 +357,9 @@ typedef struct _post_call_entry_t {
     byte prior[POST_CALL_PRIOR_BYTES_STORED];
 } post_call_entry_t;
 
+/* Entries are small and numerous: we avoid a DR heap header on each. */
+static void *post_call_pool;
+
 /* Support for external post-call caching */
 typedef struct _post_call_notify_t {
     void (*cb)(app_pc);
@@ -308,14 +381,14 @@ post_call_entry_free(void *v)
 {
     post_call_entry_t *e = (post_call_entry_t *) v;
     ASSERT(e != NULL, "invalid hashtable deletion");
-    dr_global_free(e, sizeof(*e));
+    drpool_free(post_call_pool, e);
 }
 
 /* caller must hold write lock */
 static post_call_entry_t *
 post_call_entry_add(app_pc postcall, bool external)
 {
-    post_call_entry_t *e = (post_call_entry_t *) dr_global_alloc(sizeof(*e));
+    post_call_entry_t *e = (post_call_entry_t *) drpool_alloc(post_call_pool);
     ASSERT(dr_rwlock_self_owns_write_lock(post_call_rwlock), "must hold write lock");
     e->existing_instrumented = false;
     if (!fast_safe_read(postcall - POST_CALL_PRIOR_BYTES_STORED,
@@ -323,6 +396,7 @@ post_call_entry_add(app_pc postcall, bool external)
         /* notify client somehow?  we'll carry on and invalidate on next bb */
         memset(e->prior, 0, sizeof(e->prior));
     }
+    pc_filter_add(&post_call_filter, postcall);
     hashtable_add(&post_call_table, (void*)postcall, (void*)e);
     if (!external && post_call_notify_list != NULL) {
         post_call_notify_t *cb = post_call_notify_list;
@@ -359,6 +433,8 @@ static bool
 post_call_lookup(app_pc pc)
 {
     bool res = false;
+    if (!pc_filter_maybe_contains(&post_call_filter, pc))
+        return false;
     dr_rwlock_read_lock(post_call_rwlock);
     res = (hashtable_lookup(&post_call_table, (void*)pc) != NULL);
     dr_rwlock_read_unlock(post_call_rwlock);
@@ -372,6 +448,8 @@ post_call_lookup_for_instru(app_pc pc)
 {
     bool res = false;
     post_call_entry_t *e;
+    if (!pc_filter_maybe_contains(&post_call_filter, pc))
+        return false;
     dr_rwlock_read_lock(post_call_rwlock);
     e = (post_call_entry_t *) hashtable_lookup(&post_call_table, (void*)pc);
     if (e != NULL) {
@@ -924,6 +1002,7 @@ drwrap_init(void)
                       NULL, NULL);
     hashtable_init_ex(&call_site_table, CALL_SITE_TABLE_HASH_BITS, HASH_INTPTR,
                       false/*!strdup*/, false/*!synch*/, NULL, NULL, NULL);
+    post_call_pool = drpool_create(NULL, sizeof(post_call_entry_t), 0, true/*synch*/);
     hashtable_init_ex(&post_call_table, POST_CALL_TABLE_HASH_BITS, HASH_INTPTR,
                       false/*!str_dup*/, false/*!synch*/, post_call_entry_free,
                       NULL, NULL);
@@ -976,8 +1055,11 @@ drwrap_exit(void)
     hashtable_delete(&wrap_table);
     hashtable_delete(&call_site_table);
     hashtable_delete(&post_call_table);
+    drpool_destroy(post_call_pool);
     dr_rwlock_destroy(post_call_rwlock);
     dr_recurlock_destroy(wrap_lock);
+    batch_depth = 0;
+    batch_num_ranges = 0;
     drmgr_exit();
 
     while (post_call_notify_list != NULL) {
@@ -1146,7 +1228,7 @@ drwrap_is_replaced_native(app_pc func)
 }
 
 static bool
-drwrap_replace_common(hashtable_t *table,
+drwrap_replace_common(hashtable_t *table, pc_filter_t *filter,
                       app_pc original, void *payload, bool override, bool force_flush)
 {
     bool res = true;
@@ -1161,6 +1243,12 @@ drwrap_replace_common(hashtable_t *table,
             res = hashtable_remove(table, (void *)original);
         }
     } else {
+        /* The table's own lock is not recursive so we use the wrap lock to
+         * serialize filter updates.
+         */
+        dr_recurlock_lock(wrap_lock);
+        pc_filter_add(filter, original);
+        dr_recurlock_unlock(wrap_lock);
         if (override) {
             flush = (hashtable_add_replace(table, (void *)original, payload) != NULL);
         } else
@@ -1184,7 +1272,8 @@ DR_EXPORT
 bool
 drwrap_replace(app_pc original, app_pc replacement, bool override)
 {
-    return drwrap_replace_common(&replace_table, original, replacement, override, false);
+    return drwrap_replace_common(&replace_table, &replace_filter, original, replacement,
+                                 override, false);
 }
 
 DR_EXPORT
@@ -1208,7 +1297,8 @@ drwrap_replace_native(app_pc original, app_pc replacement, bool at_entry,
         rn->user_data = user_data;
     }
     hashtable_lock(&replace_native_table);
-    res = drwrap_replace_common(&replace_native_table, original, rn, override,
+    res = drwrap_replace_common(&replace_native_table, &replace_native_filter,
+                                original, rn, override,
                                 /* i#1438: if we're not at the entry, we'd better
                                  * flush to ensure we replace.  If this is done at
                                  * module load, the flush will be empty and will cost
@@ -1462,14 +1552,15 @@ drwrap_event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
          */
         pc = dr_app_pc_as_jump_target(instr_get_isa_mode(inst), instr_get_app_pc(inst));
         /* non-native takes precedence */
-        if (replace_table.entries > 0) {
+        if (replace_table.entries > 0 && pc_filter_maybe_contains(&replace_filter, pc)) {
             replace = hashtable_lookup(&replace_table, pc);
             if (replace != NULL) {
                 drwrap_replace_bb(drcontext, bb, inst, pc, replace);
                 break;
             }
         }
-        if (replace_native_table.entries > 0) {
+        if (replace_native_table.entries > 0 &&
+            pc_filter_maybe_contains(&replace_native_filter, pc)) {
             replace_native_t *rn;
             hashtable_lock(&replace_native_table);
             rn = hashtable_lookup(&replace_native_table, pc);
@@ -1597,17 +1688,114 @@ drwrap_replace_native_fini(void *drcontext)
  * FUNCTION WRAPPING
  */
 
+static size_t
+flush_range_distance(flush_range_t *range, app_pc pc)
+{
+    if (pc < range->start)
+        return range->start - pc;
+    if (pc >= range->end)
+        return pc + 1 - range->end;
+    return 0;
+}
+
+/* Adds pc to the nearest range within FLUSH_MERGE_GAP, or to a new range.
+ * Once all max_ranges are used the nearest range is simply extended.
+ */
 static void
-drwrap_flush_func(app_pc func)
+flush_ranges_add(flush_range_t *ranges, uint *num_ranges, uint max_ranges, app_pc pc)
+{
+    uint i, best = 0;
+    size_t best_dist = (size_t)-1;
+    for (i = 0; i < *num_ranges; i++) {
+        size_t dist = flush_range_distance(&ranges[i], pc);
+        if (dist < best_dist) {
+            best_dist = dist;
+            best = i;
+        }
+    }
+    if (best_dist > FLUSH_MERGE_GAP && *num_ranges < max_ranges) {
+        ranges[*num_ranges].start = pc;
+        ranges[*num_ranges].end = pc + 1;
+        (*num_ranges)++;
+        return;
+    }
+    if (pc < ranges[best].start)
+        ranges[best].start = pc;
+    if (pc + 1 > ranges[best].end)
+        ranges[best].end = pc + 1;
+}
+
+static void
+drwrap_flush_ranges(flush_range_t *ranges, uint num_ranges)
 {
+    dr_flush_region_t regions[FLUSH_MAX_RANGES];
+    uint i;
     /* we can't flush while holding the lock.
      * we do not guarantee faster than a lazy flush.
      */
     ASSERT(!dr_recurlock_self_owns(wrap_lock), "cannot hold lock while flushing");
-    if (!dr_unlink_flush_region(func, 1))
+    ASSERT(num_ranges <= FLUSH_MAX_RANGES, "too many flush ranges");
+    if (num_ranges == 0)
+        return;
+    for (i = 0; i < num_ranges; i++) {
+        regions[i].start = ranges[i].start;
+        regions[i].size = ranges[i].end - ranges[i].start;
+    }
+    /* One synchronization for all of them */
+    if (!dr_unlink_flush_regions(regions, num_ranges))
         ASSERT(false, "wrap update flush failed");
 }
 
+/* Flushes func from the code cache, or defers it to drwrap_end_batch(). */
+static void
+drwrap_flush_func(app_pc func)
+{
+    flush_range_t range;
+    dr_recurlock_lock(wrap_lock);
+    if (batch_depth > 0) {
+        flush_ranges_add(batch_ranges, &batch_num_ranges, FLUSH_MAX_RANGES, func);
+        dr_recurlock_unlock(wrap_lock);
+        return;
+    }
+    dr_recurlock_unlock(wrap_lock);
+    range.start = func;
+    range.end = func + 1;
+    drwrap_flush_ranges(&range, 1);
+}
+
+DR_EXPORT
+void
+drwrap_begin_batch(void)
+{
+    dr_recurlock_lock(wrap_lock);
+    batch_depth++;
+    dr_recurlock_unlock(wrap_lock);
+}
+
+DR_EXPORT
+bool
+drwrap_end_batch(void)
+{
+    flush_range_t ranges[FLUSH_MAX_RANGES];
+    uint num_ranges;
+    dr_recurlock_lock(wrap_lock);
+    if (batch_depth == 0) {
+        dr_recurlock_unlock(wrap_lock);
+        return false;
+    }
+    batch_depth--;
+    if (batch_depth > 0) {
+        dr_recurlock_unlock(wrap_lock);
+        return true;
+    }
+    num_ranges = batch_num_ranges;
+    memcpy(ranges, batch_ranges, num_ranges * sizeof(ranges[0]));
+    batch_num_ranges = 0;
+    dr_recurlock_unlock(wrap_lock);
+    drwrap_flush_ranges(ranges, num_ranges);
+    return true;
+}
+
 #ifdef X86
 static app_pc
 get_retaddr_at_entry(reg_t xsp)
@@ -2054,12 +2242,16 @@ drwrap_after_callee_func(void *drcontext, per_thread_t *pt, dr_mcontext_t *mc,
         dr_set_mcontext(drcontext, wrapcxt.mc);
 
     if (do_flush) {
-        /* handle delayed flushes while holding no lock
-         * XXX: optimization: combine nearby addresses to reduce # flushes
+        /* handle delayed flushes while holding no lock, combining nearby
+         * addresses to reduce the number of flushes
          */
-        uint i;
-        for (i = 0; i < toflush.entries; i++)
-            drwrap_flush_func((app_pc)toflush.array[i]);
+        flush_range_t ranges[FLUSH_MAX_RANGES];
+        uint i, num_ranges = 0;
+        for (i = 0; i < toflush.entries; i++) {
+            flush_ranges_add(ranges, &num_ranges, FLUSH_MAX_RANGES,
+                             (app_pc)toflush.array[i]);
+        }
+        drwrap_flush_ranges(ranges, num_ranges);
         drvector_delete(&toflush);
     }
 
@@ -2141,12 +2333,115 @@ drwrap_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
     return DR_EMIT_DEFAULT;
 }
 
+/* Returns an operand for argument #arg at the entry to a function with
+ * calling convention callconv, mirroring drwrap_arg_addr().
+ */
+static opnd_t
+drwrap_arg_opnd_at_entry(drwrap_callconv_t callconv, uint arg)
+{
+    reg_id_t reg = DR_REG_NULL;
+    uint reg_arg_count = 0, stack_arg_offset = 0;
+    switch (callconv) {
+#ifdef ARM /* registers are platform-exclusive */
+    case DRWRAP_CALLCONV_ARM: {
+        static const reg_id_t regs[] = {DR_REG_R0, DR_REG_R1, DR_REG_R2, DR_REG_R3};
+        if (arg < BUFFER_SIZE_ELEMENTS(regs))
+            reg = regs[arg];
+        reg_arg_count = BUFFER_SIZE_ELEMENTS(regs);
+        break;
+    }
+#else /* Intel x86 or x64 */
+# ifdef X64 /* registers are platform-exclusive */
+    case DRWRAP_CALLCONV_AMD64: {
+        static const reg_id_t regs[] = {DR_REG_RDI, DR_REG_RSI, DR_REG_RDX,
+                                        DR_REG_RCX, DR_REG_R8, DR_REG_R9};
+        if (arg < BUFFER_SIZE_ELEMENTS(regs))
+            reg = regs[arg];
+        reg_arg_count = BUFFER_SIZE_ELEMENTS(regs);
+        stack_arg_offset = 1/*retaddr*/;
+        break;
+    }
+    case DRWRAP_CALLCONV_MICROSOFT_X64: {
+        static const reg_id_t regs[] = {DR_REG_RCX, DR_REG_RDX, DR_REG_R8, DR_REG_R9};
+        if (arg < BUFFER_SIZE_ELEMENTS(regs))
+            reg = regs[arg];
+        reg_arg_count = BUFFER_SIZE_ELEMENTS(regs);
+        stack_arg_offset = 1/*retaddr*/ + 4/*reserved*/;
+        break;
+    }
+# endif
+    case DRWRAP_CALLCONV_CDECL:
+        stack_arg_offset = 1/*retaddr*/;
+        break;
+    case DRWRAP_CALLCONV_FASTCALL:
+        if (arg == 0)
+            reg = DR_REG_XCX;
+        else if (arg == 1)
+            reg = DR_REG_XDX;
+        reg_arg_count = 2;
+        stack_arg_offset = 1/*retaddr*/;
+        break;
+    case DRWRAP_CALLCONV_THISCALL:
+        if (arg == 0)
+            reg = DR_REG_XCX;
+        reg_arg_count = 1;
+        stack_arg_offset = 1/*retaddr*/;
+        break;
+#endif
+    default:
+        ASSERT(false, "unknown or unsupported calling convention");
+        return OPND_CREATE_INTPTR(0);
+    }
+    if (reg != DR_REG_NULL)
+        return opnd_create_reg(reg);
+    return OPND_CREATE_MEMPTR(DR_REG_XSP,
+                              (arg - reg_arg_count + stack_arg_offset) * sizeof(reg_t));
+}
+
+/* Inserts a call to a drwrap_wrap_fast() callback.  We pass the requested
+ * args directly and do not set up a drwrap_context_t or dr_mcontext_t, so
+ * that simple callbacks are eligible for clean call inlining.
+ */
+static void
+drwrap_insert_fast_call(void *drcontext, instrlist_t *bb, instr_t *inst,
+                        wrap_entry_t *wrap)
+{
+    opnd_t args[DRWRAP_FAST_MAX_ARGS];
+    uint i;
+    dr_cleancall_save_t flags = TEST(DRWRAP_FAST_CLEANCALLS, global_flags) ?
+        (DR_CLEANCALL_NOSAVE_FLAGS|DR_CLEANCALL_NOSAVE_XMM_NONPARAM) : 0;
+    ASSERT(wrap->fast_num_args <= DRWRAP_FAST_MAX_ARGS, "too many fast args");
+    for (i = 0; i < wrap->fast_num_args; i++)
+        args[i] = drwrap_arg_opnd_at_entry(wrap->callconv, i);
+    switch (wrap->fast_num_args) {
+    case 0:
+        dr_insert_clean_call_ex(drcontext, bb, inst, wrap->fast_cb, flags, 0);
+        break;
+    case 1:
+        dr_insert_clean_call_ex(drcontext, bb, inst, wrap->fast_cb, flags, 1, args[0]);
+        break;
+    case 2:
+        dr_insert_clean_call_ex(drcontext, bb, inst, wrap->fast_cb, flags, 2,
+                                args[0], args[1]);
+        break;
+    case 3:
+        dr_insert_clean_call_ex(drcontext, bb, inst, wrap->fast_cb, flags, 3,
+                                args[0], args[1], args[2]);
+        break;
+    case 4:
+        dr_insert_clean_call_ex(drcontext, bb, inst, wrap->fast_cb, flags, 4,
+                                args[0], args[1], args[2], args[3]);
+        break;
+    }
+}
+
 static dr_emit_flags_t
 drwrap_event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
                        bool for_trace, bool translating, void *user_data)
 {
     /* XXX: if we had dr_bbs_cross_ctis() query (i#427) we could just check 1st instr */
     wrap_entry_t *wrap;
+    bool locked;
     /* i#1689: we store in drwrap_table as the original from the client (which
      * may have LSB=1), as well as in wrapcxt.  We then clear LSB for all other
      * uses, including all postcall uses.
@@ -2158,8 +2453,27 @@ drwrap_event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *ins
      * and flush, under the assumption that we won't have already seen the
      * return point and so won't have to incur the cost of a flush very often
      */
-    dr_recurlock_lock(wrap_lock);
-    wrap = hashtable_lookup(&wrap_table, (void *)pc);
+    locked = pc_filter_maybe_contains(&wrap_filter, pc);
+    if (locked) {
+        dr_recurlock_lock(wrap_lock);
+        wrap = hashtable_lookup(&wrap_table, (void *)pc);
+    } else
+        wrap = NULL;
+    if (wrap != NULL) {
+        /* Fast wraps get their own lean call.  We only need the full
+         * drwrap_in_callee() machinery if there is a regular wrap.
+         */
+        bool need_full = false;
+        wrap_entry_t *e;
+        for (e = wrap; e != NULL; e = e->next) {
+            if (e->fast_cb == NULL)
+                need_full = true;
+            else if (e->enabled)
+                drwrap_insert_fast_call(drcontext, bb, inst, e);
+        }
+        if (!need_full)
+            wrap = NULL;
+    }
     if (wrap != NULL) {
         void *arg1 = TEST(DRWRAP_NO_FRILLS, global_flags) ? (void *)wrap : (void *) pc;
         /* i#690: do not bother saving registers that should be scratch at
@@ -2178,7 +2492,8 @@ drwrap_event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *ins
                                 opnd_create_reg(DR_REG_XSP)
                                 _IF_ARM(opnd_create_reg(DR_REG_LR)));
     }
-    dr_recurlock_unlock(wrap_lock);
+    if (locked)
+        dr_recurlock_unlock(wrap_lock);
 
     if (post_call_lookup_for_instru(instr_get_app_pc(inst)/*normalized*/)) {
         /* XXX: for DRWRAP_FAST_CLEANCALLS we must preserve state b/c
@@ -2227,6 +2542,7 @@ drwrap_wrap_ex(app_pc func,
                void *user_data, uint flags)
 {
     wrap_entry_t *wrap_cur, *wrap_new;
+    bool flush = false;
 
     /* allow one side to be NULL (i#562) */
     if (func == NULL || (pre_func_cb == NULL && post_func_cb == NULL))
@@ -2243,6 +2559,8 @@ drwrap_wrap_ex(app_pc func,
     wrap_new->enabled = true;
     wrap_new->user_data = user_data;
     wrap_new->flags = EXCLUDE_CALLCONV(flags);
+    wrap_new->fast_cb = NULL;
+    wrap_new->fast_num_args = 0;
     wrap_new->callconv = EXTRACT_CALLCONV(flags);
     if (wrap_new->callconv == 0)
         wrap_new->callconv = DRWRAP_CALLCONV_DEFAULT;
@@ -2282,15 +2600,14 @@ drwrap_wrap_ex(app_pc func,
         hashtable_add_replace(&wrap_table, (void *)func, (void *)wrap_new);
     } else {
         wrap_new->next = NULL;
+        pc_filter_add(&wrap_filter, func);
         hashtable_add(&wrap_table, (void *)func, (void *)wrap_new);
         /* XXX: we're assuming void* tag == pc */
-        if (dr_fragment_exists_at(dr_get_current_drcontext(), func)) {
-            /* we do not guarantee faster than a lazy flush */
-            if (!dr_unlink_flush_region(func, 1))
-                ASSERT(false, "wrap update flush failed");
-        }
+        flush = dr_fragment_exists_at(dr_get_current_drcontext(), func);
     }
     dr_recurlock_unlock(wrap_lock);
+    if (flush)
+        drwrap_flush_func(func);
     return true;
 }
 
@@ -2303,6 +2620,92 @@ drwrap_wrap(app_pc func,
     return drwrap_wrap_ex(func, pre_func_cb, post_func_cb, NULL, DRWRAP_CALLCONV_DEFAULT);
 }
 
+DR_EXPORT
+bool
+drwrap_wrap_fast(app_pc func, void *pre_func_cb, uint num_args, uint flags)
+{
+    wrap_entry_t *wrap_cur, *wrap_new, *e;
+
+    if (func == NULL || pre_func_cb == NULL || num_args > DRWRAP_FAST_MAX_ARGS)
+        return false;
+
+    dr_recurlock_lock(wrap_lock);
+    wrap_cur = hashtable_lookup(&wrap_table, (void *)func);
+    for (e = wrap_cur; e != NULL; e = e->next) {
+        if (e->fast_cb == pre_func_cb) {
+            /* Re-enable and update the existing request */
+            bool changed = (!e->enabled || e->fast_num_args != num_args ||
+                            e->callconv != EXTRACT_CALLCONV(flags));
+            e->enabled = true;
+            e->fast_num_args = num_args;
+            e->flags = EXCLUDE_CALLCONV(flags);
+            e->callconv = EXTRACT_CALLCONV(flags);
+            if (e->callconv == 0)
+                e->callconv = DRWRAP_CALLCONV_DEFAULT;
+            dr_recurlock_unlock(wrap_lock);
+            /* The call is inlined in the code cache so we must flush */
+            if (changed)
+                drwrap_flush_func(func);
+            return true;
+        }
+        if (TEST(DRWRAP_NO_FRILLS, global_flags) && e->enabled) {
+            /* more than one wrap of same address is not allowed */
+            dr_recurlock_unlock(wrap_lock);
+            return false;
+        }
+    }
+
+    wrap_new = dr_global_alloc(sizeof(*wrap_new));
+    memset(wrap_new, 0, sizeof(*wrap_new));
+    wrap_new->func = func;
+    wrap_new->enabled = true;
+    wrap_new->flags = EXCLUDE_CALLCONV(flags);
+    wrap_new->callconv = EXTRACT_CALLCONV(flags);
+    if (wrap_new->callconv == 0)
+        wrap_new->callconv = DRWRAP_CALLCONV_DEFAULT;
+    wrap_new->fast_cb = pre_func_cb;
+    wrap_new->fast_num_args = num_args;
+    if (TEST(DRWRAP_NO_FRILLS, global_flags) && wrap_cur != NULL) {
+        /* free whole chain of disabled entries */
+        wrap_entry_free(wrap_cur);
+        wrap_cur = NULL;
+    }
+    wrap_new->next = wrap_cur;
+    pc_filter_add(&wrap_filter, func);
+    hashtable_add_replace(&wrap_table, (void *)func, (void *)wrap_new);
+    dr_recurlock_unlock(wrap_lock);
+    /* XXX: we're assuming void* tag == pc */
+    if (dr_fragment_exists_at(dr_get_current_drcontext(), func))
+        drwrap_flush_func(func);
+    return true;
+}
+
+DR_EXPORT
+bool
+drwrap_unwrap_fast(app_pc func, void *pre_func_cb)
+{
+    wrap_entry_t *wrap;
+    bool res = false;
+    if (func == NULL || pre_func_cb == NULL)
+        return false;
+    dr_recurlock_lock(wrap_lock);
+    for (wrap = hashtable_lookup(&wrap_table, (void *)func); wrap != NULL;
+         wrap = wrap->next) {
+        if (wrap->fast_cb == pre_func_cb && wrap->enabled) {
+            wrap->enabled = false;
+            res = true;
+            break;
+        }
+    }
+    dr_recurlock_unlock(wrap_lock);
+    /* Unlike regular wraps, whose callbacks check the enabled flag, the call is
+     * in the code cache so we must flush it.
+     */
+    if (res)
+        drwrap_flush_func(func);
+    return res;
+}
+
 DR_EXPORT
 bool
 drwrap_unwrap(app_pc func,
@@ -414,6 +414,75 @@ drwrap_wrap_ex(app_pc func,
                void (*post_func_cb)(void *wrapcxt, void *user_data),
                void *user_data, uint flags);
 
+/** The maximum number of arguments passed to a drwrap_wrap_fast() callback. */
+#define DRWRAP_FAST_MAX_ARGS 4
+
+DR_EXPORT
+/**
+ * Requests a lightweight pre-function callback for \p func.  Rather
+ * than going through drwrap's full pre-function machinery, which
+ * builds a wrap context and tracks the call for post-function
+ * callbacks, \p pre_func_cb is called directly from the code cache
+ * at the entry of \p func, the same way as a callee passed to
+ * dr_insert_clean_call().  It receives the first \p num_args
+ * arguments of \p func, at most #DRWRAP_FAST_MAX_ARGS, as
+ * pointer-sized integer parameters, read according to the calling
+ * convention in \p flags (see #drwrap_callconv_t).  A callback that
+ * takes at most one argument and is simple enough can be inlined by
+ * DR's clean call optimizations.
+ *
+ * There is no post-function callback, no wrap context, and no support
+ * for drwrap_skip_call() or drwrap_set_arg().  The DRWRAP_FAST_CLEANCALLS
+ * global flag is honored.  Requesting the same \p pre_func_cb again
+ * updates \p num_args and \p flags.  Fast and regular wraps of the
+ * same function can coexist.
+ *
+ * \return whether successful.
+ */
+bool
+drwrap_wrap_fast(app_pc func, void *pre_func_cb, uint num_args, uint flags);
+
+DR_EXPORT
+/**
+ * Removes a wrap previously requested with drwrap_wrap_fast().  As the
+ * callback is called directly from the code cache, this flushes the
+ * code for \p func.
+ *
+ * \return whether successful.
+ */
+bool
+drwrap_unwrap_fast(app_pc func, void *pre_func_cb);
+
+DR_EXPORT
+/**
+ * Starts a batch of wrap requests.  Until the matching drwrap_end_batch(),
+ * drwrap_wrap_ex(), drwrap_wrap_fast(), and drwrap_unwrap_fast() do not
+ * flush targets already present in the code cache, but record them, and
+ * drwrap_end_batch() then flushes all of them at once over a few merged
+ * regions.  Each flush synchronizes with all threads, so batching speeds
+ * up wrapping many functions at once, such as every export of a library
+ * loaded at attach time or by dlopen.
+ *
+ * Batches may nest: only the outermost drwrap_end_batch() flushes.  The
+ * batch is process-wide, so wraps requested by other threads meanwhile are
+ * deferred as well.  A wrap of code that is in the code cache does not
+ * take effect there until the batch ends.
+ */
+void
+drwrap_begin_batch(void);
+
+DR_EXPORT
+/**
+ * Ends a batch of wrap requests started by drwrap_begin_batch(), flushing
+ * the targets of the batch's requests that were in the code cache.  Flushed
+ * regions may include nearby code that was not wrapped.  As with any flush,
+ * the caller must not hold locks that application threads may need.
+ *
+ * \return false if no batch was open.
+ */
+bool
+drwrap_end_batch(void);
+
 DR_EXPORT
 /**
  * Removes a previously-requested wrap for the function \p func
@@ -35,7 +35,9 @@
 #include "dr_api.h"
 #include "drx.h"
 #include "hashtable.h"
+#include "drvector.h"
 #include "../ext_utils.h"
+#include <string.h>
 
 /* We use drmgr but only internally.  A user of drx will end up loading in
  * the drmgr library, but it won't affect the user's code.
@@ -74,6 +76,8 @@ enum {
     DRX_NOTE_AFLAGS_RESTORE_BEGIN,
     DRX_NOTE_AFLAGS_RESTORE_SAHF,
     DRX_NOTE_AFLAGS_RESTORE_END,
+    DRX_NOTE_AFLAGS_SAVE_BEGIN,
+    DRX_NOTE_AFLAGS_SAVE_END,
     DRX_NOTE_COUNT,
 };
 static ptr_uint_t note_base;
@@ -83,6 +87,25 @@ static bool soft_kills_enabled;
 
 static void soft_kills_exit(void);
 
+/* drx_buf.c */
+bool drx_buf_init_library(void);
+void drx_buf_exit_library(void);
+
+static bool sharded_counter_init(void);
+static void sharded_counter_exit(void);
+
+static bool sampler_init(void);
+static void sampler_exit(void);
+
+static void levels_init(void);
+static void levels_exit(void);
+
+#ifdef X86
+static dr_emit_flags_t
+drx_event_merge_aflags(void *drcontext, void *tag, instrlist_t *bb,
+                       bool for_trace, bool translating);
+#endif
+
 /* For debugging */
 static uint verbose = 0;
 
@@ -110,8 +133,20 @@ drx_init(void)
     drmgr_init();
     note_base = drmgr_reserve_note_range(DRX_NOTE_COUNT);
     ASSERT(note_base != DRMGR_NOTE_NONE, "failed to reserve note range");
+#ifdef X86
+    {
+        /* Run after everyone else's instru2instru so we see the final list */
+        drmgr_priority_t pri_merge = {sizeof(pri_merge), DRMGR_PRIORITY_NAME_DRX_MERGE,
+                                      NULL, NULL, DRMGR_PRIORITY_INSTRU2INSTRU_DRX_MERGE};
+        if (!drmgr_register_bb_instru2instru_event(drx_event_merge_aflags, &pri_merge))
+            return false;
+    }
+#endif
+    if (!sharded_counter_init() || !sampler_init())
+        return false;
+    levels_init();
 
-    return true;
+    return drx_buf_init_library();
 }
 
 DR_EXPORT
@@ -125,6 +160,13 @@ drx_exit()
     if (soft_kills_enabled)
         soft_kills_exit();
 
+#ifdef X86
+    drmgr_unregister_bb_instru2instru_event(drx_event_merge_aflags);
+#endif
+    drx_buf_exit_library();
+    levels_exit();
+    sampler_exit();
+    sharded_counter_exit();
     drmgr_exit();
 }
 
@@ -219,6 +261,8 @@ drx_save_arith_flags(void *drcontext, instrlist_t *ilist, instr_t *where,
 {
 #ifdef X86
     instr_t *instr;
+    ilist_insert_note_label(drcontext, ilist, where,
+                            NOTE_VAL(DRX_NOTE_AFLAGS_SAVE_BEGIN));
     /* save %eax if necessary */
     if (save_reg) {
         if (reg != DR_REG_NULL) {
@@ -242,6 +286,8 @@ drx_save_arith_flags(void *drcontext, instrlist_t *ilist, instr_t *where,
         instr = INSTR_CREATE_setcc(drcontext, OP_seto, opnd_create_reg(DR_REG_AL));
         MINSERT(ilist, where, instr);
     }
+    ilist_insert_note_label(drcontext, ilist, where,
+                            NOTE_VAL(DRX_NOTE_AFLAGS_SAVE_END));
 #elif defined(ARM)
     ASSERT(reg >= DR_REG_START_GPR && reg <= DR_REG_STOP_GPR, "reg must be a GPR");
     if (save_reg) {
@@ -376,6 +422,104 @@ merge_prev_drx_spill(instr_t *where, bool aflags)
     return NULL;
 }
 
+#ifdef X86
+/* Returns whether instr can sit between a drx aflags restore and the next drx
+ * aflags save without needing the app's aflags or %eax in place.
+ */
+static bool
+instr_is_aflags_transparent(instr_t *instr)
+{
+    int i;
+    if (instr_is_app(instr) || instr_is_label(instr) || instr_is_cti(instr) ||
+        instr_is_syscall(instr) || instr_is_interrupt(instr))
+        return false;
+    if (instr_get_arith_flags(instr, DR_QUERY_DEFAULT) != 0)
+        return false;
+    if (instr_uses_reg(instr, DR_REG_XAX))
+        return false;
+    /* Be conservative about anything that may touch a DR spill slot */
+    for (i = 0; i < instr_num_srcs(instr); i++) {
+        if (opnd_is_far_memory_reference(instr_get_src(instr, i)))
+            return false;
+    }
+    for (i = 0; i < instr_num_dsts(instr); i++) {
+        if (opnd_is_far_memory_reference(instr_get_dst(instr, i)))
+            return false;
+    }
+    return true;
+}
+
+/* merge_prev_drx_spill() only sees drx spills that are directly adjacent at
+ * insertion time.  Once all instrumentation is in place we can also drop a
+ * restore+save pair that is separated only by other tools' meta instructions
+ * that leave the aflags and %eax alone.  Both sequences must use the same
+ * spill slot so that the later restore still reloads the app's %eax.
+ *
+ * This routine looks for labels inserted by drx_save_arith_flags and
+ * drx_restore_arith_flags, so changes to those may affect this routine.
+ */
+static dr_emit_flags_t
+drx_event_merge_aflags(void *drcontext, void *tag, instrlist_t *bb,
+                       bool for_trace, bool translating)
+{
+    instr_t *instr, *next;
+    for (instr = instrlist_first(bb); instr != NULL; instr = next) {
+        instr_t *restore_begin, *restore, *save_begin, *save, *save_end, *in, *tmp;
+        next = instr_get_next(instr);
+        if (!instr_is_label(instr) ||
+            instr_get_note(instr) != NOTE_VAL(DRX_NOTE_AFLAGS_RESTORE_END))
+            continue;
+        restore = instr_get_prev(instr);
+        if (restore == NULL || instr_get_opcode(restore) != OP_mov_ld ||
+            !opnd_is_reg(instr_get_dst(restore, 0)) ||
+            opnd_get_reg(instr_get_dst(restore, 0)) != DR_REG_XAX)
+            continue;
+        for (restore_begin = instr_get_prev(restore); restore_begin != NULL;
+             restore_begin = instr_get_prev(restore_begin)) {
+            if (instr_is_label(restore_begin))
+                break;
+        }
+        if (restore_begin == NULL ||
+            instr_get_note(restore_begin) != NOTE_VAL(DRX_NOTE_AFLAGS_RESTORE_BEGIN))
+            continue;
+        for (save_begin = next; save_begin != NULL &&
+                 instr_is_aflags_transparent(save_begin);
+             save_begin = instr_get_next(save_begin))
+            ; /* nothing */
+        if (save_begin == NULL || !instr_is_label(save_begin) ||
+            instr_get_note(save_begin) != NOTE_VAL(DRX_NOTE_AFLAGS_SAVE_BEGIN))
+            continue;
+        save = instr_get_next(save_begin);
+        if (save == NULL || instr_get_opcode(save) != OP_mov_st ||
+            !opnd_is_reg(instr_get_src(save, 0)) ||
+            opnd_get_reg(instr_get_src(save, 0)) != DR_REG_XAX ||
+            !opnd_same(instr_get_src(restore, 0), instr_get_dst(save, 0)))
+            continue;
+        for (save_end = instr_get_next(save); save_end != NULL;
+             save_end = instr_get_next(save_end)) {
+            if (instr_is_label(save_end))
+                break;
+        }
+        if (save_end == NULL ||
+            instr_get_note(save_end) != NOTE_VAL(DRX_NOTE_AFLAGS_SAVE_END))
+            continue;
+        next = instr_get_next(save_end);
+        /* Remove both sequences, labels included */
+        for (in = restore_begin; in != NULL; in = tmp) {
+            tmp = (in == instr) ? NULL : instr_get_next(in);
+            instrlist_remove(bb, in);
+            instr_destroy(drcontext, in);
+        }
+        for (in = save_begin; in != next; in = tmp) {
+            tmp = instr_get_next(in);
+            instrlist_remove(bb, in);
+            instr_destroy(drcontext, in);
+        }
+    }
+    return DR_EMIT_DEFAULT;
+}
+#endif /* X86 */
+
 static bool
 counter_crosses_cache_line(byte *addr, size_t size)
 {
@@ -505,6 +649,524 @@ drx_insert_counter_update(void *drcontext, instrlist_t *ilist, instr_t *where,
     return true;
 }
 
+/***************************************************************************
+ * SHARDED COUNTERS
+ */
+
+/* Each thread gets its own cache-line-aligned array of counters, whose
+ * address is kept in a raw TLS slot so the inlined update is a TLS load and
+ * an add with no lock prefix and no sharing between threads.
+ */
+struct _drx_sharded_counter_t {
+    uint num_counters;
+    reg_id_t tls_seg;
+    uint tls_offs;
+    int tls_idx;
+    void *lock;          /* protects threads and exited */
+    struct _shard_t *threads;
+    ptr_uint_t *exited;  /* totals from threads that have exited */
+};
+
+typedef struct _shard_t {
+    ptr_uint_t *counters;
+    void *alloc;
+    size_t alloc_size;
+    struct _shard_t *prev, *next;
+} shard_t;
+
+/* All live counter groups, for the thread events */
+static drvector_t sharded_counters;
+
+static void
+sharded_counter_thread_init_one(void *drcontext, drx_sharded_counter_t *counter)
+{
+    size_t line = proc_get_cache_line_size();
+    shard_t *shard = dr_global_alloc(sizeof(*shard));
+    shard->alloc_size = counter->num_counters * sizeof(ptr_uint_t) + line;
+    shard->alloc = dr_global_alloc(shard->alloc_size);
+    shard->counters = (ptr_uint_t *) ALIGN_FORWARD(shard->alloc, line);
+    memset(shard->counters, 0, counter->num_counters * sizeof(ptr_uint_t));
+    *(ptr_uint_t **)((byte *)dr_get_dr_segment_base(counter->tls_seg) +
+                     counter->tls_offs) = shard->counters;
+    drmgr_set_tls_field(drcontext, counter->tls_idx, shard);
+    dr_mutex_lock(counter->lock);
+    shard->prev = NULL;
+    shard->next = counter->threads;
+    if (counter->threads != NULL)
+        counter->threads->prev = shard;
+    counter->threads = shard;
+    dr_mutex_unlock(counter->lock);
+}
+
+static void
+sharded_counter_thread_exit_one(void *drcontext, drx_sharded_counter_t *counter)
+{
+    shard_t *shard = (shard_t *) drmgr_get_tls_field(drcontext, counter->tls_idx);
+    uint i;
+    if (shard == NULL)
+        return;
+    dr_mutex_lock(counter->lock);
+    for (i = 0; i < counter->num_counters; i++)
+        counter->exited[i] += shard->counters[i];
+    if (shard->prev != NULL)
+        shard->prev->next = shard->next;
+    else
+        counter->threads = shard->next;
+    if (shard->next != NULL)
+        shard->next->prev = shard->prev;
+    dr_mutex_unlock(counter->lock);
+    drmgr_set_tls_field(drcontext, counter->tls_idx, NULL);
+    dr_global_free(shard->alloc, shard->alloc_size);
+    dr_global_free(shard, sizeof(*shard));
+}
+
+static void
+sharded_counter_thread_init(void *drcontext)
+{
+    uint i;
+    drvector_lock(&sharded_counters);
+    for (i = 0; i < sharded_counters.entries; i++) {
+        if (sharded_counters.array[i] != NULL) {
+            sharded_counter_thread_init_one
+                (drcontext, (drx_sharded_counter_t *) sharded_counters.array[i]);
+        }
+    }
+    drvector_unlock(&sharded_counters);
+}
+
+static void
+sharded_counter_thread_exit(void *drcontext)
+{
+    uint i;
+    drvector_lock(&sharded_counters);
+    for (i = 0; i < sharded_counters.entries; i++) {
+        if (sharded_counters.array[i] != NULL) {
+            sharded_counter_thread_exit_one
+                (drcontext, (drx_sharded_counter_t *) sharded_counters.array[i]);
+        }
+    }
+    drvector_unlock(&sharded_counters);
+}
+
+static bool
+sharded_counter_init(void)
+{
+    if (!drvector_init(&sharded_counters, 4, true/*synch*/, NULL))
+        return false;
+    return (drmgr_register_thread_init_event(sharded_counter_thread_init) &&
+            drmgr_register_thread_exit_event(sharded_counter_thread_exit));
+}
+
+static void
+sharded_counter_exit(void)
+{
+    drmgr_unregister_thread_init_event(sharded_counter_thread_init);
+    drmgr_unregister_thread_exit_event(sharded_counter_thread_exit);
+    drvector_delete(&sharded_counters);
+}
+
+DR_EXPORT
+drx_sharded_counter_t *
+drx_sharded_counter_create(uint num_counters)
+{
+    drx_sharded_counter_t *counter;
+    int tls_idx;
+    reg_id_t tls_seg;
+    uint tls_offs;
+    if (num_counters == 0)
+        return NULL;
+    tls_idx = drmgr_register_tls_field();
+    if (tls_idx == -1)
+        return NULL;
+    if (!dr_raw_tls_calloc(&tls_seg, &tls_offs, 1, 0)) {
+        drmgr_unregister_tls_field(tls_idx);
+        return NULL;
+    }
+    counter = dr_global_alloc(sizeof(*counter));
+    counter->num_counters = num_counters;
+    counter->tls_seg = tls_seg;
+    counter->tls_offs = tls_offs;
+    counter->tls_idx = tls_idx;
+    counter->lock = dr_mutex_create();
+    counter->threads = NULL;
+    counter->exited = dr_global_alloc(num_counters * sizeof(ptr_uint_t));
+    memset(counter->exited, 0, num_counters * sizeof(ptr_uint_t));
+    drvector_append(&sharded_counters, counter);
+    return counter;
+}
+
+DR_EXPORT
+bool
+drx_sharded_counter_free(drx_sharded_counter_t *counter)
+{
+    uint i;
+    bool found = false;
+    shard_t *shard, *next;
+    drvector_lock(&sharded_counters);
+    for (i = 0; i < sharded_counters.entries; i++) {
+        if (sharded_counters.array[i] == counter) {
+            sharded_counters.array[i] = NULL;
+            found = true;
+            break;
+        }
+    }
+    drvector_unlock(&sharded_counters);
+    if (!found)
+        return false;
+    /* Any remaining threads are gone from the vector, so nobody else will
+     * touch their shards.
+     */
+    for (shard = counter->threads; shard != NULL; shard = next) {
+        next = shard->next;
+        dr_global_free(shard->alloc, shard->alloc_size);
+        dr_global_free(shard, sizeof(*shard));
+    }
+    drmgr_unregister_tls_field(counter->tls_idx);
+    dr_raw_tls_cfree(counter->tls_offs, 1);
+    dr_mutex_destroy(counter->lock);
+    dr_global_free(counter->exited, counter->num_counters * sizeof(ptr_uint_t));
+    dr_global_free(counter, sizeof(*counter));
+    return true;
+}
+
+DR_EXPORT
+uint64
+drx_sharded_counter_sum(drx_sharded_counter_t *counter, uint index)
+{
+    uint64 sum;
+    shard_t *shard;
+    if (index >= counter->num_counters)
+        return 0;
+    dr_mutex_lock(counter->lock);
+    sum = counter->exited[index];
+    for (shard = counter->threads; shard != NULL; shard = shard->next)
+        sum += shard->counters[index];
+    dr_mutex_unlock(counter->lock);
+    return sum;
+}
+
+DR_EXPORT
+bool
+drx_insert_sharded_counter_update(void *drcontext, drx_sharded_counter_t *counter,
+                                  instrlist_t *ilist, instr_t *where,
+                                  dr_spill_slot_t slot, dr_spill_slot_t slot2,
+                                  uint index, int value)
+{
+    int disp;
+#ifdef X86
+    bool save_aflags = !drx_aflags_are_dead(where);
+#endif
+    if (drcontext == NULL) {
+        ASSERT(false, "drcontext cannot be NULL");
+        return false;
+    }
+    if (!(slot >= SPILL_SLOT_1 && slot <= SPILL_SLOT_MAX) ||
+        !(slot2 >= SPILL_SLOT_1 && slot2 <= SPILL_SLOT_MAX) || slot == slot2) {
+        ASSERT(false, "wrong spill slot");
+        return false;
+    }
+    if (index >= counter->num_counters)
+        return false;
+    disp = (int)(index * sizeof(ptr_uint_t));
+#ifdef X86
+    /* The shard base goes in xcx: xax is taken by the aflags */
+    if (save_aflags) {
+        drx_save_arith_flags(drcontext, ilist, where,
+                             true /* save eax */, true /* save oflag */,
+                             slot, DR_REG_NULL);
+    }
+    dr_save_reg(drcontext, ilist, where, DR_REG_XCX, slot2);
+    dr_insert_read_raw_tls(drcontext, ilist, where, counter->tls_seg,
+                           counter->tls_offs, DR_REG_XCX);
+    MINSERT(ilist, where, INSTR_CREATE_add
+            (drcontext, OPND_CREATE_MEMPTR(DR_REG_XCX, disp),
+             OPND_CREATE_INT32(value)));
+    dr_restore_reg(drcontext, ilist, where, DR_REG_XCX, slot2);
+    if (save_aflags) {
+        drx_restore_arith_flags(drcontext, ilist, where,
+                                true /* restore eax */, true /* restore oflag */,
+                                slot, DR_REG_NULL);
+    }
+#elif defined(ARM)
+    /* ldr/str take a 12-bit offset */
+    if (disp > 4095)
+        return false;
+    dr_save_reg(drcontext, ilist, where, SCRATCH_REG0, slot);
+    dr_save_reg(drcontext, ilist, where, SCRATCH_REG1, slot2);
+    dr_insert_read_raw_tls(drcontext, ilist, where, counter->tls_seg,
+                           counter->tls_offs, SCRATCH_REG0);
+    MINSERT(ilist, where, XINST_CREATE_load
+            (drcontext, opnd_create_reg(SCRATCH_REG1),
+             OPND_CREATE_MEMPTR(SCRATCH_REG0, disp)));
+    MINSERT(ilist, where, XINST_CREATE_add
+            (drcontext, opnd_create_reg(SCRATCH_REG1), OPND_CREATE_INT(value)));
+    MINSERT(ilist, where, XINST_CREATE_store
+            (drcontext, OPND_CREATE_MEMPTR(SCRATCH_REG0, disp),
+             opnd_create_reg(SCRATCH_REG1)));
+    dr_restore_reg(drcontext, ilist, where, SCRATCH_REG1, slot2);
+    dr_restore_reg(drcontext, ilist, where, SCRATCH_REG0, slot);
+#endif
+    return true;
+}
+
+/***************************************************************************
+ * SAMPLED CLEAN CALLS
+ */
+
+/* Each thread's countdown is kept in a raw TLS slot, so the inlined check is
+ * a decrement of that slot and a branch around the clean call.  The callee
+ * re-arms the countdown with the next period.  The random state for
+ * randomized periods is in a drmgr TLS field.
+ */
+struct _drx_sampler_t {
+    uint period;
+    bool randomize;
+    reg_id_t tls_seg;
+    uint tls_offs;
+    int tls_idx;
+};
+
+/* All live samplers, for the thread init event */
+static drvector_t samplers;
+
+static ptr_uint_t
+sampler_next_period(void *drcontext, drx_sampler_t *sampler)
+{
+    uint state;
+    if (!sampler->randomize || sampler->period == 1)
+        return sampler->period;
+    /* xorshift32: cheap, and good enough to break up any phase lock between
+     * the period and the application's loops.
+     */
+    state = (uint)(ptr_uint_t) drmgr_get_tls_field(drcontext, sampler->tls_idx);
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    drmgr_set_tls_field(drcontext, sampler->tls_idx, (void *)(ptr_uint_t) state);
+    /* Uniform in [1, 2*period-1], whose mean is the period */
+    return 1 + (ptr_uint_t)(state % ((uint64)sampler->period * 2 - 1));
+}
+
+static void
+sampler_arm(void *drcontext, drx_sampler_t *sampler)
+{
+    *(ptr_uint_t *)((byte *)dr_get_dr_segment_base(sampler->tls_seg) +
+                    sampler->tls_offs) = sampler_next_period(drcontext, sampler);
+}
+
+static void
+sampler_thread_init(void *drcontext)
+{
+    uint i;
+    drvector_lock(&samplers);
+    for (i = 0; i < samplers.entries; i++) {
+        drx_sampler_t *sampler = (drx_sampler_t *) samplers.array[i];
+        if (sampler == NULL)
+            continue;
+        /* Seeds must be non-zero and should differ across threads */
+        drmgr_set_tls_field(drcontext, sampler->tls_idx, (void *)(ptr_uint_t)
+                            (dr_get_random_value(0xffffffff) | 1));
+        sampler_arm(drcontext, sampler);
+    }
+    drvector_unlock(&samplers);
+}
+
+static bool
+sampler_init(void)
+{
+    if (!drvector_init(&samplers, 4, true/*synch*/, NULL))
+        return false;
+    return drmgr_register_thread_init_event(sampler_thread_init);
+}
+
+static void
+sampler_exit(void)
+{
+    drmgr_unregister_thread_init_event(sampler_thread_init);
+    drvector_delete(&samplers);
+}
+
+static void
+sampler_fire(drx_sampler_t *sampler, drx_sample_cb_t callback, void *user_data)
+{
+    void *drcontext = dr_get_current_drcontext();
+    sampler_arm(drcontext, sampler);
+    (*callback)(drcontext, user_data);
+}
+
+DR_EXPORT
+drx_sampler_t *
+drx_sampler_create(uint period, bool randomize)
+{
+    drx_sampler_t *sampler;
+    int tls_idx;
+    reg_id_t tls_seg;
+    uint tls_offs;
+    if (period == 0)
+        return NULL;
+    tls_idx = drmgr_register_tls_field();
+    if (tls_idx == -1)
+        return NULL;
+    if (!dr_raw_tls_calloc(&tls_seg, &tls_offs, 1, 0)) {
+        drmgr_unregister_tls_field(tls_idx);
+        return NULL;
+    }
+    sampler = dr_global_alloc(sizeof(*sampler));
+    sampler->period = period;
+    sampler->randomize = randomize;
+    sampler->tls_seg = tls_seg;
+    sampler->tls_offs = tls_offs;
+    sampler->tls_idx = tls_idx;
+    drvector_append(&samplers, sampler);
+    return sampler;
+}
+
+DR_EXPORT
+bool
+drx_sampler_free(drx_sampler_t *sampler)
+{
+    uint i;
+    bool found = false;
+    drvector_lock(&samplers);
+    for (i = 0; i < samplers.entries; i++) {
+        if (samplers.array[i] == sampler) {
+            samplers.array[i] = NULL;
+            found = true;
+            break;
+        }
+    }
+    drvector_unlock(&samplers);
+    if (!found)
+        return false;
+    drmgr_unregister_tls_field(sampler->tls_idx);
+    dr_raw_tls_cfree(sampler->tls_offs, 1);
+    dr_global_free(sampler, sizeof(*sampler));
+    return true;
+}
+
+DR_EXPORT
+bool
+drx_insert_sampled_clean_call(void *drcontext, drx_sampler_t *sampler,
+                              instrlist_t *ilist, instr_t *where,
+                              dr_spill_slot_t slot, dr_spill_slot_t slot2,
+                              drx_sample_cb_t callback, void *user_data)
+{
+    instr_t *skip;
+#ifdef X86
+    bool save_aflags = !drx_aflags_are_dead(where);
+#endif
+    if (drcontext == NULL) {
+        ASSERT(false, "drcontext cannot be NULL");
+        return false;
+    }
+    if (!(slot >= SPILL_SLOT_1 && slot <= SPILL_SLOT_MAX) ||
+        !(slot2 >= SPILL_SLOT_1 && slot2 <= SPILL_SLOT_MAX) || slot == slot2) {
+        ASSERT(false, "wrong spill slot");
+        return false;
+    }
+    if (sampler == NULL || callback == NULL)
+        return false;
+    skip = INSTR_CREATE_label(drcontext);
+#ifdef X86
+    if (save_aflags) {
+        drx_save_arith_flags(drcontext, ilist, where,
+                             true /* save eax */, true /* save oflag */,
+                             slot, DR_REG_NULL);
+    }
+    MINSERT(ilist, where, INSTR_CREATE_dec
+            (drcontext, opnd_create_far_base_disp(sampler->tls_seg, DR_REG_NULL,
+                                                  DR_REG_NULL, 0, sampler->tls_offs,
+                                                  OPSZ_PTR)));
+    MINSERT(ilist, where, INSTR_CREATE_jcc(drcontext, OP_jnz, opnd_create_instr(skip)));
+#elif defined(ARM)
+    /* The flags go in SCRATCH_REG1 and the countdown in SCRATCH_REG0 */
+    dr_save_reg(drcontext, ilist, where, SCRATCH_REG0, slot);
+    dr_save_reg(drcontext, ilist, where, SCRATCH_REG1, slot2);
+    MINSERT(ilist, where, INSTR_CREATE_mrs(drcontext, opnd_create_reg(SCRATCH_REG1),
+                                           opnd_create_reg(DR_REG_CPSR)));
+    dr_insert_read_raw_tls(drcontext, ilist, where, sampler->tls_seg,
+                           sampler->tls_offs, SCRATCH_REG0);
+    MINSERT(ilist, where, XINST_CREATE_sub_s
+            (drcontext, opnd_create_reg(SCRATCH_REG0), OPND_CREATE_INT(1)));
+    dr_insert_write_raw_tls(drcontext, ilist, where, sampler->tls_seg,
+                            sampler->tls_offs, SCRATCH_REG0);
+    MINSERT(ilist, where, INSTR_PRED(XINST_CREATE_jump
+                                     (drcontext, opnd_create_instr(skip)),
+                                     DR_PRED_NE));
+#endif
+    /* The clean call preserves the scratch state above */
+    dr_insert_clean_call(drcontext, ilist, where, (void *) sampler_fire,
+                         false /* no fp save */, 3, OPND_CREATE_INTPTR(sampler),
+                         OPND_CREATE_INTPTR(callback), OPND_CREATE_INTPTR(user_data));
+    MINSERT(ilist, where, skip);
+#ifdef X86
+    if (save_aflags) {
+        drx_restore_arith_flags(drcontext, ilist, where,
+                                true /* restore eax */, true /* restore oflag */,
+                                slot, DR_REG_NULL);
+    }
+#elif defined(ARM)
+    MINSERT(ilist, where, INSTR_CREATE_msr
+            (drcontext, opnd_create_reg(DR_REG_CPSR), OPND_CREATE_INT_MSR_NZCVQG(),
+             opnd_create_reg(SCRATCH_REG1)));
+    dr_restore_reg(drcontext, ilist, where, SCRATCH_REG1, slot2);
+    dr_restore_reg(drcontext, ilist, where, SCRATCH_REG0, slot);
+#endif
+    return true;
+}
+
+/***************************************************************************
+ * INSTRUMENTATION LEVELS
+ */
+
+/* Maps a tag to its level.  Level 0 is the default and is not stored, so the
+ * table only holds the usually few blocks that were promoted.
+ */
+#define LEVEL_TABLE_HASH_BITS 8
+static hashtable_t level_table;
+
+static void
+levels_init(void)
+{
+    hashtable_init(&level_table, LEVEL_TABLE_HASH_BITS, HASH_INTPTR,
+                   false/*!strdup*/);
+}
+
+static void
+levels_exit(void)
+{
+    hashtable_delete(&level_table);
+}
+
+DR_EXPORT
+bool
+drx_set_instrumentation_level(app_pc tag, uint level)
+{
+    if (tag == NULL)
+        return false;
+    if (level == 0) {
+        /* Any stored level is non-zero, so removal means a change */
+        if (!hashtable_remove(&level_table, (void *)tag))
+            return true;
+    } else {
+        void *old = hashtable_add_replace(&level_table, (void *)tag,
+                                          (void *)(ptr_uint_t)level);
+        if ((uint)(ptr_uint_t)old == level)
+            return true;
+    }
+    /* The block is rebuilt at the new level on its next execution.  A delayed
+     * flush can be requested from anywhere, including a clean call.
+     */
+    return dr_delay_flush_region(tag, 1, 0, NULL);
+}
+
+DR_EXPORT
+uint
+drx_get_instrumentation_level(app_pc tag)
+{
+    return (uint)(ptr_uint_t)hashtable_lookup(&level_table, (void *)tag);
+}
+
 /***************************************************************************
  * SOFT KILLS
  */
@@ -1064,28 +1726,37 @@ soft_kills_post_syscall(void *drcontext, int sysnum)
 static bool
 soft_kills_filter_syscall(void *drcontext, int sysnum)
 {
-    return (sysnum == SYS_kill);
+    return (sysnum == SYS_kill || sysnum == SYS_tgkill ||
+            sysnum == SYS_rt_sigqueueinfo || sysnum == SYS_rt_tgsigqueueinfo);
 }
 
 /* Returns whether to execute the system call */
 static bool
 soft_kills_pre_syscall(void *drcontext, int sysnum)
 {
-    if (sysnum == SYS_kill) {
-        process_id_t pid = (process_id_t) dr_syscall_get_param(drcontext, 0);
-        int sig = (int) dr_syscall_get_param(drcontext, 1);
-        if (sig == SIGKILL && pid != INVALID_PROCESS_ID && pid != dr_get_process_id()) {
-            /* Pass exit code << 8 for use with dr_exit_process() */
-            int exit_code = sig << 8;
-            if (soft_kills_invoke_cbs(pid, exit_code)) {
-                /* set result to 0 (success) and use_high and use_errno to false */
-                dr_syscall_result_info_t info = { sizeof(info), };
-                info.succeeded = true;
-                dr_syscall_set_result_ex(drcontext, &info);
-                return false; /* skip syscall */
-            } else
-                return true; /* execute syscall */
-        }
+    process_id_t pid;
+    int sig;
+    /* All of these take the target thread group id as their first parameter.
+     * We do not handle tkill, which targets a thread id that need not match
+     * its group's pid, nor process group kills (pid <= 0), where we do not
+     * know the individual targets.
+     */
+    pid = (process_id_t) dr_syscall_get_param(drcontext, 0);
+    if (sysnum == SYS_kill || sysnum == SYS_rt_sigqueueinfo)
+        sig = (int) dr_syscall_get_param(drcontext, 1);
+    else
+        sig = (int) dr_syscall_get_param(drcontext, 2);
+    if (sig == SIGKILL && (int)pid > 0 && pid != dr_get_process_id()) {
+        /* Pass exit code << 8 for use with dr_exit_process() */
+        int exit_code = sig << 8;
+        if (soft_kills_invoke_cbs(pid, exit_code)) {
+            /* set result to 0 (success) and use_high and use_errno to false */
+            dr_syscall_result_info_t info = { sizeof(info), };
+            info.succeeded = true;
+            dr_syscall_set_result_ex(drcontext, &info);
+            return false; /* skip syscall */
+        } else
+            return true; /* execute syscall */
     }
     return true;
 }
@@ -1310,3 +1981,182 @@ drx_open_unique_appid_file(const char *dir, ptr_int_t id,
 
     return drx_open_unique_file(dir, appid, suffix, extra_flags, result, result_len);
 }
+
+/***************************************************************************
+ * ASYNCHRONOUS WRITER
+ */
+
+/* Idle poll period of the writer thread */
+#define ASYNC_WRITER_IDLE_MS 1
+/* How long drx_async_writer_destroy() waits for the writer thread to notice it
+ * should stop before concluding DR has terminated it at process exit.
+ */
+#define ASYNC_WRITER_STOP_WAIT_MS 100
+
+typedef struct _async_chunk_t {
+    size_t size;
+    struct _async_chunk_t *next;
+    /* data follows */
+} async_chunk_t;
+
+struct _drx_async_writer_t {
+    file_t file;
+    size_t max_pending;
+    /* Protects the queue and pending.  Held only briefly. */
+    void *queue_lock;
+    /* Held by whoever is writing chunks to the file, so chunks are written in
+     * queue order.  DR does not suspend a client thread holding a dr_mutex, so
+     * the writer thread is never terminated at exit mid-chunk.
+     */
+    void *write_lock;
+    async_chunk_t *head;
+    async_chunk_t *tail;
+    size_t pending;
+    bool have_thread;
+    volatile bool stop;
+    volatile bool thread_done;
+    bool write_error;
+};
+
+static async_chunk_t *
+async_writer_dequeue(drx_async_writer_t *w)
+{
+    async_chunk_t *chunk;
+    dr_mutex_lock(w->queue_lock);
+    chunk = w->head;
+    if (chunk != NULL) {
+        w->head = chunk->next;
+        if (w->head == NULL)
+            w->tail = NULL;
+    }
+    dr_mutex_unlock(w->queue_lock);
+    return chunk;
+}
+
+/* Caller must hold write_lock */
+static void
+async_writer_write_chunk(drx_async_writer_t *w, async_chunk_t *chunk)
+{
+    byte *data = (byte *)(chunk + 1);
+    size_t done = 0;
+    while (done < chunk->size) {
+        ssize_t res = dr_write_file(w->file, data + done, chunk->size - done);
+        if (res <= 0) {
+            w->write_error = true;
+            break;
+        }
+        done += res;
+    }
+    dr_mutex_lock(w->queue_lock);
+    w->pending -= chunk->size;
+    dr_mutex_unlock(w->queue_lock);
+    dr_global_free(chunk, sizeof(*chunk) + chunk->size);
+}
+
+/* Writes queued chunks until no more than target bytes are pending */
+static void
+async_writer_drain(drx_async_writer_t *w, size_t target)
+{
+    async_chunk_t *chunk;
+    dr_mutex_lock(w->write_lock);
+    while (w->pending > target && (chunk = async_writer_dequeue(w)) != NULL)
+        async_writer_write_chunk(w, chunk);
+    dr_mutex_unlock(w->write_lock);
+}
+
+static void
+async_writer_thread(void *arg)
+{
+    drx_async_writer_t *w = (drx_async_writer_t *) arg;
+    async_chunk_t *chunk;
+    while (!w->stop) {
+        dr_mutex_lock(w->write_lock);
+        chunk = async_writer_dequeue(w);
+        if (chunk != NULL)
+            async_writer_write_chunk(w, chunk);
+        dr_mutex_unlock(w->write_lock);
+        if (chunk == NULL)
+            dr_sleep(ASYNC_WRITER_IDLE_MS);
+    }
+    w->thread_done = true;
+}
+
+DR_EXPORT
+drx_async_writer_t *
+drx_async_writer_create(file_t f, size_t max_pending)
+{
+    drx_async_writer_t *w;
+    if (f == INVALID_FILE || max_pending == 0)
+        return NULL;
+    w = dr_global_alloc(sizeof(*w));
+    memset(w, 0, sizeof(*w));
+    w->file = f;
+    w->max_pending = max_pending;
+    w->queue_lock = dr_mutex_create();
+    w->write_lock = dr_mutex_create();
+    /* Without a thread, writes are made synchronously */
+    w->have_thread = dr_create_client_thread(async_writer_thread, w);
+    return w;
+}
+
+DR_EXPORT
+bool
+drx_async_writer_write(drx_async_writer_t *w, const void *buf, size_t size)
+{
+    async_chunk_t *chunk;
+    if (w == NULL || buf == NULL)
+        return false;
+    if (size == 0)
+        return true;
+    chunk = dr_global_alloc(sizeof(*chunk) + size);
+    chunk->size = size;
+    chunk->next = NULL;
+    memcpy(chunk + 1, buf, size);
+    dr_mutex_lock(w->queue_lock);
+    if (w->tail == NULL)
+        w->head = chunk;
+    else
+        w->tail->next = chunk;
+    w->tail = chunk;
+    w->pending += size;
+    dr_mutex_unlock(w->queue_lock);
+    /* Backpressure: rather than wait for the writer thread, help it */
+    if (!w->have_thread)
+        async_writer_drain(w, 0);
+    else if (w->pending > w->max_pending)
+        async_writer_drain(w, w->max_pending);
+    return !w->write_error;
+}
+
+DR_EXPORT
+bool
+drx_async_writer_flush(drx_async_writer_t *w)
+{
+    if (w == NULL)
+        return false;
+    async_writer_drain(w, 0);
+    dr_flush_file(w->file);
+    return !w->write_error;
+}
+
+DR_EXPORT
+bool
+drx_async_writer_destroy(drx_async_writer_t *w)
+{
+    bool res;
+    int waited;
+    if (w == NULL)
+        return false;
+    w->stop = true;
+    res = drx_async_writer_flush(w);
+    if (w->have_thread) {
+        /* At process exit DR will have already terminated the thread */
+        for (waited = 0; !w->thread_done && waited < ASYNC_WRITER_STOP_WAIT_MS;
+             waited += ASYNC_WRITER_IDLE_MS)
+            dr_sleep(ASYNC_WRITER_IDLE_MS);
+    }
+    dr_mutex_destroy(w->queue_lock);
+    dr_mutex_destroy(w->write_lock);
+    dr_global_free(w, sizeof(*w));
+    return res;
+}
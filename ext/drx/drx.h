@@ -83,6 +83,19 @@ DR_EXPORT
 void
 drx_exit(void);
 
+/**
+ * Priority of the drmgr instru2instru pass that drx uses to merge arithmetic
+ * flags spills across other tools' instrumentation.  It runs late so that it
+ * sees the final instruction list; a later instru2instru pass that inserts
+ * code between two drx counter updates should use a larger priority.
+ */
+enum {
+    DRMGR_PRIORITY_INSTRU2INSTRU_DRX_MERGE = 10000, /**< Priority of the merge pass */
+};
+
+/** Name of the drmgr instru2instru pass used by drx to merge spills. */
+#define DRMGR_PRIORITY_NAME_DRX_MERGE "drx_merge_aflags"
+
 /***************************************************************************
  * INSTRUCTION NOTE FIELD
  */
@@ -146,6 +159,11 @@ DR_EXPORT
  * same \p where instruction and no other instructions should be inserted in
  * between. In that case, \p drx will try to merge the instrumentation for
  * better performance.
+ * If drx_init() was called, once all instrumentation for a block is in
+ * place drx also merges updates that are separated only by other
+ * meta-instructions that touch neither the arithmetic flags, the xax
+ * register, nor DR's spill slots.  This pass runs at instru2instru with
+ * priority #DRMGR_PRIORITY_INSTRU2INSTRU_DRX_MERGE.
  *
  * \note May be called without calling drx_init().
  */
@@ -154,6 +172,169 @@ drx_insert_counter_update(void *drcontext, instrlist_t *ilist, instr_t *where,
                           dr_spill_slot_t slot, IF_ARM_(dr_spill_slot_t slot2)
                           void *addr, int value, uint flags);
 
+/**
+ * Opaque handle for a group of counters that each thread updates in its own
+ * private copy.  See drx_sharded_counter_create().
+ */
+struct _drx_sharded_counter_t;
+typedef struct _drx_sharded_counter_t drx_sharded_counter_t;
+
+DR_EXPORT
+/**
+ * Creates a group of \p num_counters pointer-sized counters that are
+ * sharded per thread: each thread updates a private, cache-line-aligned
+ * copy without any lock prefix, and drx_sharded_counter_sum() adds up the
+ * copies.  This avoids the cache line contention of a shared
+ * #DRX_COUNTER_LOCK counter in multi-threaded applications.
+ *
+ * Counter groups must be created prior to the threads that update them:
+ * normally from dr_client_main().  Requires drx_init().
+ *
+ * \return a counter group handle, or NULL on failure.
+ */
+drx_sharded_counter_t *
+drx_sharded_counter_create(uint num_counters);
+
+DR_EXPORT
+/**
+ * Frees a counter group created by drx_sharded_counter_create().  Should be
+ * called at process exit.
+ *
+ * \return whether successful.
+ */
+bool
+drx_sharded_counter_free(drx_sharded_counter_t *counter);
+
+DR_EXPORT
+/**
+ * Returns the total of counter \p index of \p counter across all threads,
+ * including threads that have exited.  Updates from running threads are
+ * read without synchronization, so the result may lag slightly behind.
+ */
+uint64
+drx_sharded_counter_sum(drx_sharded_counter_t *counter, uint index);
+
+DR_EXPORT
+/**
+ * Inserts into \p ilist prior to \p where meta-instruction(s) to add the
+ * constant \p value to counter \p index of \p counter for the current
+ * thread.  The spill slots \p slot and \p slot2 must differ: on x86, \p
+ * slot is used for the arithmetic flags (if they are live) and \p slot2 for
+ * a scratch register; on ARM both hold scratch registers.
+ *
+ * \return whether successful.
+ */
+bool
+drx_insert_sharded_counter_update(void *drcontext, drx_sharded_counter_t *counter,
+                                  instrlist_t *ilist, instr_t *where,
+                                  dr_spill_slot_t slot, dr_spill_slot_t slot2,
+                                  uint index, int value);
+
+/***************************************************************************
+ * SAMPLED CLEAN CALLS
+ */
+
+/**
+ * Opaque handle for a per-thread countdown that fires a clean call once every
+ * period executions.  See drx_sampler_create().
+ */
+struct _drx_sampler_t;
+typedef struct _drx_sampler_t drx_sampler_t;
+
+/**
+ * Callback invoked by a sampled clean call inserted by
+ * drx_insert_sampled_clean_call().  \p user_data is the value passed at
+ * insertion time.
+ */
+typedef void (*drx_sample_cb_t)(void *drcontext, void *user_data);
+
+DR_EXPORT
+/**
+ * Creates a sampler: a per-thread countdown kept in raw TLS that is
+ * decremented inline by every sampled clean call inserted with it, and that
+ * calls the clean call's callback and restarts when it reaches zero.  All
+ * insertion points using the same sampler share each thread's countdown;
+ * create a separate sampler for each site that should be sampled on its own.
+ *
+ * If \p randomize is false, the callback runs once every \p period
+ * executions.  Otherwise, each period is drawn uniformly from [1,
+ * 2*\p period-1], which keeps the mean but avoids sampling in lockstep
+ * with a loop in the application.
+ *
+ * Samplers must be created prior to the threads that use them: normally
+ * from dr_client_main().  Requires drx_init().
+ *
+ * \return a sampler handle, or NULL on failure.
+ */
+drx_sampler_t *
+drx_sampler_create(uint period, bool randomize);
+
+DR_EXPORT
+/**
+ * Frees a sampler created by drx_sampler_create().  Should be called at
+ * process exit.
+ *
+ * \return whether successful.
+ */
+bool
+drx_sampler_free(drx_sampler_t *sampler);
+
+DR_EXPORT
+/**
+ * Inserts into \p ilist prior to \p where meta-instruction(s) to decrement
+ * the current thread's countdown of \p sampler and, when it reaches zero,
+ * to call \p callback with \p user_data from a clean call.  The clean call
+ * is branched around otherwise, so the common case costs about as much as
+ * drx_insert_counter_update().  The spill slots \p slot and \p slot2 must
+ * differ: on x86, \p slot is used for the arithmetic flags (if they are
+ * live) and \p slot2 is unused; on ARM both hold scratch registers.
+ *
+ * \return whether successful.
+ */
+bool
+drx_insert_sampled_clean_call(void *drcontext, drx_sampler_t *sampler,
+                              instrlist_t *ilist, instr_t *where,
+                              dr_spill_slot_t slot, dr_spill_slot_t slot2,
+                              drx_sample_cb_t callback, void *user_data);
+
+/***************************************************************************
+ * INSTRUMENTATION LEVELS
+ */
+
+DR_EXPORT
+/**
+ * Sets the instrumentation level of the block starting at \p tag to \p
+ * level, for tools that instrument most code cheaply (for example, with
+ * counters) and only hot or interesting code expensively (for example,
+ * with full tracing).  Levels are defined by the client: every block starts
+ * at level 0, and bb event callbacks query the level of the block being
+ * built with drx_get_instrumentation_level() to decide how to instrument it.
+ *
+ * If the level changes, the block is flushed with dr_delay_flush_region() and
+ * is rebuilt at the new level when it is next executed, while the other
+ * blocks in the cache are untouched.  Traces containing the block are
+ * flushed as well.  This routine may thus be called from anywhere, including
+ * a clean call from the block itself, which completes its current execution
+ * at the old level.
+ *
+ * Only one version of a block is kept in the cache.  Since the block may
+ * still be translated (see drmgr_register_restore_state_event()) at its new
+ * level before the flush takes effect, instrumentation that affects state
+ * restoration should be the same at every level.
+ *
+ * \return whether successful.
+ */
+bool
+drx_set_instrumentation_level(app_pc tag, uint level);
+
+DR_EXPORT
+/**
+ * Returns the instrumentation level of the block starting at \p tag set by
+ * drx_set_instrumentation_level(), or 0 if none was set.
+ */
+uint
+drx_get_instrumentation_level(app_pc tag);
+
 /***************************************************************************
  * SOFT KILLS
  */
@@ -187,6 +368,17 @@ DR_EXPORT
  * cases a parent process will terminate child processes in multiple
  * ways.
  *
+ * On Windows, the event covers NtTerminateProcess and job object
+ * termination.  On Linux, it covers SIGKILL sent to another process
+ * via kill, tgkill, rt_sigqueueinfo, or rt_tgsigqueueinfo.  Signals
+ * sent to a process group (a pid of 0 or less) and thread-targeted
+ * tkill are not covered.  Catchable termination signals such as
+ * SIGTERM do not need this event: DynamoRIO in the target process
+ * runs process exit events when such a signal's default action
+ * terminates the process, as it does for exit_group.  A buffered
+ * tool can thus rely on its exit event to flush its output on Linux
+ * for every termination other than an uncovered SIGKILL.
+ *
  * This event must be registered for during process initialization, in
  * order to properly track per-thread information.  Un-registering is
  * not supported: soft kills cannot be in effect for only part of the
@@ -209,6 +401,133 @@ DR_EXPORT
 bool
 drx_register_soft_kills(bool (*event_cb)(process_id_t pid, int exit_code));
 
+/***************************************************************************
+ * BUFFER API
+ */
+
+/**
+ * Opaque handle which represents a buffer for use by the drx_buf framework.
+ */
+struct _drx_buf_t;
+typedef struct _drx_buf_t drx_buf_t;
+
+/**
+ * Callback function type for a trace buffer that is full.  It is called with
+ * the start of the thread's buffer and the number of bytes written to it.
+ * Upon return the buffer pointer is reset to the start of the buffer.
+ */
+typedef void (*drx_buf_full_cb_t)(void *drcontext, void *buf_base, size_t size);
+
+/** Size of a circular buffer that is updated without any fault handling. */
+#define DRX_BUF_FAST_CIRCULAR_BUFSZ (1 << 16)
+
+DR_EXPORT
+/**
+ * Creates a circular buffer of \p buf_size bytes for each thread.  When the
+ * write pointer passes the end of the buffer it wraps around to the start.
+ * A size of #DRX_BUF_FAST_CIRCULAR_BUFSZ gives the fastest buffer: it is
+ * 64KB-aligned and drx_buf_insert_update_buf_ptr() wraps it by updating
+ * only the low 16 bits of the pointer.  Other sizes wrap by way of a fault
+ * on a guard page, as for trace buffers.
+ *
+ * Buffers must be created prior to the threads that use them: normally
+ * from dr_client_main().  Requires drx_init().
+ *
+ * \return a buffer handle, or NULL on failure.
+ */
+drx_buf_t *
+drx_buf_create_circular_buffer(size_t buf_size);
+
+DR_EXPORT
+/**
+ * Creates a trace buffer of \p buf_size bytes for each thread.  The
+ * buffer is followed by an inaccessible guard page instead of having its
+ * bounds checked inline.  The first store past the end faults, and drx
+ * then calls \p full_cb with the buffer contents, resets the pointer
+ * (including the register holding it), and re-executes the store at the
+ * start of the buffer.  \p full_cb is also called with any remaining
+ * contents when a thread exits.
+ *
+ * For this to work, \p buf_size should be a multiple of the record size
+ * (the stride passed to drx_buf_insert_update_buf_ptr()), so that the
+ * first store of a record is the one that reaches the guard page.  Every
+ * store must use the register loaded by drx_buf_insert_load_buf_ptr() as
+ * its base.
+ *
+ * Buffers must be created prior to the threads that use them: normally
+ * from dr_client_main().  Requires drx_init().
+ *
+ * \return a buffer handle, or NULL on failure.
+ */
+drx_buf_t *
+drx_buf_create_trace_buffer(size_t buf_size, drx_buf_full_cb_t full_cb);
+
+DR_EXPORT
+/**
+ * Frees a buffer created by drx_buf_create_circular_buffer() or
+ * drx_buf_create_trace_buffer().  Should be called at process exit.
+ *
+ * \return whether successful.
+ */
+bool
+drx_buf_free(drx_buf_t *buf);
+
+DR_EXPORT
+/** Returns the current write pointer of the buffer for thread \p drcontext. */
+void *
+drx_buf_get_buffer_ptr(void *drcontext, drx_buf_t *buf);
+
+DR_EXPORT
+/** Sets the write pointer of the buffer for thread \p drcontext. */
+void
+drx_buf_set_buffer_ptr(void *drcontext, drx_buf_t *buf, void *new_ptr);
+
+DR_EXPORT
+/** Returns the start of the buffer for thread \p drcontext. */
+void *
+drx_buf_get_buffer_base(void *drcontext, drx_buf_t *buf);
+
+DR_EXPORT
+/** Returns the size of the buffer, as passed at creation. */
+size_t
+drx_buf_get_buffer_size(void *drcontext, drx_buf_t *buf);
+
+DR_EXPORT
+/**
+ * Inserts into \p ilist prior to \p where meta-instruction(s) to load the
+ * buffer's current write pointer into \p buf_ptr.
+ */
+void
+drx_buf_insert_load_buf_ptr(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
+                            instr_t *where, reg_id_t buf_ptr);
+
+DR_EXPORT
+/**
+ * Inserts into \p ilist prior to \p where meta-instruction(s) to advance
+ * the write pointer in \p buf_ptr by \p stride bytes and store it back.
+ * The arithmetic flags are not touched.  \p scratch is only used on ARM and
+ * may be DR_REG_NULL on x86.
+ */
+void
+drx_buf_insert_update_buf_ptr(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
+                              instr_t *where, reg_id_t buf_ptr, reg_id_t scratch,
+                              ushort stride);
+
+DR_EXPORT
+/**
+ * Inserts into \p ilist prior to \p where meta-instruction(s) to store
+ * \p opnd, of size \p opsz, at \p offset bytes from the write pointer in
+ * \p buf_ptr.  \p opnd must be a register of size \p opsz or an immediate
+ * integer.  \p scratch is needed for immediates that cannot be stored
+ * directly (all immediates on ARM) and otherwise may be DR_REG_NULL.
+ *
+ * \return whether successful.
+ */
+bool
+drx_buf_insert_buf_store(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
+                         instr_t *where, reg_id_t buf_ptr, reg_id_t scratch,
+                         opnd_t opnd, opnd_size_t opsz, short offset);
+
 /***************************************************************************
  * LOGGING
  */
@@ -250,6 +569,64 @@ drx_open_unique_appid_file(const char *dir, ptr_int_t id,
                            const char *prefix, const char *suffix,
                            uint extra_flags, char *result OUT, size_t result_len);
 
+/***************************************************************************
+ * ASYNCHRONOUS WRITER
+ */
+
+/**
+ * Opaque handle for a file writer that moves writes off the threads that
+ * make them.
+ */
+struct _drx_async_writer_t;
+typedef struct _drx_async_writer_t drx_async_writer_t;
+
+DR_EXPORT
+/**
+ * Creates a writer for the file \p f, which must be open for writing.
+ * Writes passed to drx_async_writer_write() are queued and made to the file
+ * in order by a client thread (see dr_create_client_thread()).  At most
+ * \p max_pending bytes are kept queued: a thread whose write exceeds that
+ * limit writes out queued data itself until the queue is back under it.
+ * If the client thread cannot be created, writes are made synchronously.
+ *
+ * \note May be called without calling drx_init().
+ *
+ * \return a writer handle, or NULL on failure.
+ */
+drx_async_writer_t *
+drx_async_writer_create(file_t f, size_t max_pending);
+
+DR_EXPORT
+/**
+ * Queues a copy of the \p size bytes at \p buf for writing to the writer's
+ * file.  May be called from any thread.
+ *
+ * \return false if a write to the file has failed.
+ */
+bool
+drx_async_writer_write(drx_async_writer_t *w, const void *buf, size_t size);
+
+DR_EXPORT
+/**
+ * Writes out all data queued so far on \p w, waiting for it to reach the
+ * file.
+ *
+ * \return false if a write to the file has failed.
+ */
+bool
+drx_async_writer_flush(drx_async_writer_t *w);
+
+DR_EXPORT
+/**
+ * Writes out all data queued on \p w, stops its client thread, and frees
+ * it.  The file is not closed.  Should be called before the file is closed,
+ * typically from the process exit event.
+ *
+ * \return false if a write to the file has failed.
+ */
+bool
+drx_async_writer_destroy(drx_async_writer_t *w);
+
 /*@}*/ /* end doxygen group */
 
 #ifdef __cplusplus
@@ -0,0 +1,546 @@
+/* **********************************************************
+ * Copyright (c) 2016 Google, Inc.   All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* DynamoRio eXtension utilities: per-thread instrumentation buffers.
+ *
+ * Each buffer owns a raw TLS slot holding the current write pointer so that
+ * the inlined sequences need a single load and store to access it.  The fast
+ * circular buffer is 64KB and 64KB-aligned so that updating just the low 16
+ * bits of the pointer wraps it around.  Every other buffer is followed by an
+ * inaccessible guard page: the first store past the end faults, and we run
+ * the flush callback from the fault handler and re-execute the store at the
+ * start of the buffer.  Thus no instrumentation needs a bounds check.
+ */
+
+#include "dr_api.h"
+#include "drx.h"
+#include "drmgr.h"
+#include "drvector.h"
+#include "../ext_utils.h"
+#include <string.h>
+#ifdef UNIX
+# include <signal.h> /* SIGSEGV */
+#endif
+
+#ifdef DEBUG
+# define ASSERT(x, msg) DR_ASSERT_MSG(x, msg)
+#else
+# define ASSERT(x, msg) /* nothing */
+#endif
+
+#define MINSERT instrlist_meta_preinsert
+#define ALIGN_FORWARD(x, alignment)  \
+    ((((ptr_uint_t)x) + ((alignment)-1)) & (~((alignment)-1)))
+
+typedef enum {
+    DRX_BUF_CIRCULAR_FAST,
+    DRX_BUF_CIRCULAR,
+    DRX_BUF_TRACE,
+} drx_buf_type_t;
+
+struct _drx_buf_t {
+    drx_buf_type_t buf_type;
+    size_t buf_size;
+    drx_buf_full_cb_t full_cb;
+    int tls_idx;
+    reg_id_t tls_seg;
+    uint tls_offs;
+};
+
+typedef struct _per_thread_t {
+    byte *seg_base;
+    byte *cli_base;   /* start of the buffer handed to the client */
+    byte *buf_base;   /* start of the allocation */
+    size_t total_size;
+} per_thread_t;
+
+/* All live buffers, for thread events and fault lookup */
+static drvector_t buffers;
+
+static void
+drx_buf_thread_init(void *drcontext);
+
+static void
+drx_buf_thread_exit(void *drcontext);
+
+#ifdef WINDOWS
+static bool
+drx_buf_exception_event(void *drcontext, dr_exception_t *excpt);
+#else
+static dr_signal_action_t
+drx_buf_signal_event(void *drcontext, dr_siginfo_t *info);
+#endif
+
+/***************************************************************************
+ * INIT
+ */
+
+/* Called by drx_init() on its first invocation */
+bool
+drx_buf_init_library(void)
+{
+    if (!drvector_init(&buffers, 4, true/*synch*/, NULL))
+        return false;
+    if (!drmgr_register_thread_init_event(drx_buf_thread_init) ||
+        !drmgr_register_thread_exit_event(drx_buf_thread_exit))
+        return false;
+#ifdef WINDOWS
+    if (!drmgr_register_exception_event(drx_buf_exception_event))
+        return false;
+#else
+    if (!drmgr_register_signal_event(drx_buf_signal_event))
+        return false;
+#endif
+    return true;
+}
+
+/* Called by drx_exit() on its last invocation */
+void
+drx_buf_exit_library(void)
+{
+    drmgr_unregister_thread_init_event(drx_buf_thread_init);
+    drmgr_unregister_thread_exit_event(drx_buf_thread_exit);
+#ifdef WINDOWS
+    drmgr_unregister_exception_event(drx_buf_exception_event);
+#else
+    drmgr_unregister_signal_event(drx_buf_signal_event);
+#endif
+    drvector_delete(&buffers);
+}
+
+static drx_buf_t *
+drx_buf_create(drx_buf_type_t buf_type, size_t buf_size, drx_buf_full_cb_t full_cb)
+{
+    drx_buf_t *buf;
+    reg_id_t tls_seg;
+    uint tls_offs;
+    int tls_idx;
+
+    tls_idx = drmgr_register_tls_field();
+    if (tls_idx == -1)
+        return NULL;
+    /* The TLS field provided by DR cannot be directly accessed from the code
+     * cache, so we use raw TLS for the write pointer.
+     */
+    if (!dr_raw_tls_calloc(&tls_seg, &tls_offs, 1, 0)) {
+        drmgr_unregister_tls_field(tls_idx);
+        return NULL;
+    }
+    buf = dr_global_alloc(sizeof(*buf));
+    buf->buf_type = buf_type;
+    buf->buf_size = buf_size;
+    buf->full_cb = full_cb;
+    buf->tls_idx = tls_idx;
+    buf->tls_seg = tls_seg;
+    buf->tls_offs = tls_offs;
+    drvector_append(&buffers, buf);
+    return buf;
+}
+
+DR_EXPORT
+drx_buf_t *
+drx_buf_create_circular_buffer(size_t buf_size)
+{
+    if (buf_size == 0)
+        return NULL;
+    if (buf_size == DRX_BUF_FAST_CIRCULAR_BUFSZ)
+        return drx_buf_create(DRX_BUF_CIRCULAR_FAST, buf_size, NULL);
+    return drx_buf_create(DRX_BUF_CIRCULAR, buf_size, NULL);
+}
+
+DR_EXPORT
+drx_buf_t *
+drx_buf_create_trace_buffer(size_t buf_size, drx_buf_full_cb_t full_cb)
+{
+    if (buf_size == 0 || full_cb == NULL)
+        return NULL;
+    return drx_buf_create(DRX_BUF_TRACE, buf_size, full_cb);
+}
+
+DR_EXPORT
+bool
+drx_buf_free(drx_buf_t *buf)
+{
+    uint i;
+    bool found = false;
+    drvector_lock(&buffers);
+    for (i = 0; i < buffers.entries; i++) {
+        if (buffers.array[i] == buf) {
+            buffers.array[i] = NULL;
+            found = true;
+            break;
+        }
+    }
+    drvector_unlock(&buffers);
+    if (!found)
+        return false;
+    if (!drmgr_unregister_tls_field(buf->tls_idx) ||
+        !dr_raw_tls_cfree(buf->tls_offs, 1))
+        return false;
+    dr_global_free(buf, sizeof(*buf));
+    return true;
+}
+
+/***************************************************************************
+ * PER-THREAD DATA
+ */
+
+static void
+drx_buf_thread_init_buffer(void *drcontext, drx_buf_t *buf)
+{
+    per_thread_t *data = dr_thread_alloc(drcontext, sizeof(*data));
+    data->seg_base = dr_get_dr_segment_base(buf->tls_seg);
+    if (buf->buf_type == DRX_BUF_CIRCULAR_FAST) {
+        /* Twice the size so we can hand out a 64KB-aligned start */
+        data->total_size = 2 * DRX_BUF_FAST_CIRCULAR_BUFSZ;
+        data->buf_base = dr_raw_mem_alloc(data->total_size,
+                                          DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+        data->cli_base = (byte *)
+            ALIGN_FORWARD(data->buf_base, DRX_BUF_FAST_CIRCULAR_BUFSZ);
+    } else {
+        size_t used = ALIGN_FORWARD(buf->buf_size, PAGE_SIZE);
+        data->total_size = used + PAGE_SIZE;
+        data->buf_base = dr_raw_mem_alloc(data->total_size,
+                                          DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+        /* End the buffer right at the guard page */
+        data->cli_base = data->buf_base + used - buf->buf_size;
+        if (!dr_memory_protect(data->buf_base + used, PAGE_SIZE, DR_MEMPROT_NONE))
+            ASSERT(false, "failed to protect the buffer guard page");
+    }
+    ASSERT(data->seg_base != NULL && data->buf_base != NULL, "buffer alloc failed");
+    *(byte **)(data->seg_base + buf->tls_offs) = data->cli_base;
+    drmgr_set_tls_field(drcontext, buf->tls_idx, data);
+}
+
+static void
+drx_buf_thread_init(void *drcontext)
+{
+    uint i;
+    drvector_lock(&buffers);
+    for (i = 0; i < buffers.entries; i++) {
+        drx_buf_t *buf = (drx_buf_t *) buffers.array[i];
+        if (buf != NULL)
+            drx_buf_thread_init_buffer(drcontext, buf);
+    }
+    drvector_unlock(&buffers);
+}
+
+static void
+drx_buf_thread_exit(void *drcontext)
+{
+    uint i;
+    drvector_lock(&buffers);
+    for (i = 0; i < buffers.entries; i++) {
+        drx_buf_t *buf = (drx_buf_t *) buffers.array[i];
+        per_thread_t *data;
+        if (buf == NULL)
+            continue;
+        data = (per_thread_t *) drmgr_get_tls_field(drcontext, buf->tls_idx);
+        if (data == NULL)
+            continue;
+        /* Hand any remaining trace data to the client */
+        if (buf->buf_type == DRX_BUF_TRACE) {
+            byte *ptr = *(byte **)(data->seg_base + buf->tls_offs);
+            if (ptr > data->cli_base)
+                (*buf->full_cb)(drcontext, data->cli_base, ptr - data->cli_base);
+        }
+        dr_raw_mem_free(data->buf_base, data->total_size);
+        dr_thread_free(drcontext, data, sizeof(*data));
+        drmgr_set_tls_field(drcontext, buf->tls_idx, NULL);
+    }
+    drvector_unlock(&buffers);
+}
+
+DR_EXPORT
+void *
+drx_buf_get_buffer_ptr(void *drcontext, drx_buf_t *buf)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, buf->tls_idx);
+    return *(byte **)(data->seg_base + buf->tls_offs);
+}
+
+DR_EXPORT
+void
+drx_buf_set_buffer_ptr(void *drcontext, drx_buf_t *buf, void *new_ptr)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, buf->tls_idx);
+    *(byte **)(data->seg_base + buf->tls_offs) = (byte *) new_ptr;
+}
+
+DR_EXPORT
+void *
+drx_buf_get_buffer_base(void *drcontext, drx_buf_t *buf)
+{
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, buf->tls_idx);
+    return data->cli_base;
+}
+
+DR_EXPORT
+size_t
+drx_buf_get_buffer_size(void *drcontext, drx_buf_t *buf)
+{
+    return buf->buf_size;
+}
+
+/***************************************************************************
+ * FULL BUFFER FAULTS
+ */
+
+/* Returns the register holding the buffer pointer used by the store at pc
+ * that touched the guard page at target, or DR_REG_NULL.
+ */
+static reg_id_t
+drx_buf_faulting_base_reg(void *drcontext, byte *pc, byte *target,
+                          dr_mcontext_t *raw_mc)
+{
+    instr_t instr;
+    reg_id_t base = DR_REG_NULL;
+    int i;
+    instr_init(drcontext, &instr);
+    if (decode(drcontext, pc, &instr) != NULL) {
+        for (i = 0; i < instr_num_dsts(&instr); i++) {
+            opnd_t dst = instr_get_dst(&instr, i);
+            if (opnd_is_base_disp(dst) &&
+                opnd_compute_address(dst, raw_mc) == target) {
+                base = opnd_get_base(dst);
+                break;
+            }
+        }
+    }
+    instr_free(drcontext, &instr);
+    return base;
+}
+
+/* Handles a store into some buffer's guard page by flushing (for a trace
+ * buffer) and pointing both the register and the TLS slot back at the
+ * buffer start.  Returns whether the fault was ours.
+ */
+static bool
+drx_buf_handle_fault(void *drcontext, byte *target, dr_mcontext_t *raw_mc)
+{
+    uint i;
+    bool handled = false;
+    drvector_lock(&buffers);
+    for (i = 0; i < buffers.entries; i++) {
+        drx_buf_t *buf = (drx_buf_t *) buffers.array[i];
+        per_thread_t *data;
+        byte *end;
+        reg_id_t reg;
+        byte *ptr;
+        if (buf == NULL || buf->buf_type == DRX_BUF_CIRCULAR_FAST)
+            continue;
+        data = (per_thread_t *) drmgr_get_tls_field(drcontext, buf->tls_idx);
+        if (data == NULL)
+            continue;
+        end = data->cli_base + buf->buf_size;
+        if (target < end || target >= end + PAGE_SIZE)
+            continue;
+        reg = drx_buf_faulting_base_reg(drcontext, raw_mc->pc, target, raw_mc);
+        if (reg == DR_REG_NULL)
+            break;
+        ptr = (byte *) reg_get_value(reg, raw_mc);
+        if (buf->buf_type == DRX_BUF_TRACE) {
+            (*buf->full_cb)(drcontext, data->cli_base,
+                            ptr > end ? buf->buf_size : ptr - data->cli_base);
+        }
+        reg_set_value(reg, raw_mc, (reg_t) data->cli_base);
+        *(byte **)(data->seg_base + buf->tls_offs) = data->cli_base;
+        handled = true;
+        break;
+    }
+    drvector_unlock(&buffers);
+    return handled;
+}
+
+#ifdef WINDOWS
+static bool
+drx_buf_exception_event(void *drcontext, dr_exception_t *excpt)
+{
+    if (excpt->record->ExceptionCode != STATUS_ACCESS_VIOLATION)
+        return true;
+    /* Returning false re-executes the store with the updated raw mcontext */
+    return !drx_buf_handle_fault(drcontext, (byte *)
+                                 excpt->record->ExceptionInformation[1],
+                                 excpt->raw_mcontext);
+}
+#else
+static dr_signal_action_t
+drx_buf_signal_event(void *drcontext, dr_siginfo_t *info)
+{
+    if ((info->sig != SIGSEGV && info->sig != SIGBUS) || !info->raw_mcontext_valid)
+        return DR_SIGNAL_DELIVER;
+    /* DR_SIGNAL_SUPPRESS resumes at the updated raw mcontext */
+    if (drx_buf_handle_fault(drcontext, info->access_address, info->raw_mcontext))
+        return DR_SIGNAL_SUPPRESS;
+    return DR_SIGNAL_DELIVER;
+}
+#endif
+
+/***************************************************************************
+ * INSTRUMENTATION
+ */
+
+DR_EXPORT
+void
+drx_buf_insert_load_buf_ptr(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
+                            instr_t *where, reg_id_t buf_ptr)
+{
+    dr_insert_read_raw_tls(drcontext, ilist, where, buf->tls_seg,
+                           buf->tls_offs, buf_ptr);
+}
+
+DR_EXPORT
+void
+drx_buf_insert_update_buf_ptr(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
+                              instr_t *where, reg_id_t buf_ptr, reg_id_t scratch,
+                              ushort stride)
+{
+#ifdef X86
+    if (buf->buf_type == DRX_BUF_CIRCULAR_FAST) {
+        /* Bump just the low 16 bits so the pointer wraps within the 64KB-aligned
+         * buffer.  We use lea to avoid an aflags save/restore.
+         */
+        reg_id_t reg_16 = reg_32_to_16(IF_X64_ELSE(reg_64_to_32(buf_ptr), buf_ptr));
+        MINSERT(ilist, where, INSTR_CREATE_lea
+                (drcontext, opnd_create_reg(reg_16),
+                 opnd_create_base_disp(buf_ptr, DR_REG_NULL, 0, stride, OPSZ_lea)));
+    } else {
+        MINSERT(ilist, where, INSTR_CREATE_lea
+                (drcontext, opnd_create_reg(buf_ptr),
+                 opnd_create_base_disp(buf_ptr, DR_REG_NULL, 0, stride, OPSZ_lea)));
+    }
+#elif defined(ARM)
+    ASSERT(scratch != DR_REG_NULL, "drx_buf_insert_update_buf_ptr: need scratch reg");
+    MINSERT(ilist, where, XINST_CREATE_load_int
+            (drcontext, opnd_create_reg(scratch), OPND_CREATE_INT(stride)));
+    if (buf->buf_type == DRX_BUF_CIRCULAR_FAST) {
+        /* uadd16 wraps each halfword: the top one gets 0 added */
+        MINSERT(ilist, where, INSTR_CREATE_uadd16
+                (drcontext, opnd_create_reg(buf_ptr), opnd_create_reg(buf_ptr),
+                 opnd_create_reg(scratch)));
+    } else {
+        MINSERT(ilist, where, XINST_CREATE_add
+                (drcontext, opnd_create_reg(buf_ptr), opnd_create_reg(scratch)));
+    }
+#endif
+    dr_insert_write_raw_tls(drcontext, ilist, where, buf->tls_seg,
+                            buf->tls_offs, buf_ptr);
+}
+
+static bool
+drx_buf_insert_store_reg(void *drcontext, instrlist_t *ilist, instr_t *where,
+                         opnd_t dst, reg_id_t src, opnd_size_t opsz)
+{
+    instr_t *instr;
+    switch (opsz) {
+    case OPSZ_1:
+        instr = XINST_CREATE_store_1byte(drcontext, dst, opnd_create_reg(src));
+        break;
+    case OPSZ_2:
+        instr = XINST_CREATE_store_2bytes(drcontext, dst, opnd_create_reg(src));
+        break;
+    case OPSZ_4:
+    IF_X64(case OPSZ_8:)
+        instr = XINST_CREATE_store(drcontext, dst, opnd_create_reg(src));
+        break;
+    default:
+        return false;
+    }
+    MINSERT(ilist, where, instr);
+    return true;
+}
+
+DR_EXPORT
+bool
+drx_buf_insert_buf_store(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
+                         instr_t *where, reg_id_t buf_ptr, reg_id_t scratch,
+                         opnd_t opnd, opnd_size_t opsz, short offset)
+{
+    opnd_t dst = opnd_create_base_disp(buf_ptr, DR_REG_NULL, 0, offset, opsz);
+    if (opnd_is_reg(opnd)) {
+        reg_id_t src = opnd_get_reg(opnd);
+        if (opnd_size_in_bytes(reg_get_size(src)) != opnd_size_in_bytes(opsz))
+            return false;
+        return drx_buf_insert_store_reg(drcontext, ilist, where, dst, src, opsz);
+    }
+    if (!opnd_is_immed_int(opnd))
+        return false;
+#ifdef X86
+    {
+        ptr_int_t val = opnd_get_immed_int(opnd);
+        switch (opsz) {
+        case OPSZ_1:
+            MINSERT(ilist, where, INSTR_CREATE_mov_st
+                    (drcontext, dst, OPND_CREATE_INT8((char)val)));
+            return true;
+        case OPSZ_2:
+            MINSERT(ilist, where, INSTR_CREATE_mov_st
+                    (drcontext, dst, OPND_CREATE_INT16((short)val)));
+            return true;
+        case OPSZ_4:
+            MINSERT(ilist, where, INSTR_CREATE_mov_st
+                    (drcontext, dst, OPND_CREATE_INT32((int)val)));
+            return true;
+# ifdef X64
+        case OPSZ_8:
+            /* A sign-extended imm32 fits directly; otherwise go through scratch */
+            if (val == (ptr_int_t)(int)val) {
+                MINSERT(ilist, where, INSTR_CREATE_mov_st
+                        (drcontext, dst, OPND_CREATE_INT32((int)val)));
+                return true;
+            }
+            break;
+# endif
+        default:
+            return false;
+        }
+    }
+#endif
+    /* Materialize the immediate in scratch first */
+    if (scratch == DR_REG_NULL)
+        return false;
+    {
+        instr_t *first, *last;
+        instrlist_insert_mov_immed_ptrsz(drcontext, opnd_get_immed_int(opnd),
+                                         opnd_create_reg(scratch), ilist, where,
+                                         &first, &last);
+        instr_set_meta(first);
+        if (last != NULL)
+            instr_set_meta(last);
+    }
+    if (opsz != OPSZ_PTR) {
+        scratch = reg_resize_to_opsz(scratch, opsz);
+        if (scratch == DR_REG_NULL)
+            return false;
+    }
+    return drx_buf_insert_store_reg(drcontext, ilist, where, dst, scratch, opsz);
+}
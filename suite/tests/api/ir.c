@@ -1332,6 +1332,60 @@ test_xinst_create(void *dc)
     instr_reset(dc, ins2);
 }
 
+static void
+check_immed_opnds(instr_t *instr, int num_dsts, int num_srcs, int dst_base, int src_base)
+{
+    int i;
+    ASSERT(instr_num_dsts(instr) == num_dsts);
+    ASSERT(instr_num_srcs(instr) == num_srcs);
+    for (i = 0; i < num_dsts; i++)
+        ASSERT(opnd_get_immed_int(instr_get_dst(instr, i)) == dst_base + i);
+    for (i = 0; i < num_srcs; i++)
+        ASSERT(opnd_get_immed_int(instr_get_src(instr, i)) == src_base + i);
+}
+
+static void
+test_opnd_storage(void *dc)
+{
+    /* Operands that fit are held inline in instr_t, the rest in separate
+     * arrays: check that setting, cloning, and removing operands all behave
+     * on both sides of that boundary.
+     */
+    instr_t *instr, *copy;
+    int num, i;
+    for (num = 1; num <= 6; num++) {
+        instr = instr_build(dc, OP_nop, num, num);
+        for (i = 0; i < num; i++) {
+            instr_set_dst(instr, i, opnd_create_immed_int(100 + i, OPSZ_4));
+            instr_set_src(instr, i, opnd_create_immed_int(200 + i, OPSZ_4));
+        }
+        check_immed_opnds(instr, num, num, 100, 200);
+        copy = instr_clone(dc, instr);
+        instr_destroy(dc, instr);
+        check_immed_opnds(copy, num, num, 100, 200);
+        /* drop the first one to shift the rest down, including src0 */
+        instr_remove_dsts(dc, copy, 0, 1);
+        instr_remove_srcs(dc, copy, 0, 1);
+        check_immed_opnds(copy, num - 1, num - 1, 101, 201);
+        if (num > 2) {
+            /* drop the last one */
+            instr_remove_dsts(dc, copy, num - 2, num - 1);
+            instr_remove_srcs(dc, copy, num - 2, num - 1);
+            check_immed_opnds(copy, num - 2, num - 2, 101, 201);
+        }
+        instr_destroy(dc, copy);
+    }
+    /* remove from the middle of a large instr */
+    instr = instr_build(dc, OP_nop, 0, 6);
+    for (i = 0; i < 6; i++)
+        instr_set_src(instr, i, opnd_create_immed_int(i, OPSZ_4));
+    instr_remove_srcs(dc, instr, 1, 5);
+    ASSERT(instr_num_srcs(instr) == 2);
+    ASSERT(opnd_get_immed_int(instr_get_src(instr, 0)) == 0);
+    ASSERT(opnd_get_immed_int(instr_get_src(instr, 1)) == 5);
+    instr_destroy(dc, instr);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -1395,6 +1449,8 @@ main(int argc, char *argv[])
 
     test_xinst_create(dcontext);
 
+    test_opnd_storage(dcontext);
+
     print("all done\n");
     return 0;
 }
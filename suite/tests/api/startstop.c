@@ -165,7 +165,11 @@ int main(void)
 #ifdef USE_DYNAMO
         if (dr_app_running_under_dynamorio())
             print("ERROR: should not be under DynamoRIO before dr_app_start!\n");
-        dr_app_start();
+        /* Once the other threads are ours, re-enter with just this thread */
+        if (j == 0)
+            dr_app_start();
+        else
+            dr_app_start_thread();
         if (!dr_app_running_under_dynamorio())
             print("ERROR: should be under DynamoRIO after dr_app_start!\n");
 #endif
@@ -0,0 +1,188 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of VMware, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Tests drmgr's multiplexed persistence of per-module records.  The first
+ * run writes pcaches and is passed -write_extra to add a record the second
+ * run does not register, which must be skipped on resurrection.
+ */
+
+#include "dr_api.h"
+#include "drmgr.h"
+#include "hashtable.h"
+#include <string.h> /* strstr */
+
+#define CHECK(x, msg) do {               \
+    if (!(x)) {                          \
+        dr_fprintf(STDERR, "%s\n", msg); \
+        dr_abort();                      \
+    }                                    \
+} while (0);
+
+#define PERSIST_FLAGS \
+    (DR_HASHPERS_REBASE_KEY | DR_HASHPERS_ONLY_IN_RANGE | DR_HASHPERS_ONLY_PERSISTED)
+
+#define MAGIC_VALUE 0xfeedbeef
+
+/* key is the start of every bb; payload is its first byte */
+static hashtable_t bb_table;
+static uint resurrect_success;
+static bool write_extra;
+
+static size_t
+bbs_size(void *drcontext, void *perscxt, void **user_data OUT)
+{
+    return hashtable_persist_size(drcontext, &bb_table, sizeof(ptr_uint_t), perscxt,
+                                  PERSIST_FLAGS);
+}
+
+static bool
+bbs_persist(void *drcontext, void *perscxt, file_t fd, void *user_data)
+{
+    return hashtable_persist(drcontext, &bb_table, sizeof(ptr_uint_t), fd, perscxt,
+                             PERSIST_FLAGS);
+}
+
+static bool
+bbs_resurrect(void *drcontext, void *perscxt, byte *data, size_t size)
+{
+    byte *map = data;
+    uint i;
+    CHECK(((ptr_uint_t)data & (sizeof(void *) - 1)) == 0, "record data not aligned");
+    if (!hashtable_resurrect(drcontext, &map, &bb_table, sizeof(ptr_uint_t), perscxt,
+                             DR_HASHPERS_REBASE_KEY, NULL))
+        return false;
+    CHECK(map == data + size, "hashtable record size mismatch");
+    for (i = 0; i < HASHTABLE_SIZE(bb_table.table_bits); i++) {
+        hash_entry_t *he;
+        for (he = bb_table.table[i]; he != NULL; he = he->next) {
+            CHECK(*((app_pc)he->key) == (byte)(ptr_uint_t)he->payload ||
+                  /* a syscall hook is not yet in place at load time (i#1196) */
+                  (byte)(ptr_uint_t)he->payload == 0xe9,
+                  "resurrected bb byte mismatch");
+        }
+    }
+    resurrect_success++;
+    return true;
+}
+
+static size_t
+magic_size(void *drcontext, void *perscxt, void **user_data OUT)
+{
+    *user_data = (void *)(ptr_uint_t)MAGIC_VALUE;
+    return sizeof(uint);
+}
+
+static bool
+magic_persist(void *drcontext, void *perscxt, file_t fd, void *user_data)
+{
+    uint val = (uint)(ptr_uint_t)user_data;
+    return dr_write_file(fd, &val, sizeof(val)) == (ssize_t)sizeof(val);
+}
+
+static bool
+magic_resurrect(void *drcontext, void *perscxt, byte *data, size_t size)
+{
+    CHECK(size == sizeof(uint) && *(uint *)data == MAGIC_VALUE,
+          "magic record mismatch");
+    return true;
+}
+
+static size_t
+extra_size(void *drcontext, void *perscxt, void **user_data OUT)
+{
+    return 3; /* odd size to exercise padding */
+}
+
+static bool
+extra_persist(void *drcontext, void *perscxt, file_t fd, void *user_data)
+{
+    return dr_write_file(fd, "xyz", 3) == 3;
+}
+
+static bool
+extra_resurrect(void *drcontext, void *perscxt, byte *data, size_t size)
+{
+    CHECK(false, "extra record should not be resurrected");
+    return false;
+}
+
+static dr_emit_flags_t
+event_bb(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool translating)
+{
+    app_pc pc = dr_fragment_app_pc(tag);
+    hashtable_add(&bb_table, (void *)pc, (void *)(ptr_uint_t)(*pc));
+    return DR_EMIT_DEFAULT | DR_EMIT_PERSISTABLE;
+}
+
+static void
+event_exit(void)
+{
+    if (resurrect_success > 0)
+        dr_fprintf(STDERR, "successfully resurrected drmgr records\n");
+    CHECK(drmgr_unregister_persist_ro("drmgr-persist.bbs"), "unregister failed");
+    CHECK(drmgr_unregister_persist_ro("drmgr-persist.magic"), "unregister failed");
+    CHECK(!drmgr_unregister_persist_ro("drmgr-persist.bbs"),
+          "double unregister should fail");
+    if (write_extra)
+        CHECK(drmgr_unregister_persist_ro("drmgr-persist.extra"), "unregister failed");
+    hashtable_delete(&bb_table);
+    drmgr_exit();
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    bool ok;
+    drmgr_init();
+    write_extra = strstr(dr_get_options(id), "-write_extra") != NULL;
+    hashtable_init(&bb_table, 8, HASH_INTPTR, false/*!strdup*/);
+    dr_register_exit_event(event_exit);
+    ok = drmgr_register_bb_app2app_event(event_bb, NULL);
+    CHECK(ok, "drmgr register bb failed");
+
+    /* Register the extra record first so it precedes the others in the file. */
+    if (write_extra) {
+        ok = drmgr_register_persist_ro("drmgr-persist.extra", extra_size,
+                                       extra_persist, extra_resurrect);
+        CHECK(ok, "register extra failed");
+    }
+    ok = drmgr_register_persist_ro("drmgr-persist.bbs", bbs_size, bbs_persist,
+                                   bbs_resurrect);
+    CHECK(ok, "register bbs failed");
+    ok = drmgr_register_persist_ro("drmgr-persist.magic", magic_size, magic_persist,
+                                   magic_resurrect);
+    CHECK(ok, "register magic failed");
+    ok = drmgr_register_persist_ro("drmgr-persist.magic", magic_size, magic_persist,
+                                   magic_resurrect);
+    CHECK(!ok, "duplicate name should fail");
+}
@@ -60,6 +60,12 @@ static bool in_post_syscall_B;
 static void *syslock;
 static uint one_time_exec;
 
+/* For testing bb filters */
+static const char *filter_modules[2];
+static module_data_t *exe;
+static uint filtered_bbs;
+static uint thread_filter_calls;
+
 #define MAGIC_NUMBER_FROM_CACHE 0x0eadbeef
 
 static bool checked_tls_from_cache;
@@ -103,6 +109,9 @@ static dr_emit_flags_t event_bb4_insert2(void *drcontext, void *tag, instrlist_t
 
 static dr_emit_flags_t one_time_bb_event(void *drcontext, void *tag, instrlist_t *bb,
                                          bool for_trace, bool translating);
+static bool event_filter_thread(void *drcontext);
+static dr_emit_flags_t event_filtered_bb(void *drcontext, void *tag, instrlist_t *bb,
+                                         bool for_trace, bool translating);
 DR_EXPORT void
 dr_init(client_id_t id)
 {
@@ -112,6 +121,10 @@ dr_init(client_id_t id)
                                   NULL, NULL, 10};
     drmgr_priority_t sys_pri_B = {sizeof(priority), "drmgr-test-B",
                                   "drmgr-test-A", NULL, 5};
+    static drmgr_bb_filter_t filter = {sizeof(filter), filter_modules, NULL,
+                                       event_filter_thread, false};
+    drmgr_priority_t filter_pri = {sizeof(priority), "drmgr-test-filter",
+                                   NULL, NULL, 0, &filter};
     bool ok;
 
     drmgr_init();
@@ -162,6 +175,14 @@ dr_init(client_id_t id)
 
     ok = drmgr_register_bb_app2app_event(one_time_bb_event, NULL);
     CHECK(ok, "drmgr app2app registration failed");
+
+    /* test restricting a pass to the executable */
+    exe = dr_get_main_module();
+    CHECK(exe != NULL, "failed to find the executable");
+    filter_modules[0] = dr_module_preferred_name(exe);
+    filter_modules[1] = NULL;
+    ok = drmgr_register_bb_app2app_event(event_filtered_bb, &filter_pri);
+    CHECK(ok, "drmgr filtered app2app registration failed");
 }
 
 static void
@@ -173,10 +194,17 @@ event_exit(void)
     CHECK(checked_tls_write_from_cache, "failed to hit clean call");
     CHECK(checked_cls_write_from_cache, "failed to hit clean call");
     CHECK(one_time_exec == 1, "failed to execute one-time event");
+    CHECK(filtered_bbs > 0 && thread_filter_calls >= filtered_bbs,
+          "filtered pass never ran");
 
     if (!drmgr_unregister_bb_instrumentation_event(event_bb_analysis))
         CHECK(false, "drmgr unregistration failed");
 
+    if (!drmgr_unregister_bb_app2app_event(event_filtered_bb))
+        CHECK(false, "drmgr unregistration failed");
+    /* The filter's module name belongs to the module data */
+    dr_free_module_data(exe);
+
     if (!drmgr_unregister_bb_instrumentation_ex_event(event_bb4_app2app,
                                                       event_bb4_analysis,
                                                       event_bb4_insert,
@@ -492,3 +520,21 @@ one_time_bb_event(void *drcontext, void *tag, instrlist_t *bb,
 
     return DR_EMIT_DEFAULT;
 }
+
+static bool
+event_filter_thread(void *drcontext)
+{
+    dr_atomic_add32_return_sum((volatile int *)&thread_filter_calls, 1);
+    return true;
+}
+
+static dr_emit_flags_t
+event_filtered_bb(void *drcontext, void *tag, instrlist_t *bb,
+                  bool for_trace, bool translating)
+{
+    app_pc pc = dr_fragment_app_pc(tag);
+    CHECK(pc >= exe->start && pc < exe->end,
+          "filtered pass saw a block of another module");
+    dr_atomic_add32_return_sum((volatile int *)&filtered_bbs, 1);
+    return DR_EMIT_DEFAULT;
+}
@@ -34,6 +34,7 @@
 /* Tests the drx extension */
 
 #include "dr_api.h"
+#include "drmgr.h"
 #include "drx.h"
 
 #define CHECK(x, msg) do {               \
@@ -44,11 +45,37 @@
 } while (0);
 
 static client_id_t client_id;
+static drx_sampler_t *sampler;
+static int num_samples;
+
+static void
+sample_cb(void *drcontext, void *user_data)
+{
+    CHECK(user_data == (void *) &num_samples, "wrong user data");
+    dr_atomic_add32_return_sum(&num_samples, 1);
+}
+
+static dr_emit_flags_t
+event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
+                      bool for_trace, bool translating, void *user_data)
+{
+    if (drmgr_is_first_instr(drcontext, inst)) {
+        CHECK(drx_insert_sampled_clean_call(drcontext, sampler, bb, inst,
+                                            SPILL_SLOT_1, SPILL_SLOT_2, sample_cb,
+                                            (void *) &num_samples),
+              "sampled clean call insertion failed");
+    }
+    return DR_EMIT_DEFAULT;
+}
 
 static void
 event_exit(void)
 {
+    CHECK(num_samples > 0, "sampled clean call never ran");
+    CHECK(drx_sampler_free(sampler), "sampler free failed");
+    drmgr_unregister_bb_insertion_event(event_app_instruction);
     drx_exit();
+    drmgr_exit();
     dr_fprintf(STDERR, "event_exit\n");
 }
 
@@ -74,12 +101,58 @@ event_soft_kill(process_id_t pid, int exit_code)
     return true; /* skip kill */
 }
 
+static void
+test_instrumentation_levels(void)
+{
+    /* Any pc works as a tag: one that was never executed is not flushed */
+    app_pc tag = (app_pc) test_instrumentation_levels;
+    CHECK(drx_get_instrumentation_level(tag) == 0, "default level should be 0");
+    CHECK(drx_set_instrumentation_level(tag, 2), "set level failed");
+    CHECK(drx_get_instrumentation_level(tag) == 2, "level not set");
+    CHECK(drx_set_instrumentation_level(tag, 2), "re-set level failed");
+    CHECK(drx_set_instrumentation_level(tag, 0), "reset level failed");
+    CHECK(drx_get_instrumentation_level(tag) == 0, "level not reset");
+    CHECK(!drx_set_instrumentation_level(NULL, 1), "NULL tag should fail");
+}
+
+static void
+test_async_writer(void)
+{
+    char path[MAXIMUM_PATH];
+    const char *record = "0123456789abcdef";
+    drx_async_writer_t *w;
+    uint64 size;
+    file_t f;
+    int i;
+    f = drx_open_unique_file(".", "drx-test", "log", 0, path,
+                             sizeof(path));
+    CHECK(f != INVALID_FILE, "unable to open file");
+    /* a small limit so that writers also exercise the backpressure path */
+    w = drx_async_writer_create(f, 64);
+    CHECK(w != NULL, "writer creation failed");
+    for (i = 0; i < 100; i++)
+        CHECK(drx_async_writer_write(w, record, 16), "write failed");
+    CHECK(drx_async_writer_flush(w), "flush failed");
+    CHECK(dr_file_size(f, &size) && size == 100*16, "flushed data missing");
+    CHECK(drx_async_writer_write(w, record, 16), "write failed");
+    CHECK(drx_async_writer_destroy(w), "destroy failed");
+    CHECK(dr_file_size(f, &size) && size == 101*16, "destroy did not flush");
+    dr_close_file(f);
+    CHECK(dr_delete_file(path), "unable to delete file");
+}
+
 DR_EXPORT void
 dr_init(client_id_t id)
 {
-    bool ok = drx_init();
+    bool ok = drmgr_init() && drx_init();
     client_id = id;
     CHECK(ok, "drx_init failed");
+    CHECK(drx_sampler_create(0, false) == NULL, "zero period should fail");
+    sampler = drx_sampler_create(1000, true/*randomize*/);
+    CHECK(sampler != NULL, "sampler creation failed");
+    drmgr_register_bb_instrumentation_event(NULL, event_app_instruction, NULL);
+    test_instrumentation_levels();
+    test_async_writer();
     dr_register_exit_event(event_exit);
     drx_register_soft_kills(event_soft_kill);
     dr_register_nudge_event(event_nudge, id);
@@ -52,6 +52,7 @@
 #define TEST TESTANY
 
 static void test_dr_rename_delete(void);
+static void test_buffered(void);
 static void test_dir(void);
 static void test_relative(void);
 
@@ -184,6 +185,7 @@ void dr_init(client_id_t id)
 
     /* Test dr_rename_file. */
     test_dr_rename_delete();
+    test_buffered();
 
     /* Test the memory query routines */
     dummy_func();
@@ -381,6 +383,40 @@ test_dr_rename_delete(void)
         dr_delete_file(tmp_dst);
 }
 
+static void
+test_buffered(void)
+{
+    char tmp[MAXIMUM_PATH];
+    const char *line = "buffered line\n";
+    uint64 size;
+    file_t fd;
+    int i;
+
+    get_temp_filename(tmp);
+    fd = dr_open_file(tmp, DR_FILE_WRITE_OVERWRITE | DR_FILE_BUFFERED);
+    if (fd == INVALID_FILE) {
+        dr_fprintf(STDERR, "failed to open buffered file\n");
+        return;
+    }
+    for (i = 0; i < 10; i++) {
+        dr_fprintf(fd, "%s", line);
+        dr_write_file(fd, line, strlen(line));
+    }
+    /* Nothing should have reached the file yet */
+    if (!dr_file_size(fd, &size) || size != 0)
+        dr_fprintf(STDERR, "buffered writes were not buffered\n");
+    dr_flush_file(fd);
+    if (!dr_file_size(fd, &size) || size != 20*strlen(line))
+        dr_fprintf(STDERR, "buffered writes were not flushed\n");
+    /* The position should account for buffered writes */
+    dr_write_file(fd, line, strlen(line));
+    if (dr_file_tell(fd) != 21*strlen(line))
+        dr_fprintf(STDERR, "buffered file position is wrong\n");
+    dr_close_file(fd);
+    if (!dr_delete_file(tmp))
+        dr_fprintf(STDERR, "deleting buffered file failed\n");
+}
+
 static void
 test_dir(void)
 {
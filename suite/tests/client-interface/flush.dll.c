@@ -199,10 +199,20 @@ void callback(void *tag, app_pc next_pc)
             dr_redirect_execution(&mcontext);
             *(volatile uint *)NULL = 0; /* ASSERT_NOT_REACHED() */
         } else if (use_unlink) {
-            /* Test dr_unlink_flush_region() half the time (if available).
+            /* Test dr_unlink_flush_region() half the time (if available),
+             * alternating with dr_unlink_flush_regions().
              * FIXME - extend once we add unlink callback. */
             delay_flush_at_next_build = true;
-            dr_unlink_flush_region(tag, 1);
+            if (callback_count % 400 == 100)
+                dr_unlink_flush_region(tag, 1);
+            else {
+                dr_flush_region_t regions[2];
+                regions[0].start = (app_pc)tag;
+                regions[0].size = 1;
+                regions[1].start = next_pc;
+                regions[1].size = 1;
+                dr_unlink_flush_regions(regions, 2);
+            }
         }
     }
 }
@@ -0,0 +1,118 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of VMware, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests dr_fragment_exec_count() and dr_fragment_exec_count_iterate(),
+ * including that a block's count is kept when its fragment is flushed and
+ * rebuilt.
+ */
+
+#include "dr_api.h"
+
+#define NUM_CALLS 1000
+
+static void *marker_tag;
+static int marker_builds;
+static uint clean_call_count;
+static bool flushed;
+
+static void
+at_marker(void)
+{
+    clean_call_count++;
+    if (clean_call_count == NUM_CALLS / 2) {
+        flushed = true;
+        if (!dr_delay_flush_region((app_pc)marker_tag, 1, 0, NULL))
+            dr_fprintf(STDERR, "ERROR: unable to flush the marker block\n");
+    }
+}
+
+static dr_emit_flags_t
+bb_event(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool translating)
+{
+    instr_t *first = instrlist_first(bb);
+    instr_t *next = instr_get_next(first);
+    /* The app marks the block with "nop; xchg xbp, xbp" */
+    if (!instr_is_nop(first) || next == NULL || !instr_is_nop(next) ||
+        instr_get_opcode(next) != OP_xchg ||
+        !instr_writes_to_exact_reg(next, DR_REG_XBP, DR_QUERY_DEFAULT))
+        return DR_EMIT_DEFAULT;
+    marker_tag = tag;
+    if (!for_trace && !translating)
+        marker_builds++;
+    if (!flushed) {
+        dr_insert_clean_call(drcontext, bb, first, (void *)at_marker, false, 0);
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+static bool
+iter_cb(app_pc tag, uint64 count, void *user_data)
+{
+    if (tag == (app_pc)marker_tag) {
+        *(uint64 *)user_data = count;
+        return false;
+    }
+    return true;
+}
+
+static void
+exit_event(void)
+{
+    void *drcontext = dr_get_current_drcontext();
+    uint64 count = dr_fragment_exec_count(drcontext, marker_tag);
+    uint64 iter_count = 0;
+    if (count == NUM_CALLS)
+        dr_fprintf(STDERR, "marker executed %d times\n", NUM_CALLS);
+    else
+        dr_fprintf(STDERR, "ERROR: marker count is "UINT64_FORMAT_STRING"\n", count);
+    if (marker_builds >= 2)
+        dr_fprintf(STDERR, "marker rebuilt after flush\n");
+    else
+        dr_fprintf(STDERR, "ERROR: marker built %d times\n", marker_builds);
+    if (!dr_fragment_exec_count_iterate(iter_cb, &iter_count))
+        dr_fprintf(STDERR, "ERROR: -fragment_counts is not enabled\n");
+    if (iter_count == count)
+        dr_fprintf(STDERR, "iterator agrees\n");
+    else {
+        dr_fprintf(STDERR, "ERROR: iterator count is "UINT64_FORMAT_STRING"\n",
+                   iter_count);
+    }
+    if (dr_fragment_exec_count(drcontext, (void *)exit_event) != 0)
+        dr_fprintf(STDERR, "ERROR: client code has a count\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    dr_register_bb_event(bb_event);
+    dr_register_exit_event(exit_event);
+}
@@ -0,0 +1,237 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Microbenchmarks of the code that the extension libraries add to an app.
+ * Not a test: the run_bench_ext target runs it natively, under DR and under
+ * DR with the bench_ext client in each of its modes (see bench_ext.dll.c).
+ *
+ * Usage: bench_ext [-scale N] [-threads N,...] [name ...]
+ * With no names every benchmark is run, once per thread count (by default
+ * 1, 2, 4 and 8).  Each run prints one line:
+ *   bench,<name>.t<threads>,<iterations>,<nanoseconds per iteration>
+ * where the iterations are summed over the threads, so the time is the
+ * inverse of the combined throughput.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define NOINLINE __attribute__((noinline))
+#define MAX_THREADS 64
+
+static int scale = 1;
+static int thread_counts[MAX_THREADS] = { 1, 2, 4, 8 };
+static int num_thread_counts = 4;
+static volatile int go;
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/***************************************************************************
+ * The benchmarks: each runs iters iterations and returns a value to keep
+ * the compiler honest.
+ */
+
+/* The client wraps this by name, so it must be exported and not inlined. */
+NOINLINE int
+bench_ext_wrapped(int x)
+{
+    __asm__ __volatile__("" : "+r"(x));
+    return x + 1;
+}
+
+static long
+wrap_call(long iters)
+{
+    long i;
+    int x = 0;
+    for (i = 0; i < iters; i++)
+        x = bench_ext_wrapped(x);
+    return x;
+}
+
+/* Several short blocks per iteration, for per-block counters. */
+static long
+blocks(long iters)
+{
+    long i, x = 0;
+    for (i = 0; i < iters; i++) {
+        if (i & 1)
+            x += 3;
+        else
+            x ^= i;
+        __asm__ __volatile__("" : "+r"(x));
+        if (i & 2)
+            x -= 1;
+        __asm__ __volatile__("" : "+r"(x));
+        if (i & 4)
+            x += i;
+    }
+    return x;
+}
+
+#define MEM_ELEMS 1024
+
+/* Memory references with several values live at once, for register pressure
+ * from per-reference instrumentation.  Each thread has its own arrays.
+ */
+static long
+memrefs(long iters)
+{
+    long a[MEM_ELEMS], b[MEM_ELEMS], c[MEM_ELEMS];
+    long i, j, x = 0, y = 1, z = 2;
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    memset(c, 0, sizeof(c));
+    for (i = 0; i < iters; i++) {
+        j = i & (MEM_ELEMS - 1);
+        x += a[j];
+        y ^= b[(j * 7) & (MEM_ELEMS - 1)];
+        z += c[(j * 13) & (MEM_ELEMS - 1)];
+        a[j] = y;
+        b[j] = z;
+        c[j] = x;
+    }
+    return x + y + z;
+}
+
+static const struct {
+    const char *name;
+    long (*func)(long iters);
+    long iters;
+} benchmarks[] = {
+    { "wrap_call", wrap_call, 10000000L },
+    { "blocks", blocks, 20000000L },
+    { "memrefs", memrefs, 20000000L },
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks)/sizeof(benchmarks[0]))
+
+/***************************************************************************/
+
+typedef struct _run_t {
+    long (*func)(long iters);
+    long iters;
+    long result;
+} run_t;
+
+static void *
+run_thread(void *arg)
+{
+    run_t *run = (run_t *) arg;
+    while (!go)
+        ; /* spin so that all threads start together */
+    run->result = run->func(run->iters);
+    return NULL;
+}
+
+static void
+run_benchmark(int b, int num_threads)
+{
+    pthread_t threads[MAX_THREADS];
+    run_t runs[MAX_THREADS];
+    long per_thread = benchmarks[b].iters * scale / num_threads;
+    double start;
+    char name[64];
+    int t;
+    go = 0;
+    for (t = 0; t < num_threads; t++) {
+        runs[t].func = benchmarks[b].func;
+        runs[t].iters = per_thread;
+        pthread_create(&threads[t], NULL, run_thread, &runs[t]);
+    }
+    start = now_ns();
+    go = 1;
+    for (t = 0; t < num_threads; t++)
+        pthread_join(threads[t], NULL);
+    snprintf(name, sizeof(name), "%s.t%d", benchmarks[b].name, num_threads);
+    printf("bench,%s,%ld,%.1f\n", name, per_thread * num_threads,
+           (now_ns() - start) / (per_thread * num_threads));
+    fflush(stdout);
+}
+
+static int
+parse_threads(char *arg)
+{
+    char *tok;
+    num_thread_counts = 0;
+    for (tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        int count = atoi(tok);
+        if (count < 1 || count > MAX_THREADS || num_thread_counts == MAX_THREADS)
+            return 0;
+        thread_counts[num_thread_counts++] = count;
+    }
+    return num_thread_counts > 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int i, first = 1, t;
+    size_t b;
+    while (first + 1 < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-scale") == 0) {
+            scale = atoi(argv[first + 1]);
+            if (scale < 1)
+                scale = 1;
+        } else if (strcmp(argv[first], "-threads") == 0) {
+            if (!parse_threads(argv[first + 1])) {
+                fprintf(stderr, "-threads takes a list of 1 to %d\n", MAX_THREADS);
+                return 1;
+            }
+        } else
+            break;
+        first += 2;
+    }
+    for (b = 0; b < NUM_BENCHMARKS; b++) {
+        if (first < argc) {
+            for (i = first; i < argc; i++) {
+                if (strcmp(argv[i], benchmarks[b].name) == 0)
+                    break;
+            }
+            if (i == argc)
+                continue;
+        }
+        for (t = 0; t < num_thread_counts; t++)
+            run_benchmark(b, thread_counts[t]);
+    }
+    return 0;
+}
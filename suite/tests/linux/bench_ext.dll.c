@@ -0,0 +1,245 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Client for the bench_ext app, which the run_bench_ext target runs once per
+ * mode to measure what each extension library costs:
+ *   -wrap             drwrap_wrap() bench_ext_wrapped() with empty callbacks
+ *   -counter          drx_insert_counter_update() at the top of each block
+ *   -counter_lock     the same with DRX_COUNTER_LOCK
+ *   -counter_sharded  drx_insert_sharded_counter_update() instead
+ *   -drreg <N>        at each memory reference, drreg reserves the arithmetic
+ *                     flags and N registers and writes them
+ * Only blocks in the app's executable are instrumented.  At exit the client
+ * prints, in the app's "bench,<name>,<count>,<value>" format, the number of
+ * instructions it inserted per block and per app instruction and the number
+ * of those that are register spills or restores, per block.
+ */
+
+#include "dr_api.h"
+#include "drmgr.h"
+#include "drreg.h"
+#include "drwrap.h"
+#include "drx.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(x, msg) do {               \
+    if (!(x)) {                          \
+        dr_fprintf(STDERR, "%s\n", msg); \
+        dr_abort();                      \
+    }                                    \
+} while (0)
+
+static bool wrap;
+static bool counter;
+static bool counter_lock;
+static bool counter_sharded;
+static uint drreg_regs;
+
+static app_pc exe_start, exe_end;
+static uint64 block_count;
+static drx_sharded_counter_t *sharded;
+
+static int num_blocks;
+static int num_app_instrs;
+static int num_inserted;
+static int num_spills;
+
+static void
+wrap_pre(void *wrapcxt, OUT void **user_data)
+{
+}
+
+static void
+wrap_post(void *wrapcxt, void *user_data)
+{
+}
+
+static dr_emit_flags_t
+event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
+                      bool for_trace, bool translating, void *user_data)
+{
+    if ((app_pc)tag < exe_start || (app_pc)tag >= exe_end)
+        return DR_EMIT_DEFAULT;
+    if (drmgr_is_first_instr(drcontext, inst)) {
+        if (counter_sharded) {
+            CHECK(drx_insert_sharded_counter_update(drcontext, sharded, bb, inst,
+                                                    SPILL_SLOT_1, SPILL_SLOT_2, 0, 1),
+                  "sharded counter update failed");
+        } else if (counter) {
+            CHECK(drx_insert_counter_update(drcontext, bb, inst, SPILL_SLOT_1,
+                                            IF_ARM_(SPILL_SLOT_2) &block_count, 1,
+                                            DRX_COUNTER_64BIT |
+                                            (counter_lock ? DRX_COUNTER_LOCK : 0)),
+                  "counter update failed");
+        }
+    }
+    if (drreg_regs > 0 && instr_is_app(inst) &&
+        (instr_reads_memory(inst) || instr_writes_memory(inst))) {
+        reg_id_t regs[DR_NUM_GPR_REGS];
+        uint i;
+        CHECK(drreg_reserve_aflags(drcontext, bb, inst) == DRREG_SUCCESS,
+              "reserve aflags failed");
+        for (i = 0; i < drreg_regs; i++) {
+            CHECK(drreg_reserve_register(drcontext, bb, inst, NULL, &regs[i]) ==
+                  DRREG_SUCCESS, "reserve register failed");
+            instrlist_meta_preinsert(bb, inst, XINST_CREATE_load_int
+                                     (drcontext, opnd_create_reg(regs[i]),
+                                      OPND_CREATE_INT32(i)));
+        }
+        /* Clobber the flags too. */
+        instrlist_meta_preinsert(bb, inst, XINST_CREATE_add
+                                 (drcontext, opnd_create_reg(regs[0]),
+                                  OPND_CREATE_INT32(1)));
+        for (i = 0; i < drreg_regs; i++) {
+            CHECK(drreg_unreserve_register(drcontext, bb, inst, regs[i]) ==
+                  DRREG_SUCCESS, "unreserve register failed");
+        }
+        CHECK(drreg_unreserve_aflags(drcontext, bb, inst) == DRREG_SUCCESS,
+              "unreserve aflags failed");
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+/* Runs after every other pass, including drx's merging and drreg's
+ * restores, to count what ends up in the block.
+ */
+static dr_emit_flags_t
+event_bb_count(void *drcontext, void *tag, instrlist_t *bb, bool for_trace,
+               bool translating)
+{
+    instr_t *inst;
+    int app = 0, inserted = 0, spills = 0;
+    bool tls, spill;
+    reg_id_t reg;
+    uint offs;
+    if (translating || (app_pc)tag < exe_start || (app_pc)tag >= exe_end)
+        return DR_EMIT_DEFAULT;
+    for (inst = instrlist_first(bb); inst != NULL; inst = instr_get_next(inst)) {
+        if (instr_is_app(inst))
+            app++;
+        else if (!instr_is_label(inst)) {
+            inserted++;
+            if (instr_is_reg_spill_or_restore(drcontext, inst, &tls, &spill, &reg,
+                                              &offs))
+                spills++;
+        }
+    }
+    dr_atomic_add32_return_sum(&num_blocks, 1);
+    dr_atomic_add32_return_sum(&num_app_instrs, app);
+    dr_atomic_add32_return_sum(&num_inserted, inserted);
+    dr_atomic_add32_return_sum(&num_spills, spills);
+    return DR_EMIT_DEFAULT;
+}
+
+/* Prints num/denom with two decimal places. */
+static void
+report(const char *name, int count, int num, int denom)
+{
+    uint hundredths = denom == 0 ? 0 : (uint)((uint64)num * 100 / denom);
+    dr_printf("bench,%s,%d,%u.%02u\n", name, count, hundredths / 100, hundredths % 100);
+}
+
+static void
+event_exit(void)
+{
+    report("inserted_per_block", num_blocks, num_inserted, num_blocks);
+    report("inserted_per_app_instr", num_app_instrs, num_inserted, num_app_instrs);
+    report("spills_per_block", num_blocks, num_spills, num_blocks);
+    if (drreg_regs > 0) {
+        uint max;
+        CHECK(drreg_max_slots_used(&max) == DRREG_SUCCESS, "drreg query failed");
+        dr_printf("bench,drreg_max_slots,1,%u\n", max);
+    }
+    if (counter_sharded)
+        CHECK(drx_sharded_counter_free(sharded), "sharded counter free failed");
+    if (wrap)
+        drwrap_exit();
+    if (drreg_regs > 0)
+        CHECK(drreg_exit() == DRREG_SUCCESS, "drreg exit failed");
+    drx_exit();
+    drmgr_exit();
+}
+
+DR_EXPORT void
+dr_client_main(client_id_t id, int argc, const char *argv[])
+{
+    drmgr_priority_t count_pri = { sizeof(count_pri), "bench_ext.count", NULL, NULL,
+                                   DRMGR_PRIORITY_INSTRU2INSTRU_DRX_MERGE + 1 };
+    module_data_t *exe;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-wrap") == 0)
+            wrap = true;
+        else if (strcmp(argv[i], "-counter") == 0)
+            counter = true;
+        else if (strcmp(argv[i], "-counter_lock") == 0)
+            counter = counter_lock = true;
+        else if (strcmp(argv[i], "-counter_sharded") == 0)
+            counter_sharded = true;
+        else if (strcmp(argv[i], "-drreg") == 0 && i + 1 < argc)
+            drreg_regs = (uint)atoi(argv[++i]);
+        else
+            CHECK(false, "usage: [-wrap] [-counter[_lock|_sharded]] [-drreg <N>]");
+    }
+    CHECK(drreg_regs < DR_NUM_GPR_REGS, "-drreg asks for too many registers");
+
+    CHECK(drmgr_init() && drx_init(), "init failed");
+    if (drreg_regs > 0) {
+        /* One slot per register plus one for the flags. */
+        drreg_options_t ops = { sizeof(ops), drreg_regs + 1, false };
+        CHECK(drreg_init(&ops) == DRREG_SUCCESS, "drreg init failed");
+    }
+    if (counter_sharded) {
+        sharded = drx_sharded_counter_create(1);
+        CHECK(sharded != NULL, "sharded counter create failed");
+    }
+
+    exe = dr_get_main_module();
+    CHECK(exe != NULL, "no main module");
+    exe_start = exe->start;
+    exe_end = exe->end;
+    if (wrap) {
+        app_pc func = (app_pc) dr_get_proc_address(exe->handle, "bench_ext_wrapped");
+        CHECK(drwrap_init(), "drwrap init failed");
+        CHECK(func != NULL, "bench_ext_wrapped not exported");
+        CHECK(drwrap_wrap(func, wrap_pre, wrap_post), "wrap failed");
+    }
+    dr_free_module_data(exe);
+
+    dr_register_exit_event(event_exit);
+    CHECK(drmgr_register_bb_instrumentation_event(NULL, event_app_instruction, NULL) &&
+          drmgr_register_bb_instru2instru_event(event_bb_count, &count_pri),
+          "event registration failed");
+}
@@ -0,0 +1,402 @@
+/* **********************************************************
+ * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Microbenchmarks of the cost of individual DR mechanisms.  Not a test: it is
+ * run natively, under DR and under DR with a client by runbench.cmake, via the
+ * run_bench_overhead target.
+ *
+ * Usage: bench_overhead [-scale N] [name ...]
+ * With no names every benchmark is run.  Each prints one line:
+ *   bench,<name>,<iterations>,<nanoseconds per iteration>
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define NOINLINE __attribute__((noinline))
+
+static int scale = 1;
+static const char *self_path;
+static volatile int sink;
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+report(const char *name, long iters, double start)
+{
+    printf("bench,%s,%ld,%.1f\n", name, iters, (now_ns() - start) / iters);
+    fflush(stdout);
+}
+
+/***************************************************************************
+ * Indirect branches
+ */
+
+#define NUM_TARGETS 64
+
+#define TARGET(n) static NOINLINE int target##n(int x) { return x + n; }
+#define TARGETS8(n) TARGET(n##0) TARGET(n##1) TARGET(n##2) TARGET(n##3) \
+    TARGET(n##4) TARGET(n##5) TARGET(n##6) TARGET(n##7)
+TARGETS8(1) TARGETS8(2) TARGETS8(3) TARGETS8(4)
+TARGETS8(5) TARGETS8(6) TARGETS8(7) TARGETS8(8)
+
+#define ADDR8(n) target##n##0, target##n##1, target##n##2, target##n##3, \
+    target##n##4, target##n##5, target##n##6, target##n##7
+static int (* volatile targets[NUM_TARGETS])(int) = {
+    ADDR8(1), ADDR8(2), ADDR8(3), ADDR8(4), ADDR8(5), ADDR8(6), ADDR8(7), ADDR8(8)
+};
+
+static void
+bench_ibl_mono(void)
+{
+    long i, iters = 20000000L * scale;
+    int x = 0;
+    double start = now_ns();
+    for (i = 0; i < iters; i++)
+        x = targets[0](x);
+    sink = x;
+    report("ibl_mono", iters, start);
+}
+
+static void
+bench_ibl_mega(void)
+{
+    long i, iters = 20000000L * scale;
+    int x = 0;
+    double start = now_ns();
+    /* a stride co-prime with NUM_TARGETS defeats the hardware predictor too */
+    for (i = 0; i < iters; i++)
+        x = targets[(i * 7) % NUM_TARGETS](x);
+    sink = x;
+    report("ibl_mega", iters, start);
+}
+
+static NOINLINE int
+recurse(int depth)
+{
+    int res;
+    if (depth == 0)
+        return 0;
+    res = recurse(depth - 1);
+    /* keep the compiler from turning the recursion into a loop */
+    __asm__ __volatile__("" : "+r"(res));
+    return res + 1;
+}
+
+static void
+bench_return(void)
+{
+    long i, iters = 2000000L * scale;
+    double start = now_ns();
+    for (i = 0; i < iters; i++)
+        sink = recurse(16);
+    /* per return */
+    report("return", iters * 17, start);
+}
+
+static NOINLINE int
+dispatch_switch(int op, int x)
+{
+    switch (op) {
+    case 0: return x + 3;
+    case 1: return x ^ 5;
+    case 2: return x - 7;
+    case 3: return x * 3;
+    case 4: return x | 9;
+    case 5: return x & 0xff;
+    case 6: return x << 1;
+    case 7: return x >> 1;
+    case 8: return x + 11;
+    case 9: return x ^ 13;
+    case 10: return x - 17;
+    case 11: return x * 5;
+    case 12: return x | 19;
+    case 13: return x & 0xfff;
+    case 14: return x << 2;
+    default: return x >> 2;
+    }
+}
+
+static void
+bench_switch(void)
+{
+    long i, iters = 20000000L * scale;
+    int x = 1;
+    double start = now_ns();
+    for (i = 0; i < iters; i++)
+        x = dispatch_switch((int)((i * 7) & 15), x);
+    sink = x;
+    report("switch", iters, start);
+}
+
+/***************************************************************************
+ * Kernel transitions
+ */
+
+static void
+bench_syscall(void)
+{
+    long i, iters = 1000000L * scale;
+    double start = now_ns();
+    for (i = 0; i < iters; i++)
+        syscall(SYS_getpid);
+    report("syscall", iters, start);
+}
+
+static volatile int signal_count;
+
+static void
+signal_handler(int sig)
+{
+    signal_count++;
+}
+
+static void
+bench_signal(void)
+{
+    long i, iters = 200000L * scale;
+    double start;
+    signal(SIGUSR1, signal_handler);
+    start = now_ns();
+    for (i = 0; i < iters; i++)
+        kill(getpid(), SIGUSR1);
+    report("signal", iters, start);
+    assert(signal_count == iters);
+    signal(SIGUSR1, SIG_DFL);
+}
+
+static void *
+thread_noop(void *arg)
+{
+    return arg;
+}
+
+static void
+bench_thread(void)
+{
+    long i, iters = 2000L * scale;
+    double start = now_ns();
+    for (i = 0; i < iters; i++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, thread_noop, NULL);
+        pthread_join(thread, NULL);
+    }
+    report("thread", iters, start);
+}
+
+static void
+bench_fork_exec(void)
+{
+    long i, iters = 20L * scale;
+    double start = now_ns();
+    for (i = 0; i < iters; i++) {
+        pid_t child = fork();
+        if (child == 0) {
+            execl(self_path, self_path, "noop", (char *) NULL);
+            _exit(1);
+        }
+        waitpid(child, NULL, 0);
+    }
+    report("fork_exec", iters, start);
+}
+
+/***************************************************************************
+ * Generated code: block building and flushing
+ */
+
+#if defined(__i386__) || defined(__x86_64__)
+/* "add eax,1; jz +0" is one block per 7 bytes: DR never elides a jcc */
+# define BLOCK_SIZE 7
+# define NUM_BLOCKS 16384
+
+static unsigned char *
+gencode(void)
+{
+    size_t size = NUM_BLOCKS * BLOCK_SIZE + 1;
+    unsigned char *code = mmap(NULL, size, PROT_READ|PROT_WRITE|PROT_EXEC,
+                               MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    unsigned char *pc = code;
+    int i;
+    assert(code != MAP_FAILED);
+    for (i = 0; i < NUM_BLOCKS; i++) {
+        static const unsigned char block[BLOCK_SIZE] =
+            { 0x05, 0x01, 0x00, 0x00, 0x00, 0x74, 0x00 };
+        memcpy(pc, block, BLOCK_SIZE);
+        pc += BLOCK_SIZE;
+    }
+    *pc = 0xc3; /* ret */
+    return code;
+}
+
+static void
+freecode(unsigned char *code)
+{
+    munmap(code, NUM_BLOCKS * BLOCK_SIZE + 1);
+}
+
+static void
+bench_bb_build(void)
+{
+    long i, iters = 20L * scale;
+    double total = 0;
+    for (i = 0; i < iters; i++) {
+        /* fresh code each round, so DR cannot reuse anything it built */
+        unsigned char *code = gencode();
+        double start = now_ns();
+        sink = ((int (*)(void)) code)();
+        total += now_ns() - start;
+        freecode(code);
+    }
+    printf("bench,bb_build,%ld,%.1f\n", iters * NUM_BLOCKS,
+           total / (iters * NUM_BLOCKS));
+    fflush(stdout);
+}
+
+static volatile int spinners_stop;
+
+static void *
+spinner(void *arg)
+{
+    int x = 0;
+    while (!spinners_stop)
+        x = targets[x & (NUM_TARGETS - 1)](x);
+    return (void *)(long) x;
+}
+
+/* Each round executes code from a region and then unmaps it, which under DR
+ * flushes the region while the spinner threads are in the cache.
+ */
+static void
+bench_flush(int num_threads)
+{
+    pthread_t threads[8];
+    long i, iters = 200L * scale;
+    double total = 0;
+    char name[32];
+    int t;
+    assert(num_threads <= sizeof(threads)/sizeof(threads[0]));
+    spinners_stop = 0;
+    for (t = 0; t < num_threads; t++)
+        pthread_create(&threads[t], NULL, spinner, NULL);
+    for (i = 0; i < iters; i++) {
+        unsigned char *code = gencode();
+        double start;
+        sink = ((int (*)(void)) code)();
+        start = now_ns();
+        freecode(code);
+        total += now_ns() - start;
+    }
+    spinners_stop = 1;
+    for (t = 0; t < num_threads; t++)
+        pthread_join(threads[t], NULL);
+    snprintf(name, sizeof(name), "flush_t%d", num_threads);
+    printf("bench,%s,%ld,%.1f\n", name, iters, total / iters);
+    fflush(stdout);
+}
+
+static void
+bench_flush_all(void)
+{
+    bench_flush(0);
+    bench_flush(1);
+    bench_flush(2);
+    bench_flush(4);
+    bench_flush(8);
+}
+#endif
+
+/***************************************************************************/
+
+static const struct {
+    const char *name;
+    void (*func)(void);
+} benchmarks[] = {
+    { "ibl_mono", bench_ibl_mono },
+    { "ibl_mega", bench_ibl_mega },
+    { "return", bench_return },
+    { "switch", bench_switch },
+    { "syscall", bench_syscall },
+    { "signal", bench_signal },
+    { "thread", bench_thread },
+#if defined(__i386__) || defined(__x86_64__)
+    { "bb_build", bench_bb_build },
+    { "flush", bench_flush_all },
+#endif
+    { "fork_exec", bench_fork_exec },
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks)/sizeof(benchmarks[0]))
+
+int
+main(int argc, char **argv)
+{
+    int i, first = 1;
+    size_t b;
+    self_path = argv[0];
+    if (argc > 1 && strcmp(argv[1], "noop") == 0)
+        return 0; /* the exec target of fork_exec */
+    if (argc > 2 && strcmp(argv[1], "-scale") == 0) {
+        scale = atoi(argv[2]);
+        if (scale < 1)
+            scale = 1;
+        first = 3;
+    }
+    for (b = 0; b < NUM_BENCHMARKS; b++) {
+        if (first < argc) {
+            for (i = first; i < argc; i++) {
+                if (strcmp(argv[i], benchmarks[b].name) == 0)
+                    break;
+            }
+            if (i == argc)
+                continue;
+        }
+        benchmarks[b].func();
+    }
+    return 0;
+}
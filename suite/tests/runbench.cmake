@@ -0,0 +1,87 @@
+# **********************************************************
+# Copyright (c) 2015 Google, Inc.    All rights reserved.
+# **********************************************************
+
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# * Redistributions of source code must retain the above copyright notice,
+#   this list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright notice,
+#   this list of conditions and the following disclaimer in the documentation
+#   and/or other materials provided with the distribution.
+#
+# * Neither the name of Google, Inc. nor the names of its contributors may be
+#   used to endorse or promote products derived from this software without
+#   specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+# DAMAGE.
+
+
+# Runs linux/bench_overhead.c or linux/bench_ext.c natively, under DR and
+# under DR with a client, and collects its results into one CSV file.
+#
+# input:
+# * drrun = path to drrun
+# * app = path to the benchmark executable
+# * client = path to a client library, or empty to skip that configuration
+# * client_ops = client arguments, ;-separated
+# * dr_ops = extra DR options, ;-separated
+# * app_ops = benchmark arguments (names, -scale), ;-separated
+# * out = CSV file to write: mode,name,iterations,ns_per_iteration
+
+set(modes native dr)
+set(native_cmd ${app} ${app_ops})
+set(dr_cmd ${drrun} ${dr_ops} -- ${app} ${app_ops})
+if (NOT "${client}" STREQUAL "")
+  set(modes ${modes} dr_client)
+  set(dr_client_cmd ${drrun} ${dr_ops} -c ${client} ${client_ops} -- ${app} ${app_ops})
+endif ()
+
+set(csv "mode,name,iterations,ns_per_iteration\n")
+foreach (mode ${modes})
+  message(STATUS "Running ${mode}: ${${mode}_cmd}")
+  execute_process(COMMAND ${${mode}_cmd}
+    RESULT_VARIABLE cmd_result
+    ERROR_VARIABLE cmd_err
+    OUTPUT_VARIABLE cmd_out)
+  if (cmd_result)
+    message(FATAL_ERROR "*** ${${mode}_cmd} failed (${cmd_result}): ${cmd_err}***\n")
+  endif (cmd_result)
+  string(REGEX MATCHALL "bench,[^\n]*" lines "${cmd_out}")
+  foreach (line ${lines})
+    string(REGEX REPLACE "^bench," "" line "${line}")
+    set(csv "${csv}${mode},${line}\n")
+    # remember native numbers to report the slowdown
+    string(REGEX REPLACE "^([^,]*),[^,]*,([^,]*)$" "\\1;\\2" fields "${line}")
+    list(GET fields 0 name)
+    list(GET fields 1 ns)
+    if (mode STREQUAL "native")
+      set(native_${name} ${ns})
+    elseif (DEFINED native_${name})
+      # CMake math is integer-only: drop the point to work in tenths of a ns
+      string(REPLACE "." "" ns_int "${ns}")
+      string(REPLACE "." "" native_int "${native_${name}}")
+      if (native_int GREATER 0)
+        math(EXPR pct "${ns_int} * 100 / ${native_int}")
+        message(STATUS "  ${name}: ${ns} ns (${pct}% of native)")
+      else ()
+        message(STATUS "  ${name}: ${ns} ns")
+      endif ()
+    endif ()
+  endforeach (line)
+endforeach (mode)
+
+file(WRITE "${out}" "${csv}")
+message(STATUS "Results written to ${out}")
@@ -0,0 +1,188 @@
+/* **********************************************************
+ * Copyright (c) 2016 Google, Inc.    All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of VMware, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * drstatsunix.c: samples the global statistics of a Linux process running
+ * under DR with -stats_shmem, without stopping or restarting it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "configure.h"
+#include "globals_shared.h"
+#include "dr_stats.h"
+
+static const char *usage_str =
+    "usage: drstatsunix [-help] [-v] -pid <pid> [-interval <secs>] [-count <n>]\n"
+    "                   [-filter <substr>] [-nonzero]\n"
+    "       -help              Display this usage information\n"
+    "       -v                 Display version information\n"
+    "       -pid <pid>         Read the statistics of the process with id <pid>,\n"
+    "                          which must be running with -stats_shmem\n"
+    "       -interval <secs>   Re-sample every <secs> seconds (default: once)\n"
+    "       -count <n>         Stop after <n> samples (default: until the target exits)\n"
+    "       -filter <substr>   Only show stats whose name contains <substr>\n"
+    "       -nonzero           Only show stats with a non-zero value\n"
+;
+static int
+usage(void)
+{
+    fprintf(stderr, "%s", usage_str);
+    return 1;
+}
+
+static void
+print_stats(const dr_statistics_t *drstats, const char *filter, bool nonzero)
+{
+    uint i;
+    printf("Process %d (%s): %u stats\n", drstats->process_id,
+           drstats->process_name, drstats->num_stats);
+    for (i = 0; i < drstats->num_stats; i++) {
+        const single_stat_t *stat = &drstats->stats[i];
+        if (filter != NULL && strstr(stat->name, filter) == NULL)
+            continue;
+        if (nonzero && stat->value == 0)
+            continue;
+#ifdef X64
+        printf("%*.*s : %18lld\n", STAT_NAME_MAX_LEN, STAT_NAME_MAX_LEN,
+               stat->name, (long long) stat->value);
+#else
+        printf("%*.*s : %9d\n", STAT_NAME_MAX_LEN, STAT_NAME_MAX_LEN,
+               stat->name, stat->value);
+#endif
+    }
+    fflush(stdout);
+}
+
+int
+main(int argc, const char *argv[])
+{
+    process_id_t target_pid = 0;
+    uint interval = 0;
+    int count = -1;
+    const char *filter = NULL;
+    bool nonzero = false;
+    int arg_offs = 1;
+    char name[MAXIMUM_PATH];
+    struct stat st;
+    int fd;
+    dr_statistics_t *drstats;
+
+    /* parse command line */
+    if (argc <= 1)
+        return usage();
+    while (arg_offs < argc && argv[arg_offs][0] == '-') {
+        if (strcmp(argv[arg_offs], "-help") == 0) {
+            return usage();
+        } else if (strcmp(argv[arg_offs], "-v") == 0) {
+            printf("drstatsunix version %s -- build %d\n",
+                   STRINGIFY(VERSION_NUMBER), BUILD_NUMBER);
+            exit(0);
+        } else if (strcmp(argv[arg_offs], "-pid") == 0) {
+            if (argc <= arg_offs+1)
+                return usage();
+            target_pid = strtoul(argv[arg_offs+1], NULL, 10);
+            arg_offs += 2;
+        } else if (strcmp(argv[arg_offs], "-interval") == 0) {
+            if (argc <= arg_offs+1)
+                return usage();
+            interval = strtoul(argv[arg_offs+1], NULL, 10);
+            arg_offs += 2;
+        } else if (strcmp(argv[arg_offs], "-count") == 0) {
+            if (argc <= arg_offs+1)
+                return usage();
+            count = strtol(argv[arg_offs+1], NULL, 10);
+            arg_offs += 2;
+        } else if (strcmp(argv[arg_offs], "-filter") == 0) {
+            if (argc <= arg_offs+1)
+                return usage();
+            filter = argv[arg_offs+1];
+            arg_offs += 2;
+        } else if (strcmp(argv[arg_offs], "-nonzero") == 0) {
+            nonzero = true;
+            arg_offs++;
+        } else
+            return usage();
+    }
+    if (arg_offs < argc || target_pid == 0)
+        return usage();
+
+    snprintf(name, sizeof(name), "%s/%s%d", STATS_SHMEM_DIR, STATS_SHMEM_PREFIX,
+             target_pid);
+    name[sizeof(name)-1] = '\0';
+    fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: unable to open %s: is the target running with "
+                "-stats_shmem?\n", name);
+        return 1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(dr_statistics_t)) {
+        fprintf(stderr, "ERROR: %s is not a statistics segment\n", name);
+        close(fd);
+        return 1;
+    }
+    /* the segment holds num_stats entries past the fixed-size header */
+    drstats = (dr_statistics_t *) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (drstats == (dr_statistics_t *) MAP_FAILED) {
+        fprintf(stderr, "ERROR: unable to map %s\n", name);
+        return 1;
+    }
+    if (strncmp(drstats->magicstring, DYNAMORIO_MAGIC_STRING,
+                DYNAMORIO_MAGIC_STRING_LEN - 1) != 0 ||
+        offsetof(dr_statistics_t, stats) + drstats->num_stats * sizeof(single_stat_t) >
+        (size_t) st.st_size) {
+        fprintf(stderr, "ERROR: %s does not match this version\n", name);
+        munmap(drstats, st.st_size);
+        return 1;
+    }
+
+    while (true) {
+        print_stats(drstats, filter, nonzero);
+        if (interval == 0 || (count > 0 && --count == 0))
+            break;
+        sleep(interval);
+        /* once the target exits it removes the segment */
+        if (access(name, F_OK) != 0)
+            break;
+        printf("\n");
+    }
+    munmap(drstats, st.st_size);
+    return 0;
+}